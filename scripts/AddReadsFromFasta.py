@@ -7,7 +7,7 @@ import sys
 # Read the config file.
 config = GetConfig.getConfig()
 
-helpMessage = "Invoke with one argument, the name of the Fasta file."
+helpMessage = "Invoke with one argument, the name of the Fasta or Fastq file (optionally gzip or bgzip compressed)."
 
 if not len(sys.argv)==2:
     print(helpMessage)
@@ -31,7 +31,10 @@ a.assembleMarkerGraphEdges(
     markerGraphEdgeLengthThresholdForConsensus =
     int(config['Assembly']['markerGraphEdgeLengthThresholdForConsensus']),
     useMarginPhase = useMarginPhase,
-    storeCoverageData = ast.literal_eval(config['Assembly']['storeCoverageData']))
+    storeCoverageData = ast.literal_eval(config['Assembly']['storeCoverageData']),
+    starAlignmentLengthThreshold =
+    int(config['Assembly'].get('starAlignmentLengthThreshold', '0')),
+    useGpuConsensus = ast.literal_eval(config['Assembly'].get('useGpuConsensus', 'False')))
 
 
 
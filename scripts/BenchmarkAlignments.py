@@ -0,0 +1,40 @@
+#!/usr/bin/python3
+
+import shasta
+import GetConfig
+import sys
+
+helpMessage = """
+Compare the alignment graph and chaining alignment methods
+on the alignment candidates, using the [Align] parameters
+in the config file.
+
+Invoke with one optional argument, the number of alignment
+candidates to use. If omitted, all candidates are used.
+"""
+
+# Get the arguments.
+if len(sys.argv) > 2:
+    print(helpMessage)
+    exit(1)
+candidateCount = 0
+if len(sys.argv) == 2:
+    candidateCount = int(sys.argv[1])
+
+# Read the config file.
+config = GetConfig.getConfig()
+
+# Initialize the assembler and access what we need.
+a = shasta.Assembler()
+a.accessKmers()
+a.accessMarkers()
+a.accessAlignmentCandidates()
+
+# Do the computation.
+a.benchmarkAlignments(
+    maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
+    maxSkip = int(config['Align']['maxSkip']),
+    minAlignedMarkerCount = int(config['Align']['minAlignedMarkerCount']),
+    maxTrim = int(config['Align']['maxTrim']),
+    candidateCount = candidateCount)
+
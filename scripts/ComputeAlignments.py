@@ -2,6 +2,7 @@
 
 import shasta
 import GetConfig
+import ast
 import sys
 
 # Read the config file.
@@ -18,5 +19,10 @@ a.computeAlignments(
     maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
     maxSkip = int(config['Align']['maxSkip']),
     minAlignedMarkerCount = int(config['Align']['minAlignedMarkerCount']),
-    maxTrim = int(config['Align']['maxTrim']))
+    maxTrim = int(config['Align']['maxTrim']),
+    bandWidth = int(config['Align']['bandWidth']),
+    alignMethod = int(config['Align']['alignMethod']),
+    storeAlignments = ast.literal_eval(config['Align']['storeAlignments']),
+    groupCandidates = ast.literal_eval(config['Align'].get('groupCandidates', 'False')),
+    maxAlignmentGraphEdgeCount = int(config['Align'].get('maxAlignmentGraphEdgeCount', '0')))
 
@@ -0,0 +1,44 @@
+#!/usr/bin/python3
+
+import shasta
+import GetConfig
+import ast
+import sys
+
+# Computes alignments for one shard of the alignment candidates.
+# This can run on any machine that sees the Data directory
+# via a shared filesystem. When all shards are done,
+# use MergeAlignmentShards.py to combine them.
+helpMessage = """
+Invoke with two arguments: shardId shardCount.
+Shards are numbered 0 through shardCount-1.
+"""
+
+# Get the arguments.
+if not len(sys.argv) == 3:
+    print(helpMessage)
+    exit(1)
+shardId = int(sys.argv[1])
+shardCount = int(sys.argv[2])
+
+# Read the config file.
+config = GetConfig.getConfig()
+
+# Initialize the assembler and access what we need.
+a = shasta.Assembler()
+a.accessKmers()
+a.accessMarkers()
+a.accessAlignmentCandidates()
+
+# Do the computation.
+a.computeAlignmentsShard(
+    shardId = shardId,
+    shardCount = shardCount,
+    maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
+    maxSkip = int(config['Align']['maxSkip']),
+    minAlignedMarkerCount = int(config['Align']['minAlignedMarkerCount']),
+    maxTrim = int(config['Align']['maxTrim']),
+    bandWidth = int(config['Align']['bandWidth']),
+    alignMethod = int(config['Align']['alignMethod']),
+    storeAlignments = ast.literal_eval(config['Align']['storeAlignments']),
+    maxAlignmentGraphEdgeCount = int(config['Align'].get('maxAlignmentGraphEdgeCount', '0')))
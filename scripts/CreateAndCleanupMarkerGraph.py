@@ -2,6 +2,7 @@
 
 import shasta
 import GetConfig
+import ast
 import sys
 
 # Read the config file.
@@ -12,6 +13,8 @@ a = shasta.Assembler()
 a.accessKmers()
 a.accessMarkers()
 a.accessAlignmentData()
+if ast.literal_eval(config['Align']['storeAlignments']):
+    a.accessCompressedAlignments()
 a.accessReadGraph()
 a.accessChimericReadsFlags()
 
@@ -20,7 +23,10 @@ a.createMarkerGraphVertices(
     maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
     maxSkip = int(config['Align']['maxSkip']),
     minCoverage = int(config['MarkerGraph']['minCoverage']),
-    maxCoverage = int(config['MarkerGraph']['maxCoverage']))
+    maxCoverage = int(config['MarkerGraph']['maxCoverage']),
+    unionBufferSize = int(config['MarkerGraph']['unionBufferSize']),
+    outOfCorePartitionCount = int(config['MarkerGraph']['outOfCorePartitionCount']),
+    storeDisjointSetTable = ast.literal_eval(config['MarkerGraph'].get('storeDisjointSetTable', 'False')))
 
 # Create edges of the marker graph.
 a.createMarkerGraphEdges()
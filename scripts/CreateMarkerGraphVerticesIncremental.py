@@ -0,0 +1,43 @@
+#!/usr/bin/python3
+
+import shasta
+import GetConfig
+import ast
+import sys
+
+helpMessage="""
+This updates the marker graph vertices after reads are added,
+following a previous call to CreateMarkerGraphVertices.py
+with MarkerGraph.storeDisjointSetTable = True.
+Only the read graph edges involving new reads are processed.
+The markers must have been recomputed for all reads, using the same k-mers,
+and the read graph must have been recomputed.
+Marker graph edges and all later stages must be recomputed after this.
+
+Invoke without arguments.
+"""
+
+# Check that there are no arguments.
+if not len(sys.argv)==1:
+    print(helpMessage)
+    exit(1)
+    
+# Read the config file.
+config = GetConfig.getConfig()
+
+# Initialize the assembler and access what we need.
+a = shasta.Assembler()
+a.accessKmers()
+a.accessMarkers()
+a.accessAlignmentData()
+if ast.literal_eval(config['Align']['storeAlignments']):
+    a.accessCompressedAlignments()
+a.accessReadGraph()
+a.accessReadFlags()
+
+# Do the computation.
+a.createMarkerGraphVerticesIncremental(
+    maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
+    maxSkip = int(config['Align']['maxSkip']),
+    minCoverage = int(config['MarkerGraph']['minCoverage']),
+    maxCoverage = int(config['MarkerGraph']['maxCoverage']))
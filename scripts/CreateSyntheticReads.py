@@ -0,0 +1,70 @@
+#!/usr/bin/python3
+
+import random
+import sys
+
+helpMessage = """
+Create a synthetic data set for benchmarking:
+a random genome, and reads sampled from both strands of it,
+with random substitutions, insertions and deletions.
+The same arguments always create the same reads.
+
+Invoke with 5 or 6 arguments:
+- The genome length in bases.
+- The coverage.
+- The average read length. Read lengths are exponentially distributed,
+  with a minimum of one tenth of the average.
+- The error rate (for example 0.1). Errors are divided equally
+  between substitutions, insertions and deletions.
+- The name of the output FASTA file.
+- Optionally, the random seed (default 231).
+"""
+
+if not len(sys.argv) in (6, 7):
+    print(helpMessage)
+    exit(1)
+
+genomeLength = int(sys.argv[1])
+coverage = float(sys.argv[2])
+averageReadLength = int(sys.argv[3])
+errorRate = float(sys.argv[4])
+fileName = sys.argv[5]
+seed = int(sys.argv[6]) if len(sys.argv) == 7 else 231
+
+random.seed(seed)
+bases = 'ACGT'
+complement = str.maketrans('ACGT', 'TGCA')
+genome = ''.join(random.choice(bases) for i in range(genomeLength))
+minReadLength = averageReadLength // 10
+
+def addErrors(sequence):
+    output = []
+    for base in sequence:
+        r = random.random()
+        if r >= errorRate:
+            output.append(base)
+        elif r < errorRate / 3.:
+            output.append(random.choice(bases.replace(base, '')))
+        elif r < 2. * errorRate / 3.:
+            output.append(base)
+            output.append(random.choice(bases))
+        # Otherwise this is a deletion.
+    return ''.join(output)
+
+totalLength = 0
+readId = 0
+with open(fileName, 'w') as fasta:
+    while totalLength < coverage * genomeLength:
+        length = min(genomeLength, minReadLength + int(random.expovariate(
+            1. / (averageReadLength - minReadLength))))
+        begin = random.randint(0, genomeLength - length)
+        read = genome[begin : begin + length]
+        strand = random.randint(0, 1)
+        if strand == 1:
+            read = read.translate(complement)[::-1]
+        read = addErrors(read)
+        fasta.write('>read%i position=%i strand=%i\n%s\n' % (readId, begin, strand, read))
+        totalLength += len(read)
+        readId += 1
+
+print('Wrote %i reads with %i bases to %s.' % (readId, totalLength, fileName))
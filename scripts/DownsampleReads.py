@@ -0,0 +1,44 @@
+#!/usr/bin/python3
+
+import hashlib
+import sys
+
+helpMessage = """
+Downsample a FASTA file for benchmarking, keeping a given fraction
+of the reads. Whether a read is kept only depends on its name,
+so the result is reproducible and does not depend on the order
+of the reads.
+
+Invoke with 3 arguments:
+- The name of the input FASTA file (not compressed).
+- The fraction of reads to keep (for example 0.1).
+- The name of the output FASTA file.
+"""
+
+if not len(sys.argv) == 4:
+    print(helpMessage)
+    exit(1)
+
+inputFileName = sys.argv[1]
+fraction = float(sys.argv[2])
+outputFileName = sys.argv[3]
+
+def isKept(header):
+    name = header[1:].split()[0] if len(header) > 1 else ''
+    hash = int.from_bytes(hashlib.md5(name.encode()).digest()[:8], 'little')
+    return hash < fraction * 2.**64
+
+inputReadCount = 0
+outputReadCount = 0
+keep = False
+with open(inputFileName) as input, open(outputFileName, 'w') as output:
+    for line in input:
+        if line.startswith('>'):
+            inputReadCount += 1
+            keep = isKept(line.rstrip())
+            if keep:
+                outputReadCount += 1
+        if keep:
+            output.write(line)
+
+print('Kept %i of %i reads.' % (outputReadCount, inputReadCount))
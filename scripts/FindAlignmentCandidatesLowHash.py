@@ -2,6 +2,7 @@
 
 import shasta
 import GetConfig
+import ast
 import sys
 
 helpMessage="""
@@ -29,5 +30,14 @@ a.findAlignmentCandidatesLowHash(
     hashFraction = float(config['MinHash']['hashFraction']),
     minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
     maxBucketSize = int(config['MinHash']['maxBucketSize']),
-    minFrequency = int(config['MinHash']['minFrequency']))
+    minFrequency = int(config['MinHash']['minFrequency']),
+    lowHashMethod = int(config['MinHash']['lowHashMethod']),
+    candidateTableMegabytes = int(config['MinHash']['candidateTableMegabytes']),
+    singlePassHashing = ast.literal_eval(config['MinHash']['singlePassHashing']),
+    storeSketches = ast.literal_eval(config['MinHash']['storeSketches']),
+    targetCandidatesPerRead = float(config['MinHash']['targetCandidatesPerRead']),
+    maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
+    maxSkip = int(config['Align']['maxSkip']),
+    minAlignedMarkerCount = int(config['Align']['minAlignedMarkerCount']),
+    maxTrim = int(config['Align']['maxTrim']))
 
@@ -0,0 +1,38 @@
+#!/usr/bin/python3
+
+import shasta
+import GetConfig
+import sys
+
+helpMessage="""
+This uses the LowHash method to find alignment candidates
+involving reads added after a previous call to FindAlignmentCandidatesLowHash.py
+with MinHash.storeSketches = True.
+The new candidates are merged with the existing ones.
+The markers must have been recomputed for all reads, using the same k-mers.
+
+Invoke without arguments.
+"""
+
+# Check that there are no arguments.
+if not len(sys.argv)==1:
+    print(helpMessage)
+    exit(1)
+    
+# Read the config file.
+config = GetConfig.getConfig()
+
+# Initialize the assembler and access what we need.
+a = shasta.Assembler()
+a.accessKmers()
+a.accessMarkers()
+a.accessAlignmentCandidates()
+a.accessLowHashSketches()
+
+# Do the computation.
+a.findAlignmentCandidatesLowHashIncremental(
+    maxBucketSize = int(config['MinHash']['maxBucketSize']),
+    minFrequency = int(config['MinHash']['minFrequency']),
+    lowHashMethod = int(config['MinHash']['lowHashMethod']),
+    candidateTableMegabytes = int(config['MinHash']['candidateTableMegabytes']))
+
@@ -0,0 +1,45 @@
+#!/usr/bin/python3
+
+import shasta
+import GetConfig
+import ast
+import sys
+
+helpMessage="""
+This uses the LowHash method to find alignment candidates
+for one shard of the range of low hash values.
+This can run on any machine that sees the Data directory
+via a shared filesystem. When all shards are done,
+use MergeLowHashShards.py to create the alignment candidates.
+
+Invoke with two arguments: shardId shardCount.
+Shards are numbered 0 through shardCount-1.
+"""
+
+# Get the arguments.
+if not len(sys.argv)==3:
+    print(helpMessage)
+    exit(1)
+shardId = int(sys.argv[1])
+shardCount = int(sys.argv[2])
+    
+# Read the config file.
+config = GetConfig.getConfig()
+
+# Initialize the assembler and access what we need.
+a = shasta.Assembler()
+a.accessKmers()
+a.accessMarkers()
+
+# Do the computation.
+a.findAlignmentCandidatesLowHashShard(
+    shardId = shardId,
+    shardCount = shardCount,
+    m = int(config['MinHash']['m']), 
+    hashFraction = float(config['MinHash']['hashFraction']),
+    minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
+    maxBucketSize = int(config['MinHash']['maxBucketSize']),
+    lowHashMethod = int(config['MinHash']['lowHashMethod']),
+    candidateTableMegabytes = int(config['MinHash']['candidateTableMegabytes']),
+    singlePassHashing = ast.literal_eval(config['MinHash']['singlePassHashing']))
+
@@ -22,11 +22,13 @@ config = GetConfig.getConfig()
 a = shasta.Assembler()
 a.accessKmers()
 a.accessMarkers()
+a.accessReadFlags()
 
 # Do the computation.
 a.findAlignmentCandidatesMinHash(
     m = int(config['MinHash']['m']), 
     minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
     maxBucketSize = int(config['MinHash']['maxBucketSize']),
-    minFrequency = int(config['MinHash']['minFrequency']))
+    minFrequency = int(config['MinHash']['minFrequency']),
+    sketchSize = int(config['MinHash'].get('sketchSize', '1')))
 
@@ -0,0 +1,25 @@
+#!/usr/bin/python3
+
+import shasta
+import sys
+
+# Combines the alignment shards created by ComputeAlignmentsShard.py.
+# The result is the same as if ComputeAlignments.py had been used.
+helpMessage = """
+Invoke with one argument: shardCount.
+"""
+
+# Get the arguments.
+if not len(sys.argv) == 2:
+    print(helpMessage)
+    exit(1)
+shardCount = int(sys.argv[1])
+
+# Initialize the assembler and access what we need.
+a = shasta.Assembler()
+a.accessKmers()
+a.accessMarkers()
+a.accessAlignmentCandidates()
+
+# Do the computation.
+a.mergeAlignmentShards(shardCount = shardCount)
@@ -0,0 +1,31 @@
+#!/usr/bin/python3
+
+import shasta
+import GetConfig
+import sys
+
+helpMessage="""
+This combines the shards created by FindAlignmentCandidatesLowHashShard.py
+and creates the alignment candidates, applying minFrequency.
+
+Invoke with one argument: shardCount.
+"""
+
+# Get the arguments.
+if not len(sys.argv)==2:
+    print(helpMessage)
+    exit(1)
+shardCount = int(sys.argv[1])
+    
+# Read the config file.
+config = GetConfig.getConfig()
+
+# Initialize the assembler and access what we need.
+a = shasta.Assembler()
+a.accessMarkers()
+
+# Do the computation.
+a.mergeLowHashShards(
+    shardCount = shardCount,
+    minFrequency = int(config['MinHash']['minFrequency']))
+
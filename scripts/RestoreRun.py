@@ -24,9 +24,5 @@ if glob.glob('Data/*'):
 # Copy the Data directory.
 # We cannot use regular copy commands because
 # this is on the huge page filesystem.
-inputFileNames = glob.glob('DataOnDisk/*')
-for inputFileName in inputFileNames:
-    lastSlashPosition = inputFileName.rfind('/')
-    outputFileName = 'Data/' + inputFileName[lastSlashPosition+1:]
-    shasta.mappedCopy(inputFileName, outputFileName)
+shasta.copyDirectory('DataOnDisk', 'Data')
 
@@ -47,25 +47,48 @@ def runAssembly(a, config, fastaFileNames):
         a.setupMarginPhase()
     
     # Read the input fasta files.
-    for fileName in fastaFileNames:  
-        print('Reading input file', fileName, flush=True) 
-        a.addReadsFromFasta(
-            fileName = fileName, 
-            minReadLength = int(config['Reads']['minReadLength']))
+    a.addReadsFromFastaFiles(
+        fileNames = fastaFileNames,
+        minReadLength = int(config['Reads']['minReadLength']),
+        maxConcurrentFileCount = int(config['Reads'].get('maxConcurrentFileCount', 1)))
+
+    # Optionally, replace the read repeat counts
+    # with their compact representation.
+    if ast.literal_eval(config['Reads'].get('compressRepeatCounts', 'False')):
+        a.compressReadRepeatCounts()
 
     # Initialize read flags.
     a.initializeReadFlags()            
     
+    # Optionally, keep only the longest reads up to a target coverage.
+    targetCoverage = float(config['Reads'].get('subsampling.targetCoverage', '0'))
+    if targetCoverage > 0.:
+        a.subsampleReads(
+            targetCoverage = targetCoverage,
+            genomeSize = int(config['Reads']['subsampling.genomeSize']))
+    
     # Create a histogram of read lengths.
     a.histogramReadLength(fileName="ReadLengthHistogram.csv")
     
     # Randomly select the k-mers that will be used as markers.
-    a.randomlySelectKmers(
-        k = int(config['Kmers']['k']), 
-        probability = float(config['Kmers']['probability']))
+    generationMethod = int(config['Kmers'].get('generationMethod', '0'))
+    if generationMethod == 0:
+        a.randomlySelectKmers(
+            k = int(config['Kmers']['k']), 
+            probability = float(config['Kmers']['probability']))
+    elif generationMethod == 1:
+        a.selectKmersBasedOnFrequency(
+            k = int(config['Kmers']['k']), 
+            probability = float(config['Kmers']['probability']),
+            enrichmentThreshold = float(config['Kmers']['enrichmentThreshold']))
+    else:
+        raise Exception('Invalid value %i specified for Kmers.generationMethod.' % generationMethod)
         
     # Find the markers in the reads.
     a.findMarkers()
+
+    # Sort the markers of each oriented read by k-mer id.
+    a.computeSortedMarkers()
     
     # Flag palindromic reads.
     # These wil be excluded from further processing.
@@ -77,29 +100,43 @@ def runAssembly(a, config, fastaFileNames):
         deltaThreshold = int(config['Reads']['palindromicReads.deltaThreshold']))
         
     # Find alignment candidates.
-    a.findAlignmentCandidatesLowHash(
-        m = int(config['MinHash']['m']), 
-        hashFraction = float(config['MinHash']['hashFraction']),
-        minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
-        maxBucketSize = int(config['MinHash']['maxBucketSize']),
-        minFrequency = int(config['MinHash']['minFrequency']))
-    """
-    # Old MinHash code to find alignment candidates. 
-    # If using this, make sure to set MinHash.minHashIterationCount
-    # to a suitable value (100 was the defaulf when this code was active).
-    a.findAlignmentCandidatesMinHash(
-        m = int(config['MinHash']['m']), 
-        minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
-        maxBucketSize = int(config['MinHash']['maxBucketSize']),
-        minFrequency = int(config['MinHash']['minFrequency']))
-    """
+    sketchSize = int(config['MinHash'].get('sketchSize', '0'))
+    if sketchSize > 0:
+        a.findAlignmentCandidatesMinHash(
+            m = int(config['MinHash']['m']), 
+            minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
+            maxBucketSize = int(config['MinHash']['maxBucketSize']),
+            minFrequency = int(config['MinHash']['minFrequency']),
+            sketchSize = sketchSize,
+            lowHashMethod = int(config['MinHash']['lowHashMethod']))
+    else:
+        a.findAlignmentCandidatesLowHash(
+            m = int(config['MinHash']['m']), 
+            hashFraction = float(config['MinHash']['hashFraction']),
+            minHashIterationCount = int(config['MinHash']['minHashIterationCount']), 
+            maxBucketSize = int(config['MinHash']['maxBucketSize']),
+            minFrequency = int(config['MinHash']['minFrequency']),
+            lowHashMethod = int(config['MinHash']['lowHashMethod']),
+            candidateTableMegabytes = int(config['MinHash']['candidateTableMegabytes']),
+            singlePassHashing = ast.literal_eval(config['MinHash']['singlePassHashing']),
+            storeSketches = ast.literal_eval(config['MinHash']['storeSketches']),
+            targetCandidatesPerRead = float(config['MinHash']['targetCandidatesPerRead']),
+            maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
+            maxSkip = int(config['Align']['maxSkip']),
+            minAlignedMarkerCount = int(config['Align']['minAlignedMarkerCount']),
+            maxTrim = int(config['Align']['maxTrim']))
     
     # Compute alignments.
     a.computeAlignments(
         maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
         maxSkip = int(config['Align']['maxSkip']),
         minAlignedMarkerCount = int(config['Align']['minAlignedMarkerCount']),
-        maxTrim = int(config['Align']['maxTrim']))
+        maxTrim = int(config['Align']['maxTrim']),
+        bandWidth = int(config['Align']['bandWidth']),
+        alignMethod = int(config['Align']['alignMethod']),
+        storeAlignments = ast.literal_eval(config['Align']['storeAlignments']),
+        groupCandidates = ast.literal_eval(config['Align'].get('groupCandidates', 'False')),
+        maxAlignmentGraphEdgeCount = int(config['Align'].get('maxAlignmentGraphEdgeCount', '0')))
         
     # Create the read graph.
     a.createReadGraph(
@@ -115,17 +152,30 @@ def runAssembly(a, config, fastaFileNames):
     a.computeReadGraphConnectedComponents(
         minComponentSize = int(config['ReadGraph']['minComponentSize']))
     
+    # Renumber reads for memory locality, if requested.
+    if ast.literal_eval(config['ReadGraph'].get('renumberReads', 'False')):
+        a.renumberReads()
+    
     # Create vertices of the marker graph.
     a.createMarkerGraphVertices(
         maxMarkerFrequency = int(config['Align']['maxMarkerFrequency']),
         maxSkip = int(config['Align']['maxSkip']),
         minCoverage = int(config['MarkerGraph']['minCoverage']),
-        maxCoverage = int(config['MarkerGraph']['maxCoverage']))
+        maxCoverage = int(config['MarkerGraph']['maxCoverage']),
+        unionBufferSize = int(config['MarkerGraph']['unionBufferSize']),
+        outOfCorePartitionCount = int(config['MarkerGraph']['outOfCorePartitionCount']),
+        storeDisjointSetTable = ast.literal_eval(config['MarkerGraph'].get('storeDisjointSetTable', 'False')))
     a.findMarkerGraphReverseComplementVertices()
     
     # Create edges of the marker graph.
     a.createMarkerGraphEdges()
     a.findMarkerGraphReverseComplementEdges()
+    if ast.literal_eval(config['MarkerGraph'].get('canonicalEdgeMarkerIntervals', 'False')):
+        a.storeCanonicalMarkerGraphEdgeMarkerIntervals()
+    if ast.literal_eval(config['MarkerGraph'].get('compressEdgeMarkerIntervals', 'False')):
+        a.compressMarkerGraphEdgeMarkerIntervals()
+    if ast.literal_eval(config['MarkerGraph'].get('renumber', 'False')):
+        a.renumberMarkerGraph()
     
     # Approximate transitive reduction.
     a.flagMarkerGraphWeakEdges(
@@ -164,19 +214,43 @@ def runAssembly(a, config, fastaFileNames):
         markerGraphEdgeLengthThresholdForConsensus =
         int(config['Assembly']['markerGraphEdgeLengthThresholdForConsensus']),
         useMarginPhase = useMarginPhase,
-        storeCoverageData = storeCoverageData)
+        storeCoverageData = storeCoverageData,
+        starAlignmentLengthThreshold =
+        int(config['Assembly'].get('starAlignmentLengthThreshold', '0')),
+        useGpuConsensus = ast.literal_eval(config['Assembly'].get('useGpuConsensus', 'False')))
+    if storeCoverageData and \
+        ast.literal_eval(config['Assembly'].get('compressCoverageData', 'True')):
+        a.compressMarkerGraphCoverageData()
     
     # Use the assembly graph for global assembly.
-    a.assemble()
-    
-    a.computeAssemblyStatistics()
-    a.writeGfa1('Assembly.gfa')
-    a.writeFasta('Assembly.fasta')
+    outputSuffix = ''
+    if ast.literal_eval(config['Assembly'].get('bgzipOutput', 'False')):
+        outputSuffix = '.gz'
+    if ast.literal_eval(config['Assembly'].get('fusedOutput', 'False')):
+        a.assembleAndWrite(
+            fastaFileName = 'Assembly.fasta' + outputSuffix,
+            gfaFileName = 'Assembly.gfa' + outputSuffix,
+            storeSequences = ast.literal_eval(
+            config['Assembly'].get('storeAssembledSequences', 'True')))
+        a.computeAssemblyStatistics()
+    else:
+        a.assemble()
+        a.computeAssemblyStatistics()
+        a.writeGfa1('Assembly.gfa' + outputSuffix)
+        a.writeFasta('Assembly.fasta' + outputSuffix)
 
 
 def main():
-    # Parse arguments
-    fastaFileNames = sys.argv[1:]
+    # Parse arguments.
+    # The optional --liveServerPort=<port> starts an http server
+    # that can be used to inspect the run while it executes.
+    fastaFileNames = []
+    liveServerPort = None
+    for argument in sys.argv[1:]:
+        if argument.startswith('--liveServerPort='):
+            liveServerPort = int(argument.split('=', 1)[1])
+        else:
+            fastaFileNames.append(argument)
 
     # Ensure prerequisite files are present
     verifyConfigFiles()
@@ -187,6 +261,12 @@ def main():
 
     # Initialize Assembler object
     assembler = initializeAssembler(config=config, fastaFileNames=fastaFileNames)
+    if liveServerPort is not None:
+        docsDirectory = os.path.dirname(os.path.dirname(os.path.realpath(__file__))) + '/docs'
+        assembler.setDocsDirectory(docsDirectory)
+        assembler.startLiveServer(
+            port=liveServerPort,
+            consensusCaller=config['Assembly']['consensusCaller'])
 
     # Run with user specified configuration and input files
     runAssembly(config=config, fastaFileNames=fastaFileNames, a=assembler)
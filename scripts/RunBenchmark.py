@@ -0,0 +1,91 @@
+#!/usr/bin/python3
+
+import json
+import os
+import shutil
+import subprocess
+import sys
+
+helpMessage = """
+Run an end to end benchmark using the static executable
+and record the elapsed time of each stage,
+so performance regressions between versions can be detected.
+Use a fixed data set, for example created with CreateSyntheticReads.py
+or DownsampleReads.py, and always run on the same machine.
+
+Invoke with 3 or 4 arguments:
+- The path to the shasta static executable.
+- The name of the input FASTA file.
+- The name of the output json file. It contains the build id
+  and, for each stage, the contents of PerformanceReport.json.
+- Optionally, the name of a json file written by a previous run of this script
+  (the baseline). Stages that are more than 10% slower than in the baseline
+  (and at least 1 s slower) are reported, and the exit status is 2 if there are any.
+
+The assembly runs in directory BenchmarkRun, which is removed first
+if it exists. Additional command line options for the executable
+can be specified in environment variable SHASTA_BENCHMARK_OPTIONS.
+"""
+
+if not len(sys.argv) in (4, 5):
+    print(helpMessage)
+    exit(1)
+executable = os.path.abspath(sys.argv[1])
+fastaFileName = os.path.abspath(sys.argv[2])
+outputFileName = sys.argv[3]
+baselineFileName = sys.argv[4] if len(sys.argv) == 5 else None
+runDirectory = 'BenchmarkRun'
+relativeTolerance = 0.1
+absoluteTolerance = 1.
+
+# Run the assembly.
+if os.path.lexists(runDirectory):
+    shutil.rmtree(runDirectory)
+command = [executable, '--input', fastaFileName, '--output', runDirectory]
+command += os.environ.get('SHASTA_BENCHMARK_OPTIONS', '').split()
+# The executable writes its build id on the first line of output.
+buildId = subprocess.run([executable, '--help'],
+    stdout = subprocess.PIPE, universal_newlines = True).stdout.split('\n')[0]
+print(' '.join(command), flush = True)
+subprocess.run(command, check = True)
+
+# Collect the results.
+with open(os.path.join(runDirectory, 'PerformanceReport.json')) as file:
+    report = json.load(file)
+results = {
+    'buildId': buildId,
+    'command': command,
+    'stages': report['stages'],
+    'elapsedSeconds': sum(stage['elapsedSeconds'] for stage in report['stages'])
+    }
+with open(outputFileName, 'w') as file:
+    json.dump(results, file, indent = 2)
+print('Total elapsed time %.1f s. Results written to %s.' %
+    (results['elapsedSeconds'], outputFileName))
+
+# Compare with the baseline.
+if baselineFileName is None:
+    exit(0)
+with open(baselineFileName) as file:
+    baseline = json.load(file)
+baselineSeconds = {stage['name']: stage['elapsedSeconds'] for stage in baseline['stages']}
+regressionCount = 0
+print('Stage, baseline seconds, seconds, ratio')
+for stage in results['stages']:
+    name = stage['name']
+    seconds = stage['elapsedSeconds']
+    if not name in baselineSeconds:
+        print(name, 'not in baseline')
+        continue
+    previousSeconds = baselineSeconds[name]
+    isRegression = (seconds > previousSeconds * (1. + relativeTolerance) and
+        seconds > previousSeconds + absoluteTolerance)
+    print('%s, %.2f, %.2f, %.2f%s' % (name, previousSeconds, seconds,
+        seconds / previousSeconds if previousSeconds > 0. else 0.,
+        ', REGRESSION' if isRegression else ''))
+    if isRegression:
+        regressionCount += 1
+if regressionCount > 0:
+    print(regressionCount, 'stages are slower than in the baseline.')
+    exit(2)
+print('No regressions found.')
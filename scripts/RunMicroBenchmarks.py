@@ -0,0 +1,48 @@
+#!/usr/bin/python3
+
+import json
+import shasta
+import sys
+
+helpMessage = """
+Run micro-benchmarks of individual components on synthetic data
+(see src/benchmarks.hpp) and write the time in seconds
+of each phase to a json file.
+The sizes are fixed, so results from different versions
+can be compared on the same machine.
+
+Invoke with 1 or 2 arguments:
+- The name of the output json file.
+- Optionally, the number of threads (default 0, which means
+  one thread per virtual processor).
+
+Components that need the data of an existing run
+can be benchmarked using BenchmarkAlignments.py, and
+Assembler.benchmarkSimpleBayesianConsensusCaller.
+"""
+
+if not len(sys.argv) in (2, 3):
+    print(helpMessage)
+    exit(1)
+fileName = sys.argv[1]
+threadCount = int(sys.argv[2]) if len(sys.argv) == 3 else 0
+
+results = {}
+
+print('MarkerFinder', flush=True)
+results['MarkerFinder'] = shasta.benchmarkMarkerFinder(
+    readCount = 100000,
+    readLength = 10000,
+    k = 10,
+    markerDensity = 0.1,
+    threadCount = threadCount)
+
+print('VectorOfVectors', flush=True)
+results['VectorOfVectors'] = shasta.benchmarkVectorOfVectors(
+    n = 100000000,
+    averageSize = 10,
+    threadCount = threadCount)
+
+with open(fileName, 'w') as file:
+    json.dump(results, file, indent = 2, sort_keys = True)
+print('Results written to', fileName)
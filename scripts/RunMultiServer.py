@@ -0,0 +1,47 @@
+#!/usr/bin/python3
+
+import os
+import shasta
+import argparse
+import configparser
+
+# Serve several runs from a single process.
+# Each argument is a run directory, containing shasta.conf
+# and the binary data in Data or DataOnDisk.
+parser = argparse.ArgumentParser(description='Serve several Shasta runs from a single http server.')
+parser.add_argument('runDirectories', nargs='+')
+parser.add_argument('--maxMappedGB', type=float, default=64.,
+    help='Close idle runs when the data mapped by all runs exceed this.')
+parser.add_argument('--idleSeconds', type=int, default=3600,
+    help='Close runs not used for this long.')
+parser.add_argument('--port', type=int, default=17100)
+arguments = parser.parse_args()
+
+# Find the path to the docs directory.
+thisScriptPath = os.path.realpath(__file__)
+thisScriptDirectory = os.path.dirname(thisScriptPath)
+thisScriptParentDirectory = os.path.dirname(thisScriptDirectory)
+docsDirectory = thisScriptParentDirectory + '/docs'
+
+server = shasta.MultiRunHttpServer(
+    maxMappedBytes=int(arguments.maxMappedGB * 1024 * 1024 * 1024),
+    idleSeconds=arguments.idleSeconds)
+server.setDocsDirectory(docsDirectory)
+
+for runDirectory in arguments.runDirectories:
+    runDirectory = os.path.realpath(runDirectory)
+    name = os.path.basename(runDirectory)
+
+    # Read the config file of this run.
+    config = configparser.ConfigParser()
+    if not config.read(runDirectory + '/shasta.conf'):
+        raise Exception('Error reading config file for run %s.' % runDirectory)
+
+    # Use the data in memory if available, otherwise the data on disk.
+    if os.path.exists(runDirectory + '/Data/Info'):
+        dataDirectory = runDirectory + '/Data/'
+    else:
+        dataDirectory = runDirectory + '/DataOnDisk/'
+    server.addRun(name, dataDirectory, config['Assembly']['consensusCaller'])
+
+server.explore(port=arguments.port)
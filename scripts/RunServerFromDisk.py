@@ -16,7 +16,10 @@ config = GetConfig.getConfig()
 # Initialize the assembler.
 a = shasta.Assembler(
     largeDataFileNamePrefix='DataOnDisk/')
-a.accessAllSoft()
+
+# Data on disk can be cold, so access them as needed
+# instead of all up front.
+a.accessAllLazy()
 a.setupConsensusCaller(config['Assembly']['consensusCaller'])
 
 a.setDocsDirectory(docsDirectory)
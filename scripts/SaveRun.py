@@ -1,7 +1,7 @@
 #!/usr/bin/python3
 
 import os
-import shutil
+import shasta
 import sys
 
 
@@ -23,7 +23,9 @@ def saveRun(parentDirectory=""):
     if os.path.lexists(dataOnDiskPath):
         raise Exception('DataOnDisk already exists. Remove before running this script.')
         
-    shutil.copytree('Data', 'DataOnDisk')
+    # This uses reflinks where supported, multiple threads,
+    # and preserves holes (unused capacity) in the files.
+    shasta.copyDirectory(dataPath, dataOnDiskPath)
 
 
 def main():
@@ -0,0 +1,36 @@
+#!/usr/bin/python3
+
+helpMessage = """
+This runs a benchmark of union operations in dset64.hpp,
+with and without buffering in blocks of marker ids
+(see DisjointSetsUnionBuffer.hpp).
+
+Invoke with 4 arguments:
+- The number of items (vertices).
+- The number of union operations (edges).
+- The number of threads.
+- The buffer capacity (number of union operations per thread).
+
+The disjoint sets data use 16 bytes per item,
+plus 8 bytes per item to check the results.
+"""
+
+
+import shasta
+import sys
+
+if not len(sys.argv)==5:
+    print(helpMessage)
+    exit(1);
+    
+n = int(sys.argv[1])
+m = int(sys.argv[2])
+threadCount = int(sys.argv[3])
+unionBufferSize = int(sys.argv[4])
+
+
+shasta.dset64Benchmark(
+    n = n,
+    m = m,
+    threadCount = threadCount,
+    unionBufferSize = unionBufferSize)
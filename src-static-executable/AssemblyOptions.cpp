@@ -22,6 +22,31 @@ void AssemblyOptions::add(boost::program_options::options_description& options)
         default_value(10000),
         "Read length cutoff.")
 
+        ("Reads.compressRepeatCounts",
+        value<string>(&Reads.compressRepeatCounts)->
+        default_value("False"),
+        "If True, read repeat counts are stored using about 2 bits "
+        "per base instead of 8, and decoded as needed.")
+
+        ("Reads.maxConcurrentFileCount",
+        value<uint64_t>(&Reads.maxConcurrentFileCount)->
+        default_value(1),
+        "Maximum number of input files loaded concurrently. "
+        "The concurrently loaded files share the threads and the input block memory. "
+        "0 means one file per thread.")
+
+        ("Reads.subsampling.targetCoverage",
+        value<double>(&Reads.subsampling.targetCoverage)->
+        default_value(0.),
+        "If not zero, the longest reads are kept up to this coverage, "
+        "and the remaining reads are excluded from the assembly. "
+        "Requires Reads.subsampling.genomeSize.")
+
+        ("Reads.subsampling.genomeSize",
+        value<uint64_t>(&Reads.subsampling.genomeSize)->
+        default_value(0),
+        "Estimated genome size in bases, used for read subsampling.")
+
         ("Reads.palindromicReads.maxSkip",
         value<int>(&Reads.palindromicReads.maxSkip)->
         default_value(100),
@@ -57,6 +82,19 @@ void AssemblyOptions::add(boost::program_options::options_description& options)
         default_value(0.1, "0.1"),
         "Probability that a k-mer is used as a marker.")
 
+        ("Kmers.generationMethod",
+        value<int>(&Kmers.generationMethod)->
+        default_value(0),
+        "Method to generate marker k-mers: "
+        "0 = random, "
+        "1 = random, excluding k-mers over-represented in the reads.")
+
+        ("Kmers.enrichmentThreshold",
+        value<double>(&Kmers.enrichmentThreshold)->
+        default_value(10., "10."),
+        "For Kmers.generationMethod 1, exclude k-mers whose frequency in the reads "
+        "is more than this times the average frequency of the k-mers present in the reads.")
+
         ("MinHash.m",
         value<int>(&MinHash.m)->
         default_value(4),
@@ -83,6 +121,51 @@ void AssemblyOptions::add(boost::program_options::options_description& options)
         "The minimum number of times a pair of reads must be found by the MinHash/LowHash algorithm "
         "in order to be considered a candidate alignment.")
 
+        ("MinHash.lowHashMethod",
+        value<int>(&MinHash.lowHashMethod)->
+        default_value(0),
+        "Method used by the LowHash algorithm to group low hashes: "
+        "0 = buckets, "
+        "1 = sorting.")
+
+        ("MinHash.candidateTableMegabytes",
+        value<int>(&MinHash.candidateTableMegabytes)->
+        default_value(0),
+        "If not 0, the LowHash algorithm accumulates alignment candidates "
+        "in a concurrent hash table using at most this many megabytes.")
+
+        ("MinHash.singlePassHashing",
+        value<string>(&MinHash.singlePassHashing)->
+        default_value("False"),
+        "If True, the LowHash algorithm computes the low hashes for all iterations "
+        "in a single pass over the markers. "
+        "This uses more memory but reduces memory traffic.")
+
+        ("MinHash.storeSketches",
+        value<string>(&MinHash.storeSketches)->
+        default_value("False"),
+        "If True, the low hashes computed by the LowHash algorithm are stored, "
+        "so alignment candidates can later be updated incrementally "
+        "when reads are added. This implies singlePassHashing.")
+
+        ("MinHash.targetCandidatesPerRead",
+        value<double>(&MinHash.targetCandidatesPerRead)->
+        default_value(0., "0."),
+        "If not 0, the LowHash algorithm adapts to the reads: "
+        "it stops iterating and increases minFrequency to stay within "
+        "this number of alignment candidates per oriented read "
+        "and to avoid candidates that rarely give good alignments. "
+        "MinHash.minHashIterationCount and MinHash.minFrequency "
+        "become a maximum and a minimum.")
+
+        ("MinHash.sketchSize",
+        value<int>(&MinHash.sketchSize)->
+        default_value(0),
+        "If not 0, use the MinHash algorithm instead of LowHash: "
+        "at each iteration, each oriented read contributes its sketchSize "
+        "lowest feature hashes (a bottom-k sketch) instead of the hashes "
+        "below MinHash.hashFraction. 1 gives the classical MinHash algorithm.")
+
         ("Align.maxSkip",
         value<int>(&Align.maxSkip)->
         default_value(30),
@@ -103,6 +186,43 @@ void AssemblyOptions::add(boost::program_options::options_description& options)
         default_value(30),
         "The maximum number of trim markers tolerated at the beginning and end of an alignment.")
 
+        ("Align.bandWidth",
+        value<int>(&Align.bandWidth)->
+        default_value(0),
+        "If not 0, first try to compute each alignment using only marker pairs "
+        "within this distance (in markers) of the dominant diagonal, "
+        "falling back to the full alignment graph if necessary. "
+        "This should be much larger than Align.maxSkip.")
+
+        ("Align.alignMethod",
+        value<int>(&Align.alignMethod)->
+        default_value(0),
+        "The method used to compute alignments: "
+        "0 = alignment graph, 1 = chaining of marker pairs. "
+        "Align.bandWidth is only used by method 0.")
+
+        ("Align.storeAlignments",
+        value<string>(&Align.storeAlignments)->
+        default_value("False"),
+        "If True, the aligned marker pairs of the good alignments are stored "
+        "in compressed form, so the creation of marker graph vertices "
+        "does not need to compute the alignments again. "
+        "This is faster but uses more memory.")
+
+        ("Align.groupCandidates",
+        value<string>(&Align.groupCandidates)->
+        default_value("False"),
+        "If True, alignment candidates are processed grouped by their first read, "
+        "so its sorted markers can be reused. This does not change the results.")
+
+        ("Align.maxAlignmentGraphEdgeCount",
+        value<uint64_t>(&Align.maxAlignmentGraphEdgeCount)->
+        default_value(0),
+        "If not 0 and Align.alignMethod is 0, the alignment of a pair of reads "
+        "is abandoned as soon as its alignment graph has more than this number of edges. "
+        "These pairs are aligned at the end using chaining (method 1). "
+        "0 means no limit.")
+
         ("ReadGraph.maxAlignmentCount",
         value<int>(&ReadGraph.maxAlignmentCount)->
         default_value(6),
@@ -119,15 +239,71 @@ void AssemblyOptions::add(boost::program_options::options_description& options)
         default_value(2),
         "Used for chimeric read detection.")
 
+        ("ReadGraph.renumberReads",
+        value<string>(&ReadGraph.renumberReads)->
+        default_value("False"),
+        "If True, after the read graph is created the reads are renumbered "
+        "in the order of a breadth first search of the read graph, "
+        "so reads that overlap in the genome get nearby read ids. "
+        "This improves memory locality in the marker graph stages. "
+        "Read ids in the output then no longer follow the order of the input files.")
+
         ("MarkerGraph.minCoverage",
         value<int>(&MarkerGraph.minCoverage)->
         default_value(10),
-        "Minimum number of markers for a marker graph vertex.")
+        "Minimum number of markers for a marker graph vertex. "
+        "If 0, it is chosen automatically at the valley of the coverage histogram "
+        "that separates low coverage vertices caused by errors.")
 
         ("MarkerGraph.maxCoverage",
         value<int>(&MarkerGraph.maxCoverage)->
         default_value(100),
-        "Maximum number of markers for a marker graph vertex.")
+        "Maximum number of markers for a marker graph vertex. "
+        "If 0, it is chosen automatically at the first valley of the coverage histogram "
+        "after its main peak, but at most 3 times the coverage of the peak.")
+
+        ("MarkerGraph.unionBufferSize",
+        value<int>(&MarkerGraph.unionBufferSize)->
+        default_value(0),
+        "If not zero, each thread buffers this number of union operations "
+        "during marker graph vertex creation and applies them in order of marker id block. "
+        "This improves memory locality for large assemblies.")
+
+        ("MarkerGraph.outOfCorePartitionCount",
+        value<int>(&MarkerGraph.outOfCorePartitionCount)->
+        default_value(0),
+        "If not zero, marker graph vertex creation uses an out of core mode "
+        "with this number of partitions, which bounds memory usage "
+        "at the cost of writing and reading spill files. "
+        "This requires --memoryMode filesystem --memoryBacking disk.")
+
+        ("MarkerGraph.storeDisjointSetTable",
+        value<string>(&MarkerGraph.storeDisjointSetTable)->
+        default_value("False"),
+        "If True, the disjoint set table computed during marker graph vertex creation "
+        "is stored, so marker graph vertices can later be updated incrementally "
+        "when reads are added. Not supported in out of core mode.")
+
+        ("MarkerGraph.canonicalEdgeMarkerIntervals",
+        value<string>(&MarkerGraph.canonicalEdgeMarkerIntervals)->
+        default_value("False"),
+        "If True, marker graph edge marker intervals are only stored "
+        "for one edge of each reverse complement pair, "
+        "and computed as needed for the other edge.")
+
+        ("MarkerGraph.compressEdgeMarkerIntervals",
+        value<string>(&MarkerGraph.compressEdgeMarkerIntervals)->
+        default_value("False"),
+        "If True, marker graph edge marker intervals are stored "
+        "in a compressed form that uses about a third of the memory.")
+
+        ("MarkerGraph.renumber",
+        value<string>(&MarkerGraph.renumber)->
+        default_value("False"),
+        "If True, marker graph vertices and edges are renumbered "
+        "after the edges are created, so vertices and edges along chains "
+        "of the marker graph have nearby ids. This improves memory locality "
+        "of the stages that follow.")
 
         ("MarkerGraph.lowCoverageThreshold",
         value<int>(&MarkerGraph.lowCoverageThreshold)->
@@ -181,11 +357,56 @@ void AssemblyOptions::add(boost::program_options::options_description& options)
         value<string>(&Assembly.storeCoverageData)->
         default_value("False"),
         "Used to request storing coverage data.")
+
+        ("Assembly.compressCoverageData",
+        value<string>(&Assembly.compressCoverageData)->
+        default_value("True"),
+        "If True and coverage data are stored, they are block compressed.")
+
+        ("Assembly.bgzipOutput",
+        value<string>(&Assembly.bgzipOutput)->
+        default_value("False"),
+        "If True, the assembled FASTA and GFA files are bgzip compressed "
+        "and written as Assembly.fasta.gz and Assembly.gfa.gz.")
+
+        ("Assembly.fusedOutput",
+        value<string>(&Assembly.fusedOutput)->
+        default_value("False"),
+        "If True, the FASTA and GFA output is written while assembling, "
+        "instead of in separate passes after assembly.")
+
+        ("Assembly.storeAssembledSequences",
+        value<string>(&Assembly.storeAssembledSequences)->
+        default_value("True"),
+        "If False, the assembled sequences are not stored in binary data. "
+        "This saves memory but the assemble stage cannot be checkpointed. "
+        "Requires Assembly.fusedOutput = True.")
+
+        ("Assembly.starAlignmentLengthThreshold",
+        value<int>(&Assembly.starAlignmentLengthThreshold)->
+        default_value(0),
+        "Marker graph edges with all intervening sequences at most this long "
+        "are aligned to their most frequent sequence instead of using spoa. "
+        "Zero means always use spoa.")
+
+        ("Assembly.useGpuConsensus",
+        value<string>(&Assembly.useGpuConsensus)->
+        default_value("False"),
+        "Used to compute marker graph edge alignments on a GPU. "
+        "Not supported by the Shasta static executable.")
         ;
 }
 
 
 
+void AssemblyOptions::ReadsOptions::SubsamplingOptions::write(ostream& s) const
+{
+    s << "subsampling.targetCoverage = " << targetCoverage << "\n";
+    s << "subsampling.genomeSize = " << genomeSize << "\n";
+}
+
+
+
 void AssemblyOptions::ReadsOptions::PalindromicReadOptions::write(ostream& s) const
 {
     s << "palindromicReads.maxSkip = " << maxSkip << "\n";
@@ -201,6 +422,9 @@ void AssemblyOptions::ReadsOptions::write(ostream& s) const
 {
     s << "[Reads]\n";
     s << "minReadLength = " << minReadLength << "\n";
+    s << "compressRepeatCounts = " << compressRepeatCounts << "\n";
+    s << "maxConcurrentFileCount = " << maxConcurrentFileCount << "\n";
+    subsampling.write(s);
     palindromicReads.write(s);
 }
 
@@ -211,6 +435,8 @@ void AssemblyOptions::KmersOptions::write(ostream& s) const
     s << "[Kmers]\n";
     s << "k = " << k << "\n";
     s << "probability = " << probability << "\n";
+    s << "generationMethod = " << generationMethod << "\n";
+    s << "enrichmentThreshold = " << enrichmentThreshold << "\n";
 }
 
 
@@ -223,6 +449,12 @@ void AssemblyOptions::MinHashOptions::write(ostream& s) const
     s << "minHashIterationCount = " << minHashIterationCount << "\n";
     s << "maxBucketSize = " << maxBucketSize << "\n";
     s << "minFrequency = " << minFrequency << "\n";
+    s << "lowHashMethod = " << lowHashMethod << "\n";
+    s << "candidateTableMegabytes = " << candidateTableMegabytes << "\n";
+    s << "singlePassHashing = " << singlePassHashing << "\n";
+    s << "storeSketches = " << storeSketches << "\n";
+    s << "targetCandidatesPerRead = " << targetCandidatesPerRead << "\n";
+    s << "sketchSize = " << sketchSize << "\n";
 }
 
 
@@ -234,6 +466,11 @@ void AssemblyOptions::AlignOptions::write(ostream& s) const
     s << "maxMarkerFrequency = " << maxMarkerFrequency << "\n";
     s << "minAlignedMarkerCount = " << minAlignedMarkerCount << "\n";
     s << "maxTrim = " << maxTrim << "\n";
+    s << "bandWidth = " << bandWidth << "\n";
+    s << "alignMethod = " << alignMethod << "\n";
+    s << "storeAlignments = " << storeAlignments << "\n";
+    s << "groupCandidates = " << groupCandidates << "\n";
+    s << "maxAlignmentGraphEdgeCount = " << maxAlignmentGraphEdgeCount << "\n";
 }
 
 
@@ -244,6 +481,7 @@ void AssemblyOptions::ReadGraphOptions::write(ostream& s) const
     s << "maxAlignmentCount = " << maxAlignmentCount << "\n";
     s << "minComponentSize = " << minComponentSize << "\n";
     s << "maxChimericReadDistance = " << maxChimericReadDistance << "\n";
+    s << "renumberReads = " << renumberReads << "\n";
 }
 
 
@@ -252,6 +490,12 @@ void AssemblyOptions::MarkerGraphOptions::write(ostream& s) const
     s << "[MarkerGraph]\n";
     s << "minCoverage = " << minCoverage << "\n";
     s << "maxCoverage = " << maxCoverage << "\n";
+    s << "unionBufferSize = " << unionBufferSize << "\n";
+    s << "outOfCorePartitionCount = " << outOfCorePartitionCount << "\n";
+    s << "storeDisjointSetTable = " << storeDisjointSetTable << "\n";
+    s << "canonicalEdgeMarkerIntervals = " << canonicalEdgeMarkerIntervals << "\n";
+    s << "compressEdgeMarkerIntervals = " << compressEdgeMarkerIntervals << "\n";
+    s << "renumber = " << renumber << "\n";
     s << "lowCoverageThreshold = " << lowCoverageThreshold << "\n";
     s << "highCoverageThreshold = " << highCoverageThreshold << "\n";
     s << "maxDistance = " << maxDistance << "\n";
@@ -273,6 +517,18 @@ void AssemblyOptions::AssemblyOptionsInner::write(ostream& s) const
         useMarginPhase << "\n";
     s << "storeCoverageData = " <<
         storeCoverageData << "\n";
+    s << "compressCoverageData = " <<
+        compressCoverageData << "\n";
+    s << "bgzipOutput = " <<
+        bgzipOutput << "\n";
+    s << "fusedOutput = " <<
+        fusedOutput << "\n";
+    s << "storeAssembledSequences = " <<
+        storeAssembledSequences << "\n";
+    s << "starAlignmentLengthThreshold = " <<
+        starAlignmentLengthThreshold << "\n";
+    s << "useGpuConsensus = " <<
+        useGpuConsensus << "\n";
 }
 
 
@@ -27,6 +27,15 @@ public:
     class ReadsOptions {
     public:
         int minReadLength;
+        string compressRepeatCounts;    // False or True
+        uint64_t maxConcurrentFileCount;
+        class SubsamplingOptions {
+        public:
+            double targetCoverage;
+            uint64_t genomeSize;
+            void write(ostream&) const;
+        };
+        SubsamplingOptions subsampling;
         class PalindromicReadOptions {
         public:
             int maxSkip;
@@ -48,6 +57,8 @@ public:
     public:
         int k;
         double probability;
+        int generationMethod;
+        double enrichmentThreshold;
         void write(ostream&) const;
     };
     KmersOptions Kmers;
@@ -61,6 +72,12 @@ public:
         int minHashIterationCount;
         int maxBucketSize;
         int minFrequency;
+        int lowHashMethod;
+        int candidateTableMegabytes;
+        string singlePassHashing;   // False or True
+        string storeSketches;       // False or True
+        double targetCandidatesPerRead;
+        int sketchSize;
         void write(ostream&) const;
     };
     MinHashOptions MinHash;
@@ -73,6 +90,11 @@ public:
         int maxMarkerFrequency;
         int minAlignedMarkerCount;
         int maxTrim;
+        int bandWidth;
+        int alignMethod;
+        string storeAlignments;     // False or True
+        string groupCandidates;     // False or True
+        uint64_t maxAlignmentGraphEdgeCount;
         void write(ostream&) const;
     };
     AlignOptions Align;
@@ -84,6 +106,7 @@ public:
         int maxAlignmentCount;
         int minComponentSize;
         int maxChimericReadDistance;
+        string renumberReads;                   // False or True
         void write(ostream& ) const;
     };
     ReadGraphOptions ReadGraph;
@@ -94,6 +117,12 @@ public:
     public:
         int minCoverage;
         int maxCoverage;
+        int unionBufferSize;
+        int outOfCorePartitionCount;
+        string storeDisjointSetTable;           // False or True
+        string canonicalEdgeMarkerIntervals;    // False or True
+        string compressEdgeMarkerIntervals;     // False or True
+        string renumber;                        // False or True
         int lowCoverageThreshold;
         int highCoverageThreshold;
         int maxDistance;
@@ -114,6 +143,12 @@ public:
         string consensusCaller;
         string useMarginPhase;      // False or True
         string storeCoverageData;   // False or True
+        string compressCoverageData; // False or True
+        string bgzipOutput;         // False or True
+        string fusedOutput;         // False or True
+        string storeAssembledSequences; // False or True
+        int starAlignmentLengthThreshold;
+        string useGpuConsensus;     // False or True
         void write(ostream&) const;
     };
     AssemblyOptionsInner Assembly;
@@ -0,0 +1,507 @@
+// Shasta.
+#include "AssemblyPlanner.hpp"
+#include "Alignment.hpp"
+#include "AssemblyOptions.hpp"
+#include "CZI_ASSERT.hpp"
+#include "filesystem.hpp"
+#include "Kmer.hpp"
+#include "Marker.hpp"
+#include "MarkerGraph.hpp"
+#include "MarkerInterval.hpp"
+#include "OrientedReadPair.hpp"
+#include "ReadFlags.hpp"
+#include "ReadGraph.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Boost libraries.
+#include <boost/algorithm/string.hpp>
+
+// zlib, used to read the input files whether they are compressed or not.
+#include <zlib.h>
+
+// Linux.
+#include <unistd.h>
+
+// Standard library.
+#include "algorithm.hpp"
+#include "array.hpp"
+#include <cmath>
+#include "fstream.hpp"
+#include <iomanip>
+#include "stdexcept.hpp"
+#include <thread>
+
+
+
+AssemblyPlanner::AssemblyPlanner(
+    const AssemblyOptions& assemblyOptions,
+    const vector<string>& inputFastaFileNames,
+    uint64_t sampleReadCount,
+    const string& calibrationDirectory,
+    const string& memoryMode,
+    const string& memoryBacking) :
+    assemblyOptions(assemblyOptions),
+    memoryMode(memoryMode),
+    memoryBacking(memoryBacking),
+    calibrationDirectory(calibrationDirectory)
+{
+    physicalMemoryBytes = uint64_t(sysconf(_SC_PAGESIZE)) * uint64_t(sysconf(_SC_PHYS_PAGES));
+    threadCount = std::thread::hardware_concurrency();
+
+    for(const string& inputFastaFileName: inputFastaFileNames) {
+        sampleReads(inputFastaFileName, sampleReadCount);
+    }
+    if(readCount == 0.) {
+        throw runtime_error("No reads found in the input files.");
+    }
+
+    // Subsampling keeps only the longest reads up to the target coverage.
+    // We approximate its effect by scaling everything.
+    const auto& subsampling = assemblyOptions.Reads.subsampling;
+    if(subsampling.targetCoverage > 0.) {
+        const double targetBaseCount = subsampling.targetCoverage * double(subsampling.genomeSize);
+        if(rawBaseCount > targetBaseCount) {
+            const double ratio = targetBaseCount / rawBaseCount;
+            readCount *= ratio;
+            rawBaseCount *= ratio;
+            runLengthBaseCount *= ratio;
+            readNameByteCount *= ratio;
+        }
+    }
+
+    // The coverage requires the genome size. If not known,
+    // assume the coverage for which the default options are optimized.
+    if(subsampling.genomeSize > 0) {
+        coverage = rawBaseCount / double(subsampling.genomeSize);
+    } else {
+        coverage = 60.;
+        coverageIsAssumed = true;
+    }
+
+    estimateStages();
+    if(!calibrationDirectory.empty()) {
+        calibrate();
+    }
+}
+
+
+
+// Read a line from a file opened with gzopen.
+static bool getLine(gzFile file, string& line)
+{
+    line.clear();
+    array<char, 64 * 1024> buffer;
+    while(gzgets(file, buffer.data(), int(buffer.size()))) {
+        line += buffer.data();
+        if(line.back() == '\n') {
+            line.pop_back();
+            if(!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            return true;
+        }
+    }
+    return !line.empty();
+}
+
+
+
+// Read the first reads of a FASTA or FASTQ file,
+// optionally compressed, and extrapolate to the entire file.
+void AssemblyPlanner::sampleReads(const string& fileName, uint64_t sampleReadCount)
+{
+    // The sample is extrapolated using the file size,
+    // so URLs and streams cannot be used.
+    if(!filesystem::isRegularFile(fileName)) {
+        throw runtime_error("The dryRun command requires local input files. "
+            "It cannot be used with " + fileName);
+    }
+    gzFile file = gzopen(fileName.c_str(), "rb");
+    if(!file) {
+        throw runtime_error("Error opening " + fileName);
+    }
+    const size_t minReadLength = size_t(assemblyOptions.Reads.minReadLength);
+
+    double fileReadCount = 0.;
+    double fileRawBaseCount = 0.;
+    double fileRunLengthBaseCount = 0.;
+    double fileReadNameByteCount = 0.;
+    auto processRead = [&](const string& header, const string& sequence)
+    {
+        if(sequence.size() < minReadLength) {
+            return;
+        }
+        fileReadCount += 1.;
+        fileRawBaseCount += double(sequence.size());
+        uint64_t runCount = 0;
+        for(size_t i=0; i<sequence.size(); i++) {
+            if(i==0 || ::toupper(sequence[i]) != ::toupper(sequence[i-1])) {
+                ++runCount;
+            }
+        }
+        fileRunLengthBaseCount += double(runCount);
+        fileReadNameByteCount += double(min(header.find_first_of(" \t"), header.size()) - 1);
+    };
+
+    uint64_t sampledReadCount = 0;
+    string line;
+    string header;
+    string sequence;
+    if(getLine(file, line)) {
+        if(!line.empty() && line[0] == '@') {
+
+            // FASTQ: four lines per read.
+            string quality;
+            do {
+                header = line;
+                if(!getLine(file, sequence) || !getLine(file, quality) || !getLine(file, quality)) {
+                    break;
+                }
+                processRead(header, sequence);
+                ++sampledReadCount;
+            } while(sampledReadCount < sampleReadCount && getLine(file, line));
+
+        } else {
+
+            // FASTA: the sequence can span multiple lines.
+            header = line;
+            sequence.clear();
+            while(getLine(file, line)) {
+                if(!line.empty() && line[0] == '>') {
+                    processRead(header, sequence);
+                    ++sampledReadCount;
+                    if(sampledReadCount == sampleReadCount) {
+                        break;
+                    }
+                    header = line;
+                    sequence.clear();
+                } else {
+                    sequence += line;
+                }
+            }
+            if(sampledReadCount < sampleReadCount) {
+                processRead(header, sequence);
+                ++sampledReadCount;
+            }
+        }
+    }
+
+    // Extrapolate using the fraction of the file that was consumed.
+    double scale = 1.;
+    const double fileSize = double(filesystem::fileSize(fileName));
+    if(!gzeof(file)) {
+        const z_off_t offset = gzoffset(file);
+        if(offset > 0) {
+            scale = fileSize / double(offset);
+        }
+    }
+    gzclose(file);
+
+    cout << "Sampled " << sampledReadCount << " reads from " << fileName;
+    if(scale > 1.) {
+        cout << ", scaled by " << scale << " to the entire file";
+    }
+    cout << "." << endl;
+    readCount += scale * fileReadCount;
+    rawBaseCount += scale * fileRawBaseCount;
+    runLengthBaseCount += scale * fileRunLengthBaseCount;
+    readNameByteCount += scale * fileReadNameByteCount;
+    inputByteCount += fileSize;
+}
+
+
+
+// Estimate the counts of the main objects and the bytes used by each stage.
+// The ratios used here are typical values for nanopore reads
+// assembled with the default options.
+void AssemblyPlanner::estimateStages()
+{
+    const auto& Kmers = assemblyOptions.Kmers;
+    const auto& MinHash = assemblyOptions.MinHash;
+    const auto& Align = assemblyOptions.Align;
+    const double k = double(Kmers.k);
+    const double kmerCount = std::pow(4., k);
+
+    // Markers are stored for both strands.
+    orientedMarkerCount = 2. * Kmers.probability *
+        max(0., runLengthBaseCount - readCount * (k - 1.));
+
+    // Each read overlaps about 2*coverage other reads,
+    // which gives about coverage candidates per read.
+    // About half of them result in a good alignment.
+    alignmentCandidateCount = readCount * coverage;
+    alignmentCount = 0.5 * alignmentCandidateCount;
+    readGraphEdgeCount = 2. * min(alignmentCount, readCount * double(assemblyOptions.ReadGraph.maxAlignmentCount));
+
+    // About 70% of the markers end up in a vertex of the marker graph,
+    // and each vertex has about coverage markers.
+    const double markerFractionInVertices = 0.7;
+    const double markersInVertices = markerFractionInVertices * orientedMarkerCount;
+    vertexCount = markersInVertices / coverage;
+    edgeCount = 1.1 * vertexCount;
+
+    stages.clear();
+
+    // The reads are read in blocks of 2 GB.
+    stages.push_back(Stage("addReads",
+        0.25 * runLengthBaseCount +                     // Reads, 2 bits per base.
+        runLengthBaseCount +                            // Repeat counts.
+        readNameByteCount +
+        readCount * (3. * sizeof(uint64_t) + sizeof(ReadFlags)),
+        min(2. * 1024. * 1024. * 1024., 2. * rawBaseCount)));
+
+    stages.push_back(Stage("selectKmers",
+        kmerCount * (double(sizeof(KmerInfo)) + 1. / 8.),
+        (Kmers.generationMethod == 0) ? 0. : kmerCount * sizeof(uint64_t)));
+
+    stages.push_back(Stage("findMarkers",
+        orientedMarkerCount * sizeof(CompressedMarker) + 2. * readCount * sizeof(uint64_t),
+        0.));
+
+    stages.push_back(Stage("computeSortedMarkers",
+        orientedMarkerCount * sizeof(MarkerWithOrdinal) + 2. * readCount * sizeof(uint64_t),
+        0.));
+
+    stages.push_back(Stage("flagPalindromicReads", 0., 0.));
+
+    stages.push_back(Stage("findAlignmentCandidates",
+        alignmentCandidateCount * sizeof(OrientedReadPair),
+        double(MinHash.candidateTableMegabytes) * 1024. * 1024. +
+        orientedMarkerCount * MinHash.hashFraction * 2. * sizeof(uint64_t)));
+
+    // The stored alignments use about 2 bytes for each aligned marker.
+    // On average an alignment covers half the markers of a read.
+    double alignmentBytes =
+        alignmentCount * (double(sizeof(AlignmentData)) + 2. * sizeof(uint32_t)) +
+        2. * readCount * sizeof(uint32_t);
+    if(Align.storeAlignments == "True") {
+        alignmentBytes += alignmentCount * 2. * 0.5 * (orientedMarkerCount / (2. * readCount));
+    }
+    stages.push_back(Stage("computeAlignments", alignmentBytes, 0.));
+
+    stages.push_back(Stage("createReadGraph",
+        readGraphEdgeCount *
+        (double(sizeof(ReadGraph::Edge)) + sizeof(uint32_t) + sizeof(ReadGraph::Neighbor)) +
+        2. * readCount * (sizeof(uint32_t) + sizeof(uint64_t)),
+        0.));
+    stages.push_back(Stage("flagChimericReads", 0., 0.));
+    stages.push_back(Stage("computeReadGraphConnectedComponents",
+        0., 2. * readCount * sizeof(uint64_t)));
+
+    // Renumbering the reads copies one data structure at a time,
+    // the largest being the markers.
+    if(assemblyOptions.ReadGraph.renumberReads == "True") {
+        stages.push_back(Stage("renumberReads",
+            0., orientedMarkerCount * sizeof(CompressedMarker)));
+    }
+
+    // The in-core computation first uses the disjoint sets and the
+    // disjoint set table, then the disjoint set table, a work area,
+    // and the markers of each disjoint set, 8 bytes each per marker.
+    // The out of core computation only needs this for one partition at a time.
+    // Its temporary files on disk are not counted.
+    const double disjointSetBytes = (orientedMarkerCount < 4294967296.) ? 8. : 16.;
+    inCoreVertexTemporaryBytes = orientedMarkerCount * max(disjointSetBytes + 8., 24.);
+    const uint64_t partitionCount = assemblyOptions.MarkerGraph.outOfCorePartitionCount;
+    stages.push_back(Stage("createMarkerGraphVertices",
+        orientedMarkerCount * sizeof(MarkerGraph::CompressedVertexId) +
+        markersInVertices * sizeof(MarkerId) +
+        vertexCount * (double(sizeof(MarkerGraph::CompressedVertexId)) + sizeof(MarkerGraph::VertexId)),
+        (partitionCount == 0) ? inCoreVertexTemporaryBytes :
+        inCoreVertexTemporaryBytes / double(partitionCount)));
+
+    stages.push_back(Stage("createMarkerGraphEdges",
+        edgeCount * (double(sizeof(MarkerGraph::Edge)) + sizeof(uint64_t) + sizeof(MarkerGraph::EdgeId)) +
+        markersInVertices * sizeof(MarkerInterval) +
+        2. * (edgeCount * 5. + vertexCount * sizeof(uint64_t)),
+        0.));
+
+    // Renumbering the marker graph uses the old and new ids of each vertex
+    // and edge, the first new edge id of each vertex, and a copy
+    // of the largest data structure, the edge marker intervals.
+    if(assemblyOptions.MarkerGraph.renumber == "True") {
+        stages.push_back(Stage("renumberMarkerGraph",
+            0., vertexCount * 3. * sizeof(MarkerGraph::VertexId) +
+            edgeCount * 2. * sizeof(MarkerGraph::EdgeId) +
+            markersInVertices * sizeof(MarkerInterval)));
+    }
+    stages.push_back(Stage("flagMarkerGraphWeakEdges", 0., edgeCount * 2. * sizeof(uint64_t)));
+    stages.push_back(Stage("pruneMarkerGraphStrongSubgraph", 0., edgeCount));
+    stages.push_back(Stage("simplifyMarkerGraph", 0., edgeCount * sizeof(uint64_t)));
+    stages.push_back(Stage("createAssemblyGraph", edgeCount * sizeof(uint64_t), vertexCount / 8.));
+    stages.push_back(Stage("assembleMarkerGraphVertices", vertexCount * k, 0.));
+
+    // Most marker graph edges have a short consensus sequence,
+    // 2 bytes per base.
+    stages.push_back(Stage("assembleMarkerGraphEdges",
+        edgeCount * (sizeof(uint64_t) + 2. * 2. + 1.), 0.));
+
+    // The assembled sequence is about twice the genome size (both strands),
+    // with 2 bits per base plus one byte for the repeat count.
+    stages.push_back(Stage("assemble", 2. * (rawBaseCount / coverage) * 1.25, 0.));
+
+    double createdBytes = 0.;
+    for(Stage& stage: stages) {
+        createdBytes += stage.createdBytes;
+        stage.peakBytes = createdBytes + stage.temporaryBytes;
+    }
+
+    // If the in-core computation of the marker graph vertices does not fit,
+    // find the number of partitions required by the out of core mode.
+    const double usableBytes = 0.9 * double(physicalMemoryBytes);
+    const Stage& vertexStage = stages[10];
+    CZI_ASSERT(vertexStage.name == "createMarkerGraphVertices");
+    const double vertexStageOtherBytes = vertexStage.peakBytes - vertexStage.temporaryBytes;
+    if(vertexStageOtherBytes + inCoreVertexTemporaryBytes > usableBytes &&
+        vertexStageOtherBytes < usableBytes) {
+        recommendedPartitionCount = 2;
+        while(vertexStageOtherBytes + inCoreVertexTemporaryBytes / double(recommendedPartitionCount)
+            > usableBytes) {
+            recommendedPartitionCount *= 2;
+        }
+    }
+}
+
+
+
+// Scale the elapsed and cpu time and the peak mapped bytes of each stage
+// of a previous assembly by the ratio of the numbers of raw bases.
+void AssemblyPlanner::calibrate()
+{
+    // Get the number of raw bases of the previous assembly
+    // from the last line of its read length histogram.
+    const string histogramFileName = calibrationDirectory + "/ReadLengthHistogram.csv";
+    ifstream histogram(histogramFileName);
+    if(!histogram) {
+        throw runtime_error("Unable to open " + histogramFileName);
+    }
+    string line;
+    string lastLine;
+    getline(histogram, line);   // Skip the header.
+    while(getline(histogram, line)) {
+        if(!line.empty()) {
+            lastLine = line;
+        }
+    }
+    vector<string> tokens;
+    boost::algorithm::split(tokens, lastLine, boost::algorithm::is_any_of(","));
+    if(tokens.size() < 5) {
+        throw runtime_error("Unexpected format of " + histogramFileName);
+    }
+    const double calibrationRawBaseCount = std::stod(tokens[4]);
+    const double ratio = rawBaseCount / calibrationRawBaseCount;
+
+    const string reportFileName = calibrationDirectory + "/PerformanceReport.csv";
+    ifstream report(reportFileName);
+    if(!report) {
+        throw runtime_error("Unable to open " + reportFileName);
+    }
+    getline(report, line);   // Skip the header.
+    while(getline(report, line)) {
+        boost::algorithm::split(tokens, line, boost::algorithm::is_any_of(","));
+        if(tokens.size() < 10) {
+            continue;
+        }
+        for(Stage& stage: stages) {
+            if(stage.name == tokens[0]) {
+                stage.isCalibrated = true;
+                stage.calibratedElapsedSeconds = ratio * std::stod(tokens[1]);
+                stage.calibratedCpuSeconds = ratio * (std::stod(tokens[2]) + std::stod(tokens[3]));
+                stage.calibratedPeakBytes = ratio * std::stod(tokens[9]);
+            }
+        }
+    }
+}
+
+
+
+void AssemblyPlanner::write(ostream& s) const
+{
+    const double GB = 1024. * 1024. * 1024.;
+    const auto flags = s.flags();
+    s << std::fixed << std::setprecision(1);
+
+    s << "\nEstimated input:\n";
+    s << "Reads: " << readCount << "\n";
+    s << "Raw bases: " << rawBaseCount << "\n";
+    s << "Run-length bases: " << runLengthBaseCount << "\n";
+    s << "Coverage: " << coverage;
+    if(coverageIsAssumed) {
+        s << " (assumed, use Reads.subsampling.genomeSize to specify the genome size)";
+    }
+    s << "\n";
+    s << "Oriented markers: " << orientedMarkerCount << "\n";
+    s << "Alignment candidates: " << alignmentCandidateCount << "\n";
+    s << "Alignments: " << alignmentCount << "\n";
+    s << "Marker graph vertices: " << vertexCount << "\n";
+    s << "Marker graph edges: " << edgeCount << "\n";
+
+    s << "\nEstimated memory in GB for MemoryMapped data";
+    if(!calibrationDirectory.empty()) {
+        s << ", and values scaled from " << calibrationDirectory;
+    }
+    s << ":\n";
+    s << "Stage,Created,Temporary,Peak";
+    if(!calibrationDirectory.empty()) {
+        s << ",CalibratedPeak,CalibratedElapsedSeconds,CalibratedCpuSeconds";
+    }
+    s << "\n";
+    double peakBytes = 0.;
+    double totalElapsedSeconds = 0.;
+    for(const Stage& stage: stages) {
+        s << stage.name << "," <<
+            stage.createdBytes / GB << "," <<
+            stage.temporaryBytes / GB << "," <<
+            stage.peakBytes / GB;
+        peakBytes = max(peakBytes, stage.peakBytes);
+        if(stage.isCalibrated) {
+            s << "," << stage.calibratedPeakBytes / GB << "," <<
+                stage.calibratedElapsedSeconds << "," << stage.calibratedCpuSeconds;
+            peakBytes = max(peakBytes, stage.calibratedPeakBytes);
+            totalElapsedSeconds += stage.calibratedElapsedSeconds;
+        }
+        s << "\n";
+    }
+
+    s << "\nPeak memory: " << peakBytes / GB << " GB.\n";
+    s << "Physical memory: " << double(physicalMemoryBytes) / GB << " GB.\n";
+    s << "Threads: " << threadCount << " (one per hardware thread).\n";
+    if(totalElapsedSeconds > 0.) {
+        s << "Estimated elapsed time: " << totalElapsedSeconds << " s (" <<
+            totalElapsedSeconds / 3600. << " hours).\n";
+    } else {
+        s << "To estimate run times, use --dryRunCalibration to specify the output directory\n"
+            "of a previous assembly done on this machine.\n";
+    }
+
+    // Recommendations.
+    s << "\nRecommendations:\n";
+    const double usableBytes = 0.9 * double(physicalMemoryBytes);
+    const uint64_t partitionCount = assemblyOptions.MarkerGraph.outOfCorePartitionCount;
+    if(recommendedPartitionCount > partitionCount) {
+        s << "createMarkerGraphVertices does not fit in memory in core. Use "
+            "--MarkerGraph.outOfCorePartitionCount " << recommendedPartitionCount <<
+            " --memoryMode filesystem --memoryBacking disk.\n";
+    } else if(peakBytes > usableBytes) {
+        s << "The assembly data do not fit in memory. Use --memoryMode filesystem --memoryBacking disk "
+            "so the data not in use can be paged out, at a large performance cost, "
+            "or use a machine with at least " << std::ceil(peakBytes / (0.9 * GB)) << " GB of memory.\n";
+    } else if(peakBytes > 16. * GB) {
+        s << "Use 2 MB pages: --memoryMode filesystem --memoryBacking 2M (requires root privilege via sudo), "
+            "or --memoryBacking 2M --hugePageMode transparent.\n";
+    } else {
+        s << "The assembly fits comfortably in memory. 4 KB pages are sufficient.\n";
+    }
+    if(memoryMode == "anonymous" && peakBytes > usableBytes) {
+        s << "The current --memoryMode anonymous can cause the assembly to fail "
+            "when memory is exhausted.\n";
+    }
+    if(memoryBacking == "2M" && peakBytes > double(physicalMemoryBytes) - 8. * GB) {
+        s << "The current --memoryBacking 2M can use at most " <<
+            (double(physicalMemoryBytes) - 8. * GB) / GB << " GB on 2 MB pages.\n";
+    }
+
+    s.flags(flags);
+    s << std::flush;
+}
@@ -0,0 +1,123 @@
+#ifndef CZI_SHASTA_ASSEMBLY_PLANNER_HPP
+#define CZI_SHASTA_ASSEMBLY_PLANNER_HPP
+
+/*******************************************************************************
+
+Class AssemblyPlanner implements "--command dryRun" of the static executable.
+It estimates, before running an assembly, the memory used by the
+MemoryMapped data structures of each stage and, optionally, its run time,
+and recommends the memory options to use.
+
+The input is characterized by sampling the first reads of each input file.
+The total number of reads and bases is extrapolated from the fraction
+of the file (compressed, if applicable) consumed by the sample.
+
+The numbers of markers, alignment candidates, alignments, marker graph
+vertices and edges are then estimated from the options, and each
+data structure is sized using the sizes of the classes it stores.
+Some of these estimates use typical ratios (for example, the fraction
+of alignment candidates that result in a good alignment),
+so they are only approximate.
+
+Run times cannot be estimated from first principles. If the output
+directory of a previous assembly done on the same machine is given
+for calibration, the elapsed and cpu time of each stage of that
+assembly, as well as its peak mapped bytes, are scaled
+by the ratio of the number of raw bases.
+
+*******************************************************************************/
+
+// Standard library.
+#include "cstdint.hpp"
+#include "iostream.hpp"
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class AssemblyOptions;
+        class AssemblyPlanner;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::AssemblyPlanner {
+public:
+
+    AssemblyPlanner(
+        const AssemblyOptions&,
+        const vector<string>& inputFastaFileNames,
+        uint64_t sampleReadCount,
+        const string& calibrationDirectory,
+        const string& memoryMode,
+        const string& memoryBacking);
+
+    // Write the estimates and recommendations.
+    void write(ostream&) const;
+
+private:
+    const AssemblyOptions& assemblyOptions;
+    string memoryMode;
+    string memoryBacking;
+
+    // Estimated characteristics of the input.
+    double readCount = 0.;
+    double rawBaseCount = 0.;
+    double runLengthBaseCount = 0.;
+    double readNameByteCount = 0.;
+    double inputByteCount = 0.;
+    double coverage = 0.;
+    bool coverageIsAssumed = false;
+    void sampleReads(const string& fileName, uint64_t sampleReadCount);
+
+    // Estimated counts of the main objects.
+    double orientedMarkerCount = 0.;
+    double alignmentCandidateCount = 0.;
+    double alignmentCount = 0.;
+    double readGraphEdgeCount = 0.;
+    double vertexCount = 0.;
+    double edgeCount = 0.;
+
+    // The estimates for each stage.
+    class Stage {
+    public:
+        string name;
+
+        // The bytes of the data created by the stage,
+        // which remain mapped for the rest of the assembly.
+        double createdBytes = 0.;
+
+        // The peak bytes of the temporary data of the stage.
+        double temporaryBytes = 0.;
+
+        // The peak bytes mapped during the stage:
+        // data created by this and previous stages, plus temporary data.
+        double peakBytes = 0.;
+
+        // The same, scaled from the calibration assembly, if available.
+        double calibratedPeakBytes = 0.;
+        double calibratedElapsedSeconds = 0.;
+        double calibratedCpuSeconds = 0.;
+        bool isCalibrated = false;
+
+        Stage(const string& name, double createdBytes, double temporaryBytes) :
+            name(name), createdBytes(createdBytes), temporaryBytes(temporaryBytes) {}
+    };
+    vector<Stage> stages;
+    void estimateStages();
+
+    // The temporary bytes of createMarkerGraphVertices
+    // without and with the out of core mode.
+    double inCoreVertexTemporaryBytes = 0.;
+    uint64_t recommendedPartitionCount = 0;
+
+    // Calibration from the output directory of a previous assembly.
+    string calibrationDirectory;
+    void calibrate();
+
+    uint64_t physicalMemoryBytes;
+    uint64_t threadCount;
+};
+
+#endif
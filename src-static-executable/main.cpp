@@ -7,9 +7,18 @@
 // Shasta.
 #include "Assembler.hpp"
 #include "AssemblyOptions.hpp"
+#include "AssemblyPlanner.hpp"
 #include "buildId.hpp"
 #include "filesystem.hpp"
+#include "HardwareCounters.hpp"
+#include "HugePages.hpp"
+#include "MurmurHash2.hpp"
+#include "Numa.hpp"
+#include "PersistentMemory.hpp"
+#include "Progress.hpp"
+#include "ThreadLog.hpp"
 #include "timestamp.hpp"
+#include "UrlReader.hpp"
 namespace ChanZuckerberg {
     namespace shasta {
         namespace main {
@@ -18,7 +27,16 @@ namespace ChanZuckerberg {
                 Assembler&,
                 const AssemblyOptions&,
                 vector<string> inputFastaFileNames);
+            void computeStageParametersHashes(
+                const AssemblyOptions&,
+                const vector<string>& inputFastaFileNames,
+                vector< pair<string, uint64_t> >&);
             void setupHugePages();
+            void setupPersistentMemory(
+                const string& persistentMemoryDirectory,
+                const string& persistentMemoryObjects,
+                bool resume);
+            void cleanupPersistentMemory(const string& linkName);
         }
         class AssemblyOptions;
     }
@@ -28,6 +46,7 @@ using namespace shasta;
 
 // Boost libraries.
 #include <boost/program_options.hpp>
+#include <boost/tokenizer.hpp>
 
 //  Linux.
 #include <stdlib.h>
@@ -35,8 +54,10 @@ using namespace shasta;
 
 // Standard library.
 #include "fstream.hpp"
+#include <future>
 #include "iostream.hpp"
 #include "iterator.hpp"
+#include <sstream>
 #include "stdexcept.hpp"
 
 
@@ -100,9 +121,20 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
     string configFileName;
     vector < string > inputFastaFileNames;
     string outputDirectory;
+    string previousRunDirectory;
     string command;
     string memoryMode;
     string memoryBacking;
+    string numaMode;
+    string hugePageMode;
+    uint64_t addressSpaceReservationGigabytes = 0;
+    string persistentMemoryDirectory;
+    string persistentMemoryObjects;
+    double progressInterval = 60.;
+    string logLevel;
+    string dataLifetime;
+    uint64_t dryRunSampleReadCount = 10000;
+    string dryRunCalibrationDirectory;
     commandLineOnlyOptions.add_options()
 
         ("help", 
@@ -114,12 +146,33 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
 
         ("input",
         value< vector<string> >(&inputFastaFileNames)->multitoken(),
-        "Names of input FASTA files. Specify at least one.")
+        "Names of input FASTA or FASTQ files, optionally compressed with gzip or bgzip. "
+        "Each can also be an http(s), s3, or gs URL, or - for standard input. "
+        "Specify at least one.")
 
         ("output",
         value<string>(&outputDirectory)->
         default_value("ShastaRun"),
-        "Name of the output directory. Must not exist.")
+        "Name of the output directory. Must not exist, unless --resume is used.")
+
+        ("resume",
+        "Resume an assembly that did not complete, "
+        "using the checkpoints recorded in the output directory. "
+        "Stages that completed are not repeated. "
+        "This is only possible if the assembly used --memoryMode filesystem, "
+        "and the same options must be used.")
+
+        ("reuse",
+        value<string>(&previousRunDirectory),
+        "Output directory of a previous assembly done with --memoryMode filesystem, "
+        "for example with different values of some parameters. "
+        "The stages of that assembly that used the same input files "
+        "and the same parameters, and only follow stages that did, "
+        "are not repeated. Their data are hard linked into the Data directory "
+        "of the new assembly, or copied if later stages modify them "
+        "(as reflinks if the filesystem supports it). "
+        "Other output files of the reused stages are not copied. "
+        "Requires --memoryMode filesystem --memoryBacking disk.")
 
         ("command",
         value<string>(&command)->
@@ -127,7 +180,54 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
         "Command to run. Must be one of:\n"
         "assemble (default): run an assembly\n"
         "cleanup: cleanup the Data directory that was created during assembly\n"
-        "    if --memoryMode filesystem.\n")
+        "    if --memoryMode filesystem.\n"
+        "dryRun: estimate the memory used by each assembly stage, "
+        "and its run time if --dryRunCalibration is used, "
+        "and recommend memory options. "
+        "Does not create the output directory.\n")
+
+        ("dryRunSampleReadCount",
+        value<uint64_t>(&dryRunSampleReadCount)->
+        default_value(10000),
+        "For --command dryRun, the number of reads sampled "
+        "at the beginning of each input file.")
+
+        ("dryRunCalibration",
+        value<string>(&dryRunCalibrationDirectory),
+        "For --command dryRun, the output directory of a previous assembly "
+        "done on the same machine. Its run time and memory for each stage "
+        "are scaled to the number of bases of the new assembly.")
+
+        ("progressInterval",
+        value<double>(&progressInterval)->
+        default_value(60.),
+        "Interval in seconds between progress messages, which report "
+        "throughput and estimated time remaining for the stage running. "
+        "0 turns off progress messages.")
+
+        ("logLevel",
+        value<string>(&logLevel)->
+        default_value("info"),
+        "Minimum level of the messages written by the threads of each stage. "
+        "Allowed values: debug, info (default), warning, error.")
+
+        ("dataLifetime",
+        value<string>(&dataLifetime)->
+        default_value("keep"),
+        "Specify what happens to intermediate data (alignment candidates, "
+        "alignments, read graph, and similar) after the last stage that uses them, "
+        "to reduce peak memory.\n"
+        "Allowed values: keep (default), close, remove. "
+        "close unmaps them, but keeps their files, so checkpoints remain valid. "
+        "This frees memory with --memoryMode anonymous or --memoryBacking disk. "
+        "remove also removes their files, which also frees memory when "
+        "--memoryMode filesystem uses a memory backed filesystem, "
+        "but cannot be used with --resume or --reuse, and disables checkpoints.")
+
+        ("hardwareCounters",
+        "Count cpu cycles, instructions, cache misses and TLB misses "
+        "in the threads of each stage using perf_event_open (Linux only), "
+        "and add them to the performance report.")
 
 #ifdef __linux__
         ("memoryMode",
@@ -140,11 +240,62 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
         value<string>(&memoryBacking)->
         default_value("4K"),
         "Specify the type of pages used to back memory.\n"
-        "Allowed values: disk, 4K (default), 2M (for best performance, Linux only). "
+        "Allowed values: disk, 4K (default), 2M (for best performance, Linux only), "
+        "1G (1GB pages reserved in advance, for data structures of at least 1 GB, "
+        "with fallback to 2MB pages, Linux only). "
         "All combinations (memoryMode, memoryBacking) are allowed "
-        "except for (anonymous, disk).\n"
+        "except for (anonymous, disk) and (filesystem, 1G).\n"
         "Some combinations require root privilege, which is obtained using sudo "
         "and may result in a password prompting depending on your sudo set up.")
+
+        ("numaMode",
+        value<string>(&numaMode)->
+        default_value("none"),
+        "Specify how threads and memory are placed on machines "
+        "with more than one NUMA node (Linux only).\n"
+        "Allowed values: none (default), interleave, firstTouch. "
+        "Both interleave and firstTouch pin threads to cpus. "
+        "interleave spreads all memory evenly over the NUMA nodes. "
+        "firstTouch places each part of large data structures "
+        "on the NUMA node of the thread that processes it.")
+
+        ("hugePageMode",
+        value<string>(&hugePageMode)->
+        default_value("hugetlb"),
+        "Specify how memory is backed by 2MB pages when using --memoryBacking 2M "
+        "(Linux only).\n"
+        "Allowed values: hugetlb (default), transparent. "
+        "hugetlb uses hugetlb pages, which requires root privilege via sudo "
+        "to allow their allocation. "
+        "transparent uses 2MB aligned memory and asks the kernel to back it with "
+        "transparent huge pages. This does not require root privilege "
+        "for --memoryMode anonymous.")
+
+        ("addressSpaceReservation",
+        value<uint64_t>(&addressSpaceReservationGigabytes)->
+        default_value(0),
+        "If not zero, each large data structure reserves this amount of address space, "
+        "in gigabytes, without using any memory, "
+        "so it can grow in place without being remapped or copied (Linux only). "
+        "Default is 0 (no reservation).")
+
+        ("persistentMemoryDirectory",
+        value<string>(&persistentMemoryDirectory),
+        "A directory on persistent memory or CXL-attached memory, "
+        "on a filesystem mounted with the dax option (Linux only). "
+        "If specified, the data structures listed in --persistentMemoryObjects "
+        "are stored there instead of in DRAM and mapped with MAP_SYNC, "
+        "so the assembly can use more memory than the available DRAM. "
+        "Cannot be used with --reuse.")
+
+        ("persistentMemoryObjects",
+        value<string>(&persistentMemoryObjects)->
+        default_value("Reads,Markers,GlobalMarkerGraphEdgeMarkerIntervals"),
+        "Comma separated names of the data structures stored "
+        "in --persistentMemoryDirectory (Linux only). "
+        "These should be large data structures that are mostly read after "
+        "they are created. The names are the ones of the files in the Data directory "
+        "when using --memoryMode filesystem, without suffixes.")
 #endif
         ;
 
@@ -156,6 +307,8 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
 #ifndef __linux__
     memoryMode = "filesystem";
     memoryBacking = "disk";
+    numaMode = "none";
+    hugePageMode = "hugetlb";
 #endif
 
 
@@ -198,6 +351,7 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
 
     // If command is "cleanup", just do it and exit.
     if(command == "cleanup") {
+        cleanupPersistentMemory(outputDirectory + "/PersistentMemoryData");
         const string dataDirectory = outputDirectory + "/Data";
         if(!filesystem::exists(dataDirectory)) {
             cout << dataDirectory << " does not exist, nothing done." << endl;
@@ -214,8 +368,10 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
 
 
 
-    // Check that we have at least one input FASTA file.     
-    if (inputFastaFileNames.empty()) {
+    // Check that we have at least one input FASTA file.
+    // When resuming, the reads were already stored.
+    const bool resume = (variablesMap.count("resume") != 0);
+    if (inputFastaFileNames.empty() && !resume) {
         cout << executableDescription << commandLineOptions << endl;
         throw runtime_error("Specify at least one input FASTA file.");
     }
@@ -232,9 +388,141 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
     if(assemblyOptions.Assembly.useMarginPhase != "False") {
         throw runtime_error("Assembly.useMarginPhase is not supported by the Shasta static executable.");
     }
+    if(assemblyOptions.Assembly.useGpuConsensus != "False") {
+        throw runtime_error("Assembly.useGpuConsensus is not supported by the Shasta static executable.");
+    }
     if(assemblyOptions.Assembly.storeCoverageData != "False") {
         throw runtime_error("Assembly.storeCoverageData is not supported by the Shasta static executable.");
     }
+    if( assemblyOptions.Assembly.compressCoverageData != "False" &&
+        assemblyOptions.Assembly.compressCoverageData != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.Assembly.compressCoverageData +
+            " specified for Assembly.compressCoverageData. Must be False or True.");
+    }
+    if( assemblyOptions.Reads.compressRepeatCounts != "False" &&
+        assemblyOptions.Reads.compressRepeatCounts != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.Reads.compressRepeatCounts +
+            " specified for Reads.compressRepeatCounts. Must be False or True.");
+    }
+    if(assemblyOptions.Reads.subsampling.targetCoverage < 0.) {
+        throw runtime_error("Invalid value specified for Reads.subsampling.targetCoverage. "
+            "Must be zero (no subsampling) or positive.");
+    }
+    if(assemblyOptions.Reads.subsampling.targetCoverage > 0. &&
+        assemblyOptions.Reads.subsampling.genomeSize == 0) {
+        throw runtime_error("Reads.subsampling.genomeSize must be specified "
+            "when Reads.subsampling.targetCoverage is not zero.");
+    }
+    if( assemblyOptions.Assembly.bgzipOutput != "False" &&
+        assemblyOptions.Assembly.bgzipOutput != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.Assembly.bgzipOutput +
+            " specified for Assembly.bgzipOutput. Must be False or True.");
+    }
+    if( assemblyOptions.Assembly.fusedOutput != "False" &&
+        assemblyOptions.Assembly.fusedOutput != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.Assembly.fusedOutput +
+            " specified for Assembly.fusedOutput. Must be False or True.");
+    }
+    if( assemblyOptions.Assembly.storeAssembledSequences != "False" &&
+        assemblyOptions.Assembly.storeAssembledSequences != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.Assembly.storeAssembledSequences +
+            " specified for Assembly.storeAssembledSequences. Must be False or True.");
+    }
+    if( assemblyOptions.Assembly.storeAssembledSequences == "False" &&
+        assemblyOptions.Assembly.fusedOutput != "True") {
+        throw runtime_error("Assembly.storeAssembledSequences = False "
+            "requires Assembly.fusedOutput = True.");
+    }
+    if(assemblyOptions.Assembly.starAlignmentLengthThreshold < 0) {
+        throw runtime_error("Invalid value " + to_string(assemblyOptions.Assembly.starAlignmentLengthThreshold) +
+            " specified for Assembly.starAlignmentLengthThreshold. Must not be negative.");
+    }
+    if(assemblyOptions.Kmers.generationMethod != 0 && assemblyOptions.Kmers.generationMethod != 1) {
+        throw runtime_error("Invalid value " + to_string(assemblyOptions.Kmers.generationMethod) +
+            " specified for Kmers.generationMethod. Must be 0 or 1.");
+    }
+    if(assemblyOptions.MinHash.lowHashMethod != 0 && assemblyOptions.MinHash.lowHashMethod != 1) {
+        throw runtime_error("Invalid value " + to_string(assemblyOptions.MinHash.lowHashMethod) +
+            " specified for MinHash.lowHashMethod. Must be 0 or 1.");
+    }
+    if(assemblyOptions.MinHash.candidateTableMegabytes < 0) {
+        throw runtime_error("Invalid value " + to_string(assemblyOptions.MinHash.candidateTableMegabytes) +
+            " specified for MinHash.candidateTableMegabytes. Must not be negative.");
+    }
+    if(assemblyOptions.MinHash.singlePassHashing != "False" && assemblyOptions.MinHash.singlePassHashing != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.MinHash.singlePassHashing +
+            " specified for MinHash.singlePassHashing. Must be False or True.");
+    }
+    if(assemblyOptions.MinHash.storeSketches != "False" && assemblyOptions.MinHash.storeSketches != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.MinHash.storeSketches +
+            " specified for MinHash.storeSketches. Must be False or True.");
+    }
+    if(assemblyOptions.MinHash.sketchSize < 0) {
+        throw runtime_error("Invalid value " + to_string(assemblyOptions.MinHash.sketchSize) +
+            " specified for MinHash.sketchSize. Must not be negative.");
+    }
+    if(assemblyOptions.Align.bandWidth < 0) {
+        throw runtime_error("Invalid value " + to_string(assemblyOptions.Align.bandWidth) +
+            " specified for Align.bandWidth. Must not be negative.");
+    }
+    if(assemblyOptions.Align.alignMethod != 0 && assemblyOptions.Align.alignMethod != 1) {
+        throw runtime_error("Invalid value " + to_string(assemblyOptions.Align.alignMethod) +
+            " specified for Align.alignMethod. Must be 0 or 1.");
+    }
+    if(assemblyOptions.Align.storeAlignments != "False" && assemblyOptions.Align.storeAlignments != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.Align.storeAlignments +
+            " specified for Align.storeAlignments. Must be False or True.");
+    }
+    if(assemblyOptions.Align.groupCandidates != "False" && assemblyOptions.Align.groupCandidates != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.Align.groupCandidates +
+            " specified for Align.groupCandidates. Must be False or True.");
+    }
+    if(assemblyOptions.MarkerGraph.unionBufferSize < 0) {
+        throw runtime_error("Invalid value " + to_string(assemblyOptions.MarkerGraph.unionBufferSize) +
+            " specified for MarkerGraph.unionBufferSize. Must not be negative.");
+    }
+    if(assemblyOptions.MarkerGraph.outOfCorePartitionCount < 0) {
+        throw runtime_error("Invalid value " + to_string(assemblyOptions.MarkerGraph.outOfCorePartitionCount) +
+            " specified for MarkerGraph.outOfCorePartitionCount. Must not be negative.");
+    }
+    if( assemblyOptions.ReadGraph.renumberReads != "False" &&
+        assemblyOptions.ReadGraph.renumberReads != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.ReadGraph.renumberReads +
+            " specified for ReadGraph.renumberReads. Must be False or True.");
+    }
+    if( assemblyOptions.MarkerGraph.storeDisjointSetTable != "False" &&
+        assemblyOptions.MarkerGraph.storeDisjointSetTable != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.MarkerGraph.storeDisjointSetTable +
+            " specified for MarkerGraph.storeDisjointSetTable. Must be False or True.");
+    }
+    if( assemblyOptions.MarkerGraph.canonicalEdgeMarkerIntervals != "False" &&
+        assemblyOptions.MarkerGraph.canonicalEdgeMarkerIntervals != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.MarkerGraph.canonicalEdgeMarkerIntervals +
+            " specified for MarkerGraph.canonicalEdgeMarkerIntervals. Must be False or True.");
+    }
+    if( assemblyOptions.MarkerGraph.compressEdgeMarkerIntervals != "False" &&
+        assemblyOptions.MarkerGraph.compressEdgeMarkerIntervals != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.MarkerGraph.compressEdgeMarkerIntervals +
+            " specified for MarkerGraph.compressEdgeMarkerIntervals. Must be False or True.");
+    }
+    if( assemblyOptions.MarkerGraph.renumber != "False" &&
+        assemblyOptions.MarkerGraph.renumber != "True") {
+        throw runtime_error("Invalid value " + assemblyOptions.MarkerGraph.renumber +
+            " specified for MarkerGraph.renumber. Must be False or True.");
+    }
+
+    // If command is "dryRun", write the estimates and exit.
+    if(command == "dryRun") {
+        const AssemblyPlanner planner(
+            assemblyOptions,
+            inputFastaFileNames,
+            dryRunSampleReadCount,
+            dryRunCalibrationDirectory,
+            memoryMode,
+            memoryBacking);
+        planner.write(cout);
+        return;
+    }
 
     // Write a startup message.
     cout << timestamp <<
@@ -249,20 +537,87 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
         "Complete documentation for the latest version of Shasta is available here:\n"
         "https://chanzuckerberg.github.io/shasta\n\n";
 
+    // Set up NUMA thread and memory placement.
+    // This must be done before any memory is allocated.
+    // The assembly always uses one thread per hardware thread.
+    Numa::setMode(numaMode, 0);
+    HugePages::setMode(hugePageMode);
+    HardwareCounters::setEnabled(variablesMap.count("hardwareCounters") != 0);
+    ThreadLog::setMinimumLevel(logLevel);
+    MemoryMapped::AddressSpaceReservation::setByteCount(
+        addressSpaceReservationGigabytes * 1024ULL * 1024ULL * 1024ULL);
+
     // Find absolute paths of the input fasta files.
     // We will use them below after changing directory to the output directory.
+    // URLs and "-" (standard input) are used unchanged.
     vector<string> inputFastaFileAbsolutePaths;
     for(const string& inputFastaFileName: inputFastaFileNames) {
-        inputFastaFileAbsolutePaths.push_back(filesystem::getAbsolutePath(inputFastaFileName));
+        if(UrlReader::isUrl(inputFastaFileName) || inputFastaFileName == "-") {
+            inputFastaFileAbsolutePaths.push_back(inputFastaFileName);
+        } else {
+            inputFastaFileAbsolutePaths.push_back(filesystem::getAbsolutePath(inputFastaFileName));
+        }
+    }
+
+    // The persistent memory directory is used
+    // after changing directory to the output directory.
+    if(!persistentMemoryDirectory.empty()) {
+        if(!previousRunDirectory.empty()) {
+            throw runtime_error("--persistentMemoryDirectory cannot be used with --reuse.");
+        }
+        if(!filesystem::isDirectory(persistentMemoryDirectory)) {
+            throw runtime_error("Directory " + persistentMemoryDirectory +
+                " specified by --persistentMemoryDirectory does not exist.");
+        }
+        persistentMemoryDirectory = filesystem::getAbsolutePath(persistentMemoryDirectory);
+    }
+
+    // Check the data lifetime policy.
+    // Removing data is not compatible with checkpoints.
+    if(dataLifetime != "keep" && dataLifetime != "close" && dataLifetime != "remove") {
+        throw runtime_error("Invalid value specified for --dataLifetime: " + dataLifetime +
+            "\nValid values are: keep, close, remove.");
+    }
+    if(dataLifetime == "remove" && (resume || !previousRunDirectory.empty())) {
+        throw runtime_error("--dataLifetime remove cannot be used with --resume or --reuse.");
+    }
+
+    // Stages can only be reused if the data of the new assembly
+    // are on disk, and the data of the previous assembly persisted.
+    const bool reuse = !previousRunDirectory.empty();
+    if(reuse) {
+        if(resume) {
+            throw runtime_error("--reuse cannot be used together with --resume.");
+        }
+        if(memoryMode != "filesystem" || memoryBacking != "disk") {
+            throw runtime_error("--reuse can only be used with "
+                "--memoryMode filesystem --memoryBacking disk.");
+        }
+        if(!filesystem::isDirectory(previousRunDirectory)) {
+            throw runtime_error("Directory " + previousRunDirectory + " specified by --reuse "
+                "does not exist.");
+        }
+        previousRunDirectory = filesystem::getAbsolutePath(previousRunDirectory);
     }
 
     // If the output directory exists, stop.
     // Otherwise, create it and make it current.
-    if(filesystem::exists(outputDirectory)) {
-        throw runtime_error("Output directory " + outputDirectory + " already exists.\n"
-            "Remove it or use --output to specify a different output directory.");
+    // When resuming, it must exist and is made current.
+    if(resume) {
+        if(memoryMode != "filesystem") {
+            throw runtime_error("--resume can only be used with --memoryMode filesystem.");
+        }
+        if(!filesystem::exists(outputDirectory)) {
+            throw runtime_error("Output directory " + outputDirectory + " does not exist.\n"
+                "There is no assembly to resume.");
+        }
+    } else {
+        if(filesystem::exists(outputDirectory)) {
+            throw runtime_error("Output directory " + outputDirectory + " already exists.\n"
+                "Remove it or use --output to specify a different output directory.");
+        }
+        filesystem::createDirectory(outputDirectory);
     }
-    filesystem::createDirectory(outputDirectory);
     filesystem::changeDirectory(outputDirectory);
 
 
@@ -293,12 +648,40 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
             // and may result in a password prompting depending on sudo set up.
             // Root privilege is not required if 2M pages have already
             // been set up as required.
-            setupHugePages();
+            // If the set up fails, fall back to transparent huge pages,
+            // which don't require root privilege.
+            if(HugePages::getMode() == HugePages::Mode::hugetlb) {
+                try {
+                    setupHugePages();
+                } catch(const std::exception& e) {
+                    cout << e.what() << "\nUsing transparent huge pages instead." << endl;
+                    HugePages::setMode("transparent");
+                }
+            }
             pageSize = 2 * 1024 * 1024;
 
+        } else if(memoryBacking == "1G") {
+
+            // Anonymous memory on 1GB pages, for data structures
+            // of at least 1 GB, and 2MB pages for smaller ones.
+            // The 1GB pages must have been reserved in advance,
+            // at boot time or via
+            // /sys/kernel/mm/hugepages/hugepages-1048576kB/nr_hugepages.
+            // If none are available, fall back to 2MB pages,
+            // which are set up as for --memoryBacking 2M.
+            if(HugePages::getMode() == HugePages::Mode::hugetlb) {
+                try {
+                    setupHugePages();
+                } catch(const std::exception& e) {
+                    cout << e.what() << "\nUsing transparent huge pages "
+                        "for allocations that don't get 1GB pages." << endl;
+                }
+            }
+            pageSize = HugePages::giganticHugePageSize;
+
         } else {
             throw runtime_error("Invalid value specified for --memoryBacking: " + memoryBacking +
-                "\nValid values are: disk, 4K, 2M.");
+                "\nValid values are: disk, 4K, 2M, 1G.");
         }
 
     } else if(memoryMode == "filesystem") {
@@ -307,7 +690,9 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
 
             // Binary files on disk.
             // This does not require root privilege.
-            filesystem::createDirectory("Data");
+            if(!resume) {
+                filesystem::createDirectory("Data");
+            }
             dataDirectory = "Data/";
             pageSize = 4096;
 
@@ -317,14 +702,17 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
             // (filesystem in memory backed by 4K pages).
             // This requires root privilege, which is obtained using sudo
             // and may result in a password prompting depending on sudo set up.
-            filesystem::createDirectory("Data");
+            // When resuming, it is still mounted.
             dataDirectory = "Data/";
             pageSize = 4096;
-            const string command = "sudo mount -t tmpfs -o size=0 tmpfs Data";
-            const int errorCode = ::system(command.c_str());
-            if(errorCode != 0) {
-                throw runtime_error("Error " + to_string(errorCode) + ": " + strerror(errorCode) +
-                    " running command: " + command);
+            if(!resume) {
+                filesystem::createDirectory("Data");
+                const string command = "sudo mount -t tmpfs -o size=0 tmpfs Data";
+                const int errorCode = ::system(command.c_str());
+                if(errorCode != 0) {
+                    throw runtime_error("Error " + to_string(errorCode) + ": " + strerror(errorCode) +
+                        " running command: " + command);
+                }
             }
 
         } else if(memoryBacking == "2M") {
@@ -333,22 +721,46 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
             // (filesystem in memory backed by 2M pages).
             // This requires root privilege, which is obtained using sudo
             // and may result in a password prompting depending on sudo set up.
-            setupHugePages();
-            filesystem::createDirectory("Data");
+            // When resuming, it is still mounted.
+            // With --hugePageMode transparent, the files are instead on
+            // a tmpfs filesystem that uses transparent huge pages when advised.
             dataDirectory = "Data/";
             pageSize = 2 * 1024 * 1024;
-            const uid_t userId = ::getuid();
-            const gid_t groupId = ::getgid();
-            const string command = "sudo mount -t hugetlbfs -o pagesize=2M"
-                ",uid=" + to_string(userId) +
-                ",gid=" + to_string(groupId) +
-                " none Data";
-            const int errorCode = ::system(command.c_str());
-            if(errorCode != 0) {
-                throw runtime_error("Error " + to_string(errorCode) + ": " + strerror(errorCode) +
-                    " running command: " + command);
+            if(HugePages::getMode() == HugePages::Mode::transparent) {
+                if(!resume) {
+                    filesystem::createDirectory("Data");
+                    const string command = "sudo mount -t tmpfs -o size=0,huge=advise tmpfs Data";
+                    const int errorCode = ::system(command.c_str());
+                    if(errorCode != 0) {
+                        throw runtime_error("Error " + to_string(errorCode) + ": " + strerror(errorCode) +
+                            " running command: " + command);
+                    }
+                }
+            } else {
+                setupHugePages();
+                if(!resume) {
+                    filesystem::createDirectory("Data");
+                    const uid_t userId = ::getuid();
+                    const gid_t groupId = ::getgid();
+                    const string command = "sudo mount -t hugetlbfs -o pagesize=2M"
+                        ",uid=" + to_string(userId) +
+                        ",gid=" + to_string(groupId) +
+                        " none Data";
+                    const int errorCode = ::system(command.c_str());
+                    if(errorCode != 0) {
+                        throw runtime_error("Error " + to_string(errorCode) + ": " + strerror(errorCode) +
+                            " running command: " + command);
+                    }
+                }
             }
 
+        } else if(memoryBacking == "1G") {
+
+            // This would require a hugetlbfs filesystem with 1GB pages,
+            // and every file would use at least 1 GB.
+            throw runtime_error("\"--memoryMode filesystem\" is not allowed in combination "
+                "with \"--memoryBacking 1G\".");
+
         } else {
             throw runtime_error("Invalid value specified for --memoryBacking: " + memoryBacking +
                 "\nValid values are: disk, 4K, 2M.");
@@ -367,21 +779,91 @@ void ChanZuckerberg::shasta::main::main(int argumentCount, const char** argument
     copy(inputFastaFileNames.begin(), inputFastaFileNames.end(), ostream_iterator<string>(cout, " "));
     cout << endl;
     cout << "outputDirectory = " << outputDirectory << endl;
+    cout << "progressInterval = " << progressInterval << endl;
+    cout << "logLevel = " << logLevel << endl;
+    cout << "dataLifetime = " << dataLifetime << endl;
 #ifdef __linux__
     cout << "memoryMode = " << memoryMode << endl;
-    cout << "memoryBacking = " << memoryBacking << "\n" << endl;
+    cout << "memoryBacking = " << memoryBacking << endl;
+    cout << "numaMode = " << numaMode << endl;
+    cout << "addressSpaceReservation = " << addressSpaceReservationGigabytes << "\n" << endl;
+    if(!persistentMemoryDirectory.empty()) {
+        setupPersistentMemory(persistentMemoryDirectory, persistentMemoryObjects, resume);
+        cout << PersistentMemory::getDescription() << "\n" << endl;
+    }
+    if(Numa::getMode() != Numa::Mode::none) {
+        cout << Numa::getDescription() << "\n" << endl;
+    }
+    if(memoryBacking == "2M") {
+        cout << HugePages::getDescription() << "\n" << endl;
+    }
 #endif
     assemblyOptions.write(cout);
-    {
+    if(resume) {
+
+        // When resuming, the options must be the same as the ones
+        // stored in shasta.conf by the assembly being resumed.
+        std::ostringstream options;
+        assemblyOptions.write(options);
+        ifstream configurationFile("shasta.conf");
+        const string storedOptions(
+            (std::istreambuf_iterator<char>(configurationFile)),
+            std::istreambuf_iterator<char>());
+        if(options.str() != storedOptions) {
+            throw runtime_error("The options in use differ from the ones "
+                "used by the assembly being resumed, stored in " +
+                outputDirectory + "/shasta.conf.");
+        }
+    } else {
         ofstream configurationFile("shasta.conf");
         assemblyOptions.write(configurationFile);
     }
 
+    // The hash of the parameters of each stage, recorded with the checkpoints.
+    vector< pair<string, uint64_t> > stageParametersHashes;
+    computeStageParametersHashes(assemblyOptions, inputFastaFileAbsolutePaths, stageParametersHashes);
+
+    // Populate the Data directory with the stages of the previous assembly
+    // that can be reused. They are then handled as for a resumed assembly.
+    const string checkpointManifestFileName = "CheckpointManifest.csv";
+    const bool reuseStages = reuse && Assembler::reuseCheckpoints(
+        previousRunDirectory, dataDirectory, checkpointManifestFileName, stageParametersHashes);
+
     // Create the Assembler.
-    Assembler assembler(dataDirectory, true, pageSize);
+    // Checkpoints are only useful if the data persist
+    // after the assembly process terminates.
+    Assembler assembler(dataDirectory, !(resume || reuseStages), pageSize);
+    assembler.setCheckpointParameters(stageParametersHashes);
+    assembler.setDataLifetimePolicy(dataLifetime);
+    if(resume || reuseStages) {
+        assembler.resumeFromCheckpoints(checkpointManifestFileName);
+    } else if(memoryMode == "filesystem" && dataLifetime != "remove") {
+        assembler.enableCheckpoints(checkpointManifestFileName);
+    }
+
+    // Run the assembly, with periodic progress messages.
+    {
+        const Progress::Reporter progressReporter(progressInterval);
+        runAssembly(assembler, assemblyOptions, inputFastaFileAbsolutePaths);
+    }
+
+    // Report how much memory ended up on huge pages.
+#ifdef __linux__
+    if(memoryBacking == "2M") {
+        cout << HugePages::getDescription() << endl;
+    }
 
-    // Run the assembly.
-    runAssembly(assembler, assemblyOptions, inputFastaFileAbsolutePaths);
+    // Report the use of persistent memory.
+    // With anonymous memory, nothing else persists after the run,
+    // so the persistent memory files are removed.
+    // The files can be removed while they are still mapped.
+    if(PersistentMemory::isEnabled()) {
+        cout << PersistentMemory::getDescription() << endl;
+        if(memoryMode == "anonymous") {
+            cleanupPersistentMemory("PersistentMemoryData");
+        }
+    }
+#endif
 
     // Final disclaimer message.
 #ifdef __linux
@@ -422,128 +904,496 @@ void ChanZuckerberg::shasta::main::runAssembly(
     // at least for now.
     assembler.setupConsensusCaller("SimpleConsensusCaller");
 
+    // Each stage is measured by a StageTimer,
+    // which adds it to the performance report when it goes out of scope.
+    // When checkpoints are enabled, a checkpoint is recorded
+    // after each stage. Stages that were checkpointed
+    // by an assembly being resumed are skipped.
+    using StageTimer = PerformanceReport::StageTimer;
+    PerformanceReport& performanceReport = assembler.performanceReport;
+
+    // Steps that only write output files that no later stage uses,
+    // and only read data that no later stage modifies, run
+    // in the background, concurrently with the following stages.
+    // They must be single-threaded, because the multithreaded
+    // functions of the Assembler share its load balancing state
+    // and cannot run concurrently with each other.
+    // They don't write to cout, so their output does not interleave
+    // with the output of the stages. Instead, each of them returns
+    // its output, which is written when it is waited for.
+    // Their exceptions are rethrown at the same time.
+    // They are waited for at the end of the assembly, and before
+    // any stage that rewrites data they use.
+    vector< std::future<string> > backgroundTasks;
+    const auto waitForBackgroundTasks = [&backgroundTasks]()
+    {
+        for(std::future<string>& backgroundTask: backgroundTasks) {
+            cout << backgroundTask.get();
+        }
+        backgroundTasks.clear();
+    };
+
+    // After each stage, release the intermediate data
+    // that no later stage uses, as requested by --dataLifetime.
+    // The data used by each stage are declared in AssemblerDataLifetime.cpp.
+
     // Add reads from the specified FASTA files.
-    for(const string& inputFastaFileName: inputFastaFileNames) {
-        assembler.addReadsFromFasta(
-            inputFastaFileName,
+    if(!assembler.isCheckpointed("addReads")) {
+        StageTimer timer(performanceReport, "addReads");
+        assembler.addReadsFromFastaFiles(
+            inputFastaFileNames,
             assemblyOptions.Reads.minReadLength,
             2ULL * 1024ULL * 1024ULL * 1024ULL,
             1,
-            0);
-    }
-    if(assembler.readCount() == 0) {
-        throw runtime_error("There are no input reads.");
-    }
+            0,
+            assemblyOptions.Reads.maxConcurrentFileCount);
+        if(assembler.readCount() == 0) {
+            throw runtime_error("There are no input reads.");
+        }
 
+        // Optionally, replace the read repeat counts
+        // with their compact representation.
+        if(assemblyOptions.Reads.compressRepeatCounts == "True") {
+            assembler.compressReadRepeatCounts(true);
+        }
 
-    // Initialize read flags.
-    assembler.initializeReadFlags();
 
-    // Create a histogram of read lengths.
-    assembler.histogramReadLength("ReadLengthHistogram.csv");
+        // Initialize read flags.
+        assembler.initializeReadFlags();
+
+        // Optionally, keep only the longest reads up to the target coverage.
+        if(assemblyOptions.Reads.subsampling.targetCoverage > 0.) {
+            assembler.subsampleReads(
+                assemblyOptions.Reads.subsampling.targetCoverage,
+                assemblyOptions.Reads.subsampling.genomeSize);
+        }
+
+        // Create a histogram of read lengths, in the background.
+        // This overlaps with the selection of marker k-mers.
+        assembler.writeCheckpoint("addReads");
+        backgroundTasks.push_back(std::async(std::launch::async,
+            [&assembler]()
+            {
+                std::ostringstream out;
+                assembler.histogramReadLength("ReadLengthHistogram.csv", out);
+                return out.str();
+            }));
+    }
+    assembler.releaseUnneededData("addReads");
 
     // Randomly select the k-mers that will be used as markers.
-    assembler.randomlySelectKmers(
-        assemblyOptions.Kmers.k,
-        assemblyOptions.Kmers.probability, 231);
+    if(!assembler.isCheckpointed("selectKmers")) {
+        StageTimer timer(performanceReport, "selectKmers");
+        if(assemblyOptions.Kmers.generationMethod == 0) {
+            assembler.randomlySelectKmers(
+                assemblyOptions.Kmers.k,
+                assemblyOptions.Kmers.probability, 231);
+        } else {
+            assembler.selectKmersBasedOnFrequency(
+                assemblyOptions.Kmers.k,
+                assemblyOptions.Kmers.probability, 231,
+                assemblyOptions.Kmers.enrichmentThreshold, 0);
+        }
+        assembler.writeCheckpoint("selectKmers");
+    }
+    assembler.releaseUnneededData("selectKmers");
 
     // Find the markers in the reads.
-    assembler.findMarkers(0);
+    if(!assembler.isCheckpointed("findMarkers")) {
+        StageTimer timer(performanceReport, "findMarkers");
+        assembler.findMarkers(0);
+        assembler.writeCheckpoint("findMarkers");
+    }
+    assembler.releaseUnneededData("findMarkers");
+
+    // Sort the markers of each oriented read by k-mer id,
+    // so alignment computations don't have to do it each time.
+    if(!assembler.isCheckpointed("computeSortedMarkers")) {
+        StageTimer timer(performanceReport, "computeSortedMarkers");
+        assembler.computeSortedMarkers(0);
+        assembler.writeCheckpoint("computeSortedMarkers");
+    }
+    assembler.releaseUnneededData("computeSortedMarkers");
 
     // Flag palindromic reads.
     // These wil be excluded from further processing.
-    assembler.flagPalindromicReads(
-        assemblyOptions.Reads.palindromicReads.maxSkip,
-        assemblyOptions.Reads.palindromicReads.maxMarkerFrequency,
-        assemblyOptions.Reads.palindromicReads.alignedFractionThreshold,
-        assemblyOptions.Reads.palindromicReads.nearDiagonalFractionThreshold,
-        assemblyOptions.Reads.palindromicReads.deltaThreshold,
-        0);
+    if(!assembler.isCheckpointed("flagPalindromicReads")) {
+        StageTimer timer(performanceReport, "flagPalindromicReads");
+        assembler.flagPalindromicReads(
+            assemblyOptions.Reads.palindromicReads.maxSkip,
+            assemblyOptions.Reads.palindromicReads.maxMarkerFrequency,
+            assemblyOptions.Reads.palindromicReads.alignedFractionThreshold,
+            assemblyOptions.Reads.palindromicReads.nearDiagonalFractionThreshold,
+            assemblyOptions.Reads.palindromicReads.deltaThreshold,
+            0);
+        assembler.writeCheckpoint("flagPalindromicReads");
+    }
+    assembler.releaseUnneededData("flagPalindromicReads");
 
     // Find alignment candidates.
-    assembler.findAlignmentCandidatesLowHash(
-        assemblyOptions.MinHash.m,
-        assemblyOptions.MinHash.hashFraction,
-        assemblyOptions.MinHash.minHashIterationCount,
-        0,
-        assemblyOptions.MinHash.maxBucketSize,
-        assemblyOptions.MinHash.minFrequency,
-        0);
+    if(!assembler.isCheckpointed("findAlignmentCandidates")) {
+        StageTimer timer(performanceReport, "findAlignmentCandidates");
+        if(assemblyOptions.MinHash.sketchSize > 0) {
+            assembler.findAlignmentCandidatesMinHash(
+                assemblyOptions.MinHash.m,
+                assemblyOptions.MinHash.minHashIterationCount,
+                0,
+                assemblyOptions.MinHash.maxBucketSize,
+                assemblyOptions.MinHash.minFrequency,
+                assemblyOptions.MinHash.sketchSize,
+                assemblyOptions.MinHash.lowHashMethod,
+                0);
+        } else {
+            assembler.findAlignmentCandidatesLowHash(
+                assemblyOptions.MinHash.m,
+                assemblyOptions.MinHash.hashFraction,
+                assemblyOptions.MinHash.minHashIterationCount,
+                0,
+                assemblyOptions.MinHash.maxBucketSize,
+                assemblyOptions.MinHash.minFrequency,
+                assemblyOptions.MinHash.lowHashMethod,
+                assemblyOptions.MinHash.candidateTableMegabytes,
+                assemblyOptions.MinHash.singlePassHashing == "True",
+                assemblyOptions.MinHash.storeSketches == "True",
+                assemblyOptions.MinHash.targetCandidatesPerRead,
+                assemblyOptions.Align.maxMarkerFrequency,
+                assemblyOptions.Align.maxSkip,
+                assemblyOptions.Align.minAlignedMarkerCount,
+                assemblyOptions.Align.maxTrim,
+                0);
+        }
+        assembler.writeCheckpoint("findAlignmentCandidates");
+    }
+    assembler.releaseUnneededData("findAlignmentCandidates");
 
 
     // Compute alignments.
-    assembler.computeAlignments(
-        assemblyOptions.Align.maxMarkerFrequency,
-        assemblyOptions.Align.maxSkip,
-        assemblyOptions.Align.minAlignedMarkerCount,
-        assemblyOptions.Align.maxTrim,
-        0);
+    if(!assembler.isCheckpointed("computeAlignments")) {
+        StageTimer timer(performanceReport, "computeAlignments");
+        assembler.computeAlignments(
+            assemblyOptions.Align.maxMarkerFrequency,
+            assemblyOptions.Align.maxSkip,
+            assemblyOptions.Align.minAlignedMarkerCount,
+            assemblyOptions.Align.maxTrim,
+            assemblyOptions.Align.bandWidth,
+            assemblyOptions.Align.alignMethod,
+            assemblyOptions.Align.storeAlignments == "True",
+            assemblyOptions.Align.groupCandidates == "True",
+            false,
+            assemblyOptions.Align.maxAlignmentGraphEdgeCount,
+            0);
+        assembler.writeCheckpoint("computeAlignments");
+    }
+    assembler.releaseUnneededData("computeAlignments");
 
     // Create the read graph.
-    assembler.createReadGraph(
-        assemblyOptions.ReadGraph.maxAlignmentCount,
-        assemblyOptions.Align.maxTrim);
+    if(!assembler.isCheckpointed("createReadGraph")) {
+        StageTimer timer(performanceReport, "createReadGraph");
+        assembler.createReadGraph(
+            assemblyOptions.ReadGraph.maxAlignmentCount,
+            assemblyOptions.Align.maxTrim,
+            0);
 
-    // Flag read graph edges that cross strands.
-    assembler.flagCrossStrandReadGraphEdges();
+        // Flag read graph edges that cross strands.
+        assembler.flagCrossStrandReadGraphEdges();
+        assembler.writeCheckpoint("createReadGraph");
+    }
+    assembler.releaseUnneededData("createReadGraph");
 
     // Flag chimeric reads.
-    assembler.flagChimericReads(assemblyOptions.ReadGraph.maxChimericReadDistance, 0);
-    assembler.computeReadGraphConnectedComponents(assemblyOptions.ReadGraph.minComponentSize);
+    if(!assembler.isCheckpointed("flagChimericReads")) {
+        StageTimer timer(performanceReport, "flagChimericReads");
+        assembler.flagChimericReads(assemblyOptions.ReadGraph.maxChimericReadDistance, 0);
+        assembler.writeCheckpoint("flagChimericReads");
+    }
+    assembler.releaseUnneededData("flagChimericReads");
+    if(!assembler.isCheckpointed("computeReadGraphConnectedComponents")) {
+        StageTimer timer(performanceReport, "computeReadGraphConnectedComponents");
+        assembler.computeReadGraphConnectedComponents(assemblyOptions.ReadGraph.minComponentSize, 0);
+        assembler.writeCheckpoint("computeReadGraphConnectedComponents");
+    }
+    assembler.releaseUnneededData("computeReadGraphConnectedComponents");
+
+    // Renumber the reads for memory locality, if requested.
+    // This stage only exists when requested (see computeStageParametersHashes).
+    if(assemblyOptions.ReadGraph.renumberReads == "True") {
+        if(!assembler.isCheckpointed("renumberReads")) {
+            // This rewrites the reads used by the read length histogram.
+            waitForBackgroundTasks();
+            StageTimer timer(performanceReport, "renumberReads");
+            assembler.renumberReads(0);
+            assembler.writeCheckpoint("renumberReads");
+        }
+        assembler.releaseUnneededData("renumberReads");
+    }
 
     // Create vertices of the marker graph.
-    assembler.createMarkerGraphVertices(
-        assemblyOptions.Align.maxMarkerFrequency,
-        assemblyOptions.Align.maxSkip,
-        assemblyOptions.MarkerGraph.minCoverage,
-        assemblyOptions.MarkerGraph.maxCoverage,
-        0);
-    assembler.findMarkerGraphReverseComplementVertices(0);
+    if(!assembler.isCheckpointed("createMarkerGraphVertices")) {
+        StageTimer timer(performanceReport, "createMarkerGraphVertices");
+        assembler.createMarkerGraphVertices(
+            assemblyOptions.Align.maxMarkerFrequency,
+            assemblyOptions.Align.maxSkip,
+            assemblyOptions.MarkerGraph.minCoverage,
+            assemblyOptions.MarkerGraph.maxCoverage,
+            assemblyOptions.MarkerGraph.unionBufferSize,
+            assemblyOptions.MarkerGraph.outOfCorePartitionCount,
+            assemblyOptions.MarkerGraph.storeDisjointSetTable == "True",
+            0);
+        assembler.findMarkerGraphReverseComplementVertices(0);
+        assembler.writeCheckpoint("createMarkerGraphVertices");
+    }
+    assembler.releaseUnneededData("createMarkerGraphVertices");
 
     // Create edges of the marker graph.
-    assembler.createMarkerGraphEdges(0);
-    assembler.findMarkerGraphReverseComplementEdges(0);
+    if(!assembler.isCheckpointed("createMarkerGraphEdges")) {
+        StageTimer timer(performanceReport, "createMarkerGraphEdges");
+        assembler.createMarkerGraphEdges(0);
+        assembler.findMarkerGraphReverseComplementEdges(0);
+        if(assemblyOptions.MarkerGraph.canonicalEdgeMarkerIntervals == "True") {
+            assembler.storeCanonicalMarkerGraphEdgeMarkerIntervals(0);
+        }
+        if(assemblyOptions.MarkerGraph.compressEdgeMarkerIntervals == "True") {
+            assembler.compressMarkerGraphEdgeMarkerIntervals(0);
+        }
+        assembler.writeCheckpoint("createMarkerGraphEdges");
+    }
+    assembler.releaseUnneededData("createMarkerGraphEdges");
+
+    // Renumber the marker graph for memory locality, if requested.
+    // This stage only exists when requested (see computeStageParametersHashes).
+    if(assemblyOptions.MarkerGraph.renumber == "True") {
+        if(!assembler.isCheckpointed("renumberMarkerGraph")) {
+            StageTimer timer(performanceReport, "renumberMarkerGraph");
+            assembler.renumberMarkerGraph(0);
+            assembler.writeCheckpoint("renumberMarkerGraph");
+        }
+        assembler.releaseUnneededData("renumberMarkerGraph");
+    }
 
     // Approximate transitive reduction.
-    assembler.flagMarkerGraphWeakEdges(
-        assemblyOptions.MarkerGraph.lowCoverageThreshold,
-        assemblyOptions.MarkerGraph.highCoverageThreshold,
-        assemblyOptions.MarkerGraph.maxDistance,
-        assemblyOptions.MarkerGraph.edgeMarkerSkipThreshold);
+    if(!assembler.isCheckpointed("flagMarkerGraphWeakEdges")) {
+        StageTimer timer(performanceReport, "flagMarkerGraphWeakEdges");
+        assembler.flagMarkerGraphWeakEdges(
+            assemblyOptions.MarkerGraph.lowCoverageThreshold,
+            assemblyOptions.MarkerGraph.highCoverageThreshold,
+            assemblyOptions.MarkerGraph.maxDistance,
+            assemblyOptions.MarkerGraph.edgeMarkerSkipThreshold);
+        assembler.writeCheckpoint("flagMarkerGraphWeakEdges");
+    }
+    assembler.releaseUnneededData("flagMarkerGraphWeakEdges");
 
     // Prune the strong subgraph of the marker graph.
-    assembler.pruneMarkerGraphStrongSubgraph(
-        assemblyOptions.MarkerGraph.pruneIterationCount);
+    if(!assembler.isCheckpointed("pruneMarkerGraphStrongSubgraph")) {
+        StageTimer timer(performanceReport, "pruneMarkerGraphStrongSubgraph");
+        assembler.pruneMarkerGraphStrongSubgraph(
+            assemblyOptions.MarkerGraph.pruneIterationCount);
+        assembler.writeCheckpoint("pruneMarkerGraphStrongSubgraph");
+    }
+    assembler.releaseUnneededData("pruneMarkerGraphStrongSubgraph");
 
     // Simplify the marker graph to remove bubbles and superbubbles.
     // The maxLength parameter controls the maximum number of markers
     // for a branch to be collapsed during each iteration.
-    assembler.simplifyMarkerGraph(assemblyOptions.MarkerGraph.simplifyMaxLengthVector, false);
+    if(!assembler.isCheckpointed("simplifyMarkerGraph")) {
+        StageTimer timer(performanceReport, "simplifyMarkerGraph");
+        assembler.simplifyMarkerGraph(assemblyOptions.MarkerGraph.simplifyMaxLengthVector, false);
+        assembler.writeCheckpoint("simplifyMarkerGraph");
+    }
+    assembler.releaseUnneededData("simplifyMarkerGraph");
 
     // Create the assembly graph.
-    assembler.createAssemblyGraphEdges();
-    assembler.createAssemblyGraphVertices();
-    assembler.writeAssemblyGraph("AssemblyGraph-Final.dot");
+    if(!assembler.isCheckpointed("createAssemblyGraph")) {
+        StageTimer timer(performanceReport, "createAssemblyGraph");
+        assembler.createAssemblyGraphEdges();
+        assembler.createAssemblyGraphVertices();
+        assembler.writeCheckpoint("createAssemblyGraph");
+
+        // Write the assembly graph in the background.
+        // Later stages don't modify it.
+        backgroundTasks.push_back(std::async(std::launch::async,
+            [&assembler]()
+            {
+                std::ostringstream out;
+                assembler.writeAssemblyGraph("AssemblyGraph-Final.dot", out);
+                return out.str();
+            }));
+    }
+    assembler.releaseUnneededData("createAssemblyGraph");
 
     // Compute optimal repeat counts for each vertex of the marker graph.
-    assembler.assembleMarkerGraphVertices(0);
+    if(!assembler.isCheckpointed("assembleMarkerGraphVertices")) {
+        StageTimer timer(performanceReport, "assembleMarkerGraphVertices");
+        assembler.assembleMarkerGraphVertices(0);
+        assembler.writeCheckpoint("assembleMarkerGraphVertices");
+    }
+    assembler.releaseUnneededData("assembleMarkerGraphVertices");
 
     // Compute consensus sequence for marker graph edges to be used for assembly.
-    assembler.assembleMarkerGraphEdges(
-        0,
-        assemblyOptions.Assembly.markerGraphEdgeLengthThresholdForConsensus,
-        false,
-        false);
+    if(!assembler.isCheckpointed("assembleMarkerGraphEdges")) {
+        StageTimer timer(performanceReport, "assembleMarkerGraphEdges");
+        assembler.assembleMarkerGraphEdges(
+            0,
+            assemblyOptions.Assembly.markerGraphEdgeLengthThresholdForConsensus,
+            false,
+            false,
+            uint32_t(assemblyOptions.Assembly.starAlignmentLengthThreshold));
+        assembler.writeCheckpoint("assembleMarkerGraphEdges");
+    }
+    assembler.releaseUnneededData("assembleMarkerGraphEdges");
 
     // Use the assembly graph for global assembly.
-    assembler.assemble(0);
-    assembler.computeAssemblyStatistics();
-    assembler.writeGfa1("Assembly.gfa");
-    assembler.writeFasta("Assembly.fasta");
+    if(!assembler.isCheckpointed("assemble")) {
+        StageTimer timer(performanceReport, "assemble");
+        const string outputSuffix =
+            (assemblyOptions.Assembly.bgzipOutput == "True") ? ".gz" : "";
+        const bool storeSequences = (assemblyOptions.Assembly.storeAssembledSequences == "True");
+        if(assemblyOptions.Assembly.fusedOutput == "True") {
+            assembler.assembleAndWrite(
+                "Assembly.fasta" + outputSuffix,
+                "Assembly.gfa" + outputSuffix,
+                storeSequences,
+                0);
+            assembler.computeAssemblyStatistics();
+        } else {
+            assembler.assemble(0);
+            assembler.computeAssemblyStatistics();
+            assembler.writeGfa1("Assembly.gfa" + outputSuffix);
+            assembler.writeFasta("Assembly.fasta" + outputSuffix);
+        }
+
+        // Without the assembled sequences there is nothing to checkpoint,
+        // and a resumed run repeats this stage.
+        if(storeSequences) {
+            assembler.writeCheckpoint("assemble");
+        }
+    }
+    assembler.releaseUnneededData("assemble");
+
+    // Wait for the background tasks.
+    waitForBackgroundTasks();
+
+    // Report the memory released by --dataLifetime.
+    assembler.writeDataLifetimeSummary(cout);
+
+    // Write the performance report next to AssemblySummary.csv.
+    performanceReport.writeCsv("PerformanceReport.csv");
+    performanceReport.writeJson("PerformanceReport.json");
+
+}
+
 
+// Compute a hash of the parameters of each stage run by runAssembly.
+// The hash of each stage also covers the parameters of all previous stages,
+// the input files, and the build id.
+// The input files are identified by name, size, and modification time.
+// The parameters that only affect performance are included,
+// so the reused stages always match a new run exactly.
+void ChanZuckerberg::shasta::main::computeStageParametersHashes(
+    const AssemblyOptions& assemblyOptions,
+    const vector<string>& inputFastaFileNames,
+    vector< pair<string, uint64_t> >& stageParametersHashes)
+{
+    const auto& Reads = assemblyOptions.Reads;
+    const auto& MarkerGraph = assemblyOptions.MarkerGraph;
+    const auto& Assembly = assemblyOptions.Assembly;
+
+    // The parameters of each stage, in the same format as shasta.conf.
+    vector< pair<string, string> > stageParameters;
+    std::ostringstream s;
+    s << buildId() << "\n";
+    // Inputs that are not regular files (URLs and streams)
+    // are identified by name only.
+    for(const string& inputFastaFileName: inputFastaFileNames) {
+        s << inputFastaFileName;
+        if(filesystem::isRegularFile(inputFastaFileName)) {
+            s << " " << filesystem::fileSize(inputFastaFileName) <<
+                " " << filesystem::modificationTime(inputFastaFileName);
+        }
+        s << "\n";
+    }
+    s << "minReadLength = " << Reads.minReadLength << "\n";
+    s << "compressRepeatCounts = " << Reads.compressRepeatCounts << "\n";
+    Reads.subsampling.write(s);
+    stageParameters.push_back(make_pair("addReads", s.str()));
+    s.str("");
+    assemblyOptions.Kmers.write(s);
+    stageParameters.push_back(make_pair("selectKmers", s.str()));
+    stageParameters.push_back(make_pair("findMarkers", ""));
+    stageParameters.push_back(make_pair("computeSortedMarkers", ""));
+    s.str("");
+    Reads.palindromicReads.write(s);
+    stageParameters.push_back(make_pair("flagPalindromicReads", s.str()));
+    s.str("");
+    assemblyOptions.MinHash.write(s);
+    stageParameters.push_back(make_pair("findAlignmentCandidates", s.str()));
+    s.str("");
+    assemblyOptions.Align.write(s);
+    stageParameters.push_back(make_pair("computeAlignments", s.str()));
+    s.str("");
+    assemblyOptions.ReadGraph.write(s);
+    stageParameters.push_back(make_pair("createReadGraph", s.str()));
+    stageParameters.push_back(make_pair("flagChimericReads", ""));
+    stageParameters.push_back(make_pair("computeReadGraphConnectedComponents", ""));
+    if(assemblyOptions.ReadGraph.renumberReads == "True") {
+        stageParameters.push_back(make_pair("renumberReads", ""));
+    }
+    s.str("");
+    s << "minCoverage = " << MarkerGraph.minCoverage << "\n";
+    s << "maxCoverage = " << MarkerGraph.maxCoverage << "\n";
+    s << "unionBufferSize = " << MarkerGraph.unionBufferSize << "\n";
+    s << "outOfCorePartitionCount = " << MarkerGraph.outOfCorePartitionCount << "\n";
+    s << "storeDisjointSetTable = " << MarkerGraph.storeDisjointSetTable << "\n";
+    stageParameters.push_back(make_pair("createMarkerGraphVertices", s.str()));
+    s.str("");
+    s << "canonicalEdgeMarkerIntervals = " << MarkerGraph.canonicalEdgeMarkerIntervals << "\n";
+    s << "compressEdgeMarkerIntervals = " << MarkerGraph.compressEdgeMarkerIntervals << "\n";
+    stageParameters.push_back(make_pair("createMarkerGraphEdges", s.str()));
+    if(assemblyOptions.MarkerGraph.renumber == "True") {
+        stageParameters.push_back(make_pair("renumberMarkerGraph", ""));
+    }
+    s.str("");
+    s << "lowCoverageThreshold = " << MarkerGraph.lowCoverageThreshold << "\n";
+    s << "highCoverageThreshold = " << MarkerGraph.highCoverageThreshold << "\n";
+    s << "maxDistance = " << MarkerGraph.maxDistance << "\n";
+    s << "edgeMarkerSkipThreshold = " << MarkerGraph.edgeMarkerSkipThreshold << "\n";
+    stageParameters.push_back(make_pair("flagMarkerGraphWeakEdges", s.str()));
+    s.str("");
+    s << "pruneIterationCount = " << MarkerGraph.pruneIterationCount << "\n";
+    stageParameters.push_back(make_pair("pruneMarkerGraphStrongSubgraph", s.str()));
+    s.str("");
+    s << "simplifyMaxLength = " << MarkerGraph.simplifyMaxLength << "\n";
+    stageParameters.push_back(make_pair("simplifyMarkerGraph", s.str()));
+    stageParameters.push_back(make_pair("createAssemblyGraph", ""));
+    s.str("");
+    s << "consensusCaller = " << Assembly.consensusCaller << "\n";
+    stageParameters.push_back(make_pair("assembleMarkerGraphVertices", s.str()));
+    s.str("");
+    s << "markerGraphEdgeLengthThresholdForConsensus = " <<
+        Assembly.markerGraphEdgeLengthThresholdForConsensus << "\n";
+    s << "starAlignmentLengthThreshold = " << Assembly.starAlignmentLengthThreshold << "\n";
+    stageParameters.push_back(make_pair("assembleMarkerGraphEdges", s.str()));
+    s.str("");
+    s << "bgzipOutput = " << Assembly.bgzipOutput << "\n";
+    s << "fusedOutput = " << Assembly.fusedOutput << "\n";
+    s << "storeAssembledSequences = " << Assembly.storeAssembledSequences << "\n";
+    stageParameters.push_back(make_pair("assemble", s.str()));
+
+    // Chain the hashes.
+    stageParametersHashes.clear();
+    uint64_t hash = 0;
+    for(const auto& p: stageParameters) {
+        hash = MurmurHash64A(p.second.data(), int(p.second.size()), hash);
+
+        // Zero means unknown in the checkpoint manifest.
+        if(hash == 0) {
+            hash = 1;
+        }
+        stageParametersHashes.push_back(make_pair(p.first, hash));
+    }
 }
 
 
+
 // This function sets nr_overcommit_hugepages for 2MB pages
 // to a little below total memory.
 // If the setting needs to be modified, it acquires
@@ -589,3 +1439,61 @@ void ChanZuckerberg::shasta::main::setupHugePages()
     }
 
 }
+
+
+
+// Set up the placement of data structures on persistent memory.
+// The files are in a new directory inside the persistent memory directory,
+// and the output directory contains a symbolic link PersistentMemoryData
+// to it, so a resumed assembly and the cleanup command can find them.
+void ChanZuckerberg::shasta::main::setupPersistentMemory(
+    const string& persistentMemoryDirectory,
+    const string& persistentMemoryObjects,
+    bool resume)
+{
+    const string linkName = "PersistentMemoryData";
+    if(!resume) {
+        const string templateName = persistentMemoryDirectory + "/ShastaData-XXXXXX";
+        vector<char> directoryName(templateName.begin(), templateName.end());
+        directoryName.push_back(0);
+        if(::mkdtemp(directoryName.data()) == 0) {
+            throw runtime_error("Error " + to_string(errno) + ": " + strerror(errno) +
+                " creating a directory in " + persistentMemoryDirectory);
+        }
+        if(::symlink(directoryName.data(), linkName.c_str()) == -1) {
+            throw runtime_error("Error " + to_string(errno) + ": " + strerror(errno) +
+                " creating symbolic link " + linkName);
+        }
+    } else if(!filesystem::isDirectory(linkName)) {
+        throw runtime_error("The assembly being resumed did not use --persistentMemoryDirectory.");
+    }
+
+    vector<string> objectNames;
+    boost::tokenizer< boost::char_separator<char> > tokenizer(
+        persistentMemoryObjects, boost::char_separator<char>(","));
+    for(const string& token: tokenizer) {
+        objectNames.push_back(token);
+    }
+    PersistentMemory::setPlacement(linkName + "/", objectNames);
+}
+
+
+
+// Remove the persistent memory files of an assembly, if any,
+// and the symbolic link to their directory.
+void ChanZuckerberg::shasta::main::cleanupPersistentMemory(const string& linkName)
+{
+    vector<char> directoryName(4096);
+    const ssize_t length = ::readlink(linkName.c_str(), directoryName.data(), directoryName.size());
+    if(length <= 0 || size_t(length) >= directoryName.size()) {
+        return;
+    }
+    const string directory(directoryName.data(), size_t(length));
+    const int errorCode = ::system(string("rm -rf " + directory).c_str());
+    if(errorCode != 0) {
+        throw runtime_error("Error " + to_string(errorCode) + ": " + strerror(errorCode) +
+            " removing " + directory);
+    }
+    ::unlink(linkName.c_str());
+    cout << "Removed persistent memory files in " << directory << endl;
+}
@@ -0,0 +1,82 @@
+// Shasta.
+#include "AlignmentCandidateTable.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+
+
+
+void AlignmentCandidateTable::createNew(
+    const string& name,
+    size_t pageSize,
+    uint64_t maxByteCount)
+{
+    // Find the largest power of 2 that fits in the memory budget.
+    const uint64_t maxSlotCount = maxByteCount / bytesPerSlot;
+    if(maxSlotCount == 0) {
+        throw runtime_error("Memory budget for alignment candidate table is too small.");
+    }
+    const uint64_t slotCount = 1ULL << (63 - __builtin_clzl(maxSlotCount));
+    mask = slotCount - 1ULL;
+
+    keys.createNew(name + "-Keys", pageSize);
+    keys.resize(slotCount);
+    fill(keys.begin(), keys.end(), uint64_t(emptyKey));
+
+    frequencies.createNew(name + "-Frequencies", pageSize);
+    frequencies.resize(slotCount);
+    fill(frequencies.begin(), frequencies.end(), 0);
+}
+
+
+
+void AlignmentCandidateTable::remove()
+{
+    keys.remove();
+    frequencies.remove();
+}
+
+
+
+uint32_t AlignmentCandidateTable::increment(uint64_t key)
+{
+    CZI_ASSERT(key != emptyKey);
+
+    uint64_t slot = hash(key) & mask;
+    for(uint64_t probe=0; probe<maxProbeCount; probe++, slot=((slot+1ULL) & mask)) {
+        uint64_t slotKey = __atomic_load_n(&keys[slot], __ATOMIC_RELAXED);
+
+        // If the slot is empty, try to grab it.
+        // If another thread grabbed it first, it may have
+        // stored the key we are looking for.
+        if(slotKey == emptyKey) {
+            const uint64_t oldSlotKey = __sync_val_compare_and_swap(&keys[slot], emptyKey, key);
+            slotKey = (oldSlotKey == emptyKey) ? key : oldSlotKey;
+        }
+
+        if(slotKey == key) {
+            return __sync_add_and_fetch(&frequencies[slot], 1);
+        }
+    }
+
+    // We could not find or insert the key.
+    return 0;
+}
+
+
+
+void AlignmentCandidateTable::getKeys(
+    uint64_t slotBegin,
+    uint64_t slotEnd,
+    uint32_t minFrequency,
+    vector< pair<uint64_t, uint32_t> >& v) const
+{
+    for(uint64_t slot=slotBegin; slot!=slotEnd; slot++) {
+        const uint64_t key = keys[slot];
+        if(key!=emptyKey && frequencies[slot]>=minFrequency) {
+            v.push_back(make_pair(key, frequencies[slot]));
+        }
+    }
+}
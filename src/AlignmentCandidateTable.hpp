@@ -0,0 +1,120 @@
+#ifndef CZI_SHASTA_ALIGNMENT_CANDIDATE_TABLE_HPP
+#define CZI_SHASTA_ALIGNMENT_CANDIDATE_TABLE_HPP
+
+/*******************************************************************************
+
+Class AlignmentCandidateTable is a concurrent open addressing hash table
+used by LowHash to accumulate, across iterations, the number of times
+each pair of reads is found.
+
+The key is (readId0, readId1, strand), with readId0 < readId1,
+packed in a 64-bit integer so that numeric order of keys is the same as
+the order of the corresponding LowHash candidates.
+Each slot also contains a 32-bit frequency.
+Keys are inserted with a compare-and-swap and frequencies are
+incremented atomically, so any number of threads can update the table
+without locking.
+
+The table has a fixed capacity that is determined at creation
+from a memory budget. When a key cannot be inserted within
+maxProbeCount probes, it is dropped and the caller is notified.
+This bounds memory usage at the cost of losing some candidates
+if the table is too small.
+
+*******************************************************************************/
+
+// Shasta.
+#include "MemoryMappedVector.hpp"
+#include "ReadId.hpp"
+
+// Standard library.
+#include <limits>
+#include "string.hpp"
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class AlignmentCandidateTable;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::AlignmentCandidateTable {
+public:
+
+    // The number of bytes used by each slot.
+    static const uint64_t bytesPerSlot = sizeof(uint64_t) + sizeof(uint32_t);
+
+    // The maximum number of slots inspected when looking for a key.
+    static const uint64_t maxProbeCount = 64;
+
+    // Create a table using at most the given number of bytes.
+    // The capacity is the largest power of 2 that fits.
+    void createNew(const string& name, size_t pageSize, uint64_t maxByteCount);
+    void remove();
+
+    // The number of slots.
+    uint64_t capacity() const
+    {
+        return keys.size();
+    }
+
+    // Packing and unpacking of keys.
+    static uint64_t makeKey(ReadId readId0, ReadId readId1, uint64_t strand)
+    {
+        return (uint64_t(readId0) << 32ULL) | (uint64_t(readId1) << 1ULL) | strand;
+    }
+    static ReadId getReadId0(uint64_t key)
+    {
+        return ReadId(key >> 32ULL);
+    }
+    static ReadId getReadId1(uint64_t key)
+    {
+        return ReadId((key & 0xffffffffULL) >> 1ULL);
+    }
+    static uint64_t getStrand(uint64_t key)
+    {
+        return key & 1ULL;
+    }
+
+    // Increment the frequency for a key, inserting it if necessary.
+    // Returns the new frequency, or 0 if the key was not present
+    // and could not be inserted because the table is too full.
+    // This can be called by multiple threads simultaneously.
+    uint32_t increment(uint64_t key);
+
+    // Add to a vector the keys with frequency at least minFrequency
+    // stored in slots in [slotBegin, slotEnd), with their frequencies.
+    // This must not be called while the table is being updated.
+    void getKeys(
+        uint64_t slotBegin,
+        uint64_t slotEnd,
+        uint32_t minFrequency,
+        vector< pair<uint64_t, uint32_t> >&) const;
+
+private:
+
+    // The key and frequency stored in each slot.
+    MemoryMapped::Vector<uint64_t> keys;
+    MemoryMapped::Vector<uint32_t> frequencies;
+    uint64_t mask;
+
+    // The key used to flag an empty slot.
+    // This can never be a valid key because ReadIds are less than 2^31.
+    static const uint64_t emptyKey = std::numeric_limits<uint64_t>::max();
+
+    // The hash function used to find the first slot to inspect.
+    static uint64_t hash(uint64_t key)
+    {
+        key ^= key >> 33ULL;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33ULL;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33ULL;
+        return key;
+    }
+};
+
+#endif
@@ -44,6 +44,10 @@ void ChanZuckerberg::shasta::align(
     // Change to size_t when conversion completed.
     uint32_t maxMarkerFrequency,
 
+    // If not 0, first try a banded alignment using
+    // this maximum distance from the dominant diagonal.
+    size_t bandWidth,
+
     // Flag to control various types of debug output.
     bool debug,
 
@@ -59,7 +63,7 @@ void ChanZuckerberg::shasta::align(
     AlignmentInfo& alignmentInfo
     )
 {
-    graph.create(markers, maxMarkerFrequency, maxSkip, debug,
+    graph.create(markers, maxMarkerFrequency, maxSkip, bandWidth, debug,
         alignment, alignmentInfo);
 }
 
@@ -70,22 +74,144 @@ void AlignmentGraph::create(
     const array<vector<MarkerWithOrdinal>, 2>& markers,
     uint32_t maxMarkerFrequency,
     size_t maxSkip,
+    size_t bandWidth,
     bool debug,
     Alignment& alignment,
     AlignmentInfo& alignmentInfo)
 {
 
-    // Start with an empty graph.
-    clear();
-
     // Write out the markers.
     if(debug) {
         writeMarkers(markers[0], "Markers-ByKmerId-0.csv");
         writeMarkers(markers[1], "Markers-ByKmerId-1.csv");
     }
 
-    // Create the vertices - one for each pair of common markers.
+    // Find the pairs of common markers.
+    budgetExceeded = false;
     createVertices(markers, maxMarkerFrequency);
+
+
+
+    // If requested, first try a banded alignment.
+    int diagonal;
+    if(bandWidth > 0 && estimateDiagonal(bandWidth, diagonal)) {
+        const int minOffset = diagonal - int(bandWidth);
+        const int maxOffset = diagonal + int(bandWidth);
+        if(debug) {
+            cout << "Trying a banded alignment with offsets in [" <<
+                minOffset << ", " << maxOffset << "]." << endl;
+        }
+
+        // If all marker pairs are in the band, the banded alignment
+        // is the same as the full alignment.
+        bool allInBand = true;
+        for(const AlignmentGraphVertex& vertex: markerPairs) {
+            const int offset = getOffset(vertex);
+            if(offset < minOffset || offset > maxOffset) {
+                allInBand = false;
+                break;
+            }
+        }
+
+        if(alignInBand(markers, maxSkip, minOffset, maxOffset, debug, alignment, alignmentInfo)) {
+            if(allInBand) {
+                return;
+            }
+
+            // Accept the banded alignment if it stays away from
+            // the edges of the band. Successive markers in the alignment
+            // cannot change offset by more than maxSkip, so an alignment
+            // that gets close to the edge may have been truncated by the band.
+            bool isInsideBand = true;
+            for(const auto& ordinals: alignment.ordinals) {
+                const int offset =
+                    int(correctedOrdinals[1][ordinals[1]]) - int(correctedOrdinals[0][ordinals[0]]);
+                if(offset < minOffset + int(maxSkip) || offset > maxOffset - int(maxSkip)) {
+                    isInsideBand = false;
+                    break;
+                }
+            }
+            if(isInsideBand) {
+                return;
+            }
+        } else if(allInBand || budgetExceeded) {
+            // If the band already exceeded the work budget,
+            // the full alignment graph would exceed it too.
+            return;
+        }
+        if(debug) {
+            cout << "The banded alignment was not usable, using the full alignment graph." << endl;
+        }
+    }
+
+    // Use the full alignment graph.
+    alignInBand(markers, maxSkip,
+        std::numeric_limits<int>::min(), std::numeric_limits<int>::max(),
+        debug, alignment, alignmentInfo);
+}
+
+
+
+int AlignmentGraph::getOffset(const AlignmentGraphVertex& vertex) const
+{
+    return
+        int(correctedOrdinals[1][vertex.ordinals[1]]) -
+        int(correctedOrdinals[0][vertex.ordinals[0]]);
+}
+
+
+
+bool AlignmentGraph::estimateDiagonal(size_t bandWidth, int& diagonal)
+{
+    if(markerPairs.empty()) {
+        return false;
+    }
+
+    offsets.clear();
+    for(const AlignmentGraphVertex& vertex: markerPairs) {
+        offsets.push_back(getOffset(vertex));
+    }
+    sort(offsets.begin(), offsets.end());
+
+    // Find the window [offsets[i], offsets[i]+bandWidth]
+    // containing the most offsets.
+    size_t bestBegin = 0;
+    size_t bestEnd = 0;
+    size_t j = 0;
+    for(size_t i=0; i<offsets.size(); i++) {
+        while(j<offsets.size() && offsets[j] <= offsets[i] + int(bandWidth)) {
+            ++j;
+        }
+        if(j-i > bestEnd-bestBegin) {
+            bestBegin = i;
+            bestEnd = j;
+        }
+    }
+    diagonal = offsets[(bestBegin + bestEnd) / 2];
+    return true;
+}
+
+
+
+bool AlignmentGraph::alignInBand(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    size_t maxSkip,
+    int minOffset,
+    int maxOffset,
+    bool debug,
+    Alignment& alignment,
+    AlignmentInfo& alignmentInfo)
+{
+    // Start with an empty graph.
+    clear();
+
+    // Create the vertices - one for each pair of common markers in the band.
+    for(const AlignmentGraphVertex& vertex: markerPairs) {
+        const int offset = getOffset(vertex);
+        if(offset >= minOffset && offset <= maxOffset) {
+            addVertex(vertex);
+        }
+    }
     sortVertices();
 
     // Add the start and finish vertices.
@@ -99,7 +225,16 @@ void AlignmentGraph::create(
     }
 
     // Create the edges.
-    createEdges(uint32_t(markers[0].size()), uint32_t(markers[1].size()), maxSkip);
+    if(!createEdges(uint32_t(markers[0].size()), uint32_t(markers[1].size()), maxSkip)) {
+        budgetExceeded = true;
+        clear();
+        alignment.ordinals.clear();
+        if(debug) {
+            cout << "The alignment graph exceeded the work budget of " <<
+                maxEdgeCount << " edges." << endl;
+        }
+        return false;
+    }
     if(debug) {
         writeEdges("AlignmentGraphEdges.csv");
     }
@@ -112,13 +247,17 @@ void AlignmentGraph::create(
     }
 
     // Look for the shortest path between vStart and vFinish.
-    findShortestPath(*this, vStart, vFinish, shortestPath, queue);
+    if(useDijkstra) {
+        findShortestPath(*this, vStart, vFinish, shortestPath, queue);
+    } else {
+        findShortestPathDag();
+    }
     if(shortestPath.empty()) {
         alignment.ordinals.clear();
         if(debug) {
             cout << "The shortest path is empty." << endl;
         }
-        return;
+        return false;
     }
     if(debug) {
         cout << "The shortest path has " << shortestPath.size()-2;
@@ -145,9 +284,97 @@ void AlignmentGraph::create(
         writeImage(markers[0], markers[1], alignment, "Alignment.png");
     }
 #endif
+    return true;
+}
+
+
+void AlignmentGraph::findShortestPathDag()
+{
+    AlignmentGraph& graph = *this;
+    const uint64_t infinity = std::numeric_limits<uint64_t>::max();
+
+    // Initialize.
+    for(Int i=0; i<vertexCount(); i++) {
+        AlignmentGraphVertex& vertex = graph[vertex_descriptor(i)];
+        vertex.predecessor = null_vertex();
+        vertex.distance = infinity;
+    }
+    graph[vStart].predecessor = vStart;
+    graph[vStart].distance = 0;
+
+    // Every marker vertex is connected to vStart.
+    for(auto it=outEdgesBegin(vStart); it!=outEdgesEnd(vStart); ++it) {
+        const vertex_descriptor v = target(*it);
+        AlignmentGraphVertex& vertex = graph[v];
+        const uint64_t weight = graph[*it].weight;
+        if(weight < vertex.distance) {
+            vertex.distance = weight;
+            vertex.predecessor = vStart;
+        }
+    }
+
+    // Process the marker vertices in topological order,
+    // relaxing their forward edges.
+    for(Int i=0; i<vertexCount(); i++) {
+        const vertex_descriptor v0(i);
+        if(v0==vStart || v0==vFinish) {
+            continue;
+        }
+        const uint64_t distance0 = graph[v0].distance;
+        if(distance0 == infinity) {
+            continue;
+        }
+        for(auto it=outEdgesBegin(v0); it!=outEdgesEnd(v0); ++it) {
+            const vertex_descriptor v1 = target(*it);
+            if(v1 == vStart) {
+                continue;
+            }
+            if(v1 != vFinish && v1.v <= i) {
+                // This edge goes backward.
+                continue;
+            }
+            AlignmentGraphVertex& vertex1 = graph[v1];
+            const uint64_t distance1 = distance0 + graph[*it].weight;
+            if(distance1 < vertex1.distance) {
+                vertex1.distance = distance1;
+                vertex1.predecessor = v0;
+            }
+        }
+    }
+
+    // Construct the path.
+    shortestPath.clear();
+    if(graph[vFinish].distance == infinity) {
+        return;
+    }
+    for(vertex_descriptor v=vFinish; ; v=graph[v].predecessor) {
+        shortestPath.push_back(v);
+        if(v == vStart) {
+            break;
+        }
+    }
+    std::reverse(shortestPath.begin(), shortestPath.end());
 }
 
 
+
+uint64_t AlignmentGraph::capacityBytes() const
+{
+    uint64_t n =
+        AlignmentGraphBaseClass::capacityBytes() +
+        markerPairs.capacity() * sizeof(AlignmentGraphVertex) +
+        offsets.capacity() * sizeof(int) +
+        shortestPath.capacity() * sizeof(vertex_descriptor) +
+        queue.capacity() * sizeof(pair<uint64_t, vertex_descriptor>);
+    for(size_t i=0; i<2; i++) {
+        n += isLowFrequencyMarker[i].capacity() / 8;
+        n += correctedOrdinals[i].capacity() * sizeof(uint32_t);
+    }
+    return n;
+}
+
+
+
 void AlignmentGraph::writeMarkers(
     const vector<MarkerWithOrdinal>& markers,
     const string& fileName
@@ -180,6 +407,8 @@ void AlignmentGraph::createVertices(
     const MarkerIterator begin1 = markers1.begin();
     const MarkerIterator end1   = markers1.end();
 
+    markerPairs.clear();
+
     // Initialize isLowFrequencyMarker flags to all true.
     // We will set to false the ones that need it,
     // when we encounter long streaks of the same marker.
@@ -248,7 +477,7 @@ void AlignmentGraph::createVertices(
                         vertex.positions[1] = jt1->position;
                         vertex.ordinals[0] = jt0->ordinal;
                         vertex.ordinals[1] = jt1->ordinal;
-                        addVertex(vertex);
+                        markerPairs.push_back(vertex);
                     }
                 }
 
@@ -303,7 +532,7 @@ void AlignmentGraph::writeVertices(const string& fileName) const
 
 
 
-void AlignmentGraph::createEdges(
+bool AlignmentGraph::createEdges(
     uint32_t markerCount0,
     uint32_t markerCount1,
     size_t maxSkip)
@@ -371,10 +600,16 @@ void AlignmentGraph::createEdges(
             // Add the edge.
             addEdge(vA, vB, AlignmentGraphEdge(weight));
         }
+
+        // Give up if the work budget was exceeded.
+        if(maxEdgeCount!=0 && edgeCount()>maxEdgeCount) {
+            return false;
+        }
     }
 
 
     // Create edges from vStart and vFinish to all other vertices.
+    reserveEdges(edgeCount() + 2 * (vertexCount() - 2));
     for(vertex_iterator it=itBegin; it!=itEnd; ++it) {
         const vertex_descriptor v = *it;
         if(v==vStart || v==vFinish) {
@@ -404,7 +639,7 @@ void AlignmentGraph::createEdges(
             abs(deltaFinish1)));
     }
 
-
+    return true;
 }
 
 
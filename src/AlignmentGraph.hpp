@@ -17,6 +17,16 @@ oriented reads, measured using ordinals (not position).
 
 To find a good alignment, we find a shortest path in the graph.
 
+Optionally, a banded alignment can be attempted first.
+The dominant diagonal is estimated from the distribution of
+ordinal offsets of all pairs of markers with the same k-mer,
+and only vertices within bandWidth of that diagonal are used.
+This is much faster when many vertices are far from the alignment,
+for example in repetitive regions.
+If no alignment is found in the band, or the alignment
+gets within maxSkip of the edge of the band (which means the true
+alignment may have left the band), the full graph is used instead.
+
 *******************************************************************************/
 
 // shasta
@@ -60,6 +70,11 @@ namespace ChanZuckerberg {
             // Change to size_t when conversion completed.
             uint32_t maxMarkerFrequency,
 
+            // If not 0, first try a banded alignment using
+            // this maximum distance from the dominant diagonal,
+            // in markers. This should be much larger than maxSkip.
+            size_t bandWidth,
+
             // Flag to control various types of debug output.
             bool debug,
 
@@ -132,17 +147,78 @@ public:
         const array<vector<MarkerWithOrdinal>, 2>&,
         uint32_t maxMarkerFrequency,
         size_t maxSkip,
+        size_t bandWidth,
         bool debug,
         Alignment&,
         AlignmentInfo&);
 
+    // The number of bytes currently allocated,
+    // including the graph and the work areas.
+    // Because allocated memory is kept between alignments,
+    // this only increases when an alignment needs more memory
+    // than all previous alignments computed with this AlignmentGraph.
+    uint64_t capacityBytes() const;
+
+    // If set, the optimal path is found using the generic
+    // Dijkstra algorithm in shortestPath.hpp instead of findShortestPathDag.
+    // This is only used for benchmarking.
+    bool useDijkstra = false;
+
+    // Work budget. If not zero, create gives up as soon as the
+    // alignment graph has more than this number of edges,
+    // and returns an empty alignment with workBudgetWasExceeded() true.
+    // This bounds the time and memory spent on a single pair of reads
+    // with long repeats, which the caller can align differently.
+    uint64_t maxEdgeCount = 0;
+    bool workBudgetWasExceeded() const
+    {
+        return budgetExceeded;
+    }
+
+    // The length of the optimal path found by the last alignment,
+    // or std::numeric_limits<uint64_t>::max() if none was found.
+    uint64_t shortestPathLength() const
+    {
+        return (*this)[vFinish].distance;
+    }
+
 private:
 
+    // All pairs of markers with the same k-mer, computed by createVertices.
+    // The vertices of the graph are created from these,
+    // possibly only keeping the ones in a band.
+    vector<AlignmentGraphVertex> markerPairs;
+
+    // The diagonal offset of a marker pair,
+    // computed using corrected ordinals.
+    int getOffset(const AlignmentGraphVertex&) const;
+
+    // Estimate the dominant diagonal as the median offset
+    // of the densest window of marker pairs of width bandWidth.
+    // Returns false if there are no marker pairs.
+    bool estimateDiagonal(size_t bandWidth, int& diagonal);
+    vector<int> offsets;
+
+    // Create the graph using the marker pairs with offset
+    // in [minOffset, maxOffset] and compute the alignment.
+    // Returns false if no alignment was found.
+    bool alignInBand(
+        const array<vector<MarkerWithOrdinal>, 2>&,
+        size_t maxSkip,
+        int minOffset,
+        int maxOffset,
+        bool debug,
+        Alignment&,
+        AlignmentInfo&);
+
     // There is a vertex for each pair of markers with the same k-mer.
     // In addition, there is a start vertex and a finish vertex.
     vertex_descriptor vStart;
     vertex_descriptor vFinish;
 
+    // Set if the last call to create exceeded maxEdgeCount.
+    bool budgetExceeded = false;
+
     static void writeMarkers(
         const vector<MarkerWithOrdinal>&,
         const string& fileName
@@ -151,7 +227,8 @@ private:
         const array<vector<MarkerWithOrdinal>, 2>&,
         uint32_t maxMarkerFrequency);
     void writeVertices(const string& fileName) const;
-    void createEdges(
+    // Returns false if maxEdgeCount was exceeded.
+    bool createEdges(
         uint32_t markerCount0,
         uint32_t MarkerCount1,
         size_t maxSkip);
@@ -171,6 +248,18 @@ private:
     // Data members used to find the shortest path.
     vector<vertex_descriptor> shortestPath;
     FindShortestPathQueue<AlignmentGraph> queue;
+
+    // Find the shortest path from vStart to vFinish and store it in shortestPath.
+    // Edges between marker vertices only go forward in vertex order
+    // (createEdges only adds edges from a vertex to vertices
+    // that follow it in the order sorted by ordinal in sequence 0),
+    // so the marker vertices in vertex order are a topological order,
+    // and the shortest path can be found by dynamic programming
+    // in a single pass over the vertices, without a priority queue.
+    // Unlike the undirected Dijkstra search, this only
+    // considers paths that go forward, which is what
+    // an alignment requires.
+    void findShortestPathDag();
     void writeShortestPath(const string& fileName) const;
 
     // Flags that are set for markers whose k-mers
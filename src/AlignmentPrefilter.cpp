@@ -0,0 +1,177 @@
+// Shasta.
+#include "AlignmentPrefilter.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include <cstdlib>
+
+
+
+AlignmentPrefilter::Result AlignmentPrefilter::check(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    uint32_t maxMarkerFrequency,
+    size_t minAlignedMarkerCount,
+    size_t maxTrim)
+{
+    // If an empty alignment is acceptable, there is nothing to check.
+    if(minAlignedMarkerCount == 0) {
+        return Result::Pass;
+    }
+
+    // Some shorthands for readability.
+    const vector<MarkerWithOrdinal>& markers0 = markers[0];
+    const vector<MarkerWithOrdinal>& markers1 = markers[1];
+    using MarkerIterator = vector<MarkerWithOrdinal>::const_iterator;
+    const MarkerIterator end0 = markers0.end();
+    const MarkerIterator end1 = markers1.end();
+
+    // The ordinals of start and end pairs must be
+    // less than or equal to these values.
+    const array<uint64_t, 2> maxStartOrdinal = {maxTrim, maxTrim};
+    const array<uint64_t, 2> minEndOrdinal = {
+        uint64_t(markers0.size()) > maxTrim + 1 ? uint64_t(markers0.size()) - 1 - maxTrim : 0,
+        uint64_t(markers1.size()) > maxTrim + 1 ? uint64_t(markers1.size()) - 1 - maxTrim : 0};
+
+    // Joint loop over the markers, looking for common k-mer ids,
+    // in the same way as AlignmentGraph.
+    uint64_t pairCount = 0;
+    startPairs.clear();
+    endPairs.clear();
+    auto it0 = markers0.begin();
+    auto it1 = markers1.begin();
+    while(it0!=end0 && it1!=end1) {
+        if(it0->kmerId < it1->kmerId) {
+            ++it0;
+        } else if(it1->kmerId < it0->kmerId) {
+            ++it1;
+        } else {
+            const KmerId kmerId = it0->kmerId;
+            MarkerIterator it0End = it0;
+            MarkerIterator it1End = it1;
+            while(it0End!=end0 && it0End->kmerId==kmerId) {
+                ++it0End;
+            }
+            while(it1End!=end1 && it1End->kmerId==kmerId) {
+                ++it1End;
+            }
+            const uint64_t streakLength0 = uint64_t(it0End - it0);
+            const uint64_t streakLength1 = uint64_t(it1End - it1);
+            if(streakLength0<=maxMarkerFrequency && streakLength1<=maxMarkerFrequency) {
+                pairCount += streakLength0 * streakLength1;
+                for(MarkerIterator jt0=it0; jt0!=it0End; ++jt0) {
+                    for(MarkerIterator jt1=it1; jt1!=it1End; ++jt1) {
+                        const array<uint32_t, 2> ordinals = {jt0->ordinal, jt1->ordinal};
+                        if(ordinals[0]<=maxStartOrdinal[0] || ordinals[1]<=maxStartOrdinal[1]) {
+                            startPairs.push_back(ordinals);
+                        }
+                        if(ordinals[0]>=minEndOrdinal[0] || ordinals[1]>=minEndOrdinal[1]) {
+                            endPairs.push_back(ordinals);
+                        }
+                    }
+                }
+            }
+            it0 = it0End;
+            it1 = it1End;
+        }
+    }
+
+    if(pairCount < minAlignedMarkerCount) {
+        return Result::TooFewSharedMarkers;
+    }
+    if(startPairs.empty() || endPairs.empty()) {
+        return Result::TooMuchTrim;
+    }
+
+    // Look for an end pair that is not before a start pair.
+    // Sort the start pairs by ordinal on the first oriented read
+    // and replace the second ordinals with their prefix minimum.
+    sort(startPairs.begin(), startPairs.end());
+    for(size_t i=1; i<startPairs.size(); i++) {
+        startPairs[i][1] = min(startPairs[i][1], startPairs[i-1][1]);
+    }
+    for(const array<uint32_t, 2>& endPair: endPairs) {
+
+        // Find the start pairs with first ordinal not greater than the end pair.
+        const auto it = std::upper_bound(startPairs.begin(), startPairs.end(),
+            array<uint32_t, 2>({endPair[0], std::numeric_limits<uint32_t>::max()}));
+        if(it == startPairs.begin()) {
+            continue;
+        }
+        if((*(it - 1))[1] <= endPair[1]) {
+            return Result::Pass;
+        }
+    }
+    return Result::InconsistentDiagonal;
+}
+
+
+
+bool AlignmentPrefilter::mayBePalindromic(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    uint32_t maxMarkerFrequency,
+    double alignedFractionThreshold,
+    double nearDiagonalFractionThreshold,
+    uint32_t deltaThreshold) const
+{
+    const vector<MarkerWithOrdinal>& markers0 = markers[0];
+    const vector<MarkerWithOrdinal>& markers1 = markers[1];
+    using MarkerIterator = vector<MarkerWithOrdinal>::const_iterator;
+    const MarkerIterator end0 = markers0.end();
+    const MarkerIterator end1 = markers1.end();
+
+    // Joint loop over the markers, looking for common k-mer ids,
+    // in the same way as AlignmentGraph.
+    uint64_t pairCount = 0;
+    uint64_t nearDiagonalPairCount = 0;
+    auto it0 = markers0.begin();
+    auto it1 = markers1.begin();
+    while(it0!=end0 && it1!=end1) {
+        if(it0->kmerId < it1->kmerId) {
+            ++it0;
+        } else if(it1->kmerId < it0->kmerId) {
+            ++it1;
+        } else {
+            const KmerId kmerId = it0->kmerId;
+            MarkerIterator it0End = it0;
+            MarkerIterator it1End = it1;
+            while(it0End!=end0 && it0End->kmerId==kmerId) {
+                ++it0End;
+            }
+            while(it1End!=end1 && it1End->kmerId==kmerId) {
+                ++it1End;
+            }
+            const uint64_t streakLength0 = uint64_t(it0End - it0);
+            const uint64_t streakLength1 = uint64_t(it1End - it1);
+            if(streakLength0<=maxMarkerFrequency && streakLength1<=maxMarkerFrequency) {
+                pairCount += streakLength0 * streakLength1;
+                for(MarkerIterator jt0=it0; jt0!=it0End; ++jt0) {
+                    for(MarkerIterator jt1=it1; jt1!=it1End; ++jt1) {
+                        const int32_t ordinal0 = int32_t(jt0->ordinal);
+                        const int32_t ordinal1 = int32_t(jt1->ordinal);
+                        const uint32_t delta = abs(ordinal0 - ordinal1);
+                        if(delta < deltaThreshold) {
+                            ++nearDiagonalPairCount;
+                        }
+                    }
+                }
+            }
+            it0 = it0End;
+            it1 = it1End;
+        }
+    }
+
+    // Use the same expressions as flagPalindromicReads,
+    // so the result is consistent with its decision.
+    const size_t totalMarkerCount = markers0.size();
+    const double alignedFraction = double(pairCount)/double(totalMarkerCount);
+    if(alignedFraction < alignedFractionThreshold) {
+        return false;
+    }
+    const double nearDiagonalFraction = double(nearDiagonalPairCount)/double(totalMarkerCount);
+    if(nearDiagonalFraction < nearDiagonalFractionThreshold) {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,100 @@
+#ifndef CZI_SHASTA_ALIGNMENT_PREFILTER_HPP
+#define CZI_SHASTA_ALIGNMENT_PREFILTER_HPP
+
+/*******************************************************************************
+
+Class AlignmentPrefilter is used by computeAlignments to reject,
+before computing an alignment, pairs of oriented reads for which
+the alignment cannot satisfy the minAlignedMarkerCount and maxTrim
+requirements.
+
+It only uses the markers sorted by k-mer id and checks necessary
+conditions, so it never rejects a pair that would have given
+a good alignment:
+
+- Each aligned marker is a pair of markers with the same k-mer
+  (excluding k-mers with frequency greater than maxMarkerFrequency).
+  So there must be at least minAlignedMarkerCount such pairs.
+
+- The first aligned marker must be within maxTrim markers of the
+  beginning of one of the two oriented reads (a start pair),
+  and the last aligned marker must be within maxTrim markers of the
+  end of one of the two oriented reads (an end pair).
+
+- The alignment advances in both oriented reads, so there must be
+  a start pair and an end pair that are consistent,
+  that is, the end pair is not before the start pair
+  in either oriented read.
+
+It is also used by flagPalindromicReads to skip the alignment of a read
+with its reverse complement when the read cannot be palindromic
+(see mayBePalindromic).
+
+*******************************************************************************/
+
+// Shasta.
+#include "Marker.hpp"
+
+// Standard library.
+#include "array.hpp"
+#include <limits>
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class AlignmentPrefilter;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::AlignmentPrefilter {
+public:
+
+    // The possible outcomes of the check.
+    enum class Result {
+        Pass,
+        TooFewSharedMarkers,
+        TooMuchTrim,
+        InconsistentDiagonal
+    };
+    static const size_t resultCount = 4;
+
+    Result check(
+        const array<vector<MarkerWithOrdinal>, 2>& markersSortedByKmerId,
+        uint32_t maxMarkerFrequency,
+        size_t minAlignedMarkerCount,
+        size_t maxTrim);
+
+    // Return false if the alignment of a read (markersSortedByKmerId[0])
+    // with its reverse complement (markersSortedByKmerId[1])
+    // cannot satisfy the alignedFractionThreshold and
+    // nearDiagonalFractionThreshold criteria used by flagPalindromicReads.
+    // The aligned markers are distinct pairs of markers with the same k-mer,
+    // so their number is at most the number of such pairs, and the number
+    // of aligned markers near the diagonal is at most the number of such
+    // pairs near the diagonal. This does not allocate memory.
+    bool mayBePalindromic(
+        const array<vector<MarkerWithOrdinal>, 2>& markersSortedByKmerId,
+        uint32_t maxMarkerFrequency,
+        double alignedFractionThreshold,
+        double nearDiagonalFractionThreshold,
+        uint32_t deltaThreshold) const;
+
+    // The number of bytes allocated by the work areas,
+    // which are kept between calls to check.
+    uint64_t capacityBytes() const
+    {
+        return
+            startPairs.capacity() * sizeof(array<uint32_t, 2>) +
+            endPairs.capacity() * sizeof(array<uint32_t, 2>);
+    }
+
+private:
+
+    // The ordinals of the start pairs and end pairs.
+    vector< array<uint32_t, 2> > startPairs;
+    vector< array<uint32_t, 2> > endPairs;
+};
+
+#endif
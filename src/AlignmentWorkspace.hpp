@@ -0,0 +1,96 @@
+#ifndef CZI_SHASTA_ALIGNMENT_WORKSPACE_HPP
+#define CZI_SHASTA_ALIGNMENT_WORKSPACE_HPP
+
+/*******************************************************************************
+
+Class AlignmentWorkspace contains everything needed to compute
+marker alignments of many pairs of oriented reads:
+the marker buffers, the AlignmentGraph with its shortest path
+work areas, the MarkerChainer, the AlignmentPrefilter,
+and the computed alignment.
+
+None of these release memory between alignments, so once
+their capacity reaches the high water mark required by the
+alignments being computed, computing an alignment no longer
+allocates memory. Each thread computing alignments should
+own an AlignmentWorkspace.
+
+To verify this, call update after each alignment.
+It keeps track of the total number of bytes allocated,
+and counts the alignments during which that number increased.
+The allocated memory never decreases, so an increase
+happens if and only if at least one of the work areas grew.
+
+*******************************************************************************/
+
+// Shasta.
+#include "Alignment.hpp"
+#include "AlignmentGraph.hpp"
+#include "AlignmentPrefilter.hpp"
+#include "MarkerChainer.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class AlignmentWorkspace;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::AlignmentWorkspace {
+public:
+
+    // The markers of the two oriented reads being aligned, sorted by KmerId.
+    array<vector<MarkerWithOrdinal>, 2> markersSortedByKmerId;
+
+    // The alignment engines.
+    AlignmentGraph graph;
+    MarkerChainer chainer;
+
+    // Used to reject pairs that cannot give a good alignment.
+    AlignmentPrefilter prefilter;
+
+    // The computed alignment.
+    Alignment alignment;
+    AlignmentInfo alignmentInfo;
+
+    // The number of bytes currently allocated.
+    uint64_t capacityBytes() const
+    {
+        return
+            markersSortedByKmerId[0].capacity() * sizeof(MarkerWithOrdinal) +
+            markersSortedByKmerId[1].capacity() * sizeof(MarkerWithOrdinal) +
+            graph.capacityBytes() +
+            chainer.capacityBytes() +
+            prefilter.capacityBytes() +
+            alignment.ordinals.capacity() * sizeof(array<uint32_t, 2>);
+    }
+
+    // Allocation statistics.
+    class Statistics {
+    public:
+
+        // The number of alignments computed.
+        uint64_t alignmentCount = 0;
+
+        // The number of alignments that required allocating memory.
+        uint64_t growthCount = 0;
+
+        // The number of bytes allocated.
+        uint64_t highWaterBytes = 0;
+    };
+    Statistics statistics;
+
+    // Update the statistics. Call this after each alignment.
+    void update()
+    {
+        ++statistics.alignmentCount;
+        const uint64_t bytes = capacityBytes();
+        if(bytes > statistics.highWaterBytes) {
+            ++statistics.growthCount;
+            statistics.highWaterBytes = bytes;
+        }
+    }
+};
+
+#endif
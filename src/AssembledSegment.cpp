@@ -18,14 +18,14 @@ void AssembledSegment::clear()
     vertexCoverage.clear();
     edgeCoverage.clear();
 
-    vertexSequences.clear();
-    vertexRepeatCounts.clear();
-
-    edgeSequences.clear();
-    edgeRepeatCounts.clear();
+    sequenceBuffer.clear();
+    repeatCountBuffer.clear();
+    vertexSequenceOffsets.clear();
+    edgeSequenceOffsets.clear();
     edgeOverlappingBaseCounts.clear();
 
     vertexOffsets.clear();
+    vertexAssembledPortion.clear();
 
     runLengthSequence.clear();
     repeatCounts.clear();
@@ -35,6 +35,10 @@ void AssembledSegment::clear()
     vertexRawRange.clear();
     edgeRunLengthRange.clear();
     edgeRawRange.clear();
+
+    vertexCoverageData.clear();
+    edgeCoverageData.clear();
+    assembledCoverageData.clear();
 }
 
 
@@ -46,12 +50,12 @@ void AssembledSegment::computeVertexOffsets()
 
     for(size_t i=0; i<edgeCount; i++) {
         const uint8_t overlap = edgeOverlappingBaseCounts[i];
+        const uint32_t edgeSequenceLength = edgeSequenceOffsets[i+1] - edgeSequenceOffsets[i];
         if(overlap > 0) {
-            CZI_ASSERT(edgeSequences[i].empty());
-            CZI_ASSERT(edgeRepeatCounts[i].empty());
+            CZI_ASSERT(edgeSequenceLength == 0);
             vertexOffsets[i+1] = uint32_t(vertexOffsets[i] + k - overlap);
         } else {
-            vertexOffsets[i+1] = uint32_t(vertexOffsets[i] + k + edgeSequences[i].size());
+            vertexOffsets[i+1] = uint32_t(vertexOffsets[i] + k + edgeSequenceLength);
         }
     }
 }
@@ -126,9 +130,11 @@ void AssembledSegment::assemble()
         // Vertex.
         vertexRunLengthRange[i].first = uint32_t(runLengthSequence.size());
         vertexRawRange[i].first = uint32_t(assembledRawSequence.size());
+        const Base* vertexBases = sequenceBuffer.data() + vertexSequenceOffsets[i];
+        const uint32_t* vertexCounts = repeatCountBuffer.data() + vertexSequenceOffsets[i];
         for(uint32_t j=vertexAssembledPortion[i].first; j!=vertexAssembledPortion[i].second; j++) {
-            const Base base = vertexSequences[i][j];
-            const uint32_t repeatCount = vertexRepeatCounts[i][j];
+            const Base base = vertexBases[j];
+            const uint32_t repeatCount = vertexCounts[j];
             CZI_ASSERT(repeatCount > 0);
             runLengthSequence.push_back(base);
             repeatCounts.push_back(repeatCount);
@@ -150,10 +156,13 @@ void AssembledSegment::assemble()
         // Edge.
         edgeRunLengthRange[i].first = uint32_t(runLengthSequence.size());
         edgeRawRange[i].first = uint32_t(assembledRawSequence.size());
-        if(edgeSequences[i].size() > 0) {
-            for(uint32_t j=0; j!=uint32_t(edgeSequences[i].size()); j++) {
-                const Base base = edgeSequences[i][j];
-                const uint32_t repeatCount = edgeRepeatCounts[i][j];
+        const uint32_t edgeSequenceLength = edgeSequenceOffsets[i+1] - edgeSequenceOffsets[i];
+        if(edgeSequenceLength > 0) {
+            const Base* edgeBases = sequenceBuffer.data() + edgeSequenceOffsets[i];
+            const uint32_t* edgeCounts = repeatCountBuffer.data() + edgeSequenceOffsets[i];
+            for(uint32_t j=0; j!=edgeSequenceLength; j++) {
+                const Base base = edgeBases[j];
+                const uint32_t repeatCount = edgeCounts[j];
                 CZI_ASSERT(repeatCount > 0);
                 runLengthSequence.push_back(base);
                 repeatCounts.push_back(repeatCount);
@@ -272,8 +281,8 @@ void AssembledSegment::writeHtml(ostream& html) const
         // Vertex.
         const MarkerGraph::VertexId vertexId = vertexIds[i];
         const string url = urlPrefix + to_string(vertexId) + urlSuffix;
-        const vector<Base>& vertexSequence = vertexSequences[i];
-        const vector<uint32_t>& vertexRepeatCount = vertexRepeatCounts[i];
+        const auto vertexSequence = this->vertexSequence(i);
+        const auto vertexRepeatCount = this->vertexRepeatCount(i);
         // const uint32_t maxVertexRepeatCount =
         //     *std::max_element(vertexRepeatCount.begin(), vertexRepeatCount.end());
         html <<
@@ -344,8 +353,8 @@ void AssembledSegment::writeHtml(ostream& html) const
         // const MarkerGraph::Edge& edge = markerGraph.edges[edgeId];
         const string sourceUrl = urlPrefix + to_string(vertexIds[i]) + urlSuffix;
         const string targetUrl = urlPrefix + to_string(vertexIds[i+1]) + urlSuffix;
-        const vector<Base>& edgeSequence = edgeSequences[i];
-        const vector<uint32_t>& edgeRepeatCount = edgeRepeatCounts[i];
+        const auto edgeSequence = this->edgeSequence(i);
+        const auto edgeRepeatCount = this->edgeRepeatCount(i);
         const size_t edgeSequenceLength = edgeSequence.size();
         CZI_ASSERT(edgeRepeatCount.size() == edgeSequenceLength);
         // const uint32_t maxEdgeRepeatCount =
@@ -6,6 +6,7 @@
 #include "Base.hpp"
 #include "Coverage.hpp"
 #include "MarkerGraph.hpp"
+#include "MemoryAsContainer.hpp"
 
 // Standard library.
 #include "vector.hpp"
@@ -43,15 +44,46 @@ public:
     vector<uint32_t> vertexCoverage;
     vector<uint32_t> edgeCoverage;
 
-    // The consensus sequences and repeat counts for the vertices in the chain.
-    vector< vector<Base> > vertexSequences;
-    vector< vector<uint32_t> > vertexRepeatCounts;
-
-    // The consensus sequences and repeat counts for the edges in the chain.
-    vector< vector<Base> > edgeSequences;
-    vector< vector<uint32_t> > edgeRepeatCounts;
+    // The consensus sequences and repeat counts for the vertices and edges in the chain.
+    // To avoid many small memory allocations when an AssembledSegment
+    // is reused for many assembly graph edges, these are stored
+    // in a single flat buffer of bases and repeat counts,
+    // with vertex sequences first followed by edge sequences.
+    // The sequence of vertex i occupies positions
+    // [vertexSequenceOffsets[i], vertexSequenceOffsets[i+1]) of the buffers,
+    // and similarly for edges using edgeSequenceOffsets.
+    // Use the accessors below to get the sequence of a given vertex or edge.
+    vector<Base> sequenceBuffer;
+    vector<uint32_t> repeatCountBuffer;
+    vector<uint32_t> vertexSequenceOffsets;
+    vector<uint32_t> edgeSequenceOffsets;
     vector<uint8_t> edgeOverlappingBaseCounts;
 
+    MemoryAsContainer<const Base> vertexSequence(size_t i) const
+    {
+        return MemoryAsContainer<const Base>(
+            sequenceBuffer.data() + vertexSequenceOffsets[i],
+            sequenceBuffer.data() + vertexSequenceOffsets[i+1]);
+    }
+    MemoryAsContainer<const uint32_t> vertexRepeatCount(size_t i) const
+    {
+        return MemoryAsContainer<const uint32_t>(
+            repeatCountBuffer.data() + vertexSequenceOffsets[i],
+            repeatCountBuffer.data() + vertexSequenceOffsets[i+1]);
+    }
+    MemoryAsContainer<const Base> edgeSequence(size_t i) const
+    {
+        return MemoryAsContainer<const Base>(
+            sequenceBuffer.data() + edgeSequenceOffsets[i],
+            sequenceBuffer.data() + edgeSequenceOffsets[i+1]);
+    }
+    MemoryAsContainer<const uint32_t> edgeRepeatCount(size_t i) const
+    {
+        return MemoryAsContainer<const uint32_t>(
+            repeatCountBuffer.data() + edgeSequenceOffsets[i],
+            repeatCountBuffer.data() + edgeSequenceOffsets[i+1]);
+    }
+
     // Vertex offsets.
     // A vertex offset is the position of the first base
     // of the vertex consensus sequence (run-length)
@@ -81,7 +113,8 @@ public:
     void assemble();
 
     // Put back into default-constructed state
-    // (except for vector capacities).
+    // (except for vector capacities, which are preserved
+    // so an AssembledSegment can be reused without reallocating).
     void clear();
 
     // Write out details in html.
@@ -43,11 +43,26 @@ Assembler::Assembler(
 
         reads.accessExistingReadWrite(largeDataName("Reads"));
         readNames.accessExistingReadWrite(largeDataName("ReadNames"));
-        readRepeatCounts.accessExistingReadWrite(largeDataName("ReadRepeatCounts"));
+
+        // If the read repeat counts were compressed and removed,
+        // use the compressed representation.
+        try {
+            readRepeatCounts.accessExistingReadWrite(largeDataName("ReadRepeatCounts"));
+        } catch(std::exception&) {
+            accessCompactReadRepeatCounts();
+        }
+
+        // The read name index is not available for assemblies
+        // created before it was introduced.
+        try {
+            accessReadNameIndex();
+        } catch(std::exception&) {
+        }
 
     }
 
-    // In both cases, assemblerInfo, reads, readNames, readRepeatCounts are all open for write.
+    // In both cases, assemblerInfo, reads, readNames are all open for write.
+    // So is readRepeatCounts, unless it was replaced by compactReadRepeatCounts.
 
 #ifndef SHASTA_STATIC_EXECUTABLE
     fillServerFunctionTable();
@@ -60,6 +75,10 @@ Assembler::Assembler(
 Assembler::~Assembler()
 {
 #ifndef SHASTA_STATIC_EXECUTABLE
+    if(httpServerData.prefetchThread.joinable()) {
+        httpServerData.stopPrefetch = true;
+        httpServerData.prefetchThread.join();
+    }
     if(marginPhaseParameters) {
         destroyConsensusParameters(marginPhaseParameters);
         marginPhaseParameters = 0;
@@ -106,6 +125,61 @@ void Assembler::setupConsensusCaller(const string& s)
 
 
 
+// Benchmark the SimpleBayesianConsensusCaller on the coverage data
+// stored for marker graph vertices and edges.
+void Assembler::benchmarkSimpleBayesianConsensusCaller(size_t maxCoverageCount)
+{
+    if(!markerGraph.coverageDataIsOpen()) {
+        throw runtime_error("Coverage data is not accessible.");
+    }
+
+    // Gather Coverage objects, one for each position
+    // of each vertex and edge of the marker graph.
+    vector<Coverage> coverages;
+    vector<Coverage> positionCoverages;
+    vector< pair<uint32_t, CompressedCoverageData> > v;
+    auto addCoverages = [&]()
+    {
+        positionCoverages.clear();
+        for(const pair<uint32_t, CompressedCoverageData>& p: v) {
+            const uint32_t position = p.first;
+            if(position >= positionCoverages.size()) {
+                positionCoverages.resize(position+1);
+            }
+            const CompressedCoverageData& cd = p.second;
+            for(uint8_t i=0; i<cd.frequency; i++) {
+                positionCoverages[position].addRead(
+                    AlignedBase::fromInteger(cd.base), cd.strand, cd.repeatCount);
+            }
+        }
+        for(const Coverage& coverage: positionCoverages) {
+            if(coverages.size() == maxCoverageCount) {
+                return;
+            }
+            if(!coverage.getReadCoverageData().empty()) {
+                coverages.push_back(coverage);
+            }
+        }
+    };
+    for(MarkerGraph::VertexId vertexId=0;
+        vertexId<markerGraph.vertexCoverageDataSize() && coverages.size()<maxCoverageCount;
+        vertexId++) {
+        markerGraph.getVertexCoverageData(vertexId, v);
+        addCoverages();
+    }
+    for(MarkerGraph::EdgeId edgeId=0;
+        edgeId<markerGraph.edgeCoverageDataSize() && coverages.size()<maxCoverageCount;
+        edgeId++) {
+        markerGraph.getEdgeCoverageData(edgeId, v);
+        addCoverages();
+    }
+
+    const SimpleBayesianConsensusCaller consensusCaller;
+    consensusCaller.benchmark(coverages);
+}
+
+
+
 // Read marginPhase parameters from file MarginPhase.json in the run directory.
 void Assembler::setupMarginPhase()
 {
@@ -3,21 +3,35 @@
 
 // Shasta.
 #include "Alignment.hpp"
+#include "AlignmentWorkspace.hpp"
 #include "AssembledSegment.hpp"
 #include "AssemblyGraph.hpp"
+#include "CompactMarkers.hpp"
+#include "CompactRepeatCounts.hpp"
+#include "LowHashSketches.hpp"
 #include "Coverage.hpp"
 #include "dset64.hpp"
+#include "findMarkerId.hpp"
+#include "Histogram.hpp"
 #include "HttpServer.hpp"
+#include "HttpResponseCache.hpp"
 #include "Kmer.hpp"
 #include "LongBaseSequence.hpp"
 #include "Marker.hpp"
 #include "MarkerGraph.hpp"
+#include "MarkerKmerIndex.hpp"
 #include "MemoryMappedObject.hpp"
 #include "MultitreadedObject.hpp"
+#include "OrientedReadMarkers.hpp"
 #include "OrientedReadPair.hpp"
+#include "PerformanceReport.hpp"
+#include "PersistentMemory.hpp"
 #include "ReadGraph.hpp"
+#include "ReadFlagBitplanes.hpp"
 #include "ReadFlags.hpp"
 #include "ReadId.hpp"
+#include "ReadNameIndex.hpp"
+#include "ReferenceIndex.hpp"
 
 #ifndef SHASTA_STATIC_EXECUTABLE
 // MarginPhase.
@@ -25,8 +39,13 @@
 #endif
 
 // Standard library.
+#include "chrono.hpp"
 #include "memory.hpp"
+#include <map>
+#include <mutex>
+#include <shared_mutex>
 #include "string.hpp"
+#include <thread>
 #include "tuple.hpp"
 
 namespace ChanZuckerberg {
@@ -41,14 +60,20 @@ namespace ChanZuckerberg {
         class AlignmentGraph;
         class AlignmentInfo;
         class AssembledSegment;
+        class CompactLocalMarkerGraph;
+        class Consensus;
         class ConsensusCaller;
+        class CoverageTensor;
         class LocalAlignmentGraph;
         class LocalAssemblyGraph;
 #ifndef SHASTA_STATIC_EXECUTABLE
+        class LiveHttpServer;
         class LocalMarkerGraph;
 #endif
         class LocalReadGraph;
         class MarkerInterval;
+        class PoaBackend;
+        class PoaBatch;
         namespace MemoryMapped {
             template<class Int, class T> class VectorOfVectors;
         }
@@ -109,17 +134,78 @@ public:
     // Destructor.
     ~Assembler();
 
-    // Add reads from a fasta file.
+    // The time and memory used by each stage of the assembly,
+    // measured using PerformanceReport::StageTimer.
+    PerformanceReport performanceReport;
+
+    // Add reads from a fasta or fastq file,
+    // optionally compressed using gzip or bgzip.
     // The reads are added to those already previously present.
     void addReadsFromFasta(
         const string& fileName,
         size_t minReadLength,
         size_t blockSize,
         size_t threadCountForReading,
-        size_t threadCountForProcessing);
+        size_t threadCountForProcessing,
+        bool doubleBuffering = false);
+
+    // Add reads from multiple fasta or fastq files.
+    // Up to maxConcurrentFileCount files (0 = one file per processing thread)
+    // are loaded concurrently, each into temporary data structures.
+    // The concurrently loaded files share the processing threads
+    // and the block size, which is the total memory budget for input blocks.
+    // threadCountForReading is used for each file.
+    // When all files are loaded, their reads are appended
+    // in the order of fileNames, so the ReadIds are the same as if the files
+    // were loaded one at a time, regardless of the order in which loading completed.
+    // The read name index is recreated once, at the end.
+    void addReadsFromFastaFiles(
+        const vector<string>& fileNames,
+        size_t minReadLength,
+        size_t blockSize,
+        size_t threadCountForReading,
+        size_t threadCountForProcessing,
+        size_t maxConcurrentFileCount = 0);
+private:
+    void addReadsFromFastaFilesThreadFunction(size_t threadId);
+    class AddReadsFromFastaFilesData {
+    public:
+        vector<string> fileNames;
+        size_t minReadLength;
+        size_t blockSize;
+        size_t threadCountForReading;
+        size_t threadCountForProcessing;
+
+        // The reads of each file, before they are appended
+        // to the permanent data structures. Indexed by file index.
+        vector< shared_ptr<LongBaseSequences> > fileReads;
+        vector< shared_ptr< MemoryMapped::VectorOfVectors<char, uint64_t> > > fileReadNames;
+        vector< shared_ptr< MemoryMapped::VectorOfVectors<uint8_t, uint64_t> > > fileReadRepeatCounts;
+
+        // The messages written while loading each file.
+        // They are written out in file order at the end.
+        vector<string> fileMessages;
+    };
+    AddReadsFromFastaFilesData addReadsFromFastaFilesData;
+public:
 
     // Create a histogram of read lengths.
+    // A summary is written to out, or to cout if not specified.
     void histogramReadLength(const string& fileName);
+    void histogramReadLength(const string& fileName, ostream& out);
+
+    // Subsample the reads to a target coverage,
+    // given an estimate of the genome size in bases.
+    // The longest reads are kept, and the remaining ones
+    // are flagged as excluded in the read flags.
+    // Excluded reads get no markers, so they don't participate
+    // in the assembly and don't use compute time.
+    // This must be called after initializeReadFlags and before findMarkers.
+    void subsampleReads(double targetCoverage, uint64_t genomeSize);
+
+    // Micro-benchmark for computeRunLengthRepresentation
+    // using the reads currently present.
+    void benchmarkRunLengthRepresentation(size_t repeatCount);
 
     // Function to write one or all reads in Fasta format.
     void writeReads(const string& fileName);
@@ -135,20 +221,68 @@ public:
         int seed            // For random number generator.
     );
 
+    // Same as randomlySelectKmers, but k-mers that are
+    // over-represented in the reads are never selected as markers.
+    // A k-mer is over-represented if its frequency in the reads
+    // (both strands) exceeds enrichmentThreshold times
+    // the average frequency of the k-mers present in the reads.
+    // The probability is adjusted so the fraction of
+    // k-mers selected is still approximately equal to probability.
+    void selectKmersBasedOnFrequency(
+        size_t k,           // k-mer length.
+        double probability, // The probability that a k-mer is selected as a marker.
+        int seed,           // For random number generator.
+        double enrichmentThreshold,
+        size_t threadCount
+    );
+
     // Functions related to markers.
     // See the beginning of Marker.hpp for more information.
-    void findMarkers(size_t threadCount);
+    // If strandImplicit is true, markers are stored for strand 0 only,
+    // and the markers on strand 1 are computed on the fly
+    // (see OrientedReadMarkers.hpp). This halves the memory used
+    // by the markers, but the marker graph cannot be created.
+    void findMarkers(size_t threadCount, bool strandImplicit = false);
     void accessMarkers();
+
+    // Precompute the markers of each oriented read sorted by KmerId.
+    // Once this is done, alignment computations
+    // no longer sort markers for each alignment.
+    void computeSortedMarkers(size_t threadCount);
+    void accessSortedMarkers();
+
+    // Create a compact, varint encoded copy of the markers
+    // and verify that it decodes to the same markers.
+    // See CompactMarkers.hpp for more information.
+    // When the compact markers are open, getMarkerId,
+    // getMarkersSortedByKmerId, and the LowHash computation
+    // use them instead of the markers.
+    // If releaseMarkers is true, the markers are closed
+    // when done, so the LowHash stage can run without them.
+    // They remain on disk and can be accessed again
+    // with accessMarkers for the stages that need them.
+    void compressMarkers(size_t threadCount, bool releaseMarkers);
+    void accessCompactMarkers();
+
+    // Create an inverted index that gives, for each marker k-mer,
+    // the oriented reads and ordinals of the markers with that k-mer.
+    // See MarkerKmerIndex.hpp for more information.
+    void createMarkerKmerIndex(size_t threadCount);
+    void accessMarkerKmerIndex();
     void writeMarkers(ReadId, Strand, const string& fileName);
 
     // Use the minHash algorithm to find candidate alignments.
     // Use as features sequences of m consecutive special k-mers.
+    // This uses the LowHash code in bottom-k mode, keeping for
+    // each oriented read its sketchSize lowest hashes at each iteration.
     void findAlignmentCandidatesMinHash(
         size_t m,                       // Number of consecutive k-mers that define a feature.
         size_t minHashIterationCount,   // Number of minHash iterations.
         size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for minHash.
         size_t maxBucketSize,           // The maximum size for a bucket to be used.
         size_t minFrequency,            // Minimum number of minHash hits for a pair to become a candidate.
+        size_t sketchSize,              // Number of lowest hashes used for each oriented read at each iteration.
+        size_t lowHashMethod,           // 0 = use buckets, 1 = sort the hashes.
         size_t threadCount
     );
     void findAlignmentCandidatesLowHash(
@@ -158,10 +292,82 @@ public:
         size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for lowHash.
         size_t maxBucketSize,           // The maximum size for a bucket to be used.
         size_t minFrequency,            // Minimum number of lowHash hits for a pair to become a candidate.
+        size_t lowHashMethod,           // 0 = use buckets, 1 = sort the low hashes.
+        size_t candidateTableMegabytes, // If not 0, accumulate candidates in a hash table of this size.
+        bool singlePassHashing,         // If true, compute the low hashes for all iterations at once.
+        bool storeSketches,             // If true, store the low hashes for later incremental use.
+
+        // Adaptive mode. If targetCandidatesPerRead is not 0,
+        // minHashIterationCount is the maximum number of iterations,
+        // and minFrequency the minimum value of minFrequency.
+        // The iterations stop early and minFrequency is increased
+        // to stay within this number of candidates per oriented read
+        // and avoid candidates that rarely give good alignments.
+        // The success rate of alignments is estimated on samples of candidates
+        // using the following alignment parameters, as in computeAlignments.
+        double targetCandidatesPerRead,
+        uint32_t maxMarkerFrequency,
+        size_t maxSkip,
+        size_t minAlignedMarkerCount,
+        size_t maxTrim,
+
         size_t threadCount
     );
     void accessAlignmentCandidates();
 
+    // Incremental version of findAlignmentCandidatesLowHash,
+    // to be used after adding reads to a run in which
+    // findAlignmentCandidatesLowHash was called with storeSketches=true.
+    // It uses the stored low hashes of the old reads and only finds
+    // candidates involving at least one new read, which are
+    // merged with the existing alignment candidates.
+    // m, hashFraction, and minHashIterationCount are the ones
+    // used when the sketches were stored.
+    // The markers of all reads must have been recomputed
+    // using the same marker k-mers.
+    void findAlignmentCandidatesLowHashIncremental(
+        size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for lowHash.
+        size_t maxBucketSize,           // The maximum size for a bucket to be used.
+        size_t minFrequency,            // Minimum number of lowHash hits for a pair to become a candidate.
+        size_t lowHashMethod,           // 0 = use buckets, 1 = sort the low hashes.
+        size_t candidateTableMegabytes, // If not 0, accumulate candidates in a hash table of this size.
+        size_t threadCount
+    );
+    void accessLowHashSketches();
+
+    // Sharded version of findAlignmentCandidatesLowHash, for runs
+    // in which the buckets and low hashes of all oriented reads
+    // don't fit in the memory of one machine.
+    // The range of low hash values is divided into shardCount
+    // contiguous ranges. Each shard, which can run as a separate process
+    // on any machine that sees the Data directory via a shared filesystem,
+    // only uses the low hashes in its range, and stores the candidates
+    // it finds with their frequencies.
+    // When all shards are complete, mergeLowHashShards adds up
+    // the frequencies found by all shards, applies minFrequency,
+    // and creates the alignment candidates.
+    // With lowHashMethod 1 the result is the same as for
+    // findAlignmentCandidatesLowHash. With lowHashMethod 0
+    // it can differ slightly, because each shard only sees
+    // its own entries when applying maxBucketSize to a bucket.
+    void findAlignmentCandidatesLowHashShard(
+        uint64_t shardId,
+        uint64_t shardCount,
+        size_t m,                       // Number of consecutive k-mers that define a feature.
+        double hashFraction,            // Low hash threshold.
+        size_t minHashIterationCount,   // Number of lowHash iterations.
+        size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for lowHash.
+        size_t maxBucketSize,           // The maximum size for a bucket to be used.
+        size_t lowHashMethod,           // 0 = use buckets, 1 = sort the low hashes.
+        size_t candidateTableMegabytes, // If not 0, accumulate candidates in a hash table of this size.
+        bool singlePassHashing,         // If true, compute the low hashes for all iterations at once.
+        size_t threadCount
+    );
+    void mergeLowHashShards(
+        uint64_t shardCount,
+        size_t minFrequency             // Minimum number of lowHash hits for a pair to become a candidate.
+    );
+
     // Write the reads that overlap a given read.
     void writeOverlappingReads(ReadId, Strand, const string& fileName);
 
@@ -173,6 +379,23 @@ public:
         uint32_t maxMarkerFrequency
     );
 
+    // Compute marker alignments of many pairs of oriented reads
+    // in parallel, without writing any output.
+    // On return, alignmentInfos[i] describes the alignment of
+    // orientedReadIdPairs[i]. If no alignment was found,
+    // its markerCount is 0 and its other fields must not be used.
+    // The alignments are computed as in computeAlignments.
+    // Used by the Python batch alignment API.
+    void alignOrientedReadsBatch(
+        const vector< array<OrientedReadId, 2> >& orientedReadIdPairs,
+        size_t maxSkip,                 // Maximum ordinal skip allowed.
+        uint32_t maxMarkerFrequency,
+        size_t bandWidth,               // If not 0, first try a banded alignment.
+        size_t alignMethod,             // 0 = alignment graph, 1 = chaining.
+        size_t threadCount,
+        vector<AlignmentInfo>& alignmentInfos
+    );
+
     // Compute marker alignments of an oriented read with all reads
     // for which we have an Overlap.
     void alignOverlappingOrientedReads(
@@ -229,11 +452,103 @@ public:
         // Maximum left/right trim (in bases) for an alignment to be used.
         size_t maxTrim,
 
+        // If not 0, first try a banded alignment using this
+        // maximum distance (in markers) from the dominant diagonal,
+        // falling back to the full alignment graph if necessary.
+        // See AlignmentGraph.hpp for more information.
+        size_t bandWidth,
+
+        // The method used to compute alignments:
+        // 0 = alignment graph (AlignmentGraph.hpp),
+        // 1 = chaining (MarkerChainer.hpp), which ignores bandWidth.
+        size_t alignMethod,
+
+        // If true, also store the ordinals of the good alignments
+        // in compressedAlignments, so createMarkerGraphVertices
+        // can use them instead of computing the alignments again.
+        bool storeAlignments,
+
+        // If true, the candidates are processed grouped by readIds[0],
+        // so the sorted markers of the first read can be reused
+        // for consecutive candidates. This does not change the results.
+        bool groupCandidates,
+
+        // If true, reads found to be contained in another read
+        // while alignments are being computed stop being aligned
+        // with reads that are not long enough to contain them.
+        // Those alignments would be discarded by createReadGraphNew,
+        // so this should only be used in conjunction with it.
+        bool filterContainedReads,
+
+        // If not 0 and alignMethod is 0, work budget in alignment graph edges.
+        // Candidates whose alignment graph exceeds it are deferred
+        // and aligned at the end using chaining.
+        uint64_t maxAlignmentGraphEdgeCount,
+
         // Number of threads. If zero, a number of threads equal to
         // the number of virtual processors is used.
         size_t threadCount
     );
+
+    // Distributed computation of alignments, for machines that share
+    // the Data directory on a parallel filesystem.
+    // The alignment candidates are divided into shardCount ranges of
+    // about the same size. Each worker process opens the existing data
+    // (with accessKmers, accessMarkers, accessAlignmentCandidates)
+    // and calls computeAlignmentsShard for one shard, using the same
+    // arguments as computeAlignments. This stores the good alignments
+    // for the shard in Data files of its own (AlignmentData-Shard-*,
+    // CompressedAlignments-Shard-*, and AlignmentShardInfo-Shard-*, which is
+    // written last to mark the shard as complete).
+    // When all shards are complete, the coordinator calls
+    // mergeAlignmentShards, which concatenates them in shard order
+    // into alignmentData and compressedAlignments, removes the shard files,
+    // and computes the alignment table. The result is the same
+    // as with computeAlignments, except for the order of alignmentData.
+    void computeAlignmentsShard(
+        uint64_t shardId,
+        uint64_t shardCount,
+        uint32_t maxMarkerFrequency,
+        size_t maxSkip,
+        size_t minAlignedMarkerCount,
+        size_t maxTrim,
+        size_t bandWidth,
+        size_t alignMethod,
+        bool storeAlignments,
+        uint64_t maxAlignmentGraphEdgeCount,
+        size_t threadCount);
+    void mergeAlignmentShards(
+        uint64_t shardCount,
+        size_t threadCount);
+
     void accessAlignmentData();
+    void accessCompressedAlignments();
+
+    // Compare the alignment graph and chaining alignment methods
+    // on the first candidateCount alignment candidates
+    // (all of them if candidateCount is 0).
+    // For each method, write the time used and the number of
+    // good alignments, and write how many alignments are the same.
+    void benchmarkAlignments(
+        uint32_t maxMarkerFrequency,
+        size_t maxSkip,
+        size_t minAlignedMarkerCount,
+        size_t maxTrim,
+        size_t candidateCount);
+
+    // Compare the two shortest path engines of the AlignmentGraph
+    // (dynamic programming in topological order and Dijkstra)
+    // on the slow alignments logged by computeAlignments.
+    // The oriented read pairs are read from lines of the form
+    // "Slow alignment computation for oriented reads 123-0 456-1: 2.5 s."
+    // in the specified file (usually the output of a previous run).
+    // For each engine, write the time used, and write how many
+    // alignments have the same optimal path length and are identical.
+    void benchmarkAlignmentShortestPath(
+        const string& logFileName,
+        uint32_t maxMarkerFrequency,
+        size_t maxSkip,
+        size_t bandWidth);
 
 
 
@@ -255,17 +570,60 @@ public:
 
         // Minimum coverage (number of markers) for a vertex
         // of the marker graph to be kept.
+        // If zero, it is chosen from the coverage histogram,
+        // see selectMarkerGraphCoverageThresholds.
         size_t minCoverage,
 
         // Maximum coverage (number of markers) for a vertex
         // of the marker graph to be kept.
+        // If zero, it is chosen from the coverage histogram.
         size_t maxCoverage,
 
+        // If not zero, each thread buffers this number of
+        // union operations on the disjoint sets data structure
+        // and applies them in order of marker id block.
+        // See DisjointSetsUnionBuffer.hpp.
+        size_t unionBufferSize,
+
+        // If not zero, use the out of core mode with this number
+        // of partitions, which bounds memory usage at the cost
+        // of writing and reading spill files.
+        // See AssemblerMarkerGraphOutOfCore.cpp.
+        size_t outOfCorePartitionCount,
+
+        // If true, store the disjoint set that each marker was assigned to,
+        // for use by createMarkerGraphVerticesIncremental.
+        // Not supported in out of core mode.
+        bool storeDisjointSetTable,
+
         // Number of threads. If zero, a number of threads equal to
         // the number of virtual processors is used.
         size_t threadCount
     );
 
+    // Incremental version of createMarkerGraphVertices,
+    // used after reads are added to an assembly.
+    // This requires a previous call to createMarkerGraphVertices
+    // with storeDisjointSetTable set, and the markers must have been
+    // recomputed for all reads using the same k-mers, so the
+    // markers of the old reads keep their MarkerIds.
+    // Instead of processing all alignments in the read graph,
+    // the disjoint sets are initialized from the stored disjoint set table,
+    // then only the read graph edges involving at least one new read
+    // are processed. The coverage thresholds and the removal of
+    // bad vertices are then applied as in createMarkerGraphVertices,
+    // and the disjoint set table is stored again, so this can be repeated.
+    // The result is the same as createMarkerGraphVertices
+    // if the read graph edges between old reads did not change.
+    // Edges removed from the read graph by the new reads
+    // (or involving reads that became chimeric) are still used.
+    void createMarkerGraphVerticesIncremental(
+        uint32_t maxMarkerFrequency,
+        size_t maxSkip,
+        size_t minCoverage,
+        size_t maxCoverage,
+        size_t threadCount);
+
 
 
     // Python-callable access functions for the global marker graph.
@@ -340,7 +698,70 @@ public:
         size_t lowCoverageThreshold,
         size_t highCoverageThreshold,
         size_t maxDistance,
-        size_t edgeMarkerSkipThreshold);
+        size_t edgeMarkerSkipThreshold,
+        size_t threadCount = 0);
+private:
+
+    // Work area for one bounded BFS of flagMarkerGraphWeakEdges.
+    // Each thread has its own.
+    // Visited vertices are kept in a small open addressing hash table.
+    // A slot is in use only if its epoch equals the current epoch,
+    // so nothing has to be cleared between BFSs.
+    class FlagMarkerGraphWeakEdgesWorkspace {
+    public:
+        class Slot {
+        public:
+            MarkerGraph::VertexId vertexId;
+            uint32_t epoch = 0;
+        };
+        vector<Slot> slots;
+        uint32_t epoch = 0;
+        uint64_t usedCount = 0;
+
+        // The BFS queue. For each vertex we also store its distance
+        // from the start vertex and whether the BFS path to it
+        // uses edges of the coverage being processed.
+        class QueueEntry {
+        public:
+            MarkerGraph::VertexId vertexId;
+            uint32_t distance;
+            bool usesCurrentCoverage;
+        };
+        vector<QueueEntry> queue;
+
+        // Prepare for a new BFS.
+        void begin();
+
+        // Mark a vertex as visited.
+        // Returns false if it was already visited in this BFS.
+        bool visit(MarkerGraph::VertexId);
+    };
+
+    // Bounded BFS used by flagMarkerGraphWeakEdges for a single edge.
+    // Returns 0 if the target of the edge cannot be reached from its source
+    // within maxDistance without using the edge itself.
+    // Otherwise, returns 1 if the path found does not use
+    // edges with coverage currentCoverage, and 2 if it does
+    // (in that case, another path that does not use them may or may not exist).
+    uint8_t flagMarkerGraphWeakEdgesBfs(
+        MarkerGraph::EdgeId,
+        size_t maxDistance,
+        size_t currentCoverage,
+        FlagMarkerGraphWeakEdgesWorkspace&) const;
+
+    void flagMarkerGraphWeakEdgesThreadFunction(size_t threadId);
+    class FlagMarkerGraphWeakEdgesData {
+    public:
+        size_t maxDistance;
+        size_t coverage;
+
+        // The edges with the coverage being processed, and the
+        // value returned by flagMarkerGraphWeakEdgesBfs for each of them.
+        const MarkerGraph::EdgeId* edgeIds;
+        vector<uint8_t> status;
+    };
+    FlagMarkerGraphWeakEdgesData flagMarkerGraphWeakEdgesData;
+public:
 
 
 
@@ -351,6 +772,20 @@ public:
     // file containing the reference to be used with Blast commands.
     void setReferenceFastaFileName(const string&);
 
+    // Create the index of a reference fasta file, using features
+    // of m consecutive markers, used by the http server to locate reads
+    // in the reference without running Blast. See ReferenceIndex.hpp.
+    // It must be recreated if the markers are selected again.
+    void createReferenceIndex(const string& fastaFileName, size_t m);
+    void accessReferenceIndex();
+
+    // The http server caches responses to requests for
+    // local graph displays, which are expensive to compute.
+    // This sets the maximum number of bytes used by the cache
+    // (0 disables it) and removes all cached responses.
+    void setHttpResponseCacheSize(uint64_t maxByteCount);
+    void clearHttpResponseCache();
+
 
 
 private:
@@ -360,9 +795,13 @@ private:
     size_t largeDataPageSize;
 
     // Function to construct names for binary objects.
+    // Data structures placed on persistent memory
+    // use the file name prefix of PersistentMemory instead.
     string largeDataName(const string& name) const
     {
-        if(largeDataFileNamePrefix.empty()) {
+        if(PersistentMemory::isPlaced(name)) {
+            return PersistentMemory::getFileNamePrefix() + name;
+        } else if(largeDataFileNamePrefix.empty()) {
             return "";  // Anonymous;
         } else {
             return largeDataFileNamePrefix + name;
@@ -435,10 +874,42 @@ private:
     at the price of additional code complexity and performance cost
     in assembly phases that use the base repeat counts.
 
+    Once all reads are loaded, compressReadRepeatCounts can store
+    the repeat counts in compactReadRepeatCounts instead, using
+    the representation described in CompactRepeatCounts.hpp.
+    Since most read repeat counts are 1, 2, or 3, this uses
+    a little more than 2 bits per base instead of 8,
+    which roughly halves the memory used by the reads.
+    Code that uses read repeat counts must access them
+    via getReadRepeatCount or getReadRepeatCounts,
+    which work with either representation.
+
     ***************************************************************************/
 
     LongBaseSequences reads;
     MemoryMapped::VectorOfVectors<uint8_t, uint64_t> readRepeatCounts;
+    CompactRepeatCounts compactReadRepeatCounts;
+public:
+    void compressReadRepeatCounts(bool removeReadRepeatCounts);
+    void accessCompactReadRepeatCounts();
+private:
+
+    // Return the repeat count at a given position of a read,
+    // as stored (that is, on strand 0).
+    uint8_t getReadRepeatCount(ReadId readId, uint64_t position) const
+    {
+        if(readRepeatCounts.isOpen()) {
+            return readRepeatCounts.begin(readId)[position];
+        } else {
+            return compactReadRepeatCounts.get(readId, position);
+        }
+    }
+
+    // Decode the repeat counts of a range of positions
+    // of a read, as stored (that is, on strand 0).
+    // The output must have space for end-begin repeat counts.
+    void getReadRepeatCounts(ReadId, uint64_t begin, uint64_t end, uint8_t* output) const;
+    void getReadRepeatCounts(ReadId, vector<uint8_t>&) const;
 public:
     ReadId readCount() const
     {
@@ -476,9 +947,8 @@ private:
         const ReadId readId = orientedReadId.getReadId();
         const Strand strand = orientedReadId.getStrand();
 
-        // Access the bases and repeat counts for this read.
+        // Access the bases for this read.
         const auto& read = reads[readId];
-        const auto& counts = readRepeatCounts[readId];
 
         // Compute the position as stored, depending on strand.
         uint32_t orientedPosition = position;
@@ -487,7 +957,8 @@ private:
         }
 
         // Extract the base and repeat count at this position.
-        pair<Base, uint8_t> p = make_pair(read[orientedPosition], counts[orientedPosition]);
+        pair<Base, uint8_t> p = make_pair(read[orientedPosition],
+            getReadRepeatCount(readId, orientedPosition));
 
         // Complement the base, if necessary.
         if(strand == 1) {
@@ -520,6 +991,20 @@ private:
     // back to its origin.
     MemoryMapped::VectorOfVectors<char, uint64_t> readNames;
 
+    // Hash index used to find the ReadId of a read given its name.
+    // It is recreated at the end of each call to addReadsFromFasta.
+    ReadNameIndex readNameIndex;
+public:
+    void createReadNameIndex(size_t threadCount = 0);
+    void accessReadNameIndex();
+
+    // Return the ReadId of the read with the given name,
+    // or std::numeric_limits<ReadId>::max() if there is no such read.
+    // If more than one read has that name, the lowest ReadId is returned.
+    ReadId getReadId(const string& readName) const;
+    vector<ReadId> getReadIds(const vector<string>& readNamesToFind) const;
+private:
+
     // Function to write a read in Fasta format.
     void writeRead(ReadId, ostream&);
     void writeOrientedRead(OrientedReadId, ostream&);
@@ -529,6 +1014,10 @@ private:
 
     // Read flags.
     MemoryMapped::Vector<ReadFlags> readFlags;
+
+    // Bit planes used to update read flags concurrently.
+    // See ReadFlagBitplanes.hpp.
+    ReadFlagBitplanes readFlagBitplanes;
 public:
     void initializeReadFlags();
     void accessReadFlags(bool readWriteAccess);
@@ -547,31 +1036,117 @@ private:
     // if (and only if) a k-mer is a marker, its reverse complement
     // is also a marker. That is, for all permitted values of i, 0 <= i < 4^k:
     // kmerTable[i].isMarker == kmerTable[kmerTable[i].reverseComplementKmerId].isMarker
+    // The k-mer table is only created for k <= maxKmerTableK,
+    // because its size grows as 4^k (8 bytes per k-mer).
     MemoryMapped::Vector<KmerInfo> kmerTable;
+    static const size_t maxKmerTableK = 12;
     void checkKmersAreOpen() const;
+    void createKmerTable();
+
+    // Pick each k-mer and its reverse complement with probability p,
+    // skipping k-mers flagged in excludedKmers (if not null).
+    // Used by randomlySelectKmers and selectKmersBasedOnFrequency.
+    void selectKmers(
+        size_t k,
+        double p,
+        int seed,
+        const MemoryMapped::Vector<uint64_t>* excludedKmers);
+
+    // Data and functions used to compute k-mer frequencies
+    // by selectKmersBasedOnFrequency.
+    void computeKmerFrequencyThreadFunction(size_t threadId);
+    class ComputeKmerFrequencyData {
+    public:
+        size_t k;
+
+        // The number of times each k-mer appears in the reads,
+        // counting both strands. Indexed by KmerId.
+        MemoryMapped::Vector<uint64_t> frequency;
+    };
+    ComputeKmerFrequencyData computeKmerFrequencyData;
+
+    // Bitmap of the k-mers selected as markers, with one bit
+    // for each of the 4^k k-mers, indexed by k-mer id.
+    // This contains the same information as kmerTable[i].isMarker
+    // but is 64 times smaller, so it is used for
+    // marker lookups and is always available.
+    // The reverse complement of a k-mer is computed
+    // as needed using reverseComplementKmerId.
+    MemoryMapped::Vector<uint64_t> markerKmers;
+    KmerBitmap getMarkerKmers() const
+    {
+        return KmerBitmap(markerKmers.begin());
+    }
 
 
 
     // The markers on all oriented reads. Indexed by OrientedReadId::getValue().
+    // If markersAreStrandImplicit() returns true, only the markers
+    // on strand 0 are stored, indexed by ReadId.
     MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t> markers;
     void checkMarkersAreOpen() const;
+    bool markersAreStrandImplicit() const
+    {
+        return reads.size() > 0 && markers.size() == reads.size();
+    }
+    void checkMarkersAreNotStrandImplicit() const;
+
+    // Access the markers of an oriented read.
+    // This works for both ways of storing the markers.
+    OrientedReadMarkers getOrientedReadMarkers(OrientedReadId orientedReadId) const
+    {
+        return OrientedReadMarkers(markers, reads.size(), orientedReadId,
+            uint32_t(reads.getBaseCounts()[orientedReadId.getReadId()]), assemblerInfo->k);
+    }
+    uint64_t getMarkerCount(OrientedReadId orientedReadId) const
+    {
+        return markersAreStrandImplicit() ?
+            markers.size(orientedReadId.getReadId()) :
+            markers.size(orientedReadId.getValue());
+    }
 
     // Get markers sorted by KmerId for a given OrientedReadId.
+    // This uses sortedMarkers if available, and otherwise
+    // computes them on the fly.
     void getMarkersSortedByKmerId(
         OrientedReadId,
         vector<MarkerWithOrdinal>&) const;
+    void computeMarkersSortedByKmerId(
+        OrientedReadId,
+        vector<MarkerWithOrdinal>&) const;
+
+    // Optional cache of the markers of each oriented read
+    // sorted by KmerId, as returned by getMarkersSortedByKmerId.
+    // Indexed by OrientedReadId::getValue().
+    // Each oriented read is used in many alignments, so this
+    // avoids sorting its markers again for each alignment.
+    MemoryMapped::VectorOfVectors<MarkerWithOrdinal, uint64_t> sortedMarkers;
+    void computeSortedMarkersThreadFunction(size_t threadId);
+
+    // Optional compact copy of the markers, created by compressMarkers.
+    CompactMarkers compactMarkers;
+    void checkMarkersOrCompactMarkersAreOpen() const;
+
+    // Optional inverted index of the markers, created by createMarkerKmerIndex.
+    MarkerKmerIndex markerKmerIndex;
 
     // Given a marker by its OrientedReadId and ordinal,
     // return the corresponding global marker id.
+    // If the markers are strand implicit, this is the marker id
+    // the marker would have if markers were stored for both strands.
     MarkerId getMarkerId(OrientedReadId, uint32_t ordinal) const;
 
     // Inverse of the above: given a global marker id,
     // return its OrientedReadId and ordinal.
-    // This requires a binary search in the markers toc.
-    // This could be avoided, at the cost of storing
-    // an additional 4 bytes per marker.
+    // This uses markerIdIndex to limit the binary search
+    // in the markers toc to a few entries.
     pair<OrientedReadId, uint32_t> findMarkerId(MarkerId) const;
 
+    // The index used by findMarkerId. It is created on first use,
+    // under protection of the mutex, and cleared when the markers change.
+    mutable MarkerIdIndex markerIdIndex;
+    mutable std::mutex markerIdIndexMutex;
+
     // Given a MarkerId, compute the MarkerId of the
     // reverse complemented marker.
     MarkerId findReverseComplement(MarkerId) const;
@@ -595,6 +1170,32 @@ private:
         double alignedFractionThreshold;
         double nearDiagonalFractionThreshold;
         uint32_t deltaThreshold;
+
+        // Timing statistics for ranges of read lengths.
+        // Bucket i contains reads with length
+        // at least 2^i and less than 2^(i+1) (bucket 0 also contains
+        // reads of length 0).
+        class BucketStatistics {
+        public:
+            uint64_t readCount = 0;
+
+            // The number of reads for which the alignment
+            // was computed, rather than rejected by
+            // AlignmentPrefilter::mayBePalindromic.
+            uint64_t alignmentCount = 0;
+
+            double seconds = 0.;
+        };
+        static const size_t bucketCount = 32;
+        static size_t getBucket(uint64_t length)
+        {
+            size_t bucket = 0;
+            while(bucket<bucketCount-1 && (length >> (bucket+1))) {
+                ++bucket;
+            }
+            return bucket;
+        }
+        vector< array<BucketStatistics, bucketCount> > threadBucketStatistics;
     };
     FlagPalindromicReadsData flagPalindromicReadsData;
 
@@ -604,6 +1205,19 @@ private:
     MemoryMapped::Vector<OrientedReadPair> alignmentCandidates;
     void checkAlignmentCandidatesAreOpen() const;
 
+    // The low hashes stored by findAlignmentCandidatesLowHash
+    // for use by findAlignmentCandidatesLowHashIncremental.
+    LowHashSketches lowHashSketches;
+
+    // A hash of the marker k-mers, used to check that they did not change
+    // between the time the LowHash sketches were stored and their use.
+    uint64_t getMarkerKmersHash() const;
+
+    // Each shard of findAlignmentCandidatesLowHashShard writes, after its candidates,
+    // a small vector with shardCount, readCount, m, minHashIterationCount,
+    // maxBucketSize, and the number of candidates it found.
+    static const uint64_t lowHashShardInfoSize = 6;
+
 
 
     // Compute a marker alignment of two oriented reads.
@@ -625,6 +1239,7 @@ private:
         const array<vector<MarkerWithOrdinal>, 2>& markersSortedByKmerId,
         size_t maxSkip,             // Maximum ordinal skip allowed.
         uint32_t maxMarkerFrequency,
+        size_t bandWidth,           // If not 0, first try a banded alignment.
         bool debug,
         AlignmentGraph&,
         Alignment&,
@@ -663,16 +1278,61 @@ private:
     MemoryMapped::Vector<AlignmentData> alignmentData;
     void checkAlignmentDataAreOpen();
 
+    // If computeAlignments was called with storeAlignments=true,
+    // the ordinals of each alignment in alignmentData,
+    // in the compressed form described in CompressedAlignment.hpp.
+    // Indexed by the same alignment id as alignmentData.
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t> compressedAlignments;
+
     // The alignment table stores the AlignmentData that each oriented read is involved in.
     // Stores, for each OrientedReadId, a vector of indexes into the alignmentData vector.
     // Indexed by OrientedReadId::getValue(),
     MemoryMapped::VectorOfVectors<uint32_t, uint32_t> alignmentTable;
-    void computeAlignmentTable();
+    void computeAlignmentTable(size_t threadCount);
+    void computeAlignmentTableThreadFunction1(size_t threadId);
+    void computeAlignmentTableThreadFunction2(size_t threadId);
+    void computeAlignmentTableThreadFunction12(size_t pass);
+    void computeAlignmentTableThreadFunction3(size_t threadId);
 
 
 
     // Private functions and data used by computeAlignments.
+    void setupComputeAlignments(
+        uint32_t maxMarkerFrequency,
+        size_t maxSkip,
+        size_t minAlignedMarkerCount,
+        size_t maxTrim,
+        size_t bandWidth,
+        size_t alignMethod,
+        bool storeAlignments,
+        bool groupCandidates,
+        bool filterContainedReads,
+        uint64_t maxAlignmentGraphEdgeCount,
+        size_t& threadCount);
+    void computeAlignmentsInRange(
+        uint64_t candidateBegin,
+        uint64_t candidateEnd,
+        const string& alignmentDataName,
+        const string& compressedAlignmentsName,
+        size_t threadCount);
     void computeAlignmentsThreadFunction(size_t threadId);
+
+    // Scheduling for computeAlignments.
+    // The estimated cost of computing an alignment is the product
+    // of the numbers of markers of the two oriented reads.
+    uint64_t estimateAlignmentCost(const OrientedReadPair&) const;
+    void scheduleAlignmentCandidates(uint64_t n, size_t threadCount);
+    void scheduleAlignmentCandidatesThreadFunction1(size_t threadId);
+    void scheduleAlignmentCandidatesThreadFunction2(size_t threadId);
+    static string shardName(const string& name, uint64_t shardId)
+    {
+        return name + "-Shard-" + to_string(shardId);
+    }
+    static const uint64_t alignmentShardInfoSize = 5;
+    void storeAlignmentData(
+        vector<AlignmentData>&,
+        vector<uint8_t>& compressedAlignmentBytes,
+        vector<uint64_t>& compressedAlignmentSizes);
     class ComputeAlignmentsData {
     public:
 
@@ -681,12 +1341,100 @@ private:
         size_t maxSkip;
         size_t minAlignedMarkerCount;
         size_t maxTrim;
+        size_t bandWidth;
+        size_t alignMethod;
+        bool storeAlignments;
+        bool groupCandidates;
+        bool filterContainedReads;
+        uint64_t maxAlignmentGraphEdgeCount;
+
+        // The alignment candidates processed are
+        // [candidateBegin, candidateBegin + n), where n is the number
+        // passed to setupLoadBalancing.
+        uint64_t candidateBegin = 0;
+
+        // If groupCandidates is true and the candidates are not already
+        // grouped by readIds[0], the indexes of the candidates to be
+        // processed, sorted by readIds[0] and readIds[1].
+        // Batch i of the load balancing then processes candidates
+        // candidateOrder[i] instead of candidateBegin + i.
+        MemoryMapped::Vector<uint64_t> candidateOrder;
+        uint64_t getCandidateIndex(uint64_t i) const
+        {
+            return candidateOrder.isOpen ? candidateOrder[i] : candidateBegin + i;
+        }
 
-        // The AlignmentInfo found by each thread.
-        vector< vector<AlignmentData> > threadAlignmentData;
+        // Scheduling.
+        // Candidates with an estimated cost (see estimateAlignmentCost)
+        // much greater than average are "expensive" and are processed
+        // first, one at a time, in order of decreasing cost.
+        // All other candidates are then processed in batches.
+        // expensiveCandidates contains the positions i (as used above)
+        // of the expensive candidates, sorted.
+        // workList contains the same positions in the order
+        // in which they are processed.
+        uint64_t expensiveCandidateCostThreshold;
+        vector<uint64_t> threadTotalCost;
+        vector< vector< pair<uint64_t, uint64_t> > > threadExpensiveCandidates;
+        vector<uint64_t> expensiveCandidates;
+        vector<uint64_t> workList;
+        bool processingWorkList = false;
+
+        // Candidates whose alignment graph exceeded maxAlignmentGraphEdgeCount
+        // are deferred: each thread stores their positions i here.
+        // After all other candidates, they are processed from the work list
+        // with retryingDeferredCandidates set, which aligns them using chaining.
+        // For each thread, the number of good alignments found that way.
+        vector< vector<uint64_t> > threadDeferredCandidates;
+        bool retryingDeferredCandidates = false;
+        vector<uint64_t> threadRetryGoodAlignmentCounts;
+
+        // The time each thread spent computing alignments,
+        // used to report the load balance.
+        vector<double> threadBusySeconds;
+
+        // For each thread, the number of oriented reads for which
+        // sorted markers were reused from the previous candidate,
+        // and the number for which they had to be obtained.
+        vector< array<uint64_t, 2> > threadSortedMarkersCounts;
+
+        // If filterContainedReads is true, flags for the reads
+        // found so far to be contained in another read, indexed by ReadId,
+        // and, for each thread, the number of candidates skipped because of that.
+        MemoryMapped::Vector< std::atomic<bool> > isContainedRead;
+        vector<uint64_t> threadContainmentFilterCounts;
+
+        // If the read flags are available, a bitset of the reads
+        // excluded by subsampleReads, as computed by ReadFlagBitplanes::getAnyMask.
+        // Candidates involving these reads are skipped.
+        vector<uint64_t> excludedReadMask;
+
+        // Each thread appends the good alignments it finds to alignmentData
+        // in chunks of this size, which bounds the memory used by each thread.
+        static const size_t chunkSize = 1000;
+
+        // The memory allocation statistics of each thread.
+        vector<AlignmentWorkspace::Statistics> threadWorkspaceStatistics;
+
+        // The number of candidates with each AlignmentPrefilter::Result,
+        // for each thread.
+        vector< array<uint64_t, AlignmentPrefilter::resultCount> > threadPrefilterCounts;
     };
     ComputeAlignmentsData computeAlignmentsData;
 
+    // Data and thread function used by alignOrientedReadsBatch.
+    class AlignOrientedReadsBatchData {
+    public:
+        const vector< array<OrientedReadId, 2> >* orientedReadIdPairs;
+        size_t maxSkip;
+        uint32_t maxMarkerFrequency;
+        size_t bandWidth;
+        size_t alignMethod;
+        vector<AlignmentInfo>* alignmentInfos;
+    };
+    AlignOrientedReadsBatchData alignOrientedReadsBatchData;
+    void alignOrientedReadsBatchThreadFunction(size_t threadId);
+
 
 
     // Find in the alignment table the alignments involving
@@ -704,7 +1452,33 @@ private:
 public:
     void createReadGraph(
         uint32_t maxAlignmentCount,
-        uint32_t maxTrim);
+        uint32_t maxTrim,
+        size_t threadCount);
+private:
+    void createReadGraphThreadFunction1(size_t threadId);
+    void createReadGraphThreadFunction2(size_t threadId);
+    void createReadGraphThreadFunction3(size_t threadId);
+    void createReadGraphThreadFunction4(size_t threadId);
+    void createReadGraphThreadFunction5(size_t threadId);
+    void createReadGraphThreadFunction45(int);
+    void createReadGraphThreadFunction6(size_t threadId);
+    class CreateReadGraphData {
+    public:
+        uint32_t maxAlignmentCount;
+
+        // Set for alignments that generate read graph edges.
+        // Indexed by alignment id.
+        vector<uint8_t> keepAlignment;
+
+        // The alignments are processed in blocks of this size.
+        // For each block, the id of the first read graph edge it generates.
+        // Indexed by block, with an additional entry
+        // equal to the total number of read graph edges.
+        static const uint64_t blockSize = 10000;
+        vector<uint64_t> blockEdgeBegin;
+    };
+    CreateReadGraphData createReadGraphData;
+public:
 #if 1
     void createReadGraphNew(
         uint32_t maxAlignmentCount,
@@ -721,7 +1495,9 @@ private:
     class FlagCrossStrandReadGraphEdgesData {
     public:
         size_t maxDistance;
-        vector<bool> isNearStrandJump;
+        // Bytes rather than a vector<bool>, so different threads
+        // can set flags for different reads without interfering.
+        vector<uint8_t> isNearStrandJump;
     };
     FlagCrossStrandReadGraphEdgesData flagCrossStrandReadGraphEdgesData;
 
@@ -770,38 +1546,184 @@ public:
     // Components with fewer than minComponentSize are considered
     // small and excluded from assembly by setting the
     // isInSmallComponent for all the reads they contain.
-    void computeReadGraphConnectedComponents(size_t minComponentSize);
+    void computeReadGraphConnectedComponents(size_t minComponentSize, size_t threadCount);
+private:
+    void computeReadGraphConnectedComponentsThreadFunction1(size_t threadId);
+    void computeReadGraphConnectedComponentsThreadFunction2(size_t threadId);
+    void computeReadGraphConnectedComponentsThreadFunction3(size_t threadId);
+    class ComputeReadGraphConnectedComponentsData {
+    public:
+        size_t minComponentSize;
+
+        // Disjoint sets data structures.
+        MemoryMapped::Vector< std::atomic<DisjointSets::Aint> > disjointSetsData;
+        shared_ptr<DisjointSets> disjointSetsPointer;
+
+        // The disjoint set that each oriented read was assigned to.
+        // Indexed by OrientedReadId::getValue().
+        vector<ReadId> disjointSetTable;
+
+        // The number of oriented reads in each disjoint set,
+        // and the lowest OrientedReadId in it.
+        // Indexed by disjoint set id.
+        vector<ReadId> disjointSetSize;
+        vector<ReadId> disjointSetFirstOrientedRead;
+    };
+    ComputeReadGraphConnectedComponentsData computeReadGraphConnectedComponentsData;
+public:
+
+
+
+    // Renumber the reads in the order of a breadth first search
+    // of the read graph, so reads that overlap in the genome get
+    // nearby read ids, which improves the memory locality of the stages
+    // that follow. All data indexed by ReadId or OrientedReadId
+    // are rewritten consistently. This must be called
+    // before marker graph vertices are created.
+    // See AssemblerReadRenumbering.cpp for details.
+    void renumberReads(size_t threadCount);
+private:
+    void computeReadRenumbering(vector<ReadId>& oldReadIds) const;
+    void renumberAlignments(const vector<ReadId>& newReadIds, size_t threadCount);
+    void renumberReadGraph(
+        const vector<ReadId>& newReadIds,
+        const vector<uint64_t>& oldOrientedReadIndex,
+        size_t threadCount);
+public:
 
 
 
     // Private functions and data used by createMarkerGraphVertices.
 private:
     void createMarkerGraphVerticesThreadFunction1(size_t threadId);
+    template<class UnionBuffer> void createMarkerGraphVerticesThreadFunction1Template(UnionBuffer&);
     void createMarkerGraphVerticesThreadFunction2(size_t threadId);
+    template<class DisjointSetsType> void createMarkerGraphVerticesThreadFunction2Template(DisjointSetsType&);
     void createMarkerGraphVerticesThreadFunction3(size_t threadId);
+    void createMarkerGraphVerticesHistogramThreadFunction(size_t threadId);
     void createMarkerGraphVerticesThreadFunction4(size_t threadId);
     void createMarkerGraphVerticesThreadFunction5(size_t threadId);
-    void createMarkerGraphVerticesThreadFunction45(int);
     void createMarkerGraphVerticesThreadFunction6(size_t threadId);
     void createMarkerGraphVerticesThreadFunction7(size_t threadId);
+    void createMarkerGraphVerticesThreadFunction8(size_t threadId);
+    MarkerGraph::VertexId createMarkerGraphVerticesRenumber(
+        uint64_t n,
+        uint64_t batchSize,
+        size_t threadCount);
+
+    // Out of core mode of createMarkerGraphVertices.
+    // See AssemblerMarkerGraphOutOfCore.cpp.
+    void createMarkerGraphVerticesOutOfCore(
+        size_t minCoverage,
+        size_t maxCoverage,
+        uint64_t partitionCount,
+        size_t threadCount);
+    void createMarkerGraphVerticesSpillThreadFunction(size_t threadId);
+    void createMarkerGraphVerticesPartitionThreadFunction1(size_t threadId);
+    void createMarkerGraphVerticesPartitionThreadFunction2(size_t threadId);
+    void createMarkerGraphVerticesPartitionUnionThreadFunction(size_t threadId);
+    template<class DisjointSetsType> void createMarkerGraphVerticesPartitionUnionThreadFunctionTemplate(
+        DisjointSetsType&);
+
+    // Shared by createMarkerGraphVertices and createMarkerGraphVerticesIncremental.
+    void createMarkerGraphVerticesImplementation(
+        uint32_t maxMarkerFrequency,
+        size_t maxSkip,
+        size_t minCoverage,
+        size_t maxCoverage,
+        size_t unionBufferSize,
+        size_t outOfCorePartitionCount,
+        bool storeDisjointSetTable,
+        bool incremental,
+        size_t threadCount);
+
+    // Used by createMarkerGraphVerticesIncremental to initialize
+    // the disjoint sets from the stored disjoint set table.
+    void createMarkerGraphVerticesSeedThreadFunction(size_t threadId);
+    template<class DisjointSetsType> void createMarkerGraphVerticesSeedThreadFunctionTemplate(
+        DisjointSetsType&);
+    void createMarkerGraphVerticesProcessPartition(uint64_t partition, size_t threadCount);
+    uint64_t getMarkerPartition(MarkerId markerId) const
+    {
+        return markers.begin()[markerId].kmerId % createMarkerGraphVerticesData.partitionCount;
+    }
+
+    // Used by the out of core mode in place of a DisjointSetsUnionBuffer.
+    // Each union operation is buffered, then appended to the spill file
+    // of the partition of the k-mer of its markers.
+    class CreateMarkerGraphVerticesSpillBuffer {
+    public:
+        CreateMarkerGraphVerticesSpillBuffer(Assembler&);
+        void unite(MarkerId, MarkerId);
+        void flush();
+    private:
+        Assembler& assembler;
+        static const uint64_t capacity = 4096;
+        vector< vector< pair<MarkerId, MarkerId> > > buffers;
+        void flush(uint64_t partition);
+    };
+
+    // Choose the coverage thresholds for marker graph vertices
+    // from the histogram of disjoint set sizes, for the ones that are zero.
+    // minCoverage is the valley between the peak of low coverage
+    // sets (caused by errors) and the main peak. maxCoverage is
+    // the first valley after the main peak (which separates
+    // repeats), but at most maxCoverageToPeakRatio times the main peak.
+    static void selectMarkerGraphCoverageThresholds(
+        const Histogram&,
+        size_t& minCoverage,
+        size_t& maxCoverage);
+    static const size_t maxCoverageToPeakRatio = 3;
+
+    bool createMarkerGraphVerticesIsKept(MarkerGraph::VertexId) const;
+    void createMarkerGraphVerticesRenumberThreadFunction1(size_t threadId);
+    void createMarkerGraphVerticesRenumberThreadFunction2(size_t threadId);
+    void endCreateMarkerGraphVerticesPhase(
+        const string& phaseName,
+        vector< pair<string, double> >& phaseTimes,
+        steady_clock::time_point& tPhase);
     class CreateMarkerGraphVerticesData {
     public:
 
         // Parameters.
         size_t maxSkip;
         uint32_t maxMarkerFrequency;
+        size_t minCoverage;
+        size_t maxCoverage;
+
+        // If set, the alignments are obtained from compressedAlignments
+        // instead of being computed again.
+        bool useStoredAlignments;
+
+        // The capacity of the DisjointSetsUnionBuffer used by each thread.
+        size_t unionBufferSize;
 
         // The total number of oriented markers.
         uint64_t orientedMarkerCount;
 
         // Disjoint sets data structures.
+        // If there are less than 2^32 oriented markers, we use
+        // the more compact DisjointSets32 instead of DisjointSets,
+        // and only one of the two pointers is not null.
         MemoryMapped::Vector< std::atomic<DisjointSets::Aint> > disjointSetsData;
         shared_ptr<DisjointSets> disjointSetsPointer;
+        MemoryMapped::Vector< std::atomic<DisjointSets32::Aint> > disjointSets32Data;
+        shared_ptr<DisjointSets32> disjointSets32Pointer;
 
         // The disjoint set that each oriented marker was assigned to.
         // See createMarkerGraphVertices for details.
         MemoryMapped::Vector<MarkerGraph::VertexId> disjointSetTable;
 
+        // Used by createMarkerGraphVerticesIncremental.
+        // The disjoint set table stored by the previous computation,
+        // which covers the markers of the old reads.
+        // If useReadGraphEdgePairs is set, createMarkerGraphVerticesThreadFunction1
+        // only processes the pairs of read graph edges beginning
+        // at the edges stored in readGraphEdgePairs.
+        MemoryMapped::Vector<MarkerGraph::VertexId> storedDisjointSetTable;
+        bool useReadGraphEdgePairs = false;
+        vector<uint64_t> readGraphEdgePairs;
+
         // Work area used for multiple purposes.
         // See createMarkerGraphVertices for details.
         MemoryMapped::Vector<MarkerGraph::VertexId> workArea;
@@ -812,6 +1734,49 @@ private:
         // Flag disjoint sets that contain more than one marker on the same oriented read.
         MemoryMapped::Vector<bool> isBadDisjointSet;
 
+        // The histogram of disjoint set sizes, collected by all threads.
+        // Sizes above maxHistogramCoverage are counted together.
+        ShardedHistogram coverageHistogram;
+        static const size_t maxHistogramCoverage = 4096;
+
+        // Used by createMarkerGraphVerticesRenumber.
+        // The number of kept disjoint sets in each batch, and then
+        // the new number of the first kept disjoint set in each batch.
+        bool renumberBadDisjointSets;
+        uint64_t renumberBatchSize;
+        vector<uint64_t> renumberBatchCount;
+
+        // Used by the out of core mode.
+        // Oriented markers are partitioned by k-mer id. All markers
+        // of a vertex have the same k-mer, so each partition
+        // can be processed independently.
+        uint64_t partitionCount;
+
+        // The spill file for the union operations of each partition.
+        // While the spill files are written, they are protected by the mutexes.
+        vector<int> unionSpillFileDescriptors;
+        vector<std::mutex> unionSpillMutexes;
+
+        // The partition being processed and its union operations,
+        // memory mapped from its spill file.
+        uint64_t currentPartition;
+        const pair<MarkerId, MarkerId>* partitionUnions;
+
+        // The oriented markers in each partition, sorted.
+        // Computed in two passes over the markers. The first pass counts
+        // the markers of each partition in each batch of partitionBatchSize
+        // oriented markers, and a prefix sum gives the position at which
+        // each batch stores them during the second pass.
+        MemoryMapped::VectorOfVectors<MarkerId, uint64_t> partitionMarkers;
+        uint64_t partitionBatchSize;
+        vector<uint64_t> partitionBatchCount;   // Indexed by [batch*partitionCount+partition].
+
+        // The vertices found in each partition, in order of their first marker.
+        // The vertices of partition p are those in
+        // [partitionVerticesBegin[p], partitionVerticesBegin[p+1]).
+        MemoryMapped::VectorOfVectors<MarkerId, uint64_t> partitionVertices;
+        vector<uint64_t> partitionVerticesBegin;
+
     };
     CreateMarkerGraphVerticesData createMarkerGraphVerticesData;
 
@@ -849,11 +1814,41 @@ private:
     void createMarkerGraphEdgesThreadFunction1(size_t threadId);
     void createMarkerGraphEdgesThreadFunction2(size_t threadId);
     void createMarkerGraphEdgesThreadFunction12(size_t threadId, size_t pass);
+    void createMarkerGraphEdgesThreadFunction3(size_t threadId);
+    void createMarkerGraphEdgesThreadFunction4(size_t threadId);
     void createMarkerGraphEdgesBySourceAndTarget(size_t threadCount);
+    void createMarkerGraphCompactAdjacency(size_t threadCount);
+    void accessMarkerGraphCompactAdjacency();
+    void createMarkerGraphIsBadVertexBitmap(size_t threadCount);
+    void createMarkerGraphIsBadVertexBitmapThreadFunction(size_t threadId);
     class CreateMarkerGraphEdgesData {
     public:
         vector< shared_ptr< MemoryMapped::Vector<MarkerGraph::Edge> > > threadEdges;
         vector< shared_ptr< MemoryMapped::VectorOfVectors<MarkerInterval, uint64_t> > > threadEdgeMarkerIntervals;
+
+        // A batch of source vertices processed by a thread,
+        // and the range of edges it generated in the vectors of that thread.
+        class Batch {
+        public:
+            MarkerGraph::VertexId vertexBegin;
+            size_t threadId;
+            MarkerGraph::EdgeId threadEdgeBegin;
+            MarkerGraph::EdgeId threadEdgeEnd;
+
+            // The id of the first edge of this batch in markerGraph.edges.
+            MarkerGraph::EdgeId edgeBegin;
+
+            bool operator<(const Batch& that) const
+            {
+                return vertexBegin < that.vertexBegin;
+            }
+        };
+
+        // The batches processed by each thread.
+        vector< vector<Batch> > threadBatches;
+
+        // All batches, sorted by vertexBegin.
+        vector<Batch> batches;
     };
     CreateMarkerGraphEdgesData createMarkerGraphEdgesData;
 
@@ -873,17 +1868,110 @@ private:
     // and findMarkerGraphReverseComplementEdges have been called.
 public:
     void checkMarkerGraphIsStrandSymmetric(size_t threadCount = 0);
+
+    // Incremental version of the above.
+    // flagMarkerGraphWeakEdges, pruneMarkerGraphStrongSubgraph
+    // and simplifyMarkerGraph only modify edge flags,
+    // and they set the isDirty flag of the edges they modify.
+    // This only checks that the flags of dirty edges agree with
+    // the flags of their reverse complement, then clears isDirty.
+    // It assumes that a full check was done after the
+    // vertices and edges were created.
+    void checkMarkerGraphDirtyEdgesAreStrandSymmetric(size_t threadCount = 0);
 private:
     void checkMarkerGraphIsStrandSymmetricThreadFunction1(size_t threadId);
     void checkMarkerGraphIsStrandSymmetricThreadFunction2(size_t threadId);
+    void checkMarkerGraphIsStrandSymmetricThreadFunction3(size_t threadId);
+    void checkMarkerGraphIsStrandSymmetricThreadFunction4(size_t threadId);
+
+
+
+    // The marker graph is strand symmetric, and the MarkerIntervals
+    // of an edge are the MarkerIntervals of its reverse complement,
+    // in the same order, with the strand of each oriented read flipped
+    // and the ordinals mirrored.
+    // Keep them only for one edge of each reverse complement pair
+    // (the one with edgeId < reverseComplementEdge[edgeId],
+    // the same used by AssemblyGraph::isAssembledEdge),
+    // which halves the memory used by markerGraph.edgeMarkerIntervals.
+    // This can only be called after findMarkerGraphReverseComplementEdges.
+public:
+    void storeCanonicalMarkerGraphEdgeMarkerIntervals(size_t threadCount = 0);
+
+    // Get the MarkerIntervals of a marker graph edge.
+    // This works whether or not they are only stored for canonical edges.
+    void getMarkerGraphEdgeMarkerIntervals(
+        MarkerGraph::EdgeId,
+        vector<MarkerInterval>&) const;
+    uint64_t getMarkerGraphEdgeMarkerIntervalCount(MarkerGraph::EdgeId) const;
+private:
+    void storeCanonicalMarkerGraphEdgeMarkerIntervalsThreadFunction(size_t threadId);
+    MemoryMapped::VectorOfVectors<MarkerInterval, uint64_t> canonicalEdgeMarkerIntervals;
+
+    // Replace markerGraph.edgeMarkerIntervals with
+    // markerGraph.compactEdgeMarkerIntervals, which uses about
+    // a third of the memory. This can be called before or after
+    // storeCanonicalMarkerGraphEdgeMarkerIntervals, but after
+    // findMarkerGraphReverseComplementEdges.
+    // getMarkerGraphEdgeMarkerIntervals works in all cases.
+public:
+    void compressMarkerGraphEdgeMarkerIntervals(size_t threadCount = 0);
+private:
+
+
+
+    // Renumber the vertices and edges of the marker graph, so vertices
+    // and edges that follow each other along chains of the marker graph
+    // get nearby ids, which improves the memory locality of the stages
+    // that follow. This must be called after findMarkerGraphReverseComplementEdges
+    // and before the assembly graph is created.
+    // See AssemblerMarkerGraphRenumbering.cpp for details.
+public:
+    void renumberMarkerGraph(size_t threadCount = 0);
+private:
+    void computeMarkerGraphRenumbering(
+        MemoryMapped::Vector<MarkerGraph::VertexId>& oldVertexIds,
+        MemoryMapped::Vector<MarkerGraph::VertexId>& newVertexIds) const;
+    void computeMarkerGraphEdgeRenumbering(
+        const MemoryMapped::Vector<MarkerGraph::VertexId>& oldVertexIds,
+        const MemoryMapped::Vector<MarkerGraph::VertexId>& newVertexIds,
+        MemoryMapped::Vector<MarkerGraph::EdgeId>& oldEdgeIds,
+        MemoryMapped::Vector<MarkerGraph::EdgeId>& newEdgeIds,
+        size_t threadCount) const;
 
 
 
 public:
 
     // Prune leaves from the strong subgraph of the global marker graph.
-    void pruneMarkerGraphStrongSubgraph(size_t iterationCount);
+    void pruneMarkerGraphStrongSubgraph(
+        size_t iterationCount,
+        size_t threadCount = 0);
 private:
+    void pruneMarkerGraphStrongSubgraphThreadFunction1(size_t threadId);
+    void pruneMarkerGraphStrongSubgraphThreadFunction2(size_t threadId);
+    class PruneMarkerGraphStrongSubgraphData {
+    public:
+
+        // The edges to be examined at this iteration.
+        // At the first iteration we examine all edges and this is not used.
+        bool useFrontier;
+        vector<MarkerGraph::EdgeId> frontier;
+
+        // One bit for each edge, set if the edge is in the frontier
+        // for the next iteration. Used to avoid duplicates.
+        MemoryMapped::Vector<uint64_t> isInFrontier;
+
+        // The edges to be pruned at this iteration, found by each thread.
+        vector< vector<MarkerGraph::EdgeId> > threadEdgesToBePruned;
+
+        // All the edges to be pruned at this iteration.
+        vector<MarkerGraph::EdgeId> edgesToBePruned;
+
+        // The edges of the frontier for the next iteration, found by each thread.
+        vector< vector<MarkerGraph::EdgeId> > threadFrontier;
+    };
+    PruneMarkerGraphStrongSubgraphData pruneMarkerGraphStrongSubgraphData;
 
 
 
@@ -930,9 +2018,65 @@ private:
         vector< pair<MarkerGraph::VertexId, MarkerInterval> >& workArea
         ) const;
 
+    // Batched versions of the above. For each vertex in
+    // [vertexIdsBegin, vertexIdsEnd), they find the same
+    // (neighbor vertex, MarkerInterval) pairs that the single vertex
+    // versions store in their workArea, sorted in the same way.
+    // The pairs for vertexIdsBegin[i] are stored in
+    // neighbors[neighborsBegin[i], neighborsBegin[i+1]).
+    // The chain of dependent accesses (vertices, markers, vertexTable,
+    // then vertices again for the neighbors) is processed in stages
+    // for all vertices of the batch, and each stage issues software
+    // prefetches for the next one, so cache misses overlap.
+    // Batches of a few tens to a few hundred vertices work best.
+    class GlobalMarkerGraphNeighborsWorkArea {
+    public:
+        // For each marker of the vertices of the batch,
+        // the index of its vertex in the batch and the MarkerInterval
+        // being extended towards a neighbor.
+        vector< pair<uint64_t, MarkerInterval> > markerIntervals;
+
+        // The neighbor vertex found for each of the above,
+        // or invalidCompressedVertexId if none.
+        vector<MarkerGraph::VertexId> neighborVertexIds;
+    };
+    void getGlobalMarkerGraphVerticesChildren(
+        const MarkerGraph::VertexId* vertexIdsBegin,
+        const MarkerGraph::VertexId* vertexIdsEnd,
+        vector< pair<MarkerGraph::VertexId, MarkerInterval> >& neighbors,
+        vector<uint64_t>& neighborsBegin,
+        GlobalMarkerGraphNeighborsWorkArea&
+        ) const;
+    void getGlobalMarkerGraphVerticesParents(
+        const MarkerGraph::VertexId* vertexIdsBegin,
+        const MarkerGraph::VertexId* vertexIdsEnd,
+        vector< pair<MarkerGraph::VertexId, MarkerInterval> >& neighbors,
+        vector<uint64_t>& neighborsBegin,
+        GlobalMarkerGraphNeighborsWorkArea&
+        ) const;
+    void getGlobalMarkerGraphVerticesNeighbors(
+        const MarkerGraph::VertexId* vertexIdsBegin,
+        const MarkerGraph::VertexId* vertexIdsEnd,
+        bool forward,
+        vector< pair<MarkerGraph::VertexId, MarkerInterval> >& neighbors,
+        vector<uint64_t>& neighborsBegin,
+        GlobalMarkerGraphNeighborsWorkArea&
+        ) const;
+
+    // Move the second ordinal of a MarkerInterval used by the above
+    // forward or backward, starting at its current value, until it reaches
+    // a marker that is contained in a vertex (optionally not a bad vertex).
+    // Return the vertex, or invalidCompressedVertexId if none is found.
+    MarkerGraph::VertexId findGlobalMarkerGraphNeighbor(
+        MarkerInterval&,
+        bool forward,
+        bool skipBadVertices
+        ) const;
+
     // Return true if a vertex of the global marker graph has more than
     // one marker for at least one oriented read id.
     bool isBadMarkerGraphVertex(MarkerGraph::VertexId) const;
+    bool computeIsBadMarkerGraphVertex(MarkerGraph::VertexId) const;
 
     // Find out if a vertex is a forward or backward leaf of the pruned
     // strong subgraph of the marker graph.
@@ -1031,6 +2175,24 @@ private:
         bool useSuperBubbleReplacementEdges,
         LocalMarkerGraph&
         );
+
+    // Same as above, but only extract the topology of the local
+    // marker graph, in a compact representation that does not use
+    // the Boost Graph library. This is much faster for large distances.
+    // The above functions use this and then
+    // fill in the LocalMarkerGraph.
+    // Large BFS levels are processed using multiple threads,
+    // see CompactLocalMarkerGraphBfs.
+    bool extractCompactLocalMarkerGraph(
+        MarkerGraph::VertexId,
+        int distance,
+        double timeout,                 // Or 0 for no timeout.
+        bool useWeakEdges,
+        bool usePrunedEdges,
+        bool useSuperBubbleEdges,
+        CompactLocalMarkerGraph&,
+        size_t threadCount = 0
+        );
 #endif
 
     // Compute consensus sequence for a vertex of the marker graph.
@@ -1053,10 +2215,12 @@ private:
     void computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
         MarkerGraph::EdgeId,
         uint32_t markerGraphEdgeLengthThresholdForConsensus,
+        uint32_t starAlignmentLengthThreshold,
         vector<Base>& sequence,
         vector<uint32_t>& repeatCounts,
         uint8_t& overlappingBaseCount,
-        vector< pair<uint32_t, CompressedCoverageData> >* coverageData // Optional
+        vector< pair<uint32_t, CompressedCoverageData> >* coverageData, // Optional
+        PoaBatch* = 0 // Optional
         );
 #ifndef SHASTA_STATIC_EXECUTABLE
     void computeMarkerGraphEdgeConsensusSequenceUsingMarginPhase(
@@ -1065,6 +2229,48 @@ private:
         vector<uint32_t>& repeatCounts,
         uint8_t& overlappingBaseCount
         );
+
+    // Work area used to prepare the input to MarginPhase callConsensus.
+    // Each thread keeps one and reuses it for all the edges it processes,
+    // so the input to callConsensus is assembled in place
+    // without memory allocation once the buffers have grown
+    // to the size required by the largest edge.
+    class MarginPhaseWorkArea {
+    public:
+        vector<MarkerInterval> markerIntervals;
+
+        // The sequences and repeat counts of the marker intervals that are used,
+        // concatenated, each followed by a terminating 0.
+        // The sequence and repeat counts of the i-th used marker interval
+        // begin at bases[begins[i]] and repeatCounts[begins[i]],
+        // and end before begins[i+1]-1.
+        vector<char> bases;
+        vector<uint8_t> repeatCounts;
+        vector<uint64_t> begins;
+
+        // The indexes in markerIntervals of the marker intervals that are used.
+        vector<uint64_t> used;
+
+        // Indexes into used, grouped by sequence, with the groups
+        // in order of decreasing frequency.
+        vector<uint64_t> order;
+        vector< pair<uint64_t, uint64_t> > groups;
+
+        // The input to callConsensus.
+        vector<char*> sequencePointers;
+        vector<uint8_t*> repeatCountPointers;
+        vector<uint8_t> strands;
+
+        // Functions to access a used marker interval.
+        const char* sequenceBegin(uint64_t i) const
+        {
+            return bases.data() + begins[i];
+        }
+        const char* sequenceEnd(uint64_t i) const
+        {
+            return bases.data() + begins[i+1] - 1;
+        }
+    };
 #endif
 
 
@@ -1075,16 +2281,43 @@ private:
 public:
     void simplifyMarkerGraph(
         const vector<size_t>& maxLength, // One value for each iteration.
-        bool debug);
+        bool debug,
+        size_t threadCount = 0);
 private:
+    void checkMarkerGraphStrandSymmetryForSimplify(bool debug);
     void simplifyMarkerGraphIterationPart1(
         size_t iteration,
         size_t maxLength,
-        bool debug);
+        bool debug,
+        size_t threadCount);
     void simplifyMarkerGraphIterationPart2(
         size_t iteration,
         size_t maxLength,
-        bool debug);
+        bool debug,
+        size_t threadCount);
+    void simplifyMarkerGraphIterationPart1ThreadFunction(size_t threadId);
+    void simplifyMarkerGraphIterationPart2ThreadFunction(size_t threadId);
+    class SimplifyMarkerGraphData {
+    public:
+        size_t maxLength;
+        bool debug;
+        ostream* debugOut;
+
+        // For each edge of the temporary assembly graph, a flag
+        // that tells whether the edge should be kept.
+        // This is not a vector<bool> because it is written by multiple threads.
+        vector<uint8_t> keepAssemblyGraphEdge;
+
+        // Used in part 2 only.
+        vector<AssemblyGraph::VertexId> vertexComponent;
+        vector< vector<AssemblyGraph::VertexId> > componentTable;
+        vector<AssemblyGraph::VertexId> rcComponentTable;
+        vector<bool> isEntry;
+        vector<bool> isExit;
+        vector<AssemblyGraph::EdgeId> predecessorEdge;
+        vector<uint8_t> color;
+    };
+    SimplifyMarkerGraphData simplifyMarkerGraphData;
 
 
 
@@ -1097,12 +2330,83 @@ private:
 public:
     void createAssemblyGraphVertices();
     void accessAssemblyGraphVertices();
-    void createAssemblyGraphEdges();
+    void createAssemblyGraphEdges(size_t threadCount = 0);
     void accessAssemblyGraphEdgeLists();
     void accessAssemblyGraphEdges();
     void writeAssemblyGraph(const string& fileName) const;
+    void writeAssemblyGraph(const string& fileName, ostream& out) const;
 private:
 
+    // Recreate the assembly graph edges after some marker graph edges
+    // were removed from the pruned strong subgraph, reusing the chains
+    // of the existing assembly graph that were not affected.
+    // The result is identical to what createAssemblyGraphEdges would create.
+    // Used by simplifyMarkerGraph.
+    void updateAssemblyGraphEdges(size_t threadCount);
+
+    // Find the linear chain of the pruned strong subgraph
+    // of the marker graph that contains a given edge.
+    // For a circular chain, the chain begins with the given edge.
+    // Returns true if the chain is circular.
+    bool findMarkerGraphPrunedStrongSubgraphChain(
+        MarkerGraph::EdgeId startEdgeId,
+        vector<MarkerGraph::EdgeId>& chain,
+        vector<MarkerGraph::EdgeId>& previousEdges) const;
+
+    // Data and functions used by createAssemblyGraphEdges
+    // and updateAssemblyGraphEdges.
+    void createAssemblyGraphEdgesThreadFunction(size_t threadId);
+    void storeAssemblyGraphChains(size_t threadCount);
+    void storeAssemblyGraphChainsThreadFunction(size_t threadId);
+    class CreateAssemblyGraphEdgesData {
+    public:
+
+        // The chains found by each thread.
+        // Only one chain of each reverse complemented pair is stored:
+        // the one containing the lowest edge id.
+        class ThreadChains {
+        public:
+            class Chain {
+            public:
+                MarkerGraph::EdgeId lowestEdgeId;
+                uint64_t begin;
+                uint64_t end;
+                bool isSelfComplementary;
+            };
+            vector<Chain> chains;
+
+            // The marker graph edges of all chains, stored contiguously.
+            vector<MarkerGraph::EdgeId> edges;
+
+            void add(
+                vector<MarkerGraph::EdgeId>& chain,
+                bool isCircularChain,
+                const MemoryMapped::Vector<MarkerGraph::EdgeId>& reverseComplementEdge);
+        };
+        vector<ThreadChains> threadChains;
+
+        // Used to keep track of marker graph edges that were already found.
+        MemoryMapped::Vector<bool> wasFound;
+
+        // The chains found by all threads, sorted by lowest edge id.
+        // Contains pairs(lowestEdgeId, (threadId, index in ThreadChains::chains)).
+        vector< pair<MarkerGraph::EdgeId, pair<uint64_t, uint64_t> > > chains;
+        const ThreadChains::Chain& getChain(uint64_t i) const
+        {
+            return threadChains[chains[i].second.first].chains[chains[i].second.second];
+        }
+
+        // The assembly graph edge id of each of the above chains.
+        // The reverse complemented chain, if any, gets the next id.
+        vector<AssemblyGraph::EdgeId> firstAssemblyGraphEdgeId;
+    };
+    CreateAssemblyGraphEdgesData createAssemblyGraphEdgesData;
+
+    // Final steps of createAssemblyGraphEdges and updateAssemblyGraphEdges.
+    void createMarkerToAssemblyTable(size_t threadCount);
+    void createMarkerToAssemblyTableThreadFunction1(size_t threadId);
+    void createMarkerToAssemblyTableThreadFunction2(size_t threadId);
+
     // Extract a local assembly graph from the global assembly graph.
     // This returns false if the timeout was exceeded.
     bool extractLocalAssemblyGraph(
@@ -1118,6 +2422,18 @@ public:
     void accessMarkerGraphVertexRepeatCounts();
 private:
     void assembleMarkerGraphVerticesThreadFunction(size_t threadId);
+
+    // Compute consensus repeat counts for a vertex of the marker graph
+    // and store them directly in markerGraph.vertexRepeatCounts.
+    // This is equivalent to computeMarkerGraphVertexConsensusSequence,
+    // but takes advantage of the fact that all markers of a vertex
+    // have the same k-mer, so only the repeat counts vary.
+    // The remaining arguments are work areas owned by the calling thread.
+    void assembleMarkerGraphVertex(
+        MarkerGraph::VertexId,
+        vector<uint8_t>& repeatCountMatrix,
+        CoverageTensor&,
+        vector<Consensus>&);
 public:
 
 
@@ -1157,11 +2473,48 @@ public:
         bool useMarginPhase,
 
         // Request storing detailed coverage information.
-        bool storeCoverageData
+        bool storeCoverageData,
+
+        // Edges for which all intervening sequences are at most this long
+        // are aligned using computeStarAlignment instead of spoa.
+        // Zero means always use spoa.
+        uint32_t starAlignmentLengthThreshold,
+
+        // Parameter to control whether the alignments otherwise
+        // computed using spoa are computed in batches on a GPU, using cudapoa.
+        // Only available if Shasta was built with BUILD_CUDAPOA.
+        bool useGpuConsensus = false
         );
     void accessMarkerGraphEdgeConsensus();
+
+    // Compare consensus computed for marker graph edges using spoa
+    // and using computeStarAlignment, for up to maxEdgeCount edges
+    // for which computeStarAlignment would be used.
+    // Writes timings and the fraction of edges with identical
+    // consensus for each length of the longest intervening sequence.
+    void benchmarkStarAlignment(
+        uint32_t markerGraphEdgeLengthThresholdForConsensus,
+        uint32_t starAlignmentLengthThreshold,
+        uint64_t maxEdgeCount);
 private:
-    void assembleMarkerGraphEdgesThreadFunction(size_t threadId);
+    void assembleMarkerGraphEdgesThreadFunction1(size_t threadId);
+    void assembleMarkerGraphEdgesThreadFunction2(size_t threadId);
+    void assembleMarkerGraphEdgesThreadFunction3(size_t threadId);
+    void assembleMarkerGraphEdgesThreadFunction4(size_t threadId);
+
+    // Return true if assembleMarkerGraphEdges needs to compute
+    // consensus for a marker graph edge. This is true if the edge
+    // was not removed and belongs to an assembly graph edge
+    // that will be assembled.
+    bool shouldAssembleMarkerGraphEdge(MarkerGraph::EdgeId) const;
+
+    // Estimate the relative cost of computing consensus
+    // for a marker graph edge, using only the sizes and ordinal spans
+    // of its marker intervals. Used for scheduling in assembleMarkerGraphEdges.
+    uint64_t estimateMarkerGraphEdgeConsensusCost(
+        MarkerGraph::EdgeId,
+        uint32_t markerGraphEdgeLengthThresholdForConsensus) const;
+
     class AssembleMarkerGraphEdgesData {
     public:
 
@@ -1170,32 +2523,113 @@ private:
         uint32_t markerGraphEdgeLengthThresholdForConsensus;
         bool useMarginPhase;
         bool storeCoverageData;
+        uint32_t starAlignmentLengthThreshold;
 
-        // The results computed by each thread.
+        // If useGpuConsensus was specified, the PoaBackend used to compute
+        // the spoa alignments of each batch of edges.
+        shared_ptr<PoaBackend> poaBackend;
+
+        // The results computed by each thread in pass 1.
         // For each threadId:
-        // threadEdgeIds[threadId] contains the edge ids processed by each thread.
-        // threadEdgeConsensusSequence[threadId]  and
-        // threadEdgeConsensusOverlappingBaseCount[threadId] contains the corresponding
-        // consensus sequence and repeat counts.
-        // These are temporary data which are eventually gathered into
-        // MarkerGraph::edgeConsensus and MarkerGraph::edgeConsensusOverlappingBaseCount
-        // before assembleMarkerGraphEdges completes.
-        // See their definition for more details about their meaning.
-        vector< shared_ptr< MemoryMapped::Vector<MarkerGraph::EdgeId> > > threadEdgeIds;
+        // threadEdgeConsensus[threadId] and threadEdgeCoverageData[threadId]
+        // contain the consensus and coverage data for the edges
+        // processed by that thread, in the order in which they were processed.
+        // These are temporary data which are copied directly
+        // into their final slots in MarkerGraph::edgeConsensus and
+        // MarkerGraph::edgeCoverageData in pass 2.
+        // MarkerGraph::edgeConsensusOverlappingBaseCount
+        // is written directly in pass 1.
         vector< shared_ptr< MemoryMapped::VectorOfVectors<pair<Base, uint8_t>, uint64_t> > > threadEdgeConsensus;
-        vector< shared_ptr< MemoryMapped::Vector<uint8_t> > > threadEdgeConsensusOverlappingBaseCount;
-
         vector< shared_ptr<
             MemoryMapped::VectorOfVectors<pair<uint32_t, CompressedCoverageData>, uint64_t> > >
             threadEdgeCoverageData;
+
+        // Scheduling.
+        // Edges with an estimated cost (see estimateMarkerGraphEdgeConsensusCost)
+        // much greater than average are "expensive" and are processed
+        // first, one at a time, in order of decreasing cost.
+        // All other edges are then processed in batches of consecutive edge ids.
+        // expensiveEdges contains the expensive edges sorted by edge id.
+        // workList contains the expensive edges in the order
+        // in which they are processed.
+        uint64_t expensiveEdgeCostThreshold;
+        vector<uint64_t> threadTotalCost;
+        vector<uint64_t> threadAssembledEdgeCount;
+        vector< vector< pair<MarkerGraph::EdgeId, uint64_t> > > threadExpensiveEdges;
+        vector<MarkerGraph::EdgeId> expensiveEdges;
+        vector<MarkerGraph::EdgeId> workList;
+        bool processingWorkList;
+
+        // The batches processed by each thread in pass 1.
+        // Each batch is processed by a single thread.
+        // If isWorkList is true, the batch consists of workList[begin, end).
+        // Otherwise it consists of the edge ids in [begin, end)
+        // that are not in expensiveEdges.
+        // Pass 2 processes the same batches.
+        class Batch {
+        public:
+            size_t threadId;
+            uint64_t begin;
+            uint64_t end;
+            bool isWorkList;
+
+            // The index in threadEdgeConsensus[threadId] and
+            // threadEdgeCoverageData[threadId] of the first edge of the batch.
+            uint64_t firstIndex;
+        };
+        vector< vector<Batch> > threadBatches;
+        vector<Batch> batches;
+
+        // Statistics on how computeMarkerGraphEdgeConsensusSequenceUsingSpoa
+        // handled mode 2 edges (edges with intervening sequence):
+        // identicalSequenceEdgeCount counts the edges for which all
+        // marker intervals have the same intervening sequence,
+        // so the multiple sequence alignment is skipped.
+        // starAlignmentEdgeCount counts the edges for which
+        // computeStarAlignment was used.
+        // spoaEdgeCount counts the edges for which spoa was used.
+        // If a PoaBackend is in use, poaBackendDeviceEdgeCount counts
+        // the ones that were aligned on the device instead.
+        // Updated atomically by the threads.
+        uint64_t identicalSequenceEdgeCount;
+        uint64_t starAlignmentEdgeCount;
+        uint64_t spoaEdgeCount;
+        uint64_t poaBackendDeviceEdgeCount;
+
+        // Call f(edgeId) for each edge of a batch, in order.
+        template<class F> void forEachEdge(
+            uint64_t begin, uint64_t end, bool isWorkList, const F& f) const
+        {
+            if(isWorkList) {
+                for(uint64_t i=begin; i!=end; i++) {
+                    f(workList[i]);
+                }
+            } else {
+                auto it = std::lower_bound(expensiveEdges.begin(), expensiveEdges.end(), begin);
+                for(MarkerGraph::EdgeId edgeId=begin; edgeId!=end; edgeId++) {
+                    if(it!=expensiveEdges.end() && *it==edgeId) {
+                        ++it;
+                        continue;
+                    }
+                    f(edgeId);
+                }
+            }
+        }
     };
     AssembleMarkerGraphEdgesData assembleMarkerGraphEdgesData;
 
     // Access coverage data for vertices and edges of the marker graph.
     // This is only available if the run had Assembly.storeCoverageData set to True
     // in shasta.conf.
+    // If a compressed version created by compressMarkerGraphCoverageData
+    // exists, that is used.
 public:
     void accessMarkerGraphCoverageData();
+
+    // Replace the coverage data for vertices and edges of the marker graph
+    // with block compressed versions, to reduce memory and disk usage.
+    // The uncompressed coverage data are removed.
+    void compressMarkerGraphCoverageData(size_t threadCount = 0);
 private:
 
 
@@ -1215,8 +2649,45 @@ public:
     // Assemble sequence for all edges of the assembly graph.
     void assemble(size_t threadCount);
     void accessAssemblyGraphSequences();
-    void computeAssemblyStatistics();
+
+    // Fused version of assemble, writeFasta, and writeGfa1.
+    // As each chunk of assembly graph edges is assembled,
+    // its FASTA records and GFA segment records are formatted
+    // (and optionally bgzip compressed) by the assembling thread
+    // and handed to an ordered writer, so the output has the same
+    // content as the one written by writeFasta and writeGfa1.
+    // The GFA link records are written at the end.
+    // If storeSequences is false, assemblyGraph.sequences and
+    // assemblyGraph.repeatCounts are not created, which saves
+    // their memory. computeAssemblyStatistics can still be called,
+    // using statistics collected during assembly.
+    void assembleAndWrite(
+        const string& fastaFileName,
+        const string& gfaFileName,
+        bool storeSequences,
+        size_t threadCount);
+
+    // Compute assembly statistics and write them to
+    // AssemblySummary.csv (one line per assembled segment)
+    // and AssemblyStatistics.json (summary for automated use).
+    void computeAssemblyStatistics(size_t threadCount = 0);
 private:
+    void computeAssemblyStatisticsThreadFunction(size_t threadId);
+    class ComputeAssemblyStatisticsData {
+    public:
+        // The number of raw G and C bases in each assembled edge.
+        // Indexed by assembly graph edge id.
+        // Zero for edges that are not assembled.
+        vector<uint64_t> gcCount;
+
+        // The number of raw bases in each assembled edge.
+        vector<uint64_t> rawLength;
+
+        // True if gcCount and rawLength were already
+        // filled in by assembleAndWrite.
+        bool isAvailable = false;
+    };
+    ComputeAssemblyStatisticsData computeAssemblyStatisticsData;
     class AssembleData {
     public:
 
@@ -1231,11 +2702,67 @@ private:
     AssembleData assembleData;
     void assembleThreadFunction(size_t threadId);
 
+    // Functions used by assemble and assembleAndWrite to store
+    // assembly results in assembleData, and then
+    // in assemblyGraph.sequences and assemblyGraph.repeatCounts.
+    void createAssembleThreadData(size_t threadId);
+    void storeAssembledSegment(size_t threadId, AssemblyGraph::EdgeId, const AssembledSegment&);
+    uint64_t storeAssembledSequences(size_t threadCount);
+
+    void assembleAndWriteThreadFunction(size_t threadId);
+    void assembleAndWriteChunk(uint64_t chunkId, array<string, 2>& buffers);
+    class AssembleAndWriteData {
+    public:
+        bool storeSequences;
+
+        // The number of consecutive edges in each chunk.
+        static const uint64_t chunkSize = 100;
+
+        // For the FASTA and GFA output, in this order.
+        array<string, 2> fileNames;
+        array<int, 2> fileDescriptors;
+        array<bool, 2> bgzip;
+
+        // Chunks that were formatted but cannot be written yet
+        // because a previous chunk is not done.
+        // Keyed by chunk id. Protected by mutex.
+        std::map<uint64_t, array<string, 2> > pendingChunks;
+        uint64_t nextChunkId;
+        std::mutex mutex;
+
+        // The first k and last k repeat counts of each assembled edge,
+        // used to write the GFA link records.
+        // Indexed by 2*k*edgeId.
+        vector<uint8_t> edgeEnds;
+    };
+    AssembleAndWriteData assembleAndWriteData;
+
+    // Write an entire buffer to a file, retrying after
+    // interruptions and partial writes.
+    static void writeAll(int fileDescriptor, const string& buffer, const string& fileName);
+
     // Write the assembly graph in GFA 1.0 format defined here:
     // https://github.com/GFA-spec/GFA-spec/blob/master/GFA1.md
+    // If the file name ends in ".gz", the output is bgzip compressed.
 public:
-    void writeGfa1(const string& fileName);
+    void writeGfa1(const string& fileName, size_t threadCount = 0);
 private:
+    void writeGfa1Records(uint64_t begin, uint64_t end, string&);
+
+    // Format the GFA link records for assembly graph vertices [begin, end).
+    void writeGfa1LinkRecords(uint64_t begin, uint64_t end, string&);
+
+    // Get the first or last k repeat counts of an edge.
+    // Only one edge in each reverse complemented pair is assembled,
+    // so for the other one we use the reverse complemented edge.
+    void getAssembledRepeatCountsAtEnd(AssemblyGraph::EdgeId, bool last, vector<uint8_t>&) const;
+
+    // Append a FASTA record or a GFA segment record
+    // given the sequence and repeat counts of an assembled edge.
+    template<class Sequence, class RepeatCounts> static void appendFastaRecord(
+        AssemblyGraph::EdgeId, const Sequence&, const RepeatCounts&, string&);
+    template<class Sequence, class RepeatCounts> static void appendGfa1SegmentRecord(
+        AssemblyGraph::EdgeId, const Sequence&, const RepeatCounts&, string&);
     // Construct the CIGAR string given two vectors of repeat counts.
     // Used by writeGfa1.
     static void constructCigarString(
@@ -1247,7 +2774,52 @@ private:
 public:
 
     // Write assembled sequences in FASTA format.
-    void writeFasta(const string& fileName);
+    // If the file name ends in ".gz", the output is bgzip compressed.
+    void writeFasta(const string& fileName, size_t threadCount = 0);
+private:
+    void writeFastaRecords(uint64_t begin, uint64_t end, string&);
+
+
+
+    // Multithreaded output of a text file consisting of a header
+    // followed by one or more records for each of itemCount items,
+    // used by writeFasta and writeGfa1.
+    // Items are grouped in chunks of consecutive items.
+    // In a first multithreaded pass, each chunk is formatted
+    // (and optionally bgzip compressed) into its own buffer.
+    // The offset of each buffer in the output file is then
+    // known, and in a second multithreaded pass each buffer
+    // is written at its offset using pwrite.
+    // If append is true, the output is appended to an existing file.
+    void writeAssemblyOutput(
+        const string& fileName,
+        const string& header,
+        uint64_t itemCount,
+        void (Assembler::*formatFunction)(uint64_t begin, uint64_t end, string&),
+        size_t threadCount,
+        bool append = false);
+    void writeAssemblyOutputThreadFunction1(size_t threadId);
+    void writeAssemblyOutputThreadFunction2(size_t threadId);
+    class WriteAssemblyOutputData {
+    public:
+        uint64_t itemCount;
+        uint64_t chunkSize;
+        void (Assembler::*formatFunction)(uint64_t begin, uint64_t end, string&);
+        bool bgzip;
+        string fileName;
+        int fileDescriptor;
+
+        // The buffers to be written.
+        // The first one contains the header, and the last one
+        // contains the bgzip end of file marker, if needed.
+        // In between there is one buffer for each chunk.
+        vector<string> buffers;
+
+        // The offset of each buffer in the output file.
+        vector<uint64_t> offsets;
+    };
+    WriteAssemblyOutputData writeAssemblyOutputData;
+public:
 
 
 
@@ -1278,6 +2850,159 @@ public:
     );
 
 
+    /***************************************************************************
+
+    Checkpoints, used to resume an assembly that did not complete.
+    The code is in AssemblerCheckpoints.cpp.
+
+    Each stage of the assembly is identified by a name.
+    When checkpoints are enabled, writeCheckpoint is called after
+    each stage completes. It records the stage in the checkpoint manifest,
+    together with hashes of the data the stage created or modified.
+    The manifest is a csv file which is rewritten after each stage.
+
+    To resume, the Assembler is constructed with createNew=false
+    and resumeFromCheckpoints is called. It accesses the data
+    of all completed stages and verifies their hashes.
+    The stages for which isCheckpointed returns true
+    can then be skipped.
+
+    This requires the data to persist after the assembly process
+    terminates, so it is not possible when using anonymous memory.
+
+    The manifest also records, for each stage, a hash of its parameters
+    set by setCheckpointParameters. The hash for each stage
+    also covers the parameters of all previous stages.
+    For parameter sweeps, reuseCheckpoints uses these hashes to find
+    the stages of a previous assembly that were done with the same
+    parameters, and makes their data available to a new assembly
+    in the same way as a resumed assembly. Data that later stages
+    do not modify are shared with the previous assembly via hard links.
+
+    ***************************************************************************/
+public:
+    void enableCheckpoints(const string& manifestFileName);
+    void resumeFromCheckpoints(const string& manifestFileName);
+    bool isCheckpointed(const string& stageName) const;
+    void writeCheckpoint(const string& stageName);
+
+    // The stage names and their parameter hashes,
+    // in the order in which the stages run.
+    void setCheckpointParameters(const vector< pair<string, uint64_t> >&);
+
+    // Populate the data directory of a new assembly with the data
+    // of the initial stages of a previous assembly that used the same
+    // parameters, and write a checkpoint manifest for those stages.
+    // This must be called before constructing the Assembler,
+    // which must then be constructed with createNew=false
+    // and call resumeFromCheckpoints.
+    // Returns the number of stages reused, which can be zero.
+    static size_t reuseCheckpoints(
+        const string& previousRunDirectory,
+        const string& dataDirectory,
+        const string& manifestFileName,
+        const vector< pair<string, uint64_t> >& stageParametersHashes);
+private:
+    class CheckpointEntry {
+    public:
+        string stageName;
+        string dataName;
+        uint64_t hash;
+
+        // Zero if not known.
+        uint64_t parametersHash = 0;
+    };
+    vector<CheckpointEntry> checkpointManifest;
+    string checkpointManifestFileName;
+    vector< pair<string, uint64_t> > checkpointParametersHashes;
+
+    // Read or write a checkpoint manifest.
+    // readCheckpointManifest returns false if the file cannot be opened.
+    static bool readCheckpointManifest(
+        const string& manifestFileName,
+        vector<CheckpointEntry>&);
+    static void writeCheckpointManifest(
+        const string& manifestFileName,
+        const vector<CheckpointEntry>&);
+
+    // Get the prefixes of the names of the files
+    // that store one of the checkpointed data.
+    static void getCheckpointFilePrefixes(
+        const string& dataName,
+        vector<string>& prefixes);
+
+    // Get the names of the data created or modified by a stage.
+    static void getCheckpointDataNames(
+        const string& stageName,
+        vector<string>& dataNames);
+
+    // Compute the hash of one of those data.
+    uint64_t computeCheckpointHash(const string& dataName) const;
+
+    // Access the data created by a completed stage.
+    void accessCheckpointData(const string& stageName);
+public:
+
+
+
+    /***************************************************************************
+
+    Lifetime of intermediate data, used to reduce peak memory.
+    The code is in AssemblerDataLifetime.cpp.
+
+    Each stage of the assembly declares the data it reads
+    (getStageInputDataNames) and the data it creates or modifies
+    (getCheckpointDataNames). The last stage that uses each of the data
+    is found from these declarations and the stage order
+    set by setCheckpointParameters.
+
+    After each stage, or after a stage is skipped because
+    it was checkpointed, releaseUnneededData releases the
+    intermediate data that no later stage uses, depending on the policy:
+    - keep: nothing is released (the default).
+    - close: the data are unmapped, but their files are kept,
+      so checkpoints remain valid. This only frees memory
+      for anonymous memory or when the Data directory is on disk.
+    - remove: the data are unmapped and their files removed.
+      This also frees memory when the Data directory
+      is on a memory backed filesystem, but checkpoints are not possible.
+
+    Only intermediate data are released: the data used
+    to find and compute alignments and the read graph.
+    The marker graph, the assembly graph and the reads
+    are always kept, because they are the result of the assembly.
+
+    ***************************************************************************/
+public:
+    void setDataLifetimePolicy(const string& policy);
+    void releaseUnneededData(const string& completedStageName);
+
+    // Write the bytes released after each stage and an estimate
+    // of the peak memory saved, using the stages in the performance report.
+    void writeDataLifetimeSummary(ostream&) const;
+private:
+    string dataLifetimePolicy = "keep";
+
+    // The data already released, and the cumulative number
+    // of bytes released after each stage.
+    vector<string> releasedDataNames;
+    vector< pair<string, uint64_t> > releasedBytesAfterStage;
+
+    // Get the names of the data read by a stage.
+    static void getStageInputDataNames(
+        const string& stageName,
+        vector<string>& dataNames);
+
+    // Return true if one of the data can be released
+    // when no later stage uses it.
+    static bool isIntermediateData(const string& dataName);
+
+    // Release one of the data and return the number of bytes released.
+    uint64_t releaseData(const string& dataName, bool remove);
+public:
+
+
+
 #ifndef SHASTA_STATIC_EXECUTABLE
 
     // Data and functions used for the http server.
@@ -1288,6 +3013,8 @@ public:
         const vector<string>& request,
         ostream&,
         const BrowserInformation&) override;
+    bool requiresExclusiveAccess(const vector<string>& request) const override;
+    static bool keywordRequiresExclusiveAccess(const string& keyword);
     void writeHtmlBegin(ostream&) const;
     void writeHtmlEnd(ostream&) const;
     void writeMakeAllTablesSelectable(ostream&) const;
@@ -1300,6 +3027,7 @@ public:
     void exploreRead(const vector<string>&, ostream&);
     void blastRead(const vector<string>&, ostream&);
     void exploreAlignments(const vector<string>&, ostream&);
+    void exploreOverlappingReads(const vector<string>&, ostream&);
     void exploreAlignment(const vector<string>&, ostream&);
     void displayAlignmentMatrix(const vector<string>&, ostream&);
     void exploreAlignmentGraph(const vector<string>&, ostream&);
@@ -1314,9 +3042,42 @@ public:
         string docsDirectory;
         string referenceFastaFileName = "reference.fa";
 
+        // Cached responses for keywords in cachedKeywords.
+        // Those are keywords for pages that are expensive to compute
+        // and only depend on the request and on read-only data.
+        std::set<string> cachedKeywords;
+        HttpResponseCache responseCache;
+
+        // Lazy access of assembly data (see accessAllLazy).
+        // dataGroupWasAccessed is indexed by DataGroup.
+        // Both are protected by dataGroupMutex, which is held
+        // in exclusive mode while data groups are accessed,
+        // and in shared mode while a request is processed.
+        bool lazyAccess = false;
+        vector<bool> dataGroupWasAccessed;
+        std::shared_timed_mutex dataGroupMutex;
+
+        // The thread that prefetches commonly used data
+        // in the background. It is joined by the destructor.
+        std::thread prefetchThread;
+        std::atomic<bool> stopPrefetch {false};
+
+        // The server used to inspect the run while it executes
+        // (see startLiveServer). Null if not started.
+        shared_ptr<LiveHttpServer> liveServer;
+
     };
     HttpServerData httpServerData;
 
+    // Index of the markers in the reference, used to locate reads.
+    ReferenceIndex referenceIndex;
+    void locateReadInReference(
+        OrientedReadId,
+        uint32_t beginPosition,
+        uint32_t endPosition,
+        const vector<string>& request,
+        ostream&);
+
     // Display alignments in an html table.
     void displayAlignments(
         OrientedReadId,
@@ -1352,6 +3113,7 @@ public:
         double timeout;
         bool timeoutIsPresent;
         string portionToDisplay;
+        string layoutMethod;    // "dot" or "builtin".
         void writeForm(ostream&, MarkerGraph::VertexId vertexCount) const;
         bool hasMissingRequiredParameters() const;
     };
@@ -1363,8 +3125,24 @@ public:
         const LocalMarkerGraph&,
         const LocalMarkerGraphRequestParameters&
         );
+    void exploreCompactLocalMarkerGraph(const LocalMarkerGraphRequestParameters&, ostream&);
     void exploreMarkerGraphVertex(const vector<string>&, ostream&);
     void exploreMarkerGraphEdge(const vector<string>&, ostream&);
+
+    // Http server keywords beginning with "/api/" return JSON
+    // instead of html, for programmatic access.
+    // See AssemblerHttpServer-Api.cpp.
+    void fillServerApiFunctionTable();
+    static void writeJsonString(ostream&, const string&);
+    OrientedReadId getApiOrientedReadId(const vector<string>&);
+    void summaryApi(const vector<string>&, ostream&);
+    void readApi(const vector<string>&, ostream&);
+    void markersApi(const vector<string>&, ostream&);
+    void alignmentsApi(const vector<string>&, ostream&);
+    void markerGraphVertexApi(const vector<string>&, ostream&);
+    void markerGraphEdgeApi(const vector<string>&, ostream&);
+    void localMarkerGraphApi(const vector<string>&, ostream&);
+    void localMarkerGraphLayoutApi(const vector<string>&, ostream&);
 #endif
 
 
@@ -1382,8 +3160,22 @@ public:
         uint32_t maxMarkerFrequency;
         size_t minAlignedMarkerCount;
         size_t maxTrim;
+
+        // If useLowHashSketches is true, only oriented reads
+        // that share with orientedReadId0 at least minFrequency low hashes
+        // in the stored LowHash sketches are aligned.
+        // Reads added after the sketches were stored are always aligned.
+        // lowHashes0 contains the sorted low hashes
+        // of orientedReadId0 for each LowHash iteration.
+        bool useLowHashSketches;
+        size_t minFrequency;
+        vector< vector<uint64_t> > lowHashes0;
+
         // The alignments found by each thread.
         vector< vector< pair<OrientedReadId, AlignmentInfo> > > threadAlignments;
+
+        // The number of alignments computed by each thread.
+        vector<uint64_t> threadComputedAlignmentCount;
     };
     ComputeAllAlignmentsData computeAllAlignmentsData;
 
@@ -1391,7 +3183,66 @@ public:
     // Access all available assembly data, without thorwing an exception
     // on failures.
 public:
-    void accessAllSoft();
+    void accessAllSoft(bool verbose = true);
+
+    // Lazy alternative to accessAllSoft, to be used before explore
+    // for large runs. No assembly data are accessed up front.
+    // Instead, each group of data is accessed the first time
+    // an http request needs it.
+    // If prefetch is true, a background thread also accesses
+    // the commonly used data and loads their smaller parts in memory,
+    // so they are warm by the time the first requests need them.
+    void accessAllLazy(bool prefetch = true, size_t threadCount = 0);
+
+    // Start an http server that can be used to inspect the run
+    // while it is still executing (see LiveHttpServer.hpp).
+    // Each time a stage completes, publishLiveView makes the data
+    // created so far visible to the server.
+    // If the server requested that the run stop,
+    // publishLiveView throws an exception instead.
+    void startLiveServer(
+        uint16_t port,
+        bool localOnly,
+        size_t threadCount,
+        const string& consensusCaller);
+    void publishLiveView(const string& stageName);
+private:
+
+    // The groups of assembly data accessed by accessAllSoft
+    // and accessAllLazy.
+    enum class DataGroup {
+        ReadFlags,
+        Kmers,
+        Markers,
+        SortedMarkers,
+        ReferenceIndex,
+        LowHashSketches,
+        MarkerKmerIndex,
+        AlignmentCandidates,
+        Alignments,
+        ReadGraph,
+        MarkerGraphVertices,
+        MarkerGraphEdges,
+        AssemblyGraphVertices,
+        AssemblyGraphEdges,
+        AssemblyGraphEdgeLists,
+        AssemblyGraphSequences,
+        Count
+    };
+
+    // Access one group of data, without throwing an exception
+    // on failure. Returns false if the data are not accessible
+    // (always true for optional data).
+    bool accessDataGroup(DataGroup);
+
+    // In lazy mode, access the data groups needed to process
+    // an http request for this keyword, if not already done.
+    void accessDataGroupsForKeyword(const string& keyword);
+    void accessDataGroupsLazily(const vector<DataGroup>&);
+
+    // The function run by the background prefetch thread.
+    void prefetchThreadFunction(size_t threadCount);
+public:
 
 
 
@@ -1431,6 +3282,13 @@ private:
     // - SimpleBayesianConsensusCaller
 public:
     void setupConsensusCaller(const string&);
+
+    // Benchmark the SimpleBayesianConsensusCaller on the coverage data
+    // stored for marker graph vertices and edges (only available if
+    // Assembly.storeCoverageData was True). Uses at most
+    // maxCoverageCount alignment positions.
+    // Requires SimpleBayesianConsensusCaller.csv in the run directory.
+    void benchmarkSimpleBayesianConsensusCaller(size_t maxCoverageCount);
 private:
     shared_ptr<ConsensusCaller> consensusCaller;
 
@@ -1445,6 +3303,33 @@ private:
 #ifndef SHASTA_STATIC_EXECUTABLE
     PolishParams* marginPhaseParameters;
 #endif
+
+
+
+    // Read-only access to some of the large data structures.
+    // Used by the Python module to expose them as NumPy arrays
+    // without making copies.
+public:
+    const LongBaseSequences& getReads() const
+    {
+        return reads;
+    }
+    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& getMarkers() const
+    {
+        return markers;
+    }
+    const MemoryMapped::Vector<AlignmentData>& getAlignmentData() const
+    {
+        return alignmentData;
+    }
+    const MarkerGraph& getMarkerGraph() const
+    {
+        return markerGraph;
+    }
+    const AssemblyGraph& getAssemblyGraph() const
+    {
+        return assemblyGraph;
+    }
 };
 
 #endif
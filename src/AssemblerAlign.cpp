@@ -1,6 +1,11 @@
 // shasta.
 #include "Assembler.hpp"
 #include "AlignmentGraph.hpp"
+#include "AlignmentWorkspace.hpp"
+#include "CompressedAlignment.hpp"
+#include "MarkerChainer.hpp"
+#include "orderPairs.hpp"
+#include "ThreadLog.hpp"
 #include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
@@ -8,6 +13,7 @@ using namespace shasta;
 // Standard libraries.
 #include "chrono.hpp"
 #include "iterator.hpp"
+#include <sstream>
 #include "tuple.hpp"
 
 
@@ -51,7 +57,7 @@ void Assembler::alignOrientedReads(
     const bool debug = true;
     alignOrientedReads(
         markersSortedByKmerId,
-        maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
+        maxSkip, maxMarkerFrequency, 0, debug, graph, alignment, alignmentInfo);
 
     // Compute the AlignmentInfo.
     uint32_t leftTrim;
@@ -88,7 +94,7 @@ void Assembler::alignOrientedReads(
     const bool debug = true;
     alignOrientedReads(
         markersSortedByKmerId,
-        maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
+        maxSkip, maxMarkerFrequency, 0, debug, graph, alignment, alignmentInfo);
 }
 
 
@@ -97,6 +103,7 @@ void Assembler::alignOrientedReads(
     const array<vector<MarkerWithOrdinal>, 2>& markersSortedByKmerId,
     size_t maxSkip,             // Maximum ordinal skip allowed.
     uint32_t maxMarkerFrequency,
+    size_t bandWidth,           // If not 0, first try a banded alignment.
     bool debug,
     AlignmentGraph& graph,
     Alignment& alignment,
@@ -104,7 +111,97 @@ void Assembler::alignOrientedReads(
 )
 {
     align(markersSortedByKmerId,
-        maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
+        maxSkip, maxMarkerFrequency, bandWidth, debug, graph, alignment, alignmentInfo);
+}
+
+
+
+// Compute marker alignments of many pairs of oriented reads in parallel.
+void Assembler::alignOrientedReadsBatch(
+    const vector< array<OrientedReadId, 2> >& orientedReadIdPairs,
+    size_t maxSkip,
+    uint32_t maxMarkerFrequency,
+    size_t bandWidth,
+    size_t alignMethod,
+    size_t threadCount,
+    vector<AlignmentInfo>& alignmentInfos)
+{
+    checkMarkersAreOpen();
+    if(alignMethod != 0 && alignMethod != 1) {
+        throw runtime_error("Invalid alignMethod " + to_string(alignMethod) + ". Must be 0 or 1.");
+    }
+    const OrientedReadId::Int orientedReadCount = OrientedReadId::Int(2 * readCount());
+    for(const array<OrientedReadId, 2>& orientedReadIds: orientedReadIdPairs) {
+        for(const OrientedReadId orientedReadId: orientedReadIds) {
+            if(orientedReadId.getValue() >= orientedReadCount) {
+                throw runtime_error("Invalid oriented read " + orientedReadId.getString());
+            }
+        }
+    }
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    alignmentInfos.resize(orientedReadIdPairs.size());
+    AlignOrientedReadsBatchData& data = alignOrientedReadsBatchData;
+    data.orientedReadIdPairs = &orientedReadIdPairs;
+    data.maxSkip = maxSkip;
+    data.maxMarkerFrequency = maxMarkerFrequency;
+    data.bandWidth = bandWidth;
+    data.alignMethod = alignMethod;
+    data.alignmentInfos = &alignmentInfos;
+    setupLoadBalancing(orientedReadIdPairs.size(), 100);
+    runThreads(&Assembler::alignOrientedReadsBatchThreadFunction, threadCount);
+    data.orientedReadIdPairs = 0;
+    data.alignmentInfos = 0;
+}
+
+
+
+void Assembler::alignOrientedReadsBatchThreadFunction(size_t threadId)
+{
+    const AlignOrientedReadsBatchData& data = alignOrientedReadsBatchData;
+    const vector< array<OrientedReadId, 2> >& orientedReadIdPairs = *data.orientedReadIdPairs;
+    vector<AlignmentInfo>& alignmentInfos = *data.alignmentInfos;
+
+    AlignmentWorkspace workspace;
+    array<vector<MarkerWithOrdinal>, 2>& markersSortedByKmerId = workspace.markersSortedByKmerId;
+    array<OrientedReadId, 2> sortedMarkersOrientedReadIds;
+    const bool debug = false;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const array<OrientedReadId, 2>& orientedReadIds = orientedReadIdPairs[i];
+
+            // Get the sorted markers, reusing them from
+            // the previous pair when possible.
+            for(size_t j=0; j<2; j++) {
+                if(orientedReadIds[j] != sortedMarkersOrientedReadIds[j]) {
+                    getMarkersSortedByKmerId(orientedReadIds[j], markersSortedByKmerId[j]);
+                    sortedMarkersOrientedReadIds[j] = orientedReadIds[j];
+                }
+            }
+
+            // Compute the alignment.
+            if(data.alignMethod == 0) {
+                alignOrientedReads(markersSortedByKmerId,
+                    data.maxSkip, data.maxMarkerFrequency, data.bandWidth, debug,
+                    workspace.graph, workspace.alignment, workspace.alignmentInfo);
+            } else {
+                alignByChaining(markersSortedByKmerId,
+                    data.maxSkip, data.maxMarkerFrequency, debug,
+                    workspace.chainer, workspace.alignment, workspace.alignmentInfo);
+            }
+            if(workspace.alignment.ordinals.empty()) {
+                alignmentInfos[i] = AlignmentInfo();
+            } else {
+                alignmentInfos[i] = workspace.alignmentInfo;
+            }
+        }
+    }
 }
 
 
@@ -161,7 +258,7 @@ void Assembler::alignOverlappingOrientedReads(
         const bool debug = false;
         alignOrientedReads(
             markersSortedByKmerId,
-            maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
+            maxSkip, maxMarkerFrequency, 0, debug, graph, alignment, alignmentInfo);
 
         uint32_t leftTrim;
         uint32_t rightTrim;
@@ -207,6 +304,27 @@ void Assembler::computeAlignments(
     // Maximum left/right trim (in bases) for an alignment to be used.
     size_t maxTrim,
 
+    // If not 0, first try a banded alignment.
+    size_t bandWidth,
+
+    // 0 = alignment graph, 1 = chaining.
+    size_t alignMethod,
+
+    // If true, also store the ordinals of the good alignments.
+    bool storeAlignments,
+
+    // If true, process the candidates grouped by readIds[0].
+    bool groupCandidates,
+
+    // If true, stop aligning reads already found to be contained
+    // with reads that are not long enough to contain them.
+    bool filterContainedReads,
+
+    // If not 0 and alignMethod is 0, work budget in alignment graph edges.
+    // Candidates whose alignment graph exceeds it are deferred
+    // and aligned at the end using chaining.
+    uint64_t maxAlignmentGraphEdgeCount,
+
     // Number of threads. If zero, a number of threads equal to
     // the number of virtual processors is used.
     size_t threadCount
@@ -216,6 +334,44 @@ void Assembler::computeAlignments(
     cout << timestamp << "Begin computing alignments for ";
     cout << alignmentCandidates.size() << " alignment candidates." << endl;
 
+    setupComputeAlignments(maxMarkerFrequency, maxSkip, minAlignedMarkerCount, maxTrim,
+        bandWidth, alignMethod, storeAlignments, groupCandidates, filterContainedReads,
+        maxAlignmentGraphEdgeCount, threadCount);
+    computeAlignmentsInRange(0, alignmentCandidates.size(),
+        "AlignmentData", "CompressedAlignments", threadCount);
+
+    cout << "Found " << alignmentData.size() << " good alignments." << endl;
+    if(storeAlignments) {
+        cout << "Stored the ordinals of the good alignments using " <<
+            compressedAlignments.totalSize() << " bytes." << endl;
+    }
+    cout << timestamp << "Creating alignment table." << endl;
+    computeAlignmentTable(threadCount);
+
+    const auto tEnd = steady_clock::now();
+    const double tTotal = seconds(tEnd - tBegin);
+    cout << timestamp << "Computation of alignments ";
+    cout << "completed in " << tTotal << " s." << endl;
+}
+
+
+
+// Check that we have what we need to compute alignments,
+// store the parameters so they are accessible to the threads,
+// and adjust the number of threads, if necessary.
+void Assembler::setupComputeAlignments(
+    uint32_t maxMarkerFrequency,
+    size_t maxSkip,
+    size_t minAlignedMarkerCount,
+    size_t maxTrim,
+    size_t bandWidth,
+    size_t alignMethod,
+    bool storeAlignments,
+    bool groupCandidates,
+    bool filterContainedReads,
+    uint64_t maxAlignmentGraphEdgeCount,
+    size_t& threadCount)
+{
     // Check that we have what we need.
     checkReadsAreOpen();
     checkKmersAreOpen();
@@ -228,52 +384,538 @@ void Assembler::computeAlignments(
     data.maxSkip = maxSkip;
     data.minAlignedMarkerCount = minAlignedMarkerCount;
     data.maxTrim = maxTrim;
+    data.bandWidth = bandWidth;
+    data.alignMethod = alignMethod;
+    data.storeAlignments = storeAlignments;
+    data.groupCandidates = groupCandidates;
+    data.filterContainedReads = filterContainedReads;
+    data.maxAlignmentGraphEdgeCount = maxAlignmentGraphEdgeCount;
 
     // Adjust the numbers of threads, if necessary.
     if(threadCount == 0) {
         threadCount = std::thread::hardware_concurrency();
     }
     cout << "Using " << threadCount << " threads." << endl;
+}
+
+
+
+// Compute alignments for alignment candidates in [candidateBegin, candidateEnd)
+// and store the good ones in alignmentData and, if storing alignments,
+// compressedAlignments, created with the given names.
+void Assembler::computeAlignmentsInRange(
+    uint64_t candidateBegin,
+    uint64_t candidateEnd,
+    const string& alignmentDataName,
+    const string& compressedAlignmentsName,
+    size_t threadCount)
+{
+    auto& data = computeAlignmentsData;
+    CZI_ASSERT(candidateBegin <= candidateEnd && candidateEnd <= alignmentCandidates.size());
+    data.candidateBegin = candidateBegin;
+
+    // Alignment candidates are processed in order, but each one
+    // accesses the markers of two reads at random.
+    // Load the markers with multiple threads, so a cold start
+    // does not do random reads from disk.
+    alignmentCandidates.adviseAccessPattern(MemoryMapped::AccessPattern::Sequential);
+    markers.adviseAccessPattern(MemoryMapped::AccessPattern::Random);
+    markers.prefetch(threadCount);
+
+    // If requested, process the candidates grouped by readIds[0],
+    // so computeAlignmentsThreadFunction can reuse the sorted markers
+    // of the first read for consecutive candidates.
+    // LowHash already stores the candidates in this order,
+    // so the permutation is only needed if they are not.
+    if(data.candidateOrder.isOpen) {
+        data.candidateOrder.remove();
+    }
+    if(data.groupCandidates) {
+        const auto candidateLess = [this](uint64_t i, uint64_t j)
+        {
+            const OrientedReadPair& candidate0 = alignmentCandidates[i];
+            const OrientedReadPair& candidate1 = alignmentCandidates[j];
+            return candidate0.readIds < candidate1.readIds;
+        };
+        bool isGrouped = true;
+        for(uint64_t i=candidateBegin+1; i<candidateEnd; i++) {
+            if(alignmentCandidates[i].readIds[0] < alignmentCandidates[i-1].readIds[0]) {
+                isGrouped = false;
+                break;
+            }
+        }
+        if(isGrouped) {
+            cout << "Alignment candidates are already grouped by read." << endl;
+        } else {
+            cout << timestamp << "Grouping alignment candidates by read." << endl;
+            data.candidateOrder.createNew(
+                largeDataName("tmp-AlignmentCandidateOrder"), largeDataPageSize);
+            data.candidateOrder.resize(candidateEnd - candidateBegin);
+            for(uint64_t i=candidateBegin; i!=candidateEnd; i++) {
+                data.candidateOrder[i - candidateBegin] = i;
+            }
+            sort(data.candidateOrder.begin(), data.candidateOrder.end(), candidateLess);
+        }
+    }
 
     // Compute the alignments.
-    data.threadAlignmentData.resize(threadCount);
+    // The threads store the good alignments directly in alignmentData.
+    alignmentData.createNew(largeDataName(alignmentDataName), largeDataPageSize);
+    if(compressedAlignments.isOpen()) {
+        compressedAlignments.remove();
+    }
+    if(data.storeAlignments) {
+        compressedAlignments.createNew(largeDataName(compressedAlignmentsName), largeDataPageSize);
+    }
+    scheduleAlignmentCandidates(candidateEnd - candidateBegin, threadCount);
     cout << timestamp << "Alignment computation begins." << endl;
     size_t batchSize = 10000;
-    setupLoadBalancing(alignmentCandidates.size(), batchSize);
+
+    // The per-thread statistics are accumulated
+    // over the two runs of computeAlignmentsThreadFunction below.
+    data.threadWorkspaceStatistics.assign(threadCount, AlignmentWorkspace::Statistics());
+    data.threadPrefilterCounts.assign(threadCount, {});
+    data.threadSortedMarkersCounts.assign(threadCount, {});
+    if(data.filterContainedReads) {
+        data.isContainedRead.createNew(largeDataName("tmp-ContainedReads"), largeDataPageSize);
+        data.isContainedRead.resize(readCount());
+        for(ReadId readId=0; readId<readCount(); readId++) {
+            data.isContainedRead[readId] = false;
+        }
+        data.threadContainmentFilterCounts.assign(threadCount, 0);
+    }
+    if(readFlags.isOpen) {
+        readFlagBitplanes.createFromReadFlags(readFlags);
+        readFlagBitplanes.getAnyMask(
+            ReadFlagBitplanes::flagBit(ReadFlagBitplanes::isExcluded), data.excludedReadMask);
+    } else {
+        data.excludedReadMask.clear();
+    }
+    data.threadBusySeconds.assign(threadCount, 0.);
+    data.threadDeferredCandidates.assign(threadCount, {});
+    data.threadRetryGoodAlignmentCounts.assign(threadCount, 0);
+
+    // First, the expensive candidates, one at a time.
+    data.processingWorkList = true;
+    setupLoadBalancing(data.workList.size(), 1);
     runThreads(&Assembler::computeAlignmentsThreadFunction, threadCount);
+
+    // Then, all other candidates, in batches.
+    data.processingWorkList = false;
+    setupLoadBalancing(candidateEnd - candidateBegin, batchSize);
+    runThreads(&Assembler::computeAlignmentsThreadFunction, threadCount);
+
+    // Finally, the candidates deferred because their alignment graph
+    // exceeded the work budget, one at a time, aligned using chaining,
+    // which does not create the alignment graph.
+    // They are processed in order, which keeps them grouped by read.
+    data.workList.clear();
+    for(const vector<uint64_t>& threadDeferredCandidates: data.threadDeferredCandidates) {
+        data.workList.insert(data.workList.end(),
+            threadDeferredCandidates.begin(), threadDeferredCandidates.end());
+    }
+    const uint64_t deferredCandidateCount = data.workList.size();
+    if(deferredCandidateCount > 0) {
+        sort(data.workList.begin(), data.workList.end());
+        cout << timestamp << "Aligning by chaining " << deferredCandidateCount <<
+            " alignment candidates whose alignment graph had more than " <<
+            data.maxAlignmentGraphEdgeCount << " edges." << endl;
+        data.retryingDeferredCandidates = true;
+        data.processingWorkList = true;
+        setupLoadBalancing(data.workList.size(), 1);
+        runThreads(&Assembler::computeAlignmentsThreadFunction, threadCount);
+        data.processingWorkList = false;
+        data.retryingDeferredCandidates = false;
+    }
     cout << timestamp << "Alignment computation completed." << endl;
+    if(data.candidateOrder.isOpen) {
+        data.candidateOrder.remove();
+    }
+    data.workList.clear();
+    data.expensiveCandidates.clear();
+    data.threadDeferredCandidates.clear();
+
+    // Write a summary of the deferred candidates.
+    if(data.maxAlignmentGraphEdgeCount != 0 && data.alignMethod == 0) {
+        uint64_t retryGoodAlignmentCount = 0;
+        for(const uint64_t threadRetryGoodAlignmentCount: data.threadRetryGoodAlignmentCounts) {
+            retryGoodAlignmentCount += threadRetryGoodAlignmentCount;
+        }
+        cout << deferredCandidateCount << " of " << candidateEnd - candidateBegin <<
+            " alignment candidates exceeded the work budget of " <<
+            data.maxAlignmentGraphEdgeCount << " alignment graph edges and were aligned by chaining. "
+            "This found " << retryGoodAlignmentCount << " good alignments." << endl;
+    }
+
+    // Write a summary of the load balance.
+    const double minBusySeconds =
+        *min_element(data.threadBusySeconds.begin(), data.threadBusySeconds.end());
+    const double maxBusySeconds =
+        *max_element(data.threadBusySeconds.begin(), data.threadBusySeconds.end());
+    double totalBusySeconds = 0.;
+    for(const double threadBusySeconds: data.threadBusySeconds) {
+        totalBusySeconds += threadBusySeconds;
+    }
+    const double averageBusySeconds = totalBusySeconds / double(threadCount);
+    cout << "Time each thread spent computing alignments: minimum " << minBusySeconds <<
+        " s, average " << averageBusySeconds << " s, maximum " << maxBusySeconds << " s." << endl;
+    if(maxBusySeconds > 0.) {
+        cout << "Load balance efficiency (average/maximum): " <<
+            averageBusySeconds / maxBusySeconds << endl;
+    }
+
+    // Write a summary of the containment filter.
+    if(data.filterContainedReads) {
+        uint64_t containedReadCount = 0;
+        for(ReadId readId=0; readId<readCount(); readId++) {
+            if(data.isContainedRead[readId]) {
+                ++containedReadCount;
+            }
+        }
+        uint64_t skippedCandidateCount = 0;
+        for(const uint64_t threadContainmentFilterCount: data.threadContainmentFilterCounts) {
+            skippedCandidateCount += threadContainmentFilterCount;
+        }
+        cout << "Found " << containedReadCount << " contained reads out of " << readCount() <<
+            ". Skipped " << skippedCandidateCount << " of " << candidateEnd - candidateBegin <<
+            " alignment candidates involving contained reads." << endl;
+        data.isContainedRead.remove();
+    }
+
+    // Write a summary of the reuse of sorted markers.
+    uint64_t sortedMarkersReuseCount = 0;
+    uint64_t sortedMarkersGetCount = 0;
+    for(const auto& threadSortedMarkersCounts: data.threadSortedMarkersCounts) {
+        sortedMarkersReuseCount += threadSortedMarkersCounts[0];
+        sortedMarkersGetCount += threadSortedMarkersCounts[1];
+    }
+    cout << "Sorted markers were reused for " << sortedMarkersReuseCount << " of " <<
+        sortedMarkersReuseCount + sortedMarkersGetCount << " oriented reads (" <<
+        100. * double(sortedMarkersReuseCount) /
+        double(max(uint64_t(1), sortedMarkersReuseCount + sortedMarkersGetCount)) <<
+        "%)." << endl;
+
+    // Write a summary of the candidates rejected by the prefilter.
+    array<uint64_t, AlignmentPrefilter::resultCount> prefilterCounts;
+    fill(prefilterCounts.begin(), prefilterCounts.end(), 0);
+    for(const auto& threadPrefilterCounts: data.threadPrefilterCounts) {
+        for(size_t i=0; i<AlignmentPrefilter::resultCount; i++) {
+            prefilterCounts[i] += threadPrefilterCounts[i];
+        }
+    }
+    cout << "Alignment prefilter results:\n" <<
+        "    Passed: " <<
+        prefilterCounts[size_t(AlignmentPrefilter::Result::Pass)] << "\n" <<
+        "    Rejected, too few shared markers: " <<
+        prefilterCounts[size_t(AlignmentPrefilter::Result::TooFewSharedMarkers)] << "\n" <<
+        "    Rejected, too much trim: " <<
+        prefilterCounts[size_t(AlignmentPrefilter::Result::TooMuchTrim)] << "\n" <<
+        "    Rejected, inconsistent diagonal: " <<
+        prefilterCounts[size_t(AlignmentPrefilter::Result::InconsistentDiagonal)] << endl;
+
+    // Write a summary of memory allocation activity.
+    uint64_t workspaceAlignmentCount = 0;
+    uint64_t workspaceGrowthCount = 0;
+    uint64_t workspaceHighWaterBytes = 0;
+    for(const AlignmentWorkspace::Statistics& statistics: data.threadWorkspaceStatistics) {
+        workspaceAlignmentCount += statistics.alignmentCount;
+        workspaceGrowthCount += statistics.growthCount;
+        workspaceHighWaterBytes = max(workspaceHighWaterBytes, statistics.highWaterBytes);
+    }
+    cout << "Memory was allocated for " << workspaceGrowthCount << " of " <<
+        workspaceAlignmentCount << " alignments. "
+        "Maximum memory allocated by one thread to compute alignments was " <<
+        workspaceHighWaterBytes << " bytes." << endl;
+}
 
 
 
-    // Store alignmentInfos found by each thread in the global alignmentInfos.
-    cout << "Storing the alignment info objects." << endl;
+// Scheduling for computeAlignmentsInRange.
+// The cost of computing an alignment varies by orders of magnitude
+// between candidates, particularly with ultralong reads.
+// To avoid a long tail in which a few threads are still
+// working on expensive candidates while the others are idle,
+// we estimate the cost of each candidate and process the
+// expensive ones first, one at a time, in order of decreasing cost.
+// This creates computeAlignmentsData.expensiveCandidates
+// and computeAlignmentsData.workList for the n candidates to be processed.
+void Assembler::scheduleAlignmentCandidates(uint64_t n, size_t threadCount)
+{
+    auto& data = computeAlignmentsData;
+    const size_t batchSize = 100000;
+    const uint64_t expensiveCandidateCostFactor = 10;
+
+    // Compute the total estimated cost.
+    data.threadTotalCost.assign(threadCount, 0);
+    setupLoadBalancing(n, batchSize);
+    runThreads(&Assembler::scheduleAlignmentCandidatesThreadFunction1, threadCount);
+    uint64_t totalCost = 0;
+    for(const uint64_t threadTotalCost: data.threadTotalCost) {
+        totalCost += threadTotalCost;
+    }
+    data.expensiveCandidateCostThreshold = (n == 0) ? std::numeric_limits<uint64_t>::max() :
+        expensiveCandidateCostFactor * max(uint64_t(1), totalCost / n);
+
+    // Find the expensive candidates.
+    data.threadExpensiveCandidates.clear();
+    data.threadExpensiveCandidates.resize(threadCount);
+    setupLoadBalancing(n, batchSize);
+    runThreads(&Assembler::scheduleAlignmentCandidatesThreadFunction2, threadCount);
+    vector< pair<uint64_t, uint64_t> > expensiveCandidates;
+    for(const auto& v: data.threadExpensiveCandidates) {
+        expensiveCandidates.insert(expensiveCandidates.end(), v.begin(), v.end());
+    }
+    data.threadExpensiveCandidates.clear();
+    uint64_t expensiveCost = 0;
+    for(const auto& p: expensiveCandidates) {
+        expensiveCost += p.second;
+    }
+    cout << "Found " << expensiveCandidates.size() << " expensive alignment candidates out of " <<
+        n << "." << endl;
+    if(totalCost > 0) {
+        cout << "These account for " << double(expensiveCost) / double(totalCost) <<
+            " of the estimated alignment cost." << endl;
+    }
+
+    // Sort them by decreasing cost, then deal them to the threads
+    // in serpentine order (0, 1, ..., n-1, n-1, ..., 1, 0, 0, 1, ...).
+    // The work list is the concatenation of the candidates dealt to each thread,
+    // so the range of the work list initially assigned to each thread
+    // by the load balancing has about the same total cost.
+    sort(expensiveCandidates.begin(), expensiveCandidates.end(),
+        OrderPairsBySecondOnlyGreater<uint64_t, uint64_t>());
+    vector< vector<uint64_t> > dealtCandidates(threadCount);
+    for(size_t i=0; i<expensiveCandidates.size(); i++) {
+        const size_t round = i / threadCount;
+        const size_t position = i % threadCount;
+        const size_t threadId = (round % 2 == 0) ? position : (threadCount - 1 - position);
+        dealtCandidates[threadId].push_back(expensiveCandidates[i].first);
+    }
+    data.workList.clear();
+    for(const auto& v: dealtCandidates) {
+        data.workList.insert(data.workList.end(), v.begin(), v.end());
+    }
+    data.expensiveCandidates = data.workList;
+    sort(data.expensiveCandidates.begin(), data.expensiveCandidates.end());
+}
+
+
+
+uint64_t Assembler::estimateAlignmentCost(const OrientedReadPair& candidate) const
+{
+    return
+        getMarkerCount(OrientedReadId(candidate.readIds[0], 0)) *
+        getMarkerCount(OrientedReadId(candidate.readIds[1], 0));
+}
+
+
+
+// Scheduling for computeAlignmentsInRange: compute the total estimated cost.
+void Assembler::scheduleAlignmentCandidatesThreadFunction1(size_t threadId)
+{
+    const auto& data = computeAlignmentsData;
+    uint64_t totalCost = 0;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            totalCost += estimateAlignmentCost(alignmentCandidates[data.getCandidateIndex(i)]);
+        }
+    }
+
+    computeAlignmentsData.threadTotalCost[threadId] = totalCost;
+}
+
+
+
+// Scheduling for computeAlignmentsInRange: find the expensive candidates.
+void Assembler::scheduleAlignmentCandidatesThreadFunction2(size_t threadId)
+{
+    auto& data = computeAlignmentsData;
+    const uint64_t expensiveCandidateCostThreshold = data.expensiveCandidateCostThreshold;
+    auto& expensiveCandidates = data.threadExpensiveCandidates[threadId];
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const uint64_t cost =
+                estimateAlignmentCost(alignmentCandidates[data.getCandidateIndex(i)]);
+            if(cost >= expensiveCandidateCostThreshold) {
+                expensiveCandidates.push_back(make_pair(i, cost));
+            }
+        }
+    }
+}
+
+
+
+// Distributed computation of alignments, worker side.
+// See Assembler.hpp for more information.
+void Assembler::computeAlignmentsShard(
+    uint64_t shardId,
+    uint64_t shardCount,
+    uint32_t maxMarkerFrequency,
+    size_t maxSkip,
+    size_t minAlignedMarkerCount,
+    size_t maxTrim,
+    size_t bandWidth,
+    size_t alignMethod,
+    bool storeAlignments,
+    uint64_t maxAlignmentGraphEdgeCount,
+    size_t threadCount)
+{
+    if(largeDataFileNamePrefix.empty()) {
+        throw runtime_error("Distributed computation of alignments "
+            "requires the Data directory to be on a filesystem shared by all processes.");
+    }
+    if(shardId >= shardCount) {
+        throw runtime_error("Invalid alignment shard " + to_string(shardId) +
+            " of " + to_string(shardCount) + ".");
+    }
+
+    const auto tBegin = steady_clock::now();
+    const uint64_t candidateCount = alignmentCandidates.size();
+    const uint64_t candidateBegin = (candidateCount * shardId) / shardCount;
+    const uint64_t candidateEnd = (candidateCount * (shardId + 1)) / shardCount;
+    cout << timestamp << "Begin computing alignments for shard " << shardId <<
+        " of " << shardCount << ", alignment candidates " <<
+        candidateBegin << " to " << candidateEnd << " of " << candidateCount << "." << endl;
+
+    setupComputeAlignments(maxMarkerFrequency, maxSkip, minAlignedMarkerCount, maxTrim,
+        bandWidth, alignMethod, storeAlignments, false, false,
+        maxAlignmentGraphEdgeCount, threadCount);
+    computeAlignmentsInRange(candidateBegin, candidateEnd,
+        shardName("AlignmentData", shardId),
+        shardName("CompressedAlignments", shardId),
+        threadCount);
+    const uint64_t alignmentCount = alignmentData.size();
+
+    // Close the shard, which writes it to disk with the checksums
+    // verified by mergeAlignmentShards, then write the shard information.
+    // Because the shard information is written last,
+    // its presence indicates that the shard is complete.
+    alignmentData.closeWithChecksums(threadCount);
+    if(storeAlignments) {
+        compressedAlignments.close();
+    }
+    MemoryMapped::Vector<uint64_t> shardInfo;
+    shardInfo.createNew(largeDataName(shardName("AlignmentShardInfo", shardId)), largeDataPageSize);
+    shardInfo.push_back(shardCount);
+    shardInfo.push_back(candidateBegin);
+    shardInfo.push_back(candidateEnd);
+    shardInfo.push_back(alignmentCount);
+    shardInfo.push_back(storeAlignments ? 1 : 0);
+    CZI_ASSERT(shardInfo.size() == alignmentShardInfoSize);
+    shardInfo.close();
+
+    cout << timestamp << "Found " << alignmentCount << " good alignments in shard " <<
+        shardId << " in " << seconds(steady_clock::now() - tBegin) << " s." << endl;
+}
+
+
+
+// Distributed computation of alignments, coordinator side.
+// See Assembler.hpp for more information.
+void Assembler::mergeAlignmentShards(
+    uint64_t shardCount,
+    size_t threadCount)
+{
+    const auto tBegin = steady_clock::now();
+    checkReadsAreOpen();
+    checkAlignmentCandidatesAreOpen();
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    cout << timestamp << "Merging " << shardCount << " alignment shards." << endl;
+
+    // Check that all shards are complete and that together they cover
+    // all alignment candidates, using the same options.
+    uint64_t alignmentCount = 0;
+    bool storeAlignments = false;
+    for(uint64_t shardId=0; shardId<shardCount; shardId++) {
+        MemoryMapped::Vector<uint64_t> shardInfo;
+        try {
+            shardInfo.accessExistingReadOnly(largeDataName(shardName("AlignmentShardInfo", shardId)));
+        } catch(const runtime_error&) {
+            throw runtime_error("Alignment shard " + to_string(shardId) + " is missing or incomplete.");
+        }
+        if(shardInfo.size() != alignmentShardInfoSize ||
+            shardInfo[0] != shardCount ||
+            shardInfo[1] != (alignmentCandidates.size() * shardId) / shardCount ||
+            shardInfo[2] != (alignmentCandidates.size() * (shardId + 1)) / shardCount) {
+            throw runtime_error("Alignment shard " + to_string(shardId) +
+                " does not match the alignment candidates or the number of shards.");
+        }
+        if(shardId == 0) {
+            storeAlignments = (shardInfo[4] != 0);
+        } else if(storeAlignments != (shardInfo[4] != 0)) {
+            throw runtime_error("Alignment shards were computed with different values of storeAlignments.");
+        }
+        alignmentCount += shardInfo[3];
+    }
+
+    // Concatenate the shards in order.
     alignmentData.createNew(largeDataName("AlignmentData"), largeDataPageSize);
-    for(size_t threadId=0; threadId<threadCount; threadId++) {
-        const vector<AlignmentData>& threadAlignmentData = data.threadAlignmentData[threadId];
-        for(const AlignmentData& ad: threadAlignmentData) {
-            alignmentData.push_back(ad);
+    alignmentData.reserve(alignmentCount);
+    if(compressedAlignments.isOpen()) {
+        compressedAlignments.remove();
+    }
+    if(storeAlignments) {
+        compressedAlignments.createNew(largeDataName("CompressedAlignments"), largeDataPageSize);
+    }
+    for(uint64_t shardId=0; shardId<shardCount; shardId++) {
+        MemoryMapped::Vector<AlignmentData> shardAlignmentData;
+        shardAlignmentData.accessExistingReadOnly(largeDataName(shardName("AlignmentData", shardId)));
+        if(!shardAlignmentData.verifyChecksums(threadCount)) {
+            throw runtime_error("Alignment shard " + to_string(shardId) + " is corrupted.");
         }
+        const uint64_t oldSize = alignmentData.size();
+        alignmentData.resize(oldSize + shardAlignmentData.size());
+        copy(shardAlignmentData.begin(), shardAlignmentData.end(), alignmentData.begin() + oldSize);
+        shardAlignmentData.remove();
+
+        if(storeAlignments) {
+            MemoryMapped::VectorOfVectors<uint8_t, uint64_t> shardCompressedAlignments;
+            shardCompressedAlignments.accessExistingReadOnly(
+                largeDataName(shardName("CompressedAlignments", shardId)));
+            for(uint64_t i=0; i<shardCompressedAlignments.size(); i++) {
+                compressedAlignments.appendVector(
+                    shardCompressedAlignments.begin(i), shardCompressedAlignments.end(i));
+            }
+            shardCompressedAlignments.remove();
+            CZI_ASSERT(compressedAlignments.size() == alignmentData.size());
+        }
+
+        MemoryMapped::Vector<uint64_t> shardInfo;
+        shardInfo.accessExistingReadOnly(largeDataName(shardName("AlignmentShardInfo", shardId)));
+        shardInfo.remove();
     }
-    cout << timestamp << "Creating alignment table." << endl;
-    computeAlignmentTable();
+    CZI_ASSERT(alignmentData.size() == alignmentCount);
+    cout << "Found " << alignmentData.size() << " good alignments." << endl;
 
-    const auto tEnd = steady_clock::now();
-    const double tTotal = seconds(tEnd - tBegin);
-    cout << timestamp << "Computation of alignments ";
-    cout << "completed in " << tTotal << " s." << endl;
+    cout << timestamp << "Creating alignment table." << endl;
+    computeAlignmentTable(threadCount);
+    cout << timestamp << "Merging of alignment shards completed in " <<
+        seconds(steady_clock::now() - tBegin) << " s." << endl;
 }
 
 
 
 void Assembler::computeAlignmentsThreadFunction(size_t threadId)
 {
+    const auto tBegin = steady_clock::now();
 
     array<OrientedReadId, 2> orientedReadIds;
     array<OrientedReadId, 2> orientedReadIdsOppositeStrand;
-    array<vector<MarkerWithOrdinal>, 2> markersSortedByKmerId;
-    AlignmentGraph graph;
-    Alignment alignment;
-    AlignmentInfo alignmentInfo;
+
+    // All the memory used to compute alignments is in the workspace,
+    // which is reused for all the alignments computed by this thread.
+    AlignmentWorkspace workspace;
+    array<vector<MarkerWithOrdinal>, 2>& markersSortedByKmerId = workspace.markersSortedByKmerId;
+    AlignmentGraph& graph = workspace.graph;
+    MarkerChainer& chainer = workspace.chainer;
+    Alignment& alignment = workspace.alignment;
+    AlignmentInfo& alignmentInfo = workspace.alignmentInfo;
 
     const bool debug = false;
     auto& data = computeAlignmentsData;
@@ -281,20 +923,70 @@ void Assembler::computeAlignmentsThreadFunction(size_t threadId)
     const size_t maxSkip = data.maxSkip;
     const size_t minAlignedMarkerCount = data.minAlignedMarkerCount;
     const size_t maxTrim = data.maxTrim;
-
-    vector<AlignmentData>& threadAlignmentData = data.threadAlignmentData[threadId];
+    const size_t bandWidth = data.bandWidth;
+
+    // Deferred candidates are aligned using chaining.
+    // Otherwise, when using the alignment graph, candidates
+    // that exceed the work budget are deferred.
+    const bool retryingDeferredCandidates = data.retryingDeferredCandidates;
+    const size_t alignMethod = retryingDeferredCandidates ? 1 : data.alignMethod;
+    graph.maxEdgeCount = data.maxAlignmentGraphEdgeCount;
+    vector<uint64_t>& deferredCandidates = data.threadDeferredCandidates[threadId];
+    uint64_t retryGoodAlignmentCount = 0;
+
+    // The good alignments found by this thread are accumulated here
+    // and periodically appended to alignmentData.
+    vector<AlignmentData> threadAlignmentData;
+    threadAlignmentData.reserve(ComputeAlignmentsData::chunkSize);
+
+    // If storing alignments, the compressed alignments
+    // corresponding to threadAlignmentData, concatenated,
+    // and the number of bytes used by each of them.
+    const bool storeAlignments = data.storeAlignments;
+    vector<uint8_t> compressedAlignment;
+    vector<uint8_t> threadCompressedAlignmentBytes;
+    vector<uint64_t> threadCompressedAlignmentSizes;
+    array<uint64_t, AlignmentPrefilter::resultCount>& prefilterCounts =
+        data.threadPrefilterCounts[threadId];
+
+    // The oriented reads whose sorted markers are currently
+    // in markersSortedByKmerId. When consecutive candidates
+    // share an oriented read, its sorted markers are reused.
+    // This is frequent because candidates are grouped by readIds[0].
+    array<OrientedReadId, 2> sortedMarkersOrientedReadIds;
+    array<uint64_t, 2>& sortedMarkersCounts = data.threadSortedMarkersCounts[threadId];
+
+    const bool filterContainedReads = data.filterContainedReads;
+    uint64_t containmentFilterCount = 0;
+
+    // If the read flags are available, candidates involving
+    // reads excluded by subsampleReads are skipped.
+    const bool checkExcludedReads = !data.excludedReadMask.empty();
+
+    // When processing the work list, each batch is a range of positions
+    // in the work list. Otherwise, it is a range of positions i,
+    // and the expensive candidates, already processed, are skipped.
+    const bool processingWorkList = data.processingWorkList;
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
-        if((begin % 1000000) == 0){
-            std::lock_guard<std::mutex> lock(mutex);
-            cout << timestamp << "Working on alignment " << begin;
-            cout << " of " << alignmentCandidates.size() << endl;
-        }
-
-        for(size_t i=begin; i!=end; i++) {
-            const OrientedReadPair& candidate = alignmentCandidates[i];
+        auto it = std::lower_bound(data.expensiveCandidates.begin(), data.expensiveCandidates.end(), begin);
+        for(uint64_t k=begin; k!=end; k++) {
+            uint64_t i = k;
+            if(processingWorkList) {
+                i = data.workList[k];
+            } else if(it!=data.expensiveCandidates.end() && *it==k) {
+                ++it;
+                continue;
+            }
+            const uint64_t candidateIndex = data.getCandidateIndex(i);
+            const OrientedReadPair& candidate = alignmentCandidates[candidateIndex];
             CZI_ASSERT(candidate.readIds[0] < candidate.readIds[1]);
+            if(checkExcludedReads && (
+                ReadFlagBitplanes::isSet(data.excludedReadMask, candidate.readIds[0]) ||
+                ReadFlagBitplanes::isSet(data.excludedReadMask, candidate.readIds[1]))) {
+                continue;
+            }
 
             // Get the oriented read ids, with the first one on strand 0.
             orientedReadIds[0] = OrientedReadId(candidate.readIds[0], 0);
@@ -308,24 +1000,76 @@ void Assembler::computeAlignmentsThreadFunction(size_t threadId)
 
             // out << timestamp << "Working on " << i << " " << orientedReadIds[0] << " " << orientedReadIds[1] << endl;
 
-            // Get the markers for the two oriented reads in this candidate.
+            // If filtering contained reads, skip the candidate if one of
+            // the two reads was already found to be contained and the other read
+            // is not long enough to contain it (with the containment criteria
+            // used by createReadGraphNew, a containing read has more than maxTrim
+            // unaligned markers on each side).
+            // Such an alignment would be discarded by createReadGraphNew.
+            if(filterContainedReads) {
+                bool skip = false;
+                for(size_t j=0; j<2; j++) {
+                    if(data.isContainedRead[candidate.readIds[j]]) {
+                        const uint64_t markerCount = getMarkerCount(orientedReadIds[j]);
+                        const uint64_t otherMarkerCount = getMarkerCount(orientedReadIds[1-j]);
+                        if(otherMarkerCount < markerCount + 2 * (maxTrim + 1)) {
+                            skip = true;
+                        }
+                    }
+                }
+                if(skip) {
+                    ++containmentFilterCount;
+                    continue;
+                }
+            }
+
+            // Get the markers for the two oriented reads in this candidate,
+            // unless we already have them from the previous candidate.
             for(size_t j=0; j<2; j++) {
-                getMarkersSortedByKmerId(orientedReadIds[j], markersSortedByKmerId[j]);
+                if(orientedReadIds[j] == sortedMarkersOrientedReadIds[j]) {
+                    ++sortedMarkersCounts[0];
+                } else {
+                    getMarkersSortedByKmerId(orientedReadIds[j], markersSortedByKmerId[j]);
+                    sortedMarkersOrientedReadIds[j] = orientedReadIds[j];
+                    ++sortedMarkersCounts[1];
+                }
+            }
+
+            // Skip it if it cannot give a good alignment.
+            const AlignmentPrefilter::Result prefilterResult = workspace.prefilter.check(
+                markersSortedByKmerId, maxMarkerFrequency, minAlignedMarkerCount, maxTrim);
+            // Deferred candidates were already counted.
+            if(!retryingDeferredCandidates) {
+                ++prefilterCounts[size_t(prefilterResult)];
+            }
+            if(prefilterResult != AlignmentPrefilter::Result::Pass) {
+                continue;
             }
 
             // Compute the Alignment.
             const auto t0 = std::chrono::steady_clock::now();
-            alignOrientedReads(
-                markersSortedByKmerId,
-                maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
+            if(alignMethod == 0) {
+                alignOrientedReads(
+                    markersSortedByKmerId,
+                    maxSkip, maxMarkerFrequency, bandWidth, debug, graph, alignment, alignmentInfo);
+            } else {
+                alignByChaining(
+                    markersSortedByKmerId,
+                    maxSkip, maxMarkerFrequency, debug, chainer, alignment, alignmentInfo);
+            }
             const auto t1 = std::chrono::steady_clock::now();
+            workspace.update();
             const double t01 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)).count());
             if(t01 > 1.) {
-                std::lock_guard<std::mutex> lock(mutex);
-                cout << timestamp << "Slow alignment computation for oriented reads ";
-                cout << orientedReadIds[0] << " ";
-                cout << orientedReadIds[1] << ": ";
-                cout << t01 << " s.\n";
+                ThreadLog::Message(ThreadLog::Level::warning) << timestamp <<
+                    "Slow alignment computation for oriented reads " <<
+                    orientedReadIds[0] << " " <<
+                    orientedReadIds[1] << ": " <<
+                    t01 << " s.";
+            }
+            if(alignMethod == 0 && graph.workBudgetWasExceeded()) {
+                deferredCandidates.push_back(i);
+                continue;
             }
 
             // If the alignment has too few markers skip it.
@@ -342,52 +1086,337 @@ void Assembler::computeAlignmentsThreadFunction(size_t threadId)
             }
 
             // If getting here, this is a good alignment.
+            // If filtering contained reads, use it to flag a contained read,
+            // with the same criteria used by createReadGraphNew.
+            if(filterContainedReads) {
+                for(size_t j=0; j<2; j++) {
+                    if( alignmentInfo.leftTrim(j)    <= maxTrim &&
+                        alignmentInfo.rightTrim(j)   <= maxTrim &&
+                        alignmentInfo.leftTrim(1-j)  >  maxTrim &&
+                        alignmentInfo.rightTrim(1-j) >  maxTrim) {
+                        data.isContainedRead[candidate.readIds[j]] = true;
+                    }
+                }
+            }
+            if(retryingDeferredCandidates) {
+                ++retryGoodAlignmentCount;
+            }
             threadAlignmentData.push_back(AlignmentData(candidate, alignmentInfo));
+            if(storeAlignments) {
+                compressAlignment(alignment, compressedAlignment);
+                threadCompressedAlignmentBytes.insert(threadCompressedAlignmentBytes.end(),
+                    compressedAlignment.begin(), compressedAlignment.end());
+                threadCompressedAlignmentSizes.push_back(compressedAlignment.size());
+            }
+            if(threadAlignmentData.size() == ComputeAlignmentsData::chunkSize) {
+                storeAlignmentData(threadAlignmentData,
+                    threadCompressedAlignmentBytes, threadCompressedAlignmentSizes);
+            }
+        }
+    }
+    storeAlignmentData(threadAlignmentData,
+        threadCompressedAlignmentBytes, threadCompressedAlignmentSizes);
+
+    AlignmentWorkspace::Statistics& workspaceStatistics = data.threadWorkspaceStatistics[threadId];
+    workspaceStatistics.alignmentCount += workspace.statistics.alignmentCount;
+    workspaceStatistics.growthCount += workspace.statistics.growthCount;
+    workspaceStatistics.highWaterBytes =
+        max(workspaceStatistics.highWaterBytes, workspace.statistics.highWaterBytes);
+    if(filterContainedReads) {
+        data.threadContainmentFilterCounts[threadId] += containmentFilterCount;
+    }
+    data.threadRetryGoodAlignmentCounts[threadId] += retryGoodAlignmentCount;
+    data.threadBusySeconds[threadId] += seconds(steady_clock::now() - tBegin);
+}
+
+
+
+// Compare the alignment graph and chaining alignment methods.
+void Assembler::benchmarkAlignments(
+    uint32_t maxMarkerFrequency,
+    size_t maxSkip,
+    size_t minAlignedMarkerCount,
+    size_t maxTrim,
+    size_t candidateCount)
+{
+    // Check that we have what we need.
+    checkKmersAreOpen();
+    checkMarkersAreOpen();
+    checkAlignmentCandidatesAreOpen();
+    if(candidateCount == 0 || candidateCount > alignmentCandidates.size()) {
+        candidateCount = alignmentCandidates.size();
+    }
+    cout << timestamp << "Benchmarking alignment methods on " <<
+        candidateCount << " alignment candidates." << endl;
+
+    array<vector<MarkerWithOrdinal>, 2> markersSortedByKmerId;
+    AlignmentGraph graph;
+    MarkerChainer chainer;
+    array<Alignment, 2> alignments;
+    array<AlignmentInfo, 2> alignmentInfos;
+    const bool debug = false;
+
+    // Statistics for each method (0 = alignment graph, 1 = chaining).
+    array<double, 2> times = {0., 0.};
+    array<uint64_t, 2> goodAlignmentCount = {0, 0};
+    array<uint64_t, 2> goodAlignedMarkerCount = {0, 0};
+    uint64_t bothGoodCount = 0;
+    uint64_t identicalCount = 0;
+
+    for(size_t i=0; i<candidateCount; i++) {
+        const OrientedReadPair& candidate = alignmentCandidates[i];
+        const OrientedReadId orientedReadId0(candidate.readIds[0], 0);
+        const OrientedReadId orientedReadId1(candidate.readIds[1], candidate.isSameStrand ? 0 : 1);
+        getMarkersSortedByKmerId(orientedReadId0, markersSortedByKmerId[0]);
+        getMarkersSortedByKmerId(orientedReadId1, markersSortedByKmerId[1]);
+
+        array<bool, 2> isGood;
+        for(size_t method=0; method<2; method++) {
+            Alignment& alignment = alignments[method];
+            AlignmentInfo& alignmentInfo = alignmentInfos[method];
+            const auto t0 = steady_clock::now();
+            if(method == 0) {
+                alignOrientedReads(markersSortedByKmerId, maxSkip, maxMarkerFrequency, 0,
+                    debug, graph, alignment, alignmentInfo);
+            } else {
+                alignByChaining(markersSortedByKmerId, maxSkip, maxMarkerFrequency,
+                    debug, chainer, alignment, alignmentInfo);
+            }
+            times[method] += seconds(steady_clock::now() - t0);
+
+            // Use the same criteria as computeAlignments.
+            isGood[method] = false;
+            if(alignment.ordinals.size() >= minAlignedMarkerCount) {
+                uint32_t leftTrim;
+                uint32_t rightTrim;
+                tie(leftTrim, rightTrim) = alignmentInfo.computeTrim();
+                isGood[method] = (leftTrim<=maxTrim && rightTrim<=maxTrim);
+            }
+            if(isGood[method]) {
+                ++goodAlignmentCount[method];
+                goodAlignedMarkerCount[method] += alignment.ordinals.size();
+            }
+        }
+        if(isGood[0] && isGood[1]) {
+            ++bothGoodCount;
+        }
+        if(alignments[0].ordinals == alignments[1].ordinals) {
+            ++identicalCount;
         }
     }
+
+    const array<string, 2> methodNames = {"Alignment graph", "Chaining"};
+    for(size_t method=0; method<2; method++) {
+        cout << methodNames[method] << ": " << times[method] << " s, " <<
+            double(candidateCount) / times[method] << " alignments/s, " <<
+            goodAlignmentCount[method] << " good alignments";
+        if(goodAlignmentCount[method]) {
+            cout << " with on average " <<
+                double(goodAlignedMarkerCount[method]) / double(goodAlignmentCount[method]) <<
+                " aligned markers";
+        }
+        cout << "." << endl;
+    }
+    cout << bothGoodCount << " alignments are good for both methods." << endl;
+    cout << identicalCount << " alignments are identical for both methods." << endl;
+}
+
+
+
+void Assembler::benchmarkAlignmentShortestPath(
+    const string& logFileName,
+    uint32_t maxMarkerFrequency,
+    size_t maxSkip,
+    size_t bandWidth)
+{
+    // Check that we have what we need.
+    checkKmersAreOpen();
+    checkMarkersAreOpen();
+
+    // Read the oriented read pairs of the slow alignments.
+    ifstream log(logFileName);
+    if(!log) {
+        throw runtime_error("Error opening " + logFileName);
+    }
+    const string prefix = "Slow alignment computation for oriented reads ";
+    vector< array<OrientedReadId, 2> > orientedReadIdPairs;
+    string line;
+    while(std::getline(log, line)) {
+        const size_t i = line.find(prefix);
+        if(i == string::npos) {
+            continue;
+        }
+        std::istringstream s(line.substr(i + prefix.size()));
+        string token0, token1;
+        s >> token0 >> token1;
+        if(!token1.empty() && token1.back() == ':') {
+            token1.pop_back();
+        }
+        const array<OrientedReadId, 2> orientedReadIds =
+            {OrientedReadId(token0), OrientedReadId(token1)};
+        for(const OrientedReadId orientedReadId: orientedReadIds) {
+            checkReadId(orientedReadId.getReadId());
+        }
+        orientedReadIdPairs.push_back(orientedReadIds);
+    }
+    cout << timestamp << "Benchmarking alignment graph shortest path engines on " <<
+        orientedReadIdPairs.size() << " slow alignments from " << logFileName << endl;
+
+    array<vector<MarkerWithOrdinal>, 2> markersSortedByKmerId;
+    AlignmentGraph graph;
+    array<Alignment, 2> alignments;
+    array<AlignmentInfo, 2> alignmentInfos;
+    const bool debug = false;
+
+    // Statistics for each engine (0 = dynamic programming, 1 = Dijkstra).
+    array<double, 2> times = {0., 0.};
+    array<uint64_t, 2> pathLengths;
+    uint64_t sameLengthCount = 0;
+    uint64_t identicalCount = 0;
+
+    for(const array<OrientedReadId, 2>& orientedReadIds: orientedReadIdPairs) {
+        getMarkersSortedByKmerId(orientedReadIds[0], markersSortedByKmerId[0]);
+        getMarkersSortedByKmerId(orientedReadIds[1], markersSortedByKmerId[1]);
+
+        array<double, 2> pairTimes;
+        for(size_t engine=0; engine<2; engine++) {
+            graph.useDijkstra = (engine == 1);
+            const auto t0 = steady_clock::now();
+            alignOrientedReads(markersSortedByKmerId, maxSkip, maxMarkerFrequency, bandWidth,
+                debug, graph, alignments[engine], alignmentInfos[engine]);
+            pairTimes[engine] = seconds(steady_clock::now() - t0);
+            times[engine] += pairTimes[engine];
+            pathLengths[engine] = graph.shortestPathLength();
+        }
+        if(pathLengths[0] == pathLengths[1]) {
+            ++sameLengthCount;
+        }
+        if(alignments[0].ordinals == alignments[1].ordinals) {
+            ++identicalCount;
+        }
+        cout << orientedReadIds[0] << " " << orientedReadIds[1] << ": " <<
+            alignments[0].ordinals.size() << " aligned markers, " <<
+            pairTimes[0] << " s with dynamic programming, " <<
+            pairTimes[1] << " s with Dijkstra." << endl;
+    }
+
+    const array<string, 2> engineNames = {"Dynamic programming", "Dijkstra"};
+    for(size_t engine=0; engine<2; engine++) {
+        cout << engineNames[engine] << ": " << times[engine] << " s." << endl;
+    }
+    cout << sameLengthCount << " alignments have the same optimal path length for both engines." << endl;
+    cout << identicalCount << " alignments are identical for both engines." << endl;
+}
+
+
+
+// Append to alignmentData a chunk of alignments found by one thread,
+// then clear the chunk. This is called by the threads of computeAlignments.
+// If storing alignments, the corresponding compressed alignments
+// are appended to compressedAlignments, so they get the same alignment ids.
+void Assembler::storeAlignmentData(
+    vector<AlignmentData>& threadAlignmentData,
+    vector<uint8_t>& compressedAlignmentBytes,
+    vector<uint64_t>& compressedAlignmentSizes)
+{
+    if(threadAlignmentData.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t oldSize = alignmentData.size();
+    alignmentData.resize(oldSize + threadAlignmentData.size());
+    copy(threadAlignmentData.begin(), threadAlignmentData.end(), alignmentData.begin() + oldSize);
+    threadAlignmentData.clear();
+
+    if(computeAlignmentsData.storeAlignments) {
+        CZI_ASSERT(compressedAlignmentSizes.size() == alignmentData.size() - oldSize);
+        const uint8_t* p = compressedAlignmentBytes.data();
+        for(const uint64_t size: compressedAlignmentSizes) {
+            compressedAlignments.appendVector(size);
+            copy(p, p + size, compressedAlignments.begin(compressedAlignments.size() - 1));
+            p += size;
+        }
+        CZI_ASSERT(compressedAlignments.size() == alignmentData.size());
+    }
+    compressedAlignmentBytes.clear();
+    compressedAlignmentSizes.clear();
 }
 
 
 
 // Compute alignmentTable from alignmentData.
-// This could be made multithreaded if it becomes a bottleneck.
-void Assembler::computeAlignmentTable()
+// Both passes and the final sort of each section are multithreaded.
+void Assembler::computeAlignmentTable(size_t threadCount)
 {
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    const size_t batchSize = 10000;
     alignmentTable.createNew(largeDataName("AlignmentTable"), largeDataPageSize);
     alignmentTable.beginPass1(ReadId(2 * reads.size()));
-    for(const AlignmentData& ad: alignmentData) {
-        const auto& readIds = ad.readIds;
-        OrientedReadId orientedReadId0(readIds[0], 0);
-        OrientedReadId orientedReadId1(readIds[1], ad.isSameStrand ? 0 : 1);
-        alignmentTable.incrementCount(orientedReadId0.getValue());
-        alignmentTable.incrementCount(orientedReadId1.getValue());
-        orientedReadId0.flipStrand();
-        orientedReadId1.flipStrand();
-        alignmentTable.incrementCount(orientedReadId0.getValue());
-        alignmentTable.incrementCount(orientedReadId1.getValue());
-    }
+    setupLoadBalancing(alignmentData.size(), batchSize);
+    runThreads(&Assembler::computeAlignmentTableThreadFunction1, threadCount);
     alignmentTable.beginPass2();
-    for(uint32_t i=0; i<alignmentData.size(); i++) {
-        const AlignmentData& ad = alignmentData[i];
-        const auto& readIds = ad.readIds;
-        OrientedReadId orientedReadId0(readIds[0], 0);
-        OrientedReadId orientedReadId1(readIds[1], ad.isSameStrand ? 0 : 1);
-        alignmentTable.store(orientedReadId0.getValue(), i);
-        alignmentTable.store(orientedReadId1.getValue(), i);
-        orientedReadId0.flipStrand();
-        orientedReadId1.flipStrand();
-        alignmentTable.store(orientedReadId0.getValue(), i);
-        alignmentTable.store(orientedReadId1.getValue(), i);
-    }
+    setupLoadBalancing(alignmentData.size(), batchSize);
+    runThreads(&Assembler::computeAlignmentTableThreadFunction2, threadCount);
     alignmentTable.endPass2();
 
+    // Sort each section of the alignment table by OrientedReadId.
+    // Pass 2 stores the alignments of each section in an order
+    // that depends on thread scheduling, but sorting
+    // by (OrientedReadId, alignment index) makes the result deterministic.
+    setupLoadBalancing(alignmentTable.size(), 1000);
+    runThreads(&Assembler::computeAlignmentTableThreadFunction3, threadCount);
+}
 
 
-    // Sort each section of the alignment table by OrientedReadId.
+
+void Assembler::computeAlignmentTableThreadFunction1(size_t threadId)
+{
+    computeAlignmentTableThreadFunction12(1);
+}
+void Assembler::computeAlignmentTableThreadFunction2(size_t threadId)
+{
+    computeAlignmentTableThreadFunction12(2);
+}
+void Assembler::computeAlignmentTableThreadFunction12(size_t pass)
+{
+    CZI_ASSERT(pass==1 || pass==2);
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint32_t i=uint32_t(begin); i!=uint32_t(end); i++) {
+            const AlignmentData& ad = alignmentData[i];
+            const auto& readIds = ad.readIds;
+            OrientedReadId orientedReadId0(readIds[0], 0);
+            OrientedReadId orientedReadId1(readIds[1], ad.isSameStrand ? 0 : 1);
+            for(Strand strand=0; strand<2; strand++) {
+                if(pass == 1) {
+                    alignmentTable.incrementCountMultithreaded(orientedReadId0.getValue());
+                    alignmentTable.incrementCountMultithreaded(orientedReadId1.getValue());
+                } else {
+                    alignmentTable.storeMultithreaded(orientedReadId0.getValue(), i);
+                    alignmentTable.storeMultithreaded(orientedReadId1.getValue(), i);
+                }
+                orientedReadId0.flipStrand();
+                orientedReadId1.flipStrand();
+            }
+        }
+    }
+}
+
+
+
+void Assembler::computeAlignmentTableThreadFunction3(size_t threadId)
+{
     vector< pair<OrientedReadId, uint32_t> > v;
-    for(ReadId readId0=0; readId0<reads.size(); readId0++) {
-        for(Strand strand0=0; strand0<2; strand0++) {
-            const OrientedReadId orientedReadId0(readId0, strand0);
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint32_t value=uint32_t(begin); value!=uint32_t(end); value++) {
+            const OrientedReadId orientedReadId0 = OrientedReadId(value);
 
             // Access the section of the alignment table for this oriented read.
             const MemoryAsContainer<uint32_t> alignmentTableSection =
@@ -410,8 +1439,6 @@ void Assembler::computeAlignmentTable()
             }
         }
     }
-
-
 }
 
 
@@ -424,6 +1451,17 @@ void Assembler::accessAlignmentData()
 
 
 
+void Assembler::accessCompressedAlignments()
+{
+    checkAlignmentDataAreOpen();
+    compressedAlignments.accessExistingReadOnly(largeDataName("CompressedAlignments"));
+    if(compressedAlignments.size() != alignmentData.size()) {
+        throw runtime_error("Compressed alignments are inconsistent with alignment data.");
+    }
+}
+
+
+
 void Assembler::checkAlignmentDataAreOpen()
 {
     if(!alignmentData.isOpen || !alignmentTable.isOpen()) {
@@ -504,22 +1542,39 @@ void Assembler::flagPalindromicReads(
     flagPalindromicReadsData.deltaThreshold = deltaThreshold;
 
     // Reset all palindromic flags.
+    // The threads set them in the bit planes, which are then
+    // stored in the read flags.
     const ReadId readCount = ReadId(readFlags.size());
-    for(ReadId readId=0; readId<readCount; readId++) {
-        readFlags[readId].isPalindromic = 0;
-    }
+    readFlagBitplanes.createFromReadFlags(readFlags);
+    readFlagBitplanes.clearAll(ReadFlagBitplanes::isPalindromic);
 
     // Do it in parallel.
+    flagPalindromicReadsData.threadBucketStatistics.resize(threadCount);
     setupLoadBalancing(readCount, 1000);
     runThreads(&Assembler::flagPalindromicReadsThreadFunction, threadCount);
-
-    // Count the reads flagged as palindromic.
-    size_t palindromicReadCount = 0;
-    for(ReadId readId=0; readId<readCount; readId++) {
-        if(readFlags[readId].isPalindromic) {
-            ++palindromicReadCount;
+    readFlagBitplanes.storeToReadFlags(ReadFlagBitplanes::isPalindromic, readFlags);
+
+    // Write timing information for each range of read lengths.
+    cout << "Palindromic read detection by read length:" << endl;
+    for(size_t bucket=0; bucket<FlagPalindromicReadsData::bucketCount; bucket++) {
+        FlagPalindromicReadsData::BucketStatistics statistics;
+        for(const auto& threadBucketStatistics: flagPalindromicReadsData.threadBucketStatistics) {
+            statistics.readCount += threadBucketStatistics[bucket].readCount;
+            statistics.alignmentCount += threadBucketStatistics[bucket].alignmentCount;
+            statistics.seconds += threadBucketStatistics[bucket].seconds;
+        }
+        if(statistics.readCount == 0) {
+            continue;
         }
+        cout << "    Length " << (bucket==0 ? 0 : (uint64_t(1) << bucket)) << " to " <<
+            (uint64_t(1) << (bucket+1)) - 1 << ": " <<
+            statistics.readCount << " reads, " <<
+            statistics.alignmentCount << " alignments computed, " <<
+            statistics.seconds << " s." << endl;
     }
+
+    // Count the reads flagged as palindromic.
+    const size_t palindromicReadCount = readFlagBitplanes.count(ReadFlagBitplanes::isPalindromic);
     cout << timestamp << "Flagged " << palindromicReadCount <<
         " reads as palindromic out of " << readCount << " total." << endl;
     cout << "Palindromic fraction is " <<
@@ -544,10 +1599,11 @@ void Assembler::flagPalindromicReadsThreadFunction(size_t threadId)
 
     // Work areas used inside the loop and defined here
     // to reduce memory allocation activity.
-    AlignmentGraph graph;
-    Alignment alignment;
-    AlignmentInfo alignmentInfo;
-    array<vector<MarkerWithOrdinal>, 2> markersSortedByKmerId;
+    AlignmentWorkspace workspace;
+    array<vector<MarkerWithOrdinal>, 2>& markersSortedByKmerId = workspace.markersSortedByKmerId;
+    AlignmentGraph& graph = workspace.graph;
+    Alignment& alignment = workspace.alignment;
+    AlignmentInfo& alignmentInfo = workspace.alignmentInfo;
 
     // Make local copies of the parameters.
     const uint32_t maxSkip = flagPalindromicReadsData.maxSkip;
@@ -556,26 +1612,45 @@ void Assembler::flagPalindromicReadsThreadFunction(size_t threadId)
     const double nearDiagonalFractionThreshold = flagPalindromicReadsData.nearDiagonalFractionThreshold;
     const uint32_t deltaThreshold = flagPalindromicReadsData.deltaThreshold;
 
+    // Timing statistics for this thread.
+    auto& bucketStatistics = flagPalindromicReadsData.threadBucketStatistics[threadId];
+    fill(bucketStatistics.begin(), bucketStatistics.end(),
+        FlagPalindromicReadsData::BucketStatistics());
+
 
     // Loop over all batches assigned to this thread.
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
-        if((begin%1000000) == 0) {
-            std::lock_guard<std::mutex> lock(mutex);
-            cout << timestamp << begin << "/" << readFlags.size() << endl;
+        if(containsMultiple(begin, end, 1000000)) {
+            ThreadLog::Message() << timestamp << begin << "/" << readFlags.size();
         }
 
         // Loop over all reads in this batch.
         for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            const auto t0 = steady_clock::now();
+            FlagPalindromicReadsData::BucketStatistics& statistics =
+                bucketStatistics[FlagPalindromicReadsData::getBucket(reads[readId].baseCount)];
+            ++statistics.readCount;
 
             // Get markers sorted by KmerId for this read and its reverse complement.
             for(Strand strand=0; strand<2; strand++) {
                 getMarkersSortedByKmerId(OrientedReadId(readId, strand), markersSortedByKmerId[strand]);
             }
 
+            // If the decision is already clear without computing
+            // the alignment, skip it.
+            if(!workspace.prefilter.mayBePalindromic(markersSortedByKmerId, maxMarkerFrequency,
+                alignedFractionThreshold, nearDiagonalFractionThreshold, deltaThreshold)) {
+                statistics.seconds += seconds(steady_clock::now() - t0);
+                continue;
+            }
+
             // Compute a marker alignment of this read versus its reverse complement.
-            alignOrientedReads(markersSortedByKmerId, maxSkip, maxMarkerFrequency, false,
+            ++statistics.alignmentCount;
+            alignOrientedReads(markersSortedByKmerId, maxSkip, maxMarkerFrequency, 0, false,
                 graph, alignment, alignmentInfo);
+            workspace.update();
+            statistics.seconds += seconds(steady_clock::now() - t0);
 
             // If the alignment has too few markers, skip it.
             const size_t alignedMarkerCount = alignment.ordinals.size();
@@ -602,7 +1677,7 @@ void Assembler::flagPalindromicReadsThreadFunction(size_t threadId)
             }
 
             // If we got here, mark the read as palindromic.
-            readFlags[readId].isPalindromic = 1;
+            readFlagBitplanes.set(ReadFlagBitplanes::isPalindromic, readId);
 
         }
     }
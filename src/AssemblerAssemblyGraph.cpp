@@ -1,8 +1,10 @@
 // Shasta.
 #include "Assembler.hpp"
 #include "AssembledSegment.hpp"
+#include "bgzipCompress.hpp"
 #include "LocalAssemblyGraph.hpp"
 #include "orderPairs.hpp"
+#include "ThreadLog.hpp"
 #include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
@@ -14,9 +16,18 @@ using namespace shasta;
 // Standard library.
 #include "chrono.hpp"
 #include "iterator.hpp"
+#include <map>
 #include <numeric>
 #include <queue>
 #include <unordered_map>
+#include <unordered_set>
+
+// Linux, used for output with pwrite.
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // This is needed for mallopt.
 #ifdef __linux__
@@ -33,216 +44,330 @@ using namespace shasta;
 // - assemblyGraph.edgeLists.
 // - assemblyGraph.reverseComplementEdge.
 // - assemblyGraph.markerToAssemblyTable
-void Assembler::createAssemblyGraphEdges()
+// The chains are found in parallel: each thread walks forward
+// the chains that begin at the edges assigned to it.
+// Circular chains have no beginning and are found afterwards,
+// sequentially. Then storeAssemblyGraphChains stores the chains
+// in a canonical order, which does not depend on the number of threads.
+void Assembler::createAssemblyGraphEdges(size_t threadCount)
 {
     // Some shorthands.
-    using VertexId = AssemblyGraph::VertexId;
-    using EdgeId = AssemblyGraph::EdgeId;
+    using EdgeId = MarkerGraph::EdgeId;
+    auto& data = createAssemblyGraphEdgesData;
 
     // Check that we have what we need.
     checkMarkerGraphVerticesAreAvailable();
     checkMarkerGraphEdgesIsOpen();
     const auto& edges = markerGraph.edges;
+    const EdgeId edgeCount = edges.size();
 
-    // Flag to control debug output.
-    const bool debug = false;
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
 
     // Vector used to keep track of marker graph edges that were already found.
-    const EdgeId edgeCount = markerGraph.edges.size();
-    MemoryMapped::Vector<bool> wasFound;
-    wasFound.createNew(
+    // Each edge belongs to a single chain, so each entry is written by one thread only.
+    data.wasFound.createNew(
         largeDataName("tmp-createAssemblyGraphVertices-wasFound"),
         largeDataPageSize);
-    wasFound.resize(edgeCount);
-    fill(wasFound.begin(), wasFound.end(), false);
+    data.wasFound.resize(edgeCount);
+    fill(data.wasFound.begin(), data.wasFound.end(), false);
+
+    // Find the chains that are not circular, in parallel.
+    data.threadChains.clear();
+    data.threadChains.resize(threadCount);
+    setupLoadBalancing(edgeCount, 10000);
+    runThreads(&Assembler::createAssemblyGraphEdgesThreadFunction, threadCount);
+
+    // The edges that were not found belong to circular chains.
+    // Skip the removed edges 64 at a time using the edge flag bitmaps.
+    const auto& edgeFlagBitmaps = markerGraph.edgeFlagBitmaps;
+    const uint64_t wasRemovedMask = MarkerGraphEdgeFlagBitmaps::wasRemovedMask;
+    vector<EdgeId> chain;
+    vector<EdgeId> previousEdges;
+    for(EdgeId startEdgeId=edgeFlagBitmaps.nextUnset(wasRemovedMask, 0, edgeCount);
+        startEdgeId<edgeCount;
+        startEdgeId=edgeFlagBitmaps.nextUnset(wasRemovedMask, startEdgeId+1, edgeCount)) {
+        if(data.wasFound[startEdgeId]) {
+            continue;
+        }
+        const bool isCircularChain =
+            findMarkerGraphPrunedStrongSubgraphChain(startEdgeId, chain, previousEdges);
+        CZI_ASSERT(isCircularChain);
+        for(const EdgeId edgeId: chain) {
+            CZI_ASSERT(!data.wasFound[edgeId]);
+            data.wasFound[edgeId] = true;
+        }
+        data.threadChains.front().add(chain, true, markerGraph.reverseComplementEdge);
+    }
 
-    // Initialize the data structures we are going to fill in.
-    assemblyGraph.edgeLists.createNew(
-        largeDataName("AssemblyGraphEdgeLists"),
-        largeDataPageSize);
-    assemblyGraph.reverseComplementEdge.createNew(
-        largeDataName("AssemblyGraphReverseComplementEdge"), largeDataPageSize);
+    // Check that only and all edges of the cleaned up marker graph
+    // were found.
+    for(EdgeId edgeId=0; edgeId<edgeCount; edgeId++) {
+        if(markerGraph.edgeWasRemoved(edgeId)) {
+            CZI_ASSERT(!data.wasFound[edgeId]);
+        } else {
+            CZI_ASSERT(data.wasFound[edgeId]);
+        }
+    }
+    data.wasFound.remove();
 
+    storeAssemblyGraphChains(threadCount);
+}
 
 
-    // Work vectors reused for each chain.
-    vector<EdgeId> nextEdges;
-    vector<EdgeId> previousEdges;
-    vector<EdgeId> chain;
-    vector<EdgeId> reverseComplementedChain;
 
+// Find the chains that begin at the edges assigned to this thread.
+void Assembler::createAssemblyGraphEdgesThreadFunction(size_t threadId)
+{
+    using EdgeId = MarkerGraph::EdgeId;
+    auto& data = createAssemblyGraphEdgesData;
+    auto& threadChains = data.threadChains[threadId];
+    vector<EdgeId> chain;
+    vector<EdgeId> previousEdges;
 
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(EdgeId startEdgeId=begin; startEdgeId!=end; startEdgeId++) {
 
-    // Main loop over all edges of the marker graph.
-    // At each iteration we find a new linear chain of edges.
-    for(EdgeId startEdgeId=0; startEdgeId<edgeCount; startEdgeId++) {
-        const auto& startEdge = edges[startEdgeId];
+            // If this edge is not part of cleaned up marker graph, skip it.
+            if(markerGraph.edgeWasRemoved(startEdgeId)) {
+                continue;
+            }
 
-        if(debug) {
-            cout << "Working on start edge " << startEdgeId;
-            cout << " " << startEdge.source << "->" << startEdge.target << endl;
-        }
+            // If this edge is not the first edge of a chain, skip it.
+            if(previousEdgeInMarkerGraphPrunedStrongSubgraphChain(startEdgeId) !=
+                MarkerGraph::invalidEdgeId) {
+                continue;
+            }
 
-        // If this edge is not part of cleaned up marker graph, skip it.
-        if(startEdge.wasRemoved()) {
-            if(debug) {
-                cout << "Start edge was removed." << endl;
+            // Walk the chain forward.
+            const bool isCircularChain =
+                findMarkerGraphPrunedStrongSubgraphChain(startEdgeId, chain, previousEdges);
+            CZI_ASSERT(!isCircularChain);
+            CZI_ASSERT(chain.front() == startEdgeId);
+            for(const EdgeId edgeId: chain) {
+                data.wasFound[edgeId] = true;
             }
-            continue;
+            threadChains.add(chain, false, markerGraph.reverseComplementEdge);
         }
+    }
+}
 
-        // If we already found this edge, skip it.
-        // It is part of a chain we already found.
-        if(wasFound[startEdgeId]) {
-            if(debug) {
-                cout << "This edge is part of a chain we already found." << endl;
-            }
-            continue;
+
+
+// Find the linear chain of the pruned strong subgraph
+// of the marker graph that contains a given edge.
+bool Assembler::findMarkerGraphPrunedStrongSubgraphChain(
+    MarkerGraph::EdgeId startEdgeId,
+    vector<MarkerGraph::EdgeId>& chain,
+    vector<MarkerGraph::EdgeId>& previousEdges) const
+{
+    using EdgeId = MarkerGraph::EdgeId;
+    chain.clear();
+    previousEdges.clear();
+
+    // Follow the chain forward.
+    chain.push_back(startEdgeId);
+    EdgeId edgeId = startEdgeId;
+    bool isCircularChain = false;
+    while(true) {
+        edgeId = nextEdgeInMarkerGraphPrunedStrongSubgraphChain(edgeId);
+        if(edgeId == MarkerGraph::invalidEdgeId) {
+            break;
         }
+        if(edgeId == startEdgeId) {
+            isCircularChain = true;
+            break;
+        }
+        chain.push_back(edgeId);
+    }
 
-        // Follow the chain forward.
-        EdgeId edgeId = startEdgeId;
-        bool isCircularChain = false;
+    // Follow the chain backward.
+    if(!isCircularChain) {
+        edgeId = startEdgeId;
         while(true) {
-            edgeId = nextEdgeInMarkerGraphPrunedStrongSubgraphChain(edgeId);
+            edgeId = previousEdgeInMarkerGraphPrunedStrongSubgraphChain(edgeId);
             if(edgeId == MarkerGraph::invalidEdgeId) {
                 break;
             }
-            if(edgeId == startEdgeId) {
-                isCircularChain = true;
-                break;
-            }
-            nextEdges.push_back(edgeId);
+            previousEdges.push_back(edgeId);
         }
-
-        // Follow the chain backward.
-        if(!isCircularChain) {
-            edgeId = startEdgeId;
-            while(true) {
-                edgeId = previousEdgeInMarkerGraphPrunedStrongSubgraphChain(edgeId);
-                if(edgeId == MarkerGraph::invalidEdgeId) {
-                    break;
-                }
-                previousEdges.push_back(edgeId);
-            }
+        if(!previousEdges.empty()) {
+            chain.insert(chain.begin(), previousEdges.rbegin(), previousEdges.rend());
         }
+    }
 
-        // Gather the chain.
-        copy(previousEdges.rbegin(), previousEdges.rend(), back_inserter< vector<EdgeId> >(chain));
-        chain.push_back(startEdgeId);
-        copy(nextEdges.begin(), nextEdges.end(), back_inserter< vector<EdgeId> >(chain));
+    return isCircularChain;
+}
 
-        // Mark all the edges in the chain as found.
-        for(const EdgeId edgeId: chain) {
-            wasFound[edgeId] = true;
-        }
 
-        // Store this chain as a new edge of the assembly graph.
-        const EdgeId chainId = assemblyGraph.edgeLists.size();
-        assemblyGraph.edgeLists.appendVector(chain);
 
-        // Also construct the reverse complemented chain.
-        for(const EdgeId edgeId: chain) {
-        	reverseComplementedChain.push_back(markerGraph.reverseComplementEdge[edgeId]);
-        }
-        std::reverse(reverseComplementedChain.begin(), reverseComplementedChain.end());
+// Add a chain found by one thread, unless it is the reverse complement
+// of a chain that contains a lower edge id.
+// The reverse complemented chains will be recreated when storing.
+// A circular chain is rotated so it begins with its lowest edge id.
+void Assembler::CreateAssemblyGraphEdgesData::ThreadChains::add(
+    vector<MarkerGraph::EdgeId>& chain,
+    bool isCircularChain,
+    const MemoryMapped::Vector<MarkerGraph::EdgeId>& reverseComplementEdge)
+{
+    using EdgeId = MarkerGraph::EdgeId;
 
+    EdgeId lowestEdgeId = MarkerGraph::invalidEdgeId;
+    EdgeId lowestEdgeIdRc = MarkerGraph::invalidEdgeId;
+    for(const EdgeId edgeId: chain) {
+        lowestEdgeId = min(lowestEdgeId, edgeId);
+        lowestEdgeIdRc = min(lowestEdgeIdRc, reverseComplementEdge[edgeId]);
+    }
+    if(lowestEdgeIdRc < lowestEdgeId) {
+        return;
+    }
+    if(isCircularChain) {
+        std::rotate(chain.begin(), find(chain.begin(), chain.end(), lowestEdgeId), chain.end());
+    }
 
+    Chain c;
+    c.lowestEdgeId = lowestEdgeId;
+    c.begin = edges.size();
+    c.end = c.begin + chain.size();
+    c.isSelfComplementary = (lowestEdgeIdRc == lowestEdgeId);
+    chains.push_back(c);
+    edges.insert(edges.end(), chain.begin(), chain.end());
+}
 
-        // Figure out if the reverse complemented chain is the same
-        // as the original chain. This can happen in exceptional cases.
-        bool isSelfComplementary = false;
-        if(!isCircularChain) {
-        	isSelfComplementary = (chain == reverseComplementedChain);
-        } else {
 
-        	// For a circular chain the test is more complex.
-        	// We check if the reverse complement of the first edge
-        	// is in the chain.
-        	isSelfComplementary =
-        		find(chain.begin(), chain.end(), reverseComplementedChain.front()) != chain.end();
+
+// Store the chains found by all threads as edges of the assembly graph.
+// Each pair of reverse complemented chains is stored in order of the lowest
+// marker graph edge id it contains, with the chain containing that edge first.
+// If a chain is self-complementary, it is stored only once.
+// This is the order in which a sequential scan of the marker graph edges
+// would find the chains, so the result does not depend on how they were found.
+// This creates:
+// - assemblyGraph.edgeLists.
+// - assemblyGraph.reverseComplementEdge.
+// - assemblyGraph.markerToAssemblyTable
+void Assembler::storeAssemblyGraphChains(size_t threadCount)
+{
+    using EdgeId = AssemblyGraph::EdgeId;
+    auto& data = createAssemblyGraphEdgesData;
+
+    // Gather the chains found by all threads and sort them.
+    data.chains.clear();
+    for(uint64_t threadId=0; threadId<data.threadChains.size(); threadId++) {
+        const auto& threadChains = data.threadChains[threadId];
+        for(uint64_t i=0; i<threadChains.chains.size(); i++) {
+            data.chains.push_back(make_pair(threadChains.chains[i].lowestEdgeId, make_pair(threadId, i)));
         }
-        if(isSelfComplementary) {
-        	cout << "Found a self-complementary chain." << endl;
+    }
+    sort(data.chains.begin(), data.chains.end());
+
+    // Assign assembly graph edge ids. Each chain gets two,
+    // one for itself and one for its reverse complement,
+    // unless it is self-complementary.
+    data.firstAssemblyGraphEdgeId.resize(data.chains.size());
+    EdgeId assemblyGraphEdgeCount = 0;
+    for(uint64_t i=0; i<data.chains.size(); i++) {
+        data.firstAssemblyGraphEdgeId[i] = assemblyGraphEdgeCount;
+        const auto& chain = data.getChain(i);
+        if(chain.isSelfComplementary) {
+            cout << "Found a self-complementary chain." << endl;
+            ++assemblyGraphEdgeCount;
+        } else {
+            assemblyGraphEdgeCount += 2;
         }
+    }
 
-
-        // Store the reverse complemented chain, if different from the original one.
-        // Also update assemblyGraph.reverseComplementEdge.
-        if(isSelfComplementary) {
-        	assemblyGraph.reverseComplementEdge.push_back(chainId);
+    // Store the chains and their reverse complements, in parallel.
+    assemblyGraph.edgeLists.createNew(
+        largeDataName("AssemblyGraphEdgeLists"),
+        largeDataPageSize);
+    assemblyGraph.reverseComplementEdge.createNew(
+        largeDataName("AssemblyGraphReverseComplementEdge"), largeDataPageSize);
+    assemblyGraph.reverseComplementEdge.resize(assemblyGraphEdgeCount);
+    assemblyGraph.edgeLists.beginPass1(assemblyGraphEdgeCount);
+    for(uint64_t i=0; i<data.chains.size(); i++) {
+        const auto& chain = data.getChain(i);
+        const EdgeId edgeId = data.firstAssemblyGraphEdgeId[i];
+        const uint64_t chainLength = chain.end - chain.begin;
+        assemblyGraph.edgeLists.incrementCount(edgeId, chainLength);
+        if(chain.isSelfComplementary) {
+            assemblyGraph.reverseComplementEdge[edgeId] = edgeId;
         } else {
-            for(const EdgeId edgeId: reverseComplementedChain) {
-#if 0
-            	if(wasFound[edgeId]) {
-            		cout << "****** " << edgeId << " " << markerGraph.edges[edgeId].source <<
-            			" " << markerGraph.edges[edgeId].target <<endl;
-            		CZI_ASSERT(chain.size() == reverseComplementedChain.size());
-            		for(size_t i=0; i<chain.size(); i++) {
-            			cout << i << " " << chain[i] << " " << reverseComplementedChain[i];
-            			cout << " " << int(wasFound[chain[i]]) << " " <<
-            					int(wasFound[reverseComplementedChain[i]]) << endl;
-            		}
-            	}
-#endif
-            	CZI_ASSERT(!wasFound[edgeId]);
-                wasFound[edgeId] = true;
-            }
-            assemblyGraph.edgeLists.appendVector(reverseComplementedChain);
-        	assemblyGraph.reverseComplementEdge.push_back(chainId+1);
-        	assemblyGraph.reverseComplementEdge.push_back(chainId);
-
-#if 0
-        	cout << "Chain " << chain.front() << "..." << chain.back();
-            cout << ", reverse complement " << reverseComplementedChain.front() <<
-            		"..." << reverseComplementedChain.back() << endl;
-#endif
+            assemblyGraph.edgeLists.incrementCount(edgeId + 1, chainLength);
+            assemblyGraph.reverseComplementEdge[edgeId] = edgeId + 1;
+            assemblyGraph.reverseComplementEdge[edgeId + 1] = edgeId;
         }
-
-
-
-        // Cleanup.
-        nextEdges.clear();
-        previousEdges.clear();
-        chain.clear();
-        reverseComplementedChain.clear();
     }
+    assemblyGraph.edgeLists.beginPass2();
+    assemblyGraph.edgeLists.endPass2(false);
+    setupLoadBalancing(data.chains.size(), 1000);
+    runThreads(&Assembler::storeAssemblyGraphChainsThreadFunction, threadCount);
+
+    // Clean up.
+    data.threadChains.clear();
+    data.chains.clear();
+    data.chains.shrink_to_fit();
+    data.firstAssemblyGraphEdgeId.clear();
+    data.firstAssemblyGraphEdgeId.shrink_to_fit();
+
+    createMarkerToAssemblyTable(threadCount);
+}
 
 
 
-    // Check that only and all edges of the cleaned up marker graph
-    // were found.
-    for(EdgeId edgeId=0; edgeId<edgeCount; edgeId++) {
-        const auto& edge = markerGraph.edges[edgeId];
-        if(edge.wasRemoved()) {
-            CZI_ASSERT(!wasFound[edgeId]);
-        } else {
-            CZI_ASSERT(wasFound[edgeId]);
+void Assembler::storeAssemblyGraphChainsThreadFunction(size_t threadId)
+{
+    using EdgeId = AssemblyGraph::EdgeId;
+    auto& data = createAssemblyGraphEdgesData;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const auto& chain = data.getChain(i);
+            const auto& threadEdges = data.threadChains[data.chains[i].second.first].edges;
+            const EdgeId* chainBegin = threadEdges.data() + chain.begin;
+            const EdgeId* chainEnd = threadEdges.data() + chain.end;
+            const EdgeId edgeId = data.firstAssemblyGraphEdgeId[i];
+
+            // Store the chain.
+            copy(chainBegin, chainEnd, assemblyGraph.edgeLists.begin(edgeId));
+
+            // Store the reverse complemented chain.
+            if(!chain.isSelfComplementary) {
+                EdgeId* p = assemblyGraph.edgeLists.end(edgeId + 1);
+                for(const EdgeId* q=chainBegin; q!=chainEnd; ++q) {
+                    *(--p) = markerGraph.reverseComplementEdge[*q];
+                }
+            }
         }
     }
+}
 
-    wasFound.remove();
-
-    // cout << "The assembly graph has " << assemblyGraph.edgeLists.size() << " edges." << endl;
 
 
+// Create the markerToAssemblyTable and write a histogram of chain lengths.
+// The table is filled in parallel in two passes:
+// the first one initializes all entries, and the second one
+// stores the entries of the marker graph edges of each chain.
+// Each marker graph edge belongs to at most one chain,
+// so the threads never write to the same entry.
+void Assembler::createMarkerToAssemblyTable(size_t threadCount)
+{
+    using EdgeId = AssemblyGraph::EdgeId;
+    const auto& edges = markerGraph.edges;
 
     // Create the markerToAssemblyTable.
     assemblyGraph.markerToAssemblyTable.createNew(
         largeDataName("MarkerToAssemblyTable"),
         largeDataPageSize);
     assemblyGraph.markerToAssemblyTable.resize(edges.size());
-    fill(
-        assemblyGraph.markerToAssemblyTable.begin(),
-        assemblyGraph.markerToAssemblyTable.end(),
-        make_pair(std::numeric_limits<VertexId>::max(), 0));
-    for(EdgeId assemblyGraphEdgeId=0; assemblyGraphEdgeId<assemblyGraph.edgeLists.size(); assemblyGraphEdgeId++) {
-        const MemoryAsContainer<EdgeId> chain = assemblyGraph.edgeLists[assemblyGraphEdgeId];
-        for(uint32_t position=0; position!=chain.size(); position++) {
-            const EdgeId markerGraphEdgeId = chain[position];
-            assemblyGraph.markerToAssemblyTable[markerGraphEdgeId] = make_pair(assemblyGraphEdgeId, position);
-        }
-    }
+    setupLoadBalancing(edges.size(), 1000000);
+    runThreads(&Assembler::createMarkerToAssemblyTableThreadFunction1, threadCount);
+    setupLoadBalancing(assemblyGraph.edgeLists.size(), 1000);
+    runThreads(&Assembler::createMarkerToAssemblyTableThreadFunction2, threadCount);
 
 
 
@@ -267,6 +392,140 @@ void Assembler::createAssemblyGraphEdges()
 
 
 
+void Assembler::createMarkerToAssemblyTableThreadFunction1(size_t threadId)
+{
+    using Entry = AssemblyGraph::MarkerToAssemblyEntry;
+    auto& markerToAssemblyTable = assemblyGraph.markerToAssemblyTable;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        fill(markerToAssemblyTable.begin() + begin, markerToAssemblyTable.begin() + end, Entry());
+    }
+}
+
+
+
+void Assembler::createMarkerToAssemblyTableThreadFunction2(size_t threadId)
+{
+    using EdgeId = AssemblyGraph::EdgeId;
+    using Entry = AssemblyGraph::MarkerToAssemblyEntry;
+    auto& markerToAssemblyTable = assemblyGraph.markerToAssemblyTable;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(EdgeId assemblyGraphEdgeId=begin; assemblyGraphEdgeId!=end; assemblyGraphEdgeId++) {
+            const MemoryAsContainer<EdgeId> chain = assemblyGraph.edgeLists[assemblyGraphEdgeId];
+            for(uint64_t position=0; position!=chain.size(); position++) {
+                const EdgeId markerGraphEdgeId = chain[position];
+                markerToAssemblyTable[markerGraphEdgeId] = Entry(assemblyGraphEdgeId, position);
+            }
+        }
+    }
+}
+
+
+
+// Recreate the assembly graph edges after some marker graph edges
+// were removed from the pruned strong subgraph.
+// This requires the assembly graph created before the edges were removed.
+// The only marker graph vertices whose in-degree or out-degree changed
+// are the endpoints of the removed edges, so a chain of the existing
+// assembly graph is still a maximal chain, and can be reused without
+// walking it again, if none of its edges were removed and neither of its
+// end vertices is an endpoint of a removed edge.
+// The other chains are found again by walking the marker graph.
+// To obtain exactly the same result as createAssemblyGraphEdges,
+// each pair of reverse complemented chains is then stored
+// in order of the lowest marker graph edge id it contains,
+// with the chain containing that edge first.
+void Assembler::updateAssemblyGraphEdges(size_t threadCount)
+{
+    using VertexId = MarkerGraph::VertexId;
+    using EdgeId = MarkerGraph::EdgeId;
+    const auto& edges = markerGraph.edges;
+
+    CZI_ASSERT(assemblyGraph.edgeLists.isOpen());
+    checkMarkerGraphEdgesIsOpen();
+
+    // Find the chains that were affected by the removal of marker graph edges,
+    // and the endpoints of the removed edges.
+    vector<bool> isAffected(assemblyGraph.edgeLists.size(), false);
+    std::unordered_set<VertexId> affectedVertices;
+    for(uint64_t i=0; i<assemblyGraph.edgeLists.size(); i++) {
+        for(const EdgeId edgeId: assemblyGraph.edgeLists[i]) {
+            if(markerGraph.edgeWasRemoved(edgeId)) {
+                const MarkerGraph::Edge& edge = edges[edgeId];
+                isAffected[i] = true;
+                affectedVertices.insert(edge.source);
+                affectedVertices.insert(edge.target);
+            }
+        }
+    }
+    for(uint64_t i=0; i<assemblyGraph.edgeLists.size(); i++) {
+        if(isAffected[i]) {
+            continue;
+        }
+        auto chain = assemblyGraph.edgeLists[i];
+        if(affectedVertices.count(edges[chain.front()].source) ||
+            affectedVertices.count(edges[chain.back()].target)) {
+            isAffected[i] = true;
+        }
+    }
+
+
+
+    // Gather the chains we keep, and the start edges of chains that
+    // have to be found again, then remove the old assembly graph.
+    auto& data = createAssemblyGraphEdgesData;
+    data.threadChains.clear();
+    data.threadChains.resize(1);
+    auto& chains = data.threadChains.front();
+    vector<EdgeId> chain;
+    vector<EdgeId> startEdges;
+    uint64_t reusedChainCount = 0;
+    for(uint64_t i=0; i<assemblyGraph.edgeLists.size(); i++) {
+        auto oldChain = assemblyGraph.edgeLists[i];
+        if(isAffected[i]) {
+            for(const EdgeId edgeId: oldChain) {
+                if(!markerGraph.edgeWasRemoved(edgeId)) {
+                    startEdges.push_back(edgeId);
+                }
+            }
+        } else {
+            const bool isCircularChain =
+                nextEdgeInMarkerGraphPrunedStrongSubgraphChain(oldChain.back()) == oldChain.front();
+            chain.assign(oldChain.begin(), oldChain.end());
+            chains.add(chain, isCircularChain, markerGraph.reverseComplementEdge);
+            ++reusedChainCount;
+        }
+    }
+    const uint64_t oldChainCount = assemblyGraph.edgeLists.size();
+    assemblyGraph.remove();
+
+    // Find again the affected chains.
+    std::unordered_set<EdgeId> wasFound;
+    vector<EdgeId> previousEdges;
+    uint64_t newChainCount = 0;
+    for(const EdgeId startEdgeId: startEdges) {
+        if(wasFound.count(startEdgeId)) {
+            continue;
+        }
+        const bool isCircularChain =
+            findMarkerGraphPrunedStrongSubgraphChain(startEdgeId, chain, previousEdges);
+        wasFound.insert(chain.begin(), chain.end());
+        chains.add(chain, isCircularChain, markerGraph.reverseComplementEdge);
+        ++newChainCount;
+    }
+    cout << timestamp << "Updating the assembly graph edges: reused " << reusedChainCount <<
+        " of " << oldChainCount << " chains and found " << newChainCount <<
+        " chains again." << endl;
+
+    // Store them.
+    storeAssemblyGraphChains(threadCount);
+}
+
+
+
 void Assembler::accessAssemblyGraphVertices()
 {
     assemblyGraph.vertices.accessExistingReadOnly(
@@ -446,7 +705,11 @@ void Assembler::accessAssemblyGraphEdges()
 
 void Assembler::writeAssemblyGraph(const string& fileName) const
 {
-    cout << "The assembly graph has " <<
+    writeAssemblyGraph(fileName, cout);
+}
+void Assembler::writeAssemblyGraph(const string& fileName, ostream& out) const
+{
+    out << "The assembly graph has " <<
         assemblyGraph.vertices.size() << " vertices and " <<
         assemblyGraph.edges.size() << " edges." << endl;
     assemblyGraph.writeGraphviz(fileName);
@@ -485,6 +748,29 @@ void Assembler::assemble(size_t threadCount)
     setupLoadBalancing(assemblyGraph.edgeLists.size(), 1);
     runThreads(&Assembler::assembleThreadFunction, threadCount);
 
+    // Store the assembly results found by each thread.
+    const uint64_t assembledEdgeCount = storeAssembledSequences(threadCount);
+
+    // Clean up the results stored by each thread.
+    assembleData.free();
+
+    // Compute the total number of bases assembled.
+    size_t totalBaseCount = 0;
+    for(AssemblyGraph::EdgeId edgeId=0; edgeId<assemblyGraph.repeatCounts.size(); edgeId++) {
+        totalBaseCount += assemblyGraph.repeatCounts.rawSize(edgeId);
+    }
+    cout << timestamp << "Assembled a total " << totalBaseCount <<
+        " bases for " << assemblyGraph.edgeLists.size() << " assembly graph edges of which " <<
+        assembledEdgeCount << " where assembled." << endl;
+}
+
+
+
+// Store in assemblyGraph.sequences and assemblyGraph.repeatCounts
+// the assembly results stored by each thread in assembleData.
+// Returns the number of assembled edges.
+uint64_t Assembler::storeAssembledSequences(size_t threadCount)
+{
     // Find the pair(thread, index in thread) that the assembly for each edge is stored in.
     const auto uninitializedPair = make_pair(
         std::numeric_limits<size_t>::max(),
@@ -505,7 +791,7 @@ void Assembler::assemble(size_t threadCount)
     for(AssemblyGraph::EdgeId edgeId=0; edgeId<assemblyGraph.edgeLists.size(); edgeId++) {
         if(!assemblyGraph.isAssembledEdge(edgeId)) {
             assemblyGraph.sequences.append(0);
-            assemblyGraph.repeatCounts.appendVector();
+            assemblyGraph.repeatCounts.appendEmpty();
             continue;
         }
         ++assembledEdgeCount;
@@ -524,24 +810,10 @@ void Assembler::assemble(size_t threadCount)
         MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& threadRepeatCounts =
             *(assembleData.repeatCounts[threadId]);
         const MemoryAsContainer<uint8_t> vertexRepeatCounts = threadRepeatCounts[i];
-        assemblyGraph.repeatCounts.appendVector();
-        for(uint8_t r: vertexRepeatCounts) {
-            assemblyGraph.repeatCounts.append(r);
-        }
+        assemblyGraph.repeatCounts.append(vertexRepeatCounts.begin(), vertexRepeatCounts.end());
     }
 
-
-    // Clean up the results stored by each thread.
-    assembleData.free();
-
-    // Compute the total number of bases assembled.
-    size_t totalBaseCount = 0;
-    for(size_t i=0; i<assemblyGraph.repeatCounts.totalSize(); i++) {
-        totalBaseCount += assemblyGraph.repeatCounts.begin()[i];
-    }
-    cout << timestamp << "Assembled a total " << totalBaseCount <<
-        " bases for " << assemblyGraph.edgeLists.size() << " assembly graph edges of which " <<
-        assembledEdgeCount << " where assembled." << endl;
+    return assembledEdgeCount;
 }
 
 
@@ -550,15 +822,7 @@ void Assembler::assembleThreadFunction(size_t threadId)
 {
 
     // Initialize data structures for this thread.
-    vector<AssemblyGraph::EdgeId>& edges = assembleData.edges[threadId];
-
-    assembleData.sequences[threadId] = make_shared<LongBaseSequences>();
-    LongBaseSequences& sequences = *(assembleData.sequences[threadId]);
-    sequences.createNew(largeDataName("tmp-Sequences-" + to_string(threadId)), largeDataPageSize);
-
-    assembleData.repeatCounts[threadId] = make_shared<MemoryMapped::VectorOfVectors<uint8_t, uint64_t> >();
-    MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& repeatCounts = *(assembleData.repeatCounts[threadId]);
-    repeatCounts.createNew(largeDataName("tmp-RepeatCounts-" + to_string(threadId)), largeDataPageSize);
+    createAssembleThreadData(threadId);
 
     AssembledSegment assembledSegment;
 
@@ -572,32 +836,375 @@ void Assembler::assembleThreadFunction(size_t threadId)
             try {
                 assembleAssemblyGraphEdge(edgeId, false, assembledSegment);
             } catch(std::exception e) {
-                std::lock_guard<std::mutex> lock(mutex);
-                cout << timestamp << "Thread " << threadId <<
-                    " threw a standard exception while processing assembly graph edge " << edgeId << ":" << endl;
-                cout << e.what() << endl;
+                ThreadLog::Message(ThreadLog::Level::error) << timestamp << "Thread " << threadId <<
+                    " threw a standard exception while processing assembly graph edge " << edgeId << ":\n" <<
+                    e.what();
                 throw;
             } catch(...) {
-                std::lock_guard<std::mutex> lock(mutex);
-                cout << timestamp << "Thread " << threadId <<
-                    " threw a non-standard exception while processing assembly graph edge " << edgeId << endl;
+                ThreadLog::Message(ThreadLog::Level::error) << timestamp << "Thread " << threadId <<
+                    " threw a non-standard exception while processing assembly graph edge " << edgeId;
                 throw;
             }
 
-            // Store the edge id.
-            edges.push_back(edgeId);
+            storeAssembledSegment(threadId, edgeId, assembledSegment);
+        }
+    }
+
+}
+
+
+
+// Create the data structures used by a thread to store
+// the assembly results in assembleData.
+void Assembler::createAssembleThreadData(size_t threadId)
+{
+    assembleData.sequences[threadId] = make_shared<LongBaseSequences>();
+    LongBaseSequences& sequences = *(assembleData.sequences[threadId]);
+    sequences.createNew(largeDataName("tmp-Sequences-" + to_string(threadId)), largeDataPageSize);
+
+    assembleData.repeatCounts[threadId] = make_shared<MemoryMapped::VectorOfVectors<uint8_t, uint64_t> >();
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& repeatCounts = *(assembleData.repeatCounts[threadId]);
+    repeatCounts.createNew(largeDataName("tmp-RepeatCounts-" + to_string(threadId)), largeDataPageSize);
+}
+
+
+
+// Store the assembly result for an edge in the data of this thread.
+void Assembler::storeAssembledSegment(
+    size_t threadId,
+    AssemblyGraph::EdgeId edgeId,
+    const AssembledSegment& assembledSegment)
+{
+    // Store the edge id.
+    assembleData.edges[threadId].push_back(edgeId);
+
+    // Store the sequence.
+    assembleData.sequences[threadId]->append(assembledSegment.runLengthSequence);
+
+    // Store the repeat counts.
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& repeatCounts = *(assembleData.repeatCounts[threadId]);
+    repeatCounts.appendVector();
+    for(const uint32_t r: assembledSegment.repeatCounts) {
+        repeatCounts.append(uint8_t(min(uint32_t(255), r)));
+    }
+}
+
+
+
+// Append a FASTA record for an assembled edge.
+// The sequence and the repeat counts can be stored
+// in assemblyGraph or still in memory during assembly.
+template<class Sequence, class RepeatCounts> void Assembler::appendFastaRecord(
+    AssemblyGraph::EdgeId edgeId,
+    const Sequence& sequence,
+    const RepeatCounts& repeatCounts,
+    string& fasta)
+{
+    // The length, to be written in the header.
+    size_t length = 0;
+    for(const uint8_t r: repeatCounts) {
+        length += r;
+    }
+
+    fasta += ">";
+    fasta += to_string(edgeId);
+    fasta += " length ";
+    fasta += to_string(length);
+    fasta += "\n";
+    fasta.reserve(fasta.size() + length + 1);
+    for(size_t i=0; i<repeatCounts.size(); i++) {
+        fasta.append(repeatCounts[i], sequence[i].character());
+    }
+    fasta += "\n";
+}
+
+
+
+// Append a GFA segment record for an assembled edge.
+template<class Sequence, class RepeatCounts> void Assembler::appendGfa1SegmentRecord(
+    AssemblyGraph::EdgeId edgeId,
+    const Sequence& sequence,
+    const RepeatCounts& repeatCounts,
+    string& gfa)
+{
+    gfa += "S\t";
+    gfa += to_string(edgeId);
+    gfa += "\t";
+    for(size_t i=0; i<repeatCounts.size(); i++) {
+        gfa.append(repeatCounts[i], sequence[i].character());
+    }
+    gfa += "\n";
+}
+
+
+
+// Fused version of assemble, writeFasta, and writeGfa1.
+// See Assembler.hpp for more information.
+void Assembler::assembleAndWrite(
+    const string& fastaFileName,
+    const string& gfaFileName,
+    bool storeSequences,
+    size_t threadCount)
+{
+
+    // Check that we have what we need.
+    checkKmersAreOpen();
+    checkReadsAreOpen();
+    checkMarkersAreOpen();
+    checkMarkerGraphVerticesAreAvailable();
+    checkMarkerGraphEdgesIsOpen();
+    CZI_ASSERT(assemblyGraph.edgeLists.isOpen());
+    const uint64_t edgeCount = assemblyGraph.edgeLists.size();
+    const size_t k = assemblerInfo->k;
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    cout << "Using " << threadCount << " threads." << endl;
+
+    // Store what the threads need.
+    AssembleAndWriteData& data = assembleAndWriteData;
+    data.storeSequences = storeSequences;
+    data.fileNames = {fastaFileName, gfaFileName};
+    data.pendingChunks.clear();
+    data.nextChunkId = 0;
+    data.edgeEnds.resize(2 * k * edgeCount);
+    computeAssemblyStatisticsData.gcCount.assign(edgeCount, 0);
+    computeAssemblyStatisticsData.rawLength.assign(edgeCount, 0);
+    if(storeSequences) {
+        assembleData.allocate(threadCount);
+    }
+
+    // Open the output files and write the GFA header.
+    for(size_t i=0; i<2; i++) {
+        const string& fileName = data.fileNames[i];
+        data.bgzip[i] =
+            fileName.size() >= 3 &&
+            fileName.substr(fileName.size() - 3) == ".gz";
+        data.fileDescriptors[i] = ::open(fileName.c_str(),
+            O_CREAT | O_TRUNC | O_WRONLY,
+            S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if(data.fileDescriptors[i] == -1) {
+            if(i == 1) {
+                ::close(data.fileDescriptors[0]);
+            }
+            throw runtime_error("Error opening " + fileName + ": " + strerror(errno));
+        }
+    }
+    const string gfaHeader = "H\tVN:Z:1.0\n";
+    array<string, 2> headerBuffers;
+    if(data.bgzip[1]) {
+        bgzipCompress(gfaHeader.data(), gfaHeader.data() + gfaHeader.size(), headerBuffers[1]);
+    } else {
+        headerBuffers[1] = gfaHeader;
+    }
+
+    // Attempt to reduce memory fragmentation.
+#ifdef __linux__
+    mallopt(M_MMAP_THRESHOLD, 16*1024);
+#endif
+
+    // Do all the assemblies, writing the FASTA records
+    // and the GFA segment records as we go.
+    // The batches are handed out in order, so few chunks
+    // have to wait for a previous chunk before being written.
+    cout << timestamp << "Assembly begins for " << edgeCount <<
+        " edges of the assembly graph." << endl;
+    const uint64_t chunkCount = (edgeCount + data.chunkSize - 1) / data.chunkSize;
+    try {
+        for(size_t i=0; i<2; i++) {
+            writeAll(data.fileDescriptors[i], headerBuffers[i], data.fileNames[i]);
+        }
+        setupLoadBalancing(chunkCount, 1);
+        runThreads(&Assembler::assembleAndWriteThreadFunction, threadCount);
+        CZI_ASSERT(data.nextChunkId == chunkCount);
+        CZI_ASSERT(data.pendingChunks.empty());
+    } catch(...) {
+        for(size_t i=0; i<2; i++) {
+            ::close(data.fileDescriptors[i]);
+        }
+        data.pendingChunks.clear();
+        throw;
+    }
+
+    // Finish the FASTA file.
+    if(data.bgzip[0]) {
+        string eofBlock;
+        bgzipAppendEofBlock(eofBlock);
+        writeAll(data.fileDescriptors[0], eofBlock, data.fileNames[0]);
+    }
+    for(size_t i=0; i<2; i++) {
+        ::close(data.fileDescriptors[i]);
+    }
+    cout << timestamp << "Wrote " << fastaFileName << endl;
+
+    // Store the assembled sequences, if requested.
+    if(storeSequences) {
+        storeAssembledSequences(threadCount);
+        assembleData.free();
+    }
+
+    // Append the GFA link records, one item for each vertex.
+    writeAssemblyOutput(
+        gfaFileName,
+        "",
+        assemblyGraph.vertices.size(),
+        &Assembler::writeGfa1LinkRecords,
+        threadCount,
+        true);
+    data.edgeEnds.clear();
+    data.edgeEnds.shrink_to_fit();
+    cout << timestamp << "Wrote " << gfaFileName << endl;
+
+    // Compute the total number of bases assembled.
+    // The statistics collected during assembly
+    // are used by computeAssemblyStatistics.
+    computeAssemblyStatisticsData.isAvailable = true;
+    uint64_t totalBaseCount = 0;
+    uint64_t assembledEdgeCount = 0;
+    for(AssemblyGraph::EdgeId edgeId=0; edgeId<edgeCount; edgeId++) {
+        if(assemblyGraph.isAssembledEdge(edgeId)) {
+            ++assembledEdgeCount;
+            totalBaseCount += computeAssemblyStatisticsData.rawLength[edgeId];
+        }
+    }
+    cout << timestamp << "Assembled a total " << totalBaseCount <<
+        " bases for " << edgeCount << " assembly graph edges of which " <<
+        assembledEdgeCount << " where assembled." << endl;
+}
+
+
+
+void Assembler::assembleAndWriteThreadFunction(size_t threadId)
+{
+    AssembleAndWriteData& data = assembleAndWriteData;
+    const uint64_t edgeCount = assemblyGraph.edgeLists.size();
+    const size_t k = assemblerInfo->k;
+    if(data.storeSequences) {
+        createAssembleThreadData(threadId);
+    }
+
+    AssembledSegment assembledSegment;
+    vector<uint8_t> repeatCounts;
+    array<string, 2> text;
+    array<string, 2> buffers;
+
+    // Loop over chunks allocated to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t chunkId=begin; chunkId!=end; chunkId++) {
+            const AssemblyGraph::EdgeId edgeBegin = chunkId * data.chunkSize;
+            const AssemblyGraph::EdgeId edgeEnd = min(edgeCount, edgeBegin + data.chunkSize);
+            for(size_t i=0; i<2; i++) {
+                text[i].clear();
+                buffers[i].clear();
+            }
+
+            for(AssemblyGraph::EdgeId edgeId=edgeBegin; edgeId!=edgeEnd; edgeId++) {
+                if(!assemblyGraph.isAssembledEdge(edgeId)) {
+                    continue;
+                }
+                try {
+                    assembleAssemblyGraphEdge(edgeId, false, assembledSegment);
+                } catch(const std::exception& e) {
+                    ThreadLog::Message(ThreadLog::Level::error) << timestamp << "Thread " << threadId <<
+                        " threw a standard exception while processing assembly graph edge " << edgeId << ":\n" <<
+                        e.what();
+                    throw;
+                } catch(...) {
+                    ThreadLog::Message(ThreadLog::Level::error) << timestamp << "Thread " << threadId <<
+                        " threw a non-standard exception while processing assembly graph edge " << edgeId;
+                    throw;
+                }
 
-            // Store the sequence.
-            sequences.append(assembledSegment.runLengthSequence);
+                // The repeat counts as stored by assemble.
+                repeatCounts.clear();
+                for(const uint32_t r: assembledSegment.repeatCounts) {
+                    repeatCounts.push_back(uint8_t(min(uint32_t(255), r)));
+                }
+                const vector<Base>& sequence = assembledSegment.runLengthSequence;
+                CZI_ASSERT(sequence.size() == repeatCounts.size());
+                CZI_ASSERT(repeatCounts.size() >= k);
+
+                // Format the FASTA record and the GFA segment record.
+                appendFastaRecord(edgeId, sequence, repeatCounts, text[0]);
+                appendGfa1SegmentRecord(edgeId, sequence, repeatCounts, text[1]);
+
+                // Collect the statistics used by computeAssemblyStatistics.
+                uint64_t rawLength = 0;
+                uint64_t gcCount = 0;
+                for(size_t i=0; i<sequence.size(); i++) {
+                    rawLength += repeatCounts[i];
+                    if(sequence[i].value == 1 || sequence[i].value == 2) {    // C or G
+                        gcCount += repeatCounts[i];
+                    }
+                }
+                computeAssemblyStatisticsData.rawLength[edgeId] = rawLength;
+                computeAssemblyStatisticsData.gcCount[edgeId] = gcCount;
 
-            // Store the repeat counts.
-            repeatCounts.appendVector();
-            for(const uint32_t r: assembledSegment.repeatCounts) {
-                repeatCounts.append(uint8_t(min(uint32_t(255), r)));
+                // Store the repeat counts at the ends, used for the GFA links.
+                uint8_t* edgeEnds = data.edgeEnds.data() + 2 * k * edgeId;
+                copy(repeatCounts.begin(), repeatCounts.begin() + k, edgeEnds);
+                copy(repeatCounts.end() - k, repeatCounts.end(), edgeEnds + k);
+
+                if(data.storeSequences) {
+                    storeAssembledSegment(threadId, edgeId, assembledSegment);
+                }
             }
+
+            // Compress, if necessary, and hand over to the ordered writer.
+            for(size_t i=0; i<2; i++) {
+                if(data.bgzip[i]) {
+                    bgzipCompress(text[i].data(), text[i].data() + text[i].size(), buffers[i]);
+                } else {
+                    buffers[i].swap(text[i]);
+                }
+            }
+            assembleAndWriteChunk(chunkId, buffers);
+        }
+    }
+}
+
+
+
+// Ordered writer used by assembleAndWrite.
+// Store the buffers of a chunk, then write, in order,
+// all chunks that are ready to be written.
+// The thread that completes the next chunk to be written
+// does the writing for the chunks that were waiting for it.
+void Assembler::assembleAndWriteChunk(uint64_t chunkId, array<string, 2>& buffers)
+{
+    AssembleAndWriteData& data = assembleAndWriteData;
+    std::lock_guard<std::mutex> lock(data.mutex);
+    data.pendingChunks[chunkId].swap(buffers);
+    while(!data.pendingChunks.empty() && data.pendingChunks.begin()->first == data.nextChunkId) {
+        array<string, 2>& chunkBuffers = data.pendingChunks.begin()->second;
+        for(size_t i=0; i<2; i++) {
+            writeAll(data.fileDescriptors[i], chunkBuffers[i], data.fileNames[i]);
         }
+        data.pendingChunks.erase(data.pendingChunks.begin());
+        ++data.nextChunkId;
     }
+}
 
+
+
+void Assembler::writeAll(int fileDescriptor, const string& buffer, const string& fileName)
+{
+    size_t writtenCount = 0;
+    while(writtenCount < buffer.size()) {
+        const ssize_t n = ::write(fileDescriptor,
+            buffer.data() + writtenCount,
+            buffer.size() - writtenCount);
+        if(n == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Error writing " + fileName + ": " + strerror(errno));
+        }
+        writtenCount += size_t(n);
+    }
 }
 
 
@@ -636,7 +1243,7 @@ void Assembler::accessAssemblyGraphSequences()
 
 
 
-void Assembler::computeAssemblyStatistics()
+void Assembler::computeAssemblyStatistics(size_t threadCount)
 {
 
     using EdgeId = AssemblyGraph::EdgeId;
@@ -646,15 +1253,40 @@ void Assembler::computeAssemblyStatistics()
     const size_t vertexCount = assemblyGraph.vertices.size();
     CZI_ASSERT(assemblyGraph.edges.isOpen);
     const size_t edgeCount = assemblyGraph.edges.size();
-    CZI_ASSERT(assemblyGraph.sequences.isOpen());
-    CZI_ASSERT(assemblyGraph.sequences.size() == edgeCount);
-    CZI_ASSERT(assemblyGraph.repeatCounts.isOpen());
-    CZI_ASSERT(assemblyGraph.repeatCounts.size() == edgeCount);
 
-    // Compute raw sequence length of each edge.
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // Count raw bases and G and C bases of each edge in parallel.
+    // This is the only part that needs to look at the assembled sequence.
+    // If assembleAndWrite was used, this was already done during assembly.
+    vector<uint64_t>& gcCount = computeAssemblyStatisticsData.gcCount;
+    vector<uint64_t>& rawLength = computeAssemblyStatisticsData.rawLength;
+    if(!computeAssemblyStatisticsData.isAvailable) {
+        CZI_ASSERT(assemblyGraph.sequences.isOpen());
+        CZI_ASSERT(assemblyGraph.sequences.size() == edgeCount);
+        CZI_ASSERT(assemblyGraph.repeatCounts.isOpen());
+        CZI_ASSERT(assemblyGraph.repeatCounts.size() == edgeCount);
+        gcCount.resize(edgeCount);
+        rawLength.resize(edgeCount);
+        setupLoadBalancing(edgeCount, 100);
+        runThreads(&Assembler::computeAssemblyStatisticsThreadFunction, threadCount);
+    }
+    CZI_ASSERT(gcCount.size() == edgeCount);
+    CZI_ASSERT(rawLength.size() == edgeCount);
+
+    // Gather raw sequence length of each edge and the
+    // length-weighted coverage histogram.
+    // The coverage histogram is keyed by the average coverage
+    // of the marker graph edges of each assembly graph edge and contains
+    // pairs(number of segments, number of bases).
     vector< pair<EdgeId, size_t> > edgeTable;
+    std::map<uint32_t, pair<uint64_t, uint64_t> > coverageHistogram;
     size_t totalLength = 0;
     size_t assembledEdgeCount = 0;
+    uint64_t totalGcCount = 0;
     for(EdgeId edgeId=0; edgeId<edgeCount; edgeId++) {
 
         // Only consider one of each pair of reverse complemented edges.
@@ -662,28 +1294,35 @@ void Assembler::computeAssemblyStatistics()
             continue;
         }
         assembledEdgeCount++;
-        const MemoryAsContainer<uint8_t> repeatCounts = assemblyGraph.repeatCounts[edgeId];
-        size_t length = 0;
-        for(uint8_t repeatCount: repeatCounts) {
-            length += repeatCount;
-        }
+        const size_t length = rawLength[edgeId];
         edgeTable.push_back(make_pair(edgeId, length));
         totalLength += length;
+        totalGcCount += gcCount[edgeId];
+        auto& h = coverageHistogram[assemblyGraph.edges[edgeId].averageCoverage];
+        h.first++;
+        h.second += length;
     }
+    const double gcFraction = totalLength ? double(totalGcCount) / double(totalLength) : 0.;
 
     cout << "The assembly graph has " << vertexCount;
     cout << " vertices and " << edgeCount << " edges of which " <<
             assembledEdgeCount << " were assembled." << endl;
     cout << "Total length of assembled sequence is " << totalLength << endl;
+    cout << "GC content of assembled sequence is " << gcFraction << endl;
 
     // Sort by decreasing length.
     sort(edgeTable.begin(), edgeTable.end(), OrderPairsBySecondOnlyGreater<EdgeId, size_t>());
 
     // Write a csv file.
+    // While doing that, also compute the Nx curve.
+    // For x = 10, 20, ..., 90, nx[x/10-1] is the pair(Nx, Lx).
+    const size_t nxCount = 9;
+    vector< pair<size_t, size_t> > nx(nxCount, make_pair(0, 0));
+    size_t nxDone = 0;
     ofstream csv("AssemblySummary.csv");
-    csv << "Rank,EdgeId,EdgeIdRc,Length,CumulativeLength,LengthFraction,CumulativeFraction\n";
+    csv << "Rank,EdgeId,EdgeIdRc,Length,CumulativeLength,LengthFraction,CumulativeFraction,"
+        "AverageCoverage,GcFraction\n";
     size_t cumulativeLength = 0;
-    bool n50MessageWritten = false;
     for(size_t rank=0; rank<edgeTable.size(); rank++) {
         const pair<EdgeId, size_t>& p = edgeTable[rank];
         const EdgeId edgeId = p.first;
@@ -695,33 +1334,126 @@ void Assembler::computeAssemblyStatistics()
         csv << length << ",";
         csv << cumulativeLength << ",";
         csv << double(length) / double(totalLength) << ",";
-        csv << double(cumulativeLength) /double(totalLength) << "\n";
-        if(!n50MessageWritten && cumulativeLength >= totalLength/2) {
-            cout << "N50 for assembly segments is " << length << endl;
-            n50MessageWritten = true;
+        csv << double(cumulativeLength) /double(totalLength) << ",";
+        csv << assemblyGraph.edges[edgeId].averageCoverage << ",";
+        csv << (length ? double(gcCount[edgeId]) / double(length) : 0.) << "\n";
+        while(nxDone < nxCount && 10 * cumulativeLength >= (nxDone + 1) * totalLength) {
+            nx[nxDone] = make_pair(length, rank + 1);
+            nxDone++;
         }
     }
+    if(nxDone > 4) {
+        cout << "N50 for assembly segments is " << nx[4].first << endl;
+    }
+
 
+
+    // Write a json file with summary statistics, for use by automated tools.
+    ofstream json("AssemblyStatistics.json");
+    json << "{\n";
+    json << "  \"assemblyGraphVertexCount\": " << vertexCount << ",\n";
+    json << "  \"assemblyGraphEdgeCount\": " << edgeCount << ",\n";
+    json << "  \"assembledSegmentCount\": " << assembledEdgeCount << ",\n";
+    json << "  \"totalLength\": " << totalLength << ",\n";
+    json << "  \"longestSegmentLength\": " <<
+        (edgeTable.empty() ? 0 : edgeTable.front().second) << ",\n";
+    json << "  \"gcCount\": " << totalGcCount << ",\n";
+    json << "  \"gcFraction\": " << gcFraction << ",\n";
+    json << "  \"nx\": [";
+    for(size_t i=0; i<nxDone; i++) {
+        if(i != 0) {
+            json << ",";
+        }
+        json << "\n    {\"x\": " << 10 * (i + 1) <<
+            ", \"n\": " << nx[i].first <<
+            ", \"l\": " << nx[i].second << "}";
+    }
+    json << "\n  ],\n";
+    json << "  \"coverageHistogram\": [";
+    for(auto it=coverageHistogram.begin(); it!=coverageHistogram.end(); ++it) {
+        if(it != coverageHistogram.begin()) {
+            json << ",";
+        }
+        json << "\n    {\"coverage\": " << it->first <<
+            ", \"segmentCount\": " << it->second.first <<
+            ", \"length\": " << it->second.second << "}";
+    }
+    json << "\n  ]\n}\n";
+
+    // Clean up.
+    gcCount.clear();
+    gcCount.shrink_to_fit();
+    rawLength.clear();
+    rawLength.shrink_to_fit();
+    computeAssemblyStatisticsData.isAvailable = false;
+}
+
+
+
+void Assembler::computeAssemblyStatisticsThreadFunction(size_t threadId)
+{
+    vector<uint64_t>& gcCount = computeAssemblyStatisticsData.gcCount;
+    vector<uint64_t>& rawLength = computeAssemblyStatisticsData.rawLength;
+    vector<uint8_t> repeatCounts;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(AssemblyGraph::EdgeId edgeId=begin; edgeId!=end; edgeId++) {
+            gcCount[edgeId] = 0;
+            rawLength[edgeId] = 0;
+            if(!assemblyGraph.isAssembledEdge(edgeId)) {
+                continue;
+            }
+            rawLength[edgeId] = assemblyGraph.repeatCounts.rawSize(edgeId);
+            const auto sequence = assemblyGraph.sequences[edgeId];
+            assemblyGraph.repeatCounts.get(edgeId, repeatCounts);
+            uint64_t n = 0;
+            for(uint64_t i=0; i<sequence.baseCount; i++) {
+                const Base base = sequence[i];
+                if(base.value == 1 || base.value == 2) {    // C or G
+                    n += repeatCounts[i];
+                }
+            }
+            gcCount[edgeId] = n;
+        }
+    }
 }
 
 
 
 // Write the assembly graph in GFA 1.0 format defined here:
 // https://github.com/GFA-spec/GFA-spec/blob/master/GFA1.md
-void Assembler::writeGfa1(const string& fileName)
+// If the file name ends in ".gz", the output is bgzip compressed.
+void Assembler::writeGfa1(const string& fileName, size_t threadCount)
 {
-    using VertexId = AssemblyGraph::VertexId;
-    using EdgeId = AssemblyGraph::EdgeId;
-
     cout << timestamp << "writeGfa1 begins" << endl;
 
-    ofstream gfa(fileName);
+    // Items [0, edgeCount) generate the segment records for the edges.
+    // Items [edgeCount, edgeCount+vertexCount) generate the link records
+    // for the vertices.
+    writeAssemblyOutput(
+        fileName,
+        "H\tVN:Z:1.0\n",
+        assemblyGraph.sequences.size() + assemblyGraph.vertices.size(),
+        &Assembler::writeGfa1Records,
+        threadCount);
+
+    cout << timestamp << "writeGfa1 ends" << endl;
+}
 
-    // Write the header line.
-    gfa << "H\tVN:Z:1.0\n";
+
+
+// Format the GFA records for items [begin, end).
+// See writeGfa1 for the meaning of the items.
+void Assembler::writeGfa1Records(uint64_t begin, uint64_t end, string& gfa)
+{
+    using EdgeId = AssemblyGraph::EdgeId;
+    const uint64_t edgeCount = assemblyGraph.sequences.size();
+    vector<uint8_t> repeatCounts;
 
     // Write a segment record for each edge.
-    for(EdgeId edgeId=0; edgeId<assemblyGraph.sequences.size(); edgeId++) {
+    for(uint64_t item=begin; item<min(end, edgeCount); item++) {
+        const EdgeId edgeId = item;
 
         // Only output one of each pair of reverse complemented edges.
         if(!assemblyGraph.isAssembledEdge(edgeId)) {
@@ -729,29 +1461,72 @@ void Assembler::writeGfa1(const string& fileName)
         }
 
         const auto sequence = assemblyGraph.sequences[edgeId];
-        const auto repeatCounts = assemblyGraph.repeatCounts[edgeId];
+        assemblyGraph.repeatCounts.get(edgeId, repeatCounts);
         CZI_ASSERT(sequence.baseCount == repeatCounts.size());
-        gfa << "S\t" << edgeId << "\t";
-        for(size_t i=0; i<sequence.baseCount; i++) {
-            const Base b = sequence[i];
-            const uint8_t repeatCount = repeatCounts[i];
-            for(size_t k=0; k<repeatCount; k++) {
-                gfa << b;
-            }
+        appendGfa1SegmentRecord(edgeId, sequence, repeatCounts, gfa);
+    }
+
+    // Write the links for each vertex.
+    if(end > edgeCount) {
+        writeGfa1LinkRecords(max(begin, edgeCount) - edgeCount, end - edgeCount, gfa);
+    }
+}
+
+
+
+// Get the first or last k repeat counts of an edge.
+// Only one edge in each reverse complemented pair is assembled,
+// so for the other one we use the reverse complemented edge.
+// During assembleAndWrite, the repeat counts are not necessarily
+// stored, and we use the ones saved in assembleAndWriteData.edgeEnds.
+void Assembler::getAssembledRepeatCountsAtEnd(
+    AssemblyGraph::EdgeId edgeId,
+    bool last,
+    vector<uint8_t>& v) const
+{
+    const size_t k = assemblerInfo->k;
+    v.resize(k);
+    bool reverse = false;
+    if(!assemblyGraph.isAssembledEdge(edgeId)) {
+        edgeId = assemblyGraph.reverseComplementEdge[edgeId];
+        last = !last;
+        reverse = true;
+    }
+    const vector<uint8_t>& edgeEnds = assembleAndWriteData.edgeEnds;
+    if(!edgeEnds.empty()) {
+        const uint8_t* begin = edgeEnds.data() + 2 * k * edgeId + (last ? k : 0);
+        copy(begin, begin + k, v.begin());
+    } else {
+        const uint64_t n = assemblyGraph.repeatCounts.size(edgeId);
+        CZI_ASSERT(n >= k);
+        if(last) {
+            assemblyGraph.repeatCounts.get(edgeId, n - k, n, v.data());
+        } else {
+            assemblyGraph.repeatCounts.get(edgeId, 0, k, v.data());
         }
-        gfa << "\n";
     }
+    if(reverse) {
+        std::reverse(v.begin(), v.end());
+    }
+}
 
 
 
-    // Write GFA links.
-    // For each vertex in the assembly graph there is a link for
-    // each combination of in-edges and out-edges.
-    // Therefore each assembly graph vertex generates a number of
-    // links equal to the product of its in-degree and out-degree.
+// Format the GFA link records for assembly graph vertices [begin, end).
+// For each vertex in the assembly graph there is a link for
+// each combination of in-edges and out-edges.
+// Therefore each assembly graph vertex generates a number of
+// links equal to the product of its in-degree and out-degree.
+void Assembler::writeGfa1LinkRecords(uint64_t begin, uint64_t end, string& gfa)
+{
+    using VertexId = AssemblyGraph::VertexId;
+    using EdgeId = AssemblyGraph::EdgeId;
     const size_t k = assemblerInfo->k;
     string cigarString;
-    for(VertexId vertexId=0; vertexId<assemblyGraph.vertices.size(); vertexId++) {
+    vector<uint8_t> lastRepeatCounts0;
+    vector<uint8_t> firstRepeatCounts1;
+
+    for(VertexId vertexId=begin; vertexId!=end; vertexId++) {
 
         // In-edges.
         const MemoryAsContainer<EdgeId> edges0 = assemblyGraph.edgesByTarget[vertexId];
@@ -761,21 +1536,17 @@ void Assembler::writeGfa1(const string& fileName)
 
         // Loop over combinations of in-edges and out-edges.
         for(const EdgeId edge0: edges0) {
-            const MemoryAsContainer<uint8_t> repeatCounts0 = assemblyGraph.repeatCounts[edge0];
+            getAssembledRepeatCountsAtEnd(edge0, true, lastRepeatCounts0);
             for(const EdgeId edge1: edges1) {
-                const MemoryAsContainer<uint8_t> repeatCounts1 = assemblyGraph.repeatCounts[edge1];
-
-                // Locate the last k repeat counts of v0 and the first k of v1.
-                const MemoryAsContainer<uint8_t> lastRepeatCounts0(
-                    repeatCounts0.begin() + repeatCounts0.size() - k,
-                    repeatCounts0.end());
-                const MemoryAsContainer<uint8_t> firstRepeatCounts1(
-                    repeatCounts1.begin(),
-                    repeatCounts1.begin() + k);
 
+                // Get the last k repeat counts of v0 and the first k of v1.
+                getAssembledRepeatCountsAtEnd(edge1, false, firstRepeatCounts1);
 
                 // Construct the cigar string.
-                constructCigarString(lastRepeatCounts0, firstRepeatCounts1, cigarString);
+                constructCigarString(
+                    MemoryAsContainer<uint8_t>(lastRepeatCounts0.data(), lastRepeatCounts0.data() + k),
+                    MemoryAsContainer<uint8_t>(firstRepeatCounts1.data(), firstRepeatCounts1.data() + k),
+                    cigarString);
 
                 // Keep track of which edges are actually assembled and output.
                 EdgeId edge0Out = edge0;
@@ -800,31 +1571,47 @@ void Assembler::writeGfa1(const string& fileName)
                 }
 
                 // Write out the link record for this edge.
-                gfa << "L\t" <<
-                    edge0Out << "\t" <<
-                    (reverse0 ? "-" : "+") << "\t" <<
-                    edge1Out << "\t" <<
-                    (reverse1 ? "-" : "+") << "\t" <<
-                    cigarString << "\n";
+                gfa += "L\t";
+                gfa += to_string(edge0Out);
+                gfa += (reverse0 ? "\t-\t" : "\t+\t");
+                gfa += to_string(edge1Out);
+                gfa += (reverse1 ? "\t-\t" : "\t+\t");
+                gfa += cigarString;
+                gfa += "\n";
             }
         }
     }
-    cout << timestamp << "writeGfa1 ends" << endl;
 }
 
 
 
 // Write assembled sequences in FASTA format.
-void Assembler::writeFasta(const string& fileName)
+// If the file name ends in ".gz", the output is bgzip compressed.
+void Assembler::writeFasta(const string& fileName, size_t threadCount)
 {
-    using EdgeId = AssemblyGraph::EdgeId;
-
     cout << timestamp << "writeFasta begins" << endl;
 
-    ofstream fasta(fileName);
+    // There is one item for each edge of the assembly graph.
+    writeAssemblyOutput(
+        fileName,
+        "",
+        assemblyGraph.sequences.size(),
+        &Assembler::writeFastaRecords,
+        threadCount);
+
+    cout << timestamp << "writeFasta ends" << endl;
+}
+
+
+
+// Format the FASTA records for assembly graph edges [begin, end).
+void Assembler::writeFastaRecords(uint64_t begin, uint64_t end, string& fasta)
+{
+    using EdgeId = AssemblyGraph::EdgeId;
+    vector<uint8_t> repeatCounts;
 
     // Write a sequence for each edge of the assembly graph.
-    for(EdgeId edgeId=0; edgeId<assemblyGraph.sequences.size(); edgeId++) {
+    for(EdgeId edgeId=begin; edgeId!=end; edgeId++) {
 
         // Only output one of each pair of reverse complemented edges.
         if(!assemblyGraph.isAssembledEdge(edgeId)) {
@@ -832,27 +1619,154 @@ void Assembler::writeFasta(const string& fileName)
         }
 
         const auto sequence = assemblyGraph.sequences[edgeId];
-        const auto repeatCounts = assemblyGraph.repeatCounts[edgeId];
+        assemblyGraph.repeatCounts.get(edgeId, repeatCounts);
         CZI_ASSERT(sequence.baseCount == repeatCounts.size());
+        appendFastaRecord(edgeId, sequence, repeatCounts, fasta);
+    }
+}
+
+
+
+// Multithreaded output of a text file, used by writeFasta and writeGfa1.
+// See Assembler.hpp for more information.
+void Assembler::writeAssemblyOutput(
+    const string& fileName,
+    const string& header,
+    uint64_t itemCount,
+    void (Assembler::*formatFunction)(uint64_t begin, uint64_t end, string&),
+    size_t threadCount,
+    bool append)
+{
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // Store what the threads need.
+    WriteAssemblyOutputData& data = writeAssemblyOutputData;
+    data.itemCount = itemCount;
+    data.chunkSize = 100;
+    data.formatFunction = formatFunction;
+    data.bgzip =
+        fileName.size() >= 3 &&
+        fileName.substr(fileName.size() - 3) == ".gz";
+    data.fileName = fileName;
+    const uint64_t chunkCount = (itemCount + data.chunkSize - 1) / data.chunkSize;
+    data.buffers.clear();
+    data.buffers.resize(chunkCount + 2);
+
+    // The header and the end of file marker.
+    if(data.bgzip) {
+        bgzipCompress(header.data(), header.data() + header.size(), data.buffers.front());
+        bgzipAppendEofBlock(data.buffers.back());
+    } else {
+        data.buffers.front() = header;
+    }
 
-        // Compute the length so we can write it in the header.
-        size_t length = 0;
-        for(const uint8_t repeatCount: repeatCounts) {
-            length += repeatCount;
+    // Format the chunks.
+    setupLoadBalancing(chunkCount, 1);
+    runThreads(&Assembler::writeAssemblyOutputThreadFunction1, threadCount);
+
+    // Open the output file.
+    data.fileDescriptor = ::open(fileName.c_str(),
+        O_CREAT | (append ? 0 : O_TRUNC) | O_WRONLY,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if(data.fileDescriptor == -1) {
+        throw runtime_error("Error opening " + fileName + ": " + strerror(errno));
+    }
+
+    // If appending, the output begins at the current end of the file.
+    uint64_t baseOffset = 0;
+    if(append) {
+        const off_t fileSize = ::lseek(data.fileDescriptor, 0, SEEK_END);
+        if(fileSize == -1) {
+            ::close(data.fileDescriptor);
+            throw runtime_error("Error accessing " + fileName + ": " + strerror(errno));
         }
+        baseOffset = uint64_t(fileSize);
+    }
+
+    // Compute the offset of each buffer in the output file.
+    data.offsets.resize(data.buffers.size() + 1);
+    data.offsets[0] = baseOffset;
+    for(size_t i=0; i<data.buffers.size(); i++) {
+        data.offsets[i+1] = data.offsets[i] + data.buffers[i].size();
+    }
+
+    // Write the buffers.
+    try {
+        setupLoadBalancing(data.buffers.size(), 1);
+        runThreads(&Assembler::writeAssemblyOutputThreadFunction2, threadCount);
+    } catch(...) {
+        ::close(data.fileDescriptor);
+        throw;
+    }
+    ::close(data.fileDescriptor);
+
+    // Clean up.
+    data.buffers.clear();
+    data.buffers.shrink_to_fit();
+    data.offsets.clear();
+    data.offsets.shrink_to_fit();
+}
+
+
+
+// Format (and optionally compress) one chunk at a time.
+void Assembler::writeAssemblyOutputThreadFunction1(size_t threadId)
+{
+    WriteAssemblyOutputData& data = writeAssemblyOutputData;
+    string text;
 
-        fasta << ">" << edgeId << " length " << length << "\n";
-        for(size_t i=0; i<sequence.baseCount; i++) {
-            const Base b = sequence[i];
-            const uint8_t repeatCount = repeatCounts[i];
-            for(size_t k=0; k<repeatCount; k++) {
-                fasta << b;
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t chunkId=begin; chunkId!=end; chunkId++) {
+            const uint64_t itemBegin = chunkId * data.chunkSize;
+            const uint64_t itemEnd = min(data.itemCount, itemBegin + data.chunkSize);
+
+            // The first buffer is used for the header.
+            string& buffer = data.buffers[chunkId + 1];
+            if(data.bgzip) {
+                text.clear();
+                (this->*data.formatFunction)(itemBegin, itemEnd, text);
+                bgzipCompress(text.data(), text.data() + text.size(), buffer);
+            } else {
+                (this->*data.formatFunction)(itemBegin, itemEnd, buffer);
             }
         }
-        fasta << "\n";
     }
-    cout << timestamp << "writeFasta ends" << endl;
+}
+
+
+
+// Write one buffer at a time at its offset in the output file.
+void Assembler::writeAssemblyOutputThreadFunction2(size_t threadId)
+{
+    WriteAssemblyOutputData& data = writeAssemblyOutputData;
 
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            string& buffer = data.buffers[i];
+            size_t writtenCount = 0;
+            while(writtenCount < buffer.size()) {
+                const ssize_t n = ::pwrite(data.fileDescriptor,
+                    buffer.data() + writtenCount,
+                    buffer.size() - writtenCount,
+                    off_t(data.offsets[i] + writtenCount));
+                if(n == -1) {
+                    if(errno == EINTR) {
+                        continue;
+                    }
+                    throw runtime_error("Error writing " + data.fileName + ": " + strerror(errno));
+                }
+                writtenCount += size_t(n);
+            }
+
+            // Free the buffer.
+            string().swap(buffer);
+        }
+    }
 }
 
 
@@ -1198,14 +2112,32 @@ void Assembler::assembleAssemblyGraphEdge(
     assembledSegment.edgeCoverage.resize(assembledSegment.edgeCount);
     for(size_t i=0; i<assembledSegment.edgeCount; i++) {
         assembledSegment.edgeCoverage[i] =
-            uint32_t(markerGraph.edgeMarkerIntervals.size(assembledSegment.edgeIds[i]));
+            uint32_t(getMarkerGraphEdgeMarkerIntervalCount(assembledSegment.edgeIds[i]));
+    }
+
+
+
+    // Compute offsets of vertex and edge sequences in the flat
+    // sequence buffer of the AssembledSegment.
+    // Vertex sequences come first, followed by edge sequences.
+    assembledSegment.vertexSequenceOffsets.resize(assembledSegment.vertexCount + 1);
+    for(size_t i=0; i<=assembledSegment.vertexCount; i++) {
+        assembledSegment.vertexSequenceOffsets[i] = uint32_t(i * k);
+    }
+    assembledSegment.edgeSequenceOffsets.resize(assembledSegment.edgeCount + 1);
+    assembledSegment.edgeSequenceOffsets[0] = uint32_t(assembledSegment.vertexCount * k);
+    for(size_t i=0; i<assembledSegment.edgeCount; i++) {
+        assembledSegment.edgeSequenceOffsets[i+1] = uint32_t(
+            assembledSegment.edgeSequenceOffsets[i] +
+            markerGraph.edgeConsensus.size(assembledSegment.edgeIds[i]));
     }
+    const size_t bufferSize = assembledSegment.edgeSequenceOffsets.back();
+    assembledSegment.sequenceBuffer.resize(bufferSize);
+    assembledSegment.repeatCountBuffer.resize(bufferSize);
 
 
 
     // Extract consensus sequence for the vertices of the chain.
-    assembledSegment.vertexSequences.resize(assembledSegment.vertexCount);
-    assembledSegment.vertexRepeatCounts.resize(assembledSegment.vertexCount);
     for(size_t i=0; i<assembledSegment.vertexCount; i++) {
 
         // Get the sequence.
@@ -1218,28 +2150,24 @@ void Assembler::assembleAssemblyGraphEdge(
         const auto& storedConsensus = markerGraph.vertexRepeatCounts.begin() + k * assembledSegment.vertexIds[i];
 
         // Store in the AssembledSegment.
-        assembledSegment.vertexSequences[i].resize(k);
-        assembledSegment.vertexRepeatCounts[i].resize(k);
+        const size_t offset = assembledSegment.vertexSequenceOffsets[i];
         for(size_t j=0; j<k; j++) {
-            assembledSegment.vertexSequences[i][j] = kmer[j];
-            assembledSegment.vertexRepeatCounts[i][j] = storedConsensus[j];
+            assembledSegment.sequenceBuffer[offset + j] = kmer[j];
+            assembledSegment.repeatCountBuffer[offset + j] = storedConsensus[j];
         }
     }
 
 
 
     // Extract consensus sequence for the edges of the chain.
-    assembledSegment.edgeSequences.resize(assembledSegment.edgeCount);
-    assembledSegment.edgeRepeatCounts.resize(assembledSegment.edgeCount);
     assembledSegment.edgeOverlappingBaseCounts.resize(assembledSegment.edgeCount);
     for(size_t i=0; i<assembledSegment.edgeCount; i++) {
 
         const auto& storedConsensus = markerGraph.edgeConsensus[assembledSegment.edgeIds[i]];
-        assembledSegment.edgeSequences[i].resize(storedConsensus.size());
-        assembledSegment.edgeRepeatCounts[i].resize(storedConsensus.size());
+        const size_t offset = assembledSegment.edgeSequenceOffsets[i];
         for(size_t j=0; j<storedConsensus.size(); j++) {
-            assembledSegment.edgeSequences[i][j] = storedConsensus[j].first;
-            assembledSegment.edgeRepeatCounts[i][j] = storedConsensus[j].second;
+            assembledSegment.sequenceBuffer[offset + j] = storedConsensus[j].first;
+            assembledSegment.repeatCountBuffer[offset + j] = storedConsensus[j].second;
         }
         assembledSegment.edgeOverlappingBaseCounts[i] =
             markerGraph.edgeConsensusOverlappingBaseCount[assembledSegment.edgeIds[i]];
@@ -1251,15 +2179,15 @@ void Assembler::assembleAssemblyGraphEdge(
     if(storeCoverageData) {
 
         // Check that coverage data is available.
-        if( !markerGraph.vertexCoverageData.isOpen() ||
-            !markerGraph.edgeCoverageData.isOpen()) {
+        if(!markerGraph.coverageDataIsOpen()) {
             throw runtime_error("Coverage data is not accessible.");
         }
+        vector< pair<uint32_t, CompressedCoverageData> > input;
 
         // Vertices.
         assembledSegment.vertexCoverageData.resize(assembledSegment.vertexCount);
         for(size_t i=0; i<assembledSegment.vertexCount; i++) {
-            const auto& input = markerGraph.vertexCoverageData[assembledSegment.vertexIds[i]];
+            markerGraph.getVertexCoverageData(assembledSegment.vertexIds[i], input);
             auto& output = assembledSegment.vertexCoverageData[i];
             output.resize(k);
             for(const pair<uint32_t, CompressedCoverageData>& p: input) {
@@ -1273,7 +2201,7 @@ void Assembler::assembleAssemblyGraphEdge(
         // Edges.
         assembledSegment.edgeCoverageData.resize(assembledSegment.edgeCount);
         for(size_t i=0; i<assembledSegment.edgeCount; i++) {
-            const auto& input = markerGraph.edgeCoverageData[assembledSegment.edgeIds[i]];
+            markerGraph.getEdgeCoverageData(assembledSegment.edgeIds[i], input);
             auto& output = assembledSegment.edgeCoverageData[i];
             for(const pair<uint32_t, CompressedCoverageData>& p: input) {
                 const uint32_t position = p.first;
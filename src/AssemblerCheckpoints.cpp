@@ -0,0 +1,596 @@
+// Shasta.
+#include "Assembler.hpp"
+#include "filesystem.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard libraries.
+#include <cstdio>
+#include "fstream.hpp"
+#include "iterator.hpp"
+#include <map>
+#include <set>
+
+
+
+// Enable checkpoints for a new assembly.
+void Assembler::enableCheckpoints(const string& manifestFileName)
+{
+    checkpointManifestFileName = manifestFileName;
+    checkpointManifest.clear();
+}
+
+
+
+// Resume an assembly that did not complete.
+// This accesses the data of all completed stages
+// and verifies that their hashes did not change.
+void Assembler::resumeFromCheckpoints(const string& manifestFileName)
+{
+    // Read the manifest.
+    if(!readCheckpointManifest(manifestFileName, checkpointManifest)) {
+        throw runtime_error("Unable to open checkpoint manifest " + manifestFileName +
+            ". The assembly cannot be resumed.");
+    }
+    if(!isCheckpointed("addReads")) {
+        throw runtime_error("Checkpoint manifest " + manifestFileName +
+            " contains no completed stages. The assembly cannot be resumed.");
+    }
+    checkpointManifestFileName = manifestFileName;
+
+    // Access the data of the completed stages, in order.
+    // Keep track of the last recorded hash of each of their data.
+    // It is the last one because some stages modify
+    // data created by previous stages.
+    std::map<string, uint64_t> recordedHashes;
+    for(size_t i=0; i<checkpointManifest.size(); i++) {
+        const CheckpointEntry& entry = checkpointManifest[i];
+        if(i==0 || entry.stageName != checkpointManifest[i-1].stageName) {
+            cout << timestamp << "Stage " << entry.stageName <<
+                " was completed and will not be repeated." << endl;
+            accessCheckpointData(entry.stageName);
+        }
+        recordedHashes[entry.dataName] = entry.hash;
+    }
+
+    // Verify the hashes.
+    cout << timestamp << "Verifying " << recordedHashes.size() <<
+        " checkpointed data." << endl;
+    for(const auto& p: recordedHashes) {
+        const string& dataName = p.first;
+        if(computeCheckpointHash(dataName) != p.second) {
+            throw runtime_error("Checkpointed data " + dataName +
+                " changed after their checkpoint was recorded,"
+                " probably by a stage that did not complete."
+                " The assembly cannot be resumed.");
+        }
+    }
+    cout << timestamp << "Checkpointed data verified." << endl;
+}
+
+
+
+bool Assembler::isCheckpointed(const string& stageName) const
+{
+    for(const CheckpointEntry& entry: checkpointManifest) {
+        if(entry.stageName == stageName) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+// Record a completed stage in the checkpoint manifest.
+void Assembler::writeCheckpoint(const string& stageName)
+{
+    if(checkpointManifestFileName.empty()) {
+        return;
+    }
+
+    uint64_t parametersHash = 0;
+    for(const auto& p: checkpointParametersHashes) {
+        if(p.first == stageName) {
+            parametersHash = p.second;
+        }
+    }
+
+    vector<string> dataNames;
+    getCheckpointDataNames(stageName, dataNames);
+    for(const string& dataName: dataNames) {
+        CheckpointEntry entry;
+        entry.stageName = stageName;
+        entry.dataName = dataName;
+        entry.hash = computeCheckpointHash(dataName);
+        entry.parametersHash = parametersHash;
+        checkpointManifest.push_back(entry);
+    }
+
+    writeCheckpointManifest(checkpointManifestFileName, checkpointManifest);
+    cout << timestamp << "Checkpoint recorded for stage " << stageName << endl;
+}
+
+
+
+void Assembler::setCheckpointParameters(
+    const vector< pair<string, uint64_t> >& stageParametersHashes)
+{
+    checkpointParametersHashes = stageParametersHashes;
+}
+
+
+
+// Manifests written before parameter hashes were introduced
+// have no ParametersHash column. Their stages are never reused.
+bool Assembler::readCheckpointManifest(
+    const string& manifestFileName,
+    vector<CheckpointEntry>& entries)
+{
+    ifstream manifest(manifestFileName);
+    if(!manifest) {
+        return false;
+    }
+    entries.clear();
+    string line;
+    getline(manifest, line);    // Skip the header line.
+    while(getline(manifest, line)) {
+        const size_t comma0 = line.find(',');
+        const size_t comma1 = line.find(',', comma0 + 1);
+        if(comma0 == string::npos || comma1 == string::npos) {
+            throw runtime_error("Invalid line in checkpoint manifest " +
+                manifestFileName + ": " + line);
+        }
+        const size_t comma2 = line.find(',', comma1 + 1);
+        CheckpointEntry entry;
+        entry.stageName = line.substr(0, comma0);
+        entry.dataName = line.substr(comma0 + 1, comma1 - comma0 - 1);
+        entry.hash = std::stoull(line.substr(comma1 + 1), 0, 16);
+        if(comma2 != string::npos) {
+            entry.parametersHash = std::stoull(line.substr(comma2 + 1), 0, 16);
+        }
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+
+
+// The manifest is written to a temporary file which is then renamed,
+// so an interruption while writing it leaves the previous version intact.
+void Assembler::writeCheckpointManifest(
+    const string& manifestFileName,
+    const vector<CheckpointEntry>& entries)
+{
+    const string temporaryFileName = manifestFileName + ".tmp";
+    {
+        ofstream manifest(temporaryFileName);
+        manifest << "Stage,Data,Hash,ParametersHash\n";
+        manifest << std::hex;
+        for(const CheckpointEntry& entry: entries) {
+            manifest << entry.stageName << "," << entry.dataName << "," <<
+                entry.hash << "," << entry.parametersHash << "\n";
+        }
+        if(!manifest) {
+            throw runtime_error("Error writing checkpoint manifest " + temporaryFileName);
+        }
+    }
+    if(std::rename(temporaryFileName.c_str(), manifestFileName.c_str()) != 0) {
+        throw runtime_error("Error renaming " + temporaryFileName +
+            " to " + manifestFileName);
+    }
+}
+
+
+
+size_t Assembler::reuseCheckpoints(
+    const string& previousRunDirectory,
+    const string& dataDirectory,
+    const string& manifestFileName,
+    const vector< pair<string, uint64_t> >& stageParametersHashes)
+{
+    vector<CheckpointEntry> previousManifest;
+    const string previousManifestFileName = previousRunDirectory + "/" + manifestFileName;
+    if(!readCheckpointManifest(previousManifestFileName, previousManifest)) {
+        throw runtime_error("Unable to open checkpoint manifest " + previousManifestFileName +
+            ". The previous assembly cannot be reused.");
+    }
+
+    // Find the manifest entries of each stage.
+    const size_t stageCount = stageParametersHashes.size();
+    vector< vector<CheckpointEntry> > stageEntries(stageCount);
+    for(size_t i=0; i<stageCount; i++) {
+        for(const CheckpointEntry& entry: previousManifest) {
+            if(entry.stageName == stageParametersHashes[i].first) {
+                stageEntries[i].push_back(entry);
+            }
+        }
+    }
+
+    // Find the initial stages that the previous assembly
+    // completed with the same parameters.
+    // Because the parameter hash of each stage also covers
+    // all previous stages, the two assemblies diverge
+    // at the first stage that does not match.
+    size_t reusedStageCount = 0;
+    for(; reusedStageCount<stageCount; reusedStageCount++) {
+        const vector<CheckpointEntry>& entries = stageEntries[reusedStageCount];
+        const uint64_t parametersHash = stageParametersHashes[reusedStageCount].second;
+        if(entries.empty() || parametersHash == 0) {
+            break;
+        }
+        bool matches = true;
+        for(const CheckpointEntry& entry: entries) {
+            if(entry.parametersHash != parametersHash) {
+                matches = false;
+            }
+        }
+        if(!matches) {
+            break;
+        }
+    }
+
+    // Later stages of the previous assembly may have modified
+    // some of the data of these stages. The previous assembly only has
+    // the modified version, so we cannot reuse the stage that created them.
+    // Removing a stage can make more data stale, so iterate.
+    std::map<string, uint64_t> finalHashes;
+    for(const CheckpointEntry& entry: previousManifest) {
+        finalHashes[entry.dataName] = entry.hash;
+    }
+    while(true) {
+        std::map<string, uint64_t> hashes;
+        std::map<string, size_t> creatingStage;
+        for(size_t i=0; i<reusedStageCount; i++) {
+            for(const CheckpointEntry& entry: stageEntries[i]) {
+                hashes[entry.dataName] = entry.hash;
+                creatingStage.insert(make_pair(entry.dataName, i));
+            }
+        }
+        size_t newReusedStageCount = reusedStageCount;
+        for(const auto& p: hashes) {
+            if(p.second != finalHashes[p.first]) {
+                newReusedStageCount = min(newReusedStageCount, creatingStage[p.first]);
+            }
+        }
+        if(newReusedStageCount == reusedStageCount) {
+            break;
+        }
+        reusedStageCount = newReusedStageCount;
+    }
+
+    if(reusedStageCount == 0) {
+        cout << timestamp << "No stages of the previous assembly in " <<
+            previousRunDirectory << " can be reused." << endl;
+        return 0;
+    }
+    cout << timestamp << "Reusing the following stages of the previous assembly in " <<
+        previousRunDirectory << ":";
+    for(size_t i=0; i<reusedStageCount; i++) {
+        cout << " " << stageParametersHashes[i].first;
+    }
+    cout << endl;
+
+    // Find the prefixes of the names of the files to be reused.
+    // For data that stages of this assembly will modify, the files must be copied.
+    // Otherwise, they can be shared with the previous assembly using hard links.
+    std::set<string> modifiedDataNames;
+    for(size_t i=reusedStageCount; i<stageCount; i++) {
+        vector<string> dataNames;
+        getCheckpointDataNames(stageParametersHashes[i].first, dataNames);
+        modifiedDataNames.insert(dataNames.begin(), dataNames.end());
+    }
+    std::map<string, bool> prefixes;    // True if the files must be copied.
+    prefixes.insert(make_pair(string("Info"), true));
+    for(size_t i=0; i<reusedStageCount; i++) {
+        for(const CheckpointEntry& entry: stageEntries[i]) {
+            vector<string> dataPrefixes;
+            getCheckpointFilePrefixes(entry.dataName, dataPrefixes);
+            for(const string& prefix: dataPrefixes) {
+                prefixes[prefix] = (modifiedDataNames.find(entry.dataName) != modifiedDataNames.end());
+            }
+        }
+    }
+
+    // Link or copy the files.
+    const string previousDataDirectory = previousRunDirectory + "/" + dataDirectory;
+    size_t hardLinkCount = 0;
+    size_t reflinkCount = 0;
+    size_t copyCount = 0;
+    for(const string& path: filesystem::directoryContents(previousDataDirectory)) {
+        const string fileName = path.substr(path.find_last_of('/') + 1);
+
+        // A file belongs to one of the data if its name is one
+        // of the prefixes, optionally followed by a suffix
+        // beginning with a period or dash.
+        bool found = false;
+        bool mustCopy = false;
+        for(const auto& p: prefixes) {
+            const string& prefix = p.first;
+            if(fileName.compare(0, prefix.size(), prefix) == 0 &&
+                (fileName.size() == prefix.size() ||
+                fileName[prefix.size()] == '.' ||
+                fileName[prefix.size()] == '-')) {
+                found = true;
+                mustCopy = p.second;
+            }
+        }
+        if(!found) {
+            continue;
+        }
+
+        const string newPath = dataDirectory + fileName;
+        if(!mustCopy && filesystem::createHardLink(path, newPath)) {
+            ++hardLinkCount;
+        } else if(filesystem::copyFile(path, newPath)) {
+            ++reflinkCount;
+        } else {
+            ++copyCount;
+        }
+    }
+    cout << timestamp << "Reused data files: " << hardLinkCount << " hard links, " <<
+        reflinkCount << " reflinks, " << copyCount << " copies." << endl;
+
+    // Write the manifest for the reused stages.
+    vector<CheckpointEntry> manifest;
+    for(size_t i=0; i<reusedStageCount; i++) {
+        copy(stageEntries[i].begin(), stageEntries[i].end(), back_inserter(manifest));
+    }
+    writeCheckpointManifest(manifestFileName, manifest);
+
+    return reusedStageCount;
+}
+
+
+
+// The names of the data created or modified by each stage.
+// The stage names are the ones used by the static executable.
+void Assembler::getCheckpointDataNames(
+    const string& stageName,
+    vector<string>& dataNames)
+{
+    if(stageName == "addReads") {
+        dataNames = {"Reads", "ReadNames", "ReadRepeatCounts", "ReadFlags"};
+    } else if(stageName == "selectKmers") {
+        dataNames = {"MarkerKmers", "Kmers"};
+    } else if(stageName == "findMarkers") {
+        dataNames = {"Markers"};
+    } else if(stageName == "computeSortedMarkers") {
+        dataNames = {"SortedMarkers"};
+    } else if(stageName == "flagPalindromicReads") {
+        dataNames = {"ReadFlags"};
+    } else if(stageName == "findAlignmentCandidates") {
+        dataNames = {"AlignmentCandidates"};
+    } else if(stageName == "computeAlignments") {
+        dataNames = {"AlignmentData", "AlignmentTable", "CompressedAlignments"};
+    } else if(stageName == "createReadGraph") {
+        dataNames = {"ReadGraphEdges", "ReadGraphConnectivity", "ReadGraphNeighbors"};
+    } else if(stageName == "flagChimericReads") {
+        dataNames = {"ReadFlags"};
+    } else if(stageName == "computeReadGraphConnectedComponents") {
+        dataNames = {"ReadFlags"};
+    } else if(stageName == "renumberReads") {
+        dataNames = {
+            "Reads", "ReadNames", "ReadRepeatCounts", "ReadFlags",
+            "Markers", "SortedMarkers", "AlignmentCandidates",
+            "AlignmentData", "AlignmentTable", "CompressedAlignments",
+            "ReadGraphEdges", "ReadGraphConnectivity", "ReadGraphNeighbors"};
+    } else if(stageName == "createMarkerGraphVertices") {
+        dataNames = {
+            "MarkerGraphVertices",
+            "MarkerGraphVertexTable",
+            "MarkerGraphReverseComplementeVertex"};
+    } else if(stageName == "createMarkerGraphEdges") {
+        dataNames = {
+            "GlobalMarkerGraphEdges",
+            "GlobalMarkerGraphEdgeMarkerIntervals",
+            "GlobalMarkerGraphEdgesBySource",
+            "GlobalMarkerGraphEdgesByTarget",
+            "MarkerGraphReverseComplementeEdge"};
+    } else if(stageName == "renumberMarkerGraph") {
+        dataNames = {
+            "MarkerGraphVertices",
+            "MarkerGraphVertexTable",
+            "MarkerGraphReverseComplementeVertex",
+            "GlobalMarkerGraphEdges",
+            "GlobalMarkerGraphEdgeMarkerIntervals",
+            "GlobalMarkerGraphEdgesBySource",
+            "GlobalMarkerGraphEdgesByTarget",
+            "MarkerGraphReverseComplementeEdge"};
+    } else if(
+        stageName == "flagMarkerGraphWeakEdges" ||
+        stageName == "pruneMarkerGraphStrongSubgraph" ||
+        stageName == "simplifyMarkerGraph") {
+        dataNames = {"GlobalMarkerGraphEdges", "GlobalMarkerGraphEdgeMarkerIntervals"};
+    } else if(stageName == "createAssemblyGraph") {
+        dataNames = {
+            "AssemblyGraphEdgeLists",
+            "AssemblyGraphVertices",
+            "AssemblyGraphReverseComplementVertex",
+            "MarkerToAssemblyTable",
+            "AssemblyGraphEdges",
+            "AssemblyGraphReverseComplementEdge",
+            "AssemblyGraphEdgesBySource",
+            "AssemblyGraphEdgesByTarget"};
+    } else if(stageName == "assembleMarkerGraphVertices") {
+        dataNames = {"MarkerGraphVertexRepeatCounts"};
+    } else if(stageName == "assembleMarkerGraphEdges") {
+        dataNames = {
+            "MarkerGraphEdgesConsensus",
+            "MarkerGraphEdgesConsensusOverlappingBaseCount"};
+    } else if(stageName == "assemble") {
+        dataNames = {"AssembledSequences", "AssembledRepeatCounts"};
+    } else {
+        throw runtime_error("Unknown assembly stage " + stageName);
+    }
+}
+
+
+
+// The files of each data have names beginning with one of these prefixes.
+// Some data are stored together with other representations
+// or indexes which are not hashed separately.
+void Assembler::getCheckpointFilePrefixes(
+    const string& dataName,
+    vector<string>& prefixes)
+{
+    prefixes = {dataName};
+    if(dataName == "Reads") {
+        prefixes.push_back("ReadNameIndex");
+    } else if(dataName == "ReadRepeatCounts") {
+        prefixes.push_back("CompactReadRepeatCounts");
+    } else if(dataName == "Markers") {
+        prefixes.push_back("CompactMarkers");
+    } else if(dataName == "AlignmentCandidates") {
+        prefixes.push_back("LowHashSketches");
+    } else if(dataName == "GlobalMarkerGraphEdgeMarkerIntervals") {
+        prefixes.push_back("GlobalMarkerGraphEdgeMarkerIntervalsCanonical");
+        prefixes.push_back("GlobalMarkerGraphEdgeMarkerIntervalsCompact");
+        prefixes.push_back("GlobalMarkerGraphEdgeMarkerIntervalsCanonicalCompact");
+    } else if(dataName == "GlobalMarkerGraphEdgesBySource") {
+        prefixes.push_back("GlobalMarkerGraphCompactEdgesBySource");
+    } else if(dataName == "GlobalMarkerGraphEdgesByTarget") {
+        prefixes.push_back("GlobalMarkerGraphCompactEdgesByTarget");
+    }
+}
+
+
+
+// Access the data created by a completed stage.
+// Data that later stages modify are accessed with read-write access.
+void Assembler::accessCheckpointData(const string& stageName)
+{
+    if(stageName == "addReads") {
+        // The reads are accessed by the constructor.
+        accessReadFlags(true);
+    } else if(stageName == "selectKmers") {
+        accessKmers();
+    } else if(stageName == "findMarkers") {
+        accessMarkers();
+    } else if(stageName == "computeSortedMarkers") {
+        accessSortedMarkers();
+    } else if(stageName == "findAlignmentCandidates") {
+        accessAlignmentCandidates();
+    } else if(stageName == "computeAlignments") {
+        accessAlignmentData();
+        // Compressed alignments are only stored if requested.
+        if(filesystem::exists(largeDataName("CompressedAlignments") + ".toc")) {
+            accessCompressedAlignments();
+        }
+    } else if(stageName == "createReadGraph") {
+        accessReadGraph();
+    } else if(stageName == "createMarkerGraphVertices") {
+        accessMarkerGraphVertices();
+        accessMarkerGraphReverseComplementVertex();
+    } else if(stageName == "createMarkerGraphEdges") {
+        accessMarkerGraphEdges(true);
+        accessMarkerGraphReverseComplementEdge();
+    } else if(stageName == "createAssemblyGraph") {
+        accessAssemblyGraphEdgeLists();
+        accessAssemblyGraphVertices();
+        accessAssemblyGraphEdges();
+    } else if(stageName == "assembleMarkerGraphVertices") {
+        accessMarkerGraphVertexRepeatCounts();
+    } else if(stageName == "assembleMarkerGraphEdges") {
+        accessMarkerGraphEdgeConsensus();
+    } else if(stageName == "assemble") {
+        accessAssemblyGraphSequences();
+    } else {
+        // The remaining stages only modify data created by previous stages.
+        // This also checks that the stage name is valid.
+        vector<string> dataNames;
+        getCheckpointDataNames(stageName, dataNames);
+    }
+}
+
+
+
+uint64_t Assembler::computeCheckpointHash(const string& dataName) const
+{
+    if(dataName == "Reads") {
+        return reads.hash();
+    } else if(dataName == "ReadNames") {
+        return readNames.hash();
+    } else if(dataName == "ReadRepeatCounts") {
+        // If the read repeat counts were compressed,
+        // hash the compressed representation instead.
+        if(readRepeatCounts.isOpen()) {
+            return readRepeatCounts.hash();
+        } else {
+            return compactReadRepeatCounts.hash();
+        }
+    } else if(dataName == "ReadFlags") {
+        return readFlags.hash();
+    } else if(dataName == "MarkerKmers") {
+        return markerKmers.hash();
+    } else if(dataName == "Kmers") {
+        // The k-mer table is only created for k <= maxKmerTableK.
+        return kmerTable.isOpen ? kmerTable.hash() : 0;
+    } else if(dataName == "Markers") {
+        return markers.hash();
+    } else if(dataName == "SortedMarkers") {
+        return sortedMarkers.hash();
+    } else if(dataName == "AlignmentCandidates") {
+        return alignmentCandidates.hash();
+    } else if(dataName == "AlignmentData") {
+        return alignmentData.hash();
+    } else if(dataName == "AlignmentTable") {
+        return alignmentTable.hash();
+    } else if(dataName == "CompressedAlignments") {
+        return compressedAlignments.isOpen() ? compressedAlignments.hash() : 0;
+    } else if(dataName == "ReadGraphEdges") {
+        return readGraph.edges.hash();
+    } else if(dataName == "ReadGraphConnectivity") {
+        return readGraph.connectivity.hash();
+    } else if(dataName == "ReadGraphNeighbors") {
+        return readGraph.neighbors.hash();
+    } else if(dataName == "MarkerGraphVertices") {
+        return markerGraph.vertices.hash();
+    } else if(dataName == "MarkerGraphVertexTable") {
+        return markerGraph.vertexTable.hash();
+    } else if(dataName == "MarkerGraphReverseComplementeVertex") {
+        return markerGraph.reverseComplementVertex.hash();
+    } else if(dataName == "GlobalMarkerGraphEdges") {
+        return markerGraph.edges.hash();
+    } else if(dataName == "GlobalMarkerGraphEdgeMarkerIntervals") {
+        if(markerGraph.compactEdgeMarkerIntervals.isOpen()) {
+            return markerGraph.compactEdgeMarkerIntervals.hash();
+        }
+        return markerGraph.edgeMarkerIntervals.hash();
+    } else if(dataName == "GlobalMarkerGraphEdgesBySource") {
+        return markerGraph.compactEdgesBySource.hash();
+    } else if(dataName == "GlobalMarkerGraphEdgesByTarget") {
+        return markerGraph.compactEdgesByTarget.hash();
+    } else if(dataName == "MarkerGraphReverseComplementeEdge") {
+        return markerGraph.reverseComplementEdge.hash();
+    } else if(dataName == "AssemblyGraphEdgeLists") {
+        return assemblyGraph.edgeLists.hash();
+    } else if(dataName == "AssemblyGraphVertices") {
+        return assemblyGraph.vertices.hash();
+    } else if(dataName == "AssemblyGraphReverseComplementVertex") {
+        return assemblyGraph.reverseComplementVertex.hash();
+    } else if(dataName == "MarkerToAssemblyTable") {
+        return assemblyGraph.markerToAssemblyTable.hash();
+    } else if(dataName == "AssemblyGraphEdges") {
+        return assemblyGraph.edges.hash();
+    } else if(dataName == "AssemblyGraphReverseComplementEdge") {
+        return assemblyGraph.reverseComplementEdge.hash();
+    } else if(dataName == "AssemblyGraphEdgesBySource") {
+        return assemblyGraph.edgesBySource.hash();
+    } else if(dataName == "AssemblyGraphEdgesByTarget") {
+        return assemblyGraph.edgesByTarget.hash();
+    } else if(dataName == "MarkerGraphVertexRepeatCounts") {
+        return markerGraph.vertexRepeatCounts.hash();
+    } else if(dataName == "MarkerGraphEdgesConsensus") {
+        return markerGraph.edgeConsensus.hash();
+    } else if(dataName == "MarkerGraphEdgesConsensusOverlappingBaseCount") {
+        return markerGraph.edgeConsensusOverlappingBaseCount.hash();
+    } else if(dataName == "AssembledSequences") {
+        return assemblyGraph.sequences.hash();
+    } else if(dataName == "AssembledRepeatCounts") {
+        return assemblyGraph.repeatCounts.hash();
+    } else {
+        throw runtime_error("Unknown checkpointed data " + dataName);
+    }
+}
@@ -0,0 +1,279 @@
+// Shasta.
+#include "Assembler.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard libraries.
+#include "algorithm.hpp"
+#include "iostream.hpp"
+
+
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        // Close or remove one of the memory mapped data structures.
+        template<class T> void releaseMemoryMappedData(T& t, bool remove)
+        {
+            if(remove) {
+                t.remove();
+            } else {
+                t.close();
+            }
+        }
+
+    }
+}
+
+
+
+void Assembler::setDataLifetimePolicy(const string& policy)
+{
+    if(policy != "keep" && policy != "close" && policy != "remove") {
+        throw runtime_error("Invalid data lifetime policy " + policy +
+            ". Must be keep, close, or remove.");
+    }
+    dataLifetimePolicy = policy;
+}
+
+
+
+// Release the intermediate data that no stage after
+// the one that just completed (or was skipped) uses.
+void Assembler::releaseUnneededData(const string& completedStageName)
+{
+    uint64_t releasedBytes =
+        releasedBytesAfterStage.empty() ? 0 : releasedBytesAfterStage.back().second;
+    if(dataLifetimePolicy == "keep") {
+        releasedBytesAfterStage.push_back(make_pair(completedStageName, releasedBytes));
+        return;
+    }
+
+    // Find the position of this stage in the stage order.
+    const auto& stages = checkpointParametersHashes;
+    size_t stageIndex = 0;
+    for(; stageIndex<stages.size(); stageIndex++) {
+        if(stages[stageIndex].first == completedStageName) {
+            break;
+        }
+    }
+    if(stageIndex == stages.size()) {
+        throw runtime_error("Unknown assembly stage " + completedStageName);
+    }
+
+    // Gather the data used by this stage and the previous ones,
+    // and the data used by the later stages.
+    vector<string> usedData;
+    vector<string> laterUsedData;
+    vector<string> dataNames;
+    for(size_t i=0; i<stages.size(); i++) {
+        vector<string>& v = (i <= stageIndex) ? usedData : laterUsedData;
+        getStageInputDataNames(stages[i].first, dataNames);
+        copy(dataNames.begin(), dataNames.end(), back_inserter(v));
+        getCheckpointDataNames(stages[i].first, dataNames);
+        copy(dataNames.begin(), dataNames.end(), back_inserter(v));
+    }
+    sort(usedData.begin(), usedData.end());
+    usedData.erase(unique(usedData.begin(), usedData.end()), usedData.end());
+    sort(laterUsedData.begin(), laterUsedData.end());
+
+    // Release the intermediate data that are not used by any later stage.
+    const bool remove = (dataLifetimePolicy == "remove");
+    for(const string& dataName: usedData) {
+        if(!isIntermediateData(dataName) ||
+            std::binary_search(laterUsedData.begin(), laterUsedData.end(), dataName) ||
+            find(releasedDataNames.begin(), releasedDataNames.end(), dataName) != releasedDataNames.end()) {
+            continue;
+        }
+        const uint64_t byteCount = releaseData(dataName, remove);
+        releasedDataNames.push_back(dataName);
+        if(byteCount) {
+            cout << timestamp << (remove ? "Removed " : "Closed ") << dataName <<
+                ", which is not used after stage " << completedStageName <<
+                ". Released " << double(byteCount) / (1024. * 1024. * 1024.) << " GB." << endl;
+            releasedBytes += byteCount;
+        }
+    }
+    releasedBytesAfterStage.push_back(make_pair(completedStageName, releasedBytes));
+}
+
+
+
+// The names of the data read by each stage.
+// The data created or modified by each stage are
+// given by getCheckpointDataNames.
+// The stage names are the ones used by the static executable.
+// This only needs to be complete for the intermediate data
+// (see isIntermediateData), but errs on the side of listing data
+// that a stage only uses for some options.
+void Assembler::getStageInputDataNames(
+    const string& stageName,
+    vector<string>& dataNames)
+{
+    if(stageName == "addReads") {
+        dataNames = {};
+    } else if(stageName == "selectKmers") {
+        dataNames = {"Reads", "ReadFlags"};
+    } else if(stageName == "findMarkers") {
+        dataNames = {"Reads", "MarkerKmers", "Kmers"};
+    } else if(stageName == "computeSortedMarkers") {
+        dataNames = {"Markers"};
+    } else if(stageName == "flagPalindromicReads") {
+        dataNames = {"Reads", "ReadFlags", "Markers"};
+    } else if(stageName == "findAlignmentCandidates") {
+        dataNames = {"ReadFlags", "MarkerKmers", "Kmers", "Markers", "SortedMarkers"};
+    } else if(stageName == "computeAlignments") {
+        dataNames = {"ReadFlags", "MarkerKmers", "Kmers", "Markers", "SortedMarkers",
+            "AlignmentCandidates"};
+    } else if(stageName == "createReadGraph") {
+        dataNames = {"ReadFlags", "Markers", "AlignmentData", "AlignmentTable"};
+    } else if(
+        stageName == "flagChimericReads" ||
+        stageName == "computeReadGraphConnectedComponents") {
+        dataNames = {"ReadFlags", "AlignmentData", "AlignmentTable",
+            "ReadGraphEdges", "ReadGraphConnectivity", "ReadGraphNeighbors"};
+    } else if(stageName == "renumberReads") {
+        dataNames = {"Reads", "ReadNames", "ReadRepeatCounts", "ReadFlags", "Markers", "SortedMarkers",
+            "AlignmentCandidates", "AlignmentData", "AlignmentTable", "CompressedAlignments",
+            "ReadGraphEdges", "ReadGraphConnectivity", "ReadGraphNeighbors"};
+    } else if(stageName == "createMarkerGraphVertices") {
+        // The sorted markers are used when the alignments were not stored.
+        dataNames = {"Reads", "ReadFlags", "MarkerKmers", "Markers", "SortedMarkers",
+            "AlignmentData", "AlignmentTable", "CompressedAlignments",
+            "ReadGraphEdges", "ReadGraphConnectivity", "ReadGraphNeighbors"};
+    } else if(
+        stageName == "createMarkerGraphEdges" ||
+        stageName == "renumberMarkerGraph" ||
+        stageName == "flagMarkerGraphWeakEdges" ||
+        stageName == "pruneMarkerGraphStrongSubgraph" ||
+        stageName == "simplifyMarkerGraph" ||
+        stageName == "createAssemblyGraph" ||
+        stageName == "assembleMarkerGraphVertices" ||
+        stageName == "assembleMarkerGraphEdges" ||
+        stageName == "assemble") {
+        // These stages only use the reads, markers, and the data
+        // created by the marker graph and assembly graph stages,
+        // which are not released.
+        dataNames = {"Reads", "ReadRepeatCounts", "ReadFlags", "MarkerKmers", "Markers"};
+    } else {
+        throw runtime_error("Unknown assembly stage " + stageName);
+    }
+}
+
+
+
+// The data that are released when no later stage uses them.
+// The k-mer table is an intermediate, but the marker k-mers
+// are always kept because they are assumed to always be available.
+bool Assembler::isIntermediateData(const string& dataName)
+{
+    return
+        dataName == "Kmers" ||
+        dataName == "SortedMarkers" ||
+        dataName == "AlignmentCandidates" ||
+        dataName == "AlignmentData" ||
+        dataName == "AlignmentTable" ||
+        dataName == "CompressedAlignments" ||
+        dataName == "ReadGraphEdges" ||
+        dataName == "ReadGraphConnectivity" ||
+        dataName == "ReadGraphNeighbors";
+}
+
+
+
+// Release one of the data and return the number of bytes
+// that were mapped and are no longer mapped.
+// Data that are not open are skipped.
+uint64_t Assembler::releaseData(const string& dataName, bool remove)
+{
+    const uint64_t mappedBytesBefore = MemoryMapped::Statistics::getMappedBytes();
+
+    if(dataName == "Kmers") {
+        if(kmerTable.isOpen) {
+            releaseMemoryMappedData(kmerTable, remove);
+        }
+    } else if(dataName == "SortedMarkers") {
+        if(sortedMarkers.isOpen()) {
+            releaseMemoryMappedData(sortedMarkers, remove);
+        }
+    } else if(dataName == "AlignmentCandidates") {
+        // The LowHash sketches are stored with the alignment candidates
+        // (see getCheckpointFilePrefixes).
+        if(alignmentCandidates.isOpen) {
+            releaseMemoryMappedData(alignmentCandidates, remove);
+        }
+        if(lowHashSketches.isOpen()) {
+            releaseMemoryMappedData(lowHashSketches, remove);
+        }
+    } else if(dataName == "AlignmentData") {
+        if(alignmentData.isOpen) {
+            releaseMemoryMappedData(alignmentData, remove);
+        }
+    } else if(dataName == "AlignmentTable") {
+        if(alignmentTable.isOpen()) {
+            releaseMemoryMappedData(alignmentTable, remove);
+        }
+    } else if(dataName == "CompressedAlignments") {
+        if(compressedAlignments.isOpen()) {
+            releaseMemoryMappedData(compressedAlignments, remove);
+        }
+    } else if(dataName == "ReadGraphEdges") {
+        if(readGraph.edges.isOpen) {
+            releaseMemoryMappedData(readGraph.edges, remove);
+        }
+    } else if(dataName == "ReadGraphConnectivity") {
+        if(readGraph.connectivity.isOpen()) {
+            releaseMemoryMappedData(readGraph.connectivity, remove);
+        }
+    } else if(dataName == "ReadGraphNeighbors") {
+        if(readGraph.neighbors.isOpen()) {
+            releaseMemoryMappedData(readGraph.neighbors, remove);
+        }
+    } else {
+        throw runtime_error("Data " + dataName + " cannot be released.");
+    }
+
+    const uint64_t mappedBytesAfter = MemoryMapped::Statistics::getMappedBytes();
+    return (mappedBytesBefore > mappedBytesAfter) ? mappedBytesBefore - mappedBytesAfter : 0;
+}
+
+
+
+// For each stage in the performance report, the peak of mapped memory
+// without releasing data is estimated by adding the bytes
+// released before the stage began to the peak of mapped memory
+// measured for the stage.
+void Assembler::writeDataLifetimeSummary(ostream& s) const
+{
+    const double gigabyte = 1024. * 1024. * 1024.;
+    const uint64_t releasedBytes =
+        releasedBytesAfterStage.empty() ? 0 : releasedBytesAfterStage.back().second;
+    s << "Data lifetime policy: " << dataLifetimePolicy << ". Released " <<
+        releasedDataNames.size() << " intermediate data using " <<
+        double(releasedBytes) / gigabyte << " GB." << endl;
+    if(releasedBytes == 0) {
+        return;
+    }
+
+    uint64_t peakMappedBytes = 0;
+    uint64_t estimatedPeakMappedBytes = 0;
+    for(const PerformanceReport::Stage& stage: performanceReport.stages) {
+
+        // The bytes released after the previous stage.
+        uint64_t releasedBytesBefore = 0;
+        for(size_t i=1; i<releasedBytesAfterStage.size(); i++) {
+            if(releasedBytesAfterStage[i].first == stage.name) {
+                releasedBytesBefore = releasedBytesAfterStage[i-1].second;
+                break;
+            }
+        }
+
+        peakMappedBytes = max(peakMappedBytes, stage.peakMappedBytes);
+        estimatedPeakMappedBytes = max(estimatedPeakMappedBytes,
+            stage.peakMappedBytes + releasedBytesBefore);
+    }
+    s << "Peak mapped memory was " << double(peakMappedBytes) / gigabyte <<
+        " GB. Without releasing intermediate data, it would have been about " <<
+        double(estimatedPeakMappedBytes) / gigabyte << " GB." << endl;
+}
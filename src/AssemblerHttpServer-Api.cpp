@@ -0,0 +1,499 @@
+#ifndef SHASTA_STATIC_EXECUTABLE
+
+// Http server keywords that return JSON instead of html,
+// for programmatic access to the assembly data.
+// All these keywords begin with "/api/".
+// Responses are written directly to the output stream
+// as they are generated, without building the full
+// response in memory first.
+
+// Shasta.
+#include "Assembler.hpp"
+#include "CompactLocalMarkerGraph.hpp"
+#include "ConsensusCaller.hpp"
+#include "LocalMarkerGraph.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Boost libraries.
+#include <boost/graph/iteration_macros.hpp>
+
+// Standard library.
+#include "stdexcept.hpp"
+
+
+
+#define CZI_ADD_TO_API_FUNCTION_TABLE(name) \
+    httpServerData.functionTable[string("/api/") + #name ] = &Assembler::name##Api
+
+
+
+void Assembler::fillServerApiFunctionTable()
+{
+    CZI_ADD_TO_API_FUNCTION_TABLE(summary);
+    CZI_ADD_TO_API_FUNCTION_TABLE(read);
+    CZI_ADD_TO_API_FUNCTION_TABLE(markers);
+    CZI_ADD_TO_API_FUNCTION_TABLE(alignments);
+    CZI_ADD_TO_API_FUNCTION_TABLE(markerGraphVertex);
+    CZI_ADD_TO_API_FUNCTION_TABLE(markerGraphEdge);
+    CZI_ADD_TO_API_FUNCTION_TABLE(localMarkerGraph);
+    CZI_ADD_TO_API_FUNCTION_TABLE(localMarkerGraphLayout);
+}
+
+
+
+// Write a string as a JSON string, with the necessary escapes.
+void Assembler::writeJsonString(ostream& json, const string& s)
+{
+    static const char* hexDigits = "0123456789abcdef";
+    json << '"';
+    for(const char c: s) {
+        switch(c) {
+        case '"':
+            json << "\\\"";
+            break;
+        case '\\':
+            json << "\\\\";
+            break;
+        case '\n':
+            json << "\\n";
+            break;
+        case '\r':
+            json << "\\r";
+            break;
+        case '\t':
+            json << "\\t";
+            break;
+        default:
+            if(uint8_t(c) < 0x20) {
+                json << "\\u00" << hexDigits[uint8_t(c) >> 4] << hexDigits[uint8_t(c) & 0xf];
+            } else {
+                json << c;
+            }
+        }
+    }
+    json << '"';
+}
+
+
+
+// Get the oriented read specified by the readId and strand parameters,
+// throwing an exception if they are missing or invalid.
+OrientedReadId Assembler::getApiOrientedReadId(const vector<string>& request)
+{
+    ReadId readId = 0;
+    if(!getParameterValue(request, "readId", readId)) {
+        throw runtime_error("Missing readId.");
+    }
+    Strand strand = 0;
+    getParameterValue(request, "strand", strand);
+    checkReadsAreOpen();
+    if(readId >= reads.size()) {
+        throw runtime_error("Invalid readId. Must be less than " + to_string(reads.size()) + ".");
+    }
+    if(strand > 1) {
+        throw runtime_error("Invalid strand. Must be 0 or 1.");
+    }
+    return OrientedReadId(readId, strand);
+}
+
+
+
+// Summary information that clients need to interpret
+// the other responses.
+void Assembler::summaryApi(const vector<string>& request, ostream& json)
+{
+    json << "{\"k\":" << assemblerInfo->k;
+    json << ",\"readCount\":" << (reads.isOpen() ? reads.size() : 0);
+    json << ",\"markerGraphVertexCount\":" <<
+        (markerGraph.vertices.isOpen() ? markerGraph.vertices.size() : 0);
+    json << ",\"markerGraphEdgeCount\":" <<
+        (markerGraph.edges.isOpen ? markerGraph.edges.size() : 0);
+    json << ",\"alignmentCount\":" <<
+        (alignmentData.isOpen ? alignmentData.size() : 0);
+    json << "}";
+}
+
+
+
+// The run-length sequence and repeat counts of an oriented read.
+void Assembler::readApi(const vector<string>& request, ostream& json)
+{
+    const OrientedReadId orientedReadId = getApiOrientedReadId(request);
+    const ReadId readId = orientedReadId.getReadId();
+    const uint32_t length = uint32_t(reads[readId].baseCount);
+
+    json << "{\"readId\":" << readId;
+    json << ",\"strand\":" << orientedReadId.getStrand();
+    if(readNames.isOpen()) {
+        const auto readName = readNames[readId];
+        json << ",\"name\":";
+        writeJsonString(json, string(readName.begin(), readName.end()));
+    }
+    json << ",\"rawLength\":" << getReadRawSequenceLength(readId);
+    json << ",\"sequence\":\"";
+    for(uint32_t position=0; position<length; position++) {
+        json << getOrientedReadBase(orientedReadId, position);
+    }
+    json << "\",\"repeatCounts\":[";
+    for(uint32_t position=0; position<length; position++) {
+        if(position > 0) {
+            json << ",";
+        }
+        json << int(getOrientedReadBaseAndRepeatCount(orientedReadId, position).second);
+    }
+    json << "]}";
+}
+
+
+
+// The markers of an oriented read, each written as
+// [kmerId, position, vertexId].
+// The vertexId is null if the marker is not on a marker graph vertex
+// or if the marker graph is not available.
+void Assembler::markersApi(const vector<string>& request, ostream& json)
+{
+    const OrientedReadId orientedReadId = getApiOrientedReadId(request);
+    checkMarkersAreOpen();
+    const auto orientedReadMarkers = markers[orientedReadId.getValue()];
+    const MarkerId firstMarkerId = orientedReadMarkers.begin() - markers.begin();
+    const bool vertexTableIsOpen = markerGraph.vertexTable.isOpen;
+
+    json << "{\"readId\":" << orientedReadId.getReadId();
+    json << ",\"strand\":" << orientedReadId.getStrand();
+    json << ",\"markers\":[";
+    for(uint32_t ordinal=0; ordinal<orientedReadMarkers.size(); ordinal++) {
+        const CompressedMarker& marker = orientedReadMarkers[ordinal];
+        if(ordinal > 0) {
+            json << ",";
+        }
+        json << "[" << marker.kmerId << "," << marker.position << ",";
+        const MarkerGraph::CompressedVertexId vertexId =
+            vertexTableIsOpen ?
+            markerGraph.vertexTable[firstMarkerId + ordinal] :
+            MarkerGraph::invalidCompressedVertexId;
+        if(vertexId == MarkerGraph::invalidCompressedVertexId) {
+            json << "null";
+        } else {
+            json << vertexId;
+        }
+        json << "]";
+    }
+    json << "]}";
+}
+
+
+
+// The stored alignments of an oriented read,
+// oriented so the requested oriented read is the first one.
+void Assembler::alignmentsApi(const vector<string>& request, ostream& json)
+{
+    const OrientedReadId orientedReadId0 = getApiOrientedReadId(request);
+    checkAlignmentDataAreOpen();
+
+    json << "{\"readId\":" << orientedReadId0.getReadId();
+    json << ",\"strand\":" << orientedReadId0.getStrand();
+    json << ",\"alignments\":[";
+    bool isFirst = true;
+    for(const auto& p: findOrientedAlignments(orientedReadId0)) {
+        const OrientedReadId orientedReadId1 = p.first;
+        const AlignmentInfo& alignmentInfo = p.second;
+        if(!isFirst) {
+            json << ",";
+        }
+        isFirst = false;
+        json << "{\"readId\":" << orientedReadId1.getReadId();
+        json << ",\"strand\":" << orientedReadId1.getStrand();
+        json << ",\"markerCount\":" << alignmentInfo.markerCount;
+        json << ",\"leftTrim\":[" << alignmentInfo.leftTrim(0) << "," << alignmentInfo.leftTrim(1) << "]";
+        json << ",\"rightTrim\":[" << alignmentInfo.rightTrim(0) << "," << alignmentInfo.rightTrim(1) << "]";
+        json << "}";
+    }
+    json << "]}";
+}
+
+
+
+// A marker graph vertex: its markers, each written as [readId, strand, ordinal],
+// its consensus repeat counts if available,
+// and its edges if connectivity is available.
+void Assembler::markerGraphVertexApi(const vector<string>& request, ostream& json)
+{
+    MarkerGraph::VertexId vertexId = 0;
+    if(!getParameterValue(request, "vertexId", vertexId)) {
+        throw runtime_error("Missing vertexId.");
+    }
+    if(!markerGraph.vertices.isOpen()) {
+        throw runtime_error("The marker graph vertices are not available.");
+    }
+    if(vertexId >= markerGraph.vertices.size()) {
+        throw runtime_error("Invalid vertexId. Must be less than " +
+            to_string(markerGraph.vertices.size()) + ".");
+    }
+    const size_t k = assemblerInfo->k;
+    const MemoryAsContainer<MarkerId> markerIds = markerGraph.vertices[vertexId];
+
+    json << "{\"vertexId\":" << vertexId;
+    json << ",\"kmer\":\"";
+    const Kmer kmer(markers.begin()[markerIds[0]].kmerId, k);
+    for(size_t i=0; i<k; i++) {
+        json << kmer[i];
+    }
+    json << "\",\"markers\":[";
+    for(size_t j=0; j<markerIds.size(); j++) {
+        OrientedReadId orientedReadId;
+        uint32_t ordinal;
+        tie(orientedReadId, ordinal) = findMarkerId(markerIds[j]);
+        if(j > 0) {
+            json << ",";
+        }
+        json << "[" << orientedReadId.getReadId() << "," <<
+            orientedReadId.getStrand() << "," << ordinal << "]";
+    }
+    json << "]";
+
+    if(markerGraph.vertexRepeatCounts.isOpen) {
+        json << ",\"repeatCounts\":[";
+        for(size_t i=0; i<k; i++) {
+            if(i > 0) {
+                json << ",";
+            }
+            json << int(markerGraph.vertexRepeatCounts[k*vertexId + i]);
+        }
+        json << "]";
+    }
+
+    if(markerGraph.compactEdgesBySource.isOpen() && markerGraph.compactEdgesByTarget.isOpen()) {
+        json << ",\"outEdges\":[";
+        bool isFirst = true;
+        for(const uint64_t edgeId: markerGraph.compactEdgesBySource[vertexId]) {
+            if(!isFirst) {
+                json << ",";
+            }
+            isFirst = false;
+            json << edgeId;
+        }
+        json << "],\"inEdges\":[";
+        isFirst = true;
+        for(const uint64_t edgeId: markerGraph.compactEdgesByTarget[vertexId]) {
+            if(!isFirst) {
+                json << ",";
+            }
+            isFirst = false;
+            json << edgeId;
+        }
+        json << "]";
+    }
+    json << "}";
+}
+
+
+
+// A marker graph edge: its vertices, flags, marker intervals,
+// each written as [readId, strand, ordinal0, ordinal1],
+// and its consensus sequence if available.
+void Assembler::markerGraphEdgeApi(const vector<string>& request, ostream& json)
+{
+    MarkerGraph::EdgeId edgeId = 0;
+    if(!getParameterValue(request, "edgeId", edgeId)) {
+        throw runtime_error("Missing edgeId.");
+    }
+    checkMarkerGraphEdgesIsOpen();
+    if(edgeId >= markerGraph.edges.size()) {
+        throw runtime_error("Invalid edgeId. Must be less than " +
+            to_string(markerGraph.edges.size()) + ".");
+    }
+    const MarkerGraph::Edge& edge = markerGraph.edges[edgeId];
+
+    json << "{\"edgeId\":" << edgeId;
+    json << ",\"source\":" << edge.source;
+    json << ",\"target\":" << edge.target;
+    json << ",\"coverage\":" << int(edge.coverage);
+    json << ",\"wasRemovedByTransitiveReduction\":" <<
+        (edge.wasRemovedByTransitiveReduction ? "true" : "false");
+    json << ",\"wasPruned\":" << (edge.wasPruned ? "true" : "false");
+    json << ",\"isSuperBubbleEdge\":" << (edge.isSuperBubbleEdge ? "true" : "false");
+
+    json << ",\"markerIntervals\":[";
+    vector<MarkerInterval> markerIntervals;
+    getMarkerGraphEdgeMarkerIntervals(edgeId, markerIntervals);
+    for(size_t j=0; j<markerIntervals.size(); j++) {
+        const MarkerInterval& markerInterval = markerIntervals[j];
+        if(j > 0) {
+            json << ",";
+        }
+        json << "[" << markerInterval.orientedReadId.getReadId() << "," <<
+            markerInterval.orientedReadId.getStrand() << "," <<
+            markerInterval.ordinals[0] << "," <<
+            markerInterval.ordinals[1] << "]";
+    }
+    json << "]";
+
+    if(markerGraph.edgeConsensus.isOpen() && markerGraph.edgeConsensusOverlappingBaseCount.isOpen) {
+        json << ",\"overlappingBaseCount\":" <<
+            int(markerGraph.edgeConsensusOverlappingBaseCount[edgeId]);
+        json << ",\"sequence\":\"";
+        for(const auto& p: markerGraph.edgeConsensus[edgeId]) {
+            json << p.first;
+        }
+        json << "\",\"repeatCounts\":[";
+        bool isFirst = true;
+        for(const auto& p: markerGraph.edgeConsensus[edgeId]) {
+            if(!isFirst) {
+                json << ",";
+            }
+            isFirst = false;
+            json << int(p.second);
+        }
+        json << "]";
+    }
+    json << "}";
+}
+
+
+
+// A local marker graph, using the same parameters as exploreMarkerGraph.
+// Vertices are written as [vertexId, distance, coverage],
+// and edges as [sourceVertexId, targetVertexId, edgeId, coverage, consensus],
+// with edgeId null if the local marker graph was not created
+// using stored connectivity.
+void Assembler::localMarkerGraphApi(const vector<string>& request, ostream& json)
+{
+    LocalMarkerGraphRequestParameters requestParameters;
+    getLocalMarkerGraphRequestParameters(request, requestParameters);
+    if(!requestParameters.vertexIdIsPresent) {
+        throw runtime_error("Missing vertexId.");
+    }
+    if(!requestParameters.maxDistanceIsPresent) {
+        throw runtime_error("Missing maxDistance.");
+    }
+    if(requestParameters.vertexId >= markerGraph.vertices.size()) {
+        throw runtime_error("Invalid vertexId. Must be less than " +
+            to_string(markerGraph.vertices.size()) + ".");
+    }
+
+    // Create the local marker graph.
+    LocalMarkerGraph graph(
+        uint32_t(assemblerInfo->k),
+        reads,
+        readRepeatCounts,
+        compactReadRepeatCounts,
+        markers,
+        markerGraph.vertexTable,
+        *consensusCaller);
+    bool success;
+    if(requestParameters.useStoredConnectivity) {
+        success = extractLocalMarkerGraphUsingStoredConnectivity(
+            requestParameters.vertexId,
+            requestParameters.maxDistance,
+            requestParameters.timeout,
+            requestParameters.useWeakEdges,
+            requestParameters.usePrunedEdges,
+            requestParameters.useShortCycleEdges,
+            requestParameters.useBubbleEdges,
+            requestParameters.useBubbleReplacementEdges,
+            requestParameters.useSuperBubbleEdges,
+            requestParameters.useSuperBubbleReplacementEdges,
+            graph);
+    } else {
+        success = extractLocalMarkerGraph(
+            requestParameters.vertexId,
+            requestParameters.maxDistance,
+            requestParameters.timeout,
+            graph);
+    }
+    if(!success) {
+        throw runtime_error("Timeout for graph creation exceeded.");
+    }
+
+    json << "{\"vertices\":[";
+    bool isFirst = true;
+    BGL_FORALL_VERTICES(v, graph, LocalMarkerGraph) {
+        const LocalMarkerGraphVertex& vertex = graph[v];
+        if(!isFirst) {
+            json << ",";
+        }
+        isFirst = false;
+        json << "[" << vertex.vertexId << "," << vertex.distance << "," <<
+            vertex.markerInfos.size() << "]";
+    }
+    json << "],\"edges\":[";
+    isFirst = true;
+    BGL_FORALL_EDGES(e, graph, LocalMarkerGraph) {
+        const LocalMarkerGraphEdge& edge = graph[e];
+        if(!isFirst) {
+            json << ",";
+        }
+        isFirst = false;
+        json << "[" << graph[source(e, graph)].vertexId << "," <<
+            graph[target(e, graph)].vertexId << ",";
+        if(edge.edgeId == MarkerGraph::invalidEdgeId) {
+            json << "null";
+        } else {
+            json << edge.edgeId;
+        }
+        json << "," << edge.coverage() << "," << edge.consensus() << "]";
+    }
+    json << "]}";
+}
+
+
+
+// Local marker graph with vertex coordinates computed by
+// the built-in layout, without Graphviz.
+// Always uses stored connectivity.
+// Vertices are [vertexId,distance,x,y] and edges are
+// [sourceVertexId,targetVertexId,edgeId].
+void Assembler::localMarkerGraphLayoutApi(const vector<string>& request, ostream& json)
+{
+    LocalMarkerGraphRequestParameters requestParameters;
+    getLocalMarkerGraphRequestParameters(request, requestParameters);
+    if(!requestParameters.vertexIdIsPresent) {
+        throw runtime_error("Missing vertexId.");
+    }
+    if(!requestParameters.maxDistanceIsPresent) {
+        throw runtime_error("Missing maxDistance.");
+    }
+    if(requestParameters.vertexId >= markerGraph.vertices.size()) {
+        throw runtime_error("Invalid vertexId. Must be less than " +
+            to_string(markerGraph.vertices.size()) + ".");
+    }
+
+    CompactLocalMarkerGraph graph;
+    if(!extractCompactLocalMarkerGraph(
+        requestParameters.vertexId,
+        requestParameters.maxDistance,
+        requestParameters.timeout,
+        requestParameters.useWeakEdges,
+        requestParameters.usePrunedEdges,
+        requestParameters.useSuperBubbleEdges,
+        graph)) {
+        throw runtime_error("Timeout for graph creation exceeded.");
+    }
+    if(!graph.computeLayout(requestParameters.timeout)) {
+        throw runtime_error("Timeout for graph layout exceeded.");
+    }
+
+    json << "{\"vertices\":[";
+    for(CompactLocalMarkerGraph::VertexIndex v=0; v<graph.vertices.size(); v++) {
+        const auto& vertex = graph.vertices[v];
+        const auto& p = graph.positions[v];
+        if(v != 0) {
+            json << ",";
+        }
+        json << "[" << vertex.vertexId << "," << vertex.distance << "," <<
+            p[0] << "," << p[1] << "]";
+    }
+    json << "],\"edges\":[";
+    for(CompactLocalMarkerGraph::EdgeIndex e=0; e<graph.edges.size(); e++) {
+        const auto& edge = graph.edges[e];
+        if(e != 0) {
+            json << ",";
+        }
+        json << "[" << graph.vertices[edge.source].vertexId << "," <<
+            graph.vertices[edge.target].vertexId << "," << edge.edgeId << "]";
+    }
+    json << "]}";
+}
+
+#endif
@@ -2,6 +2,7 @@
 
 // Shasta.
 #include "Assembler.hpp"
+#include "CompactLocalMarkerGraph.hpp"
 #include "ConsensusCaller.hpp"
 #include "LocalMarkerGraph.hpp"
 using namespace ChanZuckerberg;
@@ -46,6 +47,13 @@ void Assembler::exploreMarkerGraph(
         return;
     }
 
+    // The built-in layout does not use Graphviz and works on
+    // a CompactLocalMarkerGraph, so it is handled separately.
+    if(requestParameters.layoutMethod == "builtin") {
+        exploreCompactLocalMarkerGraph(requestParameters, html);
+        return;
+    }
+
 
 
     // Create the local marker graph.
@@ -53,6 +61,7 @@ void Assembler::exploreMarkerGraph(
         uint32_t(assemblerInfo->k),
         reads,
         readRepeatCounts,
+        compactReadRepeatCounts,
         markers,
         markerGraph.vertexTable,
         *consensusCaller);
@@ -291,6 +300,80 @@ void Assembler::exploreMarkerGraph(
 
 
 
+// Display the local marker graph using a CompactLocalMarkerGraph
+// and the built-in layout instead of Graphviz.
+// This only shows vertices and edges, but is much faster
+// for large local marker graphs.
+void Assembler::exploreCompactLocalMarkerGraph(
+    const LocalMarkerGraphRequestParameters& requestParameters,
+    ostream& html)
+{
+    if(!requestParameters.useStoredConnectivity) {
+        html << "<p>The built-in layout requires \"Use stored connectivity\".";
+        return;
+    }
+
+    // Create the graph.
+    const auto startTime = steady_clock::now();
+    CompactLocalMarkerGraph graph;
+    if(!extractCompactLocalMarkerGraph(
+        requestParameters.vertexId,
+        requestParameters.maxDistance,
+        requestParameters.timeout,
+        requestParameters.useWeakEdges,
+        requestParameters.usePrunedEdges,
+        requestParameters.useSuperBubbleEdges,
+        graph)) {
+        html << "<p>Timeout for graph creation exceeded. Increase the timeout or reduce the maximum distance from the start vertex.";
+        return;
+    }
+    const double createTime = seconds(steady_clock::now() - startTime);
+
+    // Compute the layout, using the rest of the timeout.
+    if(requestParameters.timeout <= createTime ||
+        !graph.computeLayout(requestParameters.timeout - createTime)) {
+        html << "<p>Timeout for graph layout exceeded. Increase the timeout or reduce the maximum distance from the start vertex.";
+        return;
+    }
+    const double layoutTime = seconds(steady_clock::now() - startTime) - createTime;
+
+    html <<
+        "<h2>Marker graph near marker graph vertex " << requestParameters.vertexId << "</h2>"
+        "<p>The local marker graph has " << graph.vertices.size() <<
+        " vertices and " << graph.edges.size() << " edges. "
+        "Graph creation took " << createTime << " s, layout took " << layoutTime << " s.<br>";
+    graph.writeSvg(html, requestParameters.sizePixels, int(requestParameters.maxDistance));
+
+    // Make the vertices clickable to recompute the graph with the
+    // same parameters, but starting at the clicked vertex.
+    const string urlPrefix =
+        "exploreMarkerGraph?maxDistance=" + to_string(requestParameters.maxDistance) +
+        "&minCoverage=" + to_string(requestParameters.minCoverage) +
+        "&sizePixels=" + to_string(requestParameters.sizePixels) +
+        "&timeout=" + to_string(requestParameters.timeout) +
+        "&layoutMethod=builtin&useStoredConnectivity=on" +
+        (requestParameters.useWeakEdges ? "&useWeakEdges=on" : "") +
+        (requestParameters.usePrunedEdges ? "&usePrunedEdges=on" : "") +
+        (requestParameters.useSuperBubbleEdges ? "&useSuperBubbleEdges=on" : "") +
+        "&vertexId=";
+    html <<
+        "<script>\n"
+        "var svgVertices = document.querySelectorAll('circle[id^=vertex]');\n"
+        "for(var i=0; i<svgVertices.length; i++) {\n"
+        "    svgVertices[i].onclick = function() {\n"
+        "        location.href='" << urlPrefix << "' + this.id.substring(6);\n"
+        "    };\n"
+        "}\n"
+        "var startVertex = document.getElementById('vertex" << requestParameters.vertexId << "');\n"
+        "if(startVertex) {\n"
+        "    var r = startVertex.getBoundingClientRect();\n"
+        "    window.scrollBy((r.left + r.right - window.innerWidth) / 2, (r.top + r.bottom - window.innerHeight) / 2);\n"
+        "}\n"
+        "</script>\n";
+}
+
+
+
 // Extract  from the request the parameters for the display
 // of the local marker graph.
 void Assembler::getLocalMarkerGraphRequestParameters(
@@ -369,6 +452,10 @@ void Assembler::getLocalMarkerGraphRequestParameters(
     getParameterValue(
         request, "portionToDisplay", parameters.portionToDisplay);
 
+    parameters.layoutMethod = "dot";
+    getParameterValue(
+        request, "layoutMethod", parameters.layoutMethod);
+
 }
 
 
@@ -489,6 +576,23 @@ void Assembler::LocalMarkerGraphRequestParameters::writeForm(
 
 
 
+        // Radio buttons to choose the layout method.
+        "<br>Layout method:"
+
+        "<br><input type=radio name=layoutMethod value=dot" <<
+        (layoutMethod!="builtin" ? " checked=on" : "") <<
+        ">Graphviz dot"
+
+        "<br><input type=radio name=layoutMethod value=builtin" <<
+        (layoutMethod=="builtin" ? " checked=on" : "") <<
+        "><span title='Fast force-directed layout that does not use Graphviz. "
+        "Requires \"Use stored connectivity\". "
+        "Only shows vertices and edges, without coverage or sequence information, "
+        "and ignores \"Detailed\" and the portion of the graph to display. "
+        "Use this for large graphs.'>Built-in (fast, for large graphs)</span>"
+
+
+
         "<br><input type=submit value='Display'>"
 
         " <span style='background-color:#e0e0e0' title='"
@@ -1320,7 +1424,8 @@ void Assembler::exploreMarkerGraphEdge(const vector<string>& request, ostream& h
     const size_t markerCount = edge.coverage;
 
     // The marker intervals of this edge.
-    const MemoryAsContainer<MarkerInterval> markerIntervals = markerGraph.edgeMarkerIntervals[edgeId];
+    vector<MarkerInterval> markerIntervals;
+    getMarkerGraphEdgeMarkerIntervals(edgeId, markerIntervals);
     CZI_ASSERT(markerIntervals.size() == markerCount);
 
     // The length of each marker sequence.
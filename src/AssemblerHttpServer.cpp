@@ -20,6 +20,7 @@
 #include "AlignmentGraph.hpp"
 #include "LocalAlignmentGraph.hpp"
 #include "LocalReadGraph.hpp"
+#include "Progress.hpp"
 #include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
@@ -57,6 +58,7 @@ void Assembler::fillServerFunctionTable()
     CZI_ADD_TO_FUNCTION_TABLE(exploreRead);
     CZI_ADD_TO_FUNCTION_TABLE(blastRead);
     CZI_ADD_TO_FUNCTION_TABLE(exploreAlignments);
+    CZI_ADD_TO_FUNCTION_TABLE(exploreOverlappingReads);
     CZI_ADD_TO_FUNCTION_TABLE(exploreAlignment);
     CZI_ADD_TO_FUNCTION_TABLE(computeAllAlignments);
     CZI_ADD_TO_FUNCTION_TABLE(exploreAlignmentGraph);
@@ -68,6 +70,11 @@ void Assembler::fillServerFunctionTable()
     CZI_ADD_TO_FUNCTION_TABLE(exploreAssemblyGraph);
     CZI_ADD_TO_FUNCTION_TABLE(exploreAssemblyGraphEdge);
 
+    httpServerData.cachedKeywords.insert("/exploreReadGraph");
+    httpServerData.cachedKeywords.insert("/exploreMarkerGraph");
+    httpServerData.cachedKeywords.insert("/exploreAssemblyGraph");
+
+    fillServerApiFunctionTable();
 }
 #undef CZI_ADD_TO_FUNCTION_TABLE
 
@@ -84,6 +91,40 @@ void Assembler::setReferenceFastaFileName(const string& referenceFastaFileName)
 }
 
 
+
+// Create the index of a reference fasta file, using features
+// of m consecutive markers, used by the http server
+// to locate reads in the reference without running Blast.
+void Assembler::createReferenceIndex(const string& fastaFileName, size_t m)
+{
+    checkKmersAreOpen();
+    if(referenceIndex.isOpen()) {
+        referenceIndex.remove();
+    }
+    referenceIndex.createNew(fastaFileName, assemblerInfo->k, getMarkerKmers(), m,
+        largeDataName("ReferenceIndex"), largeDataPageSize);
+}
+
+
+
+void Assembler::accessReferenceIndex()
+{
+    referenceIndex.accessExistingReadOnly(largeDataName("ReferenceIndex"));
+}
+
+
+
+void Assembler::setHttpResponseCacheSize(uint64_t maxByteCount)
+{
+    httpServerData.responseCache.setMaxByteCount(maxByteCount);
+    httpServerData.responseCache.clear();
+}
+void Assembler::clearHttpResponseCache()
+{
+    httpServerData.responseCache.clear();
+}
+
+
 void Assembler::processRequest(
     const vector<string>& request,
     ostream& html,
@@ -131,20 +172,87 @@ void Assembler::processRequest(
     }
 
 
+    // In lazy mode, make sure the data needed by this keyword are accessed.
+    // Then hold the data group mutex in shared mode while processing the request,
+    // so other requests don't access data groups while we use them.
+    accessDataGroupsForKeyword(keyword);
+    std::shared_lock<std::shared_timed_mutex> dataGroupLock(httpServerData.dataGroupMutex);
+
+    // For api keywords, the processing function writes JSON.
+    // Errors are returned as a JSON object with an "error" field.
+    if(keyword.compare(0, 5, "/api/") == 0) {
+        html << "Content-Type: application/json\r\n\r\n";
+        try {
+            const auto function = it->second;
+            (this->*function)(request, html);
+        } catch(std::exception& e) {
+            html << "{\"error\":";
+            writeJsonString(html, e.what());
+            html << "}";
+        }
+        return;
+    }
+
     // We found the keyword. Call the function that processes this keyword.
     // The processing function is only responsible for writing the html body.
     writeHtmlBegin(html);
-    try {
-        const auto function = it->second;
-        (this->*function)(request, html);
-    } catch(std::exception& e) {
-        html << "<br><br><span style='color:purple'>" << e.what() << "</span>";
+    const auto function = it->second;
+    if(httpServerData.cachedKeywords.find(keyword) == httpServerData.cachedKeywords.end()) {
+        try {
+            (this->*function)(request, html);
+        } catch(std::exception& e) {
+            html << "<br><br><span style='color:purple'>" << e.what() << "</span>";
+        }
+    } else {
+
+        // This is a keyword for which we cache responses.
+        // Use the cached response if we have one.
+        // Otherwise, compute the response and store it in the cache,
+        // but only if it completed without errors.
+        const string key = HttpResponseCache::makeKey(request);
+        string response;
+        if(httpServerData.responseCache.get(key, response)) {
+            html << response;
+            html << "<p>This page was served from the response cache.";
+        } else {
+            std::ostringstream s;
+            try {
+                (this->*function)(request, s);
+                response = s.str();
+                httpServerData.responseCache.insert(key, response);
+                html << response;
+            } catch(std::exception& e) {
+                html << s.str();
+                html << "<br><br><span style='color:purple'>" << e.what() << "</span>";
+            }
+        }
     }
     writeHtmlEnd(html);
 }
 
 
 
+// When the http server processes requests concurrently,
+// these requests are processed while no other request is being processed:
+// - computeAllAlignments uses the MultithreadedObject machinery
+//   and computeAllAlignmentsData.
+// - exploreAlignment and displayAlignmentMatrix write
+//   fixed name image files in the current directory.
+// All other requests only read data and are safe to run concurrently.
+bool Assembler::requiresExclusiveAccess(const vector<string>& request) const
+{
+    return keywordRequiresExclusiveAccess(request.front());
+}
+bool Assembler::keywordRequiresExclusiveAccess(const string& keyword)
+{
+    return
+        keyword == "/computeAllAlignments" ||
+        keyword == "/exploreAlignment" ||
+        keyword == "/displayAlignmentMatrix";
+}
+
+
+
 void Assembler::writeHtmlBegin(ostream& html) const
 {
     html <<
@@ -272,100 +380,304 @@ void Assembler::writeNavigation(
 
 
 // Access all available assembly data, without throwing exceptions
-void Assembler::accessAllSoft()
+void Assembler::accessAllSoft(bool verbose)
 {
 
     bool allDataAreAvailable = true;
+    for(uint64_t i=0; i<uint64_t(DataGroup::Count); i++) {
+        if(!accessDataGroup(DataGroup(i))) {
+            allDataAreAvailable = false;
+        }
+    }
 
-    try {
-        accessReadFlags(false);
-    } catch(exception e) {
-        cout << "Read flags are not accessible." << endl;
-        allDataAreAvailable = false;
+    if(!allDataAreAvailable && verbose) {
+        cout << "Not all assembly data are accessible." << endl;
+        cout << "Some functionality is not available." << endl;
     }
+}
 
 
-    try {
-        accessKmers();
-    } catch(exception e) {
-        cout << "K-mers are not accessible." << endl;
-        allDataAreAvailable = false;
-    }
 
+// Access one group of data, without throwing an exception on failure.
+bool Assembler::accessDataGroup(DataGroup dataGroup)
+{
     try {
-        accessMarkers();
-    } catch(exception e) {
-        cout << "Markers are not accessible." << endl;
-        allDataAreAvailable = false;
+        switch(dataGroup) {
+        case DataGroup::ReadFlags:
+            accessReadFlags(false);
+            break;
+        case DataGroup::Kmers:
+            accessKmers();
+            break;
+        case DataGroup::Markers:
+            accessMarkers();
+            break;
+        case DataGroup::SortedMarkers:
+            accessSortedMarkers();
+            break;
+        case DataGroup::ReferenceIndex:
+            accessReferenceIndex();
+            break;
+        case DataGroup::LowHashSketches:
+            accessLowHashSketches();
+            break;
+        case DataGroup::MarkerKmerIndex:
+            accessMarkerKmerIndex();
+            break;
+        case DataGroup::AlignmentCandidates:
+            accessAlignmentCandidates();
+            break;
+        case DataGroup::Alignments:
+            accessAlignmentData();
+            break;
+        case DataGroup::ReadGraph:
+            accessReadGraph();
+            break;
+        case DataGroup::MarkerGraphVertices:
+            accessMarkerGraphVertices();
+            break;
+        case DataGroup::MarkerGraphEdges:
+            accessMarkerGraphEdges(false);
+            break;
+        case DataGroup::AssemblyGraphVertices:
+            accessAssemblyGraphVertices();
+            break;
+        case DataGroup::AssemblyGraphEdges:
+            accessAssemblyGraphEdges();
+            break;
+        case DataGroup::AssemblyGraphEdgeLists:
+            accessAssemblyGraphEdgeLists();
+            break;
+        case DataGroup::AssemblyGraphSequences:
+            accessAssemblyGraphSequences();
+            break;
+        case DataGroup::Count:
+            CZI_ASSERT(0);
+        }
+    } catch(std::exception&) {
+        switch(dataGroup) {
+        case DataGroup::ReadFlags:
+            cout << "Read flags are not accessible." << endl;
+            break;
+        case DataGroup::Kmers:
+            cout << "K-mers are not accessible." << endl;
+            break;
+        case DataGroup::Markers:
+            cout << "Markers are not accessible." << endl;
+            break;
+        case DataGroup::SortedMarkers:
+            // The sorted markers are optional and
+            // don't affect allDataAreAvailable.
+            cout << "Sorted markers are not accessible. "
+                "Markers will be sorted as needed." << endl;
+            return true;
+        case DataGroup::ReferenceIndex:
+            // The reference index is optional.
+            cout << "The reference index is not accessible. "
+                "Blast will be used to locate reads in the reference." << endl;
+            return true;
+        case DataGroup::LowHashSketches:
+            // The LowHash sketches are optional.
+            cout << "LowHash sketches are not accessible. "
+                "Aligning one read with all will align all reads." << endl;
+            return true;
+        case DataGroup::MarkerKmerIndex:
+            // The marker k-mer index is optional.
+            cout << "The marker k-mer index is not accessible. "
+                "Overlapping reads will not be available." << endl;
+            return true;
+        case DataGroup::AlignmentCandidates:
+            cout << "Alignment candidates are not accessible." << endl;
+            break;
+        case DataGroup::Alignments:
+            cout << "Alignments are not accessible." << endl;
+            break;
+        case DataGroup::ReadGraph:
+            cout << "The read graph is not accessible." << endl;
+            break;
+        case DataGroup::MarkerGraphVertices:
+            cout << "Marker graph vertices are not accessible." << endl;
+            break;
+        case DataGroup::MarkerGraphEdges:
+            cout << "Marker graph edges are not accessible." << endl;
+            break;
+        case DataGroup::AssemblyGraphVertices:
+            cout << "Assembly graph vertices are not accessible." << endl;
+            break;
+        case DataGroup::AssemblyGraphEdges:
+            cout << "Assembly graph edges are not accessible." << endl;
+            break;
+        case DataGroup::AssemblyGraphEdgeLists:
+            cout << "Assembly graph edge lists are not accessible." << endl;
+            break;
+        case DataGroup::AssemblyGraphSequences:
+            cout << "Assembly graph sequences are not accessible." << endl;
+            break;
+        case DataGroup::Count:
+            CZI_ASSERT(0);
+        }
+        return false;
     }
+    return true;
+}
 
-    try {
-        accessAlignmentCandidates();
-    } catch(exception e) {
-        cout << "Alignment candidates are not accessible." << endl;
-        allDataAreAvailable = false;
-    }
 
-    try {
-        accessAlignmentData();
-    } catch(exception e) {
-        cout << "Alignments are not accessible." << endl;
-        allDataAreAvailable = false;
-    }
 
-    try {
-        accessReadGraph();
-    } catch(exception e) {
-        cout << "The read graph is not accessible." << endl;
-        allDataAreAvailable = false;
+// Lazy alternative to accessAllSoft.
+// Opening a memory mapped file is cheap, but on a large run
+// accessAllSoft opens dozens of them, and the first
+// pages used by each request are then read from a cold disk
+// one page fault at a time.
+// Here, data groups are only accessed when a request first needs them
+// (see accessDataGroupsForKeyword), and the background prefetch
+// thread brings the commonly used data in memory with large reads.
+void Assembler::accessAllLazy(bool prefetch, size_t threadCount)
+{
+    {
+        std::unique_lock<std::shared_timed_mutex> lock(httpServerData.dataGroupMutex);
+        httpServerData.lazyAccess = true;
+        httpServerData.dataGroupWasAccessed.assign(uint64_t(DataGroup::Count), false);
     }
+    cout << timestamp << "Assembly data will be accessed as needed." << endl;
 
-    try {
-        accessMarkerGraphVertices();
-    } catch(exception e) {
-        cout << "Marker graph vertices are not accessible." << endl;
-        allDataAreAvailable = false;
+    if(prefetch && !httpServerData.prefetchThread.joinable()) {
+        httpServerData.stopPrefetch = false;
+        httpServerData.prefetchThread = std::thread(
+            &Assembler::prefetchThreadFunction, this, threadCount);
     }
+}
 
-    try {
-        accessMarkerGraphEdges(false);
-    } catch(exception e) {
-        cout << "Marker graph edges are not accessible." << endl;
-        allDataAreAvailable = false;
-    }
 
-    try {
-        accessAssemblyGraphVertices();
-    } catch(exception e) {
-        cout << "Assembly graph vertices are not accessible." << endl;
-        allDataAreAvailable = false;
-    }
 
-    try {
-        accessAssemblyGraphEdges();
-    } catch(exception e) {
-        cout << "Assembly graph edges are not accessible." << endl;
-        allDataAreAvailable = false;
-    }
+// Access the data groups that were not already accessed.
+// Requests being processed hold dataGroupMutex in shared mode,
+// so the data groups are accessed while no request is being processed.
+// Most of the time all data groups are already accessed,
+// and we only need the shared lock to find out.
+void Assembler::accessDataGroupsLazily(const vector<DataGroup>& dataGroups)
+{
+    const auto allWereAccessed = [&]()
+    {
+        if(!httpServerData.lazyAccess) {
+            return true;
+        }
+        for(const DataGroup dataGroup: dataGroups) {
+            if(!httpServerData.dataGroupWasAccessed[uint64_t(dataGroup)]) {
+                return false;
+            }
+        }
+        return true;
+    };
 
-    try {
-        accessAssemblyGraphEdgeLists();
-    } catch(exception e) {
-        cout << "Assembly graph edge lists are not accessible." << endl;
-        allDataAreAvailable = false;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(httpServerData.dataGroupMutex);
+        if(allWereAccessed()) {
+            return;
+        }
     }
 
-    try {
-        accessAssemblyGraphSequences();
-    } catch(exception e) {
-        cout << "Assembly graph sequences are not accessible." << endl;
-        allDataAreAvailable = false;
+    std::unique_lock<std::shared_timed_mutex> lock(httpServerData.dataGroupMutex);
+    if(!httpServerData.lazyAccess) {
+        return;
+    }
+    for(const DataGroup dataGroup: dataGroups) {
+        const uint64_t i = uint64_t(dataGroup);
+        if(!httpServerData.dataGroupWasAccessed[i]) {
+            // Only one attempt is made, so data that are not
+            // accessible are only reported once.
+            accessDataGroup(dataGroup);
+            httpServerData.dataGroupWasAccessed[i] = true;
+        }
     }
+}
 
-    if(!allDataAreAvailable) {
-        cout << "Not all assembly data are accessible." << endl;
-        cout << "Some functionality is not available." << endl;
+
+
+// In lazy mode, access the data groups needed to process
+// a request for this keyword.
+// The run summary only uses sizes, so it only needs
+// the data groups it reports on. The pages that explore reads
+// and alignments don't use the assembly graph.
+// All other keywords access everything, so
+// their processing functions see the same data as with accessAllSoft.
+void Assembler::accessDataGroupsForKeyword(const string& keyword)
+{
+    static const std::set<string> summaryKeywords = {
+        "", "/", "/index", "/exploreSummary", "/api/summary"};
+    static const std::set<string> readKeywords = {
+        "/exploreRead", "/blastRead", "/exploreAlignments", "/exploreAlignment",
+        "/exploreOverlappingReads",
+        "/computeAllAlignments", "/exploreAlignmentGraph", "/displayAlignmentMatrix",
+        "/exploreReadGraph", "/api/read", "/api/markers", "/api/alignments"};
+
+    vector<DataGroup> dataGroups;
+    if(summaryKeywords.find(keyword) != summaryKeywords.end()) {
+        dataGroups = {
+            DataGroup::Kmers,
+            DataGroup::Markers,
+            DataGroup::AlignmentCandidates,
+            DataGroup::Alignments,
+            DataGroup::MarkerGraphVertices};
+    } else if(readKeywords.find(keyword) != readKeywords.end()) {
+        for(uint64_t i=0; i<=uint64_t(DataGroup::MarkerGraphEdges); i++) {
+            dataGroups.push_back(DataGroup(i));
+        }
+    } else {
+        for(uint64_t i=0; i<uint64_t(DataGroup::Count); i++) {
+            dataGroups.push_back(DataGroup(i));
+        }
     }
+    accessDataGroupsLazily(dataGroups);
+}
+
+
+
+// The function run by the background prefetch thread.
+// It accesses the commonly used data groups and loads in memory
+// the data that almost every request touches: read flags,
+// the tables of contents of the markers and marker graph vertices,
+// and the assembly graph, which is small.
+// The bulk of the markers and marker graph, which on a large run
+// can exceed the available memory, is left to page faults.
+void Assembler::prefetchThreadFunction(size_t threadCount)
+{
+    const auto t0 = steady_clock::now();
+    accessDataGroupsLazily({
+        DataGroup::ReadFlags,
+        DataGroup::Kmers,
+        DataGroup::Markers,
+        DataGroup::MarkerGraphVertices,
+        DataGroup::AssemblyGraphVertices,
+        DataGroup::AssemblyGraphEdges});
+
+    // The data groups accessed above are not modified
+    // after they are accessed, so we can read them
+    // without holding the mutex.
+    size_t byteCount = 0;
+    const auto prefetch = [&](const auto& v)
+    {
+        if(v.isOpen && !httpServerData.stopPrefetch) {
+            byteCount += v.size() * sizeof(v[0]);
+            v.prefetch(threadCount);
+        }
+    };
+    prefetch(readFlags);
+    prefetch(markers.getToc());
+    prefetch(markerGraph.vertices.getToc());
+    prefetch(assemblyGraph.vertices);
+    prefetch(assemblyGraph.reverseComplementVertex);
+    prefetch(assemblyGraph.markerToAssemblyTable);
+    prefetch(assemblyGraph.edges);
+    prefetch(assemblyGraph.reverseComplementEdge);
+    if(assemblyGraph.edgesBySource.isOpen() && assemblyGraph.edgesByTarget.isOpen() &&
+        !httpServerData.stopPrefetch) {
+        assemblyGraph.edgesBySource.prefetch(threadCount);
+        assemblyGraph.edgesByTarget.prefetch(threadCount);
+    }
+
+    const auto t1 = steady_clock::now();
+    cout << timestamp << "Background prefetch of " << byteCount <<
+        " bytes of assembly data completed in " << seconds(t1 - t0) << " s." << endl;
 }
 
 
@@ -388,12 +700,8 @@ void Assembler::exploreSummary(
 #endif
 
     // Compute the number of k-mers used as markers.
-    uint64_t markerKmerCount = 0;
-    for(const auto& tableEntry: kmerTable) {
-        if(tableEntry.isMarker) {
-            ++ markerKmerCount;
-        }
-    }
+    const uint64_t kmerCount = 1ULL << (2ULL*assemblerInfo->k);
+    const uint64_t markerKmerCount = getMarkerKmers().count(assemblerInfo->k);
 
 
     html <<
@@ -417,13 +725,13 @@ void Assembler::exploreSummary(
         "<td class=right>" << assemblerInfo->k <<
 
         "<tr><td title='The total number of k-mers of length k'>Total k-mers"
-        "<td class=right>" << kmerTable.size() <<
+        "<td class=right>" << kmerCount <<
 
         "<tr><td title='The number of k-mers of length k used as markers'>Marker k-mers"
         "<td class=right>" << markerKmerCount <<
 
         "<tr><td title='The fraction of k-mers of length k used as markers'>Marker fraction"
-        "<td class=right>" << setprecision(3) << double(markerKmerCount) / double(kmerTable.size()) <<
+        "<td class=right>" << setprecision(3) << double(markerKmerCount) / double(kmerCount) <<
 
         "<tr><td title='Total number of markers on both strands'>Oriented markers"
         "<td class=right>" << markers.totalSize() <<
@@ -449,6 +757,27 @@ void Assembler::exploreSummary(
         "<td class=right>" << markerGraph.vertices.size() <<
 
         "</table>";
+
+
+
+    // If a stage is running in this process, show its progress.
+    const Progress::Status progressStatus = Progress::getStatus();
+    if(!progressStatus.stageName.empty()) {
+        html << "<h2>Progress</h2><p>" << Progress::getDescription(progressStatus);
+    }
+
+
+
+    // Time and memory used by each stage of the assembly.
+    // If this is not the process that ran the assembly,
+    // get them from the csv file written at the end of the assembly.
+    if(performanceReport.stages.empty()) {
+        performanceReport.readCsv("PerformanceReport.csv");
+    }
+    if(!performanceReport.stages.empty()) {
+        html << "<h2>Performance</h2>";
+        performanceReport.writeHtml(html);
+    }
 }
 
 
@@ -459,10 +788,29 @@ void Assembler::exploreRead(
 {
     // Get the ReadId and Strand from the request.
     ReadId readId = 0;
-    const bool readIdIsPresent = getParameterValue(request, "readId", readId);
+    bool readIdIsPresent = getParameterValue(request, "readId", readId);
     Strand strand = 0;
     const bool strandIsPresent = getParameterValue(request, "strand", strand);
 
+    // If a read name was specified, it takes precedence over the ReadId.
+    // Use the read name index to find the ReadId.
+    string requestedReadName;
+    const bool readNameIsPresent =
+        getParameterValue(request, "readName", requestedReadName) &&
+        !requestedReadName.empty();
+    if(readNameIsPresent) {
+        if(!readNameIndex.isOpen()) {
+            html << "<p>The read name index is not available.";
+            return;
+        }
+        readId = getReadId(requestedReadName);
+        if(readId == ReadNameIndex::invalidReadId) {
+            html << "<p>There is no read with name " << requestedReadName << ".";
+            return;
+        }
+        readIdIsPresent = true;
+    }
+
     // Get the begin and end position.
     uint32_t beginPosition = 0;
     const bool beginPositionIsPresent = getParameterValue(request, "beginPosition", beginPosition);
@@ -485,9 +833,11 @@ void Assembler::exploreRead(
     html <<
         "<form>"
         "<input type=submit value='Show read'> "
-        "<input type=text name=readId required" <<
+        "<input type=text name=readId" <<
         (readIdIsPresent ? (" value=" + to_string(readId)) : "") <<
         " size=8 title='Enter a read id between 0 and " << reads.size()-1 << "'>"
+        " or read name <input type=text name=readName size=20"
+        " title='Enter a read name instead of a read id'>"
         " on strand ";
     writeStrandSelection(html, "strand", strandIsPresent && strand==0, strandIsPresent && strand==1);
     html << "<br><input type=text name=beginPosition size=8";
@@ -612,14 +962,19 @@ void Assembler::exploreRead(
 
 
     // Button to Blast this read or portion of a read (summary output).
+    // If the reference index is available, it is used instead of Blast.
     html <<
         "<p><form action='blastRead'>"
-        "<input type=submit value='Blast ";
+        "<input type=submit value='" << (referenceIndex.isOpen() ? "Locate " : "Blast ");
     if(beginPositionIsPresent || endPositionIsPresent) {
         html << "this portion of ";
     }
+    if(referenceIndex.isOpen()) {
+        html << "this read in the reference using the reference index'>";
+    } else {
+        html << "this read against " << httpServerData.referenceFastaFileName << " (summary output)'>";
+    }
     html <<
-        "this read against " << httpServerData.referenceFastaFileName << " (summary output)'>"
         "<input type=text hidden name=readId value=" << readId << ">" <<
         "<input type=text hidden name=strand value=" << strand << ">" <<
         "<input type=text hidden name=beginPosition value=" << beginPosition << ">" <<
@@ -1045,15 +1400,6 @@ void Assembler::blastRead(
     const vector<string>& request,
     ostream& html)
 {
-
-    if(!filesystem::isRegularFile(httpServerData.referenceFastaFileName)) {
-        html << "<p>The fasta sequence " << httpServerData.referenceFastaFileName <<
-            " to be used as the reference (Blast subject) does not exist.";
-        return;
-    }
-
-
-
     // Get the ReadId and Strand from the request.
     ReadId readId = 0;
     const bool readIdIsPresent = getParameterValue(request, "readId", readId);
@@ -1083,6 +1429,15 @@ void Assembler::blastRead(
             // "-reward 3 -penalty -2 -gapopen 5 -gapextend 5";
     }
 
+    // For summary output, use the reference index instead of Blast,
+    // if it is available.
+    const bool useReferenceIndex = isSummary && referenceIndex.isOpen();
+    if(!useReferenceIndex && !filesystem::isRegularFile(httpServerData.referenceFastaFileName)) {
+        html << "<p>The fasta sequence " << httpServerData.referenceFastaFileName <<
+            " to be used as the reference (Blast subject) does not exist.";
+        return;
+    }
+
 
 
     // Access the read.
@@ -1107,10 +1462,16 @@ void Assembler::blastRead(
 
 
     // Write a title.
-    html << "<h1>Blast results for oriented read " << orientedReadId;
+    html << "<h1>" << (useReferenceIndex ? "Reference index" : "Blast") <<
+        " results for oriented read " << orientedReadId;
     html << ", position range " << beginPosition << " " << endPosition;
     html << " (" << endPosition-beginPosition << " bases)</h1>";
 
+    if(useReferenceIndex) {
+        locateReadInReference(orientedReadId, beginPosition, endPosition, request, html);
+        return;
+    }
+
 
 
     // Create a fasta file with this sequence.
@@ -1257,6 +1618,95 @@ void Assembler::blastRead(
 
 
 
+// Locate a portion of an oriented read in the reference
+// using the reference index, and write the alignments found
+// in the same format as the Blast summary output.
+void Assembler::locateReadInReference(
+    OrientedReadId orientedReadId,
+    uint32_t beginPosition,
+    uint32_t endPosition,
+    const vector<string>& request,
+    ostream& html)
+{
+    const auto t0 = steady_clock::now();
+
+    // Get the parameters.
+    uint64_t maxFrequency = 1000;
+    getParameterValue(request, "maxFrequency", maxFrequency);
+    uint64_t maxDiagonalGap = 100;
+    getParameterValue(request, "maxDiagonalGap", maxDiagonalGap);
+    uint64_t minFeatureCount = 5;
+    getParameterValue(request, "minFeatureCount", minFeatureCount);
+
+    // Gather the markers of the oriented read in the requested position range,
+    // with their raw positions.
+    const uint64_t k = assemblerInfo->k;
+    const vector<uint32_t> rawPositions = getRawPositions(orientedReadId);
+    const uint32_t rawLength = uint32_t(getReadRawSequenceLength(orientedReadId.getReadId()));
+    const OrientedReadMarkers orientedReadMarkers = getOrientedReadMarkers(orientedReadId);
+    vector<ReferenceIndex::QueryMarker> queryMarkers;
+    for(uint64_t ordinal=0; ordinal<orientedReadMarkers.size(); ordinal++) {
+        const uint32_t position = orientedReadMarkers.position(ordinal);
+        ReferenceIndex::QueryMarker queryMarker;
+        queryMarker.kmerId = orientedReadMarkers.kmerId(ordinal);
+        queryMarker.begin = rawPositions[position];
+        queryMarker.end = (position + k < rawPositions.size()) ? rawPositions[position + k] : rawLength;
+        if(queryMarker.begin >= beginPosition && queryMarker.end <= endPosition) {
+            queryMarkers.push_back(queryMarker);
+        }
+    }
+
+    // Locate it in the reference.
+    vector<ReferenceIndex::Alignment> alignments;
+    referenceIndex.align(k, queryMarkers, maxFrequency, maxDiagonalGap, minFeatureCount, alignments);
+    const auto t1 = steady_clock::now();
+
+    html <<
+        "<p>Located " << queryMarkers.size() << " markers of this portion of the read "
+        "using features of " << referenceIndex.m() << " consecutive markers in " <<
+        seconds(t1 - t0) << " s. Found " << alignments.size() << " alignments."
+        "<br>Parameters used: maxFrequency " << maxFrequency <<
+        ", maxDiagonalGap " << maxDiagonalGap <<
+        ", minFeatureCount " << minFeatureCount <<
+        " (these can be changed by adding them to the URL)."
+        "<br>Positions are raw positions, zero-based, and end positions are one past the end.<p>";
+
+    // Write it out.
+    html <<
+        "<table><tr>"
+        "<th rowspan=2>Aligned<br>features"
+        "<th colspan=3>In " << orientedReadId <<
+        "<th colspan=5>In reference"
+        "<th rowspan=2>Aligned<br>feature<br>fraction"
+        "<tr>"
+        "<th>Begin"
+        "<th>End"
+        "<th>Length"
+        "<th>Strand"
+        "<th>Name"
+        "<th>Begin"
+        "<th>End"
+        "<th>Length";
+    for(const ReferenceIndex::Alignment& alignment: alignments) {
+        html <<
+            "<tr style='text-align:center'>"
+            "<td>" << alignment.featureCount <<
+            "<td>" << alignment.queryBegin <<
+            "<td>" << alignment.queryEnd <<
+            "<td>" << alignment.queryEnd - alignment.queryBegin <<
+            "<td>" << (alignment.strand==0 ? "+" : "-") << " (" << alignment.strand << ")"
+            "<td>" << referenceIndex.sequenceName(alignment.sequenceId) <<
+            "<td>" << alignment.referenceBegin <<
+            "<td>" << alignment.referenceEnd <<
+            "<td>" << alignment.referenceEnd - alignment.referenceBegin <<
+            "<td>" << std::setprecision(3) <<
+            double(alignment.featureCount) / double(alignment.queryFeatureCount);
+    }
+    html << "</table>";
+}
+
+
+
 void Assembler::exploreAlignments(
     const vector<string>& request,
     ostream& html)
@@ -1324,6 +1774,173 @@ void Assembler::exploreAlignments(
 
 
 
+// Find the oriented reads that share markers with a given oriented read,
+// using the marker k-mer index. This does not compute alignments,
+// so it is fast even on a large run.
+void Assembler::exploreOverlappingReads(
+    const vector<string>& request,
+    ostream& html)
+{
+    // Get the parameters.
+    ReadId readId0 = 0;
+    const bool readId0IsPresent = getParameterValue(request, "readId", readId0);
+    Strand strand0 = 0;
+    const bool strand0IsPresent = getParameterValue(request, "strand", strand0);
+    uint64_t maxMarkerFrequency = 100;
+    getParameterValue(request, "maxMarkerFrequency", maxMarkerFrequency);
+    uint64_t minSharedMarkerCount = 20;
+    getParameterValue(request, "minSharedMarkerCount", minSharedMarkerCount);
+
+    // Write the form.
+    html <<
+        "<form>"
+        "<input type=submit value='Find oriented reads that overlap oriented read'> "
+        "<input type=text name=readId required" <<
+        (readId0IsPresent ? (" value=" + to_string(readId0)) : "") <<
+        " size=8 title='Enter a read id between 0 and " << reads.size()-1 << "'>"
+        " on strand ";
+    writeStrandSelection(html, "strand", strand0IsPresent && strand0==0, strand0IsPresent && strand0==1);
+    html <<
+        "<br>Only use marker k-mers that occur at most "
+        "<input type=text name=maxMarkerFrequency required size=8 value=" << maxMarkerFrequency << ">"
+        " times in all oriented reads."
+        "<br>Minimum number of shared markers "
+        "<input type=text name=minSharedMarkerCount required size=8 value=" << minSharedMarkerCount << ">"
+        "</form>";
+
+    // If the readId or strand are missing, stop here.
+    if(!readId0IsPresent || !strand0IsPresent) {
+        return;
+    }
+    if(readId0 >= reads.size()) {
+        html << "<p>Invalid read id.";
+        return;
+    }
+    if(strand0!=0 && strand0!=1) {
+        html << "<p>Invalid strand.";
+        return;
+    }
+    if(!markerKmerIndex.isOpen()) {
+        html << "<p>The marker k-mer index is not available. "
+            "It can be created using Python function createMarkerKmerIndex.";
+        return;
+    }
+    const OrientedReadId orientedReadId0(readId0, strand0);
+    const auto t0 = steady_clock::now();
+
+    // Gather the markers of other oriented reads with the same k-mers
+    // as the markers of orientedReadId0.
+    class Hit {
+    public:
+        OrientedReadId orientedReadId1;
+        uint32_t ordinal0;
+        uint32_t ordinal1;
+        bool operator<(const Hit& that) const
+        {
+            return orientedReadId1 < that.orientedReadId1;
+        }
+    };
+    vector<Hit> hits;
+    vector<MarkerKmerIndex::Posting> postings;
+    const OrientedReadMarkers orientedReadMarkers0 = getOrientedReadMarkers(orientedReadId0);
+    const uint32_t markerCount0 = uint32_t(orientedReadMarkers0.size());
+    for(uint32_t ordinal0=0; ordinal0<markerCount0; ordinal0++) {
+        const KmerId kmerId = orientedReadMarkers0.kmerId(ordinal0);
+        if(markerKmerIndex.frequency(kmerId) > maxMarkerFrequency) {
+            continue;
+        }
+        markerKmerIndex.get(kmerId, postings);
+        for(const MarkerKmerIndex::Posting& posting: postings) {
+            if(posting.orientedReadId.getReadId() == readId0) {
+                continue;
+            }
+            Hit hit;
+            hit.orientedReadId1 = posting.orientedReadId;
+            hit.ordinal0 = ordinal0;
+            hit.ordinal1 = posting.ordinal;
+            hits.push_back(hit);
+        }
+    }
+    stable_sort(hits.begin(), hits.end());
+
+    // Summarize the hits for each oriented read.
+    class OverlappingRead {
+    public:
+        OrientedReadId orientedReadId1;
+        uint64_t sharedMarkerCount;
+        array<uint32_t, 2> minOrdinal;
+        array<uint32_t, 2> maxOrdinal;
+        bool operator<(const OverlappingRead& that) const
+        {
+            return sharedMarkerCount > that.sharedMarkerCount;
+        }
+    };
+    vector<OverlappingRead> overlappingReads;
+    for(auto it=hits.begin(); it!=hits.end(); ) {
+        auto groupEnd = it;
+        OverlappingRead overlappingRead;
+        overlappingRead.orientedReadId1 = it->orientedReadId1;
+        overlappingRead.minOrdinal = {it->ordinal0, it->ordinal1};
+        overlappingRead.maxOrdinal = {it->ordinal0, it->ordinal1};
+        for(; groupEnd!=hits.end() && groupEnd->orientedReadId1==it->orientedReadId1; ++groupEnd) {
+            overlappingRead.minOrdinal[0] = min(overlappingRead.minOrdinal[0], groupEnd->ordinal0);
+            overlappingRead.minOrdinal[1] = min(overlappingRead.minOrdinal[1], groupEnd->ordinal1);
+            overlappingRead.maxOrdinal[0] = max(overlappingRead.maxOrdinal[0], groupEnd->ordinal0);
+            overlappingRead.maxOrdinal[1] = max(overlappingRead.maxOrdinal[1], groupEnd->ordinal1);
+        }
+        overlappingRead.sharedMarkerCount = uint64_t(groupEnd - it);
+        if(overlappingRead.sharedMarkerCount >= minSharedMarkerCount) {
+            overlappingReads.push_back(overlappingRead);
+        }
+        it = groupEnd;
+    }
+    stable_sort(overlappingReads.begin(), overlappingReads.end());
+    const auto t1 = steady_clock::now();
+
+    // Write them out.
+    html <<
+        "<h1>Oriented reads that overlap oriented read "
+        "<a href='exploreRead?readId=" << readId0  << "&strand=" << strand0 << "'>"
+        << orientedReadId0 << "</a>"
+        << " (" << markerCount0 << " markers)"
+        "</h1>"
+        "<p>Found " << overlappingReads.size() << " oriented reads sharing at least " <<
+        minSharedMarkerCount << " markers with this oriented read in " <<
+        seconds(t1 - t0) << " s. Shared markers are not necessarily in alignment. "
+        "Click on the number of shared markers to compute an alignment."
+        "<table><tr>"
+        "<th rowspan=2>Other<br>oriented<br>read"
+        "<th rowspan=2>Shared<br>markers"
+        "<th colspan=3>Markers on oriented read " << orientedReadId0 <<
+        "<th colspan=3>Markers on other oriented read"
+        "<tr>"
+        "<th>First<br>shared<th>Last<br>shared<th>Total"
+        "<th>First<br>shared<th>Last<br>shared<th>Total";
+    for(const OverlappingRead& overlappingRead: overlappingReads) {
+        const OrientedReadId orientedReadId1 = overlappingRead.orientedReadId1;
+        const ReadId readId1 = orientedReadId1.getReadId();
+        const Strand strand1 = orientedReadId1.getStrand();
+        html <<
+            "<tr>"
+            "<td class=centered><a href='exploreRead?readId=" << readId1  << "&strand=" << strand1 <<
+            "' title='Click to see this read'>" << orientedReadId1 << "</a>"
+            "<td class=centered>"
+            "<a href='exploreAlignment"
+            "?readId0=" << readId0 << "&strand0=" << strand0 <<
+            "&readId1=" << readId1 << "&strand1=" << strand1 <<
+            "' title='Click to compute the alignment'>" << overlappingRead.sharedMarkerCount << "</a>"
+            "<td class=centered>" << overlappingRead.minOrdinal[0] <<
+            "<td class=centered>" << overlappingRead.maxOrdinal[0] <<
+            "<td class=centered>" << markerCount0 <<
+            "<td class=centered>" << overlappingRead.minOrdinal[1] <<
+            "<td class=centered>" << overlappingRead.maxOrdinal[1] <<
+            "<td class=centered>" << getMarkerCount(orientedReadId1);
+    }
+    html << "</table>";
+}
+
+
+
 // Display alignments in an html table.
 void Assembler::displayAlignments(
     OrientedReadId orientedReadId0,
@@ -1551,7 +2168,7 @@ void Assembler::exploreAlignment(
     const bool debug = true;
     alignOrientedReads(
         markersSortedByKmerId,
-        maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
+        maxSkip, maxMarkerFrequency, 0, debug, graph, alignment, alignmentInfo);
     if(alignment.ordinals.empty()) {
         html << "<p>The alignment is empty (it has no markers).";
         return;
@@ -2067,6 +2684,16 @@ void Assembler::computeAllAlignments(
     computeAllAlignmentsData.maxTrim = 30;
     getParameterValue(request, "maxTrim", computeAllAlignmentsData.maxTrim);
 
+    // The LowHash sketches, if available, are used by default
+    // to only align candidate reads.
+    const bool lowHashSketchesAreAvailable =
+        lowHashSketches.isOpen() &&
+        lowHashSketches.info->markerKmersHash == getMarkerKmersHash();
+    string candidates = lowHashSketchesAreAvailable ? "lowHash" : "all";
+    getParameterValue(request, "candidates", candidates);
+    computeAllAlignmentsData.minFrequency = 2;
+    getParameterValue(request, "minFrequency", computeAllAlignmentsData.minFrequency);
+
 
     // Write the form.
     html <<
@@ -2091,6 +2718,17 @@ void Assembler::computeAllAlignments(
         "<br>Maximum number of trimmed markers"
         "<input type=text name=maxTrim required size=8 value=" <<
         computeAllAlignmentsData.maxTrim << ">"
+        "<br><input type=radio name=candidates value=lowHash" <<
+        (candidates=="lowHash" ? " checked" : "") <<
+        (lowHashSketchesAreAvailable ? "" : " disabled") <<
+        "> Only align oriented reads that share at least "
+        "<input type=text name=minFrequency required size=8 value=" <<
+        computeAllAlignmentsData.minFrequency << ">"
+        " low hashes with this oriented read in the stored LowHash sketches" <<
+        (lowHashSketchesAreAvailable ? "" : " (not available)") <<
+        "<br><input type=radio name=candidates value=all" <<
+        (candidates=="all" ? " checked" : "") <<
+        "> Align all oriented reads"
         "</form>";
 
 
@@ -2107,10 +2745,37 @@ void Assembler::computeAllAlignments(
     getMarkersSortedByKmerId(orientedReadId0, markers0SortedByKmerId);
 
 
+    // If using the LowHash sketches, get the low hashes
+    // of orientedReadId0 for each iteration, sorted.
+    computeAllAlignmentsData.useLowHashSketches = false;
+    computeAllAlignmentsData.lowHashes0.clear();
+    if(candidates == "lowHash") {
+        if(!lowHashSketchesAreAvailable) {
+            html << "<p>LowHash sketches for the current marker k-mers are not available. "
+                "All oriented reads will be aligned.";
+        } else if(readId0 >= lowHashSketches.info->readCount) {
+            html << "<p>This read was added after the LowHash sketches were stored. "
+                "All oriented reads will be aligned.";
+        } else {
+            computeAllAlignmentsData.useLowHashSketches = true;
+            const uint64_t i = orientedReadId0.getValue();
+            const uint64_t* lowHashes = lowHashSketches.lowHashes.begin(i);
+            const uint32_t* lowHashesBegin = lowHashSketches.lowHashesBegin.begin(i);
+            const uint64_t iterationCount = lowHashSketches.lowHashesBegin.size(i) - 1;
+            computeAllAlignmentsData.lowHashes0.resize(iterationCount);
+            for(uint64_t iteration=0; iteration<iterationCount; iteration++) {
+                vector<uint64_t>& v = computeAllAlignmentsData.lowHashes0[iteration];
+                v.assign(lowHashes + lowHashesBegin[iteration], lowHashes + lowHashesBegin[iteration+1]);
+                sort(v.begin(), v.end());
+            }
+        }
+    }
+
     // Compute the alignments in parallel.
     computeAllAlignmentsData.orientedReadId0 = orientedReadId0;
     const size_t threadCount =std::thread::hardware_concurrency();
     computeAllAlignmentsData.threadAlignments.resize(threadCount);
+    computeAllAlignmentsData.threadComputedAlignmentCount.assign(threadCount, 0);
     const size_t batchSize = 1000;
     setupLoadBalancing(reads.size(), batchSize);
     const auto t0 = std::chrono::steady_clock::now();
@@ -2121,12 +2786,18 @@ void Assembler::computeAllAlignments(
 
     // Gather the alignments found by each thread.
     vector< pair<OrientedReadId, AlignmentInfo> > alignments;
+    uint64_t computedAlignmentCount = 0;
     for(size_t threadId=0; threadId<threadCount; threadId++) {
         const vector< pair<OrientedReadId, AlignmentInfo> >& threadAlignments =
             computeAllAlignmentsData.threadAlignments[threadId];
         copy(threadAlignments.begin(), threadAlignments.end(), back_inserter(alignments));
+        computedAlignmentCount += computeAllAlignmentsData.threadComputedAlignmentCount[threadId];
     }
     computeAllAlignmentsData.threadAlignments.clear();
+    computeAllAlignmentsData.lowHashes0.clear();
+    html << "<p>Computed " << computedAlignmentCount << " alignments" <<
+        (computeAllAlignmentsData.useLowHashSketches ?
+            " with oriented reads selected using the LowHash sketches." : ".");
     sort(alignments.begin(), alignments.end(),
         OrderPairsByFirstOnly<OrientedReadId, AlignmentInfo>());
 
@@ -2221,10 +2892,16 @@ void Assembler::computeAllAlignmentsThreadFunction(size_t threadId)
     const uint32_t maxMarkerFrequency = computeAllAlignmentsData.maxMarkerFrequency;
     const size_t minAlignedMarkerCount =computeAllAlignmentsData.minAlignedMarkerCount;
     const size_t maxTrim =computeAllAlignmentsData.maxTrim;
+    const bool useLowHashSketches = computeAllAlignmentsData.useLowHashSketches;
+    const size_t minFrequency = computeAllAlignmentsData.minFrequency;
+    const vector< vector<uint64_t> >& lowHashes0 = computeAllAlignmentsData.lowHashes0;
+    const ReadId sketchReadCount = useLowHashSketches ? ReadId(lowHashSketches.info->readCount) : 0;
 
     // Vector where this thread will store the alignments it finds.
     vector< pair<OrientedReadId, AlignmentInfo> >& alignments =
         computeAllAlignmentsData.threadAlignments[threadId];
+    uint64_t& computedAlignmentCount =
+        computeAllAlignmentsData.threadComputedAlignmentCount[threadId];
 
     // Reusable data structures for alignOrientedReads.
     AlignmentGraph graph;
@@ -2257,6 +2934,31 @@ void Assembler::computeAllAlignmentsThreadFunction(size_t threadId)
                     continue;
                 }
 
+                // If using the LowHash sketches, skip this oriented read
+                // if it does not share enough low hashes with orientedReadId0.
+                // This only reads its low hashes, which is much faster
+                // than computing the alignment.
+                if(useLowHashSketches && readId1 < sketchReadCount) {
+                    const uint64_t i = orientedReadId1.getValue();
+                    const uint64_t* lowHashes1 = lowHashSketches.lowHashes.begin(i);
+                    const uint32_t* lowHashesBegin1 = lowHashSketches.lowHashesBegin.begin(i);
+                    uint64_t frequency = 0;
+                    for(uint64_t iteration=0; iteration<lowHashes0.size(); iteration++) {
+                        const vector<uint64_t>& v0 = lowHashes0[iteration];
+                        if(v0.empty()) {
+                            continue;
+                        }
+                        for(uint32_t j=lowHashesBegin1[iteration]; j!=lowHashesBegin1[iteration+1]; j++) {
+                            if(std::binary_search(v0.begin(), v0.end(), lowHashes1[j])) {
+                                ++frequency;
+                            }
+                        }
+                    }
+                    if(frequency < minFrequency) {
+                        continue;
+                    }
+                }
+
                 // Get markers sorted by kmer id.
                 getMarkersSortedByKmerId(orientedReadId1, markersSortedByKmerId[1]);
 
@@ -2264,7 +2966,8 @@ void Assembler::computeAllAlignmentsThreadFunction(size_t threadId)
                 const bool debug = false;
                 alignOrientedReads(
                     markersSortedByKmerId,
-                    maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
+                    maxSkip, maxMarkerFrequency, 0, debug, graph, alignment, alignmentInfo);
+                ++computedAlignmentCount;
 
                 // If the alignment has too few markers skip it.
                 if(alignment.ordinals.size() < minAlignedMarkerCount) {
@@ -1,22 +1,55 @@
+// shasta.
 #include "Assembler.hpp"
+#include "filesystem.hpp"
+#include "KmerIterator.hpp"
+#include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
+// Standard libraries.
+#include "chrono.hpp"
 #include <random>
 
 
 
+// Access the bitmap of marker k-mers and, if k is not too large,
+// the k-mer table. Assemblies created before the bitmap was stored
+// only have the k-mer table. In that case the bitmap
+// is reconstructed from it in anonymous memory.
 void Assembler::accessKmers()
 {
-    kmerTable.accessExistingReadOnly(largeDataName("Kmers"));
-    if(kmerTable.size() != (1ULL<< (2*assemblerInfo->k))) {
-        throw runtime_error("Size of k-mer vector is inconsistent with stored value of k.");
+    const size_t k = assemblerInfo->k;
+    const bool markerKmersExist = filesystem::exists(largeDataName("MarkerKmers"));
+    if(!markerKmersExist && k > maxKmerTableK) {
+        throw runtime_error("The bitmap of marker k-mers is missing, and k is too large "
+            "for a k-mer table to be available.");
+    }
+    if(k <= maxKmerTableK) {
+        kmerTable.accessExistingReadOnly(largeDataName("Kmers"));
+        if(kmerTable.size() != (1ULL<< (2*k))) {
+            throw runtime_error("Size of k-mer vector is inconsistent with stored value of k.");
+        }
+    }
+
+    if(markerKmersExist) {
+        markerKmers.accessExistingReadOnly(largeDataName("MarkerKmers"));
+        if(markerKmers.size() != KmerBitmap::wordCount(k)) {
+            throw runtime_error("Size of marker k-mer bitmap is inconsistent with stored value of k.");
+        }
+    } else {
+        markerKmers.createNew("", largeDataPageSize, KmerBitmap::wordCount(k));
+        fill(markerKmers.begin(), markerKmers.end(), 0ULL);
+        for(uint64_t kmerId=0; kmerId<kmerTable.size(); kmerId++) {
+            if(kmerTable[kmerId].isMarker) {
+                KmerBitmap::set(markerKmers.begin(), KmerId(kmerId));
+            }
+        }
     }
 }
 
 void Assembler::checkKmersAreOpen()const
 {
-    if(!kmerTable.isOpen) {
+    if(!markerKmers.isOpen) {
         throw runtime_error("Kmers are not accessible.");
     }
 }
@@ -64,54 +97,259 @@ void Assembler::randomlySelectKmers(
         CZI_ASSERT(p == 1.);
     }
 
+    // Select the markers.
+    selectKmers(k, p, seed, 0);
 
-
-    // Create the kmer table with the necessary size.
-    kmerTable.createNew(largeDataName("Kmers"), largeDataPageSize);
     const size_t kmerCount = 1ULL << (2ULL*k);
-    kmerTable.resize(kmerCount);
+    const size_t usedKmerCount = getMarkerKmers().count(k);
+    cout << "Selected " << usedKmerCount << " " << k << "-mers out of ";
+    cout << kmerCount << " total." << endl;
+    cout << "Requested probability: " << probability << "." << endl;
+    cout << "Actual fraction: ";
+    cout << double(usedKmerCount)/double(kmerCount) << "." << endl;
 
-    // Store the reverse complement of each k-mer.
-    for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
-        const Kmer kmer(kmerId, k);
-        const Kmer reverseComplementedKmer = kmer.reverseComplement(k);
-        kmerTable[kmerId].reverseComplementedKmerId = KmerId(reverseComplementedKmer.id(k));
+    if(probability == 1.) {
+        CZI_ASSERT(usedKmerCount == kmerCount);
     }
-    for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
-        const uint64_t reverseComplementedKmerId = kmerTable[kmerId].reverseComplementedKmerId;
-        CZI_ASSERT(kmerTable[reverseComplementedKmerId].reverseComplementedKmerId == kmerId);
+
+    // Also create the k-mer table, if k is not too large.
+    createKmerTable();
+}
+
+
+
+// Select k-mers to be used as markers, excluding k-mers
+// that are over-represented in the reads.
+void Assembler::selectKmersBasedOnFrequency(
+    size_t k,           // k-mer length.
+    double probability, // The probability that a k-mer is selected as a marker.
+    int seed,           // For random number generator.
+    double enrichmentThreshold,
+    size_t threadCount
+)
+{
+    cout << timestamp << "Selecting k-mers based on frequency." << endl;
+    const auto tBegin = steady_clock::now();
+    checkReadsAreOpen();
+
+    // Sanity checks.
+    if(k > Kmer::capacity) {
+        throw runtime_error("K-mer capacity exceeded.");
+    }
+    // The frequency table has 4^k entries (8 bytes per k-mer).
+    if(k > maxKmerTableK) {
+        throw runtime_error("K-mer selection based on frequency requires k <= " +
+            to_string(maxKmerTableK) + ". Use random k-mer selection for k = " +
+            to_string(k) + ".");
+    }
+    if(probability<0. || probability>1.) {
+        throw runtime_error("Invalid k-mer probability " +
+            to_string(probability) + " requested.");
+    }
+    if(enrichmentThreshold <= 0.) {
+        throw runtime_error("Invalid k-mer enrichment threshold " +
+            to_string(enrichmentThreshold) + " requested.");
+    }
+    assemblerInfo->k = k;
+    const uint64_t kmerCount = 1ULL << (2ULL*k);
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
     }
 
-    // Prepare to generate uniformly distributed numbers between 0 and 1.
-    std::mt19937 randomSource(seed);
-    std::uniform_real_distribution<> uniformDistribution;
+    // Compute the frequency of all k-mers in the reads, in parallel.
+    // This uses the run-length representation of the reads,
+    // like MarkerFinder does.
+    computeKmerFrequencyData.k = k;
+    MemoryMapped::Vector<uint64_t>& frequency = computeKmerFrequencyData.frequency;
+    frequency.createNew(largeDataName("tmp-KmerFrequency"), largeDataPageSize);
+    frequency.resize(kmerCount);
+    fill(frequency.begin(), frequency.end(), 0ULL);
+    setupLoadBalancing(reads.size(), 100);
+    runThreads(&Assembler::computeKmerFrequencyThreadFunction, threadCount);
 
-    // Pick each k-mer and its reverse complement with probability p.
-    // Use <= comparison, so if probability=1, p=1, all k-mers are kept.
+    // Compute the average frequency of the k-mers that occur in the reads.
+    // For large genomes all k-mers occur and this is the frequency
+    // we would expect if all k-mers occurred equally often.
+    // For small genomes, averaging only over the k-mers
+    // that occur avoids flagging most of them as over-represented.
+    uint64_t totalFrequency = 0;
+    uint64_t presentKmerCount = 0;
     for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
-        const double x = uniformDistribution(randomSource);
-        if(x <= p) {
-            kmerTable[kmerId].isMarker = true;
-            const uint64_t reverseComplementedKmerId = kmerTable[kmerId].reverseComplementedKmerId;
-            kmerTable[reverseComplementedKmerId].isMarker = true;
+        const uint64_t f = frequency[kmerId];
+        if(f) {
+            totalFrequency += f;
+            ++presentKmerCount;
         }
     }
-    size_t usedKmerCount = 0;
+    const double averageFrequency =
+        presentKmerCount ? double(totalFrequency) / double(presentKmerCount) : 0.;
+    const double frequencyThreshold = enrichmentThreshold * averageFrequency;
+    cout << "Average k-mer frequency is " << averageFrequency << endl;
+    cout << "K-mers with frequency above " << frequencyThreshold <<
+        " will not be used as markers." << endl;
+
+    // Flag the over-represented k-mers.
+    // Because frequencies are computed on both strands,
+    // a k-mer is excluded if and only if its reverse complement is also excluded.
+    MemoryMapped::Vector<uint64_t> excludedKmers;
+    excludedKmers.createNew(largeDataName("tmp-ExcludedKmers"), largeDataPageSize);
+    excludedKmers.resize(KmerBitmap::wordCount(k));
+    fill(excludedKmers.begin(), excludedKmers.end(), 0ULL);
+    uint64_t excludedKmerCount = 0;
+    uint64_t excludedFrequency = 0;
     for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
-        if(kmerTable[kmerId].isMarker) {
-            ++usedKmerCount;
+        if(double(frequency[kmerId]) > frequencyThreshold) {
+            KmerBitmap::set(excludedKmers.begin(), KmerId(kmerId));
+            ++excludedKmerCount;
+            excludedFrequency += frequency[kmerId];
         }
     }
+    const double excludedFraction = double(excludedKmerCount) / double(kmerCount);
+    cout << "Found " << excludedKmerCount << " over-represented " << k <<
+        "-mers out of " << kmerCount << " total." << endl;
+    if(totalFrequency > 0) {
+        cout << "These k-mers account for a fraction " <<
+            double(excludedFrequency) / double(totalFrequency) <<
+            " of all k-mer occurrences in the reads." << endl;
+    }
+
+    // Write a histogram of k-mer frequency.
+    {
+        vector<uint64_t> histogram;
+        for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
+            const uint64_t f = frequency[kmerId];
+            if(histogram.size() <= f) {
+                histogram.resize(f+1, 0);
+            }
+            ++histogram[f];
+        }
+        ofstream csv("KmerFrequencyHistogram.csv");
+        csv << "Frequency,KmerCount,Excluded\n";
+        for(uint64_t f=0; f<histogram.size(); f++) {
+            if(histogram[f]) {
+                csv << f << "," << histogram[f] << "," <<
+                    int(double(f) > frequencyThreshold) << "\n";
+            }
+        }
+    }
+    frequency.remove();
+
+    // Select the markers among the k-mers that were not excluded.
+    // Increase the probability to compensate for the excluded k-mers.
+    double adjustedProbability = 1.;
+    if(excludedFraction < 1.) {
+        adjustedProbability = min(1., probability / (1. - excludedFraction));
+    }
+    const double p = 1. - sqrt(1. - adjustedProbability);
+    selectKmers(k, p, seed, &excludedKmers);
+    excludedKmers.remove();
+
+    const size_t usedKmerCount = getMarkerKmers().count(k);
     cout << "Selected " << usedKmerCount << " " << k << "-mers out of ";
     cout << kmerCount << " total." << endl;
     cout << "Requested probability: " << probability << "." << endl;
     cout << "Actual fraction: ";
     cout << double(usedKmerCount)/double(kmerCount) << "." << endl;
 
-    if(probability == 1.) {
-        CZI_ASSERT(usedKmerCount == kmerCount);
+    // Also create the k-mer table, if k is not too large.
+    createKmerTable();
+
+    const auto tEnd = steady_clock::now();
+    cout << timestamp << "K-mer selection completed in " << seconds(tEnd - tBegin) << " s." << endl;
+}
+
+
+
+void Assembler::computeKmerFrequencyThreadFunction(size_t threadId)
+{
+    const size_t k = computeKmerFrequencyData.k;
+    uint64_t* frequency = computeKmerFrequencyData.frequency.begin();
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over reads of this batch.
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+
+            // Loop over k-mers of this read, counting each k-mer
+            // and its reverse complement, to account for both strands.
+            for(KmerIterator it(reads[readId], k); it.isValid(); it.next()) {
+                __sync_fetch_and_add(frequency + it.kmerId(), 1ULL);
+                __sync_fetch_and_add(frequency + it.reverseComplementedKmerId(), 1ULL);
+            }
+        }
+    }
+}
+
+
+
+// Pick each k-mer and its reverse complement with probability p,
+// skipping k-mers flagged in excludedKmers (if not null),
+// and store the result in the bitmap of marker k-mers.
+// The random number generator is used the same way
+// regardless of the excluded k-mers.
+void Assembler::selectKmers(
+    size_t k,
+    double p,
+    int seed,
+    const MemoryMapped::Vector<uint64_t>* excludedKmers)
+{
+    // Create the bitmap of marker k-mers, initially empty.
+    const size_t kmerCount = 1ULL << (2ULL*k);
+    markerKmers.createNew(largeDataName("MarkerKmers"), largeDataPageSize);
+    markerKmers.resize(KmerBitmap::wordCount(k));
+    fill(markerKmers.begin(), markerKmers.end(), 0ULL);
+    const KmerBitmap isExcluded(excludedKmers ? excludedKmers->begin() : 0);
+
+    // Prepare to generate uniformly distributed numbers between 0 and 1.
+    std::mt19937 randomSource(seed);
+    std::uniform_real_distribution<> uniformDistribution;
+
+    // Pick each k-mer and its reverse complement with probability p.
+    // Use <= comparison, so if p=1 all k-mers are kept.
+    for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
+        const double x = uniformDistribution(randomSource);
+        if(x <= p) {
+            if(excludedKmers && isExcluded[KmerId(kmerId)]) {
+                continue;
+            }
+            KmerBitmap::set(markerKmers.begin(), KmerId(kmerId));
+            KmerBitmap::set(markerKmers.begin(), reverseComplementKmerId(KmerId(kmerId), k));
+        }
+    }
+}
+
+
+
+// Create the k-mer table from the bitmap of marker k-mers,
+// if k is not too large.
+void Assembler::createKmerTable()
+{
+    const size_t k = assemblerInfo->k;
+    if(k > maxKmerTableK) {
+        cout << "The k-mer table was not created because k > " <<
+            maxKmerTableK << "." << endl;
+        return;
     }
 
+    const size_t kmerCount = 1ULL << (2ULL*k);
+    const KmerBitmap isMarker = getMarkerKmers();
+
+    kmerTable.createNew(largeDataName("Kmers"), largeDataPageSize);
+    kmerTable.resize(kmerCount);
+    for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
+        KmerInfo& info = kmerTable[kmerId];
+        info.reverseComplementedKmerId = reverseComplementKmerId(KmerId(kmerId), k);
+        info.isMarker = isMarker[KmerId(kmerId)];
+    }
+    for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
+        const uint64_t reverseComplementedKmerId = kmerTable[kmerId].reverseComplementedKmerId;
+        CZI_ASSERT(kmerTable[reverseComplementedKmerId].reverseComplementedKmerId == kmerId);
+        CZI_ASSERT(kmerTable[reverseComplementedKmerId].isMarker == kmerTable[kmerId].isMarker);
+    }
 }
 
 
@@ -123,7 +361,7 @@ void Assembler::writeKmers(const string& fileName) const
     // Get the k-mer length.
     const size_t k = assemblerInfo->k;
     const size_t kmerCount = 1ULL << (2ULL*k);
-    CZI_ASSERT(kmerTable.size() == kmerCount);
+    const KmerBitmap isMarker = getMarkerKmers();
 
     // Open the output file and write the header line.
     ofstream file(fileName);
@@ -131,12 +369,11 @@ void Assembler::writeKmers(const string& fileName) const
 
     // Write a line for each k-mer.
     for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
+        const KmerId reverseComplementedKmerId = reverseComplementKmerId(KmerId(kmerId), k);
         file << kmerId << ",";
         file << Kmer(kmerId, k) << ",";
-        file << int(kmerTable[kmerId].isMarker) << ",";
-        file << kmerTable[kmerId].reverseComplementedKmerId << ",";
-        file << Kmer(kmerTable[kmerId].reverseComplementedKmerId, k) << "\n";
+        file << int(isMarker[KmerId(kmerId)]) << ",";
+        file << reverseComplementedKmerId << ",";
+        file << Kmer(reverseComplementedKmerId, k) << "\n";
     }
 }
-
-
@@ -1,8 +1,15 @@
 #include "Assembler.hpp"
 #include "LowHash.hpp"
+#include "MurmurHash2.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
+// Standard library.
+#include "algorithm.hpp"
+#include "chrono.hpp"
+#include <limits>
+#include "tuple.hpp"
+
 
 
 
@@ -15,18 +22,67 @@ void Assembler::findAlignmentCandidatesLowHash(
     size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for lowHash.
     size_t maxBucketSize,           // The maximum size for a bucket to be used.
     size_t minFrequency,            // Minimum number of minHash hits for a pair to become a candidate.
+    size_t lowHashMethod,           // 0 = use buckets, 1 = sort the low hashes.
+    size_t candidateTableMegabytes, // If not 0, accumulate candidates in a hash table of this size.
+    bool singlePassHashing,         // If true, compute the low hashes for all iterations at once.
+    bool storeSketches,             // If true, store the low hashes for later incremental use.
+    double targetCandidatesPerRead, // If not 0, adjust the iterations and minFrequency. See Assembler.hpp.
+    uint32_t maxMarkerFrequency,    // Alignment parameters used in adaptive mode.
+    size_t maxSkip,
+    size_t minAlignedMarkerCount,
+    size_t maxTrim,
     size_t threadCount)
 {
 
     // Check that we have what we need.
     checkKmersAreOpen();
-    checkMarkersAreOpen();
-    const ReadId readCount = ReadId(markers.size() / 2);
+    checkMarkersOrCompactMarkersAreOpen();
+    const ReadId readCount = ReadId(reads.size());
     CZI_ASSERT(readCount > 0);
 
+    // Each LowHash iteration scans the markers of all reads in order.
+    if(markers.isOpen()) {
+        markers.adviseAccessPattern(MemoryMapped::AccessPattern::Sequential);
+    }
+
     // Create the alignment candidates.
     alignmentCandidates.createNew(largeDataName("AlignmentCandidates"), largeDataPageSize);
 
+    // Remove any previously stored sketches, which would no longer
+    // be consistent with the alignment candidates.
+    if(lowHashSketches.isOpen()) {
+        lowHashSketches.remove();
+    }
+    lowHashSketches.name = largeDataName("LowHashSketches");
+
+    // In adaptive mode, LowHash uses this to check whether
+    // a sampled candidate gives a good alignment,
+    // with the same criteria used by computeAlignments.
+    AlignmentWorkspace workspace;
+    const auto isGoodAlignment = [&](const OrientedReadPair& candidate)
+    {
+        const array<OrientedReadId, 2> orientedReadIds = {
+            OrientedReadId(candidate.readIds[0], 0),
+            OrientedReadId(candidate.readIds[1], candidate.isSameStrand ? 0 : 1)};
+        for(size_t j=0; j<2; j++) {
+            getMarkersSortedByKmerId(orientedReadIds[j], workspace.markersSortedByKmerId[j]);
+        }
+        if(workspace.prefilter.check(workspace.markersSortedByKmerId,
+            maxMarkerFrequency, minAlignedMarkerCount, maxTrim) !=
+            AlignmentPrefilter::Result::Pass) {
+            return false;
+        }
+        alignOrientedReads(workspace.markersSortedByKmerId, maxSkip, maxMarkerFrequency,
+            0, false, workspace.graph, workspace.alignment, workspace.alignmentInfo);
+        if(workspace.alignment.ordinals.size() < minAlignedMarkerCount) {
+            return false;
+        }
+        uint32_t leftTrim;
+        uint32_t rightTrim;
+        tie(leftTrim, rightTrim) = workspace.alignmentInfo.computeTrim();
+        return leftTrim <= maxTrim && rightTrim <= maxTrim;
+    };
+
     // Run the LowHash computation to find candidate alignments.
     LowHash lowHash(
         m,
@@ -35,11 +91,318 @@ void Assembler::findAlignmentCandidatesLowHash(
         log2MinHashBucketCount,
         maxBucketSize,
         minFrequency,
+        lowHashMethod,
+        candidateTableMegabytes,
+        singlePassHashing,
+        threadCount,
+        assemblerInfo->k,
+        kmerTable,
+        readFlags,
+        markers,
+        compactMarkers.isOpen() ? &compactMarkers : 0,
+        alignmentCandidates,
+        largeDataFileNamePrefix,
+        largeDataPageSize,
+        storeSketches ? &lowHashSketches : 0,
+        false, 0, 1, 0,
+        targetCandidatesPerRead,
+        isGoodAlignment);
+    if(storeSketches) {
+        lowHashSketches.info->markerKmersHash = getMarkerKmersHash();
+    }
+}
+
+
+
+// Incremental version of findAlignmentCandidatesLowHash.
+// See Assembler.hpp for more information.
+void Assembler::findAlignmentCandidatesLowHashIncremental(
+    size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for lowHash.
+    size_t maxBucketSize,           // The maximum size for a bucket to be used.
+    size_t minFrequency,            // Minimum number of minHash hits for a pair to become a candidate.
+    size_t lowHashMethod,           // 0 = use buckets, 1 = sort the low hashes.
+    size_t candidateTableMegabytes, // If not 0, accumulate candidates in a hash table of this size.
+    size_t threadCount)
+{
+
+    // Check that we have what we need.
+    checkKmersAreOpen();
+    checkMarkersOrCompactMarkersAreOpen();
+    checkAlignmentCandidatesAreOpen();
+    if(!lowHashSketches.isOpen()) {
+        throw runtime_error("LowHash sketches are not accessible.");
+    }
+    const ReadId readCount = ReadId(reads.size());
+    // Make a copy of the sketches info, because LowHash recreates the sketches.
+    LowHashSketches::Info info;
+    info.m = lowHashSketches.info->m;
+    info.hashFraction = lowHashSketches.info->hashFraction;
+    info.iterationCount = lowHashSketches.info->iterationCount;
+    info.readCount = lowHashSketches.info->readCount;
+    info.markerKmersHash = lowHashSketches.info->markerKmersHash;
+    if(info.markerKmersHash != getMarkerKmersHash()) {
+        throw runtime_error("The marker k-mers changed after the LowHash sketches were stored.");
+    }
+    if(info.readCount > readCount) {
+        throw runtime_error("The LowHash sketches were stored for " + to_string(info.readCount) +
+            " reads, but only " + to_string(readCount) + " reads are present.");
+    }
+    if(info.readCount == readCount) {
+        cout << "No reads were added after the LowHash sketches were stored." << endl;
+        return;
+    }
+
+    // Save the old alignment candidates.
+    const vector<OrientedReadPair> oldCandidates(
+        alignmentCandidates.begin(), alignmentCandidates.end());
+
+    // Run the LowHash computation to find the new candidates.
+    // This also stores updated sketches which include the new reads.
+    MemoryMapped::Vector<OrientedReadPair> newCandidates;
+    newCandidates.createNew(largeDataName("tmp-NewAlignmentCandidates"), largeDataPageSize);
+    LowHash lowHash(
+        info.m,
+        info.hashFraction,
+        info.iterationCount,
+        log2MinHashBucketCount,
+        maxBucketSize,
+        minFrequency,
+        lowHashMethod,
+        candidateTableMegabytes,
+        true,
+        threadCount,
+        assemblerInfo->k,
+        kmerTable,
+        readFlags,
+        markers,
+        compactMarkers.isOpen() ? &compactMarkers : 0,
+        newCandidates,
+        largeDataFileNamePrefix,
+        largeDataPageSize,
+        &lowHashSketches,
+        true);
+    lowHashSketches.info->markerKmersHash = getMarkerKmersHash();
+
+
+
+    // Merge the old and new candidates, keeping them in the
+    // order generated by LowHash: by readIds[0], then by readIds[1],
+    // with candidates on the same strand first.
+    // Each new candidate involves at least one new read,
+    // so it cannot also be an old candidate.
+    const auto orderKey = [](const OrientedReadPair& p)
+    {
+        return make_tuple(p.readIds[0], p.readIds[1], !p.isSameStrand);
+    };
+    alignmentCandidates.remove();
+    alignmentCandidates.createNew(largeDataName("AlignmentCandidates"), largeDataPageSize);
+    alignmentCandidates.reserve(oldCandidates.size() + newCandidates.size());
+    auto itOld = oldCandidates.begin();
+    auto itNew = newCandidates.begin();
+    while(itOld!=oldCandidates.end() || itNew!=newCandidates.end()) {
+        if(itNew==newCandidates.end() ||
+            (itOld!=oldCandidates.end() && orderKey(*itOld) < orderKey(*itNew))) {
+            alignmentCandidates.push_back(*itOld++);
+        } else {
+            alignmentCandidates.push_back(*itNew++);
+        }
+    }
+    cout << "Added " << newCandidates.size() << " alignment candidates to the existing " <<
+        oldCandidates.size() << "." << endl;
+    newCandidates.remove();
+}
+
+
+
+// Sharded version of findAlignmentCandidatesLowHash.
+// See Assembler.hpp for more information.
+void Assembler::findAlignmentCandidatesLowHashShard(
+    uint64_t shardId,
+    uint64_t shardCount,
+    size_t m,                       // Number of consecutive k-mers that define a feature.
+    double hashFraction,            // Low hash threshold.
+    size_t minHashIterationCount,   // Number of lowHash iterations.
+    size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for lowHash.
+    size_t maxBucketSize,           // The maximum size for a bucket to be used.
+    size_t lowHashMethod,           // 0 = use buckets, 1 = sort the low hashes.
+    size_t candidateTableMegabytes, // If not 0, accumulate candidates in a hash table of this size.
+    bool singlePassHashing,         // If true, compute the low hashes for all iterations at once.
+    size_t threadCount)
+{
+    if(largeDataFileNamePrefix.empty()) {
+        throw runtime_error("Sharded LowHash computation "
+            "requires the Data directory to be on a filesystem shared by all processes.");
+    }
+    if(shardId >= shardCount) {
+        throw runtime_error("Invalid LowHash shard " + to_string(shardId) +
+            " of " + to_string(shardCount) + ".");
+    }
+
+    // Check that we have what we need.
+    checkKmersAreOpen();
+    checkMarkersOrCompactMarkersAreOpen();
+    const ReadId readCount = ReadId(reads.size());
+    CZI_ASSERT(readCount > 0);
+    if(markers.isOpen()) {
+        markers.adviseAccessPattern(MemoryMapped::AccessPattern::Sequential);
+    }
+
+    // Run the LowHash computation for this shard.
+    // The alignment candidates are not used.
+    MemoryMapped::Vector<LowHash::ShardCandidate> shardCandidates;
+    shardCandidates.createNew(largeDataName(shardName("LowHashCandidates", shardId)), largeDataPageSize);
+    LowHash lowHash(
+        m,
+        hashFraction,
+        minHashIterationCount,
+        log2MinHashBucketCount,
+        maxBucketSize,
+        1,
+        lowHashMethod,
+        candidateTableMegabytes,
+        singlePassHashing,
         threadCount,
+        assemblerInfo->k,
         kmerTable,
         readFlags,
         markers,
+        compactMarkers.isOpen() ? &compactMarkers : 0,
         alignmentCandidates,
         largeDataFileNamePrefix,
-        largeDataPageSize);
+        largeDataPageSize,
+        0,
+        false,
+        shardId,
+        shardCount,
+        &shardCandidates);
+    const uint64_t candidateCount = shardCandidates.size();
+    shardCandidates.closeWithChecksums(threadCount);
+
+    // Write the shard information last, so its presence
+    // indicates that the shard is complete.
+    MemoryMapped::Vector<uint64_t> shardInfo;
+    shardInfo.createNew(largeDataName(shardName("LowHashShardInfo", shardId)), largeDataPageSize);
+    shardInfo.push_back(shardCount);
+    shardInfo.push_back(readCount);
+    shardInfo.push_back(m);
+    shardInfo.push_back(minHashIterationCount);
+    shardInfo.push_back(maxBucketSize);
+    shardInfo.push_back(candidateCount);
+    CZI_ASSERT(shardInfo.size() == lowHashShardInfoSize);
+    shardInfo.close();
+}
+
+
+
+// Merge the shards created by findAlignmentCandidatesLowHashShard.
+// Each shard is sorted by key, so this is a k-way merge
+// that adds up the frequencies of equal keys.
+// Key order is the same as the order of alignment candidates
+// generated by findAlignmentCandidatesLowHash.
+void Assembler::mergeLowHashShards(
+    uint64_t shardCount,
+    size_t minFrequency)
+{
+    const auto tBegin = steady_clock::now();
+    cout << timestamp << "Merging " << shardCount << " LowHash shards." << endl;
+    checkMarkersAreOpen();
+    const ReadId readCount = ReadId(reads.size());
+
+    // Access the shards and check that they are complete and consistent.
+    vector<MemoryMapped::Vector<LowHash::ShardCandidate> > shardCandidates(shardCount);
+    vector<uint64_t> firstShardInfo;
+    for(uint64_t shardId=0; shardId<shardCount; shardId++) {
+        MemoryMapped::Vector<uint64_t> shardInfo;
+        try {
+            shardInfo.accessExistingReadOnly(largeDataName(shardName("LowHashShardInfo", shardId)));
+        } catch(const runtime_error&) {
+            throw runtime_error("LowHash shard " + to_string(shardId) + " is missing or incomplete.");
+        }
+        const vector<uint64_t> info(shardInfo.begin(), shardInfo.end());
+        if(info.size() != lowHashShardInfoSize ||
+            info[0] != shardCount ||
+            info[1] != readCount) {
+            throw runtime_error("LowHash shard " + to_string(shardId) +
+                " does not match the reads or the number of shards.");
+        }
+        if(shardId == 0) {
+            firstShardInfo = info;
+        } else if(!equal(info.begin(), info.begin() + 5, firstShardInfo.begin())) {
+            throw runtime_error("LowHash shards were computed with different options.");
+        }
+        shardCandidates[shardId].accessExistingReadOnly(
+            largeDataName(shardName("LowHashCandidates", shardId)));
+        if(shardCandidates[shardId].size() != info[5] ||
+            !shardCandidates[shardId].verifyChecksums()) {
+            throw runtime_error("LowHash shard " + to_string(shardId) + " is corrupted.");
+        }
+    }
+
+    // Create the alignment candidates.
+    if(alignmentCandidates.isOpen) {
+        alignmentCandidates.remove();
+    }
+    alignmentCandidates.createNew(largeDataName("AlignmentCandidates"), largeDataPageSize);
+    if(lowHashSketches.isOpen()) {
+        lowHashSketches.remove();
+    }
+
+    // K-way merge. The number of shards is small,
+    // so a linear scan to find the smallest key is sufficient.
+    vector<uint64_t> next(shardCount, 0);
+    while(true) {
+        uint64_t key = std::numeric_limits<uint64_t>::max();
+        for(uint64_t shardId=0; shardId<shardCount; shardId++) {
+            const auto& v = shardCandidates[shardId];
+            if(next[shardId] != v.size()) {
+                key = min(key, v[next[shardId]].key);
+            }
+        }
+        if(key == std::numeric_limits<uint64_t>::max()) {
+            break;
+        }
+        uint64_t frequency = 0;
+        for(uint64_t shardId=0; shardId<shardCount; shardId++) {
+            const auto& v = shardCandidates[shardId];
+            if(next[shardId] != v.size() && v[next[shardId]].key == key) {
+                frequency += v[next[shardId]++].frequency;
+            }
+        }
+        if(frequency >= minFrequency) {
+            alignmentCandidates.push_back(OrientedReadPair(
+                AlignmentCandidateTable::getReadId0(key),
+                AlignmentCandidateTable::getReadId1(key),
+                AlignmentCandidateTable::getStrand(key) == 0));
+        }
+    }
+
+    // Remove the shards.
+    for(uint64_t shardId=0; shardId<shardCount; shardId++) {
+        shardCandidates[shardId].remove();
+        MemoryMapped::Vector<uint64_t> shardInfo;
+        shardInfo.accessExistingReadOnly(largeDataName(shardName("LowHashShardInfo", shardId)));
+        shardInfo.remove();
+    }
+
+    cout << "Found " << alignmentCandidates.size() << " alignment candidates."<< endl;
+    cout << "Average number of alignment candidates per oriented read is ";
+    cout << double(alignmentCandidates.size()) / double(readCount)  << "." << endl;
+    cout << timestamp << "Merging of LowHash shards completed in " <<
+        seconds(steady_clock::now() - tBegin) << " s." << endl;
+}
+
+
+
+void Assembler::accessLowHashSketches()
+{
+    lowHashSketches.accessExistingReadOnly(largeDataName("LowHashSketches"));
+}
+
+
+
+uint64_t Assembler::getMarkerKmersHash() const
+{
+    CZI_ASSERT(markerKmers.isOpen);
+    return MurmurHash64A(markerKmers.begin(),
+        int(markerKmers.size() * sizeof(uint64_t)), 231);
 }
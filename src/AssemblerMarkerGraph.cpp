@@ -1,10 +1,20 @@
 // Shasta.
 #include "Assembler.hpp"
 #include "AlignmentGraph.hpp"
+#include "CompactCoverage.hpp"
+#include "CompactLocalMarkerGraphBfs.hpp"
+#include "CompressedAlignment.hpp"
+#include "computeStarAlignment.hpp"
 #include "ConsensusCaller.hpp"
+#include "CoverageTensor.hpp"
+#include "DisjointSetsUnionBuffer.hpp"
+#include "filesystem.hpp"
 #ifndef SHASTA_STATIC_EXECUTABLE
 #include "LocalMarkerGraph.hpp"
 #endif
+#include "PoaBackend.hpp"
+#include "ThreadArena.hpp"
+#include "ThreadLog.hpp"
 #include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
@@ -15,9 +25,6 @@ using namespace shasta;
 #include <seqan/version.h>
 #endif
 
-// Spoa.
-#include "spoa/spoa.hpp"
-
 // Boost libraries.
 #include <boost/pending/disjoint_sets.hpp>
 
@@ -25,6 +32,7 @@ using namespace shasta;
 #include "chrono.hpp"
 #include <map>
 #include <queue>
+#include <unordered_map>
 
 
 
@@ -52,10 +60,58 @@ void Assembler::createMarkerGraphVertices(
     // of the marker graph to be kept.
     size_t maxCoverage,
 
+    // If not zero, each thread buffers this number of
+    // union operations on the disjoint sets data structure
+    // and applies them in order of marker id block.
+    size_t unionBufferSize,
+
+    // If not zero, use the out of core mode with this number of partitions.
+    size_t outOfCorePartitionCount,
+
+    // If true, store the disjoint set table
+    // for use by createMarkerGraphVerticesIncremental.
+    bool storeDisjointSetTable,
+
     // Number of threads. If zero, a number of threads equal to
     // the number of virtual processors is used.
     size_t threadCount
 )
+{
+    createMarkerGraphVerticesImplementation(
+        maxMarkerFrequency, maxSkip, minCoverage, maxCoverage,
+        unionBufferSize, outOfCorePartitionCount,
+        storeDisjointSetTable, false, threadCount);
+}
+
+
+
+// Incremental version of createMarkerGraphVertices,
+// used after reads are added to an assembly.
+// See Assembler.hpp for details.
+void Assembler::createMarkerGraphVerticesIncremental(
+    uint32_t maxMarkerFrequency,
+    size_t maxSkip,
+    size_t minCoverage,
+    size_t maxCoverage,
+    size_t threadCount)
+{
+    createMarkerGraphVerticesImplementation(
+        maxMarkerFrequency, maxSkip, minCoverage, maxCoverage,
+        0, 0, true, true, threadCount);
+}
+
+
+
+void Assembler::createMarkerGraphVerticesImplementation(
+    uint32_t maxMarkerFrequency,
+    size_t maxSkip,
+    size_t minCoverage,
+    size_t maxCoverage,
+    size_t unionBufferSize,
+    size_t outOfCorePartitionCount,
+    bool storeDisjointSetTable,
+    bool incremental,
+    size_t threadCount)
 {
 
     // Flag to control debug output.
@@ -72,7 +128,7 @@ void Assembler::createMarkerGraphVertices(
     checkReadsAreOpen();
     CZI_ASSERT(readFlags.isOpen);
     checkKmersAreOpen();
-    checkMarkersAreOpen();
+    checkMarkersAreNotStrandImplicit();
     checkAlignmentDataAreOpen();
     checkReadGraphIsOpen();
 
@@ -80,6 +136,18 @@ void Assembler::createMarkerGraphVertices(
     auto& data = createMarkerGraphVerticesData;
     data.maxSkip = maxSkip;
     data.maxMarkerFrequency = maxMarkerFrequency;
+    data.unionBufferSize = unionBufferSize;
+    data.useReadGraphEdgePairs = false;
+    data.readGraphEdgePairs.clear();
+
+    // If computeAlignments stored the alignments, use them
+    // instead of computing them again.
+    data.useStoredAlignments =
+        compressedAlignments.isOpen() &&
+        compressedAlignments.size() == alignmentData.size();
+    if(data.useStoredAlignments) {
+        cout << "Using the alignments stored by computeAlignments." << endl;
+    }
 
     // Adjust the numbers of threads, if necessary.
     if(threadCount == 0) {
@@ -87,27 +155,141 @@ void Assembler::createMarkerGraphVertices(
     }
     cout << "Using " << threadCount << " threads." << endl;
 
-    // Initialize computation of the global marker graph.
+    // The out of core mode does the rest of the computation differently.
+    // It processes one partition at a time, so the coverage thresholds
+    // must be known in advance.
+    if(outOfCorePartitionCount > 0) {
+        if(storeDisjointSetTable) {
+            throw runtime_error("Storing the disjoint set table "
+                "is not supported in out of core mode.");
+        }
+        if(minCoverage == 0 || maxCoverage == 0) {
+            throw runtime_error("Automatic selection of marker graph coverage thresholds "
+                "is not supported in out of core mode.");
+        }
+        createMarkerGraphVerticesOutOfCore(minCoverage, maxCoverage, outOfCorePartitionCount, threadCount);
+        cout << timestamp << "Computation of global marker graph vertices ";
+        cout << "completed in " << seconds(steady_clock::now() - tBegin) << " s." << endl;
+        return;
+    }
+
+    // In incremental mode, access the disjoint set table stored
+    // by the previous computation and find the first new read.
+    // The markers of the old reads must have kept their MarkerIds,
+    // so the old markers are the first ones.
     data.orientedMarkerCount = markers.totalSize();
-    data.disjointSetsData.createNew(
-        largeDataName("tmp-DisjointSetData"),
-        largeDataPageSize);
-    data.disjointSetsData.reserveAndResize(data.orientedMarkerCount);
-    data.disjointSetsPointer = std::make_shared<DisjointSets>(
-        data.disjointSetsData.begin(),
-        data.orientedMarkerCount
-        );
+    ReadId firstNewReadId = 0;
+    if(incremental) {
+        try {
+            data.storedDisjointSetTable.accessExistingReadOnly(
+                largeDataName("MarkerGraphDisjointSetTable"));
+        } catch(const exception&) {
+            throw runtime_error("The marker graph disjoint set table is not accessible. "
+                "Run createMarkerGraphVertices with storeDisjointSetTable set.");
+        }
+        const uint64_t oldMarkerCount = data.storedDisjointSetTable.size();
+        const ReadId readCount = ReadId(reads.size());
+        ReadId readIdBegin = 0;
+        ReadId readIdEnd = readCount;
+        while(readIdBegin < readIdEnd) {
+            const ReadId readId = readIdBegin + (readIdEnd - readIdBegin) / 2;
+            const uint64_t markerCountBefore = uint64_t(
+                markers.begin(OrientedReadId(readId, 0).getValue()) - markers.begin());
+            if(markerCountBefore < oldMarkerCount) {
+                readIdBegin = readId + 1;
+            } else {
+                readIdEnd = readId;
+            }
+        }
+        firstNewReadId = readIdBegin;
+        const uint64_t markerCountBefore = (firstNewReadId == readCount) ?
+            data.orientedMarkerCount :
+            uint64_t(markers.begin(OrientedReadId(firstNewReadId, 0).getValue()) - markers.begin());
+        if(markerCountBefore != oldMarkerCount) {
+            throw runtime_error("The stored marker graph disjoint set table is for " +
+                to_string(oldMarkerCount) + " markers, which does not correspond "
+                "to the markers of the old reads.");
+        }
+        cout << "Incremental computation: " << firstNewReadId << " old reads, " <<
+            readCount - firstNewReadId << " new reads, " <<
+            data.orientedMarkerCount - oldMarkerCount << " new markers." << endl;
+    }
+
+    // Initialize computation of the global marker graph.
+    // If possible, use 32-bit item ids for the disjoint sets,
+    // which halves their memory and bandwidth.
+    if(data.orientedMarkerCount < (uint64_t(1) << 32)) {
+        cout << "Using disjoint sets with 32-bit ids." << endl;
+        data.disjointSets32Data.createNew(
+            largeDataName("tmp-DisjointSetData"),
+            largeDataPageSize);
+        data.disjointSets32Data.reserveAndResize(data.orientedMarkerCount);
+        data.disjointSets32Pointer = std::make_shared<DisjointSets32>(
+            data.disjointSets32Data.begin(),
+            DisjointSets32::Uint(data.orientedMarkerCount)
+            );
+    } else {
+        cout << "Using disjoint sets with 64-bit ids." << endl;
+        data.disjointSetsData.createNew(
+            largeDataName("tmp-DisjointSetData"),
+            largeDataPageSize);
+        data.disjointSetsData.reserveAndResize(data.orientedMarkerCount);
+        data.disjointSetsPointer = std::make_shared<DisjointSets>(
+            data.disjointSetsData.begin(),
+            data.orientedMarkerCount
+            );
+    }
+
+
+
+    // The remaining phases are timed individually.
+    // The timings are written at the end.
+    vector< pair<string, double> > phaseTimes;
+    auto tPhase = steady_clock::now();
+    size_t batchSize = 10000;
+
+
+
+    // In incremental mode, initialize the disjoint sets
+    // from the stored disjoint set table. Each old marker is
+    // united with the representative of its old disjoint set.
+    // Then, only the read graph edges that involve a new read
+    // need to be processed.
+    if(incremental) {
+        cout << timestamp << "Initializing the disjoint sets from the stored disjoint set table." << endl;
+        batchSize = 1000000;
+        setupLoadBalancing(data.storedDisjointSetTable.size(), batchSize);
+        runThreads(&Assembler::createMarkerGraphVerticesSeedThreadFunction, threadCount);
+        data.storedDisjointSetTable.close();
+
+        // Find the pairs of read graph edges that involve a new read.
+        for(uint64_t i=0; i<readGraph.edges.size(); i+=2) {
+            const ReadGraph::Edge& readGraphEdge = readGraph.edges[i];
+            if( readGraphEdge.orientedReadIds[0].getReadId() >= firstNewReadId ||
+                readGraphEdge.orientedReadIds[1].getReadId() >= firstNewReadId) {
+                data.readGraphEdgePairs.push_back(i);
+            }
+        }
+        data.useReadGraphEdgePairs = true;
+        endCreateMarkerGraphVerticesPhase("Disjoint set initialization", phaseTimes, tPhase);
+        batchSize = 10000;
+    }
 
 
 
     // Update the disjoint set data structure for each alignment
     // in the read graph.
-    cout << "Begin processing " << readGraph.edges.size() << " alignments in the read graph." << endl;
+    const uint64_t readGraphEdgeCount = data.useReadGraphEdgePairs ?
+        2 * data.readGraphEdgePairs.size() : readGraph.edges.size();
+    cout << "Begin processing " << readGraphEdgeCount << " alignments in the read graph." << endl;
     cout << timestamp << "Disjoint set computation begins." << endl;
-    size_t batchSize = 10000;
-    setupLoadBalancing(readGraph.edges.size(), batchSize);
+    if(unionBufferSize) {
+        cout << "Each thread buffers " << unionBufferSize << " union operations." << endl;
+    }
+    setupLoadBalancing(readGraphEdgeCount, batchSize);
     runThreads(&Assembler::createMarkerGraphVerticesThreadFunction1, threadCount);
     cout << timestamp << "Disjoint set computation completed." << endl;
+    endCreateMarkerGraphVerticesPhase("Disjoint set computation", phaseTimes, tPhase);
 
 
 
@@ -121,10 +303,31 @@ void Assembler::createMarkerGraphVertices(
     cout << "Processing " << data.orientedMarkerCount << " oriented markers." << endl;
     setupLoadBalancing(data.orientedMarkerCount, batchSize);
     runThreads(&Assembler::createMarkerGraphVerticesThreadFunction2, threadCount);
+    data.useReadGraphEdgePairs = false;
+    data.readGraphEdgePairs.clear();
+    data.readGraphEdgePairs.shrink_to_fit();
+
+    // If requested, store a copy of the disjoint set table, which
+    // is later overwritten, for use by createMarkerGraphVerticesIncremental.
+    if(storeDisjointSetTable) {
+        MemoryMapped::Vector<MarkerGraph::VertexId> storedDisjointSetTable;
+        storedDisjointSetTable.createNew(
+            largeDataName("MarkerGraphDisjointSetTable"),
+            largeDataPageSize);
+        storedDisjointSetTable.resize(data.orientedMarkerCount);
+        copy(data.disjointSetTable.begin(), data.disjointSetTable.end(),
+            storedDisjointSetTable.begin());
+    }
 
     // Free the disjoint set data structure.
-    data.disjointSetsPointer = 0;
-    data.disjointSetsData.remove();
+    if(data.disjointSets32Pointer) {
+        data.disjointSets32Pointer = 0;
+        data.disjointSets32Data.remove();
+    } else {
+        data.disjointSetsPointer = 0;
+        data.disjointSetsData.remove();
+    }
+    endCreateMarkerGraphVerticesPhase("Disjoint set lookup", phaseTimes, tPhase);
 
 
     // Debug output.
@@ -153,17 +356,33 @@ void Assembler::createMarkerGraphVertices(
     cout << "Processing " << data.orientedMarkerCount << " oriented markers." << endl;
     setupLoadBalancing(data.orientedMarkerCount, batchSize);
     runThreads(&Assembler::createMarkerGraphVerticesThreadFunction3, threadCount);
+    endCreateMarkerGraphVerticesPhase("Disjoint set counting", phaseTimes, tPhase);
 
 
 
-    // Debug output.
-    if(debug) {
-        ofstream out("WorkArea-initial-count.csv");
-        for(MarkerId markerId=0; markerId<data.orientedMarkerCount; markerId++) {
-            out << markerId << "," << data.workArea[markerId] << "\n";
+    // Compute the histogram of disjoint set sizes, which is the coverage
+    // histogram of the vertices before any are removed,
+    // and use it to choose the coverage thresholds if requested.
+    cout << timestamp << "Computing the disjoint set size histogram." << endl;
+    data.coverageHistogram.reset(threadCount, data.maxHistogramCoverage);
+    setupLoadBalancing(data.orientedMarkerCount, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesHistogramThreadFunction, threadCount);
+    Histogram coverageHistogram;
+    data.coverageHistogram.merge(coverageHistogram);
+    data.coverageHistogram.reset(0, 0);
+    {
+        ofstream csv("DisjointSetsSizeHistogram.csv");
+        csv << "Coverage,Frequency\n";
+        for(size_t coverage=1; coverage<coverageHistogram.size(); coverage++) {
+            if(coverageHistogram[coverage]) {
+                csv << coverage << "," << coverageHistogram[coverage] << "\n";
+            }
         }
-
     }
+    if(minCoverage == 0 || maxCoverage == 0) {
+        selectMarkerGraphCoverageThresholds(coverageHistogram, minCoverage, maxCoverage);
+    }
+    endCreateMarkerGraphVerticesPhase("Disjoint set size histogram", phaseTimes, tPhase);
 
 
 
@@ -174,125 +393,78 @@ void Assembler::createMarkerGraphVertices(
     // Note that this numbering is not yet the final vertex numbering,
     // as we will later remove "bad" vertices
     // (vertices with more than one marker on the same read).
-    // This block is recursive and cannot be multithreaded.
+    // This is a parallel prefix sum, see createMarkerGraphVerticesRenumber.
     cout << timestamp << "Renumbering the disjoint sets." << endl;
-    MarkerGraph::VertexId newDisjointSetId = 0ULL;
-    for(MarkerGraph::VertexId oldDisjointSetId=0;
-        oldDisjointSetId<data.orientedMarkerCount; ++oldDisjointSetId) {
-        auto& w = data.workArea[oldDisjointSetId];
-        const MarkerGraph::VertexId markerCount = w;
-        if(markerCount<minCoverage || markerCount>maxCoverage) {
-            w = MarkerGraph::invalidVertexId;
-        } else {
-            w = newDisjointSetId;
-            ++newDisjointSetId;
-        }
-    }
-    const auto disjointSetCount = newDisjointSetId;
+    data.minCoverage = minCoverage;
+    data.maxCoverage = maxCoverage;
+    data.renumberBadDisjointSets = false;
+    const MarkerGraph::VertexId disjointSetCount =
+        createMarkerGraphVerticesRenumber(data.orientedMarkerCount, batchSize, threadCount);
     cout << "Kept " << disjointSetCount << " disjoint sets with coverage in the requested range." << endl;
+    endCreateMarkerGraphVerticesPhase("Renumbering by coverage", phaseTimes, tPhase);
 
 
 
-    // Debug output.
-    if(debug) {
-        ofstream out("WorkArea-initial-renumbering.csv");
-        for(MarkerId markerId=0; markerId<data.orientedMarkerCount; markerId++) {
-            out << markerId << "," << data.workArea[markerId] << "\n";
-        }
-    }
-
-
-    // Reassign vertices to disjoint sets using this new numbering.
-    // Vertices assigned to no disjoint set will store MarkerGraph::invalidVertexId.
-    // This could be multithreaded if necessary.
-    cout << timestamp << "Assigning vertices to renumbered disjoint sets." << endl;
-    for(MarkerGraph::VertexId markerId=0;
-        markerId<data.orientedMarkerCount; ++markerId) {
-        auto& d = data.disjointSetTable[markerId];
-        const auto oldId = d;
-        const auto newId = data.workArea[oldId];
-        d = newId;
-    }
-    // We no longer need the workArea.
-    data.workArea.remove();
-
-
-
-    // Debug output.
-    if(debug) {
-        ofstream out("DisjointSetTable-renumbered.csv");
-        for(MarkerId markerId=0; markerId<data.orientedMarkerCount; markerId++) {
-            out << markerId << "," << data.disjointSetTable[markerId] << "\n";
-        }
-    }
-
-
-    // At this point, data.disjointSetTable contains, for each oriented marker,
-    // the disjoint set that the oriented marker is assigned to,
-    // and all disjoint sets have a number of markers in the requested range.
-    // Vertices not assigned to any disjoint set store a disjoint set
-    // equal to MarkerGraph::invalidVertexId.
-
-
-
-    // Gather the markers in each disjoint set.
+    // Sweep over markers, pass 1.
+    // Reassign markers to disjoint sets using the new numbering
+    // and count the markers in each of the renumbered disjoint sets.
+    // Markers not assigned to any disjoint set store MarkerGraph::invalidVertexId
+    // in data.disjointSetTable and MarkerGraph::invalidCompressedVertexId
+    // in the vertex table.
+    cout << timestamp << "Assigning markers to renumbered disjoint sets." << endl;
+    markerGraph.vertexTable.createNew(
+        largeDataName("MarkerGraphVertexTable"),
+        largeDataPageSize);
+    markerGraph.vertexTable.reserveAndResize(data.orientedMarkerCount);
     data.disjointSetMarkers.createNew(
         largeDataName("tmp-DisjointSetMarkers"),
         largeDataPageSize);
-    cout << timestamp << "Gathering markers in disjoint sets, pass1." << endl;
     data.disjointSetMarkers.beginPass1(disjointSetCount);
-    cout << timestamp << "Processing " << data.orientedMarkerCount << " oriented markers." << endl;
     setupLoadBalancing(data.orientedMarkerCount, batchSize);
     runThreads(&Assembler::createMarkerGraphVerticesThreadFunction4, threadCount);
-    cout << timestamp << "Gathering markers in disjoint sets, pass2." << endl;
+    endCreateMarkerGraphVerticesPhase("Marker sweep 1", phaseTimes, tPhase);
+
+
+
+    // Sweep over markers, pass 2.
+    // Gather the markers in each disjoint set.
+    // This is a counting sort of the markers by disjoint set id.
+    cout << timestamp << "Gathering markers in disjoint sets." << endl;
     data.disjointSetMarkers.beginPass2();
-    cout << timestamp << "Processing " << data.orientedMarkerCount << " oriented markers." << endl;
     setupLoadBalancing(data.orientedMarkerCount, batchSize);
     runThreads(&Assembler::createMarkerGraphVerticesThreadFunction5, threadCount);
     data.disjointSetMarkers.endPass2();
+    data.disjointSetTable.remove();
+    endCreateMarkerGraphVerticesPhase("Marker sweep 2", phaseTimes, tPhase);
 
 
 
-    // Sort the markers in each disjoint set.
-    cout << timestamp << "Sorting the markers in each disjoint set." << endl;
-    setupLoadBalancing(disjointSetCount, batchSize);
-    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction6, threadCount);
-
-
-
-    // Flag disjoint sets that contain more than one marker on the same read.
+    // Sort the markers in each disjoint set and flag disjoint sets
+    // that contain more than one marker on the same read.
+    cout << timestamp << "Sorting the markers in each disjoint set and flagging bad disjoint sets." << endl;
     data.isBadDisjointSet.createNew(
         largeDataName("tmp-IsBadDisjointSet"),
         largeDataPageSize);
     data.isBadDisjointSet.reserveAndResize(disjointSetCount);
-    cout << timestamp << "Flagging bad disjoint sets." << endl;
     setupLoadBalancing(disjointSetCount, batchSize);
-    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction7, threadCount);
+    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction6, threadCount);
     const size_t badDisjointSetCount = std::count(
         data.isBadDisjointSet.begin(), data.isBadDisjointSet.end(), true);
     cout << "Found " << badDisjointSetCount << " bad disjoint sets "
         "with more than one marker on a single read." << endl;
+    endCreateMarkerGraphVerticesPhase("Disjoint set sort and check", phaseTimes, tPhase);
 
 
 
     // Renumber the disjoint sets again, this time without counting the ones marked as bad.
+    // The new numbering is the vertex id.
     cout << timestamp << "Renumbering disjoint sets to remove the bad ones." << endl;
-    data.workArea.createNew(
-        largeDataName("tmp-WorkArea"),
-        largeDataPageSize);
-    data.workArea.reserveAndResize(disjointSetCount);
-    newDisjointSetId = 0ULL;
-    for(MarkerGraph::VertexId oldDisjointSetId=0;
-        oldDisjointSetId<disjointSetCount; ++oldDisjointSetId) {
-        auto& w = data.workArea[oldDisjointSetId];
-        if(data.isBadDisjointSet[oldDisjointSetId]) {
-            w = MarkerGraph::invalidVertexId;
-        } else {
-            w = newDisjointSetId;
-            ++newDisjointSetId;
-        }
-    }
-    CZI_ASSERT(newDisjointSetId + badDisjointSetCount == disjointSetCount);
+    data.workArea.resize(disjointSetCount);
+    data.renumberBadDisjointSets = true;
+    const MarkerGraph::VertexId vertexCount =
+        createMarkerGraphVerticesRenumber(disjointSetCount, batchSize, threadCount);
+    CZI_ASSERT(vertexCount + badDisjointSetCount == disjointSetCount);
+    endCreateMarkerGraphVerticesPhase("Renumbering to remove bad sets", phaseTimes, tPhase);
 
 
 
@@ -305,48 +477,34 @@ void Assembler::createMarkerGraphVertices(
     }
 
 
-    // Compute the final disjoint set number for each marker.
-    // That becomes the vertex id assigned to that marker.
-    // This could be multithreaded.
-    cout << timestamp << "Assigning vertex ids to markers." << endl;
-    markerGraph.vertexTable.createNew(
-        largeDataName("MarkerGraphVertexTable"),
-        largeDataPageSize);
-    markerGraph.vertexTable.reserveAndResize(data.orientedMarkerCount);
-    for(MarkerGraph::VertexId markerId=0;
-        markerId<data.orientedMarkerCount; ++markerId) {
-        auto oldValue = data.disjointSetTable[markerId];
-        if(oldValue == MarkerGraph::invalidVertexId) {
-            markerGraph.vertexTable[markerId] = MarkerGraph::invalidCompressedVertexId;
-        } else {
-        	markerGraph.vertexTable[markerId] = data.workArea[oldValue];
-        }
-    }
-
-
 
-    // Store the disjoint sets that are not marker bad.
-    // Each corresponds to a vertex of the global marker graph.
-    // This could be multithreaded.
+    // Sweeps over disjoint sets to store the markers of each vertex
+    // of the marker graph and complete the vertex table.
+    // The first sweep only counts markers and is inexpensive.
     cout << timestamp << "Gathering the markers of each vertex of the marker graph." << endl;
     markerGraph.vertices.createNew(
         largeDataName("MarkerGraphVertices"),
         largeDataPageSize);
-    for(MarkerGraph::VertexId oldDisjointSetId=0;
-        oldDisjointSetId<disjointSetCount; ++oldDisjointSetId) {
-        if(data.isBadDisjointSet[oldDisjointSetId]) {
-            continue;
-        }
-        markerGraph.vertices.appendVector();
-        const auto markers = data.disjointSetMarkers[oldDisjointSetId];
-        for(const MarkerId markerId: markers) {
-            markerGraph.vertices.append(markerId);
-        }
-    }
+    markerGraph.vertices.beginPass1(vertexCount, threadCount);
+    setupLoadBalancing(disjointSetCount, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction7, threadCount);
+    markerGraph.vertices.beginPass2(threadCount);
+    setupLoadBalancing(disjointSetCount, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction8, threadCount);
+    markerGraph.vertices.endPass2(false);
     data.isBadDisjointSet.remove();
     data.workArea.remove();
     data.disjointSetMarkers.remove();
-    data.disjointSetTable.remove();
+    endCreateMarkerGraphVerticesPhase("Vertex sweep", phaseTimes, tPhase);
+
+
+
+    // Write the timing of each phase.
+    cout << "Timing of createMarkerGraphVertices phases:" << endl;
+    for(const auto& p: phaseTimes) {
+        cout << p.first << ": " << p.second << " s." << endl;
+    }
+
 
 
     // Check that the data structures we created are consistent with each other.
@@ -366,6 +524,23 @@ void Assembler::createMarkerGraphVertices(
 
 
 void Assembler::createMarkerGraphVerticesThreadFunction1(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    if(data.disjointSets32Pointer) {
+        DisjointSetsUnionBuffer<DisjointSets32> unionBuffer(
+            *data.disjointSets32Pointer, data.orientedMarkerCount, data.unionBufferSize);
+        createMarkerGraphVerticesThreadFunction1Template(unionBuffer);
+    } else {
+        DisjointSetsUnionBuffer<DisjointSets> unionBuffer(
+            *data.disjointSetsPointer, data.orientedMarkerCount, data.unionBufferSize);
+        createMarkerGraphVerticesThreadFunction1Template(unionBuffer);
+    }
+}
+
+
+
+template<class UnionBuffer> void Assembler::createMarkerGraphVerticesThreadFunction1Template(
+    UnionBuffer& unionBuffer)
 {
 
     array<vector<MarkerWithOrdinal>, 2> markersSortedByKmerId;
@@ -377,8 +552,7 @@ void Assembler::createMarkerGraphVerticesThreadFunction1(size_t threadId)
     auto& data = createMarkerGraphVerticesData;
     const size_t maxSkip = data.maxSkip;
     const uint32_t maxMarkerFrequency = data.maxMarkerFrequency;
-
-    const std::shared_ptr<DisjointSets> disjointSetsPointer = data.disjointSetsPointer;
+    const bool useStoredAlignments = data.useStoredAlignments;
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
@@ -388,7 +562,11 @@ void Assembler::createMarkerGraphVerticesThreadFunction1(size_t threadId)
         CZI_ASSERT((begin%2) == 0);
         CZI_ASSERT((end%2) == 0);
 
-        for(size_t i=begin; i!=end; i+=2) {
+        for(size_t k=begin; k!=end; k+=2) {
+
+            // In incremental mode, only process the
+            // pairs of read graph edges that involve a new read.
+            const size_t i = data.useReadGraphEdgePairs ? data.readGraphEdgePairs[k/2] : k;
             const ReadGraph::Edge& readGraphEdge = readGraph.edges[i];
 
             // Check that the next edge is the reverse complement of
@@ -414,17 +592,31 @@ void Assembler::createMarkerGraphVerticesThreadFunction1(size_t threadId)
                 continue;
             }
 
-            // Get the markers for the two oriented reads.
-            for(size_t j=0; j<2; j++) {
-                getMarkersSortedByKmerId(orientedReadIds[j], markersSortedByKmerId[j]);
-            }
+            if(useStoredAlignments) {
+
+                // Get the stored alignment. It uses the same orientation
+                // as the first edge of each pair.
+                const uint64_t alignmentId = readGraphEdge.alignmentId;
+                CZI_ASSERT(orientedReadIds[0] == OrientedReadId(alignmentData[alignmentId].readIds[0], 0));
+                decompressAlignment(
+                    compressedAlignments.begin(alignmentId),
+                    compressedAlignments.end(alignmentId),
+                    alignment);
 
-            // Compute the Alignment.
-            // We already know that this is a good alignment, otherwise we
-            // would not have stored it.
-            alignOrientedReads(
-                markersSortedByKmerId,
-                maxSkip, maxMarkerFrequency, debug, graph, alignment, alignmentInfo);
+            } else {
+
+                // Get the markers for the two oriented reads.
+                for(size_t j=0; j<2; j++) {
+                    getMarkersSortedByKmerId(orientedReadIds[j], markersSortedByKmerId[j]);
+                }
+
+                // Compute the Alignment.
+                // We already know that this is a good alignment, otherwise we
+                // would not have stored it.
+                alignOrientedReads(
+                    markersSortedByKmerId,
+                    maxSkip, maxMarkerFrequency, 0, debug, graph, alignment, alignmentInfo);
+            }
 
 
             // In the global marker graph, merge pairs
@@ -435,31 +627,88 @@ void Assembler::createMarkerGraphVerticesThreadFunction1(size_t threadId)
                 const MarkerId markerId0 = getMarkerId(orientedReadIds[0], ordinal0);
                 const MarkerId markerId1 = getMarkerId(orientedReadIds[1], ordinal1);
                 CZI_ASSERT(markers.begin()[markerId0].kmerId == markers.begin()[markerId1].kmerId);
-                disjointSetsPointer->unite(markerId0, markerId1);
+                unionBuffer.unite(markerId0, markerId1);
 
                 // Also merge the reverse complemented markers.
                 // This guarantees that the marker graph remains invariant
                 // under strand swap.
-                disjointSetsPointer->unite(
+                unionBuffer.unite(
                 	findReverseComplement(markerId0),
 					findReverseComplement(markerId1));
             }
         }
     }
+    unionBuffer.flush();
+
+}
+
 
+
+// Out of core mode: instead of applying the union operations,
+// write them to the spill file of their partition.
+// The template is instantiated here, so this is not
+// in AssemblerMarkerGraphOutOfCore.cpp.
+void Assembler::createMarkerGraphVerticesSpillThreadFunction(size_t threadId)
+{
+    CreateMarkerGraphVerticesSpillBuffer spillBuffer(*this);
+    createMarkerGraphVerticesThreadFunction1Template(spillBuffer);
 }
 
 
 
 void Assembler::createMarkerGraphVerticesThreadFunction2(size_t threadId)
 {
-    DisjointSets& disjointSets = *createMarkerGraphVerticesData.disjointSetsPointer;
+    auto& data = createMarkerGraphVerticesData;
+    if(data.disjointSets32Pointer) {
+        createMarkerGraphVerticesThreadFunction2Template(*data.disjointSets32Pointer);
+    } else {
+        createMarkerGraphVerticesThreadFunction2Template(*data.disjointSetsPointer);
+    }
+}
+
+
+
+// Incremental mode: initialize the disjoint sets from the stored disjoint set table.
+void Assembler::createMarkerGraphVerticesSeedThreadFunction(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    if(data.disjointSets32Pointer) {
+        createMarkerGraphVerticesSeedThreadFunctionTemplate(*data.disjointSets32Pointer);
+    } else {
+        createMarkerGraphVerticesSeedThreadFunctionTemplate(*data.disjointSetsPointer);
+    }
+}
+
+
+
+template<class DisjointSetsType> void Assembler::createMarkerGraphVerticesSeedThreadFunctionTemplate(
+    DisjointSetsType& disjointSets)
+{
+    const auto& storedDisjointSetTable = createMarkerGraphVerticesData.storedDisjointSetTable;
+    using Uint = typename DisjointSetsType::Uint;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(MarkerId i=begin; i!=end; ++i) {
+            const uint64_t disjointSetId = storedDisjointSetTable[i];
+            if(disjointSetId != i) {
+                disjointSets.unite(Uint(i), Uint(disjointSetId));
+            }
+        }
+    }
+}
+
+
+
+template<class DisjointSetsType> void Assembler::createMarkerGraphVerticesThreadFunction2Template(
+    DisjointSetsType& disjointSets)
+{
     auto& disjointSetTable = createMarkerGraphVerticesData.disjointSetTable;
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
         for(MarkerId i=begin; i!=end; ++i) {
-            const uint64_t disjointSetId = disjointSets.find(i);
+            const uint64_t disjointSetId = disjointSets.find(typename DisjointSetsType::Uint(i));
             disjointSetTable[i] = disjointSetId;
         }
     }
@@ -485,44 +734,121 @@ void Assembler::createMarkerGraphVerticesThreadFunction3(size_t threadId)
 
 
 
-void Assembler::createMarkerGraphVerticesThreadFunction4(size_t threadId)
+// Add the size of each disjoint set to the histogram.
+// The disjoint set id is the id of one of its markers, so
+// the sizes of the disjoint sets are the non-zero entries of workArea.
+void Assembler::createMarkerGraphVerticesHistogramThreadFunction(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    const auto& workArea = data.workArea;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; ++i) {
+            const uint64_t markerCount = workArea[i];
+            if(markerCount) {
+                data.coverageHistogram.increment(threadId, markerCount);
+            }
+        }
+    }
+}
+
+
+
+void Assembler::selectMarkerGraphCoverageThresholds(
+    const Histogram& histogram,
+    size_t& minCoverage,
+    size_t& maxCoverage)
 {
-    createMarkerGraphVerticesThreadFunction45(4);
+    // Work with a smoothed histogram to avoid valleys caused by noise.
+    // The last position counts all larger sizes, so it is not used.
+    vector<double> smoothed = histogram.smoothed(2);
+    if(!smoothed.empty()) {
+        smoothed.pop_back();
+    }
+
+    // The valley between the low coverage peak and the main peak.
+    const size_t valley = Histogram::findValley(smoothed, 1);
+    if(valley >= smoothed.size()) {
+        throw runtime_error("Could not select marker graph coverage thresholds "
+            "because the coverage histogram has no valley. "
+            "See DisjointSetsSizeHistogram.csv and specify the thresholds explicitly.");
+    }
+
+    // The main peak.
+    const size_t peak = size_t(std::max_element(
+        smoothed.begin() + int64_t(valley), smoothed.end()) - smoothed.begin());
+    cout << "The coverage histogram has a valley at " << valley <<
+        " and its main peak at " << peak << "." << endl;
+
+    if(minCoverage == 0) {
+        minCoverage = max(size_t(1), valley);
+        cout << "Automatically selected minimum coverage " << minCoverage << "." << endl;
+    }
+    if(maxCoverage == 0) {
+        maxCoverage = min(maxCoverageToPeakRatio * peak, Histogram::findValley(smoothed, peak));
+        maxCoverage = max(maxCoverage, minCoverage);
+        cout << "Automatically selected maximum coverage " << maxCoverage << "." << endl;
+    }
 }
 
 
 
-void Assembler::createMarkerGraphVerticesThreadFunction5(size_t threadId)
+// Marker sweep 1: reassign each marker to its renumbered disjoint set
+// and count the markers in each renumbered disjoint set.
+void Assembler::createMarkerGraphVerticesThreadFunction4(size_t threadId)
 {
-    createMarkerGraphVerticesThreadFunction45(5);
+    auto& disjointSetTable = createMarkerGraphVerticesData.disjointSetTable;
+    const auto& workArea = createMarkerGraphVerticesData.workArea;
+    auto& disjointSetMarkers = createMarkerGraphVerticesData.disjointSetMarkers;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(MarkerId i=begin; i!=end; ++i) {
+            const MarkerGraph::VertexId disjointSetId = workArea[disjointSetTable[i]];
+            disjointSetTable[i] = disjointSetId;
+            if(disjointSetId == MarkerGraph::invalidVertexId) {
+                markerGraph.vertexTable[i] = MarkerGraph::invalidCompressedVertexId;
+            } else {
+                disjointSetMarkers.incrementCountMultithreaded(disjointSetId);
+            }
+        }
+    }
 }
 
 
 
-void Assembler::createMarkerGraphVerticesThreadFunction6(size_t threadId)
+// Marker sweep 2: store the markers of each renumbered disjoint set.
+void Assembler::createMarkerGraphVerticesThreadFunction5(size_t threadId)
 {
+    const auto& disjointSetTable = createMarkerGraphVerticesData.disjointSetTable;
     auto& disjointSetMarkers = createMarkerGraphVerticesData.disjointSetMarkers;
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
-        for(MarkerGraph::VertexId i=begin; i!=end; ++i) {
-            auto markers = disjointSetMarkers[i];
-            sort(markers.begin(), markers.end());
+        for(MarkerId i=begin; i!=end; ++i) {
+            const MarkerGraph::VertexId disjointSetId = disjointSetTable[i];
+            if(disjointSetId != MarkerGraph::invalidVertexId) {
+                disjointSetMarkers.storeMultithreaded(disjointSetId, i);
+            }
         }
     }
 }
 
 
 
-void Assembler::createMarkerGraphVerticesThreadFunction7(size_t threadId)
+// Sort the markers of each disjoint set and flag disjoint sets
+// that contain more than one marker on the same read.
+void Assembler::createMarkerGraphVerticesThreadFunction6(size_t threadId)
 {
-    const auto& disjointSetMarkers = createMarkerGraphVerticesData.disjointSetMarkers;
+    auto& disjointSetMarkers = createMarkerGraphVerticesData.disjointSetMarkers;
     auto& isBadDisjointSet = createMarkerGraphVerticesData.isBadDisjointSet;
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
         for(MarkerGraph::VertexId disjointSetId=begin; disjointSetId!=end; ++disjointSetId) {
             auto markers = disjointSetMarkers[disjointSetId];
+            sort(markers.begin(), markers.end());
             const size_t markerCount = markers.size();
             CZI_ASSERT(markerCount > 0);
             isBadDisjointSet[disjointSetId] = false;
@@ -547,36 +873,183 @@ void Assembler::createMarkerGraphVerticesThreadFunction7(size_t threadId)
 
 
 
-void Assembler::createMarkerGraphVerticesThreadFunction45(int value)
+// Vertex sweep, pass 1: count the markers of each vertex.
+void Assembler::createMarkerGraphVerticesThreadFunction7(size_t threadId)
 {
-    CZI_ASSERT(value==4 || value==5);
-    const auto& disjointSetTable = createMarkerGraphVerticesData.disjointSetTable;
-    auto& disjointSetMarkers = createMarkerGraphVerticesData.disjointSetMarkers;
+    const auto& data = createMarkerGraphVerticesData;
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
-        for(MarkerId i=begin; i!=end; ++i) {
-            const uint64_t disjointSetId = disjointSetTable[i];
-            if(disjointSetId == MarkerGraph::invalidVertexId) {
-                continue;
-            }
-            if(value == 4) {
-                disjointSetMarkers.incrementCountMultithreaded(disjointSetId);
-            } else {
-                disjointSetMarkers.storeMultithreaded(disjointSetId, i);
+        for(MarkerGraph::VertexId disjointSetId=begin; disjointSetId!=end; ++disjointSetId) {
+            if(!data.isBadDisjointSet[disjointSetId]) {
+
+                // Each vertex is only incremented by one thread,
+                // so this does not need to be atomic.
+                markerGraph.vertices.incrementCount(
+                    data.workArea[disjointSetId],
+                    data.disjointSetMarkers.size(disjointSetId));
             }
         }
-   }
+    }
 }
 
 
 
-// Check for consistency of markerGraph.vertexTable and markerGraph.vertices.
-void Assembler::checkMarkerGraphVertices(
-    size_t minCoverage,
-    size_t maxCoverage)
+// Vertex sweep, pass 2: store the markers of each vertex
+// and the vertex table entries for those markers.
+void Assembler::createMarkerGraphVerticesThreadFunction8(size_t threadId)
 {
-    checkMarkersAreOpen();
+    const auto& data = createMarkerGraphVerticesData;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(MarkerGraph::VertexId disjointSetId=begin; disjointSetId!=end; ++disjointSetId) {
+            const auto markers = data.disjointSetMarkers[disjointSetId];
+            if(data.isBadDisjointSet[disjointSetId]) {
+                for(const MarkerId markerId: markers) {
+                    markerGraph.vertexTable[markerId] = MarkerGraph::invalidCompressedVertexId;
+                }
+            } else {
+                const MarkerGraph::VertexId vertexId = data.workArea[disjointSetId];
+                copy(markers.begin(), markers.end(), markerGraph.vertices.begin(vertexId));
+                for(const MarkerId markerId: markers) {
+                    markerGraph.vertexTable[markerId] = vertexId;
+                }
+            }
+        }
+    }
+}
+
+
+
+// Parallel renumbering of disjoint sets used by createMarkerGraphVertices.
+// For each disjoint set i in [0, n), if the set is kept data.workArea[i]
+// is set to the number of kept sets preceding it,
+// otherwise to MarkerGraph::invalidVertexId.
+// If data.renumberBadDisjointSets is false, a set is kept
+// if its marker count, stored in data.workArea[i], is in
+// [data.minCoverage, data.maxCoverage].
+// If data.renumberBadDisjointSets is true, a set is kept
+// if data.isBadDisjointSet[i] is false.
+// Returns the number of kept sets.
+// This is a prefix sum computed in two passes.
+// The first pass counts kept sets in each batch of batchSize
+// and the second pass assigns the new numbers.
+MarkerGraph::VertexId Assembler::createMarkerGraphVerticesRenumber(
+    uint64_t n,
+    uint64_t batchSize,
+    size_t threadCount)
+{
+    auto& data = createMarkerGraphVerticesData;
+    data.renumberBatchSize = batchSize;
+    data.renumberBatchCount.clear();
+    data.renumberBatchCount.resize((n + batchSize - 1) / batchSize, 0);
+
+    setupLoadBalancing(n, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesRenumberThreadFunction1, threadCount);
+
+    // Exclusive prefix sum over the batches.
+    MarkerGraph::VertexId keptCount = 0;
+    for(uint64_t& c: data.renumberBatchCount) {
+        const uint64_t batchKeptCount = c;
+        c = keptCount;
+        keptCount += batchKeptCount;
+    }
+
+    setupLoadBalancing(n, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesRenumberThreadFunction2, threadCount);
+
+    return keptCount;
+}
+
+
+
+bool Assembler::createMarkerGraphVerticesIsKept(MarkerGraph::VertexId disjointSetId) const
+{
+    const auto& data = createMarkerGraphVerticesData;
+    if(data.renumberBadDisjointSets) {
+        return !data.isBadDisjointSet[disjointSetId];
+    } else {
+        const MarkerGraph::VertexId markerCount = data.workArea[disjointSetId];
+        return markerCount>=data.minCoverage && markerCount<=data.maxCoverage;
+    }
+}
+
+
+
+// Count the kept disjoint sets in each renumbering batch.
+// The batches returned by getNextBatch can span more than
+// one renumbering batch, but their boundaries are multiples of
+// the batch size.
+void Assembler::createMarkerGraphVerticesRenumberThreadFunction1(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    const uint64_t batchSize = data.renumberBatchSize;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t batchBegin=begin; batchBegin<end; batchBegin+=batchSize) {
+            const uint64_t batchEnd = min(end, batchBegin + batchSize);
+            uint64_t keptCount = 0;
+            for(MarkerGraph::VertexId i=batchBegin; i!=batchEnd; ++i) {
+                if(createMarkerGraphVerticesIsKept(i)) {
+                    ++keptCount;
+                }
+            }
+            data.renumberBatchCount[batchBegin / batchSize] = keptCount;
+        }
+    }
+}
+
+
+
+// Assign the new numbers, starting each renumbering batch at the
+// value computed by the prefix sum.
+void Assembler::createMarkerGraphVerticesRenumberThreadFunction2(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    const uint64_t batchSize = data.renumberBatchSize;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t batchBegin=begin; batchBegin<end; batchBegin+=batchSize) {
+            const uint64_t batchEnd = min(end, batchBegin + batchSize);
+            MarkerGraph::VertexId newId = data.renumberBatchCount[batchBegin / batchSize];
+            for(MarkerGraph::VertexId i=batchBegin; i!=batchEnd; ++i) {
+                if(createMarkerGraphVerticesIsKept(i)) {
+                    data.workArea[i] = newId++;
+                } else {
+                    data.workArea[i] = MarkerGraph::invalidVertexId;
+                }
+            }
+        }
+    }
+}
+
+
+
+// Add the time since tPhase to the timings of the
+// createMarkerGraphVertices phases, then restart tPhase.
+void Assembler::endCreateMarkerGraphVerticesPhase(
+    const string& phaseName,
+    vector< pair<string, double> >& phaseTimes,
+    steady_clock::time_point& tPhase)
+{
+    const auto t = steady_clock::now();
+    const double phaseTime = seconds(t - tPhase);
+    cout << timestamp << phaseName << " completed in " << phaseTime << " s." << endl;
+    phaseTimes.push_back(make_pair(phaseName, phaseTime));
+    tPhase = t;
+}
+
+
+
+// Check for consistency of markerGraph.vertexTable and markerGraph.vertices.
+void Assembler::checkMarkerGraphVertices(
+    size_t minCoverage,
+    size_t maxCoverage)
+{
+    checkMarkersAreOpen();
     checkMarkerGraphVerticesAreAvailable();
     CZI_ASSERT(markers.totalSize() == markerGraph.vertexTable.size());
     const MarkerId markerCount = markers.totalSize();
@@ -665,6 +1138,15 @@ void Assembler::accessMarkerGraphVertices()
 
     markerGraph.vertices.accessExistingReadOnly(
         largeDataName("MarkerGraphVertices"));
+
+    // The bad vertex bitmap is only available
+    // after createMarkerGraphEdges. If it is not available,
+    // isBadMarkerGraphVertex looks at the markers of the vertex instead.
+    try {
+        markerGraph.isBadVertexBitmap.accessExistingReadOnly(
+            largeDataName("GlobalMarkerGraphIsBadVertex"));
+    } catch(std::exception&) {
+    }
 }
 
 
@@ -753,6 +1235,18 @@ void Assembler::getGlobalMarkerGraphVertexChildren(
         return;
     }
 
+    // If the marker graph edges were already created,
+    // get the children from the compact adjacency.
+    // This gives the same result and is much faster.
+    if(markerGraph.compactEdgesBySource.isOpen()) {
+        for(const MarkerGraph::EdgeId edgeId: markerGraph.compactEdgesBySource[vertexId]) {
+            children.push_back(markerGraph.edges[edgeId].target);
+        }
+        sort(children.begin(), children.end());
+        children.resize(std::unique(children.begin(), children.end()) - children.begin());
+        return;
+    }
+
     // Loop over the markers of this vertex.
     for(const MarkerId markerId: markerGraph.vertices[vertexId]) {
 
@@ -878,6 +1372,18 @@ void Assembler::getGlobalMarkerGraphVertexParents(
         return;
     }
 
+    // If the marker graph edges were already created,
+    // get the parents from the compact adjacency.
+    // This gives the same result and is much faster.
+    if(markerGraph.compactEdgesByTarget.isOpen()) {
+        for(const MarkerGraph::EdgeId edgeId: markerGraph.compactEdgesByTarget[vertexId]) {
+            parents.push_back(markerGraph.edges[edgeId].source);
+        }
+        sort(parents.begin(), parents.end());
+        parents.resize(std::unique(parents.begin(), parents.end()) - parents.begin());
+        return;
+    }
+
     // Loop over the markers of this vertex.
     for(const MarkerId markerId: markerGraph.vertices[vertexId]) {
 
@@ -990,6 +1496,167 @@ void Assembler::getGlobalMarkerGraphVertexParents(
 
 
 
+// Batched versions of getGlobalMarkerGraphVertexChildren
+// and getGlobalMarkerGraphVertexParents.
+void Assembler::getGlobalMarkerGraphVerticesChildren(
+    const MarkerGraph::VertexId* vertexIdsBegin,
+    const MarkerGraph::VertexId* vertexIdsEnd,
+    vector< pair<MarkerGraph::VertexId, MarkerInterval> >& neighbors,
+    vector<uint64_t>& neighborsBegin,
+    GlobalMarkerGraphNeighborsWorkArea& workArea
+    ) const
+{
+    getGlobalMarkerGraphVerticesNeighbors(
+        vertexIdsBegin, vertexIdsEnd, true, neighbors, neighborsBegin, workArea);
+}
+void Assembler::getGlobalMarkerGraphVerticesParents(
+    const MarkerGraph::VertexId* vertexIdsBegin,
+    const MarkerGraph::VertexId* vertexIdsEnd,
+    vector< pair<MarkerGraph::VertexId, MarkerInterval> >& neighbors,
+    vector<uint64_t>& neighborsBegin,
+    GlobalMarkerGraphNeighborsWorkArea& workArea
+    ) const
+{
+    getGlobalMarkerGraphVerticesNeighbors(
+        vertexIdsBegin, vertexIdsEnd, false, neighbors, neighborsBegin, workArea);
+}
+
+
+
+void Assembler::getGlobalMarkerGraphVerticesNeighbors(
+    const MarkerGraph::VertexId* vertexIdsBegin,
+    const MarkerGraph::VertexId* vertexIdsEnd,
+    bool forward,
+    vector< pair<MarkerGraph::VertexId, MarkerInterval> >& neighbors,
+    vector<uint64_t>& neighborsBegin,
+    GlobalMarkerGraphNeighborsWorkArea& workArea
+    ) const
+{
+    using VertexId = MarkerGraph::VertexId;
+    const uint64_t vertexCount = uint64_t(vertexIdsEnd - vertexIdsBegin);
+    vector< pair<uint64_t, MarkerInterval> >& markerIntervals = workArea.markerIntervals;
+    vector<VertexId>& neighborVertexIds = workArea.neighborVertexIds;
+    markerIntervals.clear();
+    neighborVertexIds.clear();
+    neighbors.clear();
+    neighborsBegin.clear();
+
+    // Stage 1: prefetch the markers of all vertices.
+    for(uint64_t i=0; i<vertexCount; i++) {
+        __builtin_prefetch(markerGraph.vertices.begin(vertexIdsBegin[i]));
+    }
+
+    // Stage 2: find the oriented read and ordinal of each marker,
+    // and prefetch the vertexTable entry of the next (or previous)
+    // marker on the same oriented read.
+    for(uint64_t i=0; i<vertexCount; i++) {
+        const VertexId vertexId = vertexIdsBegin[i];
+        if(isBadMarkerGraphVertex(vertexId)) {
+            continue;
+        }
+        for(const MarkerId markerId: markerGraph.vertices[vertexId]) {
+            MarkerInterval markerInterval;
+            tie(markerInterval.orientedReadId, markerInterval.ordinals[0]) = findMarkerId(markerId);
+            if(forward) {
+                if(markerInterval.ordinals[0] + 1 >= markers.size(markerInterval.orientedReadId.getValue())) {
+                    continue;
+                }
+                markerInterval.ordinals[1] = markerInterval.ordinals[0] + 1;
+            } else {
+                if(markerInterval.ordinals[0] == 0) {
+                    continue;
+                }
+                markerInterval.ordinals[1] = markerInterval.ordinals[0] - 1;
+            }
+            __builtin_prefetch(&markerGraph.vertexTable[
+                getMarkerId(markerInterval.orientedReadId, markerInterval.ordinals[1])]);
+            markerIntervals.push_back(make_pair(i, markerInterval));
+        }
+    }
+
+    // Stage 3: find the first marker contained in a vertex,
+    // and prefetch the toc entry of that vertex.
+    const auto& verticesToc = markerGraph.vertices.getToc();
+    for(auto& p: markerIntervals) {
+        const VertexId neighborVertexId = findGlobalMarkerGraphNeighbor(p.second, forward, false);
+        neighborVertexIds.push_back(neighborVertexId);
+        if(neighborVertexId != MarkerGraph::invalidCompressedVertexId) {
+            __builtin_prefetch(&verticesToc[neighborVertexId]);
+        }
+    }
+
+    // Stage 4: prefetch the markers of the neighbors,
+    // needed to check if they are bad vertices.
+    // This is not needed if the bad vertex bitmap is available.
+    if(!markerGraph.isBadVertexBitmap.isOpen) {
+        for(const VertexId neighborVertexId: neighborVertexIds) {
+            if(neighborVertexId != MarkerGraph::invalidCompressedVertexId) {
+                __builtin_prefetch(markerGraph.vertices.begin(neighborVertexId));
+            }
+        }
+    }
+
+    // Stage 5: skip past bad vertices and store the results for each vertex.
+    uint64_t j = 0;
+    for(uint64_t i=0; i<vertexCount; i++) {
+        neighborsBegin.push_back(neighbors.size());
+        for(; j<markerIntervals.size() && markerIntervals[j].first==i; j++) {
+            MarkerInterval& markerInterval = markerIntervals[j].second;
+            VertexId neighborVertexId = neighborVertexIds[j];
+
+            // If the neighbor is a bad vertex, keep looking past it.
+            // This is rare.
+            if( neighborVertexId != MarkerGraph::invalidCompressedVertexId &&
+                isBadMarkerGraphVertex(neighborVertexId)) {
+                neighborVertexId = MarkerGraph::invalidCompressedVertexId;
+                if(forward) {
+                    ++markerInterval.ordinals[1];
+                    neighborVertexId = findGlobalMarkerGraphNeighbor(markerInterval, forward, true);
+                } else if(markerInterval.ordinals[1] > 0) {
+                    --markerInterval.ordinals[1];
+                    neighborVertexId = findGlobalMarkerGraphNeighbor(markerInterval, forward, true);
+                }
+            }
+
+            if(neighborVertexId != MarkerGraph::invalidCompressedVertexId) {
+                neighbors.push_back(make_pair(neighborVertexId, markerInterval));
+            }
+        }
+        sort(neighbors.begin() + int64_t(neighborsBegin.back()), neighbors.end());
+    }
+    neighborsBegin.push_back(neighbors.size());
+}
+
+
+
+MarkerGraph::VertexId Assembler::findGlobalMarkerGraphNeighbor(
+    MarkerInterval& markerInterval,
+    bool forward,
+    bool skipBadVertices
+    ) const
+{
+    const uint64_t markerCount = markers.size(markerInterval.orientedReadId.getValue());
+    while(markerInterval.ordinals[1] < markerCount) {
+        const MarkerGraph::VertexId vertexId = markerGraph.vertexTable[
+            getMarkerId(markerInterval.orientedReadId, markerInterval.ordinals[1])];
+        if( vertexId != MarkerGraph::invalidCompressedVertexId &&
+            !(skipBadVertices && isBadMarkerGraphVertex(vertexId))) {
+            return vertexId;
+        }
+        if(forward) {
+            ++markerInterval.ordinals[1];
+        } else {
+            if(markerInterval.ordinals[1] == 0) {
+                break;
+            }
+            --markerInterval.ordinals[1];
+        }
+    }
+    return MarkerGraph::invalidCompressedVertexId;
+}
+
+
+
 // Find the reverse complement of each marker graph vertex.
 void Assembler::findMarkerGraphReverseComplementVertices(size_t threadCount)
 {
@@ -1016,8 +1683,13 @@ void Assembler::findMarkerGraphReverseComplementVertices(size_t threadCount)
         largeDataPageSize);
     markerGraph.reverseComplementVertex.resize(vertexCount);
 
-    // Check each vertex.
-    setupLoadBalancing(vertexCount, 10000);
+    // Process the markers of each read.
+    fill(
+        markerGraph.reverseComplementVertex.begin(),
+        markerGraph.reverseComplementVertex.end(),
+        MarkerGraph::invalidVertexId);
+    const ReadId readCount = ReadId(markers.size() / 2);
+    setupLoadBalancing(readCount, 100);
     runThreads(&Assembler::findMarkerGraphReverseComplementVerticesThreadFunction1,
         threadCount);
 
@@ -1026,57 +1698,58 @@ void Assembler::findMarkerGraphReverseComplementVertices(size_t threadCount)
     setupLoadBalancing(vertexCount, 10000);
     runThreads(&Assembler::findMarkerGraphReverseComplementVerticesThreadFunction2,
         threadCount);
-    cout << timestamp << "Begin findMarkerGraphReverseComplementVertices." << endl;
+    cout << timestamp << "End findMarkerGraphReverseComplementVertices." << endl;
 
 }
 
 
 
+// The reverse complement of marker graph vertices is found by
+// processing the two oriented reads of each read in parallel,
+// the first one by increasing ordinal and the second one by decreasing ordinal.
+// This way, accesses to the vertex table are sequential,
+// and no binary search in the markers toc is required.
+// Each pair of reverse complemented markers determines
+// the reverse complement of the vertices they belong to.
+// The first marker pair to reach a vertex sets its reverse complement.
+// All others check that they are consistent with it.
+// This guarantees that the markers of each vertex are exactly
+// the reverse complements of the markers of its
+// reverse complement vertex.
 void Assembler::findMarkerGraphReverseComplementVerticesThreadFunction1(size_t threadId)
 {
     using VertexId = MarkerGraph::VertexId;
+    VertexId* reverseComplementVertex = markerGraph.reverseComplementVertex.begin();
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
 
-        for (VertexId vertexId=begin; vertexId!=end; vertexId++) {
-
-            // Get the markers of this vertex.
-            const MemoryAsContainer<MarkerId> vertexMarkers =
-                markerGraph.vertices[vertexId];
-            CZI_ASSERT(vertexMarkers.size() > 0);
-
-            // Get the first marker of this vertex.
-            const MarkerId firstMarkerId = vertexMarkers[0];
-
-            /// Find the reverse complemented marker.
-            const MarkerId firstMarkerIdReverseComplement = findReverseComplement(
-                firstMarkerId);
-
-            // Find the corresponding vertex.
-            const VertexId vertexIdReverseComplement =
-                markerGraph.vertexTable[firstMarkerIdReverseComplement];
-            CZI_ASSERT(vertexIdReverseComplement != MarkerGraph::invalidCompressedVertexId);
-
-            // Get the markers of the reverse complemented vertex.
-            const MemoryAsContainer<MarkerId> vertexMarkersReverseComplement =
-                markerGraph.vertices[vertexIdReverseComplement];
-
-            // Check that the markers are all consistent.
-            // This could become expensive.
-            // It can be taken out when we are confident that this code works.
-            CZI_ASSERT(vertexMarkers.size() == vertexMarkersReverseComplement.size());
-            for (size_t i=0; i<vertexMarkers.size(); i++) {
-                const MarkerId markerId = vertexMarkers[i];
-                const MarkerId markerIdReverseComplement =
-                    vertexMarkersReverseComplement[i];
-                CZI_ASSERT(
-                    markerIdReverseComplement == findReverseComplement(markerId));
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            const OrientedReadId orientedReadId0(readId, 0);
+            const OrientedReadId orientedReadId1(readId, 1);
+            const uint64_t markerCount = markers.size(orientedReadId0.getValue());
+            CZI_ASSERT(markers.size(orientedReadId1.getValue()) == markerCount);
+            const MarkerId firstMarkerId0 = getMarkerId(orientedReadId0, 0);
+            const MarkerId firstMarkerId1 = getMarkerId(orientedReadId1, 0);
+
+            for(uint64_t ordinal=0; ordinal<markerCount; ordinal++) {
+                const MarkerId markerId0 = firstMarkerId0 + ordinal;
+                const MarkerId markerId1 = firstMarkerId1 + (markerCount - 1 - ordinal);
+                const VertexId vertexId0 = markerGraph.vertexTable[markerId0];
+                const VertexId vertexId1 = markerGraph.vertexTable[markerId1];
+                if(vertexId0 == MarkerGraph::invalidCompressedVertexId) {
+                    CZI_ASSERT(vertexId1 == MarkerGraph::invalidCompressedVertexId);
+                    continue;
+                }
+                CZI_ASSERT(vertexId1 != MarkerGraph::invalidCompressedVertexId);
+
+                const VertexId oldValue0 = __sync_val_compare_and_swap(
+                    reverseComplementVertex + vertexId0, MarkerGraph::invalidVertexId, vertexId1);
+                CZI_ASSERT(oldValue0 == MarkerGraph::invalidVertexId || oldValue0 == vertexId1);
+                const VertexId oldValue1 = __sync_val_compare_and_swap(
+                    reverseComplementVertex + vertexId1, MarkerGraph::invalidVertexId, vertexId0);
+                CZI_ASSERT(oldValue1 == MarkerGraph::invalidVertexId || oldValue1 == vertexId0);
             }
-
-            markerGraph.reverseComplementVertex[vertexId] =
-                vertexIdReverseComplement;
-
         }
     }
 }
@@ -1093,6 +1766,7 @@ void Assembler::findMarkerGraphReverseComplementVerticesThreadFunction2(size_t t
         for (VertexId vertexId=begin; vertexId!=end; vertexId++) {
             const VertexId vertexIdReverseComplement =
                 markerGraph.reverseComplementVertex[vertexId];
+            CZI_ASSERT(vertexIdReverseComplement != MarkerGraph::invalidVertexId);
             CZI_ASSERT(
                 markerGraph.reverseComplementVertex[vertexIdReverseComplement] == vertexId);
         }
@@ -1118,6 +1792,10 @@ void Assembler::findMarkerGraphReverseComplementEdges(size_t threadCount)
     checkMarkerGraphVerticesAreAvailable();
     checkMarkerGraphEdgesIsOpen();
     CZI_ASSERT(markerGraph.reverseComplementVertex.isOpen);
+    if(markerGraph.edgeMarkerIntervalsAreCanonical || !markerGraph.edgeMarkerIntervals.isOpen()) {
+        throw runtime_error("findMarkerGraphReverseComplementEdges requires "
+            "uncompressed marker intervals stored for all edges.");
+    }
 
     // Adjust the numbers of threads, if necessary.
     if(threadCount == 0) {
@@ -1134,8 +1812,10 @@ void Assembler::findMarkerGraphReverseComplementEdges(size_t threadCount)
         largeDataName("MarkerGraphReverseComplementeEdge"), largeDataPageSize);
     markerGraph.reverseComplementEdge.resize(edgeCount);
 
-    // Check all marker graph edges.
-    setupLoadBalancing(edgeCount, 10000);
+    // Check all marker graph edges, grouped by source vertex.
+    CZI_ASSERT(markerGraph.compactEdgesBySource.isOpen());
+    CZI_ASSERT(markerGraph.compactEdgesByTarget.isOpen());
+    setupLoadBalancing(markerGraph.vertices.size(), 10000);
     runThreads(&Assembler::findMarkerGraphReverseComplementEdgesThreadFunction1,
         threadCount);
 
@@ -1151,6 +1831,12 @@ void Assembler::findMarkerGraphReverseComplementEdges(size_t threadCount)
 
 
 
+// The edges are processed grouped by source vertex.
+// The reverse complement of an edge v->x is edge rc(x)->rc(v),
+// so the reverse complements of all edges with source v
+// are edges with target rc(v).
+// This way we access compactEdgesByTarget once per vertex,
+// instead of searching compactEdgesBySource once per edge.
 void Assembler::findMarkerGraphReverseComplementEdgesThreadFunction1(size_t threadId)
 {
     using VertexId = MarkerGraph::VertexId;
@@ -1158,38 +1844,49 @@ void Assembler::findMarkerGraphReverseComplementEdgesThreadFunction1(size_t thre
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
-        for(EdgeId edgeId=begin; edgeId!=end; edgeId++) {
-            const MarkerGraph::Edge& edge = markerGraph.edges[edgeId];
-            const VertexId v0 = edge.source;
-            const VertexId v1 = edge.target;
-            const VertexId v0rc = markerGraph.reverseComplementVertex[v0];
-            const VertexId v1rc = markerGraph.reverseComplementVertex[v1];
-            const EdgeId edgeIdRc = markerGraph.findEdgeId(v1rc, v0rc);
-            markerGraph.reverseComplementEdge[edgeId] = edgeIdRc;
-
-            // Check that marker intervals of the two are consistent.
-            const MemoryAsContainer<MarkerInterval> markerIntervals =
-                markerGraph.edgeMarkerIntervals[edgeId];
-            const MemoryAsContainer<MarkerInterval> markerIntervalsRc =
-                markerGraph.edgeMarkerIntervals[edgeIdRc];
-            CZI_ASSERT(markerIntervals.size() == markerIntervalsRc.size());
-            for (size_t i=0; i<markerIntervals.size(); i++) {
-                const MarkerInterval& markerInterval = markerIntervals[i];
-                const MarkerInterval& markerIntervalRc = markerIntervalsRc[i];
-                CZI_ASSERT(
-                    markerInterval.orientedReadId.getReadId()
-                        == markerIntervalRc.orientedReadId.getReadId());
-                CZI_ASSERT(
-                    markerInterval.orientedReadId.getStrand()
-                        == 1 - markerIntervalRc.orientedReadId.getStrand());
-                const uint32_t markerCount = uint32_t(
-                    markers.size(markerInterval.orientedReadId.getValue()));
-                CZI_ASSERT(
-                    markerInterval.ordinals[0]
-                        == markerCount - 1 - markerIntervalRc.ordinals[1]);
-                CZI_ASSERT(
-                    markerInterval.ordinals[1]
-                        == markerCount - 1 - markerIntervalRc.ordinals[0]);
+        for(VertexId v=begin; v!=end; v++) {
+            const VertexId vRc = markerGraph.reverseComplementVertex[v];
+            const auto edgesRc = markerGraph.compactEdgesByTarget[vRc];
+
+            for(const EdgeId edgeId: markerGraph.compactEdgesBySource[v]) {
+                const MarkerGraph::Edge& edge = markerGraph.edges[edgeId];
+                const VertexId xRc = markerGraph.reverseComplementVertex[edge.target];
+
+                // Find the edge xRc->vRc.
+                EdgeId edgeIdRc = MarkerGraph::invalidEdgeId;
+                for(const EdgeId candidateEdgeId: edgesRc) {
+                    if(markerGraph.edges[candidateEdgeId].source == xRc) {
+                        edgeIdRc = candidateEdgeId;
+                        break;
+                    }
+                }
+                CZI_ASSERT(edgeIdRc != MarkerGraph::invalidEdgeId);
+                markerGraph.reverseComplementEdge[edgeId] = edgeIdRc;
+
+                // Check that marker intervals of the two are consistent.
+                const MemoryAsContainer<MarkerInterval> markerIntervals =
+                    markerGraph.edgeMarkerIntervals[edgeId];
+                const MemoryAsContainer<MarkerInterval> markerIntervalsRc =
+                    markerGraph.edgeMarkerIntervals[edgeIdRc];
+                CZI_ASSERT(markerIntervals.size() == markerIntervalsRc.size());
+                for (size_t i=0; i<markerIntervals.size(); i++) {
+                    const MarkerInterval& markerInterval = markerIntervals[i];
+                    const MarkerInterval& markerIntervalRc = markerIntervalsRc[i];
+                    CZI_ASSERT(
+                        markerInterval.orientedReadId.getReadId()
+                            == markerIntervalRc.orientedReadId.getReadId());
+                    CZI_ASSERT(
+                        markerInterval.orientedReadId.getStrand()
+                            == 1 - markerIntervalRc.orientedReadId.getStrand());
+                    const uint32_t markerCount = uint32_t(
+                        markers.size(markerInterval.orientedReadId.getValue()));
+                    CZI_ASSERT(
+                        markerInterval.ordinals[0]
+                            == markerCount - 1 - markerIntervalRc.ordinals[1]);
+                    CZI_ASSERT(
+                        markerInterval.ordinals[1]
+                            == markerCount - 1 - markerIntervalRc.ordinals[0]);
+                }
             }
         }
     }
@@ -1257,11 +1954,47 @@ void Assembler::checkMarkerGraphIsStrandSymmetric(size_t threadCount)
     setupLoadBalancing(edgeCount, 10000);
     runThreads(&Assembler::checkMarkerGraphIsStrandSymmetricThreadFunction2, threadCount);
 
+    // All edges were checked, so none of them is dirty any more.
+    if(markerGraph.edges.isOpenWithWriteAccess) {
+        setupLoadBalancing(edgeCount, 10000);
+        runThreads(&Assembler::checkMarkerGraphIsStrandSymmetricThreadFunction4, threadCount);
+    }
+
     cout << timestamp << "End checkMarkerGraphIsStrandSymmetric." << endl;
 }
 
 
 
+void Assembler::checkMarkerGraphDirtyEdgesAreStrandSymmetric(size_t threadCount)
+{
+    cout << timestamp << "Begin checkMarkerGraphDirtyEdgesAreStrandSymmetric." << endl;
+
+    // Check that we have what we need.
+    checkMarkerGraphEdgesIsOpen();
+    CZI_ASSERT(markerGraph.edges.isOpenWithWriteAccess);
+    CZI_ASSERT(markerGraph.reverseComplementEdge.isOpen);
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // Check the dirty edges.
+    using EdgeId = MarkerGraph::EdgeId;
+    const EdgeId edgeCount = markerGraph.edges.size();
+    setupLoadBalancing(edgeCount, 100000);
+    runThreads(&Assembler::checkMarkerGraphIsStrandSymmetricThreadFunction3, threadCount);
+
+    // Clear the dirty flags. This is done in a separate pass
+    // because the check for an edge also reads its reverse complement.
+    setupLoadBalancing(edgeCount, 100000);
+    runThreads(&Assembler::checkMarkerGraphIsStrandSymmetricThreadFunction4, threadCount);
+
+    cout << timestamp << "End checkMarkerGraphDirtyEdgesAreStrandSymmetric." << endl;
+}
+
+
+
 // Check the vertices.
 void Assembler::checkMarkerGraphIsStrandSymmetricThreadFunction1(size_t threadId)
 {
@@ -1290,11 +2023,54 @@ void Assembler::checkMarkerGraphIsStrandSymmetricThreadFunction1(size_t threadId
 
 
 
+// Check the flags of the dirty edges.
+void Assembler::checkMarkerGraphIsStrandSymmetricThreadFunction3(size_t threadId)
+{
+    using EdgeId = MarkerGraph::EdgeId;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for (EdgeId e0=begin; e0!=end; e0++) {
+            const MarkerGraph::Edge& edge0 = markerGraph.edges[e0];
+            if(!edge0.isDirty) {
+                continue;
+            }
+            const EdgeId e1 = markerGraph.reverseComplementEdge[e0];
+            CZI_ASSERT(markerGraph.reverseComplementEdge[e1] == e0);
+            const MarkerGraph::Edge& edge1 = markerGraph.edges[e1];
+            CZI_ASSERT(
+                edge0.wasRemovedByTransitiveReduction
+                == edge1.wasRemovedByTransitiveReduction);
+            CZI_ASSERT(edge0.wasPruned == edge1.wasPruned);
+            CZI_ASSERT(edge0.isSuperBubbleEdge == edge1.isSuperBubbleEdge);
+        }
+    }
+}
+
+
+
+// Clear the isDirty flag of all edges.
+void Assembler::checkMarkerGraphIsStrandSymmetricThreadFunction4(size_t threadId)
+{
+    using EdgeId = MarkerGraph::EdgeId;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for (EdgeId edgeId=begin; edgeId!=end; edgeId++) {
+            markerGraph.edges[edgeId].isDirty = 0;
+        }
+    }
+}
+
+
+
 // Check the edges.
 void Assembler::checkMarkerGraphIsStrandSymmetricThreadFunction2(size_t threadId)
 {
     using VertexId = MarkerGraph::VertexId;
     using EdgeId = MarkerGraph::EdgeId;
+    vector<MarkerInterval> markerIntervals0;
+    vector<MarkerInterval> markerIntervals1;
 
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
@@ -1321,28 +2097,30 @@ void Assembler::checkMarkerGraphIsStrandSymmetricThreadFunction2(size_t threadId
             const EdgeId e0rc = markerGraph.findEdgeId(v1rc, v0rc);
             CZI_ASSERT(e0rc == e1);
 
-            const MemoryAsContainer<MarkerInterval> markerIntervals0 =
-                markerGraph.edgeMarkerIntervals[e0];
-            const MemoryAsContainer<MarkerInterval> markerIntervals1 =
-                markerGraph.edgeMarkerIntervals[e1];
+            // The MarkerIntervals of e1, reverse complemented,
+            // must be the same as those of e0.
+            // They are compared after sorting because
+            // compressMarkerGraphEdgeMarkerIntervals sorts
+            // the MarkerIntervals of each edge.
+            getMarkerGraphEdgeMarkerIntervals(e0, markerIntervals0);
+            getMarkerGraphEdgeMarkerIntervals(e1, markerIntervals1);
             CZI_ASSERT(markerIntervals0.size() == markerIntervals1.size());
+            for(MarkerInterval& markerInterval1: markerIntervals1) {
+                const uint32_t markerCount = uint32_t(
+                    getMarkerCount(markerInterval1.orientedReadId));
+                markerInterval1.orientedReadId.flipStrand();
+                markerInterval1 = MarkerInterval(
+                    markerInterval1.orientedReadId,
+                    markerCount - 1 - markerInterval1.ordinals[1],
+                    markerCount - 1 - markerInterval1.ordinals[0]);
+            }
+            sort(markerIntervals0.begin(), markerIntervals0.end());
+            sort(markerIntervals1.begin(), markerIntervals1.end());
             for (size_t i=0; i<markerIntervals0.size(); i++) {
                 const MarkerInterval& markerInterval0 = markerIntervals0[i];
                 const MarkerInterval& markerInterval1 = markerIntervals1[i];
-                CZI_ASSERT(
-                    markerInterval0.orientedReadId.getReadId()
-                    == markerInterval1.orientedReadId.getReadId());
-                CZI_ASSERT(
-                    markerInterval0.orientedReadId.getStrand()
-                    == 1 - markerInterval1.orientedReadId.getStrand());
-                const uint32_t markerCount = uint32_t(
-                    markers.size(markerInterval0.orientedReadId.getValue()));
-                CZI_ASSERT(
-                    markerInterval0.ordinals[0]
-                    == markerCount - 1 - markerInterval1.ordinals[1]);
-                CZI_ASSERT(
-                    markerInterval0.ordinals[1]
-                    == markerCount - 1 - markerInterval1.ordinals[0]);
+                CZI_ASSERT(markerInterval0.orientedReadId == markerInterval1.orientedReadId);
+                CZI_ASSERT(markerInterval0.ordinals == markerInterval1.ordinals);
             }
         }
     }
@@ -1350,41 +2128,214 @@ void Assembler::checkMarkerGraphIsStrandSymmetricThreadFunction2(size_t threadId
 
 
 
-// Python-callable function to get information about an edge of the
-// global marker graph. Returns an empty vector if the specified
-// edge does not exist.
-vector<Assembler::GlobalMarkerGraphEdgeInformation> Assembler::getGlobalMarkerGraphEdgeInformation(
-    MarkerGraph::VertexId vertexId0,
-    MarkerGraph::VertexId vertexId1
-    )
+// Keep the MarkerIntervals of marker graph edges only for
+// one edge of each reverse complement pair.
+void Assembler::storeCanonicalMarkerGraphEdgeMarkerIntervals(size_t threadCount)
 {
-    const uint32_t k = uint32_t(assemblerInfo->k);
+    cout << timestamp << "Begin storeCanonicalMarkerGraphEdgeMarkerIntervals." << endl;
 
-    // Find the children of vertexId0.
-    vector< pair<MarkerGraph::VertexId, vector<MarkerInterval> > > children;
-    vector< pair<MarkerGraph::VertexId, MarkerInterval> > workArea;
-    getGlobalMarkerGraphVertexChildren(vertexId0, children, workArea);
+    // Check that we have what we need.
+    checkMarkersAreOpen();
+    checkMarkerGraphEdgesIsOpen();
+    CZI_ASSERT(markerGraph.reverseComplementEdge.isOpen);
+    CZI_ASSERT(markerGraph.reverseComplementEdge.size() == markerGraph.edges.size());
+    if(markerGraph.edgeMarkerIntervalsAreCanonical) {
+        cout << "Marker graph edge marker intervals are already stored "
+            "for canonical edges only." << endl;
+        return;
+    }
+    if(!markerGraph.edgeMarkerIntervals.isOpen()) {
+        throw runtime_error("storeCanonicalMarkerGraphEdgeMarkerIntervals requires "
+            "uncompressed marker graph edge marker intervals.");
+    }
 
-    // Find vertexId1 in the children.
-    vector<GlobalMarkerGraphEdgeInformation> v;
-    for(const auto& child: children) {
-        if(child.first != vertexId1) {
-            continue;
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // Pass 1: the canonical edges keep their MarkerIntervals.
+    using EdgeId = MarkerGraph::EdgeId;
+    const EdgeId edgeCount = markerGraph.edges.size();
+    canonicalEdgeMarkerIntervals.createNew(
+        largeDataName("GlobalMarkerGraphEdgeMarkerIntervalsCanonical"), largeDataPageSize);
+    canonicalEdgeMarkerIntervals.beginPass1(edgeCount);
+    for(EdgeId edgeId=0; edgeId!=edgeCount; edgeId++) {
+        if(edgeId < markerGraph.reverseComplementEdge[edgeId]) {
+            canonicalEdgeMarkerIntervals.incrementCount(edgeId,
+                markerGraph.edgeMarkerIntervals.size(edgeId));
         }
+    }
+    canonicalEdgeMarkerIntervals.beginPass2();
+    canonicalEdgeMarkerIntervals.endPass2(false);
 
-        // We found vertexId1. Loop over its MarkerGraphNeighborInfo.
-        const auto& childInfos = child.second;
-        v.resize(childInfos.size());
-        for(size_t i=0; i<v.size(); i++) {
-            const auto& childInfo = childInfos[i];
-            auto& info = v[i];
-            info.readId = childInfo.orientedReadId.getReadId();
-            info.strand = childInfo.orientedReadId.getStrand();
-            info.ordinal0 = childInfo.ordinals[0];
-            info.ordinal1 = childInfo.ordinals[1];
+    // Pass 2: copy them.
+    const size_t batchSize = 10000;
+    setupLoadBalancing(edgeCount, batchSize);
+    runThreads(&Assembler::storeCanonicalMarkerGraphEdgeMarkerIntervalsThreadFunction, threadCount);
+
+    // Replace the old MarkerIntervals.
+    const uint64_t oldTotalSize = markerGraph.edgeMarkerIntervals.totalSize();
+    const uint64_t newTotalSize = canonicalEdgeMarkerIntervals.totalSize();
+    markerGraph.edgeMarkerIntervals.remove();
+    canonicalEdgeMarkerIntervals.close();
+    markerGraph.edgeMarkerIntervals.accessExistingReadOnly(
+        largeDataName("GlobalMarkerGraphEdgeMarkerIntervalsCanonical"));
+    markerGraph.edgeMarkerIntervalsAreCanonical = true;
+
+    cout << "Stored " << newTotalSize << " marker graph edge marker intervals "
+        "instead of " << oldTotalSize << "." << endl;
+    cout << timestamp << "End storeCanonicalMarkerGraphEdgeMarkerIntervals." << endl;
+}
 
-            // Get the positions.
-            const MarkerId markerId0 = getMarkerId(childInfo.orientedReadId, info.ordinal0);
+
+
+void Assembler::storeCanonicalMarkerGraphEdgeMarkerIntervalsThreadFunction(size_t threadId)
+{
+    using EdgeId = MarkerGraph::EdgeId;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(EdgeId edgeId=begin; edgeId!=end; edgeId++) {
+            if(edgeId < markerGraph.reverseComplementEdge[edgeId]) {
+                const MemoryAsContainer<MarkerInterval> markerIntervals =
+                    markerGraph.edgeMarkerIntervals[edgeId];
+                copy(markerIntervals.begin(), markerIntervals.end(),
+                    canonicalEdgeMarkerIntervals.begin(edgeId));
+            }
+        }
+    }
+}
+
+
+
+// Get the MarkerIntervals of a marker graph edge.
+void Assembler::getMarkerGraphEdgeMarkerIntervals(
+    MarkerGraph::EdgeId edgeId,
+    vector<MarkerInterval>& markerIntervals) const
+{
+    // Find the edge whose MarkerIntervals are stored.
+    const bool isStored =
+        !markerGraph.edgeMarkerIntervalsAreCanonical ||
+        edgeId < markerGraph.reverseComplementEdge[edgeId];
+    const MarkerGraph::EdgeId storedEdgeId =
+        isStored ? edgeId : markerGraph.reverseComplementEdge[edgeId];
+
+    // Get the stored MarkerIntervals.
+    if(markerGraph.compactEdgeMarkerIntervals.isOpen()) {
+        markerGraph.compactEdgeMarkerIntervals.get(storedEdgeId, markerIntervals);
+    } else {
+        const MemoryAsContainer<const MarkerInterval> storedMarkerIntervals =
+            markerGraph.edgeMarkerIntervals[storedEdgeId];
+        markerIntervals.assign(storedMarkerIntervals.begin(), storedMarkerIntervals.end());
+    }
+    if(isStored) {
+        return;
+    }
+
+    // Otherwise, compute them from those of the reverse complement edge.
+    // findMarkerGraphReverseComplementEdges checked that
+    // they correspond one to one.
+    for(MarkerInterval& markerInterval: markerIntervals) {
+        OrientedReadId orientedReadId = markerInterval.orientedReadId;
+        const uint32_t markerCount = uint32_t(getMarkerCount(orientedReadId));
+        orientedReadId.flipStrand();
+        markerInterval = MarkerInterval(
+            orientedReadId,
+            markerCount - 1 - markerInterval.ordinals[1],
+            markerCount - 1 - markerInterval.ordinals[0]);
+    }
+}
+
+
+
+uint64_t Assembler::getMarkerGraphEdgeMarkerIntervalCount(MarkerGraph::EdgeId edgeId) const
+{
+    const MarkerGraph::EdgeId storedEdgeId =
+        (!markerGraph.edgeMarkerIntervalsAreCanonical ||
+        edgeId < markerGraph.reverseComplementEdge[edgeId]) ?
+        edgeId : markerGraph.reverseComplementEdge[edgeId];
+    if(markerGraph.compactEdgeMarkerIntervals.isOpen()) {
+        return markerGraph.compactEdgeMarkerIntervals.size(storedEdgeId);
+    } else {
+        return markerGraph.edgeMarkerIntervals.size(storedEdgeId);
+    }
+}
+
+
+
+// Replace markerGraph.edgeMarkerIntervals with
+// markerGraph.compactEdgeMarkerIntervals.
+void Assembler::compressMarkerGraphEdgeMarkerIntervals(size_t threadCount)
+{
+    cout << timestamp << "Begin compressMarkerGraphEdgeMarkerIntervals." << endl;
+
+    // Check that we have what we need.
+    checkMarkerGraphEdgesIsOpen();
+    if(markerGraph.compactEdgeMarkerIntervals.isOpen()) {
+        cout << "Marker graph edge marker intervals are already compressed." << endl;
+        return;
+    }
+    CZI_ASSERT(markerGraph.edgeMarkerIntervals.isOpen());
+    CZI_ASSERT(markerGraph.edgeMarkerIntervals.size() == markerGraph.edges.size());
+
+    // Create the compact representation.
+    const string name = markerGraph.edgeMarkerIntervalsAreCanonical ?
+        "GlobalMarkerGraphEdgeMarkerIntervalsCanonicalCompact" :
+        "GlobalMarkerGraphEdgeMarkerIntervalsCompact";
+    markerGraph.compactEdgeMarkerIntervals.createNew(
+        markerGraph.edgeMarkerIntervals,
+        largeDataName(name), largeDataPageSize, threadCount);
+    CZI_ASSERT(markerGraph.compactEdgeMarkerIntervals.size() == markerGraph.edges.size());
+
+    // Replace the old MarkerIntervals.
+    const uint64_t oldByteCount =
+        markerGraph.edgeMarkerIntervals.totalSize() * sizeof(MarkerInterval) +
+        (markerGraph.edgeMarkerIntervals.size() + 1) * sizeof(uint64_t);
+    markerGraph.edgeMarkerIntervals.remove();
+    cout << "Marker graph edge marker intervals now use " <<
+        markerGraph.compactEdgeMarkerIntervals.byteCount() <<
+        " bytes instead of " << oldByteCount << "." << endl;
+    cout << timestamp << "End compressMarkerGraphEdgeMarkerIntervals." << endl;
+}
+
+
+
+// Python-callable function to get information about an edge of the
+// global marker graph. Returns an empty vector if the specified
+// edge does not exist.
+vector<Assembler::GlobalMarkerGraphEdgeInformation> Assembler::getGlobalMarkerGraphEdgeInformation(
+    MarkerGraph::VertexId vertexId0,
+    MarkerGraph::VertexId vertexId1
+    )
+{
+    const uint32_t k = uint32_t(assemblerInfo->k);
+
+    // Find the children of vertexId0.
+    vector< pair<MarkerGraph::VertexId, vector<MarkerInterval> > > children;
+    vector< pair<MarkerGraph::VertexId, MarkerInterval> > workArea;
+    getGlobalMarkerGraphVertexChildren(vertexId0, children, workArea);
+
+    // Find vertexId1 in the children.
+    vector<GlobalMarkerGraphEdgeInformation> v;
+    for(const auto& child: children) {
+        if(child.first != vertexId1) {
+            continue;
+        }
+
+        // We found vertexId1. Loop over its MarkerGraphNeighborInfo.
+        const auto& childInfos = child.second;
+        v.resize(childInfos.size());
+        for(size_t i=0; i<v.size(); i++) {
+            const auto& childInfo = childInfos[i];
+            auto& info = v[i];
+            info.readId = childInfo.orientedReadId.getReadId();
+            info.strand = childInfo.orientedReadId.getStrand();
+            info.ordinal0 = childInfo.ordinals[0];
+            info.ordinal1 = childInfo.ordinals[1];
+
+            // Get the positions.
+            const MarkerId markerId0 = getMarkerId(childInfo.orientedReadId, info.ordinal0);
             const MarkerId markerId1 = getMarkerId(childInfo.orientedReadId, info.ordinal1);
             const auto& marker0 = markers.begin()[markerId0];
             const auto& marker1 = markers.begin()[markerId1];
@@ -1461,6 +2412,19 @@ void Assembler::getGlobalMarkerGraphEdgeInfo(
 // Return true if a vertex of the global marker graph has more than
 // one marker for at least one oriented read id.
 bool Assembler::isBadMarkerGraphVertex(MarkerGraph::VertexId vertexId) const
+{
+    if(markerGraph.isBadVertexBitmap.isOpen) {
+        return markerGraph.isBadVertex(vertexId);
+    } else {
+        return computeIsBadMarkerGraphVertex(vertexId);
+    }
+}
+
+
+
+// Same as isBadMarkerGraphVertex, but always looks at the
+// markers of the vertex. Used to create markerGraph.isBadVertexBitmap.
+bool Assembler::computeIsBadMarkerGraphVertex(MarkerGraph::VertexId vertexId) const
 {
     // Get the markers of this vertex.
     const auto& vertexMarkerIds = markerGraph.vertices[vertexId];
@@ -1506,6 +2470,7 @@ void Assembler::extractLocalMarkerGraph(
         uint32_t(assemblerInfo->k),
         reads,
         readRepeatCounts,
+        compactReadRepeatCounts,
         markers,
         markerGraph.vertexTable,
         *consensusCaller);
@@ -1776,300 +2741,139 @@ bool Assembler::extractLocalMarkerGraphUsingStoredConnectivity(
     LocalMarkerGraph& graph
     )
 {
-    // Sanity check.
-    checkMarkerGraphEdgesIsOpen();
-
     // Some shorthands.
     using vertex_descriptor = LocalMarkerGraph::vertex_descriptor;
     using edge_descriptor = LocalMarkerGraph::edge_descriptor;
 
-    // Start a timer.
-    const auto startTime = steady_clock::now();
+    // Find the vertices and edges using the compact representation.
+    CompactLocalMarkerGraph compactGraph;
+    if(!extractCompactLocalMarkerGraph(
+        startVertexId, distance, timeout,
+        useWeakEdges, usePrunedEdges, useSuperBubbleEdges,
+        compactGraph)) {
+        return false;
+    }
 
-    // Add the start vertex.
-    if(startVertexId == MarkerGraph::invalidCompressedVertexId) {
-        return true;    // Because no timeout occurred.
+    // Create the vertices, in the same order.
+    vector<vertex_descriptor> vertexDescriptors;
+    vertexDescriptors.reserve(compactGraph.vertices.size());
+    for(const auto& vertex: compactGraph.vertices) {
+        vertexDescriptors.push_back(graph.addVertex(
+            vertex.vertexId, vertex.distance, markerGraph.vertices[vertex.vertexId]));
     }
-    const vertex_descriptor vStart = graph.addVertex(startVertexId, 0, markerGraph.vertices[startVertexId]);
 
-    // Some vectors used inside the BFS.
-    // Define them here to reduce memory allocation activity.
+    // Create the edges.
+    // The compact graph does not contain duplicate edges,
+    // so we don't need to check if an edge already exists.
     vector<MarkerInterval> markerIntervals;
+    for(const auto& compactEdge: compactGraph.edges) {
+        const MarkerGraph::EdgeId edgeId = compactEdge.edgeId;
+        edge_descriptor e;
+        bool edgeWasAdded;
+        tie(e, edgeWasAdded) = boost::add_edge(
+            vertexDescriptors[compactEdge.source],
+            vertexDescriptors[compactEdge.target],
+            graph);
+        CZI_ASSERT(edgeWasAdded);
 
+        // Fill in edge information.
+        getMarkerGraphEdgeMarkerIntervals(edgeId, markerIntervals);
+        graph.storeEdgeInfo(e, markerIntervals);
+        graph[e].edgeId = edgeId;
 
-    // Do the BFS.
-    std::queue<vertex_descriptor> q;
-    if(distance > 0) {
-        q.push(vStart);
-    }
-    while(!q.empty()) {
-
-        // See if we exceeded the timeout.
-        if(timeout>0. && seconds(steady_clock::now() - startTime) > timeout) {
-            graph.clear();
-            return false;
+        // Link to assembly graph edge.
+        if(assemblyGraph.markerToAssemblyTable.isOpen) {
+            const auto& entry = assemblyGraph.markerToAssemblyTable[edgeId];
+            graph[e].assemblyEdgeId = entry.getEdgeId();
+            graph[e].positionInAssemblyEdge = entry.getPosition();
         }
+    }
 
-        // Dequeue a vertex.
-        const vertex_descriptor v0 = q.front();
-        q.pop();
-        const LocalMarkerGraphVertex& vertex0 = graph[v0];
-        const MarkerGraph::VertexId vertexId0 = vertex0.vertexId;
-        const int distance0 = vertex0.distance;
-        const int distance1 = distance0 + 1;
+    // Fill in the oriented read ids represented in the graph.
+    graph.findOrientedReadIds();
 
-        // Loop over the children.
-        const auto childEdges = markerGraph.edgesBySource[vertexId0];
-        for(uint64_t edgeId: childEdges) {
-            const auto& edge = markerGraph.edges[edgeId];
+    // Also fill in the ConsensusInfo's for each vertex.
+    graph.computeVertexConsensusInfo();
 
-            // Skip this edge if the arguments require it.
-            if(edge.wasRemovedByTransitiveReduction && !useWeakEdges) {
-                continue;
-            }
-            if(edge.wasPruned && !usePrunedEdges) {
-                continue;
-            }
-            if(edge.isSuperBubbleEdge && !useSuperBubbleEdges) {
-                continue;
-            }
+    return true;
+}
 
-            const MarkerGraph::VertexId vertexId1 = edge.target;
-            CZI_ASSERT(edge.source == vertexId0);
-            CZI_ASSERT(vertexId1 < markerGraph.vertices.size());
-            CZI_ASSERT(!isBadMarkerGraphVertex(vertexId1));
 
-            // Find the vertex corresponding to this child, creating it if necessary.
-            bool vertexExists;
-            vertex_descriptor v1;
-            tie(vertexExists, v1) = graph.findVertex(vertexId1);
-            if(!vertexExists) {
-                v1 = graph.addVertex(
-                    vertexId1, distance1, markerGraph.vertices[vertexId1]);
-                if(distance1 < distance) {
-                    q.push(v1);
-                }
-            }
 
-            // Create the edge v0->v1, if it does not already exist.
-            edge_descriptor e;
-            bool edgeExists;
-            tie(e, edgeExists) = boost::edge(v0, v1, graph);
-            if(!edgeExists) {
-                tie(e, edgeExists) = boost::add_edge(v0, v1, graph);
-                CZI_ASSERT(edgeExists);
+bool Assembler::extractCompactLocalMarkerGraph(
+    MarkerGraph::VertexId startVertexId,
+    int distance,
+    double timeout,                 // Or 0 for no timeout.
+    bool useWeakEdges,
+    bool usePrunedEdges,
+    bool useSuperBubbleEdges,
+    CompactLocalMarkerGraph& graph,
+    size_t threadCount
+    )
+{
+    // Sanity check.
+    checkMarkerGraphEdgesIsOpen();
 
-                // Fill in edge information.
-                const auto storedMarkerIntervals = markerGraph.edgeMarkerIntervals[edgeId];
-                markerIntervals.resize(storedMarkerIntervals.size());
-                copy(storedMarkerIntervals.begin(), storedMarkerIntervals.end(), markerIntervals.begin());
-                graph.storeEdgeInfo(e, markerIntervals);
-                graph[e].edgeId = edgeId;
-
-                // Link to assembly graph edge.
-                if(assemblyGraph.markerToAssemblyTable.isOpen) {
-                    const auto& p = assemblyGraph.markerToAssemblyTable[edgeId];
-                    graph[e].assemblyEdgeId = p.first;
-                    graph[e].positionInAssemblyEdge = p.second;
-                }
-            }
-        }
+    CompactLocalMarkerGraphBfs bfs(
+        markerGraph,
+        useWeakEdges,
+        usePrunedEdges,
+        useSuperBubbleEdges);
+    return bfs.run(startVertexId, distance, timeout, threadCount, graph);
+}
 
-        // Loop over the parents.
-        const auto parentEdges = markerGraph.edgesByTarget[vertexId0];
-        for(uint64_t edgeId: parentEdges) {
-            const auto& edge = markerGraph.edges[edgeId];
 
-            // Skip this edge if the arguments require it.
-            if(edge.wasRemovedByTransitiveReduction && !useWeakEdges) {
-                continue;
-            }
-            if(edge.wasPruned && !usePrunedEdges) {
-                continue;
-            }
-            if(edge.isSuperBubbleEdge && !useSuperBubbleEdges) {
-                continue;
-            }
 
-            const MarkerGraph::VertexId vertexId1 = edge.source;
-            CZI_ASSERT(edge.target == vertexId0);
-            CZI_ASSERT(vertexId1 < markerGraph.vertices.size());
+// Create a local marker graph and return its local assembly path.
+// The local marker graph is specified by its start vertex
+// and maximum distance (number of edges) form the start vertex.
+vector<MarkerGraph::VertexId> Assembler::getLocalAssemblyPath(
+    MarkerGraph::VertexId startVertexId,
+    int maxDistance
+    )
+{
 
-            // Find the vertex corresponding to this child, creating it if necessary.
-            bool vertexExists;
-            vertex_descriptor v1;
-            tie(vertexExists, v1) = graph.findVertex(vertexId1);
-            if(!vertexExists) {
-                v1 = graph.addVertex(
-                    vertexId1, distance1, markerGraph.vertices[vertexId1]);
-                if(distance1 < distance) {
-                    q.push(v1);
-                }
-            }
+    // Create the local marker graph.
+    LocalMarkerGraph graph(
+        uint32_t(assemblerInfo->k),
+        reads,
+        readRepeatCounts,
+        compactReadRepeatCounts,
+        markers,
+        markerGraph.vertexTable,
+        *consensusCaller);
+    extractLocalMarkerGraph(startVertexId, maxDistance, 0., graph);
 
-            // Create the edge v1->v0, if it does not already exist.
-            edge_descriptor e;
-            bool edgeExists;
-            tie(e, edgeExists) = boost::edge(v1, v0, graph);
-            if(!edgeExists) {
-                tie(e, edgeExists) = boost::add_edge(v1, v0, graph);
-                CZI_ASSERT(edgeExists);
+    // Construct the local assembly path.
+    graph.approximateTopologicalSort();
+    graph.computeOptimalSpanningTree();
+    graph.computeOptimalSpanningTreeBestPath();
+    graph.computeLocalAssemblyPath(maxDistance);
 
-                // Fill in edge information.
-                const auto storedMarkerIntervals = markerGraph.edgeMarkerIntervals[edgeId];
-                markerIntervals.resize(storedMarkerIntervals.size());
-                copy(storedMarkerIntervals.begin(), storedMarkerIntervals.end(), markerIntervals.begin());
-                graph.storeEdgeInfo(e, markerIntervals);
-                graph[e].edgeId = edgeId;
-
-                // Link to assembly graph vertex.
-                if(assemblyGraph.markerToAssemblyTable.isOpen) {
-                    const auto& p = assemblyGraph.markerToAssemblyTable[edgeId];
-                    graph[e].assemblyEdgeId = p.first;
-                    graph[e].positionInAssemblyEdge = p.second;
-                }
-            }
+    // Get the vertex ids in the assembly path.
+    vector<MarkerGraph::VertexId> path;
+    if(!graph.localAssemblyPath.empty()) {
+        LocalMarkerGraph::edge_descriptor e = graph.localAssemblyPath.front();
+        const LocalMarkerGraph::vertex_descriptor v = source(e, graph);
+        path.push_back(graph[v].vertexId);
+        for(LocalMarkerGraph::edge_descriptor e: graph.localAssemblyPath) {
+            const LocalMarkerGraph::vertex_descriptor v = target(e, graph);
+            path.push_back(graph[v].vertexId);
         }
-
     }
+    return path;
+}
+#endif
 
 
-    // The BFS process did not create edges between vertices at maximum distance.
-    // Do it now.
-    // Loop over all vertices at maximum distance.
-    BGL_FORALL_VERTICES(v0, graph, LocalMarkerGraph) {
-        const LocalMarkerGraphVertex& vertex0 = graph[v0];
-        if(vertex0.distance != distance) {
-            continue;
-        }
-        const MarkerGraph::VertexId vertexId0 = vertex0.vertexId;
-
-        // Loop over the children that exist in the local marker graph
-        // and are also at maximum distance.
-        const auto childEdges = markerGraph.edgesBySource[vertexId0];
-        for(uint64_t edgeId: childEdges) {
-            const auto& edge = markerGraph.edges[edgeId];
 
-            // Skip this edge if the arguments require it.
-            if(edge.wasRemovedByTransitiveReduction && !useWeakEdges) {
-                continue;
-            }
-            if(edge.wasPruned && !usePrunedEdges) {
-                continue;
-            }
-            if(edge.isSuperBubbleEdge && !useSuperBubbleEdges) {
-                continue;
-            }
+// Compute edges of the global marker graph.
+void Assembler::createMarkerGraphEdges(size_t threadCount)
+{
+    cout << timestamp << "createMarkerGraphEdges begins." << endl;
 
-            const MarkerGraph::VertexId vertexId1 = edge.target;
-            CZI_ASSERT(edge.source == vertexId0);
-            CZI_ASSERT(vertexId1 < markerGraph.vertices.size());
-
-            // See if we have a vertex for this global vertex id.
-            bool vertexExists;
-            vertex_descriptor v1;
-            tie(vertexExists, v1) = graph.findVertex(vertexId1);
-
-            // If it does not exist in the local marker graph, skip.
-            if(!vertexExists) {
-                continue;
-            }
-
-            // If it is not at maximum distance, skip.
-            const LocalMarkerGraphVertex& vertex1 = graph[v1];
-            if(vertex1.distance != distance) {
-                continue;
-            }
-
-            // There is no way we already created this edge.
-            // Check that this is the case.
-            edge_descriptor e;
-            bool edgeExists;
-            tie(e, edgeExists) = boost::edge(v0, v1, graph);
-            CZI_ASSERT(!edgeExists);
-
-            // Add the edge.
-            tie(e, edgeExists) = boost::add_edge(v0, v1, graph);
-            CZI_ASSERT(edgeExists);
-
-            // Fill in edge information.
-            const auto storedMarkerIntervals = markerGraph.edgeMarkerIntervals[edgeId];
-            markerIntervals.resize(storedMarkerIntervals.size());
-            copy(storedMarkerIntervals.begin(), storedMarkerIntervals.end(), markerIntervals.begin());
-            graph.storeEdgeInfo(e, markerIntervals);
-            graph[e].edgeId = edgeId;
-
-            // Link to assembly graph vertex.
-            if(assemblyGraph.markerToAssemblyTable.isOpen) {
-                const auto& p = assemblyGraph.markerToAssemblyTable[edgeId];
-                graph[e].assemblyEdgeId = p.first;
-                graph[e].positionInAssemblyEdge = p.second;
-            }
-        }
-    }
-
-
-
-    // Fill in the oriented read ids represented in the graph.
-    graph.findOrientedReadIds();
-
-    // Also fill in the ConsensusInfo's for each vertex.
-    graph.computeVertexConsensusInfo();
-
-    return true;
-}
-
-
-
-// Create a local marker graph and return its local assembly path.
-// The local marker graph is specified by its start vertex
-// and maximum distance (number of edges) form the start vertex.
-vector<MarkerGraph::VertexId> Assembler::getLocalAssemblyPath(
-    MarkerGraph::VertexId startVertexId,
-    int maxDistance
-    )
-{
-
-    // Create the local marker graph.
-    LocalMarkerGraph graph(
-        uint32_t(assemblerInfo->k),
-        reads,
-        readRepeatCounts,
-        markers,
-        markerGraph.vertexTable,
-        *consensusCaller);
-    extractLocalMarkerGraph(startVertexId, maxDistance, 0., graph);
-
-    // Construct the local assembly path.
-    graph.approximateTopologicalSort();
-    graph.computeOptimalSpanningTree();
-    graph.computeOptimalSpanningTreeBestPath();
-    graph.computeLocalAssemblyPath(maxDistance);
-
-    // Get the vertex ids in the assembly path.
-    vector<MarkerGraph::VertexId> path;
-    if(!graph.localAssemblyPath.empty()) {
-        LocalMarkerGraph::edge_descriptor e = graph.localAssemblyPath.front();
-        const LocalMarkerGraph::vertex_descriptor v = source(e, graph);
-        path.push_back(graph[v].vertexId);
-        for(LocalMarkerGraph::edge_descriptor e: graph.localAssemblyPath) {
-            const LocalMarkerGraph::vertex_descriptor v = target(e, graph);
-            path.push_back(graph[v].vertexId);
-        }
-    }
-    return path;
-}
-#endif
-
-
-
-// Compute edges of the global marker graph.
-void Assembler::createMarkerGraphEdges(size_t threadCount)
-{
-    cout << timestamp << "createMarkerGraphEdges begins." << endl;
-
-    // Check that we have what we need.
-    checkMarkerGraphVerticesAreAvailable();
+    // Check that we have what we need.
+    checkMarkerGraphVerticesAreAvailable();
 
     // Adjust the numbers of threads, if necessary.
     if(threadCount == 0) {
@@ -2078,57 +2882,112 @@ void Assembler::createMarkerGraphEdges(size_t threadCount)
     cout << "Using " << threadCount << " threads." << endl;
 
     // Each thread stores the edges it finds in a separate vector.
-    createMarkerGraphEdgesData.threadEdges.resize(threadCount);
-    createMarkerGraphEdgesData.threadEdgeMarkerIntervals.resize(threadCount);
+    auto& data = createMarkerGraphEdgesData;
+    data.threadEdges.resize(threadCount);
+    data.threadEdgeMarkerIntervals.resize(threadCount);
+    data.threadBatches.clear();
+    data.threadBatches.resize(threadCount);
+
+    // Flag the bad vertices first, so the threads below
+    // don't have to look at their markers.
+    createMarkerGraphIsBadVertexBitmap(threadCount);
+
     cout << timestamp << "Processing " << markerGraph.vertices.size();
     cout << " marker graph vertices." << endl;
     setupLoadBalancing(markerGraph.vertices.size(), 100000);
     runThreads(&Assembler::createMarkerGraphEdgesThreadFunction0, threadCount);
 
-    // Combine the edges found by each thread.
-    cout << timestamp << "Combining the edges found by each thread." << endl;
+
+
+    // Sort the batches processed by all threads by source vertex.
+    // The edges of each batch will be stored contiguously,
+    // so the final edges are sorted by source vertex.
+    // A prefix sum gives the first edge id of each batch.
+    data.batches.clear();
+    for(size_t threadId=0; threadId<threadCount; threadId++) {
+        const auto& thisThreadBatches = data.threadBatches[threadId];
+        copy(thisThreadBatches.begin(), thisThreadBatches.end(), back_inserter(data.batches));
+    }
+    data.threadBatches.clear();
+    sort(data.batches.begin(), data.batches.end());
+    MarkerGraph::EdgeId edgeCount = 0;
+    for(auto& batch: data.batches) {
+        batch.edgeBegin = edgeCount;
+        edgeCount += batch.threadEdgeEnd - batch.threadEdgeBegin;
+    }
+
+
+
+    // Stitch together the edges found by each thread.
+    // Pass 1 stores the edges and counts marker intervals
+    // and edges by source and by target.
+    cout << timestamp << "Combining the " << edgeCount <<
+        " edges found by each thread, pass 1." << endl;
     markerGraph.edges.createNew(
             largeDataName("GlobalMarkerGraphEdges"),
             largeDataPageSize);
+    markerGraph.edges.resize(edgeCount);
     markerGraph.edgeMarkerIntervals.createNew(
             largeDataName("GlobalMarkerGraphEdgeMarkerIntervals"),
             largeDataPageSize);
+    markerGraph.edgeMarkerIntervals.beginPass1(edgeCount);
+    markerGraph.edgesBySource.createNew(
+        largeDataName("tmp-GlobalMarkerGraphEdgesBySource"),
+        largeDataPageSize);
+    markerGraph.edgesByTarget.createNew(
+        largeDataName("tmp-GlobalMarkerGraphEdgesByTarget"),
+        largeDataPageSize);
+    markerGraph.edgesBySource.beginPass1(markerGraph.vertices.size());
+    markerGraph.edgesByTarget.beginPass1(markerGraph.vertices.size());
+    setupLoadBalancing(data.batches.size(), 1);
+    runThreads(&Assembler::createMarkerGraphEdgesThreadFunction3, threadCount);
+
+    // Pass 2 stores marker intervals and edges by source and by target.
+    cout << timestamp << "Combining the edges found by each thread, pass 2." << endl;
+    markerGraph.edgeMarkerIntervals.beginPass2();
+    markerGraph.edgesBySource.beginPass2();
+    markerGraph.edgesByTarget.beginPass2();
+    setupLoadBalancing(data.batches.size(), 1);
+    runThreads(&Assembler::createMarkerGraphEdgesThreadFunction4, threadCount);
+    markerGraph.edgeMarkerIntervals.endPass2(false);
+    markerGraph.edgesBySource.endPass2();
+    markerGraph.edgesByTarget.endPass2();
+
+    // Clean up.
     for(size_t threadId=0; threadId<threadCount; threadId++) {
-        auto& thisThreadEdges = *createMarkerGraphEdgesData.threadEdges[threadId];
-        auto& thisThreadEdgeMarkerIntervals = *createMarkerGraphEdgesData.threadEdgeMarkerIntervals[threadId];
-        CZI_ASSERT(thisThreadEdges.size() == thisThreadEdgeMarkerIntervals.size());
-        for(size_t i=0; i<thisThreadEdges.size(); i++) {
-            const auto& edge = thisThreadEdges[i];
-            const auto edgeMarkerIntervals = thisThreadEdgeMarkerIntervals[i];
-            markerGraph.edges.push_back(edge);
-            markerGraph.edgeMarkerIntervals.appendVector();
-            for(auto edgeMarkerInterval: edgeMarkerIntervals) {
-                markerGraph.edgeMarkerIntervals.append(edgeMarkerInterval);
-            }
-        }
-        thisThreadEdges.remove();
-        thisThreadEdgeMarkerIntervals.remove();
+        data.threadEdges[threadId]->remove();
+        data.threadEdgeMarkerIntervals[threadId]->remove();
     }
-    CZI_ASSERT(markerGraph.edges.size() == markerGraph.edgeMarkerIntervals.size());
-    cout << timestamp << "Found " << markerGraph.edges.size();
-    cout << " edges for " << markerGraph.vertices.size() << " vertices." << endl;
+    data.threadEdges.clear();
+    data.threadEdgeMarkerIntervals.clear();
+    data.batches.clear();
 
+    // Create the compact adjacency used for traversals.
+    // This also removes edgesBySource and edgesByTarget.
+    createMarkerGraphCompactAdjacency(threadCount);
 
+    // Create the edge flag bitmaps. No edges are flagged yet.
+    markerGraph.edgeFlagBitmaps.createNew(
+        largeDataName("GlobalMarkerGraphEdgeFlagBitmaps"),
+        largeDataPageSize, markerGraph.edges.size());
 
-    // Now we need to create edgesBySource and edgesByTarget.
-    createMarkerGraphEdgesBySourceAndTarget(threadCount);
+    CZI_ASSERT(markerGraph.edges.size() == markerGraph.edgeMarkerIntervals.size());
+    cout << timestamp << "Found " << markerGraph.edges.size();
+    cout << " edges for " << markerGraph.vertices.size() << " vertices." << endl;
     cout << timestamp << "createMarkerGraphEdges ends." << endl;
 }
 
 
 
+// Create the compact adjacency from the edges.
+// edgesBySource and edgesByTarget are only created temporarily.
 void Assembler::createMarkerGraphEdgesBySourceAndTarget(size_t threadCount)
 {
     markerGraph.edgesBySource.createNew(
-        largeDataName("GlobalMarkerGraphEdgesBySource"),
+        largeDataName("tmp-GlobalMarkerGraphEdgesBySource"),
         largeDataPageSize);
     markerGraph.edgesByTarget.createNew(
-        largeDataName("GlobalMarkerGraphEdgesByTarget"),
+        largeDataName("tmp-GlobalMarkerGraphEdgesByTarget"),
         largeDataPageSize);
 
     cout << timestamp << "Create marker graph edges by source and target: pass 1 begins." << endl;
@@ -2145,6 +3004,72 @@ void Assembler::createMarkerGraphEdgesBySourceAndTarget(size_t threadCount)
     markerGraph.edgesBySource.endPass2();
     markerGraph.edgesByTarget.endPass2();
 
+    createMarkerGraphCompactAdjacency(threadCount);
+}
+
+
+
+// Create markerGraph.isBadVertexBitmap.
+// Each thread computes entire 64-bit words, so no locking is needed.
+void Assembler::createMarkerGraphIsBadVertexBitmap(size_t threadCount)
+{
+    cout << timestamp << "Flagging bad marker graph vertices." << endl;
+    if(markerGraph.isBadVertexBitmap.isOpen) {
+        markerGraph.isBadVertexBitmap.close();
+    }
+    markerGraph.isBadVertexBitmap.createNew(
+        largeDataName("GlobalMarkerGraphIsBadVertex"),
+        largeDataPageSize);
+    markerGraph.isBadVertexBitmap.resize((markerGraph.vertices.size() + 63) >> 6);
+    setupLoadBalancing(markerGraph.isBadVertexBitmap.size(), 1000);
+    runThreads(&Assembler::createMarkerGraphIsBadVertexBitmapThreadFunction, threadCount);
+
+    uint64_t badVertexCount = 0;
+    for(const uint64_t word: markerGraph.isBadVertexBitmap) {
+        badVertexCount += uint64_t(__builtin_popcountll(word));
+    }
+    cout << "Found " << badVertexCount << " bad marker graph vertices." << endl;
+}
+
+
+
+void Assembler::createMarkerGraphIsBadVertexBitmapThreadFunction(size_t threadId)
+{
+    const uint64_t vertexCount = markerGraph.vertices.size();
+    size_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(size_t i=begin; i!=end; i++) {
+            uint64_t word = 0;
+            const uint64_t vertexIdBegin = i << 6;
+            const uint64_t vertexIdEnd = min(vertexIdBegin + 64, vertexCount);
+            for(uint64_t vertexId=vertexIdBegin; vertexId!=vertexIdEnd; vertexId++) {
+                if(computeIsBadMarkerGraphVertex(vertexId)) {
+                    word |= uint64_t(1) << (vertexId & 63);
+                }
+            }
+            markerGraph.isBadVertexBitmap[i] = word;
+        }
+    }
+}
+
+
+
+// Create compact versions of edgesBySource and edgesByTarget,
+// then remove them. All traversals use the compact versions.
+// See MarkerGraphCompactAdjacency.hpp for more information.
+void Assembler::createMarkerGraphCompactAdjacency(size_t threadCount)
+{
+    cout << timestamp << "Creating the compact marker graph adjacency." << endl;
+    markerGraph.compactEdgesBySource.createNew(
+        markerGraph.edgesBySource,
+        largeDataName("GlobalMarkerGraphCompactEdgesBySource"),
+        largeDataPageSize, threadCount);
+    markerGraph.compactEdgesByTarget.createNew(
+        markerGraph.edgesByTarget,
+        largeDataName("GlobalMarkerGraphCompactEdgesByTarget"),
+        largeDataPageSize, threadCount);
+    markerGraph.edgesBySource.remove();
+    markerGraph.edgesByTarget.remove();
 }
 
 
@@ -2175,46 +3100,137 @@ void Assembler::createMarkerGraphEdgesThreadFunction0(size_t threadId)
             largeDataPageSize);
 
     // Some things used inside the loop but defined here for performance.
-    vector< pair<MarkerGraph::VertexId, vector<MarkerInterval> > > children;
-    vector< pair<MarkerGraph::VertexId, MarkerInterval> > workArea;
+    // The vertices of each batch are processed in chunks
+    // using getGlobalMarkerGraphVerticesChildren, which overlaps
+    // the cache misses of all vertices in a chunk.
+    const uint64_t chunkSize = 64;
+    vector<MarkerGraph::VertexId> chunkVertexIds;
+    vector< pair<MarkerGraph::VertexId, MarkerInterval> > children;
+    vector<uint64_t> childrenBegin;
+    GlobalMarkerGraphNeighborsWorkArea workArea;
     MarkerGraph::Edge edge;
 
     // Loop over all batches assigned to this thread.
+    vector<CreateMarkerGraphEdgesData::Batch>& thisThreadBatches =
+        createMarkerGraphEdgesData.threadBatches[threadId];
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
+        CreateMarkerGraphEdgesData::Batch batch;
+        batch.vertexBegin = begin;
+        batch.threadId = threadId;
+        batch.threadEdgeBegin = thisThreadEdges.size();
+
+        // Loop over chunks of marker graph vertices assigned to this batch.
+        for(MarkerGraph::VertexId chunkBegin=begin; chunkBegin!=end; ) {
+            const MarkerGraph::VertexId chunkEnd = min(chunkBegin + chunkSize, end);
+            chunkVertexIds.clear();
+            for(MarkerGraph::VertexId vertex0=chunkBegin; vertex0!=chunkEnd; ++vertex0) {
+                chunkVertexIds.push_back(vertex0);
+            }
+            getGlobalMarkerGraphVerticesChildren(
+                chunkVertexIds.data(), chunkVertexIds.data() + chunkVertexIds.size(),
+                children, childrenBegin, workArea);
+
+            // Loop over the vertices of this chunk.
+            for(uint64_t i=0; i<chunkVertexIds.size(); i++) {
+                edge.source = chunkVertexIds[i];
+
+                // The children of this vertex are sorted by vertex id,
+                // so each streak with the same child generates an edge.
+                const auto childrenEnd = children.begin() + int64_t(childrenBegin[i+1]);
+                for(auto streakBegin=children.begin() + int64_t(childrenBegin[i]);
+                    streakBegin!=childrenEnd; ) {
+                    auto streakEnd = streakBegin + 1;
+                    for(;
+                        streakEnd!=childrenEnd && streakEnd->first==streakBegin->first;
+                        streakEnd++) {
+                    }
+                    edge.target = streakBegin->first;
+                    const size_t coverage = size_t(streakEnd - streakBegin);
+                    if(coverage < 256) {
+                        edge.coverage = uint8_t(coverage);
+                    } else {
+                        edge.coverage = 255;
+                    }
 
-        // Loop over all marker graph vertices assigned to this batch.
-        for(MarkerGraph::VertexId vertex0=begin; vertex0!=end; ++vertex0) {
-            edge.source = vertex0;
-
-            getGlobalMarkerGraphVertexChildren(vertex0, children, workArea);
-            for(const auto& p: children) {
-                const auto vertex1 = p.first;
-                const auto& markerIntervals = p.second;
-                edge.target = vertex1;
-                size_t coverage = markerIntervals.size();
-                if(coverage < 256) {
-                    edge.coverage = uint8_t(coverage);
-                } else {
-                    edge.coverage = 255;
-                }
+                    // Store the edge.
+                    thisThreadEdges.push_back(edge);
 
-                // Store the edge.
-                thisThreadEdges.push_back(edge);
+                    // Store the marker intervals.
+                    thisThreadEdgeMarkerIntervals.appendVector();
+                    for(auto it=streakBegin; it!=streakEnd; it++) {
+                        thisThreadEdgeMarkerIntervals.append(it->second);
+                    }
 
-                // Store the marker intervals.
-                thisThreadEdgeMarkerIntervals.appendVector();
-                for(const MarkerInterval markerInterval: markerIntervals) {
-                    thisThreadEdgeMarkerIntervals.append(markerInterval);
+                    // Process the next streak.
+                    streakBegin = streakEnd;
                 }
             }
+            chunkBegin = chunkEnd;
         }
+
+        batch.threadEdgeEnd = thisThreadEdges.size();
+        thisThreadBatches.push_back(batch);
     }
 
 }
 
 
 
+// Pass 1 of stitching together the edges found by each thread.
+// Each batch of source vertices is processed by a single thread,
+// so counts indexed by edge id or by source vertex don't need
+// to be incremented atomically.
+void Assembler::createMarkerGraphEdgesThreadFunction3(size_t threadId)
+{
+    const auto& data = createMarkerGraphEdgesData;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; ++i) {
+            const CreateMarkerGraphEdgesData::Batch& batch = data.batches[i];
+            const auto& thisThreadEdges = *data.threadEdges[batch.threadId];
+            const auto& thisThreadEdgeMarkerIntervals = *data.threadEdgeMarkerIntervals[batch.threadId];
+            MarkerGraph::EdgeId edgeId = batch.edgeBegin;
+            for(MarkerGraph::EdgeId j=batch.threadEdgeBegin; j!=batch.threadEdgeEnd; ++j, ++edgeId) {
+                const MarkerGraph::Edge& edge = thisThreadEdges[j];
+                markerGraph.edges[edgeId] = edge;
+                markerGraph.edgeMarkerIntervals.incrementCount(edgeId,
+                    thisThreadEdgeMarkerIntervals.size(j));
+                markerGraph.edgesBySource.incrementCount(edge.source);
+                markerGraph.edgesByTarget.incrementCountMultithreaded(edge.target);
+            }
+        }
+    }
+}
+
+
+
+// Pass 2 of stitching together the edges found by each thread.
+void Assembler::createMarkerGraphEdgesThreadFunction4(size_t threadId)
+{
+    const auto& data = createMarkerGraphEdgesData;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; ++i) {
+            const CreateMarkerGraphEdgesData::Batch& batch = data.batches[i];
+            const auto& thisThreadEdgeMarkerIntervals = *data.threadEdgeMarkerIntervals[batch.threadId];
+            MarkerGraph::EdgeId edgeId = batch.edgeBegin;
+            for(MarkerGraph::EdgeId j=batch.threadEdgeBegin; j!=batch.threadEdgeEnd; ++j, ++edgeId) {
+                const MarkerGraph::Edge& edge = markerGraph.edges[edgeId];
+                const auto markerIntervals = thisThreadEdgeMarkerIntervals[j];
+                copy(markerIntervals.begin(), markerIntervals.end(),
+                    markerGraph.edgeMarkerIntervals.begin(edgeId));
+                markerGraph.edgesBySource.store(edge.source, Uint40(edgeId));
+                markerGraph.edgesByTarget.storeMultithreaded(edge.target, Uint40(edgeId));
+            }
+        }
+    }
+}
+
+
+
 void Assembler::createMarkerGraphEdgesThreadFunction1(size_t threadId)
 {
     createMarkerGraphEdgesThreadFunction12(threadId, 1);
@@ -2250,20 +3266,105 @@ void Assembler::createMarkerGraphEdgesThreadFunction12(size_t threadId, size_t p
 void Assembler::accessMarkerGraphEdges(bool accessEdgesReadWrite)
 {
     if(accessEdgesReadWrite) {
+#ifndef SHASTA_STATIC_EXECUTABLE
+        clearHttpResponseCache();
+#endif
         markerGraph.edges.accessExistingReadWrite(
             largeDataName("GlobalMarkerGraphEdges"));
-        markerGraph.edgeMarkerIntervals.accessExistingReadWrite(
-            largeDataName("GlobalMarkerGraphEdgeMarkerIntervals"));
     } else {
         markerGraph.edges.accessExistingReadOnly(
             largeDataName("GlobalMarkerGraphEdges"));
-        markerGraph.edgeMarkerIntervals.accessExistingReadOnly(
-            largeDataName("GlobalMarkerGraphEdgeMarkerIntervals"));
     }
+
+    // If storeCanonicalMarkerGraphEdgeMarkerIntervals was called,
+    // the marker intervals are only stored for canonical edges, and the reverse
+    // complement edges are needed to get them for the other edges.
+    const auto accessEdgeMarkerIntervals = [&](const string& name)
+    {
+        if(accessEdgesReadWrite) {
+            markerGraph.edgeMarkerIntervals.accessExistingReadWrite(largeDataName(name));
+        } else {
+            markerGraph.edgeMarkerIntervals.accessExistingReadOnly(largeDataName(name));
+        }
+    };
+    // If compressMarkerGraphEdgeMarkerIntervals was called,
+    // they are only available in compact form.
+    // Find out which variant is present by checking for its table of contents,
+    // so errors opening it are not mistaken for a missing variant.
+    bool found = false;
+    for(const bool isCanonical: {false, true}) {
+        const string name = isCanonical ?
+            "GlobalMarkerGraphEdgeMarkerIntervalsCanonical" :
+            "GlobalMarkerGraphEdgeMarkerIntervals";
+        if(filesystem::exists(largeDataName(name) + ".toc")) {
+            accessEdgeMarkerIntervals(name);
+            found = true;
+        } else if(filesystem::exists(largeDataName(name + "Compact") + ".toc")) {
+            markerGraph.compactEdgeMarkerIntervals.accessExistingReadOnly(
+                largeDataName(name + "Compact"));
+            found = true;
+        }
+        if(found) {
+            markerGraph.edgeMarkerIntervalsAreCanonical = isCanonical;
+            break;
+        }
+    }
+    if(!found) {
+        throw runtime_error("Marker graph edge marker intervals are not available.");
+    }
+    if(markerGraph.edgeMarkerIntervalsAreCanonical && !markerGraph.reverseComplementEdge.isOpen) {
+        accessMarkerGraphReverseComplementEdge();
+    }
+    accessMarkerGraphCompactAdjacency();
+
+    // Access the edge flag bitmaps. If they are not available
+    // (marker graph created by an older version), recreate them
+    // from the flags stored in the edges, in anonymous memory
+    // if the edges are accessed read-only.
+    const string edgeFlagBitmapsName = largeDataName("GlobalMarkerGraphEdgeFlagBitmaps");
+    if(filesystem::exists(edgeFlagBitmapsName)) {
+        if(accessEdgesReadWrite) {
+            markerGraph.edgeFlagBitmaps.accessExistingReadWrite(
+                edgeFlagBitmapsName, markerGraph.edges.size());
+        } else {
+            markerGraph.edgeFlagBitmaps.accessExistingReadOnly(
+                edgeFlagBitmapsName, markerGraph.edges.size());
+        }
+    } else {
+        markerGraph.edgeFlagBitmaps.createNew(
+            accessEdgesReadWrite ? edgeFlagBitmapsName : string(),
+            largeDataPageSize, markerGraph.edges.size());
+        markerGraph.storeEdgeFlagBitmaps();
+    }
+}
+
+
+
+// Access the compact adjacency of the marker graph.
+// Marker graphs created by older versions only have
+// edgesBySource and edgesByTarget. In that case the compact
+// adjacency is created from them in anonymous memory.
+void Assembler::accessMarkerGraphCompactAdjacency()
+{
+    if(filesystem::exists(largeDataName("GlobalMarkerGraphCompactEdgesBySource") + "-Data")) {
+        markerGraph.compactEdgesBySource.accessExistingReadOnly(
+            largeDataName("GlobalMarkerGraphCompactEdgesBySource"));
+        markerGraph.compactEdgesByTarget.accessExistingReadOnly(
+            largeDataName("GlobalMarkerGraphCompactEdgesByTarget"));
+        return;
+    }
+
+    cout << timestamp << "Creating the compact marker graph adjacency in memory." << endl;
     markerGraph.edgesBySource.accessExistingReadOnly(
         largeDataName("GlobalMarkerGraphEdgesBySource"));
     markerGraph.edgesByTarget.accessExistingReadOnly(
         largeDataName("GlobalMarkerGraphEdgesByTarget"));
+    markerGraph.compactEdgesBySource.createNew(
+        markerGraph.edgesBySource, "", largeDataPageSize, 0);
+    markerGraph.compactEdgesByTarget.createNew(
+        markerGraph.edgesByTarget, "", largeDataPageSize, 0);
+    markerGraph.edgesBySource.close();
+    markerGraph.edgesByTarget.close();
 }
 
 
@@ -2271,8 +3372,9 @@ void Assembler::accessMarkerGraphEdges(bool accessEdgesReadWrite)
 void Assembler::checkMarkerGraphEdgesIsOpen()
 {
     CZI_ASSERT(markerGraph.edges.isOpen);
-    CZI_ASSERT(markerGraph.edgesBySource.isOpen());
-    CZI_ASSERT(markerGraph.edgesByTarget.isOpen());
+    CZI_ASSERT(markerGraph.edgeFlagBitmaps.isOpen());
+    CZI_ASSERT(markerGraph.compactEdgesBySource.isOpen());
+    CZI_ASSERT(markerGraph.compactEdgesByTarget.isOpen());
 }
 
 
@@ -2288,13 +3390,12 @@ void Assembler::flagMarkerGraphWeakEdges(
     size_t lowCoverageThreshold,
     size_t highCoverageThreshold,
     size_t maxDistance,
-    size_t edgeMarkerSkipThreshold)
+    size_t edgeMarkerSkipThreshold,
+    size_t threadCount)
 {
     // Some shorthands for readability.
     auto& edges = markerGraph.edges;
-    using VertexId = MarkerGraph::VertexId;
     using EdgeId = MarkerGraph::EdgeId;
-    using Edge = MarkerGraph::Edge;
 
     // Initial message.
     cout << timestamp << "Flagging weak edges of the marker graph "
@@ -2353,20 +3454,10 @@ void Assembler::flagMarkerGraphWeakEdges(
     fill(edgeFlags.begin(), edgeFlags.end(), false);
 #endif
 
-    // Vector to contain vertex distances during each BFS.
-    // Is is set to -1 fore vertices nt reached by the BFS.
-    MemoryMapped::Vector<int> vertexDistances;
-    vertexDistances.createNew(
-        largeDataName("tmp-flagMarkerGraphWeakEdges-vertexDistances"),
-        largeDataPageSize);
-    vertexDistances.resize(markerGraph.vertices.size());
-    fill(vertexDistances.begin(), vertexDistances.end(), -1);
-
-    // Queue to be used for all BFSs.
-    std::queue<VertexId> q;
-
-    // Vector to store vertices encountered duirng a BFS.
-    vector<VertexId> bfsVertices;
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
 
 
 
@@ -2380,6 +3471,8 @@ void Assembler::flagMarkerGraphWeakEdges(
         for(const EdgeId edgeId: edgesWithThisCoverage) {
             edges[edgeId].wasRemovedByTransitiveReduction = 1;
             edges[markerGraph.reverseComplementEdge[edgeId]].wasRemovedByTransitiveReduction = 1;
+            edges[edgeId].isDirty = 1;
+            edges[markerGraph.reverseComplementEdge[edgeId]].isDirty = 1;
         }
     }
 
@@ -2391,9 +3484,9 @@ void Assembler::flagMarkerGraphWeakEdges(
     size_t coverage1HighSkipCount = 0;
     cout << timestamp << "Flagging as weak edges with coverage 1 "
         "and marker skip greater than " << edgeMarkerSkipThreshold << endl;
+    vector<MarkerInterval> markerIntervals;
     for(const EdgeId edgeId: edgesWithCoverage1) {
-        const MemoryAsContainer<MarkerInterval> markerIntervals =
-            markerGraph.edgeMarkerIntervals[edgeId];
+        getMarkerGraphEdgeMarkerIntervals(edgeId, markerIntervals);
         if(markerIntervals.size() > 1) {
             continue;
         }
@@ -2403,6 +3496,8 @@ void Assembler::flagMarkerGraphWeakEdges(
             if(edges[edgeId].wasRemovedByTransitiveReduction == 0) {
                 edges[edgeId].wasRemovedByTransitiveReduction = 1;
                 edges[markerGraph.reverseComplementEdge[edgeId]].wasRemovedByTransitiveReduction = 1;
+                edges[edgeId].isDirty = 1;
+                edges[markerGraph.reverseComplementEdge[edgeId]].isDirty = 1;
                 coverage1HighSkipCount += 2;
             }
         }
@@ -2414,111 +3509,71 @@ void Assembler::flagMarkerGraphWeakEdges(
 
 
     // Process edges of intermediate coverage.
+    // For each coverage, a parallel pass runs a BFS for each edge,
+    // ignoring edges of the same coverage that get flagged in this iteration.
+    // If the BFS finds a path that does not use edges of the same coverage,
+    // the edge would also be flagged by the sequential algorithm,
+    // because flagging other edges of the same coverage does not remove that path.
+    // If the BFS finds no path, the edge would not be flagged by the
+    // sequential algorithm either, because that only sees fewer edges.
+    // The remaining edges are processed sequentially in order of increasing
+    // edge id, which gives exactly the same result as the sequential algorithm.
+    FlagMarkerGraphWeakEdgesWorkspace workspace;
+    auto& data = flagMarkerGraphWeakEdgesData;
+    data.maxDistance = maxDistance;
     for(size_t coverage=lowCoverageThreshold+1;
         coverage<highCoverageThreshold; coverage++) {
         const auto& edgesWithThisCoverage = edgesByCoverage[coverage];
         cout << timestamp << "Processing " << edgesWithThisCoverage.size() <<
             " edges with coverage " << coverage << "." << endl;
-        size_t count = 0;
 
-        // Loop over edges with this coverage.
-        for(const EdgeId edgeId: edgesWithThisCoverage) {
-            const Edge& edge = edges[edgeId];
-            if(edge.wasRemovedByTransitiveReduction) {
-                continue;
-            }
-            const VertexId u0 = edge.source;
-            const VertexId u1 = edge.target;
-
-            // Do a forward BFS starting at v0, up to distance maxDistance,
-            // using only edges currently marked as strong
-            // and without using this edge.
-            // If we encounter v1, v1 is reachable from v0 without
-            // using this edge, and so we can mark this edge as weak.
-            q.push(u0);
-            vertexDistances[u0] = 0;
-            bfsVertices.push_back(u0);
-            bool found = false;
-            while(!q.empty()) {
-                const VertexId v0 = q.front();
-                q.pop();
-                const int distance0 = vertexDistances[v0];
-                const int distance1 = distance0 + 1;
-                for(const auto edgeId01: markerGraph.edgesBySource[v0]) {
-                    if(edgeId01 == edgeId) {
-                        continue;
-                    }
-                    const Edge& edge01 = markerGraph.edges[edgeId01];
-                    if(edge01.wasRemovedByTransitiveReduction) {
-                        continue;
-                    }
-                    const VertexId v1 = edge01.target;
-                    if(vertexDistances[v1] >= 0) {
-                        continue;   // We already encountered this vertex.
-                    }
-                    if(v1 == u1) {
-                        // We found it!
-                        found = true;
-                        break;
-                    }
-                    vertexDistances[v1] = distance1;
-                    bfsVertices.push_back(v1);
-                    if(distance1 < int(maxDistance)) {
-                        q.push(v1);
-                    }
-                }
-                if(found) {
-                    break;
-                }
-            }
+        // Parallel pass.
+        data.coverage = coverage;
+        data.edgeIds = edgesWithThisCoverage.begin();
+        data.status.resize(edgesWithThisCoverage.size());
+        setupLoadBalancing(edgesWithThisCoverage.size(), 1000);
+        runThreads(&Assembler::flagMarkerGraphWeakEdgesThreadFunction, threadCount);
 
-            if(found) {
+        // Sequential pass.
+        size_t count = 0;
+        size_t sequentialCount = 0;
+        for(size_t i=0; i<edgesWithThisCoverage.size(); i++) {
+            const EdgeId edgeId = edgesWithThisCoverage[i];
+            uint8_t status = data.status[i];
+            if(status == 2) {
+                ++sequentialCount;
+                status = flagMarkerGraphWeakEdgesBfs(edgeId, maxDistance, 0, workspace);
+            }
+            if(status != 0) {
+                const EdgeId edgeIdRc = markerGraph.reverseComplementEdge[edgeId];
                 edges[edgeId].wasRemovedByTransitiveReduction = 1;
-                edges[markerGraph.reverseComplementEdge[edgeId]].wasRemovedByTransitiveReduction = 1;
+                edges[edgeIdRc].wasRemovedByTransitiveReduction = 1;
+                edges[edgeId].isDirty = 1;
+                edges[edgeIdRc].isDirty = 1;
                 count += 2;
             }
-
-            // Clean up to be ready to process the next edge.
-            while(!q.empty()) {
-                q.pop();
-            }
-            for(const VertexId v: bfsVertices) {
-                vertexDistances[v] = -1;
-            }
-            bfsVertices.clear();
         }
 
-#if 0
-        // Actually flag these weak edges in the marker graph.
-        size_t count = 0;
-        for(EdgeId edgeId=0; edgeId<edgeFlags.size(); edgeId++) {
-            if(edgeFlags[edgeId]) {
-                edges[edgeId].isWeak = 1;
-                edgeFlags[edgeId] = false;
-                ++count;
-            }
-        }
-#endif
         cout << "Flagged as weak " << count <<
             " edges with coverage " << coverage <<
-            " out of "<< edgesWithThisCoverage.size() << " total." << endl;
+            " out of "<< 2*edgesWithThisCoverage.size() << " total. " <<
+            2*sequentialCount << " edges required sequential processing." << endl;
     }
+    data.status.clear();
+    data.status.shrink_to_fit();
+
 
 
     // Clean up our work areas.
     edgesByCoverage.remove();
-    // edgeFlags.remove();
-    vertexDistances.remove();
 
 
 
-    // Count the number of edges that were flagged as weak.
-    uint64_t weakEdgeCount = 0;;
-    for(const auto& edge: markerGraph.edges) {
-        if(edge.wasRemovedByTransitiveReduction) {
-            ++weakEdgeCount;
-        }
-    }
+    // Update the edge flag bitmaps and use them to count
+    // the number of edges that were flagged as weak.
+    markerGraph.storeEdgeFlagBitmaps();
+    const uint64_t weakEdgeCount = markerGraph.edgeFlagBitmaps.count(
+        MarkerGraphEdgeFlagBitmaps::flagBit(MarkerGraphEdgeFlagBitmaps::wasRemovedByTransitiveReduction));
     cout << "Flagged as weak " << weakEdgeCount << " marker graph edges out of ";
     cout << markerGraph.edges.size() << " total." << endl;
 
@@ -2530,6 +3585,137 @@ void Assembler::flagMarkerGraphWeakEdges(
 
 
 
+void Assembler::flagMarkerGraphWeakEdgesThreadFunction(size_t threadId)
+{
+    auto& data = flagMarkerGraphWeakEdgesData;
+    FlagMarkerGraphWeakEdgesWorkspace workspace;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const MarkerGraph::EdgeId edgeId = data.edgeIds[i];
+            if(markerGraph.edges[edgeId].wasRemovedByTransitiveReduction) {
+                data.status[i] = 0;
+            } else {
+                data.status[i] = flagMarkerGraphWeakEdgesBfs(
+                    edgeId, data.maxDistance, data.coverage, workspace);
+            }
+        }
+    }
+}
+
+
+
+// Do a forward BFS starting at the source of the given edge, up to distance maxDistance,
+// using only edges currently marked as strong and without using this edge.
+// If we encounter the target of the edge, it is reachable without
+// using this edge, and so we can mark this edge as weak.
+// Edges with coverage currentCoverage are used, but we keep track of
+// whether the path found uses any of them.
+uint8_t Assembler::flagMarkerGraphWeakEdgesBfs(
+    MarkerGraph::EdgeId edgeId,
+    size_t maxDistance,
+    size_t currentCoverage,
+    FlagMarkerGraphWeakEdgesWorkspace& workspace) const
+{
+    using VertexId = MarkerGraph::VertexId;
+    using Edge = MarkerGraph::Edge;
+    using QueueEntry = FlagMarkerGraphWeakEdgesWorkspace::QueueEntry;
+
+    const Edge& edge = markerGraph.edges[edgeId];
+    if(edge.wasRemovedByTransitiveReduction) {
+        return 0;
+    }
+    const VertexId u0 = edge.source;
+    const VertexId u1 = edge.target;
+
+    workspace.begin();
+    auto& queue = workspace.queue;
+    workspace.visit(u0);
+    queue.push_back({u0, 0, false});
+    for(size_t queueBegin=0; queueBegin!=queue.size(); queueBegin++) {
+        const QueueEntry entry0 = queue[queueBegin];
+        const uint32_t distance1 = entry0.distance + 1;
+        for(const auto edgeId01: markerGraph.compactEdgesBySource[entry0.vertexId]) {
+            if(edgeId01 == edgeId) {
+                continue;
+            }
+            const Edge& edge01 = markerGraph.edges[edgeId01];
+            if(edge01.wasRemovedByTransitiveReduction) {
+                continue;
+            }
+            const bool usesCurrentCoverage =
+                entry0.usesCurrentCoverage || (edge01.coverage == currentCoverage);
+            const VertexId v1 = edge01.target;
+            if(v1 == u1 && v1 != u0) {
+                // We found it!
+                return usesCurrentCoverage ? 2 : 1;
+            }
+            if(!workspace.visit(v1)) {
+                continue;   // We already encountered this vertex.
+            }
+            if(distance1 < maxDistance) {
+                queue.push_back({v1, distance1, usesCurrentCoverage});
+            }
+        }
+    }
+    return 0;
+}
+
+
+
+void Assembler::FlagMarkerGraphWeakEdgesWorkspace::begin()
+{
+    queue.clear();
+    usedCount = 0;
+    ++epoch;
+    if(epoch == 0) {
+        // The epoch wrapped around. Clear all slots.
+        for(Slot& slot: slots) {
+            slot.epoch = 0;
+        }
+        epoch = 1;
+    }
+    if(slots.empty()) {
+        slots.resize(1024);
+    }
+}
+
+
+
+bool Assembler::FlagMarkerGraphWeakEdgesWorkspace::visit(MarkerGraph::VertexId vertexId)
+{
+    // Keep the load factor at most 1/2.
+    if(2 * (usedCount + 1) > slots.size()) {
+        vector<Slot> oldSlots(2 * slots.size());
+        oldSlots.swap(slots);
+        usedCount = 0;
+        for(const Slot& slot: oldSlots) {
+            if(slot.epoch == epoch) {
+                visit(slot.vertexId);
+            }
+        }
+    }
+
+    // Linear probing, starting at a Fibonacci hash of the vertex id.
+    const uint64_t mask = slots.size() - 1;
+    const int shift = 64 - __builtin_ctzll(slots.size());
+    for(uint64_t i=(vertexId * 0x9E3779B97F4A7C15ULL) >> shift; ; i=(i+1) & mask) {
+        Slot& slot = slots[i];
+        if(slot.epoch != epoch) {
+            slot.vertexId = vertexId;
+            slot.epoch = epoch;
+            ++usedCount;
+            return true;
+        }
+        if(slot.vertexId == vertexId) {
+            return false;
+        }
+    }
+}
+
+
+
 // Return true if an edge disconnects the local subgraph.
 bool Assembler::markerGraphEdgeDisconnectsLocalStrongSubgraph(
     MarkerGraph::EdgeId startEdgeId,
@@ -2592,7 +3778,7 @@ bool Assembler::markerGraphEdgeDisconnectsLocalStrongSubgraph(
                 // cout << "VertexId0 " << vertexId0 << endl;
 
                 // Loop over children.
-                auto childEdgeIds = markerGraph.edgesBySource[vertexId0];
+                auto childEdgeIds = markerGraph.compactEdgesBySource[vertexId0];
                 for(EdgeId edgeId: childEdgeIds) {
                     if(edgeId == startEdgeId) {
                         continue;
@@ -2629,7 +3815,7 @@ bool Assembler::markerGraphEdgeDisconnectsLocalStrongSubgraph(
                 }
 
                 // Loop over parents.
-                auto parentEdgeIds = markerGraph.edgesByTarget[vertexId0];
+                auto parentEdgeIds = markerGraph.compactEdgesByTarget[vertexId0];
                 for(EdgeId edgeId: parentEdgeIds) {
                     if(edgeId == startEdgeId) {
                         continue;
@@ -2697,85 +3883,173 @@ bool Assembler::markerGraphEdgeDisconnectsLocalStrongSubgraph(
 
 
 // Prune leaves from the strong subgraph of the global marker graph.
-void Assembler::pruneMarkerGraphStrongSubgraph(size_t iterationCount)
+void Assembler::pruneMarkerGraphStrongSubgraph(
+    size_t iterationCount,
+    size_t threadCount)
 {
     // Some shorthands.
     using VertexId = MarkerGraph::VertexId;
     using EdgeId = VertexId;
+    auto& data = pruneMarkerGraphStrongSubgraphData;
 
     // Check that we have what we need.
     checkMarkerGraphVerticesAreAvailable();
     checkMarkerGraphEdgesIsOpen();
 
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
     // Get the number of edges.
     auto& edges = markerGraph.edges;
     const EdgeId edgeCount = edges.size();
 
-    // Flags to mark edges to prune at each iteration.
-    MemoryMapped::Vector<bool> edgesToBePruned;
-    edgesToBePruned.createNew(
-        largeDataName("tmp-PruneMarkerGraphStrogngSubgraph"),
-        largeDataPageSize);
-    edgesToBePruned.resize(edgeCount);
-    fill(edgesToBePruned.begin(), edgesToBePruned.end(), false);
-
     // Clear the wasPruned flag of all edges.
     for(MarkerGraph::Edge& edge: edges) {
         edge.wasPruned = 0;
     }
+    markerGraph.edgeFlagBitmaps.clearAll(MarkerGraphEdgeFlagBitmaps::wasPruned);
+
+    // Bits to mark edges that are in the frontier for the next iteration.
+    data.isInFrontier.createNew(
+        largeDataName("tmp-PruneMarkerGraphStrongSubgraph-IsInFrontier"),
+        largeDataPageSize);
+    data.isInFrontier.resize((edgeCount + 63) / 64);
+    fill(data.isInFrontier.begin(), data.isInFrontier.end(), 0);
+    data.threadEdgesToBePruned.resize(threadCount);
+    data.threadFrontier.resize(threadCount);
 
 
 
     // At each prune iteration we prune one layer of leaves.
+    // The first iteration examines all edges.
+    // An edge that was not pruned at an iteration can only be pruned
+    // at the next iteration if the out-degree of its target or
+    // the in-degree of its source changed, so the following
+    // iterations only examine the edges adjacent to the ones just pruned.
+    // This gives the same result as examining all edges at each iteration.
+    data.useFrontier = false;
     for(size_t iteration=0; iteration!=iterationCount; iteration++) {
         cout << timestamp << "Begin prune iteration " << iteration << endl;
 
-        // Find the edges to be pruned at each iteration.
-        for(EdgeId edgeId=0; edgeId<edgeCount; edgeId++) {
-            MarkerGraph::Edge& edge = edges[edgeId];
-            if(edge.wasRemovedByTransitiveReduction) {
-                continue;
+        // Find the edges to be pruned at this iteration.
+        if(data.useFrontier) {
+            setupLoadBalancing(data.frontier.size(), 1000);
+        } else {
+            setupLoadBalancing(edgeCount, 10000);
+        }
+        runThreads(&Assembler::pruneMarkerGraphStrongSubgraphThreadFunction1, threadCount);
+        data.edgesToBePruned.clear();
+        for(auto& v: data.threadEdgesToBePruned) {
+            data.edgesToBePruned.insert(data.edgesToBePruned.end(), v.begin(), v.end());
+            v.clear();
+        }
+
+        // Flag the edges we found at this iteration
+        // and find the frontier for the next iteration.
+        setupLoadBalancing(data.edgesToBePruned.size(), 1000);
+        runThreads(&Assembler::pruneMarkerGraphStrongSubgraphThreadFunction2, threadCount);
+        data.frontier.clear();
+        for(auto& v: data.threadFrontier) {
+            data.frontier.insert(data.frontier.end(), v.begin(), v.end());
+            v.clear();
+        }
+        data.useFrontier = true;
+
+        cout << "Pruned " << data.edgesToBePruned.size() <<
+            " edges at prune iteration " << iteration << "." << endl;
+    }
+
+    // Clean up.
+    data.isInFrontier.remove();
+    data.frontier.clear();
+    data.frontier.shrink_to_fit();
+    data.edgesToBePruned.clear();
+    data.edgesToBePruned.shrink_to_fit();
+    data.threadEdgesToBePruned.clear();
+    data.threadFrontier.clear();
+
+
+    // Count the number of surviving edges in the pruned strong subgraph.
+    const size_t count = edgeCount - markerGraph.edgeFlagBitmaps.count(
+        MarkerGraphEdgeFlagBitmaps::notInPrunedStrongSubgraphMask);
+    cout << "The marker graph has " << markerGraph.vertices.size();
+    cout << " vertices and " << edgeCount << " edges." << endl;
+    cout << "The pruned strong subgraph has " << markerGraph.vertices.size();
+    cout << " vertices and " << count << " edges." << endl;
+}
+
+
+
+// Find the edges to be pruned at the current iteration.
+// This does not modify the edges.
+void Assembler::pruneMarkerGraphStrongSubgraphThreadFunction1(size_t threadId)
+{
+    auto& data = pruneMarkerGraphStrongSubgraphData;
+    auto& edgesToBePruned = data.threadEdgesToBePruned[threadId];
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            MarkerGraph::EdgeId edgeId = i;
+            if(data.useFrontier) {
+                edgeId = data.frontier[i];
+                __sync_fetch_and_and(&data.isInFrontier[edgeId >> 6], ~(1ULL << (edgeId & 63)));
             }
-            if(edge.wasPruned) {
+            if(markerGraph.edgeFlagBitmaps.isAnySet(MarkerGraphEdgeFlagBitmaps::notInPrunedStrongSubgraphMask, edgeId)) {
                 continue;
             }
+            const MarkerGraph::Edge& edge = markerGraph.edges[edgeId];
             if(
                 isForwardLeafOfMarkerGraphPrunedStrongSubgraph(edge.target) ||
                 isBackwardLeafOfMarkerGraphPrunedStrongSubgraph(edge.source)
                 ) {
-                edgesToBePruned[edgeId] = true;
-            }
-        }
-
-
-
-        // Flag the edges we found at this iteration.
-        EdgeId count = 0;
-        for(EdgeId edgeId=0; edgeId<edgeCount; edgeId++) {
-            if(edgesToBePruned[edgeId]) {
-                edges[edgeId].wasPruned = 1;
-                ++count;
-                edgesToBePruned[edgeId] = false;    // For next iteration.
+                edgesToBePruned.push_back(edgeId);
             }
         }
-        cout << "Pruned " << count << " edges at prune iteration " << iteration << "." << endl;
     }
+}
 
 
-    edgesToBePruned.remove();
 
+// Flag the edges to be pruned at the current iteration
+// and find the edges to be examined at the next iteration.
+// Each edge is flagged by only one thread, so no locking is needed
+// for the flags. The frontier bits are set atomically because
+// an edge can be adjacent to more than one pruned edge.
+void Assembler::pruneMarkerGraphStrongSubgraphThreadFunction2(size_t threadId)
+{
+    auto& data = pruneMarkerGraphStrongSubgraphData;
+    auto& frontier = data.threadFrontier[threadId];
 
-    // Count the number of surviving edges in the pruned strong subgraph.
-    size_t count = 0;
-    for(MarkerGraph::Edge& edge: edges) {
-        if(!edge.wasRemovedByTransitiveReduction && !edge.wasPruned) {
-            ++count;
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const MarkerGraph::EdgeId edgeId = data.edgesToBePruned[i];
+            MarkerGraph::Edge& edge = markerGraph.edges[edgeId];
+            edge.wasPruned = 1;
+            edge.isDirty = 1;
+            markerGraph.edgeFlagBitmaps.set(MarkerGraphEdgeFlagBitmaps::wasPruned, edgeId);
+
+            // The source of this edge can become a forward leaf,
+            // so the edges entering it must be examined at the next iteration.
+            // The target of this edge can become a backward leaf,
+            // so the edges exiting it must be examined at the next iteration.
+            for(const MarkerGraph::EdgeId edgeId1: markerGraph.compactEdgesByTarget[edge.source]) {
+                const uint64_t mask = 1ULL << (edgeId1 & 63);
+                if(!(__sync_fetch_and_or(&data.isInFrontier[edgeId1 >> 6], mask) & mask)) {
+                    frontier.push_back(edgeId1);
+                }
+            }
+            for(const MarkerGraph::EdgeId edgeId1: markerGraph.compactEdgesBySource[edge.target]) {
+                const uint64_t mask = 1ULL << (edgeId1 & 63);
+                if(!(__sync_fetch_and_or(&data.isInFrontier[edgeId1 >> 6], mask) & mask)) {
+                    frontier.push_back(edgeId1);
+                }
+            }
         }
     }
-    cout << "The marker graph has " << markerGraph.vertices.size();
-    cout << " vertices and " << edgeCount << " edges." << endl;
-    cout << "The pruned strong subgraph has " << markerGraph.vertices.size();
-    cout << " vertices and " << count << " edges." << endl;
 }
 
 
@@ -2785,10 +4059,9 @@ void Assembler::pruneMarkerGraphStrongSubgraph(size_t iterationCount)
 // A backward leaf is a vertex with in-degree 0.
 bool Assembler::isForwardLeafOfMarkerGraphPrunedStrongSubgraph(MarkerGraph::VertexId vertexId) const
 {
-    const auto& forwardEdges = markerGraph.edgesBySource[vertexId];
+    const auto& forwardEdges = markerGraph.compactEdgesBySource[vertexId];
     for(const auto& edgeId: forwardEdges) {
-        const auto& edge = markerGraph.edges[edgeId];
-        if(!edge.wasRemovedByTransitiveReduction && !edge.wasPruned) {
+        if(!markerGraph.edgeFlagBitmaps.isAnySet(MarkerGraphEdgeFlagBitmaps::notInPrunedStrongSubgraphMask, edgeId)) {
             return false;   // We found a forward edge, so this is not a forward leaf.
         }
 
@@ -2797,10 +4070,9 @@ bool Assembler::isForwardLeafOfMarkerGraphPrunedStrongSubgraph(MarkerGraph::Vert
 }
 bool Assembler::isBackwardLeafOfMarkerGraphPrunedStrongSubgraph(MarkerGraph::VertexId vertexId) const
 {
-    const auto& backwardEdges = markerGraph.edgesByTarget[vertexId];
+    const auto& backwardEdges = markerGraph.compactEdgesByTarget[vertexId];
     for(const auto& edgeId: backwardEdges) {
-        const auto& edge = markerGraph.edges[edgeId];
-        if(!edge.wasRemovedByTransitiveReduction && !edge.wasPruned) {
+        if(!markerGraph.edgeFlagBitmaps.isAnySet(MarkerGraphEdgeFlagBitmaps::notInPrunedStrongSubgraphMask, edgeId)) {
             return false;   // We found a backward edge, so this is not a backward leaf.
         }
 
@@ -2837,12 +4109,11 @@ MarkerGraph::EdgeId Assembler::nextEdgeInMarkerGraphPrunedStrongSubgraphChain(
 
     // Loop over all edges following it.
     EdgeId nextEdgeId = MarkerGraph::invalidEdgeId;
-    for(const EdgeId edgeId1: markerGraph.edgesBySource[edge0.target]) {
-        const Edge& edge1 = edges[edgeId1];
+    for(const EdgeId edgeId1: markerGraph.compactEdgesBySource[edge0.target]) {
 
         // Skip the edge if it is not part of the
         // pruned strong subgraph of the marker graph.
-        if(edge1.wasRemoved()) {
+        if(markerGraph.edgeWasRemoved(edgeId1)) {
             continue;
         }
 
@@ -2893,7 +4164,7 @@ MarkerGraph::EdgeId Assembler::previousEdgeInMarkerGraphPrunedStrongSubgraphChai
 
     // Loop over all edges preceding it.
     EdgeId previousEdgeId = MarkerGraph::invalidEdgeId;
-    for(const EdgeId edgeId1: markerGraph.edgesByTarget[edge0.source]) {
+    for(const EdgeId edgeId1: markerGraph.compactEdgesByTarget[edge0.source]) {
         const Edge& edge1 = edges[edgeId1];
         if(debug) {
             cout << "Found " << edgeId1 << " " << edge1.source << "->" << edge1.target << endl;
@@ -2901,7 +4172,7 @@ MarkerGraph::EdgeId Assembler::previousEdgeInMarkerGraphPrunedStrongSubgraphChai
 
         // Skip the edge if it is not part of the
         // pruned strong subgraph of the marker graph.
-        if(edge1.wasRemoved()) {
+        if(markerGraph.edgeWasRemoved(edgeId1)) {
             if(debug) {
                 cout << "Edge was removed." << endl;
             }
@@ -2938,9 +4209,8 @@ size_t Assembler::markerGraphPrunedStrongSubgraphOutDegree(
     MarkerGraph::VertexId vertexId) const
 {
     size_t outDegree = 0;
-    for(const auto edgeId: markerGraph.edgesBySource[vertexId]) {
-        const auto& edge = markerGraph.edges[edgeId];
-        if(!edge.wasRemoved()) {
+    for(const auto edgeId: markerGraph.compactEdgesBySource[vertexId]) {
+        if(!markerGraph.edgeWasRemoved(edgeId)) {
             ++outDegree;
         }
     }
@@ -2950,9 +4220,8 @@ size_t Assembler::markerGraphPrunedStrongSubgraphInDegree(
     MarkerGraph::VertexId vertexId) const
 {
     size_t inDegree = 0;
-    for(const auto edgeId: markerGraph.edgesByTarget[vertexId]) {
-        const auto& edge = markerGraph.edges[edgeId];
-        if(!edge.wasRemoved()) {
+    for(const auto edgeId: markerGraph.compactEdgesByTarget[vertexId]) {
+        if(!markerGraph.edgeWasRemoved(edgeId)) {
             ++inDegree;
         }
     }
@@ -2993,10 +4262,13 @@ void Assembler::computeMarkerGraphVertexConsensusSequence(
     for(uint32_t position=0; position<uint32_t(k); position++) {
 
         // Object to store base and repeat count information
-        // at this position.
-        Coverage coverage;
+        // at this position. We use a CompactCoverage object,
+        // which does not allocate memory, and fall back to
+        // a Coverage object only if a repeat count is too long for it.
+        CompactCoverage coverage;
 
         // Loop over markers.
+        Base firstBase;
         for(size_t i=0; i<markerCount; i++) {
 
             // Get the base and repeat count.
@@ -3006,20 +4278,33 @@ void Assembler::computeMarkerGraphVertexConsensusSequence(
             uint8_t repeatCount;
             tie(base, repeatCount) = getOrientedReadBaseAndRepeatCount(orientedReadId, markerPosition + position);
 
-            // Add it to the Coverage object.
-            coverage.addRead(AlignedBase(base), orientedReadId.getStrand(), size_t(repeatCount));
-        }
+            // Sanity check that all the bases are the same.
+            if(i == 0) {
+                firstBase = base;
+            } else {
+                CZI_ASSERT(base == firstBase);
+            }
 
-        // Sanity check that all the bases are the same.
-        const vector<CoverageData>& coverageData = coverage.getReadCoverageData();
-        CZI_ASSERT(coverageData.size() == markerCount);
-        const Base firstBase = Base(coverageData.front().base);
-        for(const CoverageData& c: coverageData) {
-            CZI_ASSERT(Base(c.base) == firstBase);
+            // Add it to the CompactCoverage object.
+            coverage.addRead(AlignedBase(base), orientedReadId.getStrand(), size_t(repeatCount));
         }
 
         // Compute the consensus.
-        const Consensus consensus = (*consensusCaller)(coverage);
+        Consensus consensus;
+        if(coverage.overflow()) {
+            Coverage fullCoverage;
+            for(size_t i=0; i<markerCount; i++) {
+                const OrientedReadId orientedReadId = markerInfos[i].first;
+                Base base;
+                uint8_t repeatCount;
+                tie(base, repeatCount) = getOrientedReadBaseAndRepeatCount(orientedReadId, markerPositions[i] + position);
+                fullCoverage.addRead(AlignedBase(base), orientedReadId.getStrand(), size_t(repeatCount));
+            }
+            consensus = (*consensusCaller)(fullCoverage);
+        } else {
+            CZI_ASSERT(coverage.coverage(AlignedBase(firstBase)) == markerCount);
+            consensus = (*consensusCaller)(coverage);
+        }
         sequence[position] = Base(consensus.base);
         repeatCounts[position] = uint32_t(consensus.repeatCount);
     }
@@ -3046,8 +4331,8 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSeqan(
 #if 0
     // Access the markerIntervals for this edge.
     // Each corresponds to an oriented read on this edge.
-    const MemoryAsContainer<MarkerInterval> markerIntervals =
-        markerGraph.edgeMarkerIntervals[edgeId];
+    vector<MarkerInterval> markerIntervals;
+    getMarkerGraphEdgeMarkerIntervals(edgeId, markerIntervals);
     const size_t markerCount = markerIntervals.size();
 
     // Initialize a seqan alignment.
@@ -3146,22 +4431,35 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSeqan(
 // to avoid memory and performance problems.
 // Instead, we return as consensus the sequence of the shortest marker interval.
 // This should happen only exceptionally.
+// If all intervening sequences are at most starAlignmentLengthThreshold
+// bases long, the multiple sequence alignment is computed
+// using computeStarAlignment instead of spoa.
+// If a PoaBatch is specified, this is called twice for each edge of a batch.
+// The first call only adds the edge to the batch if it needs spoa.
+// After a PoaBackend aligns the batch, the second call
+// computes the consensus using the alignment computed by the PoaBackend.
 void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
     MarkerGraph::EdgeId edgeId,
     uint32_t markerGraphEdgeLengthThresholdForConsensus,
+    uint32_t starAlignmentLengthThreshold,
     vector<Base>& sequence,
     vector<uint32_t>& repeatCounts,
     uint8_t& overlappingBaseCount,
-    vector< pair<uint32_t, CompressedCoverageData> >* coverageData // Optional
+    vector< pair<uint32_t, CompressedCoverageData> >* coverageData, // Optional
+    PoaBatch* poaBatch // Optional
     )
 {
     // Get the marker length.
     const uint32_t k = uint32_t(assemblerInfo->k);
 
+    // The temporary containers used below are allocated in
+    // the arena of this thread, if any, and released on return.
+    const ThreadArena::Scope arenaScope;
+
     // Access the markerIntervals for this edge.
     // Each corresponds to an oriented read on this edge.
-    const MemoryAsContainer<MarkerInterval> markerIntervals =
-        markerGraph.edgeMarkerIntervals[edgeId];
+    vector<MarkerInterval> markerIntervals;
+    getMarkerGraphEdgeMarkerIntervals(edgeId, markerIntervals);
     const size_t markerCount = markerIntervals.size();
     CZI_ASSERT(markerCount > 0);
 
@@ -3298,7 +4596,7 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
         // Offset histogram.
         // Count marker offsets up to k.
         // Since we are at it, also get the kmerIds.
-        vector<uint32_t> offsetHistogram(k+1, 0);
+        ArenaVector<uint32_t> offsetHistogram(k+1, 0);
         for(size_t i=0; i!=markerCount; i++) {
             const MarkerInterval& markerInterval = markerIntervals[i];
             const OrientedReadId orientedReadId = markerInterval.orientedReadId;
@@ -3358,11 +4656,17 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
     // Gather all of the intervening sequences and repeatCounts, keeping track of distinct
     // sequences. For each sequence we store a vector of i values
     // where each sequence appear.
-    vector< vector<Base> > distinctSequences;
-    vector< vector<size_t> > distinctSequenceOccurrences;
+    // At high coverage, many marker intervals have identical
+    // intervening sequence, so we use a hash table to find
+    // the distinct sequences. Each distinct sequence is stored
+    // as a string of base characters, ready to be passed to spoa.
+    vector<string> distinctSequences;
+    ArenaVector< ArenaVector<size_t> > distinctSequenceOccurrences;
+    std::unordered_map<string, size_t, std::hash<string>, std::equal_to<string>,
+        ArenaAllocator< pair<const string, size_t> > > distinctSequenceMap;
     vector<bool> isUsed(markerCount);
-    vector<Base> interveningSequence;
-    vector< vector<uint8_t> > interveningRepeatCounts(markerCount);
+    string interveningSequence;
+    ArenaVector< ArenaVector<uint8_t> > interveningRepeatCounts(markerCount);
     for(size_t i=0; i!=markerCount; i++) {
         const MarkerInterval& markerInterval = markerIntervals[i];
         const OrientedReadId orientedReadId = markerInterval.orientedReadId;
@@ -3391,20 +4695,21 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
             Base base;
             uint8_t repeatCount;
             tie(base, repeatCount) = getOrientedReadBaseAndRepeatCount(orientedReadId, position);
-            interveningSequence.push_back(getOrientedReadBase(orientedReadId, position));
+            interveningSequence.push_back(base.character());
             interveningRepeatCounts[i].push_back(repeatCount);
         }
 
         // Store, making sure to check if we already encountered this sequence.
-        const auto it = find(distinctSequences.begin(), distinctSequences.end(), interveningSequence);
-        if(it == distinctSequences.end()) {
+        const auto q = distinctSequenceMap.insert(
+            make_pair(interveningSequence, distinctSequences.size()));
+        if(q.second) {
             // We did not already encountered this sequence.
             distinctSequences.push_back(interveningSequence);
             distinctSequenceOccurrences.resize(distinctSequenceOccurrences.size() + 1);
             distinctSequenceOccurrences.back().push_back(i);
         } else {
             // We already encountered this sequence,
-            distinctSequenceOccurrences[it - distinctSequences.begin()].push_back(i);
+            distinctSequenceOccurrences[q.first->second].push_back(i);
         }
     }
 
@@ -3415,7 +4720,7 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
     // For each pair stored:
     // first = index of the distinct sequence in distintSequenced, distinctSequenceOccurrences.
     // second = frequency.
-    vector< pair<size_t, uint32_t> > distinctSequenceTable;
+    ArenaVector< pair<size_t, uint32_t> > distinctSequenceTable;
     for(size_t j=0; j<distinctSequences.size(); j++) {
         distinctSequenceTable.push_back(make_pair(j, distinctSequenceOccurrences[j].size()));
     }
@@ -3423,36 +4728,81 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
         OrderPairsBySecondOnlyGreater<size_t, uint32_t>());
 
 
-    // We are now ready to compute the spoa alignment for the distinct sequences.
+    // The length of the longest distinct sequence.
+    uint64_t maxDistinctSequenceLength = 0;
+    for(const string& distinctSequence: distinctSequences) {
+        maxDistinctSequenceLength = max(maxDistinctSequenceLength, uint64_t(distinctSequence.size()));
+    }
 
-    // Initialize a spoa alignment.
-    const spoa::AlignmentType alignmentType = spoa::AlignmentType::kNW;
-    const int8_t match = 1;
-    const int8_t mismatch = -1;
-    const int8_t gap = -1;
-    auto alignmentEngine = spoa::createAlignmentEngine(alignmentType, match, mismatch, gap);
-    auto alignmentGraph = spoa::createGraph();
 
 
-    // Add the sequences to the alignment, in order of decreasing frequency.
-    string sequenceString;
-    for(const auto& p: distinctSequenceTable) {
-        const vector<Base>& distinctSequence = distinctSequences[p.first];
+    // The distinct sequences in order of decreasing frequency,
+    // each with its frequency as weight.
+    static thread_local vector<string> orderedDistinctSequences;
+    static thread_local vector<uint32_t> orderedDistinctSequenceWeights;
+    orderedDistinctSequences.resize(distinctSequenceTable.size());
+    orderedDistinctSequenceWeights.resize(distinctSequenceTable.size());
+    for(size_t j=0; j<distinctSequenceTable.size(); j++) {
+        orderedDistinctSequences[j] = distinctSequences[distinctSequenceTable[j].first];
+        orderedDistinctSequenceWeights[j] = distinctSequenceTable[j].second;
+    }
+    const bool useSpoa =
+        (distinctSequenceTable.size() > 1) &&
+        (maxDistinctSequenceLength > starAlignmentLengthThreshold);
 
-        // Add it to the alignment.
-        sequenceString.clear();
-        for(const Base base: distinctSequence) {
-            sequenceString += base.character();
+    // If we are gathering the spoa alignments of a batch of edges
+    // for a PoaBackend, queue this edge if it needs spoa, and return.
+    // The consensus is computed when this is called again for this edge
+    // after the batch is aligned.
+    if(poaBatch && !poaBatch->isAligned) {
+        if(useSpoa) {
+            poaBatch->addGroup(orderedDistinctSequences, orderedDistinctSequenceWeights);
         }
-        auto alignment = alignmentEngine->align(sequenceString, alignmentGraph);
-        alignmentGraph->add_alignment(alignment, sequenceString);
+        return;
     }
 
 
 
-    // Use spoa to compute the multiple sequence alignment.
+    // We are now ready to compute the multiple sequence alignment
+    // of the distinct sequences.
     vector<string>msa;
-    alignmentGraph->generate_multiple_sequence_alignment(msa);
+    if(distinctSequenceTable.size() == 1) {
+
+        // All marker intervals have the same intervening sequence.
+        // This is common at high coverage. The alignment is trivial
+        // and consists of that sequence alone, so we don't need spoa.
+        msa.push_back(distinctSequences.front());
+        __sync_fetch_and_add(&assembleMarkerGraphEdgesData.identicalSequenceEdgeCount, 1ULL);
+
+    } else if(!useSpoa) {
+
+        // All the intervening sequences are short.
+        // Align them to the most frequent one, which is the first
+        // in distinctSequenceTable. This is much faster than spoa,
+        // which builds and aligns to a partial order graph.
+        const uint64_t bandWidth = 4;
+        computeStarAlignment(orderedDistinctSequences, bandWidth, msa);
+        __sync_fetch_and_add(&assembleMarkerGraphEdgesData.starAlignmentEdgeCount, 1ULL);
+
+    } else if(poaBatch) {
+
+        // The alignment was computed by the PoaBackend,
+        // together with the other edges of the batch.
+        // The edges are processed in the same order in which they were gathered.
+        CZI_ASSERT(poaBatch->nextGroup < poaBatch->size());
+        msa.swap(poaBatch->msas[poaBatch->nextGroup++]);
+        CZI_ASSERT(msa.size() == distinctSequenceTable.size());
+        __sync_fetch_and_add(&assembleMarkerGraphEdgesData.spoaEdgeCount, 1ULL);
+
+    } else {
+
+        // Use spoa, adding the sequences to the alignment
+        // in order of decreasing frequency, each with weight equal to its frequency.
+        // Coverage is still accumulated for each marker interval
+        // when computing consensus below.
+        computeSpoaAlignment(orderedDistinctSequences, orderedDistinctSequenceWeights, msa);
+        __sync_fetch_and_add(&assembleMarkerGraphEdgesData.spoaEdgeCount, 1ULL);
+    }
 
     // The length of the alignment.
     // This includes alignment gaps.
@@ -3476,39 +4826,90 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
     // We loop over all positions in the alignment.
     // At each position we compute a consensus base and repeat count.
     // If the consensus bases is not '-', we store the base and repeat count.
-    vector<uint32_t> positions(markerCount, 0);
-    for(size_t position=0; position<alignmentLength; position++) {
-
-        // Create a Coverage object for this position.
-        Coverage coverage;
+    ArenaVector<uint32_t> positions(markerCount, 0);
 
+    // Function to add the reads at an alignment position
+    // using a given function addRead(base, strand, repeatCount).
+    // This does not update the positions vector.
+    auto addReads = [&](size_t position, auto addRead)
+    {
         // Loop over distinct sequences, in the same order in
         // which we presented them to spoa.
         for(size_t j=0; j<distinctSequenceTable.size(); j++) {
             const auto& p = distinctSequenceTable[j];
             const size_t index = p.first;
-            // const vector<Base>& distinctSequence = distinctSequences[index];
-            const vector<size_t>& occurrences = distinctSequenceOccurrences[index];
+            const ArenaVector<size_t>& occurrences = distinctSequenceOccurrences[index];
+            const AlignedBase base = AlignedBase::fromCharacter(msa[j][position]);
 
             // Loop over the marker intervals that have this sequence.
             for(const size_t i: occurrences) {
                 const MarkerInterval& markerInterval = markerIntervals[i];
                 const OrientedReadId orientedReadId = markerInterval.orientedReadId;
-                const AlignedBase base = AlignedBase::fromCharacter(msa[j][position]);
                 if(base.isGap()) {
-                    coverage.addRead(base, orientedReadId.getStrand(), 0);
+                    addRead(base, orientedReadId.getStrand(), 0);
                 } else {
-                    coverage.addRead(
+                    addRead(
                         base,
                         orientedReadId.getStrand(),
                         interveningRepeatCounts[i][positions[i]]);
+                }
+            }
+        }
+    };
+
+    // Function to advance the positions of the marker intervals
+    // that have a base at an alignment position.
+    auto advancePositions = [&](size_t position)
+    {
+        for(size_t j=0; j<distinctSequenceTable.size(); j++) {
+            if(msa[j][position] != '-') {
+                for(const size_t i: distinctSequenceOccurrences[distinctSequenceTable[j].first]) {
                     ++positions[i];
                 }
             }
         }
+    };
+
+    // If detailed coverage data was not requested, fill in a CoverageTensor
+    // for all positions of the alignment and compute consensus
+    // for all of them with a single call to the consensus caller.
+    // A Coverage object is only used when detailed coverage data
+    // is requested, or at positions with a repeat count that is too long
+    // for the CoverageTensor.
+    CoverageTensor coverageTensor;
+    vector<Consensus> batchConsensus;
+    const bool useBatch = (coverageData == 0);
+    if(useBatch) {
+        coverageTensor.clear(alignmentLength);
+        for(size_t position=0; position<alignmentLength; position++) {
+            addReads(position,
+                [&](AlignedBase base, Strand strand, size_t repeatCount)
+                {
+                    coverageTensor.addRead(position, base, strand, repeatCount);
+                });
+            advancePositions(position);
+        }
+        (*consensusCaller)(coverageTensor, batchConsensus);
+        fill(positions.begin(), positions.end(), 0);
+    }
+
+    Coverage coverage;
+    for(size_t position=0; position<alignmentLength; position++) {
 
         // Compute the consensus at this position.
-        const Consensus consensus = (*consensusCaller)(coverage);
+        Consensus consensus;
+        if(useBatch && !coverageTensor.overflow(position)) {
+            consensus = batchConsensus[position];
+        } else {
+            coverage = Coverage();
+            addReads(position,
+                [&](AlignedBase base, Strand strand, size_t repeatCount)
+                {
+                    coverage.addRead(base, strand, repeatCount);
+                });
+            consensus = (*consensusCaller)(coverage);
+        }
+        advancePositions(position);
 
         // If not a gap, store the base and repeat count.
         if(!consensus.base.isGap()) {
@@ -3544,10 +4945,14 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingMarginPhase(
     // Check that MarginPhase was setup.
     checkMarginPhaseWasSetup();
 
+    // The work area used by this thread, reused for all edges.
+    static thread_local MarginPhaseWorkArea threadWorkArea;
+    MarginPhaseWorkArea& workArea = threadWorkArea;
+
     // Access the markerIntervals for this edge.
     // Each corresponds to an oriented read on this edge.
-    const MemoryAsContainer<MarkerInterval> markerIntervals =
-        markerGraph.edgeMarkerIntervals[edgeId];
+    vector<MarkerInterval>& markerIntervals = workArea.markerIntervals;
+    getMarkerGraphEdgeMarkerIntervals(edgeId, markerIntervals);
     const size_t markerCount = markerIntervals.size();
     CZI_ASSERT(markerCount > 0);
 
@@ -3661,14 +5066,16 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingMarginPhase(
 
 
 
-    // Gather all of the intervening sequences and repeatCounts, keeping track of distinct
-    // sequences. For each sequence we store a vector of i values
-    // where each sequence appear.
-    vector< vector<Base> > distinctSequences;
-    vector< vector<size_t> > distinctSequenceOccurrences;
-    vector<bool> isUsed(markerCount);
-    vector<Base> interveningSequence;
-    vector< vector<uint8_t> > interveningRepeatCounts(markerCount);
+    // Gather the intervening sequences and repeat counts
+    // of the marker intervals that are used.
+    vector<char>& bases = workArea.bases;
+    vector<uint8_t>& interveningRepeatCounts = workArea.repeatCounts;
+    vector<uint64_t>& begins = workArea.begins;
+    vector<uint64_t>& used = workArea.used;
+    bases.clear();
+    interveningRepeatCounts.clear();
+    begins.clear();
+    used.clear();
     for(size_t i=0; i!=markerCount; i++) {
         const MarkerInterval& markerInterval = markerIntervals[i];
         const OrientedReadId orientedReadId = markerInterval.orientedReadId;
@@ -3684,128 +5091,100 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingMarginPhase(
 
         // If the offset is too small, discard this marker interval.
         if(offset <= k) {
-            isUsed[i] = false;
             continue;
         }
-        isUsed[i] = true;
+        used.push_back(i);
 
-        // Construct the sequence and repeat counts between the markers.
+        // Append the sequence and repeat counts between the markers.
         const uint32_t begin = position0 + k;
         const uint32_t end = position1;
-        interveningSequence.clear();
+        begins.push_back(bases.size());
         for(uint32_t position=begin; position!=end; position++) {
             Base base;
             uint8_t repeatCount;
             tie(base, repeatCount) = getOrientedReadBaseAndRepeatCount(orientedReadId, position);
-            interveningSequence.push_back(getOrientedReadBase(orientedReadId, position));
-            interveningRepeatCounts[i].push_back(repeatCount);
-        }
-
-        // Store, making sure to check if we already encountered this sequence.
-        const auto it = find(distinctSequences.begin(), distinctSequences.end(), interveningSequence);
-        if(it == distinctSequences.end()) {
-            // We did not already encountered this sequence.
-            distinctSequences.push_back(interveningSequence);
-            distinctSequenceOccurrences.resize(distinctSequenceOccurrences.size() + 1);
-            distinctSequenceOccurrences.back().push_back(i);
-        } else {
-            // We already encountered this sequence,
-            distinctSequenceOccurrences[it - distinctSequences.begin()].push_back(i);
+            bases.push_back(base.character());
+            interveningRepeatCounts.push_back(repeatCount);
         }
+        bases.push_back(0);
+        interveningRepeatCounts.push_back(0);
     }
+    begins.push_back(bases.size());
+    const uint64_t usedCount = used.size();
 
 
 
-    // We want to enter the distinct sequences in order of decreasing frequency,
-    // so we create a table of distinct sequences.
-    // For each pair stored:
-    // first = index of the distinct sequence in distinctSequences, distinctSequenceOccurrences.
-    // second = frequency.
-    vector< pair<size_t, uint32_t> > distinctSequenceTable;
-    for(size_t j=0; j<distinctSequences.size(); j++) {
-        distinctSequenceTable.push_back(make_pair(j, distinctSequenceOccurrences[j].size()));
-    }
-    sort(distinctSequenceTable.begin(), distinctSequenceTable.end(),
-        OrderPairsBySecondOnlyGreater<size_t, uint32_t>());
-
-
-    // We are now ready to compute the MarginPhase alignment for the distinct sequences.
-
-    // Vectors to contain the input to callConsensus.
-    vector<string> marginPhaseSequences;
-    vector< vector<uint8_t> > marginPhaseRepeatCounts;
-    vector<uint8_t> marginPhaseStrands;
-
-
-    // Fill in the input vectors.
-    for(const auto& p: distinctSequenceTable) {
-    	const size_t j = p.first;
-        const vector<Base>& sequence = distinctSequences[j];
-        const vector<size_t>& occurrences = distinctSequenceOccurrences[j];
-        string sequenceString;
-        for(const Base b: sequence) {
-        	sequenceString.push_back(b.character());
-        }
-        for(const size_t i: occurrences) {
-            const MarkerInterval& markerInterval = markerIntervals[i];
-            const OrientedReadId orientedReadId = markerInterval.orientedReadId;
-        	marginPhaseSequences.push_back(sequenceString);
-        	marginPhaseRepeatCounts.push_back(interveningRepeatCounts[i]);
-        	marginPhaseStrands.push_back(uint8_t(orientedReadId.getStrand()));
-        }
-
-    }
-
-#if 0
+    // Results are dependent on the order in which the
+    // sequences are entered, and so we enter the sequences in order
+    // of decreasing frequency. Identical sequences are entered consecutively.
+    // To find the distinct sequences, sort the used marker intervals
+    // by sequence, keeping the original order for identical sequences.
+    vector<uint64_t>& order = workArea.order;
+    order.resize(usedCount);
+    for(uint64_t i=0; i<usedCount; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+        [&workArea](uint64_t i0, uint64_t i1)
+        {
+            return std::lexicographical_compare(
+                workArea.sequenceBegin(i0), workArea.sequenceEnd(i0),
+                workArea.sequenceBegin(i1), workArea.sequenceEnd(i1));
+        });
+
+    // Each group of identical sequences is stored as (begin, end) in order.
+    // Sort the groups by decreasing frequency, and for equal frequency
+    // by first occurrence, which is the first element of each group.
+    vector< pair<uint64_t, uint64_t> >& groups = workArea.groups;
+    groups.clear();
+    for(uint64_t groupBegin=0; groupBegin<usedCount; ) {
+        uint64_t groupEnd = groupBegin + 1;
+        while(groupEnd<usedCount && std::equal(
+            workArea.sequenceBegin(order[groupBegin]), workArea.sequenceEnd(order[groupBegin]),
+            workArea.sequenceBegin(order[groupEnd]), workArea.sequenceEnd(order[groupEnd]))) {
+            ++groupEnd;
+        }
+        groups.push_back(make_pair(groupBegin, groupEnd));
+        groupBegin = groupEnd;
+    }
+    sort(groups.begin(), groups.end(),
+        [&order](const pair<uint64_t, uint64_t>& x, const pair<uint64_t, uint64_t>& y)
+        {
+            const uint64_t xSize = x.second - x.first;
+            const uint64_t ySize = y.second - y.first;
+            if(xSize != ySize) {
+                return xSize > ySize;
+            }
+            return order[x.first] < order[y.first];
+        });
 
-    // Fill in the input vectors.
-    for(size_t i=0; i!=markerCount; i++) {
-        const MarkerInterval& markerInterval = markerIntervals[i];
-        const OrientedReadId orientedReadId = markerInterval.orientedReadId;
-        const auto orientedReadMarkers = markers[orientedReadId.getValue()];
 
-        // Get the two markers.
-        const CompressedMarker& marker0 = orientedReadMarkers[markerInterval.ordinals[0]];
-        const CompressedMarker& marker1 = orientedReadMarkers[markerInterval.ordinals[1]];
 
-        // Get the position range, including the flanking markers.
-        const uint32_t positionBegin = marker0.position;
-        const uint32_t positionEnd = marker1.position + uint32_t(assemblerInfo->k);
-        const uint32_t length = positionEnd - positionBegin;
-
-        // Fill in the sequence and repeat counts for this read the sequence.
-        string& s = readSequences[i];
-        vector<uint8_t>& r = readRepeatCounts[i];
-        s.resize(length);
-        r.resize(length);
-        size_t j = 0;
-        for(uint32_t position=positionBegin; position!=positionEnd; position++, j++) {
-            Base b;
-            uint8_t rr;
-            tie(b, rr) = getOrientedReadBaseAndRepeatCount(orientedReadId, position);
-            s[j] = b.character();
-            r[j] = rr;
+    // Create the input to callConsensus.
+    // The buffers are not modified from here on, so the pointers remain valid.
+    vector<char*>& marginPhaseSequencePointers = workArea.sequencePointers;
+    vector<uint8_t*>& marginPhaseRepeatCountPointers = workArea.repeatCountPointers;
+    vector<uint8_t>& marginPhaseStrands = workArea.strands;
+    marginPhaseSequencePointers.clear();
+    marginPhaseRepeatCountPointers.clear();
+    marginPhaseStrands.clear();
+    for(const auto& group: groups) {
+        for(uint64_t j=group.first; j!=group.second; j++) {
+            const uint64_t i = order[j];
+            const OrientedReadId orientedReadId = markerIntervals[used[i]].orientedReadId;
+            marginPhaseSequencePointers.push_back(bases.data() + begins[i]);
+            marginPhaseRepeatCountPointers.push_back(interveningRepeatCounts.data() + begins[i]);
+            marginPhaseStrands.push_back(uint8_t(orientedReadId.getStrand()));
         }
     }
-#endif
-
-
-    // Create vectors of pointers to be passed to callConsensus.
-    vector<char*> marginPhaseSequencePointers;
-    vector<uint8_t*> marginPhaseRepeatCountPointers;
-    CZI_ASSERT(marginPhaseSequences.size() == marginPhaseRepeatCounts.size());
-    CZI_ASSERT(marginPhaseSequences.size() == marginPhaseStrands.size());
-    for(size_t i=0; i<marginPhaseSequences.size(); i++) {
-    	marginPhaseSequencePointers.push_back(const_cast<char*>(marginPhaseSequences[i].data()));
-    	marginPhaseRepeatCountPointers.push_back(const_cast<uint8_t*>(marginPhaseRepeatCounts[i].data()));
-    }
+    CZI_ASSERT(marginPhaseSequencePointers.size() == usedCount);
 
     // Use marginPhase to compute consensus sequence
     // and repeat counts.
     RleString* consensusPointer = callConsensus(
-    	marginPhaseSequencePointers.size(),
-		marginPhaseSequencePointers.data(),
-		marginPhaseRepeatCountPointers.data(),
+        marginPhaseSequencePointers.size(),
+        marginPhaseSequencePointers.data(),
+        marginPhaseRepeatCountPointers.data(),
         marginPhaseStrands.data(),
         marginPhaseParameters);
     const RleString& consensus = *consensusPointer;
@@ -3838,12 +5217,23 @@ void Assembler::computeMarkerGraphEdgeConsensusSequenceUsingMarginPhase(
 // to generate alternative assembled sequence.
 void Assembler::simplifyMarkerGraph(
     const vector<size_t>& maxLengthVector, // One value for each iteration.
-    bool debug)
+    bool debug,
+    size_t threadCount)
 {
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
     // Clear the superbubble flag for all edges.
     for(MarkerGraph::Edge& edge: markerGraph.edges) {
         edge.isSuperBubbleEdge = 0;
     }
+    markerGraph.edgeFlagBitmaps.clearAll(MarkerGraphEdgeFlagBitmaps::isSuperBubbleEdge);
+
+    // Each step uses a temporary assembly graph, which is updated
+    // from the one used by the previous step. Start from scratch.
+    assemblyGraph.remove();
 
 
 
@@ -3852,12 +5242,29 @@ void Assembler::simplifyMarkerGraph(
         const size_t maxLength = maxLengthVector[iteration];
         cout << timestamp << "Begin simplifyMarkerGraph iteration " << iteration <<
             " with maxLength = " << maxLength << endl;
+        checkMarkerGraphStrandSymmetryForSimplify(debug);
+        simplifyMarkerGraphIterationPart1(iteration, maxLength, debug, threadCount);
+        checkMarkerGraphStrandSymmetryForSimplify(debug);
+        simplifyMarkerGraphIterationPart2(iteration, maxLength, debug, threadCount);
+    }
+    checkMarkerGraphStrandSymmetryForSimplify(debug);
+
+    // Remove the temporary assembly graph.
+    assemblyGraph.remove();
+}
+
+
+
+// Check strand symmetry between simplifyMarkerGraph steps.
+// In debug mode, do a full check.
+// Otherwise, only check the edges modified since the last check.
+void Assembler::checkMarkerGraphStrandSymmetryForSimplify(bool debug)
+{
+    if(debug) {
         checkMarkerGraphIsStrandSymmetric();
-        simplifyMarkerGraphIterationPart1(iteration, maxLength, debug);
-        checkMarkerGraphIsStrandSymmetric();
-        simplifyMarkerGraphIterationPart2(iteration, maxLength, debug);
+    } else {
+        checkMarkerGraphDirtyEdgesAreStrandSymmetric();
     }
-    checkMarkerGraphIsStrandSymmetric();
 }
 
 
@@ -3870,7 +5277,8 @@ void Assembler::simplifyMarkerGraph(
 void Assembler::simplifyMarkerGraphIterationPart1(
     size_t iteration,
     size_t maxLength,
-    bool debug)
+    bool debug,
+    size_t threadCount)
 {
     // Setup debug output for this iteration, if requested.
     ofstream debugOut;
@@ -3879,7 +5287,13 @@ void Assembler::simplifyMarkerGraphIterationPart1(
     }
 
     // Create a temporary assembly graph.
-    createAssemblyGraphEdges();
+    // After the first step, update the one left over by the previous step,
+    // reusing the chains that were not affected by that step.
+    if(assemblyGraph.edgeLists.isOpen()) {
+        updateAssemblyGraphEdges(threadCount);
+    } else {
+        createAssemblyGraphEdges(threadCount);
+    }
     createAssemblyGraphVertices();
     assemblyGraph.writeGraphviz("AssemblyGraph-simplifyMarkerGraphIterationPart1-" + to_string(iteration) + ".dot");
     cout << "Before iteration " << iteration << " part 1, the assembly graph has " <<
@@ -3889,59 +5303,15 @@ void Assembler::simplifyMarkerGraphIterationPart1(
 
 
     // Loop over vertices in the assembly graph.
-    vector<bool> keepAssemblyGraphEdge(assemblyGraph.edges.size(), true);
-    for(AssemblyGraph::VertexId v0=0; v0<assemblyGraph.vertices.size(); v0++) {
-
-        // Get edges that have this vertex as the source.
-        const MemoryAsContainer<AssemblyGraph::EdgeId> outEdges = assemblyGraph.edgesBySource[v0];
-
-        // If any of these edges have more than maxLength markers, do nothing.
-        bool longEdgeExists = false;
-        for(AssemblyGraph::EdgeId edgeId: outEdges) {
-            if(assemblyGraph.edgeLists.size(edgeId) > maxLength) {
-                longEdgeExists = true;
-                break;
-            }
-        }
-        if(longEdgeExists) {
-            continue;
-        }
-
-        // Gather the out edges, for each target.
-        // Map key = target vertex id
-        // Map value: pairs(edgeId, average coverage).
-        std::map<AssemblyGraph::VertexId, vector< pair<AssemblyGraph::EdgeId, uint32_t> > > edgeTable;
-        for(AssemblyGraph::EdgeId edgeId: outEdges) {
-            const AssemblyGraph::Edge& edge = assemblyGraph.edges[edgeId];
-            edgeTable[edge.target].push_back(make_pair(edgeId, edge.averageCoverage));
-        }
-
-        // For each set of parallel edges, only keep the shortest one.
-        for(auto& p: edgeTable) {
-        	const AssemblyGraph::VertexId v1 = p.first;
-        	if(v1 == assemblyGraph.reverseComplementVertex[v0]) {
-        		// v0 and v1 are reverse complement of each other: skip for now.
-        		continue;
-        	}
-            vector< pair<AssemblyGraph::EdgeId, uint32_t> >& v = p.second;
-            if(v.size() < 2) {
-                continue;
-            }
-            sort(v.begin(), v.end(), OrderPairsBySecondOnlyGreater<AssemblyGraph::EdgeId, uint32_t>());
-            for(auto it=v.begin()+1; it!=v.end(); ++it) {
-                keepAssemblyGraphEdge[it->first] = false;
-            }
-            if(debug) {
-                debugOut << "Parallel edges:\n";
-                for(const auto& p: v) {
-                    const AssemblyGraph::EdgeId edgeId = p.first;
-                    const uint32_t averageCoverage = p.second;
-                    debugOut << edgeId << " " << assemblyGraph.edgeLists.size(edgeId) <<
-                        " " << averageCoverage << "\n";
-                }
-            }
-        }
-    }
+    auto& data = simplifyMarkerGraphData;
+    data.maxLength = maxLength;
+    data.debug = debug;
+    data.debugOut = &debugOut;
+    data.keepAssemblyGraphEdge.clear();
+    data.keepAssemblyGraphEdge.resize(assemblyGraph.edges.size(), 1);
+    const vector<uint8_t>& keepAssemblyGraphEdge = data.keepAssemblyGraphEdge;
+    setupLoadBalancing(assemblyGraph.vertices.size(), 1000);
+    runThreads(&Assembler::simplifyMarkerGraphIterationPart1ThreadFunction, debug ? 1 : threadCount);
 
     // Mark as superbubble edges all marker graph edges that correspond
     // to assembly graph edges not marked to be kept.
@@ -3956,13 +5326,86 @@ void Assembler::simplifyMarkerGraphIterationPart1(
         for(const MarkerGraph::EdgeId markerGraphEdgeId: markerGraphEdges) {
         	markerGraph.edges[markerGraphEdgeId].isSuperBubbleEdge = 1;
             markerGraph.edges[markerGraph.reverseComplementEdge[markerGraphEdgeId]].isSuperBubbleEdge = 1;
+            markerGraph.edges[markerGraphEdgeId].isDirty = 1;
+            markerGraph.edges[markerGraph.reverseComplementEdge[markerGraphEdgeId]].isDirty = 1;
+            markerGraph.edgeFlagBitmaps.set(MarkerGraphEdgeFlagBitmaps::isSuperBubbleEdge, markerGraphEdgeId);
+            markerGraph.edgeFlagBitmaps.set(MarkerGraphEdgeFlagBitmaps::isSuperBubbleEdge,
+                markerGraph.reverseComplementEdge[markerGraphEdgeId]);
         }
     }
 
-    // Remove the assembly graph we created at this iteration.
-    assemblyGraph.remove();
+    // Keep the assembly graph. The next step will update it.
+}
+
+
+
+// Thread function for simplifyMarkerGraphIterationPart1.
+// Each assembly graph vertex only affects the keep flags
+// of its own out-edges, so vertices can be processed independently.
+void Assembler::simplifyMarkerGraphIterationPart1ThreadFunction(size_t threadId)
+{
+    auto& data = simplifyMarkerGraphData;
+    const size_t maxLength = data.maxLength;
+    const bool debug = data.debug;
+    ostream& debugOut = *data.debugOut;
+    auto& keepAssemblyGraphEdge = data.keepAssemblyGraphEdge;
+
+    // Loop over batches of assembly graph vertices assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(AssemblyGraph::VertexId v0=begin; v0!=end; v0++) {
+
+            // Get edges that have this vertex as the source.
+            const MemoryAsContainer<AssemblyGraph::EdgeId> outEdges = assemblyGraph.edgesBySource[v0];
+
+            // If any of these edges have more than maxLength markers, do nothing.
+            bool longEdgeExists = false;
+            for(AssemblyGraph::EdgeId edgeId: outEdges) {
+                if(assemblyGraph.edgeLists.size(edgeId) > maxLength) {
+                    longEdgeExists = true;
+                    break;
+                }
+            }
+            if(longEdgeExists) {
+                continue;
+            }
 
+            // Gather the out edges, for each target.
+            // Map key = target vertex id
+            // Map value: pairs(edgeId, average coverage).
+            std::map<AssemblyGraph::VertexId, vector< pair<AssemblyGraph::EdgeId, uint32_t> > > edgeTable;
+            for(AssemblyGraph::EdgeId edgeId: outEdges) {
+                const AssemblyGraph::Edge& edge = assemblyGraph.edges[edgeId];
+                edgeTable[edge.target].push_back(make_pair(edgeId, edge.averageCoverage));
+            }
 
+            // For each set of parallel edges, only keep the shortest one.
+            for(auto& p: edgeTable) {
+            	const AssemblyGraph::VertexId v1 = p.first;
+            	if(v1 == assemblyGraph.reverseComplementVertex[v0]) {
+            		// v0 and v1 are reverse complement of each other: skip for now.
+            		continue;
+            	}
+                vector< pair<AssemblyGraph::EdgeId, uint32_t> >& v = p.second;
+                if(v.size() < 2) {
+                    continue;
+                }
+                sort(v.begin(), v.end(), OrderPairsBySecondOnlyGreater<AssemblyGraph::EdgeId, uint32_t>());
+                for(auto it=v.begin()+1; it!=v.end(); ++it) {
+                    keepAssemblyGraphEdge[it->first] = false;
+                }
+                if(debug) {
+                    debugOut << "Parallel edges:\n";
+                    for(const auto& p: v) {
+                        const AssemblyGraph::EdgeId edgeId = p.first;
+                        const uint32_t averageCoverage = p.second;
+                        debugOut << edgeId << " " << assemblyGraph.edgeLists.size(edgeId) <<
+                            " " << averageCoverage << "\n";
+                    }
+                }
+            }
+        }
+    }
 }
 
 
@@ -3971,7 +5414,8 @@ void Assembler::simplifyMarkerGraphIterationPart1(
 void Assembler::simplifyMarkerGraphIterationPart2(
     size_t iteration,
     size_t maxLength,
-    bool debug)
+    bool debug,
+    size_t threadCount)
 {
     // Setup debug output for this iteration, if requested.
     ofstream debugOut;
@@ -3980,7 +5424,13 @@ void Assembler::simplifyMarkerGraphIterationPart2(
     }
 
     // Create a temporary assembly graph.
-    createAssemblyGraphEdges();
+    // After the first step, update the one left over by the previous step,
+    // reusing the chains that were not affected by that step.
+    if(assemblyGraph.edgeLists.isOpen()) {
+        updateAssemblyGraphEdges(threadCount);
+    } else {
+        createAssemblyGraphEdges(threadCount);
+    }
     createAssemblyGraphVertices();
     assemblyGraph.writeGraphviz("AssemblyGraph-simplifyMarkerGraphIterationPart2-" + to_string(iteration) + ".dot");
     cout << "Before iteration " << iteration << " part 2, the assembly graph has " <<
@@ -4008,24 +5458,41 @@ void Assembler::simplifyMarkerGraphIterationPart2(
         disjointSets.union_set(edge.source, edge.target);
     }
 
+    // Store the component of each vertex.
+    // The code below, including the multithreaded part, uses this
+    // instead of calling find_set, which modifies the disjoint sets.
+    auto& data = simplifyMarkerGraphData;
+    data.maxLength = maxLength;
+    data.debug = debug;
+    data.debugOut = &debugOut;
+    vector<AssemblyGraph::VertexId>& vertexComponent = data.vertexComponent;
+    vertexComponent.resize(n);
+    for(AssemblyGraph::VertexId vertexId=0; vertexId<n; vertexId++) {
+        vertexComponent[vertexId] = disjointSets.find_set(vertexId);
+    }
+
 
 
     // Mark as to be kept all edges in between components.
-    vector<bool> keepAssemblyGraphEdge(assemblyGraph.edges.size(), false);
+    vector<uint8_t>& keepAssemblyGraphEdge = data.keepAssemblyGraphEdge;
+    keepAssemblyGraphEdge.clear();
+    keepAssemblyGraphEdge.resize(assemblyGraph.edges.size(), 0);
     for(AssemblyGraph::EdgeId edgeId=0; edgeId<assemblyGraph.edges.size(); edgeId++) {
         const AssemblyGraph::Edge& edge = assemblyGraph.edges[edgeId];
         const AssemblyGraph::VertexId v0 = edge.source;
         const AssemblyGraph::VertexId v1 = edge.target;
-        if(disjointSets.find_set(v0) != disjointSets.find_set(v1)) {
+        if(vertexComponent[v0] != vertexComponent[v1]) {
             keepAssemblyGraphEdge[edgeId] = true;
         }
     }
 
 
     // Gather the vertices in each connected component.
-    vector< vector<AssemblyGraph::VertexId> > componentTable(n);
+    vector< vector<AssemblyGraph::VertexId> >& componentTable = data.componentTable;
+    componentTable.clear();
+    componentTable.resize(n);
     for(AssemblyGraph::VertexId vertexId=0; vertexId<n; vertexId++) {
-        componentTable[disjointSets.find_set(vertexId)].push_back(vertexId);
+        componentTable[vertexComponent[vertexId]].push_back(vertexId);
     }
 
 
@@ -4034,7 +5501,8 @@ void Assembler::simplifyMarkerGraphIterationPart2(
     // most components come in reverse complemented pairs,
     // and some are self-complementary.
     // Find the pairs.
-    vector< AssemblyGraph::VertexId > rcComponentTable(n);
+    vector<AssemblyGraph::VertexId>& rcComponentTable = data.rcComponentTable;
+    rcComponentTable.resize(n);
     for(AssemblyGraph::VertexId componentId=0; componentId<n; componentId++) {
 
         // Get the assembly graph vertices in this connected component
@@ -4047,7 +5515,7 @@ void Assembler::simplifyMarkerGraphIterationPart2(
         // Find the reverse complement of the first vertex.
         const AssemblyGraph::VertexId v = component.front();
         const AssemblyGraph::VertexId vRc = assemblyGraph.reverseComplementVertex[v];
-        const AssemblyGraph::VertexId componentRcId = disjointSets.find_set(vRc);
+        const AssemblyGraph::VertexId componentRcId = vertexComponent[vRc];
 
         rcComponentTable[componentId] = componentRcId;
     }
@@ -4068,8 +5536,8 @@ void Assembler::simplifyMarkerGraphIterationPart2(
     // More sanity checks.
     for(AssemblyGraph::VertexId v0=0; v0<n; v0++) {
     	const AssemblyGraph::VertexId v1 = assemblyGraph.reverseComplementVertex[v0];
-    	const AssemblyGraph::VertexId c0 = disjointSets.find_set(v0);
-    	const AssemblyGraph::VertexId c1 = disjointSets.find_set(v1);
+    	const AssemblyGraph::VertexId c0 = vertexComponent[v0];
+    	const AssemblyGraph::VertexId c1 = vertexComponent[v1];
     	CZI_ASSERT(rcComponentTable[c0] == c1);
     	CZI_ASSERT(rcComponentTable[c1] == c0);
     }
@@ -4080,15 +5548,17 @@ void Assembler::simplifyMarkerGraphIterationPart2(
     // Find entries and exits.
     // An entry is a vertex with an in-edge from another component.
     // An exit is a vertex with an out-edge to another component.
-    vector<bool> isEntry(n, false);
-    vector<bool> isExit(n, false);
+    vector<bool>& isEntry = data.isEntry;
+    vector<bool>& isExit = data.isExit;
+    isEntry.assign(n, false);
+    isExit.assign(n, false);
     for(AssemblyGraph::VertexId v0=0; v0<n; v0++) {
-        const AssemblyGraph::VertexId componentId0 = disjointSets.find_set(v0);
+        const AssemblyGraph::VertexId componentId0 = vertexComponent[v0];
         const MemoryAsContainer<AssemblyGraph::EdgeId> inEdges = assemblyGraph.edgesByTarget[v0];
         for(AssemblyGraph::EdgeId edgeId : inEdges) {
             const AssemblyGraph::Edge& edge = assemblyGraph.edges[edgeId];
             CZI_ASSERT(edge.target == v0);
-            const AssemblyGraph::VertexId componentId1 = disjointSets.find_set(edge.source);
+            const AssemblyGraph::VertexId componentId1 = vertexComponent[edge.source];
             if(componentId1 != componentId0) {
                 isEntry[v0] = true;
                 break;
@@ -4098,7 +5568,7 @@ void Assembler::simplifyMarkerGraphIterationPart2(
         for(AssemblyGraph::EdgeId edgeId : outEdges) {
             const AssemblyGraph::Edge& edge = assemblyGraph.edges[edgeId];
             CZI_ASSERT(edge.source == v0);
-            const AssemblyGraph::VertexId componentId1 = disjointSets.find_set(edge.target);
+            const AssemblyGraph::VertexId componentId1 = vertexComponent[edge.target];
             if(componentId1 != componentId0) {
                 isExit[v0] = true;
                 break;
@@ -4107,255 +5577,295 @@ void Assembler::simplifyMarkerGraphIterationPart2(
     }
 
 
-    // Work areas used below.
-    // Allocate them here to reduce memory allocation activity.
-    vector<AssemblyGraph::EdgeId> predecessorEdge(n);
-    vector<uint8_t> color(n);
+    // Process the connected components in parallel.
+    // Each component only affects the keep flags of its internal edges
+    // and of their reverse complements, which are internal to the
+    // reverse complemented component, and only one component
+    // of each reverse complemented pair is processed.
+    // As a result, the components can be processed independently
+    // and the result does not depend on the number of threads.
+    // The work areas are indexed by vertex and only accessed for
+    // the vertices of the component being processed,
+    // so they can be shared by all threads.
+    data.predecessorEdge.resize(n);
+    data.color.resize(n);
+    setupLoadBalancing(n, 100);
+    runThreads(&Assembler::simplifyMarkerGraphIterationPart2ThreadFunction, debug ? 1 : threadCount);
 
 
-    // Process one connected component at a time.
-    for(AssemblyGraph::VertexId componentId=0; componentId<n; componentId++) {
 
-        // Get the assembly graph vertices in this connected component
-        // and skip it if it is empty.
-        const vector<AssemblyGraph::VertexId>& component = componentTable[componentId];
-        if(component.empty()) {
+    // Mark as superbubble edges all marker graph edges that correspond
+    // to assembly graph edges not marked to be kept.
+    for(AssemblyGraph::EdgeId assemblyGraphEdgeId=0; assemblyGraphEdgeId<assemblyGraph.edges.size(); assemblyGraphEdgeId++) {
+        if(keepAssemblyGraphEdge[assemblyGraphEdgeId]) {
             continue;
         }
 
-        if(debug) {
-            debugOut << "\nProcessing connected component with " << component.size() <<
-                " assembly/marker graph vertices:" << "\n";
-            for(const AssemblyGraph::VertexId assemblyGraphVertexId: component) {
-                const MarkerGraph::VertexId markerGraphVertexId = assemblyGraph.vertices[assemblyGraphVertexId];
-                debugOut << assemblyGraphVertexId << "/" << markerGraphVertexId;
-                if(isEntry[assemblyGraphVertexId]) {
-                    debugOut << " entry";
-                }
-                if(isExit[assemblyGraphVertexId]) {
-                    debugOut << " exit";
-                }
-                debugOut << "\n";
-            }
+        const MemoryAsContainer<MarkerGraph::EdgeId> markerGraphEdges = assemblyGraph.edgeLists[assemblyGraphEdgeId];
+        for(const MarkerGraph::EdgeId markerGraphEdgeId: markerGraphEdges) {
+            markerGraph.edges[markerGraphEdgeId].isSuperBubbleEdge = 1;
+            markerGraph.edges[markerGraphEdgeId].isDirty = 1;
+            markerGraph.edgeFlagBitmaps.set(MarkerGraphEdgeFlagBitmaps::isSuperBubbleEdge, markerGraphEdgeId);
         }
+    }
 
+    // Clean up.
+    data.vertexComponent.clear();
+    data.componentTable.clear();
+    data.rcComponentTable.clear();
+    data.isEntry.clear();
+    data.isExit.clear();
+    data.predecessorEdge.clear();
+    data.color.clear();
+
+    // Keep the assembly graph. The next step will update it.
+}
 
 
-        // If this component is self-complementary, it requires special handling.
-        // Skip for now.
-        if(rcComponentTable[componentId] == componentId) {
-        	cout << "Skipped a self-complementary component with " <<
-        		component.size() << " vertices." << endl;
-            for(const AssemblyGraph::VertexId v0: component) {
-                const AssemblyGraph::VertexId componentId0 = disjointSets.find_set(v0);
-                const MemoryAsContainer<AssemblyGraph::EdgeId> outEdges = assemblyGraph.edgesBySource[v0];
-                for(AssemblyGraph::EdgeId edgeId : outEdges) {
-                    const AssemblyGraph::Edge& edge = assemblyGraph.edges[edgeId];
-                    CZI_ASSERT(edge.source == v0);
-                    const AssemblyGraph::VertexId componentId1 = disjointSets.find_set(edge.target);
-                    if(componentId1 == componentId0) {
-                        keepAssemblyGraphEdge[edgeId] = true;
-                    }
-                }
-            }
-            continue;
-        }
-
-        // This componet is not self complementary.
-        // We want ro handle each pair of components in the same way.
-        // Only process one of the two in each pair.
-        if(rcComponentTable[componentId] < componentId) {
-        	continue;
-        }
-
 
+// Thread function for simplifyMarkerGraphIterationPart2.
+// Processes a batch of connected components.
+void Assembler::simplifyMarkerGraphIterationPart2ThreadFunction(size_t threadId)
+{
+    auto& data = simplifyMarkerGraphData;
+    const bool debug = data.debug;
+    ostream& debugOut = *data.debugOut;
+    const vector<AssemblyGraph::VertexId>& vertexComponent = data.vertexComponent;
+    const vector< vector<AssemblyGraph::VertexId> >& componentTable = data.componentTable;
+    const vector<AssemblyGraph::VertexId>& rcComponentTable = data.rcComponentTable;
+    const vector<bool>& isEntry = data.isEntry;
+    const vector<bool>& isExit = data.isExit;
+    vector<uint8_t>& keepAssemblyGraphEdge = data.keepAssemblyGraphEdge;
+    vector<AssemblyGraph::EdgeId>& predecessorEdge = data.predecessorEdge;
+    vector<uint8_t>& color = data.color;
+
+    // Loop over batches of connected components assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(AssemblyGraph::VertexId componentId=begin; componentId!=end; componentId++) {
 
-        // Find out if this component has any entries/exits.
-        bool entriesExist = false;
-        for(const AssemblyGraph::VertexId assemblyGraphVertexId: component) {
-            if(isEntry[assemblyGraphVertexId]) {
-                entriesExist = true;
-                break;
+            // Get the assembly graph vertices in this connected component
+            // and skip it if it is empty.
+            const vector<AssemblyGraph::VertexId>& component = componentTable[componentId];
+            if(component.empty()) {
+                continue;
             }
-        }
-        bool exitsExist = false;
-        for(const AssemblyGraph::VertexId assemblyGraphVertexId: component) {
-            if(isExit[assemblyGraphVertexId]) {
-                exitsExist = true;
-                break;
+
+            if(debug) {
+                debugOut << "\nProcessing connected component with " << component.size() <<
+                    " assembly/marker graph vertices:" << "\n";
+                for(const AssemblyGraph::VertexId assemblyGraphVertexId: component) {
+                    const MarkerGraph::VertexId markerGraphVertexId = assemblyGraph.vertices[assemblyGraphVertexId];
+                    debugOut << assemblyGraphVertexId << "/" << markerGraphVertexId;
+                    if(isEntry[assemblyGraphVertexId]) {
+                        debugOut << " entry";
+                    }
+                    if(isExit[assemblyGraphVertexId]) {
+                        debugOut << " exit";
+                    }
+                    debugOut << "\n";
+                }
             }
-        }
 
 
 
-        // Handle the case where there are no entries or no exits.
-        // This means that this component is actually an entire connected component
-        // of the full assembly graph (counting all edges).
-        if(!(entriesExist && exitsExist)) {
-            if(debug) {
-                debugOut << "Component skipped because it has no entries or no exits.\n";
-                debugOut << "Due to this, the following edges will be kept:\n";
-            }
-            for(const AssemblyGraph::VertexId v0: component) {
-                const AssemblyGraph::VertexId componentId0 = disjointSets.find_set(v0);
-                const MemoryAsContainer<AssemblyGraph::EdgeId> outEdges = assemblyGraph.edgesBySource[v0];
-                for(AssemblyGraph::EdgeId edgeId : outEdges) {
-                    const AssemblyGraph::Edge& edge = assemblyGraph.edges[edgeId];
-                    CZI_ASSERT(edge.source == v0);
-                    const AssemblyGraph::VertexId componentId1 = disjointSets.find_set(edge.target);
-                    if(componentId1 == componentId0) {
-                        keepAssemblyGraphEdge[edgeId] = true;
-                        keepAssemblyGraphEdge[assemblyGraph.reverseComplementEdge[edgeId]] = true;
-                        if(debug) {
-                            debugOut << edgeId << "\n";
+            // If this component is self-complementary, it requires special handling.
+            // Skip for now.
+            if(rcComponentTable[componentId] == componentId) {
+            	cout << "Skipped a self-complementary component with " <<
+            		component.size() << " vertices." << endl;
+                for(const AssemblyGraph::VertexId v0: component) {
+                    const AssemblyGraph::VertexId componentId0 = vertexComponent[v0];
+                    const MemoryAsContainer<AssemblyGraph::EdgeId> outEdges = assemblyGraph.edgesBySource[v0];
+                    for(AssemblyGraph::EdgeId edgeId : outEdges) {
+                        const AssemblyGraph::Edge& edge = assemblyGraph.edges[edgeId];
+                        CZI_ASSERT(edge.source == v0);
+                        const AssemblyGraph::VertexId componentId1 = vertexComponent[edge.target];
+                        if(componentId1 == componentId0) {
+                            keepAssemblyGraphEdge[edgeId] = true;
                         }
                     }
                 }
+                continue;
             }
-            continue;
-        }
 
-
-        // Work areas used for shortest path computation.
-        std::priority_queue<
-            pair<float, AssemblyGraph::VertexId>,
-            vector<pair<float, AssemblyGraph::VertexId> >,
-            OrderPairsByFirstOnlyGreater<size_t, AssemblyGraph::VertexId> > q;
-        vector< pair<float, AssemblyGraph::EdgeId> > sortedOutEdges;
+            // This componet is not self complementary.
+            // We want ro handle each pair of components in the same way.
+            // Only process one of the two in each pair.
+            if(rcComponentTable[componentId] < componentId) {
+            	continue;
+            }
 
 
 
-        // Loop over entry/exit pairs.
-        // We already checked that there is at least one entry
-        // and one exit, so the inner body of this loop
-        // gets executed at least once.
-        for(const AssemblyGraph::VertexId entryId: component) {
-            if(!isEntry[entryId]) {
-                continue;
+            // Find out if this component has any entries/exits.
+            bool entriesExist = false;
+            for(const AssemblyGraph::VertexId assemblyGraphVertexId: component) {
+                if(isEntry[assemblyGraphVertexId]) {
+                    entriesExist = true;
+                    break;
+                }
+            }
+            bool exitsExist = false;
+            for(const AssemblyGraph::VertexId assemblyGraphVertexId: component) {
+                if(isExit[assemblyGraphVertexId]) {
+                    exitsExist = true;
+                    break;
+                }
             }
 
 
 
-            // Compute shortest paths
-            // from this vertex to all other vertices in this component.
-            // Use as edge weight the inverse of average coverage,
-            // so the path prefers high coverage.
-            if(debug) {
-                debugOut << "Computing shortest paths starting at " <<
-                    entryId << "/" << assemblyGraph.vertices[entryId] << "\n";
-            }
-            CZI_ASSERT(q.empty());
-            q.push(make_pair(0., entryId));
-            for(const AssemblyGraph::VertexId v: component) {
-                color[v] = 0;
-                predecessorEdge[v] = AssemblyGraph::invalidEdgeId;
-            }
-            color[entryId] = 1;
-            const AssemblyGraph::VertexId entryComponentId = disjointSets.find_set(entryId);
-            while(!q.empty()) {
-
-                // Dequeue.
-                const pair<float, AssemblyGraph::VertexId> p = q.top();
-                const float distance0 = p.first;
-                const AssemblyGraph::VertexId v0 = p.second;
-                q.pop();
+            // Handle the case where there are no entries or no exits.
+            // This means that this component is actually an entire connected component
+            // of the full assembly graph (counting all edges).
+            if(!(entriesExist && exitsExist)) {
                 if(debug) {
-                    debugOut << "Dequeued " << v0 << "/" << assemblyGraph.vertices[v0] <<
-                        " at distance " << distance0 << "\n";
-                }
-                CZI_ASSERT(color[v0] == 1);
-
-                // Find the out edges and sort them.
-                const MemoryAsContainer<AssemblyGraph::EdgeId> outEdges = assemblyGraph.edgesBySource[v0];
-                sortedOutEdges.clear();
-                for(const AssemblyGraph::EdgeId e01: outEdges) {
-                    sortedOutEdges.push_back(make_pair(1./assemblyGraph.edges[e01].averageCoverage, e01));
+                    debugOut << "Component skipped because it has no entries or no exits.\n";
+                    debugOut << "Due to this, the following edges will be kept:\n";
                 }
-                sort(sortedOutEdges.begin(), sortedOutEdges.end(),
-                    OrderPairsByFirstOnly<double, AssemblyGraph::EdgeId>());
-
-                // Loop over out-edges internal to this component.
-                for(const pair<float, AssemblyGraph::EdgeId>& edgePair: sortedOutEdges) {
-                    const AssemblyGraph::EdgeId e01 = edgePair.second;
-                    const float length01 = edgePair.first;
-                    const AssemblyGraph::VertexId v1 = assemblyGraph.edges[e01].target;
-                    if(disjointSets.find_set(v1) != entryComponentId) {
-                        continue;
-                    }
-                    if(color[v1] == 1) {
-                        continue;
-                    }
-                    color[v1] = 1;
-                    predecessorEdge[v1] = e01;
-                    const float distance1 = distance0 + length01;
-                    q.push(make_pair(distance1, v1));
-                    if(debug) {
-                        debugOut << "Enqueued " << v1 << "/" << assemblyGraph.vertices[v1] <<
-                            " at distance " << distance1 << "\n";
+                for(const AssemblyGraph::VertexId v0: component) {
+                    const AssemblyGraph::VertexId componentId0 = vertexComponent[v0];
+                    const MemoryAsContainer<AssemblyGraph::EdgeId> outEdges = assemblyGraph.edgesBySource[v0];
+                    for(AssemblyGraph::EdgeId edgeId : outEdges) {
+                        const AssemblyGraph::Edge& edge = assemblyGraph.edges[edgeId];
+                        CZI_ASSERT(edge.source == v0);
+                        const AssemblyGraph::VertexId componentId1 = vertexComponent[edge.target];
+                        if(componentId1 == componentId0) {
+                            keepAssemblyGraphEdge[edgeId] = true;
+                            keepAssemblyGraphEdge[assemblyGraph.reverseComplementEdge[edgeId]] = true;
+                            if(debug) {
+                                debugOut << edgeId << "\n";
+                            }
+                        }
                     }
                 }
+                continue;
             }
 
 
+            // Work areas used for shortest path computation.
+            std::priority_queue<
+                pair<float, AssemblyGraph::VertexId>,
+                vector<pair<float, AssemblyGraph::VertexId> >,
+                OrderPairsByFirstOnlyGreater<size_t, AssemblyGraph::VertexId> > q;
+            vector< pair<float, AssemblyGraph::EdgeId> > sortedOutEdges;
+
+
 
-            for(const AssemblyGraph::VertexId exitId: component) {
-                if(!isExit[exitId]) {
+            // Loop over entry/exit pairs.
+            // We already checked that there is at least one entry
+            // and one exit, so the inner body of this loop
+            // gets executed at least once.
+            for(const AssemblyGraph::VertexId entryId: component) {
+                if(!isEntry[entryId]) {
                     continue;
                 }
-                if(exitId == entryId) {
-                    continue;
-                }
-                if(predecessorEdge[exitId] == AssemblyGraph::invalidEdgeId) {
-                    continue;   // This exit is not reachable from this entry.
-                }
 
+
+
+                // Compute shortest paths
+                // from this vertex to all other vertices in this component.
+                // Use as edge weight the inverse of average coverage,
+                // so the path prefers high coverage.
                 if(debug) {
-                    debugOut << "The following assembly graph edges will be kept because they are "
-                        "on the shortest path between entry " << entryId << "/" <<
-                        assemblyGraph.vertices[entryId] <<
-                        " and exit " << exitId << "/" << assemblyGraph.vertices[exitId] << "\n";
+                    debugOut << "Computing shortest paths starting at " <<
+                        entryId << "/" << assemblyGraph.vertices[entryId] << "\n";
                 }
-
-                AssemblyGraph::VertexId v = exitId;
-                while(true) {
-                    AssemblyGraph::EdgeId e = predecessorEdge[v];
-                    keepAssemblyGraphEdge[e] = true;
-                    // Also keep the reverse complement. This keeps the assembly and marker graph symmetric.
-                    keepAssemblyGraphEdge[assemblyGraph.reverseComplementEdge[e]] = true;
+                CZI_ASSERT(q.empty());
+                q.push(make_pair(0., entryId));
+                for(const AssemblyGraph::VertexId v: component) {
+                    color[v] = 0;
+                    predecessorEdge[v] = AssemblyGraph::invalidEdgeId;
+                }
+                color[entryId] = 1;
+                const AssemblyGraph::VertexId entryComponentId = vertexComponent[entryId];
+                while(!q.empty()) {
+
+                    // Dequeue.
+                    const pair<float, AssemblyGraph::VertexId> p = q.top();
+                    const float distance0 = p.first;
+                    const AssemblyGraph::VertexId v0 = p.second;
+                    q.pop();
                     if(debug) {
-                        debugOut << e << endl;
+                        debugOut << "Dequeued " << v0 << "/" << assemblyGraph.vertices[v0] <<
+                            " at distance " << distance0 << "\n";
                     }
-                    CZI_ASSERT(e != AssemblyGraph::invalidEdgeId);
-                    v = assemblyGraph.edges[e].source;
-                    if(v == entryId) {
-                        break;
+                    CZI_ASSERT(color[v0] == 1);
+
+                    // Find the out edges and sort them.
+                    const MemoryAsContainer<AssemblyGraph::EdgeId> outEdges = assemblyGraph.edgesBySource[v0];
+                    sortedOutEdges.clear();
+                    for(const AssemblyGraph::EdgeId e01: outEdges) {
+                        sortedOutEdges.push_back(make_pair(1./assemblyGraph.edges[e01].averageCoverage, e01));
+                    }
+                    sort(sortedOutEdges.begin(), sortedOutEdges.end(),
+                        OrderPairsByFirstOnly<double, AssemblyGraph::EdgeId>());
+
+                    // Loop over out-edges internal to this component.
+                    for(const pair<float, AssemblyGraph::EdgeId>& edgePair: sortedOutEdges) {
+                        const AssemblyGraph::EdgeId e01 = edgePair.second;
+                        const float length01 = edgePair.first;
+                        const AssemblyGraph::VertexId v1 = assemblyGraph.edges[e01].target;
+                        if(vertexComponent[v1] != entryComponentId) {
+                            continue;
+                        }
+                        if(color[v1] == 1) {
+                            continue;
+                        }
+                        color[v1] = 1;
+                        predecessorEdge[v1] = e01;
+                        const float distance1 = distance0 + length01;
+                        q.push(make_pair(distance1, v1));
+                        if(debug) {
+                            debugOut << "Enqueued " << v1 << "/" << assemblyGraph.vertices[v1] <<
+                                " at distance " << distance1 << "\n";
+                        }
                     }
                 }
-                if(debug) {
-                    debugOut << "\n";
-                }
-            }
-        }
-    }
 
 
 
-    // Mark as superbubble edges all marker graph edges that correspond
-    // to assembly graph edges not marked to be kept.
-    for(AssemblyGraph::EdgeId assemblyGraphEdgeId=0; assemblyGraphEdgeId<assemblyGraph.edges.size(); assemblyGraphEdgeId++) {
-        if(keepAssemblyGraphEdge[assemblyGraphEdgeId]) {
-            continue;
-        }
+                for(const AssemblyGraph::VertexId exitId: component) {
+                    if(!isExit[exitId]) {
+                        continue;
+                    }
+                    if(exitId == entryId) {
+                        continue;
+                    }
+                    if(predecessorEdge[exitId] == AssemblyGraph::invalidEdgeId) {
+                        continue;   // This exit is not reachable from this entry.
+                    }
 
-        const MemoryAsContainer<MarkerGraph::EdgeId> markerGraphEdges = assemblyGraph.edgeLists[assemblyGraphEdgeId];
-        for(const MarkerGraph::EdgeId markerGraphEdgeId: markerGraphEdges) {
-            markerGraph.edges[markerGraphEdgeId].isSuperBubbleEdge = 1;
+                    if(debug) {
+                        debugOut << "The following assembly graph edges will be kept because they are "
+                            "on the shortest path between entry " << entryId << "/" <<
+                            assemblyGraph.vertices[entryId] <<
+                            " and exit " << exitId << "/" << assemblyGraph.vertices[exitId] << "\n";
+                    }
+
+                    AssemblyGraph::VertexId v = exitId;
+                    while(true) {
+                        AssemblyGraph::EdgeId e = predecessorEdge[v];
+                        keepAssemblyGraphEdge[e] = true;
+                        // Also keep the reverse complement. This keeps the assembly and marker graph symmetric.
+                        keepAssemblyGraphEdge[assemblyGraph.reverseComplementEdge[e]] = true;
+                        if(debug) {
+                            debugOut << e << endl;
+                        }
+                        CZI_ASSERT(e != AssemblyGraph::invalidEdgeId);
+                        v = assemblyGraph.edges[e].source;
+                        if(v == entryId) {
+                            break;
+                        }
+                    }
+                    if(debug) {
+                        debugOut << "\n";
+                    }
+                }
+            }
         }
     }
-
-    // Remove the assembly graph we created at this iteration.
-    assemblyGraph.remove();
-
 }
 
 
@@ -4395,9 +5905,9 @@ void Assembler::assembleMarkerGraphVertices(size_t threadCount)
 
 void Assembler::assembleMarkerGraphVerticesThreadFunction(size_t threadId)
 {
-    vector<Base> sequence;
-    vector<uint32_t> repeatCounts;
-    const size_t k = assemblerInfo->k;
+    vector<uint8_t> repeatCountMatrix;
+    CoverageTensor coverageTensor;
+    vector<Consensus> consensus;
 
     // Loop over batches assigned to this thread.
     uint64_t begin, end;
@@ -4405,15 +5915,94 @@ void Assembler::assembleMarkerGraphVerticesThreadFunction(size_t threadId)
 
         // Loop over marker graph vertices assigned to this batch.
         for(MarkerGraph::VertexId vertexId=begin; vertexId!=end; vertexId++) {
+            assembleMarkerGraphVertex(vertexId, repeatCountMatrix, coverageTensor, consensus);
+        }
+    }
+}
+
+
+
+// Compute consensus repeat counts for a vertex of the marker graph
+// and store them directly in markerGraph.vertexRepeatCounts.
+// All markers of the vertex have the same k-mer, so
+// the sequence of the vertex is the sequence of any of its markers
+// and only the repeat counts vary.
+// We gather the repeat counts of all markers in a dense
+// markerCount*k matrix, accumulate them in a CoverageTensor
+// with one column for each position of the marker, and
+// compute consensus for all positions with a single call
+// to the consensus caller.
+// This gives the same results as computeMarkerGraphVertexConsensusSequence.
+void Assembler::assembleMarkerGraphVertex(
+    MarkerGraph::VertexId vertexId,
+    vector<uint8_t>& repeatCountMatrix,
+    CoverageTensor& coverageTensor,
+    vector<Consensus>& consensus)
+{
+    const uint32_t k = uint32_t(assemblerInfo->k);
+
+    // Access the markers of this vertex.
+    const MemoryAsContainer<MarkerId> markerIds = markerGraph.vertices[vertexId];
+    const size_t markerCount = markerIds.size();
+    CZI_ASSERT(markerCount > 0);
+    const KmerId kmerId = markers.begin()[markerIds[0]].kmerId;
+
+    // Gather the repeat counts of all markers, one row of k for each marker,
+    // and add them to the CoverageTensor.
+    repeatCountMatrix.resize(markerCount * k);
+    coverageTensor.clear(k);
+    AlignedBase bases[256];
+    CZI_ASSERT(k <= 256);
+    for(size_t i=0; i<markerCount; i++) {
+        const MarkerId markerId = markerIds[i];
+        const CompressedMarker& marker = markers.begin()[markerId];
+        CZI_ASSERT(marker.kmerId == kmerId);
+        const OrientedReadId orientedReadId = findMarkerId(markerId).first;
+        const ReadId readId = orientedReadId.getReadId();
+        const Strand strand = orientedReadId.getStrand();
+        const uint32_t markerPosition = marker.position;
+
+        // Get the bases from the first marker.
+        if(i == 0) {
+            for(uint32_t position=0; position<k; position++) {
+                bases[position] = AlignedBase(getOrientedReadBase(orientedReadId, markerPosition + position));
+            }
+        }
+
+        // Get the repeat counts.
+        uint8_t* row = repeatCountMatrix.data() + i*k;
+        if(strand == 0) {
+            getReadRepeatCounts(readId, markerPosition, markerPosition + k, row);
+        } else {
+            const uint64_t end = reads[readId].baseCount - markerPosition;
+            getReadRepeatCounts(readId, end - k, end, row);
+            std::reverse(row, row + k);
+        }
+
+        // Add them to the CoverageTensor.
+        for(uint32_t position=0; position<k; position++) {
+            coverageTensor.addRead(position, bases[position], strand, row[position]);
+        }
+    }
 
-            // Compute the optimal repeat counts for this vertex.
-            computeMarkerGraphVertexConsensusSequence(vertexId, sequence, repeatCounts);
+    // Compute consensus for all positions at once.
+    (*consensusCaller)(coverageTensor, consensus);
 
-            // Store them.
-            CZI_ASSERT(repeatCounts.size() == k);
-            copy(repeatCounts.begin(), repeatCounts.end(),
-                markerGraph.vertexRepeatCounts.begin() + vertexId * k);
+    // Store the consensus repeat counts.
+    // At positions where a repeat count was too long for
+    // the CoverageTensor, use a Coverage object instead.
+    uint8_t* vertexRepeatCounts = markerGraph.vertexRepeatCounts.begin() + vertexId * k;
+    for(uint32_t position=0; position<k; position++) {
+        if(coverageTensor.overflow(position)) {
+            Coverage coverage;
+            for(size_t i=0; i<markerCount; i++) {
+                const OrientedReadId orientedReadId = findMarkerId(markerIds[i]).first;
+                coverage.addRead(bases[position], orientedReadId.getStrand(),
+                    repeatCountMatrix[i*k + position]);
+            }
+            consensus[position] = (*consensusCaller)(coverage);
         }
+        vertexRepeatCounts[position] = uint8_t(consensus[position].repeatCount);
     }
 }
 
@@ -4597,7 +6186,16 @@ void Assembler::assembleMarkerGraphEdges(
     bool useMarginPhase,
 
     // Request storing detailed coverage information.
-    bool storeCoverageData
+    bool storeCoverageData,
+
+    // Edges for which all intervening sequences are at most this long
+    // are aligned using computeStarAlignment instead of spoa.
+    // Zero means always use spoa.
+    uint32_t starAlignmentLengthThreshold,
+
+    // Parameter to control whether the alignments otherwise
+    // computed using spoa are computed in batches on a GPU, using cudapoa.
+    bool useGpuConsensus
     )
 {
     cout << timestamp << "assembleMarkerGraphEdges begins." << endl;
@@ -4615,77 +6213,225 @@ void Assembler::assembleMarkerGraphEdges(
     }
     cout << "Using " << threadCount << " threads." << endl;
 
-    // Do the computation in parallel.
+    // Create the GPU backend, if requested.
+    // This throws if Shasta was not built with BUILD_CUDAPOA.
+    assembleMarkerGraphEdgesData.poaBackend.reset();
+    if(useGpuConsensus) {
+        if(useMarginPhase) {
+            throw runtime_error("useGpuConsensus cannot be used together with useMarginPhase.");
+        }
+        const int deviceId = 0;
+        assembleMarkerGraphEdgesData.poaBackend = createCudapoaBackend(deviceId);
+        cout << "Alignments that would otherwise use spoa are computed using " <<
+            assembleMarkerGraphEdgesData.poaBackend->description() << "." << endl;
+    }
+
+    // Edges are processed in order, and each edge accesses
+    // the markers of its oriented reads at random.
+    markerGraph.edges.adviseAccessPattern(MemoryMapped::AccessPattern::Sequential);
+    if(markerGraph.edgeMarkerIntervals.isOpen()) {
+        markerGraph.edgeMarkerIntervals.adviseAccessPattern(MemoryMapped::AccessPattern::Sequential);
+    }
+    markers.adviseAccessPattern(MemoryMapped::AccessPattern::Random);
+    markers.prefetch(threadCount);
+
+    // Create the final vectors.
+    // The number of consensus bases of each edge is not known in advance,
+    // so markerGraph.edgeConsensus (and markerGraph.edgeCoverageData, if requested)
+    // are constructed in two passes:
+    // - Pass 1 computes the consensus for each edge, stores it in
+    //   temporary per-thread vectors, and records its size.
+    // - Pass 2 copies the consensus of each edge directly into its final slot.
+    // markerGraph.edgeConsensusOverlappingBaseCount is written directly in pass 1.
+    const MarkerGraph::EdgeId edgeCount = markerGraph.edges.size();
+    markerGraph.edgeConsensus.createNew(
+        largeDataName("MarkerGraphEdgesConsensus"), largeDataPageSize);
+    markerGraph.edgeConsensus.beginPass1(edgeCount);
+    markerGraph.edgeConsensusOverlappingBaseCount.createNew(
+        largeDataName("MarkerGraphEdgesConsensusOverlappingBaseCount"), largeDataPageSize);
+    markerGraph.edgeConsensusOverlappingBaseCount.resize(edgeCount);
+    if(storeCoverageData) {
+        markerGraph.edgeCoverageData.createNew(
+            largeDataName("MarkerGraphEdgesCoverageData"), largeDataPageSize);
+        markerGraph.edgeCoverageData.beginPass1(edgeCount);
+    }
+
+    // Store the arguments so the threads can see them.
     assembleMarkerGraphEdgesData.markerGraphEdgeLengthThresholdForConsensus = markerGraphEdgeLengthThresholdForConsensus;
     assembleMarkerGraphEdgesData.useMarginPhase = useMarginPhase;
     assembleMarkerGraphEdgesData.storeCoverageData = storeCoverageData;
-    assembleMarkerGraphEdgesData.threadEdgeIds.resize(threadCount);
+    assembleMarkerGraphEdgesData.starAlignmentLengthThreshold = starAlignmentLengthThreshold;
+    assembleMarkerGraphEdgesData.identicalSequenceEdgeCount = 0;
+    assembleMarkerGraphEdgesData.starAlignmentEdgeCount = 0;
+    assembleMarkerGraphEdgesData.spoaEdgeCount = 0;
+    assembleMarkerGraphEdgesData.poaBackendDeviceEdgeCount = 0;
+
+
+
+    // Scheduling.
+    // The cost of computing consensus varies by orders of magnitude
+    // between edges. To avoid a long tail in which a few threads are still
+    // working on expensive edges while the others are idle,
+    // we estimate the cost of each edge and process the
+    // expensive ones first, one at a time, in order of decreasing cost.
+    const size_t batchSize = 10000;
+    const uint64_t expensiveEdgeCostFactor = 10;
+    assembleMarkerGraphEdgesData.threadTotalCost.assign(threadCount, 0);
+    assembleMarkerGraphEdgesData.threadAssembledEdgeCount.assign(threadCount, 0);
+    setupLoadBalancing(edgeCount, batchSize);
+    runThreads(&Assembler::assembleMarkerGraphEdgesThreadFunction1, threadCount);
+    uint64_t totalCost = 0;
+    uint64_t assembledEdgeCount = 0;
+    for(size_t threadId=0; threadId!=threadCount; threadId++) {
+        totalCost += assembleMarkerGraphEdgesData.threadTotalCost[threadId];
+        assembledEdgeCount += assembleMarkerGraphEdgesData.threadAssembledEdgeCount[threadId];
+    }
+    assembleMarkerGraphEdgesData.expensiveEdgeCostThreshold =
+        (assembledEdgeCount == 0) ? std::numeric_limits<uint64_t>::max() :
+        expensiveEdgeCostFactor * max(uint64_t(1), totalCost / assembledEdgeCount);
+
+    // Find the expensive edges.
+    assembleMarkerGraphEdgesData.threadExpensiveEdges.clear();
+    assembleMarkerGraphEdgesData.threadExpensiveEdges.resize(threadCount);
+    setupLoadBalancing(edgeCount, batchSize);
+    runThreads(&Assembler::assembleMarkerGraphEdgesThreadFunction2, threadCount);
+    vector< pair<MarkerGraph::EdgeId, uint64_t> > expensiveEdges;
+    for(const auto& v: assembleMarkerGraphEdgesData.threadExpensiveEdges) {
+        expensiveEdges.insert(expensiveEdges.end(), v.begin(), v.end());
+    }
+    assembleMarkerGraphEdgesData.threadExpensiveEdges.clear();
+    uint64_t expensiveCost = 0;
+    for(const auto& p: expensiveEdges) {
+        expensiveCost += p.second;
+    }
+    cout << "Found " << expensiveEdges.size() << " expensive marker graph edges out of " <<
+        assembledEdgeCount << " edges to be assembled." << endl;
+    if(totalCost > 0) {
+        cout << "These account for " << double(expensiveCost) / double(totalCost) <<
+            " of the estimated consensus cost." << endl;
+    }
+
+    // Sort them by decreasing cost, then deal them to the threads
+    // in serpentine order (0, 1, ..., n-1, n-1, ..., 1, 0, 0, 1, ...).
+    // The work list is the concatenation of the edges dealt to each thread,
+    // so the range of the work list initially assigned to each thread
+    // by the load balancing has about the same total cost.
+    sort(expensiveEdges.begin(), expensiveEdges.end(),
+        OrderPairsBySecondOnlyGreater<MarkerGraph::EdgeId, uint64_t>());
+    vector< vector<MarkerGraph::EdgeId> > dealtEdges(threadCount);
+    for(size_t i=0; i<expensiveEdges.size(); i++) {
+        const size_t round = i / threadCount;
+        const size_t position = i % threadCount;
+        const size_t threadId = (round % 2 == 0) ? position : (threadCount - 1 - position);
+        dealtEdges[threadId].push_back(expensiveEdges[i].first);
+    }
+    auto& workList = assembleMarkerGraphEdgesData.workList;
+    workList.clear();
+    for(const auto& v: dealtEdges) {
+        workList.insert(workList.end(), v.begin(), v.end());
+    }
+    auto& sortedExpensiveEdges = assembleMarkerGraphEdgesData.expensiveEdges;
+    sortedExpensiveEdges = workList;
+    sort(sortedExpensiveEdges.begin(), sortedExpensiveEdges.end());
+
+
+
+    // Allocate space for the results computed by each thread.
     assembleMarkerGraphEdgesData.threadEdgeConsensus.resize(threadCount);
-    assembleMarkerGraphEdgesData.threadEdgeConsensusOverlappingBaseCount.resize(threadCount);
     if(storeCoverageData) {
         assembleMarkerGraphEdgesData.threadEdgeCoverageData.resize(threadCount);
     }
-    const size_t batchSize = 10000;
-    setupLoadBalancing(markerGraph.edges.size(), batchSize);
-    runThreads(&Assembler::assembleMarkerGraphEdgesThreadFunction, threadCount);
-
-
-    // Figure out where the results for each edge are.
-    // For each edge we store pair(threadId, index in thread).
-    // This edge table can get big and we should store it
-    // in a MemoryMapped::Vector instead.
-    const size_t invalidValue = std::numeric_limits<size_t>::max();
-    vector< pair<size_t, size_t > > edgeTable(markerGraph.edges.size(), make_pair(invalidValue, invalidValue));
     for(size_t threadId=0; threadId!=threadCount; threadId++) {
-        const auto& edgeIds = *assembleMarkerGraphEdgesData.threadEdgeIds[threadId];
-        for(size_t i=0; i<edgeIds.size(); i++) {
-            edgeTable[edgeIds[i]] = make_pair(threadId, i);
+        assembleMarkerGraphEdgesData.threadEdgeConsensus[threadId] =
+            make_shared<MemoryMapped::VectorOfVectors<pair<Base, uint8_t>, uint64_t> >();
+        assembleMarkerGraphEdgesData.threadEdgeConsensus[threadId]->createNew(
+            largeDataName("tmp-assembleMarkerGraphEdges-consensus-" + to_string(threadId)), largeDataPageSize);
+        if(storeCoverageData) {
+            assembleMarkerGraphEdgesData.threadEdgeCoverageData[threadId] =
+                make_shared<MemoryMapped::VectorOfVectors<pair<uint32_t, CompressedCoverageData>, uint64_t> >();
+            assembleMarkerGraphEdgesData.threadEdgeCoverageData[threadId]->createNew(
+                largeDataName("tmp-assembleMarkerGraphEdges-edgeCoverageData" + to_string(threadId)), largeDataPageSize);
         }
     }
+    assembleMarkerGraphEdgesData.threadBatches.clear();
+    assembleMarkerGraphEdgesData.threadBatches.resize(threadCount);
 
-    // Gather the results.
-    markerGraph.edgeConsensus.createNew(
-        largeDataName("MarkerGraphEdgesConsensus"), largeDataPageSize);
-    markerGraph.edgeConsensusOverlappingBaseCount.createNew(
-        largeDataName("MarkerGraphEdgesConsensusOverlappingBaseCount"), largeDataPageSize);
-    markerGraph.edgeConsensusOverlappingBaseCount.resize(markerGraph.edges.size());
-    if(storeCoverageData) {
-        markerGraph.edgeCoverageData.createNew(
-            largeDataName("MarkerGraphEdgesCoverageData"), largeDataPageSize);
+
+
+    // Pass 1: compute the consensus.
+    // First, the expensive edges, one at a time.
+    cout << timestamp << "Computing consensus for expensive edges." << endl;
+    assembleMarkerGraphEdgesData.processingWorkList = true;
+    setupLoadBalancing(workList.size(), 1);
+    runThreads(&Assembler::assembleMarkerGraphEdgesThreadFunction3, threadCount);
+
+    // Then, all other edges, in batches.
+    cout << timestamp << "Computing consensus for all other edges." << endl;
+    assembleMarkerGraphEdgesData.processingWorkList = false;
+    setupLoadBalancing(edgeCount, batchSize);
+    runThreads(&Assembler::assembleMarkerGraphEdgesThreadFunction3, threadCount);
+
+    // Gather the batches processed by all threads.
+    auto& batches = assembleMarkerGraphEdgesData.batches;
+    batches.clear();
+    for(const auto& threadBatches: assembleMarkerGraphEdgesData.threadBatches) {
+        batches.insert(batches.end(), threadBatches.begin(), threadBatches.end());
     }
-    for(MarkerGraph::EdgeId edgeId=0; edgeId!=markerGraph.edges.size(); edgeId++) {
-        const auto& p = edgeTable[edgeId];
-        const size_t threadId = p.first;
-        const size_t i = p.second;
-        CZI_ASSERT(threadId != invalidValue);
-        CZI_ASSERT(i != invalidValue);
-        const auto& results = (*assembleMarkerGraphEdgesData.threadEdgeConsensus[threadId])[i];
-        markerGraph.edgeConsensus.appendVector();
-        for(const auto& q: results) {
-            markerGraph.edgeConsensus.append(q);
-        }
-        markerGraph.edgeConsensusOverlappingBaseCount[edgeId] =
-            (*assembleMarkerGraphEdgesData.threadEdgeConsensusOverlappingBaseCount[threadId])[i];
+    assembleMarkerGraphEdgesData.threadBatches.clear();
 
-        if(storeCoverageData) {
-            const auto& v = (*assembleMarkerGraphEdgesData.threadEdgeCoverageData[threadId])[i];
-            markerGraph.edgeCoverageData.appendVector(v.begin(), v.end());
-        }
+    // Pass 2: copy the results of each batch to their final slots.
+    markerGraph.edgeConsensus.beginPass2();
+    if(storeCoverageData) {
+        markerGraph.edgeCoverageData.beginPass2();
     }
+    setupLoadBalancing(batches.size(), 1);
+    runThreads(&Assembler::assembleMarkerGraphEdgesThreadFunction4, threadCount);
+    markerGraph.edgeConsensus.endPass2(false);
+    if(storeCoverageData) {
+        markerGraph.edgeCoverageData.endPass2(false);
+    }
+    batches.clear();
+    workList.clear();
+    sortedExpensiveEdges.clear();
+
+    // Write statistics on the multiple sequence alignments.
+    if(!useMarginPhase) {
+        const uint64_t identicalSequenceEdgeCount =
+            assembleMarkerGraphEdgesData.identicalSequenceEdgeCount;
+        const uint64_t starAlignmentEdgeCount = assembleMarkerGraphEdgesData.starAlignmentEdgeCount;
+        const uint64_t spoaEdgeCount = assembleMarkerGraphEdgesData.spoaEdgeCount;
+        const uint64_t msaEdgeCount = identicalSequenceEdgeCount + starAlignmentEdgeCount + spoaEdgeCount;
+        cout << "Multiple sequence alignment was needed for " << msaEdgeCount << " edges." << endl;
+        cout << "Of these, " << identicalSequenceEdgeCount <<
+            " had identical intervening sequences in all marker intervals "
+            "and did not require spoa." << endl;
+        if(starAlignmentLengthThreshold > 0) {
+            cout << starAlignmentEdgeCount << " had intervening sequences of length at most " <<
+                starAlignmentLengthThreshold << " and were aligned using the " <<
+                computeStarAlignmentImplementation() << " star alignment." << endl;
+        }
+        if(msaEdgeCount > 0) {
+            cout << "Fast path hit rate: " <<
+                double(identicalSequenceEdgeCount) / double(msaEdgeCount) << endl;
+        }
+        if(useGpuConsensus) {
+            cout << "Of the " << spoaEdgeCount << " edges that required spoa, " <<
+                assembleMarkerGraphEdgesData.poaBackendDeviceEdgeCount <<
+                " were aligned on the GPU. The rest exceeded the device limits "
+                "and were aligned on the CPU using spoa." << endl;
+        }
+    }
+    assembleMarkerGraphEdgesData.poaBackend.reset();
 
 
     // Remove the results computed by each thread.
     for(size_t threadId=0; threadId!=threadCount; threadId++) {
-        assembleMarkerGraphEdgesData.threadEdgeIds[threadId]->remove();
         assembleMarkerGraphEdgesData.threadEdgeConsensus[threadId]->remove();
-        assembleMarkerGraphEdgesData.threadEdgeConsensusOverlappingBaseCount[threadId]->remove();
         if(storeCoverageData) {
             assembleMarkerGraphEdgesData.threadEdgeCoverageData[threadId]->remove();
         }
     }
-    assembleMarkerGraphEdgesData.threadEdgeIds.clear();
     assembleMarkerGraphEdgesData.threadEdgeConsensus.clear();
-    assembleMarkerGraphEdgesData.threadEdgeConsensusOverlappingBaseCount.clear();
     if(storeCoverageData) {
         assembleMarkerGraphEdgesData.threadEdgeCoverageData.clear();
     }
@@ -4700,13 +6446,30 @@ void Assembler::assembleMarkerGraphEdges(
 // in sshasta.conf.
 void Assembler::accessMarkerGraphCoverageData()
 {
+    // First try the compressed coverage data.
+    // If only part of it can be accessed, close what was opened,
+    // so the MarkerGraph accessors only see the uncompressed data.
+    try {
+        markerGraph.compressedVertexCoverageData.accessExistingReadOnly(
+            largeDataName("MarkerGraphVerticesCompressedCoverageData"));
+        markerGraph.compressedEdgeCoverageData.accessExistingReadOnly(
+            largeDataName("MarkerGraphEdgesCompressedCoverageData"));
+        return;
+    } catch (const std::exception&) {
+        markerGraph.compressedVertexCoverageData.close();
+        markerGraph.compressedEdgeCoverageData.close();
+    }
+
     try {
         markerGraph.vertexCoverageData.accessExistingReadOnly(
             largeDataName("MarkerGraphVerticesCoverageData"));
         markerGraph.edgeCoverageData.accessExistingReadOnly(
             largeDataName("MarkerGraphEdgesCoverageData"));
 
-    } catch (std::exception) {
+    } catch (const std::exception&) {
+        if(markerGraph.vertexCoverageData.isOpen()) {
+            markerGraph.vertexCoverageData.close();
+        }
         throw runtime_error("Coverage data is not available. It is only stored if shasta.conf has "
             "Assembly.storeCoverageData set to True.");
     }
@@ -4714,122 +6477,301 @@ void Assembler::accessMarkerGraphCoverageData()
 
 
 
-void Assembler::assembleMarkerGraphEdgesThreadFunction(size_t threadId)
+// Replace the coverage data for vertices and edges of the marker graph
+// with block compressed versions.
+// The uncompressed coverage data are removed.
+void Assembler::compressMarkerGraphCoverageData(size_t threadCount)
 {
-    const uint32_t markerGraphEdgeLengthThresholdForConsensus = assembleMarkerGraphEdgesData.markerGraphEdgeLengthThresholdForConsensus;
-    const bool useMarginPhase = assembleMarkerGraphEdgesData.useMarginPhase;
-    const bool storeCoverageData = assembleMarkerGraphEdgesData.storeCoverageData;
+    cout << timestamp << "compressMarkerGraphCoverageData begins." << endl;
 
-    // Allocate space for the results computed by this thread.
-    assembleMarkerGraphEdgesData.threadEdgeIds[threadId] =
-        make_shared< MemoryMapped::Vector<MarkerGraph::EdgeId> >();
-    assembleMarkerGraphEdgesData.threadEdgeConsensus[threadId] =
-        make_shared<MemoryMapped::VectorOfVectors<pair<Base, uint8_t>, uint64_t> >();
-    assembleMarkerGraphEdgesData.threadEdgeConsensusOverlappingBaseCount[threadId] =
-        make_shared< MemoryMapped::Vector<uint8_t> >();
-    MemoryMapped::Vector<MarkerGraph::EdgeId>& edgeIds =
-        *assembleMarkerGraphEdgesData.threadEdgeIds[threadId];
-    MemoryMapped::VectorOfVectors<pair<Base, uint8_t>, uint64_t>& consensus =
-        *assembleMarkerGraphEdgesData.threadEdgeConsensus[threadId];
-    MemoryMapped::Vector<uint8_t>& overlappingBaseCountVector =
-        *assembleMarkerGraphEdgesData.threadEdgeConsensusOverlappingBaseCount[threadId];
+    // Check that we have what we need.
+    if( !markerGraph.vertexCoverageData.isOpen() ||
+        !markerGraph.edgeCoverageData.isOpen()) {
+        throw runtime_error("Coverage data is not accessible.");
+    }
 
-    edgeIds.createNew(
-        largeDataName("tmp-assembleMarkerGraphEdges-edgeIds-" + to_string(threadId)), largeDataPageSize);
-    consensus.createNew(
-        largeDataName("tmp-assembleMarkerGraphEdges-consensus-" + to_string(threadId)), largeDataPageSize);
-    overlappingBaseCountVector.createNew(
-        largeDataName("tmp-assembleMarkerGraphEdges-consensus-overlappingBaseCount" + to_string(threadId)), largeDataPageSize);
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
 
-    if(storeCoverageData) {
-        assembleMarkerGraphEdgesData.threadEdgeCoverageData[threadId] =
-            make_shared<MemoryMapped::VectorOfVectors<pair<uint32_t, CompressedCoverageData>, uint64_t> >();
-        assembleMarkerGraphEdgesData.threadEdgeCoverageData[threadId]->createNew(
-            largeDataName("tmp-assembleMarkerGraphEdges-edgeCoverageData" + to_string(threadId)), largeDataPageSize);
+    markerGraph.compressedVertexCoverageData.createNew(
+        markerGraph.vertexCoverageData,
+        largeDataName("MarkerGraphVerticesCompressedCoverageData"), largeDataPageSize,
+        threadCount);
+    markerGraph.vertexCoverageData.remove();
+
+    markerGraph.compressedEdgeCoverageData.createNew(
+        markerGraph.edgeCoverageData,
+        largeDataName("MarkerGraphEdgesCompressedCoverageData"), largeDataPageSize,
+        threadCount);
+    markerGraph.edgeCoverageData.remove();
+
+    cout << timestamp << "compressMarkerGraphCoverageData ends." << endl;
+}
+
+
+
+// Return true if assembleMarkerGraphEdges needs to compute
+// consensus for a marker graph edge.
+bool Assembler::shouldAssembleMarkerGraphEdge(MarkerGraph::EdgeId edgeId) const
+{
+    if(markerGraph.edgeWasRemoved(edgeId)) {
+        // The marker graph edge was removed.
+        return false;
+    }
+
+    // This marker graph edge was not removed.
+    // Find the corresponding assembly graph edge.
+    // If it will not be assembled, we don't need
+    // to assemble this marker graph edge.
+    const AssemblyGraph::EdgeId assemblyGraphEdgeId =
+        assemblyGraph.markerToAssemblyTable[edgeId].getEdgeId();
+    return assemblyGraph.isAssembledEdge(assemblyGraphEdgeId);
+}
+
+
+
+// Estimate the relative cost of computing consensus for a marker graph edge.
+// Each marker interval is aligned against an alignment graph
+// whose size grows with the length of the intervals,
+// so we use the sum of the squares of the ordinal spans.
+// If any marker interval is longer than markerGraphEdgeLengthThresholdForConsensus,
+// computeMarkerGraphEdgeConsensusSequenceUsingSpoa does not compute
+// an alignment, and the cost is just proportional to the number of marker intervals.
+uint64_t Assembler::estimateMarkerGraphEdgeConsensusCost(
+    MarkerGraph::EdgeId edgeId,
+    uint32_t markerGraphEdgeLengthThresholdForConsensus) const
+{
+    if(!shouldAssembleMarkerGraphEdge(edgeId)) {
+        return 0;
+    }
+    // Assembled edges are canonical, so their MarkerIntervals are always stored.
+    if(markerGraph.compactEdgeMarkerIntervals.isOpen()) {
+        const CompactMarkerIntervals& compactMarkerIntervals =
+            markerGraph.compactEdgeMarkerIntervals;
+        uint64_t cost = 0;
+        for(auto it=compactMarkerIntervals.begin(edgeId);
+            it!=compactMarkerIntervals.end(edgeId); ++it) {
+            const uint64_t span = it->ordinals[1] - it->ordinals[0];
+            if(span > markerGraphEdgeLengthThresholdForConsensus) {
+                return compactMarkerIntervals.size(edgeId);
+            }
+            cost += span * span;
+        }
+        return cost;
     }
+    const MemoryAsContainer<const MarkerInterval> markerIntervals =
+        markerGraph.edgeMarkerIntervals[edgeId];
+    uint64_t cost = 0;
+    for(const MarkerInterval& markerInterval: markerIntervals) {
+        const uint64_t span = markerInterval.ordinals[1] - markerInterval.ordinals[0];
+        if(span > markerGraphEdgeLengthThresholdForConsensus) {
+            return markerIntervals.size();
+        }
+        cost += span * span;
+    }
+    return cost;
+}
 
-    vector<Base> sequence;
-    vector<uint32_t> repeatCounts;
-    uint8_t overlappingBaseCount;
-    vector< pair<uint32_t, CompressedCoverageData> > coverageData;
 
-    // Loop over batches assigned to this thread.
+
+// Scheduling for assembleMarkerGraphEdges: compute the total estimated cost.
+void Assembler::assembleMarkerGraphEdgesThreadFunction1(size_t threadId)
+{
+    const uint32_t markerGraphEdgeLengthThresholdForConsensus =
+        assembleMarkerGraphEdgesData.markerGraphEdgeLengthThresholdForConsensus;
+    uint64_t totalCost = 0;
+    uint64_t assembledEdgeCount = 0;
+
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
-        if((begin % 10000000) == 0){
-            std::lock_guard<std::mutex> lock(mutex);
-            cout << timestamp << begin << "/" << markerGraph.edges.size() << endl;
+        for(MarkerGraph::EdgeId edgeId=begin; edgeId!=end; edgeId++) {
+            if(shouldAssembleMarkerGraphEdge(edgeId)) {
+                ++assembledEdgeCount;
+                totalCost += estimateMarkerGraphEdgeConsensusCost(
+                    edgeId, markerGraphEdgeLengthThresholdForConsensus);
+            }
         }
+    }
 
-        // Loop over marker graph vertices assigned to this batch.
-        for(MarkerGraph::EdgeId edgeId=begin; edgeId!=end; edgeId++) {
+    assembleMarkerGraphEdgesData.threadTotalCost[threadId] = totalCost;
+    assembleMarkerGraphEdgesData.threadAssembledEdgeCount[threadId] = assembledEdgeCount;
+}
 
-            // Figure out if we need to assemble this edge.
-            bool shouldAssemble = true;
-            if(markerGraph.edges[edgeId].wasRemoved()) {
-                // The marker graph edge was removed.
-                shouldAssemble = false;
-            } else {
-                // This marker graph edge was not removed.
-                // Find the corresponding assembly graph edge.
-                const AssemblyGraph::EdgeId assemblyGraphEdgeId =
-                    assemblyGraph.markerToAssemblyTable[edgeId].first;
-                if(!assemblyGraph.isAssembledEdge(assemblyGraphEdgeId)) {
-                    // The assembly graph edge will not be assembled.
-                    // Se we don't need to assemble this marker graph edge.
-                    shouldAssemble = false;
-                }
+
+
+// Scheduling for assembleMarkerGraphEdges: find the expensive edges.
+void Assembler::assembleMarkerGraphEdgesThreadFunction2(size_t threadId)
+{
+    const uint32_t markerGraphEdgeLengthThresholdForConsensus =
+        assembleMarkerGraphEdgesData.markerGraphEdgeLengthThresholdForConsensus;
+    const uint64_t expensiveEdgeCostThreshold = assembleMarkerGraphEdgesData.expensiveEdgeCostThreshold;
+    auto& expensiveEdges = assembleMarkerGraphEdgesData.threadExpensiveEdges[threadId];
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(MarkerGraph::EdgeId edgeId=begin; edgeId!=end; edgeId++) {
+            const uint64_t cost = estimateMarkerGraphEdgeConsensusCost(
+                edgeId, markerGraphEdgeLengthThresholdForConsensus);
+            if(cost >= expensiveEdgeCostThreshold) {
+                expensiveEdges.push_back(make_pair(edgeId, cost));
             }
+        }
+    }
+}
 
-            // Compute the consensus, if necessary.
-            if(!shouldAssemble) {
-                sequence.clear();
-                repeatCounts.clear();
-                overlappingBaseCount = 0;
-            } else {
-                try {
-                    if(useMarginPhase) {
+
+
+// Pass 1 of assembleMarkerGraphEdges: compute the consensus.
+void Assembler::assembleMarkerGraphEdgesThreadFunction3(size_t threadId)
+{
+    const uint32_t markerGraphEdgeLengthThresholdForConsensus = assembleMarkerGraphEdgesData.markerGraphEdgeLengthThresholdForConsensus;
+    const uint32_t starAlignmentLengthThreshold = assembleMarkerGraphEdgesData.starAlignmentLengthThreshold;
+    const bool useMarginPhase = assembleMarkerGraphEdgesData.useMarginPhase;
+    const bool storeCoverageData = assembleMarkerGraphEdgesData.storeCoverageData;
+    const bool processingWorkList = assembleMarkerGraphEdgesData.processingWorkList;
+
+    // Access the space for the results computed by this thread.
+    MemoryMapped::VectorOfVectors<pair<Base, uint8_t>, uint64_t>& consensus =
+        *assembleMarkerGraphEdgesData.threadEdgeConsensus[threadId];
+    vector<AssembleMarkerGraphEdgesData::Batch>& threadBatches =
+        assembleMarkerGraphEdgesData.threadBatches[threadId];
+
+    vector<Base> sequence;
+    vector<uint32_t> repeatCounts;
+    uint8_t overlappingBaseCount;
+    vector< pair<uint32_t, CompressedCoverageData> > coverageData;
+
+    // If a PoaBackend is in use, the spoa alignments of the edges
+    // of each batch are gathered in a PoaBatch
+    // and computed together by the PoaBackend.
+    PoaBackend* poaBackend = assembleMarkerGraphEdgesData.poaBackend.get();
+    PoaBatch poaBatch;
+    auto gatherEdge = [&](MarkerGraph::EdgeId edgeId)
+    {
+        if(shouldAssembleMarkerGraphEdge(edgeId)) {
+            computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
+                edgeId, markerGraphEdgeLengthThresholdForConsensus,
+                starAlignmentLengthThreshold,
+                sequence, repeatCounts, overlappingBaseCount,
+                0, &poaBatch);
+        }
+    };
+
+    // Function to compute and store consensus for one edge.
+    auto processEdge = [&](MarkerGraph::EdgeId edgeId)
+    {
+
+        // Compute the consensus, if necessary.
+        if(!shouldAssembleMarkerGraphEdge(edgeId)) {
+            sequence.clear();
+            repeatCounts.clear();
+            overlappingBaseCount = 0;
+            coverageData.clear();
+        } else {
+            try {
+                if(useMarginPhase) {
 #ifndef SHASTA_STATIC_EXECUTABLE
-                        computeMarkerGraphEdgeConsensusSequenceUsingMarginPhase(
-                            edgeId, sequence, repeatCounts, overlappingBaseCount);
+                    computeMarkerGraphEdgeConsensusSequenceUsingMarginPhase(
+                        edgeId, sequence, repeatCounts, overlappingBaseCount);
 #else
-                        // The static executable does not support MarginPhase.
-                        CZI_ASSERT(0);
+                    // The static executable does not support MarginPhase.
+                    CZI_ASSERT(0);
 #endif
-                    } else {
-                        computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
-                            edgeId, markerGraphEdgeLengthThresholdForConsensus,
-                            sequence, repeatCounts, overlappingBaseCount,
-                            storeCoverageData ? &coverageData : 0
-                            );
-                    }
-                } catch(std::exception e) {
-                    std::lock_guard<std::mutex> lock(mutex);
-                    cout << "A standard exception was thrown while assembling "
-                        "marker graph edge " << edgeId << ":" << endl;
-                    cout << e.what() << endl;
-                    throw;
-                } catch(...) {
-                    std::lock_guard<std::mutex> lock(mutex);
-                    cout << "A non-standard exception was thrown while assembling "
-                        "marker graph edge " << edgeId << ":" << endl;
-                    throw;
+                } else {
+                    computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
+                        edgeId, markerGraphEdgeLengthThresholdForConsensus,
+                        starAlignmentLengthThreshold,
+                        sequence, repeatCounts, overlappingBaseCount,
+                        storeCoverageData ? &coverageData : 0,
+                        poaBackend ? &poaBatch : 0
+                        );
                 }
+            } catch(std::exception e) {
+                ThreadLog::Message(ThreadLog::Level::error) <<
+                    "A standard exception was thrown while assembling "
+                    "marker graph edge " << edgeId << ":\n" << e.what();
+                throw;
+            } catch(...) {
+                ThreadLog::Message(ThreadLog::Level::error) <<
+                    "A non-standard exception was thrown while assembling "
+                    "marker graph edge " << edgeId << ":";
+                throw;
             }
+        }
+
+        // Store the results.
+        // The sizes and the overlapping base count go directly
+        // to the final vectors. Each edge is processed by only one thread,
+        // so this does not require any locking.
+        const size_t n = sequence.size();
+        CZI_ASSERT(repeatCounts.size() == n);
+        consensus.appendVector();
+        for(size_t i=0; i<n; i++) {
+            consensus.append(make_pair(sequence[i], repeatCounts[i]));
+        }
+        markerGraph.edgeConsensus.incrementCount(edgeId, n);
+        markerGraph.edgeConsensusOverlappingBaseCount[edgeId] = overlappingBaseCount;
+        if(storeCoverageData) {
+            assembleMarkerGraphEdgesData.threadEdgeCoverageData[threadId]->appendVector(coverageData);
+            markerGraph.edgeCoverageData.incrementCount(edgeId, coverageData.size());
+        }
+    };
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        if(!processingWorkList && containsMultiple(begin, end, 10000000)) {
+            ThreadLog::Message() << timestamp << begin << "/" << markerGraph.edges.size();
+        }
+        threadBatches.push_back({threadId, begin, end, processingWorkList, consensus.size()});
+        if(poaBackend) {
+            poaBatch.clear();
+            assembleMarkerGraphEdgesData.forEachEdge(begin, end, processingWorkList, gatherEdge);
+            poaBackend->align(poaBatch);
+            __sync_fetch_and_add(&assembleMarkerGraphEdgesData.poaBackendDeviceEdgeCount,
+                poaBatch.deviceGroupCount);
+        }
+        assembleMarkerGraphEdgesData.forEachEdge(begin, end, processingWorkList, processEdge);
+        if(poaBackend) {
+            CZI_ASSERT(poaBatch.nextGroup == poaBatch.size());
+        }
+    }
+}
+
 
-            // Store the results.
-            edgeIds.push_back(edgeId);
-            const size_t n = sequence.size();
-            CZI_ASSERT(repeatCounts.size() == n);
-            consensus.appendVector();
-            for(size_t i=0; i<n; i++) {
-                consensus.append(make_pair(sequence[i], repeatCounts[i]));
-            }
-            overlappingBaseCountVector.push_back(overlappingBaseCount);
-            if(storeCoverageData) {
-                assembleMarkerGraphEdgesData.threadEdgeCoverageData[threadId]->appendVector(coverageData);
-            }
 
+// Pass 2 of assembleMarkerGraphEdges: copy the results
+// computed in pass 1 to their final slots.
+void Assembler::assembleMarkerGraphEdgesThreadFunction4(size_t threadId)
+{
+    const bool storeCoverageData = assembleMarkerGraphEdgesData.storeCoverageData;
+    const auto& batches = assembleMarkerGraphEdgesData.batches;
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t batchId=begin; batchId!=end; batchId++) {
+            const AssembleMarkerGraphEdgesData::Batch& batch = batches[batchId];
+            const auto& consensus =
+                *assembleMarkerGraphEdgesData.threadEdgeConsensus[batch.threadId];
+            uint64_t index = batch.firstIndex;
+            assembleMarkerGraphEdgesData.forEachEdge(batch.begin, batch.end, batch.isWorkList,
+                [&](MarkerGraph::EdgeId edgeId)
+                {
+                    CZI_ASSERT(consensus.size(index) == markerGraph.edgeConsensus.size(edgeId));
+                    copy(consensus.begin(index), consensus.end(index),
+                        markerGraph.edgeConsensus.begin(edgeId));
+                    if(storeCoverageData) {
+                        const auto& coverageData =
+                            *assembleMarkerGraphEdgesData.threadEdgeCoverageData[batch.threadId];
+                        CZI_ASSERT(coverageData.size(index) == markerGraph.edgeCoverageData.size(edgeId));
+                        copy(coverageData.begin(index), coverageData.end(index),
+                            markerGraph.edgeCoverageData.begin(edgeId));
+                    }
+                    ++index;
+                });
         }
     }
 }
@@ -4844,3 +6786,127 @@ void Assembler::accessMarkerGraphEdgeConsensus()
         largeDataName("MarkerGraphEdgesConsensusOverlappingBaseCount"));
 
 }
+
+
+
+// Compare consensus computed for marker graph edges using spoa
+// and using computeStarAlignment, for up to maxEdgeCount edges
+// for which computeStarAlignment would be used.
+// Edges are classified by the length of their longest intervening sequence.
+// For each length, this writes the number of edges, the time spent
+// computing consensus with each method, and the number of edges for which
+// the two methods give identical consensus sequence and repeat counts.
+void Assembler::benchmarkStarAlignment(
+    uint32_t markerGraphEdgeLengthThresholdForConsensus,
+    uint32_t starAlignmentLengthThreshold,
+    uint64_t maxEdgeCount)
+{
+    // Check that we have what we need.
+    checkReadsAreOpen();
+    checkMarkersAreOpen();
+    checkMarkerGraphEdgesIsOpen();
+    const uint32_t k = uint32_t(assemblerInfo->k);
+    cout << "Using the " << computeStarAlignmentImplementation() <<
+        " version of the star alignment." << endl;
+
+    // Statistics for each length of the longest intervening sequence.
+    class LengthClass {
+    public:
+        uint64_t edgeCount = 0;
+        uint64_t identicalCount = 0;
+        double spoaTime = 0.;
+        double starAlignmentTime = 0.;
+    };
+    vector<LengthClass> lengthClasses(starAlignmentLengthThreshold + 1);
+
+    vector<MarkerInterval> markerIntervals;
+    vector<Base> spoaSequence;
+    vector<uint32_t> spoaRepeatCounts;
+    uint8_t spoaOverlappingBaseCount;
+    vector<Base> starAlignmentSequence;
+    vector<uint32_t> starAlignmentRepeatCounts;
+    uint8_t starAlignmentOverlappingBaseCount;
+    uint64_t edgeCount = 0;
+    for(MarkerGraph::EdgeId edgeId=0; edgeId<markerGraph.edges.size(); edgeId++) {
+        if(edgeCount == maxEdgeCount) {
+            break;
+        }
+        if(markerGraph.edgeWasRemoved(edgeId)) {
+            continue;
+        }
+
+        // Find the length of the longest intervening sequence.
+        getMarkerGraphEdgeMarkerIntervals(edgeId, markerIntervals);
+        uint32_t maxLength = 0;
+        for(const MarkerInterval& markerInterval: markerIntervals) {
+            const auto orientedReadMarkers = markers[markerInterval.orientedReadId.getValue()];
+            const uint32_t position0 = orientedReadMarkers[markerInterval.ordinals[0]].position;
+            const uint32_t position1 = orientedReadMarkers[markerInterval.ordinals[1]].position;
+            if(position1 > position0 + k) {
+                maxLength = max(maxLength, position1 - position0 - k);
+            }
+        }
+        if(maxLength > starAlignmentLengthThreshold) {
+            continue;
+        }
+
+        // Compute consensus using computeStarAlignment.
+        // Skip the edge if computeStarAlignment was not used.
+        const uint64_t oldStarAlignmentEdgeCount = assembleMarkerGraphEdgesData.starAlignmentEdgeCount;
+        const auto t0 = steady_clock::now();
+        computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
+            edgeId, markerGraphEdgeLengthThresholdForConsensus, starAlignmentLengthThreshold,
+            starAlignmentSequence, starAlignmentRepeatCounts, starAlignmentOverlappingBaseCount, 0);
+        const auto t1 = steady_clock::now();
+        if(assembleMarkerGraphEdgesData.starAlignmentEdgeCount == oldStarAlignmentEdgeCount) {
+            continue;
+        }
+
+        // Compute consensus using spoa.
+        computeMarkerGraphEdgeConsensusSequenceUsingSpoa(
+            edgeId, markerGraphEdgeLengthThresholdForConsensus, 0,
+            spoaSequence, spoaRepeatCounts, spoaOverlappingBaseCount, 0);
+        const auto t2 = steady_clock::now();
+
+        // Update statistics.
+        LengthClass& lengthClass = lengthClasses[maxLength];
+        ++edgeCount;
+        ++lengthClass.edgeCount;
+        lengthClass.starAlignmentTime += seconds(t1 - t0);
+        lengthClass.spoaTime += seconds(t2 - t1);
+        if(spoaSequence == starAlignmentSequence &&
+            spoaRepeatCounts == starAlignmentRepeatCounts &&
+            spoaOverlappingBaseCount == starAlignmentOverlappingBaseCount) {
+            ++lengthClass.identicalCount;
+        }
+    }
+
+    // Write the statistics.
+    cout << "Length,Edges,Identical,Identical fraction,"
+        "Spoa time (microseconds per edge),Star alignment time (microseconds per edge),Speedup" << endl;
+    LengthClass total;
+    for(uint32_t length=0; length<=starAlignmentLengthThreshold; length++) {
+        const LengthClass& lengthClass = lengthClasses[length];
+        total.edgeCount += lengthClass.edgeCount;
+        total.identicalCount += lengthClass.identicalCount;
+        total.spoaTime += lengthClass.spoaTime;
+        total.starAlignmentTime += lengthClass.starAlignmentTime;
+        if(lengthClass.edgeCount == 0) {
+            continue;
+        }
+        const double n = double(lengthClass.edgeCount);
+        cout << length << "," << lengthClass.edgeCount << "," << lengthClass.identicalCount << "," <<
+            double(lengthClass.identicalCount) / n << "," <<
+            1.e6 * lengthClass.spoaTime / n << "," <<
+            1.e6 * lengthClass.starAlignmentTime / n << "," <<
+            lengthClass.spoaTime / lengthClass.starAlignmentTime << endl;
+    }
+    if(total.edgeCount > 0) {
+        const double n = double(total.edgeCount);
+        cout << "Total," << total.edgeCount << "," << total.identicalCount << "," <<
+            double(total.identicalCount) / n << "," <<
+            1.e6 * total.spoaTime / n << "," <<
+            1.e6 * total.starAlignmentTime / n << "," <<
+            total.spoaTime / total.starAlignmentTime << endl;
+    }
+}
@@ -0,0 +1,504 @@
+// Shasta.
+#include "Assembler.hpp"
+#include "filesystem.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "chrono.hpp"
+#include <cerrno>
+#include <cstring>
+#include <queue>
+
+// Linux.
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+
+/*******************************************************************************
+
+Out of core mode of createMarkerGraphVertices.
+
+The in-core computation needs the disjoint sets for all oriented markers
+(8 or 16 bytes per marker) plus the markers and the vertex table
+in memory at the same time. In the out of core mode, memory usage
+is bounded by the size of the largest partition instead:
+
+- The oriented markers are partitioned by k-mer id (kmerId % partitionCount).
+  Two markers are only merged if they have the same k-mer, so every
+  vertex of the marker graph is entirely contained in one partition.
+- The union operations generated by the alignments are written
+  to one spill file per partition, instead of being applied immediately.
+- Each partition is then processed independently. Its union operations
+  are read back from its spill file and applied to disjoint sets
+  containing only the markers of the partition. Each disjoint set
+  with coverage in the requested range and at most one marker per read
+  becomes a vertex, stored in order of its first marker.
+- The vertices of all partitions are then merged in order of their first marker
+  (a k-way merge of sorted streams), which gives the vertex ids.
+
+The resulting marker graph vertices are the same as in the in-core
+computation. Vertex ids are assigned in order of the first marker
+of each vertex, so they don't depend on the number of threads.
+
+The spill files and work areas are created in the Data directory,
+which must be on disk rather than on huge pages or tmpfs
+for memory usage to be bounded.
+
+*******************************************************************************/
+
+
+
+void Assembler::createMarkerGraphVerticesOutOfCore(
+    size_t minCoverage,
+    size_t maxCoverage,
+    uint64_t partitionCount,
+    size_t threadCount)
+{
+    if(largeDataFileNamePrefix.empty()) {
+        throw runtime_error("The out of core mode of createMarkerGraphVertices "
+            "requires a Data directory on disk.");
+    }
+    auto& data = createMarkerGraphVerticesData;
+    data.partitionCount = partitionCount;
+    data.orientedMarkerCount = markers.totalSize();
+    data.minCoverage = minCoverage;
+    data.maxCoverage = maxCoverage;
+    cout << "Using out of core mode with " << partitionCount << " partitions." << endl;
+
+    // The phases are timed individually.
+    // The timings are written at the end.
+    vector< pair<string, double> > phaseTimes;
+    auto tPhase = steady_clock::now();
+
+
+
+    // Partition the oriented markers by k-mer.
+    // This is done in two passes with a prefix sum in between,
+    // so the markers of each partition are stored sorted.
+    cout << timestamp << "Partitioning " << data.orientedMarkerCount << " oriented markers." << endl;
+    const uint64_t batchSize = 1000000;
+    data.partitionBatchSize = batchSize;
+    const uint64_t batchCount = (data.orientedMarkerCount + batchSize - 1) / batchSize;
+    data.partitionBatchCount.clear();
+    data.partitionBatchCount.resize(batchCount * partitionCount, 0);
+    setupLoadBalancing(data.orientedMarkerCount, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesPartitionThreadFunction1, threadCount);
+    data.partitionMarkers.createNew(largeDataName("tmp-PartitionMarkers"), largeDataPageSize);
+    data.partitionMarkers.beginPass1(partitionCount);
+    for(uint64_t partition=0; partition<partitionCount; partition++) {
+        uint64_t partitionSize = 0;
+        for(uint64_t batch=0; batch<batchCount; batch++) {
+            uint64_t& c = data.partitionBatchCount[batch*partitionCount + partition];
+            const uint64_t batchPartitionSize = c;
+            c = partitionSize;
+            partitionSize += batchPartitionSize;
+        }
+        data.partitionMarkers.incrementCount(partition, partitionSize);
+    }
+    data.partitionMarkers.beginPass2();
+    data.partitionMarkers.endPass2(false);
+    setupLoadBalancing(data.orientedMarkerCount, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesPartitionThreadFunction2, threadCount);
+    data.partitionBatchCount.clear();
+    endCreateMarkerGraphVerticesPhase("Marker partitioning", phaseTimes, tPhase);
+
+
+
+    // Write the union operations to the spill file of each partition.
+    cout << timestamp << "Writing union operations for " << readGraph.edges.size() <<
+        " alignments in the read graph to spill files." << endl;
+    data.unionSpillFileDescriptors.resize(partitionCount);
+    vector<std::mutex>(partitionCount).swap(data.unionSpillMutexes);
+    for(uint64_t partition=0; partition<partitionCount; partition++) {
+        const string fileName = largeDataName("tmp-MarkerGraphUnions-" + to_string(partition));
+        const int fileDescriptor = ::open(fileName.c_str(), O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+        if(fileDescriptor == -1) {
+            throw runtime_error("Error opening " + fileName + ": " + ::strerror(errno));
+        }
+        data.unionSpillFileDescriptors[partition] = fileDescriptor;
+    }
+    setupLoadBalancing(readGraph.edges.size(), 10000);
+    runThreads(&Assembler::createMarkerGraphVerticesSpillThreadFunction, threadCount);
+    for(const int fileDescriptor: data.unionSpillFileDescriptors) {
+        ::close(fileDescriptor);
+    }
+    data.unionSpillFileDescriptors.clear();
+    data.unionSpillMutexes.clear();
+    endCreateMarkerGraphVerticesPhase("Union spill", phaseTimes, tPhase);
+
+
+
+    // Process the partitions one at a time.
+    data.partitionVertices.createNew(largeDataName("tmp-PartitionVertices"), largeDataPageSize);
+    data.partitionVerticesBegin.assign(1, 0);
+    for(uint64_t partition=0; partition<partitionCount; partition++) {
+        createMarkerGraphVerticesProcessPartition(partition, threadCount);
+        data.partitionVerticesBegin.push_back(data.partitionVertices.size());
+    }
+    data.partitionMarkers.remove();
+    endCreateMarkerGraphVerticesPhase("Partition processing", phaseTimes, tPhase);
+
+
+
+    // Merge the vertices of all partitions in order of their first marker.
+    // This assigns the vertex ids and fills in the vertex table.
+    cout << timestamp << "Merging the vertices of all partitions." << endl;
+    markerGraph.vertexTable.createNew(
+        largeDataName("MarkerGraphVertexTable"),
+        largeDataPageSize);
+    markerGraph.vertexTable.reserveAndResize(data.orientedMarkerCount);
+    fill(markerGraph.vertexTable.begin(), markerGraph.vertexTable.end(),
+        MarkerGraph::invalidCompressedVertexId);
+    markerGraph.vertices.createNew(
+        largeDataName("MarkerGraphVertices"),
+        largeDataPageSize);
+
+    // The queue contains the first marker of the next vertex
+    // of each partition, and the partition.
+    using QueueEntry = pair<MarkerId, uint64_t>;
+    std::priority_queue<QueueEntry, vector<QueueEntry>, std::greater<QueueEntry> > queue;
+    vector<uint64_t> next(data.partitionVerticesBegin.begin(), data.partitionVerticesBegin.end() - 1);
+    for(uint64_t partition=0; partition<partitionCount; partition++) {
+        if(next[partition] != data.partitionVerticesBegin[partition + 1]) {
+            queue.push(make_pair(data.partitionVertices.begin(next[partition])[0], partition));
+        }
+    }
+    while(!queue.empty()) {
+        const uint64_t partition = queue.top().second;
+        queue.pop();
+        const auto vertexMarkers = data.partitionVertices[next[partition]++];
+        const MarkerGraph::VertexId vertexId = markerGraph.vertices.size();
+        markerGraph.vertices.appendVector(vertexMarkers.begin(), vertexMarkers.end());
+        for(const MarkerId markerId: vertexMarkers) {
+            markerGraph.vertexTable[markerId] = vertexId;
+        }
+        if(next[partition] != data.partitionVerticesBegin[partition + 1]) {
+            queue.push(make_pair(data.partitionVertices.begin(next[partition])[0], partition));
+        }
+    }
+    data.partitionVertices.remove();
+    data.partitionVerticesBegin.clear();
+    cout << "The marker graph has " << markerGraph.vertices.size() << " vertices." << endl;
+    endCreateMarkerGraphVerticesPhase("Vertex merge", phaseTimes, tPhase);
+
+
+
+    // Write the timing of each phase.
+    cout << "Timing of createMarkerGraphVertices phases:" << endl;
+    for(const auto& p: phaseTimes) {
+        cout << p.first << ": " << p.second << " s." << endl;
+    }
+}
+
+
+
+// Find the vertices of one partition and append them to data.partitionVertices.
+void Assembler::createMarkerGraphVerticesProcessPartition(
+    uint64_t partition,
+    size_t threadCount)
+{
+    auto& data = createMarkerGraphVerticesData;
+    data.currentPartition = partition;
+    const uint64_t n = data.partitionMarkers.size(partition);
+    const MarkerId* partitionMarkers = data.partitionMarkers.begin(partition);
+    const uint64_t batchSize = 1000000;
+
+    // Map the union operations of this partition from its spill file.
+    const string fileName = largeDataName("tmp-MarkerGraphUnions-" + to_string(partition));
+    const int fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+    if(fileDescriptor == -1) {
+        throw runtime_error("Error opening " + fileName + ": " + ::strerror(errno));
+    }
+    const off_t fileSize = ::lseek(fileDescriptor, 0, SEEK_END);
+    const uint64_t unionCount = uint64_t(fileSize) / sizeof(pair<MarkerId, MarkerId>);
+    void* pointer = 0;
+    if(unionCount > 0) {
+        pointer = ::mmap(0, size_t(fileSize), PROT_READ, MAP_SHARED, fileDescriptor, 0);
+        if(pointer == MAP_FAILED) {
+            throw runtime_error("Error mapping " + fileName + ": " + ::strerror(errno));
+        }
+        ::madvise(pointer, size_t(fileSize), MADV_SEQUENTIAL);
+    }
+    ::close(fileDescriptor);
+    data.partitionUnions = static_cast<const pair<MarkerId, MarkerId>*>(pointer);
+    cout << timestamp << "Processing partition " << partition << " with " << n <<
+        " oriented markers and " << unionCount << " union operations." << endl;
+
+    // Apply the union operations to disjoint sets
+    // containing only the markers of this partition.
+    // Here, items of the disjoint sets are indexes into partitionMarkers.
+    if(n < (uint64_t(1) << 32)) {
+        data.disjointSets32Data.createNew(
+            largeDataName("tmp-DisjointSetData"),
+            largeDataPageSize);
+        data.disjointSets32Data.reserveAndResize(n);
+        data.disjointSets32Pointer = std::make_shared<DisjointSets32>(
+            data.disjointSets32Data.begin(),
+            DisjointSets32::Uint(n));
+    } else {
+        data.disjointSetsData.createNew(
+            largeDataName("tmp-DisjointSetData"),
+            largeDataPageSize);
+        data.disjointSetsData.reserveAndResize(n);
+        data.disjointSetsPointer = std::make_shared<DisjointSets>(
+            data.disjointSetsData.begin(),
+            n);
+    }
+    setupLoadBalancing(unionCount, 100000);
+    runThreads(&Assembler::createMarkerGraphVerticesPartitionUnionThreadFunction, threadCount);
+    if(pointer) {
+        ::munmap(pointer, size_t(fileSize));
+    }
+    data.partitionUnions = 0;
+    filesystem::remove(fileName);
+
+    // Find the disjoint set of each marker of this partition.
+    data.disjointSetTable.createNew(
+        largeDataName("tmp-DisjointSetTable"),
+        largeDataPageSize);
+    data.disjointSetTable.reserveAndResize(n);
+    setupLoadBalancing(n, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction2, threadCount);
+    if(data.disjointSets32Pointer) {
+        data.disjointSets32Pointer = 0;
+        data.disjointSets32Data.remove();
+    } else {
+        data.disjointSetsPointer = 0;
+        data.disjointSetsData.remove();
+    }
+
+    // Identify each disjoint set by its first marker
+    // instead of by the root of the disjoint set.
+    auto& disjointSetTable = data.disjointSetTable;
+    auto& workArea = data.workArea;
+    workArea.createNew(
+        largeDataName("tmp-WorkArea"),
+        largeDataPageSize);
+    workArea.reserveAndResize(n);
+    fill(workArea.begin(), workArea.end(), MarkerGraph::invalidVertexId);
+    for(uint64_t i=0; i<n; i++) {
+        MarkerGraph::VertexId& firstMarker = workArea[disjointSetTable[i]];
+        if(firstMarker == MarkerGraph::invalidVertexId) {
+            firstMarker = i;
+        }
+        disjointSetTable[i] = firstMarker;
+    }
+
+    // Count the markers in each disjoint set.
+    fill(workArea.begin(), workArea.end(), 0ULL);
+    setupLoadBalancing(n, batchSize);
+    runThreads(&Assembler::createMarkerGraphVerticesThreadFunction3, threadCount);
+
+    // Gather the markers of each disjoint set (counting sort).
+    // Disjoint sets are stored in order of their first marker,
+    // and the markers of each disjoint set are sorted.
+    uint64_t offset = 0;
+    for(uint64_t i=0; i<n; i++) {
+        const uint64_t markerCount = workArea[i];
+        workArea[i] = offset;
+        offset += markerCount;
+    }
+    CZI_ASSERT(offset == n);
+    MemoryMapped::Vector<MarkerId> disjointSetMarkers;
+    disjointSetMarkers.createNew(
+        largeDataName("tmp-PartitionDisjointSetMarkers"),
+        largeDataPageSize);
+    disjointSetMarkers.reserveAndResize(n);
+    for(uint64_t i=0; i<n; i++) {
+        disjointSetMarkers[workArea[disjointSetTable[i]]++] = partitionMarkers[i];
+    }
+
+    // Store the disjoint sets with coverage in the requested range
+    // and at most one marker on each read.
+    // For the first marker i of each disjoint set, workArea[i]
+    // is now the end of the disjoint set in disjointSetMarkers.
+    uint64_t vertexCount = 0;
+    uint64_t badDisjointSetCount = 0;
+    uint64_t disjointSetBegin = 0;
+    for(uint64_t i=0; i<n; i++) {
+        if(disjointSetTable[i] != i) {
+            continue;   // Not the first marker of its disjoint set.
+        }
+        const uint64_t disjointSetEnd = workArea[i];
+        const MarkerId* begin = disjointSetMarkers.begin() + disjointSetBegin;
+        const MarkerId* end = disjointSetMarkers.begin() + disjointSetEnd;
+        disjointSetBegin = disjointSetEnd;
+        const uint64_t markerCount = uint64_t(end - begin);
+        if(markerCount < data.minCoverage || markerCount > data.maxCoverage) {
+            continue;
+        }
+        bool isBad = false;
+        for(const MarkerId* it=begin+1; it<end; ++it) {
+            OrientedReadId previousOrientedReadId;
+            OrientedReadId orientedReadId;
+            tie(previousOrientedReadId, ignore) = findMarkerId(*(it - 1));
+            tie(orientedReadId, ignore) = findMarkerId(*it);
+            if(orientedReadId.getReadId() == previousOrientedReadId.getReadId()) {
+                isBad = true;
+                break;
+            }
+        }
+        if(isBad) {
+            ++badDisjointSetCount;
+        } else {
+            data.partitionVertices.appendVector(begin, end);
+            ++vertexCount;
+        }
+    }
+    CZI_ASSERT(disjointSetBegin == n);
+    disjointSetMarkers.remove();
+    workArea.remove();
+    disjointSetTable.remove();
+    cout << "Partition " << partition << " has " << vertexCount << " vertices. Found " <<
+        badDisjointSetCount << " bad disjoint sets with more than one marker on a single read." << endl;
+}
+
+
+
+// Count the oriented markers of each partition in each batch.
+// The batches returned by getNextBatch can span more than
+// one partitioning batch, but their boundaries are multiples of
+// the batch size.
+void Assembler::createMarkerGraphVerticesPartitionThreadFunction1(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    const uint64_t batchSize = data.partitionBatchSize;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t batchBegin=begin; batchBegin<end; batchBegin+=batchSize) {
+            const uint64_t batchEnd = min(end, batchBegin + batchSize);
+            uint64_t* batchCount = &data.partitionBatchCount[(batchBegin / batchSize) * data.partitionCount];
+            for(MarkerId i=batchBegin; i!=batchEnd; ++i) {
+                ++batchCount[getMarkerPartition(i)];
+            }
+        }
+    }
+}
+
+
+
+// Store the oriented markers of each partition, starting each batch
+// at the position computed by the prefix sum.
+void Assembler::createMarkerGraphVerticesPartitionThreadFunction2(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    const uint64_t batchSize = data.partitionBatchSize;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t batchBegin=begin; batchBegin<end; batchBegin+=batchSize) {
+            const uint64_t batchEnd = min(end, batchBegin + batchSize);
+            uint64_t* next = &data.partitionBatchCount[(batchBegin / batchSize) * data.partitionCount];
+            for(MarkerId i=batchBegin; i!=batchEnd; ++i) {
+                const uint64_t partition = getMarkerPartition(i);
+                data.partitionMarkers.begin(partition)[next[partition]++] = i;
+            }
+        }
+    }
+}
+
+
+
+// Apply the union operations of the current partition.
+void Assembler::createMarkerGraphVerticesPartitionUnionThreadFunction(size_t threadId)
+{
+    auto& data = createMarkerGraphVerticesData;
+    if(data.disjointSets32Pointer) {
+        createMarkerGraphVerticesPartitionUnionThreadFunctionTemplate(*data.disjointSets32Pointer);
+    } else {
+        createMarkerGraphVerticesPartitionUnionThreadFunctionTemplate(*data.disjointSetsPointer);
+    }
+}
+
+
+
+template<class DisjointSetsType> void Assembler::createMarkerGraphVerticesPartitionUnionThreadFunctionTemplate(
+    DisjointSetsType& disjointSets)
+{
+    const auto& data = createMarkerGraphVerticesData;
+    const MarkerId* markersBegin = data.partitionMarkers.begin(data.currentPartition);
+    const MarkerId* markersEnd = data.partitionMarkers.end(data.currentPartition);
+
+    // Find the position of a marker in the partition.
+    const auto getIndex = [markersBegin, markersEnd](MarkerId markerId)
+    {
+        const MarkerId* it = std::lower_bound(markersBegin, markersEnd, markerId);
+        CZI_ASSERT(it != markersEnd && *it == markerId);
+        return typename DisjointSetsType::Uint(it - markersBegin);
+    };
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; ++i) {
+            const pair<MarkerId, MarkerId>& p = data.partitionUnions[i];
+            disjointSets.unite(getIndex(p.first), getIndex(p.second));
+        }
+    }
+}
+
+
+
+Assembler::CreateMarkerGraphVerticesSpillBuffer::CreateMarkerGraphVerticesSpillBuffer(
+    Assembler& assembler) :
+    assembler(assembler),
+    buffers(assembler.createMarkerGraphVerticesData.partitionCount)
+{
+}
+
+
+
+void Assembler::CreateMarkerGraphVerticesSpillBuffer::unite(MarkerId i, MarkerId j)
+{
+    const uint64_t partition = assembler.getMarkerPartition(i);
+    vector< pair<MarkerId, MarkerId> >& buffer = buffers[partition];
+    buffer.push_back(make_pair(min(i, j), max(i, j)));
+    if(buffer.size() == capacity) {
+        flush(partition);
+    }
+}
+
+
+
+void Assembler::CreateMarkerGraphVerticesSpillBuffer::flush()
+{
+    for(uint64_t partition=0; partition<buffers.size(); partition++) {
+        flush(partition);
+    }
+}
+
+
+
+// Append the buffered union operations of a partition to its spill file.
+void Assembler::CreateMarkerGraphVerticesSpillBuffer::flush(uint64_t partition)
+{
+    vector< pair<MarkerId, MarkerId> >& buffer = buffers[partition];
+    if(buffer.empty()) {
+        return;
+    }
+    auto& data = assembler.createMarkerGraphVerticesData;
+    const char* pointer = reinterpret_cast<const char*>(buffer.data());
+    size_t remainingByteCount = buffer.size() * sizeof(pair<MarkerId, MarkerId>);
+    {
+        std::lock_guard<std::mutex> lock(data.unionSpillMutexes[partition]);
+        while(remainingByteCount > 0) {
+            const ssize_t writtenByteCount = ::write(
+                data.unionSpillFileDescriptors[partition], pointer, remainingByteCount);
+            if(writtenByteCount == -1) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error("Error writing marker graph union spill file: " +
+                    string(::strerror(errno)));
+            }
+            pointer += writtenByteCount;
+            remainingByteCount -= size_t(writtenByteCount);
+        }
+    }
+    buffer.clear();
+}
@@ -0,0 +1,413 @@
+// Shasta.
+#include "Assembler.hpp"
+#include "parallelAlgorithms.hpp"
+#include "permuteMemoryMapped.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard libraries.
+#include "algorithm.hpp"
+#include "chrono.hpp"
+#include <cmath>
+#include "iostream.hpp"
+
+
+
+/*******************************************************************************
+
+Marker graph vertex ids are assigned by createMarkerGraphVertices
+in the order of the disjoint sets, which is unrelated to the topology
+of the marker graph, and edge ids follow the ids of their source vertices.
+As a result, the stages that walk chains of the marker graph
+(transitive reduction, pruning, bubble removal, assembly graph creation)
+and the extraction of local marker graphs access memory at random.
+
+renumberMarkerGraph assigns new vertex ids in an approximate
+topological order of the marker graph (see computeMarkerGraphRenumbering),
+so consecutive vertices of a chain get consecutive ids.
+The edges are then renumbered so they remain sorted by source vertex
+and, for each source vertex, by target vertex,
+as they are when created by createMarkerGraphEdges
+(see computeMarkerGraphEdgeRenumbering). The edges of a chain
+therefore also get consecutive ids.
+
+All data indexed by VertexId or EdgeId, or containing them,
+are rewritten consistently, as in renumberReads
+(see permuteMemoryMapped.hpp):
+- The vertices, the vertex table, and the reverse complement vertices.
+- The edges, including their flags, and the edge flag bitmaps.
+- The edge marker intervals, in whichever representation they are stored.
+- The reverse complement edges.
+- The bad vertex bitmap, and the edges by source and by target,
+  with their compact versions, which are recreated.
+
+*******************************************************************************/
+
+
+
+void Assembler::renumberMarkerGraph(size_t threadCount)
+{
+    const auto t0 = steady_clock::now();
+    using VertexId = MarkerGraph::VertexId;
+    using EdgeId = MarkerGraph::EdgeId;
+
+    // Check that we have what we need.
+    checkMarkersAreOpen();
+    checkMarkerGraphVerticesAreAvailable();
+    checkMarkerGraphEdgesIsOpen();
+    if(!markerGraph.reverseComplementVertex.isOpen || !markerGraph.reverseComplementEdge.isOpen) {
+        throw runtime_error("Renumbering the marker graph requires "
+            "the reverse complement marker graph vertices and edges.");
+    }
+    if(!markerGraph.edgeMarkerIntervals.isOpen() && !markerGraph.compactEdgeMarkerIntervals.isOpen()) {
+        throw runtime_error("Marker graph edge marker intervals are not accessible.");
+    }
+    if(assemblyGraph.edges.isOpen ||
+        markerGraph.vertexRepeatCounts.isOpen ||
+        markerGraph.edgeConsensus.isOpen() ||
+        markerGraph.coverageDataIsOpen()) {
+        throw runtime_error("The marker graph cannot be renumbered after "
+            "the assembly graph or marker graph consensus are created.");
+    }
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+#ifndef SHASTA_STATIC_EXECUTABLE
+    clearHttpResponseCache();
+#endif
+    const VertexId vertexCount = markerGraph.vertices.size();
+    const EdgeId edgeCount = markerGraph.edges.size();
+    ParallelRunner runner;
+    const size_t vertexThreadCount = parallelAlgorithms::adjustThreadCount(threadCount, vertexCount);
+    const size_t edgeThreadCount = parallelAlgorithms::adjustThreadCount(threadCount, edgeCount);
+
+    // Compute the new order of the vertices and edges.
+    MemoryMapped::Vector<VertexId> oldVertexIds;
+    MemoryMapped::Vector<VertexId> newVertexIds;
+    oldVertexIds.createNew(largeDataName("tmp-RenumberMarkerGraph-OldVertexIds"),
+        largeDataPageSize, vertexCount);
+    newVertexIds.createNew(largeDataName("tmp-RenumberMarkerGraph-NewVertexIds"),
+        largeDataPageSize, vertexCount);
+    computeMarkerGraphRenumbering(oldVertexIds, newVertexIds);
+    MemoryMapped::Vector<EdgeId> oldEdgeIds;
+    MemoryMapped::Vector<EdgeId> newEdgeIds;
+    oldEdgeIds.createNew(largeDataName("tmp-RenumberMarkerGraph-OldEdgeIds"),
+        largeDataPageSize, edgeCount);
+    newEdgeIds.createNew(largeDataName("tmp-RenumberMarkerGraph-NewEdgeIds"),
+        largeDataPageSize, edgeCount);
+    computeMarkerGraphEdgeRenumbering(oldVertexIds, newVertexIds, oldEdgeIds, newEdgeIds, threadCount);
+
+    // Measure the locality of the edges before and after renumbering.
+    double oldDistanceSum = 0.;
+    double newDistanceSum = 0.;
+    for(const MarkerGraph::Edge& edge: markerGraph.edges) {
+        const VertexId vertexId0 = edge.source;
+        const VertexId vertexId1 = edge.target;
+        oldDistanceSum += std::fabs(double(vertexId0) - double(vertexId1));
+        newDistanceSum += std::fabs(double(newVertexIds[vertexId0]) - double(newVertexIds[vertexId1]));
+    }
+    if(edgeCount > 0) {
+        cout << timestamp << "Average vertex id distance of marker graph edges: " <<
+            oldDistanceSum / double(edgeCount) << " before renumbering, " <<
+            newDistanceSum / double(edgeCount) << " after renumbering." << endl;
+    }
+
+
+
+    // Edge marker intervals. They are stored in the new order,
+    // in the same representation, in a temporary, which requires
+    // the old reverse complement edges.
+    cout << timestamp << "Renumbering marker graph edge marker intervals." << endl;
+    const bool isCanonical = markerGraph.edgeMarkerIntervalsAreCanonical;
+    const bool isCompressed = markerGraph.compactEdgeMarkerIntervals.isOpen();
+    const auto isStored = [&](EdgeId edgeId)
+    {
+        return
+            !isCanonical ||
+            edgeId < newEdgeIds[markerGraph.reverseComplementEdge[oldEdgeIds[edgeId]]];
+    };
+    MemoryMapped::VectorOfVectors<MarkerInterval, uint64_t> permutedEdgeMarkerIntervals;
+    permutedEdgeMarkerIntervals.createNew(
+        largeDataName("tmp-RenumberMarkerGraph-EdgeMarkerIntervals"), largeDataPageSize);
+    permutedEdgeMarkerIntervals.beginPass1(edgeCount);
+    for(EdgeId edgeId=0; edgeId<edgeCount; edgeId++) {
+        if(isStored(edgeId)) {
+            permutedEdgeMarkerIntervals.incrementCount(edgeId,
+                getMarkerGraphEdgeMarkerIntervalCount(oldEdgeIds[edgeId]));
+        }
+    }
+    permutedEdgeMarkerIntervals.beginPass2();
+    permutedEdgeMarkerIntervals.endPass2(false);
+    runner.runOnRanges(edgeThreadCount, edgeCount,
+        [&](size_t begin, size_t end)
+        {
+            vector<MarkerInterval> markerIntervals;
+            for(EdgeId edgeId=begin; edgeId!=end; edgeId++) {
+                if(isStored(edgeId)) {
+                    getMarkerGraphEdgeMarkerIntervals(oldEdgeIds[edgeId], markerIntervals);
+                    copy(markerIntervals.begin(), markerIntervals.end(),
+                        permutedEdgeMarkerIntervals.begin(edgeId));
+                }
+            }
+        });
+    const string edgeMarkerIntervalsName = isCanonical ?
+        "GlobalMarkerGraphEdgeMarkerIntervalsCanonical" :
+        "GlobalMarkerGraphEdgeMarkerIntervals";
+    if(isCompressed) {
+        markerGraph.compactEdgeMarkerIntervals.remove();
+        markerGraph.compactEdgeMarkerIntervals.createNew(permutedEdgeMarkerIntervals,
+            largeDataName(edgeMarkerIntervalsName + "Compact"), largeDataPageSize, threadCount);
+    } else {
+        markerGraph.edgeMarkerIntervals.remove();
+        markerGraph.edgeMarkerIntervals.createNew(
+            largeDataName(edgeMarkerIntervalsName), largeDataPageSize);
+        copyVectors(permutedEdgeMarkerIntervals, 0, markerGraph.edgeMarkerIntervals, threadCount);
+    }
+    permutedEdgeMarkerIntervals.remove();
+
+
+
+    // Edges. Their flags are copied with them,
+    // and the edge flag bitmaps are recreated from them.
+    cout << timestamp << "Renumbering marker graph edges." << endl;
+    {
+        MemoryMapped::Vector<MarkerGraph::Edge> previousEdges;
+        recreateVector(markerGraph.edges, previousEdges, largeDataName("GlobalMarkerGraphEdges"),
+            largeDataName("tmp-RenumberMarkerGraph-Edges"), largeDataPageSize);
+        runner.runOnRanges(edgeThreadCount, edgeCount,
+            [&](size_t begin, size_t end)
+            {
+                for(EdgeId edgeId=begin; edgeId!=end; edgeId++) {
+                    MarkerGraph::Edge& edge = markerGraph.edges[edgeId];
+                    edge = previousEdges[oldEdgeIds[edgeId]];
+                    edge.source = newVertexIds[edge.source];
+                    edge.target = newVertexIds[edge.target];
+                }
+            });
+        previousEdges.remove();
+    }
+    markerGraph.edgeFlagBitmaps.remove();
+    markerGraph.edgeFlagBitmaps.createNew(
+        largeDataName("GlobalMarkerGraphEdgeFlagBitmaps"), largeDataPageSize, edgeCount);
+    markerGraph.storeEdgeFlagBitmaps();
+
+    // Reverse complement edges.
+    {
+        MemoryMapped::Vector<EdgeId> previousReverseComplementEdge;
+        recreateVector(markerGraph.reverseComplementEdge, previousReverseComplementEdge,
+            largeDataName("MarkerGraphReverseComplementeEdge"),
+            largeDataName("tmp-RenumberMarkerGraph-ReverseComplementEdge"), largeDataPageSize);
+        runner.runOnRanges(edgeThreadCount, edgeCount,
+            [&](size_t begin, size_t end)
+            {
+                for(EdgeId edgeId=begin; edgeId!=end; edgeId++) {
+                    markerGraph.reverseComplementEdge[edgeId] =
+                        newEdgeIds[previousReverseComplementEdge[oldEdgeIds[edgeId]]];
+                }
+            });
+        previousReverseComplementEdge.remove();
+    }
+
+
+
+    // Vertices.
+    cout << timestamp << "Renumbering marker graph vertices." << endl;
+    permuteVectors(markerGraph.vertices, oldVertexIds.begin(), largeDataName("MarkerGraphVertices"),
+        largeDataName("tmp-RenumberMarkerGraph-Vertices"), largeDataPageSize, threadCount);
+
+    // The vertex table is recreated from the renumbered vertices.
+    const uint64_t markerCount = markerGraph.vertexTable.size();
+    markerGraph.vertexTable.remove();
+    markerGraph.vertexTable.createNew(largeDataName("MarkerGraphVertexTable"),
+        largeDataPageSize, markerCount);
+    runner.runOnRanges(parallelAlgorithms::adjustThreadCount(threadCount, markerCount), markerCount,
+        [&](size_t begin, size_t end)
+        {
+            fill(markerGraph.vertexTable.begin() + begin, markerGraph.vertexTable.begin() + end,
+                MarkerGraph::invalidCompressedVertexId);
+        });
+    runner.runOnRanges(vertexThreadCount, vertexCount,
+        [&](size_t begin, size_t end)
+        {
+            for(VertexId vertexId=begin; vertexId!=end; vertexId++) {
+                for(const MarkerId markerId: markerGraph.vertices[vertexId]) {
+                    markerGraph.vertexTable[markerId] = vertexId;
+                }
+            }
+        });
+
+    // Reverse complement vertices.
+    {
+        MemoryMapped::Vector<VertexId> previousReverseComplementVertex;
+        recreateVector(markerGraph.reverseComplementVertex, previousReverseComplementVertex,
+            largeDataName("MarkerGraphReverseComplementeVertex"),
+            largeDataName("tmp-RenumberMarkerGraph-ReverseComplementVertex"), largeDataPageSize);
+        runner.runOnRanges(vertexThreadCount, vertexCount,
+            [&](size_t begin, size_t end)
+            {
+                for(VertexId vertexId=begin; vertexId!=end; vertexId++) {
+                    markerGraph.reverseComplementVertex[vertexId] =
+                        newVertexIds[previousReverseComplementVertex[oldVertexIds[vertexId]]];
+                }
+            });
+        previousReverseComplementVertex.remove();
+    }
+
+    // Recreate the data derived from the vertices and edges.
+    createMarkerGraphIsBadVertexBitmap(threadCount);
+    markerGraph.compactEdgesBySource.remove();
+    markerGraph.compactEdgesByTarget.remove();
+    createMarkerGraphEdgesBySourceAndTarget(threadCount);
+
+    // Clean up.
+    oldVertexIds.remove();
+    newVertexIds.remove();
+    oldEdgeIds.remove();
+    newEdgeIds.remove();
+
+    const auto t1 = steady_clock::now();
+    cout << timestamp << "Renumbering " << vertexCount << " marker graph vertices and " <<
+        edgeCount << " edges took " << seconds(t1 - t0) << " s." << endl;
+}
+
+
+
+// Compute the order of the marker graph vertices after renumbering:
+// oldVertexIds[newVertexId] is the vertex id before renumbering,
+// and newVertexIds is the inverse permutation.
+// The new order is the reverse postorder of a depth first search
+// of the marker graph. This is a topological order if the marker graph
+// is acyclic, and an approximate topological order otherwise,
+// in which only the edges that close cycles go backward.
+// At each vertex, the search continues with the unvisited child
+// reached by the edge with the lowest coverage, so the child
+// reached by the edge with the highest coverage is visited last
+// and gets the id that immediately follows its parent.
+// This way, the chains of the strong subgraph, which is not known yet
+// when this is called, get consecutive vertex ids, and a low coverage
+// edge that skips vertices of a chain does not interrupt it.
+void Assembler::computeMarkerGraphRenumbering(
+    MemoryMapped::Vector<MarkerGraph::VertexId>& oldVertexIds,
+    MemoryMapped::Vector<MarkerGraph::VertexId>& newVertexIds) const
+{
+    using VertexId = MarkerGraph::VertexId;
+    using EdgeId = MarkerGraph::EdgeId;
+    const VertexId vertexCount = markerGraph.vertices.size();
+    CZI_ASSERT(oldVertexIds.size() == vertexCount);
+    CZI_ASSERT(newVertexIds.size() == vertexCount);
+    cout << timestamp << "Computing the new order of " << vertexCount <<
+        " marker graph vertices." << endl;
+
+    // During the search, newVertexIds marks the vertices
+    // not yet visited and the vertices on the stack.
+    const VertexId notVisited = MarkerGraph::invalidVertexId;
+    const VertexId onStack = MarkerGraph::invalidVertexId - 1;
+    fill(newVertexIds.begin(), newVertexIds.end(), notVisited);
+
+    // Return the unvisited child of a vertex reached by
+    // the edge with the lowest coverage, or notVisited if there is none.
+    const auto nextChild = [&](VertexId vertexId0)
+    {
+        VertexId bestVertexId = notVisited;
+        uint8_t bestCoverage = 0;
+        for(const EdgeId edgeId: markerGraph.compactEdgesBySource[vertexId0]) {
+            const MarkerGraph::Edge& edge = markerGraph.edges[edgeId];
+            const VertexId vertexId1 = edge.target;
+            if(newVertexIds[vertexId1] != notVisited) {
+                continue;
+            }
+            if(bestVertexId == notVisited || edge.coverage < bestCoverage ||
+                (edge.coverage == bestCoverage && vertexId1 < bestVertexId)) {
+                bestVertexId = vertexId1;
+                bestCoverage = edge.coverage;
+            }
+        }
+        return bestVertexId;
+    };
+
+    // The vertices are numbered in decreasing order as they are finished.
+    VertexId finishedCount = 0;
+    vector<VertexId> stack;
+    for(VertexId startVertexId=0; startVertexId<vertexCount; startVertexId++) {
+        if(newVertexIds[startVertexId] != notVisited) {
+            continue;
+        }
+        newVertexIds[startVertexId] = onStack;
+        stack.push_back(startVertexId);
+        while(!stack.empty()) {
+            const VertexId vertexId0 = stack.back();
+            const VertexId vertexId1 = nextChild(vertexId0);
+            if(vertexId1 == notVisited) {
+                stack.pop_back();
+                const VertexId newVertexId = vertexCount - 1 - finishedCount++;
+                newVertexIds[vertexId0] = newVertexId;
+                oldVertexIds[newVertexId] = vertexId0;
+            } else {
+                newVertexIds[vertexId1] = onStack;
+                stack.push_back(vertexId1);
+            }
+        }
+    }
+    CZI_ASSERT(finishedCount == vertexCount);
+}
+
+
+
+// Compute the order of the marker graph edges after renumbering,
+// given the new order of the vertices: oldEdgeIds[newEdgeId]
+// is the edge id before renumbering, and newEdgeIds is the inverse permutation.
+// The edges are sorted by new source vertex and, for each source vertex,
+// by new target vertex.
+void Assembler::computeMarkerGraphEdgeRenumbering(
+    const MemoryMapped::Vector<MarkerGraph::VertexId>& oldVertexIds,
+    const MemoryMapped::Vector<MarkerGraph::VertexId>& newVertexIds,
+    MemoryMapped::Vector<MarkerGraph::EdgeId>& oldEdgeIds,
+    MemoryMapped::Vector<MarkerGraph::EdgeId>& newEdgeIds,
+    size_t threadCount) const
+{
+    using VertexId = MarkerGraph::VertexId;
+    using EdgeId = MarkerGraph::EdgeId;
+    const VertexId vertexCount = markerGraph.vertices.size();
+    const EdgeId edgeCount = markerGraph.edges.size();
+    CZI_ASSERT(oldEdgeIds.size() == edgeCount);
+    CZI_ASSERT(newEdgeIds.size() == edgeCount);
+    ParallelRunner runner;
+    const size_t vertexThreadCount = parallelAlgorithms::adjustThreadCount(threadCount, vertexCount);
+
+    // The first new edge id of each new source vertex.
+    MemoryMapped::Vector<EdgeId> edgeBegin;
+    edgeBegin.createNew(largeDataName("tmp-RenumberMarkerGraph-EdgeBegin"),
+        largeDataPageSize, vertexCount);
+    runner.runOnRanges(vertexThreadCount, vertexCount,
+        [&](size_t begin, size_t end)
+        {
+            for(VertexId vertexId=begin; vertexId!=end; vertexId++) {
+                edgeBegin[vertexId] = markerGraph.compactEdgesBySource.size(oldVertexIds[vertexId]);
+            }
+        });
+    const EdgeId totalEdgeCount = parallelExclusiveScan(
+        edgeBegin.begin(), edgeBegin.end(), edgeBegin.begin(), EdgeId(0), threadCount);
+    CZI_ASSERT(totalEdgeCount == edgeCount);
+
+    // Sort the edges of each source vertex by new target vertex.
+    runner.runOnRanges(vertexThreadCount, vertexCount,
+        [&](size_t begin, size_t end)
+        {
+            vector< pair<VertexId, EdgeId> > edges;
+            for(VertexId vertexId=begin; vertexId!=end; vertexId++) {
+                edges.clear();
+                for(const EdgeId edgeId: markerGraph.compactEdgesBySource[oldVertexIds[vertexId]]) {
+                    edges.push_back(make_pair(newVertexIds[markerGraph.edges[edgeId].target], edgeId));
+                }
+                sort(edges.begin(), edges.end());
+                EdgeId newEdgeId = edgeBegin[vertexId];
+                for(const auto& p: edges) {
+                    oldEdgeIds[newEdgeId] = p.second;
+                    newEdgeIds[p.second] = newEdgeId;
+                    ++newEdgeId;
+                }
+            }
+        });
+    edgeBegin.remove();
+}
@@ -2,23 +2,41 @@
 #include "Assembler.hpp"
 #include "findMarkerId.hpp"
 #include "MarkerFinder.hpp"
+#include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
+// Standard libraries.
+#include "chrono.hpp"
 
 
-void Assembler::findMarkers(size_t threadCount)
+
+void Assembler::findMarkers(size_t threadCount, bool strandImplicit)
 {
     checkReadsAreOpen();
     checkKmersAreOpen();
 
+    // Any previously sorted markers are no longer valid.
+    if(sortedMarkers.isOpen()) {
+        sortedMarkers.remove();
+    }
+    if(compactMarkers.isOpen()) {
+        compactMarkers.remove();
+    }
+    markerIdIndex.clear();
+
     markers.createNew(largeDataName("Markers"), largeDataPageSize);
     MarkerFinder markerFinder(
         assemblerInfo->k,
-        kmerTable,
+        getMarkerKmers(),
         reads,
         markers,
-        threadCount);
+        threadCount,
+        readFlags.isOpen ? &readFlags : 0,
+        strandImplicit);
+    if(strandImplicit) {
+        cout << "Markers were stored for strand 0 only." << endl;
+    }
 
 }
 
@@ -27,6 +45,7 @@ void Assembler::findMarkers(size_t threadCount)
 void Assembler::accessMarkers()
 {
     markers.accessExistingReadOnly(largeDataName("Markers"));
+    markerIdIndex.clear();
 }
 
 void Assembler::checkMarkersAreOpen() const
@@ -37,6 +56,29 @@ void Assembler::checkMarkersAreOpen() const
 }
 
 
+
+// Used by code that can use either the markers or the compact markers.
+void Assembler::checkMarkersOrCompactMarkersAreOpen() const
+{
+    if(!compactMarkers.isOpen()) {
+        checkMarkersAreOpen();
+    }
+}
+
+
+
+// Used by code that accesses the markers by global marker id,
+// which requires markers stored for both strands.
+void Assembler::checkMarkersAreNotStrandImplicit() const
+{
+    checkMarkersAreOpen();
+    if(markersAreStrandImplicit()) {
+        throw runtime_error("This requires markers stored for both strands. "
+            "Run findMarkers with strandImplicit=False.");
+    }
+}
+
+
 void Assembler::writeMarkers(ReadId readId, Strand strand, const string& fileName)
 {
     // Check that we have what we need.
@@ -47,13 +89,13 @@ void Assembler::writeMarkers(ReadId readId, Strand strand, const string& fileNam
 
     // Get the markers.
     const OrientedReadId orientedReadId(readId, strand);
-    const auto orientedReadMarkers = markers[orientedReadId.getValue()];
+    const OrientedReadMarkers orientedReadMarkers = getOrientedReadMarkers(orientedReadId);
 
     // Write them out.
     ofstream csv(fileName);
     csv << "MarkerId,Ordinal,KmerId,Kmer,Position\n";
     for(uint32_t ordinal=0; ordinal<orientedReadMarkers.size(); ordinal++) {
-        const CompressedMarker& marker = orientedReadMarkers[ordinal];
+        const Marker marker = orientedReadMarkers[ordinal];
         const MarkerId markerId = getMarkerId(orientedReadId, ordinal);
         csv << markerId << ",";
         csv << ordinal << ",";
@@ -70,13 +112,32 @@ void Assembler::getMarkersSortedByKmerId(
     OrientedReadId orientedReadId,
     vector<MarkerWithOrdinal>& markersSortedByKmerId) const
 {
-    const auto compressedMarkers = markers[orientedReadId.getValue()];
+    // If the sorted markers were precomputed, just copy them.
+    if(sortedMarkers.isOpen()) {
+        const MarkerWithOrdinal* begin = sortedMarkers.begin(orientedReadId.getValue());
+        const MarkerWithOrdinal* end = sortedMarkers.end(orientedReadId.getValue());
+        markersSortedByKmerId.assign(begin, end);
+    } else if(compactMarkers.isOpen()) {
+        compactMarkers.getMarkersSortedByKmerId(orientedReadId, markersSortedByKmerId);
+    } else {
+        computeMarkersSortedByKmerId(orientedReadId, markersSortedByKmerId);
+    }
+}
+
+
+
+// Compute markers sorted by KmerId for a given OrientedReadId,
+// without using sortedMarkers.
+void Assembler::computeMarkersSortedByKmerId(
+    OrientedReadId orientedReadId,
+    vector<MarkerWithOrdinal>& markersSortedByKmerId) const
+{
+    const OrientedReadMarkers orientedReadMarkers = getOrientedReadMarkers(orientedReadId);
     markersSortedByKmerId.clear();
-    markersSortedByKmerId.resize(compressedMarkers.size());
+    markersSortedByKmerId.resize(orientedReadMarkers.size());
 
-    for(uint32_t ordinal=0; ordinal<compressedMarkers.size(); ordinal++) {
-        const CompressedMarker& compressedMarker = compressedMarkers[ordinal];
-        markersSortedByKmerId[ordinal] = MarkerWithOrdinal(compressedMarker, ordinal);
+    for(uint32_t ordinal=0; ordinal<orientedReadMarkers.size(); ordinal++) {
+        markersSortedByKmerId[ordinal] = MarkerWithOrdinal(orientedReadMarkers[ordinal], ordinal);
     }
 
     // Sort by kmerId.
@@ -85,11 +146,162 @@ void Assembler::getMarkersSortedByKmerId(
 
 
 
+// Precompute the markers of each oriented read sorted by KmerId.
+void Assembler::computeSortedMarkers(size_t threadCount)
+{
+    cout << timestamp << "Sorting markers by k-mer id." << endl;
+    const auto tBegin = steady_clock::now();
+    checkMarkersAreOpen();
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // The sorted markers are always stored for both strands,
+    // even if the markers are strand implicit.
+    sortedMarkers.createNew(largeDataName("SortedMarkers"), largeDataPageSize);
+    const uint64_t orientedReadCount = 2 * reads.size();
+    sortedMarkers.beginPass1(orientedReadCount, threadCount);
+    for(uint64_t i=0; i<orientedReadCount; i++) {
+        sortedMarkers.incrementCount(i, getMarkerCount(OrientedReadId(OrientedReadId::Int(i))));
+    }
+    sortedMarkers.beginPass2(threadCount);
+    sortedMarkers.endPass2(false);
+
+    // Fill them in parallel.
+    setupLoadBalancing(orientedReadCount, 1000);
+    runThreads(&Assembler::computeSortedMarkersThreadFunction, threadCount);
+
+    const auto tEnd = steady_clock::now();
+    cout << timestamp << "Sorting markers by k-mer id completed in " <<
+        seconds(tEnd - tBegin) << " s." << endl;
+}
+
+
+
+void Assembler::computeSortedMarkersThreadFunction(size_t threadId)
+{
+    vector<MarkerWithOrdinal> markersSortedByKmerId;
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over oriented reads of this batch.
+        for(uint64_t i=begin; i!=end; i++) {
+            computeMarkersSortedByKmerId(OrientedReadId(ReadId(i)), markersSortedByKmerId);
+            copy(markersSortedByKmerId.begin(), markersSortedByKmerId.end(),
+                sortedMarkers.begin(i));
+        }
+    }
+}
+
+
+
+void Assembler::accessSortedMarkers()
+{
+    sortedMarkers.accessExistingReadOnly(largeDataName("SortedMarkers"));
+}
+
+
+
+// Create a compact copy of the markers and verify that
+// it gives the same results as the markers.
+void Assembler::compressMarkers(size_t threadCount, bool releaseMarkers)
+{
+    checkKmersAreOpen();
+    checkMarkersAreNotStrandImplicit();
+    if(compactMarkers.isOpen()) {
+        compactMarkers.remove();
+    }
+    compactMarkers.createNew(markers, getMarkerKmers(), assemblerInfo->k,
+        largeDataName("CompactMarkers"), largeDataPageSize, threadCount);
+
+    cout << timestamp << "Verifying compact markers." << endl;
+    CZI_ASSERT(compactMarkers.size() == markers.size());
+    CZI_ASSERT(compactMarkers.totalSize() == markers.totalSize());
+    vector<Marker> decodedMarkers;
+    vector<KmerId> kmerIds;
+    for(ReadId readId=0; readId<reads.size(); readId++) {
+        for(Strand strand=0; strand<2; strand++) {
+            const OrientedReadId orientedReadId(readId, strand);
+            const uint64_t i = orientedReadId.getValue();
+            const uint64_t n = markers.size(i);
+            compactMarkers.get(orientedReadId, decodedMarkers);
+            compactMarkers.getKmerIds(orientedReadId, kmerIds);
+            CZI_ASSERT(decodedMarkers.size() == n);
+            CZI_ASSERT(kmerIds.size() == n);
+            for(uint32_t ordinal=0; ordinal<n; ordinal++) {
+                const CompressedMarker& marker = markers.begin(i)[ordinal];
+                CZI_ASSERT(decodedMarkers[ordinal].kmerId == marker.kmerId);
+                CZI_ASSERT(decodedMarkers[ordinal].position == marker.position);
+                CZI_ASSERT(kmerIds[ordinal] == marker.kmerId);
+                CZI_ASSERT(compactMarkers.getMarkerId(orientedReadId, ordinal) ==
+                    MarkerId(markers.begin(i) - markers.begin()) + ordinal);
+                const Marker singleMarker = compactMarkers.get(orientedReadId, ordinal);
+                CZI_ASSERT(singleMarker.kmerId == marker.kmerId);
+                CZI_ASSERT(singleMarker.position == marker.position);
+            }
+        }
+    }
+    cout << timestamp << "Compact markers verified." << endl;
+
+    if(releaseMarkers) {
+        markers.close();
+        markerIdIndex.clear();
+        cout << "Markers were released. "
+            "Use accessMarkers to access them again if needed." << endl;
+    }
+}
+
+
+
+void Assembler::accessCompactMarkers()
+{
+    compactMarkers.accessExistingReadOnly(largeDataName("CompactMarkers"));
+}
+
+
+
+
+
+void Assembler::createMarkerKmerIndex(size_t threadCount)
+{
+    checkReadsAreOpen();
+    checkKmersAreOpen();
+    checkMarkersAreOpen();
+    if(markerKmerIndex.isOpen()) {
+        markerKmerIndex.remove();
+    }
+    markerKmerIndex.createNew(markers, ReadId(reads.size()), assemblerInfo->k,
+        largeDataName("MarkerKmerIndex"), largeDataPageSize, threadCount);
+}
+
+
+
+void Assembler::accessMarkerKmerIndex()
+{
+    markerKmerIndex.accessExistingReadOnly(largeDataName("MarkerKmerIndex"));
+}
+
+
+
 // Given a marker by its OrientedReadId and ordinal,
 // return the corresponding global marker id.
 MarkerId Assembler::getMarkerId(
     OrientedReadId orientedReadId, uint32_t ordinal) const
 {
+    if(compactMarkers.isOpen()) {
+        return compactMarkers.getMarkerId(orientedReadId, ordinal);
+    }
+    if(markersAreStrandImplicit()) {
+        const ReadId readId = orientedReadId.getReadId();
+        return
+            2 * MarkerId(markers.begin(readId) - markers.begin()) +
+            (orientedReadId.getStrand() == 1 ? markers.size(readId) : 0)
+            + ordinal;
+    }
     return
         (markers.begin(orientedReadId.getValue()) - markers.begin())
         + ordinal;
@@ -99,13 +311,17 @@ MarkerId Assembler::getMarkerId(
 
 // Inverse of the above: given a global marker id,
 // return its OrientedReadId and ordinal.
-// This requires a binary search in the markers toc.
-// This could be avoided, at the cost of storing
-// an additional 4 bytes per marker.
 pair<OrientedReadId, uint32_t>
     Assembler::findMarkerId(MarkerId markerId) const
 {
-    return shasta::findMarkerId(markerId, markers);
+    if(!markerIdIndex.isAvailable()) {
+        checkMarkersAreNotStrandImplicit();
+        std::lock_guard<std::mutex> lock(markerIdIndexMutex);
+        if(!markerIdIndex.isAvailable()) {
+            markerIdIndex.create(markers);
+        }
+    }
+    return markerIdIndex.find(markerId, markers);
 }
 
 
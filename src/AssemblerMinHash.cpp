@@ -1,5 +1,5 @@
 #include "Assembler.hpp"
-#include "MinHash.hpp"
+#include "LowHash.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
@@ -8,62 +8,59 @@ using namespace shasta;
 
 // Use the minHash algorithm to find alignment candidates.
 // Use as features sequences of m consecutive special k-mers.
+// This runs the LowHash engine in bottom-k mode: at each iteration,
+// each oriented read contributes its sketchSize lowest feature hashes.
+// With sketchSize 1, this is the classical MinHash algorithm.
 void Assembler::findAlignmentCandidatesMinHash(
     size_t m,                       // Number of consecutive k-mers that define a feature.
     size_t minHashIterationCount,   // Number of minHash iterations.
     size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for minHash.
     size_t maxBucketSize,           // The maximum size for a bucket to be used.
     size_t minFrequency,            // Minimum number of minHash hits for a pair to become a candidate.
+    size_t sketchSize,              // Number of lowest hashes used for each oriented read at each iteration.
+    size_t lowHashMethod,           // 0 = use buckets, 1 = sort the hashes.
     size_t threadCount
 )
 {
+    // Check that we have what we need.
     checkKmersAreOpen();
-    checkMarkersAreOpen();
-    const ReadId readCount = ReadId(markers.size() / 2);
+    checkMarkersOrCompactMarkersAreOpen();
+    const ReadId readCount = ReadId(reads.size());
     CZI_ASSERT(readCount > 0);
-
-
-
-    // If log2MinHashBucketCount is 0, choose a reasonable value
-    // for the current number of reads.
-    if(log2MinHashBucketCount == 0) {
-
-        // Compute an approximate base 2 log of the number of reads.
-        static_assert(sizeof(readCount) == 4, "Unexpected readCount size.");
-        const int leadingZeroBitCount = __builtin_clz(readCount);
-        const int log2ReadCount = 32 - leadingZeroBitCount;
-
-        // Make log2MinHashBucketCount reasonably larger
-        // than the approximate base 2 log of the number of reads.
-        log2MinHashBucketCount = 5 + log2ReadCount;
-
-        cout << "Set log2MinHashBucketCount to " << log2MinHashBucketCount << endl;
+    if(sketchSize == 0) {
+        throw runtime_error("MinHash sketch size must be at least 1.");
     }
 
-
-
-    // Check that log2MinHashBucketCount is not unreasonably small.
-    if((1ULL << (log2MinHashBucketCount-3ULL)) < readCount) {
-        throw runtime_error("log2MinHashBucketCount is unreasonably small.\n"
-            "Must at least equal base 2 log of number of reads plus 3.");
+    // Each iteration scans the markers of all reads in order.
+    if(markers.isOpen()) {
+        markers.adviseAccessPattern(MemoryMapped::AccessPattern::Sequential);
     }
 
     // Create the alignment candidates.
     alignmentCandidates.createNew(largeDataName("AlignmentCandidates"), largeDataPageSize);
 
-    // Run the MinHash computation to find candidate alignments.
-    MinHash minHash(
+    // Run the LowHash computation in bottom-k mode to find candidate alignments.
+    LowHash lowHash(
         m,
+        0.,
         minHashIterationCount,
         log2MinHashBucketCount,
         maxBucketSize,
         minFrequency,
+        lowHashMethod,
+        0,
+        false,
         threadCount,
+        assemblerInfo->k,
         kmerTable,
+        readFlags,
         markers,
+        compactMarkers.isOpen() ? &compactMarkers : 0,
         alignmentCandidates,
         largeDataFileNamePrefix,
-        largeDataPageSize);
+        largeDataPageSize,
+        0, false, 0, 1, 0, 0., nullptr,
+        sketchSize);
 }
 
 
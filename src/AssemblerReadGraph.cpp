@@ -1,8 +1,10 @@
 
 // Shasta.
 #include "Assembler.hpp"
+#include "filesystem.hpp"
 #include "LocalReadGraph.hpp"
 #include "orderPairs.hpp"
+#include "ThreadLog.hpp"
 #include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
@@ -29,96 +31,256 @@ using namespace shasta;
 // For each read, keep only the best maxAlignmentCount alignments.
 // Note that the connectivity of the resulting read graph can
 // be more than maxAlignmentCount.
+// All phases are multithreaded. The result is the same
+// as if it was done sequentially, independently of the number of threads:
+// - Read graph edges are stored in order of alignment id.
+// - In each section of the connectivity, edges
+//   are stored in decreasing order of edge id.
 void Assembler::createReadGraph(
     uint32_t maxAlignmentCount,
-    uint32_t maxTrim)
+    uint32_t maxTrim,
+    size_t threadCount)
 {
+    const auto tBegin = steady_clock::now();
+
     // Find the number of reads and oriented reads.
-    const ReadId orientedReadCount = uint32_t(markers.size());
-    CZI_ASSERT((orientedReadCount % 2) == 0);
-    const ReadId readCount = orientedReadCount / 2;
+    const ReadId readCount = ReadId(reads.size());
+    const ReadId orientedReadCount = 2 * readCount;
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // Store the parameters so all threads can see them.
+    auto& data = createReadGraphData;
+    data.maxAlignmentCount = maxAlignmentCount;
 
     // Mark all alignments as not to be kept.
-    vector<bool> keepAlignment(alignmentData.size(), false);
+    // Bytes are used instead of a vector<bool>,
+    // so different threads can set them without interfering.
+    data.keepAlignment.clear();
+    data.keepAlignment.resize(alignmentData.size(), 0);
+
+    // For each read, mark the best maxAlignmentCount alignments as to be kept.
+    setupLoadBalancing(readCount, 1000);
+    runThreads(&Assembler::createReadGraphThreadFunction1, threadCount);
+
+
+
+    // Count the alignments to be kept in each block of alignment ids.
+    const uint64_t blockSize = CreateReadGraphData::blockSize;
+    const uint64_t blockCount = (alignmentData.size() + blockSize - 1) / blockSize;
+    data.blockEdgeBegin.clear();
+    data.blockEdgeBegin.resize(blockCount + 1, 0);
+    setupLoadBalancing(blockCount, 1);
+    runThreads(&Assembler::createReadGraphThreadFunction2, threadCount);
+
+    // Each kept alignment generates two edges.
+    // Storing them in the same order as the alignments
+    // requires the number of edges generated by the previous blocks.
+    uint64_t edgeCount = 0;
+    for(uint64_t block=0; block<blockCount; block++) {
+        const uint64_t blockEdgeCount = data.blockEdgeBegin[block];
+        data.blockEdgeBegin[block] = edgeCount;
+        edgeCount += blockEdgeCount;
+    }
+    data.blockEdgeBegin[blockCount] = edgeCount;
+    cout << "Keeping " << edgeCount/2 << " alignments of " << alignmentData.size() << endl;
+
+
+
+    // Now we can create the read graph.
+    // Only the alignments we marked as "keep" generate edges in the read graph.
+    readGraph.edges.createNew(largeDataName("ReadGraphEdges"), largeDataPageSize);
+    readGraph.edges.resize(edgeCount);
+    setupLoadBalancing(blockCount, 1);
+    runThreads(&Assembler::createReadGraphThreadFunction3, threadCount);
+
+
+
+    // Create read graph connectivity.
+    const size_t batchSize = 10000;
+    readGraph.connectivity.createNew(largeDataName("ReadGraphConnectivity"), largeDataPageSize);
+    readGraph.connectivity.beginPass1(orientedReadCount);
+    setupLoadBalancing(readGraph.edges.size(), batchSize);
+    runThreads(&Assembler::createReadGraphThreadFunction4, threadCount);
+    readGraph.connectivity.beginPass2();
+    setupLoadBalancing(readGraph.edges.size(), batchSize);
+    runThreads(&Assembler::createReadGraphThreadFunction5, threadCount);
+    readGraph.connectivity.endPass2();
+
+    // Sort each section of the connectivity.
+    setupLoadBalancing(orientedReadCount, 1000);
+    runThreads(&Assembler::createReadGraphThreadFunction6, threadCount);
+
+    // Create the compact adjacency representation.
+    readGraph.createNeighbors(largeDataName("ReadGraphNeighbors"), largeDataPageSize);
+
+    data.keepAlignment.clear();
+    data.keepAlignment.shrink_to_fit();
+    data.blockEdgeBegin.clear();
+    data.blockEdgeBegin.shrink_to_fit();
+
+    const auto tEnd = steady_clock::now();
+    const double tTotal = seconds(tEnd - tBegin);
+    cout << timestamp << "Creation of the read graph completed in " << tTotal << " s." << endl;
+}
+
+
+
+// Mark the best alignments of each read as to be kept.
+void Assembler::createReadGraphThreadFunction1(size_t threadId)
+{
+    auto& data = createReadGraphData;
+    const uint32_t maxAlignmentCount = data.maxAlignmentCount;
 
     // Vector to keep the alignments for each read,
     // with their number of markers.
     // Contains pairs(marker count, alignment id).
     vector< pair<uint32_t, uint32_t> > readAlignments;
 
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
 
+            // Gather the alignments for this read, each with its number of markers.
+            readAlignments.clear();
+            for(const uint32_t alignmentId: alignmentTable[OrientedReadId(readId, 0).getValue()]) {
+                const AlignmentData& alignment = alignmentData[alignmentId];
+                readAlignments.push_back(make_pair(alignment.info.markerCount, alignmentId));
+            }
 
-    // Loop over reads.
-    for(ReadId readId=0; readId<readCount; readId++) {
+            // Keep the best maxAlignmentCount.
+            // The pairs are all distinct, so which ones are kept
+            // does not depend on the order in which they are stored.
+            if(readAlignments.size() > maxAlignmentCount) {
+                std::nth_element(
+                    readAlignments.begin(),
+                    readAlignments.begin() + maxAlignmentCount,
+                    readAlignments.end(),
+                    std::greater< pair<uint32_t, uint32_t> >());
+                readAlignments.resize(maxAlignmentCount);
+            }
 
-        // Gather the alignments for this read, each with its number of markers.
-        readAlignments.clear();
-        for(const uint32_t alignmentId: alignmentTable[OrientedReadId(readId, 0).getValue()]) {
-            const AlignmentData& alignment = alignmentData[alignmentId];
-            readAlignments.push_back(make_pair(alignment.info.markerCount, alignmentId));
+            // Mark the surviving alignments as to be kept.
+            // The same alignment can be marked by both of its reads,
+            // possibly in different threads.
+            for(const auto& p: readAlignments) {
+                const uint32_t alignmentId = p.second;
+                __sync_fetch_and_or(&data.keepAlignment[alignmentId], uint8_t(1));
+            }
         }
+    }
+}
 
-        // Keep the best maxAlignmentCount.
-        if(readAlignments.size() > maxAlignmentCount) {
-            std::nth_element(
-                readAlignments.begin(),
-                readAlignments.begin() + maxAlignmentCount,
-                readAlignments.end(),
-                std::greater< pair<uint32_t, uint32_t> >());
-            readAlignments.resize(maxAlignmentCount);
-        }
 
-        // Mark the surviving alignments as to be kept.
-        for(const auto& p: readAlignments) {
-            const uint32_t alignmentId = p.second;
-            keepAlignment[alignmentId] = true;
+
+// Count the read graph edges generated by each block of alignments.
+void Assembler::createReadGraphThreadFunction2(size_t threadId)
+{
+    auto& data = createReadGraphData;
+    const uint64_t blockSize = CreateReadGraphData::blockSize;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t block=begin; block!=end; block++) {
+            const uint64_t alignmentIdBegin = block * blockSize;
+            const uint64_t alignmentIdEnd = min(alignmentIdBegin + blockSize, uint64_t(alignmentData.size()));
+            uint64_t blockKeepCount = 0;
+            for(uint64_t alignmentId=alignmentIdBegin; alignmentId!=alignmentIdEnd; alignmentId++) {
+                if(data.keepAlignment[alignmentId]) {
+                    ++blockKeepCount;
+                }
+            }
+            data.blockEdgeBegin[block] = 2 * blockKeepCount;
         }
     }
-    const size_t keepCount = count(keepAlignment.begin(), keepAlignment.end(), true);
-    cout << "Keeping " << keepCount << " alignments of " << keepAlignment.size() << endl;
+}
 
 
 
-    // Now we can create the read graph.
-    // Only the alignments we marked as "keep" generate edges in the read graph.
-    readGraph.edges.createNew(largeDataName("ReadGraphEdges"), largeDataPageSize);
-    for(size_t alignmentId=0; alignmentId<alignmentData.size(); alignmentId++) {
-        if(!keepAlignment[alignmentId]) {
-            continue;
+// Store the read graph edges generated by each block of alignments.
+void Assembler::createReadGraphThreadFunction3(size_t threadId)
+{
+    auto& data = createReadGraphData;
+    const uint64_t blockSize = CreateReadGraphData::blockSize;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t block=begin; block!=end; block++) {
+            const uint64_t alignmentIdBegin = block * blockSize;
+            const uint64_t alignmentIdEnd = min(alignmentIdBegin + blockSize, uint64_t(alignmentData.size()));
+            uint64_t edgeId = data.blockEdgeBegin[block];
+            for(uint64_t alignmentId=alignmentIdBegin; alignmentId!=alignmentIdEnd; alignmentId++) {
+                if(!data.keepAlignment[alignmentId]) {
+                    continue;
+                }
+                const AlignmentData& alignment = alignmentData[alignmentId];
+
+                // Create the edge corresponding to this alignment.
+                ReadGraph::Edge edge;
+                edge.alignmentId = alignmentId & 0x7fff'ffff'ffff'ffff;
+                edge.orientedReadIds[0] = OrientedReadId(alignment.readIds[0], 0);
+                edge.orientedReadIds[1] = OrientedReadId(alignment.readIds[1], alignment.isSameStrand ? 0 : 1);
+                CZI_ASSERT(edge.orientedReadIds[0] < edge.orientedReadIds[1]);
+                readGraph.edges[edgeId++] = edge;
+
+                // Also create the reverse complemented edge.
+                edge.orientedReadIds[0].flipStrand();
+                edge.orientedReadIds[1].flipStrand();
+                CZI_ASSERT(edge.orientedReadIds[0] < edge.orientedReadIds[1]);
+                readGraph.edges[edgeId++] = edge;
+            }
+            CZI_ASSERT(edgeId == data.blockEdgeBegin[block+1]);
         }
-        const AlignmentData& alignment = alignmentData[alignmentId];
+    }
+}
 
-        // Create the edge corresponding to this alignment.
-        ReadGraph::Edge edge;
-        edge.alignmentId = alignmentId & 0x7fff'ffff'ffff'ffff;
-        edge.orientedReadIds[0] = OrientedReadId(alignment.readIds[0], 0);
-        edge.orientedReadIds[1] = OrientedReadId(alignment.readIds[1], alignment.isSameStrand ? 0 : 1);
-        CZI_ASSERT(edge.orientedReadIds[0] < edge.orientedReadIds[1]);
-        readGraph.edges.push_back(edge);
 
-        // Also create the reverse complemented edge.
-        edge.orientedReadIds[0].flipStrand();
-        edge.orientedReadIds[1].flipStrand();
-        CZI_ASSERT(edge.orientedReadIds[0] < edge.orientedReadIds[1]);
-        readGraph.edges.push_back(edge);
+
+// Pass 1 and pass 2 of the creation of the read graph connectivity.
+void Assembler::createReadGraphThreadFunction4(size_t threadId)
+{
+    createReadGraphThreadFunction45(4);
+}
+void Assembler::createReadGraphThreadFunction5(size_t threadId)
+{
+    createReadGraphThreadFunction45(5);
+}
+void Assembler::createReadGraphThreadFunction45(int value)
+{
+    CZI_ASSERT(value==4 || value==5);
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const ReadGraph::Edge& edge = readGraph.edges[i];
+            if(value == 4) {
+                readGraph.connectivity.incrementCountMultithreaded(edge.orientedReadIds[0].getValue());
+                readGraph.connectivity.incrementCountMultithreaded(edge.orientedReadIds[1].getValue());
+            } else {
+                readGraph.connectivity.storeMultithreaded(edge.orientedReadIds[0].getValue(), uint32_t(i));
+                readGraph.connectivity.storeMultithreaded(edge.orientedReadIds[1].getValue(), uint32_t(i));
+            }
+        }
     }
+}
 
 
 
-    // Create read graph connectivity.
-    readGraph.connectivity.createNew(largeDataName("ReadGraphConnectivity"), largeDataPageSize);
-    readGraph.connectivity.beginPass1(orientedReadCount);
-    for(const ReadGraph::Edge& edge: readGraph.edges) {
-        readGraph.connectivity.incrementCount(edge.orientedReadIds[0].getValue());
-        readGraph.connectivity.incrementCount(edge.orientedReadIds[1].getValue());
-    }
-    readGraph.connectivity.beginPass2();
-    for(size_t i=0; i<readGraph.edges.size(); i++) {
-        const ReadGraph::Edge& edge = readGraph.edges[i];
-        readGraph.connectivity.store(edge.orientedReadIds[0].getValue(), uint32_t(i));
-        readGraph.connectivity.store(edge.orientedReadIds[1].getValue(), uint32_t(i));
+// Sort each section of the read graph connectivity
+// in decreasing order of edge id. This is the order
+// that a sequential pass 2 generates.
+void Assembler::createReadGraphThreadFunction6(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            auto edgeIds = readGraph.connectivity[uint32_t(i)];
+            sort(edgeIds.begin(), edgeIds.end(), std::greater<uint32_t>());
+        }
     }
-    readGraph.connectivity.endPass2();
 }
 
 
@@ -143,9 +305,8 @@ void Assembler::createReadGraphNew(
     uint32_t maxTrim)
 {
     // Find the number of reads and oriented reads.
-    const ReadId orientedReadCount = uint32_t(markers.size());
-    CZI_ASSERT((orientedReadCount % 2) == 0);
-    const ReadId readCount = orientedReadCount / 2;
+    const ReadId readCount = ReadId(reads.size());
+    const ReadId orientedReadCount = 2 * readCount;
 
     // Mark all alignments as not to be kept.
     vector<bool> keepAlignment(alignmentData.size(), false);
@@ -301,20 +462,40 @@ void Assembler::createReadGraphNew(
         readGraph.connectivity.store(edge.orientedReadIds[1].getValue(), uint32_t(i));
     }
     readGraph.connectivity.endPass2();
+
+    // Create the compact adjacency representation.
+    readGraph.createNeighbors(largeDataName("ReadGraphNeighbors"), largeDataPageSize);
 }
 #endif
 
 
 
+// Assemblies created before the read graph neighbors were stored
+// don't have them. In that case they are recreated from the edges
+// and connectivity: in anonymous memory when accessing read-only,
+// and stored when accessing read-write.
 void Assembler::accessReadGraph()
 {
     readGraph.edges.accessExistingReadOnly(largeDataName("ReadGraphEdges"));
     readGraph.connectivity.accessExistingReadOnly(largeDataName("ReadGraphConnectivity"));
+    if(filesystem::exists(largeDataName("ReadGraphNeighbors") + ".toc")) {
+        readGraph.neighbors.accessExistingReadOnly(largeDataName("ReadGraphNeighbors"));
+    } else {
+        readGraph.createNeighbors("", largeDataPageSize);
+    }
 }
 void Assembler::accessReadGraphReadWrite()
 {
+#ifndef SHASTA_STATIC_EXECUTABLE
+    clearHttpResponseCache();
+#endif
     readGraph.edges.accessExistingReadWrite(largeDataName("ReadGraphEdges"));
     readGraph.connectivity.accessExistingReadWrite(largeDataName("ReadGraphConnectivity"));
+    if(filesystem::exists(largeDataName("ReadGraphNeighbors") + ".toc")) {
+        readGraph.neighbors.accessExistingReadWrite(largeDataName("ReadGraphNeighbors"));
+    } else {
+        readGraph.createNeighbors(largeDataName("ReadGraphNeighbors"), largeDataPageSize);
+    }
 }
 void Assembler::checkReadGraphIsOpen()
 {
@@ -349,7 +530,7 @@ bool Assembler::createLocalReadGraph(
     }
 
     // Add the starting vertex.
-    graph.addVertex(start, uint32_t(markers[start.getValue()].size()),
+    graph.addVertex(start, uint32_t(getMarkerCount(start)),
         readFlags[start.getReadId()].isChimeric, 0);
 
     // Initialize a BFS starting at the start vertex.
@@ -374,16 +555,13 @@ bool Assembler::createLocalReadGraph(
         const uint32_t distance1 = distance0 + 1;
 
         // Loop over edges of the global read graph involving this vertex.
-        for(const uint64_t i: readGraph.connectivity[orientedReadId0.getValue()]) {
-            CZI_ASSERT(i < readGraph.edges.size());
-            const ReadGraph::Edge& globalEdge = readGraph.edges[i];
-
-            if(!allowCrossStrandEdges && globalEdge.crossesStrands) {
+        for(const ReadGraph::Neighbor& neighbor: readGraph.neighbors[orientedReadId0.getValue()]) {
+            if(!allowCrossStrandEdges && neighbor.crossesStrands) {
                 continue;
             }
 
             // Get the other oriented read involved in this edge of the read graph.
-            const OrientedReadId orientedReadId1 = globalEdge.getOther(orientedReadId0);
+            const OrientedReadId orientedReadId1 = neighbor.orientedReadId;
 
             // If this read is flagged chimeric and we don't allow chimeric reads, skip.
             if(!allowChimericReads && readFlags[orientedReadId1.getReadId()].isChimeric) {
@@ -391,6 +569,7 @@ bool Assembler::createLocalReadGraph(
             }
 
             // Get alignment information.
+            const ReadGraph::Edge& globalEdge = readGraph.edges[neighbor.edgeId];
             const AlignmentData& alignment = alignmentData[globalEdge.alignmentId];
             OrientedReadId alignmentOrientedReadId0(alignment.readIds[0], 0);
             OrientedReadId alignmentOrientedReadId1(alignment.readIds[1], alignment.isSameStrand ? 0 : 1);
@@ -414,7 +593,7 @@ bool Assembler::createLocalReadGraph(
             if(distance0 < maxDistance) {
                 if(!graph.vertexExists(orientedReadId1)) {
                     graph.addVertex(orientedReadId1,
-                        uint32_t(markers[orientedReadId1.getValue()].size()),
+                        uint32_t(getMarkerCount(orientedReadId1)),
                         readFlags[orientedReadId1.getReadId()].isChimeric, distance1);
                     q.push(orientedReadId1);
                 }
@@ -423,7 +602,7 @@ bool Assembler::createLocalReadGraph(
                     orientedReadId1,
                     markerCount,
                     alignmentType,
-                    globalEdge.crossesStrands == 1);
+                    neighbor.crossesStrands == 1);
             } else {
                 CZI_ASSERT(distance0 == maxDistance);
                 if(graph.vertexExists(orientedReadId1)) {
@@ -432,7 +611,7 @@ bool Assembler::createLocalReadGraph(
                         orientedReadId1,
                         markerCount,
                         alignmentType,
-                        globalEdge.crossesStrands == 1);
+                        neighbor.crossesStrands == 1);
                 }
             }
 
@@ -474,17 +653,17 @@ void Assembler::flagChimericReads(size_t maxDistance, size_t threadCount)
     cout << "Using " << threadCount << " threads." << endl;
     // Multithreaded loop over all reads.
     cout << timestamp << "Processing " << readCount << " reads." << endl;
+    // The threads set the chimeric flags in the bit planes,
+    // which are then stored in the read flags.
+    readFlagBitplanes.createFromReadFlags(readFlags);
+    readFlagBitplanes.clearAll(ReadFlagBitplanes::isChimeric);
     setupLoadBalancing(readCount, 10000);
     runThreads(&Assembler::flagChimericReadsThreadFunction, threadCount);
+    readFlagBitplanes.storeToReadFlags(ReadFlagBitplanes::isChimeric, readFlags);
 
     cout << timestamp << "Done flagging chimeric reads." << endl;
 
-    size_t chimericReadCount = 0;
-    for(ReadId readId=0; readId!=readCount; readId++) {
-        if(readFlags[readId].isChimeric) {
-            ++chimericReadCount;
-        }
-    }
+    const size_t chimericReadCount = readFlagBitplanes.count(ReadFlagBitplanes::isChimeric);
     cout << timestamp << "Flagged " << chimericReadCount << " reads as chimeric out of ";
     cout << readCount << " total." << endl;
     cout << "Chimera rate is " << double(chimericReadCount) / double(readCount) << endl;
@@ -492,13 +671,19 @@ void Assembler::flagChimericReads(size_t maxDistance, size_t threadCount)
 
 
 
+// The BFS is done for groups of up to 64 reads at a time
+// using a bit-parallel multi-source BFS (MS-BFS): each vertex reached
+// stores a 64-bit mask of the BFS sources that reached it,
+// so each vertex and edge is visited once per level for the entire group
+// instead of once per source.
 void Assembler::flagChimericReadsThreadFunction(size_t threadId)
 {
     const size_t maxDistance = flagChimericReadsData.maxDistance;
+    const ReadId groupSize = 64;
 
     // Vector used for BFS searches by this thread.
-    // It stores the local vertex id in the current BFS assigned to each vertex,
-    // or notReached for vertices not yet reached by the current BFS.
+    // It stores the local vertex id in the current group of BFSs assigned to each vertex,
+    // or notReached for vertices not yet reached by any BFS of the current group.
     // Indexed by orientedRead.getValue().
     // This is of size equal to the number of oriented reads, and each thread has its own copy.
     // This is not prohibitive. For example, for a large human size run with
@@ -511,12 +696,23 @@ void Assembler::flagChimericReadsThreadFunction(size_t threadId)
     const uint32_t notReached = std::numeric_limits<uint32_t>::max();
     fill(vertexTable.begin(), vertexTable.end(), notReached);
 
-    // Vector to contain the vertices we found in the current BFS,
-    // each with the distance from the start vertex.
-    vector< pair<OrientedReadId, uint32_t> > localVertices;
+    // The vertices found by the current group of BFSs, indexed by local vertex id.
+    // For each vertex, masks of the BFS sources that
+    // reached it, and that reached it at the current and next level.
+    // Bit i corresponds to the i-th source of the group.
+    vector<OrientedReadId> localVertices;
+    vector<uint64_t> seen;
+    vector<uint64_t> frontierMask;
+    vector<uint64_t> nextMask;
 
-    // The queue used for the BFS.
-    std::queue<OrientedReadId> q;
+    // The local vertex ids at the current and next level.
+    vector<uint32_t> frontier;
+    vector<uint32_t> next;
+
+    // For each source, the local vertex ids of the vertices it reached,
+    // and the position in that list of each local vertex.
+    array<vector<uint32_t>, groupSize> sourceVertices;
+    vector<uint32_t> position;
 
     // Vectors used to compute connected components after each BFS.
     vector<uint32_t> rank;
@@ -527,141 +723,190 @@ void Assembler::flagChimericReadsThreadFunction(size_t threadId)
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
 
-        // Loop over all reads assigned to this batch.
-        for(ReadId startReadId=ReadId(begin); startReadId!=ReadId(end); startReadId++) {
+        // Loop over groups of reads assigned to this batch.
+        for(ReadId groupBegin=ReadId(begin); groupBegin<ReadId(end); groupBegin+=groupSize) {
+            const ReadId groupEnd = min(ReadId(end), groupBegin + groupSize);
 
-            // Check that there is no garbage left by the previous BFS.
+            // Check that there is no garbage left by the previous group.
             CZI_ASSERT(localVertices.empty());
-            CZI_ASSERT(q.empty());
 
-            // Begin by flagging this read as not chimeric.
-            readFlags[startReadId].isChimeric = 0;
+            // Initialize a BFS for each read on strand 0.
+            // The reads were already flagged as not chimeric.
+            frontier.clear();
+            for(ReadId startReadId=groupBegin; startReadId!=groupEnd; startReadId++) {
+                const OrientedReadId startOrientedReadId(startReadId, 0);
+                const uint32_t u = uint32_t(localVertices.size());
+                vertexTable[startOrientedReadId.getValue()] = u;
+                localVertices.push_back(startOrientedReadId);
+                seen.push_back(uint64_t(1) << (startReadId - groupBegin));
+                frontierMask.push_back(seen.back());
+                nextMask.push_back(0);
+                frontier.push_back(u);
+            }
 
 
 
-            // Do the BFS for this read and strand 0.
-            const OrientedReadId startOrientedReadId(startReadId, 0);
-            uint32_t localVertexId = 0;
-            q.push(startOrientedReadId);
-            localVertices.push_back(make_pair(startOrientedReadId, 0));
-            vertexTable[startOrientedReadId.getValue()] = localVertexId++;
-            while(!q.empty()) {
+            // Do the BFSs one level at a time.
+            // Vertices at maxDistance are found but not expanded.
+            for(size_t distance=0; distance<maxDistance && !frontier.empty(); distance++) {
+                next.clear();
+                for(const uint32_t u0: frontier) {
+                    const OrientedReadId v0 = localVertices[u0];
+                    const uint64_t mask0 = frontierMask[u0];
 
-                // Dequeue a vertex.
-                const OrientedReadId v0 = q.front();
-                q.pop();
-                const uint32_t distance0 = localVertices[vertexTable[v0.getValue()]].second;
-                const uint32_t distance1 = distance0 + 1;
-                // out << "Dequeued " << v0 << endl;
+                    // Loop over edges involving this vertex.
+                    for(const ReadGraph::Neighbor& neighbor: readGraph.neighbors[v0.getValue()]) {
+                        if(neighbor.crossesStrands) {
+                            continue;
+                        }
+                        const OrientedReadId v1 = neighbor.orientedReadId;
+
+                        // Record this vertex, if we never encountered it.
+                        uint32_t u1 = vertexTable[v1.getValue()];
+                        if(u1 == notReached) {
+                            u1 = uint32_t(localVertices.size());
+                            vertexTable[v1.getValue()] = u1;
+                            localVertices.push_back(v1);
+                            seen.push_back(0);
+                            frontierMask.push_back(0);
+                            nextMask.push_back(0);
+                        }
 
-                // Loop over edges involving this vertex.
-                const auto edgeIds = readGraph.connectivity[v0.getValue()];
-                for(const uint32_t edgeId: edgeIds) {
-                    const ReadGraph::Edge& edge = readGraph.edges[edgeId];
-                    if(edge.crossesStrands) {
-                        continue;
+                        // Find the sources that reach it for the first time.
+                        const uint64_t newMask = mask0 & ~seen[u1];
+                        if(newMask == 0) {
+                            continue;
+                        }
+                        if(nextMask[u1] == 0) {
+                            next.push_back(u1);
+                        }
+                        seen[u1] |= newMask;
+                        nextMask[u1] |= newMask;
                     }
-                    const OrientedReadId v1 = edge.getOther(v0);
-                    // out << "Found " << v1 << endl;
+                }
 
-                    // If we already encountered this read in this BFS, do nothing.
-                    if(vertexTable[v1.getValue()] != notReached) {
-                        // out << "Previously reached." << endl;
-                        continue;
-                    }
+                // Move to the next level.
+                for(const uint32_t u: frontier) {
+                    frontierMask[u] = 0;
+                }
+                for(const uint32_t u: next) {
+                    frontierMask[u] = nextMask[u];
+                    nextMask[u] = 0;
+                }
+                frontier.swap(next);
+            }
+            // At this point frontierMask contains, for each vertex,
+            // the sources for which it is at maxDistance.
+            // If the BFSs stopped early, it is zero for all vertices.
 
-                    // Record this vertex.
-                    // out << "Recording " << v1 << endl;
-                    localVertices.push_back(make_pair(v1, distance1));
-                    vertexTable[v1.getValue()] = localVertexId++;
 
-                    // If at distance less than maxDistance, also enqueue it.
-                    if(distance1 < maxDistance) {
-                        // out << "Enqueueing " << v1 << endl;
-                        q.push(v1);
-                    }
+
+            // Find the vertices reached by each source.
+            for(ReadId i=0; i<groupEnd-groupBegin; i++) {
+                sourceVertices[i].clear();
+            }
+            for(uint32_t u=0; u<localVertices.size(); u++) {
+                uint64_t mask = seen[u];
+                while(mask) {
+                    const uint64_t i = uint64_t(__builtin_ctzll(mask));
+                    sourceVertices[i].push_back(u);
+                    mask &= mask - 1;
                 }
             }
-            // out << "BFS found " << localVertices.size() << " vertices." << endl;
+            position.resize(localVertices.size());
 
 
 
-            // Now that we have the list of vertices with maxDistance of vStart,
-            // compute connected components, disregarding edges that involve v0
-            // and possibly its reverse complement.
+            // For each source, compute connected components of the vertices it reached,
+            // disregarding edges that involve the start vertex and its reverse complement.
+            for(ReadId startReadId=groupBegin; startReadId!=groupEnd; startReadId++) {
+                const uint64_t i = startReadId - groupBegin;
+                const uint64_t bit = uint64_t(1) << i;
+                const vector<uint32_t>& vertices = sourceVertices[i];
 
-            // Initialize the disjoint set data structures.
-            const ReadId n = ReadId(localVertices.size());
-            rank.resize(n);
-            parent.resize(n);
-            boost::disjoint_sets<ReadId*, ReadId*> disjointSets(&rank[0], &parent[0]);
-            for(ReadId i=0; i<n; i++) {
-                disjointSets.make_set(i);
-            }
+                // If there are less than two vertices at maximum distance,
+                // other than the reverse complement of the start vertex,
+                // they can't be in different connected components.
+                size_t maxDistanceVertexCount = 0;
+                for(const uint32_t u: vertices) {
+                    if((frontierMask[u] & bit) && localVertices[u].getReadId() != startReadId) {
+                        ++maxDistanceVertexCount;
+                    }
+                }
+                if(maxDistanceVertexCount < 2) {
+                    continue;
+                }
 
-            // Loop over all edges involving the vertices we found during the BFS,
-            // but disregarding vertices involving vStart or its reverse complement.
-            for(const auto& p: localVertices) {
-                const OrientedReadId v0 = p.first;
-                if(v0.getReadId() == startOrientedReadId.getReadId()) {
-                    continue;   // Skip edges involving vStart or its reverse complement.
+                // Initialize the disjoint set data structures.
+                const ReadId n = ReadId(vertices.size());
+                rank.resize(n);
+                parent.resize(n);
+                boost::disjoint_sets<ReadId*, ReadId*> disjointSets(&rank[0], &parent[0]);
+                for(ReadId j=0; j<n; j++) {
+                    disjointSets.make_set(j);
+                    position[vertices[j]] = j;
                 }
-                const uint32_t u0 = vertexTable[v0.getValue()];
-                CZI_ASSERT(u0 != notReached);
-                const auto edges = readGraph.connectivity[v0.getValue()];
-                for(const uint32_t edgeId: edges) {
-                    const ReadGraph::Edge& edge = readGraph.edges[edgeId];
-                    if(edge.crossesStrands) {
-                        continue;
-                    }
-                    const OrientedReadId v1 = edge.getOther(v0);
-                    if(v1.getReadId() == startOrientedReadId.getReadId()) {
-                        continue;   // Skip edges involving startOrientedReadId.
+
+                // Loop over all edges involving the vertices found by this BFS,
+                // but disregarding vertices involving vStart or its reverse complement.
+                for(ReadId j0=0; j0<n; j0++) {
+                    const OrientedReadId v0 = localVertices[vertices[j0]];
+                    if(v0.getReadId() == startReadId) {
+                        continue;   // Skip edges involving vStart or its reverse complement.
                     }
-                    const uint32_t u1 = vertexTable[v1.getValue()];
-                    if(u1 != notReached) {
-                        disjointSets.union_set(u0, u1);
+                    for(const ReadGraph::Neighbor& neighbor: readGraph.neighbors[v0.getValue()]) {
+                        if(neighbor.crossesStrands) {
+                            continue;
+                        }
+                        const OrientedReadId v1 = neighbor.orientedReadId;
+                        if(v1.getReadId() == startReadId) {
+                            continue;   // Skip edges involving startOrientedReadId.
+                        }
+                        const uint32_t u1 = vertexTable[v1.getValue()];
+                        if(u1 != notReached && (seen[u1] & bit)) {
+                            disjointSets.union_set(j0, position[u1]);
+                        }
                     }
                 }
-            }
 
 
-            // Now check the vertices at maximum distance.
-            // If they belong to more than one connected component,
-            // removing vStart affects the large scale connectivity of the
-            // read graph, and therefore we flag vStart as chimeric.
-            uint32_t component = std::numeric_limits<uint32_t>::max();
-            for(const auto& p: localVertices) {
-                if(p.second != maxDistance) {
-                    continue;
-                }
-                const OrientedReadId v = p.first;
-                if(v.getReadId() == startOrientedReadId.getReadId()) {
-                    // Skip the reverse complement of the start vertex.
-                    continue;
-                }
-                const uint32_t u = vertexTable[v.getValue()];
-                CZI_ASSERT(u != notReached);
-                const uint32_t uComponent = disjointSets.find_set(u);
-                if(component == std::numeric_limits<ReadId>::max()) {
-                    component = uComponent;
-                } else {
-                    if(uComponent != component) {
-                        readFlags[startReadId].isChimeric = 1;
-                        break;
+                // Now check the vertices at maximum distance.
+                // If they belong to more than one connected component,
+                // removing vStart affects the large scale connectivity of the
+                // read graph, and therefore we flag vStart as chimeric.
+                uint32_t component = std::numeric_limits<uint32_t>::max();
+                for(ReadId j=0; j<n; j++) {
+                    const uint32_t u = vertices[j];
+                    if(!(frontierMask[u] & bit)) {
+                        continue;
+                    }
+                    if(localVertices[u].getReadId() == startReadId) {
+                        // Skip the reverse complement of the start vertex.
+                        continue;
+                    }
+                    const uint32_t uComponent = disjointSets.find_set(j);
+                    if(component == std::numeric_limits<ReadId>::max()) {
+                        component = uComponent;
+                    } else {
+                        if(uComponent != component) {
+                            readFlagBitplanes.set(ReadFlagBitplanes::isChimeric, startReadId);
+                            break;
+                        }
                     }
                 }
             }
 
 
-            // Before processing the next read, we need to reset
-            // all entries of the distance vector to notReached,
-            // then clear the verticesFound vector.
-            for(const auto& p: localVertices) {
-                const OrientedReadId orientedReadId = p.first;
+            // Before processing the next group, we need to reset
+            // all entries of the vertex table to notReached,
+            // then clear the local vertices.
+            for(const OrientedReadId orientedReadId: localVertices) {
                 vertexTable[orientedReadId.getValue()] = notReached;
             }
             localVertices.clear();
+            seen.clear();
+            frontierMask.clear();
+            nextMask.clear();
         }
     }
 
@@ -677,8 +922,12 @@ void Assembler::flagChimericReadsThreadFunction(size_t threadId)
 // Components with fewer than minComponentSize are considered
 // small and excluded from assembly by setting the
 // isInSmallComponent for all the reads they contain.
+// This uses the lock-free DisjointSets also used for
+// marker graph vertices, so all the phases that touch every
+// edge or every oriented read are multithreaded.
 void Assembler::computeReadGraphConnectedComponents(
-    size_t minComponentSize
+    size_t minComponentSize,
+    size_t threadCount
     )
 {
     // Check that we have what we need.
@@ -689,67 +938,87 @@ void Assembler::computeReadGraphConnectedComponents(
     CZI_ASSERT(readGraph.connectivity.size() == orientedReadCount);
     checkAlignmentDataAreOpen();
 
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // Store the parameters so all threads can see them.
+    auto& data = computeReadGraphConnectedComponentsData;
+    data.minComponentSize = minComponentSize;
+
 
 
     // Compute connected components of the read graph,
     // treating chimeric reads as isolated.
-    vector<ReadId> rank(orientedReadCount);
-    vector<ReadId> parent(orientedReadCount);
-    boost::disjoint_sets<ReadId*, ReadId*> disjointSets(&rank[0], &parent[0]);
     cout << timestamp << "Computing connected components of the read graph." << endl;
-    for(ReadId readId=0; readId<readCount; readId++) {
-        for(Strand strand=0; strand<2; strand++) {
-            disjointSets.make_set(OrientedReadId(readId, strand).getValue());
-        }
-    }
-    for(const ReadGraph::Edge& edge: readGraph.edges) {
-        if(edge.crossesStrands) {
-            continue;
-        }
-        const OrientedReadId orientedReadId0 = edge.orientedReadIds[0];
-        const OrientedReadId orientedReadId1 = edge.orientedReadIds[1];
-        const ReadId readId0 = orientedReadId0.getReadId();
-        const ReadId readId1 = orientedReadId1.getReadId();
-        if(readFlags[readId0].isChimeric) {
-            continue;
-        }
-        if(readFlags[readId1].isChimeric) {
-            continue;
-        }
-        disjointSets.union_set(orientedReadId0.getValue(), orientedReadId1.getValue());
-    }
+    data.disjointSetsData.createNew(
+        largeDataName("tmp-ReadGraphDisjointSetData"),
+        largeDataPageSize);
+    data.disjointSetsData.reserveAndResize(orientedReadCount);
+    data.disjointSetsPointer = std::make_shared<DisjointSets>(
+        data.disjointSetsData.begin(),
+        orientedReadCount
+        );
+    const size_t batchSize = 10000;
+    setupLoadBalancing(readGraph.edges.size(), batchSize);
+    runThreads(&Assembler::computeReadGraphConnectedComponentsThreadFunction1, threadCount);
+
+    // Find the disjoint set that each oriented read belongs to,
+    // and count the oriented reads in each disjoint set.
+    data.disjointSetTable.clear();
+    data.disjointSetTable.resize(orientedReadCount);
+    data.disjointSetSize.clear();
+    data.disjointSetSize.resize(orientedReadCount, 0);
+    setupLoadBalancing(orientedReadCount, batchSize);
+    runThreads(&Assembler::computeReadGraphConnectedComponentsThreadFunction2, threadCount);
+    data.disjointSetsPointer = 0;
+    data.disjointSetsData.remove();
 
 
 
     // Gather the vertices of each component.
-    std::map<ReadId, vector<OrientedReadId> > componentMap;
-    for(ReadId readId=0; readId<readCount; readId++) {
-        for(Strand strand=0; strand<2; strand++) {
-            const OrientedReadId orientedReadId(readId, strand);
-            const ReadId componentId = disjointSets.find_set(orientedReadId.getValue());
-            componentMap[componentId].push_back(orientedReadId);
+    // Each component is identified by its disjoint set,
+    // and its oriented reads are stored in increasing order.
+    // Also store the first oriented read of the component of each disjoint set.
+    vector<ReadId> componentOfDisjointSet(orientedReadCount, std::numeric_limits<ReadId>::max());
+    data.disjointSetFirstOrientedRead.clear();
+    data.disjointSetFirstOrientedRead.resize(orientedReadCount, std::numeric_limits<ReadId>::max());
+    vector< vector<OrientedReadId> > unsortedComponents;
+    for(ReadId i=0; i<orientedReadCount; i++) {
+        const ReadId disjointSetId = data.disjointSetTable[i];
+        ReadId& componentId = componentOfDisjointSet[disjointSetId];
+        if(componentId == std::numeric_limits<ReadId>::max()) {
+            componentId = ReadId(unsortedComponents.size());
+            unsortedComponents.resize(unsortedComponents.size() + 1);
+            unsortedComponents.back().reserve(data.disjointSetSize[disjointSetId]);
+            data.disjointSetFirstOrientedRead[disjointSetId] = i;
         }
+        unsortedComponents[componentId].push_back(OrientedReadId(i));
     }
-    cout << "The read graph has " << componentMap.size() <<
+    cout << "The read graph has " << unsortedComponents.size() <<
         " connected components." << endl;
 
 
 
     // Sort the components by decreasing size (number of reads).
-    // componentTable contains pairs(size, componentId as key in componentMap).
+    // Components of the same size are in order of their first oriented read,
+    // so the order does not depend on the disjoint sets that were chosen.
     vector< pair<size_t, uint32_t> > componentTable;
-    for(const auto& p: componentMap) {
-        const vector<OrientedReadId>& component = p.second;
-        componentTable.push_back(make_pair(component.size(), p.first));
+    for(uint32_t componentId=0; componentId<unsortedComponents.size(); componentId++) {
+        componentTable.push_back(make_pair(unsortedComponents[componentId].size(), componentId));
     }
-    sort(componentTable.begin(), componentTable.end(), std::greater<pair<size_t, uint32_t>>());
+    // The components were created in that order, so a stable sort does it.
+    std::stable_sort(componentTable.begin(), componentTable.end(),
+        OrderPairsByFirstOnlyGreater<size_t, uint32_t>());
 
 
 
     // Store components in this order of decreasing size.
     vector< vector<OrientedReadId> > components;
     for(const auto& p: componentTable) {
-        components.push_back(componentMap[p.second]);
+        components.push_back(vector<OrientedReadId>());
+        components.back().swap(unsortedComponents[p.second]);
     }
     cout << timestamp << "Done computing connected components of the read graph." << endl;
 
@@ -784,12 +1053,16 @@ void Assembler::computeReadGraphConnectedComponents(
 
 
 
-    // Clear the read flags that will be set below.
+    // Set the isInSmallComponent and strand flags of all reads.
     // Note that we are not changing the isChimeric flags.
-    for(ReadFlags& f: readFlags) {
-        f.isInSmallComponent = 0;
-        f.strand = 0;
-    }
+    setupLoadBalancing(readCount, batchSize);
+    runThreads(&Assembler::computeReadGraphConnectedComponentsThreadFunction3, threadCount);
+    data.disjointSetTable.clear();
+    data.disjointSetTable.shrink_to_fit();
+    data.disjointSetSize.clear();
+    data.disjointSetSize.shrink_to_fit();
+    data.disjointSetFirstOrientedRead.clear();
+    data.disjointSetFirstOrientedRead.shrink_to_fit();
 
 
 
@@ -797,13 +1070,8 @@ void Assembler::computeReadGraphConnectedComponents(
     for(ReadId componentId=0; componentId<components.size(); componentId++) {
         const vector<OrientedReadId>& component = components[componentId];
 
-        // If this component is small, set the isInSmallComponent flag for all
-        // the reads it contains.
+        // If this component is small, its reads were already flagged.
         if(component.size() < minComponentSize) {
-            for(const OrientedReadId orientedReadId: component) {
-                const ReadId readId = orientedReadId.getReadId();
-                readFlags[readId].isInSmallComponent = 1;
-            }
             continue;
         }
 
@@ -816,20 +1084,8 @@ void Assembler::computeReadGraphConnectedComponents(
         }
 
         // If this component is not self-complementary,
-        // use it for assembly only if its first read is on strand 0.
-        // Set the strand of all the reads as
-        // the strand present in this component.
+        // the strand flags of its reads were already set.
         if(!isSelfComplementary) {
-            if(component[0].getStrand() == 0) {
-                for(const OrientedReadId orientedReadId: component) {
-                    const ReadId readId = orientedReadId.getReadId();
-                    const Strand strand = orientedReadId.getStrand();
-                    readFlags[readId].strand = strand & 1;
-                }
-            } else {
-                // No need to set any strand flags here.
-                // They will be set when processing the complementary component.
-            }
             continue;
         }
 
@@ -853,6 +1109,95 @@ void Assembler::computeReadGraphConnectedComponents(
 
 
 
+// Update the disjoint sets for each read graph edge.
+void Assembler::computeReadGraphConnectedComponentsThreadFunction1(size_t threadId)
+{
+    DisjointSets& disjointSets = *computeReadGraphConnectedComponentsData.disjointSetsPointer;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const ReadGraph::Edge& edge = readGraph.edges[i];
+            if(edge.crossesStrands) {
+                continue;
+            }
+            const OrientedReadId orientedReadId0 = edge.orientedReadIds[0];
+            const OrientedReadId orientedReadId1 = edge.orientedReadIds[1];
+            if(readFlags[orientedReadId0.getReadId()].isChimeric) {
+                continue;
+            }
+            if(readFlags[orientedReadId1.getReadId()].isChimeric) {
+                continue;
+            }
+            disjointSets.unite(orientedReadId0.getValue(), orientedReadId1.getValue());
+        }
+    }
+}
+
+
+
+// Find the disjoint set of each oriented read.
+void Assembler::computeReadGraphConnectedComponentsThreadFunction2(size_t threadId)
+{
+    auto& data = computeReadGraphConnectedComponentsData;
+    const DisjointSets& disjointSets = *data.disjointSetsPointer;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const ReadId disjointSetId = ReadId(disjointSets.find(i));
+            data.disjointSetTable[i] = disjointSetId;
+            __sync_fetch_and_add(&data.disjointSetSize[disjointSetId], ReadId(1));
+        }
+    }
+}
+
+
+
+// Set the isInSmallComponent and strand flags of each read.
+// The two oriented reads of a read are in components of the same size,
+// which are either the same (self-complementary) component
+// or reverse complements of each other.
+// In the second case, the component used for assembly is the one
+// whose first oriented read is on strand 0, and the strand
+// flag is set to the strand of the read in that component.
+// Self-complementary components are not strand separated,
+// so the strand flag of their reads is left at 0.
+void Assembler::computeReadGraphConnectedComponentsThreadFunction3(size_t threadId)
+{
+    auto& data = computeReadGraphConnectedComponentsData;
+    const size_t minComponentSize = data.minComponentSize;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            ReadFlags& flags = readFlags[readId];
+            flags.isInSmallComponent = 0;
+            flags.strand = 0;
+
+            const ReadId disjointSetId0 = data.disjointSetTable[OrientedReadId(readId, 0).getValue()];
+            const ReadId disjointSetId1 = data.disjointSetTable[OrientedReadId(readId, 1).getValue()];
+            if(data.disjointSetSize[disjointSetId0] < minComponentSize) {
+                flags.isInSmallComponent = 1;
+                continue;
+            }
+            if(disjointSetId0 == disjointSetId1) {
+                continue;
+            }
+
+            // If the first oriented read in the component of the read on strand 0
+            // is on strand 0, that component is used, and the strand is 0.
+            // Otherwise, the reverse complemented component is used
+            // (its first oriented read is the reverse complement of the
+            // first oriented read of this component), and the strand is 1.
+            const OrientedReadId first(data.disjointSetFirstOrientedRead[disjointSetId0]);
+            flags.strand = first.getStrand() & 1;
+        }
+    }
+}
+
+
+
 // Write a FASTA file containing all reads that appear in
 // the local read graph.
 void Assembler::writeLocalReadGraphReads(
@@ -894,9 +1239,9 @@ void Assembler::writeLocalReadGraphReads(
 
         // Write the sequence.
         const auto& sequence = reads[readId];
-        const auto& counts = readRepeatCounts[readId];
+        vector<uint8_t> counts;
+        getReadRepeatCounts(readId, counts);
         const size_t n = sequence.baseCount;
-        CZI_ASSERT(counts.size() == n);
         for(size_t i=0; i<n; i++) {
             const Base base = sequence[i];
             const uint8_t count = counts[i];
@@ -931,6 +1276,7 @@ void Assembler::flagCrossStrandReadGraphEdges()
     for(size_t edgeId=0; edgeId!=edgeCount; edgeId++) {
         readGraph.edges[edgeId].crossesStrands = 0;
     }
+    readGraph.updateNeighbors();
 
     // Store the maximum distance so all threads can see it.
     const size_t maxDistance = 6;
@@ -939,7 +1285,7 @@ void Assembler::flagCrossStrandReadGraphEdges()
     // Find which vertices are close to their reverse complement.
     // "Close" means that there is a path of distance up to maxDistance.
     flagCrossStrandReadGraphEdgesData.isNearStrandJump.clear();
-    flagCrossStrandReadGraphEdgesData.isNearStrandJump.resize(orientedReadCount, false);
+    flagCrossStrandReadGraphEdgesData.isNearStrandJump.resize(orientedReadCount, 0);
     const size_t batchSize = 10000;
     const size_t threadCount = std::thread::hardware_concurrency();
     setupLoadBalancing(readCount, batchSize);
@@ -1149,6 +1495,7 @@ void Assembler::flagCrossStrandReadGraphEdges()
     cout << "Marked " << crossStrandEdgeCount << " read graph edges out of " <<
         edgeCount <<
         " total as cross-strand." << endl;
+    readGraph.updateNeighbors();
 
     // Done.
     cout << timestamp << "End flagCrossStrandReadGraphEdges." << endl;
@@ -1163,25 +1510,20 @@ void Assembler::flagCrossStrandReadGraphEdgesThreadFunction(size_t threadId)
     auto& isNearStrandJump = flagCrossStrandReadGraphEdgesData.isNearStrandJump;
     vector<uint32_t> distance(2*readCount, ReadGraph::infiniteDistance);
     vector<OrientedReadId> reachedVertices;
-    vector<uint32_t> parentEdges(2*readCount);
-    vector<uint32_t> shortestPath;
     uint64_t begin, end;
 
     while(getNextBatch(begin, end)) {
 
         for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
             if((readId %100000) == 0) {
-                std::lock_guard<std::mutex> lock(mutex);
-                cout << timestamp << threadId << " " << readId << "/" << readCount << endl;
+                ThreadLog::Message() << timestamp << threadId << " " << readId << "/" << readCount;
             }
             const OrientedReadId orientedReadId0(readId, 0);
             const OrientedReadId orientedReadId1(readId, 1);
-            readGraph.computeShortPath(orientedReadId0, orientedReadId1,
-                maxDistance, shortestPath,
-                distance, reachedVertices, parentEdges);
-            if(!shortestPath.empty()) {
-                isNearStrandJump[orientedReadId0.getValue()] = true;
-                isNearStrandJump[orientedReadId1.getValue()] = true;
+            if(readGraph.isNearReverseComplement(orientedReadId0,
+                maxDistance, distance, reachedVertices)) {
+                isNearStrandJump[orientedReadId0.getValue()] = 1;
+                isNearStrandJump[orientedReadId1.getValue()] = 1;
             }
         }
     }
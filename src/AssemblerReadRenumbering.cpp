@@ -0,0 +1,454 @@
+// Shasta.
+#include "Assembler.hpp"
+#include "CompressedAlignment.hpp"
+#include "parallelAlgorithms.hpp"
+#include "permuteMemoryMapped.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard libraries.
+#include "algorithm.hpp"
+#include "chrono.hpp"
+#include <cmath>
+#include "iostream.hpp"
+
+
+
+/*******************************************************************************
+
+Read ids follow the order of the input files, so reads that overlap
+in the genome are scattered across the reads, the markers, and the read graph.
+renumberReads assigns new read ids in the order of a breadth first search
+of the read graph (see computeReadRenumbering), so the stages that follow,
+and in particular marker graph vertex creation, which processes
+the markers of pairs of overlapping reads, access nearby memory.
+
+All data indexed by ReadId or OrientedReadId, or containing them,
+are rewritten consistently. Because some of them can be accessed read-only
+(for example when resuming an assembly), each of them is copied to a temporary,
+removed, and recreated with the same name, one at a time
+(see permuteMemoryMapped.hpp).
+The read names are permuted together with the reads,
+so each read can still be traced back to its origin.
+Alignment ids and read graph edge ids do not change.
+
+*******************************************************************************/
+
+
+
+void Assembler::renumberReads(size_t threadCount)
+{
+    const auto t0 = steady_clock::now();
+    checkReadsAreOpen();
+    checkReadNamesAreOpen();
+    checkMarkersAreOpen();
+    checkAlignmentDataAreOpen();
+    checkReadGraphIsOpen();
+    if(!readFlags.isOpen) {
+        throw runtime_error("Read flags are not accessible.");
+    }
+    if(!readGraph.neighbors.isOpen()) {
+        throw runtime_error("Read graph neighbors are not accessible.");
+    }
+    if(markerGraph.vertices.isOpen()) {
+        throw runtime_error("Reads cannot be renumbered after marker graph vertices are created.");
+    }
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+#ifndef SHASTA_STATIC_EXECUTABLE
+    clearHttpResponseCache();
+#endif
+
+    // Compute the new order of the reads.
+    const ReadId readCount = ReadId(reads.size());
+    vector<ReadId> oldReadIds;
+    computeReadRenumbering(oldReadIds);
+    vector<ReadId> newReadIds(readCount);
+    for(ReadId newReadId=0; newReadId<readCount; newReadId++) {
+        newReadIds[oldReadIds[newReadId]] = newReadId;
+    }
+
+    // The indexes of the data indexed by ReadId or by OrientedReadId::getValue(),
+    // for each new index, before renumbering.
+    vector<uint64_t> oldReadIndex(oldReadIds.begin(), oldReadIds.end());
+    vector<uint64_t> oldOrientedReadIndex(2 * uint64_t(readCount));
+    for(ReadId newReadId=0; newReadId<readCount; newReadId++) {
+        for(Strand strand=0; strand<2; strand++) {
+            oldOrientedReadIndex[OrientedReadId(newReadId, strand).getValue()] =
+                OrientedReadId(oldReadIds[newReadId], strand).getValue();
+        }
+    }
+    const auto oldIndex = [&](uint64_t size) -> const vector<uint64_t>&
+    {
+        if(size == readCount) {
+            return oldReadIndex;
+        }
+        CZI_ASSERT(size == 2 * uint64_t(readCount));
+        return oldOrientedReadIndex;
+    };
+
+    // Measure the locality of the alignments before and after renumbering.
+    double oldDistanceSum = 0.;
+    double newDistanceSum = 0.;
+    for(const AlignmentData& alignment: alignmentData) {
+        const ReadId readId0 = alignment.readIds[0];
+        const ReadId readId1 = alignment.readIds[1];
+        oldDistanceSum += std::fabs(double(readId0) - double(readId1));
+        newDistanceSum += std::fabs(double(newReadIds[readId0]) - double(newReadIds[readId1]));
+    }
+    if(alignmentData.size() > 0) {
+        cout << timestamp << "Average read id distance of aligned reads: " <<
+            oldDistanceSum / double(alignmentData.size()) << " before renumbering, " <<
+            newDistanceSum / double(alignmentData.size()) << " after renumbering." << endl;
+    }
+
+    // Reads.
+    cout << timestamp << "Renumbering reads." << endl;
+    {
+        LongBaseSequences permutedReads;
+        permutedReads.createNew(largeDataName("tmp-RenumberReads-Reads"), largeDataPageSize);
+        for(ReadId newReadId=0; newReadId<readCount; newReadId++) {
+            permutedReads.append(reads[oldReadIds[newReadId]]);
+        }
+        reads.remove();
+        reads.createNew(largeDataName("Reads"), largeDataPageSize);
+        for(ReadId readId=0; readId<readCount; readId++) {
+            reads.append(permutedReads[readId]);
+        }
+        permutedReads.remove();
+    }
+    permuteVectors(readNames, oldReadIndex.data(), largeDataName("ReadNames"),
+        largeDataName("tmp-RenumberReads-ReadNames"), largeDataPageSize, threadCount);
+    if(readNameIndex.isOpen()) {
+        createReadNameIndex(threadCount);
+    }
+
+    // Read repeat counts, in either representation.
+    if(readRepeatCounts.isOpen()) {
+        permuteVectors(readRepeatCounts, oldReadIndex.data(), largeDataName("ReadRepeatCounts"),
+            largeDataName("tmp-RenumberReads-ReadRepeatCounts"), largeDataPageSize, threadCount);
+    } else if(compactReadRepeatCounts.isOpen()) {
+        CompactRepeatCounts permutedRepeatCounts;
+        permutedRepeatCounts.createNew(
+            largeDataName("tmp-RenumberReads-CompactReadRepeatCounts"), largeDataPageSize);
+        vector<uint8_t> counts;
+        for(ReadId newReadId=0; newReadId<readCount; newReadId++) {
+            compactReadRepeatCounts.get(oldReadIds[newReadId], counts);
+            permutedRepeatCounts.append(counts.data(), counts.data() + counts.size());
+        }
+        compactReadRepeatCounts.remove();
+        compactReadRepeatCounts.createNew(largeDataName("CompactReadRepeatCounts"), largeDataPageSize);
+        for(ReadId readId=0; readId<readCount; readId++) {
+            permutedRepeatCounts.get(readId, counts);
+            compactReadRepeatCounts.append(counts.data(), counts.data() + counts.size());
+        }
+        permutedRepeatCounts.remove();
+    }
+
+    // Read flags.
+    {
+        MemoryMapped::Vector<ReadFlags> previousReadFlags;
+        recreateVector(readFlags, previousReadFlags, largeDataName("ReadFlags"),
+            largeDataName("tmp-RenumberReads-ReadFlags"), largeDataPageSize);
+        for(ReadId newReadId=0; newReadId<readCount; newReadId++) {
+            readFlags[newReadId] = previousReadFlags[oldReadIds[newReadId]];
+        }
+        previousReadFlags.remove();
+    }
+
+    // Markers. The compact markers and the marker k-mer index
+    // are optional and are no longer valid.
+    cout << timestamp << "Renumbering markers." << endl;
+    permuteVectors(markers, oldIndex(markers.size()).data(), largeDataName("Markers"),
+        largeDataName("tmp-RenumberReads-Markers"), largeDataPageSize, threadCount);
+    markerIdIndex.clear();
+    if(sortedMarkers.isOpen()) {
+        permuteVectors(sortedMarkers, oldIndex(sortedMarkers.size()).data(), largeDataName("SortedMarkers"),
+            largeDataName("tmp-RenumberReads-SortedMarkers"), largeDataPageSize, threadCount);
+    }
+    if(compactMarkers.isOpen()) {
+        compactMarkers.remove();
+    }
+    if(markerKmerIndex.isOpen()) {
+        markerKmerIndex.remove();
+    }
+
+    // Alignment candidates. They are stored with readId0<readId1.
+    if(alignmentCandidates.isOpen) {
+        MemoryMapped::Vector<OrientedReadPair> previousAlignmentCandidates;
+        recreateVector(alignmentCandidates, previousAlignmentCandidates,
+            largeDataName("AlignmentCandidates"),
+            largeDataName("tmp-RenumberReads-AlignmentCandidates"), largeDataPageSize);
+        for(uint64_t i=0; i<alignmentCandidates.size(); i++) {
+            const OrientedReadPair& candidate = previousAlignmentCandidates[i];
+            const ReadId readId0 = newReadIds[candidate.readIds[0]];
+            const ReadId readId1 = newReadIds[candidate.readIds[1]];
+            alignmentCandidates[i] = OrientedReadPair(
+                min(readId0, readId1), max(readId0, readId1), candidate.isSameStrand);
+        }
+        previousAlignmentCandidates.remove();
+    }
+
+    // The LowHash sketches can only be renumbered if they cover all reads.
+    // Otherwise, an incremental LowHash computation would assume
+    // that the reads they cover come first.
+    if(lowHashSketches.isOpen()) {
+        if(lowHashSketches.info->readCount == readCount) {
+            const LowHashSketches::Info sketchesInfo = *lowHashSketches.info.operator->();
+            const string name = lowHashSketches.name;
+            MemoryMapped::VectorOfVectors<uint64_t, uint64_t> lowHashes;
+            MemoryMapped::VectorOfVectors<uint32_t, uint64_t> lowHashesBegin;
+            lowHashes.createNew(largeDataName("tmp-RenumberReads-LowHashes"), largeDataPageSize);
+            lowHashesBegin.createNew(largeDataName("tmp-RenumberReads-LowHashesBegin"), largeDataPageSize);
+            copyVectors(lowHashSketches.lowHashes, oldOrientedReadIndex.data(), lowHashes, threadCount);
+            copyVectors(lowHashSketches.lowHashesBegin, oldOrientedReadIndex.data(), lowHashesBegin, threadCount);
+            lowHashSketches.remove();
+            lowHashSketches.createNew(name, largeDataPageSize);
+            *lowHashSketches.info.operator->() = sketchesInfo;
+            copyVectors(lowHashes, 0, lowHashSketches.lowHashes, threadCount);
+            copyVectors(lowHashesBegin, 0, lowHashSketches.lowHashesBegin, threadCount);
+            lowHashes.remove();
+            lowHashesBegin.remove();
+        } else {
+            cout << "LowHash sketches do not cover all reads and were removed." << endl;
+            lowHashSketches.remove();
+        }
+    }
+
+    // Alignments and read graph.
+    cout << timestamp << "Renumbering alignments and the read graph." << endl;
+    renumberAlignments(newReadIds, threadCount);
+    renumberReadGraph(newReadIds, oldIndex(readGraph.connectivity.size()), threadCount);
+
+    const auto t1 = steady_clock::now();
+    cout << timestamp << "Renumbering " << readCount << " reads took " <<
+        seconds(t1 - t0) << " s." << endl;
+}
+
+
+
+// Compute the order of the reads after renumbering:
+// oldReadIds[newReadId] is the read id before renumbering.
+// Each connected component of the read graph, disregarding strands,
+// is visited by two breadth first searches. The first one starts
+// at the lowest numbered read of the component. The last read it reaches
+// is far from it, usually near one end of the region of the genome
+// covered by the component. The second search starts there
+// and gives the new order, so reads at similar positions along
+// the component get nearby read ids, as in the Cuthill-McKee ordering.
+// Reads without read graph edges go last, in their original order.
+void Assembler::computeReadRenumbering(vector<ReadId>& oldReadIds) const
+{
+    const ReadId readCount = ReadId(reads.size());
+    oldReadIds.clear();
+    oldReadIds.reserve(readCount);
+
+    // Add to a queue the reads that are neighbors of a read
+    // in the read graph and were not already visited.
+    const auto visitNeighbors = [this](
+        ReadId readId0,
+        vector<bool>& wasVisited,
+        vector<ReadId>& queue)
+    {
+        for(Strand strand=0; strand<2; strand++) {
+            for(const ReadGraph::Neighbor& neighbor:
+                readGraph.neighbors[OrientedReadId(readId0, strand).getValue()]) {
+                const ReadId readId1 = neighbor.orientedReadId.getReadId();
+                if(!wasVisited[readId1]) {
+                    wasVisited[readId1] = true;
+                    queue.push_back(readId1);
+                }
+            }
+        }
+    };
+
+    vector<bool> wasReached(readCount, false);
+    vector<bool> wasRenumbered(readCount, false);
+    vector<ReadId> component;
+    for(ReadId readId=0; readId<readCount; readId++) {
+        if(wasReached[readId] ||
+            (readGraph.neighbors.size(OrientedReadId(readId, 0).getValue()) == 0 &&
+            readGraph.neighbors.size(OrientedReadId(readId, 1).getValue()) == 0)) {
+            continue;
+        }
+
+        // Find the component and a read far from readId.
+        component.clear();
+        component.push_back(readId);
+        wasReached[readId] = true;
+        for(size_t i=0; i<component.size(); i++) {
+            visitNeighbors(component[i], wasReached, component);
+        }
+
+        // Number the reads of the component in the order
+        // of a search starting at that read.
+        const size_t begin = oldReadIds.size();
+        oldReadIds.push_back(component.back());
+        wasRenumbered[component.back()] = true;
+        for(size_t i=begin; i<oldReadIds.size(); i++) {
+            visitNeighbors(oldReadIds[i], wasRenumbered, oldReadIds);
+        }
+        CZI_ASSERT(oldReadIds.size() - begin == component.size());
+    }
+
+    // Isolated reads.
+    for(ReadId readId=0; readId<readCount; readId++) {
+        if(!wasReached[readId]) {
+            oldReadIds.push_back(readId);
+        }
+    }
+    CZI_ASSERT(oldReadIds.size() == readCount);
+}
+
+
+
+// Renumber the reads of the alignments.
+// The alignments are stored with readIds[0]<readIds[1] and with
+// the first read on strand 0. When the new read ids are in the
+// opposite order, the two reads are swapped and, if they are on
+// opposite strands, both are also reverse complemented.
+// Alignment ids don't change.
+void Assembler::renumberAlignments(
+    const vector<ReadId>& newReadIds,
+    size_t threadCount)
+{
+    MemoryMapped::Vector<AlignmentData> previousAlignmentData;
+    recreateVector(alignmentData, previousAlignmentData, largeDataName("AlignmentData"),
+        largeDataName("tmp-RenumberReads-AlignmentData"), largeDataPageSize);
+    vector<bool> isSwappedAlignment(alignmentData.size(), false);
+    for(uint64_t alignmentId=0; alignmentId<alignmentData.size(); alignmentId++) {
+        AlignmentData alignment = previousAlignmentData[alignmentId];
+        alignment.readIds[0] = newReadIds[alignment.readIds[0]];
+        alignment.readIds[1] = newReadIds[alignment.readIds[1]];
+        if(alignment.readIds[0] > alignment.readIds[1]) {
+            std::swap(alignment.readIds[0], alignment.readIds[1]);
+            alignment.info.swap();
+            if(!alignment.isSameStrand) {
+                alignment.info.reverseComplement();
+            }
+            isSwappedAlignment[alignmentId] = true;
+        }
+        alignmentData[alignmentId] = alignment;
+    }
+    previousAlignmentData.remove();
+
+    // Transform the stored alignments in the same way.
+    if(compressedAlignments.isOpen()) {
+        MemoryMapped::VectorOfVectors<uint8_t, uint64_t> previousCompressedAlignments;
+        previousCompressedAlignments.createNew(
+            largeDataName("tmp-RenumberReads-CompressedAlignments"), largeDataPageSize);
+        copyVectors(compressedAlignments, 0, previousCompressedAlignments, threadCount);
+        compressedAlignments.remove();
+        compressedAlignments.createNew(largeDataName("CompressedAlignments"), largeDataPageSize);
+        Alignment storedAlignment;
+        vector<uint8_t> buffer;
+        for(uint64_t alignmentId=0; alignmentId<alignmentData.size(); alignmentId++) {
+            const uint8_t* begin = previousCompressedAlignments.begin(alignmentId);
+            const uint8_t* end = previousCompressedAlignments.end(alignmentId);
+            if(!isSwappedAlignment[alignmentId]) {
+                compressedAlignments.appendVector(begin, end);
+                continue;
+            }
+            decompressAlignment(begin, end, storedAlignment);
+            const AlignmentData& alignment = alignmentData[alignmentId];
+            if(alignment.isSameStrand) {
+                for(array<uint32_t, 2>& ordinals: storedAlignment.ordinals) {
+                    std::swap(ordinals[0], ordinals[1]);
+                }
+            } else {
+                const uint32_t markerCount0 = uint32_t(getMarkerCount(OrientedReadId(alignment.readIds[0], 0)));
+                const uint32_t markerCount1 = uint32_t(getMarkerCount(OrientedReadId(alignment.readIds[1], 0)));
+                for(array<uint32_t, 2>& ordinals: storedAlignment.ordinals) {
+                    ordinals = {markerCount0 - 1 - ordinals[1], markerCount1 - 1 - ordinals[0]};
+                }
+                std::reverse(storedAlignment.ordinals.begin(), storedAlignment.ordinals.end());
+            }
+            compressAlignment(storedAlignment, buffer);
+            compressedAlignments.appendVector(buffer.begin(), buffer.end());
+        }
+        previousCompressedAlignments.remove();
+    }
+
+    // The alignment table is indexed by OrientedReadId and sorted
+    // by the other OrientedReadId, so it is easier to recreate it.
+    alignmentTable.remove();
+    computeAlignmentTable(threadCount);
+}
+
+
+
+// Renumber the reads of the read graph. This must be called after
+// renumberAlignments. Each pair of edges corresponding to an alignment
+// is recreated from the alignment, so the first edge of each pair
+// remains the one with the orientation of the alignment.
+// Each edge keeps its crossesStrands flag. When the first and
+// second edge of a pair trade places, the edge ids in the connectivity
+// are updated accordingly, which does not change their order.
+// oldOrientedReadIndex gives, for each new OrientedReadId::getValue(),
+// the old one.
+void Assembler::renumberReadGraph(
+    const vector<ReadId>& newReadIds,
+    const vector<uint64_t>& oldOrientedReadIndex,
+    size_t threadCount)
+{
+    const auto renumber = [&newReadIds](OrientedReadId orientedReadId)
+    {
+        return OrientedReadId(newReadIds[orientedReadId.getReadId()], orientedReadId.getStrand());
+    };
+
+    MemoryMapped::Vector<ReadGraph::Edge> previousEdges;
+    recreateVector(readGraph.edges, previousEdges, largeDataName("ReadGraphEdges"),
+        largeDataName("tmp-RenumberReads-ReadGraphEdges"), largeDataPageSize);
+    CZI_ASSERT((readGraph.edges.size() % 2) == 0);
+    vector<bool> isSwappedEdgePair(readGraph.edges.size() / 2, false);
+    for(uint64_t edgeId=0; edgeId<readGraph.edges.size(); edgeId+=2) {
+        const ReadGraph::Edge& previousEdge = previousEdges[edgeId];
+        const AlignmentData& alignment = alignmentData[previousEdge.alignmentId];
+
+        ReadGraph::Edge edge = previousEdge;
+        edge.orientedReadIds[0] = OrientedReadId(alignment.readIds[0], 0);
+        edge.orientedReadIds[1] = OrientedReadId(alignment.readIds[1], alignment.isSameStrand ? 0 : 1);
+        CZI_ASSERT(edge.orientedReadIds[0] < edge.orientedReadIds[1]);
+
+        // Find out if the first edge of the pair is now the second one.
+        const OrientedReadId orientedReadId0 = renumber(previousEdge.orientedReadIds[0]);
+        const OrientedReadId orientedReadId1 = renumber(previousEdge.orientedReadIds[1]);
+        const bool isSwapped =
+            orientedReadId0 != edge.orientedReadIds[0] &&
+            orientedReadId0 != edge.orientedReadIds[1];
+        if(isSwapped) {
+            OrientedReadId orientedReadId0Rc = orientedReadId0;
+            orientedReadId0Rc.flipStrand();
+            OrientedReadId orientedReadId1Rc = orientedReadId1;
+            orientedReadId1Rc.flipStrand();
+            CZI_ASSERT(
+                (orientedReadId0Rc == edge.orientedReadIds[0] && orientedReadId1Rc == edge.orientedReadIds[1]) ||
+                (orientedReadId1Rc == edge.orientedReadIds[0] && orientedReadId0Rc == edge.orientedReadIds[1]));
+            isSwappedEdgePair[edgeId / 2] = true;
+        }
+
+        edge.crossesStrands = previousEdges[isSwapped ? edgeId+1 : edgeId].crossesStrands;
+        readGraph.edges[edgeId] = edge;
+        edge.orientedReadIds[0].flipStrand();
+        edge.orientedReadIds[1].flipStrand();
+        CZI_ASSERT(edge.orientedReadIds[0] < edge.orientedReadIds[1]);
+        edge.crossesStrands = previousEdges[isSwapped ? edgeId : edgeId+1].crossesStrands;
+        readGraph.edges[edgeId+1] = edge;
+    }
+    previousEdges.remove();
+
+    // Connectivity.
+    permuteVectors(readGraph.connectivity, oldOrientedReadIndex.data(), largeDataName("ReadGraphConnectivity"),
+        largeDataName("tmp-RenumberReads-ReadGraphConnectivity"), largeDataPageSize, threadCount);
+    for(uint32_t& edgeId: readGraph.connectivity) {
+        if(isSwappedEdgePair[edgeId / 2]) {
+            edgeId ^= 1;
+        }
+    }
+
+    // Compact adjacency.
+    readGraph.neighbors.remove();
+    readGraph.createNeighbors(largeDataName("ReadGraphNeighbors"), largeDataPageSize);
+}
@@ -1,11 +1,15 @@
 // shasta.
 #include "Assembler.hpp"
+#include "computeRunLengthRepresentation.hpp"
 #include "ReadLoader.hpp"
+#include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
 // Standard libraries.
+#include "chrono.hpp"
 #include "iterator.hpp"
+#include <sstream>
 
 
 
@@ -14,7 +18,7 @@ void Assembler::checkReadsAreOpen() const
     if(!reads.isOpen()) {
         throw runtime_error("Reads are not accessible.");
     }
-    if(!readRepeatCounts.isOpen()) {
+    if(!readRepeatCounts.isOpen() && !compactReadRepeatCounts.isOpen()) {
         throw runtime_error("Read repeat counts are not accessible.");
     }
 }
@@ -35,17 +39,23 @@ void Assembler::checkReadId(ReadId readId) const
 
 
 
-// Add reads from a fasta file.
+// Add reads from a fasta or fastq file,
+// optionally compressed using gzip or bgzip.
 // The reads are added to those already previously present.
 void Assembler::addReadsFromFasta(
     const string& fileName,
     size_t minReadLength,
     size_t blockSize,
     const size_t threadCountForReading,
-    const size_t threadCountForProcessing)
+    const size_t threadCountForProcessing,
+    bool doubleBuffering)
 {
     checkReadsAreOpen();
     checkReadNamesAreOpen();
+    if(!readRepeatCounts.isOpen()) {
+        throw runtime_error("Reads cannot be added after "
+            "the read repeat counts were compressed and removed.");
+    }
 
     ReadLoader(
         fileName,
@@ -53,17 +63,208 @@ void Assembler::addReadsFromFasta(
         blockSize,
         threadCountForReading,
         threadCountForProcessing,
-        largeDataFileNamePrefix,
-        largeDataPageSize,
+        doubleBuffering,
         reads,
         readNames,
         readRepeatCounts);
 
+    createReadNameIndex(threadCountForProcessing);
+}
+
+
+
+// Add reads from multiple fasta or fastq files, loading
+// up to maxConcurrentFileCount of them concurrently.
+// Each file is loaded by a ReadLoader into temporary data structures,
+// which are then appended to the permanent ones in the order of fileNames.
+void Assembler::addReadsFromFastaFiles(
+    const vector<string>& fileNames,
+    size_t minReadLength,
+    size_t blockSize,
+    size_t threadCountForReading,
+    size_t threadCountForProcessing,
+    size_t maxConcurrentFileCount)
+{
+    checkReadsAreOpen();
+    checkReadNamesAreOpen();
+    if(!readRepeatCounts.isOpen()) {
+        throw runtime_error("Reads cannot be added after "
+            "the read repeat counts were compressed and removed.");
+    }
+
+    // Adjust the numbers of threads and of concurrent files, if necessary.
+    if(threadCountForProcessing == 0) {
+        threadCountForProcessing = std::thread::hardware_concurrency();
+    }
+    if(maxConcurrentFileCount == 0) {
+        maxConcurrentFileCount = threadCountForProcessing;
+    }
+    const size_t concurrentFileCount = min(maxConcurrentFileCount, fileNames.size());
+
+    // If only one file is loaded at a time, load each of them
+    // directly into the permanent data structures.
+    if(concurrentFileCount <= 1) {
+        for(const string& fileName: fileNames) {
+            ReadLoader(
+                fileName,
+                minReadLength,
+                blockSize,
+                threadCountForReading,
+                threadCountForProcessing,
+                false,
+                reads,
+                readNames,
+                readRepeatCounts);
+        }
+        createReadNameIndex(threadCountForProcessing);
+        return;
+    }
+
+
+
+    // Load the files concurrently. Each file uses its share
+    // of the processing threads and of the block size.
+    cout << timestamp << "Loading reads from " << fileNames.size() << " files, " <<
+        concurrentFileCount << " at a time." << endl;
+    auto& data = addReadsFromFastaFilesData;
+    data.fileNames = fileNames;
+    data.minReadLength = minReadLength;
+    data.blockSize = blockSize / concurrentFileCount;
+    data.threadCountForReading = threadCountForReading;
+    data.threadCountForProcessing = max(size_t(1), threadCountForProcessing / concurrentFileCount);
+    data.fileReads.clear();
+    data.fileReads.resize(fileNames.size());
+    data.fileReadNames.clear();
+    data.fileReadNames.resize(fileNames.size());
+    data.fileReadRepeatCounts.clear();
+    data.fileReadRepeatCounts.resize(fileNames.size());
+    data.fileMessages.clear();
+    data.fileMessages.resize(fileNames.size());
+    setupLoadBalancing(fileNames.size(), 1);
+    runThreads(&Assembler::addReadsFromFastaFilesThreadFunction, concurrentFileCount);
+
+
+
+    // Append the reads of each file, in the order of fileNames,
+    // then remove its temporary data structures.
+    cout << timestamp << "Storing the reads of all files." << endl;
+    for(size_t fileIndex=0; fileIndex<fileNames.size(); fileIndex++) {
+        cout << data.fileMessages[fileIndex];
+        LongBaseSequences& fileReads = *data.fileReads[fileIndex];
+        auto& fileReadNames = *data.fileReadNames[fileIndex];
+        auto& fileReadRepeatCounts = *data.fileReadRepeatCounts[fileIndex];
+        for(uint64_t i=0; i<fileReads.size(); i++) {
+            reads.append(fileReads[i]);
+            readNames.appendVector(fileReadNames.begin(i), fileReadNames.end(i));
+            readRepeatCounts.appendVector(fileReadRepeatCounts.begin(i), fileReadRepeatCounts.end(i));
+        }
+        fileReads.remove();
+        fileReadNames.remove();
+        fileReadRepeatCounts.remove();
+    }
+    data.fileReads.clear();
+    data.fileReadNames.clear();
+    data.fileReadRepeatCounts.clear();
+    data.fileMessages.clear();
+    cout << timestamp << "Done loading reads from " << fileNames.size() << " files." << endl;
+
+    createReadNameIndex(threadCountForProcessing);
+}
+
+
+
+void Assembler::addReadsFromFastaFilesThreadFunction(size_t threadId)
+{
+    auto& data = addReadsFromFastaFilesData;
+
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t fileIndex=begin; fileIndex!=end; fileIndex++) {
+            const string namePrefix = "tmp-addReadsFromFastaFiles-" + to_string(fileIndex) + "-";
+
+            auto fileReads = make_shared<LongBaseSequences>();
+            fileReads->createNew(largeDataName(namePrefix + "Reads"), largeDataPageSize);
+            data.fileReads[fileIndex] = fileReads;
+
+            auto fileReadNames = make_shared< MemoryMapped::VectorOfVectors<char, uint64_t> >();
+            fileReadNames->createNew(largeDataName(namePrefix + "ReadNames"), largeDataPageSize);
+            data.fileReadNames[fileIndex] = fileReadNames;
+
+            auto fileReadRepeatCounts = make_shared< MemoryMapped::VectorOfVectors<uint8_t, uint64_t> >();
+            fileReadRepeatCounts->createNew(largeDataName(namePrefix + "ReadRepeatCounts"), largeDataPageSize);
+            data.fileReadRepeatCounts[fileIndex] = fileReadRepeatCounts;
+
+            // Double buffering is not used, because the files
+            // being loaded concurrently already overlap reading and processing.
+            std::ostringstream messages;
+            ReadLoader(
+                data.fileNames[fileIndex],
+                data.minReadLength,
+                data.blockSize,
+                data.threadCountForReading,
+                data.threadCountForProcessing,
+                false,
+                *fileReads,
+                *fileReadNames,
+                *fileReadRepeatCounts,
+                messages);
+            data.fileMessages[fileIndex] = messages.str();
+        }
+    }
+}
+
+
+
+// Create the hash index used to find reads by name.
+// Any previous index is replaced, so the new index
+// covers all reads, including any just added.
+void Assembler::createReadNameIndex(size_t threadCount)
+{
+    checkReadNamesAreOpen();
+    if(readNameIndex.isOpen()) {
+        readNameIndex.remove();
+    }
+    readNameIndex.createNew(readNames, largeDataName("ReadNameIndex"), largeDataPageSize, threadCount);
+}
+
+
+
+void Assembler::accessReadNameIndex()
+{
+    readNameIndex.accessExistingReadOnly(largeDataName("ReadNameIndex"));
+}
+
+
+
+ReadId Assembler::getReadId(const string& readName) const
+{
+    checkReadNamesAreOpen();
+    if(!readNameIndex.isOpen()) {
+        throw runtime_error("The read name index is not accessible.");
+    }
+    return readNameIndex.find(readNames, readName.data(), readName.data() + readName.size());
+}
+
+
+
+// Batch version of getReadId.
+vector<ReadId> Assembler::getReadIds(const vector<string>& readNamesToFind) const
+{
+    vector<ReadId> readIds;
+    readIds.reserve(readNamesToFind.size());
+    for(const string& readName: readNamesToFind) {
+        readIds.push_back(getReadId(readName));
+    }
+    return readIds;
 }
 
 
 // Create a histogram of read lengths.
 void Assembler::histogramReadLength(const string& fileName)
+{
+    histogramReadLength(fileName, cout);
+}
+void Assembler::histogramReadLength(const string& fileName, ostream& out)
 {
 
     checkReadsAreOpen();
@@ -101,10 +302,10 @@ void Assembler::histogramReadLength(const string& fileName)
         }
         CZI_ASSERT(cumulativeFrequency == readCount());
         CZI_ASSERT(cumulativeBaseCount == totalBaseCount);
-        cout << "Total number of reads is " << cumulativeFrequency << endl;
-        cout << "Total number of raw bases is " << cumulativeBaseCount << endl;
-        cout << "Average read length is " << double(cumulativeBaseCount) / double(cumulativeFrequency);
-        cout << " bases." << endl;
+        out << "Total number of reads is " << cumulativeFrequency << endl;
+        out << "Total number of raw bases is " << cumulativeBaseCount << endl;
+        out << "Average read length is " << double(cumulativeBaseCount) / double(cumulativeFrequency);
+        out << " bases." << endl;
     }
 
 
@@ -140,6 +341,88 @@ void Assembler::histogramReadLength(const string& fileName)
 
 
 
+// Micro-benchmark for computeRunLengthRepresentation.
+// This reconstructs the raw sequence of each read,
+// then computes its run-length representation using the
+// original scalar code and the vectorized code selected for this CPU.
+// It checks that the results are identical and writes out the
+// time taken by each version.
+// The run-length representation is recomputed repeatCount times
+// for each read, to make timings more stable.
+void Assembler::benchmarkRunLengthRepresentation(size_t repeatCount)
+{
+    checkReadsAreOpen();
+    CZI_ASSERT(repeatCount > 0);
+
+    // Reconstruct the raw sequences of all reads.
+    vector< vector<Base> > rawSequences(readCount());
+    size_t totalBaseCount = 0;
+    for(ReadId readId=0; readId<readCount(); readId++) {
+        rawSequences[readId] = getOrientedReadRawSequence(OrientedReadId(readId, 0));
+        totalBaseCount += rawSequences[readId].size();
+    }
+    cout << "Benchmarking computeRunLengthRepresentation on " << readCount() <<
+        " reads with a total " << totalBaseCount << " raw bases." << endl;
+
+    // Time the scalar version.
+    vector<Base> runLengthSequence;
+    vector<uint8_t> readRepeatCount;
+    size_t scalarRunCount = 0;
+    const auto scalarBegin = steady_clock::now();
+    for(size_t iteration=0; iteration<repeatCount; iteration++) {
+        for(const vector<Base>& rawSequence: rawSequences) {
+            if(computeRunLengthRepresentationScalar(rawSequence, runLengthSequence, readRepeatCount)) {
+                scalarRunCount += runLengthSequence.size();
+            }
+        }
+    }
+    const auto scalarEnd = steady_clock::now();
+    const double scalarTime = seconds(scalarEnd - scalarBegin);
+
+    // Time the version selected for this CPU.
+    size_t vectorizedRunCount = 0;
+    const auto vectorizedBegin = steady_clock::now();
+    for(size_t iteration=0; iteration<repeatCount; iteration++) {
+        for(const vector<Base>& rawSequence: rawSequences) {
+            if(computeRunLengthRepresentation(rawSequence, runLengthSequence, readRepeatCount)) {
+                vectorizedRunCount += runLengthSequence.size();
+            }
+        }
+    }
+    const auto vectorizedEnd = steady_clock::now();
+    const double vectorizedTime = seconds(vectorizedEnd - vectorizedBegin);
+
+    // Check that the two versions give identical results.
+    vector<Base> scalarRunLengthSequence;
+    vector<uint8_t> scalarRepeatCount;
+    for(ReadId readId=0; readId<readCount(); readId++) {
+        const bool scalarSuccess = computeRunLengthRepresentationScalar(
+            rawSequences[readId], scalarRunLengthSequence, scalarRepeatCount);
+        const bool vectorizedSuccess = computeRunLengthRepresentation(
+            rawSequences[readId], runLengthSequence, readRepeatCount);
+        if(scalarSuccess != vectorizedSuccess ||
+            (scalarSuccess && (
+            scalarRunLengthSequence != runLengthSequence ||
+            scalarRepeatCount != readRepeatCount))) {
+            throw runtime_error("Run-length representation mismatch for read " +
+                to_string(readId));
+        }
+    }
+    CZI_ASSERT(scalarRunCount == vectorizedRunCount);
+
+    const double processedBaseCount = double(totalBaseCount) * double(repeatCount);
+    cout << "Scalar version: " << scalarTime << " s, " <<
+        processedBaseCount / (scalarTime * 1.e6) << " Mbases/s." << endl;
+    cout << computeRunLengthRepresentationImplementation() << " version: " <<
+        vectorizedTime << " s, " <<
+        processedBaseCount / (vectorizedTime * 1.e6) << " Mbases/s." << endl;
+    if(vectorizedTime > 0.) {
+        cout << "Speedup " << scalarTime / vectorizedTime << endl;
+    }
+}
+
+
+
 // Function to write one or all reads in Fasta format.
 void Assembler::writeReads(const string& fileName)
 {
@@ -226,7 +509,13 @@ void Assembler::writeOrientedRead(OrientedReadId orientedReadId, ostream& file)
     file << " " << readSequence.baseCount << " ";
     copy(readName.begin(), readName.end(), ostream_iterator<char>(file));
     file << "\n";
-    readSequence.write(file, strand==1);
+    if(strand == 0) {
+        file << readSequence;
+    } else {
+        LongBaseSequence reverseComplementedSequence(readSequence.baseCount);
+        readSequence.reverseComplement(reverseComplementedSequence.begin);
+        file << reverseComplementedSequence;
+    }
     file << "\n";
 
 }
@@ -236,24 +525,31 @@ void Assembler::writeOrientedRead(OrientedReadId orientedReadId, ostream& file)
 // Return a vector containing the raw sequence of an oriented read.
 vector<Base> Assembler::getOrientedReadRawSequence(OrientedReadId orientedReadId)
 {
+    const ReadId readId = orientedReadId.getReadId();
+    const auto read = reads[readId];
+    vector<uint8_t> counts;
+    getReadRepeatCounts(readId, counts);
+
     // The sequence we will return;
     vector<Base> sequence;
-
-    // The number of bases stored, in run-length representation.
-    const uint32_t storedBaseCount = uint32_t(reads[orientedReadId.getReadId()].baseCount);
-
+    sequence.reserve(getReadRawSequenceLength(readId));
 
     // We are storing a run-length representation of the read.
-    // Expand it base by base to create the raw representation.
-    for(uint32_t position=0; position<storedBaseCount; position++) {
-        Base base;
-        uint8_t count;
-        tie(base, count) = getOrientedReadBaseAndRepeatCount(orientedReadId, position);
+    // Expand it base by base to create the raw representation
+    // of strand 0.
+    for(uint64_t position=0; position<read.baseCount; position++) {
+        const Base base = read[position];
+        const uint8_t count = counts[position];
         for(uint32_t i=0; i<uint32_t(count); i++) {
             sequence.push_back(base);
         }
     }
 
+    // For strand 1, reverse complement it.
+    if(orientedReadId.getStrand() == 1) {
+        reverseComplement(sequence);
+    }
+
     return sequence;
 }
 
@@ -270,6 +566,10 @@ size_t Assembler::getReadRawSequenceLength(ReadId readId)
         // the repeat counts.
         // Don't use std::accumulate to compute the sum,
         // otherwise the sum is computed using uint8_t!
+        // The compact representation stores the sum.
+        if(!readRepeatCounts.isOpen()) {
+            return compactReadRepeatCounts.rawSize(readId);
+        }
         const auto& counts = readRepeatCounts[readId];
         size_t sum = 0;;
         for(uint8_t count: counts) {
@@ -288,7 +588,8 @@ vector<uint32_t> Assembler::getRawPositions(OrientedReadId orientedReadId) const
 {
     const ReadId readId = orientedReadId.getReadId();
     const ReadId strand = orientedReadId.getStrand();
-    const auto repeatCounts = readRepeatCounts[readId];
+    vector<uint8_t> repeatCounts;
+    getReadRepeatCounts(readId, repeatCounts);
     const size_t n = repeatCounts.size();
 
     vector<uint32_t> v;
@@ -310,6 +611,132 @@ vector<uint32_t> Assembler::getRawPositions(OrientedReadId orientedReadId) const
 
 
 
+// Subsample the reads to a target coverage, keeping the longest reads.
+// All reads of the shortest length kept are kept,
+// so the coverage obtained can be slightly above the target.
+void Assembler::subsampleReads(double targetCoverage, uint64_t genomeSize)
+{
+    checkReadsAreOpen();
+    CZI_ASSERT(readFlags.isOpenWithWriteAccess);
+    CZI_ASSERT(readFlags.size() == readCount());
+    if(targetCoverage <= 0. || genomeSize == 0) {
+        throw runtime_error("Invalid target coverage or genome size for read subsampling.");
+    }
+    const uint64_t targetBaseCount = uint64_t(targetCoverage * double(genomeSize));
+
+    // Create a histogram of read lengths, as in histogramReadLength.
+    vector<uint64_t> readLengths(readCount());
+    vector<uint64_t> histogram;
+    uint64_t totalBaseCount = 0;
+    for(ReadId readId=0; readId<readCount(); readId++) {
+        const uint64_t length = getReadRawSequenceLength(readId);
+        readLengths[readId] = length;
+        totalBaseCount += length;
+        if(histogram.size() <= length) {
+            histogram.resize(length+1, 0);
+        }
+        ++(histogram[length]);
+    }
+
+    // Going down from the longest reads, find the minimum
+    // read length required to reach the target number of bases.
+    uint64_t minLength = 0;
+    uint64_t keptBaseCount = 0;
+    for(uint64_t length=histogram.size(); length>0; length--) {
+        keptBaseCount += histogram[length-1] * (length-1);
+        if(keptBaseCount >= targetBaseCount) {
+            minLength = length-1;
+            break;
+        }
+    }
+
+    // Flag the reads shorter than that as excluded.
+    uint64_t keptReadCount = 0;
+    keptBaseCount = 0;
+    for(ReadId readId=0; readId<readCount(); readId++) {
+        const bool isExcluded = readLengths[readId] < minLength;
+        readFlags[readId].isExcluded = isExcluded ? 1 : 0;
+        if(!isExcluded) {
+            ++keptReadCount;
+            keptBaseCount += readLengths[readId];
+        }
+    }
+
+    cout << "Read subsampling to coverage " << targetCoverage <<
+        " for genome size " << genomeSize << " kept " << keptReadCount <<
+        " reads of length at least " << minLength << " out of " << readCount() <<
+        ", with " << keptBaseCount << " raw bases out of " << totalBaseCount <<
+        ". Coverage of the kept reads is " <<
+        double(keptBaseCount) / double(genomeSize) << "." << endl;
+}
+
+
+
+// Store the read repeat counts in the compact representation
+// described in CompactRepeatCounts.hpp.
+// If removeReadRepeatCounts is true, the one byte per base
+// representation is removed, and from then on read repeat counts
+// are decoded on the fly from compactReadRepeatCounts.
+// No more reads can be added after that.
+void Assembler::compressReadRepeatCounts(bool removeReadRepeatCounts)
+{
+    checkReadsAreOpen();
+    if(!readRepeatCounts.isOpen()) {
+        throw runtime_error("Read repeat counts were already compressed.");
+    }
+    const auto t0 = steady_clock::now();
+
+    compactReadRepeatCounts.createNew(largeDataName("CompactReadRepeatCounts"), largeDataPageSize);
+    for(ReadId readId=0; readId<readCount(); readId++) {
+        const auto counts = readRepeatCounts[readId];
+        compactReadRepeatCounts.append(counts.begin(), counts.end());
+    }
+
+    const auto t1 = steady_clock::now();
+    cout << timestamp << "Compressed the repeat counts of " << readCount() <<
+        " reads in " << seconds(t1 - t0) << " s. Uncompressed size " <<
+        readRepeatCounts.totalSize() << " bytes, compressed size " <<
+        compactReadRepeatCounts.byteCount() << " bytes." << endl;
+
+    if(removeReadRepeatCounts) {
+        readRepeatCounts.remove();
+    }
+}
+
+
+
+void Assembler::accessCompactReadRepeatCounts()
+{
+    compactReadRepeatCounts.accessExistingReadOnly(largeDataName("CompactReadRepeatCounts"));
+}
+
+
+
+void Assembler::getReadRepeatCounts(
+    ReadId readId,
+    uint64_t begin,
+    uint64_t end,
+    uint8_t* output) const
+{
+    if(readRepeatCounts.isOpen()) {
+        const uint8_t* counts = readRepeatCounts.begin(readId);
+        copy(counts + begin, counts + end, output);
+    } else {
+        compactReadRepeatCounts.get(readId, begin, end, output);
+    }
+}
+void Assembler::getReadRepeatCounts(ReadId readId, vector<uint8_t>& counts) const
+{
+    if(readRepeatCounts.isOpen()) {
+        counts.resize(readRepeatCounts.size(readId));
+    } else {
+        counts.resize(compactReadRepeatCounts.size(readId));
+    }
+    getReadRepeatCounts(readId, 0, counts.size(), counts.data());
+}
+
+
+
 void Assembler::initializeReadFlags()
 {
     readFlags.createNew(largeDataName("ReadFlags"), largeDataPageSize);
@@ -317,5 +744,10 @@ void Assembler::initializeReadFlags()
 }
 void Assembler::accessReadFlags(bool readWriteAccess)
 {
+#ifndef SHASTA_STATIC_EXECUTABLE
+    if(readWriteAccess) {
+        clearHttpResponseCache();
+    }
+#endif
     readFlags.accessExisting(largeDataName("ReadFlags"), readWriteAccess);
 }
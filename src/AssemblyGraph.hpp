@@ -16,11 +16,14 @@ vertex in the assembly graph.
 ***************************************************************************/
 
 // Shasta.
+#include "CompactRepeatCounts.hpp"
 #include "LongBaseSequence.hpp"
 #include "MarkerGraph.hpp"
 #include "MemoryMappedVectorOfVectors.hpp"
+#include "Uint.hpp"
 
 // Standard library.
+#include "algorithm.hpp"
 #include <limits>
 
 namespace ChanZuckerberg {
@@ -98,19 +101,49 @@ public:
     // A table that can be used to find the location of a marker graph
     // edge in the assembly graph, if any.
     // Indexed by the edge id in the marker graph, gives for each marker graph
-    // edge a pair(EdgeId, position), where:
-    // - EdgeId is the id of the assembly graph edge containing the
+    // edge a MarkerToAssemblyEntry containing:
+    // - The id of the assembly graph edge containing the
     //   given marker graph edge, or invalidEdgeId
     //   if the marker graph edge is not part of any assembly graph edge.
-    // - Position is the index of this marker graph edge in the
+    // - The position, that is the index of this marker graph edge in the
     //   chain corresponding to that assembly graph edge.
-    MemoryMapped::Vector< pair<EdgeId, uint32_t> > markerToAssemblyTable;
+    // Each entry is packed in 8 bytes, using 40 bits for the edge id
+    // and 24 bits for the position. Positions that don't fit
+    // in 24 bits are stored as maxPosition.
+    class MarkerToAssemblyEntry {
+    public:
+        static const uint64_t maxPosition = (1ULL << 24) - 1ULL;
+
+        MarkerToAssemblyEntry() :
+            edgeId(invalidPackedEdgeId), position(0) {}
+        MarkerToAssemblyEntry(EdgeId edgeIdArgument, uint64_t positionArgument) :
+            edgeId(edgeIdArgument == invalidEdgeId ? invalidPackedEdgeId : edgeIdArgument),
+            position(uint32_t(min(positionArgument, maxPosition))) {}
+
+        EdgeId getEdgeId() const
+        {
+            const EdgeId e = edgeId;
+            return (e == invalidPackedEdgeId) ? invalidEdgeId : e;
+        }
+        uint32_t getPosition() const
+        {
+            return position;
+        }
+    private:
+        static const uint64_t invalidPackedEdgeId = (1ULL << 40) - 1ULL;
+        Uint40 edgeId;
+        Uint24 position;
+    };
+    static_assert(sizeof(MarkerToAssemblyEntry) == 8, "Unexpected size of MarkerToAssemblyEntry.");
+    MemoryMapped::Vector<MarkerToAssemblyEntry> markerToAssemblyTable;
 
     // The assembled sequenced and repeat counts for each edge of the
     // assembly graph.
     // Indexed edge id in the assembly graph.
+    // The sequences use 2 bits per base, and the repeat counts
+    // use the compact representation described in CompactRepeatCounts.hpp.
     LongBaseSequences sequences;
-    MemoryMapped::VectorOfVectors<uint8_t, uint64_t> repeatCounts;
+    CompactRepeatCounts repeatCounts;
 
     // Close and remove all open data.
     void remove();
@@ -0,0 +1,222 @@
+// Shasta.
+#include "AsynchronousReader.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include <cerrno>
+#include <cstring>
+#include "stdexcept.hpp"
+
+// Linux.
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define CZI_SHASTA_HAS_IO_URING
+#endif
+#endif
+
+
+
+AsynchronousReader::AsynchronousReader(
+    size_t queueDepth,
+    size_t requestSize) :
+    queueDepth(queueDepth),
+    requestSize(requestSize)
+{
+#ifdef CZI_SHASTA_HAS_IO_URING
+    io_uring_params parameters;
+    std::memset(&parameters, 0, sizeof(parameters));
+    ringFileDescriptor = int(::syscall(__NR_io_uring_setup, unsigned(queueDepth), &parameters));
+    if(ringFileDescriptor == -1) {
+        unavailableReason = string("io_uring_setup failed: ") + ::strerror(errno);
+        return;
+    }
+
+    // The kernel can round up the number of entries.
+    this->queueDepth = min(queueDepth, size_t(parameters.sq_entries));
+    this->queueDepth = min(this->queueDepth, size_t(parameters.cq_entries));
+    requests.resize(this->queueDepth);
+
+    // Map the submission queue ring, the submission queue entries,
+    // and the completion queue ring.
+    submissionRingSize = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+    submissionEntriesSize = parameters.sq_entries * sizeof(io_uring_sqe);
+    completionRingSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(io_uring_cqe);
+    submissionRing = ::mmap(0, submissionRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ringFileDescriptor, IORING_OFF_SQ_RING);
+    submissionEntries = ::mmap(0, submissionEntriesSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ringFileDescriptor, IORING_OFF_SQES);
+    completionRing = ::mmap(0, completionRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ringFileDescriptor, IORING_OFF_CQ_RING);
+    if(submissionRing == MAP_FAILED || submissionEntries == MAP_FAILED || completionRing == MAP_FAILED) {
+        unavailableReason = string("Mapping the io_uring failed: ") + ::strerror(errno);
+        cleanup();
+        return;
+    }
+
+    char* s = static_cast<char*>(submissionRing);
+    submissionHead = reinterpret_cast<unsigned*>(s + parameters.sq_off.head);
+    submissionTail = reinterpret_cast<unsigned*>(s + parameters.sq_off.tail);
+    submissionMask = reinterpret_cast<unsigned*>(s + parameters.sq_off.ring_mask);
+    submissionArray = reinterpret_cast<unsigned*>(s + parameters.sq_off.array);
+    char* c = static_cast<char*>(completionRing);
+    completionHead = reinterpret_cast<unsigned*>(c + parameters.cq_off.head);
+    completionTail = reinterpret_cast<unsigned*>(c + parameters.cq_off.tail);
+    completionMask = reinterpret_cast<unsigned*>(c + parameters.cq_off.ring_mask);
+    completions = c + parameters.cq_off.cqes;
+#else
+    unavailableReason = "io_uring is not supported on this platform.";
+#endif
+}
+
+
+
+AsynchronousReader::~AsynchronousReader()
+{
+    cleanup();
+}
+
+
+
+void AsynchronousReader::cleanup()
+{
+    if(submissionRing && submissionRing != MAP_FAILED) {
+        ::munmap(submissionRing, submissionRingSize);
+    }
+    if(submissionEntries && submissionEntries != MAP_FAILED) {
+        ::munmap(submissionEntries, submissionEntriesSize);
+    }
+    if(completionRing && completionRing != MAP_FAILED) {
+        ::munmap(completionRing, completionRingSize);
+    }
+    submissionRing = 0;
+    submissionEntries = 0;
+    completionRing = 0;
+    if(ringFileDescriptor != -1) {
+        ::close(ringFileDescriptor);
+        ringFileDescriptor = -1;
+    }
+}
+
+
+
+void AsynchronousReader::prepare(int fileDescriptor, uint64_t slot)
+{
+#ifdef CZI_SHASTA_HAS_IO_URING
+    // We are the only producer, so the tail can be read without synchronization.
+    const unsigned tail = *submissionTail;
+    const unsigned index = tail & *submissionMask;
+    io_uring_sqe& entry = static_cast<io_uring_sqe*>(submissionEntries)[index];
+    std::memset(&entry, 0, sizeof(entry));
+    entry.opcode = IORING_OP_READV;
+    entry.fd = fileDescriptor;
+    entry.addr = reinterpret_cast<uint64_t>(&requests[slot].ioVector);
+    entry.len = 1;
+    entry.off = requests[slot].offset;
+    entry.user_data = slot;
+    submissionArray[index] = index;
+
+    // Make the entry visible to the kernel.
+    __atomic_store_n(submissionTail, tail + 1, __ATOMIC_RELEASE);
+#endif
+}
+
+
+
+// Read exactly byteCount bytes from the given file,
+// starting at the given offset.
+// The range is divided into reads of at most requestSize bytes.
+// Up to queueDepth of them are kept in flight. Each time one completes,
+// the next one is submitted. A short read is resubmitted for the remaining bytes.
+// In case of error, we wait for the reads in flight to complete
+// before throwing, because they write to the buffer.
+void AsynchronousReader::read(int fileDescriptor, char* buffer, size_t byteCount, size_t offset)
+{
+    CZI_ASSERT(isAvailable());
+
+#ifdef CZI_SHASTA_HAS_IO_URING
+    // The slots not in use.
+    vector<uint64_t> freeSlots;
+    for(uint64_t slot=0; slot<queueDepth; slot++) {
+        freeSlots.push_back(slot);
+    }
+
+    size_t nextByte = 0;        // The next byte not yet requested.
+    unsigned pendingCount = 0;  // Prepared but not yet submitted.
+    uint64_t inFlightCount = 0; // Submitted but not yet completed.
+    string errorMessage;
+    while((errorMessage.empty() && nextByte < byteCount) || pendingCount + inFlightCount > 0) {
+
+        // Prepare reads for the free slots.
+        while(errorMessage.empty() && nextByte < byteCount && !freeSlots.empty()) {
+            const uint64_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            Request& request = requests[slot];
+            const size_t n = min(requestSize, byteCount - nextByte);
+            request.ioVector.iov_base = buffer + nextByte;
+            request.ioVector.iov_len = n;
+            request.offset = offset + nextByte;
+            prepare(fileDescriptor, slot);
+            ++pendingCount;
+            nextByte += n;
+        }
+
+        // Submit them and wait for at least one to complete.
+        const long submittedCount = ::syscall(__NR_io_uring_enter, ringFileDescriptor,
+            pendingCount, 1, IORING_ENTER_GETEVENTS, 0, 0);
+        if(submittedCount == -1) {
+            if(errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            // Nothing more can be submitted or waited for.
+            throw runtime_error(string("Error during io_uring_enter: ") + ::strerror(errno));
+        }
+        pendingCount -= unsigned(submittedCount);
+        inFlightCount += uint64_t(submittedCount);
+
+        // Process the completions.
+        unsigned head = *completionHead;
+        const unsigned tail = __atomic_load_n(completionTail, __ATOMIC_ACQUIRE);
+        for(; head!=tail; ++head) {
+            const io_uring_cqe& completion =
+                static_cast<const io_uring_cqe*>(completions)[head & *completionMask];
+            const uint64_t slot = completion.user_data;
+            const int result = completion.res;
+            Request& request = requests[slot];
+            --inFlightCount;
+
+            if(!errorMessage.empty()) {
+                freeSlots.push_back(slot);
+            } else if(result == -EINTR || result == -EAGAIN) {
+                prepare(fileDescriptor, slot);
+                ++pendingCount;
+            } else if(result < 0) {
+                errorMessage = string("Error during read: ") + ::strerror(-result);
+            } else if(result == 0) {
+                errorMessage = "Unexpected end of file during read.";
+            } else if(size_t(result) < request.ioVector.iov_len) {
+
+                // Short read. Request the rest.
+                request.ioVector.iov_base = static_cast<char*>(request.ioVector.iov_base) + result;
+                request.ioVector.iov_len -= size_t(result);
+                request.offset += size_t(result);
+                prepare(fileDescriptor, slot);
+                ++pendingCount;
+            } else {
+                freeSlots.push_back(slot);
+            }
+        }
+        __atomic_store_n(completionHead, head, __ATOMIC_RELEASE);
+    }
+
+    if(!errorMessage.empty()) {
+        throw runtime_error(errorMessage);
+    }
+#endif
+}
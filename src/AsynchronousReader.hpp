@@ -0,0 +1,122 @@
+#ifndef CZI_SHASTA_ASYNCHRONOUS_READER_HPP
+#define CZI_SHASTA_ASYNCHRONOUS_READER_HPP
+
+/*******************************************************************************
+
+Class AsynchronousReader reads large ranges of a file using io_uring
+(Linux 5.1 or newer), keeping a deep queue of large reads in flight.
+A single thread can then reach the bandwidth of fast storage (NVMe),
+which with blocking pread calls requires many threads.
+The data are read directly into the destination buffer, without copies.
+
+io_uring is used via the raw system calls, so no library is required.
+It can be unavailable because the kernel is too old, or because
+a container does not allow it (seccomp). In that case isAvailable
+returns false and the caller must use ordinary blocking reads.
+
+An AsynchronousReader is not thread safe: it can only
+be used by one thread at a time.
+
+*******************************************************************************/
+
+// Standard library.
+#include "cstddef.hpp"
+#include "cstdint.hpp"
+#include "string.hpp"
+#include "vector.hpp"
+
+// Linux.
+#include <sys/uio.h>
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class AsynchronousReader;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::AsynchronousReader {
+public:
+
+    // Set up an io_uring with the given queue depth
+    // (the maximum number of reads in flight),
+    // each reading at most requestSize bytes.
+    // If this fails, isAvailable returns false
+    // and getUnavailableReason describes why.
+    AsynchronousReader(
+        size_t queueDepth = 32,
+        size_t requestSize = 4 * 1024 * 1024);
+    ~AsynchronousReader();
+
+    // Disallow C++ copy and assignment.
+    AsynchronousReader(const AsynchronousReader&) = delete;
+    AsynchronousReader& operator=(const AsynchronousReader&) = delete;
+
+    bool isAvailable() const
+    {
+        return ringFileDescriptor != -1;
+    }
+    const string& getUnavailableReason() const
+    {
+        return unavailableReason;
+    }
+    size_t getQueueDepth() const
+    {
+        return queueDepth;
+    }
+    size_t getRequestSize() const
+    {
+        return requestSize;
+    }
+
+    // Read exactly byteCount bytes from the given file,
+    // starting at the given offset.
+    // Throws an exception in case of error or if the file is too short.
+    void read(int fileDescriptor, char* buffer, size_t byteCount, size_t offset);
+
+private:
+    size_t queueDepth;
+    size_t requestSize;
+    int ringFileDescriptor = -1;
+    string unavailableReason;
+
+    // The submission queue ring, the submission queue entries,
+    // and the completion queue ring, as mapped from the kernel.
+    // The entries are stored as void* to avoid including
+    // <linux/io_uring.h> here.
+    void* submissionRing = 0;
+    size_t submissionRingSize = 0;
+    void* submissionEntries = 0;
+    size_t submissionEntriesSize = 0;
+    void* completionRing = 0;
+    size_t completionRingSize = 0;
+
+    // Pointers to the fields of the rings.
+    unsigned* submissionHead = 0;
+    unsigned* submissionTail = 0;
+    unsigned* submissionMask = 0;
+    unsigned* submissionArray = 0;
+    unsigned* completionHead = 0;
+    unsigned* completionTail = 0;
+    unsigned* completionMask = 0;
+    void* completions = 0;
+
+    // A read in flight. Each occupies a slot, identified by its index
+    // in the requests vector, which is also used as the user data
+    // of the submission queue entry. The iovec must remain valid
+    // until the read completes.
+    class Request {
+    public:
+        iovec ioVector;
+        size_t offset;
+    };
+    vector<Request> requests;
+
+    // Queue a read for the given slot, without submitting it.
+    void prepare(int fileDescriptor, uint64_t slot);
+
+    void cleanup();
+};
+
+#endif
@@ -31,6 +31,7 @@ class ChanZuckerberg::shasta::BiasedGaussianConsensusCaller :
 public:
 
     virtual Consensus operator()(const Coverage&) const;
+    using ConsensusCaller::operator();
 
 };
 
@@ -0,0 +1,196 @@
+#ifndef CZI_SHASTA_COMPACT_COVERAGE_HPP
+#define CZI_SHASTA_COMPACT_COVERAGE_HPP
+
+// Shasta.
+#include "Base.hpp"
+#include "CZI_ASSERT.hpp"
+#include "ReadId.hpp"
+
+// Standard library.
+#include "array.hpp"
+#include <limits>
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class CompactCoverage;
+    }
+}
+
+
+
+// Class CompactCoverage is a lightweight version of class Coverage
+// used for consensus calling during assembly.
+// It stores the same counts as Coverage, indexed by base (ACGT or '-'),
+// strand, and repeat count, but in a fixed size array
+// of 16-bit counters, so it never allocates memory.
+// It does not store per-read information.
+//
+// Repeat counts are only supported up to maxRepeatCount.
+// If a read with a greater repeat count is added, the read
+// is not counted and overflow() returns true.
+// In that case the caller must fall back to using a Coverage object.
+class ChanZuckerberg::shasta::CompactCoverage {
+public:
+
+    static const size_t maxRepeatCount = 31;
+    static const size_t repeatCountSlotCount = maxRepeatCount + 1;
+
+    CompactCoverage()
+    {
+        clear();
+    }
+
+    // Put back into default-constructed state, so the object
+    // can be reused for the next position of an alignment.
+    void clear()
+    {
+        detailedCoverage.fill(0);
+        baseCoverage.fill({0, 0});
+        baseRepeatCountEnd.fill(0);
+        readCount = 0;
+        hasOverflow = false;
+    }
+
+    // Add information about a supporting read.
+    // If the AlignedBase is '-',repeatCount must be zero.
+    // Otherwise, it must not be zero.
+    void addRead(AlignedBase base, Strand strand, size_t repeatCount)
+    {
+        addReads(base, strand, repeatCount, 1);
+    }
+
+    // Same as above, but add n reads with the same
+    // base, strand, and repeat count.
+    void addReads(AlignedBase base, Strand strand, size_t repeatCount, size_t n)
+    {
+        const size_t baseValue = base.value;
+        CZI_ASSERT(baseValue < 5);
+        CZI_ASSERT(strand < 2);
+        if(base.isGap()) {
+            CZI_ASSERT(repeatCount == 0);
+        } else {
+            CZI_ASSERT(repeatCount > 0);
+        }
+        if(n == 0) {
+            return;
+        }
+        if(repeatCount > maxRepeatCount) {
+            hasOverflow = true;
+            return;
+        }
+        CZI_ASSERT(readCount + n <= std::numeric_limits<uint16_t>::max());
+
+        detailedCoverage[(baseValue*2 + strand)*repeatCountSlotCount + repeatCount] += uint16_t(n);
+        baseCoverage[baseValue][strand] += uint16_t(n);
+        readCount += uint16_t(n);
+        if(repeatCount >= baseRepeatCountEnd[baseValue]) {
+            baseRepeatCountEnd[baseValue] = uint8_t(repeatCount + 1);
+        }
+    }
+
+    // Return true if a read with repeat count greater than
+    // maxRepeatCount was added. If so, the counts are incomplete.
+    bool overflow() const
+    {
+        return hasOverflow;
+    }
+
+    // The total number of reads that were added.
+    size_t coverage() const
+    {
+        return readCount;
+    }
+
+    // Get coverage for a given base,
+    // summing over all repeats and both strands.
+    size_t coverage(AlignedBase base) const
+    {
+        CZI_ASSERT(base.value < 5);
+        return size_t(baseCoverage[base.value][0]) + size_t(baseCoverage[base.value][1]);
+    }
+
+    // Get coverage for a given base and repeat count,
+    // summing over both strands.
+    size_t coverage(AlignedBase base, size_t repeatCount) const
+    {
+        return coverage(base, 0, repeatCount) + coverage(base, 1, repeatCount);
+    }
+
+    // Get coverage for a given base, strand, and repeat count.
+    size_t coverage(AlignedBase base, Strand strand, size_t repeatCount) const
+    {
+        CZI_ASSERT(base.value < 5);
+        if(repeatCount > maxRepeatCount) {
+            return 0;
+        }
+        return detailedCoverage[(base.value*2 + strand)*repeatCountSlotCount + repeatCount];
+    }
+
+    // Get, for a given base, the first repeat count for which
+    // coverage becomes permanently zero.
+    // This can be used to loop over repeat counts for that base.
+    size_t repeatCountEnd(AlignedBase base) const
+    {
+        CZI_ASSERT(base.value < 5);
+        return baseRepeatCountEnd[base.value];
+    }
+
+    // Return the base with the most coverage.
+    // This can return ACGT or '-'.
+    // Ties are broken in favor of the "earlier" base,
+    // same as Coverage::mostFrequentBase.
+    AlignedBase mostFrequentBase() const
+    {
+        uint8_t bestBaseValue = 4;
+        size_t bestBaseCoverage = 0;
+        for(uint8_t baseValue=0; baseValue<5; baseValue++) {
+            const size_t c = coverage(AlignedBase::fromInteger(baseValue));
+            if(c > bestBaseCoverage) {
+                bestBaseValue = baseValue;
+                bestBaseCoverage = c;
+            }
+        }
+        return AlignedBase::fromInteger(bestBaseValue);
+    }
+
+    // Get the repeat count with the most coverage for a given base.
+    // Ties are broken in favor of the longer repeat count,
+    // same as Coverage::mostFrequentRepeatCount.
+    size_t mostFrequentRepeatCount(AlignedBase base) const
+    {
+        CZI_ASSERT(base.value < 5);
+        const uint16_t* c0 = &detailedCoverage[(base.value*2 + 0)*repeatCountSlotCount];
+        const uint16_t* c1 = &detailedCoverage[(base.value*2 + 1)*repeatCountSlotCount];
+        const size_t countEnd = repeatCountEnd(base);
+        size_t bestCount = 0;
+        size_t bestCountCoverage = 0;
+        for(size_t repeatCount=0; repeatCount<countEnd; repeatCount++) {
+            const size_t c = size_t(c0[repeatCount]) + size_t(c1[repeatCount]);
+            if(c >= bestCountCoverage) {
+                bestCount = repeatCount;
+                bestCountCoverage = c;
+            }
+        }
+        return bestCount;
+    }
+
+private:
+
+    // Coverage for each base (ACGT or '-'), strand, and repeat count.
+    // Indexed by [(AlignedBase::value*2 + strand)*repeatCountSlotCount + repeatCount].
+    array<uint16_t, 5*2*repeatCountSlotCount> detailedCoverage;
+
+    // Coverage for each base (ACGT or '-') and strand.
+    // Indexed by [AlignedBase::value][strand].
+    array< array<uint16_t, 2>, 5> baseCoverage;
+
+    // For each base, one more than the largest repeat count seen.
+    array<uint8_t, 5> baseRepeatCountEnd;
+
+    uint16_t readCount;
+    bool hasOverflow;
+};
+
+
+
+#endif
@@ -0,0 +1,99 @@
+// Shasta.
+#include "CompactLocalMarkerGraph.hpp"
+#include "ForceDirectedLayout.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include <cmath>
+#include "iostream.hpp"
+
+
+
+bool CompactLocalMarkerGraph::computeLayout(double timeout)
+{
+    vector< pair<uint32_t, uint32_t> > layoutEdges;
+    layoutEdges.reserve(edges.size());
+    for(const Edge& edge: edges) {
+        layoutEdges.push_back(make_pair(edge.source, edge.target));
+    }
+    return ForceDirectedLayout::compute(vertices.size(), layoutEdges, positions, timeout);
+}
+
+
+
+void CompactLocalMarkerGraph::writeSvg(
+    ostream& svg,
+    uint64_t sizePixels,
+    int maxDistance) const
+{
+    CZI_ASSERT(positions.size() == vertices.size());
+
+    // Find the bounding box of the layout.
+    double xMin = 0.;
+    double xMax = 0.;
+    double yMin = 0.;
+    double yMax = 0.;
+    if(!positions.empty()) {
+        xMin = xMax = positions.front()[0];
+        yMin = yMax = positions.front()[1];
+    }
+    for(const auto& p: positions) {
+        xMin = min(xMin, p[0]);
+        xMax = max(xMax, p[0]);
+        yMin = min(yMin, p[1]);
+        yMax = max(yMax, p[1]);
+    }
+
+    // Scale so the larger dimension of the bounding box fits in sizePixels,
+    // leaving a margin. The natural edge length of the layout is 1.
+    const double margin = 10.;
+    const double extent = max(max(xMax - xMin, yMax - yMin), 1.);
+    const double scale = max(double(sizePixels) - 2. * margin, 1.) / extent;
+    const double width = (xMax - xMin) * scale + 2. * margin;
+    const double height = (yMax - yMin) * scale + 2. * margin;
+    const double vertexRadius = min(max(0.25 * scale, 1.), 8.);
+    const double strokeWidth = min(max(0.05 * scale, 0.2), 2.);
+
+    const auto oldPrecision = svg.precision(6);
+    svg <<
+        "<svg width=" << std::ceil(width) << " height=" << std::ceil(height) << ">\n"
+        "<g transform='translate(" << margin - xMin * scale << "," << margin - yMin * scale << ") "
+        "scale(" << scale << ")'>\n";
+
+    // Edges.
+    svg << "<g stroke=black stroke-width=" << strokeWidth / scale << ">\n";
+    for(const Edge& edge: edges) {
+        const auto& p0 = positions[edge.source];
+        const auto& p1 = positions[edge.target];
+        svg <<
+            "<line x1=" << p0[0] << " y1=" << p0[1] <<
+            " x2=" << p1[0] << " y2=" << p1[1] << ">"
+            "<title>Edge " << edge.edgeId << " from vertex " <<
+            vertices[edge.source].vertexId << " to vertex " <<
+            vertices[edge.target].vertexId << "</title></line>\n";
+    }
+    svg << "</g>\n";
+
+    // Vertices. The colors are the same used by LocalMarkerGraph::write.
+    for(VertexIndex v=0; v<vertices.size(); v++) {
+        const Vertex& vertex = vertices[v];
+        const auto& p = positions[v];
+        const char* color = "black";
+        if(vertex.distance == maxDistance) {
+            color = "cyan";
+        } else if(vertex.distance == 0) {
+            color = "#90ee90";
+        }
+        svg <<
+            "<circle id=vertex" << vertex.vertexId <<
+            " cx=" << p[0] << " cy=" << p[1] << " r=" << vertexRadius / scale <<
+            " fill='" << color << "' style='cursor:pointer'>"
+            "<title>Vertex " << vertex.vertexId << ", distance " << vertex.distance <<
+            ", click to recenter graph here</title></circle>\n";
+    }
+
+    svg << "</g>\n</svg>\n";
+    svg.precision(oldPrecision);
+}
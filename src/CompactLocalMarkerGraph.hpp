@@ -0,0 +1,178 @@
+#ifndef CZI_SHASTA_COMPACT_LOCAL_MARKER_GRAPH_HPP
+#define CZI_SHASTA_COMPACT_LOCAL_MARKER_GRAPH_HPP
+
+/*******************************************************************************
+
+Class CompactLocalMarkerGraph stores the topology of a local subgraph
+of the global marker graph in contiguous vectors, without the per-vertex
+and per-edge heap nodes of the boost::adjacency_list used by LocalMarkerGraph.
+It does not store sequence or coverage information.
+
+Vertices are identified by a local index, in the order in which
+they were added (for a BFS, in order of increasing distance).
+A hash table maps global MarkerGraph::VertexId to local index.
+
+Edges are stored in the order in which they were added.
+After all edges are added, computeAdjacency creates compressed
+adjacency lists (CSR format), so out-edges and in-edges
+of each vertex can be accessed without additional lookups.
+
+For display, computeLayout computes vertex positions using
+ForceDirectedLayout, without calling Graphviz,
+and writeSvg writes the graph in svg format using those positions.
+
+*******************************************************************************/
+
+// Shasta.
+#include "CZI_ASSERT.hpp"
+#include "MarkerGraph.hpp"
+#include "MemoryAsContainer.hpp"
+
+// Standard library.
+#include "array.hpp"
+#include "cstdint.hpp"
+#include "iosfwd.hpp"
+#include <limits>
+#include <unordered_map>
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class CompactLocalMarkerGraph;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::CompactLocalMarkerGraph {
+public:
+
+    using VertexIndex = uint32_t;
+    using EdgeIndex = uint32_t;
+    static const VertexIndex invalidVertexIndex = std::numeric_limits<VertexIndex>::max();
+
+    class Vertex {
+    public:
+        MarkerGraph::VertexId vertexId;
+        int distance;
+    };
+    vector<Vertex> vertices;
+
+    class Edge {
+    public:
+        VertexIndex source;
+        VertexIndex target;
+        MarkerGraph::EdgeId edgeId;
+    };
+    vector<Edge> edges;
+
+    void clear()
+    {
+        vertices.clear();
+        edges.clear();
+        vertexMap.clear();
+        positions.clear();
+        outEdgesBegin.clear();
+        outEdgesData.clear();
+        inEdgesBegin.clear();
+        inEdgesData.clear();
+    }
+
+    // Return the local index of the vertex with the given global id,
+    // or invalidVertexIndex if there is no such vertex.
+    VertexIndex findVertex(MarkerGraph::VertexId vertexId) const
+    {
+        const auto it = vertexMap.find(vertexId);
+        return (it == vertexMap.end()) ? invalidVertexIndex : it->second;
+    }
+
+    // Add a vertex with the given global id, which must not already exist,
+    // and return its local index.
+    VertexIndex addVertex(MarkerGraph::VertexId vertexId, int distance)
+    {
+        const VertexIndex v = VertexIndex(vertices.size());
+        const bool wasInserted = vertexMap.insert(make_pair(vertexId, v)).second;
+        CZI_ASSERT(wasInserted);
+        vertices.push_back({vertexId, distance});
+        return v;
+    }
+
+    // Add an edge. This does not check for duplicates.
+    EdgeIndex addEdge(VertexIndex v0, VertexIndex v1, MarkerGraph::EdgeId edgeId)
+    {
+        const EdgeIndex e = EdgeIndex(edges.size());
+        edges.push_back({v0, v1, edgeId});
+        return e;
+    }
+
+    // Create the compressed adjacency lists.
+    // This must be called after all vertices and edges are added,
+    // and before calling outEdges or inEdges.
+    void computeAdjacency()
+    {
+        computeAdjacency(true, outEdgesBegin, outEdgesData);
+        computeAdjacency(false, inEdgesBegin, inEdgesData);
+    }
+
+    // The indexes of the out-edges and in-edges of a vertex.
+    MemoryAsContainer<const EdgeIndex> outEdges(VertexIndex v) const
+    {
+        return MemoryAsContainer<const EdgeIndex>(
+            outEdgesData.data() + outEdgesBegin[v],
+            outEdgesData.data() + outEdgesBegin[v+1]);
+    }
+    MemoryAsContainer<const EdgeIndex> inEdges(VertexIndex v) const
+    {
+        return MemoryAsContainer<const EdgeIndex>(
+            inEdgesData.data() + inEdgesBegin[v],
+            inEdgesData.data() + inEdgesBegin[v+1]);
+    }
+
+    // Vertex positions, indexed by local vertex index.
+    // Only filled in by computeLayout.
+    vector< array<double, 2> > positions;
+
+    // Compute vertex positions using ForceDirectedLayout.
+    // Edge directions are ignored.
+    // Returns false if the timeout was exceeded.
+    bool computeLayout(double timeout);
+
+    // Write the graph in svg format, using the positions
+    // computed by computeLayout.
+    // Each vertex is written as a circle with id "vertex" followed
+    // by its global vertex id, so the caller can attach event handlers.
+    void writeSvg(ostream&, uint64_t sizePixels, int maxDistance) const;
+
+private:
+    std::unordered_map<MarkerGraph::VertexId, VertexIndex> vertexMap;
+
+    // Compressed adjacency lists.
+    // The edges of vertex v are in [begin[v], begin[v+1]).
+    vector<EdgeIndex> outEdgesBegin;
+    vector<EdgeIndex> outEdgesData;
+    vector<EdgeIndex> inEdgesBegin;
+    vector<EdgeIndex> inEdgesData;
+
+    void computeAdjacency(
+        bool useSource,
+        vector<EdgeIndex>& begin,
+        vector<EdgeIndex>& data) const
+    {
+        begin.assign(vertices.size() + 1, 0);
+        for(const Edge& edge: edges) {
+            ++begin[(useSource ? edge.source : edge.target) + 1];
+        }
+        for(size_t v=0; v<vertices.size(); v++) {
+            begin[v+1] += begin[v];
+        }
+        data.resize(edges.size());
+        vector<EdgeIndex> next(begin.begin(), begin.end()-1);
+        for(EdgeIndex e=0; e<edges.size(); e++) {
+            const Edge& edge = edges[e];
+            data[next[useSource ? edge.source : edge.target]++] = e;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,277 @@
+// Shasta.
+#include "CompactLocalMarkerGraphBfs.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "chrono.hpp"
+#include "tuple.hpp"
+
+
+
+CompactLocalMarkerGraphBfs::CompactLocalMarkerGraphBfs(
+    const MarkerGraph& markerGraph,
+    bool useWeakEdges,
+    bool usePrunedEdges,
+    bool useSuperBubbleEdges) :
+    MultithreadedObject(*this),
+    markerGraph(markerGraph),
+    excludedFlagMask(
+        (useWeakEdges ? 0 : MarkerGraphEdgeFlagBitmaps::flagBit(
+            MarkerGraphEdgeFlagBitmaps::wasRemovedByTransitiveReduction)) |
+        (usePrunedEdges ? 0 : MarkerGraphEdgeFlagBitmaps::flagBit(
+            MarkerGraphEdgeFlagBitmaps::wasPruned)) |
+        (useSuperBubbleEdges ? 0 : MarkerGraphEdgeFlagBitmaps::flagBit(
+            MarkerGraphEdgeFlagBitmaps::isSuperBubbleEdge))),
+    graph(0),
+    levelBegin(0),
+    levelEnd(0)
+{
+}
+
+
+
+bool CompactLocalMarkerGraphBfs::run(
+    MarkerGraph::VertexId startVertexId,
+    int distance,
+    double timeout,
+    size_t threadCount,
+    CompactLocalMarkerGraph& graphArgument)
+{
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // Start a timer.
+    const auto startTime = steady_clock::now();
+
+    // Add the start vertex.
+    graph = &graphArgument;
+    graph->clear();
+    visited.clear();
+    if(startVertexId == MarkerGraph::invalidCompressedVertexId) {
+        return true;    // Because no timeout occurred.
+    }
+    graph->addVertex(startVertexId, 0);
+
+
+
+    // Level synchronous BFS.
+    levelBegin = 0;
+    levelEnd = 1;
+    for(int levelDistance=0; levelDistance<distance; levelDistance++) {
+
+        // See if we exceeded the timeout.
+        if(timeout>0. && seconds(steady_clock::now() - startTime) > timeout) {
+            graph->clear();
+            return false;
+        }
+
+        // Process this level.
+        if(threadCount>1 && levelEnd-levelBegin >= minParallelLevelSize) {
+            processLevelParallel(levelDistance + 1, threadCount);
+        } else {
+            processLevelSerial(levelDistance + 1);
+        }
+
+        // Go to the next level.
+        levelBegin = levelEnd;
+        levelEnd = VertexIndex(graph->vertices.size());
+        if(levelBegin == levelEnd) {
+            break;
+        }
+    }
+
+
+
+    // Add the edges.
+    if(threadCount>1 && graph->vertices.size() >= minParallelLevelSize) {
+        findEdgesParallel(threadCount);
+    } else {
+        findEdgesSerial();
+    }
+    graph->computeAdjacency();
+
+    visited.clear();
+    visited.shrink_to_fit();
+    return true;
+}
+
+
+
+void CompactLocalMarkerGraphBfs::allocateVisited()
+{
+    visited.resize((markerGraph.vertices.size() + 63) / 64, 0);
+    for(const auto& vertex: graph->vertices) {
+        testAndSetVisited(vertex.vertexId);
+    }
+}
+
+
+
+void CompactLocalMarkerGraphBfs::processLevelSerial(int nextDistance)
+{
+    const bool useVisited = !visited.empty();
+    for(VertexIndex v0=levelBegin; v0!=levelEnd; ++v0) {
+        const MarkerGraph::VertexId vertexId0 = graph->vertices[v0].vertexId;
+
+        // Loop over children, then parents.
+        for(size_t direction=0; direction<2; direction++) {
+            const auto edgeIds = (direction == 0) ?
+                markerGraph.compactEdgesBySource[vertexId0] :
+                markerGraph.compactEdgesByTarget[vertexId0];
+            for(uint64_t edgeId: edgeIds) {
+                if(!edgeCanBeUsed(edgeId)) {
+                    continue;
+                }
+                const MarkerGraph::Edge& edge = markerGraph.edges[edgeId];
+                const MarkerGraph::VertexId vertexId1 =
+                    (direction == 0) ? edge.target : edge.source;
+                if(useVisited) {
+                    if(!testAndSetVisited(vertexId1)) {
+                        graph->addVertex(vertexId1, nextDistance);
+                    }
+                } else {
+                    if(graph->findVertex(vertexId1) == CompactLocalMarkerGraph::invalidVertexIndex) {
+                        graph->addVertex(vertexId1, nextDistance);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+
+void CompactLocalMarkerGraphBfs::processLevelParallel(int nextDistance, size_t threadCount)
+{
+    if(visited.empty()) {
+        allocateVisited();
+    }
+
+    // Each thread finds some of the vertices of the next level.
+    threadNextLevelVertices.resize(threadCount);
+    setupLoadBalancing(levelEnd - levelBegin, 256);
+    runThreads(&CompactLocalMarkerGraphBfs::processLevelThreadFunction, threadCount);
+
+    // Gather them and sort them by vertex id, so the result
+    // does not depend on the number of threads.
+    vector<MarkerGraph::VertexId> nextLevelVertices;
+    for(auto& v: threadNextLevelVertices) {
+        nextLevelVertices.insert(nextLevelVertices.end(), v.begin(), v.end());
+        vector<MarkerGraph::VertexId>().swap(v);
+    }
+    sort(nextLevelVertices.begin(), nextLevelVertices.end());
+    for(const MarkerGraph::VertexId vertexId: nextLevelVertices) {
+        graph->addVertex(vertexId, nextDistance);
+    }
+}
+
+
+
+void CompactLocalMarkerGraphBfs::processLevelThreadFunction(size_t threadId)
+{
+    vector<MarkerGraph::VertexId>& nextLevelVertices = threadNextLevelVertices[threadId];
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over vertices of this batch.
+        for(uint64_t i=begin; i!=end; i++) {
+            const MarkerGraph::VertexId vertexId0 = graph->vertices[levelBegin + i].vertexId;
+
+            // Loop over children, then parents.
+            for(size_t direction=0; direction<2; direction++) {
+                const auto edgeIds = (direction == 0) ?
+                    markerGraph.compactEdgesBySource[vertexId0] :
+                    markerGraph.compactEdgesByTarget[vertexId0];
+                for(uint64_t edgeId: edgeIds) {
+                    if(!edgeCanBeUsed(edgeId)) {
+                        continue;
+                    }
+                    const MarkerGraph::Edge& edge = markerGraph.edges[edgeId];
+                    const MarkerGraph::VertexId vertexId1 =
+                        (direction == 0) ? edge.target : edge.source;
+                    if(!testAndSetVisited(vertexId1)) {
+                        nextLevelVertices.push_back(vertexId1);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+
+// Add all usable edges between vertices of the local marker graph.
+// Looping over out-edges only guarantees that each edge is added once.
+void CompactLocalMarkerGraphBfs::findEdgesSerial()
+{
+    for(VertexIndex v0=0; v0<graph->vertices.size(); v0++) {
+        const MarkerGraph::VertexId vertexId0 = graph->vertices[v0].vertexId;
+        for(uint64_t edgeId: markerGraph.compactEdgesBySource[vertexId0]) {
+            if(!edgeCanBeUsed(edgeId)) {
+                continue;
+            }
+            const VertexIndex v1 = graph->findVertex(markerGraph.edges[edgeId].target);
+            if(v1 != CompactLocalMarkerGraph::invalidVertexIndex) {
+                graph->addEdge(v0, v1, edgeId);
+            }
+        }
+    }
+}
+
+
+
+// Parallel version of findEdgesSerial.
+// The edges are sorted so they end up in the same order
+// as with findEdgesSerial.
+void CompactLocalMarkerGraphBfs::findEdgesParallel(size_t threadCount)
+{
+    threadEdges.resize(threadCount);
+    setupLoadBalancing(graph->vertices.size(), 256);
+    runThreads(&CompactLocalMarkerGraphBfs::findEdgesThreadFunction, threadCount);
+
+    vector<Edge> edges;
+    for(auto& v: threadEdges) {
+        edges.insert(edges.end(), v.begin(), v.end());
+        vector<Edge>().swap(v);
+    }
+    sort(edges.begin(), edges.end(),
+        [](const Edge& x, const Edge& y)
+        {
+            return tie(x.source, x.edgeId) < tie(y.source, y.edgeId);
+        });
+    for(const Edge& edge: edges) {
+        graph->addEdge(edge.source, edge.target, edge.edgeId);
+    }
+}
+
+
+
+void CompactLocalMarkerGraphBfs::findEdgesThreadFunction(size_t threadId)
+{
+    vector<Edge>& edges = threadEdges[threadId];
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over vertices of this batch.
+        for(VertexIndex v0=VertexIndex(begin); v0!=VertexIndex(end); ++v0) {
+            const MarkerGraph::VertexId vertexId0 = graph->vertices[v0].vertexId;
+            for(uint64_t edgeId: markerGraph.compactEdgesBySource[vertexId0]) {
+                if(!edgeCanBeUsed(edgeId)) {
+                    continue;
+                }
+                const VertexIndex v1 = graph->findVertex(markerGraph.edges[edgeId].target);
+                if(v1 != CompactLocalMarkerGraph::invalidVertexIndex) {
+                    edges.push_back({v0, v1, edgeId});
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef CZI_SHASTA_COMPACT_LOCAL_MARKER_GRAPH_BFS_HPP
+#define CZI_SHASTA_COMPACT_LOCAL_MARKER_GRAPH_BFS_HPP
+
+/*******************************************************************************
+
+Class CompactLocalMarkerGraphBfs creates a CompactLocalMarkerGraph
+by doing a BFS on the global marker graph, using stored connectivity.
+
+The BFS is level synchronous. Levels with a small number of vertices
+are processed serially. Larger levels are processed in parallel:
+each thread processes batches of vertices of the current level and stores
+the newly discovered vertices in its own next level vector.
+To avoid duplicates, a vertex is only stored by the thread that
+sets its bit in a visited bitmap with one bit for each
+vertex of the global marker graph.
+The bitmap is only allocated when the first parallel level is found,
+so small local marker graphs don't pay for it.
+
+The new vertices of each level are sorted by vertex id,
+so the result does not depend on the number of threads.
+
+After the BFS, the edges between vertices of the local marker graph
+are found, also in parallel for large graphs.
+Each instance is only used for a single BFS, so different threads
+(for example, the http server threads) can use separate instances
+concurrently.
+
+*******************************************************************************/
+
+// Shasta.
+#include "CompactLocalMarkerGraph.hpp"
+#include "MarkerGraph.hpp"
+#include "MultitreadedObject.hpp"
+
+// Standard library.
+#include "cstdint.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class CompactLocalMarkerGraphBfs;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::CompactLocalMarkerGraphBfs :
+    public MultithreadedObject<CompactLocalMarkerGraphBfs> {
+public:
+
+    CompactLocalMarkerGraphBfs(
+        const MarkerGraph&,
+        bool useWeakEdges,
+        bool usePrunedEdges,
+        bool useSuperBubbleEdges);
+
+    // Run the BFS and store the result in the given CompactLocalMarkerGraph.
+    // Returns false if the timeout was exceeded, in which case
+    // the CompactLocalMarkerGraph is left empty.
+    bool run(
+        MarkerGraph::VertexId startVertexId,
+        int distance,
+        double timeout,                 // Or 0 for no timeout.
+        size_t threadCount,             // Or 0 to use all hardware threads.
+        CompactLocalMarkerGraph&);
+
+    // Levels with fewer vertices than this are processed serially.
+    static const uint64_t minParallelLevelSize = 4096;
+
+private:
+    using VertexIndex = CompactLocalMarkerGraph::VertexIndex;
+    using Edge = CompactLocalMarkerGraph::Edge;
+
+    const MarkerGraph& markerGraph;
+
+    // The edge flags that exclude an edge, as a mask for
+    // MarkerGraphEdgeFlagBitmaps, computed by the constructor
+    // from useWeakEdges, usePrunedEdges, and useSuperBubbleEdges.
+    uint64_t excludedFlagMask;
+
+    // Return true if the arguments allow us to use this edge.
+    bool edgeCanBeUsed(MarkerGraph::EdgeId edgeId) const
+    {
+        return !markerGraph.edgeFlagBitmaps.isAnySet(excludedFlagMask, edgeId);
+    }
+
+    // The graph being created.
+    CompactLocalMarkerGraph* graph;
+
+    // The vertices of the level being processed are
+    // graph->vertices[levelBegin, levelEnd).
+    VertexIndex levelBegin;
+    VertexIndex levelEnd;
+
+    // Visited bitmap, with one bit for each vertex of the global
+    // marker graph. Empty until the first parallel level.
+    vector<uint64_t> visited;
+    void allocateVisited();
+
+    // Set the visited bit for a vertex and return its previous value.
+    bool testAndSetVisited(MarkerGraph::VertexId vertexId)
+    {
+        const uint64_t mask = 1ULL << (vertexId & 63ULL);
+        uint64_t& word = visited[vertexId >> 6ULL];
+        if(word & mask) {
+            return true;
+        }
+        return (__sync_fetch_and_or(&word, mask) & mask) != 0;
+    }
+
+    // Process one level of the BFS.
+    void processLevelSerial(int nextDistance);
+    void processLevelParallel(int nextDistance, size_t threadCount);
+    void processLevelThreadFunction(size_t threadId);
+    vector< vector<MarkerGraph::VertexId> > threadNextLevelVertices;
+
+    // Add the edges between vertices of the local marker graph.
+    void findEdgesSerial();
+    void findEdgesParallel(size_t threadCount);
+    void findEdgesThreadFunction(size_t threadId);
+    vector< vector<Edge> > threadEdges;
+};
+
+#endif
@@ -0,0 +1,138 @@
+// shasta.
+#include "CompactMarkerIntervals.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "chrono.hpp"
+
+
+
+void CompactMarkerIntervals::createNew(
+    const MemoryMapped::VectorOfVectors<MarkerInterval, uint64_t>& markerIntervals,
+    const string& name,
+    size_t pageSize,
+    size_t threadCount)
+{
+    cout << timestamp << "Creating compact marker intervals." << endl;
+    const auto tBegin = steady_clock::now();
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    createData.markerIntervals = &markerIntervals;
+
+    // Pass 1: compute the number of bytes for each edge.
+    const uint64_t edgeCount = markerIntervals.size();
+    data.createNew(name, pageSize);
+    data.beginPass1(edgeCount);
+    createData.pass = 1;
+    setupLoadBalancing(edgeCount, 10000);
+    runThreads(&CompactMarkerIntervals::createThreadFunction, threadCount);
+
+    // Pass 2: store the data.
+    data.beginPass2();
+    data.endPass2(false);
+    createData.pass = 2;
+    setupLoadBalancing(edgeCount, 10000);
+    runThreads(&CompactMarkerIntervals::createThreadFunction, threadCount);
+
+    const auto tEnd = steady_clock::now();
+    cout << timestamp << "Creating compact marker intervals completed in " <<
+        seconds(tEnd - tBegin) << " s." << endl;
+    const uint64_t markerIntervalCount = markerIntervals.totalSize();
+    cout << "Compact marker intervals use " << byteCount() << " bytes for " <<
+        markerIntervalCount << " marker intervals, " <<
+        double(byteCount()) / double(max(uint64_t(1), markerIntervalCount)) <<
+        " bytes per marker interval, versus " << sizeof(MarkerInterval) <<
+        " for MarkerInterval." << endl;
+}
+
+
+
+void CompactMarkerIntervals::createThreadFunction(size_t threadId)
+{
+    const MemoryMapped::VectorOfVectors<MarkerInterval, uint64_t>& markerIntervals =
+        *createData.markerIntervals;
+    vector<MarkerInterval> edgeMarkerIntervals;
+    vector<uint8_t> bytes;
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over edges of this batch.
+        for(uint64_t edgeId=begin; edgeId!=end; edgeId++) {
+            edgeMarkerIntervals.assign(
+                markerIntervals.begin(edgeId), markerIntervals.end(edgeId));
+            bytes.clear();
+            encode(edgeMarkerIntervals, bytes);
+            if(createData.pass == 1) {
+                data.incrementCount(edgeId, bytes.size());
+            } else {
+                CZI_ASSERT(data.size(edgeId) == bytes.size());
+                copy(bytes.begin(), bytes.end(), data.begin(edgeId));
+            }
+        }
+    }
+}
+
+
+
+void CompactMarkerIntervals::encode(
+    vector<MarkerInterval>& markerIntervals,
+    vector<uint8_t>& bytes)
+{
+    sort(markerIntervals.begin(), markerIntervals.end());
+    writeVarint(markerIntervals.size(), bytes);
+    OrientedReadId::Int previousValue = 0;
+    for(const MarkerInterval& markerInterval: markerIntervals) {
+        const OrientedReadId::Int value = markerInterval.orientedReadId.getValue();
+        CZI_ASSERT(markerInterval.ordinals[1] >= markerInterval.ordinals[0]);
+        writeVarint(value - previousValue, bytes);
+        writeVarint(markerInterval.ordinals[0], bytes);
+        writeVarint(markerInterval.ordinals[1] - markerInterval.ordinals[0], bytes);
+        previousValue = value;
+    }
+}
+
+
+
+// Return all marker intervals of an edge,
+// in order of increasing OrientedReadId.
+void CompactMarkerIntervals::get(uint64_t edgeId, vector<MarkerInterval>& v) const
+{
+    v.clear();
+    v.reserve(size(edgeId));
+    for(auto it=begin(edgeId); it!=end(edgeId); ++it) {
+        v.push_back(*it);
+    }
+}
+
+
+
+void CompactMarkerIntervals::accessExistingReadOnly(const string& name)
+{
+    data.accessExistingReadOnly(name);
+}
+
+
+
+void CompactMarkerIntervals::remove()
+{
+    data.remove();
+}
+
+
+
+void CompactMarkerIntervals::writeVarint(uint64_t x, vector<uint8_t>& bytes)
+{
+    while(x >= 0x80ULL) {
+        bytes.push_back(uint8_t(x | 0x80ULL));
+        x >>= 7ULL;
+    }
+    bytes.push_back(uint8_t(x));
+}
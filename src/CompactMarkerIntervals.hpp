@@ -0,0 +1,194 @@
+#ifndef CZI_SHASTA_COMPACT_MARKER_INTERVALS_HPP
+#define CZI_SHASTA_COMPACT_MARKER_INTERVALS_HPP
+
+/*******************************************************************************
+
+Class CompactMarkerIntervals stores the same information as the
+MemoryMapped::VectorOfVectors<MarkerInterval, uint64_t> that contains
+the marker intervals of each marker graph edge
+(MarkerGraph::edgeMarkerIntervals), but using less memory.
+
+The marker intervals of each edge are sorted by OrientedReadId
+(then by ordinals). The encoded data for an edge begins with the
+number of marker intervals, followed, for each marker interval,
+by three variable length integers (LEB128 varints):
+- The OrientedReadId difference from the previous marker interval
+  of the same edge. For the first marker interval of an edge,
+  this is the OrientedReadId value itself.
+- ordinals[0].
+- ordinals[1] - ordinals[0], which is small (usually 1).
+
+A marker interval typically uses 4 or 5 bytes, versus 12 for MarkerInterval.
+
+The marker intervals of an edge can only be decoded sequentially,
+using the const_iterator returned by begin(edgeId) and end(edgeId),
+or all at once using get.
+
+*******************************************************************************/
+
+// shasta.
+#include "CZI_ASSERT.hpp"
+#include "MarkerInterval.hpp"
+#include "MemoryMappedVectorOfVectors.hpp"
+#include "MultitreadedObject.hpp"
+
+// Standard library.
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class CompactMarkerIntervals;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::CompactMarkerIntervals :
+    public MultithreadedObject<CompactMarkerIntervals> {
+public:
+
+    CompactMarkerIntervals() : MultithreadedObject(*this) {}
+
+    // Create from the uncompressed marker intervals.
+    void createNew(
+        const MemoryMapped::VectorOfVectors<MarkerInterval, uint64_t>& markerIntervals,
+        const string& name,
+        size_t pageSize,
+        size_t threadCount);
+
+    void accessExistingReadOnly(const string& name);
+    void remove();
+    bool isOpen() const
+    {
+        return data.isOpen();
+    }
+
+    // The number of edges.
+    uint64_t size() const
+    {
+        return data.size();
+    }
+
+    // The number of marker intervals of an edge.
+    uint64_t size(uint64_t edgeId) const
+    {
+        const uint8_t* p = data.begin(edgeId);
+        return readVarint(p);
+    }
+
+    // The total number of bytes used by this data structure.
+    uint64_t byteCount() const
+    {
+        return data.totalSize() * sizeof(uint8_t) + (data.size() + 1) * sizeof(uint64_t);
+    }
+
+    uint64_t hash() const
+    {
+        return data.hash();
+    }
+
+    // Iterator that decodes the marker intervals of an edge,
+    // in order of increasing OrientedReadId.
+    class const_iterator {
+    public:
+        const MarkerInterval& operator*() const
+        {
+            return markerInterval;
+        }
+        const MarkerInterval* operator->() const
+        {
+            return &markerInterval;
+        }
+        const_iterator& operator++()
+        {
+            --remaining;
+            if(remaining) {
+                decode();
+            }
+            return *this;
+        }
+        bool operator==(const const_iterator& that) const
+        {
+            return remaining == that.remaining;
+        }
+        bool operator!=(const const_iterator& that) const
+        {
+            return remaining != that.remaining;
+        }
+    private:
+        friend class CompactMarkerIntervals;
+        const_iterator(const uint8_t* p, uint64_t remaining) :
+            p(p), remaining(remaining), orientedReadIdValue(0)
+        {
+            if(remaining) {
+                decode();
+            }
+        }
+        void decode()
+        {
+            orientedReadIdValue += OrientedReadId::Int(readVarint(p));
+            markerInterval.orientedReadId = OrientedReadId(orientedReadIdValue);
+            markerInterval.ordinals[0] = uint32_t(readVarint(p));
+            markerInterval.ordinals[1] = markerInterval.ordinals[0] + uint32_t(readVarint(p));
+        }
+        const uint8_t* p;
+        uint64_t remaining;
+        OrientedReadId::Int orientedReadIdValue;
+        MarkerInterval markerInterval;
+    };
+    const_iterator begin(uint64_t edgeId) const
+    {
+        const uint8_t* p = data.begin(edgeId);
+        const uint64_t n = readVarint(p);
+        return const_iterator(p, n);
+    }
+    const_iterator end(uint64_t) const
+    {
+        return const_iterator(0, 0);
+    }
+
+    // Return all marker intervals of an edge,
+    // in order of increasing OrientedReadId.
+    void get(uint64_t edgeId, vector<MarkerInterval>&) const;
+
+private:
+
+    // The encoded marker intervals of each edge.
+    // Indexed by the marker graph EdgeId.
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t> data;
+
+    // Encode the marker intervals of an edge, appending to a byte vector.
+    // The vector of marker intervals is sorted in place.
+    static void encode(vector<MarkerInterval>&, vector<uint8_t>& bytes);
+
+    // Variable length integers, 7 bits per byte,
+    // with the high bit set on all bytes except the last.
+    static void writeVarint(uint64_t, vector<uint8_t>&);
+    static uint64_t readVarint(const uint8_t*& p)
+    {
+        uint64_t x = 0;
+        uint64_t shift = 0;
+        while(true) {
+            const uint8_t byte = *p++;
+            x |= uint64_t(byte & 0x7f) << shift;
+            if((byte & 0x80) == 0) {
+                return x;
+            }
+            shift += 7ULL;
+        }
+    }
+
+    // Data and functions used during creation.
+    void createThreadFunction(size_t threadId);
+    class CreateData {
+    public:
+        const MemoryMapped::VectorOfVectors<MarkerInterval, uint64_t>* markerIntervals;
+
+        // Pass 1 computes the sizes, pass 2 stores the data.
+        size_t pass;
+    };
+    CreateData createData;
+};
+
+#endif
@@ -0,0 +1,284 @@
+// shasta.
+#include "CompactMarkers.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "chrono.hpp"
+
+
+
+void CompactMarkers::createNew(
+    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    KmerBitmap isMarker,
+    size_t k,
+    const string& name,
+    size_t pageSize,
+    size_t threadCount)
+{
+    cout << timestamp << "Creating compact markers." << endl;
+    const auto tBegin = steady_clock::now();
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // Create the k-mer dictionary and the rank prefix
+    // used to find the dictionary index of each KmerId.
+    createData.markers = &markers;
+    createData.isMarker = isMarker;
+    const uint64_t wordCount = KmerBitmap::wordCount(k);
+    const uint64_t kmerCount = 1ULL << (2ULL*k);
+    createData.rankPrefix.resize(wordCount);
+    kmerIds.createNew(name + "-KmerIds", pageSize);
+    for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
+        if((kmerId & 63ULL) == 0) {
+            createData.rankPrefix[kmerId >> 6ULL] = uint32_t(kmerIds.size());
+        }
+        if(isMarker[KmerId(kmerId)]) {
+            kmerIds.push_back(KmerId(kmerId));
+        }
+    }
+
+    // The global marker id of the first marker of each oriented read.
+    const uint64_t orientedReadCount = markers.size();
+    firstMarkerId.createNew(name + "-FirstMarkerId", pageSize);
+    firstMarkerId.resize(orientedReadCount + 1);
+    firstMarkerId[0] = 0;
+    for(uint64_t i=0; i<orientedReadCount; i++) {
+        firstMarkerId[i+1] = firstMarkerId[i] + markers.size(i);
+    }
+
+    // Pass 1: compute the number of bytes and blocks for each oriented read.
+    data.createNew(name + "-Data", pageSize);
+    skipIndex.createNew(name + "-SkipIndex", pageSize);
+    data.beginPass1(orientedReadCount);
+    skipIndex.beginPass1(orientedReadCount);
+    createData.pass = 1;
+    setupLoadBalancing(orientedReadCount, 1000);
+    runThreads(&CompactMarkers::createThreadFunction, threadCount);
+
+    // Pass 2: store the data.
+    data.beginPass2();
+    skipIndex.beginPass2();
+    data.endPass2(false);
+    skipIndex.endPass2(false);
+    createData.pass = 2;
+    setupLoadBalancing(orientedReadCount, 1000);
+    runThreads(&CompactMarkers::createThreadFunction, threadCount);
+    createData.rankPrefix.clear();
+    createData.rankPrefix.shrink_to_fit();
+
+    const auto tEnd = steady_clock::now();
+    cout << timestamp << "Creating compact markers completed in " <<
+        seconds(tEnd - tBegin) << " s." << endl;
+    cout << "Compact markers use " << byteCount() << " bytes for " <<
+        totalSize() << " markers, " <<
+        double(byteCount()) / double(max(uint64_t(1), totalSize())) <<
+        " bytes per marker, versus " << sizeof(CompressedMarker) <<
+        " for CompressedMarker." << endl;
+}
+
+
+
+void CompactMarkers::createThreadFunction(size_t threadId)
+{
+    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers = *createData.markers;
+    vector<uint8_t> bytes;
+    vector<uint32_t> blockOffsets;
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over oriented reads of this batch.
+        for(uint64_t i=begin; i!=end; i++) {
+            bytes.clear();
+            blockOffsets.clear();
+            encode(markers.begin(i), markers.end(i), bytes, blockOffsets);
+            if(createData.pass == 1) {
+                data.incrementCount(i, bytes.size());
+                skipIndex.incrementCount(i, blockOffsets.size());
+            } else {
+                CZI_ASSERT(data.size(i) == bytes.size());
+                CZI_ASSERT(skipIndex.size(i) == blockOffsets.size());
+                copy(bytes.begin(), bytes.end(), data.begin(i));
+                copy(blockOffsets.begin(), blockOffsets.end(), skipIndex.begin(i));
+            }
+        }
+    }
+}
+
+
+
+void CompactMarkers::encode(
+    const CompressedMarker* begin,
+    const CompressedMarker* end,
+    vector<uint8_t>& bytes,
+    vector<uint32_t>& blockOffsets) const
+{
+    uint32_t previousPosition = 0;
+    for(const CompressedMarker* it=begin; it!=end; ++it) {
+        if(((it - begin) % blockSize) == 0) {
+            blockOffsets.push_back(uint32_t(bytes.size()));
+            previousPosition = 0;
+        }
+        const uint32_t position = it->position;
+        CZI_ASSERT(position >= previousPosition);
+        writeVarint(position - previousPosition, bytes);
+        writeVarint(getDictionaryIndex(it->kmerId), bytes);
+        previousPosition = position;
+    }
+}
+
+
+
+// Return the index of a marker KmerId in the dictionary.
+// This is its rank in the bitmap of marker k-mers.
+uint32_t CompactMarkers::getDictionaryIndex(KmerId kmerId) const
+{
+    CZI_ASSERT(createData.isMarker[kmerId]);
+    const uint64_t lowerBits = createData.isMarker.word(kmerId) & ((1ULL << (kmerId & 63ULL)) - 1ULL);
+    return createData.rankPrefix[kmerId >> 6ULL] + uint32_t(__builtin_popcountll(lowerBits));
+}
+
+
+
+Marker CompactMarkers::decode(const uint8_t*& p, uint32_t& previousPosition) const
+{
+    Marker marker;
+    marker.position = previousPosition + uint32_t(readVarint(p));
+    marker.kmerId = kmerIds[readVarint(p)];
+    previousPosition = marker.position;
+    return marker;
+}
+
+
+
+// Return a single marker given its oriented read and ordinal.
+Marker CompactMarkers::get(OrientedReadId orientedReadId, uint32_t ordinal) const
+{
+    const uint64_t i = orientedReadId.getValue();
+    CZI_ASSERT(ordinal < size(orientedReadId));
+    const uint64_t block = ordinal / blockSize;
+    const uint8_t* p = data.begin(i) + skipIndex.begin(i)[block];
+    uint32_t previousPosition = 0;
+    Marker marker;
+    for(uint64_t j=block*blockSize; j<=ordinal; j++) {
+        marker = decode(p, previousPosition);
+    }
+    return marker;
+}
+
+
+
+// Return all markers of an oriented read, in order of increasing ordinal.
+void CompactMarkers::get(OrientedReadId orientedReadId, vector<Marker>& v) const
+{
+    const uint64_t n = size(orientedReadId);
+    v.resize(n);
+    const uint8_t* p = data.begin(orientedReadId.getValue());
+    uint32_t previousPosition = 0;
+    for(uint64_t j=0; j<n; j++) {
+        if((j % blockSize) == 0) {
+            previousPosition = 0;
+        }
+        v[j] = decode(p, previousPosition);
+    }
+}
+
+
+
+// Return the k-mer ids of all markers of an oriented read,
+// in order of increasing ordinal.
+void CompactMarkers::getKmerIds(OrientedReadId orientedReadId, vector<KmerId>& v) const
+{
+    const uint64_t n = size(orientedReadId);
+    v.resize(n);
+    const uint8_t* p = data.begin(orientedReadId.getValue());
+    for(uint64_t j=0; j<n; j++) {
+        readVarint(p);
+        v[j] = kmerIds[readVarint(p)];
+    }
+}
+
+
+
+// Same as Assembler::getMarkersSortedByKmerId.
+void CompactMarkers::getMarkersSortedByKmerId(
+    OrientedReadId orientedReadId,
+    vector<MarkerWithOrdinal>& markersSortedByKmerId) const
+{
+    const uint64_t n = size(orientedReadId);
+    markersSortedByKmerId.resize(n);
+    const uint8_t* p = data.begin(orientedReadId.getValue());
+    uint32_t previousPosition = 0;
+    for(uint32_t ordinal=0; ordinal<n; ordinal++) {
+        if((ordinal % blockSize) == 0) {
+            previousPosition = 0;
+        }
+        markersSortedByKmerId[ordinal] = MarkerWithOrdinal(decode(p, previousPosition), ordinal);
+    }
+    sort(markersSortedByKmerId.begin(), markersSortedByKmerId.end());
+}
+
+
+
+uint64_t CompactMarkers::byteCount() const
+{
+    return
+        data.totalSize() * sizeof(uint8_t) +
+        (data.size() + 1) * sizeof(uint64_t) +
+        skipIndex.totalSize() * sizeof(uint32_t) +
+        (skipIndex.size() + 1) * sizeof(uint64_t) +
+        firstMarkerId.size() * sizeof(uint64_t) +
+        kmerIds.size() * sizeof(KmerId);
+}
+
+
+
+void CompactMarkers::accessExistingReadOnly(const string& name)
+{
+    data.accessExistingReadOnly(name + "-Data");
+    skipIndex.accessExistingReadOnly(name + "-SkipIndex");
+    firstMarkerId.accessExistingReadOnly(name + "-FirstMarkerId");
+    kmerIds.accessExistingReadOnly(name + "-KmerIds");
+}
+
+
+
+void CompactMarkers::remove()
+{
+    data.remove();
+    skipIndex.remove();
+    firstMarkerId.remove();
+    kmerIds.remove();
+}
+
+
+
+// Variable length integers, 7 bits per byte,
+// with the high bit set on all bytes except the last.
+void CompactMarkers::writeVarint(uint64_t x, vector<uint8_t>& bytes)
+{
+    while(x >= 0x80ULL) {
+        bytes.push_back(uint8_t(x | 0x80ULL));
+        x >>= 7ULL;
+    }
+    bytes.push_back(uint8_t(x));
+}
+uint64_t CompactMarkers::readVarint(const uint8_t*& p)
+{
+    uint64_t x = 0;
+    uint64_t shift = 0;
+    while(true) {
+        const uint8_t byte = *p++;
+        x |= uint64_t(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) {
+            return x;
+        }
+        shift += 7ULL;
+    }
+}
@@ -0,0 +1,181 @@
+#ifndef CZI_SHASTA_COMPACT_MARKERS_HPP
+#define CZI_SHASTA_COMPACT_MARKERS_HPP
+
+/*******************************************************************************
+
+Class CompactMarkers stores the same information as the
+MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t> that contains
+all markers (Assembler::markers), but using less memory.
+
+For each oriented read, the markers (in order of increasing position)
+are divided in blocks of blockSize markers. Each marker is stored
+as two variable length integers (LEB128 varints):
+- The position difference from the previous marker in the same block.
+  For the first marker of a block, this is the position itself,
+  so each block can be decoded independently of the others.
+- The index of its k-mer in a dictionary containing
+  the sorted KmerIds of all k-mers used as markers.
+  This index is the rank of the k-mer in the bitmap of marker k-mers,
+  so it is much smaller than the KmerId.
+
+A skip index stores, for each block, the offset of its first byte
+within the data for its oriented read. Access to a marker given its ordinal
+decodes at most blockSize markers.
+
+We also store the global MarkerId of the first marker of each oriented
+read. As a result, MarkerIds are the same as for Assembler::markers.
+
+With the default choices k=10 and marker probability 0.1,
+this uses about 4.6 bytes per marker, versus 7 for CompressedMarker.
+Most of it is the dictionary index, which typically needs 3 bytes.
+
+When the compact markers are open, Assembler::getMarkerId,
+Assembler::getMarkersSortedByKmerId, and LowHash::createKmerIds
+use them instead of Assembler::markers. Assembler::compressMarkers
+can close the markers after creating the compact markers,
+so the LowHash stage runs without the markers in memory.
+Only markers stored for both strands can be compressed.
+
+*******************************************************************************/
+
+// shasta.
+#include "Kmer.hpp"
+#include "Marker.hpp"
+#include "MemoryMappedVectorOfVectors.hpp"
+#include "MultitreadedObject.hpp"
+#include "ReadId.hpp"
+
+// Standard library.
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class CompactMarkers;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::CompactMarkers :
+    public MultithreadedObject<CompactMarkers> {
+public:
+
+    CompactMarkers() : MultithreadedObject(*this) {}
+
+    // The number of markers in each block.
+    static const uint64_t blockSize = 16;
+
+    // Create from the markers, using the given bitmap of marker k-mers
+    // to construct the k-mer dictionary.
+    void createNew(
+        const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+        KmerBitmap isMarker,
+        size_t k,
+        const string& name,
+        size_t pageSize,
+        size_t threadCount);
+
+    void accessExistingReadOnly(const string& name);
+    void remove();
+    bool isOpen() const
+    {
+        return data.isOpen() && skipIndex.isOpen() && firstMarkerId.isOpen && kmerIds.isOpen;
+    }
+
+    // The number of oriented reads.
+    uint64_t size() const
+    {
+        return data.size();
+    }
+
+    // The number of markers for a given oriented read.
+    uint64_t size(OrientedReadId orientedReadId) const
+    {
+        const uint64_t i = orientedReadId.getValue();
+        return firstMarkerId[i+1] - firstMarkerId[i];
+    }
+
+    // The total number of markers.
+    uint64_t totalSize() const
+    {
+        return firstMarkerId[firstMarkerId.size() - 1];
+    }
+
+    // The total number of bytes used by this data structure.
+    uint64_t byteCount() const;
+
+    // Return the global marker id of a marker given its
+    // oriented read and ordinal.
+    // This is the same as Assembler::getMarkerId.
+    uint64_t getMarkerId(OrientedReadId orientedReadId, uint32_t ordinal) const
+    {
+        return firstMarkerId[orientedReadId.getValue()] + ordinal;
+    }
+
+    // Return a single marker given its oriented read and ordinal.
+    Marker get(OrientedReadId, uint32_t ordinal) const;
+
+    // Return all markers of an oriented read, in order of increasing ordinal.
+    void get(OrientedReadId, vector<Marker>&) const;
+
+    // Return the k-mer ids of all markers of an oriented read,
+    // in order of increasing ordinal, as needed by LowHash::createKmerIds.
+    void getKmerIds(OrientedReadId, vector<KmerId>&) const;
+
+    // Same as Assembler::getMarkersSortedByKmerId.
+    void getMarkersSortedByKmerId(OrientedReadId, vector<MarkerWithOrdinal>&) const;
+
+private:
+
+    // The encoded markers of each oriented read.
+    // Indexed by OrientedReadId::getValue().
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t> data;
+
+    // For each oriented read and each block of blockSize markers,
+    // the offset of the first byte of the block in the data for that oriented read.
+    MemoryMapped::VectorOfVectors<uint32_t, uint64_t> skipIndex;
+
+    // The global MarkerId of the first marker of each oriented read.
+    // This has one more entry than the number of oriented reads,
+    // and the last entry is the total number of markers.
+    MemoryMapped::Vector<uint64_t> firstMarkerId;
+
+    // The k-mer dictionary: the sorted KmerIds of the k-mers used as markers.
+    MemoryMapped::Vector<KmerId> kmerIds;
+
+    // Encode the markers of an oriented read, appending to a byte vector
+    // and to a vector of block offsets.
+    void encode(
+        const CompressedMarker* begin,
+        const CompressedMarker* end,
+        vector<uint8_t>& bytes,
+        vector<uint32_t>& blockOffsets) const;
+
+    // Decode one marker, advancing the pointer.
+    Marker decode(const uint8_t*& p, uint32_t& previousPosition) const;
+
+    // Variable length integers.
+    static void writeVarint(uint64_t, vector<uint8_t>&);
+    static uint64_t readVarint(const uint8_t*&);
+
+    // Data and functions used during creation.
+    void createThreadFunction(size_t threadId);
+    class CreateData {
+    public:
+        const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>* markers;
+        KmerBitmap isMarker;
+
+        // For each 64-bit word of the bitmap of marker k-mers,
+        // the number of marker k-mers in all previous words.
+        // Used to compute the dictionary index of a KmerId.
+        vector<uint32_t> rankPrefix;
+
+        // Pass 1 computes the sizes, pass 2 stores the data.
+        size_t pass;
+    };
+    CreateData createData;
+    uint32_t getDictionaryIndex(KmerId) const;
+};
+
+#endif
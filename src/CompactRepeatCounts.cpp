@@ -0,0 +1,113 @@
+// Shasta.
+#include "CompactRepeatCounts.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+
+
+void CompactRepeatCounts::createNew(const string& name, size_t pageSize)
+{
+    segments.createNew(name + "-Segments", pageSize);
+    codes.createNew(name + "-Codes", pageSize);
+    exceptions.createNew(name + "-Exceptions", pageSize);
+    blocks.createNew(name + "-Blocks", pageSize);
+}
+
+
+
+void CompactRepeatCounts::accessExistingReadOnly(const string& name)
+{
+    segments.accessExistingReadOnly(name + "-Segments");
+    codes.accessExistingReadOnly(name + "-Codes");
+    exceptions.accessExistingReadOnly(name + "-Exceptions");
+    blocks.accessExistingReadOnly(name + "-Blocks");
+}
+
+
+
+void CompactRepeatCounts::remove()
+{
+    segments.remove();
+    codes.remove();
+    exceptions.remove();
+    blocks.remove();
+}
+
+
+
+uint64_t CompactRepeatCounts::hash() const
+{
+    uint64_t h = segments.hash();
+    h = h * 31ULL + codes.hash();
+    h = h * 31ULL + exceptions.hash();
+    h = h * 31ULL + blocks.hash();
+    return h;
+}
+
+
+
+// Append a new segment with the given repeat counts.
+void CompactRepeatCounts::append(const uint8_t* begin, const uint8_t* end)
+{
+    Segment segment;
+    segment.baseCount = end - begin;
+    segment.rawBaseCount = 0;
+    segment.codesBegin = codes.size();
+    segment.blocksBegin = blocks.size();
+
+    uint64_t word = 0;
+    for(uint64_t position=0; position!=segment.baseCount; position++) {
+        if((position % blockSize) == 0) {
+            blocks.push_back(exceptions.size());
+        }
+
+        const uint8_t repeatCount = begin[position];
+        segment.rawBaseCount += repeatCount;
+        uint64_t code = repeatCount;
+        if(repeatCount > 3) {
+            code = 0;
+        }
+        if(code == 0) {
+            exceptions.push_back(repeatCount);
+        }
+        word |= code << ((position & 31ULL) << 1ULL);
+
+        if((position & 31ULL) == 31ULL) {
+            codes.push_back(word);
+            word = 0;
+        }
+    }
+    if((segment.baseCount & 31ULL) != 0) {
+        codes.push_back(word);
+    }
+
+    segments.push_back(segment);
+}
+
+
+
+// Decode the repeat counts of a range of positions of a segment.
+void CompactRepeatCounts::get(
+    uint64_t segmentId,
+    uint64_t begin,
+    uint64_t end,
+    uint8_t* output) const
+{
+    const Segment& segment = segments[segmentId];
+    CZI_ASSERT(begin <= end);
+    CZI_ASSERT(end <= segment.baseCount);
+    if(begin == end) {
+        return;
+    }
+
+    const uint64_t* segmentCodes = codes.begin() + segment.codesBegin;
+    const uint8_t* exception = exceptions.begin() + findException(segment, begin);
+    for(uint64_t position=begin; position!=end; position++) {
+        const uint64_t code = (segmentCodes[position >> 5ULL] >> ((position & 31ULL) << 1ULL)) & 3ULL;
+        if(code == 0) {
+            *output++ = *exception++;
+        } else {
+            *output++ = uint8_t(code);
+        }
+    }
+}
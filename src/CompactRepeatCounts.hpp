@@ -0,0 +1,168 @@
+#ifndef CZI_SHASTA_COMPACT_REPEAT_COUNTS_HPP
+#define CZI_SHASTA_COMPACT_REPEAT_COUNTS_HPP
+
+// Shasta.
+#include "CZI_ASSERT.hpp"
+#include "MemoryMappedVector.hpp"
+
+// Standard library.
+#include "cstdint.hpp"
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class CompactRepeatCounts;
+    }
+}
+
+
+
+// Compact storage of the repeat counts of many run-length sequences
+// (segments), used for the assembled sequence of each assembly graph edge.
+//
+// Most repeat counts are small, so each repeat count is stored as
+// a 2-bit code, 32 codes per 64-bit word, with the code for position i
+// of a segment in bits 2*(i%32) and 2*(i%32)+1 of word i/32 of the segment.
+// Codes 1, 2, 3 represent repeat counts 1, 2, 3.
+// Code 0 is an escape: the repeat count is stored as a byte
+// in a separate vector of exceptions, in order of position.
+//
+// For random access, an index contains, for each block of blockSize
+// positions of each segment, the index in the exceptions vector
+// of the first exception at or after the beginning of the block.
+// This way, a repeat count at any position can be decoded
+// by looking at no more than blockSize/32 words of codes.
+//
+// Since in assembled run-length sequence repeat counts greater than 3
+// are uncommon, this uses little more than 2 bits per run-length base,
+// instead of the 8 bits of a one byte repeat count.
+class ChanZuckerberg::shasta::CompactRepeatCounts {
+public:
+
+    // The number of positions covered by each entry of the index.
+    // Must be a multiple of 32.
+    static const uint64_t blockSize = 256;
+
+    void createNew(const string& name, size_t pageSize);
+    void accessExistingReadOnly(const string& name);
+    void remove();
+    bool isOpen() const
+    {
+        return segments.isOpen;
+    }
+    uint64_t hash() const;
+
+    // Append a new segment with the given repeat counts.
+    void append(const uint8_t* begin, const uint8_t* end);
+
+    // Append a new empty segment.
+    void appendEmpty()
+    {
+        append(0, 0);
+    }
+
+    // The number of segments.
+    uint64_t size() const
+    {
+        return segments.size();
+    }
+
+    // The number of run-length bases in a segment.
+    uint64_t size(uint64_t segmentId) const
+    {
+        return segments[segmentId].baseCount;
+    }
+
+    // The number of raw bases in a segment, that is,
+    // the sum of its repeat counts.
+    uint64_t rawSize(uint64_t segmentId) const
+    {
+        return segments[segmentId].rawBaseCount;
+    }
+
+    // The number of bytes used by this representation.
+    uint64_t byteCount() const
+    {
+        return
+            segments.size() * sizeof(Segment) +
+            codes.size() * sizeof(uint64_t) +
+            exceptions.size() * sizeof(uint8_t) +
+            blocks.size() * sizeof(uint64_t);
+    }
+
+    // The repeat count at a given position of a segment.
+    uint8_t get(uint64_t segmentId, uint64_t position) const
+    {
+        const Segment& segment = segments[segmentId];
+        CZI_ASSERT(position < segment.baseCount);
+        const uint64_t* segmentCodes = codes.begin() + segment.codesBegin;
+        const uint64_t code = (segmentCodes[position >> 5ULL] >> ((position & 31ULL) << 1ULL)) & 3ULL;
+        if(code != 0) {
+            return uint8_t(code);
+        }
+        return exceptions.begin()[findException(segment, position)];
+    }
+
+    // Decode the repeat counts of a range of positions of a segment.
+    // The output must have space for end-begin repeat counts.
+    void get(uint64_t segmentId, uint64_t begin, uint64_t end, uint8_t* output) const;
+
+    // Decode all the repeat counts of a segment.
+    void get(uint64_t segmentId, vector<uint8_t>& output) const
+    {
+        output.resize(size(segmentId));
+        get(segmentId, 0, output.size(), output.data());
+    }
+
+private:
+
+    class Segment {
+    public:
+        uint64_t baseCount;
+        uint64_t rawBaseCount;
+
+        // The index in the codes vector of the first word of codes
+        // for this segment.
+        uint64_t codesBegin;
+
+        // The index in the blocks vector of the
+        // first index entry for this segment.
+        uint64_t blocksBegin;
+    };
+    MemoryMapped::Vector<Segment> segments;
+    MemoryMapped::Vector<uint64_t> codes;
+    MemoryMapped::Vector<uint8_t> exceptions;
+
+    // For each block of each segment, the index in the exceptions
+    // vector of the first exception at or after the beginning of the block.
+    MemoryMapped::Vector<uint64_t> blocks;
+
+    // Return a mask with bit 2*i set for each code i in a word that is zero.
+    static uint64_t zeroCodes(uint64_t word)
+    {
+        return ~(word | (word >> 1ULL)) & 0x5555555555555555ULL;
+    }
+
+    // Return the index in the exceptions vector of the exception
+    // corresponding to a given position of a segment.
+    // Also works for positions that don't contain an exception,
+    // in which case it returns the index of the next exception.
+    uint64_t findException(const Segment& segment, uint64_t position) const
+    {
+        const uint64_t* segmentCodes = codes.begin() + segment.codesBegin;
+        uint64_t exceptionIndex = blocks.begin()[segment.blocksBegin + position / blockSize];
+        const uint64_t wordEnd = position >> 5ULL;
+        for(uint64_t word=(position / blockSize) * (blockSize >> 5ULL); word!=wordEnd; word++) {
+            exceptionIndex += __builtin_popcountll(zeroCodes(segmentCodes[word]));
+        }
+        const uint64_t bitCount = (position & 31ULL) << 1ULL;
+        if(bitCount) {
+            const uint64_t mask = (1ULL << bitCount) - 1ULL;
+            exceptionIndex += __builtin_popcountll(zeroCodes(segmentCodes[wordEnd]) & mask);
+        }
+        return exceptionIndex;
+    }
+};
+
+#endif
@@ -31,6 +31,7 @@ void ChanZuckerberg::shasta::testCompactUndirectedGraph1()
     using G = CompactUndirectedGraph<double, double>;
     using vertex_descriptor = G::vertex_descriptor;
     using edge_descriptor = G::edge_descriptor;
+    using Int = G::Int;
 
     G g;
 
@@ -77,6 +78,31 @@ void ChanZuckerberg::shasta::testCompactUndirectedGraph1()
             cout << g[v0] << " " << g[v1] << " " << g[e01] << endl;
         }
     }
+
+    // Create the same graph using the bulk builder
+    // and check that the out-edges are the same.
+    G h;
+    for(Int i=0; i<4; i++) {
+        h.addVertex(double(i));
+    }
+    h.doneAddingVertices();
+    const vector< tuple<vertex_descriptor, vertex_descriptor, double> > edgeList = {
+        make_tuple(v0, v1, 10.),
+        make_tuple(v1, v2, 20.),
+        make_tuple(v2, v3, 30.)};
+    h.createEdges(edgeList.begin(), edgeList.end());
+    CZI_ASSERT(h.edgeCount() == g.edgeCount());
+    BGL_FORALL_VERTICES(v0, g, G) {
+        auto itg = g.outEdgesBegin(v0);
+        auto ith = h.outEdgesBegin(v0);
+        for(; itg!=g.outEdgesEnd(v0); ++itg, ++ith) {
+            CZI_ASSERT(ith != h.outEdgesEnd(v0));
+            CZI_ASSERT(target(*itg, g) == target(*ith, h));
+            CZI_ASSERT(g[*itg] == h[*ith]);
+        }
+        CZI_ASSERT(ith == h.outEdgesEnd(v0));
+    }
+    cout << "Bulk builder gives the same out-edges." << endl;
 }
 
 
@@ -28,7 +28,9 @@
 // Standard library.
 #include "array.hpp"
 #include "iostream.hpp"
+#include "iterator.hpp"
 #include  <limits>
+#include "tuple.hpp"
 #include "utility.hpp"
 #include "vector.hpp"
 
@@ -128,14 +130,35 @@ public:
 
     // Operations allowed only when getState() == AddingEdges.
     edge_descriptor addEdge(vertex_descriptor, vertex_descriptor, const Edge& edge = Edge());
+    void reserveEdges(Int);
     void doneAddingEdges();  // Transitions to state = Processing.
 
+    // Bulk alternative to addEdge and doneAddingEdges,
+    // for use when all edges are known up front.
+    // The iterators point to tuples of the form
+    // (vertex_descriptor, vertex_descriptor, Edge).
+    // The edges are appended to any edges already added,
+    // with storage allocated once, then the adjacency lists
+    // are created as in doneAddingEdges.
+    // Transitions to state = Processing.
+    template<class EdgeIterator> void createEdges(EdgeIterator begin, EdgeIterator end);
+
     // All remaining operations are only allowed when getState() == Processing.
 
     // Clear all vertices and edges and put the graph back in the AddingVertices state.
+    // This keeps the allocated memory.
     void clear();
     CompactUndirectedGraph();
 
+    // The number of bytes currently allocated.
+    uint64_t capacityBytes() const
+    {
+        return
+            vertexTable.capacity() * sizeof(pair<Vertex, Int>) +
+            edgeTable.capacity() * sizeof(EdgeInfo) +
+            edgeLists.capacity() * sizeof(Int);
+    }
+
     // Vertices of an edge.
     vertex_descriptor source(edge_descriptor e) const
     {
@@ -535,11 +558,36 @@ template<class Vertex, class Edge>
     return e;
 }
 
+template<class Vertex, class Edge>
+    inline void
+    ChanZuckerberg::shasta::CompactUndirectedGraph<Vertex, Edge>::
+    reserveEdges(Int n)
+{
+    CZI_ASSERT(state == State::AddingEdges);
+    edgeTable.reserve(n);
+}
+
+template<class Vertex, class Edge>
+    template<class EdgeIterator>
+    inline void
+    ChanZuckerberg::shasta::CompactUndirectedGraph<Vertex, Edge>::
+    createEdges(EdgeIterator begin, EdgeIterator end)
+{
+    CZI_ASSERT(state == State::AddingEdges);
+    edgeTable.reserve(edgeTable.size() + Int(std::distance(begin, end)));
+    for(EdgeIterator it=begin; it!=end; ++it) {
+        edgeTable.push_back(EdgeInfo(std::get<0>(*it), std::get<1>(*it), std::get<2>(*it)));
+    }
+    doneAddingEdges();
+}
+
 template<class Vertex, class Edge>
     inline void
     ChanZuckerberg::shasta::CompactUndirectedGraph<Vertex, Edge>::
     doneAddingEdges()
 {
+    // This creates the adjacency lists in two passes over the edges.
+
     // First, we store the degree of each vertex
     // (number of edges to the vertex).
     for(const EdgeInfo& edgeInfo: edgeTable) {
@@ -560,25 +608,21 @@ template<class Vertex, class Edge>
     }
     vertexTable.push_back(make_pair(Vertex(), n));
 
-    // Now store in reverse order.
+    // Now store the edges, filling the edge list of each vertex
+    // from the end. Looping over edges in reverse order
+    // leaves the edge list of each vertex sorted.
+    // At the end, each vertex points to its first edge.
     edgeLists.resize(n);
-    for(Int e=0; e<Int(edgeTable.size()); e++) {
+    for(Int e=Int(edgeTable.size()); e!=Int(0); ) {
+        --e;
         const EdgeInfo& edgeInfo = edgeTable[e];
         const vertex_descriptor v0 = edgeInfo.vertices[0];
         const vertex_descriptor v1 = edgeInfo.vertices[1];
-        edgeLists[--vertexTable[v0.v].second] = e;
         edgeLists[--vertexTable[v1.v].second] = e;
+        edgeLists[--vertexTable[v0.v].second] = e;
     }
     CZI_ASSERT(vertexTable.front().second == Int(0));
 
-    // Reverse the order, for each vertex,
-    // so it is sorted.
-    for(Int v=0; v<Int(vertexTable.size()-1); v++) {
-        std::reverse(
-            edgeLists.begin() + vertexTable[v].second,
-            edgeLists.begin() + vertexTable[v + Int(1)].second);
-    }
-
     CZI_ASSERT(edgeLists.size() == 2*edgeTable.size());
     CZI_ASSERT(vertexTable.back().second == Int(edgeLists.size()));
 
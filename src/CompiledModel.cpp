@@ -0,0 +1,66 @@
+// shasta.
+#include "CompiledModel.hpp"
+#include "filesystem.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Linux.
+#include <stdio.h>
+#include <unistd.h>
+
+// Standard library.
+#include "algorithm.hpp"
+#include "iostream.hpp"
+
+
+
+bool ChanZuckerberg::shasta::isCompiledModelUpToDate(
+    const string& textFileName,
+    const string& binaryFileName)
+{
+    if(!filesystem::isRegularFile(binaryFileName)) {
+        return false;
+    }
+    if(!filesystem::exists(textFileName)) {
+        return true;
+    }
+    return filesystem::modificationTime(binaryFileName) >=
+        filesystem::modificationTime(textFileName);
+}
+
+
+
+void ChanZuckerberg::shasta::createCompiledModel(
+    const string& binaryFileName,
+    const vector<char>& image,
+    MemoryMapped::Vector<char>& data)
+{
+    if(binaryFileName.empty()) {
+        data.createNew("", 4096, image.size());
+        copy(image.begin(), image.end(), data.begin());
+        return;
+    }
+
+    const string temporaryFileName = binaryFileName + "-" + to_string(::getpid());
+    try {
+        data.createNew(temporaryFileName, 4096, image.size());
+        copy(image.begin(), image.end(), data.begin());
+        data.close();
+        if(::rename(temporaryFileName.c_str(), binaryFileName.c_str()) != 0) {
+            filesystem::remove(temporaryFileName);
+            throw runtime_error("Error renaming " + temporaryFileName + " to " + binaryFileName);
+        }
+        data.accessExistingReadOnly(binaryFileName);
+    } catch(...) {
+        cout << "Could not store compiled model " << binaryFileName <<
+            ". The model will be compiled again by each process." << endl;
+        if(data.isOpen) {
+            data.remove();
+        }
+        if(filesystem::exists(temporaryFileName)) {
+            filesystem::remove(temporaryFileName);
+        }
+        data.createNew("", 4096, image.size());
+        copy(image.begin(), image.end(), data.begin());
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef CZI_SHASTA_COMPILED_MODEL_HPP
+#define CZI_SHASTA_COMPILED_MODEL_HPP
+
+/*******************************************************************************
+
+Support for models (for example, consensus caller models) that are
+provided as text files in the run directory, but used in a compiled
+binary form.
+
+The first process that needs a model parses the text file and writes
+the compiled form to a binary file next to it. Subsequent processes
+(including Python workers that each construct their own Assembler)
+only map the binary file read-only, which takes no parsing
+and shares the same physical pages between processes.
+
+The binary file is a MemoryMapped::Vector<char>, so its data are
+aligned to cache lines. The layout of the data is defined by each model,
+which is responsible for storing a magic number and format version
+and checking them when accessing an existing binary file.
+
+The binary file is recreated if the text file is modified after it.
+If the text file does not exist, an existing binary file is used as is.
+
+*******************************************************************************/
+
+// shasta.
+#include "MemoryMappedVector.hpp"
+
+// Standard library.
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        // Return true if binaryFileName exists and
+        // textFileName does not exist or was not modified after it.
+        bool isCompiledModelUpToDate(
+            const string& textFileName,
+            const string& binaryFileName);
+
+        // Store the compiled model contained in image
+        // in binaryFileName, then map it read-only into data.
+        // The file is written under a temporary name and then renamed,
+        // so concurrent processes see either no file or a complete one.
+        // If the file cannot be written (for example because the directory
+        // is not writable), the model is stored in anonymous memory instead.
+        // The same happens if binaryFileName is empty.
+        void createCompiledModel(
+            const string& binaryFileName,
+            const vector<char>& image,
+            MemoryMapped::Vector<char>& data);
+    }
+}
+
+#endif
@@ -0,0 +1,66 @@
+// Shasta.
+#include "CompressedAlignment.hpp"
+#include "Alignment.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+
+
+// Variable length integers, 7 bits per byte,
+// with the high bit set on all bytes except the last.
+static void writeVarint(uint64_t x, vector<uint8_t>& bytes)
+{
+    while(x >= 0x80ULL) {
+        bytes.push_back(uint8_t(x | 0x80ULL));
+        x >>= 7ULL;
+    }
+    bytes.push_back(uint8_t(x));
+}
+static uint64_t readVarint(const uint8_t*& p)
+{
+    uint64_t x = 0;
+    uint64_t shift = 0;
+    while(true) {
+        const uint8_t byte = *p++;
+        x |= uint64_t(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) {
+            return x;
+        }
+        shift += 7ULL;
+    }
+}
+
+
+
+void ChanZuckerberg::shasta::compressAlignment(
+    const Alignment& alignment,
+    vector<uint8_t>& bytes)
+{
+    bytes.clear();
+    array<uint32_t, 2> previous = {0, 0};
+    for(const array<uint32_t, 2>& ordinals: alignment.ordinals) {
+        CZI_ASSERT(ordinals[0] >= previous[0]);
+        CZI_ASSERT(ordinals[1] >= previous[1]);
+        writeVarint(ordinals[0] - previous[0], bytes);
+        writeVarint(ordinals[1] - previous[1], bytes);
+        previous = ordinals;
+    }
+}
+
+
+
+void ChanZuckerberg::shasta::decompressAlignment(
+    const uint8_t* begin,
+    const uint8_t* end,
+    Alignment& alignment)
+{
+    alignment.ordinals.clear();
+    array<uint32_t, 2> ordinals = {0, 0};
+    const uint8_t* p = begin;
+    while(p != end) {
+        ordinals[0] += uint32_t(readVarint(p));
+        ordinals[1] += uint32_t(readVarint(p));
+        alignment.ordinals.push_back(ordinals);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef CZI_SHASTA_COMPRESSED_ALIGNMENT_HPP
+#define CZI_SHASTA_COMPRESSED_ALIGNMENT_HPP
+
+/*******************************************************************************
+
+Compact representation of the ordinals of a marker alignment
+(Alignment::ordinals), used to store the alignments computed by
+computeAlignments so createMarkerGraphVertices does not
+need to compute them again.
+
+The ordinals of an alignment never decrease on either
+oriented read. Each pair of aligned markers is stored as two
+variable length integers (LEB128 varints): the differences of its ordinals
+from the ones of the previous pair in the alignment.
+For the first pair, these are the ordinals themselves.
+Successive aligned markers are usually only a few ordinals apart,
+so most pairs use 2 bytes, versus 8 for the uncompressed ordinals.
+
+*******************************************************************************/
+
+// Standard library.
+#include "cstdint.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        class Alignment;
+
+        // Compress the ordinals of an alignment,
+        // replacing the contents of the byte vector.
+        void compressAlignment(const Alignment&, vector<uint8_t>&);
+
+        // Decompress the ordinals of an alignment
+        // stored in [begin, end) by compressAlignment.
+        void decompressAlignment(const uint8_t* begin, const uint8_t* end, Alignment&);
+    }
+}
+
+#endif
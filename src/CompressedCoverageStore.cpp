@@ -0,0 +1,248 @@
+// shasta.
+#include "CompressedCoverageStore.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "chrono.hpp"
+#include "stdexcept.hpp"
+
+// zlib.
+#include <zlib.h>
+
+
+
+void CompressedCoverageStore::createNew(
+    const MemoryMapped::VectorOfVectors<Entry, uint64_t>& coverageData,
+    const string& name,
+    size_t pageSize,
+    size_t threadCount)
+{
+    const auto tBegin = steady_clock::now();
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    const uint64_t idCount = coverageData.size();
+    const uint64_t blockCount = (idCount + blockSize - 1) / blockSize;
+    blockTable.createNew(name + "-BlockTable", pageSize);
+    blockTable.resize(blockCount);
+    blocks.createNew(name + "-Blocks", pageSize);
+    createData.coverageData = &coverageData;
+    createData.compressedBlocks.clear();
+    createData.compressedBlocks.resize(blockCount);
+
+    // Pass 1: compress each block.
+    blocks.beginPass1(blockCount);
+    createData.pass = 1;
+    setupLoadBalancing(blockCount, 16);
+    runThreads(&CompressedCoverageStore::createThreadFunction, threadCount);
+
+    // Pass 2: copy the compressed blocks to their final location.
+    blocks.beginPass2();
+    blocks.endPass2(false);
+    createData.pass = 2;
+    setupLoadBalancing(blockCount, 16);
+    runThreads(&CompressedCoverageStore::createThreadFunction, threadCount);
+    createData.compressedBlocks.clear();
+    createData.compressedBlocks.shrink_to_fit();
+
+    const auto tEnd = steady_clock::now();
+    const uint64_t uncompressedByteCount =
+        coverageData.totalSize() * sizeof(Entry) + (idCount + 1) * sizeof(uint64_t);
+    cout << "Compressed coverage data for " << idCount << " ids from " <<
+        uncompressedByteCount << " to " << byteCount() << " bytes in " <<
+        seconds(tEnd - tBegin) << " s." << endl;
+}
+
+
+
+void CompressedCoverageStore::createThreadFunction(size_t threadId)
+{
+    const MemoryMapped::VectorOfVectors<Entry, uint64_t>& coverageData = *createData.coverageData;
+    const uint64_t idCount = coverageData.size();
+    vector<uint8_t> bytes;
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over blocks of this batch.
+        for(uint64_t blockId=begin; blockId!=end; blockId++) {
+            vector<uint8_t>& compressedBlock = createData.compressedBlocks[blockId];
+
+            if(createData.pass == 1) {
+
+                // Encode the block.
+                const uint64_t idBegin = blockId * blockSize;
+                const uint64_t idEnd = min(idBegin + blockSize, idCount);
+                bytes.clear();
+                encode(coverageData, idBegin, idEnd, bytes);
+                if(bytes.size() > std::numeric_limits<uint32_t>::max()) {
+                    throw runtime_error("Coverage data block is too large to be compressed.");
+                }
+
+                // Compress it.
+                uLongf compressedSize = compressBound(uLong(bytes.size()));
+                compressedBlock.resize(compressedSize);
+                if(compress2(compressedBlock.data(), &compressedSize,
+                    bytes.data(), uLong(bytes.size()), Z_DEFAULT_COMPRESSION) != Z_OK) {
+                    throw runtime_error("Error compressing coverage data.");
+                }
+                compressedBlock.resize(compressedSize);
+                compressedBlock.shrink_to_fit();
+
+                Block& block = blockTable[blockId];
+                block.idCount = uint32_t(idEnd - idBegin);
+                block.uncompressedSize = uint32_t(bytes.size());
+                blocks.incrementCount(blockId, compressedBlock.size());
+
+            } else {
+                CZI_ASSERT(blocks.size(blockId) == compressedBlock.size());
+                copy(compressedBlock.begin(), compressedBlock.end(), blocks.begin(blockId));
+                vector<uint8_t>().swap(compressedBlock);
+            }
+        }
+    }
+}
+
+
+
+// Encode the coverage data for the ids of a block.
+void CompressedCoverageStore::encode(
+    const MemoryMapped::VectorOfVectors<Entry, uint64_t>& coverageData,
+    uint64_t idBegin,
+    uint64_t idEnd,
+    vector<uint8_t>& bytes)
+{
+    for(uint64_t id=idBegin; id!=idEnd; id++) {
+        writeVarint(coverageData.size(id), bytes);
+    }
+    for(uint64_t id=idBegin; id!=idEnd; id++) {
+        uint32_t previousPosition = 0;
+        for(const Entry& entry: coverageData[id]) {
+            const uint32_t position = entry.first;
+            CZI_ASSERT(position >= previousPosition);
+            writeVarint(position - previousPosition, bytes);
+            previousPosition = position;
+            const uint8_t* c = reinterpret_cast<const uint8_t*>(&entry.second);
+            bytes.insert(bytes.end(), c, c + sizeof(CompressedCoverageData));
+        }
+    }
+}
+
+
+
+// Get the coverage data for one id, ordered by position.
+void CompressedCoverageStore::get(uint64_t id, vector<Entry>& v) const
+{
+    CZI_ASSERT(id < size());
+    const uint64_t blockId = id / blockSize;
+    const Block& block = blockTable[blockId];
+
+    // Decompress the block.
+    vector<uint8_t> bytes(block.uncompressedSize);
+    uLongf uncompressedSize = block.uncompressedSize;
+    if(uncompress(bytes.data(), &uncompressedSize,
+        blocks.begin(blockId), uLong(blocks.size(blockId))) != Z_OK ||
+        uncompressedSize != block.uncompressedSize) {
+        throw runtime_error("Error decompressing coverage data.");
+    }
+
+    // Read the entry counts, skipping the entries
+    // of the ids in the block that precede the one we want.
+    const uint8_t* p = bytes.data();
+    const uint64_t idInBlock = id - blockId * blockSize;
+    uint64_t skipCount = 0;
+    uint64_t entryCount = 0;
+    for(uint64_t i=0; i<block.idCount; i++) {
+        const uint64_t n = readVarint(p);
+        if(i < idInBlock) {
+            skipCount += n;
+        } else if(i == idInBlock) {
+            entryCount = n;
+        }
+    }
+    for(uint64_t i=0; i<skipCount; i++) {
+        readVarint(p);
+        p += sizeof(CompressedCoverageData);
+    }
+
+    // Decode the entries we want.
+    v.resize(entryCount);
+    uint32_t position = 0;
+    for(uint64_t i=0; i<entryCount; i++) {
+        position += uint32_t(readVarint(p));
+        Entry& entry = v[i];
+        entry.first = position;
+        copy(p, p + sizeof(CompressedCoverageData), reinterpret_cast<uint8_t*>(&entry.second));
+        p += sizeof(CompressedCoverageData);
+    }
+}
+
+
+
+uint64_t CompressedCoverageStore::byteCount() const
+{
+    return
+        blockTable.size() * sizeof(Block) +
+        blocks.totalSize() * sizeof(uint8_t) +
+        (blocks.size() + 1) * sizeof(uint64_t);
+}
+
+
+
+void CompressedCoverageStore::accessExistingReadOnly(const string& name)
+{
+    blockTable.accessExistingReadOnly(name + "-BlockTable");
+    blocks.accessExistingReadOnly(name + "-Blocks");
+}
+
+
+
+void CompressedCoverageStore::remove()
+{
+    blockTable.remove();
+    blocks.remove();
+}
+
+
+
+void CompressedCoverageStore::close()
+{
+    if(blockTable.isOpen) {
+        blockTable.close();
+    }
+    if(blocks.isOpen()) {
+        blocks.close();
+    }
+}
+
+
+
+// Variable length integers, 7 bits per byte,
+// with the high bit set on all bytes except the last.
+void CompressedCoverageStore::writeVarint(uint64_t x, vector<uint8_t>& bytes)
+{
+    while(x >= 0x80ULL) {
+        bytes.push_back(uint8_t(x | 0x80ULL));
+        x >>= 7ULL;
+    }
+    bytes.push_back(uint8_t(x));
+}
+uint64_t CompressedCoverageStore::readVarint(const uint8_t*& p)
+{
+    uint64_t x = 0;
+    uint64_t shift = 0;
+    while(true) {
+        const uint8_t byte = *p++;
+        x |= uint64_t(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) {
+            return x;
+        }
+        shift += 7ULL;
+    }
+}
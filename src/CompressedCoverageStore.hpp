@@ -0,0 +1,126 @@
+#ifndef CZI_SHASTA_COMPRESSED_COVERAGE_STORE_HPP
+#define CZI_SHASTA_COMPRESSED_COVERAGE_STORE_HPP
+
+/*******************************************************************************
+
+Class CompressedCoverageStore stores the same information as the
+MemoryMapped::VectorOfVectors<pair<uint32_t, CompressedCoverageData>, uint64_t>
+used for MarkerGraph::vertexCoverageData and MarkerGraph::edgeCoverageData,
+but block compressed.
+
+Vertices (or edges) are grouped in blocks of blockSize consecutive ids.
+The coverage data of each block is encoded as follows:
+- For each id, the number of entries as a LEB128 varint.
+- Then, for each entry, the position difference from the previous entry
+  of the same id as a varint (for the first entry, the position itself),
+  followed by the three bytes of the CompressedCoverageData.
+The encoded block is then compressed using zlib.
+
+Access to the coverage data of a single id decompresses its block,
+so it costs about as much as decoding blockSize ids.
+This is fast enough for the HTTP server, the Python API,
+and assembly with Assembly.storeCoverageData.
+
+*******************************************************************************/
+
+// shasta.
+#include "Coverage.hpp"
+#include "MemoryMappedVectorOfVectors.hpp"
+#include "MultitreadedObject.hpp"
+
+// Standard library.
+#include "string.hpp"
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class CompressedCoverageStore;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::CompressedCoverageStore :
+    public MultithreadedObject<CompressedCoverageStore> {
+public:
+
+    CompressedCoverageStore() : MultithreadedObject(*this) {}
+
+    typedef pair<uint32_t, CompressedCoverageData> Entry;
+
+    // The number of ids in each block.
+    static const uint64_t blockSize = 256;
+
+    // Create from uncompressed coverage data.
+    void createNew(
+        const MemoryMapped::VectorOfVectors<Entry, uint64_t>& coverageData,
+        const string& name,
+        size_t pageSize,
+        size_t threadCount);
+
+    void accessExistingReadOnly(const string& name);
+    void remove();
+
+    // Close whatever is open, also after a partially
+    // successful accessExistingReadOnly.
+    void close();
+
+    bool isOpen() const
+    {
+        return blockTable.isOpen && blocks.isOpen();
+    }
+
+    // The number of ids (vertices or edges).
+    uint64_t size() const
+    {
+        if(blockTable.size() == 0) {
+            return 0;
+        }
+        return (blockTable.size() - 1) * blockSize + blockTable[blockTable.size() - 1].idCount;
+    }
+
+    // The total number of bytes used by this data structure.
+    uint64_t byteCount() const;
+
+    // Get the coverage data for one id, ordered by position.
+    void get(uint64_t id, vector<Entry>&) const;
+
+private:
+
+    class Block {
+    public:
+        uint32_t idCount;
+        uint32_t uncompressedSize;
+    };
+    MemoryMapped::Vector<Block> blockTable;
+
+    // The compressed data for each block.
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t> blocks;
+
+    // Encode the coverage data for the ids of a block.
+    static void encode(
+        const MemoryMapped::VectorOfVectors<Entry, uint64_t>&,
+        uint64_t idBegin,
+        uint64_t idEnd,
+        vector<uint8_t>&);
+
+    // Variable length integers.
+    static void writeVarint(uint64_t, vector<uint8_t>&);
+    static uint64_t readVarint(const uint8_t*&);
+
+    // Data and functions used during creation.
+    void createThreadFunction(size_t threadId);
+    class CreateData {
+    public:
+        const MemoryMapped::VectorOfVectors<Entry, uint64_t>* coverageData;
+
+        // Pass 1 compresses each block and stores it in compressedBlocks.
+        // Pass 2 copies it to its final location.
+        size_t pass;
+        vector< vector<uint8_t> > compressedBlocks;
+    };
+    CreateData createData;
+};
+
+#endif
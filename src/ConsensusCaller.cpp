@@ -1,10 +1,53 @@
 #include "ConsensusCaller.hpp"
+#include "CompactCoverage.hpp"
 #include "Coverage.hpp"
+#include "CoverageTensor.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
 
 
+// Default implementation of the CompactCoverage version of operator().
+// It converts the CompactCoverage to a Coverage object.
+// This loses the per-read information, but that is not
+// used by any of the ConsensusCaller implementations.
+Consensus ConsensusCaller::operator()(
+    const CompactCoverage& compactCoverage) const
+{
+    Coverage coverage;
+    for(uint8_t baseValue=0; baseValue<5; baseValue++) {
+        const AlignedBase base = AlignedBase::fromInteger(baseValue);
+        const size_t repeatCountEnd = compactCoverage.repeatCountEnd(base);
+        for(Strand strand=0; strand<2; strand++) {
+            for(size_t repeatCount=0; repeatCount<repeatCountEnd; repeatCount++) {
+                const size_t n = compactCoverage.coverage(base, strand, repeatCount);
+                for(size_t i=0; i<n; i++) {
+                    coverage.addRead(base, strand, repeatCount);
+                }
+            }
+        }
+    }
+    return (*this)(coverage);
+}
+
+
+
+// Default implementation of the batch operator().
+// It calls the CompactCoverage version for each column.
+void ConsensusCaller::operator()(
+    const CoverageTensor& coverageTensor,
+    vector<Consensus>& consensus) const
+{
+    consensus.resize(coverageTensor.size());
+    CompactCoverage compactCoverage;
+    for(size_t column=0; column<coverageTensor.size(); column++) {
+        coverageTensor.getColumn(column, compactCoverage);
+        consensus[column] = (*this)(compactCoverage);
+    }
+}
+
+
+
 // Given a vector of Coverage objects,
 // find the repeat counts that have non-zero coverage on the called base
 // at any position.
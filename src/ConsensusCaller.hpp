@@ -16,6 +16,18 @@ Derived classes must implement operator(), which must
 run the consensus algorithm and return a pair containing
 the "best" base and repeat count.
 
+Derived classes can also override the operator() that takes
+a CompactCoverage object, which is used during assembly
+to avoid memory allocations. The default implementation
+converts the CompactCoverage to a Coverage object.
+
+Finally, derived classes can override the batch operator()
+that takes a CoverageTensor and computes consensus for
+all of its columns in a single call. This allows
+implementations to loop over columns in their innermost loops.
+The default implementation calls the CompactCoverage version
+once for each column.
+
 *******************************************************************************/
 
 // Shasta
@@ -28,7 +40,9 @@ the "best" base and repeat count.
 
 namespace ChanZuckerberg {
     namespace shasta {
+        class CompactCoverage;
         class Coverage;
+        class CoverageTensor;
         class ConsensusCaller;
         class Consensus;
     }
@@ -59,6 +73,20 @@ public:
     // It must be implemented by all derived classes.
     virtual Consensus operator()(const Coverage&) const = 0;
 
+    // Same, for a CompactCoverage object.
+    // The default implementation converts to a Coverage object
+    // and calls the above. Derived classes can override this
+    // to work directly on the CompactCoverage.
+    virtual Consensus operator()(const CompactCoverage&) const;
+
+    // Batch version: compute consensus for all the columns
+    // of a CoverageTensor. On return, the consensus vector
+    // has one entry for each column.
+    // Columns for which CoverageTensor::overflow(column)
+    // is true are not supported. The caller must handle them
+    // separately using a Coverage object.
+    virtual void operator()(const CoverageTensor&, vector<Consensus>&) const;
+
     // Virtual destructor, to ensure destruction of derived classes.
     virtual ~ConsensusCaller() {}
 
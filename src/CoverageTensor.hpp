@@ -0,0 +1,194 @@
+#ifndef CZI_SHASTA_COVERAGE_TENSOR_HPP
+#define CZI_SHASTA_COVERAGE_TENSOR_HPP
+
+// Shasta.
+#include "accumulateCoverage.hpp"
+#include "Base.hpp"
+#include "CompactCoverage.hpp"
+#include "CZI_ASSERT.hpp"
+#include "ReadId.hpp"
+
+// Standard library.
+#include <limits>
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class CoverageTensor;
+    }
+}
+
+
+
+// Class CoverageTensor stores the same counts as CompactCoverage,
+// but for many alignment positions (columns) at once.
+// It is used to call consensus for all the columns of an alignment
+// with a single call to a ConsensusCaller.
+//
+// The counts are stored as a struct of arrays:
+// for each combination of base (ACGT or '-'), strand, and repeat count
+// (a "slot"), there is a contiguous array of 16-bit counts,
+// one for each column. This way a ConsensusCaller can
+// loop over columns in its innermost loop.
+//
+// As in CompactCoverage, repeat counts are only supported up to maxRepeatCount.
+// If a read with a greater repeat count is added to a column, the read
+// is not counted and overflow(column) returns true.
+class ChanZuckerberg::shasta::CoverageTensor {
+public:
+
+    static const size_t maxRepeatCount = CompactCoverage::maxRepeatCount;
+    static const size_t repeatCountSlotCount = CompactCoverage::repeatCountSlotCount;
+    static const size_t slotCount = 5*2*repeatCountSlotCount;
+
+    // Remove all counts and set the number of columns.
+    void clear(size_t columnCountArgument)
+    {
+        columnCount = columnCountArgument;
+        counts.assign(slotCount * columnCount, 0);
+        overflowFlags.assign(columnCount, 0);
+        hasOverflow = false;
+    }
+
+    // The number of columns.
+    size_t size() const
+    {
+        return columnCount;
+    }
+
+    // Return the slot for a given base, strand, and repeat count.
+    static size_t slot(AlignedBase base, Strand strand, size_t repeatCount)
+    {
+        return (base.value*2 + strand)*repeatCountSlotCount + repeatCount;
+    }
+
+    // Add information about a read supporting a column.
+    // If the AlignedBase is '-',repeatCount must be zero.
+    // Otherwise, it must not be zero.
+    void addRead(size_t column, AlignedBase base, Strand strand, size_t repeatCount)
+    {
+        CZI_ASSERT(column < columnCount);
+        CZI_ASSERT(base.value < 5);
+        CZI_ASSERT(strand < 2);
+        if(base.isGap()) {
+            CZI_ASSERT(repeatCount == 0);
+        } else {
+            CZI_ASSERT(repeatCount > 0);
+        }
+        if(repeatCount > maxRepeatCount) {
+            overflowFlags[column] = 1;
+            hasOverflow = true;
+            return;
+        }
+        uint16_t& count = counts[slot(base, strand, repeatCount)*columnCount + column];
+        CZI_ASSERT(count < std::numeric_limits<uint16_t>::max());
+        ++count;
+    }
+
+    // Return true if any column overflowed.
+    bool overflow() const
+    {
+        return hasOverflow;
+    }
+
+    // Return true if a read with repeat count greater than
+    // maxRepeatCount was added to the given column.
+    bool overflow(size_t column) const
+    {
+        return overflowFlags[column] != 0;
+    }
+
+    // Return the counts for all columns for a given slot.
+    const uint16_t* slotCounts(size_t slot) const
+    {
+        return counts.data() + slot*columnCount;
+    }
+
+    // Get coverage for a given column, base, strand, and repeat count.
+    size_t coverage(size_t column, AlignedBase base, Strand strand, size_t repeatCount) const
+    {
+        if(repeatCount > maxRepeatCount) {
+            return 0;
+        }
+        return counts[slot(base, strand, repeatCount)*columnCount + column];
+    }
+
+    // Get coverage for a given column, base, and repeat count,
+    // summing over both strands.
+    size_t coverage(size_t column, AlignedBase base, size_t repeatCount) const
+    {
+        return coverage(column, base, 0, repeatCount) + coverage(column, base, 1, repeatCount);
+    }
+
+    // Compute, for each base (ACGT or '-') and column, the coverage summed
+    // over both strands and all repeat counts.
+    // On return, baseCoverage[base*size() + column] contains the coverage
+    // for that base and column.
+    void computeBaseCoverage(vector<uint32_t>& baseCoverage) const
+    {
+        baseCoverage.assign(5*columnCount, 0);
+        for(size_t baseValue=0; baseValue<5; baseValue++) {
+            uint32_t* c = baseCoverage.data() + baseValue*columnCount;
+            for(size_t s=baseValue*2*repeatCountSlotCount; s<(baseValue+1)*2*repeatCountSlotCount; s++) {
+                accumulateCoverage(slotCounts(s), c, columnCount);
+            }
+        }
+    }
+
+    // Find the base with the most coverage at each column.
+    // This can return ACGT or '-'.
+    // Ties are broken in favor of the "earlier" base,
+    // same as CompactCoverage::mostFrequentBase.
+    void mostFrequentBases(vector<AlignedBase>& bases) const
+    {
+        vector<uint32_t> baseCoverage;
+        computeBaseCoverage(baseCoverage);
+        vector<uint32_t> bestCoverage(columnCount, 0);
+        vector<uint8_t> bestBaseValue(columnCount, 4);
+        for(uint8_t baseValue=0; baseValue<5; baseValue++) {
+            const uint32_t* c = baseCoverage.data() + baseValue*columnCount;
+            for(size_t column=0; column<columnCount; column++) {
+                if(c[column] > bestCoverage[column]) {
+                    bestCoverage[column] = c[column];
+                    bestBaseValue[column] = baseValue;
+                }
+            }
+        }
+        bases.resize(columnCount);
+        for(size_t column=0; column<columnCount; column++) {
+            bases[column] = AlignedBase::fromInteger(bestBaseValue[column]);
+        }
+    }
+
+    // Copy the counts for a column to a CompactCoverage object.
+    void getColumn(size_t column, CompactCoverage& compactCoverage) const
+    {
+        compactCoverage.clear();
+        for(uint8_t baseValue=0; baseValue<5; baseValue++) {
+            const AlignedBase base = AlignedBase::fromInteger(baseValue);
+            for(Strand strand=0; strand<2; strand++) {
+                for(size_t repeatCount=0; repeatCount<=maxRepeatCount; repeatCount++) {
+                    const size_t n = coverage(column, base, strand, repeatCount);
+                    if(n) {
+                        compactCoverage.addReads(base, strand, repeatCount, n);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    size_t columnCount = 0;
+
+    // The counts, indexed by [slot*columnCount + column].
+    vector<uint16_t> counts;
+
+    // For each column, a flag that is set if a read with
+    // repeat count greater than maxRepeatCount was added.
+    vector<uint8_t> overflowFlags;
+    bool hasOverflow = false;
+};
+
+
+
+#endif
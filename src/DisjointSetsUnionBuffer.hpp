@@ -0,0 +1,129 @@
+#ifndef CZI_SHASTA_DISJOINT_SETS_UNION_BUFFER_HPP
+#define CZI_SHASTA_DISJOINT_SETS_UNION_BUFFER_HPP
+
+/*******************************************************************************
+
+Class DisjointSetsUnionBuffer buffers calls to DisjointSets::unite
+and applies them in order of marker id block.
+The template argument is DisjointSets or DisjointSets32 (see dset64.hpp).
+
+When the DisjointSets object is large (16 bytes per item,
+so tens of GB for billions of markers), union operations
+in random order touch a different cache line and often a different page
+for almost every call. Here, the union operations are
+accumulated in a buffer. When the buffer is full,
+they are partitioned (counting sort) by the block of the
+smaller of the two item ids, then applied block by block.
+With blockSizeLog2 = 16, a block covers 1 MB of DisjointSets data,
+so the accesses to the first item of each union operation
+stay within a region that fits in cache and in a few TLB entries.
+The accesses to the second item and to the roots remain random.
+
+The final disjoint sets do not depend on the order
+in which union operations are applied, but the
+ids of the roots can change. Code using this class
+must not depend on which item of each set is the root.
+
+Each thread should use its own DisjointSetsUnionBuffer,
+and must call flush after its last call to unite.
+If the capacity is zero, unite calls DisjointSets::unite directly.
+
+*******************************************************************************/
+
+#include "dset64.hpp"
+
+// Standard library.
+#include "algorithm.hpp"
+#include "cstdint.hpp"
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        template<class DisjointSetsType> class DisjointSetsUnionBuffer;
+    }
+}
+
+
+
+template<class DisjointSetsType> class ChanZuckerberg::shasta::DisjointSetsUnionBuffer {
+public:
+
+    static const uint64_t blockSizeLog2 = 16;
+
+    DisjointSetsUnionBuffer(
+        DisjointSetsType& disjointSets,
+        uint64_t itemCount,
+        uint64_t capacity) :
+        disjointSets(disjointSets),
+        capacity(capacity)
+    {
+        if(capacity > 0) {
+            buffer.reserve(capacity);
+            blockCount = (itemCount >> blockSizeLog2) + 1;
+        }
+    }
+
+    void unite(uint64_t i, uint64_t j)
+    {
+        if(capacity == 0) {
+            disjointSets.unite(
+                typename DisjointSetsType::Uint(i),
+                typename DisjointSetsType::Uint(j));
+            return;
+        }
+        if(i > j) {
+            std::swap(i, j);
+        }
+        buffer.push_back(make_pair(i, j));
+        if(buffer.size() == capacity) {
+            flush();
+        }
+    }
+
+    // Apply all buffered union operations.
+    void flush()
+    {
+        if(buffer.empty()) {
+            return;
+        }
+
+        // Count the union operations in each block.
+        blockBegin.assign(blockCount + 1, 0);
+        for(const auto& p: buffer) {
+            ++blockBegin[(p.first >> blockSizeLog2) + 1];
+        }
+        for(uint64_t block=0; block<blockCount; block++) {
+            blockBegin[block + 1] += blockBegin[block];
+        }
+
+        // Partition them by block.
+        partitionedBuffer.resize(buffer.size());
+        for(const auto& p: buffer) {
+            partitionedBuffer[blockBegin[p.first >> blockSizeLog2]++] = p;
+        }
+
+        // Apply them in order of block,
+        // skipping consecutive duplicates.
+        pair<uint64_t, uint64_t> previous(1, 0);
+        for(const auto& p: partitionedBuffer) {
+            if(p != previous) {
+                disjointSets.unite(
+                    typename DisjointSetsType::Uint(p.first),
+                    typename DisjointSetsType::Uint(p.second));
+                previous = p;
+            }
+        }
+        buffer.clear();
+    }
+
+private:
+    DisjointSetsType& disjointSets;
+    uint64_t capacity;
+    uint64_t blockCount = 0;
+    vector< pair<uint64_t, uint64_t> > buffer;
+    vector< pair<uint64_t, uint64_t> > partitionedBuffer;
+    vector<uint64_t> blockBegin;
+};
+
+#endif
@@ -0,0 +1,433 @@
+// Shasta.
+#include "ForceDirectedLayout.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include <cmath>
+
+
+
+bool ForceDirectedLayout::compute(
+    uint64_t vertexCount,
+    const vector< pair<uint32_t, uint32_t> >& edges,
+    vector<Point>& positions,
+    double timeout,
+    uint32_t seed)
+{
+    const auto startTime = steady_clock::now();
+    uint32_t randomState = (seed == 0) ? 1 : seed;
+    positions.clear();
+    if(vertexCount == 0) {
+        return true;
+    }
+
+    // Create the finest level.
+    vector<Level> levels(1);
+    createLevel(vertexCount, edges, vector<double>(vertexCount, 1.), levels.front());
+
+    // Coarsen until the graph is small or no longer shrinks.
+    const uint64_t minVertexCount = 32;
+    while(levels.back().vertexCount() > minVertexCount) {
+        Level coarse;
+        if(!coarsen(levels.back(), coarse, randomState)) {
+            break;
+        }
+        levels.push_back(coarse);
+    }
+
+    // Lay out the coarsest level starting from random positions.
+    const Level& coarsest = levels.back();
+    const double initialSize = std::sqrt(double(vertexCount));
+    positions.resize(coarsest.vertexCount());
+    for(Point& p: positions) {
+        p[0] = initialSize * randomDouble(randomState);
+        p[1] = initialSize * randomDouble(randomState);
+    }
+    if(!refine(coarsest, positions, 200, 0.1 * initialSize + 1., startTime, timeout)) {
+        positions.clear();
+        return false;
+    }
+
+    // Go back to the finer levels.
+    vector<Point> finePositions;
+    for(uint64_t i=levels.size()-1; i!=0; i--) {
+        const Level& fine = levels[i-1];
+        finePositions.resize(fine.vertexCount());
+        for(uint32_t v=0; v<fine.vertexCount(); v++) {
+            const Point& p = positions[fine.coarseVertex[v]];
+            finePositions[v][0] = p[0] + 0.1 * (randomDouble(randomState) - 0.5);
+            finePositions[v][1] = p[1] + 0.1 * (randomDouble(randomState) - 0.5);
+        }
+        positions.swap(finePositions);
+        if(!refine(fine, positions, 50, 1., startTime, timeout)) {
+            positions.clear();
+            return false;
+        }
+    }
+
+    CZI_ASSERT(positions.size() == vertexCount);
+    return true;
+}
+
+
+
+void ForceDirectedLayout::createLevel(
+    uint64_t vertexCount,
+    const vector< pair<uint32_t, uint32_t> >& edges,
+    const vector<double>& mass,
+    Level& level)
+{
+    CZI_ASSERT(mass.size() == vertexCount);
+    level.mass = mass;
+
+    // Count neighbors, ignoring self-loops.
+    level.adjacencyBegin.assign(vertexCount + 1, 0);
+    for(const auto& edge: edges) {
+        if(edge.first != edge.second) {
+            ++level.adjacencyBegin[edge.first + 1];
+            ++level.adjacencyBegin[edge.second + 1];
+        }
+    }
+    for(uint64_t v=0; v<vertexCount; v++) {
+        level.adjacencyBegin[v+1] += level.adjacencyBegin[v];
+    }
+
+    // Store the neighbors.
+    level.adjacency.resize(level.adjacencyBegin[vertexCount]);
+    vector<uint32_t> next(level.adjacencyBegin.begin(), level.adjacencyBegin.end()-1);
+    for(const auto& edge: edges) {
+        if(edge.first != edge.second) {
+            level.adjacency[next[edge.first]++] = edge.second;
+            level.adjacency[next[edge.second]++] = edge.first;
+        }
+    }
+
+    // Remove duplicate neighbors.
+    uint32_t newEnd = 0;
+    for(uint64_t v=0; v<vertexCount; v++) {
+        const auto begin = level.adjacency.begin() + level.adjacencyBegin[v];
+        const auto end = level.adjacency.begin() + level.adjacencyBegin[v+1];
+        sort(begin, end);
+        const auto uniqueEnd = unique(begin, end);
+        level.adjacencyBegin[v] = newEnd;
+        for(auto it=begin; it!=uniqueEnd; ++it) {
+            level.adjacency[newEnd++] = *it;
+        }
+    }
+    level.adjacencyBegin[vertexCount] = newEnd;
+    level.adjacency.resize(newEnd);
+}
+
+
+
+// Coarsen a level by collapsing a maximal matching.
+// Vertices are visited in random order, and each unmatched vertex
+// is matched with its unmatched neighbor of smallest mass,
+// which keeps coarse vertices balanced.
+// Returns false if the coarse level would not be much smaller.
+bool ForceDirectedLayout::coarsen(Level& fine, Level& coarse, uint32_t& randomState)
+{
+    const uint64_t n = fine.vertexCount();
+    const uint32_t unmatched = std::numeric_limits<uint32_t>::max();
+
+    // Random visiting order.
+    vector<uint32_t> order(n);
+    for(uint32_t v=0; v<n; v++) {
+        order[v] = v;
+    }
+    for(uint64_t i=n-1; i>0; i--) {
+        swap(order[i], order[random(randomState) % (i+1)]);
+    }
+
+    // Find the matching.
+    fine.coarseVertex.assign(n, unmatched);
+    vector<double> coarseMass;
+    for(const uint32_t v0: order) {
+        if(fine.coarseVertex[v0] != unmatched) {
+            continue;
+        }
+        uint32_t v1 = unmatched;
+        for(uint32_t i=fine.adjacencyBegin[v0]; i!=fine.adjacencyBegin[v0+1]; i++) {
+            const uint32_t v = fine.adjacency[i];
+            if(fine.coarseVertex[v] == unmatched &&
+                (v1 == unmatched || fine.mass[v] < fine.mass[v1])) {
+                v1 = v;
+            }
+        }
+        const uint32_t c = uint32_t(coarseMass.size());
+        fine.coarseVertex[v0] = c;
+        coarseMass.push_back(fine.mass[v0]);
+        if(v1 != unmatched) {
+            fine.coarseVertex[v1] = c;
+            coarseMass.back() += fine.mass[v1];
+        }
+    }
+    if(double(coarseMass.size()) > 0.8 * double(n)) {
+        fine.coarseVertex.clear();
+        return false;
+    }
+
+    // Create the coarse edges.
+    vector< pair<uint32_t, uint32_t> > coarseEdges;
+    for(uint32_t v0=0; v0<n; v0++) {
+        const uint32_t c0 = fine.coarseVertex[v0];
+        for(uint32_t i=fine.adjacencyBegin[v0]; i!=fine.adjacencyBegin[v0+1]; i++) {
+            const uint32_t v1 = fine.adjacency[i];
+            const uint32_t c1 = fine.coarseVertex[v1];
+            if(v0 < v1 && c0 != c1) {
+                coarseEdges.push_back(make_pair(c0, c1));
+            }
+        }
+    }
+    createLevel(coarseMass.size(), coarseEdges, coarseMass, coarse);
+    return true;
+}
+
+
+
+// Force-directed refinement using the spring-electrical model
+// with natural length K=1 and the adaptive step length of Hu (2005).
+bool ForceDirectedLayout::refine(
+    const Level& level,
+    vector<Point>& positions,
+    uint64_t iterationCount,
+    double initialStep,
+    steady_clock::time_point startTime,
+    double timeout)
+{
+    const uint64_t n = level.vertexCount();
+    const double C = 0.2;
+    const double t = 0.9;
+
+    double step = initialStep;
+    double energy = std::numeric_limits<double>::max();
+    uint64_t progress = 0;
+    QuadTree quadTree;
+    vector<Point> forces(n);
+    vector<uint32_t> stack;
+
+    for(uint64_t iteration=0; iteration<iterationCount; iteration++) {
+        if(timeout>0. && seconds(steady_clock::now() - startTime) > timeout) {
+            return false;
+        }
+
+        // Compute the forces.
+        quadTree.create(positions, level.mass);
+        for(uint32_t v=0; v<n; v++) {
+            Point& force = forces[v];
+            force = {0., 0.};
+
+            // Repulsive forces.
+            quadTree.addRepulsiveForce(v, positions, level.mass, force, stack);
+            force[0] *= C;
+            force[1] *= C;
+
+            // Attractive forces.
+            const Point& p = positions[v];
+            for(uint32_t i=level.adjacencyBegin[v]; i!=level.adjacencyBegin[v+1]; i++) {
+                const Point& q = positions[level.adjacency[i]];
+                const double dx = q[0] - p[0];
+                const double dy = q[1] - p[1];
+                const double d = std::sqrt(dx*dx + dy*dy);
+                force[0] += dx * d;
+                force[1] += dy * d;
+            }
+        }
+
+        // Move each vertex by step in the direction of its force.
+        const double oldEnergy = energy;
+        energy = 0.;
+        for(uint32_t v=0; v<n; v++) {
+            const Point& force = forces[v];
+            const double f2 = force[0]*force[0] + force[1]*force[1];
+            energy += f2;
+            if(f2 > 0.) {
+                const double f = std::sqrt(f2);
+                positions[v][0] += step * force[0] / f;
+                positions[v][1] += step * force[1] / f;
+            }
+        }
+
+        // Update the step length.
+        if(energy < oldEnergy) {
+            ++progress;
+            if(progress >= 5) {
+                progress = 0;
+                step /= t;
+            }
+        } else {
+            progress = 0;
+            step *= t;
+        }
+    }
+    return true;
+}
+
+
+
+void ForceDirectedLayout::QuadTree::create(
+    const vector<Point>& positions,
+    const vector<double>& mass)
+{
+    nodes.clear();
+    if(positions.empty()) {
+        return;
+    }
+
+    // Find the bounding square.
+    double xMin = positions.front()[0];
+    double xMax = xMin;
+    double yMin = positions.front()[1];
+    double yMax = yMin;
+    for(const Point& p: positions) {
+        xMin = min(xMin, p[0]);
+        xMax = max(xMax, p[0]);
+        yMin = min(yMin, p[1]);
+        yMax = max(yMax, p[1]);
+    }
+    const double halfSize = 0.5 * max(max(xMax - xMin, yMax - yMin), 1.e-6) * 1.0001;
+    createNode({0.5*(xMin + xMax), 0.5*(yMin + yMax)}, halfSize);
+
+    for(uint32_t v=0; v<positions.size(); v++) {
+        insert(0, v, positions[v], mass[v], 0);
+    }
+}
+
+
+
+uint32_t ForceDirectedLayout::QuadTree::createNode(const Point& center, double halfSize)
+{
+    Node node;
+    node.center = center;
+    node.halfSize = halfSize;
+    node.centerOfMass = {0., 0.};
+    node.mass = 0.;
+    node.children.fill(noNode);
+    node.vertex = noVertex;
+    nodes.push_back(node);
+    return uint32_t(nodes.size() - 1);
+}
+
+
+
+// Insert a vertex in the subtree rooted at the given node.
+// Note that createNode can reallocate the nodes vector,
+// so we don't keep references to nodes across calls to it.
+void ForceDirectedLayout::QuadTree::insert(
+    uint32_t nodeIndex,
+    uint32_t v,
+    const Point& p,
+    double m,
+    uint64_t depth)
+{
+    if(nodes[nodeIndex].children[0] == noNode) {
+        Node& node = nodes[nodeIndex];
+
+        // If this is an empty leaf, store the vertex here.
+        if(node.mass == 0.) {
+            node.vertex = v;
+            node.centerOfMass = p;
+            node.mass = m;
+            return;
+        }
+
+        // If we are too deep, treat all vertices in this leaf as a single body.
+        if(depth == maxDepth) {
+            addMass(node, p, m);
+            node.vertex = noVertex;
+            return;
+        }
+
+        // Split this leaf and move its vertex to a child.
+        // The mass of this node already includes it.
+        const uint32_t oldVertex = node.vertex;
+        const Point oldPosition = node.centerOfMass;
+        const double oldMass = node.mass;
+        const Point center = node.center;
+        const double childHalfSize = 0.5 * node.halfSize;
+        for(uint64_t i=0; i<4; i++) {
+            const uint32_t child = createNode({
+                center[0] + ((i & 1) ? childHalfSize : -childHalfSize),
+                center[1] + ((i & 2) ? childHalfSize : -childHalfSize)},
+                childHalfSize);
+            nodes[nodeIndex].children[i] = child;
+        }
+        nodes[nodeIndex].vertex = noVertex;
+        insert(nodes[nodeIndex].children[quadrant(nodeIndex, oldPosition)],
+            oldVertex, oldPosition, oldMass, depth + 1);
+    }
+
+    // Add the new vertex to this node and to the appropriate child.
+    addMass(nodes[nodeIndex], p, m);
+    insert(nodes[nodeIndex].children[quadrant(nodeIndex, p)], v, p, m, depth + 1);
+}
+
+
+
+void ForceDirectedLayout::QuadTree::addMass(Node& node, const Point& p, double m)
+{
+    const double newMass = node.mass + m;
+    node.centerOfMass[0] = (node.centerOfMass[0] * node.mass + p[0] * m) / newMass;
+    node.centerOfMass[1] = (node.centerOfMass[1] * node.mass + p[1] * m) / newMass;
+    node.mass = newMass;
+}
+
+
+
+// The child of a node that contains a given point.
+uint64_t ForceDirectedLayout::QuadTree::quadrant(uint32_t nodeIndex, const Point& p) const
+{
+    const Point& center = nodes[nodeIndex].center;
+    return
+        ((p[0] >= center[0]) ? 1 : 0) +
+        ((p[1] >= center[1]) ? 2 : 0);
+}
+
+
+
+// Add the repulsive force on vertex v,
+// with magnitude mass(v) * mass(other) / distance.
+void ForceDirectedLayout::QuadTree::addRepulsiveForce(
+    uint32_t v,
+    const vector<Point>& positions,
+    const vector<double>& mass,
+    Point& force,
+    vector<uint32_t>& stack) const
+{
+    if(nodes.empty()) {
+        return;
+    }
+    const Point& p = positions[v];
+    const double m = mass[v];
+
+    stack.clear();
+    stack.push_back(0);
+    while(!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        if(node.mass == 0.) {
+            continue;
+        }
+        const bool isLeaf = (node.children[0] == noNode);
+        if(isLeaf && node.vertex == v) {
+            continue;
+        }
+        const double dx = p[0] - node.centerOfMass[0];
+        const double dy = p[1] - node.centerOfMass[1];
+        const double d2 = dx*dx + dy*dy;
+        if(isLeaf || (2. * node.halfSize) < theta * std::sqrt(d2)) {
+            if(d2 > 1.e-12) {
+                const double factor = m * node.mass / d2;
+                force[0] += factor * dx;
+                force[1] += factor * dy;
+            }
+        } else {
+            for(const uint32_t child: node.children) {
+                stack.push_back(child);
+            }
+        }
+    }
+}
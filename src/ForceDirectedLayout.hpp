@@ -0,0 +1,157 @@
+#ifndef CZI_SHASTA_FORCE_DIRECTED_LAYOUT_HPP
+#define CZI_SHASTA_FORCE_DIRECTED_LAYOUT_HPP
+
+/*******************************************************************************
+
+Class ForceDirectedLayout computes a two-dimensional layout of a graph
+without using Graphviz. It is used by the http server to display
+large local graphs, for which Graphviz can take a long time.
+
+The layout uses the multilevel spring-electrical model
+(Y. Hu, Efficient and high quality force-directed graph drawing,
+The Mathematica Journal 10, 37-71, 2005):
+- The graph is repeatedly coarsened by collapsing a maximal matching
+  of its edges, until it has few vertices or it no longer shrinks.
+- The coarsest graph is laid out starting from random positions.
+- Going back from coarse to fine levels, each vertex starts
+  at the position of the coarse vertex that contains it,
+  and the layout is refined by a few force-directed iterations.
+- Repulsive forces are approximated using a Barnes-Hut quadtree,
+  so each iteration costs O(n log n) instead of O(n^2).
+
+Edge directions are ignored. The layout is deterministic
+for a given graph and seed.
+
+*******************************************************************************/
+
+// Standard library.
+#include "array.hpp"
+#include "chrono.hpp"
+#include "cstdint.hpp"
+#include <limits>
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class ForceDirectedLayout;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::ForceDirectedLayout {
+public:
+
+    using Point = array<double, 2>;
+
+    // Compute the layout of a graph with the given number of vertices
+    // and edges, each given as a pair of vertex indexes.
+    // Returns false if the timeout was exceeded
+    // (positions are then left empty).
+    // The natural edge length is 1.
+    static bool compute(
+        uint64_t vertexCount,
+        const vector< pair<uint32_t, uint32_t> >& edges,
+        vector<Point>& positions,
+        double timeout,             // Or 0 for no timeout.
+        uint32_t seed = 231);
+
+private:
+
+    // One level of the multilevel hierarchy.
+    class Level {
+    public:
+
+        // Adjacency lists, in CSR format.
+        // The neighbors of vertex v are in adjacency[adjacencyBegin[v], adjacencyBegin[v+1]).
+        vector<uint32_t> adjacencyBegin;
+        vector<uint32_t> adjacency;
+
+        // The number of vertices of the finest level
+        // contained in each vertex.
+        vector<double> mass;
+
+        // For each vertex, the vertex of the next coarser level that contains it.
+        vector<uint32_t> coarseVertex;
+
+        uint64_t vertexCount() const
+        {
+            return mass.size();
+        }
+    };
+    static void createLevel(
+        uint64_t vertexCount,
+        const vector< pair<uint32_t, uint32_t> >& edges,
+        const vector<double>& mass,
+        Level&);
+    static bool coarsen(Level& fine, Level& coarse, uint32_t& randomState);
+
+    // Force-directed refinement of the layout of one level.
+    // Returns false if the timeout was exceeded.
+    static bool refine(
+        const Level&,
+        vector<Point>& positions,
+        uint64_t iterationCount,
+        double initialStep,
+        steady_clock::time_point startTime,
+        double timeout);
+
+    // Barnes-Hut quadtree used to approximate repulsive forces.
+    class QuadTree {
+    public:
+        void create(const vector<Point>&, const vector<double>& mass);
+
+        // Add to force the repulsive force on vertex v.
+        // The last argument is a work area.
+        void addRepulsiveForce(
+            uint32_t v,
+            const vector<Point>&,
+            const vector<double>& mass,
+            Point& force,
+            vector<uint32_t>& stack) const;
+
+    private:
+        class Node {
+        public:
+            Point center;   // Center of the square.
+            double halfSize;
+            Point centerOfMass;
+            double mass;
+
+            // The children, or noNode if this is a leaf.
+            array<uint32_t, 4> children;
+
+            // For a leaf, the vertex it contains, or noVertex if empty.
+            // If more than one vertex ended up in a leaf at maximum depth,
+            // this is noVertex and the leaf is treated as a single body.
+            uint32_t vertex;
+        };
+        vector<Node> nodes;
+        static const uint32_t noNode = std::numeric_limits<uint32_t>::max();
+        static const uint32_t noVertex = std::numeric_limits<uint32_t>::max();
+        static const uint64_t maxDepth = 40;
+        uint32_t createNode(const Point& center, double halfSize);
+        void insert(uint32_t nodeIndex, uint32_t v, const Point&, double mass, uint64_t depth);
+        static void addMass(Node&, const Point&, double mass);
+        uint64_t quadrant(uint32_t nodeIndex, const Point&) const;
+    };
+
+    // The Barnes-Hut opening criterion.
+    static constexpr double theta = 1.2;
+
+    // Simple deterministic random number generator.
+    static uint32_t random(uint32_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    static double randomDouble(uint32_t& state)
+    {
+        return double(random(state)) / 4294967296.;
+    }
+};
+
+#endif
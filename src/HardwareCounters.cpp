@@ -0,0 +1,225 @@
+// Shasta.
+#include "HardwareCounters.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include "iostream.hpp"
+#include "memory.hpp"
+
+// Linux.
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+
+
+bool HardwareCounters::enabled = false;
+bool HardwareCounters::isAvailable = true;
+HardwareCounters::Values HardwareCounters::totals;
+std::mutex HardwareCounters::mutex;
+vector<HardwareCounters::Loop> HardwareCounters::loops;
+
+
+
+void HardwareCounters::setEnabled(bool enabledArgument)
+{
+#ifdef __linux__
+    enabled = enabledArgument;
+#else
+    if(enabledArgument) {
+        cout << "Hardware counters are only supported on Linux." << endl;
+    }
+#endif
+}
+
+
+
+void HardwareCounters::Values::atomicAdd(const Values& that)
+{
+    __sync_fetch_and_add(&cycles, that.cycles);
+    __sync_fetch_and_add(&instructions, that.instructions);
+    __sync_fetch_and_add(&llcMisses, that.llcMisses);
+    __sync_fetch_and_add(&dtlbMisses, that.dtlbMisses);
+}
+
+
+
+HardwareCounters::Values HardwareCounters::Values::atomicRead() const
+{
+    Values& that = const_cast<Values&>(*this);
+    Values values;
+    values.cycles = __sync_fetch_and_add(&that.cycles, 0);
+    values.instructions = __sync_fetch_and_add(&that.instructions, 0);
+    values.llcMisses = __sync_fetch_and_add(&that.llcMisses, 0);
+    values.dtlbMisses = __sync_fetch_and_add(&that.dtlbMisses, 0);
+    return values;
+}
+
+
+
+HardwareCounters::Values HardwareCounters::Values::operator-(const Values& that) const
+{
+    Values values;
+    values.cycles = cycles - that.cycles;
+    values.instructions = instructions - that.instructions;
+    values.llcMisses = llcMisses - that.llcMisses;
+    values.dtlbMisses = dtlbMisses - that.dtlbMisses;
+    return values;
+}
+
+
+
+HardwareCounters::Values& HardwareCounters::Values::operator+=(const Values& that)
+{
+    cycles += that.cycles;
+    instructions += that.instructions;
+    llcMisses += that.llcMisses;
+    dtlbMisses += that.dtlbMisses;
+    return *this;
+}
+
+
+
+double HardwareCounters::Values::instructionsPerCycle() const
+{
+    if(cycles == 0) {
+        return 0.;
+    }
+    return double(instructions) / double(cycles);
+}
+
+
+
+double HardwareCounters::Values::perThousandInstructions(uint64_t count, uint64_t instructions)
+{
+    if(instructions == 0) {
+        return 0.;
+    }
+    return 1000. * double(count) / double(instructions);
+}
+
+
+
+int HardwareCounters::open(uint32_t type, uint64_t config)
+{
+#ifdef __linux__
+    perf_event_attr attributes;
+    std::memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = type;
+    attributes.config = config;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+
+    // Count the calling thread, on any cpu.
+    return int(::syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+#else
+    return -1;
+#endif
+}
+
+
+
+HardwareCounters::ThreadCounters::ThreadCounters(Values& values) :
+    values(values)
+{
+    fileDescriptors.fill(-1);
+    if(!enabled || !isAvailable) {
+        return;
+    }
+
+#ifdef __linux__
+    const uint64_t cacheReadMiss =
+        (uint64_t(PERF_COUNT_HW_CACHE_OP_READ) << 8) |
+        (uint64_t(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16);
+    fileDescriptors[0] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    if(fileDescriptors[0] == -1) {
+        // Write a message only once.
+        if(__sync_bool_compare_and_swap(&isAvailable, true, false)) {
+            cout << "Hardware counters are not available: perf_event_open failed: " <<
+                ::strerror(errno) << endl;
+        }
+        return;
+    }
+    fileDescriptors[1] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fileDescriptors[2] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | cacheReadMiss);
+    fileDescriptors[3] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | cacheReadMiss);
+#endif
+}
+
+
+
+HardwareCounters::ThreadCounters::~ThreadCounters()
+{
+    // Counters that could not be opened count as zero.
+    array<uint64_t, counterCount> counts;
+    for(size_t i=0; i<counterCount; i++) {
+        counts[i] = 0;
+        const int fileDescriptor = fileDescriptors[i];
+        if(fileDescriptor != -1) {
+            if(::read(fileDescriptor, &counts[i], sizeof(counts[i])) != ssize_t(sizeof(counts[i]))) {
+                counts[i] = 0;
+            }
+            ::close(fileDescriptor);
+        }
+    }
+    if(fileDescriptors[0] == -1) {
+        return;
+    }
+
+    Values threadValues;
+    threadValues.cycles = counts[0];
+    threadValues.instructions = counts[1];
+    threadValues.llcMisses = counts[2];
+    threadValues.dtlbMisses = counts[3];
+    values.atomicAdd(threadValues);
+    totals.atomicAdd(threadValues);
+}
+
+
+
+void HardwareCounters::addLoop(
+    const char* mangledObjectType,
+    size_t threadCount,
+    double elapsedSeconds,
+    const Values& values)
+{
+    Loop loop;
+    int status = 0;
+    const std::unique_ptr<char, void(*)(void*)> demangled(
+        abi::__cxa_demangle(mangledObjectType, 0, 0, &status), std::free);
+    loop.objectType = (status == 0) ? demangled.get() : mangledObjectType;
+    loop.threadCount = threadCount;
+    loop.elapsedSeconds = elapsedSeconds;
+    loop.values = values;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    loops.push_back(loop);
+}
+
+
+
+uint64_t HardwareCounters::getLoopCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return loops.size();
+}
+
+
+
+vector<HardwareCounters::Loop> HardwareCounters::getLoops(uint64_t begin)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(begin >= loops.size()) {
+        return vector<Loop>();
+    }
+    return vector<Loop>(loops.begin() + int64_t(begin), loops.end());
+}
@@ -0,0 +1,149 @@
+#ifndef CZI_SHASTA_HARDWARE_COUNTERS_HPP
+#define CZI_SHASTA_HARDWARE_COUNTERS_HPP
+
+/*******************************************************************************
+
+Class HardwareCounters provides opt-in instrumentation to find out
+where time goes in a slow stage without attaching perf by hand.
+
+Hardware performance counters
+-----------------------------
+When enabled (setEnabled(true), or --hardwareCounters in the executable),
+each MultithreadedObject pool thread counts, using perf_event_open,
+cpu cycles, instructions, last level cache misses and data TLB misses
+while it runs the thread function passed to runThreads or startThreads.
+Only user space events of the thread itself are counted,
+which works with the default setting of
+/proc/sys/kernel/perf_event_paranoid (2) and does not require root privilege.
+
+The counts are summed over the threads of each invocation
+of runThreads/startThreads and recorded as a Loop,
+together with the MultithreadedObject type, thread count and elapsed time.
+PerformanceReport::StageTimer reports, for each stage,
+the total counts and the loops that ran during the stage.
+From these, the performance report computes instructions per cycle (IPC)
+and misses per thousand instructions (MPKI).
+Work done outside MultithreadedObject threads is not counted.
+
+If perf_event_open is not available (for example in a container
+that does not allow it), a message is written once and the counts are zero.
+When disabled (the default), the only cost is one test per thread function.
+
+USDT probes
+-----------
+If <sys/sdt.h> is available at compile time, statically defined probes
+(no-ops unless attached) mark the beginning and end of each stage
+(set by Progress) and of each thread function. They can be used with
+perf, for example:
+    perf buildid-cache --add shastaDynamic.so
+    perf probe sdt_shasta:stage_begin
+    perf record -e sdt_shasta:stage_begin -e sdt_shasta:stage_end -a ...
+Probes: stage_begin(name), stage_end(name),
+thread_function_begin(threadId), thread_function_end(threadId).
+
+*******************************************************************************/
+
+// Standard library.
+#include "array.hpp"
+#include "cstddef.hpp"
+#include "cstdint.hpp"
+#include <mutex>
+#include "string.hpp"
+#include "vector.hpp"
+
+// USDT probes.
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CZI_SHASTA_PROBE1(name, arg) DTRACE_PROBE1(shasta, name, arg)
+#endif
+#endif
+#ifndef CZI_SHASTA_PROBE1
+#define CZI_SHASTA_PROBE1(name, arg)
+#endif
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class HardwareCounters;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::HardwareCounters {
+public:
+
+    static void setEnabled(bool);
+    static bool isEnabled()
+    {
+        return enabled;
+    }
+
+    // The counts we use.
+    class Values {
+    public:
+        uint64_t cycles = 0;
+        uint64_t instructions = 0;
+        uint64_t llcMisses = 0;     // Last level cache misses.
+        uint64_t dtlbMisses = 0;    // Data TLB misses.
+
+        void atomicAdd(const Values&);
+        Values atomicRead() const;
+        Values operator-(const Values&) const;
+        Values& operator+=(const Values&);
+
+        // Instructions per cycle, or 0 if unknown.
+        double instructionsPerCycle() const;
+
+        // Misses per thousand instructions, or 0 if unknown.
+        static double perThousandInstructions(uint64_t count, uint64_t instructions);
+    };
+
+    // Count the events of the calling thread
+    // for the lifetime of this object, if enabled.
+    // The counts are added to the given Values (atomically)
+    // and to the process totals.
+    class ThreadCounters {
+    public:
+        ThreadCounters(Values&);
+        ~ThreadCounters();
+    private:
+        Values& values;
+        static const size_t counterCount = 4;
+        array<int, counterCount> fileDescriptors;
+    };
+
+    // The counts summed over all threads since the beginning of the process.
+    static Values getTotals()
+    {
+        return totals.atomicRead();
+    }
+
+    // One invocation of MultithreadedObject::runThreads or startThreads.
+    class Loop {
+    public:
+        string objectType;  // The MultithreadedObject type, demangled.
+        size_t threadCount = 0;
+        double elapsedSeconds = 0.;
+        Values values;
+    };
+    static void addLoop(const char* mangledObjectType, size_t threadCount,
+        double elapsedSeconds, const Values&);
+
+    // Get the loops recorded so far, starting at loop number begin.
+    static uint64_t getLoopCount();
+    static vector<Loop> getLoops(uint64_t begin);
+
+private:
+    static bool enabled;
+    static bool isAvailable;
+    static Values totals;
+    static std::mutex mutex;
+    static vector<Loop> loops;
+
+    // Open one counter for the calling thread.
+    // Returns -1 if it could not be opened.
+    static int open(uint32_t type, uint64_t config);
+};
+
+#endif
@@ -2,12 +2,14 @@
 #define CZI_SHASTA_HISTOGRAM_HPP
 
 #include "algorithm.hpp"
+#include "cstdint.hpp"
 #include <numeric>
 #include "vector.hpp"
 
 namespace ChanZuckerberg {
     namespace shasta {
         class Histogram;
+        class ShardedHistogram;
     }
 }
 
@@ -42,6 +44,79 @@ public:
     {
         return *std::max_element(begin(), end());
     }
+
+    // Return the histogram smoothed by a moving average
+    // over 2*halfWidth+1 positions (fewer at the ends).
+    vector<double> smoothed(size_t halfWidth) const
+    {
+        const size_t n = size();
+        vector<double> s(n, 0.);
+        for(size_t i=0; i<n; i++) {
+            const size_t b = (i > halfWidth) ? i - halfWidth : 0;
+            const size_t e = min(n, i + halfWidth + 1);
+            s[i] = double(std::accumulate(begin() + int64_t(b), begin() + int64_t(e), 0ULL)) /
+                double(e - b);
+        }
+        return s;
+    }
+
+    // Return the first valley of a (usually smoothed) histogram
+    // at or after position begin: the first position
+    // after which the histogram increases.
+    // Returns the size of the histogram if there is none.
+    static size_t findValley(const vector<double>& v, size_t begin)
+    {
+        for(size_t i=begin; i+1<v.size(); i++) {
+            if(v[i+1] > v[i]) {
+                return i;
+            }
+        }
+        return v.size();
+    }
+};
+
+
+
+// A histogram that many threads can increment concurrently
+// without locks or atomic operations.
+// Each thread increments its own shard, and merge adds up
+// the shards into a Histogram. Shards are padded
+// so they don't share cache lines.
+// Values greater than maxValue are counted at maxValue.
+class ChanZuckerberg::shasta::ShardedHistogram {
+public:
+
+    ShardedHistogram(size_t shardCount = 0, size_t maxValue = 0)
+    {
+        reset(shardCount, maxValue);
+    }
+
+    void reset(size_t shardCount, size_t maxValueArgument)
+    {
+        maxValue = maxValueArgument;
+        stride = ((maxValue + 1 + 7) / 8 + 1) * 8;
+        counts.assign(shardCount * stride, 0);
+    }
+
+    void increment(size_t shardId, size_t value)
+    {
+        ++counts[shardId * stride + min(value, maxValue)];
+    }
+
+    void merge(Histogram& histogram) const
+    {
+        histogram.assign(maxValue + 1, 0);
+        for(size_t offset=0; offset<counts.size(); offset+=stride) {
+            for(size_t value=0; value<=maxValue; value++) {
+                histogram[value] += counts[offset + value];
+            }
+        }
+    }
+
+private:
+    size_t maxValue;
+    size_t stride;
+    vector<uint64_t> counts;
 };
 
 
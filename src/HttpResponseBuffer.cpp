@@ -0,0 +1,325 @@
+#ifndef SHASTA_STATIC_EXECUTABLE
+
+// Implementation of class HttpResponseBuffer - see HttpResponseBuffer.hpp for more information.
+
+#include "HttpResponseBuffer.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+#include <boost/algorithm/string.hpp>
+
+#include "iostream.hpp"
+#include "stdexcept.hpp"
+
+
+
+// Choose the content encoding to use, given the value of
+// the Accept-Encoding header of the request.
+// Encodings with q=0 are not acceptable.
+// We prefer gzip over deflate, because some old browsers
+// interpret deflate as raw deflate without the zlib wrapper.
+HttpResponseBuffer::ContentEncoding HttpResponseBuffer::negotiateContentEncoding(
+    const string& acceptEncoding)
+{
+    bool gzipIsAcceptable = false;
+    bool deflateIsAcceptable = false;
+
+    vector<string> codings;
+    boost::algorithm::split(codings, acceptEncoding, boost::algorithm::is_any_of(","));
+    for(const string& coding: codings) {
+        vector<string> tokens;
+        boost::algorithm::split(tokens, coding, boost::algorithm::is_any_of(";"));
+        string name = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(tokens.front()));
+
+        // Check for q=0.
+        bool isAcceptable = true;
+        for(size_t i=1; i<tokens.size(); i++) {
+            const string parameter = boost::algorithm::trim_copy(tokens[i]);
+            if(parameter.size()>2 && (parameter[0]=='q' || parameter[0]=='Q') && parameter[1]=='=') {
+                try {
+                    isAcceptable = std::stod(parameter.substr(2)) > 0.;
+                } catch(...) {
+                    isAcceptable = false;
+                }
+            }
+        }
+        if(!isAcceptable) {
+            continue;
+        }
+
+        if(name == "gzip" || name == "x-gzip" || name == "*") {
+            gzipIsAcceptable = true;
+        } else if(name == "deflate") {
+            deflateIsAcceptable = true;
+        }
+    }
+
+    if(gzipIsAcceptable) {
+        return ContentEncoding::gzip;
+    } else if(deflateIsAcceptable) {
+        return ContentEncoding::deflate;
+    } else {
+        return ContentEncoding::identity;
+    }
+}
+
+
+
+const char* HttpResponseBuffer::contentEncodingName(ContentEncoding contentEncoding)
+{
+    switch(contentEncoding) {
+    case ContentEncoding::identity:
+        return "identity";
+    case ContentEncoding::gzip:
+        return "gzip";
+    case ContentEncoding::deflate:
+        return "deflate";
+    default:
+        CZI_ASSERT(0);
+    }
+}
+
+
+
+HttpResponseBuffer::HttpResponseBuffer(
+    ostream& s,
+    ContentEncoding contentEncoding,
+    bool useChunkedTransferEncoding,
+    bool keepAlive) :
+    s(s),
+    contentEncoding(contentEncoding),
+    useChunkedTransferEncoding(useChunkedTransferEncoding),
+    keepAlive(keepAlive),
+    inputBuffer(bufferSize)
+{
+    // Without chunked transfer encoding, the end of the body
+    // is indicated by closing the connection.
+    CZI_ASSERT(useChunkedTransferEncoding || !keepAlive);
+
+    setp(inputBuffer.data(), inputBuffer.data() + inputBuffer.size());
+}
+
+
+
+HttpResponseBuffer::~HttpResponseBuffer()
+{
+    if(compress) {
+        deflateEnd(&zStream);
+    }
+}
+
+
+
+HttpResponseBuffer::int_type HttpResponseBuffer::overflow(int_type c)
+{
+    drain();
+    if(!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+
+
+int HttpResponseBuffer::sync()
+{
+    drain();
+    return 0;
+}
+
+
+
+// Send to the connection the characters in the input buffer.
+void HttpResponseBuffer::drain()
+{
+    const char* p = pbase();
+    const char* end = pptr();
+    setp(inputBuffer.data(), inputBuffer.data() + inputBuffer.size());
+
+    // Look for the end of the headers.
+    for(; p!=end && !headersAreComplete; ++p) {
+        processHeaderCharacter(*p);
+    }
+
+    // The rest is body.
+    if(p != end) {
+        sendBody(p, size_t(end - p));
+    }
+}
+
+
+
+// The headers end with an empty line.
+// If the derived class does not write any headers,
+// the response starts with the empty line.
+void HttpResponseBuffer::processHeaderCharacter(char c)
+{
+    headers.push_back(c);
+    if(c != '\n') {
+        return;
+    }
+    if(headers == "\r\n" ||
+        (headers.size() >= 4 && headers.compare(headers.size()-4, 4, "\r\n\r\n") == 0)) {
+        headers.resize(headers.size() - 2);
+        sendHeaders();
+    }
+}
+
+
+
+void HttpResponseBuffer::sendHeaders()
+{
+    headersAreComplete = true;
+
+    // Find the Content-Type header, if any.
+    string contentType;
+    vector<string> lines;
+    boost::algorithm::split(lines, headers, boost::algorithm::is_any_of("\n"));
+    const string contentTypePrefix = "content-type:";
+    for(const string& line: lines) {
+        if(boost::algorithm::istarts_with(line, contentTypePrefix)) {
+            contentType = boost::algorithm::trim_copy(line.substr(contentTypePrefix.size()));
+        }
+    }
+
+    // Decide whether to compress.
+    if(contentEncoding != ContentEncoding::identity && isCompressible(contentType)) {
+        zStream.zalloc = Z_NULL;
+        zStream.zfree = Z_NULL;
+        zStream.opaque = Z_NULL;
+
+        // Window bits 15 + 16 writes a gzip wrapper,
+        // 15 writes the zlib wrapper used by deflate content encoding.
+        // We use the fastest compression level: html and svg responses
+        // are highly redundant and compress well even at this level,
+        // and the time to compress large responses matters.
+        const int windowBits = (contentEncoding == ContentEncoding::gzip) ? 15 + 16 : 15;
+        if(deflateInit2(&zStream, Z_BEST_SPEED, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw runtime_error("Error initializing zlib for http response compression.");
+        }
+        compress = true;
+        outputBuffer.resize(bufferSize);
+    }
+
+    s << "HTTP/1.1 200 OK\r\n";
+    s << headers;
+    if(compress) {
+        s << "Content-Encoding: " << contentEncodingName(contentEncoding) << "\r\n";
+    }
+    s << "Vary: Accept-Encoding\r\n";
+    if(useChunkedTransferEncoding) {
+        s << "Transfer-Encoding: chunked\r\n";
+    }
+    s << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n";
+    s << "\r\n";
+}
+
+
+
+void HttpResponseBuffer::sendBody(const char* p, size_t n)
+{
+    bodyByteCount += n;
+    if(compress) {
+        compressBody(p, n, Z_NO_FLUSH);
+    } else {
+        sendChunk(p, n);
+    }
+}
+
+
+
+// Compress and send full output buffers as chunks.
+// With Z_FINISH, also send what is left in the output buffer.
+void HttpResponseBuffer::compressBody(const char* p, size_t n, int flush)
+{
+    zStream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(p));
+    zStream.avail_in = uInt(n);
+    while(true) {
+        zStream.next_out = reinterpret_cast<Bytef*>(outputBuffer.data() + outputSize);
+        zStream.avail_out = uInt(outputBuffer.size() - outputSize);
+        const int status = deflate(&zStream, flush);
+        if(status == Z_STREAM_ERROR) {
+            throw runtime_error("Error compressing http response.");
+        }
+        outputSize = outputBuffer.size() - zStream.avail_out;
+        if(outputSize == outputBuffer.size()) {
+            sendChunk(outputBuffer.data(), outputSize);
+            outputSize = 0;
+            continue;
+        }
+
+        // The output buffer is not full, so deflate consumed
+        // all the input. With Z_FINISH, the compressed stream is complete.
+        CZI_ASSERT(zStream.avail_in == 0);
+        if(flush == Z_FINISH) {
+            CZI_ASSERT(status == Z_STREAM_END);
+            sendChunk(outputBuffer.data(), outputSize);
+            outputSize = 0;
+        }
+        break;
+    }
+}
+
+
+
+void HttpResponseBuffer::sendChunk(const char* p, size_t n)
+{
+    if(n == 0) {
+        // An empty chunk would terminate the body.
+        return;
+    }
+    if(useChunkedTransferEncoding) {
+        s << std::hex << n << std::dec << "\r\n";
+    }
+    s.write(p, std::streamsize(n));
+    if(useChunkedTransferEncoding) {
+        s << "\r\n";
+    }
+    sentByteCount += n;
+}
+
+
+
+void HttpResponseBuffer::finish()
+{
+    CZI_ASSERT(!finished);
+    finished = true;
+
+    drain();
+
+    // If the derived class never terminated the headers,
+    // the response has an empty body.
+    if(!headersAreComplete) {
+        sendHeaders();
+    }
+
+    if(compress) {
+        compressBody(0, 0, Z_FINISH);
+    }
+    if(useChunkedTransferEncoding) {
+        s << "0\r\n\r\n";
+    }
+    s.flush();
+}
+
+
+
+// Return true if a Content-Type header value designates
+// a textual type that is worth compressing.
+// Responses without a Content-Type header are html.
+bool HttpResponseBuffer::isCompressible(const string& contentType)
+{
+    if(contentType.empty()) {
+        return true;
+    }
+    const string type = boost::algorithm::to_lower_copy(contentType);
+    return
+        boost::algorithm::starts_with(type, "text/") ||
+        type.find("json") != string::npos ||
+        type.find("xml") != string::npos ||
+        type.find("javascript") != string::npos;
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef SHASTA_STATIC_EXECUTABLE
+
+#ifndef CZI_SHASTA_HTTP_RESPONSE_BUFFER_HPP
+#define CZI_SHASTA_HTTP_RESPONSE_BUFFER_HPP
+
+// zlib, used for gzip and deflate content encoding.
+#include <zlib.h>
+
+// Standard library.
+#include "cstdint.hpp"
+#include "iosfwd.hpp"
+#include <streambuf>
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class HttpResponseBuffer;
+    }
+}
+
+
+
+// Class HttpResponseBuffer is the stream buffer used by HttpServer
+// for the ostream passed to the derived class in processRequest.
+// The derived class writes optional header lines, an empty line,
+// and the response body, exactly as if it was writing
+// directly to the connection after the status line.
+// HttpResponseBuffer sends to the connection:
+// - The status line.
+// - The headers written by the derived class, plus
+//   Content-Encoding, Transfer-Encoding, and Connection headers.
+// - The body, optionally compressed using gzip or deflate
+//   content encoding, and optionally sent using chunked transfer encoding.
+// The body is sent in chunks as it is written, so large responses
+// don't have to be kept in memory, and the browser can start
+// receiving them before they are complete.
+// Chunked transfer encoding is required for keep-alive
+// connections, because the content length is not known
+// when the headers are sent.
+// Compression is only used for textual content (responses without
+// a Content-Type header, which are html, or with a textual Content-Type).
+class ChanZuckerberg::shasta::HttpResponseBuffer : public std::streambuf {
+public:
+
+    enum class ContentEncoding {
+        identity,
+        gzip,
+        deflate
+    };
+
+    // Choose the content encoding to use, given the value of
+    // the Accept-Encoding header of the request.
+    static ContentEncoding negotiateContentEncoding(const string& acceptEncoding);
+    static const char* contentEncodingName(ContentEncoding);
+
+    HttpResponseBuffer(
+        ostream&,
+        ContentEncoding,
+        bool useChunkedTransferEncoding,
+        bool keepAlive);
+    ~HttpResponseBuffer();
+
+    // Complete the response. This must be called after the derived class
+    // has written the entire response.
+    void finish();
+
+    // The number of body bytes written by the derived class
+    // and sent to the connection (after compression).
+    // Valid after finish has been called.
+    uint64_t bodyByteCount = 0;
+    uint64_t sentByteCount = 0;
+
+    // Whether the body was compressed.
+    bool isCompressed() const
+    {
+        return compress;
+    }
+
+protected:
+    int_type overflow(int_type) override;
+
+    // This does not force sending a partial chunk, because
+    // the derived class could flush the stream frequently,
+    // and each flush would send a small chunk
+    // and degrade compression.
+    int sync() override;
+
+private:
+
+    ostream& s;
+    const ContentEncoding contentEncoding;
+    const bool useChunkedTransferEncoding;
+    const bool keepAlive;
+    bool finished = false;
+
+    // Buffer for characters written by the derived class.
+    static const size_t bufferSize = 64 * 1024;
+    vector<char> inputBuffer;
+
+    // Send to the connection the characters in the input buffer.
+    void drain();
+
+    // The headers written by the derived class, while
+    // we have not yet seen the empty line that terminates them.
+    bool headersAreComplete = false;
+    string headers;
+    void processHeaderCharacter(char);
+    void sendHeaders();
+
+    // Body processing.
+    bool compress = false;
+    z_stream zStream;
+    vector<char> outputBuffer;
+    size_t outputSize = 0;
+    void sendBody(const char*, size_t);
+    void compressBody(const char*, size_t, int flush);
+    void sendChunk(const char*, size_t);
+
+    // Return true if a Content-Type header value designates
+    // a textual type that is worth compressing.
+    static bool isCompressible(const string& contentType);
+};
+
+#endif
+
+#endif
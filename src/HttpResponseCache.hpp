@@ -0,0 +1,172 @@
+#ifndef CZI_SHASTA_HTTP_RESPONSE_CACHE_HPP
+#define CZI_SHASTA_HTTP_RESPONSE_CACHE_HPP
+
+// Standard library.
+#include "algorithm.hpp"
+#include "cstdint.hpp"
+#include <list>
+#include <mutex>
+#include "string.hpp"
+#include <unordered_map>
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class HttpResponseCache;
+    }
+}
+
+
+
+// Class HttpResponseCache is a least recently used cache
+// of http responses, used by the http server for pages
+// that are expensive to compute, such as local graph displays.
+// The key is constructed from the request by makeKey,
+// so the order of the request parameters does not matter.
+// The total size of the cached responses is kept
+// below a configurable number of bytes.
+// All public functions are thread safe.
+class ChanZuckerberg::shasta::HttpResponseCache {
+public:
+
+    HttpResponseCache(uint64_t maxByteCount = 256ULL * 1024ULL * 1024ULL) :
+        maxByteCount(maxByteCount) {}
+
+    // Construct a key from a request, already parsed as for
+    // HttpServer::processRequest: the keyword, followed by
+    // parameter names and values.
+    static string makeKey(const vector<string>& request)
+    {
+        vector< pair<string, string> > parameters;
+        for(size_t i=1; i+1<request.size(); i+=2) {
+            parameters.push_back(make_pair(request[i], request[i+1]));
+        }
+        sort(parameters.begin(), parameters.end());
+        string key = request.front();
+        for(const auto& p: parameters) {
+            key += '&';
+            key += p.first;
+            key += '=';
+            key += p.second;
+        }
+        return key;
+    }
+
+    // Look up a response. If found, copy it to the response argument,
+    // make it the most recently used, and return true.
+    bool get(const string& key, string& response)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = table.find(key);
+        if(it == table.end()) {
+            ++missCount;
+            return false;
+        }
+        ++hitCount;
+        entries.splice(entries.begin(), entries, it->second);
+        response = it->second->second;
+        return true;
+    }
+
+    // Store a response, evicting least recently used
+    // responses as necessary to stay within maxByteCount.
+    // A response larger than maxByteCount is not stored.
+    void insert(const string& key, const string& response)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = table.find(key);
+        if(it != table.end()) {
+            byteCount -= entryByteCount(*it->second);
+            entries.erase(it->second);
+            table.erase(it);
+        }
+        const uint64_t n = key.size() + response.size();
+        if(n > maxByteCount) {
+            return;
+        }
+        entries.push_front(make_pair(key, response));
+        table.insert(make_pair(key, entries.begin()));
+        byteCount += n;
+        evict();
+    }
+
+    // Remove all responses.
+    // This must be called when the data used to construct
+    // the responses may have changed.
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        table.clear();
+        byteCount = 0;
+    }
+
+    // Change the maximum total size of the cached responses.
+    // Zero disables the cache.
+    void setMaxByteCount(uint64_t maxByteCountArgument)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        maxByteCount = maxByteCountArgument;
+        evict();
+    }
+
+    // Statistics. Each value is read under the mutex,
+    // but separate calls are not a consistent snapshot.
+    uint64_t getHitCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hitCount;
+    }
+    uint64_t getMissCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return missCount;
+    }
+    uint64_t getByteCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return byteCount;
+    }
+    uint64_t getMaxByteCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return maxByteCount;
+    }
+    uint64_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return table.size();
+    }
+
+private:
+    using Entry = pair<string, string>;
+    std::list<Entry> entries;   // Most recently used first.
+    std::unordered_map<string, std::list<Entry>::iterator> table;
+    uint64_t maxByteCount;
+    uint64_t byteCount = 0;
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+
+    // Mutable so the const statistics functions can lock it.
+    mutable std::mutex mutex;
+
+    static uint64_t entryByteCount(const Entry& entry)
+    {
+        return entry.first.size() + entry.second.size();
+    }
+
+    // Remove least recently used entries until
+    // byteCount is not greater than maxByteCount.
+    void evict()
+    {
+        while(byteCount > maxByteCount && !entries.empty()) {
+            const Entry& entry = entries.back();
+            byteCount -= entryByteCount(entry);
+            table.erase(entry.first);
+            entries.pop_back();
+        }
+    }
+};
+
+#endif
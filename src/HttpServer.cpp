@@ -4,6 +4,7 @@
 
 #include "HttpServer.hpp"
 #include "CZI_ASSERT.hpp"
+#include "HttpResponseBuffer.hpp"
 #include "timestamp.hpp"
 // #include "tokenize.hpp"
 using namespace ChanZuckerberg;
@@ -20,18 +21,28 @@ using namespace asio;
 using namespace ip;
 
 #include <chrono>
+#include <condition_variable>
 #include "fstream.hpp"
 #include "iostream.hpp"
+#include "memory.hpp"
+#include <mutex>
+#include <queue>
 #include <sstream>
 #include "stdexcept.hpp"
+#include <thread>
 
 
 
 // This function puts the server into an endless loop
 // of processing requests.
 // This is trhe function that the base class should call to start the server.
-void HttpServer::explore(uint16_t port, bool localOnly)
+void HttpServer::explore(uint16_t port, bool localOnly, size_t threadCount)
 {
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
     // Create the acceptor, making sure to accept both ipv4 and ipv6 ip addresses.
     io_service service;
     tcp::acceptor acceptor(service);
@@ -70,33 +81,134 @@ void HttpServer::explore(uint16_t port, bool localOnly)
         cout << "Accepting connections from all hosts." << endl;
     }
 
+    // Single threaded mode: endless loop over incoming connections.
+    if(threadCount == 1) {
+        while(true) {
+              tcp::iostream s;
+              tcp::endpoint remoteEndpoint;
+              boost::system::error_code errorCode;
+              acceptor.accept(*s.rdbuf(), remoteEndpoint, errorCode);
+              if(errorCode) {
+                  // If interrupted with Ctrl-C, we get here.
+                  cout << "\nError code from accept: " << errorCode.message() << endl;
+                  s.close();        // Should not be necessary.
+                  acceptor.close(); // Should not be necessary
+                  return;
+              }
+
+              // Process the request.
+              cout << timestamp << remoteEndpoint.address().to_string() << " " << flush;
+              const auto t0 = std::chrono::steady_clock::now();
+              processRequest(s, false);
+              const auto t1 = std::chrono::steady_clock::now();
+              const std::chrono::duration<double> t01 = t1 - t0;
+              cout << timestamp << "Request satisfied in " << t01.count() << "s." << endl;
+        }
+    }
+
+
+
+    // Multithreaded mode.
+    // This thread accepts connections and puts them in a queue.
+    // A pool of threads takes connections from the queue and processes them.
+    // A connection is kept alive between requests only while
+    // no other connections are waiting in the queue, so idle
+    // keep-alive connections don't delay new connections.
+    cout << "Processing requests using " << threadCount << " threads." << endl;
+    class Connection {
+    public:
+        tcp::iostream s;
+        tcp::endpoint remoteEndpoint;
+    };
+    std::queue< shared_ptr<Connection> > connections;
+    std::mutex connectionsMutex;
+    std::condition_variable connectionsCondition;
+    bool done = false;
+    auto threadFunction = [&]()
+    {
+        while(true) {
+
+            // Get a connection from the queue.
+            shared_ptr<Connection> connection;
+            {
+                std::unique_lock<std::mutex> lock(connectionsMutex);
+                connectionsCondition.wait(lock, [&]{return done || !connections.empty();});
+                if(connections.empty()) {
+                    return;
+                }
+                connection = connections.front();
+                connections.pop();
+            }
+
+            // Process requests on this connection.
+            while(true) {
+                bool allowKeepAlive;
+                {
+                    std::lock_guard<std::mutex> lock(connectionsMutex);
+                    allowKeepAlive = !done && connections.empty();
+                }
+                bool keepAlive = false;
+                const auto t0 = std::chrono::steady_clock::now();
+                try {
+                    keepAlive = processRequest(connection->s, allowKeepAlive);
+                } catch(std::exception& e) {
+                    cout << timestamp << "Error processing request from " <<
+                        connection->remoteEndpoint.address().to_string() << ": " << e.what() << endl;
+                }
+                const auto t1 = std::chrono::steady_clock::now();
+                const std::chrono::duration<double> t01 = t1 - t0;
+                cout << timestamp << connection->remoteEndpoint.address().to_string() <<
+                    " request satisfied in " << t01.count() << "s." << endl;
+                if(!(keepAlive && waitForRequest(connection->s))) {
+                    break;
+                }
+            }
+        }
+    };
+    vector<std::thread> threads;
+    for(size_t threadId=0; threadId<threadCount; threadId++) {
+        threads.push_back(std::thread(threadFunction));
+    }
+
     // Endless loop over incoming connections.
     while(true) {
-          tcp::iostream s;
-          tcp::endpoint remoteEndpoint;
-          boost::system::error_code errorCode;
-          acceptor.accept(*s.rdbuf(), remoteEndpoint, errorCode);
-          if(errorCode) {
-              // If interrupted with Ctrl-C, we get here.
-              cout << "\nError code from accept: " << errorCode.message() << endl;
-              s.close();        // Should not be necessary.
-              acceptor.close(); // Should not be necessary
-              return;
-          }
-
-          // Process the request.
-          cout << timestamp << remoteEndpoint.address().to_string() << " " << flush;
-          const auto t0 = std::chrono::steady_clock::now();
-          processRequest(s);
-          const auto t1 = std::chrono::steady_clock::now();
-          const std::chrono::duration<double> t01 = t1 - t0;
-          cout << timestamp << "Request satisfied in " << t01.count() << "s." << endl;
+        const shared_ptr<Connection> connection = make_shared<Connection>();
+        boost::system::error_code errorCode;
+        acceptor.accept(*connection->s.rdbuf(), connection->remoteEndpoint, errorCode);
+        if(errorCode) {
+            // If interrupted with Ctrl-C, we get here.
+            cout << "\nError code from accept: " << errorCode.message() << endl;
+            acceptor.close(); // Should not be necessary
+            break;
+        }
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        connections.push(connection);
+        connectionsCondition.notify_one();
+    }
+
+    // Let the threads finish the requests already in the queue, then stop them.
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        done = true;
+    }
+    connectionsCondition.notify_all();
+    for(std::thread& thread: threads) {
+        thread.join();
     }
 }
 
 
 
-void HttpServer::processRequest(tcp::iostream& s)
+// Wait for the next request on a keep-alive connection.
+bool HttpServer::waitForRequest(tcp::iostream& s)
+{
+    s.expires_from_now(boost::posix_time::seconds(keepAliveTimeout));
+    return s.peek() != tcp::iostream::traits_type::eof();
+}
+
+
+
+bool HttpServer::processRequest(tcp::iostream& s, bool allowKeepAlive)
 {
     // If the client is too slow sending the request, drop it.
     s.expires_from_now(boost::posix_time::seconds(1));
@@ -106,7 +218,7 @@ void HttpServer::processRequest(tcp::iostream& s)
     getline(s, requestLine);
     if(requestLine.empty()) {
         cout << "Empty request ignored." << endl;
-        return;
+        return false;
     }
 
     // Parse it to get only the request string portion.
@@ -117,25 +229,27 @@ void HttpServer::processRequest(tcp::iostream& s)
         s << "Unexpected number of tokens in http request: expected 3, got " << tokens.size();
         cout << "Unexpected number of tokens in http request: expected 3, got " << tokens.size() << endl;
         cout << "Request was: " << requestLine << endl;
-        return;
+        return false;
     }
     if(tokens.front() == "POST") {
         s.expires_from_now(boost::posix_time::seconds(10000000));
+        std::unique_lock<std::shared_timed_mutex> lock(requestMutex);
         processPost(tokens, s);
-        return;
+        return false;
     }
 
     if(tokens.front() != "GET") {
         s << "Unexpected keyword in http request: " << tokens.front();
         cout << "Unexpected keyword in http request: " << tokens.front() << endl;
         cout << "Request was: " << requestLine << endl;
-        return;
+        return false;
     }
+    const string httpVersion = boost::algorithm::trim_copy(tokens[2]);
     const string& request = tokens[1];
     if(request.empty()) {
         s << "Empty GET request: " << requestLine;
         cout << "Empty GET request: " << requestLine;
-        return;
+        return false;
     }
 
     // Give ourselves time to satisfy the request
@@ -162,11 +276,15 @@ void HttpServer::processRequest(tcp::iostream& s)
 
     // Read the rest of the input from the client, but ignore it,
     // except for the User Agent string, which tells us what browser
-    // issued the request.
+    // issued the request, and the headers that determine
+    // how we send the response.
     // If we don't read all the input, the client may get a timeout.
     string line;
     const string userAgentPrefix = "User-Agent: ";
     BrowserInformation browserInformation;
+    string acceptEncoding;
+    string connectionHeader;
+    bool headersAreComplete = false;
     while(true) {
         if(!s) {
             break;
@@ -177,6 +295,7 @@ void HttpServer::processRequest(tcp::iostream& s)
         }
         // cout << "Got another line of length " << line.size() << ": <<<" << line << ">>>" << endl;
         if(line.size()==1) {
+            headersAreComplete = true;
             break;
         }
 
@@ -184,19 +303,63 @@ void HttpServer::processRequest(tcp::iostream& s)
         if(line.compare(0, userAgentPrefix.size(), userAgentPrefix) == 0) {
             browserInformation.set(line);
         }
+
+        // Header names are case insensitive.
+        const size_t colonPosition = line.find(':');
+        if(colonPosition != string::npos) {
+            const string name = line.substr(0, colonPosition);
+            const string value = boost::algorithm::trim_copy(line.substr(colonPosition + 1));
+            if(boost::algorithm::iequals(name, "Accept-Encoding")) {
+                acceptEncoding = value;
+            } else if(boost::algorithm::iequals(name, "Connection")) {
+                connectionHeader = value;
+            }
+        }
     }
     cout << "isFirefox=" << browserInformation.isFirefox << " ";
     cout << "isChrome=" << browserInformation.isChrome << endl;
 
 
 
-    // Write the success response.
-    // We don't write the required empty line, so the derived class can send headers
-    // if it wants to.
-    s << "HTTP/1.1 200 OK\r\n";
+    // Decide how to send the response.
+    // Chunked transfer encoding, which is required for keep-alive,
+    // is only available with HTTP/1.1. Otherwise, the end
+    // of the response is indicated by closing the connection.
+    const bool useChunkedTransferEncoding = (httpVersion == "HTTP/1.1");
+    const bool keepAlive =
+        allowKeepAlive &&
+        useChunkedTransferEncoding &&
+        headersAreComplete &&
+        !boost::algorithm::icontains(connectionHeader, "close");
+    HttpResponseBuffer responseBuffer(
+        s,
+        HttpResponseBuffer::negotiateContentEncoding(acceptEncoding),
+        useChunkedTransferEncoding,
+        keepAlive);
+    ostream response(&responseBuffer);
 
     // The derived class processes the request.
-    processRequest(tokens, s, browserInformation);
+    // The response buffer writes the status line,
+    // so the derived class can send headers if it wants to,
+    // followed by the required empty line and the response body.
+    if(requiresExclusiveAccess(tokens)) {
+        std::unique_lock<std::shared_timed_mutex> lock(requestMutex);
+        processRequest(tokens, response, browserInformation);
+    } else {
+        std::shared_lock<std::shared_timed_mutex> lock(requestMutex);
+        processRequest(tokens, response, browserInformation);
+    }
+    responseBuffer.finish();
+
+    cout << "Response body " << responseBuffer.bodyByteCount << " bytes";
+    if(responseBuffer.isCompressed()) {
+        cout << ", " << responseBuffer.sentByteCount << " bytes sent using " <<
+            HttpResponseBuffer::contentEncodingName(
+            HttpResponseBuffer::negotiateContentEncoding(acceptEncoding)) << " encoding";
+    }
+    cout << "." << endl;
+
+    return keepAlive && bool(s);
 }
 
 
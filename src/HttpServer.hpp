@@ -4,6 +4,10 @@
 // http server functionality to facilitate data exploration and debugging.
 // The derived class only has to override
 // function processRequest.
+// Responses are compressed (gzip or deflate content encoding)
+// if the browser accepts it, and sent using chunked transfer encoding.
+// When processing requests concurrently, connections
+// are kept alive between requests (HTTP/1.1 keep-alive).
 
 #ifndef CZI_SHASTA_HTTP_SERVER_HPP
 #define CZI_SHASTA_HTTP_SERVER_HPP
@@ -16,6 +20,7 @@
 #include "iosfwd.hpp"
 #include <map>
 #include <set>
+#include <shared_mutex>
 #include "string.hpp"
 #include "vector.hpp"
 
@@ -33,7 +38,10 @@ public:
 
     // This function puts the server into an endless loop
     // of processing requests.
-    void explore(uint16_t port, bool localOnly=false);
+    // If threadCount is greater than 1, requests are processed
+    // concurrently by a pool of threadCount threads.
+    // If threadCount is 0, it is set to the number of virtual processors.
+    void explore(uint16_t port, bool localOnly=false, size_t threadCount=1);
 
     // The destructor needs to be virtual for clean destruction of
     // the derived class.
@@ -59,6 +67,17 @@ protected:
         const PostData&,
         ostream& html);
 
+    // When requests are processed concurrently, the derived class
+    // should override this to return true for GET requests that
+    // modify shared state or files. Those requests are then processed
+    // while no other request is being processed.
+    // POST requests are always processed in this way.
+    // The request is already parsed as for processRequest.
+    virtual bool requiresExclusiveAccess(const vector<string>& request) const
+    {
+        return false;
+    }
+
 
 
     // This function can be used by the derived class to get the value of a parameter.
@@ -117,7 +136,21 @@ protected:
 
 
 private:
-    void processRequest(boost::asio::ip::tcp::iostream&);
+
+    // Process a request on a connection.
+    // Returns true if the connection can be used for another request
+    // (HTTP/1.1 keep-alive). Keep-alive is only used if allowKeepAlive is true.
+    bool processRequest(boost::asio::ip::tcp::iostream&, bool allowKeepAlive);
+
+    // Wait for the next request on a keep-alive connection.
+    // Returns false if the client closed the connection or did not
+    // send another request in keepAliveTimeout seconds.
+    static const long keepAliveTimeout = 5;
+    static bool waitForRequest(boost::asio::ip::tcp::iostream&);
+
+    // Requests that require exclusive access (see requiresExclusiveAccess)
+    // hold this in exclusive mode. All other requests hold it in shared mode.
+    std::shared_timed_mutex requestMutex;
 
     void processPost(
         const vector<string>& request,
@@ -0,0 +1,318 @@
+// Shasta.
+#include "HugePages.hpp"
+#include "PersistentMemory.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include <cerrno>
+#include <cstring>
+#include "fstream.hpp"
+#include "iostream.hpp"
+#include <sstream>
+#include "stdexcept.hpp"
+
+// Linux.
+#include <sys/mman.h>
+#ifdef __linux__
+#include <linux/mman.h>
+#endif
+
+
+
+HugePages::Mode HugePages::mode = HugePages::Mode::hugetlb;
+uint64_t HugePages::hugetlbMappingCount = 0;
+uint64_t HugePages::giganticMappingCount = 0;
+uint64_t HugePages::transparentMappingCount = 0;
+uint64_t HugePages::fallbackMappingCount = 0;
+
+
+
+void HugePages::setMode(const string& modeName)
+{
+    if(modeName == "hugetlb") {
+        mode = Mode::hugetlb;
+    } else if(modeName == "transparent") {
+        mode = Mode::transparent;
+    } else {
+        throw runtime_error("Invalid huge page mode " + modeName +
+            ". Must be hugetlb or transparent.");
+    }
+}
+
+
+
+string HugePages::getModeName()
+{
+    switch(mode) {
+    case Mode::hugetlb:
+        return "hugetlb";
+    case Mode::transparent:
+        return "transparent";
+    }
+    return "";
+}
+
+
+
+void* HugePages::mapAnonymous(size_t size, size_t pageSize)
+{
+    const int protection = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if(pageSize != hugePageSize && pageSize != giganticHugePageSize) {
+        return ::mmap(0, size, protection, flags, -1, 0);
+    }
+
+#ifdef __linux__
+    if(mode == Mode::hugetlb) {
+        if(pageSize == giganticHugePageSize && size % giganticHugePageSize == 0) {
+            void* pointer = mapGigantic(0, size, protection, flags);
+            if(pointer != MAP_FAILED) {
+                return pointer;
+            }
+        }
+
+        void* pointer = ::mmap(0, size, protection, flags | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+        if(pointer != MAP_FAILED) {
+            __sync_fetch_and_add(&hugetlbMappingCount, 1);
+            return pointer;
+        }
+
+        // No hugetlb pages are available. Fall back to transparent huge pages.
+        reportFallback(size);
+    }
+#endif
+
+    return mapAligned(size, -1, protection, flags);
+}
+
+
+
+void HugePages::reportFallback(size_t size)
+{
+    if(__sync_fetch_and_add(&fallbackMappingCount, 1) == 0) {
+        cout << "Allocation of " << size << " bytes using 2 MB hugetlb pages failed: " <<
+            ::strerror(errno) << ". Using transparent huge pages instead. "
+            "This message is only written once." << endl;
+    }
+}
+
+
+
+void* HugePages::mapGigantic(void* address, size_t size, int protection, int flags)
+{
+#if defined(__linux__) && defined(MAP_HUGE_1GB)
+    void* pointer = ::mmap(address, size, protection, flags | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+    if(pointer != MAP_FAILED) {
+        __sync_fetch_and_add(&hugetlbMappingCount, 1);
+        __sync_fetch_and_add(&giganticMappingCount, 1);
+        return pointer;
+    }
+    cout << "Allocation of " << size << " bytes using 1 GB hugetlb pages failed: " <<
+        ::strerror(errno) << ". Using 2 MB pages instead." << endl;
+#else
+    errno = EINVAL;
+#endif
+    return MAP_FAILED;
+}
+
+
+
+void* HugePages::mapFile(int fileDescriptor, size_t size, int protection)
+{
+    if(PersistentMemory::isPersistentMemoryFile(fileDescriptor)) {
+        return PersistentMemory::mapFile(0, size, protection, fileDescriptor, 0);
+    }
+    if(mode == Mode::transparent && size > 0 && size % hugePageSize == 0) {
+        return mapAligned(size, fileDescriptor, protection, MAP_SHARED);
+    }
+    return ::mmap(0, size, protection, MAP_SHARED, fileDescriptor, 0);
+}
+
+
+
+void* HugePages::mapAligned(size_t size, int fileDescriptor, int protection, int flags)
+{
+    void* begin = reserveAddressSpace(size);
+    if(begin == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+
+    // Create the mapping at the aligned address, replacing the reserved range.
+    void* pointer = ::mmap(begin, size, protection, flags | MAP_FIXED, fileDescriptor, 0);
+    if(pointer == MAP_FAILED) {
+        const int savedErrno = errno;
+        ::munmap(begin, size);
+        errno = savedErrno;
+        return MAP_FAILED;
+    }
+
+    // This is only a hint, so errors are ignored.
+#ifdef __linux__
+    ::madvise(begin, size, MADV_HUGEPAGE);
+#endif
+    __sync_fetch_and_add(&transparentMappingCount, 1);
+    return begin;
+}
+
+
+
+void* HugePages::reserveAddressSpace(size_t size, size_t alignment)
+{
+    // Reserve an address range large enough to contain
+    // an aligned range of the requested size.
+    const size_t reservedSize = size + alignment;
+    void* reservedPointer = ::mmap(0, reservedSize, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(reservedPointer == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+    char* reservedBegin = static_cast<char*>(reservedPointer);
+    char* reservedEnd = reservedBegin + reservedSize;
+    char* begin = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(reservedBegin) + alignment - 1) & ~uintptr_t(alignment - 1));
+    char* end = begin + size;
+
+    // Release the parts we don't need.
+    if(begin > reservedBegin) {
+        ::munmap(reservedBegin, size_t(begin - reservedBegin));
+    }
+    if(reservedEnd > end) {
+        ::munmap(end, size_t(reservedEnd - end));
+    }
+    return begin;
+}
+
+
+
+void* HugePages::mapAnonymousAt(void* address, size_t size, size_t pageSize)
+{
+    const int protection = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+    if(pageSize != hugePageSize && pageSize != giganticHugePageSize) {
+        return ::mmap(address, size, protection, flags, -1, 0);
+    }
+
+#ifdef __linux__
+    if(mode == Mode::hugetlb) {
+        if(pageSize == giganticHugePageSize &&
+            reinterpret_cast<uintptr_t>(address) % giganticHugePageSize == 0 &&
+            size % giganticHugePageSize == 0) {
+            void* pointer = mapGigantic(address, size, protection, flags);
+            if(pointer != MAP_FAILED) {
+                return pointer;
+            }
+        }
+
+        void* pointer = ::mmap(address, size, protection, flags | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+        if(pointer != MAP_FAILED) {
+            __sync_fetch_and_add(&hugetlbMappingCount, 1);
+            return pointer;
+        }
+        reportFallback(size);
+    }
+#endif
+
+    void* pointer = ::mmap(address, size, protection, flags, -1, 0);
+    if(pointer != MAP_FAILED) {
+#ifdef __linux__
+        ::madvise(pointer, size, MADV_HUGEPAGE);
+#endif
+        __sync_fetch_and_add(&transparentMappingCount, 1);
+    }
+    return pointer;
+}
+
+
+
+void* HugePages::mapFileAt(
+    void* address,
+    size_t size,
+    int protection,
+    int fileDescriptor,
+    size_t fileOffset)
+{
+    if(PersistentMemory::isPersistentMemoryFile(fileDescriptor)) {
+        return PersistentMemory::mapFile(address, size, protection, fileDescriptor, fileOffset);
+    }
+    void* pointer = ::mmap(address, size, protection, MAP_SHARED | MAP_FIXED,
+        fileDescriptor, off_t(fileOffset));
+    if(pointer != MAP_FAILED && mode == Mode::transparent) {
+#ifdef __linux__
+        ::madvise(pointer, size, MADV_HUGEPAGE);
+#endif
+        __sync_fetch_and_add(&transparentMappingCount, 1);
+    }
+    return pointer;
+}
+
+
+
+void* HugePages::releaseToReservedAddressSpace(void* address, size_t size)
+{
+    return ::mmap(address, size, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+}
+
+
+
+// The lines of /proc/self/smaps_rollup we use look like this:
+// AnonHugePages:    123456 kB
+void HugePages::getStatistics(
+    uint64_t& transparentBytes,
+    uint64_t& hugetlbBytes)
+{
+    transparentBytes = 0;
+    hugetlbBytes = 0;
+
+    ifstream file("/proc/self/smaps_rollup");
+    string line;
+    while(getline(file, line)) {
+        const size_t colonPosition = line.find(':');
+        if(colonPosition == string::npos) {
+            continue;
+        }
+        const string key = line.substr(0, colonPosition);
+        uint64_t* value = 0;
+        if(key == "AnonHugePages" || key == "ShmemPmdMapped" || key == "FilePmdMapped") {
+            value = &transparentBytes;
+        } else if(key == "Shared_Hugetlb" || key == "Private_Hugetlb") {
+            value = &hugetlbBytes;
+        } else {
+            continue;
+        }
+        std::istringstream s(line.substr(colonPosition+1));
+        uint64_t kiloBytes = 0;
+        s >> kiloBytes;
+        *value += 1024 * kiloBytes;
+    }
+}
+
+
+
+string HugePages::getDescription()
+{
+    std::ostringstream s;
+    s << "Huge page mode " << getModeName();
+
+    // The system setting looks like this: always [madvise] never
+    ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+    string enabled;
+    if(getline(file, enabled)) {
+        s << ", transparent huge pages enabled: " << enabled;
+    }
+
+    s << ", " << hugetlbMappingCount << " hugetlb mappings (" <<
+        giganticMappingCount << " on 1 GB pages), ";
+    s << transparentMappingCount << " transparent huge page mappings, ";
+    s << fallbackMappingCount << " hugetlb allocation failures";
+
+    uint64_t transparentBytes;
+    uint64_t hugetlbBytes;
+    getStatistics(transparentBytes, hugetlbBytes);
+    const double megaByte = 1024. * 1024.;
+    s << ", currently mapped on huge pages: " <<
+        double(transparentBytes) / megaByte << " MB transparent, " <<
+        double(hugetlbBytes) / megaByte << " MB hugetlb.";
+    return s.str();
+}
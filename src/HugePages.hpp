@@ -0,0 +1,182 @@
+#ifndef CZI_SHASTA_HUGE_PAGES_HPP
+#define CZI_SHASTA_HUGE_PAGES_HPP
+
+/*******************************************************************************
+
+Class HugePages controls how MemoryMapped::Vector objects
+with a page size of 2 MB get their memory backed by 2 MB pages.
+
+- Mode hugetlb (the default): anonymous memory is mapped
+  with MAP_HUGETLB | MAP_HUGE_2MB, and file backed memory
+  is expected to be on a hugetlbfs filesystem.
+  This requires huge pages to be reserved or allowed via
+  /sys/kernel/mm/hugepages/hugepages-2048kB/nr_overcommit_hugepages,
+  which requires root privilege.
+  If a MAP_HUGETLB mapping fails, the mapping falls back
+  to transparent huge pages and a message is written once.
+
+- Mode transparent: memory is mapped normally, but at an address
+  aligned to 2 MB, and the kernel is asked to back it with
+  transparent huge pages using madvise(MADV_HUGEPAGE).
+  This does not require root privilege.
+  It only has an effect if /sys/kernel/mm/transparent_hugepage/enabled
+  is "always" or "madvise". For file backed memory it only has an effect
+  for files on tmpfs mounted with huge=advise or huge=always
+  (or, for read-only mappings, if the kernel supports
+  transparent huge pages for other filesystems).
+  Since these are only hints, failures are ignored.
+
+Alignment and madvise are also used for file backed mappings
+whose size is a multiple of 2 MB, because they are usually
+created with a 2 MB page size.
+
+Anonymous memory can also be requested with a page size of 1 GB.
+This only makes a difference in mode hugetlb: the memory is mapped
+with MAP_HUGETLB | MAP_HUGE_1GB, which requires 1 GB pages to be
+reserved via /sys/kernel/mm/hugepages/hugepages-1048576kB/nr_hugepages
+or at boot time, because 1 GB pages cannot be overcommitted.
+If that fails, the mapping falls back to 2 MB hugetlb pages
+and then to transparent huge pages, and a message is written
+for each mapping that did not get 1 GB pages.
+In mode transparent, a 1 GB page size is treated as 2 MB,
+because transparent huge pages are always 2 MB.
+Because 1 GB pages round up the size of each mapping to a multiple
+of 1 GB, they are only used for data structures of at least 1 GB
+(see getEffectivePageSize). Smaller ones use 2 MB pages instead.
+
+getStatistics returns the number of bytes of this process
+currently mapped on huge pages, of either kind
+(from /proc/self/smaps_rollup).
+
+*******************************************************************************/
+
+// Standard library.
+#include "cstddef.hpp"
+#include "cstdint.hpp"
+#include "string.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class HugePages;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::HugePages {
+public:
+
+    enum class Mode {
+        hugetlb,
+        transparent
+    };
+
+    // Set the mode. Allowed mode names are hugetlb and transparent.
+    // This should be called once, at the beginning of the run,
+    // before any memory is allocated.
+    static void setMode(const string& modeName);
+    static Mode getMode()
+    {
+        return mode;
+    }
+    static string getModeName();
+
+    static const size_t hugePageSize = 2 * 1024 * 1024;
+    static const size_t giganticHugePageSize = 1024 * 1024 * 1024;
+
+    // Return true if the given page size is one of the allowed
+    // page sizes: 4096, hugePageSize, or giganticHugePageSize.
+    static bool isValidPageSize(size_t pageSize)
+    {
+        return
+            pageSize == 4096 ||
+            pageSize == hugePageSize ||
+            pageSize == giganticHugePageSize;
+    }
+
+    // Return the page size to be used for a mapping of the given
+    // number of bytes when the given page size is requested.
+    // This is the requested page size, except that 1 GB pages
+    // are replaced by 2 MB pages for mappings smaller than 1 GB.
+    static size_t getEffectivePageSize(size_t requestedPageSize, size_t byteCount)
+    {
+        if(requestedPageSize == giganticHugePageSize && byteCount < giganticHugePageSize) {
+            return hugePageSize;
+        }
+        return requestedPageSize;
+    }
+
+    // Map anonymous read-write memory.
+    // If pageSize is hugePageSize or giganticHugePageSize, the memory is backed
+    // by huge pages as described above.
+    // Returns MAP_FAILED and sets errno in case of failure, like mmap.
+    static void* mapAnonymous(size_t size, size_t pageSize);
+
+    // Map a file with MAP_SHARED.
+    // In mode transparent, if the size is a multiple of hugePageSize,
+    // the mapping is aligned and advised to use transparent huge pages.
+    // Files on persistent memory are mapped by PersistentMemory::mapFile.
+    // This also applies to mapFileAt.
+    // Returns MAP_FAILED and sets errno in case of failure, like mmap.
+    static void* mapFile(int fileDescriptor, size_t size, int protection);
+
+    // Functions used by MemoryMapped::Vector to grow in place
+    // inside a range of reserved address space.
+    // The reserved range is aligned to hugePageSize,
+    // so huge pages can be mapped anywhere in it at offsets
+    // that are multiples of hugePageSize.
+    // All return MAP_FAILED and set errno in case of failure, like mmap.
+
+    // Reserve a range of address space without committing any memory.
+    // The range is aligned to the given alignment, which must be a power of 2.
+    static void* reserveAddressSpace(size_t size, size_t alignment = hugePageSize);
+
+    // Map anonymous read-write memory or a portion of a file
+    // at the given address, inside a reserved range.
+    // 1 GB pages are only used if the address and size
+    // are multiples of 1 GB. Otherwise 2 MB pages are used.
+    static void* mapAnonymousAt(void* address, size_t size, size_t pageSize);
+    static void* mapFileAt(void* address, size_t size, int protection,
+        int fileDescriptor, size_t fileOffset);
+
+    // Return a portion of a mapping to reserved address space,
+    // releasing the memory it used.
+    static void* releaseToReservedAddressSpace(void* address, size_t size);
+
+    // Bytes of this process currently mapped on huge pages:
+    // transparent huge pages (AnonHugePages, ShmemPmdMapped, FilePmdMapped)
+    // and hugetlb pages (Shared_Hugetlb, Private_Hugetlb).
+    // If unavailable, they are returned as zero.
+    static void getStatistics(
+        uint64_t& transparentBytes,
+        uint64_t& hugetlbBytes);
+
+    // Describe the mode in effect, the system transparent huge page setting,
+    // the number of mappings of each kind, and the current statistics.
+    static string getDescription();
+
+private:
+    static Mode mode;
+
+    // The number of mappings of each kind created so far.
+    static uint64_t hugetlbMappingCount;
+    static uint64_t giganticMappingCount;
+    static uint64_t transparentMappingCount;
+    static uint64_t fallbackMappingCount;
+
+    // Count a hugetlb allocation failure, and write a message the first time.
+    static void reportFallback(size_t size);
+
+    // Attempt to map anonymous memory on 1 GB hugetlb pages.
+    // If that fails, write a message and return MAP_FAILED.
+    // The flags must include MAP_PRIVATE | MAP_ANONYMOUS
+    // and, if an address is given, MAP_FIXED.
+    static void* mapGigantic(void* address, size_t size, int protection, int flags);
+
+    // Call mmap with the given arguments, but at an address
+    // aligned to hugePageSize, then advise the mapping
+    // to use transparent huge pages.
+    static void* mapAligned(size_t size, int fileDescriptor, int protection, int flags);
+};
+
+#endif
@@ -18,7 +18,18 @@ namespace ChanZuckerberg {
             std::numeric_limits<KmerId>::digits == 2*Kmer::capacity,
             "Kmer and KmerId types are inconsistent.");
 
+        // Wider types for k-mers longer than Kmer::capacity.
+        // These are used by the k-mer kernels that are templated
+        // on the k-mer id type (GenericKmerIterator, reverseComplementKmerId,
+        // computeFeatureHashes).
+        using Kmer64 = ShortBaseSequence32;
+        using KmerId64 = uint64_t;
+        static_assert(
+            std::numeric_limits<KmerId64>::digits == 2*Kmer64::capacity,
+            "Kmer64 and KmerId64 types are inconsistent.");
+
         class KmerInfo;
+        class KmerBitmap;
     }
 }
 
@@ -30,4 +41,58 @@ public:
     bool isMarker;
 };
 
+
+
+// A set of k-mers of length k, represented as a bitmap
+// with one bit for each of the 4^k k-mers, indexed by KmerId.
+// This is used to flag the k-mers selected as markers.
+// Compared to KmerInfo, it uses 64 times less memory,
+// so it stays in cache for moderate values of k,
+// and remains manageable up to the maximum k allowed by KmerId.
+// The reverse complement of a k-mer is not stored:
+// it can be computed using reverseComplementKmerId (in KmerIterator.hpp).
+// This class does not own the memory it manipulates.
+class ChanZuckerberg::shasta::KmerBitmap {
+public:
+
+    KmerBitmap(const uint64_t* bits = 0) : bits(bits) {}
+
+    // The number of uint64_t words needed for a given k.
+    static uint64_t wordCount(uint64_t k)
+    {
+        const uint64_t kmerCount = 1ULL << (2ULL*k);
+        return (kmerCount + 63ULL) >> 6ULL;
+    }
+
+    bool operator[](KmerId kmerId) const
+    {
+        return (bits[kmerId >> 6ULL] >> (kmerId & 63ULL)) & 1ULL;
+    }
+
+    // Access the 64-bit word containing the bit for KmerId kmerId.
+    uint64_t word(KmerId kmerId) const
+    {
+        return bits[kmerId >> 6ULL];
+    }
+
+    // Add a k-mer to a bitmap under construction.
+    static void set(uint64_t* bits, KmerId kmerId)
+    {
+        bits[kmerId >> 6ULL] |= (1ULL << (kmerId & 63ULL));
+    }
+
+    // Return the number of k-mers in the set.
+    uint64_t count(uint64_t k) const
+    {
+        uint64_t n = 0;
+        for(uint64_t i=0; i<wordCount(k); i++) {
+            n += uint64_t(__builtin_popcountll(bits[i]));
+        }
+        return n;
+    }
+
+private:
+    const uint64_t* bits;
+};
+
 #endif
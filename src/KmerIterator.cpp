@@ -0,0 +1,50 @@
+#include "KmerIterator.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+#include <random>
+
+
+
+// Check KmerIterator and reverseComplementKmerId against
+// the k-mer ids computed using class Kmer,
+// and the same for KmerIterator64 and Kmer64.
+namespace ChanZuckerberg {
+    namespace shasta {
+        template<class KmerType, class Int> void testKmerIterator();
+    }
+}
+template<class KmerType, class Int> void ChanZuckerberg::shasta::testKmerIterator()
+{
+    std::mt19937 randomSource;
+    for(uint64_t k=1; k<=KmerType::capacity; k++) {
+        for(uint64_t n=0; n<200; n++) {
+            LongBaseSequence sequence(n);
+            for(uint64_t i=0; i<n; i++) {
+                sequence.set(i, Base::fromInteger(uint8_t(randomSource() % 4)));
+            }
+
+            uint64_t kmerCount = 0;
+            for(GenericKmerIterator<Int> it(sequence, k); it.isValid(); it.next()) {
+                CZI_ASSERT(it.position == kmerCount);
+                KmerType kmer;
+                for(uint64_t i=0; i<k; i++) {
+                    kmer.set(i, sequence[it.position + i]);
+                }
+                const Int kmerId = Int(kmer.id(k));
+                const Int reverseComplementedKmerId = Int(kmer.reverseComplement(k).id(k));
+                CZI_ASSERT(it.kmerId() == kmerId);
+                CZI_ASSERT(it.reverseComplementedKmerId() == reverseComplementedKmerId);
+                CZI_ASSERT(reverseComplementKmerId(kmerId, k) == reverseComplementedKmerId);
+                ++kmerCount;
+            }
+            CZI_ASSERT(kmerCount == (n >= k ? n-k+1 : 0));
+        }
+    }
+}
+void ChanZuckerberg::shasta::testKmerIterator()
+{
+    testKmerIterator<Kmer, KmerId>();
+    testKmerIterator<Kmer64, KmerId64>();
+    cout << "KmerIterator test passed." << endl;
+}
@@ -0,0 +1,138 @@
+#ifndef CZI_SHASTA_KMER_ITERATOR_HPP
+#define CZI_SHASTA_KMER_ITERATOR_HPP
+
+// shasta.
+#include "Kmer.hpp"
+#include "LongBaseSequence.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        // The iterator is templated on the integer type used for k-mer ids.
+        // KmerIterator uses KmerId and supports k up to Kmer::capacity.
+        // KmerIterator64 uses KmerId64 and supports k up to Kmer64::capacity.
+        template<class Int> class GenericKmerIterator;
+        using KmerIterator = GenericKmerIterator<KmerId>;
+        using KmerIterator64 = GenericKmerIterator<KmerId64>;
+
+        // Return the id of the reverse complement of a k-mer, given its id.
+        // This works for KmerId and KmerId64.
+        template<class Int> inline Int reverseComplementKmerId(Int, uint64_t k);
+
+        void testKmerIterator();
+    }
+}
+
+
+
+// Iterator that visits all k-mers of a LongBaseSequenceView,
+// in order of increasing position.
+// It maintains the KmerId of the current k-mer and of its
+// reverse complement, updating them incrementally
+// using shifts and masks as we move one base at a time,
+// without ever constructing a Kmer object.
+// The KmerId is the same as returned by Kmer::id(k), that is,
+// the concatenation of the k MSB bits of the bases (base 0 first)
+// followed by the k LSB bits of the bases (base 0 first).
+// Typical usage:
+// for(KmerIterator it(sequence, k); it.isValid(); it.next()) {
+//     ... use it.position, it.kmerId(), it.reverseComplementedKmerId()
+// }
+template<class Int> class ChanZuckerberg::shasta::GenericKmerIterator {
+public:
+
+    // The maximum k supported: each of the two halves of a k-mer id
+    // uses k bits.
+    static const uint64_t capacity = std::numeric_limits<Int>::digits / 2;
+
+    GenericKmerIterator(const LongBaseSequenceView& sequence, uint64_t k) :
+        position(0),
+        sequence(sequence),
+        k(k),
+        mask((1ULL << k) - 1ULL)
+    {
+        CZI_ASSERT(k > 0 && k <= capacity);
+        if(sequence.baseCount >= k) {
+            for(uint64_t i=0; i<k; i++) {
+                add(sequence[i]);
+            }
+        }
+    }
+
+    // Return true if the iterator points to a valid k-mer,
+    // false if we reached the end of the sequence.
+    bool isValid() const
+    {
+        return position + k <= sequence.baseCount;
+    }
+
+    // Move to the next k-mer.
+    void next()
+    {
+        const uint64_t newBasePosition = position + k;
+        ++position;
+        if(newBasePosition < sequence.baseCount) {
+            add(sequence[newBasePosition]);
+        }
+    }
+
+    // The id of the current k-mer and of its reverse complement.
+    Int kmerId() const
+    {
+        return Int((msb << k) | lsb);
+    }
+    Int reverseComplementedKmerId() const
+    {
+        return Int((reverseComplementedMsb << k) | reverseComplementedLsb);
+    }
+
+    // The position in the sequence of the first base of the current k-mer.
+    uint64_t position;
+
+private:
+    const LongBaseSequenceView sequence;
+    uint64_t k;
+    uint64_t mask;
+
+    // The bits of the current k-mer, in the same order used by KmerId.
+    uint64_t lsb = 0;
+    uint64_t msb = 0;
+
+    // The bits of the reverse complement of the current k-mer.
+    uint64_t reverseComplementedLsb = 0;
+    uint64_t reverseComplementedMsb = 0;
+
+    // Add a base at the end of the k-mer, dropping the first one.
+    // For the reverse complement, the complement of the new
+    // base goes at the beginning and the last base is dropped.
+    void add(Base base)
+    {
+        const uint64_t bit0 = base.value & 1ULL;
+        const uint64_t bit1 = (base.value >> 1ULL) & 1ULL;
+        lsb = ((lsb << 1ULL) | bit0) & mask;
+        msb = ((msb << 1ULL) | bit1) & mask;
+        const uint64_t shift = k - 1ULL;
+        reverseComplementedLsb = (reverseComplementedLsb >> 1ULL) | ((bit0 ^ 1ULL) << shift);
+        reverseComplementedMsb = (reverseComplementedMsb >> 1ULL) | ((bit1 ^ 1ULL) << shift);
+    }
+};
+
+
+
+// Return the id of the reverse complement of a k-mer, given its id.
+// This reverses and complements the k bits of each of the two halves of the id.
+template<class Int> inline Int ChanZuckerberg::shasta::reverseComplementKmerId(
+    Int kmerId,
+    uint64_t k)
+{
+    const uint64_t mask = (1ULL << k) - 1ULL;
+    const uint64_t shift = 64ULL - k;
+    const uint64_t lsb = ~uint64_t(kmerId) & mask;
+    const uint64_t msb = ~(uint64_t(kmerId) >> k) & mask;
+    return Int(
+        ((LongBaseSequenceView::reverseBits(msb) >> shift) << k) |
+        (LongBaseSequenceView::reverseBits(lsb) >> shift));
+}
+
+
+
+#endif
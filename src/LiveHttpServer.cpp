@@ -0,0 +1,197 @@
+#ifndef SHASTA_STATIC_EXECUTABLE
+
+// Shasta.
+#include "LiveHttpServer.hpp"
+#include "Assembler.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "iostream.hpp"
+#include "stdexcept.hpp"
+#include <thread>
+
+// Linux.
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+
+LiveHttpServer::LiveHttpServer(
+    const string& largeDataFileNamePrefix,
+    size_t largeDataPageSize,
+    const string& consensusCaller,
+    const string& docsDirectory) :
+    largeDataFileNamePrefix(largeDataFileNamePrefix),
+    largeDataPageSize(largeDataPageSize),
+    consensusCaller(consensusCaller),
+    docsDirectory(docsDirectory)
+{
+}
+
+
+
+void LiveHttpServer::start(
+    const shared_ptr<LiveHttpServer>& server,
+    uint16_t port,
+    bool localOnly,
+    size_t threadCount)
+{
+    std::thread thread([server, port, localOnly, threadCount]()
+    {
+        // Lower the priority of this thread. On Linux the nice value
+        // is per thread and is inherited by the threads
+        // it creates, so this also applies to the threads
+        // that process requests.
+        ::setpriority(PRIO_PROCESS, id_t(::syscall(SYS_gettid)), 19);
+
+        try {
+            server->explore(port, localOnly, threadCount);
+        } catch(std::exception& e) {
+            cout << timestamp << "The live server stopped: " << e.what() << endl;
+        }
+    });
+    thread.detach();
+}
+
+
+
+void LiveHttpServer::publish(const string& stageName)
+{
+    // Create the new view. This only maps the data.
+    const shared_ptr<Assembler> newView =
+        make_shared<Assembler>(largeDataFileNamePrefix, false, largeDataPageSize);
+    newView->accessAllSoft(false);
+    newView->setupConsensusCaller(consensusCaller);
+    newView->setDocsDirectory(docsDirectory);
+
+    // Replace the previous view, which is destroyed
+    // when no request is using it.
+    shared_ptr<Assembler> oldView;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        oldView.swap(view);
+        view = newView;
+        completedStages.push_back(stageName);
+    }
+}
+
+
+
+bool LiveHttpServer::requiresExclusiveAccess(const vector<string>& request) const
+{
+    return Assembler::keywordRequiresExclusiveAccess(request.front());
+}
+
+
+
+void LiveHttpServer::processRequest(
+    const vector<string>& request,
+    ostream& html,
+    const BrowserInformation& browserInformation)
+{
+    const string& keyword = request.front();
+
+    if(keyword == "/" || keyword == "/liveStatus") {
+        writeStatus(html);
+        return;
+    }
+
+    if(keyword == "/stopRun") {
+        string confirm;
+        getParameterValue(request, "confirm", confirm);
+        if(confirm == "yes") {
+            if(!stopRequested) {
+                cout << timestamp << "Stop requested by the live server." << endl;
+            }
+            stopRequested = true;
+        }
+        writeStatus(html);
+        return;
+    }
+
+    shared_ptr<Assembler> currentView;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentView = view;
+    }
+    if(!currentView) {
+        writeStatus(html);
+        return;
+    }
+    currentView->processRequest(request, html, browserInformation);
+}
+
+
+
+void LiveHttpServer::writeStatus(ostream& html)
+{
+    html << "\r\n<!DOCTYPE html><html><head><meta charset='UTF-8'>"
+        "<title>Shasta run in progress</title>";
+    writeStyle(html);
+    html << "</head><body><h1>Shasta run in progress</h1>";
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(completedStages.empty()) {
+            html << "<p>No stage has completed yet.";
+        } else {
+            html << "<p>Completed stages:<ol>";
+            for(const string& stageName: completedStages) {
+                html << "<li>" << stageName;
+            }
+            html << "</ol><p><a href='exploreSummary'>Inspect the data of the completed stages</a>";
+        }
+    }
+
+    if(stopRequested) {
+        html << "<p>The run will stop at the end of the current stage.";
+    } else {
+        html << "<form action='stopRun'>"
+            "<input type=hidden name=confirm value=yes>"
+            "<input type=submit value='Stop the run at the end of the current stage'>"
+            "</form>";
+    }
+    html << "</body></html>";
+}
+
+
+
+void Assembler::startLiveServer(
+    uint16_t port,
+    bool localOnly,
+    size_t threadCount,
+    const string& consensusCaller)
+{
+    if(httpServerData.liveServer) {
+        throw runtime_error("The live server was already started.");
+    }
+    httpServerData.liveServer = make_shared<LiveHttpServer>(
+        largeDataFileNamePrefix, largeDataPageSize,
+        consensusCaller, httpServerData.docsDirectory);
+    LiveHttpServer::start(httpServerData.liveServer, port, localOnly, threadCount);
+}
+
+
+
+void Assembler::publishLiveView(const string& stageName)
+{
+    const shared_ptr<LiveHttpServer>& liveServer = httpServerData.liveServer;
+    if(!liveServer) {
+        return;
+    }
+    if(liveServer->stopWasRequested()) {
+        throw runtime_error("The run was stopped from the live server after stage " +
+            stageName + ".");
+    }
+    try {
+        liveServer->publish(stageName);
+    } catch(std::exception& e) {
+        cout << timestamp << "Could not publish the data of stage " << stageName <<
+            " to the live server: " << e.what() << endl;
+    }
+}
+
+#endif
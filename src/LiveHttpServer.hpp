@@ -0,0 +1,100 @@
+#ifndef SHASTA_STATIC_EXECUTABLE
+
+#ifndef CZI_SHASTA_LIVE_HTTP_SERVER_HPP
+#define CZI_SHASTA_LIVE_HTTP_SERVER_HPP
+
+/*******************************************************************************
+
+Class LiveHttpServer allows inspecting a run while it is still executing.
+It is started by Assembler::startLiveServer.
+
+The server runs in its own threads, at the lowest scheduling priority,
+so it only uses processors the assembly leaves idle.
+It never touches the data of the Assembler that runs the assembly.
+Instead, every time a stage completes, Assembler::publishLiveView
+calls publish, which creates a separate read-only view of the run:
+a second Assembler on the same binary data, with all the data
+that exist at that point accessed. This only maps the data,
+so it does not slow down the assembly.
+Requests are then processed by the most recent view.
+A request holds a reference to its view, so a view is
+only destroyed when no request is using it.
+
+Data created by a stage only become visible when the stage completes.
+Data that a later stage modifies in place are seen as they are modified.
+
+The "stopRun" page requests that the run stop at the end
+of the current stage, so a run with a wrong parameter
+can be stopped as soon as this is apparent.
+
+*******************************************************************************/
+
+#include "HttpServer.hpp"
+
+#include <atomic>
+#include "memory.hpp"
+#include <mutex>
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class Assembler;
+        class LiveHttpServer;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::LiveHttpServer : public HttpServer {
+public:
+
+    LiveHttpServer(
+        const string& largeDataFileNamePrefix,
+        size_t largeDataPageSize,
+        const string& consensusCaller,
+        const string& docsDirectory);
+
+    // Start the server in a separate low priority thread.
+    // The thread keeps a reference to the server, so the server
+    // stays available after the Assembler that started it is destroyed.
+    static void start(
+        const shared_ptr<LiveHttpServer>&,
+        uint16_t port,
+        bool localOnly,
+        size_t threadCount);
+
+    // Create a new view of the run after the given stage completed.
+    void publish(const string& stageName);
+
+    bool stopWasRequested() const
+    {
+        return stopRequested;
+    }
+
+private:
+    string largeDataFileNamePrefix;
+    size_t largeDataPageSize;
+    string consensusCaller;
+    string docsDirectory;
+
+    // The current view, null until the first stage completes,
+    // and the stages completed so far.
+    // Protected by the mutex.
+    shared_ptr<Assembler> view;
+    vector<string> completedStages;
+    std::mutex mutex;
+
+    std::atomic<bool> stopRequested {false};
+
+    void processRequest(
+        const vector<string>& request,
+        ostream& html,
+        const BrowserInformation&) override;
+    bool requiresExclusiveAccess(const vector<string>& request) const override;
+    void writeStatus(ostream& html);
+};
+
+#endif
+
+#endif
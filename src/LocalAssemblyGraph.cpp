@@ -74,18 +74,10 @@ int LocalAssemblyGraph::baseCount(edge_descriptor e) const
         return -1;
     }
 
-    // Get the repeat counts for this vertex.
+    // The sum of the repeat counts for this edge is stored.
     const LocalAssemblyGraph& graph = *this;
     const EdgeId edgeId = graph[e].edgeId;
-    const MemoryAsContainer<uint8_t> repeatCounts = globalAssemblyGraph.repeatCounts[edgeId];
-
-
-    // Add them up.
-    int count = 0;
-    for(const uint8_t repeatCount: repeatCounts) {
-        count += repeatCount;
-    }
-    return count;
+    return int(globalAssemblyGraph.repeatCounts.rawSize(edgeId));
 }
 
 
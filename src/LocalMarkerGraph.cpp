@@ -32,6 +32,7 @@ LocalMarkerGraph::LocalMarkerGraph(
     uint32_t k,
     LongBaseSequences& reads,
     const MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts,
+    const CompactRepeatCounts& compactReadRepeatCounts,
     const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
     const MemoryMapped::Vector<MarkerGraph::CompressedVertexId>& globalMarkerGraphVertex,
     const ConsensusCaller& consensusCaller
@@ -39,6 +40,7 @@ LocalMarkerGraph::LocalMarkerGraph(
     k(k),
     reads(reads),
     readRepeatCounts(readRepeatCounts),
+    compactReadRepeatCounts(compactReadRepeatCounts),
     markers(markers),
     globalMarkerGraphVertex(globalMarkerGraphVertex),
     consensusCaller(consensusCaller)
@@ -125,14 +127,14 @@ vector<uint8_t> LocalMarkerGraph::getRepeatCounts(
     const Strand strand = orientedReadId.getStrand();
     const CompressedMarker& marker = markers.begin()[markerInfo.markerId];
 
-    const auto& counts = readRepeatCounts[readId];
+    const uint64_t readLength = reads[readId].baseCount;
 
     vector<uint8_t> v(k);
     for(size_t i=0; i<k; i++) {
         if(strand == 0) {
-            v[i] = counts[marker.position + i];
+            v[i] = getReadRepeatCount(readId, marker.position + i);
         } else {
-            v[i] = counts[counts.size() - 1 - marker.position - i];
+            v[i] = getReadRepeatCount(readId, readLength - 1 - marker.position - i);
         }
     }
 
@@ -203,14 +205,15 @@ void LocalMarkerGraph::storeEdgeInfo(
         MarkerIntervalWithRepeatCounts intervalWithRepeatCounts(interval);
         if(marker1.position <= marker0.position + k) {
             sequence.overlappingBaseCount = uint8_t(marker0.position + k - marker1.position);
-            const auto& repeatCounts = readRepeatCounts[interval.orientedReadId.getReadId()];
+            const ReadId readId = interval.orientedReadId.getReadId();
+            const uint64_t readLength = reads[readId].baseCount;
             for(uint32_t i=0; i<sequence.overlappingBaseCount; i++) {
                 uint32_t position = marker1.position + i;
                 uint8_t repeatCount = 0;
                 if(interval.orientedReadId.getStrand() == 0) {
-                    repeatCount = repeatCounts[position];
+                    repeatCount = getReadRepeatCount(readId, position);
                 } else {
-                    repeatCount = repeatCounts[repeatCounts.size() - 1 - position];
+                    repeatCount = getReadRepeatCount(readId, readLength - 1 - position);
                 }
                 intervalWithRepeatCounts.repeatCounts.push_back(repeatCount);
             }
@@ -228,13 +231,13 @@ void LocalMarkerGraph::storeEdgeInfo(
                 }
                 sequence.sequence.push_back(base);
             }
-            const auto repeatCounts = readRepeatCounts[interval.orientedReadId.getReadId()];
+            const ReadId readId = interval.orientedReadId.getReadId();
             for(uint32_t position=marker0.position+k;  position!=marker1.position; position++) {
                 uint8_t repeatCount;
                 if(interval.orientedReadId.getStrand() == 0) {
-                    repeatCount = repeatCounts[position];
+                    repeatCount = getReadRepeatCount(readId, position);
                 } else {
-                    repeatCount = repeatCounts[readLength - 1 - position];
+                    repeatCount = getReadRepeatCount(readId, readLength - 1 - position);
                 }
                 intervalWithRepeatCounts.repeatCounts.push_back(repeatCount);
             }
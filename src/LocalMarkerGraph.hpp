@@ -18,6 +18,7 @@ a group of aligned markers.
 
 // Shasta.
 #include "AssemblyGraph.hpp"
+#include "CompactRepeatCounts.hpp"
 #include "Coverage.hpp"
 #include "Kmer.hpp"
 #include "MarkerGraph.hpp"
@@ -34,6 +35,7 @@ a group of aligned markers.
 // Standard library.
 #include "iostream.hpp"
 #include <map>
+#include <unordered_map>
 #include "string.hpp"
 #include "tuple.hpp"
 #include "utility.hpp"
@@ -242,6 +244,7 @@ public:
         uint32_t k,
         LongBaseSequences& reads,
         const MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts,
+        const CompactRepeatCounts& compactReadRepeatCounts,
         const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
         const MemoryMapped::Vector<MarkerGraph::CompressedVertexId>& globalMarkerGraphVertex,
         const ConsensusCaller&
@@ -397,7 +400,7 @@ public:
 private:
 
     // Map a global vertex id to a vertex descriptor for the local graph.
-    std::map<MarkerGraph::VertexId, vertex_descriptor> vertexMap;
+    std::unordered_map<MarkerGraph::VertexId, vertex_descriptor> vertexMap;
 
     // The length of k-mers used as markers.
     uint32_t k;
@@ -406,8 +409,20 @@ private:
     // (not just those in this local marker graph).
     LongBaseSequences& reads;
     const MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts;
+    const CompactRepeatCounts& compactReadRepeatCounts;
     const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers;
 
+    // Return the repeat count at a given position of a read, as stored,
+    // using readRepeatCounts if open, or else compactReadRepeatCounts.
+    uint8_t getReadRepeatCount(ReadId readId, uint64_t position) const
+    {
+        if(readRepeatCounts.isOpen()) {
+            return readRepeatCounts.begin(readId)[position];
+        } else {
+            return compactReadRepeatCounts.get(readId, position);
+        }
+    }
+
     // A reference to the vector containing the global marker graph vertex id
     // corresponding to each marker.
     // Indexed by MarkerId.
@@ -3,6 +3,8 @@ using namespace ChanZuckerberg;
 using namespace shasta;
 
 #include "vector.hpp"
+#include <algorithm>
+#include <random>
 
 
 
@@ -166,4 +168,44 @@ void ChanZuckerberg::shasta::testLongBaseSequence()
             cout << sequence << endl;
         }
     }
+
+
+
+    // Test the word-parallel reverse complement
+    // against the base by base version, for all lengths up to 300.
+    {
+        std::mt19937 randomSource;
+        for(uint64_t n=0; n<=300; n++) {
+            LongBaseSequence s(n);
+            vector<Base> v(n);
+            for(uint64_t i=0; i<n; i++) {
+                v[i] = Base::fromInteger(uint8_t(randomSource() % 4));
+                s.set(i, v[i]);
+            }
+
+            // Into a separate buffer.
+            LongBaseSequence t(n);
+            s.reverseComplement(t.begin);
+
+            // In place, base by base.
+            LongBaseSequence u(s);
+            u.reverseComplementBaseByBase();
+
+            // In place, word-parallel.
+            s.reverseComplement();
+
+            // Vector of bases.
+            reverseComplement(v);
+
+            for(uint64_t i=0; i<n; i++) {
+                CZI_ASSERT(t[i] == u[i]);
+                CZI_ASSERT(s[i] == u[i]);
+                CZI_ASSERT(v[i] == u[i]);
+            }
+            const uint64_t wordCount = LongBaseSequenceView::wordCount(n);
+            CZI_ASSERT(std::equal(s.begin, s.begin+wordCount, t.begin));
+            CZI_ASSERT(std::equal(s.begin, s.begin+wordCount, u.begin));
+        }
+        cout << "Reverse complement test passed." << endl;
+    }
 }
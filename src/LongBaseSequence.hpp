@@ -9,6 +9,7 @@
 #include "iostream.hpp"
 #include "stdexcept.hpp"
 #include "string.hpp"
+#include <cstring>
 
 namespace ChanZuckerberg {
     namespace shasta {
@@ -104,6 +105,23 @@ public:
 
     // In-place reverse complement.
     void reverseComplement()
+    {
+        reverseComplementWords(begin, begin, baseCount);
+    }
+
+    // Reverse complement into a buffer supplied by the caller,
+    // which must have space for wordCount(baseCount) words.
+    // This does not allocate memory and
+    // leaves this sequence unchanged, unless output==begin,
+    // in which case this is the same as the in-place reverse complement.
+    void reverseComplement(uint64_t* output) const
+    {
+        reverseComplementWords(begin, output, baseCount);
+    }
+
+    // Original base by base version of the in-place reverse complement,
+    // kept for testing.
+    void reverseComplementBaseByBase()
     {
         for(uint64_t i=0; i<baseCount/2; i++) {
             const uint64_t j = baseCount - 1 - i;
@@ -121,6 +139,75 @@ public:
 
 
 
+    // Reverse the bits of a 64-bit word.
+    static uint64_t reverseBits(uint64_t x)
+    {
+        x = ((x >> 1ULL) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1ULL);
+        x = ((x >> 2ULL) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2ULL);
+        x = ((x >> 4ULL) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4ULL);
+        return __builtin_bswap64(x);
+    }
+
+
+
+    // Word-parallel reverse complement of a sequence of baseCount bases
+    // stored in the representation described above.
+    // The output can be the same as the input (in-place reverse complement),
+    // but must not otherwise overlap it.
+    // Because each base has its two bits stored in the same position
+    // of two separate words, and the complement of a base flips both its bits,
+    // the reverse complement of a block of 64 bases is obtained by
+    // bit reversing and complementing each of its two words.
+    // We do that while also reversing the order of the blocks,
+    // then shift everything towards the beginning
+    // to remove the unused positions of the last block,
+    // which are now at the beginning. This leaves the unused positions
+    // of the last block set to zero, as LongBaseSequences::append does.
+    static void reverseComplementWords(
+        const uint64_t* input,
+        uint64_t* output,
+        uint64_t baseCount)
+    {
+        if(baseCount == 0) {
+            return;
+        }
+        const uint64_t blockCount = ((baseCount-1ULL) >> 6ULL) + 1ULL;
+
+        // Reverse the blocks and bit reverse and complement each word.
+        // Work from both ends, so this also works in place.
+        for(uint64_t i=0, j=blockCount-1; i<=j; i++, j--) {
+            const uint64_t i0 = input[2*i];
+            const uint64_t i1 = input[2*i+1];
+            const uint64_t j0 = input[2*j];
+            const uint64_t j1 = input[2*j+1];
+            output[2*i]   = ~reverseBits(j0);
+            output[2*i+1] = ~reverseBits(j1);
+            output[2*j]   = ~reverseBits(i0);
+            output[2*j+1] = ~reverseBits(i1);
+            if(j == 0) {
+                break;
+            }
+        }
+
+        // Shift towards the beginning by the number of unused positions
+        // in the last block.
+        const uint64_t shift = (blockCount << 6ULL) - baseCount;
+        if(shift == 0) {
+            return;
+        }
+        for(uint64_t i=0; i<blockCount; i++) {
+            for(uint64_t k=0; k<2; k++) {
+                uint64_t& word = output[2*i+k];
+                word <<= shift;
+                if(i+1 < blockCount) {
+                    word |= output[2*(i+1)+k] >> (64ULL - shift);
+                }
+            }
+        }
+    }
+
+
+
     // Compute the number of uint64_t words given the number of bases.
     static uint64_t wordCount(uint64_t baseCount)
     {
@@ -274,6 +361,19 @@ public:
     void append(const vector<Base>&);
     void append(size_t baseCount);
 
+    // The number of bases in each sequence.
+    const MemoryMapped::Vector<uint64_t>& getBaseCounts() const
+    {
+        return baseCount;
+    }
+
+    // Hash the base counts and the data.
+    uint64_t hash() const
+    {
+        const array<uint64_t, 2> hashes = {baseCount.hash(), data.hash()};
+        return MurmurHash64A(&hashes, int(sizeof(hashes)), 231);
+    }
+
 private:
 
     // The number of bases of each of the sequences.
@@ -287,23 +387,37 @@ private:
 
 
 // Reverse complement a vector of bases.
+// This works 8 bases at a time from both ends, using the fact that
+// each Base is stored in one byte and its complement is obtained
+// by flipping its two low order bits.
 inline void ChanZuckerberg::shasta::reverseComplement(vector<Base>&v)
 {
-    const size_t n = v.size();
-    const size_t nm1 = n - 1;
-    const size_t nHalf = n / 2;
+    static_assert(sizeof(Base) == 1, "Unexpected size of class Base.");
+    const uint64_t complementMask = 0x0303030303030303ULL;
+
+    size_t i = 0;
+    size_t j = v.size();
+    for(; j-i >= 16; i+=8, j-=8) {
+        uint64_t x, y;
+        std::memcpy(&x, &v[i].value, 8);
+        std::memcpy(&y, &v[j-8].value, 8);
+        x = __builtin_bswap64(x) ^ complementMask;
+        y = __builtin_bswap64(y) ^ complementMask;
+        std::memcpy(&v[i].value, &y, 8);
+        std::memcpy(&v[j-8].value, &x, 8);
+    }
 
-    for(size_t i=0; i<nHalf; i++) {
+    // Finish the bases in the middle, one at a time.
+    for(; j-i >= 2; i++, j--) {
         Base& x = v[i];
-        Base& y = v[nm1 - i];
+        Base& y = v[j-1];
         const Base xRc = x.complement();
         const Base yRc = y.complement();
         x = yRc;
         y = xRc;
     }
-
-    if((n % 2)) {
-        v[nHalf].complementInPlace();
+    if(j-i == 1) {
+        v[i].complementInPlace();
     }
 }
 
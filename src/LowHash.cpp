@@ -1,11 +1,16 @@
 // Shasta.
 #include "LowHash.hpp"
+#include "CompactMarkers.hpp"
+#include "computeFeatureHashes.hpp"
+#include "OrientedReadMarkers.hpp"
+#include "ReadFlagBitplanes.hpp"
 #include "ReadFlags.hpp"
 #include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
 // Standard library.
+#include "algorithm.hpp"
 #include "chrono.hpp"
 #include <numeric>
 
@@ -24,43 +29,115 @@ LowHash::LowHash(
     size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for minHash.
     size_t maxBucketSize,           // The maximum size for a bucket to be used.
     size_t minFrequency,            // Minimum number of minHash hits for a pair to be considered a candidate.
+    size_t method,                  // 0 = use buckets, 1 = sort the low hashes.
+    size_t candidateTableMegabytes, // If not 0, accumulate candidates in an AlignmentCandidateTable.
+    bool singlePassHashing,         // If true, compute the low hashes for all iterations at once.
     size_t threadCountArgument,
+    size_t k,
     const MemoryMapped::Vector<KmerInfo>& kmerTable,
     const MemoryMapped::Vector<ReadFlags>& readFlags,
     const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    const CompactMarkers* compactMarkers,
     MemoryMapped::Vector<OrientedReadPair>& candidateAlignments,
     const string& largeDataFileNamePrefix,
-    size_t largeDataPageSize
+    size_t largeDataPageSize,
+    LowHashSketches* sketches,
+    bool incremental,
+    uint64_t shardId,
+    uint64_t shardCount,
+    MemoryMapped::Vector<ShardCandidate>* shardCandidates,
+    double targetCandidatesPerRead,
+    const std::function<bool(const OrientedReadPair&)>& isGoodAlignment,
+    size_t sketchSize
     ) :
     MultithreadedObject(*this),
     m(m),
     hashFraction(hashFraction),
+    sketchSize(sketchSize),
     maxBucketSize(maxBucketSize),
     minFrequency(minFrequency),
+    method(method),
+    singlePassHashing(singlePassHashing),
     threadCount(threadCountArgument),
+    k(k),
     kmerTable(kmerTable),
     readFlags(readFlags),
     markers(markers),
+    compactMarkers(compactMarkers),
     largeDataFileNamePrefix(largeDataFileNamePrefix),
-    largeDataPageSize(largeDataPageSize)
+    largeDataPageSize(largeDataPageSize),
+    shardCandidates(shardCandidates),
+    sketches(sketches),
+    firstNewReadId(0),
+    useCandidateTable(candidateTableMegabytes > 0),
+    targetCandidatesPerRead(targetCandidatesPerRead),
+    isGoodAlignment(isGoodAlignment)
 
 {
     cout << timestamp << "LowHash begins." << endl;
     const auto tBegin = steady_clock::now();
 
+    if(method != 0 && method != 1) {
+        throw runtime_error("Invalid LowHash method " + to_string(method) + ". Must be 0 or 1.");
+    }
+
     // Adjust the numbers of threads, if necessary.
     if(threadCount == 0) {
         threadCount = std::thread::hardware_concurrency();
     }
     cout << "Using " << threadCount << " threads." << endl;
 
+    // For a sharded computation, minFrequency is applied
+    // after the candidates of all shards are merged.
+    CZI_ASSERT(shardId < shardCount);
+    if(shardCandidates) {
+        CZI_ASSERT(!sketches);
+        this->minFrequency = 1;
+        cout << "Computing LowHash shard " << shardId << " of " << shardCount << "." << endl;
+    } else {
+        CZI_ASSERT(shardCount == 1);
+    }
+    if(targetCandidatesPerRead > 0.) {
+        CZI_ASSERT(!shardCandidates);
+        CZI_ASSERT(!incremental);
+        CZI_ASSERT(isGoodAlignment);
+        cout << "Adaptive LowHash with a target of " << targetCandidatesPerRead <<
+            " alignment candidates per oriented read." << endl;
+    }
+
+    if(sketchSize) {
+        if(sketches) {
+            throw runtime_error("Storing LowHash sketches is not supported in bottom-k mode.");
+        }
+        cout << "Bottom-k mode: each oriented read contributes its " << sketchSize <<
+            " lowest feature hashes at each iteration." << endl;
+    }
+
+    // Find the reads that don't participate: palindromic or excluded.
+    {
+        ReadFlagBitplanes readFlagBitplanes;
+        readFlagBitplanes.createFromReadFlags(readFlags);
+        readFlagBitplanes.getAnyMask(
+            ReadFlagBitplanes::flagBit(ReadFlagBitplanes::isPalindromic) |
+            ReadFlagBitplanes::flagBit(ReadFlagBitplanes::isExcluded),
+            skippedReadMask);
+    }
+
 
     // Estimate the total number of low hashes and its base 2 log.
     // Except for very short reads, each marker generates a feature,
     // and each feature generates a low hash with probability hashFraction.
     // So an estimate of the total number of hashes is:
-    const uint64_t totalLowHashCountEstimate =
-        uint64_t(hashFraction * double(markers.totalSize()));
+    // Each shard only sees its portion of the low hashes.
+    // If markers are stored for strand 0 only, the total number
+    // of oriented markers is twice the number stored.
+    // In bottom-k mode, each oriented read generates sketchSize low hashes.
+    // The compact markers are always stored for both strands.
+    const uint64_t orientedMarkerCount = compactMarkers ? compactMarkers->totalSize() :
+        (markers.size() == readFlags.size() ? 2 : 1) * markers.totalSize();
+    const uint64_t totalLowHashCountEstimate = (sketchSize ?
+        uint64_t(sketchSize) * 2ULL * readFlags.size() :
+        uint64_t(hashFraction * double(orientedMarkerCount))) / shardCount;
     const uint32_t leadingZeroBitCount = uint32_t(__builtin_clzl(totalLowHashCountEstimate));
     const uint32_t log2TotalLowHashCountEstimate = 64 - leadingZeroBitCount;
 
@@ -95,49 +172,145 @@ LowHash::LowHash(
     createKmerIds();
 
     // Compute the threshold for a hash value to be considered low.
-    hashThreshold = uint64_t(double(hashFraction) * double(std::numeric_limits<uint64_t>::max()));
+    // In bottom-k mode, there is no threshold.
+    hashThreshold = sketchSize ? std::numeric_limits<uint64_t>::max() :
+        uint64_t(double(hashFraction) * double(std::numeric_limits<uint64_t>::max()));
+
+    // The range of low hashes used by this shard.
+    const uint64_t shardHashSize = hashThreshold / shardCount;
+    shardHashBegin = shardId * shardHashSize;
+    shardHashEnd = (shardId == shardCount - 1) ? hashThreshold : shardHashBegin + shardHashSize;
 
     // The number of oriented reads, each with its own vector of markers.
-    const OrientedReadId::Int orientedReadCount = OrientedReadId::Int(markers.size());
-    const ReadId readCount = orientedReadCount / 2;
+    const ReadId readCount = ReadId(readFlags.size());
+    const OrientedReadId::Int orientedReadCount = 2 * readCount;
     cout << "There are " << readCount << " reads, " << orientedReadCount << " oriented reads." << endl;
     CZI_ASSERT(orientedReadCount == 2*readCount);
 
 
 
     // Set up work areas.
-    buckets.createNew(
-            largeDataFileNamePrefix + "tmp-LowHash-Buckets",
-            largeDataPageSize);
-    lowHashes.resize(orientedReadCount);
-    candidates.resize(readCount);
+    if(method == 0) {
+        buckets.createNew(
+                largeDataFileNamePrefix + "tmp-LowHash-Buckets",
+                largeDataPageSize);
+        lowHashes.resize(orientedReadCount);
+    } else {
+        cout << "LowHash will sort low hashes instead of using buckets." << endl;
+        sortedHashEntries.createNew(
+                largeDataFileNamePrefix + "tmp-LowHash-SortedHashEntries",
+                largeDataPageSize);
+        threadHashEntries.resize(threadCount);
+        threadPartitionSizes.resize(threadCount, vector<uint64_t>(partitionCount));
+        threadPartitionBegin.resize(threadCount, vector<uint64_t>(partitionCount));
+        threadCandidates.resize(threadCount);
+    }
+    if(useCandidateTable) {
+        candidateTable.createNew(
+            largeDataFileNamePrefix + "tmp-LowHash-CandidateTable",
+            largeDataPageSize,
+            uint64_t(candidateTableMegabytes) * 1024ULL * 1024ULL);
+        cout << "Alignment candidates will be accumulated in a hash table with " <<
+            candidateTable.capacity() << " slots." << endl;
+    } else {
+        candidates.resize(readCount);
+    }
     threadStatistics.resize(threadCount);
 
+    // Storing the low hashes requires computing them in a single pass.
+    // For an incremental computation, get the number of old reads.
+    if(sketches) {
+        this->singlePassHashing = true;
+        if(incremental) {
+            CZI_ASSERT(sketches->isOpen());
+            CZI_ASSERT(sketches->info->m == m);
+            CZI_ASSERT(sketches->info->hashFraction == hashFraction);
+            CZI_ASSERT(sketches->info->iterationCount == minHashIterationCount);
+            firstNewReadId = ReadId(sketches->info->readCount);
+            CZI_ASSERT(firstNewReadId <= readCount);
+            CZI_ASSERT(sketches->lowHashes.size() == 2 * uint64_t(firstNewReadId));
+            cout << "Incremental computation: " << firstNewReadId << " old reads, " <<
+                readCount - firstNewReadId << " new reads." << endl;
+        }
+    } else {
+        CZI_ASSERT(!incremental);
+    }
+
+    // If requested, compute the low hashes for all iterations
+    // in a single pass over the k-mer ids.
+    // After this, the k-mer ids are no longer needed.
+    iterationCount = minHashIterationCount;
+    if(this->singlePassHashing) {
+        cout << timestamp << "Computing low hashes for all iterations." << endl;
+        allLowHashes.resize(orientedReadCount);
+        allLowHashesBegin.resize(orientedReadCount);
+        setupLoadBalancing(readCount, 1000);
+        runThreads(&LowHash::computeAllLowHashesThreadFunction, threadCount);
+        kmerIds.remove();
+        uint64_t lowHashCount = 0;
+        for(const auto& v: allLowHashes) {
+            lowHashCount += v.size();
+        }
+        cout << "Stored " << lowHashCount << " low hashes for " <<
+            minHashIterationCount << " iterations." << endl;
+        if(sketches) {
+            storeSketches();
+        }
+    }
+
+    // Cumulative statistics when using the candidateTable.
+    uint64_t candidateTableHighFrequency = 0;
+    uint64_t candidateTableTotal = 0;
+    uint64_t candidateTableDropped = 0;
+
 
 
     // LowHash iteration loop.
     for(iteration=0; iteration<minHashIterationCount; iteration++) {
         cout << timestamp << "LowHash iteration " << iteration << " begins." << endl;
 
-        // Pass1: compute the low hashes for each oriented read
-        // and prepare the buckets for filling.
-        buckets.clear();
-        buckets.beginPass1(bucketCount);
-        size_t batchSize = 10000;
-        setupLoadBalancing(readCount, batchSize);
-        runThreads(&LowHash::pass1ThreadFunction, threadCount);
-
-        // Pass 2: fill the buckets.
-        buckets.beginPass2();
-        batchSize = 10000;
-        setupLoadBalancing(readCount, batchSize);
-        runThreads(&LowHash::pass2ThreadFunction, threadCount);
-        buckets.endPass2(false, false);
-
-        // Pass 3: inspect the buckets to find candidates.
-        batchSize = 10000;
-        setupLoadBalancing(readCount, batchSize);
-        runThreads(&LowHash::pass3ThreadFunction, threadCount);
+        if(method == 0) {
+
+            // Pass1: compute the low hashes for each oriented read
+            // and prepare the buckets for filling.
+            buckets.clear();
+            buckets.beginPass1(bucketCount);
+            size_t batchSize = 10000;
+            setupLoadBalancing(readCount, batchSize);
+            runThreads(&LowHash::pass1ThreadFunction, threadCount);
+
+            // Pass 2: fill the buckets.
+            buckets.beginPass2();
+            batchSize = 10000;
+            setupLoadBalancing(readCount, batchSize);
+            runThreads(&LowHash::pass2ThreadFunction, threadCount);
+            buckets.endPass2(false, false);
+
+            // Pass 3: inspect the buckets to find candidates.
+            batchSize = 10000;
+            setupLoadBalancing(readCount, batchSize);
+            runThreads(&LowHash::pass3ThreadFunction, threadCount);
+
+        } else {
+
+            // Pass 1: compute the low hashes for each oriented read.
+            const size_t batchSize = 10000;
+            setupLoadBalancing(readCount, batchSize);
+            runThreads(&LowHash::sortPass1ThreadFunction, threadCount);
+
+            // Pass 2: sort them.
+            sortHashEntries();
+
+            // Pass 3: scan runs of equal hashes to find candidates.
+            setupLoadBalancing(partitionCount, 1);
+            runThreads(&LowHash::sortPass3ThreadFunction, threadCount);
+
+            // Pass 4: merge them into the stored candidates.
+            if(!useCandidateTable) {
+                setupLoadBalancing(readCount, batchSize);
+                runThreads(&LowHash::sortPass4ThreadFunction, threadCount);
+            }
+        }
 
         // Write a summary for this iteration.
         uint64_t highFrequency = 0;
@@ -148,37 +321,124 @@ LowHash::LowHash(
             total += s.total;
             capacity += s.capacity;
         }
+        if(useCandidateTable) {
+            for(const auto& s: threadStatistics) {
+                candidateTableDropped += s.dropped;
+            }
+            candidateTableHighFrequency += highFrequency;
+            candidateTableTotal += total;
+            highFrequency = candidateTableHighFrequency;
+            total = candidateTableTotal;
+            capacity = candidateTable.capacity();
+        }
         cout << "Alignment candidates after iteration " << iteration;
         cout << ": high frequency " << highFrequency;
         cout << ", total " << total;
         cout << ", capacity " << capacity << "." << endl;
+
+        if(targetCandidatesPerRead > 0. && adaptiveStop(highFrequency)) {
+            cout << "Adaptive LowHash stopped after " << iteration + 1 <<
+                " of " << minHashIterationCount << " iterations." << endl;
+            break;
+        }
+    }
+    if(candidateTableDropped > 0) {
+        cout << "The alignment candidate table was too small and " <<
+            candidateTableDropped << " candidate hits were discarded. "
+            "Consider increasing the memory for the alignment candidate table." << endl;
+    }
+
+
+
+    // In adaptive mode, adjust minFrequency before
+    // the candidates are stored.
+    if(targetCandidatesPerRead > 0.) {
+        adaptiveFinish();
     }
 
 
 
     // Create the candidate alignments.
+    // For a sharded computation, store them in the shardCandidates
+    // instead, with their frequencies.
     cout << timestamp << "Storing candidate alignments." << endl;
     CZI_ASSERT(orientedReadCount == 2*readCount);
-    for(ReadId readId0=0; readId0<readCount; readId0++) {
-        const auto& candidates0 = candidates[readId0];
-        for(const Candidate& candidate: candidates0) {
-            if(candidate.frequency >= minFrequency) {
-                const ReadId readId1 = candidate.readId1;
-                CZI_ASSERT(readId0 < readId1);
-                candidateAlignments.push_back(
-                    OrientedReadPair(readId0, readId1, candidate.strand==0));
+    const auto storeCandidate = [&](ReadId readId0, ReadId readId1, uint64_t strand, uint64_t frequency)
+    {
+        CZI_ASSERT(readId0 < readId1);
+        if(shardCandidates) {
+            shardCandidates->push_back(
+                ShardCandidate{AlignmentCandidateTable::makeKey(readId0, readId1, strand), frequency});
+        } else {
+            candidateAlignments.push_back(OrientedReadPair(readId0, readId1, strand==0));
+        }
+    };
+    if(useCandidateTable) {
+
+        // Extract the candidates from the hash table in parallel.
+        threadCandidateKeys.resize(threadCount);
+        setupLoadBalancing(candidateTable.capacity(), 1ULL << 16);
+        runThreads(&LowHash::extractCandidatesThreadFunction, threadCount);
+
+        // Merge the sorted keys found by each thread.
+        // Key order is the same as the order of candidates
+        // in the candidates vectors, so the result is the same.
+        vector<uint64_t> next(threadCount, 0);
+        while(true) {
+            size_t bestThreadId = threadCount;
+            for(size_t threadId=0; threadId<threadCount; threadId++) {
+                const auto& keys = threadCandidateKeys[threadId];
+                if(next[threadId] != keys.size() &&
+                    (bestThreadId == threadCount ||
+                    keys[next[threadId]].first < threadCandidateKeys[bestThreadId][next[bestThreadId]].first)) {
+                    bestThreadId = threadId;
+                }
+            }
+            if(bestThreadId == threadCount) {
+                break;
+            }
+            const auto& p = threadCandidateKeys[bestThreadId][next[bestThreadId]++];
+            const uint64_t key = p.first;
+            storeCandidate(
+                AlignmentCandidateTable::getReadId0(key),
+                AlignmentCandidateTable::getReadId1(key),
+                AlignmentCandidateTable::getStrand(key),
+                p.second);
+        }
+        threadCandidateKeys.clear();
+
+    } else {
+        for(ReadId readId0=0; readId0<readCount; readId0++) {
+            const auto& candidates0 = candidates[readId0];
+            for(const Candidate& candidate: candidates0) {
+                if(candidate.frequency >= minFrequency) {
+                    storeCandidate(readId0, candidate.readId1, candidate.strand, candidate.frequency);
+                }
             }
         }
     }
-    cout << "Found " << candidateAlignments.size() << " alignment candidates."<< endl;
+    const uint64_t candidateCount =
+        shardCandidates ? shardCandidates->size() : candidateAlignments.size();
+    cout << "Found " << candidateCount << " alignment candidates."<< endl;
     cout << "Average number of alignment candidates per oriented read is ";
-    cout << (2.* double(candidateAlignments.size())) / double(orientedReadCount)  << "." << endl;
+    cout << (2.* double(candidateCount)) / double(orientedReadCount)  << "." << endl;
 
 
 
     // Clean up work areas.
-    buckets.remove();
-    kmerIds.remove();
+    if(method == 0) {
+        buckets.remove();
+    } else {
+        sortedHashEntries.remove();
+    }
+    if(useCandidateTable) {
+        candidateTable.remove();
+    }
+    if(kmerIds.isOpen()) {
+        kmerIds.remove();
+    }
+    allLowHashes.clear();
+    allLowHashesBegin.clear();
 
 
 
@@ -195,14 +455,18 @@ void LowHash::createKmerIds()
     kmerIds.createNew(
         largeDataFileNamePrefix + "tmp-LowHash-Markers",
         largeDataPageSize);
-    const ReadId orientedReadCount = ReadId(markers.size());
-    const ReadId readCount = orientedReadCount / 2;
+    const ReadId readCount = ReadId(readFlags.size());
+    const ReadId orientedReadCount = 2 * readCount;
     kmerIds.beginPass1(orientedReadCount);
     for(ReadId readId=0; readId!=readCount; readId++) {
         for(Strand strand=0; strand<2; strand++) {
             const OrientedReadId orientedReadId(readId, strand);
-            const auto markerCount = markers.size(orientedReadId.getValue());
-            kmerIds.incrementCount(orientedReadId.getValue(), markerCount);
+            if(compactMarkers) {
+                kmerIds.incrementCount(orientedReadId.getValue(), compactMarkers->size(orientedReadId));
+                continue;
+            }
+            const OrientedReadMarkers orientedReadMarkers(markers, readCount, orientedReadId, 0, k);
+            kmerIds.incrementCount(orientedReadId.getValue(), orientedReadMarkers.size());
         }
     }
     kmerIds.beginPass2();
@@ -217,6 +481,8 @@ void LowHash::createKmerIds()
 // Thread function for createKmerIds.
 void LowHash::createKmerIds(size_t threadId)
 {
+    const ReadId readCount = ReadId(readFlags.size());
+    vector<KmerId> orientedReadKmerIds;
 
     // Loop over batches assigned to this thread.
     uint64_t begin, end;
@@ -226,13 +492,24 @@ void LowHash::createKmerIds(size_t threadId)
         for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
             for(Strand strand=0; strand<2; strand++) {
                 const OrientedReadId orientedReadId(readId, strand);
-                const auto orientedReadMarkers = markers[orientedReadId.getValue()];
+
+                // With compact markers, decode the k-mer ids directly.
+                if(compactMarkers) {
+                    compactMarkers->getKmerIds(orientedReadId, orientedReadKmerIds);
+                    CZI_ASSERT(kmerIds.size(orientedReadId.getValue()) == orientedReadKmerIds.size());
+                    copy(orientedReadKmerIds.begin(), orientedReadKmerIds.end(),
+                        kmerIds.begin(orientedReadId.getValue()));
+                    continue;
+                }
+
+                // Only k-mer ids are used, so the read length is not needed.
+                const OrientedReadMarkers orientedReadMarkers(markers, readCount, orientedReadId, 0, k);
 
                 CZI_ASSERT(kmerIds.size(orientedReadId.getValue()) == orientedReadMarkers.size());
 
                 auto pointer = kmerIds.begin(orientedReadId.getValue());
-                for(const CompressedMarker& marker: orientedReadMarkers) {
-                    *pointer++ = marker.kmerId;
+                for(uint64_t ordinal=0; ordinal<orientedReadMarkers.size(); ordinal++) {
+                    *pointer++ = orientedReadMarkers.kmerId(ordinal);
                 }
             }
         }
@@ -245,50 +522,169 @@ void LowHash::createKmerIds(size_t threadId)
 // and prepare the buckets for filling.
 void LowHash::pass1ThreadFunction(size_t threadId)
 {
-    const int featureByteCount = int(m * sizeof(KmerId));
-    const uint64_t seed = iteration * 37;
+    vector<uint64_t> featureHashes;
 
     // Loop over batches assigned to this thread.
     uint64_t begin, end;
     while(getNextBatch(begin, end)) {
 
         // Loop over oriented reads assigned to this batch.
-        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
-            if(readFlags[readId].isPalindromic) {
-                continue;
-            }
+        for(ReadId readId=ReadFlagBitplanes::nextUnset(skippedReadMask, ReadId(begin), ReadId(end));
+            readId!=ReadId(end);
+            readId=ReadFlagBitplanes::nextUnset(skippedReadMask, readId+1, ReadId(end))) {
             for(Strand strand=0; strand<2; strand++) {
                 const OrientedReadId orientedReadId(readId, strand);
 
                 vector<uint64_t>& orientedReadLowHashes = lowHashes[orientedReadId.getValue()];
-                orientedReadLowHashes.clear();
-                const size_t markerCount = kmerIds.size(orientedReadId.getValue());
-
-                // Handle the pathological case where there are fewer than m markers.
-                // This oriented read ends up in no bucket.
-                if(markerCount < m) {
-                    continue;
+                getLowHashes(orientedReadId, orientedReadLowHashes, featureHashes);
+                for(const uint64_t hash: orientedReadLowHashes) {
+                    const uint64_t bucketId = hash & mask;
+                    buckets.incrementCountMultithreaded(bucketId);
                 }
+            }
+        }
+    }
 
+}
 
-                // Get the markers for this oriented read.
-                KmerId* kmerIdsPointer = kmerIds.begin(orientedReadId.getValue());
-                const size_t featureCount = markerCount - m + 1;
 
-                // Loop over features of this oriented read.
-                // Features are sequences of m consecutive markers.
-                for(size_t j=0; j<featureCount; j++, kmerIdsPointer++) {
-                    const uint64_t hash = MurmurHash64A(kmerIdsPointer, featureByteCount, seed);
-                    if(hash < hashThreshold) {
-                        orientedReadLowHashes.push_back(hash);
-                        const uint64_t bucketId = hash & mask;
-                        buckets.incrementCountMultithreaded(bucketId);
+
+// Append to a vector the low hashes of an oriented read
+// at a given iteration. The second vector is a work area.
+void LowHash::appendLowHashes(
+    OrientedReadId orientedReadId,
+    size_t iterationArgument,
+    vector<uint64_t>& orientedReadLowHashes,
+    vector<uint64_t>& featureHashes) const
+{
+    const uint64_t seed = iterationArgument * 37;
+    const size_t markerCount = kmerIds.size(orientedReadId.getValue());
+
+    // Handle the pathological case where there are fewer than m markers.
+    // This oriented read ends up in no bucket.
+    if(markerCount < m) {
+        return;
+    }
+
+    // Hash all the features of this oriented read.
+    // Features are sequences of m consecutive markers.
+    const size_t featureCount = markerCount - m + 1;
+    featureHashes.resize(featureCount);
+    computeFeatureHashes(kmerIds.begin(orientedReadId.getValue()),
+        featureCount, m, seed, featureHashes.data());
+
+    // In bottom-k mode, only the sketchSize lowest hashes are low hashes.
+    if(sketchSize && featureCount > sketchSize) {
+        std::nth_element(featureHashes.begin(), featureHashes.begin() + int64_t(sketchSize - 1),
+            featureHashes.end());
+        featureHashes.resize(sketchSize);
+    }
+
+    // Keep the low ones that belong to this shard.
+    for(const uint64_t hash: featureHashes) {
+        if(hash >= shardHashBegin && hash < shardHashEnd) {
+            orientedReadLowHashes.push_back(hash);
+        }
+    }
+}
+
+
+
+// Get the low hashes of an oriented read at the current iteration,
+// computing them or taking them from allLowHashes.
+void LowHash::getLowHashes(
+    OrientedReadId orientedReadId,
+    vector<uint64_t>& orientedReadLowHashes,
+    vector<uint64_t>& featureHashes) const
+{
+    orientedReadLowHashes.clear();
+    if(singlePassHashing) {
+        const vector<uint64_t>& v = allLowHashes[orientedReadId.getValue()];
+        const vector<uint32_t>& vBegin = allLowHashesBegin[orientedReadId.getValue()];
+        orientedReadLowHashes.insert(orientedReadLowHashes.end(),
+            v.begin() + vBegin[iteration], v.begin() + vBegin[iteration + 1]);
+    } else {
+        appendLowHashes(orientedReadId, iteration, orientedReadLowHashes, featureHashes);
+    }
+}
+
+
+
+// Compute the low hashes of all iterations for each oriented read.
+// The k-mer ids of each oriented read are read from memory
+// once and stay in cache while we loop over iterations.
+void LowHash::computeAllLowHashesThreadFunction(size_t threadId)
+{
+    vector<uint64_t> featureHashes;
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over oriented reads assigned to this batch.
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            for(Strand strand=0; strand<2; strand++) {
+                const OrientedReadId orientedReadId(readId, strand);
+                vector<uint64_t>& v = allLowHashes[orientedReadId.getValue()];
+                vector<uint32_t>& vBegin = allLowHashesBegin[orientedReadId.getValue()];
+
+                // For an old read, use the stored low hashes.
+                if(readId < firstNewReadId) {
+                    const uint64_t i = orientedReadId.getValue();
+                    v.assign(sketches->lowHashes.begin(i), sketches->lowHashes.end(i));
+                    vBegin.assign(sketches->lowHashesBegin.begin(i), sketches->lowHashesBegin.end(i));
+                    CZI_ASSERT(vBegin.size() == iterationCount + 1);
+                    continue;
+                }
+
+                vBegin.resize(iterationCount + 1);
+                for(size_t i=0; i<iterationCount; i++) {
+                    vBegin[i] = uint32_t(v.size());
+                    if(!ReadFlagBitplanes::isSet(skippedReadMask, readId)) {
+                        appendLowHashes(orientedReadId, i, v, featureHashes);
                     }
                 }
+                vBegin[iterationCount] = uint32_t(v.size());
+                v.shrink_to_fit();
             }
         }
     }
+}
+
+
+
+// Store the low hashes of all iterations in the sketches,
+// replacing their previous contents.
+// The caller is responsible for setting info->markerKmersHash.
+void LowHash::storeSketches()
+{
+    cout << timestamp << "Storing low hashes." << endl;
+    const uint64_t orientedReadCount = allLowHashes.size();
 
+    if(sketches->isOpen()) {
+        sketches->remove();
+    }
+    sketches->createNew(sketches->name, largeDataPageSize);
+    sketches->info->m = m;
+    sketches->info->hashFraction = hashFraction;
+    sketches->info->iterationCount = iterationCount;
+    sketches->info->readCount = orientedReadCount / 2;
+    sketches->info->markerKmersHash = 0;
+
+    sketches->lowHashes.beginPass1(orientedReadCount);
+    sketches->lowHashesBegin.beginPass1(orientedReadCount);
+    for(uint64_t i=0; i<orientedReadCount; i++) {
+        sketches->lowHashes.incrementCount(i, allLowHashes[i].size());
+        sketches->lowHashesBegin.incrementCount(i, allLowHashesBegin[i].size());
+    }
+    sketches->lowHashes.beginPass2();
+    sketches->lowHashesBegin.beginPass2();
+    sketches->lowHashes.endPass2(false);
+    sketches->lowHashesBegin.endPass2(false);
+    for(uint64_t i=0; i<orientedReadCount; i++) {
+        copy(allLowHashes[i].begin(), allLowHashes[i].end(), sketches->lowHashes.begin(i));
+        copy(allLowHashesBegin[i].begin(), allLowHashesBegin[i].end(), sketches->lowHashesBegin.begin(i));
+    }
 }
 
 
@@ -302,10 +698,9 @@ void LowHash::pass2ThreadFunction(size_t threadId)
     while(getNextBatch(begin, end)) {
 
         // Loop over oriented reads assigned to this batch.
-        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
-            if(readFlags[readId].isPalindromic) {
-                continue;
-            }
+        for(ReadId readId=ReadFlagBitplanes::nextUnset(skippedReadMask, ReadId(begin), ReadId(end));
+            readId!=ReadId(end);
+            readId=ReadFlagBitplanes::nextUnset(skippedReadMask, readId+1, ReadId(end))) {
             for(Strand strand=0; strand<2; strand++) {
                 const OrientedReadId orientedReadId(readId, strand);
                 const vector<uint64_t>& orientedReadLowHashes = lowHashes[orientedReadId.getValue()];
@@ -370,34 +765,498 @@ void LowHash::pass3ThreadFunction(size_t threadId)
                             continue;
                         }
 
-                        // Add it to our work area.
+                        // In an incremental computation, skip it if both reads are old.
+                        if(readId1 < firstNewReadId) {
+                            continue;
+                        }
+
+                        // Add it to our work area, or directly to the candidateTable.
                         const bool isSameStrand = orientedReadId1.getStrand() == strand0;
-                        newCandidates.push_back(Candidate(readId1, isSameStrand? 0 : 1));
+                        const Candidate candidate(readId1, isSameStrand? 0 : 1);
+                        if(useCandidateTable) {
+                            addToCandidateTable(readId0, candidate, thisThreadStatistics);
+                        } else {
+                            newCandidates.push_back(candidate);
+                        }
                     }
                 }
             }
 
-            // Sort the candidates found during this iteration.
-            sort(newCandidates.begin(), newCandidates.end());
+            if(!useCandidateTable) {
+                storeNewCandidates(readId0, newCandidates, mergedCandidates, thisThreadStatistics);
+            }
+        }
+    }
+}
+
 
-            // Merge the contents of the work area
-            // with the candidates previously stored.
-            vector<Candidate>& storedCandidates = candidates[readId0];
-            mergedCandidates.clear();
-            merge(storedCandidates, newCandidates, mergedCandidates);
 
-            // Store the merged candidates in place of the old ones.
-            storedCandidates.resize(mergedCandidates.size());
-            copy(mergedCandidates.begin(), mergedCandidates.end(), storedCandidates.begin());
+// Merge new candidates for readId0 into the stored candidates
+// and update thread statistics.
+// The new candidates don't have to be sorted.
+void LowHash::storeNewCandidates(
+    ReadId readId0,
+    vector<Candidate>& newCandidates,
+    vector<Candidate>& mergedCandidates,
+    ThreadStatistics& thisThreadStatistics)
+{
+    // Sort the candidates found during this iteration.
+    sort(newCandidates.begin(), newCandidates.end());
+
+    // Merge the contents of the work area
+    // with the candidates previously stored.
+    vector<Candidate>& storedCandidates = candidates[readId0];
+    mergedCandidates.clear();
+    merge(storedCandidates, newCandidates, mergedCandidates);
+
+    // Store the merged candidates in place of the old ones.
+    storedCandidates.resize(mergedCandidates.size());
+    copy(mergedCandidates.begin(), mergedCandidates.end(), storedCandidates.begin());
+
+    // Update thread statistics.
+    thisThreadStatistics.total += storedCandidates.size();
+    thisThreadStatistics.capacity += storedCandidates.capacity();
+    for(const Candidate& candidate: storedCandidates) {
+        if(candidate.frequency >= minFrequency) {
+            ++thisThreadStatistics.highFrequency;
+        }
+    }
+}
 
-            // Update thread statistics.
-            thisThreadStatistics.total += storedCandidates.size();
-            thisThreadStatistics.capacity += storedCandidates.capacity();
-            for(const Candidate& candidate: storedCandidates) {
-                if(candidate.frequency >= minFrequency) {
-                    ++thisThreadStatistics.highFrequency;
+
+
+// Add a candidate to the candidateTable and update thread statistics.
+void LowHash::addToCandidateTable(
+    ReadId readId0,
+    const Candidate& candidate,
+    ThreadStatistics& thisThreadStatistics)
+{
+    const uint64_t key = AlignmentCandidateTable::makeKey(readId0, candidate.readId1, candidate.strand);
+    const uint32_t frequency = candidateTable.increment(key);
+    if(frequency == 0) {
+        ++thisThreadStatistics.dropped;
+        return;
+    }
+    if(frequency == 1) {
+        ++thisThreadStatistics.total;
+    }
+    if(frequency == max(uint32_t(minFrequency), uint32_t(1))) {
+        ++thisThreadStatistics.highFrequency;
+    }
+}
+
+
+
+// Adaptive mode: decide, after each iteration, whether to stop.
+bool LowHash::adaptiveStop(uint64_t highFrequency)
+{
+    const double orientedReadCount = 2. * double(readFlags.size());
+    const double candidatesPerRead = 2. * double(highFrequency) / orientedReadCount;
+    const uint64_t newCount = highFrequency - adaptivePreviousHighFrequency;
+    adaptivePreviousHighFrequency = highFrequency;
+
+    // Until minFrequency iterations are done, no candidate
+    // can have been found minFrequency times.
+    if(iteration + 1 < minFrequency) {
+        return false;
+    }
+
+    // Further iterations can only add candidates.
+    if(candidatesPerRead >= targetCandidatesPerRead) {
+        cout << "Reached " << candidatesPerRead <<
+            " alignment candidates per oriented read." << endl;
+        return true;
+    }
+
+    // Most of the pairs found by further iterations will be
+    // candidates that reach minFrequency. If these rarely align,
+    // further iterations increase the cost of computeAlignments
+    // without finding many more good alignments.
+    const double successRate = sampleSuccessRate(minFrequency);
+    if(successRate >= 0.) {
+        cout << "Sampled alignment success rate for candidates found " <<
+            minFrequency << " times: " << successRate << endl;
+    }
+    if(successRate >= 0. && successRate < adaptiveMinSuccessRate) {
+        return true;
+    }
+
+    // If this iteration found few new candidates, we are
+    // already finding most of the overlaps.
+    if(double(newCount) < adaptiveMinGrowth * double(highFrequency)) {
+        cout << "The last LowHash iteration found only " << newCount <<
+            " new alignment candidates." << endl;
+        return true;
+    }
+
+    return false;
+}
+
+
+
+// Adaptive mode: adjust minFrequency after the last iteration.
+void LowHash::adaptiveFinish()
+{
+    vector<uint64_t> histogram;
+    computeFrequencyHistogram(histogram);
+
+    // The number of candidates with frequency at least f.
+    vector<uint64_t> cumulativeHistogram(histogram.size() + 1, 0);
+    for(uint64_t f=histogram.size(); f>0; f--) {
+        cumulativeHistogram[f - 1] = cumulativeHistogram[f] + histogram[f - 1];
+    }
+    const auto candidateCount = [&](uint64_t f)
+    {
+        return f < cumulativeHistogram.size() ? cumulativeHistogram[f] : 0;
+    };
+    const double orientedReadCount = 2. * double(readFlags.size());
+    const double targetCandidateCount = targetCandidatesPerRead * orientedReadCount / 2.;
+
+    // Stay within the target number of candidates.
+    const size_t oldMinFrequency = minFrequency;
+    while(double(candidateCount(minFrequency)) > targetCandidateCount &&
+        candidateCount(minFrequency + 1) > 0) {
+        ++minFrequency;
+    }
+
+    // Don't keep candidates found only minFrequency times if they rarely align.
+    while(candidateCount(minFrequency + 1) > 0) {
+        const double successRate = sampleSuccessRate(minFrequency);
+        if(successRate < 0. || successRate >= adaptiveMinSuccessRate) {
+            break;
+        }
+        cout << "Sampled alignment success rate for candidates found " <<
+            minFrequency << " times is " << successRate << endl;
+        ++minFrequency;
+    }
+
+    if(minFrequency != oldMinFrequency) {
+        cout << "Adaptive LowHash increased minFrequency from " <<
+            oldMinFrequency << " to " << minFrequency << "." << endl;
+    }
+    cout << "Adaptive LowHash keeps " << candidateCount(minFrequency) <<
+        " alignment candidates." << endl;
+}
+
+
+
+// Adaptive mode: estimate the alignment success rate
+// of the candidates found exactly the given number of times.
+// The sample is taken from reads (or slots of the candidateTable)
+// spread uniformly, so it does not depend on the read order.
+double LowHash::sampleSuccessRate(uint64_t frequency)
+{
+    vector<OrientedReadPair> sample;
+    const uint64_t probeCount = 4 * adaptiveSampleSize;
+    if(useCandidateTable) {
+        const uint64_t slotCount = 1024;
+        vector< pair<uint64_t, uint32_t> > keys;
+        for(uint64_t probe=0; probe<probeCount && sample.size()<adaptiveSampleSize; probe++) {
+            const uint64_t slotBegin = (probe * candidateTable.capacity()) / probeCount;
+            const uint64_t slotEnd = min(slotBegin + slotCount, candidateTable.capacity());
+            keys.clear();
+            candidateTable.getKeys(slotBegin, slotEnd, uint32_t(frequency), keys);
+            for(const auto& p: keys) {
+                if(p.second == frequency) {
+                    sample.push_back(OrientedReadPair(
+                        AlignmentCandidateTable::getReadId0(p.first),
+                        AlignmentCandidateTable::getReadId1(p.first),
+                        AlignmentCandidateTable::getStrand(p.first) == 0));
+                    break;
+                }
+            }
+        }
+    } else {
+        const ReadId readCount = ReadId(candidates.size());
+        for(uint64_t probe=0; probe<probeCount && sample.size()<adaptiveSampleSize; probe++) {
+            const ReadId readId0 = ReadId((probe * readCount) / probeCount);
+            for(const Candidate& candidate: candidates[readId0]) {
+                if(candidate.frequency == frequency) {
+                    sample.push_back(OrientedReadPair(readId0, candidate.readId1, candidate.strand == 0));
+                    break;
+                }
+            }
+        }
+    }
+    if(sample.empty()) {
+        return -1.;
+    }
+
+    uint64_t goodCount = 0;
+    for(const OrientedReadPair& candidate: sample) {
+        if(isGoodAlignment(candidate)) {
+            ++goodCount;
+        }
+    }
+    return double(goodCount) / double(sample.size());
+}
+
+
+
+void LowHash::computeFrequencyHistogram(vector<uint64_t>& histogram)
+{
+    histogram.clear();
+    const auto increment = [&histogram](uint64_t frequency)
+    {
+        if(frequency >= histogram.size()) {
+            histogram.resize(frequency + 1, 0);
+        }
+        ++histogram[frequency];
+    };
+    if(useCandidateTable) {
+        const uint64_t slotCount = 1ULL << 16;
+        vector< pair<uint64_t, uint32_t> > keys;
+        for(uint64_t slotBegin=0; slotBegin<candidateTable.capacity(); slotBegin+=slotCount) {
+            keys.clear();
+            candidateTable.getKeys(slotBegin,
+                min(slotBegin + slotCount, candidateTable.capacity()), 1, keys);
+            for(const auto& p: keys) {
+                increment(p.second);
+            }
+        }
+    } else {
+        for(const vector<Candidate>& candidates0: candidates) {
+            for(const Candidate& candidate: candidates0) {
+                increment(candidate.frequency);
+            }
+        }
+    }
+}
+
+
+
+// Thread function used to extract the candidates from the candidateTable.
+void LowHash::extractCandidatesThreadFunction(size_t threadId)
+{
+    vector< pair<uint64_t, uint32_t> >& keys = threadCandidateKeys[threadId];
+    keys.clear();
+
+    // Loop over batches of slots assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        candidateTable.getKeys(begin, end, uint32_t(minFrequency), keys);
+    }
+    sort(keys.begin(), keys.end());
+}
+
+
+
+// Method 1, pass 1: compute the low hashes for each oriented read
+// and store them in threadHashEntries, counting
+// the number of entries in each partition.
+void LowHash::sortPass1ThreadFunction(size_t threadId)
+{
+    vector<uint64_t> orientedReadLowHashes;
+    vector<uint64_t> featureHashes;
+
+    vector<HashEntry>& hashEntries = threadHashEntries[threadId];
+    vector<uint64_t>& partitionSizes = threadPartitionSizes[threadId];
+    hashEntries.clear();
+    fill(partitionSizes.begin(), partitionSizes.end(), 0);
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over oriented reads assigned to this batch.
+        for(ReadId readId=ReadFlagBitplanes::nextUnset(skippedReadMask, ReadId(begin), ReadId(end));
+            readId!=ReadId(end);
+            readId=ReadFlagBitplanes::nextUnset(skippedReadMask, readId+1, ReadId(end))) {
+            for(Strand strand=0; strand<2; strand++) {
+                const OrientedReadId orientedReadId(readId, strand);
+                getLowHashes(orientedReadId, orientedReadLowHashes, featureHashes);
+                for(const uint64_t hash: orientedReadLowHashes) {
+                    hashEntries.push_back(HashEntry(hash, orientedReadId));
+                    ++partitionSizes[getPartition(hash)];
+                }
+            }
+        }
+    }
+}
+
+
+
+// Method 1, pass 2: sort the hash entries by hash.
+// This does one radix pass on the low bits of the hash,
+// with no atomics because each thread knows in advance
+// where to store its entries for each partition,
+// followed by a sort of each partition.
+void LowHash::sortHashEntries()
+{
+    // Compute where each thread stores its entries for each partition.
+    partitionBegin.resize(partitionCount + 1);
+    uint64_t offset = 0;
+    for(uint64_t partition=0; partition<partitionCount; partition++) {
+        partitionBegin[partition] = offset;
+        for(size_t threadId=0; threadId<threadCount; threadId++) {
+            threadPartitionBegin[threadId][partition] = offset;
+            offset += threadPartitionSizes[threadId][partition];
+        }
+    }
+    partitionBegin[partitionCount] = offset;
+    sortedHashEntries.resize(offset);
+
+    // Store the entries of each thread in their partitions.
+    setupLoadBalancing(threadCount, 1);
+    runThreads(&LowHash::sortPass2ThreadFunction, threadCount);
+
+    // Sort each partition.
+    setupLoadBalancing(partitionCount, 1);
+    runThreads(&LowHash::sortPass2SortThreadFunction, threadCount);
+}
+
+
+
+void LowHash::sortPass2ThreadFunction(size_t threadId)
+{
+    vector<uint64_t> next;
+
+    // Loop over batches assigned to this thread.
+    // Each batch consists of the hash entries found by
+    // one or more threads during pass 1.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            next = threadPartitionBegin[i];
+            vector<HashEntry>& hashEntries = threadHashEntries[i];
+            for(const HashEntry& hashEntry: hashEntries) {
+                sortedHashEntries[next[getPartition(hashEntry.hash)]++] = hashEntry;
+            }
+            hashEntries.clear();
+        }
+    }
+}
+
+
+
+void LowHash::sortPass2SortThreadFunction(size_t threadId)
+{
+    // Loop over batches assigned to this thread.
+    // Each batch consists of one or more partitions.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t partition=begin; partition!=end; partition++) {
+            sort(
+                sortedHashEntries.begin() + partitionBegin[partition],
+                sortedHashEntries.begin() + partitionBegin[partition + 1]);
+        }
+    }
+}
+
+
+
+// Method 1, pass 3: find candidates by scanning
+// runs of equal hashes in sortedHashEntries.
+// A run plays the role of a bucket in method 0.
+void LowHash::sortPass3ThreadFunction(size_t threadId)
+{
+    vector< pair<ReadId, Candidate> >& thisThreadCandidates = threadCandidates[threadId];
+    thisThreadCandidates.clear();
+
+    ThreadStatistics& thisThreadStatistics = threadStatistics[threadId];
+    thisThreadStatistics.clear();
+
+    // Loop over batches assigned to this thread.
+    // Each batch consists of one or more partitions.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t partition=begin; partition!=end; partition++) {
+            const HashEntry* partitionEnd = sortedHashEntries.begin() + partitionBegin[partition + 1];
+
+            // Loop over runs of equal hashes in this partition.
+            const HashEntry* runBegin = sortedHashEntries.begin() + partitionBegin[partition];
+            while(runBegin != partitionEnd) {
+                const HashEntry* runEnd = runBegin + 1;
+                while(runEnd != partitionEnd && runEnd->hash == runBegin->hash) {
+                    ++runEnd;
+                }
+
+                // If the run is too big, skip it.
+                if(uint64_t(runEnd - runBegin) <= maxBucketSize) {
+
+                    // Each pair of entries on different reads generates a candidate.
+                    for(const HashEntry* x=runBegin; x!=runEnd; ++x) {
+                        const ReadId readIdX = x->orientedReadId.getReadId();
+                        for(const HashEntry* y=x+1; y!=runEnd; ++y) {
+                            const ReadId readIdY = y->orientedReadId.getReadId();
+                            if(readIdX == readIdY) {
+                                continue;
+                            }
+                            const bool isSameStrand =
+                                x->orientedReadId.getStrand() == y->orientedReadId.getStrand();
+                            const ReadId readId0 = min(readIdX, readIdY);
+                            const ReadId readId1 = max(readIdX, readIdY);
+
+                            // In an incremental computation, skip it if both reads are old.
+                            if(readId1 < firstNewReadId) {
+                                continue;
+                            }
+                            const Candidate candidate(readId1, isSameStrand? 0 : 1);
+                            if(useCandidateTable) {
+                                addToCandidateTable(readId0, candidate, thisThreadStatistics);
+                            } else {
+                                thisThreadCandidates.push_back(make_pair(readId0, candidate));
+                            }
+                        }
+                    }
+                }
+
+                runBegin = runEnd;
+            }
+        }
+    }
+
+    // Sort by readId0, so pass 4 can find the candidates for each read.
+    sort(thisThreadCandidates.begin(), thisThreadCandidates.end(),
+        [](const pair<ReadId, Candidate>& x, const pair<ReadId, Candidate>& y)
+        {
+            return x.first < y.first;
+        });
+}
+
+
+
+// Method 1, pass 4: merge the candidates found
+// during pass 3 into the stored candidates.
+void LowHash::sortPass4ThreadFunction(size_t threadId)
+{
+    vector<Candidate> newCandidates;
+    vector<Candidate> mergedCandidates;
+
+    ThreadStatistics& thisThreadStatistics = threadStatistics[threadId];
+    thisThreadStatistics.clear();
+
+    // For each thread, the next candidate to be used
+    // and the end of its candidates.
+    using Iterator = vector< pair<ReadId, Candidate> >::const_iterator;
+    vector<Iterator> next(threadCount);
+    vector<Iterator> ends(threadCount);
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Find the first candidate for this batch in the candidates
+        // found by each thread.
+        for(size_t i=0; i<threadCount; i++) {
+            const vector< pair<ReadId, Candidate> >& v = threadCandidates[i];
+            next[i] = lower_bound(v.begin(), v.end(), ReadId(begin),
+                [](const pair<ReadId, Candidate>& x, ReadId readId)
+                {
+                    return x.first < readId;
+                });
+            ends[i] = v.end();
+        }
+
+        // Loop over reads assigned to this batch.
+        for(ReadId readId0=ReadId(begin); readId0!=ReadId(end); readId0++) {
+            newCandidates.clear();
+            for(size_t i=0; i<threadCount; i++) {
+                for(; next[i]!=ends[i] && next[i]->first==readId0; ++next[i]) {
+                    newCandidates.push_back(next[i]->second);
                 }
             }
+            storeNewCandidates(readId0, newCandidates, mergedCandidates, thisThreadStatistics);
         }
     }
 }
@@ -2,15 +2,23 @@
 #define CZI_SHASTA_LOW_HASH_HPP
 
 // Shasta
+#include "AlignmentCandidateTable.hpp"
+#include "LowHashSketches.hpp"
 #include "Marker.hpp"
 #include "MemoryMappedVectorOfVectors.hpp"
 #include "MultitreadedObject.hpp"
 #include "OrientedReadPair.hpp"
 #include "ReadId.hpp"
 
+// Standard library.
+#include <functional>
+#include "utility.hpp"
+#include "vector.hpp"
+
 namespace ChanZuckerberg {
     namespace shasta {
         class LowHash;
+        class CompactMarkers;
         class ReadFlags;
     }
 }
@@ -20,10 +28,25 @@ namespace ChanZuckerberg {
 // This class uses the LowHash algorithm to find candidate pairs
 // of aligned reads. It uses as features
 // sequences of m consecutive markers.
+// At each iteration, the low hashes of an oriented read are
+// the hashes of its features that are below a threshold
+// set by hashFraction or, in bottom-k mode (sketchSize not 0),
+// its sketchSize lowest feature hashes. Bottom-k mode with
+// sketchSize 1 is the MinHash algorithm.
 class ChanZuckerberg::shasta::LowHash :
     public MultithreadedObject<LowHash>{
 public:
 
+    // An alignment candidate found by one shard of a sharded computation,
+    // with the number of times it was found in that shard.
+    // The key is as in AlignmentCandidateTable::makeKey,
+    // so the order of keys is the order of the alignment candidates.
+    class ShardCandidate {
+    public:
+        uint64_t key;
+        uint64_t frequency;
+    };
+
     // The constructor does all the work.
     LowHash(
         size_t m,                       // Number of consecutive markers that define a feature.
@@ -32,13 +55,56 @@ public:
         size_t log2MinHashBucketCount,  // Base 2 log of number of buckets for minHash.
         size_t maxBucketSize,           // The maximum size for a bucket to be used.
         size_t minFrequency,            // Minimum number of minHash hits for a pair to be considered a candidate.
+        size_t method,                  // 0 = use buckets, 1 = sort the low hashes.
+        size_t candidateTableMegabytes, // If not 0, accumulate candidates in an AlignmentCandidateTable.
+        bool singlePassHashing,         // If true, compute the low hashes for all iterations at once.
         size_t threadCount,
+        size_t k,                       // Used if the markers are stored for strand 0 only.
         const MemoryMapped::Vector<KmerInfo>& kmerTable,
         const MemoryMapped::Vector<ReadFlags>& readFlags,
         const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>&,
+        const CompactMarkers*,          // If not 0, used instead of the markers.
         MemoryMapped::Vector<OrientedReadPair>&,
         const string& largeDataFileNamePrefix,
-        size_t largeDataPageSize
+        size_t largeDataPageSize,
+
+        // If not 0, the low hashes are stored here.
+        // This forces singlePassHashing.
+        LowHashSketches* sketches = 0,
+
+        // If true, use the low hashes stored in the sketches
+        // for the reads that were present when they were computed,
+        // and only find candidates involving at least one new read.
+        bool incremental = false,
+
+        // Sharded computation. If shardCandidates is not 0,
+        // only low hashes in the range of hash values assigned to shardId
+        // are used, and the candidates found are stored in shardCandidates
+        // with their frequency, without applying minFrequency.
+        // candidateAlignments is not used.
+        // The hash range is divided into shardCount contiguous ranges,
+        // so each low hash belongs to exactly one shard, and adding
+        // the frequencies found by all shards gives the same
+        // frequencies as an unsharded computation.
+        uint64_t shardId = 0,
+        uint64_t shardCount = 1,
+        MemoryMapped::Vector<ShardCandidate>* shardCandidates = 0,
+
+        // Adaptive mode. If targetCandidatesPerRead is not 0,
+        // minHashIterationCount and minFrequency become a maximum number of
+        // iterations and a minimum value of minFrequency, adjusted
+        // using the statistics of each iteration and the success rate
+        // of alignments of samples of the candidates,
+        // computed by isGoodAlignment. See adaptiveStop and adaptiveFinish.
+        // Not supported for sharded or incremental computations.
+        double targetCandidatesPerRead = 0.,
+        const std::function<bool(const OrientedReadPair&)>& isGoodAlignment = nullptr,
+
+        // Bottom-k mode. If not 0, hashFraction is not used, and
+        // the low hashes of each oriented read at each iteration
+        // are its sketchSize lowest feature hashes.
+        // Not supported when storing sketches.
+        size_t sketchSize = 0
 );
 
 private:
@@ -46,23 +112,41 @@ private:
     // Store some of the arguments passed to the constructor.
     size_t m;                       // Number of consecutive markers that define a feature.
     double hashFraction;
+    size_t sketchSize;
     size_t maxBucketSize;           // The maximum size for a bucket to be used.
     size_t minFrequency;            // Minimum number of minHash hits for a pair to be considered a candidate.
+    size_t method;
+    bool singlePassHashing;
     size_t threadCount;
+    size_t k;
     const MemoryMapped::Vector<KmerInfo>& kmerTable;
     const MemoryMapped::Vector<ReadFlags>& readFlags;
+
+    // Bitset of the reads that are palindromic or excluded
+    // and so don't participate, indexed by ReadId.
+    // Computed using ReadFlagBitplanes::getAnyMask.
+    vector<uint64_t> skippedReadMask;
     const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers;
+    const CompactMarkers* compactMarkers;
     const string& largeDataFileNamePrefix;
     size_t largeDataPageSize;
 
     // Vectors containing only the k-mer ids of all markers
     // for all oriented reads.
     // Indexed by OrientedReadId.getValue().
+    // This is always stored for both strands, even if
+    // the markers are stored for strand 0 only.
     // This is used to speed up the computation of hash functions.
     MemoryMapped::VectorOfVectors<KmerId, uint64_t> kmerIds;
     void createKmerIds();
     void createKmerIds(size_t threadId);
 
+    // The range of hash values used by this shard.
+    // For an unsharded computation, this is [0, hashThreshold).
+    uint64_t shardHashBegin;
+    uint64_t shardHashEnd;
+    MemoryMapped::Vector<ShardCandidate>* shardCandidates;
+
     // The current MinHash iteration.
     // This is used to compute a different MurmurHash function
     // at each iteration.
@@ -74,6 +158,43 @@ private:
     vector< vector<uint64_t> > lowHashes;
     void computeLowHashes(size_t threadId);
 
+    // Append to a vector the low hashes of an oriented read
+    // at a given iteration. The second vector is a work area.
+    void appendLowHashes(
+        OrientedReadId,
+        size_t iteration,
+        vector<uint64_t>& orientedReadLowHashes,
+        vector<uint64_t>& featureHashes) const;
+
+    // Get the low hashes of an oriented read at the current iteration,
+    // computing them or taking them from allLowHashes.
+    void getLowHashes(
+        OrientedReadId,
+        vector<uint64_t>& orientedReadLowHashes,
+        vector<uint64_t>& featureHashes) const;
+
+    // If singlePassHashing is true, the low hashes of all iterations
+    // are computed in a single pass over the k-mer ids,
+    // before the first iteration. This uses more memory but
+    // reads the k-mer ids only once instead of once per iteration.
+    // For each oriented read, allLowHashes contains the low hashes
+    // for all iterations, and the low hashes for iteration i
+    // begin at allLowHashesBegin[i] and end at allLowHashesBegin[i+1].
+    // Indexed by OrientedReadId::getValue().
+    vector< vector<uint64_t> > allLowHashes;
+    vector< vector<uint32_t> > allLowHashesBegin;
+    size_t iterationCount;
+    void computeAllLowHashesThreadFunction(size_t threadId);
+
+    // Persistent storage of the low hashes, and incremental computation.
+    // Reads with id less than firstNewReadId are old reads:
+    // their low hashes are taken from the sketches, and pairs
+    // in which both reads are old are not considered.
+    // For a non-incremental computation, firstNewReadId is 0.
+    LowHashSketches* sketches;
+    ReadId firstNewReadId;
+    void storeSketches();
+
     // The mask used to compute to compute the bucket
     // corresponding to a hash value.
     uint64_t mask;
@@ -96,6 +217,61 @@ private:
 
 
 
+    // Data used by method 1, which does not use buckets.
+    // Instead, each thread stores its low hashes together with
+    // the oriented read they came from.
+    // These are then sorted by hash using one radix pass on the
+    // low bits of the hash followed by a sort of each partition.
+    // Candidates are then found by a linear scan of runs of equal hashes.
+    // This gives sequential memory access and requires no atomics.
+    class HashEntry {
+    public:
+        uint64_t hash;
+        OrientedReadId orientedReadId;
+        HashEntry(
+            uint64_t hash,
+            OrientedReadId orientedReadId) :
+            hash(hash),
+            orientedReadId(orientedReadId) {}
+        HashEntry() {}
+        bool operator<(const HashEntry& that) const
+        {
+            if(hash < that.hash) {
+                return true;
+            }
+            if(that.hash < hash) {
+                return false;
+            }
+            return orientedReadId.getValue() < that.orientedReadId.getValue();
+        }
+    };
+    static const uint64_t log2PartitionCount = 8;
+    static const uint64_t partitionCount = 1ULL << log2PartitionCount;
+    static uint64_t getPartition(uint64_t hash)
+    {
+        return hash & (partitionCount - 1ULL);
+    }
+
+    // The hash entries found by each thread,
+    // and the number of entries in each partition for each thread.
+    // Indexed by threadId.
+    vector< vector<HashEntry> > threadHashEntries;
+    vector< vector<uint64_t> > threadPartitionSizes;
+
+    // Where each thread stores its entries for each partition in sortedHashEntries.
+    // Indexed by [threadId][partition].
+    vector< vector<uint64_t> > threadPartitionBegin;
+
+    // The beginning of each partition in sortedHashEntries.
+    // This has partitionCount+1 entries.
+    vector<uint64_t> partitionBegin;
+
+    // All hash entries, sorted by hash within each partition.
+    MemoryMapped::Vector<HashEntry> sortedHashEntries;
+    void sortHashEntries();
+
+
+
     // Class used to store candidate pairs.
     class Candidate {
     public:
@@ -144,6 +320,22 @@ private:
     // For each readId0, this is kept sorted.
     vector< vector<Candidate> > candidates;
 
+    // If useCandidateTable is true, candidates are accumulated
+    // in this hash table instead of in the candidates vectors.
+    bool useCandidateTable;
+    AlignmentCandidateTable candidateTable;
+
+    // Extraction of the candidates from the candidateTable.
+    // Each thread stores the keys it finds with their frequencies, sorted.
+    // Indexed by threadId.
+    vector< vector< pair<uint64_t, uint32_t> > > threadCandidateKeys;
+    void extractCandidatesThreadFunction(size_t threadId);
+
+    // For method 1, the candidates found by each thread
+    // at the current iteration, with their readId0, sorted by readId0.
+    // Indexed by threadId.
+    vector< vector< pair<ReadId, Candidate> > > threadCandidates;
+
 
 
     // Per-iteration statistics for each thread.
@@ -152,6 +344,10 @@ private:
         uint64_t highFrequency;
         uint64_t total;
         uint64_t capacity;
+
+        // Only used with the candidateTable.
+        uint64_t dropped;
+
         ThreadStatistics()
         {
             clear();
@@ -161,11 +357,64 @@ private:
             highFrequency = 0;
             total = 0;
             capacity = 0;
+            dropped = 0;
         }
 
     };
     vector<ThreadStatistics> threadStatistics;
 
+    // Adaptive mode.
+    double targetCandidatesPerRead;
+    std::function<bool(const OrientedReadPair&)> isGoodAlignment;
+
+    // The number of candidates aligned to estimate a success rate.
+    static const uint64_t adaptiveSampleSize = 100;
+
+    // Candidates found minFrequency times with a lower success rate
+    // than this are not worth the cost of computing their alignments.
+    static constexpr double adaptiveMinSuccessRate = 0.1;
+
+    // Stop when an iteration increases the number of
+    // high frequency candidates by less than this fraction.
+    static constexpr double adaptiveMinGrowth = 0.01;
+
+    // The number of high frequency candidates after the previous iteration.
+    uint64_t adaptivePreviousHighFrequency = 0;
+
+    // Called after each iteration with the number of candidates
+    // with frequency at least minFrequency. Returns true if
+    // the iteration loop should stop because the target was reached,
+    // because the last iteration found few new candidates, or because
+    // the candidates found exactly minFrequency times rarely give good alignments.
+    bool adaptiveStop(uint64_t highFrequency);
+
+    // Called after the last iteration. Increases minFrequency
+    // until the number of candidates is within the target and the candidates
+    // found exactly minFrequency times have an acceptable success rate.
+    void adaptiveFinish();
+
+    // Estimate the success rate of alignments of candidates
+    // found exactly the given number of times, aligning a sample of them
+    // spread over all reads. Returns -1 if no such candidates are found.
+    double sampleSuccessRate(uint64_t frequency);
+
+    // Compute a histogram of the frequencies of all candidates.
+    void computeFrequencyHistogram(vector<uint64_t>&);
+
+    // Merge new candidates for readId0 into the stored candidates
+    // and update thread statistics.
+    // The new candidates don't have to be sorted.
+    void storeNewCandidates(
+        ReadId readId0,
+        vector<Candidate>& newCandidates,
+        vector<Candidate>& mergedCandidates,
+        ThreadStatistics&);
+
+    // Add a candidate to the candidateTable and update thread statistics.
+    // With the candidateTable, thread statistics are for
+    // the current iteration only, not cumulative.
+    void addToCandidateTable(ReadId readId0, const Candidate&, ThreadStatistics&);
+
 
 
     // Thread functions.
@@ -180,6 +429,24 @@ private:
     // Pass 3: inspect the buckets to find candidates.
     void pass3ThreadFunction(size_t threadId);
 
+    // Thread functions used by method 1.
+
+    // Pass 1: compute the low hashes for each oriented read
+    // and store them in threadHashEntries.
+    void sortPass1ThreadFunction(size_t threadId);
+
+    // Pass 2: copy the hash entries to sortedHashEntries,
+    // then sort each partition.
+    void sortPass2ThreadFunction(size_t threadId);
+    void sortPass2SortThreadFunction(size_t threadId);
+
+    // Pass 3: scan runs of equal hashes to find candidates
+    // and store them in threadCandidates.
+    void sortPass3ThreadFunction(size_t threadId);
+
+    // Pass 4: merge the candidates found into the stored candidates.
+    void sortPass4ThreadFunction(size_t threadId);
+
 };
 
 #endif
@@ -0,0 +1,42 @@
+// Shasta.
+#include "LowHashSketches.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+
+
+void LowHashSketches::createNew(const string& nameArgument, size_t pageSize)
+{
+    name = nameArgument;
+    info.createNew(getName(name, "-Info"), pageSize);
+    lowHashes.createNew(getName(name, "-LowHashes"), pageSize);
+    lowHashesBegin.createNew(getName(name, "-LowHashesBegin"), pageSize);
+}
+
+
+
+void LowHashSketches::accessExistingReadOnly(const string& nameArgument)
+{
+    name = nameArgument;
+    info.accessExistingReadOnly(getName(name, "-Info"));
+    lowHashes.accessExistingReadOnly(getName(name, "-LowHashes"));
+    lowHashesBegin.accessExistingReadOnly(getName(name, "-LowHashesBegin"));
+}
+
+
+
+void LowHashSketches::remove()
+{
+    info.remove();
+    lowHashes.remove();
+    lowHashesBegin.remove();
+}
+
+
+
+void LowHashSketches::close()
+{
+    info.close();
+    lowHashes.close();
+    lowHashesBegin.close();
+}
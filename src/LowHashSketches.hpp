@@ -0,0 +1,89 @@
+#ifndef CZI_SHASTA_LOW_HASH_SKETCHES_HPP
+#define CZI_SHASTA_LOW_HASH_SKETCHES_HPP
+
+/*******************************************************************************
+
+Class LowHashSketches stores, for each oriented read, the low hashes
+computed by the LowHash algorithm at each iteration.
+It is filled by LowHash when requested, and stored as memory mapped
+data, so it persists after the LowHash computation.
+
+When reads are later added to the run, the LowHash computation
+can be done incrementally: the stored low hashes of the old reads are used,
+and only the new reads are hashed. Only candidate pairs involving
+at least one new read are generated.
+
+The low hashes depend on the marker k-mers, on m,
+on hashFraction, and on the number of iterations, which are stored
+together with the low hashes, so an incremental computation
+can check that they did not change.
+
+*******************************************************************************/
+
+// Shasta.
+#include "MemoryMappedObject.hpp"
+#include "MemoryMappedVectorOfVectors.hpp"
+#include "ReadId.hpp"
+
+// Standard library.
+#include "string.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class LowHashSketches;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::LowHashSketches {
+public:
+
+    // The parameters used to compute the low hashes.
+    class Info {
+    public:
+        uint64_t m;
+        double hashFraction;
+        uint64_t iterationCount;
+
+        // The number of reads at the time the low hashes were computed.
+        // Incremental computations use hashes for these reads.
+        uint64_t readCount;
+
+        // A hash of the bitmap of marker k-mers.
+        uint64_t markerKmersHash;
+    };
+    MemoryMapped::Object<Info> info;
+
+    // For each oriented read, the low hashes for all iterations.
+    // The low hashes for iteration i begin at lowHashesBegin[i]
+    // and end at lowHashesBegin[i+1].
+    // Indexed by OrientedReadId::getValue().
+    MemoryMapped::VectorOfVectors<uint64_t, uint64_t> lowHashes;
+    MemoryMapped::VectorOfVectors<uint32_t, uint64_t> lowHashesBegin;
+
+    void createNew(const string& name, size_t pageSize);
+    void accessExistingReadOnly(const string& name);
+    void remove();
+    void close();
+    bool isOpen() const
+    {
+        return info.isOpen && lowHashes.isOpen() && lowHashesBegin.isOpen();
+    }
+
+    // The name used to create or access the sketches,
+    // so LowHash can recreate them when doing an incremental computation.
+    string name;
+
+private:
+    static string getName(const string& name, const string& suffix)
+    {
+        if(name.empty()) {
+            return "";  // Anonymous.
+        } else {
+            return name + suffix;
+        }
+    }
+};
+
+#endif
@@ -16,6 +16,11 @@ Because of the way markers are selected, the following is
 true for all permitted values of i, 0 <= i < 4^k:
 kmerTable[i].isMarker == kmerTable[kmerTable[i].reverseComplementKmerId].isMarker
 
+The same information is also stored in a bitmap of 4^k bits
+(Assembler::markerKmers, see class KmerBitmap), which is the structure
+used for marker lookups. The k-mer table is only created
+for moderate values of k, because its size grows as 4^k.
+
 *******************************************************************************/
 
 #include "Kmer.hpp"
@@ -0,0 +1,301 @@
+// Shasta.
+#include "MarkerChainer.hpp"
+#include "Alignment.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "iostream.hpp"
+
+
+
+// Compute an alignment of the markers of two oriented reads by chaining.
+void ChanZuckerberg::shasta::alignByChaining(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    size_t maxSkip,
+    uint32_t maxMarkerFrequency,
+    bool debug,
+    MarkerChainer& chainer,
+    Alignment& alignment,
+    AlignmentInfo& alignmentInfo)
+{
+    chainer.align(markers, maxMarkerFrequency, maxSkip, debug,
+        alignment, alignmentInfo);
+}
+
+
+
+void MarkerChainer::align(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    uint32_t maxMarkerFrequency,
+    size_t maxSkip,
+    bool debug,
+    Alignment& alignment,
+    AlignmentInfo& alignmentInfo)
+{
+    alignment.ordinals.clear();
+
+    // Create the anchors, sorted by corrected ordinals.
+    createAnchors(markers, maxMarkerFrequency);
+    if(debug) {
+        cout << "Found " << anchors.size() << " anchors." << endl;
+    }
+    if(anchors.empty()) {
+        return;
+    }
+    const uint32_t anchorCount = uint32_t(anchors.size());
+
+    // Initialize the segment tree and the active anchors
+    // for each corrected ordinal on the second oriented read.
+    uint32_t correctedMarkerCount1 = 0;
+    for(const bool isLowFrequency: isLowFrequencyMarker[1]) {
+        if(isLowFrequency) {
+            ++correctedMarkerCount1;
+        }
+    }
+    initializeTree(correctedMarkerCount1);
+    leafFirst.assign(correctedMarkerCount1, uint32_t(noPredecessor));
+    leafLast.assign(correctedMarkerCount1, uint32_t(noPredecessor));
+    nextInLeaf.assign(anchorCount, uint32_t(noPredecessor));
+
+
+
+    // Process the anchors in groups with the same corrected ordinal
+    // on the first oriented read. All anchors in a group are scored before
+    // any of them is made active, so a chain cannot contain two of them.
+    uint32_t firstActive = 0;
+    for(uint32_t groupBegin=0; groupBegin!=anchorCount; ) {
+        const uint32_t x = anchors[groupBegin].correctedOrdinals[0];
+        uint32_t groupEnd = groupBegin;
+        while(groupEnd!=anchorCount && anchors[groupEnd].correctedOrdinals[0]==x) {
+            ++groupEnd;
+        }
+
+        // Deactivate the anchors that are more than maxSkip
+        // behind on the first oriented read.
+        // Anchors with the same corrected ordinal on the second oriented read
+        // are deactivated in the same order in which they were activated,
+        // so each one is the first active anchor of its leaf.
+        while(firstActive<groupBegin &&
+            anchors[firstActive].correctedOrdinals[0] + maxSkip < x) {
+            const uint32_t y = anchors[firstActive].correctedOrdinals[1];
+            CZI_ASSERT(leafFirst[y] == firstActive);
+            leafFirst[y] = nextInLeaf[firstActive];
+            if(leafFirst[y] == noPredecessor) {
+                leafLast[y] = noPredecessor;
+            }
+            updateLeaf(y);
+            ++firstActive;
+        }
+
+        // Find the best predecessor of each anchor in this group.
+        for(uint32_t i=groupBegin; i!=groupEnd; i++) {
+            Anchor& anchor = anchors[i];
+            const uint32_t y = anchor.correctedOrdinals[1];
+            const uint32_t yBegin = (y > maxSkip) ? uint32_t(y - maxSkip) : 0;
+            const Entry best = getMaximum(yBegin, y);
+            if(best.first == 0) {
+                anchor.score = 1;
+                anchor.predecessor = noPredecessor;
+            } else {
+                anchor.score = best.first + 1;
+                anchor.predecessor = best.second;
+            }
+        }
+
+        // Activate the anchors in this group.
+        for(uint32_t i=groupBegin; i!=groupEnd; i++) {
+            const uint32_t y = anchors[i].correctedOrdinals[1];
+            if(leafLast[y] == noPredecessor) {
+                leafFirst[y] = i;
+            } else {
+                nextInLeaf[leafLast[y]] = i;
+            }
+            leafLast[y] = i;
+            updateLeaf(y);
+        }
+
+        groupBegin = groupEnd;
+    }
+
+
+
+    // Find the anchor where the best chain ends.
+    uint32_t bestAnchor = 0;
+    for(uint32_t i=1; i<anchorCount; i++) {
+        if(anchors[i].score > anchors[bestAnchor].score) {
+            bestAnchor = i;
+        }
+    }
+
+    // Store the alignment.
+    for(uint32_t i=bestAnchor; i!=noPredecessor; i=anchors[i].predecessor) {
+        alignment.ordinals.push_back(anchors[i].ordinals);
+    }
+    std::reverse(alignment.ordinals.begin(), alignment.ordinals.end());
+    if(debug) {
+        cout << "The best chain has " << alignment.ordinals.size() << " anchors." << endl;
+    }
+
+    // Store the alignment info.
+    alignmentInfo.create(alignment, uint32_t(markers[0].size()), uint32_t(markers[1].size()));
+}
+
+
+
+void MarkerChainer::createAnchors(
+    const array<vector<MarkerWithOrdinal>, 2>& markers,
+    uint32_t maxMarkerFrequency)
+{
+    // Some shorthands for readability.
+    const vector<MarkerWithOrdinal>& markers0 = markers[0];
+    const vector<MarkerWithOrdinal>& markers1 = markers[1];
+    using MarkerIterator = vector<MarkerWithOrdinal>::const_iterator;
+    const MarkerIterator end0   = markers0.end();
+    const MarkerIterator end1   = markers1.end();
+
+    anchors.clear();
+    for(size_t i=0; i<2; i++) {
+        isLowFrequencyMarker[i].clear();
+        isLowFrequencyMarker[i].resize(markers[i].size(), true);
+    }
+
+    // Joint loop over the markers, looking for common k-mer ids.
+    auto it0 = markers0.begin();
+    auto it1 = markers1.begin();
+    while(it0!=end0 && it1!=end1) {
+        if(it0->kmerId < it1->kmerId) {
+            ++it0;
+        } else if(it1->kmerId < it0->kmerId) {
+            ++it1;
+        } else {
+
+            // We found a common k-mer id.
+            // Find the streak of this k-mer in each of the oriented reads.
+            const KmerId kmerId = it0->kmerId;
+            MarkerIterator it0End = it0;
+            MarkerIterator it1End = it1;
+            while(it0End!=end0 && it0End->kmerId==kmerId) {
+                ++it0End;
+            }
+            while(it1End!=end1 && it1End->kmerId==kmerId) {
+                ++it1End;
+            }
+
+            if(size_t(it0End-it0)>maxMarkerFrequency || size_t(it1End-it1)>maxMarkerFrequency) {
+
+                // At least one of these streaks is too long.
+                for(MarkerIterator jt0=it0; jt0!=it0End; ++jt0) {
+                    isLowFrequencyMarker[0][jt0->ordinal] = false;
+                }
+                for(MarkerIterator jt1=it1; jt1!=it1End; ++jt1) {
+                    isLowFrequencyMarker[1][jt1->ordinal] = false;
+                }
+
+            } else {
+
+                // Generate an anchor for each pair in the streaks.
+                for(MarkerIterator jt0=it0; jt0!=it0End; ++jt0) {
+                    for(MarkerIterator jt1=it1; jt1!=it1End; ++jt1) {
+                        Anchor anchor;
+                        anchor.ordinals[0] = jt0->ordinal;
+                        anchor.ordinals[1] = jt1->ordinal;
+                        anchors.push_back(anchor);
+                    }
+                }
+            }
+
+            it0 = it0End;
+            it1 = it1End;
+        }
+    }
+
+
+
+    // Compute the corrected ordinals, keeping into account
+    // only low frequency markers.
+    for(size_t i=0; i<2; i++) {
+        correctedOrdinals[i].resize(markers[i].size());
+        uint32_t correctedOrdinal = 0;
+        for(size_t j=0; j<markers[i].size(); j++) {
+            if(isLowFrequencyMarker[i][j]) {
+                correctedOrdinals[i][j] = correctedOrdinal++;
+            } else {
+                correctedOrdinals[i][j] = std::numeric_limits<uint32_t>::max();
+            }
+        }
+    }
+    for(Anchor& anchor: anchors) {
+        for(size_t i=0; i<2; i++) {
+            anchor.correctedOrdinals[i] = correctedOrdinals[i][anchor.ordinals[i]];
+        }
+    }
+    sort(anchors.begin(), anchors.end());
+}
+
+
+
+uint64_t MarkerChainer::capacityBytes() const
+{
+    uint64_t n =
+        anchors.capacity() * sizeof(Anchor) +
+        tree.capacity() * sizeof(Entry) +
+        leafFirst.capacity() * sizeof(uint32_t) +
+        leafLast.capacity() * sizeof(uint32_t) +
+        nextInLeaf.capacity() * sizeof(uint32_t);
+    for(size_t i=0; i<2; i++) {
+        n += isLowFrequencyMarker[i].capacity() / 8;
+        n += correctedOrdinals[i].capacity() * sizeof(uint32_t);
+    }
+    return n;
+}
+
+
+
+void MarkerChainer::initializeTree(uint32_t n)
+{
+    leafCount = n;
+    tree.assign(2 * size_t(n), Entry(0, uint32_t(noPredecessor)));
+}
+
+
+
+void MarkerChainer::setLeaf(uint32_t i, Entry entry)
+{
+    i += leafCount;
+    tree[i] = entry;
+    for(i>>=1; i>0; i>>=1) {
+        tree[i] = max(tree[2*i], tree[2*i+1]);
+    }
+}
+
+
+
+// Return the maximum entry for leaves in [begin, end).
+MarkerChainer::Entry MarkerChainer::getMaximum(uint32_t begin, uint32_t end) const
+{
+    Entry best(0, uint32_t(noPredecessor));
+    for(begin+=leafCount, end+=leafCount; begin<end; begin>>=1, end>>=1) {
+        if(begin & 1) {
+            best = max(best, tree[begin++]);
+        }
+        if(end & 1) {
+            best = max(best, tree[--end]);
+        }
+    }
+    return best;
+}
+
+
+
+// Recompute a leaf from its active anchors.
+void MarkerChainer::updateLeaf(uint32_t y)
+{
+    Entry best(0, uint32_t(noPredecessor));
+    for(uint32_t i=leafFirst[y]; i!=noPredecessor; i=nextInLeaf[i]) {
+        best = max(best, Entry(anchors[i].score, i));
+    }
+    setLeaf(y, best);
+}
@@ -0,0 +1,160 @@
+#ifndef CZI_SHASTA_MARKER_CHAINER_HPP
+#define CZI_SHASTA_MARKER_CHAINER_HPP
+
+/*******************************************************************************
+
+Class MarkerChainer computes an alignment of the markers of two
+oriented reads using sparse dynamic programming (chaining),
+as an alternative to the AlignmentGraph.
+
+The anchors are the pairs of markers in the two oriented reads
+that have the same k-mer, excluding k-mers that appear more than
+maxMarkerFrequency times in either oriented read, exactly like the vertices
+of the AlignmentGraph. As in the AlignmentGraph, distances are
+measured using corrected ordinals, which only count low frequency markers.
+
+A chain is a sequence of anchors strictly increasing in both
+oriented reads, with successive anchors no more than maxSkip
+apart in each of the two oriented reads. The alignment is the
+longest chain. With the weights used by the AlignmentGraph,
+this is also the shortest path in the alignment graph
+restricted to edges that advance on both oriented reads.
+
+The anchors are processed in order of corrected ordinal in the first
+oriented read. The best chain ending at each anchor is found using
+a segment tree keyed by corrected ordinal in the second oriented read,
+which only contains anchors at most maxSkip behind on the
+first oriented read. This takes O(n log n) time for n anchors.
+
+*******************************************************************************/
+
+// Shasta.
+#include "Marker.hpp"
+
+// Standard library.
+#include "array.hpp"
+#include <limits>
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        class Alignment;
+        class AlignmentInfo;
+        class MarkerChainer;
+
+        // Top level function to compute the marker alignment by chaining.
+        // The arguments are the same as for align (see AlignmentGraph.hpp).
+        void alignByChaining(
+
+            // Markers of the two oriented reads to be aligned, sorted by KmerId.
+            const array<vector<MarkerWithOrdinal>, 2>& markers,
+
+            // The maximum ordinal skip to be tolerated between successive markers
+            // in the alignment.
+            size_t maxSkip,
+
+            // Marker frequency threshold.
+            uint32_t maxMarkerFrequency,
+
+            // Flag to control debug output.
+            bool debug,
+
+            // The MarkerChainer can be reused.
+            // For performance, it should be reused when doing many alignments.
+            MarkerChainer&,
+
+            // The computed alignment.
+            Alignment&,
+
+            // Also create alignment summary information.
+            AlignmentInfo&
+            );
+
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::MarkerChainer {
+public:
+
+    void align(
+        const array<vector<MarkerWithOrdinal>, 2>&,
+        uint32_t maxMarkerFrequency,
+        size_t maxSkip,
+        bool debug,
+        Alignment&,
+        AlignmentInfo&);
+
+    // The number of bytes currently allocated by the work areas,
+    // which are kept between alignments.
+    uint64_t capacityBytes() const;
+
+private:
+
+    // A pair of markers with the same k-mer.
+    class Anchor {
+    public:
+
+        // The ordinals in each of the oriented reads.
+        array<uint32_t, 2> ordinals;
+
+        // The corrected ordinals, counting only low frequency markers.
+        array<uint32_t, 2> correctedOrdinals;
+
+        // The length of the longest chain ending at this anchor,
+        // and the previous anchor in that chain.
+        uint32_t score;
+        uint32_t predecessor;
+
+        bool operator<(const Anchor& that) const
+        {
+            return correctedOrdinals < that.correctedOrdinals;
+        }
+    };
+    vector<Anchor> anchors;
+    static const uint32_t noPredecessor = std::numeric_limits<uint32_t>::max();
+
+    // Create the anchors, sorted by corrected ordinals.
+    void createAnchors(
+        const array<vector<MarkerWithOrdinal>, 2>&,
+        uint32_t maxMarkerFrequency);
+
+    // Flags that are set for markers whose k-mers
+    // have frequency maxMarkerFrequency or less in
+    // both oriented reads. Indexed by [0 or 1][ordinal].
+    array<vector<bool>, 2> isLowFrequencyMarker;
+
+    // The corrected ordinals. Indexed by [0 or 1][ordinal].
+    array<vector<uint32_t>, 2> correctedOrdinals;
+
+
+
+    // Segment tree used to find the best predecessor of each anchor.
+    // Each leaf corresponds to a corrected ordinal in the second
+    // oriented read and contains the best (score, anchor index)
+    // among the active anchors with that corrected ordinal.
+    // (0, noPredecessor) means no anchor.
+    using Entry = pair<uint32_t, uint32_t>;
+    vector<Entry> tree;
+    uint32_t leafCount;
+    void initializeTree(uint32_t n);
+    void setLeaf(uint32_t i, Entry);
+    Entry getMaximum(uint32_t begin, uint32_t end) const;
+
+    // For each leaf, the active anchors, in order of corrected ordinal
+    // in the first oriented read, are stored as a linked list:
+    // leafFirst and leafLast are indexed by leaf, and
+    // nextInLeaf is indexed by anchor.
+    // There are at most maxMarkerFrequency active anchors in each leaf.
+    // Using flat vectors means that no memory is allocated
+    // once they reach the size required by the largest alignment.
+    vector<uint32_t> leafFirst;
+    vector<uint32_t> leafLast;
+    vector<uint32_t> nextInLeaf;
+    void updateLeaf(uint32_t);
+};
+
+#endif
@@ -1,6 +1,9 @@
 // shasta.
 #include "MarkerFinder.hpp"
+#include "KmerIterator.hpp"
 #include "LongBaseSequence.hpp"
+#include "MemoryMappedVector.hpp"
+#include "ReadFlags.hpp"
 #include "ReadId.hpp"
 #include "timestamp.hpp"
 using namespace ChanZuckerberg;
@@ -13,16 +16,20 @@ using namespace shasta;
 
 MarkerFinder::MarkerFinder(
     size_t k,
-    const MemoryMapped::Vector<KmerInfo>& kmerTable,
+    KmerBitmap isMarker,
     LongBaseSequences& reads,
     MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
-    size_t threadCountArgument) :
+    size_t threadCountArgument,
+    const MemoryMapped::Vector<ReadFlags>* readFlags,
+    bool strandImplicit) :
     MultithreadedObject(*this),
     k(k),
-    kmerTable(kmerTable),
+    isMarker(isMarker),
     reads(reads),
     markers(markers),
-    threadCount(threadCountArgument)
+    threadCount(threadCountArgument),
+    readFlags(readFlags),
+    strandImplicit(strandImplicit)
 {
     // Initial message.
     cout << timestamp << "Finding markers in " << reads.size() << " reads." << endl;
@@ -35,11 +42,11 @@ MarkerFinder::MarkerFinder(
     cout << "Using " << threadCount << " threads." << endl;
 
     const size_t batchSize = 100000;
-    markers.beginPass1(2 * reads.size());
+    markers.beginPass1((strandImplicit ? 1 : 2) * reads.size(), threadCount);
     setupLoadBalancing(reads.size(), batchSize);
     pass = 1;
     runThreads(&MarkerFinder::threadFunction, threadCount);
-    markers.beginPass2();
+    markers.beginPass2(threadCount);
     markers.endPass2(false);
     setupLoadBalancing(reads.size(), batchSize);
     pass = 2;
@@ -68,51 +75,53 @@ void MarkerFinder::threadFunction(size_t threadId)
             CompressedMarker* markerPointerStrand0 = 0;
             CompressedMarker* markerPointerStrand1 = 0;
             if(pass == 2) {
-                markerPointerStrand0 = markers.begin(OrientedReadId(readId, 0).getValue());
-                markerPointerStrand1 = markers.end(OrientedReadId(readId, 1).getValue()) - 1ULL;
+                if(strandImplicit) {
+                    markerPointerStrand0 = markers.begin(readId);
+                } else {
+                    markerPointerStrand0 = markers.begin(OrientedReadId(readId, 0).getValue());
+                    markerPointerStrand1 = markers.end(OrientedReadId(readId, 1).getValue()) - 1ULL;
+                }
             }
 
-            if(read.baseCount >= k) {   // Avoid pathological case.
+            // Reads excluded by subsampling get no markers.
+            const bool isExcluded = readFlags && (*readFlags)[readId].isExcluded;
 
-                // Loop over k-mers of this read.
-                Kmer kmer;
-                for(size_t position=0; position<k; position++) {
-                    kmer.set(position, read[position]);
-                }
-                for(uint32_t position=0; /*The check is done later */; position++) {
-                    const KmerId kmerId = KmerId(kmer.id(k));
-                    if(kmerTable[kmerId].isMarker) {
-                        // This k-mer is a marker.
-
-                        if(pass == 1) {
-                            ++markerCount;
-                        } else {
-                            // Strand 0.
-                            markerPointerStrand0->kmerId = kmerId;
-                            markerPointerStrand0->position = position;
-                            ++markerPointerStrand0;
-
-                            // Strand 1.
-                            markerPointerStrand1->kmerId = kmerTable[kmerId].reverseComplementedKmerId;
+            // Loop over k-mers of this read.
+            for(KmerIterator it(read, k); !isExcluded && it.isValid(); it.next()) {
+                const KmerId kmerId = it.kmerId();
+                if(isMarker[kmerId]) {
+                    // This k-mer is a marker.
+
+                    if(pass == 1) {
+                        ++markerCount;
+                    } else {
+                        const uint32_t position = uint32_t(it.position);
+
+                        // Strand 0.
+                        markerPointerStrand0->kmerId = kmerId;
+                        markerPointerStrand0->position = position;
+                        ++markerPointerStrand0;
+
+                        // Strand 1, unless it is computed on the fly.
+                        if(!strandImplicit) {
+                            markerPointerStrand1->kmerId = it.reverseComplementedKmerId();
                             markerPointerStrand1->position = uint32_t(read.baseCount - k - position);
                             --markerPointerStrand1;
-
                         }
-                    }
 
-                    if(position+k == read.baseCount) {
-                        break;
                     }
-
-                    // Update the k-mer.
-                    kmer.shiftLeft();
-                    kmer.set(k-1, read[position+k]);
                 }
             }
 
             if(pass == 1) {
-                markers.incrementCount(OrientedReadId(readId, 0).getValue(), markerCount);
-                markers.incrementCount(OrientedReadId(readId, 1).getValue(), markerCount);
+                if(strandImplicit) {
+                    markers.incrementCount(readId, markerCount);
+                } else {
+                    markers.incrementCount(OrientedReadId(readId, 0).getValue(), markerCount);
+                    markers.incrementCount(OrientedReadId(readId, 1).getValue(), markerCount);
+                }
+            } else if(strandImplicit) {
+                CZI_ASSERT(markerPointerStrand0 == markers.end(readId));
             } else {
                 CZI_ASSERT(markerPointerStrand0 ==
                     markers.end(OrientedReadId(readId, 0).getValue()));
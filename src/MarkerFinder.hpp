@@ -9,6 +9,7 @@ namespace ChanZuckerberg {
     namespace shasta {
         class MarkerFinder;
         class LongBaseSequences;
+        class ReadFlags;
         namespace MemoryMapped {
             template<class T> class Vector;
             template<class Int, class T> class VectorOfVectors;
@@ -23,21 +24,28 @@ class ChanZuckerberg::shasta::MarkerFinder :
 public:
 
     // The constructor does all the work.
+    // If readFlags is not null, reads flagged as excluded get no markers.
+    // If strandImplicit is true, markers are only stored for strand 0
+    // and indexed by ReadId (see OrientedReadMarkers.hpp).
     MarkerFinder(
         size_t k,
-        const MemoryMapped::Vector<KmerInfo>& kmerTable,
+        KmerBitmap isMarker,
         LongBaseSequences& reads,
         MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
-        size_t threadCount);
+        size_t threadCount,
+        const MemoryMapped::Vector<ReadFlags>* readFlags = 0,
+        bool strandImplicit = false);
 
 private:
 
     // The arguments passed to the constructor.
     size_t k;
-    const MemoryMapped::Vector<KmerInfo>& kmerTable;
+    KmerBitmap isMarker;
     LongBaseSequences& reads;
     MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers;
     size_t threadCount;
+    const MemoryMapped::Vector<ReadFlags>* readFlags;
+    bool strandImplicit;
 
     void threadFunction(size_t threadId);
 
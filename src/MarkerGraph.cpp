@@ -13,7 +13,7 @@ const MarkerGraph::CompressedVertexId
 const MarkerGraph::Edge*
     MarkerGraph::findEdge(Uint40 source, Uint40 target) const
 {
-    const auto edgesWithThisSource = edgesBySource[source];
+    const auto edgesWithThisSource = compactEdgesBySource[source];
     for(const uint64_t i: edgesWithThisSource) {
         const Edge& edge = edges[i];
         if(edge.target == target) {
@@ -24,6 +24,40 @@ const MarkerGraph::Edge*
 }
 
 
+void MarkerGraph::storeEdgeFlagBitmaps()
+{
+    CZI_ASSERT(edgeFlagBitmaps.size() == edges.size());
+    uint64_t* plane0 = edgeFlagBitmaps.plane(MarkerGraphEdgeFlagBitmaps::wasRemovedByTransitiveReduction);
+    uint64_t* plane1 = edgeFlagBitmaps.plane(MarkerGraphEdgeFlagBitmaps::wasPruned);
+    uint64_t* plane2 = edgeFlagBitmaps.plane(MarkerGraphEdgeFlagBitmaps::isSuperBubbleEdge);
+    const uint64_t edgeCount = edges.size();
+    for(uint64_t i=0; i<edgeFlagBitmaps.getWordCount(); i++) {
+        uint64_t word0 = 0;
+        uint64_t word1 = 0;
+        uint64_t word2 = 0;
+        const uint64_t begin = i << 6;
+        const uint64_t end = min(begin + 64, edgeCount);
+        for(uint64_t edgeId=begin; edgeId!=end; edgeId++) {
+            const Edge& edge = edges[edgeId];
+            const uint64_t bit = uint64_t(1) << (edgeId & 63);
+            if(edge.wasRemovedByTransitiveReduction) {
+                word0 |= bit;
+            }
+            if(edge.wasPruned) {
+                word1 |= bit;
+            }
+            if(edge.isSuperBubbleEdge) {
+                word2 |= bit;
+            }
+        }
+        plane0[i] = word0;
+        plane1[i] = word1;
+        plane2[i] = word2;
+    }
+}
+
+
+
 MarkerGraph::EdgeId MarkerGraph::findEdgeId(Uint40 source, Uint40 target) const
 {
 	const Edge* edgePointer = findEdge(source, target);
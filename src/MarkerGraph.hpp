@@ -2,7 +2,11 @@
 #define CZI_SHASTA_MARKER_GRAPH_HPP
 
 #include "Base.hpp"
+#include "CompactMarkerIntervals.hpp"
+#include "CompressedCoverageStore.hpp"
 #include "Coverage.hpp"
+#include "MarkerGraphCompactAdjacency.hpp"
+#include "MarkerGraphEdgeFlagBitmaps.hpp"
 #include "MemoryMappedVectorOfVectors.hpp"
 #include "Uint.hpp"
 #include "cstdint.hpp"
@@ -56,6 +60,17 @@ public:
     // Indexed by VertexId.
     MemoryMapped::Vector<VertexId> reverseComplementVertex;
 
+    // A bitmap with one bit for each vertex, set for the vertices
+    // that contain more than one marker of the same oriented read.
+    // Created by Assembler::createMarkerGraphEdges, so
+    // Assembler::isBadMarkerGraphVertex does not have to
+    // look up the markers of the vertex.
+    MemoryMapped::Vector<uint64_t> isBadVertexBitmap;
+    bool isBadVertex(VertexId vertexId) const
+    {
+        return (isBadVertexBitmap[vertexId >> 6] >> (vertexId & 63)) & 1;
+    }
+
     // The edges of the marker graph.
     class Edge {
     public:
@@ -82,8 +97,12 @@ public:
         // Set if this edge belongs to a bubble/superbubble that was removed.
         uint8_t isSuperBubbleEdge : 1;
 
+        // Set when one of the above flags is modified, so
+        // checkMarkerGraphDirtyEdgesAreStrandSymmetric can only check
+        // the edges that changed. Cleared by the strand symmetry checks.
+        uint8_t isDirty : 1;
+
         // Unused.
-        uint8_t flag3 : 1;
         uint8_t flag4 : 1;
         uint8_t flag5 : 1;
         uint8_t flag6 : 1;
@@ -94,7 +113,7 @@ public:
             wasRemovedByTransitiveReduction = 0;
             wasPruned = 0;
             isSuperBubbleEdge = 0;
-            flag3 = 0;
+            isDirty = 0;
             flag4 = 0;
             flag5 = 0;
             flag6 = 0;
@@ -112,17 +131,49 @@ public:
     const Edge* findEdge(Uint40 source, Uint40 target) const;
     EdgeId findEdgeId(Uint40 source, Uint40 target) const;
 
+    // The flags that mark edges as removed, as one bitmap per flag.
+    // See MarkerGraphEdgeFlagBitmaps.hpp for more information.
+    // storeEdgeFlagBitmaps copies the flags of all edges to the bitmaps.
+    // It must be called by the code that modifies these flags
+    // in the edges, unless it also updates the bitmaps as it goes.
+    MarkerGraphEdgeFlagBitmaps edgeFlagBitmaps;
+    void storeEdgeFlagBitmaps();
+
+    // Same as edges[edgeId].wasRemoved(), but only reads the bitmaps.
+    bool edgeWasRemoved(EdgeId edgeId) const
+    {
+        return edgeFlagBitmaps.isAnySet(MarkerGraphEdgeFlagBitmaps::wasRemovedMask, edgeId);
+    }
+
     // The MarkerIntervals for each of the above edges.
+    // If edgeMarkerIntervalsAreCanonical is true, they are only stored
+    // for edges with edgeId < reverseComplementEdge[edgeId],
+    // and the vectors for the other edges are empty.
+    // If Assembler::compressMarkerGraphEdgeMarkerIntervals was called,
+    // they are stored in compactEdgeMarkerIntervals instead,
+    // sorted by OrientedReadId, and edgeMarkerIntervals is not open.
+    // Use Assembler::getMarkerGraphEdgeMarkerIntervals to get them
+    // for any edge.
     MemoryMapped::VectorOfVectors<MarkerInterval, uint64_t> edgeMarkerIntervals;
+    CompactMarkerIntervals compactEdgeMarkerIntervals;
+    bool edgeMarkerIntervalsAreCanonical = false;
 
     // The edges that each vertex is the source of.
     // Contains indexes into the above edges vector.
+    // Only used while creating compactEdgesBySource.
     MemoryMapped::VectorOfVectors<Uint40, uint64_t> edgesBySource;
 
     // The edges that each vertex is the target of.
     // Contains indexes into the above edges vector.
+    // Only used while creating compactEdgesByTarget.
     MemoryMapped::VectorOfVectors<Uint40, uint64_t> edgesByTarget;
 
+    // Compact versions of edgesBySource and edgesByTarget,
+    // used for all traversals once the marker graph edges are created.
+    // See MarkerGraphCompactAdjacency.hpp for more information.
+    MarkerGraphCompactAdjacency compactEdgesBySource;
+    MarkerGraphCompactAdjacency compactEdgesByTarget;
+
     // The reverse complement of each edge.
     // Indexed by EdgeId.
     MemoryMapped::Vector<EdgeId> reverseComplementEdge;
@@ -170,6 +221,53 @@ public:
     // ordered by position.
     MemoryMapped::VectorOfVectors<pair<uint32_t, CompressedCoverageData>, uint64_t>
         edgeCoverageData;
+
+    // Block compressed versions of vertexCoverageData and edgeCoverageData,
+    // created by Assembler::compressMarkerGraphCoverageData.
+    // When these are available, the uncompressed versions are not.
+    CompressedCoverageStore compressedVertexCoverageData;
+    CompressedCoverageStore compressedEdgeCoverageData;
+
+    // Access coverage data for a vertex or edge,
+    // from the compressed or uncompressed version, whichever is open.
+    bool coverageDataIsOpen() const
+    {
+        return
+            (vertexCoverageData.isOpen() && edgeCoverageData.isOpen()) ||
+            (compressedVertexCoverageData.isOpen() && compressedEdgeCoverageData.isOpen());
+    }
+    uint64_t vertexCoverageDataSize() const
+    {
+        return vertexCoverageData.isOpen() ?
+            vertexCoverageData.size() : compressedVertexCoverageData.size();
+    }
+    uint64_t edgeCoverageDataSize() const
+    {
+        return edgeCoverageData.isOpen() ?
+            edgeCoverageData.size() : compressedEdgeCoverageData.size();
+    }
+    void getVertexCoverageData(
+        VertexId vertexId,
+        vector< pair<uint32_t, CompressedCoverageData> >& v) const
+    {
+        if(vertexCoverageData.isOpen()) {
+            const auto data = vertexCoverageData[vertexId];
+            v.assign(data.begin(), data.end());
+        } else {
+            compressedVertexCoverageData.get(vertexId, v);
+        }
+    }
+    void getEdgeCoverageData(
+        EdgeId edgeId,
+        vector< pair<uint32_t, CompressedCoverageData> >& v) const
+    {
+        if(edgeCoverageData.isOpen()) {
+            const auto data = edgeCoverageData[edgeId];
+            v.assign(data.begin(), data.end());
+        } else {
+            compressedEdgeCoverageData.get(edgeId, v);
+        }
+    }
 };
 
 #endif
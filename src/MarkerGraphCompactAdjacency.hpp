@@ -0,0 +1,389 @@
+#ifndef CZI_SHASTA_MARKER_GRAPH_COMPACT_ADJACENCY_HPP
+#define CZI_SHASTA_MARKER_GRAPH_COMPACT_ADJACENCY_HPP
+
+/*******************************************************************************
+
+Class template MarkerGraphCompactAdjacency stores the same information as
+MarkerGraph::edgesBySource or MarkerGraph::edgesByTarget
+(a MemoryMapped::VectorOfVectors<Uint40, uint64_t>), but using less memory.
+
+Vertices are divided in blocks of 2^log2BlockSize consecutive vertices.
+The index has two levels:
+- For each block, a 64-bit offset of its first byte in the encoded data.
+- For each vertex, an offset of type Offset (normally 32 bits)
+  relative to the beginning of its block.
+
+The edges of each vertex are stored in order of increasing EdgeId as
+LEB128 varints: first the number of edges, then the first EdgeId,
+then the differences between consecutive EdgeIds.
+Because marker graph edges are sorted by source vertex,
+consecutive EdgeIds of a vertex are close to each other,
+and most differences fit in one or two bytes.
+
+Compared to the VectorOfVectors, this replaces 8 bytes of offset per vertex
+and 5 bytes per edge with typically 5 bytes per vertex (4 for the offset,
+1 for the count) and 1 to 3 bytes per edge.
+Most vertices have a single edge, so the entire adjacency of a vertex
+fits in a few bytes and is usually decoded from a single cache line.
+
+The VectorOfVectors it is created from is only needed during creation.
+
+*******************************************************************************/
+
+// shasta.
+#include "CZI_ASSERT.hpp"
+#include "MemoryMappedVectorOfVectors.hpp"
+#include "MultitreadedObject.hpp"
+#include "timestamp.hpp"
+#include "Uint.hpp"
+
+// Standard library.
+#include "algorithm.hpp"
+#include "chrono.hpp"
+#include "iostream.hpp"
+#include <limits>
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        template<class Offset, uint64_t log2BlockSize> class MarkerGraphCompactAdjacencyTemplate;
+        using MarkerGraphCompactAdjacency = MarkerGraphCompactAdjacencyTemplate<uint32_t, 16>;
+    }
+}
+
+
+
+template<class Offset, uint64_t log2BlockSize>
+    class ChanZuckerberg::shasta::MarkerGraphCompactAdjacencyTemplate :
+    public MultithreadedObject< MarkerGraphCompactAdjacencyTemplate<Offset, log2BlockSize> > {
+public:
+
+    using EdgeId = uint64_t;
+    using VertexId = uint64_t;
+    static const uint64_t blockSize = 1ULL << log2BlockSize;
+
+    MarkerGraphCompactAdjacencyTemplate() :
+        MultithreadedObject< MarkerGraphCompactAdjacencyTemplate<Offset, log2BlockSize> >(*this) {}
+
+    // Create from edgesBySource or edgesByTarget.
+    // If the name is empty, the data are stored in anonymous memory.
+    void createNew(
+        const MemoryMapped::VectorOfVectors<Uint40, uint64_t>& adjacency,
+        const string& name,
+        size_t pageSize,
+        size_t threadCount);
+
+    void accessExistingReadOnly(const string& name)
+    {
+        blockOffsets.accessExistingReadOnly(name + "-BlockOffsets");
+        vertexOffsets.accessExistingReadOnly(name + "-VertexOffsets");
+        data.accessExistingReadOnly(name + "-Data");
+    }
+    void remove()
+    {
+        blockOffsets.remove();
+        vertexOffsets.remove();
+        data.remove();
+    }
+    bool isOpen() const
+    {
+        return blockOffsets.isOpen && vertexOffsets.isOpen && data.isOpen;
+    }
+
+    // The data determine the edges of all vertices,
+    // so the offsets don't need to be hashed.
+    uint64_t hash() const
+    {
+        return data.hash();
+    }
+
+    // The number of vertices.
+    uint64_t size() const
+    {
+        return vertexOffsets.size();
+    }
+
+    // The total number of bytes used by this data structure.
+    uint64_t byteCount() const
+    {
+        return
+            blockOffsets.size() * sizeof(uint64_t) +
+            vertexOffsets.size() * sizeof(Offset) +
+            data.size();
+    }
+
+
+
+    // The edges of a vertex, decoded on the fly during iteration.
+    // This allows range for loops, as for the VectorOfVectors:
+    // for(const EdgeId edgeId: adjacency[vertexId]) ...
+    class const_iterator {
+    public:
+        const_iterator(const uint8_t* p, uint64_t remaining) :
+            p(p), remaining(remaining), edgeId(0)
+        {
+            if(remaining > 0) {
+                edgeId = readVarint(this->p);
+            }
+        }
+        EdgeId operator*() const
+        {
+            return edgeId;
+        }
+        const_iterator& operator++()
+        {
+            --remaining;
+            if(remaining > 0) {
+                edgeId += readVarint(p);
+            }
+            return *this;
+        }
+        bool operator==(const const_iterator& that) const
+        {
+            return remaining == that.remaining;
+        }
+        bool operator!=(const const_iterator& that) const
+        {
+            return remaining != that.remaining;
+        }
+    private:
+        const uint8_t* p;
+        uint64_t remaining;
+        EdgeId edgeId;
+    };
+    class Edges {
+    public:
+        Edges(const uint8_t* p) : p(p), n(readVarint(this->p)) {}
+        uint64_t size() const
+        {
+            return n;
+        }
+        bool empty() const
+        {
+            return n == 0;
+        }
+        const_iterator begin() const
+        {
+            return const_iterator(p, n);
+        }
+        const_iterator end() const
+        {
+            return const_iterator(p, 0);
+        }
+    private:
+        const uint8_t* p;
+        uint64_t n;
+    };
+    Edges operator[](VertexId vertexId) const
+    {
+        return Edges(getPointer(vertexId));
+    }
+
+    // The number of edges of a vertex. This only decodes the count.
+    uint64_t size(VertexId vertexId) const
+    {
+        const uint8_t* p = getPointer(vertexId);
+        return readVarint(p);
+    }
+
+
+
+private:
+
+    // For each block of blockSize vertices, the offset of its first byte in data.
+    // This has one more entry than the number of blocks,
+    // and the last entry is the total number of bytes.
+    MemoryMapped::Vector<uint64_t> blockOffsets;
+
+    // For each vertex, the offset of its first byte,
+    // relative to the beginning of its block.
+    MemoryMapped::Vector<Offset> vertexOffsets;
+
+    // The encoded edges.
+    MemoryMapped::Vector<uint8_t> data;
+
+    const uint8_t* getPointer(VertexId vertexId) const
+    {
+        return data.begin() + blockOffsets[vertexId >> log2BlockSize] + vertexOffsets[vertexId];
+    }
+
+    // Variable length integers.
+    static uint64_t varintSize(uint64_t x)
+    {
+        uint64_t n = 1;
+        while(x >= 0x80ULL) {
+            x >>= 7;
+            ++n;
+        }
+        return n;
+    }
+    static uint8_t* writeVarint(uint64_t x, uint8_t* p)
+    {
+        while(x >= 0x80ULL) {
+            *p++ = uint8_t(x | 0x80ULL);
+            x >>= 7;
+        }
+        *p++ = uint8_t(x);
+        return p;
+    }
+    static uint64_t readVarint(const uint8_t*& p)
+    {
+        uint64_t x = *p++;
+        if(x < 0x80ULL) {
+            return x;
+        }
+        x &= 0x7fULL;
+        for(uint64_t shift=7; ; shift+=7) {
+            const uint64_t byte = *p++;
+            x |= (byte & 0x7fULL) << shift;
+            if(byte < 0x80ULL) {
+                return x;
+            }
+        }
+    }
+
+    // Data and functions used during creation.
+    // Both passes loop over blocks of vertices.
+    // Pass 1 computes vertexOffsets and the number of bytes in each block.
+    // Pass 2 stores the data.
+    void createThreadFunction(size_t threadId);
+    class CreateData {
+    public:
+        const MemoryMapped::VectorOfVectors<Uint40, uint64_t>* adjacency;
+        size_t pass;
+    };
+    CreateData createData;
+
+    // Get the edges of a vertex, sorted.
+    void getSortedEdges(VertexId, vector<EdgeId>&) const;
+
+    // The name of one of the vectors, or empty for anonymous memory.
+    static string vectorName(const string& name, const string& suffix)
+    {
+        return name.empty() ? name : name + suffix;
+    }
+};
+
+
+
+template<class Offset, uint64_t log2BlockSize>
+    inline void ChanZuckerberg::shasta::MarkerGraphCompactAdjacencyTemplate<Offset, log2BlockSize>::createNew(
+    const MemoryMapped::VectorOfVectors<Uint40, uint64_t>& adjacency,
+    const string& name,
+    size_t pageSize,
+    size_t threadCount)
+{
+    const auto tBegin = steady_clock::now();
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    const uint64_t vertexCount = adjacency.size();
+    const uint64_t blockCount = (vertexCount + blockSize - 1) >> log2BlockSize;
+    createData.adjacency = &adjacency;
+
+    // Pass 1: compute vertexOffsets and the number of bytes in each block,
+    // which is stored in blockOffsets[block+1].
+    blockOffsets.createNew(vectorName(name, "-BlockOffsets"), pageSize);
+    vertexOffsets.createNew(vectorName(name, "-VertexOffsets"), pageSize);
+    blockOffsets.resize(blockCount + 1);
+    vertexOffsets.resize(vertexCount);
+    createData.pass = 1;
+    this->setupLoadBalancing(blockCount, 1);
+    this->runThreads(&MarkerGraphCompactAdjacencyTemplate::createThreadFunction, threadCount);
+
+    // Turn the block sizes into offsets.
+    blockOffsets[0] = 0;
+    for(uint64_t block=0; block<blockCount; block++) {
+        blockOffsets[block+1] += blockOffsets[block];
+    }
+
+    // Pass 2: store the data.
+    data.createNew(vectorName(name, "-Data"), pageSize);
+    data.resize(blockOffsets[blockCount]);
+    createData.pass = 2;
+    this->setupLoadBalancing(blockCount, 1);
+    this->runThreads(&MarkerGraphCompactAdjacencyTemplate::createThreadFunction, threadCount);
+
+    const auto tEnd = steady_clock::now();
+    cout << timestamp << "Compact adjacency " << name << " uses " << byteCount() <<
+        " bytes for " << vertexCount << " vertices and " << adjacency.totalSize() <<
+        " edges, versus " <<
+        (vertexCount + 1) * sizeof(uint64_t) + adjacency.totalSize() * sizeof(Uint40) <<
+        ". Created in " << seconds(tEnd - tBegin) << " s." << endl;
+}
+
+
+
+template<class Offset, uint64_t log2BlockSize>
+    inline void ChanZuckerberg::shasta::MarkerGraphCompactAdjacencyTemplate<Offset, log2BlockSize>::
+    createThreadFunction(size_t threadId)
+{
+    const MemoryMapped::VectorOfVectors<Uint40, uint64_t>& adjacency = *createData.adjacency;
+    const uint64_t vertexCount = adjacency.size();
+    vector<EdgeId> edgeIds;
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(this->getNextBatch(begin, end)) {
+
+        // Loop over blocks of this batch.
+        for(uint64_t block=begin; block!=end; block++) {
+            const VertexId vertexBegin = block << log2BlockSize;
+            const VertexId vertexEnd = min(vertexBegin + blockSize, vertexCount);
+
+            if(createData.pass == 1) {
+
+                // Compute the offset of each vertex in this block.
+                uint64_t offset = 0;
+                for(VertexId vertexId=vertexBegin; vertexId!=vertexEnd; vertexId++) {
+                    CZI_ASSERT(offset <= uint64_t(std::numeric_limits<Offset>::max()));
+                    vertexOffsets[vertexId] = Offset(offset);
+                    getSortedEdges(vertexId, edgeIds);
+                    offset += varintSize(edgeIds.size());
+                    EdgeId previousEdgeId = 0;
+                    for(const EdgeId edgeId: edgeIds) {
+                        offset += varintSize(edgeId - previousEdgeId);
+                        previousEdgeId = edgeId;
+                    }
+                }
+                blockOffsets[block + 1] = offset;
+
+            } else {
+
+                // Store the data for this block.
+                uint8_t* p = data.begin() + blockOffsets[block];
+                for(VertexId vertexId=vertexBegin; vertexId!=vertexEnd; vertexId++) {
+                    CZI_ASSERT(p == data.begin() + blockOffsets[block] + vertexOffsets[vertexId]);
+                    getSortedEdges(vertexId, edgeIds);
+                    p = writeVarint(edgeIds.size(), p);
+                    EdgeId previousEdgeId = 0;
+                    for(const EdgeId edgeId: edgeIds) {
+                        p = writeVarint(edgeId - previousEdgeId, p);
+                        previousEdgeId = edgeId;
+                    }
+                }
+                CZI_ASSERT(p == data.begin() + blockOffsets[block + 1]);
+            }
+        }
+    }
+}
+
+
+
+template<class Offset, uint64_t log2BlockSize>
+    inline void ChanZuckerberg::shasta::MarkerGraphCompactAdjacencyTemplate<Offset, log2BlockSize>::
+    getSortedEdges(VertexId vertexId, vector<EdgeId>& edgeIds) const
+{
+    const auto v = (*createData.adjacency)[vertexId];
+    edgeIds.clear();
+    for(const Uint40 edgeId: v) {
+        edgeIds.push_back(uint64_t(edgeId));
+    }
+    sort(edgeIds.begin(), edgeIds.end());
+}
+
+#endif
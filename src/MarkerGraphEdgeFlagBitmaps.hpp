@@ -0,0 +1,208 @@
+#ifndef CZI_SHASTA_MARKER_GRAPH_EDGE_FLAG_BITMAPS_HPP
+#define CZI_SHASTA_MARKER_GRAPH_EDGE_FLAG_BITMAPS_HPP
+
+/*******************************************************************************
+
+Class MarkerGraphEdgeFlagBitmaps stores the flags that mark
+a marker graph edge as removed (MarkerGraph::Edge::wasRemovedByTransitiveReduction,
+wasPruned, and isSuperBubbleEdge), with one memory mapped bitmap
+(a bitset indexed by EdgeId) for each flag.
+
+The flags in MarkerGraph::Edge remain the persistent, authoritative copy.
+The bitmaps are kept in sync with them by the stages that set the flags:
+flagMarkerGraphWeakEdges, pruneMarkerGraphStrongSubgraph, and simplifyMarkerGraph.
+
+Traversals that only need to know whether an edge can be used
+test one bit instead of loading the 12-byte MarkerGraph::Edge,
+and loops over all edges test 64 edges at a time using getAnyWord
+or nextUnset. The three bitmaps together use 1/32 of the memory
+used by the edges.
+
+*******************************************************************************/
+
+// shasta.
+#include "CZI_ASSERT.hpp"
+#include "MemoryMappedVector.hpp"
+
+// Standard library.
+#include "algorithm.hpp"
+#include "cstdint.hpp"
+#include "string.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class MarkerGraphEdgeFlagBitmaps;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::MarkerGraphEdgeFlagBitmaps {
+public:
+
+    // The flags, in the same order as the bit fields of MarkerGraph::Edge.
+    enum Flag {
+        wasRemovedByTransitiveReduction,
+        wasPruned,
+        isSuperBubbleEdge,
+        flagCount
+    };
+
+    // The bit corresponding to a flag in the flag masks
+    // used by getAnyWord, isAnySet, and nextUnset.
+    static uint64_t flagBit(Flag flag)
+    {
+        return uint64_t(1) << flag;
+    }
+
+    // The flag mask equivalent to MarkerGraph::Edge::wasRemoved.
+    static const uint64_t wasRemovedMask = (uint64_t(1) << flagCount) - 1;
+
+    // The flag mask for the edges that are not
+    // in the pruned strong subgraph of the marker graph.
+    static const uint64_t notInPrunedStrongSubgraphMask =
+        (uint64_t(1) << wasRemovedByTransitiveReduction) |
+        (uint64_t(1) << wasPruned);
+
+    // Create the bitmaps for the given number of edges, with all flags cleared.
+    void createNew(const string& name, size_t pageSize, uint64_t edgeCountArgument)
+    {
+        data.createNew(name, pageSize);
+        edgeCount = edgeCountArgument;
+        wordCount = (edgeCount + 63) >> 6;
+        data.resize(flagCount * wordCount);
+        fill(data.begin(), data.end(), uint64_t(0));
+    }
+    void accessExistingReadOnly(const string& name, uint64_t edgeCountArgument)
+    {
+        data.accessExistingReadOnly(name);
+        setEdgeCount(edgeCountArgument);
+    }
+    void accessExistingReadWrite(const string& name, uint64_t edgeCountArgument)
+    {
+        data.accessExistingReadWrite(name);
+        setEdgeCount(edgeCountArgument);
+    }
+    void remove()
+    {
+        data.remove();
+        edgeCount = 0;
+        wordCount = 0;
+    }
+    bool isOpen() const
+    {
+        return data.isOpen;
+    }
+    uint64_t size() const
+    {
+        return edgeCount;
+    }
+
+    bool get(Flag flag, uint64_t edgeId) const
+    {
+        return (plane(flag)[edgeId >> 6] >> (edgeId & 63)) & 1;
+    }
+
+    // Set or clear a flag. These are atomic and can be called
+    // concurrently by multiple threads for any edges.
+    void set(Flag flag, uint64_t edgeId)
+    {
+        __sync_fetch_and_or(plane(flag) + (edgeId >> 6), uint64_t(1) << (edgeId & 63));
+    }
+    void clear(Flag flag, uint64_t edgeId)
+    {
+        __sync_fetch_and_and(plane(flag) + (edgeId >> 6), ~(uint64_t(1) << (edgeId & 63)));
+    }
+    void set(Flag flag, uint64_t edgeId, bool value)
+    {
+        if(value) {
+            set(flag, edgeId);
+        } else {
+            clear(flag, edgeId);
+        }
+    }
+
+    // Clear a flag for all edges. Not thread safe.
+    void clearAll(Flag flag)
+    {
+        fill(plane(flag), plane(flag) + wordCount, uint64_t(0));
+    }
+
+    // Access word i of the bitmap of a flag, for bulk updates.
+    // Bit j of word i corresponds to EdgeId 64*i+j.
+    // Bits past the last edge must remain clear.
+    uint64_t* plane(Flag flag)
+    {
+        return data.begin() + flag * wordCount;
+    }
+    const uint64_t* plane(Flag flag) const
+    {
+        return data.begin() + flag * wordCount;
+    }
+    uint64_t getWordCount() const
+    {
+        return wordCount;
+    }
+
+    // Return word i of the union of the flags in flagMask
+    // (an OR of flagBit values).
+    uint64_t getAnyWord(uint64_t flagMask, uint64_t i) const
+    {
+        uint64_t word = 0;
+        for(uint64_t flag=0; flag<flagCount; flag++) {
+            if(flagMask & (uint64_t(1) << flag)) {
+                word |= plane(Flag(flag))[i];
+            }
+        }
+        return word;
+    }
+
+    // Return true if any of the flags in flagMask is set for an edge.
+    bool isAnySet(uint64_t flagMask, uint64_t edgeId) const
+    {
+        return (getAnyWord(flagMask, edgeId >> 6) >> (edgeId & 63)) & 1;
+    }
+
+    // Return the first EdgeId in [edgeId, end) for which none
+    // of the flags in flagMask is set, or end if there is none.
+    // This examines 64 edges at a time.
+    uint64_t nextUnset(uint64_t flagMask, uint64_t edgeId, uint64_t end) const
+    {
+        while(edgeId < end) {
+            const uint64_t word = (~getAnyWord(flagMask, edgeId >> 6)) >> (edgeId & 63);
+            if(word) {
+                return min(end, edgeId + uint64_t(__builtin_ctzll(word)));
+            }
+            edgeId = (edgeId | 63) + 1;
+        }
+        return end;
+    }
+
+    // The number of edges for which any of the flags in flagMask is set.
+    uint64_t count(uint64_t flagMask) const
+    {
+        uint64_t n = 0;
+        for(uint64_t i=0; i<wordCount; i++) {
+            n += uint64_t(__builtin_popcountll(getAnyWord(flagMask, i)));
+        }
+        return n;
+    }
+
+private:
+
+    // The number of edges and of 64-bit words in each bitmap.
+    uint64_t edgeCount = 0;
+    uint64_t wordCount = 0;
+
+    // The bitmaps, one after the other.
+    MemoryMapped::Vector<uint64_t> data;
+
+    void setEdgeCount(uint64_t edgeCountArgument)
+    {
+        edgeCount = edgeCountArgument;
+        wordCount = (edgeCount + 63) >> 6;
+        CZI_ASSERT(data.size() == flagCount * wordCount);
+    }
+};
+
+#endif
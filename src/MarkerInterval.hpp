@@ -7,6 +7,7 @@
 
 // Standard library.
 #include "array.hpp"
+#include "vector.hpp"
 
 namespace ChanZuckerberg {
     namespace shasta {
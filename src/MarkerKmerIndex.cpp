@@ -0,0 +1,289 @@
+// shasta.
+#include "MarkerKmerIndex.hpp"
+#include "KmerIterator.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "chrono.hpp"
+
+
+
+void MarkerKmerIndex::createNew(
+    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+    ReadId readCount,
+    size_t k,
+    const string& name,
+    size_t pageSize,
+    size_t threadCount)
+{
+    cout << timestamp << "Creating the marker k-mer index." << endl;
+    const auto tBegin = steady_clock::now();
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    createData.markers = &markers;
+    createData.markersAreStrandImplicit = (markers.size() == readCount);
+    if(!createData.markersAreStrandImplicit) {
+        CZI_ASSERT(markers.size() == 2 * uint64_t(readCount));
+    }
+    const uint64_t kmerCount = 1ULL << (2ULL*k);
+
+    // The number of markers of each read.
+    markerCounts.createNew(name + "-MarkerCounts", pageSize);
+    markerCounts.resize(readCount);
+    for(ReadId readId=0; readId<readCount; readId++) {
+        const uint64_t i = createData.markersAreStrandImplicit ?
+            readId : OrientedReadId(readId, 0).getValue();
+        markerCounts[readId] = uint32_t(markers.size(i));
+    }
+
+    // Gather the postings of each KmerId, using the two-pass
+    // procedure of VectorOfVectors. Each KmerId gets its postings
+    // in an order that depends on the threads.
+    createData.postings.createNew(name.empty() ? "" : (name + "-tmp-Postings"), pageSize);
+    createData.postings.beginPass1(kmerCount);
+    createData.pass = 1;
+    setupLoadBalancing(readCount, 1000);
+    runThreads(&MarkerKmerIndex::gatherThreadFunction, threadCount);
+    createData.postings.beginPass2();
+    createData.pass = 2;
+    setupLoadBalancing(readCount, 1000);
+    runThreads(&MarkerKmerIndex::gatherThreadFunction, threadCount);
+    createData.postings.endPass2();
+
+    // Sort and encode the postings of each KmerId.
+    // Pass 1 computes the number of bytes for each KmerId.
+    counts.createNew(name + "-Counts", pageSize);
+    counts.resize(kmerCount);
+    data.createNew(name + "-Data", pageSize);
+    data.beginPass1(kmerCount);
+    createData.pass = 1;
+    setupLoadBalancing(kmerCount, 1024);
+    runThreads(&MarkerKmerIndex::encodeThreadFunction, threadCount);
+
+    // Pass 2 stores the encoded postings.
+    data.beginPass2();
+    data.endPass2(false);
+    createData.pass = 2;
+    setupLoadBalancing(kmerCount, 1024);
+    runThreads(&MarkerKmerIndex::encodeThreadFunction, threadCount);
+    const uint64_t postingCount = createData.postings.totalSize();
+    createData.postings.remove();
+
+    const auto tEnd = steady_clock::now();
+    cout << timestamp << "Creating the marker k-mer index completed in " <<
+        seconds(tEnd - tBegin) << " s." << endl;
+    cout << "The marker k-mer index uses " << byteCount() << " bytes for " <<
+        postingCount << " markers on strand 0, " <<
+        double(byteCount()) / double(max(uint64_t(1), postingCount)) <<
+        " bytes per marker." << endl;
+}
+
+
+
+void MarkerKmerIndex::gatherThreadFunction(size_t threadId)
+{
+    const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers = *createData.markers;
+    auto& postings = createData.postings;
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over reads of this batch.
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            const uint64_t i = createData.markersAreStrandImplicit ?
+                readId : OrientedReadId(readId, 0).getValue();
+            const CompressedMarker* readMarkers = markers.begin(i);
+            const uint32_t n = uint32_t(markers.size(i));
+            for(uint32_t ordinal=0; ordinal<n; ordinal++) {
+                const KmerId kmerId = readMarkers[ordinal].kmerId;
+                if(createData.pass == 1) {
+                    postings.incrementCountMultithreaded(kmerId);
+                } else {
+                    PostingOnStrand0 posting;
+                    posting.readId = readId;
+                    posting.ordinal = ordinal;
+                    postings.storeMultithreaded(kmerId, posting);
+                }
+            }
+        }
+    }
+}
+
+
+
+// Each KmerId is processed by a single thread,
+// so its entries can be updated without synchronization.
+void MarkerKmerIndex::encodeThreadFunction(size_t threadId)
+{
+    auto& postings = createData.postings;
+    vector<uint8_t> bytes;
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over KmerIds of this batch.
+        for(uint64_t kmerId=begin; kmerId!=end; kmerId++) {
+            PostingOnStrand0* postingsBegin = postings.begin(kmerId);
+            PostingOnStrand0* postingsEnd = postings.end(kmerId);
+
+            // In pass 1, sort the postings. In pass 2 they are already sorted.
+            if(createData.pass == 1) {
+                sort(postingsBegin, postingsEnd);
+            }
+
+            bytes.clear();
+            ReadId previousReadId = 0;
+            uint32_t previousOrdinal = 0;
+            for(const PostingOnStrand0* it=postingsBegin; it!=postingsEnd; ++it) {
+                const ReadId readIdDelta = it->readId - previousReadId;
+                writeVarint(readIdDelta, bytes);
+                writeVarint((readIdDelta == 0) ? (it->ordinal - previousOrdinal) : it->ordinal, bytes);
+                previousReadId = it->readId;
+                previousOrdinal = it->ordinal;
+            }
+
+            if(createData.pass == 1) {
+                data.incrementCount(kmerId, bytes.size());
+                counts[kmerId] = uint32_t(postingsEnd - postingsBegin);
+            } else {
+                CZI_ASSERT(data.size(kmerId) == bytes.size());
+                copy(bytes.begin(), bytes.end(), data.begin(kmerId));
+            }
+        }
+    }
+}
+
+
+
+void MarkerKmerIndex::accessExistingReadOnly(const string& name)
+{
+    data.accessExistingReadOnly(name + "-Data");
+    counts.accessExistingReadOnly(name + "-Counts");
+    markerCounts.accessExistingReadOnly(name + "-MarkerCounts");
+}
+
+
+
+void MarkerKmerIndex::remove()
+{
+    data.remove();
+    counts.remove();
+    markerCounts.remove();
+}
+
+
+
+uint64_t MarkerKmerIndex::byteCount() const
+{
+    return
+        data.totalSize() * sizeof(uint8_t) +
+        (data.size() + 1) * sizeof(uint64_t) +
+        counts.size() * sizeof(uint32_t) +
+        markerCounts.size() * sizeof(uint32_t);
+}
+
+
+
+size_t MarkerKmerIndex::k() const
+{
+    size_t kmerLength = 0;
+    while((1ULL << (2ULL*kmerLength)) < counts.size()) {
+        ++kmerLength;
+    }
+    CZI_ASSERT((1ULL << (2ULL*kmerLength)) == counts.size());
+    return kmerLength;
+}
+
+
+
+// The number of occurrences on strand 1 of a KmerId is the number
+// of occurrences on strand 0 of its reverse complement.
+uint64_t MarkerKmerIndex::frequency(KmerId kmerId) const
+{
+    const KmerId reverseComplementedKmerId = KmerId(reverseComplementKmerId(kmerId, k()));
+    return uint64_t(counts[kmerId]) + uint64_t(counts[reverseComplementedKmerId]);
+}
+
+
+
+// Decode the postings on strand 0 for a KmerId,
+// calling the given function for each of them.
+template<class F> void MarkerKmerIndex::decode(KmerId kmerId, const F& f) const
+{
+    const uint8_t* p = data.begin(kmerId);
+    const uint8_t* end = data.end(kmerId);
+    ReadId readId = 0;
+    uint32_t ordinal = 0;
+    while(p != end) {
+        const ReadId readIdDelta = ReadId(readVarint(p));
+        const uint32_t x = uint32_t(readVarint(p));
+        readId += readIdDelta;
+        ordinal = (readIdDelta == 0) ? (ordinal + x) : x;
+        f(readId, ordinal);
+    }
+}
+
+
+
+void MarkerKmerIndex::get(KmerId kmerId, vector<Posting>& postings) const
+{
+    postings.clear();
+    postings.reserve(frequency(kmerId));
+
+    // Strand 0.
+    decode(kmerId,
+        [&postings](ReadId readId, uint32_t ordinal)
+        {
+            postings.push_back(Posting(OrientedReadId(readId, 0), ordinal));
+        });
+    const auto strand0End = postings.end() - postings.begin();
+
+    // Strand 1, from the occurrences of the reverse complement on strand 0.
+    // For each read, these come in order of decreasing ordinal.
+    const KmerId reverseComplementedKmerId = KmerId(reverseComplementKmerId(kmerId, k()));
+    decode(reverseComplementedKmerId,
+        [this, &postings](ReadId readId, uint32_t ordinal)
+        {
+            postings.push_back(Posting(OrientedReadId(readId, 1), markerCounts[readId] - 1 - ordinal));
+        });
+    sort(postings.begin() + strand0End, postings.end());
+
+    // OrientedReadId(readId, 0) < OrientedReadId(readId, 1) < OrientedReadId(readId+1, 0),
+    // so we merge the two strands.
+    std::inplace_merge(postings.begin(), postings.begin() + strand0End, postings.end());
+}
+
+
+
+// Variable length integers, 7 bits per byte,
+// with the high bit set on all bytes except the last.
+void MarkerKmerIndex::writeVarint(uint64_t x, vector<uint8_t>& bytes)
+{
+    while(x >= 0x80ULL) {
+        bytes.push_back(uint8_t(x | 0x80ULL));
+        x >>= 7ULL;
+    }
+    bytes.push_back(uint8_t(x));
+}
+uint64_t MarkerKmerIndex::readVarint(const uint8_t*& p)
+{
+    uint64_t x = 0;
+    uint64_t shift = 0;
+    while(true) {
+        const uint8_t byte = *p++;
+        x |= uint64_t(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) {
+            return x;
+        }
+        shift += 7ULL;
+    }
+}
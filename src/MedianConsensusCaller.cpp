@@ -1,5 +1,7 @@
 #include "MedianConsensusCaller.hpp"
+#include "CompactCoverage.hpp"
 #include "Coverage.hpp"
+#include "CoverageTensor.hpp"
 #include <cmath>
 using namespace ChanZuckerberg;
 using namespace shasta;
@@ -8,6 +10,17 @@ using std::ceil;
 
 
 size_t MedianConsensusCaller::predict_runlength(const Coverage &coverage, AlignedBase consensus_base) const{
+    return predict_runlength_template(coverage, consensus_base);
+}
+
+
+size_t MedianConsensusCaller::predict_runlength(const CompactCoverage &coverage, AlignedBase consensus_base) const{
+    return predict_runlength_template(coverage, consensus_base);
+}
+
+
+template<class CoverageType> size_t MedianConsensusCaller::predict_runlength_template(
+    const CoverageType &coverage, AlignedBase consensus_base) const{
     size_t max_observed_repeat;     // Used to define the range of the loop over [base,length] observations
     size_t n_coverage;              // How many reads support each run length
     size_t n_total_coverage;        // How many reads support consensus base in total
@@ -60,6 +73,73 @@ Consensus MedianConsensusCaller::operator()(
 }
 
 
+Consensus MedianConsensusCaller::operator()(
+    const CompactCoverage& coverage) const
+{
+    const AlignedBase base = coverage.mostFrequentBase();
+    const size_t repeatCount = predict_runlength(coverage, base);
+    return Consensus(base, repeatCount);
+}
+
+
+// Batch version. This does the same computation as predict_runlength,
+// but for all columns at once, with the loop over columns innermost.
+// Because repeat counts in a CoverageTensor are limited
+// to CoverageTensor::maxRepeatCount, we can loop over
+// all possible repeat counts instead of stopping at repeatCountEnd.
+void MedianConsensusCaller::operator()(
+    const CoverageTensor& coverageTensor,
+    vector<Consensus>& consensus) const
+{
+    const size_t columnCount = coverageTensor.size();
+
+    vector<AlignedBase> bases;
+    coverageTensor.mostFrequentBases(bases);
+    vector<uint32_t> baseCoverage;
+    coverageTensor.computeBaseCoverage(baseCoverage);
+
+    vector<double> midpoint(columnCount);
+    for(size_t column=0; column<columnCount; column++) {
+        midpoint[column] = double(baseCoverage[bases[column].value*columnCount + column])/2;
+    }
+
+    vector<size_t> sum(columnCount, 0);
+    vector<size_t> prev_length(columnCount, 0);
+    vector<size_t> median(columnCount, 0);
+    vector<bool> done(columnCount, false);
+    for (size_t length=0; length<=CoverageTensor::maxRepeatCount; length++){
+        for(size_t column=0; column<columnCount; column++) {
+            if(done[column]) {
+                continue;
+            }
+            const size_t n_coverage = coverageTensor.coverage(column, bases[column], length);
+            sum[column] += n_coverage;
+
+            if (double(sum[column]) > midpoint[column]){
+                if (n_coverage > 1){
+                    // Both flanking observations are the same value
+                    median[column] = length;
+                }else{
+                    // Flanking observations differ in value (use the ceiling of their average)
+                    median[column] = size_t(ceil(double(prev_length[column]+length)/2));
+                }
+                done[column] = true;
+                continue;
+            }
+
+            if (n_coverage > 0){
+                prev_length[column] = length;
+            }
+        }
+    }
+
+    consensus.resize(columnCount);
+    for(size_t column=0; column<columnCount; column++) {
+        consensus[column] = Consensus(bases[column], median[column]);
+    }
+}
+
+
 void testMedianConsensusCaller(){
     MedianConsensusCaller classifier;
     Coverage coverage;
@@ -34,7 +34,16 @@ class ChanZuckerberg::shasta::MedianConsensusCaller :
 public:
 
     size_t predict_runlength(const Coverage &coverage, AlignedBase consensus_base) const;
+    size_t predict_runlength(const CompactCoverage &coverage, AlignedBase consensus_base) const;
     virtual Consensus operator()(const Coverage&) const;
+    virtual Consensus operator()(const CompactCoverage&) const;
+    virtual void operator()(const CoverageTensor&, vector<Consensus>&) const;
+
+private:
+
+    // The implementation is the same for Coverage and CompactCoverage.
+    template<class CoverageType> size_t predict_runlength_template(
+        const CoverageType &coverage, AlignedBase consensus_base) const;
 };
 
 void testMedianConsensusCaller();
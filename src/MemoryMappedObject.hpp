@@ -6,6 +6,7 @@
 // CZI.
 #include "CZI_ASSERT.hpp"
 #include "filesystem.hpp"
+#include "HugePages.hpp"
 #include "touchMemory.hpp"
 
 // Standard libraries.
@@ -99,6 +100,8 @@ private:
         // If the mapped file is backed by Linux huge pages,
         // this value must equal the Linux huge page size used
         // or a multiple of it.
+        // If 1 GB pages were requested, this is 2 MB
+        // (see HugePages::getEffectivePageSize).
         size_t pageSize;
 
         // The number of pages in the mapped file.
@@ -127,7 +130,8 @@ private:
             headerSize = sizeof(Header);
             objectSize = sizeof(T);
             objectCount = 1;
-            pageSize = pageSizeArgument;
+            pageSize = HugePages::getEffectivePageSize(
+                pageSizeArgument, headerSize + objectSize * objectCount);
             pageCount = computePageCount(headerSize + objectSize * objectCount, pageSize);
             fileSize = pageCount * pageSize;
             capacity = 1;
@@ -248,7 +252,7 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Object<T>::t
 // Map to memory the given file descriptor for the specified size.
 template<class T> inline void* ChanZuckerberg::shasta::MemoryMapped::Object<T>::map(int fileDescriptor, size_t fileSize, bool writeAccess)
 {
-    void* pointer = ::mmap(0, fileSize, PROT_READ | (writeAccess ? PROT_WRITE : 0), MAP_SHARED, fileDescriptor, 0);
+    void* pointer = HugePages::mapFile(fileDescriptor, fileSize, PROT_READ | (writeAccess ? PROT_WRITE : 0));
     if(pointer == reinterpret_cast<void*>(-1LL)) {
         ::close(fileDescriptor);
         throw runtime_error("Error during mmap.");
@@ -275,7 +279,7 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Object<T>::c
     const string& name,
     size_t pageSize)
 {
-    CZI_ASSERT(pageSize==4096 || pageSize==2*1024*1024);
+    CZI_ASSERT(HugePages::isValidPageSize(pageSize));
 
     if(name.empty()) {
         createNewAnonymous(pageSize);
@@ -343,15 +347,7 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Object<T>::c
         const size_t fileSize = headerOnStack.fileSize;
 
         // Map it in memory.
-        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
-#ifdef __linux__
-        if(pageSize == 2*1024*1024) {
-            flags |= MAP_HUGETLB | MAP_HUGE_2MB;
-        }
-#endif
-        void* pointer = ::mmap(0, fileSize,
-            PROT_READ | PROT_WRITE, flags,
-            -1, 0);
+        void* pointer = HugePages::mapAnonymous(fileSize, headerOnStack.pageSize);
         if(pointer == reinterpret_cast<void*>(-1LL)) {
             throw runtime_error("Error " + to_string(errno)
                 + " during mmap call for MemoryMapped::Vector: " + string(strerror(errno)));
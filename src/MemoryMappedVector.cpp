@@ -1,6 +1,14 @@
 #include "MemoryMappedObject.hpp"
 #include "MemoryMappedVector.hpp"
 
+// Static data members of class MemoryMapped::Statistics.
+uint64_t ChanZuckerberg::shasta::MemoryMapped::Statistics::mappedVectorCount = 0;
+uint64_t ChanZuckerberg::shasta::MemoryMapped::Statistics::mappedBytes = 0;
+uint64_t ChanZuckerberg::shasta::MemoryMapped::Statistics::peakMappedBytes = 0;
+
+// Static data member of class MemoryMapped::AddressSpaceReservation.
+uint64_t ChanZuckerberg::shasta::MemoryMapped::AddressSpaceReservation::byteCount = 0;
+
 namespace ChanZuckerberg {
     namespace shasta {
         class MemoryMappedObjectTest {
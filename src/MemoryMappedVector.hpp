@@ -6,8 +6,10 @@
 // CZI.
 #include "CZI_ASSERT.hpp"
 #include "filesystem.hpp"
+#include "HugePages.hpp"
 #include "MarkerInterval.hpp"
 #include "MurmurHash2.hpp"
+#include "Numa.hpp"
 #include "touchMemory.hpp"
 
 // Boost libraries.
@@ -20,6 +22,7 @@
 #include "iostream.hpp"
 #include "stdexcept.hpp"
 #include "string.hpp"
+#include <thread>
 #include "vector.hpp"
 
 // Linux.
@@ -38,6 +41,18 @@ namespace ChanZuckerberg {
     namespace shasta {
         namespace MemoryMapped {
             template<class T> class Vector;
+            class Statistics;
+            class AddressSpaceReservation;
+
+            // Access pattern hints for Vector::adviseAccessPattern.
+            // These map to the corresponding madvise/posix_fadvise advice values.
+            enum class AccessPattern {
+                Normal,
+                Sequential,
+                Random,
+                WillNeed,
+                DontNeed
+            };
         }
         void testMemoryMappedVector();
     }
@@ -45,6 +60,94 @@ namespace ChanZuckerberg {
 
 
 
+// Class Statistics keeps track of the memory mapped by all
+// MemoryMapped::Vector objects: the number of open vectors,
+// the total number of bytes they map (the sum of their file sizes,
+// which includes the header and any capacity not in use),
+// and the high water mark of that total.
+// The static data members are defined in MemoryMappedVector.cpp.
+class ChanZuckerberg::shasta::MemoryMapped::Statistics {
+public:
+
+    static uint64_t getMappedVectorCount()
+    {
+        return mappedVectorCount;
+    }
+    static uint64_t getMappedBytes()
+    {
+        return mappedBytes;
+    }
+    static uint64_t getPeakMappedBytes()
+    {
+        return peakMappedBytes;
+    }
+
+    // Restart the high water mark from the current number of mapped bytes.
+    static void resetPeakMappedBytes()
+    {
+        peakMappedBytes = mappedBytes;
+    }
+
+    // Called by Vector every time it maps or unmaps memory.
+    static void recordMap(uint64_t byteCount)
+    {
+        __sync_fetch_and_add(&mappedVectorCount, 1);
+        const uint64_t newMappedBytes = __sync_add_and_fetch(&mappedBytes, byteCount);
+        uint64_t oldPeak = peakMappedBytes;
+        while(newMappedBytes > oldPeak) {
+            const uint64_t previousPeak =
+                __sync_val_compare_and_swap(&peakMappedBytes, oldPeak, newMappedBytes);
+            if(previousPeak == oldPeak) {
+                break;
+            }
+            oldPeak = previousPeak;
+        }
+    }
+    static void recordUnmap(uint64_t byteCount)
+    {
+        __sync_fetch_and_sub(&mappedVectorCount, 1);
+        __sync_fetch_and_sub(&mappedBytes, byteCount);
+    }
+
+private:
+    static uint64_t mappedVectorCount;
+    static uint64_t mappedBytes;
+    static uint64_t peakMappedBytes;
+};
+
+
+
+// Class AddressSpaceReservation controls growth in place
+// of MemoryMapped::Vector objects.
+// If the reservation byte count is not zero, each Vector created or opened
+// with write access reserves, without committing any memory,
+// a range of address space of at least that size
+// (and at least twice its current size).
+// When the Vector grows (resize, reserve, push_back), the new pages
+// are mapped in place at the end of the existing mapping,
+// so the data are never moved, existing mappings are not touched,
+// and there is no copy for anonymous vectors.
+// When it shrinks, the pages no longer needed are returned
+// to the reserved range.
+// Only growth beyond the reserved range falls back to remapping.
+// The default is zero (no reservation).
+// The static data member is defined in MemoryMappedVector.cpp.
+class ChanZuckerberg::shasta::MemoryMapped::AddressSpaceReservation {
+public:
+    static void setByteCount(uint64_t byteCountArgument)
+    {
+        byteCount = byteCountArgument;
+    }
+    static uint64_t getByteCount()
+    {
+        return byteCount;
+    }
+private:
+    static uint64_t byteCount;
+};
+
+
+
 template<class T> class ChanZuckerberg::shasta::MemoryMapped::Vector {
 public:
 
@@ -100,6 +203,11 @@ public:
     // This is automatically called by the destructor.
     void close();
 
+    // Same as close, but first compute the checksums
+    // and store them in the header (see verifyChecksums).
+    // Use this for files that will be verified when accessed again.
+    void closeWithChecksums(size_t threadCount = 0);
+
 
     // Close and remove the supporting file.
     void remove();
@@ -119,6 +227,23 @@ public:
         return shasta::touchMemory(begin(), end());
     }
 
+    // Tell the kernel how the mapped memory will be accessed,
+    // so it can adjust read-ahead and page eviction.
+    // This is only a hint, so errors are ignored.
+    // For anonymous vectors, DontNeed is ignored
+    // because it would discard the data.
+    void adviseAccessPattern(AccessPattern) const;
+
+    // Load the mapped memory in real memory using multiple threads.
+    // This is faster than touchMemory when starting from a cold page cache.
+    // If threadCount is 0, the number of hardware threads is used.
+    // The return value can be ignored.
+    size_t prefetch(size_t threadCount = 0) const
+    {
+        adviseAccessPattern(AccessPattern::WillNeed);
+        return shasta::touchMemoryMultithreaded(begin(), end(), threadCount);
+    }
+
 
     void reserve();
     void reserve(size_t capacity);
@@ -150,8 +275,40 @@ public:
     // Can be used to check integrity.
     uint64_t hash() const;
 
+    // Per-chunk checksums of the data, used to detect corrupted files
+    // without having to hash the entire vector.
+    // Computing the checksums requires hashing all the data,
+    // so this is only done on request: for a vector backed by a file
+    // and open with write access, closeWithChecksums computes the checksums
+    // and stores them in the header.
+    // The checksums are invalidated in the file as soon as it is opened
+    // with write access, so a run that terminates without closing
+    // its vectors does not leave stale checksums.
+    // The verify functions check the data against the checksums
+    // the file had when it was opened, so they must be called
+    // before the data are modified.
+    // They return false if no valid checksums are available
+    // (anonymous vectors, files written by older versions,
+    // or files that were not closed) and throw an exception
+    // in case of mismatch.
+    bool hasValidChecksums() const
+    {
+        return openChecksums.isValid != 0;
+    }
+
+    // Verify all chunks, using multiple threads.
+    bool verifyChecksums(size_t threadCount = 0) const;
+
+    // Verify only the chunks that contain elements [begin, end)
+    // and were not already verified.
+    // This is cheap enough to be called before accessing a range of elements.
+    bool verifyChecksums(size_t begin, size_t end) const;
+
 private:
 
+    // Hash a range of bytes. This is used by hash and for checksums.
+    static uint64_t hashBytes(const char*, uint64_t byteCount);
+
 
     // Compute the number of pages needed to hold n bytes.
     static size_t computePageCount(size_t n, size_t pageSize)
@@ -177,6 +334,8 @@ private:
         // If the mapped file is backed by Linux huge pages,
         // this value must equal the Linux huge page size used
         // or a multiple of it.
+        // If 1 GB pages were requested but the data are
+        // smaller than 1 GB, this is 2 MB (see HugePages::getEffectivePageSize).
         size_t pageSize;
 
         // The number of pages in the mapped file.
@@ -196,8 +355,43 @@ private:
         static const size_t constantMagicNumber =  0xa3756fd4b5d8bcc1ULL;
         size_t magicNumber;
 
+        // The format version. Files created before versioning
+        // have zero here and have no checksums.
+        static const size_t currentFormatVersion = 1;
+        size_t formatVersion;
+
+        // Used to detect files created on a machine with different byte order.
+        static const size_t constantEndiannessTag = 0x0102030405060708ULL;
+        size_t endiannessTag;
+
+        // Checksums of the data, in chunks of chunkSize bytes
+        // (the last chunk can be shorter).
+        // The data are divided in at most maxChunkCount chunks,
+        // so the checksums fit in the header.
+        class Checksums {
+        public:
+            static const size_t maxChunkCount = 16;
+            size_t isValid;
+            size_t byteCount;   // The number of bytes covered by the checksums.
+            size_t chunkSize;
+            array<uint64_t, maxChunkCount> values;
+            size_t chunkCount() const
+            {
+                return (byteCount == 0) ? 0 : ((byteCount - 1) / chunkSize + 1);
+            }
+        };
+        Checksums checksums;
+
+        // The page size specified to createNew, used when the capacity changes.
+        // Files created by older versions have zero here.
+        size_t requestedPageSize;
+        size_t getRequestedPageSize() const
+        {
+            return requestedPageSize ? requestedPageSize : pageSize;
+        }
+
         // Pad to 256 bytes to make sure the data are aligned with cache lines.
-        array<size_t, 24> padding;
+        array<size_t, 2> padding;
 
 
 
@@ -210,11 +404,15 @@ private:
             headerSize = sizeof(Header);
             objectSize = sizeof(T);
             objectCount = n;
-            pageSize = pageSizeArgument;
+            requestedPageSize = pageSizeArgument;
+            pageSize = HugePages::getEffectivePageSize(
+                pageSizeArgument, headerSize + objectSize * requestedCapacity);
             pageCount = computePageCount(headerSize + objectSize * requestedCapacity, pageSize);
             fileSize = pageCount * pageSize;
             capacity = (fileSize - headerSize) / objectSize;
             magicNumber = constantMagicNumber;
+            formatVersion = currentFormatVersion;
+            endiannessTag = constantEndiannessTag;
         }
 
 
@@ -243,6 +441,40 @@ public:
     string fileName;
 
 private:
+
+    // The size of the reserved address space range that begins at header,
+    // or zero if not using reserved address space (see AddressSpaceReservation).
+    size_t reservedByteCount;
+
+    // The checksums stored in the header when the file was opened,
+    // and a bit mask of the chunks already verified.
+    typename Header::Checksums openChecksums;
+    mutable uint64_t verifiedChunks;
+    void computeChecksums(size_t threadCount = 0);
+    void verifyChunk(size_t chunkId) const;
+
+    // msync the entire mapping.
+    void syncMappedMemory();
+
+    // The number of bytes to munmap when unmapping.
+    size_t mappedByteCount() const
+    {
+        return reservedByteCount ? reservedByteCount : header->fileSize;
+    }
+
+    // Map a file or, if the file descriptor is -1, anonymous memory,
+    // using reserved address space if requested by AddressSpaceReservation.
+    void* mapWithReservation(int fileDescriptor, size_t fileSize, bool writeAccess, size_t pageSize);
+
+    // Change the file size in place inside the reserved address space.
+    // Returns false if not using reserved address space,
+    // or if the new file size does not fit.
+    bool resizeInPlace(const Header& newHeader);
+
+    // Stop using reserved address space, releasing the part
+    // of the reserved range that is not in use.
+    void releaseReservation();
+
     // Unmap the memory.
     void unmap();
 
@@ -382,8 +614,11 @@ template<class T> inline ChanZuckerberg::shasta::MemoryMapped::Vector<T>::Vector
     header(0),
     data(0),
     isOpen(false),
-    isOpenWithWriteAccess(false)
+    isOpenWithWriteAccess(false),
+    reservedByteCount(0),
+    verifiedChunks(0)
 {
+    openChecksums.isValid = 0;
 }
 
 
@@ -434,7 +669,7 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::t
 // Map to memory the given file descriptor for the specified size.
 template<class T> inline void* ChanZuckerberg::shasta::MemoryMapped::Vector<T>::map(int fileDescriptor, size_t fileSize, bool writeAccess)
 {
-    void* pointer = ::mmap(0, fileSize, PROT_READ | (writeAccess ? PROT_WRITE : 0), MAP_SHARED, fileDescriptor, 0);
+    void* pointer = HugePages::mapFile(fileDescriptor, fileSize, PROT_READ | (writeAccess ? PROT_WRITE : 0));
     if(pointer == reinterpret_cast<void*>(-1LL)) {
         ::close(fileDescriptor);
         throw runtime_error("Error " + boost::lexical_cast<string>(errno)
@@ -467,7 +702,7 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::c
     size_t n,
     size_t requiredCapacity)
 {
-    CZI_ASSERT(pageSize==4096 || pageSize==2*1024*1024);
+    CZI_ASSERT(HugePages::isValidPageSize(pageSize));
 
     if(name.empty()) {
         createNewAnonymous(pageSize, n, requiredCapacity);
@@ -490,7 +725,7 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::c
         truncate(fileDescriptor, fileSize);
 
         // Map it in memory.
-        void* pointer = map(fileDescriptor, fileSize, true);
+        void* pointer = mapWithReservation(fileDescriptor, fileSize, true, headerOnStack.pageSize);
 
         // There is no need to keep the file descriptor open.
         // Closing the file descriptor as early as possible will make it possible to use large
@@ -504,8 +739,10 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::c
 
         // Store the header.
         *header = headerOnStack;
+        Statistics::recordMap(header->fileSize);
 
         // Call the default constructor on the data.
+        Numa::firstTouch(data, data+n);
         for(size_t i=0; i<n; i++) {
             new(data+i) T();
         }
@@ -539,19 +776,7 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::c
         const size_t fileSize = headerOnStack.fileSize;
 
         // Map it in memory.
-        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
-#ifdef __linux__
-        if(pageSize == 2*1024*1024) {
-            flags |= MAP_HUGETLB | MAP_HUGE_2MB;
-        }
-#endif
-        void* pointer = ::mmap(0, fileSize,
-            PROT_READ | PROT_WRITE, flags,
-            -1, 0);
-        if(pointer == reinterpret_cast<void*>(-1LL)) {
-            throw runtime_error("Error " + boost::lexical_cast<string>(errno)
-                + " during mmap call for MemoryMapped::Vector: " + string(strerror(errno)));
-        }
+        void* pointer = mapWithReservation(-1, fileSize, true, headerOnStack.pageSize);
 
         // Figure out where the data and the header go.
         header = static_cast<Header*>(pointer);
@@ -559,8 +784,10 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::c
 
         // Store the header.
         *header = headerOnStack;
+        Statistics::recordMap(header->fileSize);
 
         // Call the default constructor on the data.
+        Numa::firstTouch(data, data+n);
         for(size_t i=0; i<n; i++) {
             new(data+i) T();
         }
@@ -590,7 +817,11 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::a
         const size_t fileSize = getFileSize(fileDescriptor);
 
         // Now map it in memory.
-        void* pointer = map(fileDescriptor, fileSize, readWriteAccess);
+        // Only use reserved address space if we can write,
+        // because otherwise the vector cannot grow.
+        void* pointer = readWriteAccess ?
+            mapWithReservation(fileDescriptor, fileSize, true, 4096) :
+            map(fileDescriptor, fileSize, false);
 
         // There is no need to keep the file descriptor open.
         // Closing the file descriptor as early as possible will make it possible to use large
@@ -604,8 +835,28 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::a
 
         // Sanity checks.
         CZI_ASSERT(header->magicNumber == Header::constantMagicNumber);
+        if(header->formatVersion > Header::currentFormatVersion) {
+            throw runtime_error("File format version " + to_string(header->formatVersion) +
+                " is not supported by this version of the code.");
+        }
+        if(header->formatVersion > 0 && header->endiannessTag != Header::constantEndiannessTag) {
+            throw runtime_error("File was created on a machine with different byte order.");
+        }
         CZI_ASSERT(header->fileSize == fileSize);
         CZI_ASSERT(header->objectSize == sizeof(T));
+        Statistics::recordMap(header->fileSize);
+
+        // Remember the checksums, then, if we have write access,
+        // invalidate them in the file until closeWithChecksums stores new ones.
+        if(header->formatVersion > 0) {
+            openChecksums = header->checksums;
+        } else {
+            openChecksums.isValid = 0;
+        }
+        verifiedChunks = 0;
+        if(readWriteAccess) {
+            header->checksums.isValid = 0;
+        }
 
         // Indicate that the mapped vector is open with write access.
         isOpen = true;
@@ -635,7 +886,7 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::a
 {
     try {
         accessExistingReadWrite(name);
-        CZI_ASSERT(pageSize == header->pageSize);
+        CZI_ASSERT(pageSize == header->getRequestedPageSize());
     } catch(...) {
         createNew(name, pageSize);
     }
@@ -647,6 +898,10 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::a
 template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::syncToDisk()
 {
     CZI_ASSERT(isOpen);
+    syncMappedMemory();
+}
+template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::syncMappedMemory()
+{
     const int msyncReturnCode = ::msync(header, header->fileSize, MS_SYNC);
     if(msyncReturnCode == -1) {
         throw runtime_error("Error " + to_string(errno) + " during msync for " + fileName
@@ -654,15 +909,64 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::s
     }
 }
 
+template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::adviseAccessPattern(
+    AccessPattern accessPattern) const
+{
+    CZI_ASSERT(isOpen);
+
+    int madviseAdvice = MADV_NORMAL;
+    int fadviseAdvice = POSIX_FADV_NORMAL;
+    switch(accessPattern) {
+    case AccessPattern::Normal:
+        break;
+    case AccessPattern::Sequential:
+        madviseAdvice = MADV_SEQUENTIAL;
+        fadviseAdvice = POSIX_FADV_SEQUENTIAL;
+        break;
+    case AccessPattern::Random:
+        madviseAdvice = MADV_RANDOM;
+        fadviseAdvice = POSIX_FADV_RANDOM;
+        break;
+    case AccessPattern::WillNeed:
+        madviseAdvice = MADV_WILLNEED;
+        fadviseAdvice = POSIX_FADV_WILLNEED;
+        break;
+    case AccessPattern::DontNeed:
+        if(fileName.empty()) {
+            return;
+        }
+        madviseAdvice = MADV_DONTNEED;
+        fadviseAdvice = POSIX_FADV_DONTNEED;
+        break;
+    }
+    ::madvise(header, header->fileSize, madviseAdvice);
+
+    // For a file backed vector, also advise the page cache.
+    // This affects read-ahead from disk for pages not yet in memory.
+    if(!fileName.empty()) {
+        const int fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+        if(fileDescriptor != -1) {
+            ::posix_fadvise(fileDescriptor, 0, 0, fadviseAdvice);
+            ::close(fileDescriptor);
+        }
+    }
+}
+
+
+
 // Unmap the memory.
 template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::unmap()
 {
     CZI_ASSERT(isOpen);
 
-    const int munmapReturnCode = ::munmap(header, header->fileSize);
+    Statistics::recordUnmap(header->fileSize);
+    const int munmapReturnCode = ::munmap(header, mappedByteCount());
     if(munmapReturnCode == -1) {
         throw runtime_error("Error unmapping " + fileName);
     }
+    reservedByteCount = 0;
+    openChecksums.isValid = 0;
+    verifiedChunks = 0;
 
     // Mark it as not open.
     isOpen = false;
@@ -679,10 +983,14 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::u
 {
     CZI_ASSERT(isOpen);
 
-    const int munmapReturnCode = ::munmap(header, header->fileSize);
+    Statistics::recordUnmap(header->fileSize);
+    const int munmapReturnCode = ::munmap(header, mappedByteCount());
     if(munmapReturnCode == -1) {
         throw runtime_error("Error unmapping.");
     }
+    reservedByteCount = 0;
+    openChecksums.isValid = 0;
+    verifiedChunks = 0;
 
     // Mark it as not open.
     isOpen = false;
@@ -702,14 +1010,25 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::c
     unmap();
 }
 
+// Compute and store the checksums, then close it.
+template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::closeWithChecksums(
+    size_t threadCount)
+{
+    CZI_ASSERT(isOpenWithWriteAccess);
+    CZI_ASSERT(!fileName.empty());
+    computeChecksums(threadCount);
+    close();
+}
+
 // Close it and remove the supporting file.
 template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::remove()
 {
     if(fileName.empty()) {
         unmapAnonymous();
     } else {
+        // No need to sync data that are about to be removed.
         const string savedFileName = fileName;
-        close();    // This forgets the fileName.
+        unmap();    // This forgets the fileName.
         filesystem::remove(savedFileName);
     }
 }
@@ -750,6 +1069,8 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::r
             header->objectCount = newSize;
 
             // Call the constructor on the elements we added.
+
+            Numa::firstTouch(data+oldSize, data+newSize);
             for(size_t i=oldSize; i<newSize; i++) {
                 new(data+i) T();
             }
@@ -762,15 +1083,25 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::r
             // Note that we don't have to copy the existing vector elements.
 
             // Save the page size.
-            const size_t pageSize = header->pageSize;
-
-            // Save the file name and close it.
-            const string name = fileName;
-            close();
+            const size_t pageSize = header->getRequestedPageSize();
 
             // Create a header corresponding to increased capacity.
             const Header headerOnStack(newSize, size_t(1.5*double(newSize)), pageSize);
 
+            // If possible, grow in place in the reserved address space.
+            if(resizeInPlace(headerOnStack)) {
+                Numa::firstTouch(data+oldSize, data+newSize);
+                for(size_t i=oldSize; i<newSize; i++) {
+                    new(data+i) T();
+                }
+                return;
+            }
+
+            // Save the file name, sync it, and unmap it.
+            const string name = fileName;
+            syncMappedMemory();
+            unmap();
+
 
             // Resize the file as necessary.
             const int fileDescriptor = openExisting(name, true);
@@ -779,7 +1110,7 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::r
             // Remap it.
             void* pointer = 0;
             try {
-                pointer = map(fileDescriptor, headerOnStack.fileSize, true);
+                pointer = mapWithReservation(fileDescriptor, headerOnStack.fileSize, true, headerOnStack.pageSize);
             } catch(runtime_error e) {
                 throw runtime_error("An error occurred while resizing MemoryMapped::Vector "
                     + name + ":\n" +
@@ -794,6 +1125,7 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::r
 
             // Store the header.
             *header = headerOnStack;
+            Statistics::recordMap(header->fileSize);
 
             // Indicate that the mapped vector is open with write access.
             isOpen = true;
@@ -801,6 +1133,8 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::r
             fileName = name;
 
             // Call the constructor on the elements we added.
+
+            Numa::firstTouch(data+oldSize, data+newSize);
             for(size_t i=oldSize; i<newSize; i++) {
                 new(data+i) T();
             }
@@ -839,6 +1173,8 @@ template<class T> inline void
             header->objectCount = newSize;
 
             // Call the constructor on the elements we added.
+
+            Numa::firstTouch(data+oldSize, data+newSize);
             for(size_t i=oldSize; i<newSize; i++) {
                 new(data+i) T();
             }
@@ -851,15 +1187,26 @@ template<class T> inline void
             // Note that we don't have to copy the existing vector elements.
 
             // Save the page size.
-            const size_t pageSize = header->pageSize;
+            const size_t pageSize = header->getRequestedPageSize();
 
             // Create a header corresponding to increased capacity.
             const Header headerOnStack(newSize, size_t(1.5*double(newSize)), pageSize);
 
+            // If possible, grow in place in the reserved address space.
+            if(resizeInPlace(headerOnStack)) {
+                Numa::firstTouch(data+oldSize, data+newSize);
+                for(size_t i=oldSize; i<newSize; i++) {
+                    new(data+i) T();
+                }
+                return;
+            }
+            releaseReservation();
+
 
 
             // Remap it.
             // We can only use remap for Linux, and for 4K pages.
+            Statistics::recordUnmap(header->fileSize);
             bool useMremap = false;
             void* pointer = 0;
 #ifdef __linux__
@@ -877,22 +1224,14 @@ template<class T> inline void
 
                 // We cannot use mremap. We have to create a new mapping
                 // and copy the data.
-                int flags = MAP_PRIVATE | MAP_ANONYMOUS;
-#ifdef __linux__
-                if(pageSize == 2*1024*1024) {
-                    flags |= MAP_HUGETLB | MAP_HUGE_2MB;
-                }
-#endif
-                void* newPointer = ::mmap(0, headerOnStack.fileSize,
-                    PROT_READ | PROT_WRITE, flags,
-                    -1, 0);
+                void* newPointer = HugePages::mapAnonymous(headerOnStack.fileSize, headerOnStack.pageSize);
                 if(newPointer == reinterpret_cast<void*>(-1LL)) {
                     throw runtime_error("Error " + boost::lexical_cast<string>(errno)
                         + " during mmap call for MemoryMapped::Vector: " + string(strerror(errno)));
                 }
                 std::copy(
                     reinterpret_cast<char*>(header),
-                    reinterpret_cast<char*>(header) + header->fileSize,
+                    reinterpret_cast<char*>(header) + std::min(header->fileSize, headerOnStack.fileSize),
                     static_cast<char*>(newPointer));
                 ::munmap(header, header->fileSize);
                 pointer = newPointer;
@@ -906,6 +1245,7 @@ template<class T> inline void
 
             // Store the header.
             *header = headerOnStack;
+            Statistics::recordMap(header->fileSize);
 
             // Indicate that the mapped vector is open with write access.
             isOpen = true;
@@ -913,6 +1253,8 @@ template<class T> inline void
             fileName = "";
 
             // Call the constructor on the elements we added.
+
+            Numa::firstTouch(data+oldSize, data+newSize);
             for(size_t i=oldSize; i<newSize; i++) {
                 new(data+i) T();
             }
@@ -942,21 +1284,27 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::r
         return;
     }
 
-    // Save what we need and close it.
+    // Create a header corresponding to the new capacity.
     const size_t currentSize = size();
-    const string name = fileName;
-    const size_t pageSize = header->pageSize;
-    close();
-
-    // Create a header corresponding to increased capacity.
+    const size_t pageSize = header->getRequestedPageSize();
     const Header headerOnStack(currentSize, capacity, pageSize);
 
+    // If possible, change the capacity in place in the reserved address space.
+    if(resizeInPlace(headerOnStack)) {
+        return;
+    }
+
+    // Save what we need, sync it, and unmap it.
+    const string name = fileName;
+    syncMappedMemory();
+    unmap();
+
     // Resize the file as necessary.
     const int fileDescriptor = openExisting(name, true);
     truncate(fileDescriptor, headerOnStack.fileSize);
 
     // Remap it.
-    void* pointer = map(fileDescriptor, headerOnStack.fileSize, true);
+    void* pointer = mapWithReservation(fileDescriptor, headerOnStack.fileSize, true, headerOnStack.pageSize);
     ::close(fileDescriptor);
 
     // Figure out where the data and the header are.
@@ -965,6 +1313,7 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::r
 
     // Store the header.
     *header = headerOnStack;
+    Statistics::recordMap(header->fileSize);
 
     // Indicate that the mapped vector is open with write access.
     isOpen = true;
@@ -982,14 +1331,21 @@ template<class T> inline
     // Save what we need and close it.
     const size_t currentSize = size();
     const string name = fileName;
-    const size_t pageSize = header->pageSize;
+    const size_t pageSize = header->getRequestedPageSize();
 
     // Create a header corresponding to increased capacity.
     const Header headerOnStack(currentSize, capacity, pageSize);
 
+    // If possible, change the capacity in place in the reserved address space.
+    if(resizeInPlace(headerOnStack)) {
+        return;
+    }
+    releaseReservation();
+
 
     // Remap it.
     // We can only use remap for Linux, and for 4K pages.
+    Statistics::recordUnmap(header->fileSize);
     bool useMremap = false;
 #ifdef __linux__
     useMremap = (pageSize == 4096);
@@ -1007,22 +1363,15 @@ template<class T> inline
 
         // We cannot use mremap. We have to create a new mapping
         // and copy the data.
-        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
-#ifdef __linux__
-        if(pageSize == 2*1024*1024) {
-            flags |= MAP_HUGETLB | MAP_HUGE_2MB;
-        }
-#endif
-        void* newPointer = ::mmap(0, headerOnStack.fileSize,
-            PROT_READ | PROT_WRITE, flags,
-            -1, 0);
+        void* newPointer = HugePages::mapAnonymous(headerOnStack.fileSize, headerOnStack.pageSize);
         if(newPointer == reinterpret_cast<void*>(-1LL)) {
             throw runtime_error("Error " + boost::lexical_cast<string>(errno)
                 + " during mmap call for MemoryMapped::Vector: " + string(strerror(errno)));
         }
+        // The capacity can be decreasing, so only copy what fits.
         std::copy(
             reinterpret_cast<char*>(header),
-            reinterpret_cast<char*>(header) + header->fileSize,
+            reinterpret_cast<char*>(header) + std::min(header->fileSize, headerOnStack.fileSize),
             static_cast<char*>(newPointer));
         ::munmap(header, header->fileSize);
         pointer = newPointer;
@@ -1036,6 +1385,7 @@ template<class T> inline
 
     // Store the header.
     *header = headerOnStack;
+    Statistics::recordMap(header->fileSize);
 
     // Indicate that the mapped vector is open with write access.
     isOpen = true;
@@ -1045,6 +1395,133 @@ template<class T> inline
 
 
 
+template<class T> inline void* ChanZuckerberg::shasta::MemoryMapped::Vector<T>::mapWithReservation(
+    int fileDescriptor,
+    size_t fileSize,
+    bool writeAccess,
+    size_t pageSize)
+{
+    reservedByteCount = 0;
+    const uint64_t requestedByteCount = AddressSpaceReservation::getByteCount();
+    if(requestedByteCount == 0) {
+        if(fileDescriptor == -1) {
+            void* pointer = HugePages::mapAnonymous(fileSize, pageSize);
+            if(pointer == reinterpret_cast<void*>(-1LL)) {
+                throw runtime_error("Error " + boost::lexical_cast<string>(errno)
+                    + " during mmap call for MemoryMapped::Vector: " + string(strerror(errno)));
+            }
+            return pointer;
+        } else {
+            return map(fileDescriptor, fileSize, writeAccess);
+        }
+    }
+
+    // Reserve the address space, rounded up to a multiple of the huge page size,
+    // or of the page size if larger, so 1 GB pages can be mapped in it.
+    const size_t alignment = std::max(HugePages::hugePageSize, pageSize);
+    size_t byteCount = std::max(size_t(requestedByteCount), 2 * fileSize);
+    byteCount = ((byteCount - 1) / alignment + 1) * alignment;
+    void* pointer = HugePages::reserveAddressSpace(byteCount, alignment);
+    if(pointer == reinterpret_cast<void*>(-1LL)) {
+        if(fileDescriptor != -1) {
+            ::close(fileDescriptor);
+        }
+        throw runtime_error("Error " + boost::lexical_cast<string>(errno)
+            + " reserving address space for MemoryMapped::Vector: " + string(strerror(errno)));
+    }
+
+    // Map the file or anonymous memory at the beginning of the reserved range.
+    void* mappedPointer = (fileDescriptor == -1) ?
+        HugePages::mapAnonymousAt(pointer, fileSize, pageSize) :
+        HugePages::mapFileAt(pointer, fileSize, PROT_READ | (writeAccess ? PROT_WRITE : 0),
+            fileDescriptor, 0);
+    if(mappedPointer == reinterpret_cast<void*>(-1LL)) {
+        const int savedErrno = errno;
+        ::munmap(pointer, byteCount);
+        if(fileDescriptor != -1) {
+            ::close(fileDescriptor);
+        }
+        throw runtime_error("Error " + boost::lexical_cast<string>(savedErrno)
+            + " during mmap call for MemoryMapped::Vector: " + string(strerror(savedErrno)));
+    }
+    reservedByteCount = byteCount;
+    return pointer;
+}
+
+
+
+template<class T> inline bool ChanZuckerberg::shasta::MemoryMapped::Vector<T>::resizeInPlace(
+    const Header& newHeader)
+{
+    const size_t oldFileSize = header->fileSize;
+    const size_t newFileSize = newHeader.fileSize;
+    if(reservedByteCount == 0 || newFileSize > reservedByteCount) {
+        return false;
+    }
+    char* begin = reinterpret_cast<char*>(header);
+
+    if(newFileSize > oldFileSize) {
+
+        // Map the new pages after the existing ones.
+        void* pointer = 0;
+        if(fileName.empty()) {
+            pointer = HugePages::mapAnonymousAt(
+                begin + oldFileSize, newFileSize - oldFileSize, newHeader.pageSize);
+        } else {
+            const int fileDescriptor = openExisting(fileName, true);
+            truncate(fileDescriptor, newFileSize);
+            pointer = HugePages::mapFileAt(
+                begin + oldFileSize, newFileSize - oldFileSize, PROT_READ | PROT_WRITE,
+                fileDescriptor, oldFileSize);
+            ::close(fileDescriptor);
+        }
+        if(pointer == reinterpret_cast<void*>(-1LL)) {
+            throw runtime_error("Error " + boost::lexical_cast<string>(errno)
+                + " during mmap call for MemoryMapped::Vector: " + string(strerror(errno)));
+        }
+
+    } else if(newFileSize < oldFileSize) {
+
+        // Return the pages no longer needed to the reserved range.
+        if(!fileName.empty()) {
+            syncMappedMemory();
+        }
+        void* pointer = HugePages::releaseToReservedAddressSpace(
+            begin + newFileSize, oldFileSize - newFileSize);
+        if(pointer == reinterpret_cast<void*>(-1LL)) {
+            throw runtime_error("Error " + boost::lexical_cast<string>(errno)
+                + " during mmap call for MemoryMapped::Vector: " + string(strerror(errno)));
+        }
+        if(!fileName.empty()) {
+            const int fileDescriptor = openExisting(fileName, true);
+            truncate(fileDescriptor, newFileSize);
+            ::close(fileDescriptor);
+        }
+    }
+
+    // Store the new header.
+    Statistics::recordUnmap(oldFileSize);
+    *header = newHeader;
+    Statistics::recordMap(newFileSize);
+    return true;
+}
+
+
+
+template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::releaseReservation()
+{
+    if(reservedByteCount == 0) {
+        return;
+    }
+    if(reservedByteCount > header->fileSize) {
+        ::munmap(reinterpret_cast<char*>(header) + header->fileSize,
+            reservedByteCount - header->fileSize);
+    }
+    reservedByteCount = 0;
+}
+
+
+
 template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::unreserve()
 {
     reserve(size());
@@ -1064,12 +1541,163 @@ template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::m
 // Can be used to check for integrity.
 template<class T> inline uint64_t ChanZuckerberg::shasta::MemoryMapped::Vector<T>::hash() const
 {
-    // The second argument to MurmurHash64A is a 4-byte integer.
-    // Sooner or later we will have to deal with this.
-    // For now we just check that there is no overflow.
-    const uint64_t byteCount = size()*sizeof(T);
-    CZI_ASSERT(byteCount <= uint64_t(std::numeric_limits<int>::max()));
-    return MurmurHash64A(begin(), int(byteCount), 231);
+    return hashBytes(reinterpret_cast<const char*>(begin()), size()*sizeof(T));
+}
+template<class T> inline uint64_t ChanZuckerberg::shasta::MemoryMapped::Vector<T>::hashBytes(
+    const char* p, uint64_t byteCount)
+{
+    // The second argument to MurmurHash64A is a 4-byte integer,
+    // so large ranges are hashed in chunks, using the hash
+    // of each chunk as the seed for the next one.
+    // Ranges of up to one chunk get the same hash as hashing them at once.
+    const uint64_t maxChunkSize = 1ULL << 30;
+    uint64_t hashValue = 231;
+    do {
+        const uint64_t chunkSize = std::min(byteCount, maxChunkSize);
+        hashValue = MurmurHash64A(p, int(chunkSize), hashValue);
+        p += chunkSize;
+        byteCount -= chunkSize;
+    } while(byteCount > 0);
+    return hashValue;
+}
+
+
+
+// Compute the checksums of the data and store them in the header.
+// The chunks are hashed in parallel.
+template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::computeChecksums(
+    size_t threadCount)
+{
+    typename Header::Checksums& checksums = header->checksums;
+    checksums.isValid = 0;
+    checksums.byteCount = size() * sizeof(T);
+
+    // Use at most maxChunkCount chunks, each a multiple of 1 MB.
+    const size_t maxChunkCount = Header::Checksums::maxChunkCount;
+    const size_t megaByte = 1024 * 1024;
+    const size_t minimumChunkSize = (checksums.byteCount == 0) ? 1 :
+        ((checksums.byteCount - 1) / maxChunkCount + 1);
+    checksums.chunkSize = ((minimumChunkSize - 1) / megaByte + 1) * megaByte;
+    const size_t chunkCount = checksums.chunkCount();
+    CZI_ASSERT(chunkCount <= maxChunkCount);
+    std::fill(checksums.values.begin(), checksums.values.end(), uint64_t(0));
+
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    threadCount = std::max(size_t(1), std::min(threadCount, chunkCount));
+    const char* dataBytes = reinterpret_cast<const char*>(begin());
+    auto hashChunks = [&checksums, dataBytes, chunkCount, threadCount](size_t firstChunkId)
+    {
+        for(size_t chunkId=firstChunkId; chunkId<chunkCount; chunkId+=threadCount) {
+            const size_t chunkBegin = chunkId * checksums.chunkSize;
+            const size_t chunkEnd = std::min(checksums.byteCount, chunkBegin + checksums.chunkSize);
+            checksums.values[chunkId] = hashBytes(dataBytes + chunkBegin, chunkEnd - chunkBegin);
+        }
+    };
+    if(threadCount == 1) {
+        hashChunks(0);
+    } else {
+        vector<std::thread> threads;
+        for(size_t i=0; i<threadCount; i++) {
+            threads.push_back(std::thread(hashChunks, i));
+        }
+        for(std::thread& thread: threads) {
+            thread.join();
+        }
+    }
+    checksums.isValid = 1;
+
+    // These are now also the checksums for verification,
+    // and they match the data.
+    openChecksums = checksums;
+    verifiedChunks = (chunkCount == 64) ? ~uint64_t(0) : ((uint64_t(1) << chunkCount) - 1);
+}
+
+
+
+template<class T> inline void ChanZuckerberg::shasta::MemoryMapped::Vector<T>::verifyChunk(
+    size_t chunkId) const
+{
+    if(verifiedChunks & (uint64_t(1) << chunkId)) {
+        return;
+    }
+    const size_t chunkBegin = chunkId * openChecksums.chunkSize;
+    const size_t chunkEnd = std::min(openChecksums.byteCount, chunkBegin + openChecksums.chunkSize);
+    if(chunkEnd > size() * sizeof(T) ||
+        hashBytes(reinterpret_cast<const char*>(begin()) + chunkBegin, chunkEnd - chunkBegin) !=
+        openChecksums.values[chunkId]) {
+        throw runtime_error("Checksum mismatch for " + fileName + " in bytes " +
+            to_string(chunkBegin) + " to " + to_string(chunkEnd) + " of the data. "
+            "The file is corrupted.");
+    }
+    __sync_fetch_and_or(&verifiedChunks, uint64_t(1) << chunkId);
+}
+
+
+
+template<class T> inline bool ChanZuckerberg::shasta::MemoryMapped::Vector<T>::verifyChecksums(
+    size_t threadCount) const
+{
+    CZI_ASSERT(isOpen);
+    if(!hasValidChecksums()) {
+        return false;
+    }
+    const size_t chunkCount = openChecksums.chunkCount();
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    threadCount = std::max(size_t(1), std::min(threadCount, chunkCount));
+
+    // Each thread verifies every threadCount-th chunk.
+    // An exception in a thread is reported after all threads finish.
+    vector<string> errorMessages(threadCount);
+    auto verifyChunks = [this, chunkCount, threadCount, &errorMessages](size_t firstChunkId)
+    {
+        try {
+            for(size_t chunkId=firstChunkId; chunkId<chunkCount; chunkId+=threadCount) {
+                verifyChunk(chunkId);
+            }
+        } catch(const std::exception& e) {
+            errorMessages[firstChunkId] = e.what();
+        }
+    };
+    vector<std::thread> threads;
+    for(size_t i=0; i<threadCount; i++) {
+        threads.push_back(std::thread(verifyChunks, i));
+    }
+    for(std::thread& thread: threads) {
+        thread.join();
+    }
+    for(const string& errorMessage: errorMessages) {
+        if(!errorMessage.empty()) {
+            throw runtime_error(errorMessage);
+        }
+    }
+    return true;
+}
+
+
+
+template<class T> inline bool ChanZuckerberg::shasta::MemoryMapped::Vector<T>::verifyChecksums(
+    size_t beginIndex, size_t endIndex) const
+{
+    CZI_ASSERT(isOpen);
+    CZI_ASSERT(beginIndex <= endIndex);
+    if(!hasValidChecksums()) {
+        return false;
+    }
+    const size_t byteBegin = beginIndex * sizeof(T);
+    const size_t byteEnd = std::min(endIndex * sizeof(T), openChecksums.byteCount);
+    if(byteBegin >= byteEnd) {
+        return true;
+    }
+    const size_t firstChunkId = byteBegin / openChecksums.chunkSize;
+    const size_t lastChunkId = (byteEnd - 1) / openChecksums.chunkSize;
+    for(size_t chunkId=firstChunkId; chunkId<=lastChunkId; chunkId++) {
+        verifyChunk(chunkId);
+    }
+    return true;
 }
 
 #endif
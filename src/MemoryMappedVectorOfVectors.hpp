@@ -7,9 +7,14 @@
 // CZI.
 #include "MemoryMappedVector.hpp"
 #include "MemoryAsContainer.hpp"
+#include "parallelAlgorithms.hpp"
 
 // Standard libraries, partially injected into the ChanZuckerberg::Rna1 namespace.
 #include "algorithm.hpp"
+#include "memory.hpp"
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include "utility.hpp"
 #include "vector.hpp"
 
@@ -230,13 +235,50 @@ public:
     // In pass 2 we store the entries.
     // This can be easily turned into multithreaded code
     // if atomic memory access primitives are used.
-    void beginPass1(Int n);
+    // beginPass1, beginPass2, and endPass2 use multiple threads
+    // when n is large (threadCount=0 uses the number of hardware threads).
+    void beginPass1(Int n, size_t threadCount = 0);
     void incrementCount(Int index, Int m=1);  // Called during pass 1.
     void incrementCountMultithreaded(Int index, Int m=1);  // Called during pass 1.
-    void beginPass2();
+    void beginPass2(size_t threadCount = 0);
     void store(Int index, const T&);            // Called during pass 2.
     void storeMultithreaded(Int index, const T&);            // Called during pass 2.
-    void endPass2(bool check = true, bool free=true);
+    void endPass2(bool check = true, bool free=true, size_t threadCount = 0);
+
+
+
+    // Functions to append vectors from multiple threads,
+    // when the number of vectors and/or the size of each vector
+    // are not known in advance.
+    // Usage:
+    // - Call beginMultithreadedAppend or beginMultithreadedAppendOrdered.
+    // - Each thread creates its own MultithreadedAppender
+    //   and uses it to append vectors.
+    // - After all threads are done, call endMultithreadedAppend.
+    //
+    // Each appender reserves chunks of a staging area atomically
+    // and copies the vectors it receives into its current chunk,
+    // so there is no contention except when a new chunk is needed.
+    // endMultithreadedAppend then builds the toc and copies
+    // the vectors from the staging area to their final positions,
+    // using multiple threads.
+    // Existing vectors are preserved and the new ones are added after them.
+    //
+    // With beginMultithreadedAppend, the vectors are added in the
+    // order in which they are received, and MultithreadedAppender::appendVector
+    // returns the index assigned to each of them.
+    // With beginMultithreadedAppendOrdered(n), exactly n vectors are added,
+    // and the caller specifies the position of each of them
+    // with MultithreadedAppender::storeVector.
+    // Each position must be stored at most once.
+    // Positions that are never stored get an empty vector.
+    // The result is then independent of the order in which vectors
+    // are received, and therefore of the number of threads.
+    void beginMultithreadedAppend(size_t chunkSize = defaultAppendChunkSize);
+    void beginMultithreadedAppendOrdered(Int n, size_t chunkSize = defaultAppendChunkSize);
+    void endMultithreadedAppend(size_t threadCount = 0);
+    class MultithreadedAppender;
+    static const size_t defaultAppendChunkSize = 64 * 1024;
 
     // Touch the memory in order to cause the
     // supporting pages of virtual memory to be loaded in real memory.
@@ -245,6 +287,18 @@ public:
         return toc.touchMemory() + data.touchMemory();
     }
 
+    // Access pattern hints and multithreaded prefetch.
+    // See the corresponding functions of MemoryMapped::Vector.
+    void adviseAccessPattern(AccessPattern accessPattern) const
+    {
+        toc.adviseAccessPattern(accessPattern);
+        data.adviseAccessPattern(accessPattern);
+    }
+    size_t prefetch(size_t threadCount = 0) const
+    {
+        return toc.prefetch(threadCount) + data.prefetch(threadCount);
+    }
+
     bool isOpen() const
     {
         return toc.isOpen && data.isOpen;
@@ -260,18 +314,147 @@ public:
     // This requires a binary search in the toc.
     pair<Int, Int> find(Int k) const;
 
+    // Direct read-only access to the table of contents.
+    // Vector i occupies positions [toc[i], toc[i+1]) of the data.
+    const Vector<Int>& getToc() const
+    {
+        return toc;
+    }
+
+    // Hash the table of contents and the data.
+    uint64_t hash() const
+    {
+        const array<uint64_t, 2> hashes = {toc.hash(), data.hash()};
+        return MurmurHash64A(&hashes, int(sizeof(hashes)), 231);
+    }
+
 private:
     Vector<Int> toc;
     Vector<Int> count;
     Vector<T> data;
     string name;
     size_t pageSize;
+
+    // Data used by the multithreaded append functions.
+    class AppendData {
+    public:
+
+        // The staging area where appenders copy their vectors.
+        Vector<T> stagingData;
+        uint64_t stagingSize = 0;
+        size_t chunkSize;
+
+        // For each vector received, its position and size in stagingData.
+        Vector< pair<uint64_t, uint64_t> > vectors;
+        uint64_t vectorCount = 0;
+        bool isOrdered;
+
+        // Appenders hold a shared lock while writing to the staging area
+        // and to vectors, and an exclusive lock while resizing them,
+        // because resizing can move them.
+        std::shared_timed_mutex mutex;
+    };
+    shared_ptr<AppendData> appendData;
+    void beginMultithreadedAppend(size_t chunkSize, bool isOrdered, Int n);
+
+    // Run f(begin, end) on ranges of [0, n) using up to threadCount threads.
+    template<class F> static void runOnRanges(size_t threadCount, size_t n, const F& f);
+
+    // Return the number of threads to use to process n items, making sure
+    // each thread gets at least minimumItemsPerThread of them.
+    static size_t adjustThreadCount(size_t threadCount, size_t n, size_t minimumItemsPerThread);
+    static const size_t minimumCountsPerThread = 1024 * 1024;
+};
+
+
+
+// Class used by a single thread to append vectors to a VectorOfVectors.
+// See beginMultithreadedAppend for details.
+template<class T, class Int> class ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::MultithreadedAppender {
+public:
+    MultithreadedAppender(VectorOfVectors<T, Int>& vectorOfVectors) :
+        appendData(*vectorOfVectors.appendData),
+        firstIndex(Int(vectorOfVectors.size()))
+    {
+    }
+
+    // Append a vector. Returns the index it will have in the VectorOfVectors.
+    // Only valid after beginMultithreadedAppend.
+    template<class Iterator> Int appendVector(Iterator begin, Iterator end)
+    {
+        CZI_ASSERT(!appendData.isOrdered);
+        const uint64_t i = __sync_fetch_and_add(&appendData.vectorCount, 1);
+        store(i, begin, end);
+        return Int(firstIndex + i);
+    }
+    Int appendVector(const vector<T>& v)
+    {
+        return appendVector(v.begin(), v.end());
+    }
+
+    // Store the vector at position i, 0 <= i < n,
+    // relative to the size of the VectorOfVectors when the append began.
+    // Only valid after beginMultithreadedAppendOrdered(n).
+    template<class Iterator> void storeVector(Int i, Iterator begin, Iterator end)
+    {
+        CZI_ASSERT(appendData.isOrdered);
+        CZI_ASSERT(i < appendData.vectorCount);
+        store(i, begin, end);
+    }
+    void storeVector(Int i, const vector<T>& v)
+    {
+        storeVector(i, v.begin(), v.end());
+    }
+
+private:
+    AppendData& appendData;
+    Int firstIndex;
+
+    // The portion of the staging area this appender is currently filling.
+    uint64_t chunkBegin = 0;
+    uint64_t chunkEnd = 0;
+
+    template<class Iterator> void store(uint64_t i, Iterator begin, Iterator end)
+    {
+        const uint64_t n = uint64_t(std::distance(begin, end));
+
+        // If the vector does not fit in the current chunk, get a new one.
+        // Vectors larger than the chunk size get a chunk of their own.
+        if(chunkBegin + n > chunkEnd) {
+            const uint64_t chunkSize = max(uint64_t(appendData.chunkSize), n);
+            chunkBegin = __sync_fetch_and_add(&appendData.stagingSize, chunkSize);
+            chunkEnd = chunkBegin + chunkSize;
+        }
+
+        while(true) {
+            {
+                std::shared_lock<std::shared_timed_mutex> lock(appendData.mutex);
+                if(chunkEnd <= appendData.stagingData.size() and i < appendData.vectors.size()) {
+                    std::copy(begin, end, appendData.stagingData.begin() + chunkBegin);
+                    appendData.vectors[i] = make_pair(chunkBegin, n);
+                    break;
+                }
+            }
+
+            // The staging area or the vectors need to grow.
+            // Double the size to keep this infrequent.
+            std::unique_lock<std::shared_timed_mutex> lock(appendData.mutex);
+            if(chunkEnd > appendData.stagingData.size()) {
+                appendData.stagingData.resize(max(chunkEnd, 2 * appendData.stagingData.size()));
+            }
+            if(i >= appendData.vectors.size()) {
+                appendData.vectors.resize(max(i + 1, 2 * appendData.vectors.size()));
+            }
+        }
+        chunkBegin += n;
+    }
 };
 
 
 
 template<class T, class Int>
-    void ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::beginPass1(Int n)
+    void ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::beginPass1(
+        Int n, size_t threadCount)
 {
 
     if(!count.isOpen) {
@@ -282,21 +465,28 @@ template<class T, class Int>
         }
     }
     count.reserveAndResize(n);
-    fill(count.begin(), count.end(), Int(0));
+    runOnRanges(adjustThreadCount(threadCount, count.size(), minimumCountsPerThread), count.size(),
+        [this](uint64_t begin, uint64_t end)
+        {
+            fill(count.begin() + begin, count.begin() + end, Int(0));
+        });
 }
 
 
 
+// The toc is the exclusive prefix sum of the counts,
+// computed by parallelExclusiveScan.
 template<class T, class Int>
-    void ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::beginPass2()
+    void ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::beginPass2(
+        size_t threadCount)
 {
-    const Int n = Int(count.size());
+    const size_t n = count.size();
     toc.reserveAndResize(n+1);
-    toc[0] = 0;
-    for(Int i=0; i<n; i++) {
-        toc[i+1] = toc[i] + count[i];
-    }
-    const size_t  dataSize = toc.back();
+    const uint64_t dataSize = parallelExclusiveScan(
+        count.begin(), count.end(), toc.begin(), uint64_t(0),
+        adjustThreadCount(threadCount, n, minimumCountsPerThread));
+    toc[n] = Int(dataSize);
+
     data.reserveAndResize(dataSize);
 }
 
@@ -304,14 +494,18 @@ template<class T, class Int>
 
 template<class T, class Int>
     void ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::endPass2(
-        bool check, bool free)
+        bool check, bool free, size_t threadCount)
 {
     // Verify that all counts are now zero.
     if(check) {
-        const Int n = Int(count.size());
-        for(Int i=0; i<n; i++) {
-            CZI_ASSERT(count[i] == 0);;
-        }
+        const size_t n = count.size();
+        runOnRanges(adjustThreadCount(threadCount, n, minimumCountsPerThread), n,
+            [this](uint64_t begin, uint64_t end)
+            {
+                for(uint64_t i=begin; i!=end; i++) {
+                    CZI_ASSERT(count[i] == 0);
+                }
+            });
     }
 
     // Free the memory of the count vector.
@@ -353,6 +547,147 @@ template<class T, class Int>
 
 
 
+template<class T, class Int>
+    void ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::beginMultithreadedAppend(
+        size_t chunkSize)
+{
+    beginMultithreadedAppend(chunkSize, false, 0);
+}
+template<class T, class Int>
+    void ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::beginMultithreadedAppendOrdered(
+        Int n, size_t chunkSize)
+{
+    beginMultithreadedAppend(chunkSize, true, n);
+}
+template<class T, class Int>
+    void ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::beginMultithreadedAppend(
+        size_t chunkSize, bool isOrdered, Int n)
+{
+    CZI_ASSERT(!appendData);
+    CZI_ASSERT(chunkSize > 0);
+    appendData = make_shared<AppendData>();
+    appendData->chunkSize = chunkSize;
+    appendData->isOrdered = isOrdered;
+
+    // The staging area is always anonymous, but it uses the same page size.
+    // If the VectorOfVectors was opened with accessExisting,
+    // the page size is not known, so we use 4 KB pages.
+    const size_t stagingPageSize = (pageSize == 0) ? 4096 : pageSize;
+    appendData->stagingData.createNew("", stagingPageSize);
+    appendData->vectors.createNew("", stagingPageSize);
+
+    if(isOrdered) {
+        appendData->vectorCount = n;
+        appendData->vectors.resize(n);
+        fill(appendData->vectors.begin(), appendData->vectors.end(), make_pair(uint64_t(0), uint64_t(0)));
+    }
+}
+
+
+
+template<class T, class Int>
+    void ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::endMultithreadedAppend(
+        size_t threadCount)
+{
+    CZI_ASSERT(appendData);
+    AppendData& a = *appendData;
+    const uint64_t n = a.vectorCount;
+    CZI_ASSERT(a.vectors.size() >= n);
+    threadCount = adjustThreadCount(threadCount, n, 1);
+
+    // Each thread works on a contiguous range of the new vectors.
+    // First, each thread computes the total size of its range.
+    const size_t oldVectorCount = size();
+    const uint64_t oldDataSize = data.size();
+    const size_t vectorsPerThread = (n == 0) ? 1 : ((n - 1) / threadCount + 1);
+    vector<uint64_t> rangeSizes(threadCount, 0);
+    runOnRanges(threadCount, n,
+        [&](uint64_t begin, uint64_t end)
+        {
+            uint64_t sum = 0;
+            for(uint64_t i=begin; i!=end; i++) {
+                sum += a.vectors[i].second;
+            }
+            rangeSizes[begin / vectorsPerThread] = sum;
+        });
+
+    // The starting position of each range in data.
+    vector<uint64_t> rangeBegins(threadCount);
+    uint64_t newDataSize = oldDataSize;
+    for(size_t t=0; t<threadCount; t++) {
+        rangeBegins[t] = newDataSize;
+        newDataSize += rangeSizes[t];
+    }
+
+    // Make space.
+    toc.resize(oldVectorCount + n + 1);
+    data.resize(newDataSize);
+
+    // Fill in the toc and copy the data, again one range per thread.
+    runOnRanges(threadCount, n,
+        [&](uint64_t begin, uint64_t end)
+        {
+            uint64_t position = rangeBegins[begin / vectorsPerThread];
+            for(uint64_t i=begin; i!=end; i++) {
+                const pair<uint64_t, uint64_t>& v = a.vectors[i];
+                if(v.second > 0) {
+                    const T* stagingBegin = a.stagingData.begin() + v.first;
+                    std::copy(stagingBegin, stagingBegin + v.second, data.begin() + position);
+                }
+                position += v.second;
+                toc[oldVectorCount + i + 1] = Int(position);
+            }
+        });
+    CZI_ASSERT(toc.back() == newDataSize);
+
+    // Free the staging area.
+    a.stagingData.remove();
+    a.vectors.remove();
+    appendData.reset();
+}
+
+
+
+template<class T, class Int>
+    template<class F>
+    void ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::runOnRanges(
+        size_t threadCount, size_t n, const F& f)
+{
+    if(n == 0) {
+        return;
+    }
+    const size_t rangeSize = (n - 1) / threadCount + 1;
+    if(threadCount == 1) {
+        f(uint64_t(0), uint64_t(n));
+        return;
+    }
+    vector<std::thread> threads;
+    for(size_t t=0; t<threadCount; t++) {
+        const uint64_t begin = min(n, t * rangeSize);
+        const uint64_t end = min(n, (t + 1) * rangeSize);
+        if(begin < end) {
+            threads.push_back(std::thread([&f, begin, end]() {f(begin, end);}));
+        }
+    }
+    for(std::thread& thread: threads) {
+        thread.join();
+    }
+}
+
+
+
+template<class T, class Int>
+    size_t ChanZuckerberg::shasta::MemoryMapped::VectorOfVectors<T, Int>::adjustThreadCount(
+        size_t threadCount, size_t n, size_t minimumItemsPerThread)
+{
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    return max(size_t(1), min(threadCount, n / minimumItemsPerThread));
+}
+
+
+
 // Given a global index k in a VectorOfVectors v,
 // find i and j such that v[i][j] (aka v.begin(i)[j]) is the same
 // (stored at the same position) as v.begin()[k].
@@ -0,0 +1,299 @@
+#ifndef SHASTA_STATIC_EXECUTABLE
+
+// Shasta.
+#include "MultiRunHttpServer.hpp"
+#include "Assembler.hpp"
+#include "MemoryMappedVector.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "iostream.hpp"
+#include "stdexcept.hpp"
+
+
+
+MultiRunHttpServer::MultiRunHttpServer(
+    uint64_t maxMappedBytes,
+    uint64_t idleSeconds,
+    uint64_t checkSeconds) :
+    maxMappedBytes(maxMappedBytes),
+    idleSeconds(idleSeconds),
+    checkSeconds(checkSeconds)
+{
+    idleThread = std::thread(&MultiRunHttpServer::idleThreadFunction, this);
+}
+
+
+
+MultiRunHttpServer::~MultiRunHttpServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopIdleThread = true;
+    }
+    idleThreadCondition.notify_all();
+    idleThread.join();
+}
+
+
+
+void MultiRunHttpServer::addRun(
+    const string& name,
+    const string& largeDataFileNamePrefix,
+    const string& consensusCaller,
+    bool prefetch)
+{
+    if(name.empty() || name.find('/') != string::npos) {
+        throw runtime_error("Invalid run name " + name);
+    }
+    if(findRun(name)) {
+        throw runtime_error("Duplicate run name " + name);
+    }
+
+    const shared_ptr<Run> run = make_shared<Run>();
+    run->name = name;
+    run->largeDataFileNamePrefix = largeDataFileNamePrefix;
+    run->consensusCaller = consensusCaller;
+    run->prefetch = prefetch;
+    std::lock_guard<std::mutex> lock(mutex);
+    runs.push_back(run);
+}
+
+
+
+void MultiRunHttpServer::setDocsDirectory(const string& docsDirectoryArgument)
+{
+    docsDirectory = docsDirectoryArgument;
+}
+
+
+
+shared_ptr<MultiRunHttpServer::Run> MultiRunHttpServer::findRun(const string& name) const
+{
+    for(const shared_ptr<Run>& run: runs) {
+        if(run->name == name) {
+            return run;
+        }
+    }
+    return shared_ptr<Run>();
+}
+
+
+
+shared_ptr<Assembler> MultiRunHttpServer::getAssembler(Run& run)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        run.lastAccessTime = std::chrono::steady_clock::now();
+        if(run.assembler) {
+            return run.assembler;
+        }
+    }
+
+    // The run is closed. Open it, making sure that
+    // concurrent requests for the same run only open it once.
+    // Other runs remain available while this one is being opened.
+    std::lock_guard<std::mutex> openLock(run.openMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(run.assembler) {
+            return run.assembler;
+        }
+    }
+    cout << timestamp << "Opening run " << run.name <<
+        " at " << run.largeDataFileNamePrefix << endl;
+    const shared_ptr<Assembler> assembler =
+        make_shared<Assembler>(run.largeDataFileNamePrefix, false, 2*1024*1024);
+    assembler->accessAllLazy(run.prefetch);
+    assembler->setupConsensusCaller(run.consensusCaller);
+    assembler->setDocsDirectory(docsDirectory);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        run.assembler = assembler;
+        run.lastAccessTime = std::chrono::steady_clock::now();
+    }
+
+    // Opening a run can push the mapped memory over budget.
+    closeRuns(false);
+
+    return assembler;
+}
+
+
+
+void MultiRunHttpServer::closeIdleRuns()
+{
+    closeRuns(true);
+}
+
+
+
+void MultiRunHttpServer::closeRuns(bool all)
+{
+    const auto now = std::chrono::steady_clock::now();
+    const auto maxIdleTime = std::chrono::seconds(idleSeconds);
+
+    // Close runs one at a time, least recently used first.
+    // A run is in use if a request holds a reference to its Assembler.
+    // All references are obtained while holding the mutex,
+    // so the use count cannot increase while we hold it.
+    while(true) {
+        shared_ptr<Assembler> assembler;
+        string name;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const bool overBudget =
+                MemoryMapped::Statistics::getMappedBytes() > maxMappedBytes;
+            shared_ptr<Run> oldestRun;
+            for(const shared_ptr<Run>& run: runs) {
+                if(!run->assembler || run->assembler.use_count() != 1) {
+                    continue;
+                }
+                if(!all && !overBudget && now - run->lastAccessTime <= maxIdleTime) {
+                    continue;
+                }
+                if(!oldestRun || run->lastAccessTime < oldestRun->lastAccessTime) {
+                    oldestRun = run;
+                }
+            }
+            if(!oldestRun) {
+                return;
+            }
+            assembler.swap(oldestRun->assembler);
+            name = oldestRun->name;
+        }
+
+        // Destroying the Assembler unmaps all of its data.
+        // Do it without holding the mutex.
+        cout << timestamp << "Closing run " << name << endl;
+        assembler.reset();
+    }
+}
+
+
+
+void MultiRunHttpServer::idleThreadFunction()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(!stopIdleThread) {
+        idleThreadCondition.wait_for(lock, std::chrono::seconds(checkSeconds));
+        if(stopIdleThread) {
+            break;
+        }
+        lock.unlock();
+        try {
+            closeRuns(false);
+        } catch(std::exception& e) {
+            cout << timestamp << "Error closing idle runs: " << e.what() << endl;
+        }
+        lock.lock();
+    }
+}
+
+
+
+bool MultiRunHttpServer::parsePath(const string& path, string& name, string& rest)
+{
+    const string prefix = "/run/";
+    if(path.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    const size_t slash = path.find('/', prefix.size());
+    if(slash == string::npos) {
+        name = path.substr(prefix.size());
+        rest.clear();
+    } else {
+        name = path.substr(prefix.size(), slash - prefix.size());
+        rest = path.substr(slash);
+    }
+    return true;
+}
+
+
+
+bool MultiRunHttpServer::requiresExclusiveAccess(const vector<string>& request) const
+{
+    string name;
+    string rest;
+    if(!parsePath(request.front(), name, rest)) {
+        return false;
+    }
+    return Assembler::keywordRequiresExclusiveAccess(rest);
+}
+
+
+
+void MultiRunHttpServer::processRequest(
+    const vector<string>& request,
+    ostream& html,
+    const BrowserInformation& browserInformation)
+{
+    string name;
+    string rest;
+    if(!parsePath(request.front(), name, rest)) {
+        writeRunSelector(html);
+        return;
+    }
+
+    shared_ptr<Run> run;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        run = findRun(name);
+    }
+    if(!run) {
+        html << "\r\n<!DOCTYPE html><html><body>Unknown run " << name <<
+            ". <a href='/'>Available runs</a></body></html>";
+        return;
+    }
+
+    // The pages of the run use relative links,
+    // so the run prefix must end with "/".
+    if(rest.empty()) {
+        html << "\r\n<!DOCTYPE html><html><head>"
+            "<meta http-equiv='refresh' content='0; url=" << urlEncode(name) << "/'>"
+            "</head></html>";
+        return;
+    }
+
+    shared_ptr<Assembler> assembler;
+    try {
+        assembler = getAssembler(*run);
+    } catch(std::exception& e) {
+        html << "\r\n<!DOCTYPE html><html><body>Error opening run " << name <<
+            ": " << e.what() << "</body></html>";
+        return;
+    }
+
+    vector<string> runRequest = request;
+    runRequest.front() = rest;
+    assembler->processRequest(runRequest, html, browserInformation);
+}
+
+
+
+void MultiRunHttpServer::writeRunSelector(ostream& html)
+{
+    html << "\r\n<!DOCTYPE html><html><head><meta charset='UTF-8'>"
+        "<title>Shasta runs</title>";
+    writeStyle(html);
+    html << "</head><body><h1>Shasta runs</h1>"
+        "<table><tr><th>Run<th>Data<th>Status";
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(const shared_ptr<Run>& run: runs) {
+            html <<
+                "<tr><td><a href='run/" << urlEncode(run->name) << "/'>" << run->name << "</a>"
+                "<td>" << run->largeDataFileNamePrefix <<
+                "<td>" << (run->assembler ? "Open" : "Closed");
+        }
+    }
+    html << "</table>"
+        "<p>Memory mapped by all open runs: " <<
+        MemoryMapped::Statistics::getMappedBytes() / (1024*1024) << " MB, budget " <<
+        maxMappedBytes / (1024*1024) << " MB."
+        "</body></html>";
+}
+
+#endif
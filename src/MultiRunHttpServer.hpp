@@ -0,0 +1,126 @@
+#ifndef SHASTA_STATIC_EXECUTABLE
+
+#ifndef CZI_SHASTA_MULTI_RUN_HTTP_SERVER_HPP
+#define CZI_SHASTA_MULTI_RUN_HTTP_SERVER_HPP
+
+/*******************************************************************************
+
+Class MultiRunHttpServer serves several assembly runs from a single process.
+
+The top page lists the runs. The pages of each run are served
+under the prefix /run/<name>/, by forwarding the rest of the path
+to an Assembler for that run. The html written by the Assembler
+only uses relative links, so all navigation stays within the run.
+
+The Assembler for a run is only created when the run is first requested,
+and its data are accessed lazily (Assembler::accessAllLazy).
+A run that is not being used is closed, which unmaps all of its data,
+when it was not requested for more than idleSeconds,
+or, least recently used first, when the memory mapped by all runs
+exceeds maxMappedBytes. A closed run is reopened
+the next time it is requested. Closing never interrupts a request:
+a request holds a reference to its Assembler, and a run
+is only closed when no request holds one.
+
+*******************************************************************************/
+
+#include "HttpServer.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include "memory.hpp"
+#include <mutex>
+#include "string.hpp"
+#include <thread>
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class Assembler;
+        class MultiRunHttpServer;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::MultiRunHttpServer : public HttpServer {
+public:
+
+    // The idle policy is checked every checkSeconds.
+    MultiRunHttpServer(
+        uint64_t maxMappedBytes,
+        uint64_t idleSeconds = 3600,
+        uint64_t checkSeconds = 10);
+    ~MultiRunHttpServer();
+
+    // Add a run. The name is used in the url and must not contain "/".
+    // The run is not accessed until it is first requested.
+    void addRun(
+        const string& name,
+        const string& largeDataFileNamePrefix,
+        const string& consensusCaller = "SimpleConsensusCaller",
+        bool prefetch = true);
+
+    void setDocsDirectory(const string&);
+
+    // Close all runs that are not being used.
+    void closeIdleRuns();
+
+private:
+
+    class Run {
+    public:
+        string name;
+        string largeDataFileNamePrefix;
+        string consensusCaller;
+        bool prefetch;
+
+        // Null if the run is closed.
+        shared_ptr<Assembler> assembler;
+
+        // Serializes opening the run.
+        std::mutex openMutex;
+
+        std::chrono::steady_clock::time_point lastAccessTime;
+    };
+    vector< shared_ptr<Run> > runs;
+    string docsDirectory;
+
+    // Protects the assembler and lastAccessTime fields of all runs.
+    std::mutex mutex;
+
+    uint64_t maxMappedBytes;
+    uint64_t idleSeconds;
+
+    // Find a run by name. Returns a null pointer if not found.
+    shared_ptr<Run> findRun(const string& name) const;
+
+    // Return the Assembler for a run, opening it if necessary.
+    shared_ptr<Assembler> getAssembler(Run&);
+
+    // Close runs that are not being used, according to the idle policy.
+    // If all is true, close all runs that are not being used.
+    void closeRuns(bool all);
+
+    // Split a request path of the form /run/<name>/<rest>.
+    // Returns false if the path does not begin with /run/.
+    static bool parsePath(const string& path, string& name, string& rest);
+
+    void processRequest(
+        const vector<string>& request,
+        ostream& html,
+        const BrowserInformation&) override;
+    bool requiresExclusiveAccess(const vector<string>& request) const override;
+    void writeRunSelector(ostream& html);
+
+    // The thread that periodically applies the idle policy.
+    std::thread idleThread;
+    std::condition_variable idleThreadCondition;
+    bool stopIdleThread = false;
+    uint64_t checkSeconds;
+    void idleThreadFunction();
+};
+
+#endif
+
+#endif
@@ -17,6 +17,7 @@ public:
         x.resize(n);
         y.resize(n);
         z.resize(n);
+        visitCount.resize(n, 0);
         for(uint64_t i=0; i<n; i++) {
             x[i] = i;
             y[i] = 2 * i;
@@ -30,7 +31,9 @@ public:
         uint64_t begin, end;
         while(getNextBatch(begin, end)) {
             out << timestamp << begin << " " << end << endl;
+            CZI_ASSERT((begin % minimumBatchSize) == 0);
             for(uint64_t i=begin; i!=end; i++) {
+                __sync_fetch_and_add(&visitCount[i], 1ULL);
                 uint64_t s = 0;
                 for(uint64_t j=0; j<n; j++) {
                     s += x[i] * y[j];
@@ -39,9 +42,10 @@ public:
             }
         }
     }
-    void check() const
+    void check(uint64_t runCount) const
     {
         for(uint64_t i=0; i<x.size(); i++) {
+            CZI_ASSERT(visitCount[i] == runCount);
             uint64_t s = 0;
             for(uint64_t j=0; j<n; j++) {
                 s += x[i] * y[j];
@@ -51,9 +55,13 @@ public:
     }
 
     uint64_t n;
+    uint64_t minimumBatchSize = 0;
     vector<uint64_t> x;
     vector<uint64_t> y;
     vector<uint64_t> z;
+
+    // The number of times each item was processed.
+    vector<uint64_t> visitCount;
 };
 
 
@@ -64,8 +72,10 @@ void ChanZuckerberg::shasta::testMultithreadedObject()
     const uint64_t n = 32 * 1024;
     const uint64_t batchSize = 64;
     const uint64_t threadCount = 8;
+    const uint64_t runCount = 10;
     MultithreadedObjectTestClass x(n);
-    for(int i=0; i<10; i++) {
+    x.minimumBatchSize = batchSize;
+    for(uint64_t i=0; i<runCount; i++) {
         x.setupLoadBalancing(n, batchSize);
         const auto t0 = std::chrono::steady_clock::now();
         x.runThreads(&MultithreadedObjectTestClass::compute, threadCount, "threadLogs-");
@@ -73,6 +83,6 @@ void ChanZuckerberg::shasta::testMultithreadedObject()
         const double t01 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)).count());
         cout << t01 << endl;
     }
-    x.check();
+    x.check(runCount);
 }
 
@@ -13,11 +13,63 @@
 //     void compute(size_t threadId);
 // };
 
+// The threads are kept in a pool owned by the MultithreadedObject
+// and reused by all calls to runThreads/startThreads,
+// so each call only wakes them up instead of creating new threads.
+// The pool grows as needed to the largest thread count used,
+// and its threads are joined when the MultithreadedObject is destroyed.
+// If a NUMA mode is in use, each pool thread is pinned
+// to a cpu when it starts (see Numa.hpp).
+
+// Dynamic load balancing (setupLoadBalancing/getNextBatch)
+// uses guided scheduling with work stealing.
+// When the threads are started, the n items to be processed
+// are divided into one contiguous range per thread.
+// Each thread takes batches from the beginning of its own range.
+// Each batch is a fraction of what remains in the range,
+// so batches start large and get smaller towards the end of the range,
+// but never smaller than the batch size passed to setupLoadBalancing.
+// When its range is exhausted, a thread steals the second half
+// of the largest remaining range of another thread.
+// Each range is updated with a 16-byte compare and swap (requires -mcx16).
+// All batch boundaries, except for n, are multiples of the batch size,
+// so code that relies on batch alignment keeps working.
+// However, a given position is no longer guaranteed
+// to be the beginning of a batch (see containsMultiple).
+// The load balancing state belongs to the pool, so setupLoadBalancing
+// must not be called while threads are running. A thread outside
+// the pool can call getNextBatch, but it takes batches from
+// the existing ranges and never owns one.
+
+// Each pool thread owns a ThreadArena, which is the current arena
+// of the thread while it runs a thread function, and is reset
+// when the thread function returns. Thread functions can use it
+// for short lived containers via ArenaAllocator (see ThreadArena.hpp).
+// Its statistics are added to the process totals at the same time.
+
+// Messages written to getLog by a thread function are queued
+// without locking and written to the log file by a background thread
+// (see ThreadLog.hpp). Thread functions should use ThreadLog
+// instead of writing to cout under the mutex.
+// waitForThreads writes out all messages queued by the threads.
+
+// Batches handed out by getNextBatch are reported to Progress
+// (see Progress.hpp). If enabled, the hardware counters of each pool thread
+// are summed over each call to runThreads/startThreads
+// (see HardwareCounters.hpp).
+
 // CZI.
 #include "CZI_ASSERT.hpp"
+#include "HardwareCounters.hpp"
+#include "Numa.hpp"
+#include "Progress.hpp"
+#include "ThreadArena.hpp"
+#include "ThreadLog.hpp"
 
 // Standard libraries.
 #include "algorithm.hpp"
+#include "chrono.hpp"
+#include <condition_variable>
 #include "cstddef.hpp"
 #include "fstream.hpp"
 #include "iostream.hpp"
@@ -26,6 +78,7 @@
 #include "stdexcept.hpp"
 #include "string.hpp"
 #include <thread>
+#include <typeinfo>
 #include "utility.hpp"
 #include "vector.hpp"
 
@@ -73,18 +126,28 @@ protected:
     // The constructor stores a reference to *this.
     MultithreadedObject(T&);
 
+    // The destructor joins the threads in the pool.
+    ~MultithreadedObject();
+
     bool getNextBatch(
         uint64_t& begin,
         uint64_t& end);
 
+    // Return true if [begin, end) contains a multiple of m.
+    // Used to decide when to write progress messages,
+    // because batches don't begin at predictable positions.
+    static bool containsMultiple(uint64_t begin, uint64_t end, uint64_t m)
+    {
+        return (begin == 0) || ((begin - 1) / m != (end - 1) / m);
+    }
+
     ostream& getLog(size_t threadId)
     {
         CZI_ASSERT(threadId < threadLogs.size());
-        ofstream& s = threadLogs[threadId];
-        if(!s.is_open()) {
+        if(!threadLogs[threadId].is_open()) {
             throw runtime_error("Attempt to write to unopened log output for thread " + to_string(threadId));
         }
-        return s;
+        return *threadLogStreams[threadId];
     }
 
     // General purpose mutex, used when exclusive access is needed.
@@ -114,34 +177,115 @@ private:
             (t.*f)(threadId);
         } catch(exception& e) {
             t.exceptionsOccurred = true;
-            std::lock_guard<std::mutex> lock(t.mutex);
-            cout << "A standard exception occurred in thread " << threadId << ": ";
-            cout << e.what() << endl;
+            ThreadLog::Message(ThreadLog::Level::error) <<
+                "A standard exception occurred in thread " << threadId << ": " << e.what();
+            ThreadLog::flush();
             ::exit(1);
         } catch(...) {
             t.exceptionsOccurred = true;
-            std::lock_guard<std::mutex> lock(t.mutex);
-            cout << "A non-standard exception occurred in thread " << threadId << "." << endl;
+            ThreadLog::Message(ThreadLog::Level::error) <<
+                "A non-standard exception occurred in thread " << threadId << ".";
+            ThreadLog::flush();
             ::exit(1);
         }
     }
 
 
 
+    // The thread pool.
+    // Each pool thread waits for poolGeneration to change,
+    // then runs poolFunction if its threadId is less than poolThreadCount.
+    void poolThreadFunction(size_t threadId, uint64_t generation);
     vector< std::shared_ptr<std::thread> > threads;
-
+    std::mutex poolMutex;
+    std::condition_variable poolStartCondition;
+    std::condition_variable poolDoneCondition;
+    ThreadFunction poolFunction = 0;
+    size_t poolThreadCount = 0;
+    uint64_t poolGeneration = 0;
+    size_t poolRunningCount = 0;
+    bool poolIsRunning = false;
+    bool poolShouldExit = false;
+
+    // Hardware counters summed over the threads, if enabled.
+    steady_clock::time_point poolStartTime;
+    HardwareCounters::Values poolCounterValues;
+
+    // The MultithreadedObject and threadId of the pool thread
+    // running in the current thread, if any.
+    // Used by getNextBatch to find the range owned by the calling thread.
+    static thread_local const MultithreadedObject* currentObject;
+    static thread_local size_t currentThreadId;
+
+    // The log files opened by startThreads, and the streams
+    // returned by getLog, which write to them via ThreadLog.
     vector<ofstream> threadLogs;
+    vector< std::shared_ptr<ThreadLog::Stream> > threadLogStreams;
 
     bool exceptionsOccurred= false;
 
+
+
     // Load balancing.
     uint64_t n = 0;
     uint64_t batchSize = 0;
-    uint64_t nextBatch = 0;
+
+    // The work not yet assigned, as one range [begin, end) per thread,
+    // stored as a __uint128_t with begin in the low 64 bits.
+    // Only one of every rangeStride entries is used, so the ranges
+    // of different threads don't share a cache line.
+    static const size_t rangeStride = 4;
+    vector<__uint128_t> ranges;
+    bool rangesArePartitioned = false;
+    size_t rangeCount() const
+    {
+        return ranges.size() / rangeStride;
+    }
+    __uint128_t& range(size_t i)
+    {
+        return ranges[i * rangeStride];
+    }
+    static __uint128_t makeRange(uint64_t begin, uint64_t end)
+    {
+        return (__uint128_t(end) << 64) | __uint128_t(begin);
+    }
+    static uint64_t rangeBegin(__uint128_t r)
+    {
+        return uint64_t(r);
+    }
+    static uint64_t rangeEnd(__uint128_t r)
+    {
+        return uint64_t(r >> 64);
+    }
+    void partitionRanges(size_t threadCount);
+    bool getBatchFromRange(size_t i, uint64_t& begin, uint64_t& end);
+    bool stealRange(size_t i);
+
+    // The size and start time of the last batch returned to each pool thread.
+    // The batch is reported to Progress as completed when the thread
+    // asks for its next batch. Strided like the ranges.
+    class PendingBatch {
+    public:
+        uint64_t itemCount;
+        steady_clock::time_point startTime;
+    };
+    static const size_t pendingStride = 4;
+    vector<PendingBatch> pendingBatches;
+
+    // The fraction of the remaining work in a range
+    // taken by each batch is 1/guidedDivisor.
+    static const uint64_t guidedDivisor = 4;
 };
 
 
 
+template<class T> thread_local const ChanZuckerberg::shasta::MultithreadedObject<T>*
+    ChanZuckerberg::shasta::MultithreadedObject<T>::currentObject = 0;
+template<class T> thread_local size_t
+    ChanZuckerberg::shasta::MultithreadedObject<T>::currentThreadId = 0;
+
+
+
 template<class T> inline ChanZuckerberg::shasta::MultithreadedObject<T>::MultithreadedObject(T& t) :
     t(t)
 {
@@ -149,6 +293,69 @@ template<class T> inline ChanZuckerberg::shasta::MultithreadedObject<T>::Multith
 
 
 
+template<class T> inline ChanZuckerberg::shasta::MultithreadedObject<T>::~MultithreadedObject()
+{
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        poolShouldExit = true;
+    }
+    poolStartCondition.notify_all();
+    for(std::shared_ptr<std::thread> thread: threads) {
+        thread->join();
+    }
+}
+
+
+
+template<class T> inline void ChanZuckerberg::shasta::MultithreadedObject<T>::poolThreadFunction(
+    size_t threadId,
+    uint64_t generation)
+{
+    currentObject = this;
+    currentThreadId = threadId;
+    Numa::pinThread(threadId);
+    ThreadArena arena;
+    const ThreadArena::MakeCurrent makeArenaCurrent(arena);
+
+    while(true) {
+
+        // Wait for the next call to startThreads.
+        ThreadFunction f;
+        {
+            std::unique_lock<std::mutex> lock(poolMutex);
+            while(poolGeneration == generation && !poolShouldExit) {
+                poolStartCondition.wait(lock);
+            }
+            if(poolShouldExit) {
+                return;
+            }
+            generation = poolGeneration;
+            if(threadId >= poolThreadCount) {
+                continue;
+            }
+            f = poolFunction;
+        }
+
+        CZI_SHASTA_PROBE1(thread_function_begin, threadId);
+        {
+            const HardwareCounters::ThreadCounters threadCounters(poolCounterValues);
+            runThreadFunction(t, f, threadId);
+        }
+        CZI_SHASTA_PROBE1(thread_function_end, threadId);
+        arena.reset();
+        arena.addToTotals();
+
+        // Let waitForThreads know when the last thread is done.
+        std::lock_guard<std::mutex> lock(poolMutex);
+        --poolRunningCount;
+        if(poolRunningCount == 0) {
+            poolDoneCondition.notify_all();
+        }
+    }
+}
+
+
+
 template<class T> inline void ChanZuckerberg::shasta::MultithreadedObject<T>::runThreads(
     ThreadFunction f,
     size_t threadCount,
@@ -165,7 +372,7 @@ template<class T> inline void ChanZuckerberg::shasta::MultithreadedObject<T>::st
     size_t threadCount,
     const string& logFileNamePrefix)
 {
-    if(!threads.empty()) {
+    if(poolIsRunning) {
         throw runtime_error("Unsupported attempt to start new threads while other threads have not been joined.");
     }
     CZI_ASSERT(threadLogs.empty());
@@ -182,25 +389,63 @@ template<class T> inline void ChanZuckerberg::shasta::MultithreadedObject<T>::st
                 throw runtime_error("Error opening thread log file " + fileName);
             }
             log.exceptions(ofstream::failbit | ofstream::badbit );
+            threadLogStreams.push_back(std::make_shared<ThreadLog::Stream>(log));
+        } else {
+            threadLogStreams.push_back(0);
         }
+    }
+
+    // If load balancing was set up and not used yet,
+    // give each thread its own range.
+    partitionRanges(threadCount);
+
+    // Grow the pool if necessary.
+    // The new threads wait for the next generation.
+    while(threads.size() < threadCount) {
         threads.push_back(std::make_shared<std::thread>(
             std::thread(
-            &MultithreadedObject::runThreadFunction,
-            std::ref(t),
-            f,
-            threadId)));
+            &MultithreadedObject::poolThreadFunction,
+            this,
+            threads.size(),
+            poolGeneration)));
+    }
+
+    // Wake up the threads.
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        poolFunction = f;
+        poolThreadCount = threadCount;
+        poolStartTime = steady_clock::now();
+        poolCounterValues = HardwareCounters::Values();
+        poolRunningCount = threadCount;
+        ++poolGeneration;
+        poolIsRunning = true;
     }
+    poolStartCondition.notify_all();
 }
 
 
 
 template<class T> inline void ChanZuckerberg::shasta::MultithreadedObject<T>::waitForThreads()
 {
-    for(std::shared_ptr<std::thread> thread: threads) {
-        thread->join();
+    {
+        std::unique_lock<std::mutex> lock(poolMutex);
+        while(poolRunningCount != 0) {
+            poolDoneCondition.wait(lock);
+        }
+        poolIsRunning = false;
+    }
+    if(HardwareCounters::isEnabled()) {
+        HardwareCounters::addLoop(typeid(T).name(), poolThreadCount,
+            seconds(steady_clock::now() - poolStartTime), poolCounterValues);
     }
-    threads.clear();
+
+    // Write out all messages queued by the threads
+    // before closing the log files.
+    threadLogStreams.clear();
+    ThreadLog::flush();
     threadLogs.clear();
+
     if(exceptionsOccurred) {
         throw runtime_error("Exceptions occurred in at least one thread.");
     }
@@ -214,21 +459,180 @@ template<class T> inline void ChanZuckerberg::shasta::MultithreadedObject<T>::se
     uint64_t nArgument,
     uint64_t batchSizeArgument)
 {
+    CZI_ASSERT(batchSizeArgument > 0);
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if(poolIsRunning) {
+            throw runtime_error("Unsupported attempt to set up load balancing while threads are running.");
+        }
+    }
     n = nArgument;
     batchSize = batchSizeArgument;
-    nextBatch = 0;
+
+    // Until the threads are started, all the work is in the first range.
+    // This way getNextBatch also works if called
+    // without starting any threads.
+    ranges.assign(rangeStride, 0);
+    range(0) = makeRange(0, n);
+    rangesArePartitioned = false;
+    pendingBatches.clear();
+    Progress::beginLoop(n);
+}
+
+
+
+// Give each thread a range of about the same size.
+// This is only done once for each call to setupLoadBalancing,
+// so threads started again without calling setupLoadBalancing
+// see the work that was left over, if any.
+template<class T> inline void ChanZuckerberg::shasta::MultithreadedObject<T>::partitionRanges(
+    size_t threadCount)
+{
+    if(rangesArePartitioned || ranges.empty() || threadCount == 0) {
+        return;
+    }
+    rangesArePartitioned = true;
+    if(range(0) != makeRange(0, n)) {
+        return;
+    }
+
+    // Range boundaries are multiples of the batch size.
+    const uint64_t batchCount = (n + batchSize - 1) / batchSize;
+    ranges.assign(threadCount * rangeStride, 0);
+    for(size_t i=0; i<threadCount; i++) {
+        const uint64_t begin = min(n, batchSize * ((batchCount * i) / threadCount));
+        const uint64_t end = min(n, batchSize * ((batchCount * (i + 1)) / threadCount));
+        range(i) = makeRange(begin, end);
+    }
+    pendingBatches.assign(threadCount * pendingStride, PendingBatch{0, steady_clock::time_point()});
 }
-template<class T> inline bool ChanZuckerberg::shasta::MultithreadedObject<T>:: getNextBatch(
+
+
+
+template<class T> inline bool ChanZuckerberg::shasta::MultithreadedObject<T>::getNextBatch(
     uint64_t& begin,
     uint64_t& end)
 {
-    begin = __sync_fetch_and_add(&nextBatch, batchSize);
-    if(begin < n) {
-        end = min(n, begin + batchSize);
-        return true;
-    } else {
+    if(ranges.empty()) {
+        return false;
+    }
+
+    // Threads not in the pool don't own a range.
+    // They take a batch from any range that has work left,
+    // without timing, and never steal into a range.
+    if(currentObject != this || currentThreadId >= rangeCount()) {
+        for(size_t j=0; j<rangeCount(); j++) {
+            if(getBatchFromRange(j, begin, end)) {
+                Progress::addCompletedItems(end - begin);
+                return true;
+            }
+        }
         return false;
     }
+
+    // Find the range owned by this thread.
+    const size_t i = currentThreadId;
+    PendingBatch* pendingBatch = 0;
+    steady_clock::time_point now;
+    if(i * pendingStride < pendingBatches.size()) {
+        pendingBatch = &pendingBatches[i * pendingStride];
+        now = steady_clock::now();
+        if(pendingBatch->itemCount > 0) {
+            Progress::addCompletedBatch(i, pendingBatch->itemCount, uint64_t(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - pendingBatch->startTime).count()));
+            pendingBatch->itemCount = 0;
+        }
+    }
+
+    // Take a batch from our range. If it is empty, steal
+    // some more work and try again.
+    while(true) {
+        if(getBatchFromRange(i, begin, end)) {
+            // Report the batch as completed when this thread asks for the next one.
+            // If the ranges were not partitioned, report it immediately.
+            if(pendingBatch) {
+                pendingBatch->itemCount = end - begin;
+                pendingBatch->startTime = now;
+            } else {
+                Progress::addCompletedItems(end - begin);
+            }
+            return true;
+        }
+        if(!stealRange(i)) {
+            return false;
+        }
+    }
+}
+
+
+
+// Take a batch from the beginning of range i.
+template<class T> inline bool ChanZuckerberg::shasta::MultithreadedObject<T>::getBatchFromRange(
+    size_t i,
+    uint64_t& begin,
+    uint64_t& end)
+{
+    __uint128_t& r = range(i);
+    while(true) {
+        const __uint128_t oldRange = r;
+        begin = rangeBegin(oldRange);
+        const uint64_t rangeEndValue = rangeEnd(oldRange);
+        if(begin >= rangeEndValue) {
+            return false;
+        }
+        const uint64_t remaining = rangeEndValue - begin;
+        const uint64_t size = max(batchSize, batchSize * ((remaining / guidedDivisor) / batchSize));
+        end = min(rangeEndValue, begin + size);
+        if(__sync_bool_compare_and_swap(&r, oldRange, makeRange(end, rangeEndValue))) {
+            return true;
+        }
+    }
+}
+
+
+
+// Move the second half of the largest range of another thread
+// to range i, which must be empty.
+// Returns false if all ranges are empty.
+template<class T> inline bool ChanZuckerberg::shasta::MultithreadedObject<T>::stealRange(size_t i)
+{
+    while(true) {
+
+        // Find the largest range.
+        size_t victim = rangeCount();
+        __uint128_t victimRange = 0;
+        uint64_t victimSize = 0;
+        for(size_t j=0; j<rangeCount(); j++) {
+            const __uint128_t r = range(j);
+            const uint64_t begin = rangeBegin(r);
+            const uint64_t end = rangeEnd(r);
+            if(end > begin && end - begin > victimSize) {
+                victim = j;
+                victimRange = r;
+                victimSize = end - begin;
+            }
+        }
+        if(victim == rangeCount()) {
+            return false;
+        }
+
+        // Split it, keeping the split point a multiple of the batch size.
+        // If the range is less than two batches, take all of it.
+        const uint64_t begin = rangeBegin(victimRange);
+        const uint64_t end = rangeEnd(victimRange);
+        const uint64_t middle = begin + batchSize * ((victimSize / 2) / batchSize);
+        if(!__sync_bool_compare_and_swap(&range(victim), victimRange, makeRange(begin, middle))) {
+            continue;
+        }
+
+        // Store the stolen work in our range.
+        // Only its owner stores into an empty range, so this cannot fail.
+        const __uint128_t oldRange = range(i);
+        CZI_ASSERT(rangeBegin(oldRange) >= rangeEnd(oldRange));
+        const bool success = __sync_bool_compare_and_swap(&range(i), oldRange, makeRange(middle, end));
+        CZI_ASSERT(success);
+        return true;
+    }
 }
 
 #endif
@@ -0,0 +1,260 @@
+// Shasta.
+#include "Numa.hpp"
+#include "MultitreadedObject.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "fstream.hpp"
+#include <sstream>
+#include "stdexcept.hpp"
+#include <thread>
+
+// Linux.
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+
+Numa::Mode Numa::mode = Numa::Mode::none;
+size_t Numa::threadCount = 0;
+vector<int> Numa::cpus;
+vector<int> Numa::memoryNodes;
+
+
+
+// Class used by Numa::firstTouch to touch memory
+// using threads pinned like all other MultithreadedObject threads.
+namespace ChanZuckerberg {
+    namespace shasta {
+        class NumaFirstTouch;
+    }
+}
+class ChanZuckerberg::shasta::NumaFirstTouch :
+    public MultithreadedObject<NumaFirstTouch> {
+public:
+    NumaFirstTouch(char* begin, char* end, size_t threadCount) :
+        MultithreadedObject(*this),
+        begin(begin),
+        end(end),
+        threadCount(threadCount)
+    {
+    }
+
+    // Touch the threadId-th slice of [begin, end).
+    // Reading is not enough, because a read of an anonymous page
+    // that was never written maps the shared zero page.
+    // Writing back the value read leaves the contents unchanged.
+    void threadFunction(size_t threadId)
+    {
+        const size_t pageSize = 4096;
+        const size_t size = size_t(end - begin);
+        const size_t sliceBegin = ((size * threadId) / threadCount) & ~(pageSize - 1);
+        const size_t sliceEnd = (threadId == threadCount - 1) ? size :
+            (((size * (threadId + 1)) / threadCount) & ~(pageSize - 1));
+        for(size_t offset=sliceBegin; offset<sliceEnd; offset+=pageSize) {
+            volatile char* p = begin + offset;
+            *p = *p;
+        }
+    }
+
+private:
+    char* begin;
+    char* end;
+    size_t threadCount;
+};
+
+
+
+void Numa::setMode(const string& modeName, size_t threadCountArgument)
+{
+    if(modeName == "none") {
+        mode = Mode::none;
+    } else if(modeName == "interleave") {
+        mode = Mode::interleave;
+    } else if(modeName == "firstTouch") {
+        mode = Mode::firstTouch;
+    } else {
+        throw runtime_error("Invalid NUMA mode " + modeName +
+            ". Must be none, interleave, or firstTouch.");
+    }
+    threadCount = threadCountArgument;
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    cpus.clear();
+    memoryNodes.clear();
+    if(mode == Mode::none) {
+        return;
+    }
+
+#ifdef __linux__
+
+    // Find the cpus available to this process.
+    cpu_set_t allowedCpus;
+    CPU_ZERO(&allowedCpus);
+    if(::sched_getaffinity(0, sizeof(allowedCpus), &allowedCpus) != 0) {
+        throw runtime_error("Error getting the cpus available to this process.");
+    }
+
+    // Order them by NUMA node.
+    const vector<int> nodes = readList("/sys/devices/system/node/online");
+    for(const int node: nodes) {
+        const vector<int> nodeCpus =
+            readList("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        for(const int cpu: nodeCpus) {
+            if(cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowedCpus)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+
+    // If NUMA information is not available, use the allowed cpus in order.
+    if(cpus.empty()) {
+        for(int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+            if(CPU_ISSET(cpu, &allowedCpus)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+
+    memoryNodes = readList("/sys/devices/system/node/has_memory");
+
+    // In interleave mode, set the memory policy of the process.
+    // This is inherited by all threads created later.
+    if(mode == Mode::interleave && !memoryNodes.empty()) {
+        const int maxNode = *max_element(memoryNodes.begin(), memoryNodes.end());
+        const size_t bitsPerWord = 8 * sizeof(unsigned long);
+        vector<unsigned long> nodeMask(size_t(maxNode) / bitsPerWord + 1, 0UL);
+        for(const int node: memoryNodes) {
+            nodeMask[size_t(node) / bitsPerWord] |= (1UL << (size_t(node) % bitsPerWord));
+        }
+        // The kernel uses one bit less than the maxnode argument.
+        const unsigned long maskBitCount = nodeMask.size() * bitsPerWord + 1;
+        if(::syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, nodeMask.data(), maskBitCount) != 0) {
+            throw runtime_error("Error setting the NUMA interleave memory policy.");
+        }
+    }
+
+#else
+    throw runtime_error("NUMA modes other than none are only supported on Linux.");
+#endif
+}
+
+
+
+void Numa::pinThread(size_t threadId)
+{
+    if(mode == Mode::none || cpus.empty()) {
+        return;
+    }
+
+#ifdef __linux__
+    // Spread the threads evenly over the cpus,
+    // keeping consecutive threads on the same NUMA node.
+    const size_t i = (threadId % threadCount) * cpus.size() / threadCount;
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpus[i], &cpuSet);
+    // Failure is not fatal: the thread just remains unpinned.
+    ::sched_setaffinity(0, sizeof(cpuSet), &cpuSet);
+#endif
+}
+
+
+
+void Numa::firstTouch(void* begin, void* end)
+{
+    if(mode != Mode::firstTouch || threadCount < 2) {
+        return;
+    }
+    char* cBegin = static_cast<char*>(begin);
+    char* cEnd = static_cast<char*>(end);
+    if(cEnd <= cBegin || size_t(cEnd - cBegin) < firstTouchMinimumBytes) {
+        return;
+    }
+    NumaFirstTouch numaFirstTouch(cBegin, cEnd, threadCount);
+    numaFirstTouch.runThreads(&NumaFirstTouch::threadFunction, threadCount);
+}
+
+
+
+void Numa::getNodeStatistics(
+    uint64_t& localPageCount,
+    uint64_t& remotePageCount)
+{
+    localPageCount = 0;
+    remotePageCount = 0;
+
+    // Each line of numastat contains a name and a value.
+    const vector<int> nodes = readList("/sys/devices/system/node/online");
+    for(const int node: nodes) {
+        ifstream file("/sys/devices/system/node/node" + to_string(node) + "/numastat");
+        string name;
+        uint64_t value;
+        while(file >> name >> value) {
+            if(name == "local_node") {
+                localPageCount += value;
+            } else if(name == "other_node") {
+                remotePageCount += value;
+            }
+        }
+    }
+}
+
+
+
+string Numa::getDescription()
+{
+    std::ostringstream s;
+    s << "NUMA mode ";
+    switch(mode) {
+    case Mode::none:
+        s << "none";
+        break;
+    case Mode::interleave:
+        s << "interleave";
+        break;
+    case Mode::firstTouch:
+        s << "firstTouch";
+        break;
+    }
+    s << ", " << readList("/sys/devices/system/node/online").size() << " NUMA nodes, ";
+    s << memoryNodes.size() << " with memory, ";
+    s << threadCount << " threads pinned to " << cpus.size() << " cpus.";
+    return s.str();
+}
+
+
+
+vector<int> Numa::readList(const string& fileName)
+{
+    vector<int> v;
+    ifstream file(fileName);
+    string list;
+    if(!(file >> list)) {
+        return v;
+    }
+
+    // The list is a comma separated sequence of integers or ranges.
+    std::istringstream s(list);
+    string item;
+    while(getline(s, item, ',')) {
+        const size_t dashPosition = item.find('-');
+        if(dashPosition == string::npos) {
+            v.push_back(std::stoi(item));
+        } else {
+            const int first = std::stoi(item.substr(0, dashPosition));
+            const int last = std::stoi(item.substr(dashPosition + 1));
+            for(int i=first; i<=last; i++) {
+                v.push_back(i);
+            }
+        }
+    }
+    return v;
+}
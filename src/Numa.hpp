@@ -0,0 +1,120 @@
+#ifndef CZI_SHASTA_NUMA_HPP
+#define CZI_SHASTA_NUMA_HPP
+
+/*******************************************************************************
+
+Class Numa controls the placement of threads and memory
+on machines with more than one NUMA node (typically one node per socket).
+
+By default (mode none) nothing is done, and each page of memory
+is allocated on the NUMA node of the thread that first touches it.
+For large MemoryMapped::Vector objects this is often the main thread
+constructing the elements, so all of the memory ends up on one node.
+
+In the other modes, the threads of each MultithreadedObject pool
+are pinned to cpus: thread i always runs on the same cpu,
+regardless of which MultithreadedObject it belongs to.
+The cpus are ordered by NUMA node, and consecutive threads
+are assigned to cpus of the same node.
+In addition, the memory of large MemoryMapped::Vector objects
+is placed as follows:
+
+- Mode interleave: the pages of all memory allocated
+  by the process are interleaved between the NUMA nodes
+  that have memory (set_mempolicy with MPOL_INTERLEAVE).
+
+- Mode firstTouch: when a MemoryMapped::Vector is created or grows
+  by at least firstTouchMinimumBytes, the new memory is first touched
+  in parallel before the elements are constructed.
+  Thread i touches the i-th of threadCount equal slices,
+  which is approximately the range of items that getNextBatch
+  initially assigns to thread i (see MultithreadedObject.hpp).
+  As a result, the pages are placed on the NUMA node
+  of the thread that will most likely process them.
+
+getNodeStatistics returns, summed over all NUMA nodes,
+the number of pages allocated on the node of the allocating thread
+and on a different node (local_node and other_node
+in /sys/devices/system/node/nodeN/numastat).
+These are system wide counters,
+and they count page allocations, not memory accesses,
+but on a machine dedicated to the assembly
+the fraction of remote pages is a useful measure of how well
+memory placement matches thread placement.
+
+*******************************************************************************/
+
+// Standard library.
+#include "cstddef.hpp"
+#include "cstdint.hpp"
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class Numa;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::Numa {
+public:
+
+    enum class Mode {
+        none,
+        interleave,
+        firstTouch
+    };
+
+    // Set the mode. Allowed mode names are none, interleave, and firstTouch.
+    // The thread count should be the number of threads
+    // used by MultithreadedObject pools. Zero means the number of
+    // hardware threads.
+    // This should be called once, at the beginning of the run,
+    // before any threads are started or memory is allocated.
+    static void setMode(const string& modeName, size_t threadCount);
+    static Mode getMode()
+    {
+        return mode;
+    }
+
+    // Pin the calling thread to the cpu assigned to the given thread id.
+    // This is called by each MultithreadedObject pool thread when it starts.
+    // It does nothing in mode none.
+    static void pinThread(size_t threadId);
+
+    // In mode firstTouch, touch the memory in [begin, end) in parallel,
+    // using threads pinned in the same way as MultithreadedObject threads.
+    // In the other modes, or if the range is less than firstTouchMinimumBytes,
+    // this does nothing.
+    static void firstTouch(void* begin, void* end);
+    static const size_t firstTouchMinimumBytes = 64 * 1024 * 1024;
+
+    // Number of pages allocated, summed over all NUMA nodes,
+    // on the node of the allocating thread and on a different node.
+    // If unavailable, they are returned as zero.
+    static void getNodeStatistics(
+        uint64_t& localPageCount,
+        uint64_t& remotePageCount);
+
+    // Describe the NUMA nodes and the current mode.
+    static string getDescription();
+
+private:
+    static Mode mode;
+    static size_t threadCount;
+
+    // The cpus available to this process, ordered by NUMA node.
+    static vector<int> cpus;
+
+    // The NUMA nodes that have memory.
+    static vector<int> memoryNodes;
+
+    // Parse a list of integers in the format used in /sys,
+    // for example "0-3,8-11". Returns an empty vector
+    // if the file does not exist.
+    static vector<int> readList(const string& fileName);
+};
+
+#endif
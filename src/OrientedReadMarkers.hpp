@@ -0,0 +1,115 @@
+#ifndef CZI_SHASTA_ORIENTED_READ_MARKERS_HPP
+#define CZI_SHASTA_ORIENTED_READ_MARKERS_HPP
+
+/*******************************************************************************
+
+Class OrientedReadMarkers is a read-only view of the markers
+of one oriented read.
+
+The markers of an oriented read on strand 1 are the markers
+of the same read on strand 0, in reverse order, with each k-mer
+replaced by its reverse complement and each position p
+replaced by readLength - k - p.
+So Assembler::markers can store markers for strand 0 only
+(Assembler::findMarkers with strandImplicit=true),
+which uses half the memory. In that case Assembler::markers
+is indexed by ReadId instead of OrientedReadId::getValue(),
+and the markers on strand 1 are computed on the fly by this class.
+
+Code that uses this class (usually via Assembler::getOrientedReadMarkers)
+works with both storage modes. Code that accesses Assembler::markers
+directly, or uses global marker ids to index it (the marker graph),
+requires markers stored for both strands.
+
+*******************************************************************************/
+
+// shasta.
+#include "CZI_ASSERT.hpp"
+#include "KmerIterator.hpp"
+#include "Marker.hpp"
+#include "MemoryMappedVectorOfVectors.hpp"
+#include "ReadId.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class OrientedReadMarkers;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::OrientedReadMarkers {
+public:
+
+    // Construct the view for an oriented read, given the markers
+    // stored either for both strands or for strand 0 only.
+    // The read length (in run-length bases) is only used to compute
+    // positions on strand 1 in the strand implicit case.
+    OrientedReadMarkers(
+        const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers,
+        uint64_t readCount,
+        OrientedReadId orientedReadId,
+        uint32_t readLength,
+        uint64_t k) :
+        readLength(readLength),
+        k(k)
+    {
+        if(markers.size() == 2 * readCount) {
+            begin = markers.begin(orientedReadId.getValue());
+            end = markers.end(orientedReadId.getValue());
+            isDerived = false;
+        } else {
+            CZI_ASSERT(markers.size() == readCount);
+            begin = markers.begin(orientedReadId.getReadId());
+            end = markers.end(orientedReadId.getReadId());
+            isDerived = (orientedReadId.getStrand() == 1);
+        }
+    }
+
+    uint64_t size() const
+    {
+        return uint64_t(end - begin);
+    }
+    bool empty() const
+    {
+        return begin == end;
+    }
+
+    KmerId kmerId(uint64_t ordinal) const
+    {
+        if(isDerived) {
+            return reverseComplementKmerId(end[-1 - int64_t(ordinal)].kmerId, k);
+        } else {
+            return begin[ordinal].kmerId;
+        }
+    }
+
+    uint32_t position(uint64_t ordinal) const
+    {
+        if(isDerived) {
+            return uint32_t(readLength - k - end[-1 - int64_t(ordinal)].position);
+        } else {
+            return begin[ordinal].position;
+        }
+    }
+
+    Marker operator[](uint64_t ordinal) const
+    {
+        Marker marker;
+        marker.kmerId = kmerId(ordinal);
+        marker.position = position(ordinal);
+        return marker;
+    }
+
+private:
+    const CompressedMarker* begin;
+    const CompressedMarker* end;
+
+    // True if these are strand 1 markers computed from the strand 0 markers.
+    bool isDerived;
+
+    uint32_t readLength;
+    uint64_t k;
+};
+
+#endif
@@ -0,0 +1,360 @@
+// Shasta.
+#include "PerformanceReport.hpp"
+#include "HugePages.hpp"
+#include "MemoryMappedVector.hpp"
+#include "Numa.hpp"
+#include "Progress.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "fstream.hpp"
+#include <iomanip>
+#include "iostream.hpp"
+#include <sstream>
+
+// Linux.
+#include <sys/resource.h>
+#include <sys/time.h>
+
+
+
+PerformanceReport::StageTimer::StageTimer(
+    PerformanceReport& performanceReport,
+    const string& name) :
+    performanceReport(performanceReport),
+    name(name)
+{
+    startTime = steady_clock::now();
+    getResourceUsage(startUserSeconds, startSystemSeconds, startMajorPageFaults);
+    Numa::getNodeStatistics(startNumaLocalPageCount, startNumaRemotePageCount);
+    MemoryMapped::Statistics::resetPeakMappedBytes();
+    startHardwareCounters = HardwareCounters::getTotals();
+    startLoopCount = HardwareCounters::getLoopCount();
+    startArenaStatistics = ThreadArena::getTotals();
+    Progress::beginStage(name);
+}
+
+
+
+PerformanceReport::StageTimer::~StageTimer()
+{
+    Progress::endStage();
+
+    Stage stage;
+    stage.name = name;
+    stage.elapsedSeconds = seconds(steady_clock::now() - startTime);
+
+    double userSeconds;
+    double systemSeconds;
+    uint64_t majorPageFaults;
+    getResourceUsage(userSeconds, systemSeconds, majorPageFaults);
+    stage.userSeconds = userSeconds - startUserSeconds;
+    stage.systemSeconds = systemSeconds - startSystemSeconds;
+    stage.majorPageFaults = majorPageFaults - startMajorPageFaults;
+
+    getResidentMemory(stage.residentBytes, stage.peakResidentBytes);
+
+    stage.mappedVectorCount = MemoryMapped::Statistics::getMappedVectorCount();
+    stage.mappedBytes = MemoryMapped::Statistics::getMappedBytes();
+    stage.peakMappedBytes = MemoryMapped::Statistics::getPeakMappedBytes();
+
+    uint64_t numaLocalPageCount;
+    uint64_t numaRemotePageCount;
+    Numa::getNodeStatistics(numaLocalPageCount, numaRemotePageCount);
+    stage.numaLocalPageCount = numaLocalPageCount - startNumaLocalPageCount;
+    stage.numaRemotePageCount = numaRemotePageCount - startNumaRemotePageCount;
+
+    HugePages::getStatistics(stage.transparentHugePageBytes, stage.hugetlbBytes);
+
+    stage.hardwareCounters = HardwareCounters::getTotals() - startHardwareCounters;
+    stage.loops = HardwareCounters::getLoops(startLoopCount);
+    stage.arenaStatistics = ThreadArena::getTotals() - startArenaStatistics;
+
+    performanceReport.stages.push_back(stage);
+}
+
+
+
+void PerformanceReport::getResourceUsage(
+    double& userSeconds,
+    double& systemSeconds,
+    uint64_t& majorPageFaults)
+{
+    rusage usage;
+    if(::getrusage(RUSAGE_SELF, &usage) != 0) {
+        userSeconds = 0.;
+        systemSeconds = 0.;
+        majorPageFaults = 0;
+        return;
+    }
+    userSeconds = double(usage.ru_utime.tv_sec) + 1.e-6 * double(usage.ru_utime.tv_usec);
+    systemSeconds = double(usage.ru_stime.tv_sec) + 1.e-6 * double(usage.ru_stime.tv_usec);
+    majorPageFaults = uint64_t(usage.ru_majflt);
+}
+
+
+
+// The lines of /proc/self/status we use look like this:
+// VmHWM:	  123456 kB
+// VmRSS:	  123456 kB
+void PerformanceReport::getResidentMemory(
+    uint64_t& residentBytes,
+    uint64_t& peakResidentBytes)
+{
+    residentBytes = 0;
+    peakResidentBytes = 0;
+
+    ifstream file("/proc/self/status");
+    string line;
+    while(getline(file, line)) {
+        const size_t colonPosition = line.find(':');
+        if(colonPosition == string::npos) {
+            continue;
+        }
+        const string key = line.substr(0, colonPosition);
+        uint64_t* value = 0;
+        if(key == "VmRSS") {
+            value = &residentBytes;
+        } else if(key == "VmHWM") {
+            value = &peakResidentBytes;
+        } else {
+            continue;
+        }
+        std::istringstream s(line.substr(colonPosition+1));
+        uint64_t kiloBytes = 0;
+        s >> kiloBytes;
+        *value = 1024 * kiloBytes;
+    }
+}
+
+
+
+void PerformanceReport::writeCsv(const string& fileName) const
+{
+    ofstream csv(fileName);
+    csv << "Stage,ElapsedSeconds,UserSeconds,SystemSeconds,MajorPageFaults,"
+        "ResidentBytes,PeakResidentBytes,MappedVectorCount,MappedBytes,PeakMappedBytes,"
+        "NumaLocalPageCount,NumaRemotePageCount,TransparentHugePageBytes,HugetlbBytes,"
+        "Cycles,Instructions,LlcMisses,DtlbMisses,"
+        "ArenaAllocationCount,ArenaAllocatedBytes,ArenaBlockCount,ArenaBlockBytes\n";
+    for(const Stage& stage: stages) {
+        csv << stage.name << ",";
+        csv << stage.elapsedSeconds << ",";
+        csv << stage.userSeconds << ",";
+        csv << stage.systemSeconds << ",";
+        csv << stage.majorPageFaults << ",";
+        csv << stage.residentBytes << ",";
+        csv << stage.peakResidentBytes << ",";
+        csv << stage.mappedVectorCount << ",";
+        csv << stage.mappedBytes << ",";
+        csv << stage.peakMappedBytes << ",";
+        csv << stage.numaLocalPageCount << ",";
+        csv << stage.numaRemotePageCount << ",";
+        csv << stage.transparentHugePageBytes << ",";
+        csv << stage.hugetlbBytes << ",";
+        csv << stage.hardwareCounters.cycles << ",";
+        csv << stage.hardwareCounters.instructions << ",";
+        csv << stage.hardwareCounters.llcMisses << ",";
+        csv << stage.hardwareCounters.dtlbMisses << ",";
+        csv << stage.arenaStatistics.allocationCount << ",";
+        csv << stage.arenaStatistics.allocatedBytes << ",";
+        csv << stage.arenaStatistics.blockCount << ",";
+        csv << stage.arenaStatistics.blockBytes << "\n";
+    }
+}
+
+
+
+void PerformanceReport::writeJson(const string& fileName) const
+{
+    ofstream json(fileName);
+    json << "{\n  \"stages\": [";
+    for(size_t i=0; i<stages.size(); i++) {
+        const Stage& stage = stages[i];
+        if(i != 0) {
+            json << ",";
+        }
+        json << "\n    {\n";
+        json << "      \"name\": \"" << stage.name << "\",\n";
+        json << "      \"elapsedSeconds\": " << stage.elapsedSeconds << ",\n";
+        json << "      \"userSeconds\": " << stage.userSeconds << ",\n";
+        json << "      \"systemSeconds\": " << stage.systemSeconds << ",\n";
+        json << "      \"majorPageFaults\": " << stage.majorPageFaults << ",\n";
+        json << "      \"residentBytes\": " << stage.residentBytes << ",\n";
+        json << "      \"peakResidentBytes\": " << stage.peakResidentBytes << ",\n";
+        json << "      \"mappedVectorCount\": " << stage.mappedVectorCount << ",\n";
+        json << "      \"mappedBytes\": " << stage.mappedBytes << ",\n";
+        json << "      \"peakMappedBytes\": " << stage.peakMappedBytes << ",\n";
+        json << "      \"numaLocalPageCount\": " << stage.numaLocalPageCount << ",\n";
+        json << "      \"numaRemotePageCount\": " << stage.numaRemotePageCount << ",\n";
+        json << "      \"transparentHugePageBytes\": " << stage.transparentHugePageBytes << ",\n";
+        json << "      \"hugetlbBytes\": " << stage.hugetlbBytes << ",\n";
+        writeJson(json, stage.hardwareCounters, "      ");
+        json << ",\n";
+        json << "      \"arenaAllocationCount\": " << stage.arenaStatistics.allocationCount << ",\n";
+        json << "      \"arenaAllocatedBytes\": " << stage.arenaStatistics.allocatedBytes << ",\n";
+        json << "      \"arenaBlockCount\": " << stage.arenaStatistics.blockCount << ",\n";
+        json << "      \"arenaBlockBytes\": " << stage.arenaStatistics.blockBytes << ",\n";
+        json << "      \"loops\": [";
+        for(size_t j=0; j<stage.loops.size(); j++) {
+            const HardwareCounters::Loop& loop = stage.loops[j];
+            if(j != 0) {
+                json << ",";
+            }
+            json << "\n        {\n";
+            json << "          \"objectType\": \"" << loop.objectType << "\",\n";
+            json << "          \"threadCount\": " << loop.threadCount << ",\n";
+            json << "          \"elapsedSeconds\": " << loop.elapsedSeconds << ",\n";
+            writeJson(json, loop.values, "          ");
+            json << "\n        }";
+        }
+        json << "\n      ]\n";
+        json << "    }";
+    }
+    json << "\n  ]\n}\n";
+}
+
+
+
+// Write the hardware counters as json fields, without a final comma or newline.
+void PerformanceReport::writeJson(
+    ostream& json,
+    const HardwareCounters::Values& values,
+    const string& indent)
+{
+    json << indent << "\"cycles\": " << values.cycles << ",\n";
+    json << indent << "\"instructions\": " << values.instructions << ",\n";
+    json << indent << "\"llcMisses\": " << values.llcMisses << ",\n";
+    json << indent << "\"dtlbMisses\": " << values.dtlbMisses << ",\n";
+    json << indent << "\"instructionsPerCycle\": " << values.instructionsPerCycle() << ",\n";
+    json << indent << "\"llcMissesPerThousandInstructions\": " <<
+        HardwareCounters::Values::perThousandInstructions(values.llcMisses, values.instructions) << ",\n";
+    json << indent << "\"dtlbMissesPerThousandInstructions\": " <<
+        HardwareCounters::Values::perThousandInstructions(values.dtlbMisses, values.instructions);
+}
+
+
+
+bool PerformanceReport::readCsv(const string& fileName)
+{
+    ifstream csv(fileName);
+    if(!csv) {
+        return false;
+    }
+    stages.clear();
+
+    // Skip the header line.
+    string line;
+    getline(csv, line);
+
+    while(getline(csv, line)) {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream s(line);
+        Stage stage;
+        s >>
+            stage.name >>
+            stage.elapsedSeconds >>
+            stage.userSeconds >>
+            stage.systemSeconds >>
+            stage.majorPageFaults >>
+            stage.residentBytes >>
+            stage.peakResidentBytes >>
+            stage.mappedVectorCount >>
+            stage.mappedBytes >>
+            stage.peakMappedBytes >>
+            stage.numaLocalPageCount >>
+            stage.numaRemotePageCount;
+        if(s) {
+            // These columns are missing in reports
+            // written by older versions.
+            s >> stage.transparentHugePageBytes >> stage.hugetlbBytes;
+            s >>
+                stage.hardwareCounters.cycles >>
+                stage.hardwareCounters.instructions >>
+                stage.hardwareCounters.llcMisses >>
+                stage.hardwareCounters.dtlbMisses;
+            s >>
+                stage.arenaStatistics.allocationCount >>
+                stage.arenaStatistics.allocatedBytes >>
+                stage.arenaStatistics.blockCount >>
+                stage.arenaStatistics.blockBytes;
+            stages.push_back(stage);
+        }
+    }
+    return true;
+}
+
+
+
+void PerformanceReport::writeHtml(ostream& html) const
+{
+    using std::fixed;
+    using std::setprecision;
+    const double gigaByte = 1024. * 1024. * 1024.;
+
+    html <<
+        "<table>"
+        "<tr>"
+        "<th>Stage"
+        "<th title='Elapsed (wall clock) time in seconds'>Elapsed"
+        "<th title='User CPU time in seconds, summed over all threads'>User"
+        "<th title='System CPU time in seconds, summed over all threads'>System"
+        "<th title='Number of major page faults'>Major faults"
+        "<th title='Resident memory at the end of the stage, in GB'>Resident"
+        "<th title='Process high water mark of resident memory at the end of the stage, in GB'>Peak resident"
+        "<th title='Number of open MemoryMapped::Vector objects at the end of the stage'>Mapped vectors"
+        "<th title='Bytes mapped by MemoryMapped::Vector objects at the end of the stage, in GB'>Mapped"
+        "<th title='High water mark of bytes mapped by MemoryMapped::Vector objects during the stage, in GB'>Peak mapped"
+        "<th title='Percentage of the pages allocated during the stage (by any process) "
+        "that were on a different NUMA node than the allocating thread'>Remote pages"
+        "<th title='Memory of this process on transparent huge pages at the end of the stage, in GB'>Transparent huge pages"
+        "<th title='Memory of this process on hugetlb pages at the end of the stage, in GB'>Hugetlb pages"
+        "<th title='Instructions per cycle in MultithreadedObject threads "
+        "(only if hardware counters are enabled)'>IPC"
+        "<th title='Last level cache misses per thousand instructions "
+        "in MultithreadedObject threads (only if hardware counters are enabled)'>LLC MPKI"
+        "<th title='Data TLB misses per thousand instructions "
+        "in MultithreadedObject threads (only if hardware counters are enabled)'>dTLB MPKI"
+        "<th title='Number of allocations served by thread arenas'>Arena allocations"
+        "<th title='Number of blocks obtained from malloc by thread arenas'>Arena mallocs";
+
+    for(const Stage& stage: stages) {
+        html << fixed <<
+            "<tr><td>" << stage.name <<
+            "<td class=right>" << setprecision(2) << stage.elapsedSeconds <<
+            "<td class=right>" << stage.userSeconds <<
+            "<td class=right>" << stage.systemSeconds <<
+            "<td class=right>" << stage.majorPageFaults <<
+            "<td class=right>" << setprecision(3) << double(stage.residentBytes) / gigaByte <<
+            "<td class=right>" << double(stage.peakResidentBytes) / gigaByte <<
+            "<td class=right>" << stage.mappedVectorCount <<
+            "<td class=right>" << double(stage.mappedBytes) / gigaByte <<
+            "<td class=right>" << double(stage.peakMappedBytes) / gigaByte <<
+            "<td class=right>";
+        const uint64_t numaPageCount = stage.numaLocalPageCount + stage.numaRemotePageCount;
+        if(numaPageCount > 0) {
+            html << setprecision(1) <<
+                100. * double(stage.numaRemotePageCount) / double(numaPageCount) << "%";
+        }
+        html << setprecision(3) <<
+            "<td class=right>" << double(stage.transparentHugePageBytes) / gigaByte <<
+            "<td class=right>" << double(stage.hugetlbBytes) / gigaByte <<
+            "<td class=right>";
+        const HardwareCounters::Values& counters = stage.hardwareCounters;
+        if(counters.cycles > 0) {
+            using Values = HardwareCounters::Values;
+            html << setprecision(2) << counters.instructionsPerCycle() <<
+                "<td class=right>" << Values::perThousandInstructions(counters.llcMisses, counters.instructions) <<
+                "<td class=right>" << Values::perThousandInstructions(counters.dtlbMisses, counters.instructions);
+        } else {
+            html << "<td class=right><td class=right>";
+        }
+        html <<
+            "<td class=right>" << stage.arenaStatistics.allocationCount <<
+            "<td class=right>" << stage.arenaStatistics.blockCount;
+    }
+    html << "</table>";
+    html.unsetf(std::ios_base::floatfield);
+}
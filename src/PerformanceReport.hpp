@@ -0,0 +1,146 @@
+#ifndef CZI_SHASTA_PERFORMANCE_REPORT_HPP
+#define CZI_SHASTA_PERFORMANCE_REPORT_HPP
+
+/*******************************************************************************
+
+Class PerformanceReport keeps a machine readable record of the
+time and memory used by each stage of an assembly.
+
+Each stage is measured by a StageTimer, which samples the process
+resource usage when it is constructed and again when it is destroyed:
+
+{
+    PerformanceReport::StageTimer timer(performanceReport, "findMarkers");
+    ... run the stage ...
+}
+
+The measurements for each stage are:
+- Elapsed (wall clock) time.
+- User and system CPU time, summed over all threads (from getrusage).
+- The number of major page faults (from getrusage).
+- Resident memory at the end of the stage, and the process
+  high water mark of resident memory (VmRSS and VmHWM
+  from /proc/self/status). Note that the high water mark
+  is cumulative since the beginning of the process.
+- The number of open MemoryMapped::Vector objects and the total
+  number of bytes they map at the end of the stage, and the
+  high water mark of the number of mapped bytes during the stage
+  (see MemoryMapped::Statistics).
+- The number of pages allocated during the stage on the NUMA node
+  of the allocating thread and on a different node (see Numa.hpp).
+  These are system wide counters.
+- The number of bytes of this process mapped on transparent huge pages
+  and on hugetlb pages at the end of the stage (see HugePages.hpp).
+- If enabled, hardware counters (cycles, instructions,
+  last level cache misses, data TLB misses) summed over
+  MultithreadedObject threads, both for the entire stage and for each
+  call to runThreads/startThreads during the stage (see HardwareCounters.hpp).
+  The per-call counters are only written to the json report.
+- The number of allocations served by ThreadArena objects during the stage,
+  and the number of blocks they obtained from malloc (see ThreadArena.hpp).
+
+While it exists, a StageTimer also makes its stage
+the current stage reported by Progress (see Progress.hpp).
+
+The report can be written in csv or json format, and read back
+from csv, which is used to display it in the http server.
+
+*******************************************************************************/
+
+// Shasta.
+#include "HardwareCounters.hpp"
+#include "ThreadArena.hpp"
+
+// Standard library.
+#include "chrono.hpp"
+#include "cstdint.hpp"
+#include "iosfwd.hpp"
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class PerformanceReport;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::PerformanceReport {
+public:
+
+    // The measurements for one stage.
+    class Stage {
+    public:
+        string name;
+        double elapsedSeconds = 0.;
+        double userSeconds = 0.;
+        double systemSeconds = 0.;
+        uint64_t majorPageFaults = 0;
+        uint64_t residentBytes = 0;
+        uint64_t peakResidentBytes = 0;
+        uint64_t mappedVectorCount = 0;
+        uint64_t mappedBytes = 0;
+        uint64_t peakMappedBytes = 0;
+        uint64_t numaLocalPageCount = 0;
+        uint64_t numaRemotePageCount = 0;
+        uint64_t transparentHugePageBytes = 0;
+        uint64_t hugetlbBytes = 0;
+        HardwareCounters::Values hardwareCounters;
+        vector<HardwareCounters::Loop> loops;
+        ThreadArena::Statistics arenaStatistics;
+    };
+    vector<Stage> stages;
+
+    // Measure a stage for its lifetime and add it to the report
+    // when it is destroyed.
+    // Stage timers should not be nested, because each of them
+    // restarts the high water mark of mapped bytes.
+    class StageTimer {
+    public:
+        StageTimer(PerformanceReport&, const string& name);
+        ~StageTimer();
+    private:
+        PerformanceReport& performanceReport;
+        string name;
+        steady_clock::time_point startTime;
+        double startUserSeconds;
+        double startSystemSeconds;
+        uint64_t startMajorPageFaults;
+        uint64_t startNumaLocalPageCount;
+        uint64_t startNumaRemotePageCount;
+        HardwareCounters::Values startHardwareCounters;
+        uint64_t startLoopCount;
+        ThreadArena::Statistics startArenaStatistics;
+    };
+
+    void writeCsv(const string& fileName) const;
+    void writeJson(const string& fileName) const;
+    void writeHtml(ostream&) const;
+
+    // Replace the stages with the ones stored in a csv file
+    // created by writeCsv. Return false if the file could not be opened.
+    bool readCsv(const string& fileName);
+
+private:
+
+    // Get the user and system CPU time and the number of major page faults
+    // for this process.
+    static void getResourceUsage(
+        double& userSeconds,
+        double& systemSeconds,
+        uint64_t& majorPageFaults);
+
+    // Get the resident memory and its high water mark
+    // from /proc/self/status. If unavailable, they are returned as zero.
+    static void getResidentMemory(
+        uint64_t& residentBytes,
+        uint64_t& peakResidentBytes);
+
+    static void writeJson(
+        ostream&,
+        const HardwareCounters::Values&,
+        const string& indent);
+};
+
+#endif
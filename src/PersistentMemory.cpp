@@ -0,0 +1,148 @@
+// Shasta.
+#include "PersistentMemory.hpp"
+#include "HugePages.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include <cerrno>
+#include <cstring>
+#include "iostream.hpp"
+#include <sstream>
+#include "stdexcept.hpp"
+
+// Linux.
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/mman.h>
+#endif
+
+
+
+string PersistentMemory::fileNamePrefix;
+vector<string> PersistentMemory::objectNames;
+uint64_t PersistentMemory::deviceId = 0;
+uint64_t PersistentMemory::syncMappingCount = 0;
+uint64_t PersistentMemory::fallbackMappingCount = 0;
+
+
+
+void PersistentMemory::setPlacement(
+    const string& fileNamePrefixArgument,
+    const vector<string>& objectNamesArgument)
+{
+    if(fileNamePrefixArgument.empty() || fileNamePrefixArgument.back() != '/') {
+        throw runtime_error("Invalid persistent memory file name prefix " +
+            fileNamePrefixArgument + ". Must end with a slash.");
+    }
+    struct stat fileInformation;
+    if(::stat(fileNamePrefixArgument.c_str(), &fileInformation) == -1 ||
+        !S_ISDIR(fileInformation.st_mode)) {
+        throw runtime_error("Persistent memory directory " +
+            fileNamePrefixArgument + " does not exist.");
+    }
+    fileNamePrefix = fileNamePrefixArgument;
+    objectNames = objectNamesArgument;
+    deviceId = uint64_t(fileInformation.st_dev);
+}
+
+
+
+bool PersistentMemory::isPlaced(const string& objectName)
+{
+    return
+        isEnabled() &&
+        find(objectNames.begin(), objectNames.end(), objectName) != objectNames.end();
+}
+
+
+
+bool PersistentMemory::isPersistentMemoryFile(int fileDescriptor)
+{
+    if(!isEnabled()) {
+        return false;
+    }
+    struct stat fileInformation;
+    if(::fstat(fileDescriptor, &fileInformation) == -1) {
+        return false;
+    }
+    return uint64_t(fileInformation.st_dev) == deviceId;
+}
+
+
+
+void* PersistentMemory::mapFile(
+    void* address,
+    size_t size,
+    int protection,
+    int fileDescriptor,
+    size_t fileOffset)
+{
+    // If no address was given, reserve an aligned range,
+    // so the kernel can use 2 MB mappings of the persistent memory.
+    void* begin = address;
+    if(begin == 0) {
+        begin = HugePages::reserveAddressSpace(size);
+        if(begin == MAP_FAILED) {
+            return MAP_FAILED;
+        }
+    }
+
+#if defined(MAP_SYNC) && defined(MAP_SHARED_VALIDATE)
+    void* pointer = ::mmap(begin, size, protection,
+        MAP_SHARED_VALIDATE | MAP_SYNC | MAP_FIXED, fileDescriptor, off_t(fileOffset));
+    if(pointer != MAP_FAILED) {
+        __sync_fetch_and_add(&syncMappingCount, 1);
+        return pointer;
+    }
+
+    // The filesystem does not support MAP_SYNC.
+    // Fall back to a regular shared mapping.
+    if(errno == EOPNOTSUPP || errno == EINVAL) {
+        if(__sync_fetch_and_add(&fallbackMappingCount, 1) == 0) {
+            cout << "Mapping " << size << " bytes with MAP_SYNC failed: " <<
+                ::strerror(errno) << ". The persistent memory directory " <<
+                fileNamePrefix << " is probably not on a filesystem mounted with dax. "
+                "Using MAP_SHARED instead. This message is only written once." << endl;
+        }
+    } else {
+        if(address == 0) {
+            const int savedErrno = errno;
+            ::munmap(begin, size);
+            errno = savedErrno;
+        }
+        return MAP_FAILED;
+    }
+#else
+    __sync_fetch_and_add(&fallbackMappingCount, 1);
+#endif
+
+    void* sharedPointer = ::mmap(begin, size, protection,
+        MAP_SHARED | MAP_FIXED, fileDescriptor, off_t(fileOffset));
+    if(sharedPointer == MAP_FAILED && address == 0) {
+        const int savedErrno = errno;
+        ::munmap(begin, size);
+        errno = savedErrno;
+    }
+    return sharedPointer;
+}
+
+
+
+string PersistentMemory::getDescription()
+{
+    std::ostringstream s;
+    if(!isEnabled()) {
+        s << "Persistent memory is not in use.";
+        return s.str();
+    }
+    s << "Persistent memory directory " << fileNamePrefix << " used for";
+    for(const string& objectName: objectNames) {
+        s << " " << objectName;
+    }
+    s << ", " << syncMappingCount << " mappings with MAP_SYNC, " <<
+        fallbackMappingCount << " mappings without MAP_SYNC.";
+    return s.str();
+}
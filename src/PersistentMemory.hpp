@@ -0,0 +1,105 @@
+#ifndef CZI_SHASTA_PERSISTENT_MEMORY_HPP
+#define CZI_SHASTA_PERSISTENT_MEMORY_HPP
+
+/*******************************************************************************
+
+Class PersistentMemory places selected large data structures
+on persistent memory (Optane-class) or CXL-attached memory
+exposed as a filesystem mounted with the dax option,
+so an assembly can use more memory than the available DRAM
+at the cost of a modest slowdown.
+
+The placement is by object name: the names passed to
+Assembler::largeDataName that appear in the list given to setPlacement
+(for example Reads, Markers, GlobalMarkerGraphEdgeMarkerIntervals)
+are stored in files beginning with the given prefix,
+which must be a directory on the dax filesystem.
+All other data structures, including the ones that are
+written heavily, stay where they would be otherwise (in DRAM,
+or in the Data directory). Good candidates for placement are
+large data structures that are mostly read after they are created.
+
+Files on the same device as that directory are mapped
+with MAP_SHARED_VALIDATE | MAP_SYNC, at addresses aligned to 2 MB,
+so the kernel maps the persistent memory directly into the address
+space, using 2 MB mappings when possible, without going through
+the page cache. If the filesystem does not support MAP_SYNC
+(it is not a dax filesystem), the files are mapped with MAP_SHARED
+and a message is written once. This makes it possible to test
+the placement on any filesystem.
+
+The mapping functions of HugePages call mapFile for files
+on the persistent memory device, so this works for all
+MemoryMapped objects.
+
+*******************************************************************************/
+
+// Standard library.
+#include "cstddef.hpp"
+#include "cstdint.hpp"
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class PersistentMemory;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::PersistentMemory {
+public:
+
+    // Place the data structures with the given names in files
+    // beginning with the given prefix, which must end with a slash
+    // and name an existing directory.
+    // This should be called once, at the beginning of the run,
+    // before any memory is allocated.
+    static void setPlacement(
+        const string& fileNamePrefix,
+        const vector<string>& objectNames);
+    static bool isEnabled()
+    {
+        return !fileNamePrefix.empty();
+    }
+
+    // Return true if the data structure with this name
+    // is placed on persistent memory.
+    static bool isPlaced(const string& objectName);
+    static const string& getFileNamePrefix()
+    {
+        return fileNamePrefix;
+    }
+
+    // Return true if an open file is on the persistent memory device.
+    static bool isPersistentMemoryFile(int fileDescriptor);
+
+    // Map a file on the persistent memory device as described above.
+    // If address is not zero, the mapping is created at that address,
+    // which must be inside a reserved range, as with HugePages::mapFileAt.
+    // Returns MAP_FAILED and sets errno in case of failure, like mmap.
+    static void* mapFile(
+        void* address,
+        size_t size,
+        int protection,
+        int fileDescriptor,
+        size_t fileOffset);
+
+    // Describe the placement and the number of mappings of each kind.
+    static string getDescription();
+
+private:
+    static string fileNamePrefix;
+    static vector<string> objectNames;
+
+    // The device of the persistent memory directory.
+    static uint64_t deviceId;
+
+    // The number of mappings that used MAP_SYNC and
+    // the number of mappings that fell back to MAP_SHARED.
+    static uint64_t syncMappingCount;
+    static uint64_t fallbackMappingCount;
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include "PoaBackend.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Spoa.
+#include "spoa/spoa.hpp"
+
+// Standard library.
+#include <limits>
+#include <stdexcept>
+
+// cudapoa from GenomeWorks, only used if building with BUILD_CUDAPOA.
+#ifdef SHASTA_BUILD_CUDAPOA
+#include <claraparabricks/genomeworks/cudapoa/batch.hpp>
+#include <claraparabricks/genomeworks/cudapoa/cudapoa.hpp>
+#include <claraparabricks/genomeworks/utils/allocator.hpp>
+#include <cuda_runtime_api.h>
+#include <mutex>
+#endif
+
+
+
+// Compute a multiple sequence alignment using spoa,
+// entering the sequences in order, each with its weight.
+void ChanZuckerberg::shasta::computeSpoaAlignment(
+    const vector<string>& sequences,
+    const vector<uint32_t>& weights,
+    vector<string>& msa)
+{
+    CZI_ASSERT(weights.size() == sequences.size());
+
+    // Each thread keeps its own spoa alignment engine and graph,
+    // created the first time they are needed, and the graph is
+    // cleared before each use. This avoids constructing them for each call.
+    static thread_local std::unique_ptr<spoa::AlignmentEngine> alignmentEngine;
+    static thread_local std::unique_ptr<spoa::Graph> alignmentGraph;
+    if(!alignmentEngine) {
+        const spoa::AlignmentType alignmentType = spoa::AlignmentType::kNW;
+        const int8_t match = 1;
+        const int8_t mismatch = -1;
+        const int8_t gap = -1;
+        alignmentEngine = spoa::createAlignmentEngine(alignmentType, match, mismatch, gap);
+        alignmentGraph = spoa::createGraph();
+    } else {
+        alignmentGraph->clear();
+    }
+
+    for(size_t i=0; i<sequences.size(); i++) {
+        const string& sequence = sequences[i];
+        auto alignment = alignmentEngine->align(sequence, alignmentGraph);
+        alignmentGraph->add_alignment(alignment, sequence, weights[i]);
+    }
+
+    msa.clear();
+    alignmentGraph->generate_multiple_sequence_alignment(msa);
+}
+
+
+
+#ifndef SHASTA_BUILD_CUDAPOA
+
+shared_ptr<PoaBackend> ChanZuckerberg::shasta::createCudapoaBackend(int)
+{
+    throw std::runtime_error("The GPU backend for marker graph edge consensus "
+        "is not available in this build of Shasta. "
+        "To use it, build the Shasta library with BUILD_CUDAPOA turned on.");
+}
+
+#else
+
+namespace cudapoa = claraparabricks::genomeworks::cudapoa;
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class CudapoaBackend;
+    }
+}
+
+
+
+// PoaBackend that computes the alignments on a GPU using cudapoa.
+// The device is shared by all threads, so only one thread
+// at a time submits work to it. The other threads
+// continue computing consensus on the CPU meanwhile.
+class ChanZuckerberg::shasta::CudapoaBackend : public PoaBackend {
+public:
+    CudapoaBackend(int deviceId);
+    ~CudapoaBackend();
+    void align(PoaBatch&);
+    string description() const;
+
+private:
+    int deviceId;
+    cudaStream_t stream;
+    std::unique_ptr<cudapoa::Batch> deviceBatch;
+    std::mutex mutex;
+
+    // The device limits. Groups that have more sequences, longer sequences,
+    // or weights that don't fit in an int8_t are aligned on the CPU.
+    static const int32_t maxSequenceLength = 1024;
+    static const int32_t maxSequenceCount = 100;
+
+    // Fraction of the free device memory used by cudapoa.
+    static constexpr double deviceMemoryFraction = 0.9;
+
+    bool fitsOnDevice(const PoaBatch&, uint64_t groupId) const;
+
+    // Run the groups currently added to the device batch
+    // and store their alignments. Group ids set to invalidGroupId
+    // were added incompletely, and their alignments are discarded.
+    static const uint64_t invalidGroupId = std::numeric_limits<uint64_t>::max();
+    void runDeviceBatch(
+        PoaBatch&,
+        vector<uint64_t>& deviceGroupIds,
+        vector<bool>& isAligned);
+};
+
+
+
+shared_ptr<PoaBackend> ChanZuckerberg::shasta::createCudapoaBackend(int deviceId)
+{
+    return make_shared<CudapoaBackend>(deviceId);
+}
+
+
+
+CudapoaBackend::CudapoaBackend(int deviceId) :
+    deviceId(deviceId)
+{
+    if(cudapoa::Init() != cudapoa::StatusType::success) {
+        throw std::runtime_error("Error initializing cudapoa.");
+    }
+    if(cudaSetDevice(deviceId) != cudaSuccess) {
+        throw std::runtime_error("Unable to use GPU device " + to_string(deviceId) + ".");
+    }
+    if(cudaStreamCreate(&stream) != cudaSuccess) {
+        throw std::runtime_error("Unable to create a CUDA stream on GPU device " +
+            to_string(deviceId) + ".");
+    }
+
+    size_t freeMemory, totalMemory;
+    if(cudaMemGetInfo(&freeMemory, &totalMemory) != cudaSuccess) {
+        throw std::runtime_error("Unable to get the memory size of GPU device " +
+            to_string(deviceId) + ".");
+    }
+    const int64_t maxMemory = int64_t(deviceMemoryFraction * double(freeMemory));
+
+    // Same scoring as computeSpoaAlignment.
+    const int16_t gap = -1;
+    const int16_t mismatch = -1;
+    const int16_t match = 1;
+    const cudapoa::BatchConfig batchConfig(maxSequenceLength, maxSequenceCount);
+    deviceBatch = cudapoa::create_batch(
+        deviceId, stream,
+        claraparabricks::genomeworks::create_default_device_allocator(maxMemory, stream),
+        maxMemory, cudapoa::OutputType::msa, batchConfig,
+        gap, mismatch, match);
+}
+
+
+
+CudapoaBackend::~CudapoaBackend()
+{
+    deviceBatch.reset();
+    cudaStreamDestroy(stream);
+}
+
+
+
+string CudapoaBackend::description() const
+{
+    return "cudapoa on GPU device " + to_string(deviceId);
+}
+
+
+
+bool CudapoaBackend::fitsOnDevice(const PoaBatch& poaBatch, uint64_t groupId) const
+{
+    const vector<string>& sequences = poaBatch.sequences[groupId];
+    const vector<uint32_t>& weights = poaBatch.weights[groupId];
+    if(sequences.size() > uint64_t(maxSequenceCount)) {
+        return false;
+    }
+    for(size_t i=0; i<sequences.size(); i++) {
+        if(sequences[i].size() > uint64_t(maxSequenceLength)) {
+            return false;
+        }
+        if(weights[i] > uint32_t(std::numeric_limits<int8_t>::max())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+void CudapoaBackend::align(PoaBatch& poaBatch)
+{
+    const uint64_t groupCount = poaBatch.size();
+    poaBatch.msas.clear();
+    poaBatch.msas.resize(groupCount);
+    poaBatch.deviceGroupCount = 0;
+    vector<bool> isAligned(groupCount, false);
+
+    // cudapoa takes a weight for each base.
+    // These must stay valid until the device batch is run.
+    vector< vector< vector<int8_t> > > baseWeights;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(cudaSetDevice(deviceId) != cudaSuccess) {
+            throw std::runtime_error("Unable to use GPU device " + to_string(deviceId) + ".");
+        }
+
+        vector<uint64_t> deviceGroupIds;
+        vector<cudapoa::StatusType> sequenceStatus;
+        for(uint64_t groupId=0; groupId<groupCount; groupId++) {
+            if(!fitsOnDevice(poaBatch, groupId)) {
+                continue;
+            }
+            const vector<string>& sequences = poaBatch.sequences[groupId];
+            const vector<uint32_t>& weights = poaBatch.weights[groupId];
+
+            baseWeights.resize(baseWeights.size() + 1);
+            vector< vector<int8_t> >& groupBaseWeights = baseWeights.back();
+            groupBaseWeights.resize(sequences.size());
+            cudapoa::Group group;
+            for(size_t i=0; i<sequences.size(); i++) {
+                groupBaseWeights[i].assign(sequences[i].size(), int8_t(weights[i]));
+                cudapoa::Entry entry;
+                entry.seq = sequences[i].data();
+                entry.weights = groupBaseWeights[i].data();
+                entry.length = int32_t(sequences[i].size());
+                group.push_back(entry);
+            }
+
+            // Add the group, running the device batch first if it is full.
+            sequenceStatus.clear();
+            cudapoa::StatusType status = deviceBatch->add_poa_group(sequenceStatus, group);
+            if( (status == cudapoa::StatusType::exceeded_maximum_poas ||
+                status == cudapoa::StatusType::exceeded_batch_size) &&
+                !deviceGroupIds.empty()) {
+                runDeviceBatch(poaBatch, deviceGroupIds, isAligned);
+                sequenceStatus.clear();
+                status = deviceBatch->add_poa_group(sequenceStatus, group);
+            }
+            if(status != cudapoa::StatusType::success) {
+                continue;
+            }
+
+            // If any sequence was not added, the alignment
+            // of this group cannot be used.
+            bool allSequencesWereAdded = true;
+            for(const cudapoa::StatusType s: sequenceStatus) {
+                if(s != cudapoa::StatusType::success) {
+                    allSequencesWereAdded = false;
+                }
+            }
+            deviceGroupIds.push_back(allSequencesWereAdded ? groupId : uint64_t(invalidGroupId));
+        }
+        if(!deviceGroupIds.empty()) {
+            runDeviceBatch(poaBatch, deviceGroupIds, isAligned);
+        }
+    }
+
+    // Align on the CPU the groups that were not aligned on the device.
+    for(uint64_t groupId=0; groupId<groupCount; groupId++) {
+        if(!isAligned[groupId]) {
+            computeSpoaAlignment(
+                poaBatch.sequences[groupId], poaBatch.weights[groupId], poaBatch.msas[groupId]);
+        }
+    }
+    poaBatch.isAligned = true;
+}
+
+
+
+void CudapoaBackend::runDeviceBatch(
+    PoaBatch& poaBatch,
+    vector<uint64_t>& deviceGroupIds,
+    vector<bool>& isAligned)
+{
+    deviceBatch->generate_poa();
+    vector< vector<string> > msas;
+    vector<cudapoa::StatusType> status;
+    deviceBatch->get_msa(msas, status);
+    CZI_ASSERT(msas.size() == deviceGroupIds.size());
+    CZI_ASSERT(status.size() == deviceGroupIds.size());
+
+    for(size_t i=0; i<deviceGroupIds.size(); i++) {
+        const uint64_t groupId = deviceGroupIds[i];
+        if(groupId == invalidGroupId || status[i] != cudapoa::StatusType::success) {
+            continue;
+        }
+        CZI_ASSERT(msas[i].size() == poaBatch.sequences[groupId].size());
+        poaBatch.msas[groupId].swap(msas[i]);
+        isAligned[groupId] = true;
+        ++poaBatch.deviceGroupCount;
+    }
+
+    deviceBatch->reset();
+    deviceGroupIds.clear();
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef CZI_SHASTA_POA_BACKEND_HPP
+#define CZI_SHASTA_POA_BACKEND_HPP
+
+
+/*******************************************************************************
+
+Class PoaBackend is an abstract base class for computing
+partial order alignments (POA) of batches of sequence groups.
+
+It is used by assembleMarkerGraphEdges to compute the multiple
+sequence alignments that computeMarkerGraphEdgeConsensusSequenceUsingSpoa
+would otherwise compute one edge at a time using spoa.
+For each batch of marker graph edges, the distinct intervening sequences
+of each edge that requires spoa are gathered into a PoaBatch,
+in the order in which they would be entered in spoa, each with
+its frequency as its weight. The PoaBackend then computes
+the alignments of all the groups in the batch, and the consensus of each
+edge is computed from its alignment exactly as with spoa.
+
+Derived classes must implement align. A single PoaBackend
+is shared by all threads, so align must be callable concurrently.
+
+The only derived class is CudapoaBackend, which computes the alignments
+on a GPU using cudapoa from GenomeWorks. It is only available
+if Shasta was built with BUILD_CUDAPOA, which defines SHASTA_BUILD_CUDAPOA.
+Groups that exceed the limits of the device are aligned on the CPU
+using computeSpoaAlignment.
+
+*******************************************************************************/
+
+#include "cstdint.hpp"
+#include "memory.hpp"
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class PoaBackend;
+        class PoaBatch;
+
+        // Compute a multiple sequence alignment using spoa,
+        // entering the sequences in order, each with its weight.
+        // On return, msa[i] is the aligned version of sequences[i],
+        // with '-' for gaps.
+        // Each thread keeps its own spoa alignment engine and graph,
+        // so this can be called concurrently by multiple threads.
+        void computeSpoaAlignment(
+            const vector<string>& sequences,
+            const vector<uint32_t>& weights,
+            vector<string>& msa);
+
+        // Create the cudapoa GPU backend.
+        // Throws if Shasta was not built with BUILD_CUDAPOA.
+        shared_ptr<PoaBackend> createCudapoaBackend(int deviceId);
+    }
+}
+
+
+
+// A batch of groups of sequences to be aligned by a PoaBackend.
+class ChanZuckerberg::shasta::PoaBatch {
+public:
+
+    // Add a group of sequences, in the order in which
+    // they should be entered in the alignment, each with its weight.
+    void addGroup(const vector<string>& groupSequences, const vector<uint32_t>& groupWeights)
+    {
+        sequences.push_back(groupSequences);
+        weights.push_back(groupWeights);
+    }
+
+    uint64_t size() const
+    {
+        return sequences.size();
+    }
+
+    void clear()
+    {
+        sequences.clear();
+        weights.clear();
+        msas.clear();
+        isAligned = false;
+        nextGroup = 0;
+        deviceGroupCount = 0;
+    }
+
+    // The sequences and weights of each group.
+    vector< vector<string> > sequences;
+    vector< vector<uint32_t> > weights;
+
+    // The multiple sequence alignment of each group,
+    // stored by PoaBackend::align, which also sets isAligned.
+    vector< vector<string> > msas;
+    bool isAligned = false;
+
+    // The number of groups aligned on the device.
+    // The remaining groups exceeded the device limits
+    // and were aligned on the CPU.
+    uint64_t deviceGroupCount = 0;
+
+    // The next group whose alignment will be used.
+    // Used by computeMarkerGraphEdgeConsensusSequenceUsingSpoa.
+    uint64_t nextGroup = 0;
+};
+
+
+
+class ChanZuckerberg::shasta::PoaBackend {
+public:
+
+    // Compute the multiple sequence alignment of each group in the batch.
+    virtual void align(PoaBatch&) = 0;
+
+    // A short description of the backend, to be written to the log.
+    virtual string description() const = 0;
+
+    virtual ~PoaBackend() {}
+};
+
+#endif
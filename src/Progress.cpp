@@ -0,0 +1,248 @@
+// Shasta.
+#include "Progress.hpp"
+#include "HardwareCounters.hpp"
+#include "ThreadLog.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include <iomanip>
+#include "iostream.hpp"
+#include <sstream>
+
+
+
+std::mutex Progress::mutex;
+string Progress::stageName;
+steady_clock::time_point Progress::stageStartTime;
+steady_clock::time_point Progress::loopStartTime;
+uint64_t Progress::loopCount = 0;
+uint64_t Progress::itemCount = 0;
+uint64_t Progress::completedItemCount = 0;
+array<Progress::ThreadCounters, Progress::maxThreadCount> Progress::threadCounters;
+array<uint64_t, Progress::batchTimeBinCount> Progress::batchTimeHistogram;
+
+
+
+void Progress::beginStage(const string& name)
+{
+    CZI_SHASTA_PROBE1(stage_begin, name.c_str());
+    std::lock_guard<std::mutex> lock(mutex);
+    stageName = name;
+    stageStartTime = steady_clock::now();
+    loopCount = 0;
+    itemCount = 0;
+    completedItemCount = 0;
+}
+
+
+
+void Progress::endStage()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    CZI_SHASTA_PROBE1(stage_end, stageName.c_str());
+    stageName.clear();
+    loopCount = 0;
+    itemCount = 0;
+    completedItemCount = 0;
+}
+
+
+
+void Progress::beginLoop(uint64_t itemCountArgument)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    loopStartTime = steady_clock::now();
+    ++loopCount;
+    itemCount = itemCountArgument;
+    completedItemCount = 0;
+    for(ThreadCounters& counters: threadCounters) {
+        counters.busyNanoseconds = 0;
+        counters.batchCount = 0;
+    }
+    batchTimeHistogram.fill(0);
+}
+
+
+
+void Progress::addCompletedBatch(
+    size_t threadId,
+    uint64_t batchItemCount,
+    uint64_t batchNanoseconds)
+{
+    addCompletedItems(batchItemCount);
+
+    ThreadCounters& counters = threadCounters[min(threadId, maxThreadCount - 1)];
+    __sync_fetch_and_add(&counters.busyNanoseconds, batchNanoseconds);
+    __sync_fetch_and_add(&counters.batchCount, 1);
+
+    // The bin is the position of the most significant bit.
+    const size_t bin = (batchNanoseconds == 0) ? 0 :
+        size_t(63 - __builtin_clzll(batchNanoseconds));
+    __sync_fetch_and_add(&batchTimeHistogram[bin], 1);
+}
+
+
+
+Progress::Status Progress::getStatus()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const steady_clock::time_point now = steady_clock::now();
+
+    Status status;
+    status.stageName = stageName;
+    if(!stageName.empty()) {
+        status.stageSeconds = seconds(now - stageStartTime);
+    }
+    status.loopCount = loopCount;
+    if(loopCount == 0) {
+        return status;
+    }
+
+    // Items.
+    status.itemCount = itemCount;
+    status.completedItemCount = min(itemCount, __sync_fetch_and_add(&completedItemCount, 0));
+    status.loopSeconds = seconds(now - loopStartTime);
+    if(status.loopSeconds > 0.) {
+        status.itemsPerSecond = double(status.completedItemCount) / status.loopSeconds;
+    }
+    if(status.completedItemCount > 0) {
+        const double completedFraction = double(status.completedItemCount) / double(status.itemCount);
+        status.remainingSeconds = status.loopSeconds * (1. - completedFraction) / completedFraction;
+    }
+
+    // Busy time of each thread.
+    const double nanosecond = 1.e-9;
+    for(ThreadCounters& counters: threadCounters) {
+        if(__sync_fetch_and_add(&counters.batchCount, 0) == 0) {
+            continue;
+        }
+        const double busySeconds = nanosecond *
+            double(__sync_fetch_and_add(&counters.busyNanoseconds, 0));
+        if(status.threadCount == 0) {
+            status.minThreadBusySeconds = busySeconds;
+            status.maxThreadBusySeconds = busySeconds;
+        } else {
+            status.minThreadBusySeconds = min(status.minThreadBusySeconds, busySeconds);
+            status.maxThreadBusySeconds = max(status.maxThreadBusySeconds, busySeconds);
+        }
+        ++status.threadCount;
+        status.busySeconds += busySeconds;
+    }
+
+    // Batch times.
+    array<uint64_t, batchTimeBinCount> histogram;
+    for(size_t bin=0; bin<batchTimeBinCount; bin++) {
+        histogram[bin] = __sync_fetch_and_add(&batchTimeHistogram[bin], 0);
+        status.batchCount += histogram[bin];
+    }
+    uint64_t cumulativeCount = 0;
+    for(size_t bin=0; bin<batchTimeBinCount; bin++) {
+        if(histogram[bin] == 0) {
+            continue;
+        }
+        const double binEnd = nanosecond * double(2ULL << min(bin, size_t(62)));
+        if(2 * cumulativeCount < status.batchCount &&
+            2 * (cumulativeCount + histogram[bin]) >= status.batchCount) {
+            status.medianBatchSeconds = binEnd;
+        }
+        if(10 * cumulativeCount < 9 * status.batchCount &&
+            10 * (cumulativeCount + histogram[bin]) >= 9 * status.batchCount) {
+            status.p90BatchSeconds = binEnd;
+        }
+        status.maxBatchSeconds = binEnd;
+        cumulativeCount += histogram[bin];
+    }
+
+    return status;
+}
+
+
+
+string Progress::getDescription()
+{
+    return getDescription(getStatus());
+}
+
+
+
+string Progress::getDescription(const Status& status)
+{
+    if(status.stageName.empty()) {
+        return "No stage running.";
+    }
+
+    std::ostringstream s;
+    s << std::fixed << std::setprecision(1);
+    s << "Stage " << status.stageName << " running for " << status.stageSeconds << " s";
+    if(status.loopCount > 0) {
+        s << ", parallel loop " << status.loopCount << ": " <<
+            status.completedItemCount << " of " << status.itemCount << " items done";
+        if(status.itemCount > 0) {
+            s << " (" << 100. * double(status.completedItemCount) / double(status.itemCount) << "%)";
+        }
+        s << ", " << status.itemsPerSecond << " items/s";
+        if(status.remainingSeconds >= 0.) {
+            s << ", about " << status.remainingSeconds << " s remaining";
+        }
+        if(status.threadCount > 0 && status.loopSeconds > 0.) {
+            s << ", " << status.threadCount << " threads busy " <<
+                100. * status.busySeconds / (double(status.threadCount) * status.loopSeconds) <<
+                "% of the time (" << status.minThreadBusySeconds << " to " <<
+                status.maxThreadBusySeconds << " s each)";
+        }
+        if(status.batchCount > 0) {
+            s.unsetf(std::ios::floatfield);
+            s << std::setprecision(2) << ", " << status.batchCount << " batches taking up to " <<
+                status.medianBatchSeconds << " s (median), " <<
+                status.p90BatchSeconds << " s (90%), " <<
+                status.maxBatchSeconds << " s (maximum)";
+        }
+    }
+    s << ".";
+    return s.str();
+}
+
+
+
+Progress::Reporter::Reporter(double intervalSeconds) :
+    intervalSeconds(intervalSeconds)
+{
+    if(intervalSeconds > 0.) {
+        thread = std::thread(&Reporter::threadFunction, this);
+    }
+}
+
+
+
+Progress::Reporter::~Reporter()
+{
+    if(thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shouldStop = true;
+        }
+        condition.notify_all();
+        thread.join();
+        ThreadLog::flush();
+    }
+}
+
+
+
+// Progress messages go through ThreadLog, like the messages
+// written by other threads, so they are not interleaved with them.
+void Progress::Reporter::threadFunction()
+{
+    const auto interval = std::chrono::duration<double>(intervalSeconds);
+    std::unique_lock<std::mutex> lock(mutex);
+    while(!condition.wait_for(lock, interval, [this]{return shouldStop;})) {
+        const Status status = getStatus();
+        if(status.stageName.empty()) {
+            continue;
+        }
+        ThreadLog::Message(ThreadLog::Level::info) << timestamp << "Progress: " << getDescription(status);
+    }
+}
@@ -0,0 +1,156 @@
+#ifndef CZI_SHASTA_PROGRESS_HPP
+#define CZI_SHASTA_PROGRESS_HPP
+
+/*******************************************************************************
+
+Class Progress keeps track, for the entire process, of the assembly stage
+currently running and of the progress of its current parallel loop.
+It can be queried from any thread at any time, for example from Python
+while a long running Assembler function runs with the GIL released,
+or from the http server.
+
+- The current stage is set using a Progress::Stage object
+  for the duration of the stage. This is done by
+  PerformanceReport::StageTimer and, for long running Assembler
+  functions called from Python, by the Python module.
+- Parallel loops that use MultithreadedObject::setupLoadBalancing
+  and getNextBatch report their progress automatically:
+  setupLoadBalancing begins a new loop, and each call to getNextBatch
+  counts as completed the previous batch of the calling thread,
+  together with the time the thread spent on it.
+  Counters are updated with atomic operations, without locking.
+- The statistics of the current loop include throughput,
+  the time each thread was busy processing batches
+  (which shows load imbalance), and the distribution
+  of the time taken by each batch, kept as a histogram
+  with power of two bins.
+- The time remaining is extrapolated from the fraction of items
+  completed in the current loop. A stage can consist of several loops,
+  so this is an estimate for the current loop only.
+- A Progress::Reporter object runs a thread that periodically
+  writes the current progress to cout via ThreadLog, uniformly for all stages.
+
+If more than one parallel loop runs at the same time
+(for example in the http server), the loop information
+refers to the one that started last.
+
+*******************************************************************************/
+
+// Standard library.
+#include "array.hpp"
+#include "chrono.hpp"
+#include <condition_variable>
+#include "cstdint.hpp"
+#include <mutex>
+#include "string.hpp"
+#include <thread>
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class Progress;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::Progress {
+public:
+
+    // Set the current stage for the lifetime of this object.
+    class Stage {
+    public:
+        Stage(const string& name)
+        {
+            beginStage(name);
+        }
+        ~Stage()
+        {
+            endStage();
+        }
+    };
+    static void beginStage(const string& name);
+    static void endStage();
+
+    // Called by MultithreadedObject.
+    static void beginLoop(uint64_t itemCount);
+    static void addCompletedItems(uint64_t completedItemCountArgument)
+    {
+        __sync_fetch_and_add(&completedItemCount, completedItemCountArgument);
+    }
+    static void addCompletedBatch(
+        size_t threadId,
+        uint64_t batchItemCount,
+        uint64_t batchNanoseconds);
+
+    // The current progress.
+    class Status {
+    public:
+        string stageName;           // Empty if no stage is running.
+        double stageSeconds = 0.;   // Elapsed time in the current stage.
+        uint64_t loopCount = 0;     // The number of parallel loops begun in the current stage.
+        uint64_t itemCount = 0;     // The number of items in the current loop.
+        uint64_t completedItemCount = 0;
+        double loopSeconds = 0.;    // Elapsed time in the current loop.
+        double remainingSeconds = -1.;  // Estimated for the current loop, or -1 if unknown.
+        double itemsPerSecond = 0.;
+
+        // Time spent by threads processing batches in the current loop.
+        uint64_t threadCount = 0;   // The number of threads that completed at least one batch.
+        double busySeconds = 0.;    // Summed over threads.
+        double minThreadBusySeconds = 0.;
+        double maxThreadBusySeconds = 0.;
+
+        // Distribution of the time taken by each batch in the current loop.
+        // These are upper bounds, with a resolution of a factor of two.
+        uint64_t batchCount = 0;
+        double medianBatchSeconds = 0.;
+        double p90BatchSeconds = 0.;
+        double maxBatchSeconds = 0.;
+    };
+    static Status getStatus();
+
+    // A one line description of the current progress.
+    static string getDescription();
+    static string getDescription(const Status&);
+
+    // Write the current progress to cout (via ThreadLog) every intervalSeconds,
+    // for the lifetime of this object, while a stage is running.
+    class Reporter {
+    public:
+        Reporter(double intervalSeconds);
+        ~Reporter();
+    private:
+        double intervalSeconds;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool shouldStop = false;
+        void threadFunction();
+    };
+
+private:
+    static std::mutex mutex;
+    static string stageName;
+    static steady_clock::time_point stageStartTime;
+    static steady_clock::time_point loopStartTime;
+    static uint64_t loopCount;
+    static uint64_t itemCount;
+    static uint64_t completedItemCount;
+
+    // Per-thread counters for the current loop, one cache line each.
+    // Threads with higher ids share the last entry.
+    class alignas(64) ThreadCounters {
+    public:
+        uint64_t busyNanoseconds;
+        uint64_t batchCount;
+    };
+    static const size_t maxThreadCount = 256;
+    static array<ThreadCounters, maxThreadCount> threadCounters;
+
+    // Histogram of batch times. Bin i counts batches
+    // that took between 2^i and 2^(i+1) nanoseconds.
+    static const size_t batchTimeBinCount = 64;
+    static array<uint64_t, batchTimeBinCount> batchTimeHistogram;
+};
+
+#endif
@@ -1,13 +1,24 @@
 #ifndef SHASTA_STATIC_EXECUTABLE
 
 // Shasta.
+#include "accumulateCoverage.hpp"
+#include "accumulateLogLikelihoods.hpp"
 #include "Assembler.hpp"
 #include "Base.hpp"
+#include "benchmarks.hpp"
 #include "CompactUndirectedGraph.hpp"
+#include "computeFeatureHashes.hpp"
+#include "computeStarAlignment.hpp"
+#include "decodeBases.hpp"
 #include "dset64Test.hpp"
+#include "HardwareCounters.hpp"
+#include "KmerIterator.hpp"
 #include "LongBaseSequence.hpp"
 #include "mappedCopy.hpp"
+#include "MultiRunHttpServer.hpp"
 #include "MultitreadedObject.hpp"
+#include "Progress.hpp"
+#include "ThreadLog.hpp"
 #include "ShortBaseSequence.hpp"
 #include "splitRange.hpp"
 #include "testMarginCore.hpp"
@@ -25,8 +36,239 @@ using namespace pybind11;
 
 
 
+// Functions used to expose MemoryMapped data to Python
+// as read-only NumPy arrays, without making copies.
+// Each array keeps alive the Python object that owns the data
+// (the Assembler), so it remains valid as long as it is in use.
+
+// Create a NumPy structured data type given the name, NumPy format,
+// and byte offset of each field.
+static pybind11::dtype makeDtype(
+    const vector<string>& names,
+    const vector<string>& formats,
+    const vector<size_t>& offsets,
+    size_t itemSize)
+{
+    pybind11::list nameList;
+    pybind11::list formatList;
+    pybind11::list offsetList;
+    for(size_t i=0; i<names.size(); i++) {
+        nameList.append(names[i]);
+        formatList.append(formats[i]);
+        offsetList.append(offsets[i]);
+    }
+    return pybind11::dtype(nameList, formatList, offsetList, ssize_t(itemSize));
+}
+
+// Offset of a field in an object, in bytes.
+template<class T, class Field> static size_t fieldOffset(const T& t, const Field& field)
+{
+    return size_t(reinterpret_cast<const char*>(&field) - reinterpret_cast<const char*>(&t));
+}
+
+// Create a read-only NumPy array that uses the memory of n objects of type T
+// starting at p.
+template<class T> static pybind11::array makeArray(
+    const T* p,
+    size_t n,
+    const pybind11::dtype& type,
+    handle owner)
+{
+    pybind11::array a(type, vector<ssize_t>(1, ssize_t(n)), vector<ssize_t>(1, ssize_t(sizeof(T))), p, owner);
+    a.attr("setflags")(arg("write") = false);
+    return a;
+}
+template<class T> static pybind11::array makeArray(
+    const MemoryMapped::Vector<T>& v,
+    const pybind11::dtype& type,
+    handle owner)
+{
+    if(!v.isOpen) {
+        throw runtime_error("The requested data are not available.");
+    }
+    return makeArray(v.begin(), v.size(), type, owner);
+}
+
+// For a VectorOfVectors, return a tuple (toc, data).
+// Vector i is data[toc[i]:toc[i+1]].
+template<class T> static pybind11::tuple makeArrays(
+    const MemoryMapped::VectorOfVectors<T, uint64_t>& v,
+    const pybind11::dtype& type,
+    handle owner)
+{
+    if(!v.isOpen()) {
+        throw runtime_error("The requested data are not available.");
+    }
+    return make_tuple(
+        makeArray(v.getToc(), pybind11::dtype::of<uint64_t>(), owner),
+        makeArray(v.begin(), v.totalSize(), type, owner));
+}
+
+// NumPy data types for the Shasta classes we expose.
+// Uint40 and Uint24 fields are exposed as arrays of 5 or 3 bytes,
+// least significant byte first, because NumPy has no 40-bit or 24-bit integers.
+static pybind11::dtype compressedMarkerDtype()
+{
+    static_assert(sizeof(CompressedMarker) == sizeof(KmerId) + 3, "Unexpected CompressedMarker layout.");
+    return makeDtype(
+        {"kmerId", "position"},
+        {"u4", "3u1"},
+        {0, sizeof(KmerId)},
+        sizeof(CompressedMarker));
+}
+static pybind11::dtype alignmentDataDtype()
+{
+    // The fields of AlignmentInfo::Data are markerCount, firstOrdinal, lastOrdinal.
+    static_assert(sizeof(AlignmentInfo::Data) == 3 * sizeof(uint32_t), "Unexpected AlignmentInfo::Data layout.");
+    const AlignmentData a;
+    const size_t data0 = fieldOffset(a, a.info.data[0]);
+    const size_t data1 = fieldOffset(a, a.info.data[1]);
+    return makeDtype(
+        {"readId0", "readId1", "isSameStrand",
+         "markerCount0", "firstOrdinal0", "lastOrdinal0",
+         "markerCount1", "firstOrdinal1", "lastOrdinal1",
+         "markerCount"},
+        {"u4", "u4", "?", "u4", "u4", "u4", "u4", "u4", "u4", "u4"},
+        {fieldOffset(a, a.readIds[0]), fieldOffset(a, a.readIds[1]), fieldOffset(a, a.isSameStrand),
+         data0, data0 + 4, data0 + 8,
+         data1, data1 + 4, data1 + 8,
+         fieldOffset(a, a.info.markerCount)},
+        sizeof(AlignmentData));
+}
+static pybind11::dtype markerGraphEdgeDtype()
+{
+    // The flags are bit fields stored in the byte following the coverage:
+    // bit 0 wasRemovedByTransitiveReduction, bit 1 wasPruned,
+    // bit 2 isSuperBubbleEdge, bit 3 isDirty.
+    static_assert(sizeof(MarkerGraph::Edge) == 12, "Unexpected MarkerGraph::Edge layout.");
+    const MarkerGraph::Edge e;
+    const size_t coverageOffset = fieldOffset(e, e.coverage);
+    return makeDtype(
+        {"source", "target", "coverage", "flags"},
+        {"5u1", "5u1", "u1", "u1"},
+        {fieldOffset(e, e.source), fieldOffset(e, e.target), coverageOffset, coverageOffset + 1},
+        sizeof(MarkerGraph::Edge));
+}
+static pybind11::dtype markerIntervalDtype()
+{
+    const MarkerInterval m;
+    return makeDtype(
+        {"orientedReadId", "ordinal0", "ordinal1"},
+        {"u4", "u4", "u4"},
+        {fieldOffset(m, m.orientedReadId), fieldOffset(m, m.ordinals[0]), fieldOffset(m, m.ordinals[1])},
+        sizeof(MarkerInterval));
+}
+static pybind11::dtype assemblyGraphEdgeDtype()
+{
+    const AssemblyGraph::Edge e = AssemblyGraph::Edge();
+    return makeDtype(
+        {"source", "target", "averageCoverage"},
+        {"u8", "u8", "u4"},
+        {fieldOffset(e, e.source), fieldOffset(e, e.target), fieldOffset(e, e.averageCoverage)},
+        sizeof(AssemblyGraph::Edge));
+}
+
+
+
+// Wrap a long running Assembler member function so that, while it runs,
+// Progress reports it as the current stage.
+// These functions are exposed with the GIL released, so other Python threads
+// can call getProgress while they run, or call into a different Assembler object.
+// Calls into the same Assembler object must not overlap.
+// When the stage completes, its data are published to the live server,
+// if one was started (Assembler::startLiveServer).
+template<class R> class StageCall {
+public:
+    template<class F> static R call(Assembler& assembler, const char* name, F f)
+    {
+        R r = f();
+        assembler.publishLiveView(name);
+        return r;
+    }
+};
+template<> class StageCall<void> {
+public:
+    template<class F> static void call(Assembler& assembler, const char* name, F f)
+    {
+        f();
+        assembler.publishLiveView(name);
+    }
+};
+template<class R, class... Args> static auto stage(
+    const char* name,
+    R (Assembler::*f)(Args...))
+{
+    return [name, f](Assembler& assembler, Args... args) -> R
+    {
+        const Progress::Stage progressStage(name);
+        return StageCall<R>::call(assembler, name, [&]()
+        {
+            return (assembler.*f)(std::forward<Args>(args)...);
+        });
+    };
+}
+template<class R, class... Args> static auto stage(
+    const char* name,
+    R (Assembler::*f)(Args...) const)
+{
+    return [name, f](const Assembler& assembler, Args... args) -> R
+    {
+        const Progress::Stage progressStage(name);
+        return (assembler.*f)(std::forward<Args>(args)...);
+    };
+}
+
+
+
 PYBIND11_MODULE(shasta, module)
 {
+    {
+        // The progress of the stage currently running.
+        using Status = Progress::Status;
+        class_<Status>(module, "ProgressStatus")
+            .def_readonly("stageName", &Status::stageName)
+            .def_readonly("stageSeconds", &Status::stageSeconds)
+            .def_readonly("loopCount", &Status::loopCount)
+            .def_readonly("itemCount", &Status::itemCount)
+            .def_readonly("completedItemCount", &Status::completedItemCount)
+            .def_readonly("loopSeconds", &Status::loopSeconds)
+            .def_readonly("remainingSeconds", &Status::remainingSeconds)
+            .def_readonly("itemsPerSecond", &Status::itemsPerSecond)
+            .def_readonly("threadCount", &Status::threadCount)
+            .def_readonly("busySeconds", &Status::busySeconds)
+            .def_readonly("minThreadBusySeconds", &Status::minThreadBusySeconds)
+            .def_readonly("maxThreadBusySeconds", &Status::maxThreadBusySeconds)
+            .def_readonly("batchCount", &Status::batchCount)
+            .def_readonly("medianBatchSeconds", &Status::medianBatchSeconds)
+            .def_readonly("p90BatchSeconds", &Status::p90BatchSeconds)
+            .def_readonly("maxBatchSeconds", &Status::maxBatchSeconds)
+            ;
+        module.def("getProgress",
+            Progress::getStatus,
+            "Return the progress of the stage currently running. "
+            "Can be called from a different Python thread while "
+            "a long running Assembler function runs.");
+        module.def("getProgressDescription",
+            (string (*)()) Progress::getDescription);
+
+        // Hardware counters, see HardwareCounters.hpp.
+        module.def("setHardwareCountersEnabled",
+            HardwareCounters::setEnabled,
+            arg("enabled") = true);
+
+        // Messages written by thread functions, see ThreadLog.hpp.
+        module.def("setLogLevel",
+            (void (*)(const string&)) ThreadLog::setMinimumLevel,
+            arg("level"),
+            "Set the minimum level of the messages written by the threads "
+            "of each stage: debug, info, warning, or error.");
+
+        // While this object exists, write the progress to cout periodically.
+        class_<Progress::Reporter>(module, "ProgressReporter")
+            .def(pybind11::init<double>(),
+                arg("intervalSeconds") = 60.)
+            ;
+    }
 
     {
         // Class used by Assembler::getGlobalMarkerGraphEdgeInformation.
@@ -57,17 +299,41 @@ PYBIND11_MODULE(shasta, module)
 
         // Reads
         .def("addReadsFromFasta",
-            &Assembler::addReadsFromFasta,
-            "Add reads from a fasta file.",
+            stage("addReadsFromFasta", &Assembler::addReadsFromFasta),
+            call_guard<gil_scoped_release>(),
+            "Add reads from a fasta or fastq file, optionally compressed using gzip or bgzip.",
             arg("fileName"),
             arg("minReadLength"),
             arg("blockSize") = 2ULL * 1024ULL * 1024ULL * 1024ULL,
             arg("threadCountForReading") = 1,
-            arg("threadCountForProcessing") = 0)
+            arg("threadCountForProcessing") = 0,
+            arg("doubleBuffering") = false)
+        .def("addReadsFromFastaFiles",
+            stage("addReadsFromFastaFiles", &Assembler::addReadsFromFastaFiles),
+            call_guard<gil_scoped_release>(),
+            "Add reads from multiple fasta or fastq files, loading some of them concurrently.",
+            arg("fileNames"),
+            arg("minReadLength"),
+            arg("blockSize") = 2ULL * 1024ULL * 1024ULL * 1024ULL,
+            arg("threadCountForReading") = 1,
+            arg("threadCountForProcessing") = 0,
+            arg("maxConcurrentFileCount") = 0)
         .def("histogramReadLength",
+            (
+                void (Assembler::*)
+                (const string&)
+            )
             &Assembler::histogramReadLength,
             "Create a histogram of read length and write it to a csv file.",
             arg("fileName") = "ReadLengthHistogram.csv")
+        .def("subsampleReads",
+            stage("subsampleReads", &Assembler::subsampleReads),
+            arg("targetCoverage"),
+            arg("genomeSize"))
+        .def("benchmarkRunLengthRepresentation",
+            &Assembler::benchmarkRunLengthRepresentation,
+            "Micro-benchmark for the computation of the run-length representation of reads.",
+            arg("repeatCount") = 10)
         .def("writeReads",
             &Assembler::writeReads,
             "Write all reads to a file in fasta format.",
@@ -96,6 +362,25 @@ PYBIND11_MODULE(shasta, module)
         .def("accessReadFlags",
             &Assembler::accessReadFlags,
             arg("readWriteAccess") = false)
+        .def("compressReadRepeatCounts",
+            stage("compressReadRepeatCounts", &Assembler::compressReadRepeatCounts),
+            arg("removeReadRepeatCounts") = true)
+        .def("accessCompactReadRepeatCounts",
+            &Assembler::accessCompactReadRepeatCounts)
+        .def("createReadNameIndex",
+            stage("createReadNameIndex", &Assembler::createReadNameIndex),
+            call_guard<gil_scoped_release>(),
+            arg("threadCount") = 0)
+        .def("accessReadNameIndex",
+            &Assembler::accessReadNameIndex)
+        .def("getReadId",
+            &Assembler::getReadId,
+            "Return the ReadId of the read with the given name.",
+            arg("readName"))
+        .def("getReadIds",
+            &Assembler::getReadIds,
+            "Return the ReadIds of the reads with the given names.",
+            arg("readNames"))
 
 
 
@@ -106,10 +391,20 @@ PYBIND11_MODULE(shasta, module)
             &Assembler::writeKmers,
             arg("fileName") = "Kmers.csv")
         .def("randomlySelectKmers",
-            &Assembler::randomlySelectKmers,
+            stage("randomlySelectKmers", &Assembler::randomlySelectKmers),
+            call_guard<gil_scoped_release>(),
             arg("k"),
             arg("probability"),
             arg("seed") = 231)
+        .def("selectKmersBasedOnFrequency",
+            stage("selectKmersBasedOnFrequency", &Assembler::selectKmersBasedOnFrequency),
+            call_guard<gil_scoped_release>(),
+            "Select marker k-mers randomly, excluding k-mers over-represented in the reads.",
+            arg("k"),
+            arg("probability"),
+            arg("seed") = 231,
+            arg("enrichmentThreshold") = 10.,
+            arg("threadCount") = 0)
 
 
 
@@ -117,8 +412,34 @@ PYBIND11_MODULE(shasta, module)
         .def("accessMarkers",
             &Assembler::accessMarkers)
         .def("findMarkers",
-            &Assembler::findMarkers,
+            stage("findMarkers", &Assembler::findMarkers),
+            call_guard<gil_scoped_release>(),
             "Find markers in reads.",
+            arg("threadCount") = 0,
+            arg("strandImplicit") = false)
+        .def("accessSortedMarkers",
+            &Assembler::accessSortedMarkers)
+        .def("computeSortedMarkers",
+            stage("computeSortedMarkers", &Assembler::computeSortedMarkers),
+            call_guard<gil_scoped_release>(),
+            "Precompute markers sorted by k-mer id, for faster alignments.",
+            arg("threadCount") = 0)
+        .def("accessCompactMarkers",
+            &Assembler::accessCompactMarkers)
+        .def("compressMarkers",
+            stage("compressMarkers", &Assembler::compressMarkers),
+            call_guard<gil_scoped_release>(),
+            "Create a compact copy of the markers, used by getMarkerId, "
+            "getMarkersSortedByKmerId and LowHash. "
+            "If releaseMarkers is True, the markers are closed when done.",
+            arg("threadCount") = 0,
+            arg("releaseMarkers") = false)
+        .def("accessMarkerKmerIndex",
+            &Assembler::accessMarkerKmerIndex)
+        .def("createMarkerKmerIndex",
+            stage("createMarkerKmerIndex", &Assembler::createMarkerKmerIndex),
+            call_guard<gil_scoped_release>(),
+            "Create the inverted index from marker k-mers to oriented reads and ordinals.",
             arg("threadCount") = 0)
         .def("writeMarkers",
             (
@@ -135,24 +456,67 @@ PYBIND11_MODULE(shasta, module)
 
         // Alignment candidates.
         .def("findAlignmentCandidatesMinHash",
-            &Assembler::findAlignmentCandidatesMinHash,
+            stage("findAlignmentCandidatesMinHash", &Assembler::findAlignmentCandidatesMinHash),
+            call_guard<gil_scoped_release>(),
             arg("m"),
             arg("minHashIterationCount"),
             arg("log2MinHashBucketCount") = 0,
             arg("maxBucketSize"),
             arg("minFrequency"),
+            arg("sketchSize") = 1,
+            arg("lowHashMethod") = 0,
             arg("threadCount") = 0)
         .def("findAlignmentCandidatesLowHash",
-            &Assembler::findAlignmentCandidatesLowHash,
+            stage("findAlignmentCandidatesLowHash", &Assembler::findAlignmentCandidatesLowHash),
+            call_guard<gil_scoped_release>(),
+            arg("m"),
+            arg("hashFraction"),
+            arg("minHashIterationCount"),
+            arg("log2MinHashBucketCount") = 0,
+            arg("maxBucketSize"),
+            arg("minFrequency"),
+            arg("lowHashMethod") = 0,
+            arg("candidateTableMegabytes") = 0,
+            arg("singlePassHashing") = false,
+            arg("storeSketches") = false,
+            arg("targetCandidatesPerRead") = 0.,
+            arg("maxMarkerFrequency") = 10,
+            arg("maxSkip") = 30,
+            arg("minAlignedMarkerCount") = 100,
+            arg("maxTrim") = 30,
+            arg("threadCount") = 0)
+        .def("findAlignmentCandidatesLowHashShard",
+            stage("findAlignmentCandidatesLowHashShard", &Assembler::findAlignmentCandidatesLowHashShard),
+            call_guard<gil_scoped_release>(),
+            arg("shardId"),
+            arg("shardCount"),
             arg("m"),
             arg("hashFraction"),
             arg("minHashIterationCount"),
             arg("log2MinHashBucketCount") = 0,
             arg("maxBucketSize"),
+            arg("lowHashMethod") = 0,
+            arg("candidateTableMegabytes") = 0,
+            arg("singlePassHashing") = false,
+            arg("threadCount") = 0)
+        .def("mergeLowHashShards",
+            stage("mergeLowHashShards", &Assembler::mergeLowHashShards),
+            call_guard<gil_scoped_release>(),
+            arg("shardCount"),
+            arg("minFrequency"))
+        .def("findAlignmentCandidatesLowHashIncremental",
+            stage("findAlignmentCandidatesLowHashIncremental", &Assembler::findAlignmentCandidatesLowHashIncremental),
+            call_guard<gil_scoped_release>(),
+            arg("log2MinHashBucketCount") = 0,
+            arg("maxBucketSize"),
             arg("minFrequency"),
+            arg("lowHashMethod") = 0,
+            arg("candidateTableMegabytes") = 0,
             arg("threadCount") = 0)
         .def("accessAlignmentCandidates",
             &Assembler::accessAlignmentCandidates)
+        .def("accessLowHashSketches",
+            &Assembler::accessLowHashSketches)
         .def("writeOverlappingReads",
             &Assembler::writeOverlappingReads,
             "Write in fasta format the reads that overlap a given read.",
@@ -160,7 +524,8 @@ PYBIND11_MODULE(shasta, module)
             arg("strand"),
             arg("fileName") = "OverlappingReads.fasta")
         .def("flagPalindromicReads",
-            &Assembler::flagPalindromicReads,
+            stage("flagPalindromicReads", &Assembler::flagPalindromicReads),
+            call_guard<gil_scoped_release>(),
             arg("maxSkip"),
             arg("maxMarkerFrequency"),
             arg("alignedFractionThreshold"),
@@ -181,6 +546,93 @@ PYBIND11_MODULE(shasta, module)
             arg("strand1"),
             arg("maxSkip"),
             arg("maxMarkerFrequency"))
+
+        // Batch version of alignOrientedReads. Takes four NumPy arrays
+        // of the same length describing pairs of oriented reads,
+        // and returns a dictionary of NumPy arrays of the same length:
+        // markerCount (0 if no alignment was found), and for each of
+        // the two oriented reads the range of ordinals covered by the alignment
+        // (firstOrdinal, lastOrdinal) and the trims (leftTrim, rightTrim),
+        // with suffixes 0 and 1.
+        // The alignments are computed in parallel with the GIL released.
+        .def("alignOrientedReadsBatch",
+            [](
+                Assembler& assembler,
+                const pybind11::array_t<ReadId, pybind11::array::c_style | pybind11::array::forcecast>& readId0,
+                const pybind11::array_t<Strand, pybind11::array::c_style | pybind11::array::forcecast>& strand0,
+                const pybind11::array_t<ReadId, pybind11::array::c_style | pybind11::array::forcecast>& readId1,
+                const pybind11::array_t<Strand, pybind11::array::c_style | pybind11::array::forcecast>& strand1,
+                size_t maxSkip,
+                uint32_t maxMarkerFrequency,
+                size_t bandWidth,
+                size_t alignMethod,
+                size_t threadCount)
+            {
+                const size_t n = size_t(readId0.size());
+                if(size_t(strand0.size()) != n || size_t(readId1.size()) != n || size_t(strand1.size()) != n) {
+                    throw runtime_error("alignOrientedReadsBatch: the input arrays must have the same length.");
+                }
+                vector< std::array<OrientedReadId, 2> > orientedReadIdPairs(n);
+                for(size_t i=0; i<n; i++) {
+                    if(strand0.data()[i] > 1 || strand1.data()[i] > 1) {
+                        throw runtime_error("alignOrientedReadsBatch: strands must be 0 or 1.");
+                    }
+                    orientedReadIdPairs[i][0] = OrientedReadId(readId0.data()[i], strand0.data()[i]);
+                    orientedReadIdPairs[i][1] = OrientedReadId(readId1.data()[i], strand1.data()[i]);
+                }
+
+                vector<AlignmentInfo> alignmentInfos;
+                {
+                    gil_scoped_release release;
+                    const Progress::Stage progressStage("alignOrientedReadsBatch");
+                    assembler.alignOrientedReadsBatch(orientedReadIdPairs,
+                        maxSkip, maxMarkerFrequency, bandWidth, alignMethod, threadCount,
+                        alignmentInfos);
+                }
+
+                // Store the results. The fields of a failed alignment are all 0.
+                const ssize_t size = ssize_t(n);
+                pybind11::array_t<uint32_t> markerCount(size);
+                std::array<pybind11::array_t<uint32_t>, 2> firstOrdinal, lastOrdinal, leftTrim, rightTrim;
+                for(size_t j=0; j<2; j++) {
+                    firstOrdinal[j] = pybind11::array_t<uint32_t>(size);
+                    lastOrdinal[j] = pybind11::array_t<uint32_t>(size);
+                    leftTrim[j] = pybind11::array_t<uint32_t>(size);
+                    rightTrim[j] = pybind11::array_t<uint32_t>(size);
+                }
+                for(size_t i=0; i<n; i++) {
+                    const AlignmentInfo& alignmentInfo = alignmentInfos[i];
+                    const bool isValid = alignmentInfo.markerCount > 0;
+                    markerCount.mutable_data()[i] = alignmentInfo.markerCount;
+                    for(size_t j=0; j<2; j++) {
+                        const AlignmentInfo::Data& data = alignmentInfo.data[j];
+                        firstOrdinal[j].mutable_data()[i] = isValid ? data.leftTrim() : 0;
+                        lastOrdinal[j].mutable_data()[i] = isValid ? data.leftTrim() + data.range() - 1 : 0;
+                        leftTrim[j].mutable_data()[i] = isValid ? data.leftTrim() : 0;
+                        rightTrim[j].mutable_data()[i] = isValid ? data.rightTrim() : 0;
+                    }
+                }
+                pybind11::dict result;
+                result["markerCount"] = markerCount;
+                for(size_t j=0; j<2; j++) {
+                    const string suffix = to_string(j);
+                    result[("firstOrdinal" + suffix).c_str()] = firstOrdinal[j];
+                    result[("lastOrdinal" + suffix).c_str()] = lastOrdinal[j];
+                    result[("leftTrim" + suffix).c_str()] = leftTrim[j];
+                    result[("rightTrim" + suffix).c_str()] = rightTrim[j];
+                }
+                return result;
+            },
+            "Align many pairs of oriented reads in parallel and return NumPy arrays.",
+            arg("readId0"),
+            arg("strand0"),
+            arg("readId1"),
+            arg("strand1"),
+            arg("maxSkip"),
+            arg("maxMarkerFrequency"),
+            arg("bandWidth") = 0,
+            arg("alignMethod") = 0,
+            arg("threadCount") = 0)
         .def("alignOverlappingOrientedReads",
             (
                 void (Assembler::*)
@@ -197,24 +649,68 @@ PYBIND11_MODULE(shasta, module)
 
         // Compute an alignment for each alignment candidate.
         .def("computeAlignments",
-            &Assembler::computeAlignments,
+            stage("computeAlignments", &Assembler::computeAlignments),
+            call_guard<gil_scoped_release>(),
             arg("maxMarkerFrequency"),
             arg("maxSkip"),
             arg("minAlignedMarkerCount"),
             arg("maxTrim"),
+            arg("bandWidth") = 0,
+            arg("alignMethod") = 0,
+            arg("storeAlignments") = false,
+            arg("groupCandidates") = false,
+            arg("filterContainedReads") = false,
+            arg("maxAlignmentGraphEdgeCount") = 0,
             arg("threadCount") = 0)
+        .def("computeAlignmentsShard",
+            stage("computeAlignmentsShard", &Assembler::computeAlignmentsShard),
+            call_guard<gil_scoped_release>(),
+            arg("shardId"),
+            arg("shardCount"),
+            arg("maxMarkerFrequency"),
+            arg("maxSkip"),
+            arg("minAlignedMarkerCount"),
+            arg("maxTrim"),
+            arg("bandWidth") = 0,
+            arg("alignMethod") = 0,
+            arg("storeAlignments") = false,
+            arg("maxAlignmentGraphEdgeCount") = 0,
+            arg("threadCount") = 0)
+        .def("mergeAlignmentShards",
+            stage("mergeAlignmentShards", &Assembler::mergeAlignmentShards),
+            call_guard<gil_scoped_release>(),
+            arg("shardCount"),
+            arg("threadCount") = 0)
+        .def("benchmarkAlignments",
+            &Assembler::benchmarkAlignments,
+            arg("maxMarkerFrequency"),
+            arg("maxSkip"),
+            arg("minAlignedMarkerCount"),
+            arg("maxTrim"),
+            arg("candidateCount") = 0)
+        .def("benchmarkAlignmentShortestPath",
+            &Assembler::benchmarkAlignmentShortestPath,
+            arg("logFileName"),
+            arg("maxMarkerFrequency"),
+            arg("maxSkip"),
+            arg("bandWidth") = 0)
         .def("accessAlignmentData",
             &Assembler::accessAlignmentData)
+        .def("accessCompressedAlignments",
+            &Assembler::accessCompressedAlignments)
 
 
 
         // Read graph
         .def("createReadGraph",
-            &Assembler::createReadGraph,
+            stage("createReadGraph", &Assembler::createReadGraph),
+            call_guard<gil_scoped_release>(),
             arg("maxAlignmentCount"),
-            arg("maxTrim"))
+            arg("maxTrim"),
+            arg("threadCount") = 0)
         .def("createReadGraphNew",
-            &Assembler::createReadGraphNew,
+            stage("createReadGraphNew", &Assembler::createReadGraphNew),
+            call_guard<gil_scoped_release>(),
             arg("maxAlignmentCount"),
             arg("maxTrim"))
         .def("accessReadGraph",
@@ -224,12 +720,19 @@ PYBIND11_MODULE(shasta, module)
         .def("flagCrossStrandReadGraphEdges",
             &Assembler::flagCrossStrandReadGraphEdges)
         .def("flagChimericReads",
-             &Assembler::flagChimericReads,
+             stage("flagChimericReads", &Assembler::flagChimericReads),
+             call_guard<gil_scoped_release>(),
             arg("maxChimericReadDistance"),
             arg("threadCount") = 0)
         .def("computeReadGraphConnectedComponents",
-            &Assembler::computeReadGraphConnectedComponents,
-            arg("minComponentSize"))
+            stage("computeReadGraphConnectedComponents", &Assembler::computeReadGraphConnectedComponents),
+            call_guard<gil_scoped_release>(),
+            arg("minComponentSize"),
+            arg("threadCount") = 0)
+        .def("renumberReads",
+            stage("renumberReads", &Assembler::renumberReads),
+            call_guard<gil_scoped_release>(),
+            arg("threadCount") = 0)
         .def("writeLocalReadGraphReads",
             &Assembler::writeLocalReadGraphReads,
             arg("readId"),
@@ -242,7 +745,19 @@ PYBIND11_MODULE(shasta, module)
 
         // Global marker graph.
         .def("createMarkerGraphVertices",
-            &Assembler::createMarkerGraphVertices,
+            stage("createMarkerGraphVertices", &Assembler::createMarkerGraphVertices),
+            call_guard<gil_scoped_release>(),
+            arg("maxMarkerFrequency"),
+            arg("maxSkip"),
+            arg("minCoverage"),
+            arg("maxCoverage"),
+            arg("unionBufferSize") = 0,
+            arg("outOfCorePartitionCount") = 0,
+            arg("storeDisjointSetTable") = false,
+            arg("threadCount") = 0)
+        .def("createMarkerGraphVerticesIncremental",
+            stage("createMarkerGraphVerticesIncremental", &Assembler::createMarkerGraphVerticesIncremental),
+            call_guard<gil_scoped_release>(),
             arg("maxMarkerFrequency"),
             arg("maxSkip"),
             arg("minCoverage"),
@@ -300,65 +815,108 @@ PYBIND11_MODULE(shasta, module)
             arg("startVertexId"),
             arg("maxDistance"))
         .def("findMarkerGraphReverseComplementVertices",
-            &Assembler::findMarkerGraphReverseComplementVertices,
+            stage("findMarkerGraphReverseComplementVertices", &Assembler::findMarkerGraphReverseComplementVertices),
+            call_guard<gil_scoped_release>(),
             arg("threadCount") = 0)
         .def("accessMarkerGraphReverseComplementVertex",
             &Assembler::accessMarkerGraphReverseComplementVertex)
         .def("findMarkerGraphReverseComplementEdges",
-            &Assembler::findMarkerGraphReverseComplementEdges,
+            stage("findMarkerGraphReverseComplementEdges", &Assembler::findMarkerGraphReverseComplementEdges),
+            call_guard<gil_scoped_release>(),
             arg("threadCount") = 0)
         .def("accessMarkerGraphReverseComplementEdge",
             &Assembler::accessMarkerGraphReverseComplementEdge)
+        .def("storeCanonicalMarkerGraphEdgeMarkerIntervals",
+            stage("storeCanonicalMarkerGraphEdgeMarkerIntervals",
+            &Assembler::storeCanonicalMarkerGraphEdgeMarkerIntervals),
+            call_guard<gil_scoped_release>(),
+            arg("threadCount") = 0)
+        .def("compressMarkerGraphEdgeMarkerIntervals",
+            stage("compressMarkerGraphEdgeMarkerIntervals",
+            &Assembler::compressMarkerGraphEdgeMarkerIntervals),
+            call_guard<gil_scoped_release>(),
+            arg("threadCount") = 0)
+        .def("renumberMarkerGraph",
+            stage("renumberMarkerGraph", &Assembler::renumberMarkerGraph),
+            call_guard<gil_scoped_release>(),
+            arg("threadCount") = 0)
         .def("checkMarkerGraphIsStrandSymmetric",
             &Assembler::checkMarkerGraphIsStrandSymmetric,
             arg("threadCount") = 0)
+        .def("checkMarkerGraphDirtyEdgesAreStrandSymmetric",
+            &Assembler::checkMarkerGraphDirtyEdgesAreStrandSymmetric,
+            arg("threadCount") = 0)
 
 
 
         // Edges of the global marker graph.
         .def("createMarkerGraphEdges",
-            &Assembler::createMarkerGraphEdges,
+            stage("createMarkerGraphEdges", &Assembler::createMarkerGraphEdges),
+            call_guard<gil_scoped_release>(),
             arg("threadCount") = 0)
         .def("accessMarkerGraphEdges",
             &Assembler::accessMarkerGraphEdges,
             arg("accessEdgesReadWrite") = false)
         .def("flagMarkerGraphWeakEdges",
-            &Assembler::flagMarkerGraphWeakEdges,
+            stage("flagMarkerGraphWeakEdges", &Assembler::flagMarkerGraphWeakEdges),
+            call_guard<gil_scoped_release>(),
             arg("lowCoverageThreshold"),
             arg("highCoverageThreshold"),
             arg("maxDistance"),
-            arg("edgeMarkerSkipThreshold"))
+            arg("edgeMarkerSkipThreshold"),
+            arg("threadCount") = 0)
         .def("pruneMarkerGraphStrongSubgraph",
-            &Assembler::pruneMarkerGraphStrongSubgraph,
-            arg("iterationCount"))
+            stage("pruneMarkerGraphStrongSubgraph", &Assembler::pruneMarkerGraphStrongSubgraph),
+            call_guard<gil_scoped_release>(),
+            arg("iterationCount"),
+            arg("threadCount") = 0)
         .def("simplifyMarkerGraph",
-            &Assembler::simplifyMarkerGraph,
+            stage("simplifyMarkerGraph", &Assembler::simplifyMarkerGraph),
+            call_guard<gil_scoped_release>(),
             arg("maxLength"),
-            arg("debug") = false)
+            arg("debug") = false,
+            arg("threadCount") = 0)
         .def("assembleMarkerGraphVertices",
-            &Assembler::assembleMarkerGraphVertices,
+            stage("assembleMarkerGraphVertices", &Assembler::assembleMarkerGraphVertices),
+            call_guard<gil_scoped_release>(),
             arg("threadCount") = 0)
         .def("accessMarkerGraphVertexRepeatCounts",
             &Assembler::accessMarkerGraphVertexRepeatCounts)
         .def("computeMarkerGraphVerticesCoverageData",
-            &Assembler::computeMarkerGraphVerticesCoverageData,
+            stage("computeMarkerGraphVerticesCoverageData", &Assembler::computeMarkerGraphVerticesCoverageData),
+            call_guard<gil_scoped_release>(),
             arg("threadCount") = 0)
         .def("assembleMarkerGraphEdges",
-            &Assembler::assembleMarkerGraphEdges,
+            stage("assembleMarkerGraphEdges", &Assembler::assembleMarkerGraphEdges),
+            call_guard<gil_scoped_release>(),
             arg("threadCount") = 0,
             arg("markerGraphEdgeLengthThresholdForConsensus"),
             arg("useMarginPhase"),
-            arg("storeCoverageData"))
+            arg("storeCoverageData"),
+            arg("starAlignmentLengthThreshold") = 0,
+            arg("useGpuConsensus") = false)
         .def("accessMarkerGraphEdgeConsensus",
             &Assembler::accessMarkerGraphEdgeConsensus)
+        .def("benchmarkStarAlignment",
+            &Assembler::benchmarkStarAlignment,
+            arg("markerGraphEdgeLengthThresholdForConsensus") = 1000,
+            arg("starAlignmentLengthThreshold") = 8,
+            arg("maxEdgeCount") = 1000000)
         .def("accessMarkerGraphCoverageData",
             &Assembler::accessMarkerGraphCoverageData)
+        .def("compressMarkerGraphCoverageData",
+            stage("compressMarkerGraphCoverageData", &Assembler::compressMarkerGraphCoverageData),
+            call_guard<gil_scoped_release>(),
+            arg("threadCount") = 0)
 
         // Assembly graph.
         .def("createAssemblyGraphEdges",
-            &Assembler::createAssemblyGraphEdges)
+            stage("createAssemblyGraphEdges", &Assembler::createAssemblyGraphEdges),
+            call_guard<gil_scoped_release>(),
+            arg("threadCount") = 0)
         .def("createAssemblyGraphVertices",
-            &Assembler::createAssemblyGraphVertices)
+            stage("createAssemblyGraphVertices", &Assembler::createAssemblyGraphVertices),
+            call_guard<gil_scoped_release>())
         .def("accessAssemblyGraphEdgeLists",
             &Assembler::accessAssemblyGraphEdgeLists)
         .def("accessAssemblyGraphEdges",
@@ -366,20 +924,38 @@ PYBIND11_MODULE(shasta, module)
         .def("accessAssemblyGraphVertices",
             &Assembler::accessAssemblyGraphVertices)
         .def("writeAssemblyGraph",
+            (
+                void (Assembler::*)
+                (const string&) const
+            )
             &Assembler::writeAssemblyGraph)
         .def("assemble",
-            &Assembler::assemble,
+            stage("assemble", &Assembler::assemble),
+            call_guard<gil_scoped_release>(),
             arg("threadCount") = 0)
         .def("accessAssemblyGraphSequences",
             &Assembler::accessAssemblyGraphSequences)
+        .def("assembleAndWrite",
+            stage("assembleAndWrite", &Assembler::assembleAndWrite),
+            call_guard<gil_scoped_release>(),
+            arg("fastaFileName"),
+            arg("gfaFileName"),
+            arg("storeSequences") = true,
+            arg("threadCount") = 0)
         .def("computeAssemblyStatistics",
-            &Assembler::computeAssemblyStatistics)
+            stage("computeAssemblyStatistics", &Assembler::computeAssemblyStatistics),
+            call_guard<gil_scoped_release>(),
+            arg("threadCount") = 0)
         .def("writeGfa1",
-            &Assembler::writeGfa1,
-            arg("fileName"))
+            stage("writeGfa1", &Assembler::writeGfa1),
+            call_guard<gil_scoped_release>(),
+            arg("fileName"),
+            arg("threadCount") = 0)
         .def("writeFasta",
-            &Assembler::writeFasta,
-            arg("fileName"))
+            stage("writeFasta", &Assembler::writeFasta),
+            call_guard<gil_scoped_release>(),
+            arg("fileName"),
+            arg("threadCount") = 0)
         .def("assembleAssemblyGraphEdge",
             (
                 AssembledSegment (Assembler::*)
@@ -403,29 +979,131 @@ PYBIND11_MODULE(shasta, module)
 
         // Http server.
         .def("accessAllSoft",
-           &Assembler::accessAllSoft)
+           &Assembler::accessAllSoft,
+           arg("verbose") = true)
+        .def("startLiveServer",
+           &Assembler::startLiveServer,
+           arg("port") = 17100,
+           arg("localOnly") = false,
+           arg("threadCount") = 1,
+           arg("consensusCaller") = "SimpleConsensusCaller")
+        .def("accessAllLazy",
+           &Assembler::accessAllLazy,
+           arg("prefetch") = true,
+           arg("threadCount") = 0)
         .def("explore",
             &Assembler::explore,
+            call_guard<gil_scoped_release>(),
             arg("port") = 17100,
-            arg("localOnly") = false)
+            arg("localOnly") = false,
+            arg("threadCount") = 1)
         .def("setDocsDirectory",
             &Assembler::setDocsDirectory)
         .def("setReferenceFastaFileName",
             &Assembler::setReferenceFastaFileName)
+        .def("createReferenceIndex",
+            &Assembler::createReferenceIndex,
+            arg("fastaFileName") = "reference.fa",
+            arg("m") = 3)
+        .def("accessReferenceIndex",
+            &Assembler::accessReferenceIndex)
+        .def("setHttpResponseCacheSize",
+            &Assembler::setHttpResponseCacheSize,
+            arg("maxByteCount"))
+        .def("clearHttpResponseCache",
+            &Assembler::clearHttpResponseCache)
 
         // Consensus caller.
         .def("setupConsensusCaller",
             &Assembler::setupConsensusCaller)
+        .def("benchmarkSimpleBayesianConsensusCaller",
+            &Assembler::benchmarkSimpleBayesianConsensusCaller,
+            arg("maxCoverageCount") = 1000000)
 
         // MarginPhase parameters.
         .def("setupMarginPhase",
             &Assembler::setupMarginPhase)
 
+        // Read-only NumPy views of the data, without copies.
+        .def("getReadLengthsArray",
+            [](object self)
+            {
+                return makeArray(self.cast<const Assembler&>().getReads().getBaseCounts(),
+                    pybind11::dtype::of<uint64_t>(), self);
+            },
+            "Return a read-only NumPy array with the number of bases of each read "
+            "in the run-length representation.")
+        .def("getMarkersArrays",
+            [](object self)
+            {
+                return makeArrays(self.cast<const Assembler&>().getMarkers(),
+                    compressedMarkerDtype(), self);
+            },
+            "Return read-only NumPy arrays (toc, markers). "
+            "The markers of oriented read i are markers[toc[i]:toc[i+1]], "
+            "where i = 2*readId + strand.")
+        .def("getAlignmentDataArray",
+            [](object self)
+            {
+                return makeArray(self.cast<const Assembler&>().getAlignmentData(),
+                    alignmentDataDtype(), self);
+            },
+            "Return a read-only NumPy array with the stored alignments.")
+        .def("getMarkerGraphEdgesArray",
+            [](object self)
+            {
+                return makeArray(self.cast<const Assembler&>().getMarkerGraph().edges,
+                    markerGraphEdgeDtype(), self);
+            },
+            "Return a read-only NumPy array with the marker graph edges and their coverage.")
+        .def("getMarkerGraphEdgeMarkerIntervalsArrays",
+            [](object self)
+            {
+                return makeArrays(self.cast<const Assembler&>().getMarkerGraph().edgeMarkerIntervals,
+                    markerIntervalDtype(), self);
+            },
+            "Return read-only NumPy arrays (toc, markerIntervals). "
+            "The marker intervals of marker graph edge i are "
+            "markerIntervals[toc[i]:toc[i+1]].")
+        .def("getAssemblyGraphEdgesArray",
+            [](object self)
+            {
+                return makeArray(self.cast<const Assembler&>().getAssemblyGraph().edges,
+                    assemblyGraphEdgeDtype(), self);
+            },
+            "Return a read-only NumPy array with the assembly graph edges.")
+
         // Definition of class_<Assembler> ends here.
     ;
 
 
 
+    // Expose class MultiRunHttpServer to Python.
+    class_<MultiRunHttpServer>(module, "MultiRunHttpServer")
+        .def(pybind11::init<uint64_t, uint64_t, uint64_t>(),
+            arg("maxMappedBytes"),
+            arg("idleSeconds") = 3600,
+            arg("checkSeconds") = 10)
+        .def("addRun",
+            &MultiRunHttpServer::addRun,
+            arg("name"),
+            arg("largeDataFileNamePrefix"),
+            arg("consensusCaller") = "SimpleConsensusCaller",
+            arg("prefetch") = true)
+        .def("setDocsDirectory",
+            &MultiRunHttpServer::setDocsDirectory)
+        .def("closeIdleRuns",
+            &MultiRunHttpServer::closeIdleRuns)
+        .def("explore",
+            &MultiRunHttpServer::explore,
+            call_guard<gil_scoped_release>(),
+            arg("port") = 17100,
+            arg("localOnly") = false,
+            arg("threadCount") = 0)
+        ;
+
+
+
     // Expose class AssembledSegment to Python.
     class_<AssembledSegment>(module, "AssembledSegment")
         .def("size", &AssembledSegment::size)
@@ -469,6 +1147,24 @@ PYBIND11_MODULE(shasta, module)
     module.def("testLongBaseSequence",
         testLongBaseSequence
         );
+    module.def("testKmerIterator",
+        testKmerIterator
+        );
+    module.def("testComputeFeatureHashes",
+        testComputeFeatureHashes
+        );
+    module.def("testDecodeBases",
+        testDecodeBases
+        );
+    module.def("testAccumulateCoverage",
+        testAccumulateCoverage
+        );
+    module.def("testAccumulateLogLikelihoods",
+        testAccumulateLogLikelihoods
+        );
+    module.def("testStarAlignment",
+        testStarAlignment
+        );
     module.def("testSplitRange",
         testSplitRange
         );
@@ -498,9 +1194,48 @@ PYBIND11_MODULE(shasta, module)
         arg("batchSize"),
         arg("seed")
         );
+    module.def("dset64Benchmark",
+        dset64Benchmark,
+        arg("n"),
+        arg("m"),
+        arg("threadCount"),
+        arg("unionBufferSize") = 4000000,
+        arg("seed") = 231,
+        arg("checkResults") = true
+        );
+    module.def("benchmarkMarkerFinder",
+        benchmarkMarkerFinder,
+        arg("readCount"),
+        arg("readLength"),
+        arg("k") = 10,
+        arg("markerDensity") = 0.1,
+        arg("threadCount") = 0,
+        arg("seed") = 231
+        );
+    module.def("benchmarkVectorOfVectors",
+        benchmarkVectorOfVectors,
+        arg("n"),
+        arg("averageSize"),
+        arg("threadCount") = 0,
+        arg("seed") = 231
+        );
     module.def("mappedCopy",
         mappedCopy
         );
+    module.def("copyFile",
+        copyFile,
+        call_guard<gil_scoped_release>(),
+        arg("inputPath"),
+        arg("outputPath"),
+        arg("threadCount") = 0
+        );
+    module.def("copyDirectory",
+        copyDirectory,
+        call_guard<gil_scoped_release>(),
+        arg("inputDirectory"),
+        arg("outputDirectory"),
+        arg("threadCount") = 0
+        );
 
 }
 
@@ -0,0 +1,115 @@
+// shasta.
+#include "ReadFlagBitplanes.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+
+
+void ReadFlagBitplanes::resize(uint64_t readCount)
+{
+    n = readCount;
+    wordCount = (n + 63) / 64;
+    data.assign(flagCount * wordCount, 0);
+}
+
+
+
+void ReadFlagBitplanes::createFromReadFlags(const MemoryMapped::Vector<ReadFlags>& readFlags)
+{
+    resize(readFlags.size());
+    for(ReadId readId=0; readId<ReadId(n); readId++) {
+        const ReadFlags& flags = readFlags[readId];
+        const uint64_t i = readId >> 6;
+        const uint64_t bit = uint64_t(1) << (readId & 63);
+        for(uint64_t flag=0; flag<flagCount; flag++) {
+            if(getReadFlag(flags, Flag(flag))) {
+                plane(Flag(flag))[i] |= bit;
+            }
+        }
+    }
+}
+
+
+
+void ReadFlagBitplanes::storeToReadFlags(
+    Flag flag,
+    MemoryMapped::Vector<ReadFlags>& readFlags) const
+{
+    CZI_ASSERT(readFlags.size() == n);
+    for(ReadId readId=0; readId<ReadId(n); readId++) {
+        setReadFlag(readFlags[readId], flag, get(flag, readId));
+    }
+}
+
+
+
+void ReadFlagBitplanes::clearAll(Flag flag)
+{
+    fill(plane(flag), plane(flag) + wordCount, 0);
+}
+
+
+
+uint64_t ReadFlagBitplanes::count(Flag flag) const
+{
+    uint64_t c = 0;
+    for(uint64_t i=0; i<wordCount; i++) {
+        c += uint64_t(__builtin_popcountll(plane(flag)[i]));
+    }
+    return c;
+}
+
+
+
+void ReadFlagBitplanes::getAnyMask(uint64_t flagMask, vector<uint64_t>& mask) const
+{
+    mask.resize(wordCount);
+    for(uint64_t i=0; i<wordCount; i++) {
+        mask[i] = getAnyWord(flagMask, i);
+    }
+}
+
+
+
+bool ReadFlagBitplanes::getReadFlag(const ReadFlags& flags, Flag flag)
+{
+    switch(flag) {
+    case isPalindromic:
+        return flags.isPalindromic;
+    case isChimeric:
+        return flags.isChimeric;
+    case isInSmallComponent:
+        return flags.isInSmallComponent;
+    case strand:
+        return flags.strand;
+    case isExcluded:
+        return flags.isExcluded;
+    default:
+        CZI_ASSERT(0);
+    }
+}
+
+
+
+void ReadFlagBitplanes::setReadFlag(ReadFlags& flags, Flag flag, bool value)
+{
+    switch(flag) {
+    case isPalindromic:
+        flags.isPalindromic = value;
+        break;
+    case isChimeric:
+        flags.isChimeric = value;
+        break;
+    case isInSmallComponent:
+        flags.isInSmallComponent = value;
+        break;
+    case strand:
+        flags.strand = value;
+        break;
+    case isExcluded:
+        flags.isExcluded = value;
+        break;
+    default:
+        CZI_ASSERT(0);
+    }
+}
@@ -0,0 +1,176 @@
+#ifndef CZI_SHASTA_READ_FLAG_BITPLANES_HPP
+#define CZI_SHASTA_READ_FLAG_BITPLANES_HPP
+
+/*******************************************************************************
+
+Class ReadFlagBitplanes stores the same flags as ReadFlags,
+but with one bit plane (a bitset indexed by ReadId) for each flag,
+instead of one byte per read containing all flags.
+
+This has two uses:
+
+- Concurrent flag updates. Bits are set and cleared using atomic
+  operations on 64-bit words, so threads can update flags of any read,
+  including reads processed by other threads, without data races.
+  With ReadFlags, the bit fields of neighbouring reads share cache lines,
+  and updating them from multiple threads is only safe because
+  each thread only writes flags of its own reads.
+  Code that computes a flag in parallel updates the bit plane
+  and at the end stores it in the persistent ReadFlags
+  using storeToReadFlags.
+
+- Bulk tests. getAnyMask returns a bitset with the union of a set
+  of flags, which uses one bit per read instead of one byte.
+  Loops over reads can use nextUnset to skip over reads
+  with any of these flags set, testing 64 reads at a time.
+
+This is not persistent. It is created from the persistent ReadFlags
+when needed.
+
+*******************************************************************************/
+
+// shasta.
+#include "CZI_ASSERT.hpp"
+#include "MemoryMappedVector.hpp"
+#include "ReadFlags.hpp"
+#include "ReadId.hpp"
+
+// Standard library.
+#include "algorithm.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class ReadFlagBitplanes;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::ReadFlagBitplanes {
+public:
+
+    // The flags, in the same order as the bit fields of ReadFlags.
+    enum Flag {
+        isPalindromic,
+        isChimeric,
+        isInSmallComponent,
+        strand,
+        isExcluded,
+        flagCount
+    };
+
+    // The bit corresponding to a flag in the flag masks
+    // used by getAnyWord and getAnyMask.
+    static uint64_t flagBit(Flag flag)
+    {
+        return uint64_t(1) << flag;
+    }
+
+    // Resize for the given number of reads, with all flags cleared.
+    void resize(uint64_t readCount);
+
+    // Create from the persistent ReadFlags.
+    void createFromReadFlags(const MemoryMapped::Vector<ReadFlags>&);
+
+    // Store one flag in the persistent ReadFlags.
+    void storeToReadFlags(Flag, MemoryMapped::Vector<ReadFlags>&) const;
+
+    uint64_t readCount() const
+    {
+        return n;
+    }
+
+    bool get(Flag flag, ReadId readId) const
+    {
+        return (plane(flag)[readId >> 6] >> (readId & 63)) & 1;
+    }
+
+    // Set or clear a flag. These are atomic and can be called
+    // concurrently by multiple threads for any reads.
+    void set(Flag flag, ReadId readId)
+    {
+        __sync_fetch_and_or(plane(flag) + (readId >> 6), uint64_t(1) << (readId & 63));
+    }
+    void clear(Flag flag, ReadId readId)
+    {
+        __sync_fetch_and_and(plane(flag) + (readId >> 6), ~(uint64_t(1) << (readId & 63)));
+    }
+    void set(Flag flag, ReadId readId, bool value)
+    {
+        if(value) {
+            set(flag, readId);
+        } else {
+            clear(flag, readId);
+        }
+    }
+
+    // Clear a flag for all reads. Not thread safe.
+    void clearAll(Flag);
+
+    // The number of reads for which a flag is set.
+    uint64_t count(Flag) const;
+
+    // Return word i of the union of the flags in flagMask
+    // (an OR of flagBit values). Bit j of word i corresponds to ReadId 64*i+j.
+    uint64_t getAnyWord(uint64_t flagMask, uint64_t i) const
+    {
+        uint64_t word = 0;
+        for(uint64_t flag=0; flag<flagCount; flag++) {
+            if(flagMask & (uint64_t(1) << flag)) {
+                word |= plane(Flag(flag))[i];
+            }
+        }
+        return word;
+    }
+
+    // Return a bitset with the union of the flags in flagMask.
+    void getAnyMask(uint64_t flagMask, vector<uint64_t>& mask) const;
+
+    // Functions to test a mask returned by getAnyMask.
+    static bool isSet(const vector<uint64_t>& mask, ReadId readId)
+    {
+        return (mask[readId >> 6] >> (readId & 63)) & 1;
+    }
+
+    // Return the first ReadId in [readId, end) for which the mask
+    // is not set, or end if there is none.
+    // This examines 64 reads at a time.
+    static ReadId nextUnset(const vector<uint64_t>& mask, ReadId readId, ReadId end)
+    {
+        while(readId < end) {
+            const uint64_t word = (~mask[readId >> 6]) >> (readId & 63);
+            if(word) {
+                return min(end, ReadId(readId + ReadId(__builtin_ctzll(word))));
+            }
+            readId = (readId | 63) + 1;
+        }
+        return end;
+    }
+
+private:
+
+    // The number of reads.
+    uint64_t n = 0;
+
+    // The number of 64-bit words in each plane.
+    uint64_t wordCount = 0;
+
+    // The bit planes, one after the other.
+    vector<uint64_t> data;
+
+    uint64_t* plane(Flag flag)
+    {
+        return data.data() + flag * wordCount;
+    }
+    const uint64_t* plane(Flag flag) const
+    {
+        return data.data() + flag * wordCount;
+    }
+
+    // Access a flag in ReadFlags.
+    static bool getReadFlag(const ReadFlags&, Flag);
+    static void setReadFlag(ReadFlags&, Flag, bool);
+};
+
+#endif
@@ -31,8 +31,12 @@ public:
     // Not valid if isPalindromic, isChimeric or isInSmallComponent is set.
     uint8_t strand : 1;
 
+    // Set if the read was excluded by Assembler::subsampleReads.
+    // Excluded reads get no markers, so they don't participate
+    // in alignments and in the marker graph.
+    uint8_t isExcluded : 1;
+
     // Unused bits.
-    uint8_t bit4 : 1;
     uint8_t bit5 : 1;
     uint8_t bit6 : 1;
     uint8_t bit7 : 1;
@@ -13,6 +13,38 @@ using namespace shasta;
 const uint32_t ReadGraph::infiniteDistance = std::numeric_limits<uint32_t>::max();
 
 
+
+void ReadGraph::createNeighbors(const string& name, size_t pageSize)
+{
+    // The edge id must fit in 31 bits.
+    CZI_ASSERT(edges.size() < (uint64_t(1) << 31));
+
+    neighbors.createNew(name, pageSize);
+    for(OrientedReadId::Int v0=0; v0<connectivity.size(); v0++) {
+        const OrientedReadId orientedReadId0(v0);
+        neighbors.appendVector();
+        for(const uint32_t edgeId: connectivity[v0]) {
+            const Edge& edge = edges[edgeId];
+            Neighbor neighbor;
+            neighbor.orientedReadId = edge.getOther(orientedReadId0);
+            neighbor.edgeId = edgeId & 0x7fff'ffff;
+            neighbor.crossesStrands = edge.crossesStrands;
+            neighbors.append(neighbor);
+        }
+    }
+}
+
+
+
+void ReadGraph::updateNeighbors()
+{
+    CZI_ASSERT(neighbors.size() == connectivity.size());
+    for(Neighbor& neighbor: neighbors) {
+        neighbor.crossesStrands = edges[neighbor.edgeId].crossesStrands;
+    }
+}
+
+
 void RawReadGraph::Visitor::examine_edge(edge_descriptor e, const RawReadGraph& constGraph)
 {
     RawReadGraph& graph = const_cast<RawReadGraph&>(constGraph);
@@ -131,18 +163,17 @@ void ReadGraph::computeShortPath(
 
         // Loop over adjacent vertices.
         bool pathFound = false;
-        for(const uint32_t edgeId: connectivity[vertex0.getValue()]) {
-            const Edge& edge = edges[edgeId];
-            if(edge.crossesStrands) {
+        for(const Neighbor& neighbor: neighbors[vertex0.getValue()]) {
+            if(neighbor.crossesStrands) {
                 continue;
             }
-            const OrientedReadId vertex1 = edge.getOther(vertex0);
+            const OrientedReadId vertex1 = neighbor.orientedReadId;
 
             // If we did not encounter this vertex before, process it.
             if(distance[vertex1.getValue()] == infiniteDistance) {
                 distance[vertex1.getValue()] = distance1;
                 reachedVertices.push_back(vertex1);
-                parentEdges[vertex1.getValue()] = edgeId;
+                parentEdges[vertex1.getValue()] = neighbor.edgeId;
                 if(distance1 < maxDistance) {
                     if(debug) {
                         cout << "Enqueued " << vertex1 << endl;
@@ -180,3 +211,91 @@ void ReadGraph::computeShortPath(
     }
     reachedVertices.clear();
 }
+
+
+
+// Because the read graph is invariant under reverse complementing,
+// the distance between u and v is the same as the distance
+// between their reverse complements u' and v'.
+// So, if there is a path of length L from v to v' and u is
+// the vertex at distance floor(L/2) from v along that path,
+// the distance from v to u' is the distance from v' to u,
+// which is ceil(L/2). That is, there is a vertex u within
+// distance ceil(L/2) of v such that u' is also within distance ceil(L/2) of v,
+// and the sum of the two distances is L.
+// Conversely, d(v, u) + d(v, u') = d(v, u) + d(u, v') >= d(v, v').
+// So, to check whether d(v, v') <= maxDistance, it is sufficient
+// to do a BFS from v up to distance ceil(maxDistance/2)
+// and look for a vertex u such that u' is also reached
+// and d(v, u) + d(v, u') <= maxDistance.
+// The BFS visits far fewer vertices than a BFS up to maxDistance
+// using computeShortPath.
+bool ReadGraph::isNearReverseComplement(
+    OrientedReadId orientedReadId0,
+    size_t maxDistance,
+    vector<uint32_t>& distance,
+    vector<OrientedReadId>& reachedVertices)
+{
+    const uint32_t halfMaxDistance = uint32_t((maxDistance + 1) / 2);
+
+    // Initialize the BFS.
+    std::queue<OrientedReadId> queuedVertices;
+    if(halfMaxDistance > 0) {
+        queuedVertices.push(orientedReadId0);
+    }
+    distance[orientedReadId0.getValue()] = 0;
+    reachedVertices.clear();
+    reachedVertices.push_back(orientedReadId0);
+
+
+
+    // Do the BFS.
+    // Each vertex is checked when it is reached. If it and its reverse complement
+    // satisfy the condition, it is found when the second one of the two is reached.
+    bool found = false;
+    while(!queuedVertices.empty() && !found) {
+
+        // Dequeue a vertex.
+        const OrientedReadId vertex0 = queuedVertices.front();
+        queuedVertices.pop();
+        const uint32_t distance0 = distance[vertex0.getValue()];
+        const uint32_t distance1 = distance0 + 1;
+
+        // Loop over adjacent vertices.
+        for(const Neighbor& neighbor: neighbors[vertex0.getValue()]) {
+            if(neighbor.crossesStrands) {
+                continue;
+            }
+            const OrientedReadId vertex1 = neighbor.orientedReadId;
+
+            // If we encountered this vertex before, skip it.
+            if(distance[vertex1.getValue()] != infiniteDistance) {
+                continue;
+            }
+            distance[vertex1.getValue()] = distance1;
+            reachedVertices.push_back(vertex1);
+            if(distance1 < halfMaxDistance) {
+                queuedVertices.push(vertex1);
+            }
+
+            // Check its reverse complement.
+            OrientedReadId vertex1ReverseComplement = vertex1;
+            vertex1ReverseComplement.flipStrand();
+            const uint32_t distance2 = distance[vertex1ReverseComplement.getValue()];
+            if(distance2 != infiniteDistance && distance1 + distance2 <= maxDistance) {
+                found = true;
+                break;
+            }
+        }
+    }
+
+
+
+    // Clean up.
+    for(const OrientedReadId orientedReadId: reachedVertices) {
+        distance[orientedReadId.getValue()] = infiniteDistance;
+    }
+    reachedVertices.clear();
+
+    return found;
+}
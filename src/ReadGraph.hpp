@@ -90,6 +90,29 @@ public:
     // of the edges that this OrientedReadId is involved in.
     MemoryMapped::VectorOfVectors<uint32_t, uint32_t> connectivity;
 
+    // Compact adjacency (CSR) representation of the read graph,
+    // used by code that visits many neighbors, like BFSs.
+    // For each OrientedReadId, it stores the same edges as connectivity,
+    // in the same order, but each slot contains the other OrientedReadId
+    // and the crossesStrands flag, so visiting a neighbor
+    // does not require looking up the edge.
+    // Each slot consists of two 32-bit words.
+    class Neighbor {
+    public:
+        OrientedReadId orientedReadId;
+        uint32_t edgeId : 31;
+        uint32_t crossesStrands : 1;
+    };
+    static_assert(sizeof(Neighbor) == 8, "Unexpected size of ReadGraph::Neighbor.");
+    MemoryMapped::VectorOfVectors<Neighbor, uint64_t> neighbors;
+
+    // Create the neighbors from edges and connectivity.
+    void createNeighbors(const string& name, size_t pageSize);
+
+    // Copy the crossesStrands flags of the edges to the neighbors.
+    // This must be called after changing the crossesStrands flags.
+    void updateNeighbors();
+
     // Compute a shortest path, disregarding edges flagged as cross-strand edges.
     void computeShortPath(
         OrientedReadId orientedReadId0,
@@ -106,6 +129,23 @@ public:
         vector<uint32_t>& parentEdges  // One per vertex
 
         );
+
+    // Return true if there is a path of length up to maxDistance
+    // between an oriented read and its reverse complement,
+    // disregarding edges flagged as cross-strand edges.
+    // This gives the same answer as computeShortPath
+    // but only does a BFS up to half of maxDistance.
+    // It requires the read graph to be invariant under reverse complementing
+    // (including the crossesStrands flags).
+    bool isNearReverseComplement(
+        OrientedReadId,
+        size_t maxDistance,
+
+        // Work areas.
+        vector<uint32_t>& distance, // One per vertex, equals infiniteDistance before and after.
+        vector<OrientedReadId>& reachedVertices   // For which distance is not infiniteDistance.
+        );
+
     static const uint32_t infiniteDistance;
 };
 
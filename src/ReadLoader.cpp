@@ -1,37 +1,51 @@
 // shasta.
 #include "ReadLoader.hpp"
 #include "computeRunLengthRepresentation.hpp"
+#include "decodeBases.hpp"
 #include "splitRange.hpp"
 #include "timestamp.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
 // Standard library.
+#include "array.hpp"
+#include <cstring>
+#include <limits>
 #include "tuple.hpp"
 
 
 
-// Load reads from a fastq or fasta file.
+// Load reads from a fasta or fastq file, optionally compressed with gzip or bgzip.
 ReadLoader::ReadLoader(
     const string& fileName,
     size_t minReadLength,
     size_t blockSize,
     size_t threadCountForReadingArgument,
     size_t threadCountForProcessingArgument,
-    const string& dataNamePrefix,
-    size_t pageSize,
+    bool doubleBuffering,
     LongBaseSequences& reads,
     MemoryMapped::VectorOfVectors<char, uint64_t>& readNames,
-    MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts) :
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts,
+    ostream& out) :
 
     MultithreadedObject(*this),
+    out(out),
     minReadLength(minReadLength),
     blockSize(blockSize),
+    doubleBuffering(doubleBuffering),
     threadCountForReading(threadCountForReadingArgument),
-    threadCountForProcessing(threadCountForProcessingArgument)
+    threadCountForProcessing(threadCountForProcessingArgument),
+    reads(reads),
+    readNames(readNames),
+    readRepeatCounts(readRepeatCounts)
 {
-    cout << timestamp << "Loading reads from " << fileName << "." << endl;
-    cout << "Input file block size: " << blockSize << " bytes." << endl;
+    // Writes to out are done while holding the mutex, because
+    // the read thread also writes to it when double buffering is enabled.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << timestamp << "Loading reads from " << fileName << "." << endl;
+        out << "Input file block size: " << blockSize << " bytes." << endl;
+    }
     const auto tBegin = std::chrono::steady_clock::now();
 
     // Adjust the numbers of threads, if necessary.
@@ -41,132 +55,284 @@ ReadLoader::ReadLoader(
     if(threadCountForProcessing == 0) {
         threadCountForProcessing = std::thread::hardware_concurrency();
     }
-    cout << "Using " << threadCountForReading << " threads for reading and ";
-    cout << threadCountForProcessing << " threads for processing." << endl;
 
     // Allocate space to keep a block of the file.
     buffer.reserve(blockSize);
-
-    // Open the input file.
-    fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
-    if(fileDescriptor == -1) {
-        throw runtime_error("Error opening " + fileName + " for read.");
+    if(doubleBuffering) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "Double buffering is enabled: reading and processing will overlap." << endl;
     }
 
-    // Find the size of the input file.
-    getFileSize();
-    cout << "Input file size is " << fileSize << " bytes." << endl;
+    // Open the input file, URL, or stream, and find its size.
+    openInput(fileName);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(inputKind == InputKind::stream) {
+            out << "Input is a stream of unknown size." << endl;
+        } else {
+            out << "Input file size is " << fileSize << " bytes." << endl;
+        }
+
+        if(inputKind == InputKind::url) {
+            out << "Using " << urlReader->getConnectionCount() << " parallel range requests for reading and ";
+        } else if(inputKind == InputKind::stream) {
+            out << "Reading the stream sequentially and using ";
+        } else if(asynchronousReader.isAvailable()) {
+            out << "Using io_uring with " << asynchronousReader.getQueueDepth() <<
+                " reads of " << asynchronousReader.getRequestSize() <<
+                " bytes in flight for reading and ";
+        } else {
+            out << "io_uring is not available (" << asynchronousReader.getUnavailableReason() << ").\n";
+            out << "Using " << threadCountForReading << " threads for reading and ";
+        }
+        out << threadCountForProcessing << " threads for processing." << endl;
+    }
 
     // Allocate space for the data structures where
-    // each thread stores the reads it found and their names.
-    threadReadNames.resize(threadCountForProcessing);
-    threadReads.resize(threadCountForProcessing);
-    threadReadRepeatCounts.resize(threadCountForProcessing);
-    for(size_t threadId=0; threadId<threadCountForProcessing; threadId++) {
-        threadReadNames[threadId] = make_shared< MemoryMapped::VectorOfVectors<char, uint64_t> >();
-        threadReadNames[threadId]->createNew(
-            threadDataName(dataNamePrefix, threadId, "ReadNames"), pageSize);
-        threadReads[threadId] = make_shared<LongBaseSequences>();
-        threadReads[threadId]->createNew(
-            threadDataName(dataNamePrefix, threadId, "Reads"), pageSize);
-        threadReadRepeatCounts[threadId] = make_shared< MemoryMapped::VectorOfVectors<uint8_t, uint64_t> >();
-        threadReadRepeatCounts[threadId]->createNew(
-            threadDataName(dataNamePrefix, threadId, "ReadRepeatCounts"), pageSize);
+    // each thread stores the locations of the reads it found.
+    threadReadLocations.resize(threadCountForProcessing);
+
+
+    // Find out if the input file is compressed.
+    detectCompression();
+    if(compression == Compression::gzip) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "Input file is gzip compressed." << endl;
+    } else if(compression == Compression::bgzip) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "Input file is bgzip compressed." << endl;
     }
 
 
     // Main loop over blocks in the input file.
-    for(blockBegin=0; blockBegin<fileSize; ) {
+    // If double buffering is enabled, the next block is read
+    // by a separate thread while the current block is being processed.
+    // Otherwise, reading and processing alternate.
+    double readTime = 0.;       // Total time spent reading (and decompressing) blocks.
+    double readWaitTime = 0.;   // The portion of readTime not overlapped with processing.
+    double processTime = 0.;    // Total time spent processing blocks and storing reads.
+    blockBegin = 0;
+    readBlockTimed();
+    readTime += lastBlockReadTime;
+    readWaitTime += lastBlockReadTime;
+    while(true) {
+
+        // The block we just read becomes the block to be processed.
+        processingBuffer.swap(buffer);
+        const bool processingFinalBlock = isFinalBlock;
+
+        // If double buffering, start reading the next block.
+        // If processing this block throws, the guard waits for the read thread
+        // before the exception propagates, because destroying
+        // a joinable std::thread would terminate the program.
+        std::thread readThread;
+        struct ReadThreadGuard {
+            std::thread& thread;
+            ~ReadThreadGuard()
+            {
+                if(thread.joinable()) {
+                    thread.join();
+                }
+            }
+        } readThreadGuard = {readThread};
+        if(doubleBuffering && !processingFinalBlock) {
+            readThread = std::thread(&ReadLoader::readNextBlockThreadFunction, this);
+        }
 
-        // Read this block.
-        blockEnd = min(blockBegin+blockSize, fileSize);
-        cout << timestamp << "Reading " << fileName << " block " << blockBegin << " " << blockEnd << ", " << blockEnd-blockBegin << " bytes." << endl;
-        const auto t0 = std::chrono::steady_clock::now();
-        readBlock(threadCountForReading);
-        const auto t1 = std::chrono::steady_clock::now();
-        const double t01 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)).count());
-        cout << "Block read in " << t01 << " s at " << double(blockEnd-blockBegin)/t01 << " bytes/s." << endl;
-        // cout << leftOver.size() << " characters in this block will be processed with the next block." << endl;
-
-        // Process this block in parallel.
+        // Process this block in parallel, in two passes.
         // This does not use load balancing. Each thread is assigned a predetermined
         // portion of this block. This way, we store the reads in the same
         // order as they appear in the input file.
-        cout << "Processing " << buffer.size() << " input characters." << endl;
+        // In pass 1, each thread locates the reads that begin in its portion
+        // of the block and computes their run-length representation,
+        // but only stores their location and size.
+        // Then we make space for all these reads in the final data structures,
+        // and in pass 2 each thread stores its reads directly in their final location.
+        // This avoids copying the reads through per-thread storage,
+        // at the cost of computing the run-length representation twice.
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            out << "Processing " << processingBuffer.size() << " input characters." << endl;
+        }
         const auto t2 = std::chrono::steady_clock::now();
-        runThreads(&ReadLoader::processThreadFunction, threadCountForProcessing);
+        if(!processingBuffer.empty()) {
+            runThreads(&ReadLoader::processThreadFunction, threadCountForProcessing);
+        }
         const auto t3 = std::chrono::steady_clock::now();
         const double t23 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2)).count());
-        cout << "Block processed in " << t23 << " s." << endl;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            out << "Block processed in " << t23 << " s." << endl;
+        }
 
-        // Permanently store the reads found by each thread.
-        // We could speed this up by just making space in single threaded code,
-        // then copying the data in multi threaded code.
-        // cout << timestamp << "Storing reads for this block." << endl;
+        // Make space for the reads found by each thread,
+        // then store them in parallel.
         const auto t4 = std::chrono::steady_clock::now();
+        threadFirstReadId.resize(threadCountForProcessing);
         for(size_t threadId=0; threadId<threadCountForProcessing; threadId++) {
-            MemoryMapped::VectorOfVectors<char, uint64_t>& thisThreadReadNames = *(threadReadNames[threadId]);
-            LongBaseSequences& thisThreadReads = *(threadReads[threadId]);
-            const size_t n = thisThreadReadNames.size();
-            CZI_ASSERT(thisThreadReads.size() == n);
-            MemoryMapped::VectorOfVectors<uint8_t, uint64_t>* thisThreadReadRepeatCounts = 0;
-            thisThreadReadRepeatCounts = threadReadRepeatCounts[threadId].get();
-            CZI_ASSERT(thisThreadReadRepeatCounts->size() == n);
-            for(size_t i=0; i<n; i++) {
-                readNames.appendVector(thisThreadReadNames.begin(i), thisThreadReadNames.end(i));
-                reads.append(thisThreadReads[i]);
-                const size_t j = readRepeatCounts.size();
-                readRepeatCounts.appendVector(thisThreadReadRepeatCounts->size(i));
-                copy(
-                    thisThreadReadRepeatCounts->begin(i),
-                    thisThreadReadRepeatCounts->end(i),
-                    readRepeatCounts.begin(j));
+            threadFirstReadId[threadId] = reads.size();
+            for(const ReadLocation& readLocation: threadReadLocations[threadId]) {
+                reads.append(readLocation.runLengthBaseCount);
+                readNames.appendVector(readLocation.nameEnd - readLocation.nameBegin);
+                readRepeatCounts.appendVector(readLocation.runLengthBaseCount);
             }
-            thisThreadReadNames.clear();
-            thisThreadReads.clear();
-            thisThreadReadRepeatCounts->clear();
+        }
+        if(!processingBuffer.empty()) {
+            runThreads(&ReadLoader::storeThreadFunction, threadCountForProcessing);
+        }
+        for(size_t threadId=0; threadId<threadCountForProcessing; threadId++) {
+            threadReadLocations[threadId].clear();
         }
         const auto t5 = std::chrono::steady_clock::now();
         const double t45 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t5 - t4)).count());
-        cout << "Reads for this block stored in " << t45 << " s." << endl;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            out << "Reads for this block stored in " << t45 << " s." << endl;
+        }
+        processTime += t23 + t45;
 
-        // Prepare to process the next block.
-        blockBegin = blockEnd;
-    }
-    cout << timestamp << "Done processing fasta file." << endl;
+        if(processingFinalBlock) {
+            break;
+        }
 
+        // Get the next block.
+        if(doubleBuffering) {
+
+            // Wait for the read thread to finish.
+            // The time spent waiting is the portion of the read time
+            // that could not be overlapped with processing.
+            const auto t6 = std::chrono::steady_clock::now();
+            readThread.join();
+            const auto t7 = std::chrono::steady_clock::now();
+            const double t67 = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t7 - t6)).count());
+            if(readException) {
+                std::rethrow_exception(readException);
+            }
+            readTime += lastBlockReadTime;
+            readWaitTime += t67;
+            std::lock_guard<std::mutex> lock(mutex);
+            out << "Waited " << t67 << " s for the next block to be read." << endl;
+
+        } else {
+
+            // Without double buffering, we reuse the same buffer.
+            processingBuffer.swap(buffer);
+            blockBegin = blockEnd;
+            readBlockTimed();
+            readTime += lastBlockReadTime;
+            readWaitTime += lastBlockReadTime;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << timestamp << "Done processing input file." << endl;
+    }
 
-    // Close the input file.
-    ::close(fileDescriptor);
 
-    // Remove the temporary data used for thread storage.
-    for(size_t threadId=0; threadId<threadCountForProcessing; threadId++) {
-        threadReadNames[threadId]->remove();
-        threadReads[threadId]->remove();
-        threadReadRepeatCounts[threadId]->remove();
+    // Close the input file. Standard input is left open.
+    if(fileDescriptor > 0) {
+        ::close(fileDescriptor);
+    }
+    if(gzipStreamIsInitialized) {
+        inflateEnd(&gzipStream);
+        gzipStreamIsInitialized = false;
     }
+
     const auto tEnd = std::chrono::steady_clock::now();
     const double tTotal = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tBegin)).count());
-    cout << "Processed " << fileSize << " bytes in " << tTotal;
-    cout << "s, " << double(fileSize)/tTotal << " bytes/s." << endl;
-    cout << timestamp << "Done loading reads." << endl;
+
+    // The end of the final block is the number of input bytes consumed.
+    // Unlike fileSize, this is also known for streams.
+    const size_t byteCount = blockEnd;
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "Processed " << byteCount << " bytes in " << tTotal;
+    out << "s, " << double(byteCount)/tTotal << " bytes/s." << endl;
+    out << "Time spent reading blocks: " << readTime << " s, of which " <<
+        readTime - readWaitTime << " s overlapped with processing." << endl;
+    out << "Time spent processing blocks: " << processTime << " s." << endl;
+    if(readWaitTime > processTime) {
+        out << "Loading was I/O bound." << endl;
+    } else {
+        out << "Loading was processing bound." << endl;
+    }
+    out << timestamp << "Done loading reads." << endl;
+}
+
+
+
+// Read a block starting at blockBegin and write a message
+// with timing information. This also stores the elapsed time
+// in lastBlockReadTime.
+void ReadLoader::readBlockTimed()
+{
+    const auto t0 = std::chrono::steady_clock::now();
+    readBlock(doubleBuffering ? 1 : threadCountForReading);
+    const auto t1 = std::chrono::steady_clock::now();
+    lastBlockReadTime = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)).count());
+    std::lock_guard<std::mutex> lock(mutex);
+    out << timestamp << "Read block " << blockBegin << " " << blockEnd << ", " << blockEnd-blockBegin <<
+        " bytes, in " << lastBlockReadTime << " s at " << double(blockEnd-blockBegin)/lastBlockReadTime << " bytes/s." << endl;
+    // out << leftOver.size() << " characters in this block will be processed with the next block." << endl;
+}
+
+
+
+// Function run by the thread that reads the next block
+// when double buffering is enabled.
+// It takes care of catching exceptions, which are later
+// rethrown by the main thread.
+void ReadLoader::readNextBlockThreadFunction()
+{
+    readException = nullptr;
+    try {
+        blockBegin = blockEnd;
+        readBlockTimed();
+    } catch(...) {
+        readException = std::current_exception();
+    }
 }
 
 
 
-// Create the name to be used for a MemoryMapped
-// object to be used by a thread.
-std::string ReadLoader::threadDataName(
-    const string& dataNamePrefix,
-    size_t threadId,
-    const string& dataName)
+// Open the input and find its size.
+// Names that begin with a URL scheme are read using UrlReader.
+// "-" is standard input. Anything that is not a regular file
+// (for example, a named pipe) is read as a stream.
+void ReadLoader::openInput(const string& fileName)
 {
-    if(dataNamePrefix.empty()) {
-        return "";
+    if(UrlReader::isUrl(fileName)) {
+        inputKind = InputKind::url;
+        urlReader = make_shared<UrlReader>(fileName,
+            (threadCountForReading > 1) ? threadCountForReading : 16);
+        fileSize = urlReader->size();
+        return;
+    }
+
+    if(fileName == "-") {
+        fileDescriptor = 0;
     } else {
-        return dataNamePrefix + "tmp-ReadLoader-" + dataName + "-" + to_string(threadId);
+        fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+        if(fileDescriptor == -1) {
+            throw runtime_error("Error opening " + fileName + " for read.");
+        }
+    }
+
+    struct stat fileInformation;
+    if(::fstat(fileDescriptor, &fileInformation)) {
+        throw runtime_error("Error from fstat.");
+    }
+    if(!S_ISREG(fileInformation.st_mode)) {
+        inputKind = InputKind::stream;
+        fileSize = std::numeric_limits<size_t>::max();
+        return;
     }
 
+    // The input file is read sequentially and only once.
+    // This is only a hint, so errors are ignored.
+#ifdef __linux__
+    ::posix_fadvise(fileDescriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    getFileSize();
 }
 
 
@@ -187,37 +353,70 @@ void ReadLoader::getFileSize()
 // Read one block into the above buffer.
 // This copies the leftOver data to buffer, then
 // reads into the rest of the buffer the portion of the input file
-// at offset in [blockBegin, blockEnd).
+// at offset in [blockBegin, blockEnd), decompressing it if necessary.
 // It finally moves to the leftOver data the
 // final, possibly partial, read in the buffer
 // (this is not done for the final block).
 void ReadLoader::readBlock(size_t threadCount)
 {
-    // Prepare the buffer for this block and
-    // copy the leftOver data to the buffer.
-    buffer.resize(leftOver.size() + (blockEnd - blockBegin));
-    copy(leftOver.begin(), leftOver.end(), buffer.begin());
+    if(compression == Compression::gzip) {
+        readBlockGzip();
+    } else if(compression == Compression::bgzip) {
+        readBlockBgzip(threadCount);
+    } else {
 
+        // Prepare the buffer for this block and
+        // copy the leftOver data to the buffer.
+        blockEnd = min(blockBegin+blockSize, fileSize);
+        buffer.resize(leftOver.size() + (blockEnd - blockBegin));
+        copy(leftOver.begin(), leftOver.end(), buffer.begin());
+
+        // Parallel reads are only useful for a file without io_uring.
+        // UrlReader does its own parallel requests.
+        if(threadCount <= 1 || inputKind != InputKind::file || asynchronousReader.isAvailable()) {
+            readBlockSequential();
+        } else {
+            readBlockParallel(threadCount);
+        }
+        isFinalBlock = (blockEnd == fileSize);
+    }
 
-    if(threadCount <= 1) {
-        readBlockSequential();
-    } else {
-        readBlockParallel(threadCount);
+    if(buffer.empty()) {
+        if(isFinalBlock) {
+            return;
+        } else {
+            throw runtime_error("Unexpected empty block in input file.");
+        }
     }
 
-    if(buffer.front() != '>') {
-        throw runtime_error("Expected '>' at beginning of a block.");
+    // The first block determines whether this is a fasta or fastq file.
+    if(blockBegin == 0) {
+        if(buffer.front() == '>') {
+            isFastq = false;
+        } else if(buffer.front() == '@') {
+            isFastq = true;
+            std::lock_guard<std::mutex> lock(mutex);
+            out << "Input file is in fastq format." << endl;
+        } else {
+            throw runtime_error("Input file is not in fasta or fastq format.");
+        }
+    }
+    if(buffer.front() != (isFastq ? '@' : '>')) {
+        throw runtime_error(isFastq ?
+            "Expected '@' at beginning of a block." :
+            "Expected '>' at beginning of a block.");
     }
 
-    if(blockEnd != fileSize) {
+    if(!isFinalBlock) {
         // Go back to the beginning of the last read in the buffer.
         size_t bufferIndex=buffer.size()-1;
         for(; bufferIndex>0; bufferIndex--) {
-            if(readBeginsHere(bufferIndex)) {
+            if(readBeginsHere(buffer, bufferIndex)) {
                 break;
             }
         }
-        CZI_ASSERT(buffer[bufferIndex]=='>' && (bufferIndex==0 || buffer[bufferIndex-1]=='\n'));
+        CZI_ASSERT(buffer[bufferIndex]==(isFastq ? '@' : '>') &&
+            (bufferIndex==0 || buffer[bufferIndex-1]=='\n'));
 
         // Throw away what follows, store it as leftover.
         leftOver.clear();
@@ -231,18 +430,95 @@ void ReadLoader::readBlock(size_t threadCount)
 
 void ReadLoader::readBlockSequential()
 {
+    const size_t byteCount = readFully(buffer.data() + leftOver.size(), blockEnd - blockBegin, blockBegin);
+
+    // At the end of a stream, fewer bytes are read.
+    if(byteCount < blockEnd - blockBegin) {
+        blockEnd = blockBegin + byteCount;
+        buffer.resize(leftOver.size() + byteCount);
+    }
+}
+
+
+
+// Read from the input file, at the given offset,
+// exactly the specified number of bytes.
+// For a stream, fewer bytes are read at the end of the stream.
+// Returns the number of bytes read.
+size_t ReadLoader::readFully(char* bufferPointer, size_t bytesToRead, size_t offset)
+{
+    if(inputKind == InputKind::url) {
+        urlReader->read(bufferPointer, bytesToRead, offset);
+        return bytesToRead;
+    }
+    if(inputKind == InputKind::stream) {
+        return readFromStream(bufferPointer, bytesToRead, offset);
+    }
 
-    size_t bytesToRead = blockEnd - blockBegin;
-    char* bufferPointer = buffer.data() + leftOver.size();
+    if(asynchronousReader.isAvailable() && bytesToRead >= asynchronousReader.getRequestSize()) {
+        asynchronousReader.read(fileDescriptor, bufferPointer, bytesToRead, offset);
+        return bytesToRead;
+    }
+
+    const size_t totalByteCount = bytesToRead;
     while(bytesToRead) {
-        const ssize_t byteCount = ::read(fileDescriptor, bufferPointer, bytesToRead);
+        const ssize_t byteCount = ::pread(fileDescriptor, bufferPointer, bytesToRead, offset);
         if(byteCount <= 0) {
             throw runtime_error("Error during read.");
         }
         bytesToRead -= byteCount;
         bufferPointer += byteCount;
+        offset += byteCount;
+    }
+    return totalByteCount;
+}
+
+
+
+// Read from a stream. The offset can be before the current
+// position in the stream only by the size of streamTail.
+size_t ReadLoader::readFromStream(char* bufferPointer, size_t bytesToRead, size_t offset)
+{
+    CZI_ASSERT(offset >= streamTailBegin && offset <= streamPosition);
+    char* const begin = bufferPointer;
+
+    // Get what we can from the bytes already read.
+    const size_t tailByteCount = min(bytesToRead, streamPosition - offset);
+    copy(
+        streamTail.begin() + (offset - streamTailBegin),
+        streamTail.begin() + (offset - streamTailBegin + tailByteCount),
+        bufferPointer);
+    bufferPointer += tailByteCount;
+    bytesToRead -= tailByteCount;
+    if(bytesToRead == 0) {
+        return tailByteCount;
+    }
+
+    // Read the rest from the stream.
+    while(bytesToRead) {
+        const ssize_t byteCount = ::read(fileDescriptor, bufferPointer, bytesToRead);
+        if(byteCount < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Error during read: " + string(strerror(errno)));
+        }
+        if(byteCount == 0) {
+            // The end of the stream. Now we know its size.
+            fileSize = streamPosition;
+            break;
+        }
+        bytesToRead -= byteCount;
+        bufferPointer += byteCount;
+        streamPosition += byteCount;
     }
 
+    // Keep the last bytes read, which can be requested again.
+    const size_t totalByteCount = size_t(bufferPointer - begin);
+    const size_t keepCount = min(totalByteCount, streamTailSize);
+    streamTail.assign(bufferPointer - keepCount, bufferPointer);
+    streamTailBegin = streamPosition - keepCount;
+    return totalByteCount;
 }
 
 
@@ -254,8 +530,14 @@ void ReadLoader::readBlockParallel(size_t threadCount)
 
 
 
+// Pass 1 of the processing of a block.
+// Locate the reads that begin in the slice of the block
+// assigned to this thread and store their location and
+// run-length size in threadReadLocations[threadId].
 void ReadLoader::processThreadFunction(size_t threadId)
 {
+    // The block being processed.
+    const vector<char>& buffer = processingBuffer;
 
     // Get the slice of the buffer assigned to this thread.
     size_t sliceBegin, sliceEnd;
@@ -265,7 +547,7 @@ void ReadLoader::processThreadFunction(size_t threadId)
     // Locate the first read that begins in the slice assigned to this thread.
     // We only process reads that begin in this slice.
     size_t bufferIndex = sliceBegin;
-    while(bufferIndex<sliceEnd && !readBeginsHere(bufferIndex)) {
+    while(bufferIndex<sliceEnd && !readBeginsHere(buffer, bufferIndex)) {
         ++bufferIndex;
     }
     if(threadId == 0) {
@@ -275,29 +557,29 @@ void ReadLoader::processThreadFunction(size_t threadId)
         return;
     }
 
-    // Access the data structures that this thread will use to store reads
-    // and read names.
-    MemoryMapped::VectorOfVectors<char, uint64_t>& thisThreadReadNames = *(threadReadNames[threadId]);
-    LongBaseSequences& thisThreadReads = *(threadReads[threadId]);
-    MemoryMapped::VectorOfVectors<uint8_t, uint64_t>* thisThreadReadRepeatCounts = 0;
-    thisThreadReadRepeatCounts = threadReadRepeatCounts[threadId].get();
+    // Access the vector where this thread stores the locations
+    // of the reads it finds.
+    vector<ReadLocation>& readLocations = threadReadLocations[threadId];
 
     // Main loop over the buffer slice assigned to this thread.
-    string readName;
+    ReadLocation readLocation;
     vector<Base> read;
     vector<Base> runLengthRead;
     vector<uint8_t> readRepeatCount;
     while(bufferIndex < sliceEnd) {
 
-        // Skip the '>' that introduces the new read.
-        if(buffer[bufferIndex++] != '>')
+        // Skip the '>' or '@' that introduces the new read.
+        if(buffer[bufferIndex++] != (isFastq ? '@' : '>'))
         {
-            throw runtime_error("The sequence of each read must be on a "
+            throw runtime_error(isFastq ?
+                "Each read must be on exactly four lines of the input fastq file." :
+                "The sequence of each read must be on a "
                 "single line of the input fasta file.");
         }
 
-        // Extract the read name and discard the rest of the line.
-        readName.clear();
+        // Locate the read name and discard the rest of the line.
+        readLocation.nameBegin = bufferIndex;
+        readLocation.nameEnd = bufferIndex;
         bool blankFound = false;
         while(bufferIndex < buffer.size()) {
             const char c = buffer[bufferIndex++];
@@ -308,20 +590,27 @@ void ReadLoader::processThreadFunction(size_t threadId)
                 blankFound = true;
             }
             if(!blankFound) {
-                readName.push_back(c);
+                readLocation.nameEnd = bufferIndex;
             }
         }
-        // cout << readName << endl;
 
 
         // Read the base characters.
-        read.clear();
-        while(bufferIndex < buffer.size()) {
-            const char c = buffer[bufferIndex++];
-            if(c == '\n') {
-                break;
+        readLocation.sequenceBegin = bufferIndex;
+        bufferIndex = getReadBases(buffer, bufferIndex, read);
+
+        // For fastq, skip the '+' line and the quality line.
+        if(isFastq) {
+            if(bufferIndex == buffer.size() || buffer[bufferIndex] != '+') {
+                throw runtime_error("Each read must be on exactly four lines of the input fastq file.");
+            }
+            for(int line=0; line<2; line++) {
+                while(bufferIndex < buffer.size()) {
+                    if(buffer[bufferIndex++] == '\n') {
+                        break;
+                    }
+                }
             }
-            read.push_back(Base::fromCharacter(c));
         }
 
         // If the read is too short, skip it.
@@ -329,17 +618,93 @@ void ReadLoader::processThreadFunction(size_t threadId)
             continue;
         }
 
-        // Store the read bases.
+        // Compute the run-length representation and keep track of this read.
         if(computeRunLengthRead(read, runLengthRead, readRepeatCount)) {
-            thisThreadReadNames.appendVector(readName.begin(), readName.end());
-            thisThreadReads.append(runLengthRead);
-            thisThreadReadRepeatCounts->appendVector(readRepeatCount);
+            readLocation.runLengthBaseCount = runLengthRead.size();
+            readLocations.push_back(readLocation);
         }
     }
 }
 
 
 
+// Pass 2 of the processing of a block.
+// Store the reads found by this thread during pass 1
+// directly in their final location.
+// The space for them was already allocated.
+void ReadLoader::storeThreadFunction(size_t threadId)
+{
+    const vector<char>& buffer = processingBuffer;
+    const vector<ReadLocation>& readLocations = threadReadLocations[threadId];
+
+    vector<Base> read;
+    vector<Base> runLengthRead;
+    vector<uint8_t> readRepeatCount;
+    uint64_t readId = threadFirstReadId[threadId];
+    for(const ReadLocation& readLocation: readLocations) {
+
+        // Store the name.
+        copy(
+            buffer.begin() + readLocation.nameBegin,
+            buffer.begin() + readLocation.nameEnd,
+            readNames.begin(readId));
+
+        // Compute the run-length representation again.
+        getReadBases(buffer, readLocation.sequenceBegin, read);
+        const bool success = computeRunLengthRead(read, runLengthRead, readRepeatCount);
+        CZI_ASSERT(success);
+        CZI_ASSERT(runLengthRead.size() == readLocation.runLengthBaseCount);
+
+        // Store the run-length bases.
+        LongBaseSequenceView storedRead = reads[readId];
+        CZI_ASSERT(storedRead.baseCount == runLengthRead.size());
+        fill(
+            storedRead.begin,
+            storedRead.begin + LongBaseSequenceView::wordCount(storedRead.baseCount),
+            0ULL);
+        for(size_t i=0; i<runLengthRead.size(); i++) {
+            storedRead.set(i, runLengthRead[i]);
+        }
+
+        // Store the repeat counts.
+        copy(readRepeatCount.begin(), readRepeatCount.end(), readRepeatCounts.begin(readId));
+
+        ++readId;
+    }
+}
+
+
+
+// Extract the bases of a read, beginning at the given
+// position in the buffer and ending at the end of the line.
+// Returns the buffer position following the end of the line.
+size_t ReadLoader::getReadBases(
+    const vector<char>& buffer,
+    size_t bufferIndex,
+    vector<Base>& read)
+{
+    read.clear();
+    if(bufferIndex >= buffer.size()) {
+        return bufferIndex;
+    }
+
+    // Find the end of the line (memchr is vectorized),
+    // then convert the characters in bulk.
+    const char* begin = buffer.data() + bufferIndex;
+    const char* bufferEnd = buffer.data() + buffer.size();
+    const char* end = static_cast<const char*>(
+        std::memchr(begin, '\n', size_t(bufferEnd - begin)));
+    if(end == 0) {
+        end = bufferEnd;
+    }
+    decodeBases(begin, end, read);
+
+    // Skip the newline, if present.
+    return size_t(end - buffer.data()) + ((end == bufferEnd) ? 0 : 1);
+}
+
+
+
 void ReadLoader::readThreadFunction(size_t threadId)
 {
     // Get the slice of the block assigned to this thread.
@@ -347,32 +712,321 @@ void ReadLoader::readThreadFunction(size_t threadId)
     tie(sliceBegin, sliceEnd) = splitRange(blockBegin, blockEnd, threadCountForReading, threadId);
 
     // Read all the data in the slice.
-    size_t bytesToRead = sliceEnd - sliceBegin;
-    char* bufferPointer = buffer.data() + leftOver.size() + sliceBegin;
-    size_t offset = sliceBegin;
-    while(bytesToRead) {
-        const ssize_t byteCount = ::pread(fileDescriptor, bufferPointer, bytesToRead, offset);
-        if(byteCount <= 0) {
-            throw runtime_error("Error during read.");
+    readFully(
+        buffer.data() + leftOver.size() + (sliceBegin - blockBegin),
+        sliceEnd - sliceBegin,
+        sliceBegin);
+}
+
+
+
+// Look at the first bytes of the input file to decide whether
+// it is compressed using gzip or bgzip.
+void ReadLoader::detectCompression()
+{
+    compression = Compression::none;
+    array<char, 18> header;
+    if(fileSize < header.size()) {
+        return;
+    }
+    if(readFully(header.data(), header.size(), 0) < header.size()) {
+        return;
+    }
+    if(uint8_t(header[0]) != 0x1f || uint8_t(header[1]) != 0x8b) {
+        return;
+    }
+    size_t bgzipBlockSize;
+    if(isBgzipBlockHeader(header.data(), header.size(), bgzipBlockSize)) {
+        compression = Compression::bgzip;
+    } else {
+        compression = Compression::gzip;
+    }
+}
+
+
+
+// Return true if the given bytes are the beginning of a BGZF block,
+// and if so also return the total size of the block.
+// A BGZF block is a gzip member with an extra field
+// containing a "BC" subfield that stores the block size minus one.
+// See section 4.1 of https://samtools.github.io/hts-specs/SAMv1.pdf.
+bool ReadLoader::isBgzipBlockHeader(
+    const char* p,
+    size_t availableBytes,
+    size_t& blockSize)
+{
+    if(availableBytes < 18) {
+        return false;
+    }
+    const uint8_t* q = reinterpret_cast<const uint8_t*>(p);
+    if(q[0]!=0x1f || q[1]!=0x8b || q[2]!=8 || (q[3]&4)==0) {
+        return false;
+    }
+    const size_t extraLength = size_t(q[10]) + (size_t(q[11]) << 8);
+    if(availableBytes < 12 + extraLength) {
+        return false;
+    }
+
+    // Look for the BC subfield.
+    for(size_t i=12; i+4<=12+extraLength; ) {
+        const size_t subfieldLength = size_t(q[i+2]) + (size_t(q[i+3]) << 8);
+        if(q[i]=='B' && q[i+1]=='C' && subfieldLength==2 && i+6<=12+extraLength) {
+            blockSize = 1 + size_t(q[i+4]) + (size_t(q[i+5]) << 8);
+            return true;
         }
-        bytesToRead -= byteCount;
-        bufferPointer += byteCount;
-        offset += byteCount;
+        i += 4 + subfieldLength;
+    }
+    return false;
+}
+
+
+
+// Read a block of a gzip compressed file.
+// The decompression is sequential, and stops when
+// the uncompressed block reaches blockSize or at the end of the input file.
+void ReadLoader::readBlockGzip()
+{
+    if(!gzipStreamIsInitialized) {
+        gzipStream.zalloc = Z_NULL;
+        gzipStream.zfree = Z_NULL;
+        gzipStream.opaque = Z_NULL;
+        gzipStream.next_in = Z_NULL;
+        gzipStream.avail_in = 0;
+        // 15 + 16: maximum window size, gzip format.
+        if(inflateInit2(&gzipStream, 15 + 16) != Z_OK) {
+            throw runtime_error("Error initializing gzip decompression.");
+        }
+        gzipStreamIsInitialized = true;
+        gzipInputBuffer.resize(gzipInputBufferSize);
+        gzipNextOffset = 0;
+    }
+
+    // Prepare the buffer for this block and
+    // copy the leftOver data to the buffer.
+    buffer.resize(leftOver.size() + blockSize);
+    copy(leftOver.begin(), leftOver.end(), buffer.begin());
+    size_t uncompressedSize = leftOver.size();
+
+    isFinalBlock = false;
+    while(uncompressedSize < buffer.size()) {
+
+        // If necessary, get some more input.
+        if(gzipStream.avail_in == 0) {
+            if(!readGzipInput()) {
+                throw runtime_error("Unexpected end of gzip compressed input file.");
+            }
+        }
+
+        // Decompress as much as possible.
+        // avail_out is a 32-bit value, so we limit it to 1 GB.
+        const size_t availableOutput = min(buffer.size() - uncompressedSize, size_t(1) << 30);
+        gzipStream.next_out = reinterpret_cast<Bytef*>(buffer.data() + uncompressedSize);
+        gzipStream.avail_out = uInt(availableOutput);
+        const int returnCode = inflate(&gzipStream, Z_NO_FLUSH);
+        uncompressedSize += availableOutput - gzipStream.avail_out;
+
+        if(returnCode == Z_STREAM_END) {
+            if(gzipStream.avail_in == 0 && !readGzipInput()) {
+                isFinalBlock = true;
+                break;
+            }
+            // Another gzip member follows.
+            if(inflateReset(&gzipStream) != Z_OK) {
+                throw runtime_error("Error during gzip decompression.");
+            }
+        } else if(returnCode != Z_OK) {
+            throw runtime_error("Error " + to_string(returnCode) +
+                " during gzip decompression.");
+        }
+    }
+    buffer.resize(uncompressedSize);
+    blockEnd = gzipNextOffset - gzipStream.avail_in;
+}
+
+
+
+// Read more compressed input into gzipInputBuffer.
+// Returns false if the end of the input file was reached.
+bool ReadLoader::readGzipInput()
+{
+    if(gzipNextOffset == fileSize) {
+        return false;
+    }
+    const size_t byteCount = readFully(
+        gzipInputBuffer.data(),
+        min(gzipInputBufferSize, fileSize - gzipNextOffset),
+        gzipNextOffset);
+    gzipNextOffset += byteCount;
+    gzipStream.next_in = reinterpret_cast<Bytef*>(gzipInputBuffer.data());
+    gzipStream.avail_in = uInt(byteCount);
+    return byteCount > 0;
+}
+
+
+
+// Read a block of a bgzip compressed file.
+// We read a portion of the compressed file, locate
+// the BGZF blocks that it contains, and decompress them
+// in parallel.
+void ReadLoader::readBlockBgzip(size_t threadCount)
+{
+    // The compressed portion we read is smaller than blockSize
+    // to account for compression. This only affects the
+    // size of the block being processed.
+    const size_t compressedChunkSize = max(blockSize / 4, 2 * bgzipMaxBlockSize);
+    const size_t compressedEnd = min(blockBegin + compressedChunkSize, fileSize);
+    bgzipInputBuffer.resize(compressedEnd - blockBegin);
+    bgzipInputBuffer.resize(readFully(bgzipInputBuffer.data(), bgzipInputBuffer.size(), blockBegin));
+
+    // Locate the complete BGZF blocks in what we just read.
+    bgzipBlocks.clear();
+    size_t compressedOffset = 0;
+    size_t uncompressedOffset = leftOver.size();
+    while(compressedOffset < bgzipInputBuffer.size()) {
+        const char* p = bgzipInputBuffer.data() + compressedOffset;
+        const size_t availableBytes = bgzipInputBuffer.size() - compressedOffset;
+        size_t compressedSize;
+        if(!isBgzipBlockHeader(p, availableBytes, compressedSize)) {
+            if(availableBytes >= bgzipMaxBlockSize) {
+                throw runtime_error("Invalid BGZF block in bgzip compressed input file at offset " +
+                    to_string(blockBegin + compressedOffset));
+            }
+            break;
+        }
+        if(compressedSize > availableBytes) {
+            // This block is incomplete. Leave it for the next block.
+            break;
+        }
+
+        // The uncompressed size is stored in the last 4 bytes of the block.
+        const uint8_t* q = reinterpret_cast<const uint8_t*>(p + compressedSize - 4);
+        const size_t uncompressedSize =
+            size_t(q[0]) + (size_t(q[1]) << 8) + (size_t(q[2]) << 16) + (size_t(q[3]) << 24);
+
+        BgzipBlock block;
+        block.compressedBegin = compressedOffset;
+        block.compressedSize = compressedSize;
+        block.uncompressedBegin = uncompressedOffset;
+        block.uncompressedSize = uncompressedSize;
+        bgzipBlocks.push_back(block);
+        compressedOffset += compressedSize;
+        uncompressedOffset += uncompressedSize;
+    }
+    if(bgzipBlocks.empty()) {
+
+        // A stream can end exactly at the end of the previous block.
+        if(bgzipInputBuffer.empty() && blockBegin == fileSize) {
+            blockEnd = blockBegin;
+            isFinalBlock = true;
+            buffer = leftOver;
+            return;
+        }
+        throw runtime_error("Truncated bgzip compressed input file.");
+    }
+    blockEnd = blockBegin + compressedOffset;
+    isFinalBlock = (blockEnd == fileSize);
+
+    // Prepare the buffer for this block and
+    // copy the leftOver data to the buffer.
+    buffer.resize(uncompressedOffset);
+    copy(leftOver.begin(), leftOver.end(), buffer.begin());
+
+    // Decompress the BGZF blocks, in parallel if requested.
+    // With a single thread this does not use load balancing,
+    // because with double buffering this runs in the read thread
+    // while the main thread uses the thread pool to process the previous block.
+    if(threadCount <= 1) {
+        decompressBgzipBlocks(0, bgzipBlocks.size());
+    } else {
+        const size_t batchSize = 16;
+        setupLoadBalancing(bgzipBlocks.size(), batchSize);
+        runThreads(&ReadLoader::decompressBgzipThreadFunction, threadCount);
+    }
+}
+
+
+
+void ReadLoader::decompressBgzipThreadFunction(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        decompressBgzipBlocks(begin, end);
+    }
+}
+
+
+
+// Decompress the BGZF blocks in [begin, end) into the buffer.
+void ReadLoader::decompressBgzipBlocks(uint64_t begin, uint64_t end)
+{
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    stream.next_in = Z_NULL;
+    stream.avail_in = 0;
+    if(inflateInit2(&stream, 15 + 16) != Z_OK) {
+        throw runtime_error("Error initializing bgzip decompression.");
     }
+
+    for(uint64_t i=begin; i!=end; i++) {
+        const BgzipBlock& block = bgzipBlocks[i];
+        if(inflateReset(&stream) != Z_OK) {
+            inflateEnd(&stream);
+            throw runtime_error("Error during bgzip decompression.");
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(bgzipInputBuffer.data() + block.compressedBegin);
+        stream.avail_in = uInt(block.compressedSize);
+        stream.next_out = reinterpret_cast<Bytef*>(buffer.data() + block.uncompressedBegin);
+        stream.avail_out = uInt(block.uncompressedSize);
+        const int returnCode = inflate(&stream, Z_FINISH);
+        if(returnCode != Z_STREAM_END || stream.avail_out != 0) {
+            inflateEnd(&stream);
+            throw runtime_error("Error " + to_string(returnCode) +
+                " during bgzip decompression.");
+        }
+    }
+    inflateEnd(&stream);
 }
 
 
 
 // Return true if a read begins at this position in the buffer.
-bool ReadLoader::readBeginsHere(size_t bufferIndex) const
+// For fastq, a read begins at a line starting with '@'
+// if the line two lines below starts with '+'.
+// This is needed because a quality line can also begin with '@'.
+bool ReadLoader::readBeginsHere(
+    const vector<char>& buffer,
+    size_t bufferIndex) const
 {
     const char c = buffer[bufferIndex];
-    if(bufferIndex == 0) {
-        CZI_ASSERT(c == '>');
-        return true;
-    } else {
-        return c=='>' && buffer[bufferIndex-1]=='\n';
+    if(!isFastq) {
+        if(bufferIndex == 0) {
+            CZI_ASSERT(c == '>');
+            return true;
+        } else {
+            return c=='>' && buffer[bufferIndex-1]=='\n';
+        }
+    }
+
+    if(c != '@') {
+        return false;
+    }
+    if(bufferIndex > 0 && buffer[bufferIndex-1] != '\n') {
+        return false;
+    }
+
+    // Skip the header line and the sequence line.
+    for(int line=0; line<2; line++) {
+        while(bufferIndex<buffer.size() && buffer[bufferIndex]!='\n') {
+            ++bufferIndex;
+        }
+        if(bufferIndex == buffer.size()) {
+            return false;
+        }
+        ++bufferIndex;
     }
+    return bufferIndex<buffer.size() && buffer[bufferIndex]=='+';
 }
 
 
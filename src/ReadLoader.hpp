@@ -2,11 +2,18 @@
 #define CZI_SHASTA_READ_LOADER_HPP
 
 // shasta
+#include "AsynchronousReader.hpp"
 #include "LongBaseSequence.hpp"
 #include "MemoryMappedObject.hpp"
 #include "MultitreadedObject.hpp"
+#include "UrlReader.hpp"
+
+// zlib, used to read gzip and bgzip compressed input.
+#include <zlib.h>
 
 // Standard library.
+#include <exception>
+#include "iostream.hpp"
 #include "memory.hpp"
 #include "string.hpp"
 
@@ -18,7 +25,17 @@ namespace ChanZuckerberg {
 
 
 
-// Class used to load reads from a fasta file.
+// Class used to load reads from a fasta or fastq file.
+// The input file can optionally be compressed using gzip or bgzip.
+// This is detected automatically from the file contents.
+// Bgzip compressed files are decompressed in parallel
+// by threadCountForReading threads.
+// The input file is read using io_uring if available
+// (see AsynchronousReader), or else with blocking reads.
+// The input can also be:
+// - A URL, read with parallel range requests (see UrlReader).
+// - "-" (standard input) or a named pipe, read sequentially
+//   as a stream of unknown size.
 class ChanZuckerberg::shasta::ReadLoader :
     public MultithreadedObject<ReadLoader>{
 public:
@@ -30,20 +47,67 @@ public:
         size_t blockSize,
         size_t threadCountForReading,
         size_t threadCountForProcessing,
-        const string& dataNamePrefix,
-        size_t pageSize,
+        bool doubleBuffering,
         LongBaseSequences& reads,
         MemoryMapped::VectorOfVectors<char, uint64_t>& readNames,
-        MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts);
+        MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts,
+        ostream& out = cout);
 private:
 
+    // The stream where messages are written.
+    // Assembler::addReadsFromFastaFiles uses a separate stream
+    // for each file being loaded concurrently.
+    ostream& out;
+
     // The file descriptor for the input file.
     int fileDescriptor = -1;
 
+    // The kind of input, determined from the file name.
+    enum class InputKind {
+        file,
+        stream,
+        url
+    };
+    InputKind inputKind = InputKind::file;
+    void openInput(const string& fileName);
+
     // The size, in bytes, of the input file.
+    // For a stream, this is the largest size_t
+    // until the end of the stream is reached.
     size_t fileSize;
     void getFileSize();
 
+    // For a URL, the UrlReader used for all reads.
+    shared_ptr<UrlReader> urlReader;
+
+    // For a stream, the offset of the next byte to be read,
+    // and the last bytes read, beginning at offset streamTailBegin.
+    // Reads must be at non-decreasing offsets, but they can
+    // request again the last bytes read. This happens for the header
+    // read by detectCompression, and for an incomplete BGZF block
+    // at the end of a compressed chunk.
+    size_t streamPosition = 0;
+    size_t streamTailBegin = 0;
+    vector<char> streamTail;
+    static const size_t streamTailSize = 128 * 1024;
+    size_t readFromStream(char* bufferPointer, size_t bytesToRead, size_t offset);
+
+    // The compression used for the input file,
+    // detected from its first bytes.
+    enum class Compression {
+        none,
+        gzip,
+        bgzip
+    };
+    Compression compression = Compression::none;
+    void detectCompression();
+
+    // The format of the input file, detected from the
+    // first character of the first block.
+    // Each read must be on a single line (fasta) or on
+    // exactly four lines (fastq).
+    bool isFastq = false;
+
     // The minimum read length. Shorter reads are not stored.
     size_t minReadLength;
 
@@ -51,12 +115,38 @@ private:
     size_t blockSize;
 
     // The begin/end offset of the block being read.
+    // For compressed files, these are offsets in the compressed file.
     size_t blockBegin;
     size_t blockEnd;
 
-    // Buffer to keep the the input file being processed.
+    // Set by readBlock when the block just read
+    // is the last one in the input file.
+    bool isFinalBlock;
+
+    // Buffer to keep the block of the input file being read.
     vector<char> buffer;
 
+    // Buffer to keep the block of the input file being processed.
+    // Without double buffering, buffer and processingBuffer
+    // are swapped back and forth, so only one of them uses
+    // memory at any given time.
+    vector<char> processingBuffer;
+
+    // If double buffering is enabled, the next block is read,
+    // into buffer, by a separate thread while the current block,
+    // in processingBuffer, is being processed.
+    // In this mode reading, including any necessary decompression,
+    // is done by that single thread, so threadCountForReading is not used.
+    bool doubleBuffering;
+    void readNextBlockThreadFunction();
+    std::exception_ptr readException;
+
+    // Read a block starting at blockBegin and write a message
+    // with timing information. This also stores the elapsed time
+    // in lastBlockReadTime.
+    void readBlockTimed();
+    double lastBlockReadTime = 0.;
+
     // Characters left over from the previous block.
     vector<char> leftOver;
 
@@ -67,26 +157,100 @@ private:
     // Read one block into the above buffer.
     // This copies the leftOver data to buffer, then
     // reads into the rest of the buffer the portion of the input file
-    // at offset in [blockBegin, blockEnd).
+    // at offset in [blockBegin, blockEnd), decompressing it if necessary.
     // It finally moves to the leftOver data the
     // final, possibly partial, read in the buffer
     // (this is not done for the final block).
     void readBlock(size_t threadCount);
     void readBlockSequential();
     void readBlockParallel(size_t threadCount);
+    void readBlockGzip();
+    void readBlockBgzip(size_t threadCount);
+
+    // Read from the input file, at the given offset,
+    // exactly the specified number of bytes.
+    // For a stream, fewer bytes are read at the end of the stream.
+    // Returns the number of bytes read.
+    // Large reads use the asynchronousReader, if available.
+    size_t readFully(char* bufferPointer, size_t bytesToRead, size_t offset);
+
+    // If io_uring is available, large reads keep a deep queue
+    // of requests in flight from a single thread.
+    // In that case threadCountForReading is not used.
+    AsynchronousReader asynchronousReader;
+
+    // State used to decompress gzip files.
+    // A gzip file can consist of more than one concatenated gzip member.
+    z_stream gzipStream;
+    bool gzipStreamIsInitialized = false;
+    vector<char> gzipInputBuffer;
+    size_t gzipNextOffset = 0;
+    static const size_t gzipInputBufferSize = 16 * 1024 * 1024;
+
+    // Read more compressed input into gzipInputBuffer.
+    // Returns false if the end of the input file was reached.
+    bool readGzipInput();
+
+    // Data used to decompress bgzip files.
+    // A bgzip file is a sequence of independent gzip members (BGZF blocks)
+    // of at most 64 KB each, and the compressed and uncompressed size
+    // of each of them is known from its header and trailer.
+    // This allows the blocks to be decompressed in parallel.
+    class BgzipBlock {
+    public:
+        size_t compressedBegin;     // In bgzipInputBuffer.
+        size_t compressedSize;
+        size_t uncompressedBegin;   // In buffer.
+        size_t uncompressedSize;
+    };
+    vector<BgzipBlock> bgzipBlocks;
+    vector<char> bgzipInputBuffer;
+    static const size_t bgzipMaxBlockSize = 64 * 1024;
+    static bool isBgzipBlockHeader(const char*, size_t availableBytes, size_t& blockSize);
 
     // Functions called by each thread.
     void readThreadFunction(size_t threadId);
     void processThreadFunction(size_t threadId);
+    void storeThreadFunction(size_t threadId);
+    void decompressBgzipThreadFunction(size_t threadId);
+    void decompressBgzipBlocks(uint64_t begin, uint64_t end);
 
     // Return true if a read begins at this position in the buffer.
-    bool readBeginsHere(size_t bufferIndex) const;
+    // For fastq, a read begins at a line starting with '@'
+    // if the line two lines below starts with '+'.
+    // This is needed because a quality line can also begin with '@'.
+    bool readBeginsHere(const vector<char>& buffer, size_t bufferIndex) const;
+
+    // The final data structures where the reads are stored.
+    LongBaseSequences& reads;
+    MemoryMapped::VectorOfVectors<char, uint64_t>& readNames;
+    MemoryMapped::VectorOfVectors<uint8_t, uint64_t>& readRepeatCounts;
 
-    // Vectors where each thread stores the reads it found.
+    // The location in processingBuffer of a read found during pass 1,
+    // and the number of bases in its run-length representation.
+    class ReadLocation {
+    public:
+        size_t nameBegin;
+        size_t nameEnd;
+        size_t sequenceBegin;
+        size_t runLengthBaseCount;
+    };
+
+    // The reads found by each thread during pass 1.
+    // Indexed by threadId.
+    vector< vector<ReadLocation> > threadReadLocations;
+
+    // The read id assigned to the first read found by each thread.
     // Indexed by threadId.
-    vector< shared_ptr<MemoryMapped::VectorOfVectors<char, uint64_t> > > threadReadNames;
-    vector< shared_ptr<LongBaseSequences> > threadReads;
-    vector< shared_ptr<MemoryMapped::VectorOfVectors<uint8_t, uint64_t> > > threadReadRepeatCounts;
+    vector<uint64_t> threadFirstReadId;
+
+    // Extract the bases of a read, beginning at the given
+    // position in the buffer and ending at the end of the line.
+    // Returns the buffer position following the end of the line.
+    static size_t getReadBases(
+        const vector<char>& buffer,
+        size_t bufferIndex,
+        vector<Base>&);
 
     // Given the raw representation of a read, compute its
     // run-length representation.
@@ -98,13 +262,6 @@ private:
         vector<Base>& runLengthRead,
         vector<uint8_t>& readRepeatCount);
 
-    // Create the name to be used for a MemoryMapped
-    // object to be used by a thread.
-    static string threadDataName(
-        const string& dataNamePrefix,
-        size_t threadId,
-        const string& dataName);
-
 };
 
 
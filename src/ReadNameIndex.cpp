@@ -0,0 +1,119 @@
+// shasta.
+#include "ReadNameIndex.hpp"
+#include "MurmurHash2.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "chrono.hpp"
+
+
+
+void ReadNameIndex::createNew(
+    const MemoryMapped::VectorOfVectors<char, uint64_t>& readNames,
+    const string& name,
+    size_t pageSize,
+    size_t threadCount)
+{
+    cout << timestamp << "Creating the read name index." << endl;
+    const auto tBegin = steady_clock::now();
+
+    // Adjust the numbers of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    createData.readNames = &readNames;
+
+    // Use a power of 2 number of slots, at least twice the number of reads.
+    const uint64_t readCount = readNames.size();
+    uint64_t slotCount = 16;
+    while(slotCount < 2 * readCount) {
+        slotCount *= 2;
+    }
+    table.createNew(name, pageSize);
+    table.resize(slotCount);
+    fill(table.begin(), table.end(), invalidReadId);
+
+    // Fill the table in parallel.
+    setupLoadBalancing(readCount, 10000);
+    runThreads(&ReadNameIndex::createThreadFunction, threadCount);
+
+    const auto tEnd = steady_clock::now();
+    cout << timestamp << "Creating the read name index for " << readCount <<
+        " reads completed in " << seconds(tEnd - tBegin) << " s." << endl;
+}
+
+
+
+void ReadNameIndex::createThreadFunction(size_t threadId)
+{
+    const MemoryMapped::VectorOfVectors<char, uint64_t>& readNames =
+        *createData.readNames;
+    const uint64_t mask = table.size() - 1;
+    ReadId* slots = table.begin();
+
+    // Loop over batches assigned to this thread.
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+
+        // Loop over reads of this batch.
+        for(ReadId readId=ReadId(begin); readId!=ReadId(end); readId++) {
+            uint64_t slot = hashName(readNames.begin(readId), readNames.end(readId)) & mask;
+
+            // Claim the first free slot, using linear probing.
+            while(!__sync_bool_compare_and_swap(slots + slot, invalidReadId, readId)) {
+                slot = (slot + 1) & mask;
+            }
+        }
+    }
+}
+
+
+
+ReadId ReadNameIndex::find(
+    const MemoryMapped::VectorOfVectors<char, uint64_t>& readNames,
+    const char* nameBegin,
+    const char* nameEnd) const
+{
+    CZI_ASSERT(table.isOpen);
+    const uint64_t mask = table.size() - 1;
+    const uint64_t nameLength = uint64_t(nameEnd - nameBegin);
+
+    // Scan the entire probe sequence so the result does not depend
+    // on the order in which reads with the same name were inserted.
+    ReadId foundReadId = invalidReadId;
+    for(uint64_t slot = hashName(nameBegin, nameEnd) & mask; ; slot = (slot + 1) & mask) {
+        const ReadId readId = table[slot];
+        if(readId == invalidReadId) {
+            return foundReadId;
+        }
+        if(readId < foundReadId &&
+            readNames.size(readId) == nameLength &&
+            std::equal(nameBegin, nameEnd, readNames.begin(readId))) {
+            foundReadId = readId;
+        }
+    }
+}
+
+
+
+void ReadNameIndex::accessExistingReadOnly(const string& name)
+{
+    table.accessExistingReadOnly(name);
+}
+
+
+
+void ReadNameIndex::remove()
+{
+    table.remove();
+}
+
+
+
+uint64_t ReadNameIndex::hashName(const char* nameBegin, const char* nameEnd)
+{
+    return MurmurHash64A(nameBegin, int(nameEnd - nameBegin), 1253);
+}
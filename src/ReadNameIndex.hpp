@@ -0,0 +1,96 @@
+#ifndef CZI_SHASTA_READ_NAME_INDEX_HPP
+#define CZI_SHASTA_READ_NAME_INDEX_HPP
+
+/*******************************************************************************
+
+Class ReadNameIndex is a persistent hash index that allows finding
+the ReadId of a read given its name, without scanning all read names.
+
+It is an open addressing hash table with linear probing,
+stored as a MemoryMapped::Vector<ReadId>. Each slot contains
+a ReadId or invalidReadId if empty. The number of slots is
+a power of 2 at least twice the number of reads, so the load
+factor is at most 0.5. The hash of a name is MurmurHash64A.
+
+Only ReadIds are stored. The names themselves remain in
+Assembler::readNames, which must be passed in for lookups.
+
+Read names are not required to be unique. If more than one read has
+the requested name, find returns the lowest ReadId with that name,
+independently of the order in which the table was filled.
+
+The table is filled in parallel, using an atomic compare and swap
+to claim each slot.
+
+*******************************************************************************/
+
+// shasta.
+#include "MemoryMappedVector.hpp"
+#include "MemoryMappedVectorOfVectors.hpp"
+#include "MultitreadedObject.hpp"
+#include "ReadId.hpp"
+
+// Standard library.
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class ReadNameIndex;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::ReadNameIndex :
+    public MultithreadedObject<ReadNameIndex> {
+public:
+
+    ReadNameIndex() : MultithreadedObject(*this) {}
+
+    static const ReadId invalidReadId = std::numeric_limits<ReadId>::max();
+
+    // Create the index for the given read names.
+    void createNew(
+        const MemoryMapped::VectorOfVectors<char, uint64_t>& readNames,
+        const string& name,
+        size_t pageSize,
+        size_t threadCount);
+
+    void accessExistingReadOnly(const string& name);
+    void remove();
+    bool isOpen() const
+    {
+        return table.isOpen;
+    }
+
+    // Return the lowest ReadId with the given name,
+    // or invalidReadId if there is no such read.
+    // The read names must be the same used to create the index.
+    ReadId find(
+        const MemoryMapped::VectorOfVectors<char, uint64_t>& readNames,
+        const char* nameBegin,
+        const char* nameEnd) const;
+
+    uint64_t hash() const
+    {
+        return table.hash();
+    }
+
+private:
+
+    // The hash table.
+    MemoryMapped::Vector<ReadId> table;
+
+    static uint64_t hashName(const char* nameBegin, const char* nameEnd);
+
+    // Data and functions used during creation.
+    void createThreadFunction(size_t threadId);
+    class CreateData {
+    public:
+        const MemoryMapped::VectorOfVectors<char, uint64_t>* readNames;
+    };
+    CreateData createData;
+};
+
+#endif
@@ -0,0 +1,414 @@
+// shasta.
+#include "ReferenceIndex.hpp"
+#include "Base.hpp"
+#include "computeFeatureHashes.hpp"
+#include "filesystem.hpp"
+#include "KmerIterator.hpp"
+#include "MurmurHash2.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "array.hpp"
+#include "chrono.hpp"
+#include "fstream.hpp"
+#include <limits>
+#include "stdexcept.hpp"
+#include "tuple.hpp"
+
+
+
+void ReferenceIndex::createNew(
+    const string& fastaFileName,
+    uint64_t k,
+    KmerBitmap isMarker,
+    uint64_t m,
+    const string& name,
+    size_t pageSize)
+{
+    CZI_ASSERT(m > 0);
+    cout << timestamp << "Creating the reference index for " << fastaFileName << endl;
+    const auto tBegin = steady_clock::now();
+
+    const auto dataName = [&name](const string& s)
+    {
+        return name.empty() ? string() : (name + "-" + s);
+    };
+    info.createNew(dataName("Info"), pageSize);
+    sequenceNames.createNew(dataName("SequenceNames"), pageSize);
+    sequenceLengths.createNew(dataName("SequenceLengths"), pageSize);
+    occurrences.createNew(dataName("Occurrences"), pageSize);
+
+    // Use about one bucket for every 64 bytes of the fasta file.
+    // There are typically a few features per bucket.
+    info->k = k;
+    info->m = m;
+    info->bucketBits = 10;
+    while((1ULL << info->bucketBits) < filesystem::fileSize(fastaFileName) / 64) {
+        ++info->bucketBits;
+    }
+
+    // Read the fasta file twice: once to count the occurrences
+    // in each bucket, once to store them.
+    occurrences.beginPass1(1ULL << info->bucketBits);
+    findFeatures(fastaFileName, isMarker, true,
+        [this](uint64_t hash, const Occurrence&)
+        {
+            occurrences.incrementCount(getBucket(hash));
+        });
+    occurrences.beginPass2();
+    findFeatures(fastaFileName, isMarker, false,
+        [this](uint64_t hash, const Occurrence& occurrence)
+        {
+            occurrences.store(getBucket(hash), occurrence);
+        });
+    occurrences.endPass2();
+
+    uint64_t totalLength = 0;
+    for(uint64_t sequenceId=0; sequenceId<sequenceCount(); sequenceId++) {
+        totalLength += sequenceLength(sequenceId);
+    }
+    const auto tEnd = steady_clock::now();
+    cout << timestamp << "Creating the reference index completed in " <<
+        seconds(tEnd - tBegin) << " s." << endl;
+    cout << "The reference has " << sequenceCount() << " sequences with a total " <<
+        totalLength << " bases and " << featureCount() << " features." << endl;
+}
+
+
+
+void ReferenceIndex::accessExistingReadOnly(const string& name)
+{
+    info.accessExistingReadOnly(name + "-Info");
+    sequenceNames.accessExistingReadOnly(name + "-SequenceNames");
+    sequenceLengths.accessExistingReadOnly(name + "-SequenceLengths");
+    occurrences.accessExistingReadOnly(name + "-Occurrences");
+}
+
+
+
+void ReferenceIndex::remove()
+{
+    info.remove();
+    sequenceNames.remove();
+    sequenceLengths.remove();
+    occurrences.remove();
+}
+
+
+
+// Read the fasta file and call the given function
+// for each feature occurrence, with its hash.
+// The sequence is converted to run-length representation
+// on the fly, keeping the raw position of the first base
+// of each of the last k runs. A marker is found when
+// the last run of its k-mer ends, and it completes a feature
+// if it is preceded by at least m-1 markers in the same stretch
+// of ACGT bases.
+template<class F> void ReferenceIndex::findFeatures(
+    const string& fastaFileName,
+    KmerBitmap isMarker,
+    bool storeSequences,
+    const F& f)
+{
+    ifstream fasta(fastaFileName);
+    if(!fasta) {
+        throw runtime_error("Error opening " + fastaFileName);
+    }
+    const uint64_t k = info->k;
+    const uint64_t m = info->m;
+
+    // The state for the current sequence.
+    const uint64_t mask = (1ULL << k) - 1ULL;
+    uint64_t lsb = 0;
+    uint64_t msb = 0;
+    uint64_t runCount = 0;          // Since the last non-ACGT base.
+    uint8_t previousBase = 255;
+    vector<uint32_t> runBegins(k);  // Circular, indexed by run number modulo k.
+    uint64_t rawPosition = 0;
+    uint64_t sequenceCount = 0;
+
+    // The last m markers in the current stretch.
+    vector<KmerId> kmerIds(m);
+    vector<uint32_t> markerBegins(m);
+    uint64_t markerCount = 0;       // Since the last non-ACGT base.
+
+    // Process the k-mer ending with the last run, if it is a marker.
+    const auto flush = [&]()
+    {
+        if(runCount < k) {
+            return;
+        }
+        const KmerId kmerId = KmerId((msb << k) | lsb);
+        if(!isMarker[kmerId]) {
+            return;
+        }
+        std::copy(kmerIds.begin() + 1, kmerIds.end(), kmerIds.begin());
+        std::copy(markerBegins.begin() + 1, markerBegins.end(), markerBegins.begin());
+        kmerIds.back() = kmerId;
+        markerBegins.back() = runBegins[runCount % k];
+        ++markerCount;
+        if(markerCount >= m) {
+            const uint64_t hash = MurmurHash64A(kmerIds.data(), int(m * sizeof(KmerId)), hashSeed);
+            Occurrence occurrence;
+            occurrence.sequenceId = uint32_t(sequenceCount - 1);
+            occurrence.begin = markerBegins.front();
+            occurrence.length = uint16_t(min(rawPosition - markerBegins.front(),
+                uint64_t(std::numeric_limits<uint16_t>::max())));
+            occurrence.hashBits = getHashBits(hash);
+            f(hash, occurrence);
+        }
+    };
+
+    // Start a new stretch of ACGT bases.
+    const auto reset = [&]()
+    {
+        runCount = 0;
+        previousBase = 255;
+        markerCount = 0;
+    };
+
+    const auto endSequence = [&]()
+    {
+        if(sequenceCount > 0) {
+            flush();
+            if(storeSequences) {
+                sequenceLengths.push_back(rawPosition);
+            }
+        }
+    };
+
+    string line;
+    while(getline(fasta, line)) {
+        if(!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if(line.empty()) {
+            continue;
+        }
+
+        // A new sequence begins.
+        // Its name is the first word of the header line.
+        if(line.front() == '>') {
+            endSequence();
+            ++sequenceCount;
+            if(sequenceCount > std::numeric_limits<uint32_t>::max()) {
+                throw runtime_error("Too many sequences in " + fastaFileName);
+            }
+            if(storeSequences) {
+                const auto nameEnd = std::find_if(line.begin() + 1, line.end(),
+                    [](char c) {return c == ' ' || c == '\t';});
+                sequenceNames.appendVector(line.begin() + 1, nameEnd);
+            }
+            reset();
+            rawPosition = 0;
+            continue;
+        }
+        if(sequenceCount == 0) {
+            throw runtime_error("Fasta file " + fastaFileName + " does not begin with '>'.");
+        }
+        if(rawPosition + line.size() > std::numeric_limits<uint32_t>::max()) {
+            throw runtime_error("Reference sequences longer than 4 Gb are not supported.");
+        }
+
+        // Process the bases in this line.
+        for(const char c: line) {
+            const uint8_t base = BaseInitializer::table[uint8_t(c)];
+            if(base == 255) {
+                // Not ACGT.
+                flush();
+                reset();
+            } else if(base != previousBase) {
+                // A new run begins.
+                flush();
+                lsb = ((lsb << 1ULL) | (base & 1ULL)) & mask;
+                msb = ((msb << 1ULL) | ((base >> 1ULL) & 1ULL)) & mask;
+                runBegins[runCount % k] = uint32_t(rawPosition);
+                ++runCount;
+                previousBase = base;
+            }
+            ++rawPosition;
+        }
+    }
+    endSequence();
+}
+
+
+
+void ReferenceIndex::align(
+    uint64_t k,
+    const vector<QueryMarker>& queryMarkers,
+    uint64_t maxFrequency,
+    uint64_t maxDiagonalGap,
+    uint64_t minFeatureCount,
+    vector<Alignment>& alignments) const
+{
+    alignments.clear();
+    if(info->k != k) {
+        throw runtime_error("The reference index was created with a different k.");
+    }
+    const uint64_t m = info->m;
+    const uint64_t markerCount = queryMarkers.size();
+    if(markerCount < m) {
+        return;
+    }
+    const uint64_t queryFeatureCount = markerCount - m + 1;
+
+    // Compute the feature hashes on both strands.
+    // Feature i on strand 1 consists of the reverse complements
+    // of the query markers in reverse order, beginning at
+    // reverse complemented marker i, so it is the reverse complement
+    // of query feature queryFeatureCount-1-i.
+    vector<KmerId> kmerIds(markerCount);
+    array<vector<uint64_t>, 2> hashes;
+    for(Strand strand=0; strand<2; strand++) {
+        for(uint64_t i=0; i<markerCount; i++) {
+            kmerIds[i] = (strand == 0) ?
+                queryMarkers[i].kmerId :
+                KmerId(reverseComplementKmerId(queryMarkers[markerCount-1-i].kmerId, k));
+        }
+        hashes[strand].resize(queryFeatureCount);
+        computeFeatureHashes(kmerIds.data(), queryFeatureCount, m, hashSeed, hashes[strand].data());
+    }
+
+    // Gather the hits on both strands.
+    // On strand 0, reference and query positions increase together,
+    // and their difference is approximately constant along an alignment.
+    // On strand 1, the reverse complement of the query feature
+    // is found in the reference, reference positions decrease
+    // as query positions increase, and their sum is approximately constant.
+    class Hit {
+    public:
+        Strand strand;
+        uint32_t sequenceId;
+        int64_t diagonal;
+        uint32_t ordinal;       // Query feature, or index in queryMarkers of its first marker.
+        int64_t chainKey;       // Increases along an alignment.
+        uint32_t begin;         // In the reference.
+        uint32_t end;
+        bool operator<(const Hit& that) const
+        {
+            return tie(strand, sequenceId, diagonal, ordinal) <
+                tie(that.strand, that.sequenceId, that.diagonal, that.ordinal);
+        }
+    };
+    vector<Hit> hits;
+    vector<Occurrence> featureOccurrences;
+    for(Strand strand=0; strand<2; strand++) {
+        for(uint64_t i=0; i<queryFeatureCount; i++) {
+            const uint64_t hash = hashes[strand][i];
+            const uint16_t hashBits = getHashBits(hash);
+            featureOccurrences.clear();
+            for(const Occurrence& occurrence: occurrences[getBucket(hash)]) {
+                if(occurrence.hashBits == hashBits) {
+                    featureOccurrences.push_back(occurrence);
+                }
+            }
+            if(featureOccurrences.size() > maxFrequency) {
+                continue;
+            }
+
+            const uint32_t ordinal = uint32_t((strand == 0) ? i : (queryFeatureCount - 1 - i));
+            const uint32_t queryBegin = queryMarkers[ordinal].begin;
+            const uint32_t queryEnd = queryMarkers[ordinal + m - 1].end;
+            for(const Occurrence& occurrence: featureOccurrences) {
+                Hit hit;
+                hit.strand = strand;
+                hit.sequenceId = occurrence.sequenceId;
+                hit.ordinal = ordinal;
+                hit.begin = occurrence.begin;
+                hit.end = occurrence.begin + occurrence.length;
+                if(strand == 0) {
+                    hit.diagonal = int64_t(occurrence.begin) - int64_t(queryBegin);
+                    hit.chainKey = int64_t(occurrence.begin);
+                } else {
+                    hit.diagonal = int64_t(occurrence.begin) + int64_t(queryEnd);
+                    hit.chainKey = -int64_t(occurrence.begin);
+                }
+                hits.push_back(hit);
+            }
+        }
+    }
+    sort(hits.begin(), hits.end());
+
+
+
+    // Cluster the hits by diagonal. In each cluster, find the longest
+    // chain with increasing query ordinal and increasing chain key
+    // (longest increasing subsequence).
+    vector<Hit> cluster;
+    vector<uint64_t> tails;         // Index in cluster of the last hit of the best chain of each length.
+    vector<uint64_t> predecessors;
+    for(uint64_t clusterBegin=0; clusterBegin<hits.size(); ) {
+        uint64_t clusterEnd = clusterBegin + 1;
+        while(clusterEnd < hits.size() &&
+            hits[clusterEnd].strand == hits[clusterBegin].strand &&
+            hits[clusterEnd].sequenceId == hits[clusterBegin].sequenceId &&
+            hits[clusterEnd].diagonal - hits[clusterEnd-1].diagonal <= int64_t(maxDiagonalGap)) {
+            ++clusterEnd;
+        }
+        if(clusterEnd - clusterBegin < minFeatureCount) {
+            clusterBegin = clusterEnd;
+            continue;
+        }
+
+        // Sort the cluster by query ordinal, and by decreasing chain key
+        // for the same ordinal, so at most one hit
+        // per query feature is used in the chain.
+        cluster.assign(hits.begin() + clusterBegin, hits.begin() + clusterEnd);
+        clusterBegin = clusterEnd;
+        sort(cluster.begin(), cluster.end(),
+            [](const Hit& x, const Hit& y)
+            {
+                return x.ordinal < y.ordinal || (x.ordinal == y.ordinal && x.chainKey > y.chainKey);
+            });
+
+        tails.clear();
+        predecessors.assign(cluster.size(), std::numeric_limits<uint64_t>::max());
+        for(uint64_t i=0; i<cluster.size(); i++) {
+            const auto it = std::lower_bound(tails.begin(), tails.end(), cluster[i].chainKey,
+                [&cluster](uint64_t j, int64_t chainKey)
+                {
+                    return cluster[j].chainKey < chainKey;
+                });
+            if(it != tails.begin()) {
+                predecessors[i] = *(it - 1);
+            }
+            if(it == tails.end()) {
+                tails.push_back(i);
+            } else {
+                *it = i;
+            }
+        }
+        if(tails.size() < minFeatureCount) {
+            continue;
+        }
+
+        // Store the alignment described by this chain.
+        uint64_t first = tails.back();
+        while(predecessors[first] != std::numeric_limits<uint64_t>::max()) {
+            first = predecessors[first];
+        }
+        const Hit& firstHit = cluster[first];
+        const Hit& lastHit = cluster[tails.back()];
+        Alignment alignment;
+        alignment.sequenceId = firstHit.sequenceId;
+        alignment.strand = firstHit.strand;
+        alignment.queryBegin = queryMarkers[firstHit.ordinal].begin;
+        alignment.queryEnd = queryMarkers[lastHit.ordinal + m - 1].end;
+        if(alignment.strand == 0) {
+            alignment.referenceBegin = firstHit.begin;
+            alignment.referenceEnd = lastHit.end;
+        } else {
+            alignment.referenceBegin = lastHit.begin;
+            alignment.referenceEnd = firstHit.end;
+        }
+        alignment.featureCount = uint32_t(tails.size());
+        alignment.queryFeatureCount = lastHit.ordinal - firstHit.ordinal + 1;
+        alignments.push_back(alignment);
+    }
+
+    stable_sort(alignments.begin(), alignments.end());
+}
@@ -0,0 +1,212 @@
+#ifndef CZI_SHASTA_REFERENCE_INDEX_HPP
+#define CZI_SHASTA_REFERENCE_INDEX_HPP
+
+/*******************************************************************************
+
+Class ReferenceIndex is a persistent index of a reference fasta file,
+used by the http server to locate reads in the reference
+interactively, without running Blast.
+
+The reference sequences are processed in the same way as the reads:
+they are converted to run-length representation, and the k-mers
+that are markers (as flagged in Assembler::markerKmers)
+are found in the run-length sequence.
+Bases other than ACGT (for example, N) interrupt the sequence,
+so no marker contains them.
+
+Individual markers are not specific enough to index a large reference
+(with k=10 there are only 4*3^9 distinct run-length k-mers).
+Instead, as in the LowHash algorithm, the index uses features consisting
+of m consecutive markers, identified by the MurmurHash64A hash
+of their k-mer ids (see computeFeatureHashes).
+The occurrences of the features are stored in a
+MemoryMapped::VectorOfVectors indexed by the most significant bits
+of the hash (the bucket). Each occurrence also stores some of the
+least significant bits of the hash, to skip most occurrences
+of other features that fall in the same bucket.
+Positions are stored in raw (not run-length) coordinates
+of the reference sequence, so they can be displayed directly.
+
+To locate a read, the features of its markers are looked up on both strands.
+The hits on each reference sequence and strand are clustered by diagonal,
+and in each cluster the longest chain of hits with increasing
+positions in both the read and the reference is found.
+Each chain with enough features is reported as an alignment.
+
+Because it uses the marker k-mers, the index must be recreated
+if the markers are selected again.
+
+*******************************************************************************/
+
+// shasta.
+#include "Kmer.hpp"
+#include "MemoryMappedObject.hpp"
+#include "MemoryMappedVector.hpp"
+#include "MemoryMappedVectorOfVectors.hpp"
+#include "ReadId.hpp"
+
+// Standard library.
+#include "cstdint.hpp"
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class ReferenceIndex;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::ReferenceIndex {
+public:
+
+    // Create the index for the reference sequences in a fasta file,
+    // using features of m consecutive markers.
+    // The name is used to construct the names of the memory mapped
+    // files. If empty, anonymous memory is used.
+    void createNew(
+        const string& fastaFileName,
+        uint64_t k,
+        KmerBitmap isMarker,
+        uint64_t m,
+        const string& name,
+        size_t pageSize);
+
+    void accessExistingReadOnly(const string& name);
+    void remove();
+    bool isOpen() const
+    {
+        return occurrences.isOpen();
+    }
+
+    // The reference sequences.
+    uint64_t sequenceCount() const
+    {
+        return sequenceLengths.size();
+    }
+    string sequenceName(uint64_t sequenceId) const
+    {
+        return string(sequenceNames.begin(sequenceId), sequenceNames.end(sequenceId));
+    }
+    uint64_t sequenceLength(uint64_t sequenceId) const
+    {
+        return sequenceLengths[sequenceId];
+    }
+    uint64_t featureCount() const
+    {
+        return occurrences.totalSize();
+    }
+    uint64_t m() const
+    {
+        return info->m;
+    }
+
+    // A marker of the sequence to be located, with its
+    // raw begin and end position in that sequence.
+    class QueryMarker {
+    public:
+        KmerId kmerId;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    // An alignment found by align.
+    // Positions are raw positions. On strand 1, the query
+    // aligns to the reverse complement of the reference,
+    // and referenceBegin and referenceEnd still refer
+    // to the reference sequence as stored.
+    class Alignment {
+    public:
+        uint32_t sequenceId;
+        Strand strand;
+        uint32_t queryBegin;
+        uint32_t queryEnd;
+        uint32_t referenceBegin;
+        uint32_t referenceEnd;
+
+        // The number of query features in the chain.
+        uint32_t featureCount;
+
+        // The number of query features in the aligned query range.
+        uint32_t queryFeatureCount;
+
+        // Order by decreasing number of aligned features.
+        bool operator<(const Alignment& that) const
+        {
+            return featureCount > that.featureCount;
+        }
+    };
+
+    // Locate a sequence in the reference, given its markers,
+    // sorted by position. The alignments found are returned
+    // sorted by decreasing number of aligned features.
+    // Features that occur more than maxFrequency times
+    // in the reference are not used.
+    // Hits whose diagonals differ by up to maxDiagonalGap bases
+    // are clustered together, and alignments with less than
+    // minFeatureCount features are not reported.
+    void align(
+        uint64_t k,
+        const vector<QueryMarker>&,
+        uint64_t maxFrequency,
+        uint64_t maxDiagonalGap,
+        uint64_t minFeatureCount,
+        vector<Alignment>&) const;
+
+private:
+
+    class Info {
+    public:
+        uint64_t k;
+        uint64_t m;
+
+        // The number of buckets is 2^bucketBits.
+        uint64_t bucketBits;
+    };
+    MemoryMapped::Object<Info> info;
+
+    // The seed used to hash features.
+    static const uint64_t hashSeed = 1253;
+
+    // An occurrence of a feature in the reference.
+    // The begin is the raw position of the first base
+    // of the first marker, and the length includes
+    // the entire last run of the last marker.
+    class Occurrence {
+    public:
+        uint32_t sequenceId;
+        uint32_t begin;
+        uint16_t length;
+
+        // The least significant bits of the feature hash.
+        uint16_t hashBits;
+    };
+    uint64_t getBucket(uint64_t hash) const
+    {
+        return hash >> (64 - info->bucketBits);
+    }
+    static uint16_t getHashBits(uint64_t hash)
+    {
+        return uint16_t(hash);
+    }
+
+    // The names and raw lengths of the reference sequences.
+    MemoryMapped::VectorOfVectors<char, uint64_t> sequenceNames;
+    MemoryMapped::Vector<uint64_t> sequenceLengths;
+
+    // The occurrences of the features, indexed by bucket.
+    MemoryMapped::VectorOfVectors<Occurrence, uint64_t> occurrences;
+
+    // Read the fasta file and call the given function
+    // for each feature occurrence, with its hash.
+    // If storeSequences is true, also store the names
+    // and lengths of the reference sequences.
+    template<class F> void findFeatures(
+        const string& fastaFileName,
+        KmerBitmap isMarker,
+        bool storeSequences,
+        const F&);
+};
+
+#endif
@@ -10,8 +10,11 @@
 #include <array>
 #include <cmath>
 #include <map>
+#include <chrono>
 #include "SimpleBayesianConsensusCaller.hpp"
+#include "accumulateLogLikelihoods.hpp"
 #include "Coverage.hpp"
+#include "CoverageTensor.hpp"
 #include "ConsensusCaller.hpp"
 
 using ChanZuckerberg::shasta::Consensus;
@@ -29,6 +32,7 @@ using std::cout;
 using std::pow;
 using std::map;
 using std::max;
+using std::min;
 
 using namespace ChanZuckerberg;
 using namespace shasta;
@@ -63,29 +67,40 @@ SimpleBayesianConsensusCaller::SimpleBayesianConsensusCaller(){
     count_gaps_as_zeros = false;
 
     const string fileName = "SimpleBayesianConsensusCaller.csv";
-    ifstream matrix_file(fileName);
-    if (not matrix_file.good()) {
-        const string error_message = "Error opening file: " + fileName;
-        throw runtime_error(error_message);
-    }
+    const string binaryFileName = "SimpleBayesianConsensusCaller.bin";
+
+    // Use the compiled model if it is up to date.
+    // Otherwise, parse the csv file and compile it.
+    if (not (isCompiledModelUpToDate(fileName, binaryFileName) and
+        access_compiled_model(binaryFileName))) {
+        ifstream matrix_file(fileName);
+        if (not matrix_file.good()) {
+            const string error_message = "Error opening file: " + fileName;
+            throw runtime_error(error_message);
+        }
 
-    load_configuration(matrix_file);
+        load_configuration(matrix_file);
+        compile_model(binaryFileName);
+        probability_matrices = array<vector<vector<double> >, 4>();
+        priors = array<vector<double>, 2>();
+    }
+    use_compiled_model();
 
     cout << "Using SimpleBayesianConsensusCaller with '"<< configuration_name <<"' configuration\n";
 }
 
 
 void SimpleBayesianConsensusCaller::print_probability_matrices(char separator){
-    const uint32_t length = uint(probability_matrices[0].size());
+    const uint32_t length = uint32_t(max_runlength) + 1;
     uint32_t n_bases = 4;
 
     for (uint32_t b=0; b<n_bases; b++){
-        cout << '>' << Base::fromInteger(b).character() << " " << probability_matrices[b].size() << '\n';
+        cout << '>' << Base::fromInteger(b).character() << " " << length << '\n';
 
         for (uint32_t i=0; i<length; i++){
             for (uint32_t j=0; j<length; j++){
                 // Print with exactly 9 decimal values
-                printf("%.9f",probability_matrices[b][i][j]);
+                printf("%.9f",log_likelihood_row(uint8_t(b), uint16_t(i))[j]);
                 if (j != length-1){
                     cout << separator;
                 }
@@ -100,14 +115,14 @@ void SimpleBayesianConsensusCaller::print_probability_matrices(char separator){
 
 
 void SimpleBayesianConsensusCaller::print_priors(char separator){
-    const uint32_t length = uint(priors[0].size());
+    const uint32_t length = uint32_t(max_runlength) + 1;
     uint32_t n_bases = 2;
 
     for (uint32_t b=0; b<n_bases; b++){
-        cout << '>' << Base::fromInteger(b).character() << " " << priors[b].size() << '\n';
+        cout << '>' << Base::fromInteger(b).character() << " " << length << '\n';
 
         for (uint32_t i=0; i<length; i++){
-            printf("%d %.9f",int(i), priors[b][i]);
+            printf("%d %.9f",int(i), prior_rows[b][i]);
             if (i != length-1){
                 cout << separator;
             }
@@ -199,6 +214,118 @@ void SimpleBayesianConsensusCaller::load_configuration(ifstream& matrix_file){
 }
 
 
+// Create the compiled model from probability_matrices and priors.
+// Each row (a prior, or a fixed base and true run length) is padded
+// to a multiple of 8 doubles (64 bytes). The header is also a multiple
+// of 64 bytes, so each row starts on a cache line boundary.
+void SimpleBayesianConsensusCaller::compile_model(const string& binaryFileName){
+    const size_t length = size_t(max_runlength) + 1;
+    const size_t doublesPerCacheLine = 64 / sizeof(double);
+    const size_t stride = ((length + doublesPerCacheLine - 1) / doublesPerCacheLine) * doublesPerCacheLine;
+
+    // The rows: two priors followed by the log likelihood table.
+    vector<double> rows((2 + 4*length) * stride, -INF);
+    bool early_termination = true;
+    for (uint32_t p=0; p<2; p++){
+        const vector<double>& prior = priors[p];
+        if (prior.size() < length){
+            throw runtime_error("SimpleBayesianConsensusCaller: prior has fewer than " +
+                std::to_string(length) + " entries.");
+        }
+        for (size_t y=0; y<length; y++){
+            rows[p*stride + y] = prior[y];
+            if (prior[y] > 0.){
+                early_termination = false;
+            }
+        }
+    }
+    for (uint32_t b=0; b<4; b++){
+        const vector<vector<double> >& probability_matrix = probability_matrices[b];
+        if (probability_matrix.size() < length){
+            throw runtime_error("SimpleBayesianConsensusCaller: likelihood matrix for " +
+                string(1, Base::fromInteger(b).character()) + " has fewer than " +
+                std::to_string(length) + " rows.");
+        }
+        for (uint16_t y=0; y<length; y++){
+            const vector<double>& matrix_row = probability_matrix[y];
+            if (matrix_row.size() < length){
+                throw runtime_error("SimpleBayesianConsensusCaller: likelihood matrix for " +
+                    string(1, Base::fromInteger(b).character()) + " has a row with fewer than " +
+                    std::to_string(length) + " entries.");
+            }
+            double* row = rows.data() + (2 + b*length + y) * stride;
+            for (size_t x=0; x<length; x++){
+                row[x] = matrix_row[x];
+                if (row[x] > 0.){
+                    early_termination = false;
+                }
+            }
+        }
+    }
+
+    // The header.
+    CompiledModelHeader header;
+    header.magicNumber = CompiledModelHeader::constantMagicNumber;
+    header.formatVersion = CompiledModelHeader::currentFormatVersion;
+    header.max_runlength = max_runlength;
+    header.stride = stride;
+    header.allow_early_termination = early_termination ? 1 : 0;
+    header.configuration_name.fill(0);
+    std::copy_n(configuration_name.begin(),
+        min(configuration_name.size(), header.configuration_name.size()-1),
+        header.configuration_name.begin());
+
+    // Store it.
+    vector<char> image(sizeof(header) + rows.size()*sizeof(double));
+    std::copy_n(reinterpret_cast<const char*>(&header), sizeof(header), image.begin());
+    std::copy_n(reinterpret_cast<const char*>(rows.data()), rows.size()*sizeof(double),
+        image.begin() + sizeof(header));
+    createCompiledModel(binaryFileName, image, compiled_model);
+}
+
+
+
+// Map an existing compiled model.
+// Returns false if it was created with a different format version
+// or for a different max_runlength.
+bool SimpleBayesianConsensusCaller::access_compiled_model(const string& binaryFileName){
+    try {
+        compiled_model.accessExistingReadOnly(binaryFileName);
+    } catch (...) {
+        return false;
+    }
+    if (compiled_model.size() >= sizeof(CompiledModelHeader)){
+        const CompiledModelHeader& header =
+            *reinterpret_cast<const CompiledModelHeader*>(compiled_model.begin());
+        const size_t length = size_t(max_runlength) + 1;
+        if (header.magicNumber == CompiledModelHeader::constantMagicNumber and
+            header.formatVersion == CompiledModelHeader::currentFormatVersion and
+            header.max_runlength == max_runlength and
+            header.stride >= length and
+            compiled_model.size() == sizeof(CompiledModelHeader) + (2 + 4*length)*header.stride*sizeof(double)){
+            return true;
+        }
+    }
+    compiled_model.close();
+    return false;
+}
+
+
+
+// Set the pointers into compiled_model.
+void SimpleBayesianConsensusCaller::use_compiled_model(){
+    const CompiledModelHeader& header =
+        *reinterpret_cast<const CompiledModelHeader*>(compiled_model.begin());
+    configuration_name = string(header.configuration_name.data());
+    allow_early_termination = (header.allow_early_termination != 0);
+    log_likelihood_table_stride = header.stride;
+    const double* rows = reinterpret_cast<const double*>(compiled_model.begin() + sizeof(CompiledModelHeader));
+    prior_rows[0] = rows;
+    prior_rows[1] = rows + log_likelihood_table_stride;
+    log_likelihood_table = rows + 2*log_likelihood_table_stride;
+}
+
+
 void SimpleBayesianConsensusCaller::print_log_likelihood_vector(vector<double>& log_likelihoods){
     int i = 0;
     for (auto& item: log_likelihoods){
@@ -275,11 +402,16 @@ uint16_t SimpleBayesianConsensusCaller::predict_runlength(const Coverage &covera
         factor_repeats(factored_repeats, coverage);
     }
 
+    // Make sure there is room for all values of Y
+    if (log_likelihood_y.size() < size_t(max_runlength)+1){
+        log_likelihood_y.resize(size_t(max_runlength)+1, -INF);
+    }
+
     // Iterate all possible Y from 0 to j to calculate p(Y_j|X) where X is all observations 0 to i,
     // assuming i and j are less than max_runlength
     for (y_j = 0; y_j <= max_runlength; y_j++){
         // Initialize log_sum for this Y value using empirically determined priors
-        log_sum = priors[prior_index][y_j];
+        log_sum = prior_rows[prior_index][y_j];
 
         for (uint16_t strand = 0; strand <= factored_repeats.size() - 1; strand++){
             for (auto& item: factored_repeats[strand]){
@@ -292,7 +424,7 @@ uint16_t SimpleBayesianConsensusCaller::predict_runlength(const Coverage &covera
                 }
 
                 // Increment log likelihood for this y_j
-                log_sum += double(c_i)*probability_matrices[consensusBase.value][y_j][x_i];
+                log_sum += double(c_i)*log_likelihood_row(consensusBase.value, y_j)[x_i];
             }
         }
 
@@ -311,6 +443,82 @@ uint16_t SimpleBayesianConsensusCaller::predict_runlength(const Coverage &covera
 }
 
 
+uint16_t SimpleBayesianConsensusCaller::predict_runlength_from_table(const Coverage &coverage, AlignedBase consensusBase) const{
+    // Repeats grouped by strand and length, indexed by [strand*256 + x_i].
+    // Repeat counts in reads are stored in one byte, so they are less than 256.
+    array<uint16_t, 512> factored_repeats;
+    factored_repeats.fill(0);
+    array<uint16_t, 2> x_end = {0, 0};    // One past the largest x_i observed, for each strand
+
+    for (const CoverageData& observation: coverage.getReadCoverageData()){
+        if (ignore_non_consensus_base_repeats and observation.base.value != consensusBase.value){
+            continue;
+        }
+        uint16_t x_i;
+        if (not observation.base.isGap()){
+            x_i = uint16_t(observation.repeatCount);
+        }else if (count_gaps_as_zeros){
+            x_i = 0;
+        }else{
+            continue;
+        }
+        CZI_ASSERT(x_i < 256);
+        factored_repeats[observation.strand*256 + x_i]++;
+        x_end[observation.strand] = max(x_end[observation.strand], uint16_t(x_i + 1));
+    }
+
+    // Gather the non-zero counts and the corresponding columns of the log likelihood table.
+    // They are gathered in order of strand and x_i, which is the order
+    // in which predict_runlength visits them, so the sums below are identical.
+    array<uint16_t, 512> observation_columns;
+    array<uint16_t, 512> observation_counts;
+    size_t observation_count = 0;
+    for (uint16_t strand=0; strand<2; strand++){
+        const uint16_t* counts = factored_repeats.data() + strand*256;
+        for (uint16_t x_i=0; x_i<x_end[strand]; x_i++){
+            if (counts[x_i] != 0){
+                // In the case that observed runlength is too large for the matrix, cap it at max_runlength
+                observation_columns[observation_count] = min(x_i, max_runlength);
+                observation_counts[observation_count] = counts[x_i];
+                ++observation_count;
+            }
+        }
+    }
+
+    // Determine which index to use for this->priors
+    size_t prior_index = 0;
+    if (consensusBase.character() == 'G' || consensusBase.character() == 'C'){
+        prior_index = 1;
+    }
+    const double* prior = prior_rows[prior_index];
+
+    double y_max_likelihood = -INF;     // Probability of most probable true repeat length
+    uint16_t y_max = 0;                 // Most probable repeat length
+
+    for (uint16_t y_j = 0; y_j <= max_runlength; y_j++){
+        double log_sum = prior[y_j];
+
+        // With early termination, stop as soon as this y_j can no longer
+        // become the most likely. Ties go to the smaller y_j,
+        // so this gives the same y_max as without early termination.
+        bool terminated = (allow_early_termination and log_sum <= y_max_likelihood);
+
+        const double* row = log_likelihood_row(consensusBase.value, y_j);
+        for (size_t i=0; i<observation_count and not terminated; i++){
+            log_sum += double(observation_counts[i])*row[observation_columns[i]];
+            terminated = (allow_early_termination and log_sum <= y_max_likelihood);
+        }
+
+        if (not terminated and log_sum > y_max_likelihood){
+            y_max_likelihood = log_sum;
+            y_max = y_j;
+        }
+    }
+
+    return max(uint16_t(1), y_max);   // Don't allow zeroes...
+}
+
+
 AlignedBase SimpleBayesianConsensusCaller::predict_consensus_base(const Coverage& coverage) const{
     const vector<CoverageData>& coverage_data_vector = coverage.getReadCoverageData();
     vector<uint32_t> base_counts(5,0);
@@ -346,18 +554,17 @@ Consensus SimpleBayesianConsensusCaller::operator()(const Coverage& coverage) co
     // TODO: test that coverage is not empty?
     AlignedBase consensus_base;
     uint16_t consensus_repeat;
-    vector<double> log_likelihoods(u_long(max_runlength), -INF);    // initialize as zeros in log space
 
     consensus_base = predict_consensus_base(coverage);
 
     if (predict_gap_runlengths) {
         // Predict all run lengths regardless of whether consensus base is a gap
-        consensus_repeat = predict_runlength(coverage, consensus_base, log_likelihoods);
+        consensus_repeat = predict_runlength_from_table(coverage, consensus_base);
     }
     else {
         if (not consensus_base.isGap()) {
             // Consensus is NOT a gap character, and the configuration forbids predicting gaps
-            consensus_repeat = predict_runlength(coverage, consensus_base, log_likelihoods);
+            consensus_repeat = predict_runlength_from_table(coverage, consensus_base);
         } else {
             // Consensus IS a gap character, and the configuration forbids predicting gaps
             consensus_repeat = 0;
@@ -368,6 +575,167 @@ Consensus SimpleBayesianConsensusCaller::operator()(const Coverage& coverage) co
 }
 
 
+void SimpleBayesianConsensusCaller::operator()(const CoverageTensor& coverageTensor, vector<Consensus>& consensus) const{
+    const size_t column_count = coverageTensor.size();
+    const size_t slot_count = CoverageTensor::repeatCountSlotCount;
+    consensus.resize(column_count);
+
+    // Consensus bases for all columns. This uses the same rule as predict_consensus_base.
+    vector<AlignedBase> consensus_bases;
+    coverageTensor.mostFrequentBases(consensus_bases);
+
+    vector<size_t> columns;             // The columns with the consensus base being processed
+    vector<double> observations;        // Number of observations, indexed by [(strand*slot_count + x_i)*column count + column]
+    vector<double> log_sums;            // Log likelihood for the current y_j, for each column
+    vector<double> y_max_likelihoods;   // Probability of most probable true repeat length, for each column
+    vector<uint16_t> y_maxes;           // Most probable repeat length, for each column
+    vector<size_t> observed_rows;       // The rows of observations (strand*slot_count + x_i) that are not all zero
+
+    // Process the columns in groups with the same consensus base.
+    for (uint8_t base_value=0; base_value<5; base_value++){
+        const AlignedBase consensus_base = AlignedBase::fromInteger(base_value);
+        columns.clear();
+        for (size_t column=0; column<column_count; column++){
+            if (consensus_bases[column].value == base_value){
+                columns.push_back(column);
+            }
+        }
+        if (columns.empty()){
+            continue;
+        }
+        const size_t n = columns.size();
+
+        // If the consensus base is a gap, the run length is zero,
+        // unless predict_gap_runlengths is set, in which case
+        // we use the single column version.
+        if (consensus_base.isGap()){
+            if (predict_gap_runlengths){
+                CompactCoverage compactCoverage;
+                for (const size_t column: columns){
+                    coverageTensor.getColumn(column, compactCoverage);
+                    consensus[column] = (*this)(compactCoverage);
+                }
+            }else{
+                for (const size_t column: columns){
+                    consensus[column] = Consensus(consensus_base, 0);
+                }
+            }
+            continue;
+        }
+
+        // Gather the observations for these columns, same as factor_repeats does for a single column.
+        observations.assign(2*slot_count*n, 0.);
+        for (Strand strand=0; strand<2; strand++){
+            for (uint8_t observed_base_value=0; observed_base_value<5; observed_base_value++){
+                const AlignedBase observed_base = AlignedBase::fromInteger(observed_base_value);
+                if (ignore_non_consensus_base_repeats and observed_base_value != base_value){
+                    continue;
+                }
+                if (observed_base.isGap() and not count_gaps_as_zeros){
+                    continue;
+                }
+                for (size_t x_i=0; x_i<slot_count; x_i++){
+                    const uint16_t* counts = coverageTensor.slotCounts(CoverageTensor::slot(observed_base, strand, x_i));
+                    double* row = observations.data() + (strand*slot_count + x_i)*n;
+                    for (size_t k=0; k<n; k++){
+                        row[k] += double(counts[columns[k]]);
+                    }
+                }
+            }
+        }
+
+        // Only rows with at least one observation contribute.
+        observed_rows.clear();
+        for (size_t r=0; r<2*slot_count; r++){
+            const double* row = observations.data() + r*n;
+            for (size_t k=0; k<n; k++){
+                if (row[k] != 0.){
+                    observed_rows.push_back(r);
+                    break;
+                }
+            }
+        }
+
+        // Determine which index to use for this->priors
+        const size_t prior_index = (consensus_base.character() == 'A' || consensus_base.character() == 'T') ? 0 : 1;
+
+        // Iterate all possible Y from 0 to j to calculate p(Y_j|X) for all columns.
+        // The order of the sums is the same as in predict_runlength,
+        // so the results are identical.
+        log_sums.resize(n);
+        y_max_likelihoods.assign(n, -INF);
+        y_maxes.assign(n, 0);
+        for (uint16_t y_j = 0; y_j <= max_runlength; y_j++){
+            std::fill(log_sums.begin(), log_sums.end(), prior_rows[prior_index][y_j]);
+
+            const double* log_likelihoods = log_likelihood_row(base_value, y_j);
+            for (const size_t r: observed_rows){
+                // In the case that observed runlength is too large for the matrix, cap it at max_runlength
+                const size_t x_i = std::min(r % slot_count, size_t(max_runlength));
+                const double p = log_likelihoods[x_i];
+                accumulateLogLikelihoods(observations.data() + r*n, p, log_sums.data(), n);
+            }
+
+            for (size_t k=0; k<n; k++){
+                if (log_sums[k] > y_max_likelihoods[k]){
+                    y_max_likelihoods[k] = log_sums[k];
+                    y_maxes[k] = y_j;
+                }
+            }
+        }
+
+        for (size_t k=0; k<n; k++){
+            consensus[columns[k]] = Consensus(consensus_base, max(uint16_t(1), y_maxes[k]));   // Don't allow zeroes...
+        }
+    }
+}
+
+
+void SimpleBayesianConsensusCaller::benchmark(const vector<Coverage>& coverages) const{
+    using std::chrono::steady_clock;
+    using std::chrono::duration;
+
+    // Reference implementation.
+    vector<Consensus> reference_consensus(coverages.size());
+    vector<double> log_likelihoods(size_t(max_runlength)+1, -INF);
+    const auto t0 = steady_clock::now();
+    for (size_t i=0; i<coverages.size(); i++){
+        const AlignedBase consensus_base = predict_consensus_base(coverages[i]);
+        uint16_t consensus_repeat = 0;
+        if (predict_gap_runlengths or not consensus_base.isGap()){
+            consensus_repeat = predict_runlength(coverages[i], consensus_base, log_likelihoods);
+        }
+        reference_consensus[i] = Consensus(consensus_base, consensus_repeat);
+    }
+
+    // Table based implementation.
+    vector<Consensus> consensus(coverages.size());
+    const auto t1 = steady_clock::now();
+    for (size_t i=0; i<coverages.size(); i++){
+        consensus[i] = (*this)(coverages[i]);
+    }
+    const auto t2 = steady_clock::now();
+
+    size_t mismatch_count = 0;
+    for (size_t i=0; i<coverages.size(); i++){
+        if (consensus[i].base.value != reference_consensus[i].base.value or
+            consensus[i].repeatCount != reference_consensus[i].repeatCount){
+            ++mismatch_count;
+        }
+    }
+
+    const double reference_time = duration<double>(t1 - t0).count();
+    const double table_time = duration<double>(t2 - t1).count();
+    cout << "SimpleBayesianConsensusCaller benchmark on " << coverages.size() << " Coverage objects.\n";
+    cout << "Reference implementation: " << reference_time << " s\n";
+    cout << "Table based implementation: " << table_time << " s\n";
+    if (table_time > 0.){
+        cout << "Speedup: " << reference_time / table_time << '\n';
+    }
+    cout << "Number of differences: " << mismatch_count << '\n';
+}
+
+
 void testSimpleBayesianConsensusCaller(){
     SimpleBayesianConsensusCaller classifier;
     Coverage coverage;
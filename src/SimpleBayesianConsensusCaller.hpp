@@ -24,8 +24,16 @@ and can be initially neglected.
 Note that in the above, the base read at a given alignment position
 must take into account which strand each read is on.
 
+The model is read from file SimpleBayesianConsensusCaller.csv
+in the run directory and compiled to SimpleBayesianConsensusCaller.bin,
+which contains the priors and the log likelihood table
+in the layout used for the computation (see CompiledModel.hpp).
+Subsequent instances only map the binary file read-only,
+without parsing the csv file.
+
 *******************************************************************************/
 
+#include "CompiledModel.hpp"
 #include "ConsensusCaller.hpp"
 #include <iostream>
 #include <fstream>
@@ -62,7 +70,8 @@ public:
 
     // The constructor does not have any parameters.
     // All data is read from file SimpleBayesianConsensusCaller.csv
-    // in the run directory. We will update the documentation accordingly.
+    // in the run directory, or from its compiled form
+    // SimpleBayesianConsensusCaller.bin if that is up to date.
     SimpleBayesianConsensusCaller();
 
     // Given a coverage object, return the most likely run length, and the normalized log likelihood vector for all run
@@ -74,6 +83,17 @@ public:
     // This is the primary function of this class. Given a coverage object and consensus base, predict the true
     // run length of the aligned bases at a position
     virtual Consensus operator()(const Coverage&) const;
+    using ConsensusCaller::operator();
+
+    // Batch version: compute consensus for all columns of a CoverageTensor.
+    // Columns are grouped by consensus base, and for each group
+    // the log likelihoods are accumulated for all columns at once.
+    virtual void operator()(const CoverageTensor&, vector<Consensus>&) const;
+
+    // Compare the speed of operator() against the reference implementation
+    // (predict_consensus_base followed by predict_runlength) on the given
+    // Coverage objects, and check that the results are identical.
+    void benchmark(const vector<Coverage>&) const;
 
 private:
 
@@ -90,12 +110,48 @@ private:
     bool predict_gap_runlengths;
     bool count_gaps_as_zeros;
 
-    // p(X|Y) normalized for each Y, where X = observed and Y = True run length
+    // p(X|Y) normalized for each Y, where X = observed and Y = True run length.
+    // Only used while parsing the csv file.
     array<vector<vector<double> >, 4> probability_matrices;
 
-    // priors p(Y) normalized for each Y, where X = observed and Y = True run length
+    // priors p(Y) normalized for each Y, where X = observed and Y = True run length.
+    // Only used while parsing the csv file.
     array<vector<double>, 2> priors;
 
+    // The compiled model, memory mapped from SimpleBayesianConsensusCaller.bin.
+    // It begins with a CompiledModelHeader, followed by the two priors
+    // and by the probability matrices flattened into a single contiguous table.
+    // The row for base b and true run length y
+    // starts at log_likelihood_table + (b*(max_runlength+1) + y)*log_likelihood_table_stride,
+    // and contains the log likelihoods for each observed run length x.
+    // Each row, including the priors, is padded to a multiple of 8 doubles
+    // and starts at a 64-byte boundary.
+    class CompiledModelHeader {
+    public:
+        static const uint64_t constantMagicNumber = 0x5e3c2b1f8a6d4c97ULL;
+        static const uint64_t currentFormatVersion = 1;
+        uint64_t magicNumber;
+        uint64_t formatVersion;
+        uint64_t max_runlength;
+        uint64_t stride;
+        uint64_t allow_early_termination;
+        array<char, 472> configuration_name;
+    };
+    static_assert(sizeof(CompiledModelHeader) % 64 == 0,
+        "Unexpected size of SimpleBayesianConsensusCaller::CompiledModelHeader.");
+    MemoryMapped::Vector<char> compiled_model;
+
+    // Pointers into compiled_model.
+    array<const double*, 2> prior_rows;
+    const double* log_likelihood_table;
+    size_t log_likelihood_table_stride;
+
+    // True if all priors and log likelihoods are not positive.
+    // In that case the log likelihood for a given y_j can only decrease
+    // as observations are added, and predict_runlength_from_table can stop
+    // processing y_j as soon as it can no longer become the most likely.
+    bool allow_early_termination;
+
     /// ----- Methods ----- ///
 
     // For parsing any character separated file format
@@ -112,6 +168,28 @@ private:
     void parse_prior(ifstream& matrix_file, string& line, vector<string>& tokens);
     void parse_likelihood(ifstream& matrix_file, string& line, vector<string>& tokens);
 
+    // Create the compiled model from probability_matrices and priors
+    // and store it in the given file.
+    void compile_model(const string& binaryFileName);
+
+    // Map an existing compiled model. Returns false if it is not usable.
+    bool access_compiled_model(const string& binaryFileName);
+
+    // Set the pointers into compiled_model.
+    void use_compiled_model();
+
+    // Return the row of log_likelihood_table for a given base and true run length.
+    const double* log_likelihood_row(uint8_t base, uint16_t y) const
+    {
+        return log_likelihood_table +
+            (size_t(base)*(max_runlength+1) + y) * log_likelihood_table_stride;
+    }
+
+    // Same result as predict_runlength, but using log_likelihood_table, with
+    // early termination, and without computing the log likelihood vector.
+    // This is what operator() uses.
+    uint16_t predict_runlength_from_table(const Coverage &coverage, AlignedBase consensusBase) const;
+
     // For a given vector of likelihoods over each Y value, normalize by the maximum
     void normalize_likelihoods(vector<double>& x, double x_max) const;
 
@@ -1,4 +1,5 @@
 #include "SimpleConsensusCaller.hpp"
+#include "CompactCoverage.hpp"
 #include "Coverage.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
@@ -12,3 +13,12 @@ Consensus SimpleConsensusCaller::operator()(
     return Consensus(base, repeatCount);
 }
 
+
+
+Consensus SimpleConsensusCaller::operator()(
+    const CompactCoverage& coverage) const
+{
+    const AlignedBase base = coverage.mostFrequentBase();
+    const size_t repeatCount = coverage.mostFrequentRepeatCount(base);
+    return Consensus(base, repeatCount);
+}
@@ -34,6 +34,8 @@ class ChanZuckerberg::shasta::SimpleConsensusCaller :
 public:
 
     virtual Consensus operator()(const Coverage&) const;
+    virtual Consensus operator()(const CompactCoverage&) const;
+    using ConsensusCaller::operator();
 
 };
 
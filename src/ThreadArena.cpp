@@ -0,0 +1,114 @@
+// Shasta.
+#include "ThreadArena.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include <cstdlib>
+#include <mutex>
+
+thread_local ThreadArena* ThreadArena::current = 0;
+
+// The process totals.
+namespace {
+    std::mutex totalsMutex;
+    ThreadArena::Statistics totals;
+}
+
+
+
+ThreadArena::~ThreadArena()
+{
+    for(const Block& block: blocks) {
+        ::free(block.begin);
+    }
+}
+
+
+
+// Called when the allocation does not fit in the current block.
+// Move to the next block, reusing it if it is large enough,
+// or replacing it with a larger one if it is not.
+void* ThreadArena::allocateSlow(size_t byteCount, size_t alignment)
+{
+    if(blockIndex < blocks.size()) {
+        ++blockIndex;
+    }
+    const size_t requiredSize = byteCount + alignment;
+    if(blockIndex < blocks.size() && blocks[blockIndex].size < requiredSize) {
+        ::free(blocks[blockIndex].begin);
+        blocks.erase(blocks.begin() + int64_t(blockIndex));
+    }
+    if(blockIndex == blocks.size() || blocks[blockIndex].size < requiredSize) {
+        const size_t previousSize = blocks.empty() ? firstBlockSize / 2 : blocks.back().size;
+        const size_t size = max(requiredSize, min(maxBlockSize, 2 * previousSize));
+        Block block;
+        block.begin = static_cast<char*>(::malloc(size));
+        if(!block.begin) {
+            throw std::bad_alloc();
+        }
+        block.size = size;
+        blocks.insert(blocks.begin() + int64_t(blockIndex), block);
+        ++statistics.blockCount;
+        statistics.blockBytes += size;
+    }
+
+    const Block& block = blocks[blockIndex];
+    position = reinterpret_cast<uintptr_t>(block.begin);
+    blockEnd = position + block.size;
+    void* p = allocate(byteCount, alignment);
+    CZI_ASSERT(p);
+    return p;
+}
+
+
+
+void ThreadArena::rewind(size_t blockIndexArgument, uintptr_t positionArgument)
+{
+    blockIndex = blockIndexArgument;
+    if(blockIndex < blocks.size()) {
+        const Block& block = blocks[blockIndex];
+        const uintptr_t blockBegin = reinterpret_cast<uintptr_t>(block.begin);
+        position = positionArgument ? positionArgument : blockBegin;
+        blockEnd = blockBegin + block.size;
+    } else {
+        position = 0;
+        blockEnd = 0;
+    }
+}
+
+
+
+void ThreadArena::addToTotals()
+{
+    {
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        totals.allocationCount += statistics.allocationCount;
+        totals.allocatedBytes += statistics.allocatedBytes;
+        totals.blockCount += statistics.blockCount;
+        totals.blockBytes += statistics.blockBytes;
+    }
+    statistics = Statistics();
+}
+
+
+
+ThreadArena::Statistics ThreadArena::getTotals()
+{
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    return totals;
+}
+
+
+
+ThreadArena::Statistics ThreadArena::Statistics::operator-(const Statistics& that) const
+{
+    Statistics s;
+    s.allocationCount = allocationCount - that.allocationCount;
+    s.allocatedBytes = allocatedBytes - that.allocatedBytes;
+    s.blockCount = blockCount - that.blockCount;
+    s.blockBytes = blockBytes - that.blockBytes;
+    return s;
+}
@@ -0,0 +1,239 @@
+#ifndef CZI_SHASTA_THREAD_ARENA_HPP
+#define CZI_SHASTA_THREAD_ARENA_HPP
+
+/*******************************************************************************
+
+Class ThreadArena is a monotonic memory arena used by a single thread
+for the many short lived containers created while processing
+one item or one batch of a MultithreadedObject loop.
+
+Allocation just advances a pointer in the current block, and deallocation
+does nothing. The memory is reclaimed all at once when a ThreadArena::Scope
+is destroyed: the arena goes back to where it was when the Scope was created.
+The blocks are kept and reused, so in steady state
+processing an item does not call malloc at all.
+
+Each MultithreadedObject pool thread owns a ThreadArena,
+which is the current arena of the thread while it runs a thread function.
+Containers use it via ArenaAllocator, for example:
+
+void A::threadFunction(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            const ThreadArena::Scope arenaScope;
+            ArenaVector<uint32_t> v;
+            ArenaMap<uint32_t, uint64_t> m;
+            ...
+        }
+    }
+}
+
+The Scope must be created before the containers that use the arena,
+so it is destroyed after them, and containers that use the arena
+must not outlive the Scope. The arena is also reset
+at the end of each thread function.
+In threads without a current arena (for example, the main thread or
+the http server), ArenaAllocator uses the standard allocator,
+so code using arena containers can be called from anywhere.
+
+Each arena counts allocations, allocated bytes, and the blocks
+it obtained from malloc. The counts are added to process totals
+at the end of each thread function, and PerformanceReport
+reports them for each stage.
+
+*******************************************************************************/
+
+// Standard library.
+#include "cstddef.hpp"
+#include "cstdint.hpp"
+#include <functional>
+#include <map>
+#include <new>
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class ThreadArena;
+        template<class T> class ArenaAllocator;
+
+        template<class T> using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+        template<class Key, class T, class Compare = std::less<Key> > using ArenaMap =
+            std::map<Key, T, Compare, ArenaAllocator< std::pair<const Key, T> > >;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::ThreadArena {
+public:
+
+    ThreadArena() {}
+    ~ThreadArena();
+
+    // Disallow C++ copy and assignment.
+    ThreadArena(const ThreadArena&) = delete;
+    ThreadArena& operator=(const ThreadArena&) = delete;
+
+    void* allocate(size_t byteCount, size_t alignment)
+    {
+        // Fast path: the allocation fits in the current block.
+        if(blockIndex < blocks.size()) {
+            const uintptr_t p = (position + (alignment - 1)) & ~uintptr_t(alignment - 1);
+            if(p + byteCount <= blockEnd) {
+                position = p + byteCount;
+                ++statistics.allocationCount;
+                statistics.allocatedBytes += byteCount;
+                return reinterpret_cast<void*>(p);
+            }
+        }
+        return allocateSlow(byteCount, alignment);
+    }
+
+    // Release all allocations.
+    void reset()
+    {
+        rewind(0, 0);
+    }
+
+    // Scope used to release all allocations done during its lifetime,
+    // in the current arena of the calling thread (if any).
+    class Scope {
+    public:
+        Scope() : arena(current)
+        {
+            if(arena) {
+                blockIndex = arena->blockIndex;
+                position = arena->position;
+            }
+        }
+        ~Scope()
+        {
+            if(arena) {
+                arena->rewind(blockIndex, position);
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        ThreadArena* arena;
+        size_t blockIndex = 0;
+        uintptr_t position = 0;
+    };
+
+    // The current arena of the calling thread, or 0 if none.
+    static ThreadArena* getCurrent()
+    {
+        return current;
+    }
+
+    // Make this the current arena of the calling thread
+    // for the lifetime of this object.
+    class MakeCurrent {
+    public:
+        MakeCurrent(ThreadArena& arena) : previous(current)
+        {
+            current = &arena;
+        }
+        ~MakeCurrent()
+        {
+            current = previous;
+        }
+        MakeCurrent(const MakeCurrent&) = delete;
+        MakeCurrent& operator=(const MakeCurrent&) = delete;
+    private:
+        ThreadArena* previous;
+    };
+
+    class Statistics {
+    public:
+        uint64_t allocationCount = 0;   // Allocations served by the arena.
+        uint64_t allocatedBytes = 0;    // Bytes requested by those allocations.
+        uint64_t blockCount = 0;        // Blocks obtained from malloc.
+        uint64_t blockBytes = 0;        // Bytes in those blocks.
+        Statistics operator-(const Statistics&) const;
+    };
+
+    // Add the statistics of this arena to the process totals
+    // and zero them.
+    void addToTotals();
+
+    // The statistics of all arenas since the beginning of the process,
+    // as of the last call to addToTotals for each arena.
+    static Statistics getTotals();
+
+private:
+
+    // The blocks, obtained from malloc.
+    class Block {
+    public:
+        char* begin;
+        size_t size;
+    };
+    vector<Block> blocks;
+
+    // The block currently used for allocation, and the
+    // first free position and end of that block.
+    // Blocks after the current one are free and are reused.
+    size_t blockIndex = 0;
+    uintptr_t position = 0;
+    uintptr_t blockEnd = 0;
+
+    Statistics statistics;
+
+    // The first block allocated is of this size.
+    // Each new block is twice the size of the previous one,
+    // up to maxBlockSize, but always large enough for the allocation
+    // that requires it.
+    static const size_t firstBlockSize = 64 * 1024;
+    static const size_t maxBlockSize = 64 * 1024 * 1024;
+
+    void* allocateSlow(size_t byteCount, size_t alignment);
+    void rewind(size_t blockIndex, uintptr_t position);
+
+    static thread_local ThreadArena* current;
+};
+
+
+
+// Allocator that uses the current ThreadArena of the calling thread
+// at the time the allocator is constructed, or the standard allocator
+// if there is none.
+template<class T> class ChanZuckerberg::shasta::ArenaAllocator {
+public:
+    using value_type = T;
+
+    ArenaAllocator() : arena(ThreadArena::getCurrent()) {}
+    template<class U> ArenaAllocator(const ArenaAllocator<U>& that) : arena(that.arena) {}
+
+    T* allocate(size_t n)
+    {
+        if(arena) {
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        } else {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+    }
+    void deallocate(T* p, size_t)
+    {
+        if(!arena) {
+            ::operator delete(p);
+        }
+    }
+
+    template<class U> bool operator==(const ArenaAllocator<U>& that) const
+    {
+        return arena == that.arena;
+    }
+    template<class U> bool operator!=(const ArenaAllocator<U>& that) const
+    {
+        return arena != that.arena;
+    }
+
+private:
+    ThreadArena* arena;
+    template<class U> friend class ArenaAllocator;
+};
+
+#endif
@@ -0,0 +1,339 @@
+// Shasta.
+#include "ThreadLog.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "array.hpp"
+#include <condition_variable>
+#include "memory.hpp"
+#include <mutex>
+#include "stdexcept.hpp"
+#include <thread>
+#include "vector.hpp"
+
+
+
+std::atomic<ThreadLog::Level> ThreadLog::minimumLevel {ThreadLog::Level::info};
+
+
+
+// The ring buffer of a thread.
+// Entries [readIndex, writeIndex) contain messages not yet written out.
+// writeIndex is only modified by the thread that owns the ring buffer,
+// and readIndex only by the Drainer while holding its drainMutex.
+class ThreadLog::RingBuffer {
+public:
+    class Entry {
+    public:
+        uint64_t sequenceNumber;
+        Level level;
+        ostream* sink;
+        string text;
+    };
+    static const uint64_t capacity = 1024;
+    array<Entry, capacity> entries;
+    alignas(64) std::atomic<uint64_t> writeIndex {0};
+    alignas(64) std::atomic<uint64_t> readIndex {0};
+
+    bool isEmpty() const
+    {
+        return readIndex.load(std::memory_order_acquire) ==
+            writeIndex.load(std::memory_order_acquire);
+    }
+};
+
+
+
+class ThreadLog::Drainer {
+public:
+    Drainer();
+    ~Drainer();
+
+    // Register the ring buffer of a new thread.
+    void add(const shared_ptr<RingBuffer>&);
+
+    // Write out all queued messages. Holds drainMutex.
+    void drain();
+
+    // Used to wake up the background thread before its next scheduled drain.
+    void wakeUp()
+    {
+        condition.notify_one();
+    }
+
+    // Assigns a global order to messages written by different threads.
+    std::atomic<uint64_t> sequenceNumber {0};
+
+    // The number of messages dropped because a ring buffer was full.
+    std::atomic<uint64_t> droppedCount {0};
+
+private:
+
+    // The registered ring buffers, protected by ringBuffersMutex.
+    vector< shared_ptr<RingBuffer> > ringBuffers;
+    std::mutex ringBuffersMutex;
+
+    // Serializes draining between the background thread and flush.
+    std::mutex drainMutex;
+
+    // Entries being written out, only used while holding drainMutex.
+    vector<RingBuffer::Entry> entries;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool shouldStop = false;
+    void threadFunction();
+    static const uint64_t intervalMilliseconds = 50;
+};
+
+
+
+ThreadLog::Drainer& ThreadLog::getDrainer()
+{
+    static Drainer drainer;
+    return drainer;
+}
+
+
+
+ThreadLog::RingBuffer& ThreadLog::getRingBuffer()
+{
+    // The Drainer keeps a reference, so messages written
+    // just before the thread exits are still written out.
+    static thread_local shared_ptr<RingBuffer> ringBuffer;
+    if(!ringBuffer) {
+        ringBuffer = make_shared<RingBuffer>();
+        getDrainer().add(ringBuffer);
+    }
+    return *ringBuffer;
+}
+
+
+
+void ThreadLog::write(Level level, string text, ostream* sink)
+{
+    if(!isEnabled(level)) {
+        return;
+    }
+    RingBuffer& ringBuffer = getRingBuffer();
+    Drainer& drainer = getDrainer();
+
+    // Wait for room if the ring buffer is full, or drop the message.
+    const uint64_t writeIndex = ringBuffer.writeIndex.load(std::memory_order_relaxed);
+    while(writeIndex - ringBuffer.readIndex.load(std::memory_order_acquire) >= RingBuffer::capacity) {
+        if(level < Level::warning) {
+            drainer.droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        drainer.wakeUp();
+        std::this_thread::yield();
+    }
+
+    // Store the message, then publish it.
+    RingBuffer::Entry& entry = ringBuffer.entries[writeIndex % RingBuffer::capacity];
+    entry.sequenceNumber = drainer.sequenceNumber.fetch_add(1, std::memory_order_relaxed);
+    entry.level = level;
+    entry.sink = sink;
+    entry.text.swap(text);
+    ringBuffer.writeIndex.store(writeIndex + 1, std::memory_order_release);
+
+    // Don't wait for the next scheduled drain if the ring buffer is getting full.
+    if(writeIndex + 1 - ringBuffer.readIndex.load(std::memory_order_relaxed) ==
+        RingBuffer::capacity / 2) {
+        drainer.wakeUp();
+    }
+}
+
+
+
+void ThreadLog::flush()
+{
+    getDrainer().drain();
+}
+
+
+
+ThreadLog::Drainer::Drainer()
+{
+    thread = std::thread(&Drainer::threadFunction, this);
+}
+
+
+
+ThreadLog::Drainer::~Drainer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shouldStop = true;
+    }
+    condition.notify_all();
+    thread.join();
+    drain();
+}
+
+
+
+void ThreadLog::Drainer::add(const shared_ptr<RingBuffer>& ringBuffer)
+{
+    std::lock_guard<std::mutex> lock(ringBuffersMutex);
+    ringBuffers.push_back(ringBuffer);
+}
+
+
+
+void ThreadLog::Drainer::threadFunction()
+{
+    const auto interval = std::chrono::milliseconds(intervalMilliseconds);
+    std::unique_lock<std::mutex> lock(mutex);
+    while(!shouldStop) {
+        condition.wait_for(lock, interval);
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+
+
+
+void ThreadLog::Drainer::drain()
+{
+    std::lock_guard<std::mutex> drainLock(drainMutex);
+
+    // Get the ring buffers, removing the ones of threads that no longer exist
+    // and have no messages left.
+    vector< shared_ptr<RingBuffer> > ringBuffersCopy;
+    {
+        std::lock_guard<std::mutex> lock(ringBuffersMutex);
+        ringBuffers.erase(
+            remove_if(ringBuffers.begin(), ringBuffers.end(),
+                [](const shared_ptr<RingBuffer>& ringBuffer)
+                {
+                    return ringBuffer.use_count() == 1 && ringBuffer->isEmpty();
+                }),
+            ringBuffers.end());
+        ringBuffersCopy = ringBuffers;
+    }
+
+    // Gather the messages available in all ring buffers.
+    entries.clear();
+    for(const shared_ptr<RingBuffer>& ringBuffer: ringBuffersCopy) {
+        const uint64_t readIndex = ringBuffer->readIndex.load(std::memory_order_relaxed);
+        const uint64_t writeIndex = ringBuffer->writeIndex.load(std::memory_order_acquire);
+        for(uint64_t i=readIndex; i!=writeIndex; i++) {
+            RingBuffer::Entry& entry = ringBuffer->entries[i % RingBuffer::capacity];
+            entries.push_back(RingBuffer::Entry());
+            RingBuffer::Entry& copy = entries.back();
+            copy.sequenceNumber = entry.sequenceNumber;
+            copy.level = entry.level;
+            copy.sink = entry.sink;
+            copy.text.swap(entry.text);
+        }
+        ringBuffer->readIndex.store(writeIndex, std::memory_order_release);
+    }
+
+    // Write them out in the order in which they were written.
+    sort(entries.begin(), entries.end(),
+        [](const RingBuffer::Entry& x, const RingBuffer::Entry& y)
+        {
+            return x.sequenceNumber < y.sequenceNumber;
+        });
+    vector<ostream*> sinks;
+    for(const RingBuffer::Entry& entry: entries) {
+        ostream& s = entry.sink ? *entry.sink : cout;
+        try {
+            s << entry.text;
+            if(entry.text.empty() || entry.text.back() != '\n') {
+                s << '\n';
+            }
+        } catch(const std::exception& e) {
+            cout << "Error writing a log message: " << e.what() << endl;
+        }
+        if(find(sinks.begin(), sinks.end(), &s) == sinks.end()) {
+            sinks.push_back(&s);
+        }
+    }
+    for(ostream* s: sinks) {
+        try {
+            s->flush();
+        } catch(const std::exception& e) {
+            cout << "Error flushing log output: " << e.what() << endl;
+        }
+    }
+
+    const uint64_t n = droppedCount.exchange(0);
+    if(n > 0) {
+        cout << timestamp << n << " log messages were dropped "
+            "because they were written faster than they could be output." << endl;
+    }
+}
+
+
+
+ThreadLog::Stream::Stream(ostream& sink, Level level) :
+    ostream(0),
+    buffer(sink, level)
+{
+    rdbuf(&buffer);
+}
+
+
+
+ThreadLog::Stream::~Stream()
+{
+    buffer.pubsync();
+}
+
+
+
+int ThreadLog::Stream::Buffer::sync()
+{
+    if(!str().empty()) {
+        ThreadLog::write(level, str(), &sink);
+        str(string());
+    }
+    return 0;
+}
+
+
+
+void ThreadLog::setMinimumLevel(Level level)
+{
+    minimumLevel = level;
+}
+
+
+
+void ThreadLog::setMinimumLevel(const string& levelName)
+{
+    setMinimumLevel(parseLevel(levelName));
+}
+
+
+
+ThreadLog::Level ThreadLog::parseLevel(const string& s)
+{
+    for(const Level level: {Level::debug, Level::info, Level::warning, Level::error}) {
+        if(s == levelName(level)) {
+            return level;
+        }
+    }
+    throw runtime_error("Invalid log level " + s +
+        ". Must be one of debug, info, warning, error.");
+}
+
+
+
+const char* ThreadLog::levelName(Level level)
+{
+    switch(level) {
+    case Level::debug: return "debug";
+    case Level::info: return "info";
+    case Level::warning: return "warning";
+    case Level::error: return "error";
+    }
+    return "unknown";
+}
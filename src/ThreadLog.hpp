@@ -0,0 +1,139 @@
+#ifndef CZI_SHASTA_THREAD_LOG_HPP
+#define CZI_SHASTA_THREAD_LOG_HPP
+
+/*******************************************************************************
+
+Class ThreadLog is used by thread functions to write messages
+without locking and without doing any I/O.
+
+Each thread that writes a message gets its own ring buffer of messages.
+A message is formatted by the thread that writes it,
+then stored in the ring buffer of that thread.
+The ring buffer has a single producer (its thread)
+and a single consumer, so this only uses atomic loads and stores.
+A background thread drains all ring buffers periodically
+and writes the messages, in the order in which they were written,
+to cout or to the ostream specified for each message.
+The only locking happens when a thread writes its first message
+and its ring buffer is registered.
+
+Messages have a level, and messages with a level lower than
+the minimum level (default info) are discarded.
+If the ring buffer of a thread is full, debug and info messages
+are dropped (and the number of dropped messages is reported),
+while warning and error messages wait until the background thread
+makes room for them.
+
+Usage:
+
+ThreadLog::Message(ThreadLog::Level::info) << timestamp << "Processed " << n << " reads.";
+
+The message is queued when the temporary Message object is destroyed.
+A newline is added if the message does not end with one.
+
+MultithreadedObject::getLog also writes through ThreadLog,
+and MultithreadedObject::waitForThreads calls flush,
+so all messages written by the threads are written out
+before waitForThreads returns.
+
+*******************************************************************************/
+
+// Standard library.
+#include <atomic>
+#include "cstdint.hpp"
+#include "iostream.hpp"
+#include <sstream>
+#include "string.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class ThreadLog;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::ThreadLog {
+public:
+
+    enum class Level : uint8_t {
+        debug = 0,
+        info = 1,
+        warning = 2,
+        error = 3
+    };
+
+    // Messages with a lower level are discarded.
+    static void setMinimumLevel(Level);
+    static void setMinimumLevel(const string&);
+    static bool isEnabled(Level level)
+    {
+        return level >= minimumLevel.load(std::memory_order_relaxed);
+    }
+
+    // Convert between levels and their names.
+    static Level parseLevel(const string&);
+    static const char* levelName(Level);
+
+    // Queue a message to be written to the given ostream,
+    // or to cout if sink is null.
+    static void write(Level, string message, ostream* sink = 0);
+
+    // Write out all queued messages and flush the ostreams they were written to.
+    static void flush();
+
+    // Formats a message and queues it when destroyed.
+    class Message {
+    public:
+        Message(Level level = Level::info) : level(level) {}
+        ~Message()
+        {
+            if(isEnabled(level)) {
+                ThreadLog::write(level, s.str());
+            }
+        }
+        template<class T> Message& operator<<(const T& t)
+        {
+            s << t;
+            return *this;
+        }
+        Message& operator<<(ostream& (*manipulator)(ostream&))
+        {
+            manipulator(s);
+            return *this;
+        }
+    private:
+        Level level;
+        std::ostringstream s;
+    };
+
+    // An ostream that queues what is written to it, one message
+    // every time it is flushed (for example by endl),
+    // to be written to the given sink.
+    class Stream : public ostream {
+    public:
+        Stream(ostream& sink, Level = Level::info);
+        ~Stream();
+    private:
+        class Buffer : public std::stringbuf {
+        public:
+            Buffer(ostream& sink, Level level) : sink(sink), level(level) {}
+            int sync() override;
+        private:
+            ostream& sink;
+            Level level;
+        };
+        Buffer buffer;
+    };
+
+private:
+    static std::atomic<Level> minimumLevel;
+
+    // The ring buffer of a thread, and the background thread that drains them.
+    class RingBuffer;
+    class Drainer;
+    static RingBuffer& getRingBuffer();
+    static Drainer& getDrainer();
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "TrainedBayesianConsensusCaller.hpp"
 #include "Coverage.hpp"
+#include "filesystem.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
 
@@ -15,9 +16,43 @@ using namespace shasta;
 // In addition, there is assumed to be a header line with column titles.
 static const string trainedDistributionFilepath = "consensus_distribution";
 
+// The compiled form of the same file.
+static const string compiledDistributionFilepath = "consensus_distribution.bin";
+
 TrainedBayesianConsensusCaller::TrainedBayesianConsensusCaller()
 {
-    std::ifstream trainedDistributionFile(trainedDistributionFilepath);
+    // Use the compiled model if it is up to date.
+    // Otherwise, parse the text file and compile it.
+    // If the text file does not exist, the model is empty
+    // and is not stored.
+    if(!(isCompiledModelUpToDate(trainedDistributionFilepath, compiledDistributionFilepath) &&
+        accessCompiledModel(compiledDistributionFilepath))) {
+        compileModel(trainedDistributionFilepath,
+            filesystem::exists(trainedDistributionFilepath) ? compiledDistributionFilepath : string());
+    }
+    const CompiledModelHeader& header =
+        *reinterpret_cast<const CompiledModelHeader*>(compiledModel.begin());
+    maxRepeatCount = header.maxRepeatCount;
+    logConditionalProbabilities =
+        reinterpret_cast<const double*>(compiledModel.begin() + sizeof(CompiledModelHeader));
+
+    // Make vector of all possible homopolymer repeats
+    repeatBases.reserve(4 * maxRepeatCount + 1);
+    repeatBases.emplace_back(AlignedBase::fromCharacter('-'), 0);
+    for (char base : string("ACGT")) {
+        for (size_t len = 1; len <= maxRepeatCount; len++) {
+            repeatBases.emplace_back(AlignedBase::fromCharacter(base), len);
+        }
+    }
+}
+
+
+
+void TrainedBayesianConsensusCaller::compileModel(
+    const string& textFileName,
+    const string& binaryFileName)
+{
+    std::ifstream trainedDistributionFile(textFileName);
     
     std::string line;
     
@@ -68,19 +103,22 @@ TrainedBayesianConsensusCaller::TrainedBayesianConsensusCaller()
     }
     
     // Make vector of all possible homopolymer repeats
-    repeatBases.reserve(4 * maxRepeatCount + 1);
-    repeatBases.emplace_back(AlignedBase::fromCharacter('-'), 0);
-    for (char base : "ACGT") {
+    vector<Consensus> allRepeatBases;
+    allRepeatBases.reserve(4 * maxRepeatCount + 1);
+    allRepeatBases.emplace_back(AlignedBase::fromCharacter('-'), 0);
+    for (char base : string("ACGT")) {
         for (size_t len = 1; len <= maxRepeatCount; len++) {
-            repeatBases.emplace_back(AlignedBase::fromCharacter(base), len);
+            allRepeatBases.emplace_back(AlignedBase::fromCharacter(base), len);
         }
     }
     
     // Compute the conditional probability of each true run length base given each called run length base
-    for (const Consensus& calledRepeatBase : repeatBases) {
+    const size_t n = maxRepeatCount + 1;
+    vector<double> table(5 * n * 5 * n, std::numeric_limits<double>::quiet_NaN());
+    for (const Consensus& calledRepeatBase : allRepeatBases) {
         
         double normalizingFactor = 0.0;
-        for (const auto& trueRepeatBase : repeatBases) {
+        for (const auto& trueRepeatBase : allRepeatBases) {
             normalizingFactor += distribution[make_tuple(calledRepeatBase.base,
                                                          calledRepeatBase.repeatCount,
                                                          trueRepeatBase.base,
@@ -88,12 +126,52 @@ TrainedBayesianConsensusCaller::TrainedBayesianConsensusCaller()
         }
         double logNormalizingFactor = log(normalizingFactor);
         
-        for (const Consensus& trueRepeatBase : repeatBases) {
+        for (const Consensus& trueRepeatBase : allRepeatBases) {
             auto key = make_tuple(calledRepeatBase.base, calledRepeatBase.repeatCount,
                                   trueRepeatBase.base, trueRepeatBase.repeatCount);
-            logConditionalProbabilities[key] = log(distribution[key]) - logNormalizingFactor;
+            table[logConditionalProbabilityIndex(
+                calledRepeatBase.base, calledRepeatBase.repeatCount,
+                trueRepeatBase.base, trueRepeatBase.repeatCount)] =
+                log(distribution[key]) - logNormalizingFactor;
+        }
+    }
+
+    // Store the compiled model.
+    CompiledModelHeader header;
+    header.magicNumber = CompiledModelHeader::constantMagicNumber;
+    header.formatVersion = CompiledModelHeader::currentFormatVersion;
+    header.maxRepeatCount = maxRepeatCount;
+    header.padding.fill(0);
+    vector<char> image(sizeof(header) + table.size() * sizeof(double));
+    std::copy_n(reinterpret_cast<const char*>(&header), sizeof(header), image.begin());
+    std::copy_n(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(double),
+        image.begin() + sizeof(header));
+    createCompiledModel(binaryFileName, image, compiledModel);
+}
+
+
+
+// Map an existing compiled model.
+// Returns false if it was created with a different format version.
+bool TrainedBayesianConsensusCaller::accessCompiledModel(const string& binaryFileName)
+{
+    try {
+        compiledModel.accessExistingReadOnly(binaryFileName);
+    } catch(...) {
+        return false;
+    }
+    if(compiledModel.size() >= sizeof(CompiledModelHeader)) {
+        const CompiledModelHeader& header =
+            *reinterpret_cast<const CompiledModelHeader*>(compiledModel.begin());
+        const size_t n = header.maxRepeatCount + 1;
+        if(header.magicNumber == CompiledModelHeader::constantMagicNumber &&
+            header.formatVersion == CompiledModelHeader::currentFormatVersion &&
+            compiledModel.size() == sizeof(CompiledModelHeader) + 5 * n * 5 * n * sizeof(double)) {
+            return true;
         }
     }
+    compiledModel.close();
+    return false;
 }
 
 
@@ -124,10 +202,16 @@ Consensus TrainedBayesianConsensusCaller::operator()(
                 calledLookupBase = observation.base;
             }
             
-            logLikelihood += logConditionalProbabilities.at(make_tuple(calledLookupBase,
-                                                                       observation.repeatCount,
-                                                                       trueLookupBase,
-                                                                       trueRepeatBase.repeatCount));
+            // The called homopolymer must be one for which the model has probabilities.
+            if (observation.repeatCount > maxRepeatCount ||
+                calledLookupBase.isGap() != (observation.repeatCount == 0)) {
+                throw std::out_of_range("TrainedBayesianConsensusCaller: no probability available for " +
+                    string(1, calledLookupBase.character()) + " with repeat count " +
+                    std::to_string(observation.repeatCount));
+            }
+            logLikelihood += logConditionalProbabilities[logConditionalProbabilityIndex(
+                calledLookupBase, observation.repeatCount,
+                trueLookupBase, trueRepeatBase.repeatCount)];
         }
         
         // Identify the maximum likelihood consensus
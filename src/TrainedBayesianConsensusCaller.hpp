@@ -6,8 +6,15 @@
 Class TrainedBayesianConsensusCaller uses a Bayesian approach
 developed by Jordan Eizenga at UCSC.
 
+The trained distribution is read from file consensus_distribution
+in the run directory and compiled to consensus_distribution.bin,
+which contains the table of log conditional probabilities.
+Subsequent instances only map the binary file read-only,
+without parsing the text file (see CompiledModel.hpp).
+
 *******************************************************************************/
 
+#include "CompiledModel.hpp"
 #include "ConsensusCaller.hpp"
 
 #include <cmath>
@@ -17,6 +24,7 @@ developed by Jordan Eizenga at UCSC.
 #include <string>
 #include <map>
 
+#include "array.hpp"
 #include "tuple.hpp"
 #include "vector.hpp"
 
@@ -33,12 +41,14 @@ public:
 
     // The constructor does not have any parameters.
     // All data should be read from a file with fixed name
-    // in the run directory. We will update the documentation accordingly.
+    // in the run directory, or from its compiled form
+    // if that is up to date. We will update the documentation accordingly.
     TrainedBayesianConsensusCaller();
 
     // Function that does the computation for a given alignment position.
     // The Coverage object contains all the necessary information.
     virtual Consensus operator()(const Coverage&) const;
+    using ConsensusCaller::operator();
 
 private:
     
@@ -48,9 +58,46 @@ private:
     // Convenience vector that contains all possible homopolymer calls
     vector<Consensus> repeatBases;
     
-    // Memo of the log(prob) of a called homopolymer given a true homopolymer
-    std::map<tuple<AlignedBase, size_t, AlignedBase, size_t>, double> logConditionalProbabilities;
+    // The compiled model, memory mapped from consensus_distribution.bin.
+    // It begins with a CompiledModelHeader, followed by the
+    // log(prob) of a called homopolymer given a true homopolymer
+    // for all combinations of bases (including the gap)
+    // and repeat counts up to maxRepeatCount.
+    // Entries for combinations that are not valid homopolymers
+    // (a gap with non-zero repeat count, or a base with zero repeat count)
+    // are not used.
+    class CompiledModelHeader {
+    public:
+        static const uint64_t constantMagicNumber = 0x7c41e9a3d2b6f058ULL;
+        static const uint64_t currentFormatVersion = 1;
+        uint64_t magicNumber;
+        uint64_t formatVersion;
+        uint64_t maxRepeatCount;
+        array<uint64_t, 5> padding;
+    };
+    static_assert(sizeof(CompiledModelHeader) % 64 == 0,
+        "Unexpected size of TrainedBayesianConsensusCaller::CompiledModelHeader.");
+    MemoryMapped::Vector<char> compiledModel;
+    const double* logConditionalProbabilities;
+
+    // Index in logConditionalProbabilities of the log(prob) for a
+    // called homopolymer given a true homopolymer.
+    size_t logConditionalProbabilityIndex(
+        AlignedBase calledBase,
+        size_t calledRepeatCount,
+        AlignedBase trueBase,
+        size_t trueRepeatCount) const
+    {
+        const size_t n = maxRepeatCount + 1;
+        return ((size_t(calledBase.value) * n + calledRepeatCount) * 5 +
+            size_t(trueBase.value)) * n + trueRepeatCount;
+    }
+
+    // Parse the text file and compile it.
+    void compileModel(const string& textFileName, const string& binaryFileName);
 
+    // Map an existing compiled model. Returns false if it is not usable.
+    bool accessCompiledModel(const string& binaryFileName);
 };
 
 #endif
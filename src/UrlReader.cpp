@@ -0,0 +1,184 @@
+// Shasta.
+#include "UrlReader.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "array.hpp"
+#include <atomic>
+#include <cstdio>
+#include <sstream>
+#include "stdexcept.hpp"
+#include <thread>
+#include "vector.hpp"
+
+
+
+UrlReader::UrlReader(
+    const string& urlArgument,
+    size_t connectionCount,
+    size_t requestSize) :
+    connectionCount(max(size_t(1), connectionCount)),
+    requestSize(requestSize)
+{
+    // Translate object storage URLs to their public https endpoints.
+    if(urlArgument.substr(0, 5) == "s3://") {
+        const size_t slashPosition = urlArgument.find('/', 5);
+        if(slashPosition == string::npos) {
+            throw runtime_error("Invalid S3 URL " + urlArgument);
+        }
+        url = "https://" + urlArgument.substr(5, slashPosition - 5) +
+            ".s3.amazonaws.com" + urlArgument.substr(slashPosition);
+    } else if(urlArgument.substr(0, 5) == "gs://") {
+        url = "https://storage.googleapis.com/" + urlArgument.substr(5);
+    } else {
+        url = urlArgument;
+    }
+
+    // Request the first byte and get the size of the file
+    // from the Content-Range response header, which looks like this:
+    // Content-Range: bytes 0-0/123456789
+    // With redirects, there is a set of headers for each response,
+    // and we use the last one.
+    const string command = "curl --silent --show-error --fail --location "
+        "--range 0-0 --dump-header - --output /dev/null " + shellQuote(url);
+    FILE* pipe = ::popen(command.c_str(), "r");
+    if(!pipe) {
+        throw runtime_error("Error running curl to access " + url);
+    }
+    string headers;
+    array<char, 4096> buffer;
+    size_t n;
+    while((n = fread(buffer.data(), 1, buffer.size(), pipe)) > 0) {
+        headers.append(buffer.data(), n);
+    }
+    const int status = ::pclose(pipe);
+    if(status != 0) {
+        throw runtime_error("Error accessing " + url +
+            ". Make sure curl is installed and the URL allows read access.");
+    }
+    bool found = false;
+    std::istringstream s(headers);
+    string line;
+    while(getline(s, line)) {
+        const string key = "content-range:";
+        if(line.size() < key.size()) {
+            continue;
+        }
+        string lineKey = line.substr(0, key.size());
+        std::transform(lineKey.begin(), lineKey.end(), lineKey.begin(), ::tolower);
+        if(lineKey != key) {
+            continue;
+        }
+        const size_t slashPosition = line.find('/');
+        if(slashPosition != string::npos && ::isdigit(line[slashPosition + 1])) {
+            fileSize = std::stoull(line.substr(slashPosition + 1));
+            found = true;
+        }
+    }
+    if(!found) {
+        throw runtime_error("The server for " + url + " does not support range requests.");
+    }
+}
+
+
+
+bool UrlReader::isUrl(const string& name)
+{
+    for(const char* prefix: {"http://", "https://", "s3://", "gs://"}) {
+        if(name.compare(0, string(prefix).size(), prefix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+// Read exactly byteCount bytes starting at the given offset,
+// using parallel requests.
+void UrlReader::read(char* buffer, size_t byteCount, size_t offset) const
+{
+    if(offset + byteCount > fileSize) {
+        throw runtime_error("Attempt to read beyond the end of " + url);
+    }
+    const size_t requestCount = (byteCount + requestSize - 1) / requestSize;
+    std::atomic<size_t> nextRequest(0);
+    std::atomic<bool> failed(false);
+
+    // Each thread processes requests until there are no more,
+    // or until one of them fails.
+    auto threadFunction = [&]()
+    {
+        while(!failed) {
+            const size_t i = nextRequest++;
+            if(i >= requestCount) {
+                return;
+            }
+            const size_t begin = i * requestSize;
+            const size_t n = min(requestSize, byteCount - begin);
+            bool success = false;
+            for(size_t attempt=0; attempt<maxAttemptCount && !success; attempt++) {
+                success = readRange(buffer + begin, n, offset + begin);
+            }
+            if(!success) {
+                failed = true;
+            }
+        }
+    };
+    vector<std::thread> threads;
+    for(size_t t=0; t<min(connectionCount, requestCount); t++) {
+        threads.push_back(std::thread(threadFunction));
+    }
+    for(std::thread& thread: threads) {
+        thread.join();
+    }
+    if(failed) {
+        throw runtime_error("Error reading " + to_string(byteCount) +
+            " bytes at offset " + to_string(offset) + " from " + url);
+    }
+}
+
+
+
+bool UrlReader::readRange(char* buffer, size_t byteCount, size_t offset) const
+{
+    const string command = "curl --silent --show-error --fail --location "
+        "--range " + to_string(offset) + "-" + to_string(offset + byteCount - 1) +
+        " " + shellQuote(url);
+    FILE* pipe = ::popen(command.c_str(), "r");
+    if(!pipe) {
+        return false;
+    }
+    size_t totalCount = 0;
+    while(totalCount < byteCount) {
+        const size_t n = fread(buffer + totalCount, 1, byteCount - totalCount, pipe);
+        if(n == 0) {
+            break;
+        }
+        totalCount += n;
+    }
+
+    // If the server ignored the range request,
+    // there can be more data, which we don't read.
+    const bool extraData = (totalCount == byteCount) && (fgetc(pipe) != EOF);
+    const int status = ::pclose(pipe);
+    return status == 0 && totalCount == byteCount && !extraData;
+}
+
+
+
+string UrlReader::shellQuote(const string& s)
+{
+    string quoted = "'";
+    for(const char c: s) {
+        if(c == '\'') {
+            quoted += "'\\''";
+        } else {
+            quoted += c;
+        }
+    }
+    quoted += "'";
+    return quoted;
+}
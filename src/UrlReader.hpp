@@ -0,0 +1,79 @@
+#ifndef CZI_SHASTA_URL_READER_HPP
+#define CZI_SHASTA_URL_READER_HPP
+
+/*******************************************************************************
+
+Class UrlReader reads ranges of a file served over HTTP or HTTPS,
+using HTTP range requests. This allows ReadLoader to read input
+directly from object storage, without staging it to local disk first.
+
+The requests are done by curl processes, so no library dependency
+is required, and all protocols and proxies supported by curl can be used.
+A large range is split into requests of requestSize bytes,
+and up to connectionCount of them run in parallel.
+Each request writes directly to its portion of the destination buffer.
+Failed requests are retried a few times.
+
+Besides http:// and https:// URLs, the following are also accepted:
+- s3://bucket/key, read as https://bucket.s3.amazonaws.com/key.
+- gs://bucket/key, read as https://storage.googleapis.com/bucket/key.
+These only work for objects that allow anonymous read access.
+For private objects, use a presigned https URL.
+
+*******************************************************************************/
+
+// Standard library.
+#include "cstddef.hpp"
+#include "string.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+        class UrlReader;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::UrlReader {
+public:
+
+    // Find the size of the file with a range request
+    // for its first byte, which also checks that the server
+    // supports range requests.
+    UrlReader(
+        const string& url,
+        size_t connectionCount = 16,
+        size_t requestSize = 64 * 1024 * 1024);
+
+    // Return true if the name is a URL that can be read by this class.
+    static bool isUrl(const string& name);
+
+    size_t size() const
+    {
+        return fileSize;
+    }
+    size_t getConnectionCount() const
+    {
+        return connectionCount;
+    }
+
+    // Read exactly byteCount bytes starting at the given offset.
+    void read(char* buffer, size_t byteCount, size_t offset) const;
+
+private:
+    string url;
+    size_t connectionCount;
+    size_t requestSize;
+    size_t fileSize;
+
+    // Read one range with a single request. Returns false in case of failure.
+    bool readRange(char* buffer, size_t byteCount, size_t offset) const;
+
+    // The number of attempts for each range before giving up.
+    static const size_t maxAttemptCount = 4;
+
+    // Quote a string for the shell.
+    static string shellQuote(const string&);
+};
+
+#endif
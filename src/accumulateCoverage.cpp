@@ -0,0 +1,186 @@
+#include "accumulateCoverage.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "iostream.hpp"
+#include <random>
+#include "utility.hpp"
+#include "vector.hpp"
+
+// Intrinsics for the vectorized versions, x86-64 only.
+// These are compiled with function-level target attributes,
+// so they don't require compiling the whole file
+// with -mavx2 or -mavx512f, and the appropriate version is selected
+// at run time based on the capabilities of the CPU.
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        using AccumulateCoverageFunction = void (*)(
+            const uint16_t* counts,
+            uint32_t* coverage,
+            size_t n);
+
+
+
+        // Scalar version, one count at a time.
+        void accumulateCoverageScalar(
+            const uint16_t* counts,
+            uint32_t* coverage,
+            size_t n)
+        {
+            for(size_t i=0; i<n; i++) {
+                coverage[i] += counts[i];
+            }
+        }
+
+
+
+#if defined(__x86_64__)
+
+        // AVX2 version, 8 counts at a time.
+        __attribute__((target("avx2"))) void accumulateCoverageAvx2(
+            const uint16_t* counts,
+            uint32_t* coverage,
+            size_t n)
+        {
+            size_t i = 0;
+            for(; i+8<=n; i+=8) {
+                const __m256i c = _mm256_cvtepu16_epi32(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i)));
+                __m256i* p = reinterpret_cast<__m256i*>(coverage + i);
+                _mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), c));
+            }
+            accumulateCoverageScalar(counts + i, coverage + i, n - i);
+        }
+
+
+
+        // AVX-512 version, 16 counts at a time.
+        // The pragmas suppress spurious warnings that some versions
+        // of gcc generate from the AVX-512 intrinsics headers.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+        __attribute__((target("avx512f"))) void accumulateCoverageAvx512(
+            const uint16_t* counts,
+            uint32_t* coverage,
+            size_t n)
+        {
+            size_t i = 0;
+            for(; i+16<=n; i+=16) {
+                const __m512i c = _mm512_cvtepu16_epi32(
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counts + i)));
+                uint32_t* p = coverage + i;
+                _mm512_storeu_si512(p, _mm512_add_epi32(_mm512_loadu_si512(p), c));
+            }
+            accumulateCoverageScalar(counts + i, coverage + i, n - i);
+        }
+#pragma GCC diagnostic pop
+
+#endif
+
+
+
+        // Select the best available version for this CPU.
+        // This is done once, the first time it is needed.
+        class AccumulateCoverageFunctionSelector {
+        public:
+            AccumulateCoverageFunction function;
+            const char* name;
+            AccumulateCoverageFunctionSelector()
+            {
+#if defined(__x86_64__)
+                __builtin_cpu_init();
+                if(__builtin_cpu_supports("avx512f")) {
+                    function = accumulateCoverageAvx512;
+                    name = "AVX-512";
+                } else if(__builtin_cpu_supports("avx2")) {
+                    function = accumulateCoverageAvx2;
+                    name = "AVX2";
+                } else {
+                    function = accumulateCoverageScalar;
+                    name = "scalar";
+                }
+#else
+                function = accumulateCoverageScalar;
+                name = "scalar";
+#endif
+            }
+        };
+        inline const AccumulateCoverageFunctionSelector& getAccumulateCoverageFunctionSelector()
+        {
+            static const AccumulateCoverageFunctionSelector selector;
+            return selector;
+        }
+
+    }
+}
+
+
+
+void ChanZuckerberg::shasta::accumulateCoverage(
+    const uint16_t* counts,
+    uint32_t* coverage,
+    size_t n)
+{
+    (*getAccumulateCoverageFunctionSelector().function)(counts, coverage, n);
+}
+
+
+
+const char* ChanZuckerberg::shasta::accumulateCoverageImplementation()
+{
+    return getAccumulateCoverageFunctionSelector().name;
+}
+
+
+
+void ChanZuckerberg::shasta::testAccumulateCoverage()
+{
+    // The versions to be tested.
+    vector< pair<AccumulateCoverageFunction, const char*> > functions;
+    functions.push_back(make_pair(accumulateCoverageScalar, "scalar"));
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        functions.push_back(make_pair(accumulateCoverageAvx2, "AVX2"));
+    }
+    if(__builtin_cpu_supports("avx512f")) {
+        functions.push_back(make_pair(accumulateCoverageAvx512, "AVX-512"));
+    }
+#endif
+
+    std::mt19937 randomSource;
+    vector<uint16_t> counts;
+    vector<uint32_t> coverage;
+    vector<uint32_t> expectedCoverage;
+    for(const auto& p: functions) {
+        cout << "Testing " << p.second << " version of accumulateCoverage." << endl;
+        for(size_t n=0; n<100; n++) {
+
+            // Use vectors of exactly the required size, so
+            // out of bounds accesses can be found using a memory checker.
+            counts.resize(n);
+            coverage.resize(n);
+            for(size_t i=0; i<n; i++) {
+                counts[i] = uint16_t(randomSource());
+                coverage[i] = uint32_t(randomSource() >> 1);
+            }
+            expectedCoverage = coverage;
+            for(size_t i=0; i<n; i++) {
+                expectedCoverage[i] += counts[i];
+            }
+            (*p.first)(counts.data(), coverage.data(), n);
+            CZI_ASSERT(coverage == expectedCoverage);
+        }
+    }
+    cout << "accumulateCoverage test passed. Using the " <<
+        accumulateCoverageImplementation() << " version on this CPU." << endl;
+}
@@ -0,0 +1,32 @@
+#ifndef CZI_SHASTA_ACCUMULATE_COVERAGE_HPP
+#define CZI_SHASTA_ACCUMULATE_COVERAGE_HPP
+
+#include "cstdint.hpp"
+#include "cstddef.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+    // Add n 16-bit coverage counts to n 32-bit totals:
+    // coverage[i] += counts[i] for i in [0, n).
+    // This is the inner loop of CoverageTensor::computeBaseCoverage.
+    // It widens and adds 16 counts at a time using AVX-512
+    // or 8 at a time using AVX2, selected at run time based
+    // on the capabilities of the CPU, with a scalar fallback.
+    void accumulateCoverage(
+        const uint16_t* counts,
+        uint32_t* coverage,
+        size_t n);
+
+    // Return the name of the implementation used by
+    // accumulateCoverage on this CPU.
+    const char* accumulateCoverageImplementation();
+
+    // Check all versions available on this CPU
+    // against the scalar version.
+    void testAccumulateCoverage();
+
+    }
+}
+
+#endif
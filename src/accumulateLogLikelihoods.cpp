@@ -0,0 +1,186 @@
+#include "accumulateLogLikelihoods.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include <cstring>
+#include "iostream.hpp"
+#include <limits>
+#include <random>
+#include "utility.hpp"
+#include "vector.hpp"
+
+// Intrinsics for the vectorized version, x86-64 only.
+// It is compiled with a function-level target attribute,
+// so it does not require compiling the whole file
+// with -mavx2, and it is selected
+// at run time based on the capabilities of the CPU.
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        using AccumulateLogLikelihoodsFunction = void (*)(
+            const double* observations,
+            double logLikelihood,
+            double* logSums,
+            size_t n);
+
+
+
+        // Scalar version, one sum at a time.
+        void accumulateLogLikelihoodsScalar(
+            const double* observations,
+            double logLikelihood,
+            double* logSums,
+            size_t n)
+        {
+            for(size_t i=0; i<n; i++) {
+                if(observations[i] != 0.) {
+                    logSums[i] += observations[i] * logLikelihood;
+                }
+            }
+        }
+
+
+
+#if defined(__x86_64__)
+
+        // AVX2 version, 4 sums at a time.
+        // The sums are computed for all lanes, then the lanes
+        // with no observations keep their previous value.
+        // The multiply and the add are separate instructions,
+        // as in the scalar version, so the results are identical.
+        // There is no AVX-512 version, because
+        // with AVX-512 gcc can contract them into a fused multiply-add,
+        // which would change the results in the last bit.
+        __attribute__((target("avx2"))) void accumulateLogLikelihoodsAvx2(
+            const double* observations,
+            double logLikelihood,
+            double* logSums,
+            size_t n)
+        {
+            const __m256d p = _mm256_set1_pd(logLikelihood);
+            const __m256d zero = _mm256_setzero_pd();
+            size_t i = 0;
+            for(; i+4<=n; i+=4) {
+                const __m256d x = _mm256_loadu_pd(observations + i);
+                const __m256d s = _mm256_loadu_pd(logSums + i);
+                const __m256d isObserved = _mm256_cmp_pd(x, zero, _CMP_NEQ_UQ);
+                const __m256d sum = _mm256_add_pd(s, _mm256_mul_pd(x, p));
+                _mm256_storeu_pd(logSums + i, _mm256_blendv_pd(s, sum, isObserved));
+            }
+            accumulateLogLikelihoodsScalar(observations + i, logLikelihood, logSums + i, n - i);
+        }
+
+#endif
+
+
+
+        // Select the best available version for this CPU.
+        // This is done once, the first time it is needed.
+        class AccumulateLogLikelihoodsFunctionSelector {
+        public:
+            AccumulateLogLikelihoodsFunction function;
+            const char* name;
+            AccumulateLogLikelihoodsFunctionSelector()
+            {
+#if defined(__x86_64__)
+                __builtin_cpu_init();
+                if(__builtin_cpu_supports("avx2")) {
+                    function = accumulateLogLikelihoodsAvx2;
+                    name = "AVX2";
+                } else {
+                    function = accumulateLogLikelihoodsScalar;
+                    name = "scalar";
+                }
+#else
+                function = accumulateLogLikelihoodsScalar;
+                name = "scalar";
+#endif
+            }
+        };
+        inline const AccumulateLogLikelihoodsFunctionSelector& getAccumulateLogLikelihoodsFunctionSelector()
+        {
+            static const AccumulateLogLikelihoodsFunctionSelector selector;
+            return selector;
+        }
+
+    }
+}
+
+
+
+void ChanZuckerberg::shasta::accumulateLogLikelihoods(
+    const double* observations,
+    double logLikelihood,
+    double* logSums,
+    size_t n)
+{
+    (*getAccumulateLogLikelihoodsFunctionSelector().function)(observations, logLikelihood, logSums, n);
+}
+
+
+
+const char* ChanZuckerberg::shasta::accumulateLogLikelihoodsImplementation()
+{
+    return getAccumulateLogLikelihoodsFunctionSelector().name;
+}
+
+
+
+void ChanZuckerberg::shasta::testAccumulateLogLikelihoods()
+{
+    // The versions to be tested.
+    vector< pair<AccumulateLogLikelihoodsFunction, const char*> > functions;
+    functions.push_back(make_pair(accumulateLogLikelihoodsScalar, "scalar"));
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        functions.push_back(make_pair(accumulateLogLikelihoodsAvx2, "AVX2"));
+    }
+#endif
+
+    // The log likelihoods used, including -infinity,
+    // which must not contribute where there are no observations.
+    std::mt19937 randomSource;
+    std::uniform_real_distribution<double> logLikelihoodDistribution(-20., 0.);
+    vector<double> logLikelihoods = {0., -std::numeric_limits<double>::infinity()};
+    for(size_t i=0; i<10; i++) {
+        logLikelihoods.push_back(logLikelihoodDistribution(randomSource));
+    }
+
+    vector<double> observations;
+    vector<double> logSums;
+    vector<double> expectedLogSums;
+    for(const auto& p: functions) {
+        cout << "Testing " << p.second << " version of accumulateLogLikelihoods." << endl;
+        for(size_t n=0; n<50; n++) {
+            for(const double logLikelihood: logLikelihoods) {
+
+                // Use vectors of exactly the required size, so
+                // out of bounds accesses can be found using a memory checker.
+                // About half of the observations are zero.
+                observations.resize(n);
+                logSums.resize(n);
+                for(size_t i=0; i<n; i++) {
+                    observations[i] = double(randomSource() % 2 ? 0 : randomSource() % 100);
+                    logSums[i] = logLikelihoodDistribution(randomSource);
+                }
+                expectedLogSums = logSums;
+                accumulateLogLikelihoodsScalar(observations.data(), logLikelihood, expectedLogSums.data(), n);
+                (*p.first)(observations.data(), logLikelihood, logSums.data(), n);
+
+                // Compare the bits, so -infinity compares as expected.
+                CZI_ASSERT(n == 0 || ::memcmp(logSums.data(), expectedLogSums.data(), n*sizeof(double)) == 0);
+            }
+        }
+    }
+    cout << "accumulateLogLikelihoods test passed. Using the " <<
+        accumulateLogLikelihoodsImplementation() << " version on this CPU." << endl;
+}
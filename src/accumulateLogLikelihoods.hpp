@@ -0,0 +1,36 @@
+#ifndef CZI_SHASTA_ACCUMULATE_LOG_LIKELIHOODS_HPP
+#define CZI_SHASTA_ACCUMULATE_LOG_LIKELIHOODS_HPP
+
+#include "cstddef.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+    // Add to n log likelihood sums the contribution of a number of observations
+    // with a given log likelihood:
+    // if(observations[i] != 0) logSums[i] += observations[i] * logLikelihood.
+    // Observations equal to zero are skipped, so a log likelihood
+    // of -infinity does not contribute NaNs.
+    // This is the inner loop of the SimpleBayesianConsensusCaller
+    // for a CoverageTensor.
+    // It processes 4 sums at a time using AVX2, selected at run time
+    // based on the capabilities of the CPU, with a scalar fallback.
+    // All versions give exactly the same results.
+    void accumulateLogLikelihoods(
+        const double* observations,
+        double logLikelihood,
+        double* logSums,
+        size_t n);
+
+    // Return the name of the implementation used by
+    // accumulateLogLikelihoods on this CPU.
+    const char* accumulateLogLikelihoodsImplementation();
+
+    // Check all versions available on this CPU
+    // against the scalar version.
+    void testAccumulateLogLikelihoods();
+
+    }
+}
+
+#endif
@@ -44,18 +44,36 @@ and therefore excluded from the topological sort.
 As an example, if the input graph consists of a single cycle,
 Only the last edge processed will be classified as causing a cycle.
 
+The same algorithm is also available incrementally via class
+ApproximateTopologicalSort, which keeps the topological sort
+and its work areas between calls. After initialize (or after
+a call to approximateTopologicalSort, which uses it),
+edges can be added one at a time with addEdge,
+and vertices with addVertex. When an edge is removed
+from the DAG with removeEdge, the topological sort remains valid
+and is not changed. Removing an edge does not cause edges previously
+excluded because they caused cycles to be reconsidered.
+To reconsider them, call addEdge for them again.
+This way, when a graph is modified by adding or removing a few edges,
+the topological sort can be updated at a cost proportional to the
+affected region, instead of recomputing it from scratch.
+
 ********************************************************************************/
 
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/filtered_graph.hpp>
 #include <boost/graph/iteration_macros.hpp>
 
+#include "algorithm.hpp"
 #include <stack>
+#include "stdexcept.hpp"
+#include "utility.hpp"
 #include "vector.hpp"
 
 namespace ChanZuckerberg {
     namespace shasta {
         template<class Graph> class ApproximateTopologicalSortEdgePredicate;
+        template<class Graph> class ApproximateTopologicalSort;
         template<class Graph> void approximateTopologicalSort(
             Graph&,
             const vector<typename Graph::edge_descriptor>&);
@@ -77,36 +95,65 @@ public:
 
 
 
-template<class Graph> void ChanZuckerberg::shasta::approximateTopologicalSort(
-    Graph& graph,
-    const vector<typename Graph::edge_descriptor>& edgesToProcess)
-{
-    // Type names for readability.
+template<class Graph> class ChanZuckerberg::shasta::ApproximateTopologicalSort {
+public:
     using vertex_descriptor = typename Graph::vertex_descriptor;
     using edge_descriptor = typename Graph::edge_descriptor;
 
-    // Initialize.
-    size_t rank = 0;
-    BGL_FORALL_VERTICES_T(v, graph, Graph) {
+    ApproximateTopologicalSort(Graph& graph) :
+        graph(graph),
+        filteredGraph(graph, ApproximateTopologicalSortEdgePredicate<Graph>(graph))
+    {}
+
+    // Assign initial ranks to all vertices and
+    // remove all edges from the DAG.
+    void initialize();
+
+    // Assign a rank to a vertex added to the graph after initialize.
+    void addVertex(vertex_descriptor v)
+    {
         auto& vertex = graph[v];
         vertex.color = 0;
-        vertex.rank = rank++;
+        vertex.rank = nextRank++;
     }
-    BGL_FORALL_EDGES_T(e, graph, Graph) {
+
+    // Add an edge to the DAG, updating the topological sort,
+    // unless it would create a cycle.
+    // Sets isDagEdge for the edge and returns its value.
+    bool addEdge(edge_descriptor);
+
+    // Add edges in the specified order.
+    void addEdges(const vector<edge_descriptor>& edges)
+    {
+        for(const edge_descriptor e: edges) {
+            addEdge(e);
+        }
+    }
+
+    // Remove an edge from the DAG. This must be called
+    // before the edge is removed from the graph.
+    // The topological sort remains valid and is not changed.
+    void removeEdge(edge_descriptor e)
+    {
         graph[e].isDagEdge = false;
     }
 
-    // We will work with a filtered graph that includes only the edges
-    // that we have already processed and that did not introduce cycles.
-    using EdgePredicate = ApproximateTopologicalSortEdgePredicate<Graph>;
-    const EdgePredicate edgePredicate(graph);
-    using FilteredGraph = boost::filtered_graph<Graph, EdgePredicate>;
-    FilteredGraph filteredGraph(graph, edgePredicate);
+private:
+    Graph& graph;
+
+    // The graph that includes only the edges
+    // that were added and did not introduce cycles.
+    using FilteredGraph = boost::filtered_graph<Graph, ApproximateTopologicalSortEdgePredicate<Graph> >;
+    FilteredGraph filteredGraph;
+
+    // The rank to be assigned to the next vertex added.
+    size_t nextRank = 0;
+
+    // Work areas, kept between calls to reduce memory allocation activity.
 
     // Vectors to hold deltaF and deltaB
     // (see definition 2.6 in the paper).
     // Stored as pairs (rank, vertex descriptor).
-    // Defined here outside the loop to reduce memory allocation activity.
     vector< pair<size_t, vertex_descriptor> > deltaF;
     vector< pair<size_t, vertex_descriptor> > deltaB;
 
@@ -115,123 +162,147 @@ template<class Graph> void ChanZuckerberg::shasta::approximateTopologicalSort(
 
     // Stack used for DFS's.
     std::stack<vertex_descriptor> vertexStack;
+};
 
-    // Loop over the given edges in the specified order.
-    for(const edge_descriptor e: edgesToProcess) {
-        const vertex_descriptor vX = source(e, graph);
-        const vertex_descriptor vY = target(e, graph);
-        auto& vertexX = graph[vX];
-        auto& vertexY = graph[vY];
-
-        // If this edge is consistent with the existing rank,
-        // just mark the edge as belonging to the DAG.
-        // The topological sort is not affected.
-        if(vertexX.rank < vertexY.rank) {
-            graph[e].isDagEdge = true;
-            continue;
-        }
 
-        deltaRanks.clear();
 
-        // Use a forward DFS starting at vY, and limited to the affected region,
-        // to compute deltaF (see definition 2.6 in the paper).
-        deltaF.clear();
-        if(!vertexStack.empty()) {
-            throw runtime_error("Vertex stack is not empty.");
-        }
-        vertexStack.push(vY);
-        deltaF.push_back(make_pair(vertexY.rank, vY));
-        deltaRanks.push_back(vertexY.rank);
-        graph[vY].color = 1;
-        while(!vertexStack.empty()) {
-            const vertex_descriptor v0 = vertexStack.top();
-            vertexStack.pop();
-            BGL_FORALL_OUTEDGES_T(v0, e01, filteredGraph, FilteredGraph) {
-                const vertex_descriptor v1 = target(e01, graph);
-                auto& vertex1 = graph[v1];
-                if(vertex1.rank > vertexX.rank) {
-                    // Outside the affected region.
-                    continue;
-                }
-                if(vertex1.color == 1) {
-                    // We already have this vertex.
-                    continue;
-                }
-                vertex1.color = 1;
-                vertexStack.push(v1);
-                deltaF.push_back(make_pair(vertex1.rank, v1));
-                deltaRanks.push_back(vertex1.rank);
-            }
-        }
-        sort(deltaF.begin(), deltaF.end());
-        for(const auto& p: deltaF) {
-            graph[p.second].color = 0;
-        }
+template<class Graph> void ChanZuckerberg::shasta::ApproximateTopologicalSort<Graph>::initialize()
+{
+    nextRank = 0;
+    BGL_FORALL_VERTICES_T(v, graph, Graph) {
+        addVertex(v);
+    }
+    BGL_FORALL_EDGES_T(e, graph, Graph) {
+        graph[e].isDagEdge = false;
+    }
+}
 
 
 
-        // Use a backward DFS starting at vX, and limited to the affected region,
-        // to compute deltaB (see definition 2.6 in the paper).
-        deltaB.clear();
-        if(!vertexStack.empty()) {
-            throw runtime_error("Vertex stack is not empty.");
-        }
-        vertexStack.push(vX);
-        deltaB.push_back(make_pair(vertexX.rank, vX));
-        deltaRanks.push_back(vertexX.rank);
-        graph[vX].color = 1;
-        while(!vertexStack.empty()) {
-            const vertex_descriptor v0 = vertexStack.top();
-            vertexStack.pop();
-            BGL_FORALL_INEDGES_T(v0, e01, filteredGraph, FilteredGraph) {
-                const vertex_descriptor v1 = source(e01, graph);
-                auto& vertex1 = graph[v1];
-                if(vertex1.rank < vertexY.rank) {
-                    // Outside the affected region.
-                    continue;
-                }
-                if(vertex1.color == 1) {
-                    // We already have this vertex.
-                    continue;
-                }
-                vertex1.color = 1;
-                vertexStack.push(v1);
-                deltaB.push_back(make_pair(vertex1.rank, v1));
-                deltaRanks.push_back(vertex1.rank);
-            }
-        }
-        sort(deltaB.begin(), deltaB.end());
-        for(const auto& p: deltaB) {
-            graph[p.second].color = 0;
-        }
+template<class Graph> bool ChanZuckerberg::shasta::ApproximateTopologicalSort<Graph>::addEdge(
+    edge_descriptor e)
+{
+    const vertex_descriptor vX = source(e, graph);
+    const vertex_descriptor vY = target(e, graph);
+    auto& vertexX = graph[vX];
+    auto& vertexY = graph[vY];
+
+    // If this edge is consistent with the existing rank,
+    // just mark the edge as belonging to the DAG.
+    // The topological sort is not affected.
+    if(vertexX.rank < vertexY.rank) {
+        graph[e].isDagEdge = true;
+        return true;
+    }
 
+    deltaRanks.clear();
 
-        // Sort the ranks. If we find any duplicates, deltaF and deltaB
-        // intersect, which means this edge introduces a cycle.
-        // So we ignore it.
-        sort(deltaRanks.begin(), deltaRanks.end());
-        bool createsCycle = false;
-        for(size_t i=1; i<deltaRanks.size(); i++) {
-            if(deltaRanks[i-1] == deltaRanks[i]) {
-                createsCycle = true;
-                break;
+    // Use a forward DFS starting at vY, and limited to the affected region,
+    // to compute deltaF (see definition 2.6 in the paper).
+    deltaF.clear();
+    if(!vertexStack.empty()) {
+        throw runtime_error("Vertex stack is not empty.");
+    }
+    vertexStack.push(vY);
+    deltaF.push_back(make_pair(vertexY.rank, vY));
+    deltaRanks.push_back(vertexY.rank);
+    graph[vY].color = 1;
+    while(!vertexStack.empty()) {
+        const vertex_descriptor v0 = vertexStack.top();
+        vertexStack.pop();
+        BGL_FORALL_OUTEDGES_T(v0, e01, filteredGraph, FilteredGraph) {
+            const vertex_descriptor v1 = target(e01, graph);
+            auto& vertex1 = graph[v1];
+            if(vertex1.rank > vertexX.rank) {
+                // Outside the affected region.
+                continue;
             }
+            if(vertex1.color == 1) {
+                // We already have this vertex.
+                continue;
+            }
+            vertex1.color = 1;
+            vertexStack.push(v1);
+            deltaF.push_back(make_pair(vertex1.rank, v1));
+            deltaRanks.push_back(vertex1.rank);
         }
-        if(!createsCycle) {
+    }
+    sort(deltaF.begin(), deltaF.end());
+    for(const auto& p: deltaF) {
+        graph[p.second].color = 0;
+    }
+
 
-            // This edge does not create a cycle.
-            // redistribute the deltaRanks to vertices in deltaB and deltaF.
-            size_t i = 0;
-            for(const auto& p: deltaB) {
-               graph[p.second].rank = deltaRanks[i++];
+
+    // Use a backward DFS starting at vX, and limited to the affected region,
+    // to compute deltaB (see definition 2.6 in the paper).
+    deltaB.clear();
+    if(!vertexStack.empty()) {
+        throw runtime_error("Vertex stack is not empty.");
+    }
+    vertexStack.push(vX);
+    deltaB.push_back(make_pair(vertexX.rank, vX));
+    deltaRanks.push_back(vertexX.rank);
+    graph[vX].color = 1;
+    while(!vertexStack.empty()) {
+        const vertex_descriptor v0 = vertexStack.top();
+        vertexStack.pop();
+        BGL_FORALL_INEDGES_T(v0, e01, filteredGraph, FilteredGraph) {
+            const vertex_descriptor v1 = source(e01, graph);
+            auto& vertex1 = graph[v1];
+            if(vertex1.rank < vertexY.rank) {
+                // Outside the affected region.
+                continue;
             }
-            for(const auto& p: deltaF) {
-               graph[p.second].rank = deltaRanks[i++];
+            if(vertex1.color == 1) {
+                // We already have this vertex.
+                continue;
             }
-            graph[e].isDagEdge = true;
+            vertex1.color = 1;
+            vertexStack.push(v1);
+            deltaB.push_back(make_pair(vertex1.rank, v1));
+            deltaRanks.push_back(vertex1.rank);
         }
+    }
+    sort(deltaB.begin(), deltaB.end());
+    for(const auto& p: deltaB) {
+        graph[p.second].color = 0;
+    }
+
+
+    // Sort the ranks. If we find any duplicates, deltaF and deltaB
+    // intersect, which means this edge introduces a cycle.
+    // So we ignore it.
+    sort(deltaRanks.begin(), deltaRanks.end());
+    for(size_t i=1; i<deltaRanks.size(); i++) {
+        if(deltaRanks[i-1] == deltaRanks[i]) {
+            graph[e].isDagEdge = false;
+            return false;
+        }
+    }
 
+    // This edge does not create a cycle.
+    // redistribute the deltaRanks to vertices in deltaB and deltaF.
+    size_t i = 0;
+    for(const auto& p: deltaB) {
+       graph[p.second].rank = deltaRanks[i++];
     }
+    for(const auto& p: deltaF) {
+       graph[p.second].rank = deltaRanks[i++];
+    }
+    graph[e].isDagEdge = true;
+    return true;
+}
+
+
+
+template<class Graph> void ChanZuckerberg::shasta::approximateTopologicalSort(
+    Graph& graph,
+    const vector<typename Graph::edge_descriptor>& edgesToProcess)
+{
+    ApproximateTopologicalSort<Graph> topologicalSort(graph);
+    topologicalSort.initialize();
+    topologicalSort.addEdges(edgesToProcess);
 }
 
 #endif
@@ -0,0 +1,163 @@
+// Shasta.
+#include "benchmarks.hpp"
+#include "Kmer.hpp"
+#include "LongBaseSequence.hpp"
+#include "MarkerFinder.hpp"
+#include "MurmurHash2.hpp"
+#include "timestamp.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "chrono.hpp"
+#include "iostream.hpp"
+#include <random>
+
+
+
+std::map<string, double> ChanZuckerberg::shasta::benchmarkMarkerFinder(
+    uint64_t readCount,
+    uint64_t readLength,
+    uint64_t k,
+    double markerDensity,
+    size_t threadCount,
+    int seed)
+{
+    CZI_ASSERT(k > 0 && k <= 16);
+    std::mt19937 randomSource(static_cast<uint32_t>(seed));
+    std::map<string, double> timings;
+
+    // Generate the reads.
+    steady_clock::time_point t0 = steady_clock::now();
+    LongBaseSequences reads;
+    reads.createNew("", 4096);
+    std::uniform_int_distribution<uint64_t> baseDistribution(0, 3);
+    for(uint64_t readId=0; readId<readCount; readId++) {
+        reads.append(readLength);
+        LongBaseSequenceView read = reads[readId];
+        for(uint64_t position=0; position<readLength; position++) {
+            read.set(position, Base::fromInteger(baseDistribution(randomSource)));
+        }
+    }
+
+    // Select the markers. Unlike the assembly,
+    // this does not keep the set of markers symmetric under reverse complement.
+    vector<uint64_t> markerBits(KmerBitmap::wordCount(k), 0);
+    std::uniform_real_distribution<double> uniformDistribution;
+    const uint64_t kmerCount = 1ULL << (2ULL * k);
+    for(uint64_t kmerId=0; kmerId<kmerCount; kmerId++) {
+        if(uniformDistribution(randomSource) < markerDensity) {
+            markerBits[kmerId >> 6ULL] |= (1ULL << (kmerId & 63ULL));
+        }
+    }
+    timings["generate"] = seconds(steady_clock::now() - t0);
+
+    // Find the markers.
+    t0 = steady_clock::now();
+    MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t> markers;
+    markers.createNew("", 4096);
+    MarkerFinder markerFinder(k, KmerBitmap(markerBits.data()), reads, markers, threadCount);
+    const double t = seconds(steady_clock::now() - t0);
+    timings["findMarkers"] = t;
+    cout << "Found " << markers.totalSize() << " markers in " <<
+        readCount * readLength << " bases in " << t << " s, " <<
+        double(readCount * readLength) / t << " bases per second." << endl;
+
+    return timings;
+}
+
+
+
+std::map<string, double> ChanZuckerberg::shasta::benchmarkVectorOfVectors(
+    uint64_t n,
+    uint64_t averageSize,
+    size_t threadCount,
+    int seed)
+{
+    std::map<string, double> timings;
+    VectorOfVectorsBenchmark benchmark(n, averageSize, threadCount, seed, timings);
+    return timings;
+}
+
+
+
+VectorOfVectorsBenchmark::VectorOfVectorsBenchmark(
+    uint64_t n,
+    uint64_t averageSize,
+    size_t threadCount,
+    int seed,
+    std::map<string, double>& timings) :
+    MultithreadedObject(*this),
+    n(n),
+    m(n * averageSize),
+    seed(uint64_t(seed))
+{
+    CZI_ASSERT(n > 0);
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    const uint64_t batchSize = 100000;
+    data.createNew("", 4096);
+
+    steady_clock::time_point t0 = steady_clock::now();
+    data.beginPass1(n, threadCount);
+    steady_clock::time_point t1 = steady_clock::now();
+    timings["beginPass1"] = seconds(t1 - t0);
+
+    setupLoadBalancing(m, batchSize);
+    runThreads(&VectorOfVectorsBenchmark::pass1ThreadFunction, threadCount);
+    t0 = steady_clock::now();
+    timings["pass1"] = seconds(t0 - t1);
+
+    data.beginPass2(threadCount);
+    t1 = steady_clock::now();
+    timings["beginPass2"] = seconds(t1 - t0);
+
+    setupLoadBalancing(m, batchSize);
+    runThreads(&VectorOfVectorsBenchmark::pass2ThreadFunction, threadCount);
+    t0 = steady_clock::now();
+    timings["pass2"] = seconds(t0 - t1);
+
+    data.endPass2(true, true, threadCount);
+    t1 = steady_clock::now();
+    timings["endPass2"] = seconds(t1 - t0);
+
+    double total = 0.;
+    for(const auto& p: timings) {
+        total += p.second;
+    }
+    timings["total"] = total;
+    cout << "Constructed " << n << " vectors with " << m << " entries in " <<
+        total << " s using " << threadCount << " threads." << endl;
+}
+
+
+
+uint64_t VectorOfVectorsBenchmark::getIndex(uint64_t i) const
+{
+    return MurmurHash64A(&i, int(sizeof(i)), seed) % n;
+}
+
+
+
+void VectorOfVectorsBenchmark::pass1ThreadFunction(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            data.incrementCountMultithreaded(getIndex(i));
+        }
+    }
+}
+
+
+
+void VectorOfVectorsBenchmark::pass2ThreadFunction(size_t threadId)
+{
+    uint64_t begin, end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; i++) {
+            data.storeMultithreaded(getIndex(i), i);
+        }
+    }
+}
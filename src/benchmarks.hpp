@@ -0,0 +1,78 @@
+#ifndef CZI_SHASTA_BENCHMARKS_HPP
+#define CZI_SHASTA_BENCHMARKS_HPP
+
+/*******************************************************************************
+
+Micro-benchmarks of individual components on synthetic data,
+used by scripts/RunMicroBenchmarks.py.
+Each of them returns the elapsed time in seconds of each phase,
+keyed by phase name, so the results can be recorded and compared
+between versions. The data are generated from a hash of the seed,
+so a given set of arguments always does the same work.
+
+Other micro-benchmarks are dset64Benchmark (dset64Test.hpp)
+and the Assembler functions benchmarkAlignments
+and benchmarkSimpleBayesianConsensusCaller,
+which use the data of an existing run.
+
+*******************************************************************************/
+
+// Shasta.
+#include "MemoryMappedVectorOfVectors.hpp"
+#include "MultitreadedObject.hpp"
+
+// Standard library.
+#include <map>
+#include "string.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        // Find markers in random reads using MarkerFinder.
+        std::map<string, double> benchmarkMarkerFinder(
+            uint64_t readCount,
+            uint64_t readLength,
+            uint64_t k,
+            double markerDensity,   // The fraction of k-mers used as markers.
+            size_t threadCount,
+            int seed);
+
+        // Two-pass construction of a MemoryMapped::VectorOfVectors
+        // with n vectors and n*averageSize entries at random positions,
+        // using incrementCountMultithreaded and storeMultithreaded.
+        std::map<string, double> benchmarkVectorOfVectors(
+            uint64_t n,
+            uint64_t averageSize,
+            size_t threadCount,
+            int seed);
+        class VectorOfVectorsBenchmark;
+    }
+}
+
+
+
+class ChanZuckerberg::shasta::VectorOfVectorsBenchmark :
+    public MultithreadedObject<VectorOfVectorsBenchmark> {
+public:
+
+    VectorOfVectorsBenchmark(
+        uint64_t n,
+        uint64_t averageSize,
+        size_t threadCount,
+        int seed,
+        std::map<string, double>& timings);
+
+private:
+    uint64_t n;
+    uint64_t m;
+    uint64_t seed;
+    MemoryMapped::VectorOfVectors<uint64_t, uint64_t> data;
+
+    // The vector that entry i goes to, from a hash of i and the seed.
+    uint64_t getIndex(uint64_t i) const;
+
+    void pass1ThreadFunction(size_t threadId);
+    void pass2ThreadFunction(size_t threadId);
+};
+
+#endif
@@ -0,0 +1,100 @@
+// Shasta.
+#include "bgzipCompress.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "cstdint.hpp"
+#include "stdexcept.hpp"
+
+// zlib.
+#include <zlib.h>
+
+
+
+// The maximum number of uncompressed bytes in a block.
+// This is the value used by htslib. It guarantees that
+// the compressed block, including header and footer,
+// fits in 64 KB even for incompressible data.
+static const size_t bgzipMaxBlockDataSize = 0xff00;
+
+// The size of the header and footer of a BGZF block.
+static const size_t bgzipBlockHeaderSize = 18;
+static const size_t bgzipBlockFooterSize = 8;
+
+
+
+void ChanZuckerberg::shasta::bgzipCompress(
+    const char* begin,
+    const char* end,
+    string& output)
+{
+    const size_t maxBlockSize = 0x10000;
+
+    for(const char* blockBegin=begin; blockBegin!=end; ) {
+        const char* blockEnd = blockBegin + min(bgzipMaxBlockDataSize, size_t(end - blockBegin));
+        const size_t dataSize = blockEnd - blockBegin;
+
+        // Make space for the largest possible block.
+        const size_t blockOffset = output.size();
+        output.resize(blockOffset + maxBlockSize);
+        unsigned char* block = reinterpret_cast<unsigned char*>(&output[blockOffset]);
+
+        // Compress the data as a raw deflate stream.
+        z_stream stream;
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        if(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw runtime_error("Error initializing zlib for bgzip compression.");
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(blockBegin));
+        stream.avail_in = uInt(dataSize);
+        stream.next_out = block + bgzipBlockHeaderSize;
+        stream.avail_out = uInt(maxBlockSize - bgzipBlockHeaderSize - bgzipBlockFooterSize);
+        const int status = deflate(&stream, Z_FINISH);
+        const size_t compressedSize = stream.total_out;
+        deflateEnd(&stream);
+        if(status != Z_STREAM_END) {
+            throw runtime_error("Error during bgzip compression.");
+        }
+        const size_t blockSize = bgzipBlockHeaderSize + compressedSize + bgzipBlockFooterSize;
+        CZI_ASSERT(blockSize <= maxBlockSize);
+
+        // The gzip header, with the BC extra subfield
+        // containing the total block size minus 1.
+        const unsigned char header[bgzipBlockHeaderSize] = {
+            0x1f, 0x8b, 8, 4,
+            0, 0, 0, 0,
+            0, 0xff,
+            6, 0,
+            'B', 'C', 2, 0,
+            (unsigned char)((blockSize - 1) & 0xff),
+            (unsigned char)((blockSize - 1) >> 8)};
+        copy(header, header + bgzipBlockHeaderSize, block);
+
+        // The gzip footer: CRC32 and uncompressed size, little endian.
+        const uint32_t crc = uint32_t(crc32(crc32(0L, Z_NULL, 0),
+            reinterpret_cast<const Bytef*>(blockBegin), uInt(dataSize)));
+        unsigned char* footer = block + bgzipBlockHeaderSize + compressedSize;
+        for(size_t i=0; i<4; i++) {
+            footer[i] = (unsigned char)((crc >> (8*i)) & 0xff);
+            footer[4+i] = (unsigned char)((dataSize >> (8*i)) & 0xff);
+        }
+
+        output.resize(blockOffset + blockSize);
+        blockBegin = blockEnd;
+    }
+}
+
+
+
+void ChanZuckerberg::shasta::bgzipAppendEofBlock(string& output)
+{
+    const unsigned char eofBlock[28] = {
+        0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+        0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    output.append(reinterpret_cast<const char*>(eofBlock), sizeof(eofBlock));
+}
@@ -0,0 +1,26 @@
+#ifndef CZI_SHASTA_BGZIP_COMPRESS_HPP
+#define CZI_SHASTA_BGZIP_COMPRESS_HPP
+
+#include "cstddef.hpp"
+#include "string.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        // Compress the given data in bgzip (BGZF) format and append
+        // the compressed blocks to the output string.
+        // BGZF blocks are independent gzip members, so the result
+        // of compressing consecutive pieces of a file separately
+        // and concatenating them is a valid bgzip file.
+        // The end of file marker is not written - use bgzipAppendEofBlock for that.
+        void bgzipCompress(
+            const char* begin,
+            const char* end,
+            string& output);
+
+        // Append the empty block used as an end of file marker by bgzip.
+        void bgzipAppendEofBlock(string& output);
+    }
+}
+
+#endif
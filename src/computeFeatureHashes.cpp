@@ -0,0 +1,318 @@
+#include "computeFeatureHashes.hpp"
+#include "CZI_ASSERT.hpp"
+#include "MurmurHash2.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "iostream.hpp"
+#include <random>
+#include "utility.hpp"
+#include "vector.hpp"
+
+// Intrinsics for the vectorized versions, x86-64 only.
+// These are compiled with function-level target attributes,
+// so they don't require compiling the whole file
+// with -mavx2 or -mavx512f, and the appropriate version is selected
+// at run time based on the capabilities of the CPU.
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+
+// The vectorized versions load pairs of consecutive k-mer ids
+// as the 64-bit words hashed by MurmurHash64A.
+static_assert(sizeof(ChanZuckerberg::shasta::KmerId) == 4, "Unexpected size of KmerId.");
+
+
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        // The constants used by MurmurHash64A.
+        const uint64_t murmurHashMultiplier = 0xc6a4a7935bd1e995ULL;
+        const int murmurHashShift = 47;
+
+        using FeatureHashFunction = void (*)(
+            const KmerId* kmerIds,
+            uint64_t featureCount,
+            uint64_t m,
+            uint64_t seed,
+            uint64_t* hashes);
+
+
+
+        // Scalar version, one feature at a time.
+        void computeFeatureHashesScalar(
+            const KmerId* kmerIds,
+            uint64_t featureCount,
+            uint64_t m,
+            uint64_t seed,
+            uint64_t* hashes)
+        {
+            const int featureByteCount = int(m * sizeof(KmerId));
+            for(uint64_t j=0; j<featureCount; j++) {
+                hashes[j] = MurmurHash64A(kmerIds + j, featureByteCount, seed);
+            }
+        }
+
+
+
+#if defined(__x86_64__)
+
+        // AVX2 version, 4 features at a time.
+        // AVX2 has no 64-bit multiply, so it is done using
+        // three 32x32->64 multiplies.
+        __attribute__((target("avx2"))) inline __m256i multiplyAvx2(
+            __m256i x,
+            __m256i multiplierLow,
+            __m256i multiplierHigh)
+        {
+            const __m256i lowLow = _mm256_mul_epu32(x, multiplierLow);
+            const __m256i highLow = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), multiplierLow);
+            const __m256i lowHigh = _mm256_mul_epu32(x, multiplierHigh);
+            return _mm256_add_epi64(lowLow,
+                _mm256_slli_epi64(_mm256_add_epi64(highLow, lowHigh), 32));
+        }
+        __attribute__((target("avx2"))) void computeFeatureHashesAvx2(
+            const KmerId* kmerIds,
+            uint64_t featureCount,
+            uint64_t m,
+            uint64_t seed,
+            uint64_t* hashes)
+        {
+            const __m256i multiplierLow = _mm256_set1_epi64x(int64_t(murmurHashMultiplier & 0xffffffffULL));
+            const __m256i multiplierHigh = _mm256_set1_epi64x(int64_t(murmurHashMultiplier >> 32));
+            const __m256i initialHash = _mm256_set1_epi64x(
+                int64_t(seed ^ (uint64_t(m * sizeof(KmerId)) * murmurHashMultiplier)));
+
+            // For word i of the 4 features beginning at kmerIds+j,
+            // we need kmerIds[j+2i] through kmerIds[j+2i+4].
+            // We load these 5 k-mer ids (the masked load does not touch
+            // memory for the other 3) and rearrange them into 4 words.
+            const __m256i loadMask = _mm256_setr_epi32(-1, -1, -1, -1, -1, 0, 0, 0);
+            const __m256i permutation = _mm256_setr_epi32(0, 1, 1, 2, 2, 3, 3, 4);
+
+            uint64_t j = 0;
+            for(; j+4<=featureCount; j+=4) {
+                const int* p = reinterpret_cast<const int*>(kmerIds + j);
+                __m256i h = initialHash;
+                for(uint64_t i=0; i<m/2; i++) {
+                    __m256i k = _mm256_permutevar8x32_epi32(
+                        _mm256_maskload_epi32(p + 2*i, loadMask), permutation);
+                    k = multiplyAvx2(k, multiplierLow, multiplierHigh);
+                    k = _mm256_xor_si256(k, _mm256_srli_epi64(k, murmurHashShift));
+                    k = multiplyAvx2(k, multiplierLow, multiplierHigh);
+                    h = _mm256_xor_si256(h, k);
+                    h = multiplyAvx2(h, multiplierLow, multiplierHigh);
+                }
+
+                // If m is odd, the last k-mer id is the 4-byte tail.
+                if(m & 1) {
+                    const __m256i tail = _mm256_cvtepu32_epi64(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + m - 1)));
+                    h = _mm256_xor_si256(h, tail);
+                    h = multiplyAvx2(h, multiplierLow, multiplierHigh);
+                }
+
+                // Final mix.
+                h = _mm256_xor_si256(h, _mm256_srli_epi64(h, murmurHashShift));
+                h = multiplyAvx2(h, multiplierLow, multiplierHigh);
+                h = _mm256_xor_si256(h, _mm256_srli_epi64(h, murmurHashShift));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(hashes + j), h);
+            }
+
+            computeFeatureHashesScalar(kmerIds + j, featureCount - j, m, seed, hashes + j);
+        }
+
+
+
+        // AVX-512 version, 8 features at a time.
+        // The pragmas suppress spurious warnings that some versions
+        // of gcc generate from the AVX-512 intrinsics headers.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+        __attribute__((target("avx512f,avx512dq"))) void computeFeatureHashesAvx512(
+            const KmerId* kmerIds,
+            uint64_t featureCount,
+            uint64_t m,
+            uint64_t seed,
+            uint64_t* hashes)
+        {
+            const __m512i multiplier = _mm512_set1_epi64(int64_t(murmurHashMultiplier));
+            const __m512i initialHash = _mm512_set1_epi64(
+                int64_t(seed ^ (uint64_t(m * sizeof(KmerId)) * murmurHashMultiplier)));
+
+            // Same as the AVX2 version, but with 9 k-mer ids
+            // rearranged into 8 words.
+            const __mmask16 loadMask = 0x1ff;
+            const __m512i permutation = _mm512_setr_epi32(
+                0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8);
+
+            uint64_t j = 0;
+            for(; j+8<=featureCount; j+=8) {
+                const int* p = reinterpret_cast<const int*>(kmerIds + j);
+                __m512i h = initialHash;
+                for(uint64_t i=0; i<m/2; i++) {
+                    __m512i k = _mm512_permutexvar_epi32(permutation,
+                        _mm512_maskz_loadu_epi32(loadMask, p + 2*i));
+                    k = _mm512_mullo_epi64(k, multiplier);
+                    k = _mm512_xor_si512(k, _mm512_srli_epi64(k, murmurHashShift));
+                    k = _mm512_mullo_epi64(k, multiplier);
+                    h = _mm512_xor_si512(h, k);
+                    h = _mm512_mullo_epi64(h, multiplier);
+                }
+
+                // If m is odd, the last k-mer id is the 4-byte tail.
+                if(m & 1) {
+                    const __m512i tail = _mm512_cvtepu32_epi64(
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + m - 1)));
+                    h = _mm512_xor_si512(h, tail);
+                    h = _mm512_mullo_epi64(h, multiplier);
+                }
+
+                // Final mix.
+                h = _mm512_xor_si512(h, _mm512_srli_epi64(h, murmurHashShift));
+                h = _mm512_mullo_epi64(h, multiplier);
+                h = _mm512_xor_si512(h, _mm512_srli_epi64(h, murmurHashShift));
+                _mm512_storeu_si512(hashes + j, h);
+            }
+
+            computeFeatureHashesAvx2(kmerIds + j, featureCount - j, m, seed, hashes + j);
+        }
+#pragma GCC diagnostic pop
+#endif
+
+
+
+        // Select the best available version for this CPU.
+        // This is done once, the first time it is needed.
+        class FeatureHashFunctionSelector {
+        public:
+            FeatureHashFunction function;
+            const char* name;
+            FeatureHashFunctionSelector()
+            {
+#if defined(__x86_64__)
+                __builtin_cpu_init();
+                if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+                    function = computeFeatureHashesAvx512;
+                    name = "AVX-512";
+                } else if(__builtin_cpu_supports("avx2")) {
+                    function = computeFeatureHashesAvx2;
+                    name = "AVX2";
+                } else {
+                    function = computeFeatureHashesScalar;
+                    name = "scalar";
+                }
+#else
+                function = computeFeatureHashesScalar;
+                name = "scalar";
+#endif
+            }
+        };
+        inline const FeatureHashFunctionSelector& getFeatureHashFunctionSelector()
+        {
+            static const FeatureHashFunctionSelector selector;
+            return selector;
+        }
+
+    }
+}
+
+
+
+void ChanZuckerberg::shasta::computeFeatureHashes(
+    const KmerId* kmerIds,
+    uint64_t featureCount,
+    uint64_t m,
+    uint64_t seed,
+    uint64_t* hashes)
+{
+    (*getFeatureHashFunctionSelector().function)(kmerIds, featureCount, m, seed, hashes);
+}
+
+
+
+void ChanZuckerberg::shasta::computeFeatureHashes(
+    const KmerId64* kmerIds,
+    uint64_t featureCount,
+    uint64_t m,
+    uint64_t seed,
+    uint64_t* hashes)
+{
+    const int featureByteCount = int(m * sizeof(KmerId64));
+    for(uint64_t j=0; j<featureCount; j++) {
+        hashes[j] = MurmurHash64A(kmerIds + j, featureByteCount, seed);
+    }
+}
+
+
+
+const char* ChanZuckerberg::shasta::computeFeatureHashesImplementation()
+{
+    return getFeatureHashFunctionSelector().name;
+}
+
+
+
+void ChanZuckerberg::shasta::testComputeFeatureHashes()
+{
+    // The versions to be tested.
+    vector< pair<FeatureHashFunction, const char*> > functions;
+    functions.push_back(make_pair(computeFeatureHashesScalar, "scalar"));
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        functions.push_back(make_pair(computeFeatureHashesAvx2, "AVX2"));
+    }
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+        functions.push_back(make_pair(computeFeatureHashesAvx512, "AVX-512"));
+    }
+#endif
+
+    std::mt19937 randomSource;
+    vector<KmerId> kmerIds;
+    vector<uint64_t> hashes;
+    for(const auto& p: functions) {
+        cout << "Testing " << p.second << " version of computeFeatureHashes." << endl;
+        for(uint64_t m=1; m<=8; m++) {
+            for(uint64_t featureCount=0; featureCount<100; featureCount++) {
+
+                // Use a vector of exactly the required size, so
+                // out of bounds accesses can be found using a memory checker.
+                kmerIds.resize(featureCount + m - 1);
+                for(KmerId& kmerId: kmerIds) {
+                    kmerId = KmerId(randomSource());
+                }
+                hashes.resize(featureCount);
+                const uint64_t seed = randomSource();
+                (*p.first)(kmerIds.data(), featureCount, m, seed, hashes.data());
+                for(uint64_t j=0; j<featureCount; j++) {
+                    CZI_ASSERT(hashes[j] == MurmurHash64A(kmerIds.data() + j, int(m * sizeof(KmerId)), seed));
+                }
+            }
+        }
+    }
+
+    // The version for 64-bit k-mer ids.
+    vector<KmerId64> kmerIds64;
+    for(uint64_t m=1; m<=8; m++) {
+        for(uint64_t featureCount=0; featureCount<100; featureCount++) {
+            kmerIds64.resize(featureCount + m - 1);
+            for(KmerId64& kmerId: kmerIds64) {
+                kmerId = (KmerId64(randomSource()) << 32ULL) | KmerId64(randomSource());
+            }
+            hashes.resize(featureCount);
+            const uint64_t seed = randomSource();
+            computeFeatureHashes(kmerIds64.data(), featureCount, m, seed, hashes.data());
+            for(uint64_t j=0; j<featureCount; j++) {
+                CZI_ASSERT(hashes[j] == MurmurHash64A(kmerIds64.data() + j, int(m * sizeof(KmerId64)), seed));
+            }
+        }
+    }
+
+    cout << "computeFeatureHashes test passed. Using the " <<
+        computeFeatureHashesImplementation() << " version on this CPU." << endl;
+}
@@ -0,0 +1,45 @@
+#ifndef CZI_SHASTA_COMPUTE_FEATURE_HASHES_HPP
+#define CZI_SHASTA_COMPUTE_FEATURE_HASHES_HPP
+
+#include "Kmer.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+    // Compute the MurmurHash64A hashes of all the MinHash/LowHash
+    // features of an oriented read. Feature j consists of the m
+    // consecutive k-mer ids beginning at kmerIds[j], so kmerIds
+    // must contain at least featureCount+m-1 entries.
+    // On return, hashes[j] is equal to
+    // MurmurHash64A(kmerIds+j, int(m*sizeof(KmerId)), seed).
+    // This hashes several features at a time using AVX-512 or AVX2
+    // selected at run time based on the capabilities of the CPU,
+    // with a scalar fallback. All versions give exactly the same results.
+    void computeFeatureHashes(
+        const KmerId* kmerIds,
+        uint64_t featureCount,
+        uint64_t m,
+        uint64_t seed,
+        uint64_t* hashes);
+
+    // Same, for 64-bit k-mer ids, as used with k > Kmer::capacity.
+    // Each k-mer id is already one of the 64-bit words hashed
+    // by MurmurHash64A, so this only has a scalar version.
+    void computeFeatureHashes(
+        const KmerId64* kmerIds,
+        uint64_t featureCount,
+        uint64_t m,
+        uint64_t seed,
+        uint64_t* hashes);
+
+    // Return the name of the implementation used by
+    // computeFeatureHashes on this CPU.
+    const char* computeFeatureHashesImplementation();
+
+    // Check all versions available on this CPU against MurmurHash64A.
+    void testComputeFeatureHashes();
+
+    }
+}
+
+#endif
@@ -2,6 +2,240 @@
 using namespace ChanZuckerberg;
 using namespace shasta;
 
+// Intrinsics for the vectorized versions, x86-64 only.
+// These are compiled with function-level target attributes,
+// so they don't require compiling the whole file
+// with -mavx2, and the appropriate version is selected
+// at run time based on the capabilities of the CPU.
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+
+// The run boundary detectors below work on the bytes of the Base
+// objects, so they require a Base to be stored in exactly one byte.
+static_assert(sizeof(Base) == 1, "Unexpected size of class Base.");
+
+
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        // Function used by all versions to emit the runs that
+        // end at the bases specified by a bit mask.
+        // Bit i of boundaryMask is set if a new run begins at position
+        // begin+i of the sequence.
+        // This returns false if we find a run longer than 255.
+        inline bool emitRunBoundaries(
+            const uint8_t* sequence,
+            uint64_t begin,
+            uint64_t boundaryMask,
+            uint8_t* runLengthSequence,
+            uint8_t* repeatCount,
+            uint64_t& runCount,
+            uint64_t& runBegin)
+        {
+            while(boundaryMask) {
+                const uint64_t position = begin + uint64_t(__builtin_ctzll(boundaryMask));
+                const uint64_t runLength = position - runBegin;
+                if(runLength > 255) {
+                    return false;
+                }
+                repeatCount[runCount-1] = uint8_t(runLength);
+                runLengthSequence[runCount++] = sequence[position];
+                runBegin = position;
+                boundaryMask &= boundaryMask - 1ULL;
+            }
+            return true;
+        }
+
+
+
+        // Scalar detection of run boundaries for positions in [begin, end).
+        inline bool computeRunBoundariesScalar(
+            const uint8_t* sequence,
+            uint64_t begin,
+            uint64_t end,
+            uint8_t* runLengthSequence,
+            uint8_t* repeatCount,
+            uint64_t& runCount,
+            uint64_t& runBegin)
+        {
+            for(uint64_t position=begin; position<end; position++) {
+                if(sequence[position] != sequence[position-1]) {
+                    const uint64_t runLength = position - runBegin;
+                    if(runLength > 255) {
+                        return false;
+                    }
+                    repeatCount[runCount-1] = uint8_t(runLength);
+                    runLengthSequence[runCount++] = sequence[position];
+                    runBegin = position;
+                }
+            }
+            return true;
+        }
+
+
+
+        // The signature shared by all versions of the run boundary detector.
+        // They all process positions in [1, n) and detect positions
+        // where a new run begins.
+        using RunBoundaryFunction = bool (*)(
+            const uint8_t* sequence,
+            uint64_t n,
+            uint8_t* runLengthSequence,
+            uint8_t* repeatCount,
+            uint64_t& runCount,
+            uint64_t& runBegin);
+
+        bool computeRunBoundariesScalarAll(
+            const uint8_t* sequence,
+            uint64_t n,
+            uint8_t* runLengthSequence,
+            uint8_t* repeatCount,
+            uint64_t& runCount,
+            uint64_t& runBegin)
+        {
+            return computeRunBoundariesScalar(
+                sequence, 1, n, runLengthSequence, repeatCount, runCount, runBegin);
+        }
+
+#if defined(__x86_64__)
+
+        // SSE2 version: 16 bases at a time.
+        // SSE2 is always available on x86-64.
+        bool computeRunBoundariesSse2(
+            const uint8_t* sequence,
+            uint64_t n,
+            uint8_t* runLengthSequence,
+            uint8_t* repeatCount,
+            uint64_t& runCount,
+            uint64_t& runBegin)
+        {
+            uint64_t position = 1;
+            for(; position+16<=n; position+=16) {
+                const __m128i current = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(sequence + position));
+                const __m128i previous = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(sequence + position - 1));
+                const uint64_t equalMask = uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(current, previous))));
+                const uint64_t boundaryMask = (~equalMask) & 0xffffULL;
+                if(!emitRunBoundaries(sequence, position, boundaryMask,
+                    runLengthSequence, repeatCount, runCount, runBegin)) {
+                    return false;
+                }
+            }
+            return computeRunBoundariesScalar(
+                sequence, position, n, runLengthSequence, repeatCount, runCount, runBegin);
+        }
+
+
+
+        // AVX2 version: 32 bases at a time.
+        __attribute__((target("avx2"))) bool computeRunBoundariesAvx2(
+            const uint8_t* sequence,
+            uint64_t n,
+            uint8_t* runLengthSequence,
+            uint8_t* repeatCount,
+            uint64_t& runCount,
+            uint64_t& runBegin)
+        {
+            uint64_t position = 1;
+            for(; position+32<=n; position+=32) {
+                const __m256i current = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(sequence + position));
+                const __m256i previous = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(sequence + position - 1));
+                const uint64_t equalMask = uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(current, previous))));
+                const uint64_t boundaryMask = (~equalMask) & 0xffffffffULL;
+                if(!emitRunBoundaries(sequence, position, boundaryMask,
+                    runLengthSequence, repeatCount, runCount, runBegin)) {
+                    return false;
+                }
+            }
+            return computeRunBoundariesScalar(
+                sequence, position, n, runLengthSequence, repeatCount, runCount, runBegin);
+        }
+#endif
+
+
+
+        // Select the best available run boundary detector for this CPU.
+        // This is done once, the first time it is needed.
+        class RunBoundaryFunctionSelector {
+        public:
+            RunBoundaryFunction function;
+            const char* name;
+            RunBoundaryFunctionSelector()
+            {
+#if defined(__x86_64__)
+                __builtin_cpu_init();
+                if(__builtin_cpu_supports("avx2")) {
+                    function = computeRunBoundariesAvx2;
+                    name = "AVX2";
+                } else {
+                    function = computeRunBoundariesSse2;
+                    name = "SSE2";
+                }
+#else
+                function = computeRunBoundariesScalarAll;
+                name = "scalar";
+#endif
+            }
+        };
+        inline const RunBoundaryFunctionSelector& getRunBoundaryFunctionSelector()
+        {
+            static const RunBoundaryFunctionSelector selector;
+            return selector;
+        }
+
+
+
+        // Compute the run-length representation using a given
+        // run boundary detector.
+        inline bool computeRunLengthRepresentation(
+            RunBoundaryFunction runBoundaryFunction,
+            const vector<Base>& sequence,
+            vector<Base>& runLengthSequence,
+            vector<uint8_t>& repeatCount)
+        {
+            const uint64_t n = sequence.size();
+            if(n == 0) {
+                runLengthSequence.clear();
+                repeatCount.clear();
+                return true;
+            }
+
+            // Make space for the worst case, then shrink at the end.
+            runLengthSequence.resize(n);
+            repeatCount.resize(n);
+            const uint8_t* s = &sequence.front().value;
+            uint8_t* r = &runLengthSequence.front().value;
+            uint8_t* c = repeatCount.data();
+
+            // The first base always begins a run.
+            r[0] = s[0];
+            uint64_t runCount = 1;
+            uint64_t runBegin = 0;
+            if(!runBoundaryFunction(s, n, r, c, runCount, runBegin)) {
+                return false;
+            }
+
+            // Finish the last run.
+            const uint64_t runLength = n - runBegin;
+            if(runLength > 255) {
+                return false;
+            }
+            c[runCount-1] = uint8_t(runLength);
+
+            runLengthSequence.resize(runCount);
+            repeatCount.resize(runCount);
+            return true;
+        }
+    }
+}
+
 
 
 // Given the raw representation of a sequence, compute its
@@ -9,10 +243,33 @@ using namespace shasta;
 // This returns false if the sequence contains a homopolymer run
 // of more than 255 bases, which cannot be represented
 // with a one-byte repeat count.
+// This uses the fastest implementation available on this CPU.
 bool ChanZuckerberg::shasta::computeRunLengthRepresentation(
     const vector<Base>& sequence,
     vector<Base>& runLengthSequence,
     vector<uint8_t>& repeatCount)
+{
+    return computeRunLengthRepresentation(
+        getRunBoundaryFunctionSelector().function,
+        sequence, runLengthSequence, repeatCount);
+}
+
+
+
+// Return the name of the implementation used by
+// computeRunLengthRepresentation on this CPU.
+const char* ChanZuckerberg::shasta::computeRunLengthRepresentationImplementation()
+{
+    return getRunBoundaryFunctionSelector().name;
+}
+
+
+
+// Original, base by base version, kept for testing and benchmarking.
+bool ChanZuckerberg::shasta::computeRunLengthRepresentationScalar(
+    const vector<Base>& sequence,
+    vector<Base>& runLengthSequence,
+    vector<uint8_t>& repeatCount)
 {
     runLengthSequence.clear();
     repeatCount.clear();
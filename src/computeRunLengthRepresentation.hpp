@@ -12,11 +12,25 @@ namespace ChanZuckerberg {
     // This returns false if the sequence contains a homopolymer run
     // of more than 255 bases, which cannot be represented
     // with a one-byte repeat count.
+    // This uses a vectorized run boundary detector (AVX2 or SSE2)
+    // selected at run time based on the capabilities of the CPU,
+    // with a scalar fallback on other architectures.
     bool computeRunLengthRepresentation(
         const vector<Base>& sequence,
         vector<Base>& runLengthSequence,
         vector<uint8_t>& repeatCount);
 
+    // Return the name of the implementation used by
+    // computeRunLengthRepresentation on this CPU.
+    const char* computeRunLengthRepresentationImplementation();
+
+    // Original, base by base version of computeRunLengthRepresentation,
+    // kept for testing and benchmarking.
+    bool computeRunLengthRepresentationScalar(
+        const vector<Base>& sequence,
+        vector<Base>& runLengthSequence,
+        vector<uint8_t>& repeatCount);
+
     }
 }
 
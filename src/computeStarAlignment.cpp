@@ -0,0 +1,499 @@
+#include "computeStarAlignment.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "algorithm.hpp"
+#include "iostream.hpp"
+#include <random>
+#include "utility.hpp"
+
+// Intrinsics for the vectorized version, x86-64 only.
+// It is compiled with a function-level target attribute,
+// so it does not require compiling the whole file
+// with -mavx2, and it is selected
+// at run time based on the capabilities of the CPU.
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        // Scores are stored as int16_t. Cells outside the band
+        // get score starAlignmentMinusInfinity.
+        // This limits the length of the sequences.
+        const int16_t starAlignmentMinusInfinity = -16384;
+        const uint64_t starAlignmentMaxLength = 4096;
+
+        // Traceback directions.
+        // Ties are resolved in this order.
+        const int16_t starAlignmentDiagonal = 0;    // Consume a base of the center and of the sequence.
+        const int16_t starAlignmentUp = 1;          // Consume a base of the center only.
+        const int16_t starAlignmentLeft = 2;        // Consume a base of the sequence only.
+
+        // The traceback directions computed by an implementation
+        // for a batch of sequences, one in each lane.
+        // The direction for lane l at cell (i, j)
+        // (i bases of the center and j bases of the sequence)
+        // is directions[(i*(maxLength+1) + j)*laneCount + l].
+        class StarAlignmentDirections {
+        public:
+            uint64_t laneCount;
+            uint64_t maxLength;
+            vector<int16_t> directions;
+            int16_t operator()(uint64_t i, uint64_t j, uint64_t lane) const
+            {
+                return directions[(i*(maxLength+1) + j)*laneCount + lane];
+            }
+        };
+
+        // An implementation computes the traceback directions for
+        // sequences[begin, end), of which there are at most laneCount.
+        using StarAlignmentFunction = void (*)(
+            const vector<string>& sequences,
+            uint64_t begin,
+            uint64_t end,
+            uint64_t bandWidth,
+            StarAlignmentDirections&);
+
+        // The band of diagonals (j-i) used to align a sequence
+        // of length n to a center sequence of length centerLength.
+        inline void getStarAlignmentBand(
+            uint64_t centerLength,
+            uint64_t n,
+            uint64_t bandWidth,
+            int64_t& diagonalBegin,
+            int64_t& diagonalEnd)
+        {
+            const int64_t d = int64_t(n) - int64_t(centerLength);
+            diagonalBegin = min(int64_t(0), d) - int64_t(bandWidth);
+            diagonalEnd = max(int64_t(0), d) + int64_t(bandWidth) + 1;
+        }
+
+
+
+        // Scalar version, one sequence at a time.
+        void computeStarAlignmentScalar(
+            const vector<string>& sequences,
+            uint64_t begin,
+            uint64_t end,
+            uint64_t bandWidth,
+            StarAlignmentDirections& directions)
+        {
+            const string& center = sequences.front();
+            const uint64_t centerLength = center.size();
+            const uint64_t laneCount = end - begin;
+            uint64_t maxLength = 0;
+            for(uint64_t s=begin; s!=end; s++) {
+                maxLength = max(maxLength, uint64_t(sequences[s].size()));
+            }
+            directions.laneCount = laneCount;
+            directions.maxLength = maxLength;
+            directions.directions.resize((centerLength+1)*(maxLength+1)*laneCount);
+
+            vector<int> previousRow(maxLength+1);
+            vector<int> currentRow(maxLength+1);
+            for(uint64_t lane=0; lane!=laneCount; lane++) {
+                const string& sequence = sequences[begin + lane];
+                const uint64_t n = sequence.size();
+                int64_t diagonalBegin, diagonalEnd;
+                getStarAlignmentBand(centerLength, n, bandWidth, diagonalBegin, diagonalEnd);
+                auto isInBand = [&](uint64_t i, uint64_t j)
+                {
+                    const int64_t d = int64_t(j) - int64_t(i);
+                    return d>=diagonalBegin && d<diagonalEnd;
+                };
+                auto direction = [&](uint64_t i, uint64_t j) -> int16_t&
+                {
+                    return directions.directions[(i*(maxLength+1) + j)*laneCount + lane];
+                };
+
+                for(uint64_t i=0; i<=centerLength; i++) {
+                    for(uint64_t j=0; j<=n; j++) {
+                        int h;
+                        int16_t dir;
+                        if(i == 0) {
+                            h = -int(j);
+                            dir = starAlignmentLeft;
+                        } else if(j == 0) {
+                            h = -int(i);
+                            dir = starAlignmentUp;
+                        } else {
+                            const int diagonal = previousRow[j-1] +
+                                (center[i-1]==sequence[j-1] ? 1 : -1);
+                            const int up = previousRow[j] - 1;
+                            const int left = currentRow[j-1] - 1;
+                            h = max(diagonal, max(up, left));
+                            dir = (h == diagonal) ? starAlignmentDiagonal :
+                                ((h == up) ? starAlignmentUp : starAlignmentLeft);
+                        }
+                        if(!isInBand(i, j)) {
+                            h = starAlignmentMinusInfinity;
+                        }
+                        currentRow[j] = h;
+                        direction(i, j) = dir;
+                    }
+                    previousRow.swap(currentRow);
+                }
+            }
+        }
+
+
+
+#if defined(__x86_64__)
+
+        // AVX2 version, 16 sequences at a time,
+        // one in each 16-bit lane. Each lane computes the same
+        // cells as the scalar version, up to the length of
+        // the longest sequence. Cells beyond the length of the sequence
+        // in a lane are computed but never used.
+        __attribute__((target("avx2"))) void computeStarAlignmentAvx2(
+            const vector<string>& sequences,
+            uint64_t begin,
+            uint64_t end,
+            uint64_t bandWidth,
+            StarAlignmentDirections& directions)
+        {
+            const uint64_t laneCount = 16;
+            const string& center = sequences.front();
+            const uint64_t centerLength = center.size();
+            uint64_t maxLength = 0;
+            for(uint64_t s=begin; s!=end; s++) {
+                maxLength = max(maxLength, uint64_t(sequences[s].size()));
+            }
+            directions.laneCount = laneCount;
+            directions.maxLength = maxLength;
+            directions.directions.resize((centerLength+1)*(maxLength+1)*laneCount);
+            __m256i* directionsPointer = reinterpret_cast<__m256i*>(directions.directions.data());
+
+            // The sequences and band limits, one in each lane.
+            // Sequence characters are stored for j=1,...,maxLength.
+            vector<int16_t> characters((maxLength+1)*laneCount, 0);
+            int16_t diagonalBeginMinusOne[16];
+            int16_t diagonalEnd[16];
+            for(uint64_t lane=0; lane!=laneCount; lane++) {
+                if(begin+lane < end) {
+                    const string& sequence = sequences[begin + lane];
+                    for(uint64_t j=1; j<=sequence.size(); j++) {
+                        characters[j*laneCount + lane] = int16_t(sequence[j-1]);
+                    }
+                    int64_t b, e;
+                    getStarAlignmentBand(centerLength, sequence.size(), bandWidth, b, e);
+                    diagonalBeginMinusOne[lane] = int16_t(b - 1);
+                    diagonalEnd[lane] = int16_t(e);
+                } else {
+                    diagonalBeginMinusOne[lane] = 0;
+                    diagonalEnd[lane] = 0;
+                }
+            }
+            const __m256i* charactersPointer = reinterpret_cast<const __m256i*>(characters.data());
+            const __m256i diagonalBeginMinusOneVector =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(diagonalBeginMinusOne));
+            const __m256i diagonalEndVector =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(diagonalEnd));
+
+            const __m256i one = _mm256_set1_epi16(1);
+            const __m256i minusOne = _mm256_set1_epi16(-1);
+            const __m256i upVector = _mm256_set1_epi16(starAlignmentUp);
+            const __m256i leftVector = _mm256_set1_epi16(starAlignmentLeft);
+            const __m256i minusInfinity = _mm256_set1_epi16(starAlignmentMinusInfinity);
+
+            vector<int16_t> previousRowStorage((maxLength+1)*laneCount);
+            vector<int16_t> currentRowStorage((maxLength+1)*laneCount);
+            for(uint64_t i=0; i<=centerLength; i++) {
+                __m256i* previousRow = reinterpret_cast<__m256i*>(previousRowStorage.data());
+                __m256i* currentRow = reinterpret_cast<__m256i*>(currentRowStorage.data());
+                const __m256i c = _mm256_set1_epi16(int16_t(i==0 ? 0 : center[i-1]));
+                for(uint64_t j=0; j<=maxLength; j++) {
+                    __m256i h;
+                    __m256i dir;
+                    if(i == 0) {
+                        h = _mm256_set1_epi16(int16_t(-int(j)));
+                        dir = leftVector;
+                    } else if(j == 0) {
+                        h = _mm256_set1_epi16(int16_t(-int(i)));
+                        dir = upVector;
+                    } else {
+                        const __m256i isMatch = _mm256_cmpeq_epi16(c, _mm256_loadu_si256(charactersPointer + j));
+                        const __m256i diagonal = _mm256_add_epi16(_mm256_loadu_si256(previousRow + j - 1),
+                            _mm256_blendv_epi8(minusOne, one, isMatch));
+                        const __m256i up = _mm256_add_epi16(_mm256_loadu_si256(previousRow + j), minusOne);
+                        const __m256i left = _mm256_add_epi16(_mm256_loadu_si256(currentRow + j - 1), minusOne);
+                        h = _mm256_max_epi16(diagonal, _mm256_max_epi16(up, left));
+                        dir = _mm256_andnot_si256(_mm256_cmpeq_epi16(h, diagonal),
+                            _mm256_blendv_epi8(leftVector, upVector, _mm256_cmpeq_epi16(h, up)));
+                    }
+
+                    // Only keep the score in the lanes for which
+                    // cell (i, j) is in the band.
+                    const __m256i d = _mm256_set1_epi16(int16_t(int64_t(j) - int64_t(i)));
+                    const __m256i isInBand = _mm256_and_si256(
+                        _mm256_cmpgt_epi16(d, diagonalBeginMinusOneVector),
+                        _mm256_cmpgt_epi16(diagonalEndVector, d));
+                    _mm256_storeu_si256(currentRow + j, _mm256_blendv_epi8(minusInfinity, h, isInBand));
+                    _mm256_storeu_si256(directionsPointer + i*(maxLength+1) + j, dir);
+                }
+                previousRowStorage.swap(currentRowStorage);
+            }
+        }
+
+#endif
+
+
+
+        // Select the best available version for this CPU.
+        // This is done once, the first time it is needed.
+        class StarAlignmentFunctionSelector {
+        public:
+            StarAlignmentFunction function;
+            uint64_t laneCount;
+            const char* name;
+            StarAlignmentFunctionSelector()
+            {
+#if defined(__x86_64__)
+                __builtin_cpu_init();
+                if(__builtin_cpu_supports("avx2")) {
+                    function = computeStarAlignmentAvx2;
+                    laneCount = 16;
+                    name = "AVX2";
+                } else {
+                    function = computeStarAlignmentScalar;
+                    laneCount = 1;
+                    name = "scalar";
+                }
+#else
+                function = computeStarAlignmentScalar;
+                laneCount = 1;
+                name = "scalar";
+#endif
+            }
+        };
+        inline const StarAlignmentFunctionSelector& getStarAlignmentFunctionSelector()
+        {
+            static const StarAlignmentFunctionSelector selector;
+            return selector;
+        }
+
+
+
+        // Compute the star alignment using a given implementation.
+        void computeStarAlignment(
+            StarAlignmentFunction function,
+            uint64_t laneCount,
+            const vector<string>& sequences,
+            uint64_t bandWidth,
+            vector<string>& msa)
+        {
+            CZI_ASSERT(!sequences.empty());
+            const string& center = sequences.front();
+            const uint64_t centerLength = center.size();
+            const uint64_t sequenceCount = sequences.size();
+            for(const string& sequence: sequences) {
+                CZI_ASSERT(sequence.size() < starAlignmentMaxLength);
+            }
+
+            // Work areas, reused by each thread for all calls.
+            static thread_local StarAlignmentDirections directions;
+
+            // For each sequence, the base aligned to each position
+            // of the center sequence, or '-', and the bases inserted
+            // before each position of the center sequence and at the end.
+            static thread_local vector<string> alignedBases;
+            static thread_local vector< vector<string> > insertions;
+            alignedBases.resize(sequenceCount);
+            insertions.resize(sequenceCount);
+
+            // Compute the pairwise alignments, one batch at a time,
+            // and trace them back.
+            for(uint64_t begin=0; begin<sequenceCount; begin+=laneCount) {
+                const uint64_t end = min(sequenceCount, begin+laneCount);
+                (*function)(sequences, begin, end, bandWidth, directions);
+                for(uint64_t s=begin; s!=end; s++) {
+                    const string& sequence = sequences[s];
+                    string& aligned = alignedBases[s];
+                    vector<string>& sequenceInsertions = insertions[s];
+                    aligned.assign(centerLength, '-');
+                    sequenceInsertions.resize(centerLength+1);
+                    for(string& insertion: sequenceInsertions) {
+                        insertion.clear();
+                    }
+                    uint64_t i = centerLength;
+                    uint64_t j = sequence.size();
+                    while(i>0 || j>0) {
+                        switch(directions(i, j, s-begin)) {
+                        case starAlignmentDiagonal:
+                            aligned[--i] = sequence[--j];
+                            break;
+                        case starAlignmentUp:
+                            --i;
+                            break;
+                        default:
+                            sequenceInsertions[i].push_back(sequence[--j]);
+                        }
+                    }
+                    for(string& insertion: sequenceInsertions) {
+                        reverse(insertion.begin(), insertion.end());
+                    }
+                }
+            }
+
+            // The number of alignment columns in each gap
+            // of the center sequence is the longest insertion in that gap.
+            vector<uint64_t> gapLengths(centerLength+1, 0);
+            for(uint64_t s=0; s!=sequenceCount; s++) {
+                for(uint64_t g=0; g<=centerLength; g++) {
+                    gapLengths[g] = max(gapLengths[g], uint64_t(insertions[s][g].size()));
+                }
+            }
+
+            // Merge.
+            msa.resize(sequenceCount);
+            for(uint64_t s=0; s!=sequenceCount; s++) {
+                string& row = msa[s];
+                row.clear();
+                for(uint64_t g=0; g<=centerLength; g++) {
+                    const string& insertion = insertions[s][g];
+                    row.append(insertion);
+                    row.append(gapLengths[g]-insertion.size(), '-');
+                    if(g < centerLength) {
+                        row.push_back(alignedBases[s][g]);
+                    }
+                }
+            }
+        }
+
+    }
+}
+
+
+
+void ChanZuckerberg::shasta::computeStarAlignment(
+    const vector<string>& sequences,
+    uint64_t bandWidth,
+    vector<string>& msa)
+{
+    const StarAlignmentFunctionSelector& selector = getStarAlignmentFunctionSelector();
+    computeStarAlignment(selector.function, selector.laneCount, sequences, bandWidth, msa);
+}
+
+
+
+const char* ChanZuckerberg::shasta::computeStarAlignmentImplementation()
+{
+    return getStarAlignmentFunctionSelector().name;
+}
+
+
+
+void ChanZuckerberg::shasta::testStarAlignment()
+{
+    // The versions to be tested.
+    class Version {
+    public:
+        StarAlignmentFunction function;
+        uint64_t laneCount;
+        const char* name;
+    };
+    vector<Version> versions;
+    versions.push_back({computeStarAlignmentScalar, 1, "scalar"});
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        versions.push_back({computeStarAlignmentAvx2, 16, "AVX2"});
+    }
+#endif
+
+    // Return the optimal global alignment score, without a band.
+    auto optimalScore = [](const string& x, const string& y)
+    {
+        vector< vector<int> > h(x.size()+1, vector<int>(y.size()+1));
+        for(uint64_t i=0; i<=x.size(); i++) {
+            for(uint64_t j=0; j<=y.size(); j++) {
+                if(i == 0) {
+                    h[i][j] = -int(j);
+                } else if(j == 0) {
+                    h[i][j] = -int(i);
+                } else {
+                    h[i][j] = max(h[i-1][j-1] + (x[i-1]==y[j-1] ? 1 : -1),
+                        max(h[i-1][j], h[i][j-1]) - 1);
+                }
+            }
+        }
+        return h[x.size()][y.size()];
+    };
+
+    std::mt19937 randomSource;
+    const string bases = "ACGT";
+    vector<string> sequences;
+    vector<string> referenceMsa;
+    vector<string> msa;
+    for(uint64_t iteration=0; iteration<2000; iteration++) {
+
+        // Generate a center sequence and random mutations of it.
+        const uint64_t centerLength = 1 + randomSource() % 20;
+        const uint64_t sequenceCount = 2 + randomSource() % 40;
+        const uint64_t bandWidth = (randomSource() % 4 == 0) ? 1000 : randomSource() % 3;
+        sequences.resize(sequenceCount);
+        sequences[0].clear();
+        for(uint64_t i=0; i<centerLength; i++) {
+            sequences[0].push_back(bases[randomSource() % 4]);
+        }
+        for(uint64_t s=1; s<sequenceCount; s++) {
+            string& sequence = sequences[s];
+            sequence.clear();
+            for(uint64_t i=0; i<=centerLength; i++) {
+                if(randomSource() % 8 == 0) {
+                    sequence.push_back(bases[randomSource() % 4]);
+                }
+                if(i < centerLength) {
+                    const uint64_t r = randomSource() % 10;
+                    if(r == 0) {
+                        sequence.push_back(bases[randomSource() % 4]);
+                    } else if(r != 1) {
+                        sequence.push_back(sequences[0][i]);
+                    }
+                }
+            }
+        }
+
+        for(uint64_t v=0; v<versions.size(); v++) {
+            const Version& version = versions[v];
+            computeStarAlignment(version.function, version.laneCount,
+                sequences, bandWidth, v==0 ? referenceMsa : msa);
+            if(v == 0) {
+
+                // Check the alignment.
+                CZI_ASSERT(referenceMsa.size() == sequenceCount);
+                for(uint64_t s=0; s<sequenceCount; s++) {
+                    CZI_ASSERT(referenceMsa[s].size() == referenceMsa[0].size());
+                    string sequence = referenceMsa[s];
+                    sequence.erase(std::remove(sequence.begin(), sequence.end(), '-'), sequence.end());
+                    CZI_ASSERT(sequence == sequences[s]);
+
+                    // Without a band limitation, the alignment
+                    // to the center is optimal.
+                    if(bandWidth >= centerLength + sequences[s].size()) {
+                        int score = 0;
+                        for(uint64_t c=0; c<referenceMsa[0].size(); c++) {
+                            const char x = referenceMsa[0][c];
+                            const char y = referenceMsa[s][c];
+                            if(x!='-' || y!='-') {
+                                score += (x==y) ? 1 : -1;
+                            }
+                        }
+                        CZI_ASSERT(score == optimalScore(sequences[0], sequences[s]));
+                    }
+                }
+            } else {
+                // All versions must give identical results.
+                CZI_ASSERT(msa == referenceMsa);
+            }
+        }
+    }
+    cout << "Star alignment test passed. Using the " <<
+        computeStarAlignmentImplementation() << " version on this CPU." << endl;
+}
@@ -0,0 +1,47 @@
+#ifndef CZI_SHASTA_COMPUTE_STAR_ALIGNMENT_HPP
+#define CZI_SHASTA_COMPUTE_STAR_ALIGNMENT_HPP
+
+#include "cstdint.hpp"
+#include "string.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+    // Compute a multiple sequence alignment of a set of short sequences
+    // by aligning each of them to sequences[0] (the center sequence)
+    // and merging the pairwise alignments (star alignment).
+    // This is used instead of spoa for marker graph edges
+    // with short intervening sequences.
+    // The pairwise alignments are global, with the same
+    // scoring used with spoa in computeMarkerGraphEdgeConsensusSequenceUsingSpoa
+    // (match 1, mismatch -1, gap -1), and restricted to a band
+    // of diagonals extending bandWidth beyond the diagonals
+    // of the start and end of the alignment.
+    // Insertions relative to the center sequence are left aligned
+    // in the gap in which they occur.
+    // On return, msa[i] is the aligned version of sequences[i],
+    // with '-' for gaps.
+    // The sequences are aligned to the center sequence
+    // 16 at a time, one in each lane of an AVX2 register
+    // (inter-sequence vectorization), with a scalar fallback.
+    // The version to use is selected at run time based on the
+    // capabilities of the CPU, and all versions
+    // give identical results.
+    void computeStarAlignment(
+        const vector<string>& sequences,
+        uint64_t bandWidth,
+        vector<string>& msa);
+
+    // Return the name of the implementation used by
+    // computeStarAlignment on this CPU.
+    const char* computeStarAlignmentImplementation();
+
+    // Check all versions available on this CPU against each other
+    // and against an unbanded alignment.
+    void testStarAlignment();
+
+    }
+}
+
+#endif
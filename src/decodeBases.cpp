@@ -0,0 +1,211 @@
+#include "decodeBases.hpp"
+#include "CZI_ASSERT.hpp"
+using namespace ChanZuckerberg;
+using namespace shasta;
+
+// Standard library.
+#include "iostream.hpp"
+#include <random>
+#include "stdexcept.hpp"
+#include "string.hpp"
+#include "utility.hpp"
+
+// Intrinsics for the vectorized version, x86-64 only.
+// It is compiled with a function-level target attribute,
+// so it does not require compiling the whole file
+// with -mavx2, and it is selected
+// at run time based on the capabilities of the CPU.
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+
+// The vectorized version stores the Base values as bytes.
+static_assert(sizeof(Base) == 1, "Unexpected size of class Base.");
+
+
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        using DecodeBasesFunction = void (*)(
+            const char* begin,
+            const char* end,
+            Base* bases);
+
+
+
+        // Scalar version, one character at a time.
+        void decodeBasesScalar(
+            const char* begin,
+            const char* end,
+            Base* bases)
+        {
+            for(const char* p=begin; p!=end; ++p) {
+                *bases++ = Base::fromCharacter(*p);
+            }
+        }
+
+
+
+#if defined(__x86_64__)
+
+        // AVX2 version, 32 characters at a time.
+        // The valid characters have distinct low 4 bits
+        // (A=1, C=3, G=7, T=4, the same for lower case),
+        // so a PSHUFB lookup on those gives the Base value.
+        // A character is valid if, after clearing the bit that
+        // distinguishes lower and upper case, it is A, C, G, or T.
+        __attribute__((target("avx2"))) void decodeBasesAvx2(
+            const char* begin,
+            const char* end,
+            Base* bases)
+        {
+            const __m256i lookup = _mm256_setr_epi8(
+                0, 0, 0, 1, 3, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0,
+                0, 0, 0, 1, 3, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0);
+            const __m256i caseMask = _mm256_set1_epi8(char(0xdf));
+            const __m256i A = _mm256_set1_epi8('A');
+            const __m256i C = _mm256_set1_epi8('C');
+            const __m256i G = _mm256_set1_epi8('G');
+            const __m256i T = _mm256_set1_epi8('T');
+
+            const char* p = begin;
+            for(; p+32<=end; p+=32, bases+=32) {
+                const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                const __m256i upper = _mm256_and_si256(x, caseMask);
+                const __m256i isValid = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(upper, A), _mm256_cmpeq_epi8(upper, C)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(upper, G), _mm256_cmpeq_epi8(upper, T)));
+                if(_mm256_movemask_epi8(isValid) != -1) {
+                    // This throws the same exception as Base::fromCharacter.
+                    decodeBasesScalar(p, p+32, bases);
+                }
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(bases),
+                    _mm256_shuffle_epi8(lookup, x));
+            }
+            decodeBasesScalar(p, end, bases);
+        }
+
+#endif
+
+
+
+        // Select the best available version for this CPU.
+        // This is done once, the first time it is needed.
+        class DecodeBasesFunctionSelector {
+        public:
+            DecodeBasesFunction function;
+            const char* name;
+            DecodeBasesFunctionSelector()
+            {
+#if defined(__x86_64__)
+                __builtin_cpu_init();
+                if(__builtin_cpu_supports("avx2")) {
+                    function = decodeBasesAvx2;
+                    name = "AVX2";
+                } else {
+                    function = decodeBasesScalar;
+                    name = "scalar";
+                }
+#else
+                function = decodeBasesScalar;
+                name = "scalar";
+#endif
+            }
+        };
+        inline const DecodeBasesFunctionSelector& getDecodeBasesFunctionSelector()
+        {
+            static const DecodeBasesFunctionSelector selector;
+            return selector;
+        }
+
+    }
+}
+
+
+
+void ChanZuckerberg::shasta::decodeBases(
+    const char* begin,
+    const char* end,
+    vector<Base>& bases)
+{
+    const size_t oldSize = bases.size();
+    bases.resize(oldSize + size_t(end - begin));
+    (*getDecodeBasesFunctionSelector().function)(begin, end, bases.data() + oldSize);
+}
+
+
+
+const char* ChanZuckerberg::shasta::decodeBasesImplementation()
+{
+    return getDecodeBasesFunctionSelector().name;
+}
+
+
+
+void ChanZuckerberg::shasta::testDecodeBases()
+{
+    // The versions to be tested.
+    vector< pair<DecodeBasesFunction, const char*> > functions;
+    functions.push_back(make_pair(decodeBasesScalar, "scalar"));
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        functions.push_back(make_pair(decodeBasesAvx2, "AVX2"));
+    }
+#endif
+
+    std::mt19937 randomSource;
+    const string validCharacters = "ACGTacgt";
+    string characters;
+    vector<Base> bases;
+    for(const auto& p: functions) {
+        cout << "Testing " << p.second << " version of decodeBases." << endl;
+        for(uint64_t n=0; n<200; n++) {
+
+            // Valid characters.
+            characters.resize(n);
+            for(char& c: characters) {
+                c = validCharacters[randomSource() % validCharacters.size()];
+            }
+            bases.resize(n);
+            (*p.first)(characters.data(), characters.data() + n, bases.data());
+            for(uint64_t i=0; i<n; i++) {
+                CZI_ASSERT(bases[i] == Base::fromCharacter(characters[i]));
+            }
+
+            // Each possible invalid character at a random position
+            // must throw the same exception as Base::fromCharacter.
+            if(n == 0) {
+                continue;
+            }
+            for(int c=0; c<256; c++) {
+                if(validCharacters.find(char(c)) != string::npos) {
+                    continue;
+                }
+                const uint64_t i = randomSource() % n;
+                const char savedCharacter = characters[i];
+                characters[i] = char(c);
+                string expectedMessage;
+                try {
+                    Base::fromCharacter(char(c));
+                } catch(std::exception& e) {
+                    expectedMessage = e.what();
+                }
+                string message;
+                try {
+                    (*p.first)(characters.data(), characters.data() + n, bases.data());
+                } catch(std::exception& e) {
+                    message = e.what();
+                }
+                CZI_ASSERT(!expectedMessage.empty());
+                CZI_ASSERT(message == expectedMessage);
+                characters[i] = savedCharacter;
+            }
+        }
+    }
+    cout << "decodeBases test passed. Using the " <<
+        decodeBasesImplementation() << " version on this CPU." << endl;
+}
@@ -0,0 +1,36 @@
+#ifndef CZI_SHASTA_DECODE_BASES_HPP
+#define CZI_SHASTA_DECODE_BASES_HPP
+
+#include "Base.hpp"
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+    // Convert the base characters in [begin, end) to Base values,
+    // appending them to a vector.
+    // Upper and lower case A, C, G, T are accepted.
+    // Any other character causes the same exception
+    // thrown by Base::fromCharacter.
+    // This converts 32 characters at a time using an AVX2
+    // lookup (PSHUFB) on the low 4 bits of each character,
+    // with validation of a whole chunk using a single movemask.
+    // The AVX2 version is selected at run time based on the capabilities
+    // of the CPU, with a scalar fallback.
+    void decodeBases(
+        const char* begin,
+        const char* end,
+        vector<Base>&);
+
+    // Return the name of the implementation used by
+    // decodeBases on this CPU.
+    const char* decodeBasesImplementation();
+
+    // Check all versions available on this CPU
+    // against Base::fromCharacter.
+    void testDecodeBases();
+
+    }
+}
+
+#endif
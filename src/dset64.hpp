@@ -2,6 +2,7 @@
 #define __DSET64_HPP
 
 #include <atomic>
+#include <cstdint>
 #include <stdexcept>
 
 /**
@@ -59,30 +60,41 @@
  */
 
 
-class DisjointSets {
+// The item id type Uint and the atomic type Aint are template arguments.
+// Aint must be twice as wide as Uint: it holds the parent
+// in its least significant half and the rank in its most significant half.
+// Two instantiations are provided:
+// - DisjointSets uses 64-bit item ids and 128-bit atomics (requires -mcx16).
+// - DisjointSets32 uses 32-bit item ids and 64-bit atomics,
+//   as in the original implementation by Wenzel Jakob.
+//   It uses half the memory, but can only be used for
+//   less than 2^32 items.
+template<class UintArgument, class AintArgument> class DisjointSetsTemplate {
 public:
 
     // Integer type used for the item ids.
     // This determines the maximum number of items that can be handled.
-    using Uint = uint64_t;
-    static_assert(sizeof(Uint) == 8, "Unexpected size of DisjointSets::Uint.");
+    using Uint = UintArgument;
 
     // Integer type used for synchronization primitives.
-    // This must have 128 bits and its atomic type must be lock-free
+    // Its atomic type must be lock-free
     // (this is checked in the constructor).
     // See the Compilation/Portability comment above.
-    using Aint = __uint128_t;
-    static_assert(sizeof(Aint) == 16, "Unexpected size of DisjointSets::Aint.");
+    using Aint = AintArgument;
+    static_assert(sizeof(Aint) == 2 * sizeof(Uint), "Unexpected size of DisjointSets::Aint.");
 
-    // We use the 128 bits of Aint to hold the parent in the
-    // 64 least significant bits and the rank in the most significant bits.
+    // Number of bits in Uint.
+    static const int shift = 8 * int(sizeof(Uint));
+
+    // We use the bits of Aint to hold the parent in the
+    // least significant half and the rank in the most significant half.
     // Define two masks for these two sets of bits.
-    static const Aint parentMask = Aint(~0ULL);
-    static const Aint rankMask = parentMask << 64;
+    static const Aint parentMask = Aint(Uint(~Uint(0)));
+    static const Aint rankMask = parentMask << shift;
 
     // For memory allocation flexibility, the memory is allocated
     // and owned by the caller.
-    DisjointSets(std::atomic<Aint>* mData, Uint size) : mData(mData), n(size) {
+    DisjointSetsTemplate(std::atomic<Aint>* mData, Uint size) : mData(mData), n(size) {
         if(!mData->is_lock_free()) {
             // If this happens with g++ on 64-bit x86 Linux, use
             // compile option -mcx16.
@@ -134,15 +146,15 @@ public:
                 std::swap(id1, id2);
             }
 
-            Aint oldEntry = ((Aint) r1 << 64) | id1;
-            Aint newEntry = ((Aint) r1 << 64) | id2;
+            Aint oldEntry = ((Aint) r1 << shift) | id1;
+            Aint newEntry = ((Aint) r1 << shift) | id2;
 
             if (!mData[id1].compare_exchange_strong(oldEntry, newEntry))
                 continue;
 
             if (r1 == r2) {
-                oldEntry = ((Aint) r2 << 64) | id2;
-                newEntry = ((Aint) (r2+1) << 64) | id2;
+                oldEntry = ((Aint) r2 << shift) | id2;
+                newEntry = ((Aint) (r2+1) << shift) | id2;
                 /* Try to update the rank (may fail, that's ok) */
                 mData[id2].compare_exchange_weak(oldEntry, newEntry);
             }
@@ -155,7 +167,7 @@ public:
     Uint size() const { return n; }
 
     Uint rank(Uint id) const {
-        return ((Uint) (mData[id] >> 64)) & parentMask;
+        return ((Uint) (mData[id] >> shift)) & parentMask;
     }
 
     Uint parent(Uint id) const {
@@ -168,4 +180,10 @@ public:
     Uint n;
 };
 
+using DisjointSets = DisjointSetsTemplate<uint64_t, __uint128_t>;
+using DisjointSets32 = DisjointSetsTemplate<uint32_t, uint64_t>;
+static_assert(sizeof(DisjointSets::Uint) == 8, "Unexpected size of DisjointSets::Uint.");
+static_assert(sizeof(DisjointSets::Aint) == 16, "Unexpected size of DisjointSets::Aint.");
+static_assert(sizeof(DisjointSets32::Aint) == 8, "Unexpected size of DisjointSets32::Aint.");
+
 #endif /* __DSET64_HPP */
@@ -1,5 +1,7 @@
 // shasta.
 #include "dset64Test.hpp"
+#include "DisjointSetsUnionBuffer.hpp"
+#include "MurmurHash2.hpp"
 #include "vector.hpp"
 using namespace ChanZuckerberg;
 using namespace shasta;
@@ -8,8 +10,10 @@ using namespace shasta;
 #include <boost/pending/disjoint_sets.hpp>
 
 // Standard libraries.
+#include "array.hpp"
 #include "chrono.hpp"
 #include "iostream.hpp"
+#include <limits>
 #include <random>
 
 
@@ -99,6 +103,30 @@ Dset64Test::Dset64Test(
 
 
 
+    // Now, do it using the 32-bit variant, sequentially.
+    if(n < (uint64_t(1) << 32)) {
+        vector< vector<uint64_t> > sortedComponents32;
+        using Aint = DisjointSets32::Aint;
+        vector< std::atomic<Aint> > data(n);
+        DisjointSets32 disjointSets(&data.front(), DisjointSets32::Uint(n));
+        const auto t0 = std::chrono::steady_clock::now();
+        for(const auto& p: edges) {
+            disjointSets.unite(DisjointSets32::Uint(p.first), DisjointSets32::Uint(p.second));
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        cout << "Sequential dset64 with 32-bit ids ran in " << seconds(t1-t0) << "s." << endl;
+
+        // Gather the components.
+        std::map<uint64_t, vector<uint64_t> > componentTable;
+        for(uint64_t i=0; i<n; i++) {
+            componentTable[disjointSets.find(DisjointSets32::Uint(i))].push_back(i);
+        }
+        getSortedComponents(componentTable, sortedComponents32);
+        CZI_ASSERT(sortedComponents32 == sortedComponentsBoost);
+    }
+
+
+
     // Now, do it using dset64.hpp, using the specified number of threads.
     vector< vector<uint64_t> > sortedComponentsParallel;
     {
@@ -107,7 +135,7 @@ Dset64Test::Dset64Test(
         DisjointSets disjointSets(&data.front(), n);
         disjointSetsPointer = &disjointSets;
         const auto t0 = std::chrono::steady_clock::now();
-        setupLoadBalancing(n, batchSize);
+        setupLoadBalancing(m, batchSize);
         runThreads(&Dset64Test::threadFunction, threadCount);
         const auto t1 = std::chrono::steady_clock::now();
         cout << "Parallel dset64 ran in " << seconds(t1-t0) << "s." << endl;
@@ -155,3 +183,136 @@ void Dset64Test::getSortedComponents(
     sort(sortedComponents.begin(), sortedComponents.end());
 }
 
+
+
+
+void ChanZuckerberg::shasta::dset64Benchmark(
+    uint64_t n,                 // The number of items (vertices).
+    uint64_t m,                 // The number of union operations (edges).
+    uint64_t threadCount,       // The number of threads to use.
+    uint64_t unionBufferSize,   // The DisjointSetsUnionBuffer capacity.
+    int seed,                   // The random seed.
+    bool checkResults           // Check that both methods give the same sets.
+    )
+{
+    Dset64Benchmark(n, m, threadCount, unionBufferSize, seed, checkResults);
+}
+
+
+
+Dset64Benchmark::Dset64Benchmark(
+    uint64_t n,
+    uint64_t m,
+    uint64_t threadCount,
+    uint64_t unionBufferSize,
+    int seed,
+    bool checkResults
+    ) :
+    MultithreadedObject(*this),
+    n(n),
+    m(m),
+    seed(uint64_t(seed))
+{
+    CZI_ASSERT(unionBufferSize > 0);
+    using Aint = DisjointSets::Aint;
+    vector< std::atomic<Aint> > data(n);
+    cout << "Disjoint sets data use " << double(n * sizeof(Aint)) / 1.e9 << " GB." << endl;
+
+    // Unbuffered union operations.
+    uint64_t hash0 = 0;
+    double t0;
+    {
+        DisjointSets disjointSets(&data.front(), n);
+        t0 = run(disjointSets, threadCount, 0);
+        if(checkResults) {
+            hash0 = hashSets(disjointSets, n);
+        }
+    }
+    cout << "Unbuffered: " << m << " unions in " << t0 << " s, ";
+    cout << double(m) / t0 << " unions per second." << endl;
+
+    // Buffered union operations.
+    // Constructing the DisjointSets again reinitializes the data.
+    uint64_t hash1 = 0;
+    double t1;
+    {
+        DisjointSets disjointSets(&data.front(), n);
+        t1 = run(disjointSets, threadCount, unionBufferSize);
+        if(checkResults) {
+            hash1 = hashSets(disjointSets, n);
+        }
+    }
+    cout << "Buffered with capacity " << unionBufferSize << ": " << m << " unions in " << t1 << " s, ";
+    cout << double(m) / t1 << " unions per second." << endl;
+    cout << "Speedup " << t0 / t1 << endl;
+
+    if(checkResults) {
+        CZI_ASSERT(hash0 == hash1);
+        cout << "No error found. Both methods found the same disjoint sets." << endl;
+    }
+}
+
+
+
+// Generate edge i from a hash of i and the seed.
+pair<uint64_t, uint64_t> Dset64Benchmark::getEdge(uint64_t i) const
+{
+    const array<uint64_t, 2> keys = {2 * i, 2 * i + 1};
+    return make_pair(
+        MurmurHash64A(&keys[0], sizeof(uint64_t), seed) % n,
+        MurmurHash64A(&keys[1], sizeof(uint64_t), seed) % n);
+}
+
+
+
+double Dset64Benchmark::run(
+    DisjointSets& disjointSets,
+    uint64_t threadCount,
+    uint64_t unionBufferSizeArgument)
+{
+    disjointSetsPointer = &disjointSets;
+    unionBufferSize = unionBufferSizeArgument;
+    const auto t0 = std::chrono::steady_clock::now();
+    const uint64_t batchSize = 1000000;
+    setupLoadBalancing(m, batchSize);
+    runThreads(&Dset64Benchmark::threadFunction, threadCount);
+    const auto t1 = std::chrono::steady_clock::now();
+    return seconds(t1 - t0);
+}
+
+
+
+void Dset64Benchmark::threadFunction(size_t threadId)
+{
+    DisjointSetsUnionBuffer<DisjointSets> unionBuffer(*disjointSetsPointer, n, unionBufferSize);
+    uint64_t begin;
+    uint64_t end;
+    while(getNextBatch(begin, end)) {
+        for(uint64_t i=begin; i!=end; ++i) {
+            const auto p = getEdge(i);
+            unionBuffer.unite(p.first, p.second);
+        }
+    }
+    unionBuffer.flush();
+}
+
+
+
+// Label each item with the smallest item in its set,
+// then combine the labels with a hash that does not depend
+// on the order of the items.
+uint64_t Dset64Benchmark::hashSets(DisjointSets& disjointSets, uint64_t n)
+{
+    const uint64_t invalid = std::numeric_limits<uint64_t>::max();
+    vector<uint64_t> smallestItem(n, invalid);
+    uint64_t hash = 0;
+    for(uint64_t i=0; i<n; i++) {
+        uint64_t& label = smallestItem[disjointSets.find(i)];
+        if(label == invalid) {
+            label = i;
+        }
+        const array<uint64_t, 2> key = {i, label};
+        hash += MurmurHash64A(&key[0], sizeof(key), 0);
+    }
+    return hash;
+}
@@ -1,7 +1,7 @@
 #ifndef CZI_SHASTA_DSET_64_TEST_HPP
 #define CZI_SHASTA_DSET_64_TEST_HPP
 
-// Unit test for dset64.hpp.
+// Unit test and benchmark for dset64.hpp.
 #include "dset64.hpp"
 #include "MultitreadedObject.hpp"
 #include <map>
@@ -16,6 +16,21 @@ namespace ChanZuckerberg {
             int seed                // The random seed.
             );
         class Dset64Test;
+
+        // Benchmark of union operations with and without
+        // DisjointSetsUnionBuffer. Unlike dset64Test,
+        // this can run with n and m of order 1e9, given enough memory
+        // (16 bytes per item, plus 8 bytes per item
+        // if checkResults is true).
+        void dset64Benchmark(
+            uint64_t n,                 // The number of items (vertices).
+            uint64_t m,                 // The number of union operations (edges).
+            uint64_t threadCount,       // The number of threads to use.
+            uint64_t unionBufferSize,   // The DisjointSetsUnionBuffer capacity.
+            int seed,                   // The random seed.
+            bool checkResults           // Check that both methods give the same sets.
+            );
+        class Dset64Benchmark;
     }
 }
 
@@ -45,4 +60,39 @@ private:
     void threadFunction(size_t threadId);
 };
 
+
+
+class ChanZuckerberg::shasta::Dset64Benchmark :
+    public MultithreadedObject<Dset64Benchmark> {
+public:
+
+    Dset64Benchmark(
+        uint64_t n,
+        uint64_t m,
+        uint64_t threadCount,
+        uint64_t unionBufferSize,
+        int seed,
+        bool checkResults
+        );
+
+private:
+    uint64_t n;
+    uint64_t m;
+    uint64_t seed;
+
+    // The union operations are not stored.
+    // Instead, edge i is generated from a hash of i and the seed.
+    pair<uint64_t, uint64_t> getEdge(uint64_t i) const;
+
+    // Run the union operations and return the elapsed time in seconds.
+    DisjointSets* disjointSetsPointer;
+    uint64_t unionBufferSize;
+    double run(DisjointSets&, uint64_t threadCount, uint64_t unionBufferSize);
+    void threadFunction(size_t threadId);
+
+    // Return a hash of the disjoint sets that does not depend
+    // on which item of each set is the root.
+    static uint64_t hashSets(DisjointSets&, uint64_t n);
+};
+
 #endif
@@ -22,11 +22,17 @@ using namespace ChanZuckerberg::shasta::filesystem;
 
 // Linux.
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
 
 // Standard library.
 #include "array.hpp"
+#include "vector.hpp"
 
 
 // Return true if the path exists.
@@ -219,6 +225,20 @@ size_t ChanZuckerberg::shasta::filesystem::fileSize(const string& path)
 
 
 
+// Find the last modification time of a file,
+// in nanoseconds since the epoch.
+uint64_t ChanZuckerberg::shasta::filesystem::modificationTime(const string& path)
+{
+    struct ::stat fileInformation;
+    if(::stat(path.c_str(), &fileInformation) != 0) {
+        throw runtime_error("Could not determine the modification time of file " + path);
+    }
+    return uint64_t(fileInformation.st_mtim.tv_sec) * 1000000000ULL +
+        uint64_t(fileInformation.st_mtim.tv_nsec);
+}
+
+
+
 // Find the absolute path.
 string ChanZuckerberg::shasta::filesystem::getAbsolutePath(const string& path)
 {
@@ -227,3 +247,64 @@ string ChanZuckerberg::shasta::filesystem::getAbsolutePath(const string& path)
     ::realpath(path.c_str(), buffer.data());
     return string(buffer.data());
 }
+
+
+
+// Create a hard link to an existing file.
+// Return false if this is not possible, for example
+// because the two paths are on different filesystems.
+bool ChanZuckerberg::shasta::filesystem::createHardLink(
+    const string& existingPath,
+    const string& newPath)
+{
+    return ::link(existingPath.c_str(), newPath.c_str()) == 0;
+}
+
+
+
+// Copy a file, as a reflink if the filesystem supports it.
+bool ChanZuckerberg::shasta::filesystem::copyFile(
+    const string& sourcePath,
+    const string& destinationPath)
+{
+    const int sourceFileDescriptor = ::open(sourcePath.c_str(), O_RDONLY);
+    if(sourceFileDescriptor == -1) {
+        throw runtime_error("Unable to open " + sourcePath + " for copy.");
+    }
+    const int destinationFileDescriptor = ::open(destinationPath.c_str(),
+        O_CREAT | O_TRUNC | O_WRONLY,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if(destinationFileDescriptor == -1) {
+        ::close(sourceFileDescriptor);
+        throw runtime_error("Unable to create " + destinationPath + " for copy.");
+    }
+
+    // Try a reflink first.
+    bool isReflink = false;
+#ifdef FICLONE
+    isReflink = (::ioctl(destinationFileDescriptor, FICLONE, sourceFileDescriptor) == 0);
+#endif
+
+    // If that did not work, copy the data.
+    if(!isReflink) {
+        vector<char> buffer(4 * 1024 * 1024);
+        while(true) {
+            const ssize_t readByteCount = ::read(sourceFileDescriptor, buffer.data(), buffer.size());
+            if(readByteCount == 0) {
+                break;
+            }
+            if(readByteCount < 0 ||
+                ::write(destinationFileDescriptor, buffer.data(), size_t(readByteCount)) != readByteCount) {
+                ::close(sourceFileDescriptor);
+                ::close(destinationFileDescriptor);
+                throw runtime_error("Error copying " + sourcePath + " to " + destinationPath);
+            }
+        }
+    }
+
+    ::close(sourceFileDescriptor);
+    if(::close(destinationFileDescriptor) != 0) {
+        throw runtime_error("Error copying " + sourcePath + " to " + destinationPath);
+    }
+    return isReflink;
+}
@@ -15,6 +15,7 @@ which is the version used in CentOs 7).
 
 *******************************************************************************/
 
+#include "cstdint.hpp"
 #include "string.hpp"
 #include "vector.hpp"
 
@@ -58,8 +59,23 @@ namespace ChanZuckerberg {
             // Find the size of a file.
             size_t fileSize(const string&);
 
+            // Find the last modification time of a file,
+            // in nanoseconds since the epoch.
+            uint64_t modificationTime(const string&);
+
             // Find the absolute path.
             string getAbsolutePath(const string& path);
+
+            // Create a hard link to an existing file.
+            // Return false if this is not possible, for example
+            // because the two paths are on different filesystems.
+            bool createHardLink(const string& existingPath, const string& newPath);
+
+            // Copy a file. Where the filesystem supports it (Linux only),
+            // the copy is a reflink which shares storage with the source
+            // until either of them is modified, and copyFile returns true.
+            // In case of failure, throw an exception.
+            bool copyFile(const string& sourcePath, const string& destinationPath);
         }
     }
 }
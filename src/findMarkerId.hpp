@@ -5,13 +5,18 @@
 #include "MemoryMappedVectorOfVectors.hpp"
 #include "ReadId.hpp"
 
+#include "algorithm.hpp"
+#include <atomic>
 #include "cstdint.hpp"
 #include "tuple.hpp"
 #include "utility.hpp"
+#include "vector.hpp"
 
 namespace ChanZuckerberg {
     namespace shasta {
 
+        class MarkerIdIndex;
+
         // Given a global marker id in the global marker table,
         // return the corresponding OrientedReadId and ordinal.
         // This requires a binary search in the markers toc.
@@ -35,4 +40,79 @@ inline std::pair<ChanZuckerberg::shasta::OrientedReadId, uint32_t>
 }
 
 
+
+
+// Sampled index used to speed up findMarkerId.
+// For every 2^shift global marker ids, it stores the OrientedReadId
+// that contains the marker with that id. The OrientedReadId
+// containing any marker id is then between two consecutive samples,
+// and the binary search in the markers toc is limited to those entries.
+// The shift is chosen so that the sampling interval is about the
+// average number of markers per oriented read, so the index uses
+// about 4 bytes per oriented read and the search usually
+// examines one or two toc entries.
+// After create, find can be called concurrently by multiple threads.
+class ChanZuckerberg::shasta::MarkerIdIndex {
+public:
+
+    void create(const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers)
+    {
+        const uint64_t orientedReadCount = markers.size();
+        const uint64_t markerCount = markers.totalSize();
+        const auto& toc = markers.getToc();
+
+        // Choose the sampling interval.
+        shift = 0;
+        while((2ULL << shift) * orientedReadCount <= markerCount) {
+            ++shift;
+        }
+
+        // Store the samples.
+        samples.clear();
+        uint64_t i = 0;
+        for(uint64_t markerId=0; markerId<markerCount; markerId+=(1ULL << shift)) {
+            while(toc[i+1] <= markerId) {
+                ++i;
+            }
+            samples.push_back(OrientedReadId::Int(i));
+        }
+        available.store(true, std::memory_order_release);
+    }
+
+    void clear()
+    {
+        available.store(false, std::memory_order_release);
+        samples.clear();
+        samples.shrink_to_fit();
+    }
+
+    bool isAvailable() const
+    {
+        return available.load(std::memory_order_acquire);
+    }
+
+    // Same as findMarkerId, using the index.
+    pair<OrientedReadId, uint32_t> find(
+        MarkerId markerId,
+        const MemoryMapped::VectorOfVectors<CompressedMarker, uint64_t>& markers) const
+    {
+        const uint64_t sample = markerId >> shift;
+        CZI_ASSERT(sample < samples.size());
+        const uint64_t iBegin = samples[sample];
+        const uint64_t iEnd = (sample + 1 < samples.size()) ?
+            samples[sample + 1] : (markers.size() - 1);
+        const uint64_t* toc = markers.getToc().begin();
+        const uint64_t* it = std::upper_bound(toc + iBegin, toc + iEnd + 1, markerId) - 1;
+        const uint64_t i = uint64_t(it - toc);
+        return make_pair(OrientedReadId(OrientedReadId::Int(i)), uint32_t(markerId - *it));
+    }
+
+private:
+    uint64_t shift = 0;
+    vector<OrientedReadId::Int> samples;
+    std::atomic<bool> available {false};
+};
+
+
+
 #endif
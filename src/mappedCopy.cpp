@@ -1,21 +1,33 @@
 
 // shasta.
 #include "mappedCopy.hpp"
+#include "filesystem.hpp"
 #include "timestamp.hpp"
 
 // Standard library.
 #include "algorithm.hpp"
+#include <atomic>
 #include <chrono>
 #include "iostream.hpp"
+#include <mutex>
 #include "stdexcept.hpp"
+#include <thread>
+#include "utility.hpp"
+#include "vector.hpp"
 
 // Linux.
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
 
 // This can be used to copy a file to the huge page filesystem.
 // The regular cp command does not work (but it works to copy
@@ -103,3 +115,216 @@ void ChanZuckerberg::shasta::mappedCopy(
     const double tTotal = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tBegin)).count());
     cout << timestamp << "Copied " << n << " bytes in " << tTotal << " s, " << double(n)/tTotal << " bytes/s." << endl;
 }
+
+
+
+// Fast copy of a file, used to save and restore runs.
+// See mappedCopy.hpp for details.
+size_t ChanZuckerberg::shasta::copyFile(
+    const string& inputPath,
+    const string& outputPath,
+    size_t threadCount)
+{
+    // Open the input file and get its size.
+    const int inputFileDescriptor = ::open(inputPath.c_str(), O_RDONLY);
+    if(inputFileDescriptor == -1) {
+        throw runtime_error("Error opening " + inputPath + ": " + strerror(errno));
+    }
+    struct ::stat inputInfo;
+    if(::fstat(inputFileDescriptor, &inputInfo) == -1) {
+        ::close(inputFileDescriptor);
+        throw runtime_error("Error during fstat for " + inputPath + ": " + strerror(errno));
+    }
+    const size_t n = size_t(inputInfo.st_size);
+
+    // Open the output file.
+    const int outputFileDescriptor = ::open(outputPath.c_str(),
+        O_CREAT | O_TRUNC | O_RDWR,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if(outputFileDescriptor == -1) {
+        ::close(inputFileDescriptor);
+        throw runtime_error("Error opening " + outputPath + ": " + strerror(errno));
+    }
+
+    // If the filesystem supports it, create a reflink.
+    // No data are copied.
+#ifdef FICLONE
+    if(::ioctl(outputFileDescriptor, FICLONE, inputFileDescriptor) == 0) {
+        ::close(inputFileDescriptor);
+        ::close(outputFileDescriptor);
+        return 0;
+    }
+#endif
+
+    // Set the size of the output file.
+    // Anything we don't write will be a hole.
+    if(::ftruncate(outputFileDescriptor, off_t(n)) == -1) {
+        ::close(inputFileDescriptor);
+        ::close(outputFileDescriptor);
+        throw runtime_error("Error setting file size for " + outputPath +
+            ". Must be a multiple of page size on the target filesystem.");
+    }
+
+    // Find the blocks to be copied. These are the regions of the input
+    // file that contain data, expanded to multiples of copyBlockAlignment,
+    // merged, then split into blocks of at most copyBlockSize.
+    // If the filesystem does not support SEEK_DATA/SEEK_HOLE,
+    // the entire file is treated as data.
+    vector< pair<size_t, size_t> > blocks;
+    size_t dataBegin = 0;
+    while(dataBegin < n) {
+        size_t dataEnd = n;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+        const off_t nextData = ::lseek(inputFileDescriptor, off_t(dataBegin), SEEK_DATA);
+        if(nextData == -1) {
+            if(errno == ENXIO) {
+                break;  // Only a hole from here to the end.
+            }
+        } else {
+            dataBegin = size_t(nextData);
+            const off_t nextHole = ::lseek(inputFileDescriptor, off_t(dataBegin), SEEK_HOLE);
+            if(nextHole != -1) {
+                dataEnd = size_t(nextHole);
+            }
+        }
+#endif
+        dataBegin = (dataBegin / copyBlockAlignment) * copyBlockAlignment;
+        dataEnd = min(n, ((dataEnd - 1) / copyBlockAlignment + 1) * copyBlockAlignment);
+        if(!blocks.empty() && blocks.back().second >= dataBegin) {
+            dataBegin = blocks.back().second;
+        }
+        for(size_t begin=dataBegin; begin<dataEnd; begin+=copyBlockSize) {
+            blocks.push_back(make_pair(begin, min(dataEnd, begin + copyBlockSize)));
+        }
+        dataBegin = dataEnd;
+    }
+
+    // Adjust the number of threads, if necessary.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    threadCount = max(size_t(1), min(threadCount, blocks.size()));
+
+    // Each thread copies one block at a time.
+    // It first tries copy_file_range, which copies in the kernel
+    // (or on the storage device) without going through user space.
+    // If the filesystems do not support it (this is the case for
+    // the huge page filesystem), all threads switch to a copy via memory mapping.
+    uint64_t nextBlock = 0;
+    std::atomic<bool> useMappedCopy(false);
+    size_t copiedByteCount = 0;
+    std::mutex mutex;
+    string errorMessage;
+    auto threadFunction = [&]()
+    {
+        while(true) {
+            const uint64_t blockId = __sync_fetch_and_add(&nextBlock, 1);
+            if(blockId >= blocks.size()) {
+                break;
+            }
+            size_t begin = blocks[blockId].first;
+            const size_t end = blocks[blockId].second;
+            __sync_fetch_and_add(&copiedByteCount, end - begin);
+
+#ifdef SYS_copy_file_range
+            while(begin < end && !useMappedCopy) {
+                loff_t inputOffset = loff_t(begin);
+                loff_t outputOffset = loff_t(begin);
+                const long c = ::syscall(SYS_copy_file_range,
+                    inputFileDescriptor, &inputOffset,
+                    outputFileDescriptor, &outputOffset,
+                    end - begin, 0);
+                if(c > 0) {
+                    begin += size_t(c);
+                } else if(c == -1 && errno == EINTR) {
+                    continue;
+                } else {
+                    useMappedCopy = true;
+                }
+            }
+#else
+            useMappedCopy = true;
+#endif
+            if(begin >= end) {
+                continue;
+            }
+
+            // Copy via memory mapping. The mapping must start
+            // at a multiple of the page size of the filesystem.
+            begin = (begin / copyBlockAlignment) * copyBlockAlignment;
+            const size_t length = end - begin;
+            void* inputPointer = ::mmap(0, length, PROT_READ, MAP_SHARED,
+                inputFileDescriptor, off_t(begin));
+            if(inputPointer == MAP_FAILED) {
+                std::lock_guard<std::mutex> lock(mutex);
+                errorMessage = "Error mapping " + inputPath + " to memory: " + strerror(errno);
+                break;
+            }
+            void* outputPointer = ::mmap(0, length, PROT_WRITE, MAP_SHARED,
+                outputFileDescriptor, off_t(begin));
+            if(outputPointer == MAP_FAILED) {
+                ::munmap(inputPointer, length);
+                std::lock_guard<std::mutex> lock(mutex);
+                errorMessage = "Error mapping " + outputPath + " to memory: " + strerror(errno);
+                break;
+            }
+#ifdef __linux__
+            ::madvise(inputPointer, length, MADV_SEQUENTIAL);
+#endif
+            const char* inputBegin = static_cast<const char*>(inputPointer);
+            copy(inputBegin, inputBegin + length, static_cast<char*>(outputPointer));
+            ::munmap(inputPointer, length);
+            ::munmap(outputPointer, length);
+        }
+    };
+    vector<std::thread> threads;
+    for(size_t i=0; i<threadCount; i++) {
+        threads.push_back(std::thread(threadFunction));
+    }
+    for(std::thread& thread: threads) {
+        thread.join();
+    }
+
+    ::close(inputFileDescriptor);
+    ::close(outputFileDescriptor);
+    if(!errorMessage.empty()) {
+        throw runtime_error(errorMessage);
+    }
+    return copiedByteCount;
+}
+
+
+
+// Use copyFile to copy all regular files in a directory
+// to another directory, which is created if it does not exist.
+void ChanZuckerberg::shasta::copyDirectory(
+    const string& inputDirectory,
+    const string& outputDirectory,
+    size_t threadCount)
+{
+    cout << timestamp << "Copying " << inputDirectory << " to " << outputDirectory << endl;
+    const auto tBegin = std::chrono::steady_clock::now();
+
+    if(!filesystem::exists(outputDirectory)) {
+        filesystem::createDirectory(outputDirectory);
+    }
+
+    size_t fileCount = 0;
+    size_t totalByteCount = 0;
+    size_t copiedByteCount = 0;
+    for(const string& inputPath: filesystem::directoryContents(inputDirectory)) {
+        if(!filesystem::isRegularFile(inputPath)) {
+            continue;
+        }
+        const string outputPath = outputDirectory + inputPath.substr(inputPath.rfind('/'));
+        totalByteCount += filesystem::fileSize(inputPath);
+        copiedByteCount += copyFile(inputPath, outputPath, threadCount);
+        ++fileCount;
+    }
+
+    const auto tEnd = std::chrono::steady_clock::now();
+    const double tTotal = 1.e-9 * double((std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tBegin)).count());
+    cout << timestamp << "Copied " << fileCount << " files totaling " << totalByteCount <<
+        " bytes in " << tTotal << " s. " <<
+        copiedByteCount << " bytes were copied, the rest were holes or shared via reflinks." << endl;
+}
@@ -12,6 +12,34 @@ namespace ChanZuckerberg {
         void mappedCopy(
             const string& inputPath,
             const string& outputPath);
+
+        // Fast copy of a file, used to save and restore runs.
+        // - If the filesystem supports it (e.g. btrfs, xfs),
+        //   the output file is a reflink that shares storage with the input.
+        // - Otherwise, the file is copied in large blocks using multiple threads,
+        //   using copy_file_range where possible, or memory mapping otherwise.
+        //   The latter is required for the huge page filesystem.
+        // - Holes in the input file are preserved in the output file,
+        //   at the granularity of copyBlockAlignment. This avoids
+        //   copying the unused capacity of MemoryMapped::Vector objects.
+        // The size of the input file must be a multiple of the page size
+        // of the target filesystem.
+        // Returns the number of bytes actually copied (excluding holes
+        // and reflinked data).
+        size_t copyFile(
+            const string& inputPath,
+            const string& outputPath,
+            size_t threadCount = 0);
+
+        // Use copyFile to copy all regular files in a directory
+        // to another directory, which is created if it does not exist.
+        void copyDirectory(
+            const string& inputDirectory,
+            const string& outputDirectory,
+            size_t threadCount = 0);
+
+        const size_t copyBlockAlignment = 2 * 1024 * 1024;
+        const size_t copyBlockSize = 64 * 1024 * 1024;
     }
 }
 
@@ -0,0 +1,584 @@
+#ifndef CZI_SHASTA_PARALLEL_ALGORITHMS_HPP
+#define CZI_SHASTA_PARALLEL_ALGORITHMS_HPP
+
+/*******************************************************************************
+
+Parallel versions of some standard algorithms, for use by stages
+that process large vectors serially or with ad hoc multithreading code.
+
+- parallelExclusiveScan: exclusive prefix sum.
+- parallelRadixSort: stable LSD radix sort on a fixed width integer key.
+- parallelStableSort: stable sort with a comparison function.
+- parallelMerge: stable merge of two sorted ranges.
+- parallelStablePartition: stable partition according to a predicate.
+
+All of them work on random access iterators, which includes
+pointers into MemoryMapped::Vector and MemoryMapped::VectorOfVectors.
+A threadCount of 0 uses std::thread::hardware_concurrency() threads.
+The number of threads is reduced for small inputs,
+and for very small inputs the standard library algorithm is used instead.
+The results do not depend on the number of threads.
+
+The threads are run using class ParallelRunner, which is
+a MultithreadedObject, so they come from its thread pool.
+Each algorithm creates its own ParallelRunner, but
+all the steps of an algorithm use the same pool.
+As with all MultithreadedObject threads, an exception
+in a thread terminates the program.
+
+*******************************************************************************/
+
+// Shasta.
+#include "CZI_ASSERT.hpp"
+#include "MultitreadedObject.hpp"
+#include "splitRange.hpp"
+
+// Standard library.
+#include "algorithm.hpp"
+#include "array.hpp"
+#include "cstddef.hpp"
+#include "cstdint.hpp"
+#include <functional>
+#include <iterator>
+#include <thread>
+#include "vector.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        class ParallelRunner;
+
+        template<class InputIterator, class OutputIterator, class T>
+            T parallelExclusiveScan(
+            InputIterator begin,
+            InputIterator end,
+            OutputIterator output,
+            T initialValue,
+            size_t threadCount = 0);
+
+        template<class Iterator, class KeyFunction>
+            void parallelRadixSort(
+            Iterator begin,
+            Iterator end,
+            const KeyFunction& key,
+            size_t keyBitCount = 64,
+            size_t threadCount = 0);
+
+        template<class Iterator, class Compare>
+            void parallelStableSort(
+            Iterator begin,
+            Iterator end,
+            const Compare& compare,
+            size_t threadCount = 0);
+
+        template<class InputIterator0, class InputIterator1, class OutputIterator, class Compare>
+            void parallelMerge(
+            InputIterator0 begin0,
+            InputIterator0 end0,
+            InputIterator1 begin1,
+            InputIterator1 end1,
+            OutputIterator output,
+            const Compare& compare,
+            size_t threadCount = 0);
+
+        template<class Iterator, class Predicate>
+            Iterator parallelStablePartition(
+            Iterator begin,
+            Iterator end,
+            const Predicate& predicate,
+            size_t threadCount = 0);
+
+        // Functions used by the above.
+        namespace parallelAlgorithms {
+            inline size_t adjustThreadCount(size_t threadCount, size_t n);
+            template<class InputIterator0, class InputIterator1, class OutputIterator, class Compare>
+                void merge(
+                ParallelRunner&,
+                size_t threadCount,
+                InputIterator0 begin0,
+                InputIterator0 end0,
+                InputIterator1 begin1,
+                InputIterator1 end1,
+                OutputIterator output,
+                const Compare& compare);
+            template<class InputIterator, class OutputIterator>
+                void copy(
+                ParallelRunner&,
+                size_t threadCount,
+                InputIterator begin,
+                InputIterator end,
+                OutputIterator output);
+
+            // Inputs shorter than this are processed
+            // using a single thread.
+            const size_t minimumItemsPerThread = 16 * 1024;
+        }
+    }
+}
+
+
+
+// Class used to run a function in each thread
+// of a MultithreadedObject thread pool.
+class ChanZuckerberg::shasta::ParallelRunner :
+    public MultithreadedObject<ParallelRunner> {
+public:
+    ParallelRunner() : MultithreadedObject<ParallelRunner>(*this) {}
+
+    // Call f(threadId) for each threadId in [0, threadCount).
+    void run(size_t threadCount, const std::function<void(size_t)>& f)
+    {
+        if(threadCount == 1) {
+            f(0);
+            return;
+        }
+        function = &f;
+        runThreads(&ParallelRunner::threadFunction, threadCount);
+        function = 0;
+    }
+
+    // Divide [0, n) in threadCount ranges using splitRange
+    // and call f(begin, end) for each of them in parallel.
+    void runOnRanges(size_t threadCount, size_t n, const std::function<void(size_t, size_t)>& f)
+    {
+        run(threadCount,
+            [&](size_t threadId)
+            {
+                const pair<size_t, size_t> r = splitRange(0, n, threadCount, threadId);
+                f(r.first, r.second);
+            });
+    }
+
+private:
+    const std::function<void(size_t)>* function = 0;
+    void threadFunction(size_t threadId)
+    {
+        (*function)(threadId);
+    }
+};
+
+
+
+// Return the number of threads to use to process n items.
+inline size_t ChanZuckerberg::shasta::parallelAlgorithms::adjustThreadCount(
+    size_t threadCount,
+    size_t n)
+{
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    return max(size_t(1), min(threadCount, n / minimumItemsPerThread));
+}
+
+
+
+// Exclusive prefix sum: store in output[i] the sum of initialValue
+// and input elements [0, i), and return the sum of initialValue
+// and all input elements.
+// The output can be the same as the input.
+// The sums are computed using type T
+// and converted to the output type when stored.
+// Each thread sums its range, then the ranges are scanned
+// again starting at the sum of the preceding ranges.
+template<class InputIterator, class OutputIterator, class T>
+    T ChanZuckerberg::shasta::parallelExclusiveScan(
+    InputIterator begin,
+    InputIterator end,
+    OutputIterator output,
+    T initialValue,
+    size_t threadCount)
+{
+    using OutputType = typename std::iterator_traits<OutputIterator>::value_type;
+    const size_t n = size_t(end - begin);
+    threadCount = parallelAlgorithms::adjustThreadCount(threadCount, n);
+    ParallelRunner runner;
+
+    // Sum each range.
+    vector<T> rangeBegins(threadCount + 1, T(0));
+    runner.run(threadCount,
+        [&](size_t threadId)
+        {
+            const pair<size_t, size_t> r = splitRange(0, n, threadCount, threadId);
+            T sum = T(0);
+            for(size_t i=r.first; i!=r.second; i++) {
+                sum += T(begin[i]);
+            }
+            rangeBegins[threadId + 1] = sum;
+        });
+
+    // Compute the sum of the preceding ranges.
+    rangeBegins[0] = initialValue;
+    for(size_t threadId=0; threadId<threadCount; threadId++) {
+        rangeBegins[threadId + 1] += rangeBegins[threadId];
+    }
+
+    // Scan each range.
+    runner.run(threadCount,
+        [&](size_t threadId)
+        {
+            const pair<size_t, size_t> r = splitRange(0, n, threadCount, threadId);
+            T sum = rangeBegins[threadId];
+            for(size_t i=r.first; i!=r.second; i++) {
+                const T value = T(begin[i]);
+                output[i] = OutputType(sum);
+                sum += value;
+            }
+        });
+
+    return rangeBegins[threadCount];
+}
+
+
+
+// Stable LSD radix sort by key(x), which must return an unsigned integer
+// (at most 64 bits) using only the low keyBitCount bits.
+// Each pass sorts by 8 bits of the key:
+// - Each thread computes the histogram of the digits in its range.
+// - The histograms give the position in the output of the
+//   first element of each thread with each digit.
+// - Each thread scatters its range to those positions.
+// Passes in which all elements have the same digit are skipped.
+// Uses a temporary buffer of the same size as the input.
+template<class Iterator, class KeyFunction>
+    void ChanZuckerberg::shasta::parallelRadixSort(
+    Iterator begin,
+    Iterator end,
+    const KeyFunction& key,
+    size_t keyBitCount,
+    size_t threadCount)
+{
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    CZI_ASSERT(keyBitCount <= 64);
+    const size_t n = size_t(end - begin);
+    threadCount = parallelAlgorithms::adjustThreadCount(threadCount, n);
+    if(n < parallelAlgorithms::minimumItemsPerThread) {
+        std::stable_sort(begin, end,
+            [&key](const T& x, const T& y)
+            {
+                return key(x) < key(y);
+            });
+        return;
+    }
+    ParallelRunner runner;
+    vector<T> buffer(n);
+
+    // The digit counts for each thread, later turned into positions.
+    const size_t digitCount = 256;
+    vector< array<uint64_t, digitCount> > counts(threadCount);
+
+    // The data are alternatively in the input range or in the buffer.
+    bool dataIsInBuffer = false;
+    const size_t passCount = (keyBitCount + 7) / 8;
+    for(size_t pass=0; pass<passCount; pass++) {
+        const size_t shift = 8 * pass;
+
+        // Digit histogram for each thread.
+        runner.run(threadCount,
+            [&](size_t threadId)
+            {
+                const pair<size_t, size_t> r = splitRange(0, n, threadCount, threadId);
+                array<uint64_t, digitCount>& c = counts[threadId];
+                fill(c.begin(), c.end(), 0);
+                for(size_t i=r.first; i!=r.second; i++) {
+                    const T& x = dataIsInBuffer ? buffer[i] : begin[i];
+                    ++c[(uint64_t(key(x)) >> shift) & 0xff];
+                }
+            });
+
+        // If all elements have the same digit, this pass does nothing.
+        bool skipPass = false;
+        for(size_t digit=0; digit<digitCount; digit++) {
+            uint64_t total = 0;
+            for(size_t threadId=0; threadId<threadCount; threadId++) {
+                total += counts[threadId][digit];
+            }
+            if(total == n) {
+                skipPass = true;
+            }
+            if(total != 0) {
+                break;
+            }
+        }
+        if(skipPass) {
+            continue;
+        }
+
+        // Turn the counts into positions.
+        uint64_t position = 0;
+        for(size_t digit=0; digit<digitCount; digit++) {
+            for(size_t threadId=0; threadId<threadCount; threadId++) {
+                const uint64_t count = counts[threadId][digit];
+                counts[threadId][digit] = position;
+                position += count;
+            }
+        }
+        CZI_ASSERT(position == n);
+
+        // Scatter.
+        runner.run(threadCount,
+            [&](size_t threadId)
+            {
+                const pair<size_t, size_t> r = splitRange(0, n, threadCount, threadId);
+                array<uint64_t, digitCount>& p = counts[threadId];
+                for(size_t i=r.first; i!=r.second; i++) {
+                    if(dataIsInBuffer) {
+                        T& x = buffer[i];
+                        begin[p[(uint64_t(key(x)) >> shift) & 0xff]++] = std::move(x);
+                    } else {
+                        T& x = begin[i];
+                        buffer[p[(uint64_t(key(x)) >> shift) & 0xff]++] = std::move(x);
+                    }
+                }
+            });
+        dataIsInBuffer = !dataIsInBuffer;
+    }
+
+    // Copy the result back to the input range, if necessary.
+    if(dataIsInBuffer) {
+        parallelAlgorithms::copy(runner, threadCount, buffer.begin(), buffer.end(), begin);
+    }
+}
+
+
+
+// Stable sort. Each thread sorts its range using std::stable_sort,
+// then pairs of adjacent sorted runs are merged until only one is left.
+// Each merge uses all threads (see parallelMerge).
+// Uses a temporary buffer of the same size as the input.
+template<class Iterator, class Compare>
+    void ChanZuckerberg::shasta::parallelStableSort(
+    Iterator begin,
+    Iterator end,
+    const Compare& compare,
+    size_t threadCount)
+{
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    const size_t n = size_t(end - begin);
+    threadCount = parallelAlgorithms::adjustThreadCount(threadCount, n);
+    if(threadCount == 1) {
+        std::stable_sort(begin, end, compare);
+        return;
+    }
+    ParallelRunner runner;
+
+    // Sort the range of each thread.
+    // The runs are [runBegins[i], runBegins[i+1]).
+    vector<size_t> runBegins(threadCount + 1);
+    for(size_t threadId=0; threadId<threadCount; threadId++) {
+        runBegins[threadId] = splitRange(0, n, threadCount, threadId).first;
+    }
+    runBegins[threadCount] = n;
+    runner.run(threadCount,
+        [&](size_t threadId)
+        {
+            std::stable_sort(begin + runBegins[threadId], begin + runBegins[threadId + 1], compare);
+        });
+
+    // Merge pairs of adjacent runs, alternating between
+    // the input range and the buffer.
+    vector<T> buffer(n);
+    bool dataIsInBuffer = false;
+    vector<size_t> newRunBegins;
+    while(runBegins.size() > 2) {
+        newRunBegins.clear();
+        const size_t runCount = runBegins.size() - 1;
+        for(size_t i=0; i<runCount; i+=2) {
+            const size_t b0 = runBegins[i];
+            const size_t e0 = runBegins[i + 1];
+            const size_t e1 = (i + 1 < runCount) ? runBegins[i + 2] : e0;
+            newRunBegins.push_back(b0);
+            if(dataIsInBuffer) {
+                parallelAlgorithms::merge(runner, threadCount,
+                    buffer.begin() + b0, buffer.begin() + e0,
+                    buffer.begin() + e0, buffer.begin() + e1,
+                    begin + b0, compare);
+            } else {
+                parallelAlgorithms::merge(runner, threadCount,
+                    std::make_move_iterator(begin + b0), std::make_move_iterator(begin + e0),
+                    std::make_move_iterator(begin + e0), std::make_move_iterator(begin + e1),
+                    buffer.begin() + b0, compare);
+            }
+        }
+        newRunBegins.push_back(n);
+        runBegins.swap(newRunBegins);
+        dataIsInBuffer = !dataIsInBuffer;
+    }
+
+    // Copy the result back to the input range, if necessary.
+    if(dataIsInBuffer) {
+        parallelAlgorithms::copy(runner, threadCount, buffer.begin(), buffer.end(), begin);
+    }
+}
+
+
+
+// Stable merge: for equal elements, the ones
+// from the first range come first, as for std::merge.
+template<class InputIterator0, class InputIterator1, class OutputIterator, class Compare>
+    void ChanZuckerberg::shasta::parallelMerge(
+    InputIterator0 begin0,
+    InputIterator0 end0,
+    InputIterator1 begin1,
+    InputIterator1 end1,
+    OutputIterator output,
+    const Compare& compare,
+    size_t threadCount)
+{
+    const size_t n = size_t(end0 - begin0) + size_t(end1 - begin1);
+    threadCount = parallelAlgorithms::adjustThreadCount(threadCount, n);
+    ParallelRunner runner;
+    parallelAlgorithms::merge(runner, threadCount, begin0, end0, begin1, end1, output, compare);
+}
+
+
+
+// The output is divided in threadCount ranges.
+// For the beginning of each range, a binary search finds
+// how many of the preceding output elements come from each input range.
+// Each thread then merges its part with std::merge.
+template<class InputIterator0, class InputIterator1, class OutputIterator, class Compare>
+    void ChanZuckerberg::shasta::parallelAlgorithms::merge(
+    ParallelRunner& runner,
+    size_t threadCount,
+    InputIterator0 begin0,
+    InputIterator0 end0,
+    InputIterator1 begin1,
+    InputIterator1 end1,
+    OutputIterator output,
+    const Compare& compare)
+{
+    const size_t n0 = size_t(end0 - begin0);
+    const size_t n1 = size_t(end1 - begin1);
+    const size_t n = n0 + n1;
+    threadCount = min(threadCount, max(size_t(1), n / minimumItemsPerThread));
+    if(threadCount == 1) {
+        std::merge(begin0, end0, begin1, end1, output, compare);
+        return;
+    }
+
+    // Return the number of elements of the first range
+    // among the first k elements of the output.
+    // An element of the first range goes before
+    // an element of the second range unless the latter is less.
+    auto split = [&](size_t k)
+    {
+        size_t low = (k > n1) ? k - n1 : 0;
+        size_t high = min(k, n0);
+        while(low < high) {
+            const size_t middle = (low + high) / 2;
+            if(compare(begin1[k - middle - 1], begin0[middle])) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        return low;
+    };
+
+    runner.run(threadCount,
+        [&](size_t threadId)
+        {
+            const pair<size_t, size_t> r = splitRange(0, n, threadCount, threadId);
+            const size_t i0 = split(r.first);
+            const size_t j0 = split(r.second);
+            std::merge(
+                begin0 + i0, begin0 + j0,
+                begin1 + (r.first - i0), begin1 + (r.second - j0),
+                output + r.first, compare);
+        });
+}
+
+
+
+template<class InputIterator, class OutputIterator>
+    void ChanZuckerberg::shasta::parallelAlgorithms::copy(
+    ParallelRunner& runner,
+    size_t threadCount,
+    InputIterator begin,
+    InputIterator end,
+    OutputIterator output)
+{
+    runner.runOnRanges(threadCount, size_t(end - begin),
+        [&](size_t rangeBegin, size_t rangeEnd)
+        {
+            std::move(begin + rangeBegin, begin + rangeEnd, output + rangeBegin);
+        });
+}
+
+
+
+// Stable partition: move the elements for which the predicate
+// is true before the others, preserving their relative order,
+// and return an iterator to the first element for which the predicate is false.
+// The predicate is called twice for each element,
+// so it must always return the same value for a given element.
+// Uses a temporary buffer of the same size as the input.
+template<class Iterator, class Predicate>
+    Iterator ChanZuckerberg::shasta::parallelStablePartition(
+    Iterator begin,
+    Iterator end,
+    const Predicate& predicate,
+    size_t threadCount)
+{
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    const size_t n = size_t(end - begin);
+    threadCount = parallelAlgorithms::adjustThreadCount(threadCount, n);
+    if(threadCount == 1) {
+        return std::stable_partition(begin, end, predicate);
+    }
+    ParallelRunner runner;
+
+    // Count the elements for which the predicate is true in each range.
+    vector<size_t> trueCounts(threadCount);
+    runner.run(threadCount,
+        [&](size_t threadId)
+        {
+            const pair<size_t, size_t> r = splitRange(0, n, threadCount, threadId);
+            size_t count = 0;
+            for(size_t i=r.first; i!=r.second; i++) {
+                if(predicate(begin[i])) {
+                    ++count;
+                }
+            }
+            trueCounts[threadId] = count;
+        });
+
+    // Find where each thread stores its true and false elements.
+    vector<size_t> trueBegins(threadCount);
+    vector<size_t> falseBegins(threadCount);
+    size_t trueCount = 0;
+    for(size_t threadId=0; threadId<threadCount; threadId++) {
+        trueBegins[threadId] = trueCount;
+        trueCount += trueCounts[threadId];
+    }
+    size_t falseCount = trueCount;
+    for(size_t threadId=0; threadId<threadCount; threadId++) {
+        falseBegins[threadId] = falseCount;
+        const pair<size_t, size_t> r = splitRange(0, n, threadCount, threadId);
+        falseCount += (r.second - r.first) - trueCounts[threadId];
+    }
+    CZI_ASSERT(falseCount == n);
+
+    // Scatter to the buffer, then copy back.
+    vector<T> buffer(n);
+    runner.run(threadCount,
+        [&](size_t threadId)
+        {
+            const pair<size_t, size_t> r = splitRange(0, n, threadCount, threadId);
+            size_t truePosition = trueBegins[threadId];
+            size_t falsePosition = falseBegins[threadId];
+            for(size_t i=r.first; i!=r.second; i++) {
+                T& x = begin[i];
+                if(predicate(x)) {
+                    buffer[truePosition++] = std::move(x);
+                } else {
+                    buffer[falsePosition++] = std::move(x);
+                }
+            }
+        });
+    parallelAlgorithms::copy(runner, threadCount, buffer.begin(), buffer.end(), begin);
+
+    return begin + trueCount;
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef CZI_SHASTA_PERMUTE_MEMORY_MAPPED_HPP
+#define CZI_SHASTA_PERMUTE_MEMORY_MAPPED_HPP
+
+// Functions used to renumber the elements of memory mapped data structures
+// (see AssemblerReadRenumbering.cpp and AssemblerMarkerGraphRenumbering.cpp).
+// Because some of them can be accessed read-only (for example when resuming
+// an assembly), each of them is copied to a temporary, removed,
+// and recreated with the same name.
+
+// Shasta.
+#include "CZI_ASSERT.hpp"
+#include "MemoryMappedVectorOfVectors.hpp"
+#include "parallelAlgorithms.hpp"
+
+// Standard library.
+#include "algorithm.hpp"
+#include "cstdint.hpp"
+#include "string.hpp"
+
+namespace ChanZuckerberg {
+    namespace shasta {
+
+        // Copy the vectors of a VectorOfVectors to another,
+        // which must be empty. If oldIndex is not null,
+        // vector i of the copy is vector oldIndex[i] of the source.
+        template<class T, class Int> void copyVectors(
+            const MemoryMapped::VectorOfVectors<T, Int>& source,
+            const uint64_t* oldIndex,
+            MemoryMapped::VectorOfVectors<T, Int>& target,
+            size_t threadCount)
+        {
+            const uint64_t n = source.size();
+            target.beginPass1(Int(n));
+            for(uint64_t i=0; i<n; i++) {
+                const uint64_t j = oldIndex ? oldIndex[i] : i;
+                CZI_ASSERT(j < n);
+                target.incrementCount(Int(i), Int(source.size(Int(j))));
+            }
+            target.beginPass2();
+            target.endPass2(false);
+
+            ParallelRunner runner;
+            runner.runOnRanges(parallelAlgorithms::adjustThreadCount(threadCount, n), n,
+                [&](size_t begin, size_t end)
+                {
+                    for(uint64_t i=begin; i!=end; i++) {
+                        const uint64_t j = oldIndex ? oldIndex[i] : i;
+                        std::copy(source.begin(Int(j)), source.end(Int(j)), target.begin(Int(i)));
+                    }
+                });
+        }
+
+        // Permute the vectors of a VectorOfVectors, recreating it with the given name.
+        // Vector i becomes vector oldIndex[i] of the original.
+        template<class T, class Int> void permuteVectors(
+            MemoryMapped::VectorOfVectors<T, Int>& v,
+            const uint64_t* oldIndex,
+            const string& name,
+            const string& temporaryName,
+            size_t pageSize,
+            size_t threadCount)
+        {
+            MemoryMapped::VectorOfVectors<T, Int> permuted;
+            permuted.createNew(temporaryName, pageSize);
+            copyVectors(v, oldIndex, permuted, threadCount);
+            v.remove();
+            v.createNew(name, pageSize);
+            copyVectors(permuted, 0, v, threadCount);
+            permuted.remove();
+        }
+
+        // Move the contents of a Vector to a temporary
+        // and recreate it with the given name and the same size,
+        // so the caller can rewrite it using the temporary.
+        template<class T> void recreateVector(
+            MemoryMapped::Vector<T>& v,
+            MemoryMapped::Vector<T>& previous,
+            const string& name,
+            const string& temporaryName,
+            size_t pageSize)
+        {
+            previous.createNew(temporaryName, pageSize, v.size());
+            std::copy(v.begin(), v.end(), previous.begin());
+            v.remove();
+            v.createNew(name, pageSize, previous.size());
+        }
+
+    }
+}
+
+#endif
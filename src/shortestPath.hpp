@@ -34,12 +34,20 @@ namespace ChanZuckerberg {
     namespace shasta {
 
         // The last argument to findShortestPath is a work area with this type.
-        template<class Graph> using FindShortestPathQueue  =
-            std::priority_queue<
+        // The capacity of the underlying vector is kept when the queue is emptied,
+        // so reusing the queue avoids memory allocation.
+        template<class Graph> class FindShortestPathQueue  :
+            public std::priority_queue<
                 pair< uint64_t, typename Graph::vertex_descriptor>,
                 vector< pair< uint64_t, typename Graph::vertex_descriptor> >,
                 OrderPairsByFirstOnlyGreater< uint64_t, typename Graph::vertex_descriptor>
-            >;
+            > {
+        public:
+            size_t capacity() const
+            {
+                return this->c.capacity();
+            }
+        };
 
         template<class Graph> void findShortestPath(
             Graph&,
@@ -4,6 +4,11 @@
 using namespace ChanZuckerberg;
 using namespace shasta;
 
+// Standard library.
+#include "algorithm.hpp"
+#include <thread>
+#include "vector.hpp"
+
 // Touch a range of memory in order to cause the
 // supporting pages of virtual memory to be loaded in real memory.
 // The return value can be ignored.
@@ -21,3 +26,56 @@ size_t ChanZuckerberg::shasta::touchMemory(
     return sum;
 }
 
+
+
+size_t ChanZuckerberg::shasta::touchMemoryMultithreaded(
+    const void* begin,
+    const void* end,
+    size_t threadCount,
+    size_t pageSize)
+{
+    const char* cBegin = static_cast<const char*>(begin);
+    const char* cEnd = static_cast<const char*>(end);
+    if(cEnd <= cBegin) {
+        return 0;
+    }
+
+    // Adjust the number of threads, if necessary.
+    // Don't use more threads than pages.
+    if(threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    const size_t pageCount = (size_t(cEnd - cBegin) - 1) / pageSize + 1;
+    threadCount = max(size_t(1), min(threadCount, pageCount));
+    if(threadCount == 1) {
+        return touchMemory(begin, end, pageSize);
+    }
+
+    // Each thread touches a contiguous range of pages.
+    const size_t pagesPerThread = (pageCount - 1) / threadCount + 1;
+    vector<size_t> sums(threadCount, 0);
+    vector<std::thread> threads;
+    for(size_t i=0; i<threadCount; i++) {
+        const char* threadBegin = cBegin + min(pageCount, i * pagesPerThread) * pageSize;
+        const char* threadEnd = cBegin + min(pageCount, (i + 1) * pagesPerThread) * pageSize;
+        threadEnd = min(threadEnd, cEnd);
+        if(threadBegin >= threadEnd) {
+            break;
+        }
+        size_t& sum = sums[i];
+        threads.push_back(std::thread(
+            [threadBegin, threadEnd, pageSize, &sum]()
+            {
+                sum = touchMemory(threadBegin, threadEnd, pageSize);
+            }));
+    }
+    for(std::thread& thread: threads) {
+        thread.join();
+    }
+
+    size_t sum = 0;
+    for(const size_t threadSum: sums) {
+        sum += threadSum;
+    }
+    return sum;
+}
@@ -10,6 +10,14 @@ namespace ChanZuckerberg {
         // supporting pages of virtual memory to be loaded in real memory.
         // The return value can be ignored.
         size_t touchMemory(const void* begin, const void* end, size_t pageSize=4096);
+
+        // Same, using multiple threads, each touching a contiguous range.
+        // If threadCount is 0, the number of hardware threads is used.
+        size_t touchMemoryMultithreaded(
+            const void* begin,
+            const void* end,
+            size_t threadCount=0,
+            size_t pageSize=4096);
     }
 }
 